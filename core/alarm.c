@@ -70,6 +70,10 @@ void uwsgi_alarm_func_mule(struct uwsgi_alarm_instance *uai, char *msg, size_t l
 	// skip if mules are not available
 	if (uwsgi.mules_cnt == 0)
 		return;
+	if (uwsgi.mule_ring) {
+		uwsgi_mule_ring_push(uai->data32, NULL, msg, len);
+		return;
+	}
 	int fd = uwsgi.shared->mule_queue_pipe[0];
 	if (uai->data32 > 0) {
 		int mule_id = uai->data32 - 1;
@@ -161,6 +165,188 @@ static struct uwsgi_alarm_instance *uwsgi_alarm_get_instance(char *name) {
 
 
 #ifdef UWSGI_PCRE
+/*
+	get the longest literal that has to be part of every match of the regexp, it is used
+	as a cheap prefilter before running pcre. Alternations, special groups and escapes we
+	do not know about disable the prefilter.
+*/
+static char *alarm_regexp_literal(char *re, size_t *literal_len) {
+	size_t len = strlen(re);
+	if (strchr(re, '|') || strstr(re, "(?") || strstr(re, "(*")) return NULL;
+
+	char *run = uwsgi_malloc(len + 1);
+	char *best = uwsgi_malloc(len + 1);
+	size_t run_len = 0;
+	size_t best_len = 0;
+	size_t i = 0;
+
+	while (i < len) {
+		char c = re[i];
+		int literal = 1;
+		if (c == '\\') {
+			if (i + 1 >= len) goto unknown;
+			c = re[i + 1];
+			i += 2;
+			if (isalnum((int) c)) {
+				// only the single-char classes and assertions are known
+				if (!strchr("dDsSwWbBAZz", c)) goto unknown;
+				literal = 0;
+			}
+		}
+		else if (c == '[') {
+			i++;
+			if (i < len && re[i] == '^') i++;
+			if (i < len && re[i] == ']') i++;
+			while (i < len && re[i] != ']') {
+				if (re[i] == '\\') i++;
+				i++;
+			}
+			i++;
+			literal = 0;
+		}
+		else if (c == '(') {
+			int depth = 0;
+			while (i < len) {
+				if (re[i] == '\\') {
+					i += 2;
+					continue;
+				}
+				if (re[i] == '[') {
+					i++;
+					if (i < len && re[i] == ']') i++;
+					while (i < len && re[i] != ']') {
+						if (re[i] == '\\') i++;
+						i++;
+					}
+				}
+				else if (re[i] == '(') {
+					depth++;
+				}
+				else if (re[i] == ')') {
+					if (--depth == 0) break;
+				}
+				i++;
+			}
+			i++;
+			literal = 0;
+		}
+		else if (c == '?' || c == '*' || c == '+' || c == '{') {
+			// the previous atom is optional (or repeated), it cannot be part of the literal
+			if (run_len) run_len--;
+			if (c == '{') {
+				while (i < len && re[i] != '}') i++;
+			}
+			i++;
+			// lazy and possessive quantifiers
+			if (i < len && (re[i] == '?' || re[i] == '+')) i++;
+			literal = 0;
+		}
+		else if (c == '.' || c == '^' || c == '$' || c == ')') {
+			i++;
+			literal = 0;
+		}
+		else {
+			i++;
+		}
+
+		if (literal) {
+			// a following quantifier will remove it
+			run[run_len++] = c;
+			continue;
+		}
+		if (run_len > best_len) {
+			memcpy(best, run, run_len);
+			best_len = run_len;
+		}
+		run_len = 0;
+	}
+
+	if (run_len > best_len) {
+		memcpy(best, run, run_len);
+		best_len = run_len;
+	}
+	free(run);
+	// too short literals are not worth it
+	if (best_len < 3) {
+		free(best);
+		return NULL;
+	}
+	*literal_len = best_len;
+	return best;
+
+unknown:
+	free(run);
+	free(best);
+	return NULL;
+}
+
+static int alarm_has_literal(char *msg, size_t len, char *literal, size_t literal_len) {
+	char *end = msg + len;
+	while ((size_t) (end - msg) >= literal_len) {
+		char *ptr = memchr(msg, literal[0], (end - msg) - literal_len + 1);
+		if (!ptr) return 0;
+		if (!memcmp(ptr, literal, literal_len)) return 1;
+		msg = ptr + 1;
+	}
+	return 0;
+}
+
+// regexps with backreferences or special groups cannot be safely merged in a single alternation
+static int alarm_regexp_combinable(char *re) {
+	if (strstr(re, "(?") || strstr(re, "(*")) return 0;
+	char *ptr = strchr(re, '\\');
+	while (ptr) {
+		char c = ptr[1];
+		if (!c) return 0;
+		if (isdigit((int) c) || c == 'g' || c == 'k') return 0;
+		ptr = strchr(ptr + 2, '\\');
+	}
+	return 1;
+}
+
+/*
+	when no log-alarm regexp matches (the common case) a single pcre run
+	on the combined alternation is enough to skip the whole list
+*/
+static void uwsgi_alarm_log_combine(struct uwsgi_string_list *regexps) {
+	struct uwsgi_alarm_log *ual = uwsgi.alarm_logs;
+	struct uwsgi_string_list *usl = regexps;
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(uwsgi.page_size);
+	int n = 0;
+	while (ual && usl) {
+		if (alarm_regexp_combinable(usl->value)) {
+			if (n > 0 && uwsgi_buffer_append(ub, "|", 1)) goto end;
+			if (uwsgi_buffer_append(ub, "(?:", 3)) goto end;
+			if (uwsgi_buffer_append(ub, usl->value, strlen(usl->value))) goto end;
+			if (uwsgi_buffer_append(ub, ")", 1)) goto end;
+			n++;
+		}
+		ual = ual->next;
+		usl = usl->next;
+	}
+	// nothing to gain
+	if (n < 2) goto end;
+	if (uwsgi_buffer_append(ub, "\0", 1)) goto end;
+
+	struct uwsgi_alarm_log *combined = uwsgi_calloc(sizeof(struct uwsgi_alarm_log));
+	if (uwsgi_regexp_build(ub->buf, &combined->pattern, &combined->pattern_extra)) {
+		uwsgi_log("unable to combine log-alarm regexps, they will be checked one by one\n");
+		free(combined);
+		goto end;
+	}
+	uwsgi.alarm_logs_combined = combined;
+
+	ual = uwsgi.alarm_logs;
+	usl = regexps;
+	while (ual && usl) {
+		ual->combined = alarm_regexp_combinable(usl->value);
+		ual = ual->next;
+		usl = usl->next;
+	}
+end:
+	uwsgi_buffer_destroy(ub);
+}
+
 static int uwsgi_alarm_log_add(char *alarms, char *regexp, int negate) {
 
 	struct uwsgi_alarm_log *old_ual = NULL, *ual = uwsgi.alarm_logs;
@@ -175,6 +361,7 @@ static int uwsgi_alarm_log_add(char *alarms, char *regexp, int negate) {
 		return -1;
 	}
 	ual->negate = negate;
+	ual->literal = alarm_regexp_literal(regexp, &ual->literal_len);
 
 	if (old_ual) {
 		old_ual->next = ual;
@@ -333,6 +520,7 @@ void uwsgi_alarms_init() {
 
 #ifdef UWSGI_PCRE
 	// then map log-alarm
+	struct uwsgi_string_list *regexps = NULL;
 	usl = uwsgi.alarm_logs_list;
 	while (usl) {
 		char *line = uwsgi_str(usl->value);
@@ -348,9 +536,11 @@ void uwsgi_alarms_init() {
 			uwsgi_log("invalid log-alarm: %s\n", usl->value);
 			exit(1);
 		}
+		uwsgi_string_new_list(&regexps, regexp);
 
 		usl = usl->next;
 	}
+	uwsgi_alarm_log_combine(regexps);
 #endif
 }
 
@@ -382,8 +572,14 @@ void uwsgi_alarm_trigger_uai(struct uwsgi_alarm_instance *uai, char *msg, size_t
 void uwsgi_alarm_log_check(char *msg, size_t len) {
 	if (!uwsgi_strncmp(msg, len, "[uwsgi-alarm", 12))
 		return;
+	int combined_match = 1;
+	if (uwsgi.alarm_logs_combined) {
+		combined_match = uwsgi_regexp_match(uwsgi.alarm_logs_combined->pattern, uwsgi.alarm_logs_combined->pattern_extra, msg, len) >= 0;
+	}
 	struct uwsgi_alarm_log *ual = uwsgi.alarm_logs;
 	while (ual) {
+		if (ual->combined && !combined_match) goto next;
+		if (ual->literal && !alarm_has_literal(msg, len, ual->literal, ual->literal_len)) goto next;
 		if (uwsgi_regexp_match(ual->pattern, ual->pattern_extra, msg, len) >= 0) {
 			if (!ual->negate) {
 				struct uwsgi_alarm_ll *uall = ual->alarms;
@@ -399,6 +595,7 @@ void uwsgi_alarm_log_check(char *msg, size_t len) {
 				break;
 			}
 		}
+next:
 		ual = ual->next;
 	}
 }
@@ -412,6 +609,22 @@ void uwsgi_alarm_run(struct uwsgi_alarm_instance *uai, char *msg, size_t len) {
 		if (now - uai->last_run < uwsgi.alarm_freq)
 			return;
 	}
+	// a storm of different messages is limited too
+	if (uwsgi.alarm_burst) {
+		if (now - uai->window_start >= (uwsgi.alarm_freq > 0 ? uwsgi.alarm_freq : 1)) {
+			if (uai->suppressed) {
+				uwsgi_log_alarm("] %llu alarms suppressed for \"%s\"\n", (unsigned long long) uai->suppressed, uai->name);
+			}
+			uai->window_start = now;
+			uai->window_count = 0;
+			uai->suppressed = 0;
+		}
+		if (uai->window_count >= uwsgi.alarm_burst) {
+			uai->suppressed++;
+			return;
+		}
+		uai->window_count++;
+	}
 	uai->alarm->func(uai, msg, len);
 	uai->last_run = uwsgi_now();
 	memcpy(uai->last_msg, msg, len);
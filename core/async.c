@@ -2,6 +2,9 @@
 
 extern struct uwsgi_server uwsgi;
 
+// the loop of the current thread (one for each --async-threads)
+static __thread struct uwsgi_async_loop *ual;
+
 /*
 
 	This is a general-purpose async loop engine (it expects a coroutine-based approach)
@@ -17,8 +20,26 @@ extern struct uwsgi_server uwsgi;
 
 	IMPORTANT: this is not a callback-based engine !!!
 
+	With --async-threads every thread runs its own loop (event queue, runqueue and timeouts)
+	while the cores (and the fd maps) are shared: a core belongs to the thread that accepted
+	the connection until the end of the request.
+
 */
 
+struct uwsgi_async_loop *uwsgi_async_loop_get() {
+	return ual;
+}
+
+static struct wsgi_request *async_current_wsgi_req() {
+	return ual->wsgi_req;
+}
+
+// uwsgi.wsgi_req is always updated for the plugins not using current_wsgi_req()
+static void async_set_current_wsgi_req(struct wsgi_request *wsgi_req) {
+	uwsgi.wsgi_req = wsgi_req;
+	if (ual) ual->wsgi_req = wsgi_req;
+}
+
 // this is called whenever a new connection is ready, but there are no cores to handle it
 void uwsgi_async_queue_is_full(time_t now) {
 	if (now > uwsgi.async_queue_is_full && uwsgi.async_warn_if_queue_full) {
@@ -29,20 +50,38 @@ void uwsgi_async_queue_is_full(time_t now) {
 
 void uwsgi_async_init() {
 
-	uwsgi.async_queue = event_queue_init();
+	// optimization, this array maps file descriptor to requests
+        uwsgi.async_waiting_fd_table = uwsgi_calloc(sizeof(struct wsgi_request *) * uwsgi.max_fd);
+        uwsgi.async_proto_fd_table = uwsgi_calloc(sizeof(struct wsgi_request *) * uwsgi.max_fd);
+
+	// the runqueue items (the wsgi_request structure is zeroed at the end of the request, so they cannot live there)
+	uwsgi.async_runqueue_items = uwsgi_calloc(sizeof(struct uwsgi_async_request) * uwsgi.cores);
 
-	if (uwsgi.async_queue < 0) {
+	int threads = uwsgi.async_threads > 1 ? uwsgi.async_threads : 1;
+	uwsgi.async_loops = uwsgi_calloc(sizeof(struct uwsgi_async_loop) * threads);
+	pthread_mutex_init(&uwsgi.async_queue_unused_lock, NULL);
+}
+
+static void async_loop_init(int id) {
+
+	ual = &uwsgi.async_loops[id];
+	ual->id = id;
+
+	ual->queue = event_queue_init();
+
+	if (ual->queue < 0) {
 		exit(1);
 	}
 
-	uwsgi_add_sockets_to_queue(uwsgi.async_queue, -1);
+	uwsgi_add_sockets_to_queue(ual->queue, -1);
 
-	uwsgi.rb_async_timeouts = uwsgi_init_rb_timer();
-
-	// optimization, this array maps file descriptor to requests
-        uwsgi.async_waiting_fd_table = uwsgi_calloc(sizeof(struct wsgi_request *) * uwsgi.max_fd);
-        uwsgi.async_proto_fd_table = uwsgi_calloc(sizeof(struct wsgi_request *) * uwsgi.max_fd);
+	ual->timeouts = uwsgi_init_rb_timer();
 
+	// signals are managed only by the first thread
+	if (id == 0 && uwsgi.signal_socket > -1) {
+		event_queue_add_fd_read(ual->queue, uwsgi.signal_socket);
+		event_queue_add_fd_read(ual->queue, uwsgi.my_signal_socket);
+	}
 }
 
 struct wsgi_request *find_wsgi_req_proto_by_fd(int fd) {
@@ -65,67 +104,97 @@ static void runqueue_remove(struct uwsgi_async_request *u_request) {
 		child->prev = parent;
 	}
 
-	if (u_request == uwsgi.async_runqueue) {
-		uwsgi.async_runqueue = child;
+	if (u_request == ual->runqueue) {
+		ual->runqueue = child;
 	}
 
-	if (u_request == uwsgi.async_runqueue_last) {
-		uwsgi.async_runqueue_last = parent;
+	if (u_request == ual->runqueue_last) {
+		ual->runqueue_last = parent;
 	}
 
-	free(u_request);
+	u_request->queued = 0;
 }
 
 static void runqueue_push(struct wsgi_request *wsgi_req) {
 
 	// do not push the same request in the runqueue
-	struct uwsgi_async_request *uar = uwsgi.async_runqueue;
-	while(uar) {
-		if (uar->wsgi_req == wsgi_req) return;
-		uar = uar->next;
-	}
+	struct uwsgi_async_request *uar = &uwsgi.async_runqueue_items[wsgi_req->async_id];
+	if (uar->queued) return;
 
-	uar = uwsgi_malloc(sizeof(struct uwsgi_async_request));
+	uar->queued = 1;
 	uar->prev = NULL;
 	uar->next = NULL;
 	uar->wsgi_req = wsgi_req;
 
-	if (uwsgi.async_runqueue == NULL) {
-		uwsgi.async_runqueue = uar;
+	if (ual->runqueue == NULL) {
+		ual->runqueue = uar;
 	}
 	else {
-		uar->prev = uwsgi.async_runqueue_last;	
+		uar->prev = ual->runqueue_last;	
 	}
 
-	if (uwsgi.async_runqueue_last) {
-		uwsgi.async_runqueue_last->next = uar;
+	if (ual->runqueue_last) {
+		ual->runqueue_last->next = uar;
 	}
-	uwsgi.async_runqueue_last = uar;
+	ual->runqueue_last = uar;
 }
 
 struct wsgi_request *find_first_available_wsgi_req() {
 
-	struct wsgi_request *wsgi_req;
+	struct wsgi_request *wsgi_req = NULL;
+
+	if (uwsgi.async_threads > 1) pthread_mutex_lock(&uwsgi.async_queue_unused_lock);
 
-	if (uwsgi.async_queue_unused_ptr < 0) {
-		return NULL;
+	if (uwsgi.async_queue_unused_ptr >= 0) {
+		wsgi_req = uwsgi.async_queue_unused[uwsgi.async_queue_unused_ptr];
+		uwsgi.async_queue_unused_ptr--;
+		if (ual) ual->running++;
 	}
 
-	wsgi_req = uwsgi.async_queue_unused[uwsgi.async_queue_unused_ptr];
-	uwsgi.async_queue_unused_ptr--;
+	if (uwsgi.async_threads > 1) pthread_mutex_unlock(&uwsgi.async_queue_unused_lock);
 	return wsgi_req;
 }
 
+// give back a core to the stack of the unused ones
+static void async_release_core(struct wsgi_request *wsgi_req) {
+	if (uwsgi.async_threads > 1) pthread_mutex_lock(&uwsgi.async_queue_unused_lock);
+	uwsgi.async_queue_unused_ptr++;
+	uwsgi.async_queue_unused[uwsgi.async_queue_unused_ptr] = wsgi_req;
+	if (ual) ual->running--;
+	if (uwsgi.async_threads > 1) pthread_mutex_unlock(&uwsgi.async_queue_unused_lock);
+}
+
+// with multiple threads the core can be taken by another thread only after leaving the runqueue
+static void async_end_request(struct wsgi_request *wsgi_req) {
+	if (ual && uwsgi.async_threads > 1) {
+		uwsgi.async_runqueue_items[wsgi_req->async_id].release = 1;
+		return;
+	}
+	async_release_core(wsgi_req);
+}
+
+// leave the new connection to a waiting thread with less running requests
+static int async_should_accept() {
+	if (uwsgi.async_threads < 2) return 1;
+	int i;
+	for(i=0;i<uwsgi.async_threads;i++) {
+		struct uwsgi_async_loop *other = &uwsgi.async_loops[i];
+		if (other == ual) continue;
+		if (other->polling && other->running < ual->running) return 0;
+	}
+	return 1;
+}
+
 void async_reset_request(struct wsgi_request *wsgi_req) {
 	if (wsgi_req->async_timeout) {
-		uwsgi_del_rb_timer(uwsgi.rb_async_timeouts, wsgi_req->async_timeout);
+		uwsgi_del_rb_timer(ual->timeouts, wsgi_req->async_timeout);
 		free(wsgi_req->async_timeout);
 		wsgi_req->async_timeout = NULL;
 	}
 	
 	struct uwsgi_async_fd *uaf = wsgi_req->waiting_fds;
 	while (uaf) {
-        	event_queue_del_fd(uwsgi.async_queue, uaf->fd, uaf->event);
+        	event_queue_del_fd(ual->queue, uaf->fd, uaf->event);
                 uwsgi.async_waiting_fd_table[uaf->fd] = NULL;
                 struct uwsgi_async_fd *current_uaf = uaf;
                 uaf = current_uaf->next;
@@ -142,7 +211,7 @@ static void async_expire_timeouts(uint64_t now) {
 
 	for (;;) {
 
-		urbt = uwsgi_min_rb_timer(uwsgi.rb_async_timeouts, NULL);
+		urbt = uwsgi_min_rb_timer(ual->timeouts, NULL);
 
 		if (urbt == NULL)
 			return;
@@ -165,7 +234,7 @@ static void async_expire_timeouts(uint64_t now) {
 
 int async_add_fd_read(struct wsgi_request *wsgi_req, int fd, int timeout) {
 
-	if (uwsgi.async < 1 || !uwsgi.async_waiting_fd_table){ 
+	if (uwsgi.async < 1 || !ual) {
 		uwsgi_log_verbose("ASYNC call without async mode !!!\n");
 		return -1;
 	}
@@ -199,7 +268,7 @@ int async_add_fd_read(struct wsgi_request *wsgi_req, int fd, int timeout) {
 	}
 	uwsgi.async_waiting_fd_table[fd] = wsgi_req;
 	wsgi_req->async_force_again = 1;
-	return event_queue_add_fd_read(uwsgi.async_queue, fd);
+	return event_queue_add_fd_read(ual->queue, fd);
 }
 
 static int async_wait_fd_read(int fd, int timeout) {
@@ -257,7 +326,7 @@ static int async_wait_fd_read2(int fd0, int fd1, int timeout, int *fd) {
 
 void async_add_timeout(struct wsgi_request *wsgi_req, int timeout) {
 
-	if (uwsgi.async < 1 || !uwsgi.rb_async_timeouts) {
+	if (uwsgi.async < 1 || !ual) {
 		uwsgi_log_verbose("ASYNC call without async mode !!!\n");
 		return;
 	}
@@ -265,14 +334,14 @@ void async_add_timeout(struct wsgi_request *wsgi_req, int timeout) {
 	wsgi_req->async_ready_fd = 0;
 
 	if (timeout > 0 && wsgi_req->async_timeout == NULL) {
-		wsgi_req->async_timeout = uwsgi_add_rb_timer(uwsgi.rb_async_timeouts, uwsgi_now() + timeout, wsgi_req);
+		wsgi_req->async_timeout = uwsgi_add_rb_timer(ual->timeouts, uwsgi_now() + timeout, wsgi_req);
 	}
 
 }
 
 int async_add_fd_write(struct wsgi_request *wsgi_req, int fd, int timeout) {
 
-	if (uwsgi.async < 1 || !uwsgi.async_waiting_fd_table) {
+	if (uwsgi.async < 1 || !ual) {
 		uwsgi_log_verbose("ASYNC call without async mode !!!\n");
 		return -1;
 	}
@@ -307,7 +376,7 @@ int async_add_fd_write(struct wsgi_request *wsgi_req, int fd, int timeout) {
 
 	uwsgi.async_waiting_fd_table[fd] = wsgi_req;
 	wsgi_req->async_force_again = 1;
-	return event_queue_add_fd_write(uwsgi.async_queue, fd);
+	return event_queue_add_fd_write(ual->queue, fd);
 }
 
 static int async_wait_fd_write(int fd, int timeout) {
@@ -329,36 +398,44 @@ static int async_wait_fd_write(int fd, int timeout) {
 }
 
 void async_schedule_to_req(void) {
+	struct wsgi_request *wsgi_req = current_wsgi_req();
 #ifdef UWSGI_ROUTING
-        if (uwsgi_apply_routes(uwsgi.wsgi_req) == UWSGI_ROUTE_BREAK) {
+	// this is called again on every resume, account routing only the first time
+	int first_run = !wsgi_req->is_routing;
+        if (uwsgi_apply_routes(wsgi_req) == UWSGI_ROUTE_BREAK) {
+		uwsgi_req_timing(wsgi_req, UWSGI_REQ_STAGE_ROUTING);
 		goto end;
         }
+	if (first_run) {
+		uwsgi_req_timing(wsgi_req, UWSGI_REQ_STAGE_ROUTING);
+	}
 	// a trick to avoid calling routes again
-	uwsgi.wsgi_req->is_routing = 1;
+	wsgi_req->is_routing = 1;
 #endif
-	uwsgi.wsgi_req->async_status = uwsgi.p[uwsgi.wsgi_req->uh->modifier1]->request(uwsgi.wsgi_req);
-        if (uwsgi.wsgi_req->async_status <= UWSGI_OK) goto end;
+	wsgi_req->async_status = uwsgi.p[wsgi_req->uh->modifier1]->request(wsgi_req);
+        if (wsgi_req->async_status <= UWSGI_OK) goto end;
 
 	if (uwsgi.schedule_to_main) {
-        	uwsgi.schedule_to_main(uwsgi.wsgi_req);
+        	uwsgi.schedule_to_main(wsgi_req);
 	}
 	return;
 
 end:
-	async_reset_request(uwsgi.wsgi_req);
-	uwsgi_close_request(uwsgi.wsgi_req);
-	uwsgi.wsgi_req->async_status = UWSGI_OK;	
-	uwsgi.async_queue_unused_ptr++;
-        uwsgi.async_queue_unused[uwsgi.async_queue_unused_ptr] = uwsgi.wsgi_req;
+	async_reset_request(wsgi_req);
+	uwsgi_close_request(wsgi_req);
+	wsgi_req->async_status = UWSGI_OK;	
+	async_end_request(wsgi_req);
 }
 
 void async_schedule_to_req_green(void) {
-	struct wsgi_request *wsgi_req = uwsgi.wsgi_req;
+	struct wsgi_request *wsgi_req = current_wsgi_req();
 #ifdef UWSGI_ROUTING
         if (uwsgi_apply_routes(wsgi_req) == UWSGI_ROUTE_BREAK) {
+		uwsgi_req_timing(wsgi_req, UWSGI_REQ_STAGE_ROUTING);
                 goto end;
         }
 #endif
+	uwsgi_req_timing(wsgi_req, UWSGI_REQ_STAGE_ROUTING);
         for(;;) {
 		wsgi_req->async_status = uwsgi.p[wsgi_req->uh->modifier1]->request(wsgi_req);
                 if (wsgi_req->async_status <= UWSGI_OK) {
@@ -377,14 +454,13 @@ void async_schedule_to_req_green(void) {
 end:
 #endif
 	// re-set the global state
-	uwsgi.wsgi_req = wsgi_req;
+	async_set_current_wsgi_req(wsgi_req);
         async_reset_request(wsgi_req);
         uwsgi_close_request(wsgi_req);
 	// re-set the global state (routing could have changed it)
-	uwsgi.wsgi_req = wsgi_req;
+	async_set_current_wsgi_req(wsgi_req);
         wsgi_req->async_status = UWSGI_OK;
-	uwsgi.async_queue_unused_ptr++;
-        uwsgi.async_queue_unused[uwsgi.async_queue_unused_ptr] = wsgi_req;
+	async_end_request(wsgi_req);
 }
 
 static int uwsgi_async_wait_milliseconds_hook(int timeout) {
@@ -404,40 +480,53 @@ static int uwsgi_async_wait_milliseconds_hook(int timeout) {
 	return -1;
 }
 
-void async_loop() {
+static void *async_loop_run(void *);
 
-	if (uwsgi.async < 1) {
-		uwsgi_log("the async loop engine requires async mode (--async <n>)\n");
-		exit(1);
+// accept a new connection in a free core, returns -1 when no more connections can be accepted
+static int async_accept(struct uwsgi_socket *uwsgi_sock, int fd, time_t now, int first) {
+	struct wsgi_request *wsgi_req = find_first_available_wsgi_req();
+
+	async_set_current_wsgi_req(wsgi_req);
+	if (wsgi_req == NULL) {
+		if (first) uwsgi_async_queue_is_full(now);
+		return -1;
 	}
 
-	int interesting_fd, i;
-	struct uwsgi_rb_timer *min_timeout;
-	int timeout;
-	int is_a_new_connection;
-	int proto_parser_status;
+	// on error re-insert the request in the queue
+	wsgi_req_setup(wsgi_req, wsgi_req->async_id, uwsgi_sock);
+	if (wsgi_req_simple_accept(wsgi_req, fd)) {
+		async_release_core(wsgi_req);
+		return -1;
+	}
 
-	uint64_t now;
+	if (wsgi_req_async_recv(wsgi_req)) {
+		async_release_core(wsgi_req);
+		return -1;
+	}
 
-	struct uwsgi_async_request *current_request = NULL;
+	// by default the core is in UWSGI_AGAIN mode
+	wsgi_req->async_status = UWSGI_AGAIN;
+	// some protocol (like zeromq) do not need additional parsing, just push it in the runqueue
+	if (wsgi_req->do_not_add_to_async_queue) {
+		runqueue_push(wsgi_req);
+	}
+	return 0;
+}
 
-	void *events = event_queue_alloc(64);
-	struct uwsgi_socket *uwsgi_sock;
+void async_loop() {
 
-	uwsgi_async_init();
+	if (uwsgi.async < 1) {
+		uwsgi_log("the async loop engine requires async mode (--async <n>)\n");
+		exit(1);
+	}
 
-	uwsgi.async_runqueue = NULL;
+	uwsgi_async_init();
 
 	uwsgi.wait_write_hook = async_wait_fd_write;
         uwsgi.wait_read_hook = async_wait_fd_read;
         uwsgi.wait_read2_hook = async_wait_fd_read2;
 	uwsgi.wait_milliseconds_hook = uwsgi_async_wait_milliseconds_hook;
 
-	if (uwsgi.signal_socket > -1) {
-		event_queue_add_fd_read(uwsgi.async_queue, uwsgi.signal_socket);
-		event_queue_add_fd_read(uwsgi.async_queue, uwsgi.my_signal_socket);
-	}
-
 	// set a default request manager
 	if (!uwsgi.schedule_to_req)
 		uwsgi.schedule_to_req = async_schedule_to_req;
@@ -446,14 +535,56 @@ void async_loop() {
 		uwsgi_log("*** DANGER *** async mode without coroutine/greenthread engine loaded !!!\n");
 	}
 
+	if (uwsgi.async_threads > 1) {
+		uwsgi.current_wsgi_req = async_current_wsgi_req;
+		long i;
+		for(i=1;i<uwsgi.async_threads;i++) {
+			pthread_t tid;
+			if (pthread_create(&tid, &uwsgi.threads_attr, async_loop_run, (void *) i)) {
+				uwsgi_error("async_loop()/pthread_create()");
+				exit(1);
+			}
+		}
+	}
+
+	async_loop_run(NULL);
+}
+
+static void *async_loop_run(void *arg) {
+
+	long id = (long) arg;
+
+	if (id > 0) {
+		// signals are managed by the main thread
+		sigset_t smask;
+		sigfillset(&smask);
+		pthread_sigmask(SIG_BLOCK, &smask, NULL);
+	}
+
+	async_loop_init(id);
+
+	int interesting_fd, i;
+	struct uwsgi_rb_timer *min_timeout;
+	int timeout;
+	int is_a_new_connection;
+	int proto_parser_status;
+
+	uint64_t now;
+
+	struct uwsgi_async_request *current_request = NULL;
+	struct wsgi_request *wsgi_req;
+
+	void *events = event_queue_alloc(64);
+	struct uwsgi_socket *uwsgi_sock;
+
 	while (uwsgi.workers[uwsgi.mywid].manage_next_request) {
 
 		now = (uint64_t) uwsgi_now();
-		if (uwsgi.async_runqueue) {
+		if (ual->runqueue) {
 			timeout = 0;
 		}
 		else {
-			min_timeout = uwsgi_min_rb_timer(uwsgi.rb_async_timeouts, NULL);
+			min_timeout = uwsgi_min_rb_timer(ual->timeouts, NULL);
 			if (min_timeout) {
 				timeout = min_timeout->value - now;
 				if (timeout <= 0) {
@@ -466,27 +597,31 @@ void async_loop() {
 			}
 		}
 
-		uwsgi.async_nevents = event_queue_wait_multi(uwsgi.async_queue, timeout, events, 64);
+		ual->polling = 1;
+		ual->nevents = event_queue_wait_multi(ual->queue, timeout, events, 64);
+		ual->polling = 0;
 
 		now = (uint64_t) uwsgi_now();
 		// timeout ???
-		if (uwsgi.async_nevents == 0) {
+		if (ual->nevents == 0) {
 			async_expire_timeouts(now);
 		}
 
 
-		for (i = 0; i < uwsgi.async_nevents; i++) {
+		for (i = 0; i < ual->nevents; i++) {
 			// manage events
 			interesting_fd = event_queue_interesting_fd(events, i);
 
 			// signals are executed in the main stack... in the future we could have dedicated stacks for them
 			if (uwsgi.signal_socket > -1 && (interesting_fd == uwsgi.signal_socket || interesting_fd == uwsgi.my_signal_socket)) {
-				uwsgi.wsgi_req = find_first_available_wsgi_req();
-                                if (uwsgi.wsgi_req == NULL) {
+				wsgi_req = find_first_available_wsgi_req();
+				async_set_current_wsgi_req(wsgi_req);
+                                if (wsgi_req == NULL) {
                                 	uwsgi_async_queue_is_full((time_t)now);
                                         continue; 
                                 }
-				uwsgi_receive_signal(uwsgi.wsgi_req, interesting_fd, "worker", uwsgi.mywid);
+				uwsgi_receive_signal(wsgi_req, interesting_fd, "worker", uwsgi.mywid);
+				async_release_core(wsgi_req);
 				continue;
 			}
 
@@ -500,31 +635,12 @@ void async_loop() {
 
 					is_a_new_connection = 1;
 
-					uwsgi.wsgi_req = find_first_available_wsgi_req();
-					if (uwsgi.wsgi_req == NULL) {
-						uwsgi_async_queue_is_full((time_t)now);
-						break;
-					}
-
-					// on error re-insert the request in the queue
-					wsgi_req_setup(uwsgi.wsgi_req, uwsgi.wsgi_req->async_id, uwsgi_sock);
-					if (wsgi_req_simple_accept(uwsgi.wsgi_req, interesting_fd)) {
-						uwsgi.async_queue_unused_ptr++;
-						uwsgi.async_queue_unused[uwsgi.async_queue_unused_ptr] = uwsgi.wsgi_req;
-						break;
-					}
-
-					if (wsgi_req_async_recv(uwsgi.wsgi_req)) {
-						uwsgi.async_queue_unused_ptr++;
-						uwsgi.async_queue_unused[uwsgi.async_queue_unused_ptr] = uwsgi.wsgi_req;
-						break;
-					}
-
-					// by default the core is in UWSGI_AGAIN mode
-					uwsgi.wsgi_req->async_status = UWSGI_AGAIN;
-					// some protocol (like zeromq) do not need additional parsing, just push it in the runqueue
-					if (uwsgi.wsgi_req->do_not_add_to_async_queue) {
-						runqueue_push(uwsgi.wsgi_req);
+					// a single wakeup can accept more connections (see uwsgi_accept_batch())
+					int batch = uwsgi_accept_batch();
+					int i;
+					for(i=0;i<batch;i++) {
+						if (!async_should_accept()) break;
+						if (async_accept(uwsgi_sock, interesting_fd, (time_t) now, i == 0)) break;
 					}
 
 					break;
@@ -535,19 +651,20 @@ void async_loop() {
 
 			if (!is_a_new_connection) {
 				// proto event
-				uwsgi.wsgi_req = find_wsgi_req_proto_by_fd(interesting_fd);
-				if (uwsgi.wsgi_req) {
-					proto_parser_status = uwsgi.wsgi_req->socket->proto(uwsgi.wsgi_req);
+				wsgi_req = find_wsgi_req_proto_by_fd(interesting_fd);
+				async_set_current_wsgi_req(wsgi_req);
+				if (wsgi_req) {
+					proto_parser_status = wsgi_req->socket->proto(wsgi_req);
 					// reset timeout
-					async_reset_request(uwsgi.wsgi_req);
+					async_reset_request(wsgi_req);
 					// parsing complete
 					if (!proto_parser_status) {
 						// remove fd from event poll and fd proto table 
 						uwsgi.async_proto_fd_table[interesting_fd] = NULL;
-						event_queue_del_fd(uwsgi.async_queue, interesting_fd, event_queue_read());
+						event_queue_del_fd(ual->queue, interesting_fd, event_queue_read());
 						// put request in the runqueue (set it as UWSGI_OK to signal the first run)
-						uwsgi.wsgi_req->async_status = UWSGI_OK;
-						runqueue_push(uwsgi.wsgi_req);
+						wsgi_req->async_status = UWSGI_OK;
+						runqueue_push(wsgi_req);
 						continue;
 					}
 					else if (proto_parser_status < 0) {
@@ -556,50 +673,58 @@ void async_loop() {
 						continue;
 					}
 					// re-add timer
-					async_add_timeout(uwsgi.wsgi_req, uwsgi.socket_timeout);
+					async_add_timeout(wsgi_req, uwsgi.socket_timeout);
 					continue;
 				}
 
 				// app-registered event
-				uwsgi.wsgi_req = find_wsgi_req_by_fd(interesting_fd);
+				wsgi_req = find_wsgi_req_by_fd(interesting_fd);
+				async_set_current_wsgi_req(wsgi_req);
 				// unknown fd, remove it (for safety)
-				if (uwsgi.wsgi_req == NULL) {
+				if (wsgi_req == NULL) {
 					close(interesting_fd);
 					continue;
 				}
 
 				// remove all the fd monitors and timeout
-				async_reset_request(uwsgi.wsgi_req);
-				uwsgi.wsgi_req->async_ready_fd = 1;
-				uwsgi.wsgi_req->async_last_ready_fd = interesting_fd;
+				async_reset_request(wsgi_req);
+				wsgi_req->async_ready_fd = 1;
+				wsgi_req->async_last_ready_fd = interesting_fd;
 
 				// put the request in the runqueue again
-				runqueue_push(uwsgi.wsgi_req);
+				runqueue_push(wsgi_req);
 			}
 		}
 
 
 		// event queue managed, give cpu to runqueue
-		current_request = uwsgi.async_runqueue;
+		current_request = ual->runqueue;
 
 		while(current_request) {
 
 			// current_request could be nulled on error/end of request
 			struct uwsgi_async_request *next_request = current_request->next;
 
-			uwsgi.wsgi_req = current_request->wsgi_req;
+			wsgi_req = current_request->wsgi_req;
+
+			async_set_current_wsgi_req(wsgi_req);
 			uwsgi.schedule_to_req();
-			uwsgi.wsgi_req->switches++;
+			wsgi_req->switches++;
 
 			// request ended ?
-			if (uwsgi.wsgi_req->async_status <= UWSGI_OK ||
-				uwsgi.wsgi_req->waiting_fds || uwsgi.wsgi_req->async_timeout) {
+			if (wsgi_req->async_status <= UWSGI_OK ||
+				wsgi_req->waiting_fds || wsgi_req->async_timeout) {
 				// remove from the runqueue
 				runqueue_remove(current_request);
+				if (current_request->release) {
+					current_request->release = 0;
+					async_release_core(wsgi_req);
+				}
 			}
 			current_request = next_request;
 		}
 
 	}
 
+	return NULL;
 }
@@ -16,17 +16,98 @@ struct uwsgi_buffer *uwsgi_buffer_new(size_t len) {
 
 }
 
+/*
+	per-thread pools of buffers (in size classes)
+
+	uwsgi_buffer_get() returns a buffer of at least len bytes (ub->len could be bigger), the smallest class
+	has its payload allocated together with the structure. uwsgi_buffer_put() gives a buffer back to the pool
+	of the calling thread (any buffer can be put, but pooled ones must not have their ->buf stolen or swapped)
+*/
+
+#define UWSGI_BUFFER_POOL_CLASSES 5
+#define UWSGI_BUFFER_POOL_MAX 32
+
+static const size_t uwsgi_buffer_pool_sizes[UWSGI_BUFFER_POOL_CLASSES] = { UWSGI_BUFFER_SMALL, 1024, 4096, 16384, 65536 };
+static __thread struct uwsgi_buffer *uwsgi_buffer_pool[UWSGI_BUFFER_POOL_CLASSES];
+static __thread int uwsgi_buffer_pool_cnt[UWSGI_BUFFER_POOL_CLASSES];
+
+struct uwsgi_buffer *uwsgi_buffer_get(size_t len) {
+	int i;
+	for (i = 0; i < UWSGI_BUFFER_POOL_CLASSES; i++) {
+		if (len <= uwsgi_buffer_pool_sizes[i]) break;
+	}
+	if (i == UWSGI_BUFFER_POOL_CLASSES) return uwsgi_buffer_new(len);
+
+	struct uwsgi_buffer *ub = uwsgi_buffer_pool[i];
+	if (ub) {
+		uwsgi_buffer_pool[i] = ub->pool_next;
+		uwsgi_buffer_pool_cnt[i]--;
+		ub->pool_next = NULL;
+		return ub;
+	}
+
+	if (i == 0) {
+		ub = uwsgi_calloc(sizeof(struct uwsgi_buffer) + UWSGI_BUFFER_SMALL);
+		ub->buf = (char *) (ub + 1);
+		ub->len = UWSGI_BUFFER_SMALL;
+		ub->inline_buf = 1;
+		return ub;
+	}
+
+	return uwsgi_buffer_new(uwsgi_buffer_pool_sizes[i]);
+}
+
+void uwsgi_buffer_put(struct uwsgi_buffer *ub) {
+	int i;
+	// stolen memory
+	if (!ub->buf) goto destroy;
+	for (i = UWSGI_BUFFER_POOL_CLASSES - 1; i >= 0; i--) {
+		if (ub->len >= uwsgi_buffer_pool_sizes[i]) break;
+	}
+	// do not keep grown buffers around
+	if (i < 0 || ub->len > uwsgi_buffer_pool_sizes[i] * 4 || uwsgi_buffer_pool_cnt[i] >= UWSGI_BUFFER_POOL_MAX) goto destroy;
+
+	ub->pos = 0;
+	ub->limit = 0;
+	ub->pool_next = uwsgi_buffer_pool[i];
+	uwsgi_buffer_pool[i] = ub;
+	uwsgi_buffer_pool_cnt[i]++;
+	return;
+destroy:
+	uwsgi_buffer_destroy(ub);
+}
+
+// empty the buffer, keeping its memory
+void uwsgi_buffer_reset(struct uwsgi_buffer *ub) {
+	ub->pos = 0;
+}
+
+// inline payloads cannot be realloc()'ed
+static int uwsgi_buffer_resize(struct uwsgi_buffer *ub, size_t len, char *func) {
+	char *new_buf;
+	if (ub->inline_buf) {
+		new_buf = malloc(len);
+		if (new_buf) memcpy(new_buf, ub->buf, ub->pos);
+	}
+	else {
+		new_buf = realloc(ub->buf, len);
+	}
+	if (!new_buf) {
+		uwsgi_error(func);
+		return -1;
+	}
+	ub->buf = new_buf;
+	ub->len = len;
+	ub->inline_buf = 0;
+	return 0;
+}
+
 int uwsgi_buffer_fix(struct uwsgi_buffer *ub, size_t len) {
 	if (ub->limit > 0 && len > ub->limit)
 		return -1;
 	if (ub->len < len) {
-		char *new_buf = realloc(ub->buf, len);
-		if (!new_buf) {
-			uwsgi_error("uwsgi_buffer_fix()");
+		if (uwsgi_buffer_resize(ub, len, "uwsgi_buffer_fix()"))
 			return -1;
-		}
-		ub->buf = new_buf;
-		ub->len = len;
 	}
 	return 0;
 }
@@ -40,13 +121,8 @@ int uwsgi_buffer_ensure(struct uwsgi_buffer *ub, size_t len) {
 			if (new_len == ub->len)
 				return -1;
 		}
-		char *new_buf = realloc(ub->buf, new_len);
-		if (!new_buf) {
-			uwsgi_error("uwsgi_buffer_ensure()");
+		if (uwsgi_buffer_resize(ub, new_len, "uwsgi_buffer_ensure()"))
 			return -1;
-		}
-		ub->buf = new_buf;
-		ub->len = new_len;
 	}
 	return 0;
 }
@@ -103,20 +179,13 @@ int uwsgi_buffer_append(struct uwsgi_buffer *ub, char *buf, size_t len) {
 	if (len > remains) {
 		size_t chunk_size = UMAX(len, (size_t) uwsgi.page_size);
 		if (ub->limit > 0 && ub->len + chunk_size > ub->limit) {
-			// retry with another minimal size
-			if (len < (size_t) uwsgi.page_size) {
-				chunk_size = len;
-			}
+			// retry with the minimal size (reused buffers could be already bigger than requested)
+			chunk_size = len - remains;
 			if (ub->len + chunk_size > ub->limit)
 				return -1;
 		}
-		char *new_buf = realloc(ub->buf, ub->len + chunk_size);
-		if (!new_buf) {
-			uwsgi_error("uwsgi_buffer_append()");
+		if (uwsgi_buffer_resize(ub, ub->len + chunk_size, "uwsgi_buffer_append()"))
 			return -1;
-		}
-		ub->buf = new_buf;
-		ub->len += chunk_size;
 	}
 
 	memcpy(ub->buf + ub->pos, buf, len);
@@ -125,28 +194,39 @@ int uwsgi_buffer_append(struct uwsgi_buffer *ub, char *buf, size_t len) {
 }
 
 int uwsgi_buffer_append_json(struct uwsgi_buffer *ub, char *buf, size_t len) {
-	// need to escape \ and "
-	size_t i;
+	// need to escape \ and " (and control chars), unescaped runs are copied at once
+	size_t i, base = 0;
 	for(i=0;i<len;i++) {
-		if (buf[i] == '\t') {
+		unsigned char c = (unsigned char) buf[i];
+		if (c >= 0x20 && c != '"' && c != '\\') continue;
+		if (i > base) {
+			if (uwsgi_buffer_append(ub, buf+base, i-base)) return -1;
+		}
+		base = i+1;
+		if (c == '\t') {
 			if (uwsgi_buffer_append(ub, "\\t", 2)) return -1;
 		}
-		else if (buf[i] == '\n') {
+		else if (c == '\n') {
 			if (uwsgi_buffer_append(ub, "\\n", 2)) return -1;
 		}
-		else if (buf[i] == '\r') {
+		else if (c == '\r') {
 			if (uwsgi_buffer_append(ub, "\\r", 2)) return -1;
 		}
-		else if (buf[i] == '"') {
+		else if (c == '"') {
 			if (uwsgi_buffer_append(ub, "\\\"", 2)) return -1;
 		}
-		else if (buf[i] == '\\') {
+		else if (c == '\\') {
 			if (uwsgi_buffer_append(ub, "\\\\", 2)) return -1;
 		}
 		else {
-			if (uwsgi_buffer_append(ub, buf+i, 1)) return -1;
+			char u[7];
+			snprintf(u, 7, "\\u%04x", c);
+			if (uwsgi_buffer_append(ub, u, 6)) return -1;
 		}
 	}
+	if (i > base) {
+		if (uwsgi_buffer_append(ub, buf+base, i-base)) return -1;
+	}
 	return 0;
 }
 
@@ -352,7 +432,7 @@ void uwsgi_buffer_destroy(struct uwsgi_buffer *ub) {
 	}
 	ub->freed = 1;
 #endif
-	if (ub->buf)
+	if (ub->buf && !ub->inline_buf)
 		free(ub->buf);
 	free(ub);
 }
@@ -437,9 +517,10 @@ struct uwsgi_buffer *uwsgi_buffer_from_file(char *filename) {
 }
 
 void uwsgi_buffer_map(struct uwsgi_buffer *ub, char *buf, size_t len) {
-	if (ub->buf) {
+	if (ub->buf && !ub->inline_buf) {
 		free(ub->buf);
 	}
+	ub->inline_buf = 0;
 	ub->buf = buf;
 	ub->pos = len;
 	ub->len = len;
@@ -24,27 +24,202 @@ extern struct uwsgi_server uwsgi;
 
 */
 
+/*
+	approximated eviction policies
+
+	contrary to the lru list (purge_lru), they do not need to update shared pointers
+	on every hit (so a read lock is enough for gets). The unused lru fields of the items are
+	reused to track accesses:
+
+		clock -> lru_next is the reference bit, the clock hand sweeps the items clearing it
+		sampled-lru -> lru_prev is the last access time, the oldest one of N sampled items is evicted
+		lfu -> the item hits counter is used, the least used one of N sampled items is evicted
+*/
+
+#define cache_item_referenced(uci) (uci)->lru_next
+#define cache_item_last_access(uci) (uci)->lru_prev
+
+static inline void cache_item_touch(struct uwsgi_cache *uc, struct uwsgi_cache_item *uci) {
+	if (uc->eviction == UWSGI_CACHE_EVICTION_CLOCK) {
+		// avoid dirtying the cacheline if not needed
+		if (!cache_item_referenced(uci)) cache_item_referenced(uci) = 1;
+	}
+	else if (uc->eviction == UWSGI_CACHE_EVICTION_SAMPLED_LRU) {
+		cache_item_last_access(uci) = uwsgi_micros();
+	}
+}
+
+static uint64_t cache_evict_clock(struct uwsgi_cache *uc, uint64_t exclude) {
+	uint64_t n;
+	for(n=0;n<uc->max_items*2;n++) {
+		if (uc->clock_hand < 1 || uc->clock_hand >= uc->max_items) uc->clock_hand = 1;
+		uint64_t index = uc->clock_hand++;
+		struct uwsgi_cache_item *uci = cache_item(index);
+		if (!uci->keysize || index == exclude) continue;
+		if (cache_item_referenced(uci)) {
+			cache_item_referenced(uci) = 0;
+			continue;
+		}
+		return index;
+	}
+	return 0;
+}
+
+static uint64_t cache_evict_sampled(struct uwsgi_cache *uc, uint64_t exclude) {
+	uint64_t victim = 0, victim_score = 0;
+	uint64_t samples = 0, probes;
+	if (uc->max_items < 2) return 0;
+	for(probes=0;probes<uc->eviction_samples*4 && samples < uc->eviction_samples;probes++) {
+		// cheap lcg, the clock hand is its state
+		uc->clock_hand = uc->clock_hand * 6364136223846793005LLU + 1442695040888963407LLU;
+		uint64_t index = 1 + ((uc->clock_hand >> 33) % (uc->max_items - 1));
+		struct uwsgi_cache_item *uci = cache_item(index);
+		if (!uci->keysize || index == exclude) continue;
+		samples++;
+		uint64_t score = uc->eviction == UWSGI_CACHE_EVICTION_LFU ? uci->hits : cache_item_last_access(uci);
+		if (!victim || score < victim_score) {
+			victim = index;
+			victim_score = score;
+		}
+	}
+	return victim;
+}
+
+// evict an item (different from exclude) following the configured policy, returns 0 if nothing has been evicted
+static int cache_evict(struct uwsgi_cache *uc, uint64_t exclude) {
+	uint64_t index = 0;
+	if (uc->purge_lru) {
+		index = uc->lru_head;
+		if (index && index == exclude) {
+			struct uwsgi_cache_item *uci = cache_item(index);
+			index = uci->lru_next;
+		}
+	}
+	else if (uc->eviction == UWSGI_CACHE_EVICTION_CLOCK) {
+		index = cache_evict_clock(uc, exclude);
+	}
+	else if (uc->eviction) {
+		index = cache_evict_sampled(uc, exclude);
+	}
+	if (!index) return 0;
+	uwsgi_cache_del2(uc, NULL, 0, index, UWSGI_CACHE_FLAG_LOCAL);
+	return 1;
+}
+
+/*
+	expiration timing wheel
+
+	every item with an expiration is linked in the slot (expires % wheel_slots) of a circular
+	array of one-second lists, so the sweeper only walks the slots elapsed since its last run.
+	Items expiring after more than wheel_slots seconds are skipped until their turn comes.
+	The head of a list has the slot number (with the high bit set) as prev, 0 means unlinked.
+*/
+#define UWSGI_CACHE_WHEEL_HEAD 0x8000000000000000ULL
+#define UWSGI_CACHE_WHEEL_BATCH 1000
+
+static void cache_wheel_add(struct uwsgi_cache *uc, uint64_t index, uint64_t expires) {
+	// already expired items go to the next slot to sweep
+	uint64_t slot = (expires > uc->wheel_pos ? expires : uc->wheel_pos + 1) % uc->wheel_slots;
+	uint64_t head = uc->wheel[slot];
+	uc->wheel_next[index] = head;
+	uc->wheel_prev[index] = UWSGI_CACHE_WHEEL_HEAD | slot;
+	if (head) uc->wheel_prev[head] = index;
+	uc->wheel[slot] = index;
+}
+
+static void cache_wheel_remove(struct uwsgi_cache *uc, uint64_t index) {
+	uint64_t prev = uc->wheel_prev[index];
+	if (!prev) return;
+	uint64_t next = uc->wheel_next[index];
+	if (prev & UWSGI_CACHE_WHEEL_HEAD) {
+		uc->wheel[prev & ~UWSGI_CACHE_WHEEL_HEAD] = next;
+	}
+	else {
+		uc->wheel_next[prev] = next;
+	}
+	if (next) uc->wheel_prev[next] = prev;
+	uc->wheel_prev[index] = 0;
+	uc->wheel_next[index] = 0;
+}
+
+/*
+	free the expired items of the slots up to now.
+	With a batch the lock is acquired here and released every batch visited items,
+	otherwise the caller already holds it.
+*/
+static uint64_t cache_wheel_expire(struct uwsgi_cache *uc, uint64_t now, uint64_t batch) {
+	uint64_t freed_items = 0;
+	uint64_t visited = 0;
+	uint64_t cursor = 0;
+
+	if (batch) uwsgi_wlock(uc->lock);
+
+	// first run (or a very long pause), every slot has to be checked once
+	uint64_t t = uc->wheel_pos + 1;
+	if (!uc->wheel_pos || now - uc->wheel_pos > uc->wheel_slots) {
+		t = now - uc->wheel_slots + 1;
+	}
+
+	while (t <= now) {
+		uint64_t index = cursor ? cursor : uc->wheel[t % uc->wheel_slots];
+		cursor = 0;
+		while (index) {
+			if (batch && visited >= batch) {
+				cursor = index;
+				break;
+			}
+			uint64_t next = uc->wheel_next[index];
+			struct uwsgi_cache_item *uci = cache_item(index);
+			if (uci->expires && uci->expires <= now) {
+				uwsgi_cache_del2(uc, NULL, 0, index, UWSGI_CACHE_FLAG_LOCAL);
+				freed_items++;
+			}
+			visited++;
+			index = next;
+		}
+		if (cursor) {
+			// give readers and writers a chance
+			uwsgi_rwunlock(uc->lock);
+			visited = 0;
+			uwsgi_wlock(uc->lock);
+			// the item could have been unlinked in the meantime, restart from the head of the slot
+			if (!uc->wheel_prev[cursor]) cursor = 0;
+			continue;
+		}
+		uc->wheel_pos = t;
+		t++;
+	}
+
+	if (batch) uwsgi_rwunlock(uc->lock);
+	return freed_items;
+}
+
 static void cache_full(struct uwsgi_cache *uc) {
 	uint64_t i;
 
 	if (!uc->ignore_full) {
         	if (uc->purge_lru)
                 	uwsgi_log("LRU item will be purged from cache \"%s\"\n", uc->name);
+		else if (uc->eviction)
+			uwsgi_log("an item will be evicted from cache \"%s\"\n", uc->name);
                 else
                 	uwsgi_log("*** DANGER cache \"%s\" is FULL !!! ***\n", uc->name);
 	}
 
         uc->full++;
 
-        if (uc->purge_lru && uc->lru_head)
-        	uwsgi_cache_del2(uc, NULL, 0, uc->lru_head, UWSGI_CACHE_FLAG_LOCAL);
+        if (uc->purge_lru || uc->eviction)
+		cache_evict(uc, 0);
 
 	// we do not need locking here !
 	if (uc->sweep_on_full) {
 		uint64_t now = (uint64_t) uwsgi_now();
 		if (uc->next_scan <= now) {
 			uc->next_scan = now + uc->sweep_on_full;
-                	for (i = 1; i < uc->max_items; i++) {
+			if (uc->wheel) {
+				cache_wheel_expire(uc, now, 0);
+			}
+                	else for (i = 1; i < uc->max_items; i++) {
 				struct uwsgi_cache_item *uci = cache_item(i);
 				if (uci->expires > 0 && uci->expires <= now) {
                 			uwsgi_cache_del2(uc, NULL, 0, i, 0);
@@ -60,7 +235,150 @@ static void cache_full(struct uwsgi_cache *uc) {
 	}
 }
 
+/*
+	slab allocator
+
+	the blocks area is split in slabs of slab_blocks blocks. A slab is assigned to a size class
+	(chunks of 2^n blocks) on demand and goes back to the unused stack when all of its chunks are free.
+	Free chunks are linked (prev/next, first block + 1) in a list per class, the links are stored in the
+	chunk memory itself. The blocks bitmap is still updated, it is used to rebuild the slabs on restore.
+*/
+
+#define cache_slab_of(uc, block) ((block) / (uc)->slab_blocks)
+
+static inline uint8_t cache_slab_class(struct uwsgi_cache *uc, uint64_t len) {
+	uint64_t needed_blocks = len/uc->blocksize;
+	if (len % uc->blocksize > 0) needed_blocks++;
+	uint8_t class = 0;
+	while((1LLU << class) < needed_blocks) class++;
+	return class;
+}
+
+static inline uint64_t cache_slab_link(struct uwsgi_cache *uc, uint64_t block, int slot) {
+	uint64_t value;
+	memcpy(&value, ((char *) uc->data) + (block * uc->blocksize) + (slot * 8), 8);
+	return value;
+}
+
+static inline void cache_slab_set_link(struct uwsgi_cache *uc, uint64_t block, int slot, uint64_t value) {
+	memcpy(((char *) uc->data) + (block * uc->blocksize) + (slot * 8), &value, 8);
+}
+
+static void cache_slab_push(struct uwsgi_cache *uc, uint8_t class, uint64_t block) {
+	uint64_t head = uc->slab_free[class];
+	cache_slab_set_link(uc, block, 0, 0);
+	cache_slab_set_link(uc, block, 1, head);
+	if (head) cache_slab_set_link(uc, head - 1, 0, block + 1);
+	uc->slab_free[class] = block + 1;
+}
+
+static void cache_slab_unlink(struct uwsgi_cache *uc, uint8_t class, uint64_t block) {
+	uint64_t prev = cache_slab_link(uc, block, 0);
+	uint64_t next = cache_slab_link(uc, block, 1);
+	if (prev) cache_slab_set_link(uc, prev - 1, 1, next);
+	else uc->slab_free[class] = next;
+	if (next) cache_slab_set_link(uc, next - 1, 0, prev);
+}
+
+static uint64_t cache_slab_alloc(struct uwsgi_cache *uc, uint64_t len) {
+	uint8_t class = cache_slab_class(uc, len);
+	if (class >= uc->slab_classes) return 0xffffffffffffffffLLU;
+
+	if (!uc->slab_free[class]) {
+		if (!uc->slab_unused_ptr) return 0xffffffffffffffffLLU;
+		uint64_t slab = uc->slab_unused[uc->slab_unused_ptr--];
+		uc->slab_class[slab] = class;
+		uc->slab_used[slab] = 0;
+		uint64_t chunk = 1LLU << class;
+		uint64_t block = slab * uc->slab_blocks;
+		uint64_t last = block + uc->slab_blocks;
+		// push in reverse order, so chunks are served from the start of the slab
+		while(last > block) {
+			last -= chunk;
+			cache_slab_push(uc, class, last);
+		}
+	}
+
+	uint64_t block = uc->slab_free[class] - 1;
+	cache_slab_unlink(uc, class, block);
+	uc->slab_used[cache_slab_of(uc, block)]++;
+	return block;
+}
+
+static void cache_slab_free(struct uwsgi_cache *uc, uint64_t block) {
+	uint64_t slab = cache_slab_of(uc, block);
+	uint8_t class = uc->slab_class[slab];
+	if (class == 0xff) return;
+	cache_slab_push(uc, class, block);
+	if (--uc->slab_used[slab] > 0) return;
+	// the whole slab is free, give it back
+	uint64_t chunk = 1LLU << class;
+	uint64_t first = slab * uc->slab_blocks;
+	uint64_t i;
+	for(i=first;i<first+uc->slab_blocks;i+=chunk) {
+		cache_slab_unlink(uc, class, i);
+	}
+	uc->slab_class[slab] = 0xff;
+	uc->slab_unused[++uc->slab_unused_ptr] = slab;
+}
+
+static void cache_setup_slabs(struct uwsgi_cache *uc) {
+	// slabs are a power of two of blocks, and they cannot be bigger than the whole area
+	uint64_t slab_blocks = 1;
+	while(slab_blocks * 2 <= uc->slab_blocks && slab_blocks * 2 <= uc->blocks) slab_blocks *= 2;
+	uc->slab_blocks = slab_blocks;
+	uc->slabs = uc->blocks / uc->slab_blocks;
+	uc->slab_classes = 0;
+	while((1LLU << uc->slab_classes) <= uc->slab_blocks) uc->slab_classes++;
+	uc->max_item_size = uc->blocksize * uc->slab_blocks;
+
+	uc->slab_free = uwsgi_calloc_shared(sizeof(uint64_t) * uc->slab_classes);
+	uc->slab_class = uwsgi_calloc_shared(uc->slabs);
+	memset(uc->slab_class, 0xff, uc->slabs);
+	uc->slab_used = uwsgi_calloc_shared(sizeof(uint64_t) * uc->slabs);
+	uc->slab_unused = uwsgi_calloc_shared(sizeof(uint64_t) * (uc->slabs + 1));
+	uint64_t i;
+	for(i=uc->slabs;i>0;i--) {
+		uc->slab_unused[++uc->slab_unused_ptr] = i - 1;
+	}
+}
+
+// rebuild the slabs from the restored items (the blocks bitmap has been filled by uwsgi_cache_fix())
+static void cache_rebuild_slabs(struct uwsgi_cache *uc) {
+	uint64_t i;
+	memset(uc->slab_free, 0, sizeof(uint64_t) * uc->slab_classes);
+	memset(uc->slab_class, 0xff, uc->slabs);
+	memset(uc->slab_used, 0, sizeof(uint64_t) * uc->slabs);
+	for(i=1;i<uc->max_items;i++) {
+		struct uwsgi_cache_item *uci = cache_item(i);
+		if (!uci->keysize) continue;
+		uint64_t slab = cache_slab_of(uc, uci->first_block);
+		if (slab >= uc->slabs) continue;
+		if (uc->slab_class[slab] == 0xff) uc->slab_class[slab] = cache_slab_class(uc, uci->valsize);
+		uc->slab_used[slab]++;
+	}
+	uc->slab_unused_ptr = 0;
+	for(i=uc->slabs;i>0;i--) {
+		uint64_t slab = i - 1;
+		uint8_t class = uc->slab_class[slab];
+		if (class == 0xff) {
+			uc->slab_unused[++uc->slab_unused_ptr] = slab;
+			continue;
+		}
+		uint64_t chunk = 1LLU << class;
+		uint64_t first = slab * uc->slab_blocks;
+		uint64_t block = first + uc->slab_blocks;
+		while(block > first) {
+			block -= chunk;
+			if (!(uc->blocks_bitmap[block/8] & (1 << (7 - (block % 8))))) {
+				cache_slab_push(uc, class, block);
+			}
+		}
+	}
+}
+
 static uint64_t uwsgi_cache_find_free_blocks(struct uwsgi_cache *uc, uint64_t need) {
+	if (uc->slab_blocks) return cache_slab_alloc(uc, need);
 	// how many blocks we need ?
 	uint64_t needed_blocks = need/uc->blocksize;
 	if (need % uc->blocksize > 0) needed_blocks++;
@@ -175,6 +493,7 @@ static uint64_t cache_mark_blocks(struct uwsgi_cache *uc, uint64_t index, uint64
 }
 
 static void cache_unmark_blocks(struct uwsgi_cache *uc, uint64_t index, uint64_t len) {
+	if (uc->slab_blocks) cache_slab_free(uc, index);
 	uint64_t needed_blocks = len/uc->blocksize;
         if (len % uc->blocksize > 0) needed_blocks++;
 
@@ -252,14 +571,15 @@ static void uwsgi_cache_add_items(struct uwsgi_cache *uc) {
 		key_len = value - key;
 		value++;
 		uint64_t len = (usl->value + usl->len) - value;
-                uwsgi_wlock(uc->lock);
+		struct uwsgi_lock_item *cl = uwsgi_cache_key_lock(uc, key, key_len);
+                uwsgi_wlock(cl);
                 if (!uwsgi_cache_set2(uc, key, key_len, value, len, 0, 0)) {
                 	uwsgi_log("[cache] stored \"%.*s\" in \"%s\"\n", key_len, key, uc->name);
                 }
                 else {
                 	uwsgi_log("[cache-error] unable to store \"%.*s\" in \"%s\"\n", key_len, key, uc->name);
                 }
-                uwsgi_rwunlock(uc->lock);
+                uwsgi_rwunlock(cl);
 next:
                 usl = usl->next;
         }
@@ -285,14 +605,15 @@ static void uwsgi_cache_load_files(struct uwsgi_cache *uc) {
 		}
 		value = uwsgi_open_and_read(key, &len, 0, NULL);
 		if (value) {
-			uwsgi_wlock(uc->lock);
+			struct uwsgi_lock_item *cl = uwsgi_cache_key_lock(uc, key, key_len);
+			uwsgi_wlock(cl);
 			if (!uwsgi_cache_set2(uc, key, key_len, value, len, 0, 0)) {
 				uwsgi_log("[cache] stored \"%.*s\" in \"%s\"\n", key_len, key, uc->name);
 			}		
 			else {
 				uwsgi_log("[cache-error] unable to store \"%.*s\" in \"%s\"\n", key_len, key, uc->name);
 			}
-			uwsgi_rwunlock(uc->lock);
+			uwsgi_rwunlock(cl);
 			free(value);
 		}
 		else {
@@ -322,11 +643,12 @@ next:
                 if (value) {
 			struct uwsgi_buffer *gzipped = uwsgi_gzip(value, len);
 			if (gzipped) {
-                        	uwsgi_wlock(uc->lock);
+				struct uwsgi_lock_item *cl = uwsgi_cache_key_lock(uc, key, key_len);
+                        	uwsgi_wlock(cl);
                         	if (!uwsgi_cache_set2(uc, key, key_len, gzipped->buf, gzipped->len, 0, 0)) {
                                 	uwsgi_log("[cache-gzip] stored \"%.*s\" in \"%s\"\n", key_len, key, uc->name);
                         	}
-                        	uwsgi_rwunlock(uc->lock);
+                        	uwsgi_rwunlock(cl);
 				uwsgi_buffer_destroy(gzipped);
 			}
                         free(value);
@@ -339,11 +661,169 @@ next2:
 
 
 
-void uwsgi_cache_init(struct uwsgi_cache *uc) {
+/*
+	incremental store
+
+	the cache lives in anonymous shared memory, the store file is loaded at startup
+	and only the pages dirtied by set/del are written back (by the master) with pwrite().
+	Item links are not trusted on reload, the index is rebuilt by uwsgi_cache_fix()
+*/
+static void cache_setup_incremental_store(struct uwsgi_cache *uc) {
+	struct stat cst;
+
+	// the store is updated with pwrite(), not supported by hugetlbfs
+	if (uwsgi_path_page_size(uc->store) > (uint64_t) uwsgi.page_size) {
+		uwsgi_log("incremental cache stores are not supported on hugetlbfs: %s\n", uc->store);
+		exit(1);
+	}
 
-	uc->hashtable = uwsgi_calloc_shared(sizeof(uint64_t) * uc->hashsize);
+	uc->items = (struct uwsgi_cache_item *) uwsgi_mmap_shared(uc->filesize, &uc->page_size);
+	if (uc->items == MAP_FAILED) {
+		uwsgi_error("cache_setup_incremental_store()/mmap()");
+		exit(1);
+	}
+
+	uc->store_pages = (uc->filesize + uwsgi.page_size - 1) / uwsgi.page_size;
+	uc->store_dirty = uwsgi_calloc_shared(sizeof(uint64_t) * ((uc->store_pages / 64) + 1));
+
+	if (uc->store_delete && !stat(uc->store, &cst) && ((size_t) cst.st_size != uc->filesize || !S_ISREG(cst.st_mode))) {
+		uwsgi_log("Removing invalid cache store file: %s\n", uc->store);
+		if (unlink(uc->store) != 0) {
+			uwsgi_log("Cannot remove invalid cache store file: %s\n", uc->store);
+			exit(1);
+		}
+	}
+
+	if (stat(uc->store, &cst)) {
+		uwsgi_log("creating a new cache store file: %s\n", uc->store);
+		uc->store_fd = open(uc->store, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+		if (uc->store_fd < 0) {
+			uwsgi_error_open(uc->store);
+			exit(1);
+		}
+		if (ftruncate(uc->store_fd, uc->filesize)) {
+			uwsgi_error("cache_setup_incremental_store()/ftruncate()");
+			exit(1);
+		}
+		// anonymous memory is already zeroed
+		return;
+	}
+
+	if ((size_t) cst.st_size != uc->filesize || !S_ISREG(cst.st_mode)) {
+		uwsgi_log("invalid cache store file. Please remove it or fix cache blocksize/items to match its size\n");
+		exit(1);
+	}
+
+	uc->store_fd = open(uc->store, O_RDWR);
+	if (uc->store_fd < 0) {
+		uwsgi_error_open(uc->store);
+		exit(1);
+	}
+
+	// a sequential read is way faster than faulting in the whole mapping
+	char *ptr = (char *) uc->items;
+	size_t remains = uc->filesize;
+	while(remains > 0) {
+		ssize_t rlen = pread(uc->store_fd, ptr, remains, ptr - (char *) uc->items);
+		if (rlen <= 0) {
+			uwsgi_error("cache_setup_incremental_store()/pread()");
+			exit(1);
+		}
+		ptr += rlen;
+		remains -= rlen;
+	}
+	uwsgi_log("recovered cache from backing store file: %s\n", uc->store);
+	uwsgi_cache_fix(uc);
+}
+
+static void cache_store_dirty(struct uwsgi_cache *uc, void *ptr, uint64_t len) {
+	if (!uc->store_dirty || !len) return;
+	uint64_t offset = (char *) ptr - (char *) uc->items;
+	uint64_t page = offset / uwsgi.page_size;
+	uint64_t last = (offset + len - 1) / uwsgi.page_size;
+	for(;page<=last;page++) {
+		uwsgi_atomic_or(&uc->store_dirty[page / 64], 1LLU << (page % 64));
+	}
+}
+
+#define cache_item_dirty(uc, index) cache_store_dirty(uc, cache_item(index), sizeof(struct uwsgi_cache_item) + (uc)->keysize)
+#define cache_value_dirty(uc, uci, len) cache_store_dirty(uc, ((char *) (uc)->data) + ((uci)->first_block * (uc)->blocksize), len)
+
+static int cache_store_write(struct uwsgi_cache *uc, uint64_t first_page, uint64_t pages) {
+	uint64_t offset = first_page * uwsgi.page_size;
+	uint64_t len = pages * uwsgi.page_size;
+	if (offset + len > uc->filesize) len = uc->filesize - offset;
+	char *ptr = ((char *) uc->items) + offset;
+	while(len > 0) {
+		ssize_t wlen = pwrite(uc->store_fd, ptr, len, ptr - (char *) uc->items);
+		if (wlen <= 0) {
+			uwsgi_error("cache_store_write()/pwrite()");
+			return -1;
+		}
+		ptr += wlen;
+		len -= wlen;
+	}
+	return 0;
+}
+
+// write back the dirty pages, consecutive pages are coalesced in a single write
+static void cache_store_flush(struct uwsgi_cache *uc) {
+	if (uc->segments) {
+		uint64_t i;
+		for(i=0;i<uc->segments;i++) {
+			cache_store_flush(uc->segment[i]);
+		}
+		return;
+	}
+	uint64_t words = (uc->store_pages / 64) + 1;
+	uint64_t run_start = 0, run_len = 0;
+	uint64_t i;
+	for(i=0;i<words;i++) {
+		if (!uc->store_dirty[i]) {
+			continue;
+		}
+		// pages dirtied from now on will be written in the next round
+		uint64_t dirty = uwsgi_atomic_get_and_clear(&uc->store_dirty[i]);
+		uint8_t bit;
+		for(bit=0;bit<64;bit++) {
+			if (!(dirty & (1LLU << bit))) continue;
+			uint64_t page = (i * 64) + bit;
+			if (run_len && run_start + run_len == page) {
+				run_len++;
+				continue;
+			}
+			if (run_len && cache_store_write(uc, run_start, run_len)) return;
+			run_start = page;
+			run_len = 1;
+		}
+	}
+	if (run_len) cache_store_write(uc, run_start, run_len);
+}
+
+// allocate the hashtable, the items/blocks area (optionally backed by a store file) and the lock
+static void cache_setup_memory(struct uwsgi_cache *uc) {
+
+	if (uc->open_index) {
+		// power of two, at least twice the number of items to keep probe sequences short
+		uc->hashsize = 8;
+		while(uc->hashsize < uc->max_items * 2) uc->hashsize <<= 1;
+		uc->buckets = uwsgi_calloc_shared(sizeof(struct uwsgi_cache_bucket) * uc->hashsize);
+	}
+	else {
+		uc->hashtable = uwsgi_calloc_shared(sizeof(uint64_t) * uc->hashsize);
+	}
+	// the sequence counters are used by optimistic readers and as items generation by snapshots
+	uc->seqlocks = uwsgi_calloc_shared(sizeof(uint32_t) * uc->hashsize);
 	uc->unused_blocks_stack = uwsgi_calloc_shared(sizeof(uint64_t) * uc->max_items);
 	uc->unused_blocks_stack_ptr = 0;
+	uc->generation = uwsgi_calloc_shared(sizeof(uint64_t));
+	// the wheel is only needed when expired items are actively removed
+	if (!uc->no_expire && !uc->purge_lru && !uc->lazy_expire) {
+		if (!uc->wheel_slots) uc->wheel_slots = 4096;
+		uc->wheel = uwsgi_calloc_shared(sizeof(uint64_t) * uc->wheel_slots);
+		uc->wheel_next = uwsgi_calloc_shared(sizeof(uint64_t) * uc->max_items);
+		uc->wheel_prev = uwsgi_calloc_shared(sizeof(uint64_t) * uc->max_items);
+	}
 	uc->filesize = ( (sizeof(struct uwsgi_cache_item)+uc->keysize) * uc->max_items) + (uc->blocksize * uc->blocks);
 
 	uint64_t i;
@@ -360,14 +840,29 @@ void uwsgi_cache_init(struct uwsgi_cache *uc) {
 		if (m > 0) {
 			uc->blocks_bitmap[uc->blocks_bitmap_size-1] = 0xff >> m;
 		}
+		if (uc->slab_blocks) cache_setup_slabs(uc);
 	}
 
 	//uwsgi.cache_items = (struct uwsgi_cache_item *) mmap(NULL, sizeof(struct uwsgi_cache_item) * uwsgi.cache_max_items, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
-	if (uc->store) {
+	if (uc->store && uc->store_incremental) {
+		cache_setup_incremental_store(uc);
+	}
+	else if (uc->store) {
 		int cache_fd;
 		struct stat cst;
+		size_t store_size = uc->filesize;
+
+		// store files on hugetlbfs are sized in multiples of the huge page size (and they cannot be sendfile()d)
+		uc->page_size = uwsgi_path_page_size(uc->store);
+		if (uc->page_size > (uint64_t) uwsgi.page_size) {
+			store_size = ((uc->filesize + uc->page_size - 1) / uc->page_size) * uc->page_size;
+			if (uc->store_sendfile) {
+				uwsgi_log("cache store %s is on hugetlbfs, store_sendfile disabled\n", uc->store);
+				uc->store_sendfile = 0;
+			}
+		}
 
-        if (uc->store_delete && !stat(uc->store, &cst) && ((size_t) cst.st_size != uc->filesize || !S_ISREG(cst.st_mode))) {
+        if (uc->store_delete && !stat(uc->store, &cst) && ((size_t) cst.st_size != store_size || !S_ISREG(cst.st_mode))) {
             uwsgi_log("Removing invalid cache store file: %s\n", uc->store);
             if (unlink(uc->store) != 0) {
                 uwsgi_log("Cannot remove invalid cache store file: %s\n", uc->store);
@@ -380,14 +875,14 @@ void uwsgi_cache_init(struct uwsgi_cache *uc) {
 			cache_fd = open(uc->store, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
 			if (cache_fd >= 0) {
 				// fill the caching store
-				if (ftruncate(cache_fd, uc->filesize)) {
+				if (ftruncate(cache_fd, store_size)) {
 					uwsgi_log("ftruncate()");
 					exit(1);
 				}
 			}
 		}
 		else {
-			if ((size_t) cst.st_size != uc->filesize || !S_ISREG(cst.st_mode)) {
+			if ((size_t) cst.st_size != store_size || !S_ISREG(cst.st_mode)) {
 				uwsgi_log("invalid cache store file. Please remove it or fix cache blocksize/items to match its size\n");
 				exit(1);
 			}
@@ -399,17 +894,23 @@ void uwsgi_cache_init(struct uwsgi_cache *uc) {
 			uwsgi_error_open(uc->store);
 			exit(1);
 		}
-		uc->items = (struct uwsgi_cache_item *) mmap(NULL, uc->filesize, PROT_READ | PROT_WRITE, MAP_SHARED, cache_fd, 0);
+		uc->items = (struct uwsgi_cache_item *) mmap(NULL, store_size, PROT_READ | PROT_WRITE, MAP_SHARED, cache_fd, 0);
 		if (uc->items == MAP_FAILED) {
 			uwsgi_error("uwsgi_cache_init()/mmap() [with store]");
 			exit(1);
 		}
 
 		uwsgi_cache_fix(uc);
-		close(cache_fd);
+		// keep the store open for serving values with sendfile()
+		if (uc->store_sendfile) {
+			uc->store_fd = cache_fd;
+		}
+		else {
+			close(cache_fd);
+		}
 	}
 	else {
-		uc->items = (struct uwsgi_cache_item *) mmap(NULL, uc->filesize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+		uc->items = (struct uwsgi_cache_item *) uwsgi_mmap_shared(uc->filesize, &uc->page_size);
 		if (uc->items == MAP_FAILED) {
 			uwsgi_error("uwsgi_cache_init()/mmap()");
 			exit(1);
@@ -423,6 +924,8 @@ void uwsgi_cache_init(struct uwsgi_cache *uc) {
 
 	uc->data = ((char *)uc->items) + ((sizeof(struct uwsgi_cache_item)+uc->keysize) * uc->max_items);
 
+	if (uc->store && uc->slab_blocks) cache_rebuild_slabs(uc);
+
 	if (uc->name) {
 		// can't free that until shutdown
 		char *lock_name = uwsgi_concat2("cache_", uc->name);
@@ -431,16 +934,127 @@ void uwsgi_cache_init(struct uwsgi_cache *uc) {
 	else {
 		uc->lock = uwsgi_rwlock_init("cache");
 	}
+}
+
+/*
+	segmented caches
+
+	with segments=N the cache is split in N sub-caches, each one with its own hashtable,
+	lru list, items area and lock. Keys are routed to a segment by their hash, so concurrent
+	operations on different keys do not contend for the same lock.
+
+	The parent cache only holds the configuration, the routing table and a lock
+	(still used by whole-cache operations). Item indexes of the parent are mapped to
+	segment * items_per_segment + local index.
+*/
+
+static void cache_setup_segments(struct uwsgi_cache *uc) {
+	uint64_t i;
+	uint64_t items = uc->max_items / uc->segments;
+	if (uc->max_items % uc->segments) items++;
+	// slot 0 of each segment is reserved
+	items++;
+	uint64_t blocks = uc->blocks / uc->segments;
+	if (uc->blocks % uc->segments) blocks++;
+	if (blocks < items) blocks = items;
+	uint64_t hashsize = uc->hashsize / uc->segments;
+	if (!hashsize) hashsize = 1;
+
+	uc->segment = uwsgi_calloc_shared(sizeof(struct uwsgi_cache *) * uc->segments);
+	uc->filesize = 0;
+
+	for(i=0;i<uc->segments;i++) {
+		struct uwsgi_cache *ucs = uwsgi_calloc_shared(sizeof(struct uwsgi_cache));
+		char *num = uwsgi_num2str(i);
+		ucs->name = uwsgi_concat3(uc->name, "#", num);
+		ucs->name_len = strlen(ucs->name);
+		if (uc->store) {
+			ucs->store = uwsgi_concat3(uc->store, ".", num);
+		}
+		free(num);
+
+		ucs->keysize = uc->keysize;
+		ucs->blocksize = uc->blocksize;
+		ucs->blocks = blocks;
+		ucs->max_items = items;
+		ucs->hashsize = hashsize;
+		ucs->hash = uc->hash;
+		ucs->use_blocks_bitmap = uc->use_blocks_bitmap;
+		ucs->slab_blocks = uc->slab_blocks;
+		ucs->max_item_size = uc->use_blocks_bitmap ? ucs->blocksize * ucs->blocks : ucs->blocksize;
+		ucs->use_last_modified = uc->use_last_modified;
+		ucs->no_expire = uc->no_expire;
+		ucs->math_initial = uc->math_initial;
+		ucs->ignore_full = uc->ignore_full;
+		ucs->purge_lru = uc->purge_lru;
+		ucs->lazy_expire = uc->lazy_expire;
+		ucs->optimistic = uc->optimistic;
+		ucs->eviction = uc->eviction;
+		ucs->eviction_samples = uc->eviction_samples;
+		ucs->open_index = uc->open_index;
+		ucs->sweep_on_full = uc->sweep_on_full;
+		ucs->wheel_slots = uc->wheel_slots;
+		ucs->clear_on_full = uc->clear_on_full;
+		ucs->store_sync = uc->store_sync;
+		ucs->store_delete = uc->store_delete;
+		ucs->store_incremental = uc->store_incremental;
+		ucs->store_sendfile = uc->store_sendfile;
+
+		cache_setup_memory(ucs);
+		uc->filesize += ucs->filesize;
+		uc->segment[i] = ucs;
+	}
+
+	// the parent cache exposes the whole (global) index space
+	uc->max_items = items * uc->segments;
+	uc->blocks = blocks * uc->segments;
+	uc->hashsize = uc->segment[0]->hashsize * uc->segments;
+	uc->max_item_size = uc->segment[0]->max_item_size;
+	uc->page_size = uc->segment[0]->page_size;
+
+	char *lock_name = uwsgi_concat2("cache_", uc->name);
+	uc->lock = uwsgi_rwlock_init(lock_name);
+}
+
+static inline struct uwsgi_cache *cache_segment(struct uwsgi_cache *uc, char *key, uint16_t keylen) {
+	uint64_t hash = uwsgi_hash_algo_64(uc->hash, key, keylen);
+	// fibonacci hashing, to not correlate with the hashtable slot chosen inside the segment
+	return uc->segment[((hash * 0x9E3779B97F4A7C15LLU) >> 32) % uc->segments];
+}
+
+static inline struct uwsgi_cache *cache_segment_by_index(struct uwsgi_cache *uc, uint64_t index, uint64_t *local_index) {
+	uint64_t items = uc->max_items / uc->segments;
+	*local_index = index % items;
+	return uc->segment[(index / items) % uc->segments];
+}
+
+void uwsgi_cache_init(struct uwsgi_cache *uc) {
+
+	if (uc->segments > 1) {
+		cache_setup_segments(uc);
+	}
+	else {
+		uc->segments = 0;
+		cache_setup_memory(uc);
+	}
 
-	uwsgi_log("*** Cache \"%s\" initialized: %lluMB (key: %llu bytes, keys: %llu bytes, data: %llu bytes, bitmap: %llu bytes) preallocated ***\n",
+	uwsgi_log("*** Cache \"%s\" initialized: %lluMB (key: %llu bytes, keys: %llu bytes, data: %llu bytes, bitmap: %llu bytes, segments: %llu) preallocated ***\n",
 			uc->name,
 			(unsigned long long) uc->filesize / (1024 * 1024),
 			(unsigned long long) sizeof(struct uwsgi_cache_item)+uc->keysize,
 			(unsigned long long) ((sizeof(struct uwsgi_cache_item)+uc->keysize) * uc->max_items), (unsigned long long) (uc->blocksize * uc->blocks),
-			(unsigned long long) uc->blocks_bitmap_size);
+			(unsigned long long) (uc->segments ? uc->segment[0]->blocks_bitmap_size * uc->segments : uc->blocks_bitmap_size),
+			(unsigned long long) uc->segments);
 
 	uwsgi_cache_setup_nodes(uc);
 
+	if (uc->replication) {
+		struct uwsgi_cache_replication *ucr = uc->replication;
+		ucr->lock = uwsgi_lock_init(uwsgi_concat2("cache_replication_", uc->name));
+		ucr->buf = uwsgi_calloc_shared(ucr->size);
+		ucr->node_id = (((uint64_t) uwsgi_micros()) << 16) ^ getpid();
+	}
+
 	uc->udp_node_socket = socket(AF_INET, SOCK_DGRAM, 0);
 	if (uc->udp_node_socket < 0) {
 		uwsgi_error("[cache-udp-node] socket()");
@@ -456,6 +1070,34 @@ void uwsgi_cache_init(struct uwsgi_cache *uc) {
 
 }
 
+/*
+	optimistic reads
+
+	writers (always holding the write lock) make the sequence counter of the hashtable slot
+	they are modifying odd for the whole duration of the change. Readers do not lock: they
+	copy the value and retry if the counter was odd or changed in the meantime.
+
+	Nested changes of the same slot (like LRU purging during a set) are already covered
+	by the outer one, so seqlock_begin() returns 0 for them.
+*/
+// with the open addressing index items can move between buckets, so a single counter is used
+#define cache_seqlock_slot(uc, hash) ((uc)->buckets ? 0 : (hash) % (uc)->hashsize)
+
+static int cache_seqlock_begin(struct uwsgi_cache *uc, uint64_t hash) {
+	if (!uc->seqlocks) return 0;
+	uint32_t *seq = &uc->seqlocks[cache_seqlock_slot(uc, hash)];
+	if (*seq & 1) return 0;
+	(*seq)++;
+	uwsgi_barrier();
+	return 1;
+}
+
+static void cache_seqlock_end(struct uwsgi_cache *uc, uint64_t hash, int started) {
+	if (!started) return;
+	uwsgi_barrier();
+	uc->seqlocks[cache_seqlock_slot(uc, hash)]++;
+}
+
 static uint64_t check_lazy(struct uwsgi_cache *uc, struct uwsgi_cache_item *uci, uint64_t slot) {
 	if (!uci->expires || !uc->lazy_expire) return slot;
 	uint64_t now = (uint64_t) uwsgi_now();
@@ -467,10 +1109,75 @@ static uint64_t check_lazy(struct uwsgi_cache *uc, struct uwsgi_cache_item *uci,
 	return slot;
 }
 
+/*
+	open addressing index
+
+	buckets store the (low 32 bits of the) hash of the key inline, so most of the misses are detected
+	without touching the items memory. Deletions use backward shifting (no tombstones).
+*/
+
+static uint64_t cache_open_lookup(struct uwsgi_cache *uc, uint64_t hash, char *key, uint16_t keylen) {
+	uint64_t mask = uc->hashsize - 1;
+	uint64_t i = hash & mask;
+	uint64_t rounds = 0;
+	while(uc->buckets[i].slot) {
+		if (uc->buckets[i].hash == (uint32_t) hash) {
+			struct uwsgi_cache_item *uci = cache_item(uc->buckets[i].slot);
+			if (uci->hash == hash && uci->keysize == keylen && !memcmp(uci->key, key, keylen)) {
+				return uc->buckets[i].slot;
+			}
+		}
+		i = (i + 1) & mask;
+		if (++rounds >= uc->hashsize) break;
+	}
+	return 0;
+}
+
+static void cache_open_insert(struct uwsgi_cache *uc, uint64_t hash, uint64_t slot) {
+	uint64_t mask = uc->hashsize - 1;
+	uint64_t i = hash & mask;
+	// the table is always at least twice the number of items, so a free bucket exists
+	while(uc->buckets[i].slot) {
+		i = (i + 1) & mask;
+	}
+	uc->buckets[i].hash = (uint32_t) hash;
+	uc->buckets[i].slot = slot;
+}
+
+static void cache_open_remove(struct uwsgi_cache *uc, uint64_t hash, uint64_t slot) {
+	uint64_t mask = uc->hashsize - 1;
+	uint64_t i = hash & mask;
+	uint64_t rounds = 0;
+	while(uc->buckets[i].slot != slot) {
+		if (!uc->buckets[i].slot || ++rounds >= uc->hashsize) return;
+		i = (i + 1) & mask;
+	}
+	// shift back the following items of the cluster that are not in their home bucket
+	uint64_t j = i;
+	for(;;) {
+		j = (j + 1) & mask;
+		if (!uc->buckets[j].slot) break;
+		uint64_t k = uc->buckets[j].hash & mask;
+		if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+			uc->buckets[i] = uc->buckets[j];
+			i = j;
+		}
+	}
+	uc->buckets[i].slot = 0;
+	uc->buckets[i].hash = 0;
+}
+
 static uint64_t uwsgi_cache_get_index(struct uwsgi_cache *uc, char *key, uint16_t keylen) {
 
-	uint32_t hash = uc->hash->func(key, keylen);
-	uint32_t hash_key = hash % uc->hashsize;
+	uint64_t hash = uwsgi_hash_algo_64(uc->hash, key, keylen);
+
+	if (uc->buckets) {
+		uint64_t slot = cache_open_lookup(uc, hash, key, keylen);
+		if (!slot) return 0;
+		return check_lazy(uc, cache_item(slot), slot);
+	}
+
+	uint64_t hash_key = hash % uc->hashsize;
 
 	uint64_t slot = uc->hashtable[hash_key];
 
@@ -525,6 +1232,8 @@ cycle:
 
 uint32_t uwsgi_cache_exists2(struct uwsgi_cache *uc, char *key, uint16_t keylen) {
 
+	if (uc->segments) uc = cache_segment(uc, key, keylen);
+
 	return uwsgi_cache_get_index(uc, key, keylen);
 }
 
@@ -562,6 +1271,8 @@ static void lru_add_item(struct uwsgi_cache *uc, uint64_t index)
 
 char *uwsgi_cache_get2(struct uwsgi_cache *uc, char *key, uint16_t keylen, uint64_t * valsize) {
 
+	if (uc->segments) uc = cache_segment(uc, key, keylen);
+
 	uint64_t index = uwsgi_cache_get_index(uc, key, keylen);
 
 	if (index) {
@@ -573,24 +1284,32 @@ char *uwsgi_cache_get2(struct uwsgi_cache *uc, char *key, uint16_t keylen, uint6
 			lru_remove_item(uc, index);
 			lru_add_item(uc, index);
 		}
+		else if (uc->eviction) {
+			cache_item_touch(uc, uci);
+		}
 		uci->hits++;
 		uc->hits++;
+		uwsgi_probe4(cache_hit, uc->name, key, keylen, uci->valsize);
 		return uc->data + (uci->first_block * uc->blocksize);
 	}
 
 	uc->miss++;
+	uwsgi_probe3(cache_miss, uc->name, key, keylen);
 
 	return NULL;
 }
 
 int64_t uwsgi_cache_num2(struct uwsgi_cache *uc, char *key, uint16_t keylen) {
 
+	if (uc->segments) uc = cache_segment(uc, key, keylen);
+
         uint64_t index = uwsgi_cache_get_index(uc, key, keylen);
 
         if (index) {
                 struct uwsgi_cache_item *uci = cache_item(index);
 		if (uci->flags & UWSGI_CACHE_FLAG_UNGETTABLE)
                         return 0;
+		if (uc->eviction) cache_item_touch(uc, uci);
                 uci->hits++;
                 uc->hits++;
 		int64_t *num = (int64_t *) (uc->data + (uci->first_block * uc->blocksize));
@@ -603,6 +1322,8 @@ int64_t uwsgi_cache_num2(struct uwsgi_cache *uc, char *key, uint16_t keylen) {
 
 char *uwsgi_cache_get3(struct uwsgi_cache *uc, char *key, uint16_t keylen, uint64_t * valsize, uint64_t *expires) {
 
+	if (uc->segments) uc = cache_segment(uc, key, keylen);
+
         uint64_t index = uwsgi_cache_get_index(uc, key, keylen);
 
         if (index) {
@@ -616,18 +1337,25 @@ char *uwsgi_cache_get3(struct uwsgi_cache *uc, char *key, uint16_t keylen, uint6
 			lru_remove_item(uc, index);
 			lru_add_item(uc, index);
 		}
+		else if (uc->eviction) {
+			cache_item_touch(uc, uci);
+		}
                 uci->hits++;
                 uc->hits++;
+                uwsgi_probe4(cache_hit, uc->name, key, keylen, uci->valsize);
                 return uc->data + (uci->first_block * uc->blocksize);
         }
 
         uc->miss++;
+        uwsgi_probe3(cache_miss, uc->name, key, keylen);
 
         return NULL;
 }
 
 char *uwsgi_cache_get4(struct uwsgi_cache *uc, char *key, uint16_t keylen, uint64_t * valsize, uint64_t *hits) {
 
+	if (uc->segments) uc = cache_segment(uc, key, keylen);
+
         uint64_t index = uwsgi_cache_get_index(uc, key, keylen);
 
         if (index) {
@@ -637,16 +1365,123 @@ char *uwsgi_cache_get4(struct uwsgi_cache *uc, char *key, uint16_t keylen, uint6
                 *valsize = uci->valsize;
                 if (hits)
                         *hits = uci->hits;
+		if (uc->eviction) cache_item_touch(uc, uci);
                 uci->hits++;
                 uc->hits++;
+                uwsgi_probe4(cache_hit, uc->name, key, keylen, uci->valsize);
                 return uc->data + (uci->first_block * uc->blocksize);
         }
 
         uc->miss++;
+        uwsgi_probe3(cache_miss, uc->name, key, keylen);
 
         return NULL;
 }
 
+/*
+	lock-less get (requires optimistic=1), returns a newly allocated copy of the value.
+
+	The chain walk and the copy are bound-checked as concurrent writers could change
+	them under us; after the copy the slot sequence counter tells us if the result is valid.
+	After a bunch of failed attempts we fallback to the read lock.
+*/
+char *uwsgi_cache_get_optimistic(struct uwsgi_cache *uc, char *key, uint16_t keylen, uint64_t *valsize, uint64_t *expires) {
+
+	if (keylen > uc->keysize) return NULL;
+
+	if (uc->segments) uc = cache_segment(uc, key, keylen);
+
+	char *buf = NULL;
+	uint64_t buf_size = 0;
+	uint64_t hash = uwsgi_hash_algo_64(uc->hash, key, keylen);
+	volatile uint32_t *seq = &uc->seqlocks[cache_seqlock_slot(uc, hash)];
+	uint64_t data_size = uc->blocks * uc->blocksize;
+	int tries;
+
+	for(tries=0;tries<16;tries++) {
+		uint32_t seq_start = *seq;
+		if (seq_start & 1) continue;
+		uwsgi_barrier();
+
+		uint64_t slot = 0;
+		uint64_t bucket = hash & (uc->hashsize - 1);
+		if (uc->buckets) {
+			while((slot = uc->buckets[bucket].slot) && uc->buckets[bucket].hash != (uint32_t) hash) {
+				bucket = (bucket + 1) & (uc->hashsize - 1);
+			}
+		}
+		else {
+			slot = uc->hashtable[hash % uc->hashsize];
+		}
+		uint64_t rounds = 0;
+		int found = 0;
+		uint64_t vsize = 0, vexpires = 0;
+		while(slot && slot < uc->max_items && rounds++ <= uc->max_items) {
+			struct uwsgi_cache_item *uci = cache_item(slot);
+			if (uci->hash == hash && uci->keysize == keylen && !memcmp(uci->key, key, keylen)) {
+				uint64_t first_block = uci->first_block;
+				vsize = uci->valsize;
+				vexpires = uci->expires;
+				if (uci->flags & UWSGI_CACHE_FLAG_UNGETTABLE) break;
+				if (uc->lazy_expire && vexpires && vexpires <= (uint64_t) uwsgi_now()) break;
+				if (first_block >= uc->blocks || vsize > data_size - (first_block * uc->blocksize)) break;
+				if (vsize > buf_size) {
+					free(buf);
+					buf = uwsgi_malloc(vsize);
+					buf_size = vsize;
+				}
+				char *src = uc->data + (first_block * uc->blocksize);
+				// counters can be changed by atomic adds outside of the seqlock (see cache_math_fast())
+				if (vsize == 8 && !((uintptr_t) src & 7)) {
+					uint64_t num = __atomic_load_n((uint64_t *) src, __ATOMIC_RELAXED);
+					memcpy(buf, &num, 8);
+				}
+				else {
+					memcpy(buf, src, vsize);
+				}
+				found = 1;
+				break;
+			}
+			if (!uc->buckets) {
+				slot = uci->next;
+				continue;
+			}
+			// next bucket with the same hash
+			do {
+				bucket = (bucket + 1) & (uc->hashsize - 1);
+			} while((slot = uc->buckets[bucket].slot) && uc->buckets[bucket].hash != (uint32_t) hash);
+		}
+
+		uwsgi_barrier();
+		if (*seq != seq_start) continue;
+
+		if (!found) {
+			uc->miss++;
+			uwsgi_probe3(cache_miss, uc->name, key, keylen);
+			free(buf);
+			return NULL;
+		}
+		uc->hits++;
+		uwsgi_probe4(cache_hit, uc->name, key, keylen, vsize);
+		*valsize = vsize;
+		if (expires) *expires = vexpires;
+		return buf;
+	}
+
+	free(buf);
+
+	// too much contention, use the lock
+	uwsgi_rlock(uc->lock);
+	char *value = uwsgi_cache_get3(uc, key, keylen, valsize, expires);
+	if (!value) {
+		uwsgi_rwunlock(uc->lock);
+		return NULL;
+	}
+	buf = uwsgi_malloc(*valsize);
+	memcpy(buf, value, *valsize);
+	uwsgi_rwunlock(uc->lock);
+	return buf;
+}
 
 int uwsgi_cache_del2(struct uwsgi_cache *uc, char *key, uint16_t keylen, uint64_t index, uint16_t flags) {
 
@@ -654,10 +1489,25 @@ int uwsgi_cache_del2(struct uwsgi_cache *uc, char *key, uint16_t keylen, uint64_
 	struct uwsgi_cache_item *uci;
 	int ret = -1;
 
+	if (uc->segments) {
+		if (!index) {
+			ret = uwsgi_cache_del2(cache_segment(uc, key, keylen), key, keylen, 0, flags | UWSGI_CACHE_FLAG_LOCAL);
+		}
+		else {
+			uint64_t local_index = 0;
+			struct uwsgi_cache *ucs = cache_segment_by_index(uc, index, &local_index);
+			// slot 0 of a segment is always free
+			ret = local_index ? uwsgi_cache_del2(ucs, NULL, 0, local_index, flags | UWSGI_CACHE_FLAG_LOCAL) : 0;
+		}
+		goto udp;
+	}
+
 	if (!index) index = uwsgi_cache_get_index(uc, key, keylen);
 
 	if (index) {
 		uci = cache_item(index);
+		uint64_t seq_hash = uci->hash;
+		int seq_started = cache_seqlock_begin(uc, seq_hash);
 		if (uci->keysize > 0) {
 			// unmark blocks
 			if (uc->blocks_bitmap) cache_unmark_blocks(uc, uci->first_block, uci->valsize);
@@ -665,6 +1515,11 @@ int uwsgi_cache_del2(struct uwsgi_cache *uc, char *key, uint16_t keylen, uint64_
 			uc->unused_blocks_stack_ptr++;
 			uc->unused_blocks_stack[uc->unused_blocks_stack_ptr] = index;
 
+			if (uc->buckets) {
+				cache_open_remove(uc, uci->hash, index);
+				goto unlinked;
+			}
+
 			// unlink prev and next (if any)
 			if (uci->prev) {
                         	struct uwsgi_cache_item *ucii = cache_item(uci->prev);
@@ -684,9 +1539,12 @@ int uwsgi_cache_del2(struct uwsgi_cache *uc, char *key, uint16_t keylen, uint64_
                         	// reset hashtable entry
                         	uc->hashtable[uci->hash % uc->hashsize] = 0;
                 	}
+unlinked:
 
 			if (uc->purge_lru)
 				lru_remove_item(uc, index);
+			else if (uc->wheel)
+				cache_wheel_remove(uc, index);
 
 			uc->n_items--;
 		}
@@ -700,11 +1558,17 @@ int uwsgi_cache_del2(struct uwsgi_cache *uc, char *key, uint16_t keylen, uint64_
 		uci->next = 0;
 		uci->expires = 0;
 
+		cache_item_dirty(uc, index);
+		__atomic_add_fetch(uc->generation, 1, __ATOMIC_RELEASE);
+
+		cache_seqlock_end(uc, seq_hash, seq_started);
+
 		if (uc->use_last_modified) {
 			uc->last_modified_at = uwsgi_now();
 		}
 	}
 
+udp:
 	if (uc->nodes && ret == 0 && !(flags & UWSGI_CACHE_FLAG_LOCAL)) {
                 cache_send_udp_command(uc, key, keylen, NULL, 0, 0, 11);
         }
@@ -723,11 +1587,42 @@ void uwsgi_cache_fix(struct uwsgi_cache *uc) {
 	for (i = 1; i < uc->max_items; i++) {
 		// valid record ?
 		struct uwsgi_cache_item *uci = cache_item(i);
-		if (uci->keysize) {
-			if (!uci->prev) {
+		if (uci->keysize && uc->store_incremental) {
+			// links could be stale, rebuild the whole index
+			restored++;
+			uci->prev = 0;
+			uci->next = 0;
+			if (uc->blocks_bitmap) cache_mark_blocks(uc, uci->first_block, uci->valsize);
+			if (uc->purge_lru) lru_add_item(uc, i);
+			if (uc->wheel && uci->expires) cache_wheel_add(uc, i, uci->expires);
+			if (uc->buckets) {
+				cache_open_insert(uc, uci->hash, i);
+				continue;
+			}
+			uint64_t slot = uci->hash % uc->hashsize;
+			uint64_t last_index = uc->hashtable[slot];
+			if (!last_index) {
+				uc->hashtable[slot] = i;
+				continue;
+			}
+			struct uwsgi_cache_item *ucii = cache_item(last_index);
+			while(ucii->next) {
+				last_index = ucii->next;
+				ucii = cache_item(last_index);
+			}
+			ucii->next = i;
+			uci->prev = last_index;
+		}
+		else if (uci->keysize) {
+			restored++;
+			if (uc->blocks_bitmap) cache_mark_blocks(uc, uci->first_block, uci->valsize);
+			if (uc->wheel && uci->expires) cache_wheel_add(uc, i, uci->expires);
+			if (uc->buckets) {
+				cache_open_insert(uc, uci->hash, i);
+			}
+			else if (!uci->prev) {
 				// put value in hash_table
 				uc->hashtable[uci->hash % uc->hashsize] = i;
-				restored++;
 			}
 		}
 		else {
@@ -738,6 +1633,7 @@ void uwsgi_cache_fix(struct uwsgi_cache *uc) {
 	}
 
 	uc->n_items = restored;
+	__atomic_add_fetch(uc->generation, 1, __ATOMIC_RELEASE);
 	uwsgi_log("[uwsgi-cache] restored %llu items\n", uc->n_items);
 }
 
@@ -751,6 +1647,8 @@ int uwsgi_cache_set2(struct uwsgi_cache *uc, char *key, uint16_t keylen, char *v
 
 	int ret = -1;
 	time_t now = 0;
+	int seq_started = 0;
+	uint64_t seq_hash = 0;
 
 	if (!keylen || !vallen)
 		return -1;
@@ -762,6 +1660,18 @@ int uwsgi_cache_set2(struct uwsgi_cache *uc, char *key, uint16_t keylen, char *v
 
 	if ((flags & UWSGI_CACHE_FLAG_MATH) && vallen != 8) return -1;
 
+	if (uc->segments) {
+		ret = uwsgi_cache_set2(cache_segment(uc, key, keylen), key, keylen, val, vallen, expires, flags | UWSGI_CACHE_FLAG_LOCAL);
+		// nodes expect absolute expires
+		if (expires && !(flags & UWSGI_CACHE_FLAG_ABSEXPIRE)) expires += uwsgi_now();
+		goto udp;
+	}
+
+	if (uc->seqlocks) {
+		seq_hash = uwsgi_hash_algo_64(uc->hash, key, keylen);
+		seq_started = cache_seqlock_begin(uc, seq_hash);
+	}
+
 	//uwsgi_log("putting cache data in key %.*s %d\n", keylen, key, vallen);
 	index = uwsgi_cache_get_index(uc, key, keylen);
 	if (!index) {
@@ -780,6 +1690,14 @@ int uwsgi_cache_set2(struct uwsgi_cache *uc, char *key, uint16_t keylen, char *v
 		}
 		else {
 			uci->first_block = uwsgi_cache_find_free_blocks(uc, vallen);
+			// approximated policies can make room by evicting more items
+			if (uc->eviction) {
+				int evictions = 0;
+				while(uci->first_block == 0xffffffffffffffffLLU && evictions++ < 8 && cache_evict(uc, index)) {
+					uc->full++;
+					uci->first_block = uwsgi_cache_find_free_blocks(uc, vallen);
+				}
+			}
 			if (uci->first_block == 0xffffffffffffffffLLU) {
 				uc->unused_blocks_stack_ptr++;
 				cache_full(uc);
@@ -797,14 +1715,19 @@ int uwsgi_cache_set2(struct uwsgi_cache *uc, char *key, uint16_t keylen, char *v
 		}
 		if (uc->purge_lru)
 			lru_add_item(uc, index);
-		else if (expires && !(flags & UWSGI_CACHE_FLAG_ABSEXPIRE)) {
+		else if (uc->eviction) {
+			cache_item_referenced(uci) = 0;
+			cache_item_last_access(uci) = uc->eviction == UWSGI_CACHE_EVICTION_SAMPLED_LRU ? uwsgi_micros() : 0;
+		}
+		if (!uc->purge_lru && expires && !(flags & UWSGI_CACHE_FLAG_ABSEXPIRE)) {
 			now = uwsgi_now();
 			expires += now;
 			if (!uc->next_scan || uc->next_scan > expires)
 				uc->next_scan = expires;
 		}
 		uci->expires = expires;
-		uci->hash = uc->hash->func(key, keylen);
+		if (uc->wheel && expires) cache_wheel_add(uc, index, expires);
+		uci->hash = uwsgi_hash_algo_64(uc->hash, key, keylen);
 		uci->hits = 0;
 		uci->flags = flags;
 		memcpy(uci->key, key, keylen);
@@ -847,8 +1770,10 @@ int uwsgi_cache_set2(struct uwsgi_cache *uc, char *key, uint16_t keylen, char *v
 		uci->prev = 0;
 		uci->next = 0;
 
-		last_index = uc->hashtable[slot];
-		if (last_index == 0) {
+		if (uc->buckets) {
+			cache_open_insert(uc, uci->hash, index);
+		}
+		else if ((last_index = uc->hashtable[slot]) == 0) {
 			uc->hashtable[slot] = index;
 		}
 		else {
@@ -862,6 +1787,9 @@ int uwsgi_cache_set2(struct uwsgi_cache *uc, char *key, uint16_t keylen, char *v
 			uci->prev = last_index;
 		}
 
+		cache_item_dirty(uc, index);
+		cache_value_dirty(uc, uci, vallen);
+
 		uc->n_items++ ;
 	}
 	else if (flags & UWSGI_CACHE_FLAG_UPDATE) {
@@ -876,12 +1804,23 @@ int uwsgi_cache_set2(struct uwsgi_cache *uc, char *key, uint16_t keylen, char *v
 				if (!uc->next_scan || uc->next_scan > expires)
 					uc->next_scan = expires;
 			}
+			if (uc->wheel) {
+				cache_wheel_remove(uc, index);
+				if (expires) cache_wheel_add(uc, index, expires);
+			}
 			uci->expires = expires;
 		}
 		if (uc->blocks_bitmap) {
 			// we have a special case here, as we need to find a new series of free blocks
 			uint64_t old_first_block = uci->first_block;
 			uci->first_block = uwsgi_cache_find_free_blocks(uc, vallen);
+			if (uc->eviction) {
+				int evictions = 0;
+				while(uci->first_block == 0xffffffffffffffffLLU && evictions++ < 8 && cache_evict(uc, index)) {
+					uc->full++;
+					uci->first_block = uwsgi_cache_find_free_blocks(uc, vallen);
+				}
+			}
                         if (uci->first_block == 0xffffffffffffffffLLU) {
 				uci->first_block = old_first_block;
 				cache_full(uc);
@@ -924,6 +1863,8 @@ int uwsgi_cache_set2(struct uwsgi_cache *uc, char *key, uint16_t keylen, char *v
                         }
 		}
 		uci->valsize = vallen;
+		cache_item_dirty(uc, index);
+		cache_value_dirty(uc, uci, vallen);
 		ret = 0;
 	}
 
@@ -931,19 +1872,290 @@ int uwsgi_cache_set2(struct uwsgi_cache *uc, char *key, uint16_t keylen, char *v
 		uc->last_modified_at = (now ? now : uwsgi_now());
 	}
 
+	if (ret == 0) __atomic_add_fetch(uc->generation, 1, __ATOMIC_RELEASE);
+
+	// readers can go on, udp nodes are managed outside of the critical section
+	cache_seqlock_end(uc, seq_hash, seq_started);
+	seq_started = 0;
+
+udp:
 	if (uc->nodes && ret == 0 && !(flags & UWSGI_CACHE_FLAG_LOCAL)) {
 		cache_send_udp_command(uc, key, keylen, val, vallen, expires, 10);
 	}
 
 
 end:
+	cache_seqlock_end(uc, seq_hash, seq_started);
+	uwsgi_probe6(cache_set, uc->name, key, keylen, vallen, flags, ret);
 	return ret;
 
 }
 
 
+/*
+	lock-free counters
+
+	incrementing (or decrementing) an existing 64bit counter does not need the write lock:
+	the item is looked up under the read lock (so it cannot be moved or freed) and its value
+	is changed with an atomic add. Missing or expired counters, the other operations and
+	the caches replicating to udp nodes take the classic path under the write lock.
+*/
+
+// side-effect free lookup (no lazy expiration)
+static uint64_t cache_find_slot(struct uwsgi_cache *uc, uint64_t hash, char *key, uint16_t keylen) {
+	if (uc->buckets) return cache_open_lookup(uc, hash, key, keylen);
+	uint64_t slot = uc->hashtable[hash % uc->hashsize];
+	uint64_t rounds = 0;
+	while(slot && rounds++ <= uc->max_items) {
+		struct uwsgi_cache_item *uci = cache_item(slot);
+		if (uci->hash == hash && uci->keysize == keylen && !memcmp(uci->key, key, keylen)) return slot;
+		slot = uci->next;
+	}
+	return 0;
+}
+
+static int cache_math_can_fast(struct uwsgi_cache *uc, uint64_t vallen, uint64_t flags) {
+	if (uc->nodes || vallen != 8) return 0;
+	uint64_t required = UWSGI_CACHE_FLAG_UPDATE | UWSGI_CACHE_FLAG_MATH | UWSGI_CACHE_FLAG_FIXEXPIRE;
+	if ((flags & required) != required) return 0;
+	return (flags & (UWSGI_CACHE_FLAG_INC | UWSGI_CACHE_FLAG_DEC)) ? 1 : 0;
+}
+
+// must be called with the read lock held, returns 1 if the classic path is required
+static int cache_math_fast(struct uwsgi_cache *uc, char *key, uint16_t keylen, char *val, uint64_t flags) {
+	if (keylen > uc->keysize) return 1;
+	uint64_t hash = uwsgi_hash_algo_64(uc->hash, key, keylen);
+	uint64_t slot = cache_find_slot(uc, hash, key, keylen);
+	if (!slot) return 1;
+
+	struct uwsgi_cache_item *uci = cache_item(slot);
+	if (uci->valsize != 8) return 1;
+	if (uc->lazy_expire && uci->expires && uci->expires <= (uint64_t) uwsgi_now()) return 1;
+	int64_t *num = (int64_t *) (((char *) uc->data) + (uci->first_block * uc->blocksize));
+	if ((uintptr_t) num & 7) return 1;
+
+	int64_t delta;
+	memcpy(&delta, val, 8);
+	if (flags & UWSGI_CACHE_FLAG_INC) {
+		__atomic_add_fetch(num, delta, __ATOMIC_RELAXED);
+	}
+	else {
+		__atomic_sub_fetch(num, delta, __ATOMIC_RELAXED);
+	}
+
+	cache_value_dirty(uc, uci, 8);
+	if (uc->use_last_modified) uc->last_modified_at = uwsgi_now();
+	__atomic_add_fetch(uc->generation, 1, __ATOMIC_RELEASE);
+	uwsgi_probe6(cache_set, uc->name, key, keylen, 8, flags, 0);
+	return 0;
+}
+
+/*
+	batched replication
+
+	updates are appended (with a sequence number) to a shared buffer and a master thread sends
+	them in batches (modifier2 12) to all of the nodes with a single sendmmsg() per round.
+
+	record: [seq 8][cmd 1][keylen 2][vallen 2][expires 8] + key + value
+	packet: [uwsgi header][node id 8][last seq 8] + records
+
+	when a node finds a hole in the sequence it resyncs itself from the sync nodes.
+	Idle nodes send an empty packet every second, so holes at the end of a burst are found too
+*/
+
+#define UWSGI_CACHE_REPLICATION_RECORD 21
+#define UWSGI_CACHE_REPLICATION_PACKET 32768
+
+static void cache_replication_append(struct uwsgi_cache *uc, char *key, uint16_t keylen, char *val, uint16_t vallen, uint64_t expires, uint8_t cmd) {
+	struct uwsgi_cache_replication *ucr = uc->replication;
+	uint64_t len = UWSGI_CACHE_REPLICATION_RECORD + keylen + vallen;
+
+	uwsgi_lock(ucr->lock);
+	uint64_t seq = ++ucr->seq;
+	// the sequence number is consumed anyway, so the nodes will notice the hole
+	if (ucr->pos + len > ucr->size || 20 + len > UWSGI_CACHE_REPLICATION_PACKET) {
+		ucr->dropped++;
+		uwsgi_unlock(ucr->lock);
+		return;
+	}
+	char *ptr = ucr->buf + ucr->pos;
+	memcpy(ptr, &seq, 8);
+	ptr[8] = cmd;
+	memcpy(ptr + 9, &keylen, 2);
+	memcpy(ptr + 11, &vallen, 2);
+	memcpy(ptr + 13, &expires, 8);
+	memcpy(ptr + UWSGI_CACHE_REPLICATION_RECORD, key, keylen);
+	if (vallen > 0) memcpy(ptr + UWSGI_CACHE_REPLICATION_RECORD + keylen, val, vallen);
+	ucr->pos += len;
+	uwsgi_unlock(ucr->lock);
+}
+
+static void cache_replication_send(struct uwsgi_cache *uc, char **packets, uint16_t *packets_len, int n) {
+	if (!uc->nodes || !n) return;
+
+	int i;
+	struct iovec *iov = uwsgi_malloc(sizeof(struct iovec) * n);
+	for(i=0;i<n;i++) {
+		iov[i].iov_base = packets[i];
+		iov[i].iov_len = packets_len[i];
+	}
+	// the socket is non blocking, packets not sent will be resynced by the nodes
+	uwsgi_dgram_send_nodes(uc->udp_node_socket, iov, n, uc->nodes);
+	free(iov);
+}
+
+static void *cache_replication_loop(void *ucache) {
+	// block all signals
+	sigset_t smask;
+	sigfillset(&smask);
+	pthread_sigmask(SIG_BLOCK, &smask, NULL);
+
+	struct uwsgi_cache *uc = (struct uwsgi_cache *) ucache;
+	struct uwsgi_cache_replication *ucr = uc->replication;
+	char *buf = uwsgi_malloc(ucr->size);
+	int max_packets = (ucr->size / (UWSGI_CACHE_REPLICATION_PACKET / 2)) + 2;
+	char **packets = uwsgi_malloc(sizeof(char *) * max_packets);
+	uint16_t *packets_len = uwsgi_malloc(sizeof(uint16_t) * max_packets);
+	int i;
+	for(i=0;i<max_packets;i++) {
+		packets[i] = uwsgi_malloc(UWSGI_CACHE_REPLICATION_PACKET);
+	}
+	uint64_t last_send = 0;
+
+	for(;;) {
+		usleep(ucr->freq * 1000);
+
+		// swap out the pending records as fast as possible
+		uwsgi_lock(ucr->lock);
+		uint64_t len = ucr->pos;
+		uint64_t last_seq = ucr->seq;
+		if (len) memcpy(buf, ucr->buf, len);
+		ucr->pos = 0;
+		uwsgi_unlock(ucr->lock);
+
+		uint64_t now = uwsgi_micros();
+		if (!len && now - last_send < 1000000) continue;
+		last_send = now;
+
+		int n = 0;
+		uint64_t pos = 0;
+		packets_len[0] = 0;
+		// heartbeat
+		if (!len) {
+			packets_len[0] = 20;
+			memcpy(packets[0] + 4, &ucr->node_id, 8);
+			memcpy(packets[0] + 12, &last_seq, 8);
+			packets[0][0] = 111;
+			packets[0][3] = 12;
+		}
+		while(pos < len) {
+			uint16_t keylen, vallen;
+			memcpy(&keylen, buf + pos + 9, 2);
+			memcpy(&vallen, buf + pos + 11, 2);
+			uint64_t rlen = UWSGI_CACHE_REPLICATION_RECORD + keylen + vallen;
+			if (!packets_len[n] || packets_len[n] + rlen > UWSGI_CACHE_REPLICATION_PACKET) {
+				if (packets_len[n]) n++;
+				if (n >= max_packets) break;
+				struct uwsgi_header *uh = (struct uwsgi_header *) packets[n];
+				uh->modifier1 = 111;
+				uh->modifier2 = 12;
+				memcpy(packets[n] + 4, &ucr->node_id, 8);
+				memcpy(packets[n] + 12, &last_seq, 8);
+				packets_len[n] = 20;
+			}
+			memcpy(packets[n] + packets_len[n], buf + pos, rlen);
+			packets_len[n] += rlen;
+			pos += rlen;
+		}
+		if (n < max_packets && packets_len[n]) n++;
+		for(i=0;i<n;i++) {
+			struct uwsgi_header *uh = (struct uwsgi_header *) packets[i];
+			uh->_pktsize = packets_len[i] - 4;
+		}
+		cache_replication_send(uc, packets, packets_len, n);
+	}
+
+	return NULL;
+}
+
+struct cache_replication_peer {
+	uint64_t node_id;
+	uint64_t next_seq;
+	struct cache_replication_peer *next;
+};
+
+// apply a batch of updates, returns 1 if a hole in the sequence has been found
+static int cache_replication_apply(struct uwsgi_cache *uc, struct cache_replication_peer **peers, char *buf, uint16_t pktsize) {
+	if (pktsize < 16) return 0;
+	uint64_t node_id, last_seq;
+	memcpy(&node_id, buf + 4, 8);
+	memcpy(&last_seq, buf + 12, 8);
+
+	struct cache_replication_peer *peer = *peers;
+	while(peer) {
+		if (peer->node_id == node_id) break;
+		peer = peer->next;
+	}
+	// a new node (or a restarted one), start following its stream
+	if (!peer) {
+		peer = uwsgi_calloc(sizeof(struct cache_replication_peer));
+		peer->node_id = node_id;
+		peer->next = *peers;
+		*peers = peer;
+	}
+
+	int hole = 0;
+	char *ptr = buf + 20;
+	char *watermark = buf + 4 + pktsize;
+	while(ptr + UWSGI_CACHE_REPLICATION_RECORD <= watermark) {
+		uint64_t seq, expires;
+		uint16_t keylen, vallen;
+		memcpy(&seq, ptr, 8);
+		uint8_t cmd = ptr[8];
+		memcpy(&keylen, ptr + 9, 2);
+		memcpy(&vallen, ptr + 11, 2);
+		memcpy(&expires, ptr + 13, 8);
+		char *key = ptr + UWSGI_CACHE_REPLICATION_RECORD;
+		char *val = key + keylen;
+		if (val + vallen > watermark) break;
+		ptr = val + vallen;
+
+		// duplicated or late record
+		if (peer->next_seq && seq < peer->next_seq) continue;
+		if (peer->next_seq && seq > peer->next_seq) hole = 1;
+		peer->next_seq = seq + 1;
+
+		struct uwsgi_lock_item *cl = uwsgi_cache_key_lock(uc, key, keylen);
+		uwsgi_wlock(cl);
+		if (cmd == 10) {
+			uwsgi_cache_set2(uc, key, keylen, val, vallen, expires, UWSGI_CACHE_FLAG_UPDATE|UWSGI_CACHE_FLAG_LOCAL|UWSGI_CACHE_FLAG_ABSEXPIRE);
+		}
+		else if (cmd == 11) {
+			uwsgi_cache_del2(uc, key, keylen, 0, UWSGI_CACHE_FLAG_LOCAL);
+		}
+		uwsgi_rwunlock(cl);
+	}
+
+	// records after the last received one have been lost (the packet order is not guaranteed, so check only the heartbeats)
+	if (pktsize == 16) {
+		if (!peer->next_seq) {
+			peer->next_seq = last_seq + 1;
+		}
+		else if (last_seq >= peer->next_seq) {
+			hole = 1;
+			peer->next_seq = last_seq + 1;
+		}
+	}
+	return hole;
+}
+
 static void cache_send_udp_command(struct uwsgi_cache *uc, char *key, uint16_t keylen, char *val, uint16_t vallen, uint64_t expires, uint8_t cmd) {
 
+		if (uc->replication && uc->replication->active) {
+			cache_replication_append(uc, key, keylen, val, vallen, expires, cmd);
+			return;
+		}
+
 		struct uwsgi_header uh;
 		uint8_t u_k[2];
 		uint8_t u_v[2];
@@ -1032,62 +2244,96 @@ void *cache_udp_server_loop(void *ucache) {
                                 exit(1);
                         }
                         uwsgi_socket_nb(fd);
+			// make room for bursts of replication packets
+			if (uc->replication) {
+				int rcvbuf = uc->replication->size;
+				if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(int))) {
+					uwsgi_error("[cache-udp-server] setsockopt()");
+				}
+			}
                         event_queue_add_fd_read(queue, fd);
                         uwsgi_log("*** udp server for cache \"%s\" running on %s ***\n", uc->name, usl->value);
                 }
                 usl = usl->next;
         }
 
-        // allocate 64k chunk to receive messages
-        char *buf = uwsgi_malloc(UMAX16);
+        // receive bursts of (up to 64k) messages with a single syscall
+	struct uwsgi_dgram_batch *udb = uwsgi_dgram_batch_new(UWSGI_DGRAM_BATCH, UMAX16);
+	struct cache_replication_peer *peers = NULL;
+	uint64_t last_resync = 0;
+	int resync = 0;
 	
 	for(;;) {
-                uint16_t pktsize = 0, ss = 0;
                 int interesting_fd = -1;
                 int rlen = event_queue_wait(queue, -1, &interesting_fd);
                 if (rlen <= 0) continue;
                 if (interesting_fd < 0) continue;
-                ssize_t len = read(interesting_fd, buf, UMAX16);
-                if (len <= 7) {
-                        uwsgi_error("[cache-udp-server] read()");
-                }
-                if (buf[0] != 111) continue;
-                memcpy(&pktsize, buf+1, 2);
-                if (pktsize != len-4) continue;
-
-                memcpy(&ss, buf + 4, 2);
-                if (4+ss > pktsize) continue;
-                uint16_t keylen = ss;
-                char *key = buf + 6;
-
-                // cache set/update
-                if (buf[3] == 10) {
-                        if (keylen + 2 + 2 > pktsize) continue;
-                        memcpy(&ss, buf + 6 + keylen, 2);
-                        if (4+keylen+ss > pktsize) continue;
-                        uint16_t vallen = ss;
-                        char *val = buf + 8 + keylen;
-                        uint64_t expires = 0;
-                        if (2 + keylen + 2 + vallen + 2 < pktsize) {
-                                memcpy(&ss, buf + 8 + keylen + vallen , 2);
-                                if (6+keylen+vallen+ss > pktsize) continue;
-                                expires = uwsgi_str_num(buf + 10 + keylen+vallen, ss);
-                        }
-                        uwsgi_wlock(uc->lock);
-                        if (uwsgi_cache_set2(uc, key, keylen, val, vallen, expires, UWSGI_CACHE_FLAG_UPDATE|UWSGI_CACHE_FLAG_LOCAL|UWSGI_CACHE_FLAG_ABSEXPIRE)) {
-                                uwsgi_log("[cache-udp-server] unable to update cache\n");
-                        }
-                        uwsgi_rwunlock(uc->lock);
-                }
-                // cache del
-                else if (buf[3] == 11) {
-                        uwsgi_wlock(uc->lock);
-                        if (uwsgi_cache_del2(uc, key, keylen, 0, UWSGI_CACHE_FLAG_LOCAL)) {
-                                uwsgi_log("[cache-udp-server] unable to update cache\n");
-                        }
-                        uwsgi_rwunlock(uc->lock);
-                }
-        }
+		int i, n = uwsgi_dgram_batch_recv(interesting_fd, udb);
+		if (n < 0) {
+			uwsgi_error("[cache-udp-server] recvmmsg()");
+			continue;
+		}
+		for(i=0;i<n;i++) {
+			char *buf = uwsgi_dgram_batch_buf(udb, i);
+			ssize_t len = udb->len[i];
+			uint16_t pktsize = 0, ss = 0;
+			if (len <= 7) continue;
+			if (buf[0] != 111) continue;
+			memcpy(&pktsize, buf+1, 2);
+			if (pktsize != len-4) continue;
+
+			// batched replication
+			if (buf[3] == 12) {
+				if (cache_replication_apply(uc, &peers, buf, pktsize)) {
+					uwsgi_log("[cache-replication] lost updates for cache \"%s\"\n", uc->name);
+					if (uc->sync_nodes && !uc->segments) resync = 1;
+				}
+				// do not resync more than once every 10 seconds (heartbeats will retry)
+				if (!resync || (uint64_t) uwsgi_now() < last_resync + 10) continue;
+				resync = 0;
+				last_resync = uwsgi_now();
+				uwsgi_cache_wlock(uc);
+				uwsgi_cache_sync_from_nodes(uc);
+				uwsgi_cache_rwunlock(uc);
+				continue;
+			}
+
+			memcpy(&ss, buf + 4, 2);
+			if (4+ss > pktsize) continue;
+			uint16_t keylen = ss;
+			char *key = buf + 6;
+
+			// cache set/update
+			if (buf[3] == 10) {
+				if (keylen + 2 + 2 > pktsize) continue;
+				memcpy(&ss, buf + 6 + keylen, 2);
+				if (4+keylen+ss > pktsize) continue;
+				uint16_t vallen = ss;
+				char *val = buf + 8 + keylen;
+				uint64_t expires = 0;
+				if (2 + keylen + 2 + vallen + 2 < pktsize) {
+					memcpy(&ss, buf + 8 + keylen + vallen , 2);
+					if (6+keylen+vallen+ss > pktsize) continue;
+					expires = uwsgi_str_num(buf + 10 + keylen+vallen, ss);
+				}
+				struct uwsgi_lock_item *cl = uwsgi_cache_key_lock(uc, key, keylen);
+				uwsgi_wlock(cl);
+				if (uwsgi_cache_set2(uc, key, keylen, val, vallen, expires, UWSGI_CACHE_FLAG_UPDATE|UWSGI_CACHE_FLAG_LOCAL|UWSGI_CACHE_FLAG_ABSEXPIRE)) {
+					uwsgi_log("[cache-udp-server] unable to update cache\n");
+				}
+				uwsgi_rwunlock(cl);
+			}
+			// cache del
+			else if (buf[3] == 11) {
+				struct uwsgi_lock_item *cl = uwsgi_cache_key_lock(uc, key, keylen);
+				uwsgi_wlock(cl);
+				if (uwsgi_cache_del2(uc, key, keylen, 0, UWSGI_CACHE_FLAG_LOCAL)) {
+					uwsgi_log("[cache-udp-server] unable to update cache\n");
+				}
+				uwsgi_rwunlock(cl);
+			}
+		}
+	}
 
         return NULL;
 }
@@ -1099,6 +2345,17 @@ static uint64_t cache_sweeper_free_items(struct uwsgi_cache *uc) {
 	if (uc->no_expire || uc->purge_lru || uc->lazy_expire)
 		return 0;
 
+	if (uc->segments) {
+		for(i=0;i<uc->segments;i++) {
+			freed_items += cache_sweeper_free_items(uc->segment[i]);
+		}
+		return freed_items;
+	}
+
+	if (uc->wheel) {
+		return cache_wheel_expire(uc, (uint64_t)uwsgi.current_time, UWSGI_CACHE_WHEEL_BATCH);
+	}
+
 	uwsgi_rlock(uc->lock);
 	if (!uc->next_scan || uc->next_scan > (uint64_t)uwsgi.current_time) {
 		uwsgi_rwunlock(uc->lock);
@@ -1160,8 +2417,19 @@ void uwsgi_cache_sync_all() {
 
 	struct uwsgi_cache *uc = uwsgi.caches;
 	while(uc) {
-		if (uc->store && (uwsgi.master_cycles == 0 || (uc->store_sync > 0 && (uwsgi.master_cycles % uc->store_sync) == 0))) {
-                	if (msync(uc->items, uc->filesize, MS_ASYNC)) {
+		if (uc->store && uc->store_incremental && (uwsgi.master_cycles == 0 || (uc->store_sync > 0 && (uwsgi.master_cycles % uc->store_sync) == 0))) {
+			cache_store_flush(uc);
+		}
+		else if (uc->store && (uwsgi.master_cycles == 0 || (uc->store_sync > 0 && (uwsgi.master_cycles % uc->store_sync) == 0))) {
+			if (uc->segments) {
+				uint64_t i;
+				for(i=0;i<uc->segments;i++) {
+					if (msync(uc->segment[i]->items, uc->segment[i]->filesize, MS_ASYNC)) {
+						uwsgi_error("uwsgi_cache_sync_all()/msync()");
+					}
+				}
+			}
+                	else if (msync(uc->items, uc->filesize, MS_ASYNC)) {
                         	uwsgi_error("uwsgi_cache_sync_all()/msync()");
                         }
 		}
@@ -1169,6 +2437,17 @@ void uwsgi_cache_sync_all() {
 	}
 }
 
+// called on shutdown/reload, incremental stores would lose the last dirty pages otherwise
+void uwsgi_cache_flush_all() {
+	struct uwsgi_cache *uc = uwsgi.caches;
+	while(uc) {
+		if (uc->store && uc->store_incremental) {
+			cache_store_flush(uc);
+		}
+		uc = uc->next;
+	}
+}
+
 void uwsgi_cache_start_sweepers() {
 	struct uwsgi_cache *uc = uwsgi.caches;
 
@@ -1199,6 +2478,18 @@ void uwsgi_cache_start_sync_servers() {
 
 	struct uwsgi_cache *uc = uwsgi.caches;
 	while(uc) {
+		if (uc->replication && uc->nodes) {
+			pthread_t cache_replication;
+			if (pthread_create(&cache_replication, NULL, cache_replication_loop, (void *) uc)) {
+				uwsgi_error("pthread_create()");
+				uwsgi_log("unable to run the cache replication thread !!!\n");
+			}
+			else {
+				// from now on updates are batched
+				uc->replication->active = 1;
+				uwsgi_log("replication thread enabled for cache \"%s\"\n", uc->name);
+			}
+		}
 		if (!uc->udp_servers) goto next;		
 		pthread_t cache_udp_server;
                 if (pthread_create(&cache_udp_server, NULL, cache_udp_server_loop, (void *) uc)) {
@@ -1261,6 +2552,13 @@ struct uwsgi_cache *uwsgi_cache_create(char *arg) {
 		char *c_store = NULL;
 		char *c_store_sync = NULL;
 		char *c_store_delete = NULL;
+		char *c_store_incremental = NULL;
+		char *c_replicate = NULL;
+		char *c_slabs = NULL;
+		char *c_store_sendfile = NULL;
+		char *c_slab_blocks = NULL;
+		char *c_replicate_buffer = NULL;
+		char *c_replicate_freq = NULL;
 		char *c_nodes = NULL;
 		char *c_sync = NULL;
 		char *c_udp_servers = NULL;
@@ -1273,6 +2571,14 @@ struct uwsgi_cache *uwsgi_cache_create(char *arg) {
 		char *c_sweep_on_full = NULL;
 		char *c_clear_on_full = NULL;
 		char *c_no_expire = NULL;
+		char *c_segments = NULL;
+		char *c_optimistic = NULL;
+		char *c_eviction = NULL;
+		char *c_eviction_samples = NULL;
+		char *c_index = NULL;
+		char *c_expire_wheel = NULL;
+		char *c_l1 = NULL;
+		char *c_l1_max_value = NULL;
 
 		if (uwsgi_kvlist_parse(arg, strlen(arg), ',', '=',
                         "name", &c_name,
@@ -1291,6 +2597,14 @@ struct uwsgi_cache *uwsgi_cache_create(char *arg) {
                         "storesync", &c_store_sync,
                         "store_delete", &c_store_delete,
                         "storedelete", &c_store_delete,
+                        "store_incremental", &c_store_incremental,
+                        "store_sendfile", &c_store_sendfile,
+                        "replicate", &c_replicate,
+                        "slabs", &c_slabs,
+                        "slab_blocks", &c_slab_blocks,
+                        "replicate_buffer", &c_replicate_buffer,
+                        "replicate_freq", &c_replicate_freq,
+                        "storeincremental", &c_store_incremental,
                         "node", &c_nodes,
                         "nodes", &c_nodes,
                         "sync", &c_sync,
@@ -1310,6 +2624,15 @@ struct uwsgi_cache *uwsgi_cache_create(char *arg) {
 			"sweep_on_full", &c_sweep_on_full,
 			"clear_on_full", &c_clear_on_full,
 			"no_expire", &c_no_expire,
+			"segments", &c_segments,
+			"optimistic", &c_optimistic,
+			"seqlock", &c_optimistic,
+			"eviction", &c_eviction,
+			"eviction_samples", &c_eviction_samples,
+			"index", &c_index,
+			"expire_wheel", &c_expire_wheel,
+			"l1", &c_l1,
+			"l1_max_value", &c_l1_max_value,
                 	NULL)) {
 			uwsgi_log("unable to parse cache definition\n");
 			exit(1);
@@ -1356,10 +2679,35 @@ struct uwsgi_cache *uwsgi_cache_create(char *arg) {
 			uc->use_blocks_bitmap = 1; 
 			uc->max_item_size = uc->blocksize * uc->blocks;
 		}
+		if (c_slabs) {
+			if (!uc->use_blocks_bitmap) {
+				uwsgi_log("slabs require bitmap mode for cache \"%s\"\n", uc->name);
+				exit(1);
+			}
+			// the free chunks store their links in the first 16 bytes
+			if (uc->blocksize < 16) {
+				uwsgi_log("slabs require a blocksize of at least 16 bytes for cache \"%s\"\n", uc->name);
+				exit(1);
+			}
+			// the biggest size class (in blocks), rounded to a power of two
+			uc->slab_blocks = 1024;
+			if (c_slab_blocks) uc->slab_blocks = uwsgi_n64(c_slab_blocks);
+			if (!uc->slab_blocks) uc->slab_blocks = 1;
+		}
 		if (c_use_last_modified) uc->use_last_modified = 1;
 		if (c_ignore_full) uc->ignore_full = 1;
 
 		if (c_store_delete) uc->store_delete = 1;
+		if (c_store_incremental) uc->store_incremental = 1;
+		if (c_store_sendfile) {
+			// the file content of incremental stores is not up to date
+			if (uc->store_incremental) {
+				uwsgi_log("store_sendfile is not available for incremental stores (cache \"%s\")\n", uc->name);
+				exit(1);
+			}
+			uc->store_sendfile = uwsgi_n64(c_store_sendfile);
+			if (!uc->store_sendfile) uc->store_sendfile = 1;
+		}
 
 		if (c_math_initial) uc->math_initial = strtol(c_math_initial, NULL, 10);
 
@@ -1369,6 +2717,17 @@ struct uwsgi_cache *uwsgi_cache_create(char *arg) {
 		}
 		if (c_clear_on_full) uc->clear_on_full = 1;
 		if (c_no_expire) uc->no_expire = 1;
+		if (c_l1) {
+			uc->l1_items = uwsgi_n64(c_l1);
+			uc->l1_max_value = c_l1_max_value ? uwsgi_n64(c_l1_max_value) : 4096;
+		}
+		if (c_expire_wheel) {
+			uc->wheel_slots = uwsgi_n64(c_expire_wheel);
+			if (!uc->wheel_slots) {
+				uwsgi_log("invalid expire_wheel value for cache \"%s\"\n", uc->name);
+				exit(1);
+			}
+		}
 
 		uc->store_sync = uwsgi.cache_store_sync;
 		if (c_store_sync) { uc->store_sync = uwsgi_n64(c_store_sync); }
@@ -1387,22 +2746,88 @@ struct uwsgi_cache *uwsgi_cache_create(char *arg) {
 			}
 		}
 
-		if (c_sync) {
-			char *p, *ctx = NULL;
-			uwsgi_foreach_token(c_sync, ";", p, ctx) {
-                                uwsgi_string_new_list(&uc->sync_nodes, p);
-                        }
+		if (c_sync) {
+			char *p, *ctx = NULL;
+			uwsgi_foreach_token(c_sync, ";", p, ctx) {
+                                uwsgi_string_new_list(&uc->sync_nodes, p);
+                        }
+		}
+
+		if (c_udp_servers) {
+			char *p, *ctx = NULL;
+                        uwsgi_foreach_token(c_udp_servers, ";", p, ctx) {
+                                uwsgi_string_new_list(&uc->udp_servers, p);
+                        }
+                }
+		
+		if (c_purge_lru)
+			uc->purge_lru = 1;
+
+		if (c_eviction) {
+			if (!strcmp(c_eviction, "lru")) {
+				uc->purge_lru = 1;
+			}
+			else if (!strcmp(c_eviction, "clock")) {
+				uc->eviction = UWSGI_CACHE_EVICTION_CLOCK;
+			}
+			else if (!strcmp(c_eviction, "sampled-lru") || !strcmp(c_eviction, "sampled_lru")) {
+				uc->eviction = UWSGI_CACHE_EVICTION_SAMPLED_LRU;
+			}
+			else if (!strcmp(c_eviction, "lfu")) {
+				uc->eviction = UWSGI_CACHE_EVICTION_LFU;
+			}
+			else {
+				uwsgi_log("invalid eviction policy for cache \"%s\": %s\n", uc->name, c_eviction);
+				exit(1);
+			}
+			if (uc->purge_lru) uc->eviction = UWSGI_CACHE_EVICTION_NONE;
+		}
+
+		if (c_index) {
+			if (!strcmp(c_index, "open")) {
+				if (uc->max_items > 0x40000000) {
+					uwsgi_log("too many items for the open addressing index of cache \"%s\"\n", uc->name);
+					exit(1);
+				}
+				uc->open_index = 1;
+			}
+			else if (strcmp(c_index, "chained")) {
+				uwsgi_log("invalid index type for cache \"%s\": %s\n", uc->name, c_index);
+				exit(1);
+			}
+		}
+
+		uc->eviction_samples = 5;
+		if (c_eviction_samples) uc->eviction_samples = uwsgi_n64(c_eviction_samples);
+		if (!uc->eviction_samples) uc->eviction_samples = 1;
+
+		if (c_optimistic) {
+			// lru needs to update the list on every hit, so it requires the write lock anyway
+			if (uc->purge_lru) {
+				uwsgi_log("[cache] optimistic reads are not available for lru caches (\"%s\")\n", uc->name);
+			}
+			else {
+				uc->optimistic = 1;
+			}
+		}
+
+		if (c_replicate) {
+			uc->replication = uwsgi_calloc_shared(sizeof(struct uwsgi_cache_replication));
+			uc->replication->size = 1024 * 1024;
+			if (c_replicate_buffer) uc->replication->size = uwsgi_n64(c_replicate_buffer);
+			if (uc->replication->size < UWSGI_CACHE_REPLICATION_PACKET) uc->replication->size = UWSGI_CACHE_REPLICATION_PACKET;
+			// milliseconds
+			uc->replication->freq = 20;
+			if (c_replicate_freq) uc->replication->freq = uwsgi_n64(c_replicate_freq);
 		}
 
-		if (c_udp_servers) {
-			char *p, *ctx = NULL;
-                        uwsgi_foreach_token(c_udp_servers, ";", p, ctx) {
-                                uwsgi_string_new_list(&uc->udp_servers, p);
-                        }
-                }
-		
-		if (c_purge_lru)
-			uc->purge_lru = 1;
+		if (c_segments) {
+			uc->segments = uwsgi_n64(c_segments);
+			if (uc->segments > 1 && uc->sync_nodes) {
+				uwsgi_log("segmented caches cannot be synced from other nodes (\"%s\")\n", uc->name);
+				exit(1);
+			}
+		}
 	}
 
 	uwsgi_cache_init(uc);
@@ -1504,6 +2929,11 @@ void uwsgi_cache_magic_context_hook(char *key, uint16_t key_len, char *value, ui
                 ucmc->status_len = vallen;
                 return;
         }
+
+	if (!uwsgi_strncmp(key, key_len, "failed", 6)) {
+                ucmc->failed = uwsgi_str_num(value, vallen);
+                return;
+        }
 }
 
 static struct uwsgi_buffer *uwsgi_cache_prepare_magic_get(char *cache_name, uint16_t cache_name_len, char *key, uint16_t key_len) {
@@ -1634,7 +3064,198 @@ static int cache_magic_send_and_manage(int fd, struct uwsgi_buffer *ub, char *st
 	return 0;
 }
 
-char *uwsgi_cache_magic_get(char *key, uint16_t keylen, uint64_t *vallen, uint64_t *expires, char *cache) {
+/*
+	near cache (l1)
+
+	a small per-thread lru table in front of a cache, no locking is involved.
+	Items of local caches are valid until the generation counter of the cache (or of its segment)
+	changes, items of remote caches live for --cache-remote-l1-ttl seconds (and are forgotten
+	when this thread modifies them)
+*/
+struct uwsgi_cache_l1_item {
+	char *key;
+	uint16_t keylen;
+	char *value;
+	uint64_t vallen;
+	uint64_t hash;
+	uint64_t expires;
+	uint64_t generation;
+	uint64_t deadline;
+	// hash chain (or free list) and lru links
+	uint64_t hnext;
+	uint64_t lru_prev;
+	uint64_t lru_next;
+};
+
+struct uwsgi_cache_l1 {
+	struct uwsgi_cache *uc;
+	char *name;
+	uint64_t max_items;
+	uint64_t max_value;
+	uint64_t hashsize;
+	uint64_t *hashtable;
+	struct uwsgi_cache_l1_item *items;
+	uint64_t free_head;
+	uint64_t lru_head;
+	uint64_t lru_tail;
+	struct uwsgi_hash_algo *hash;
+	struct uwsgi_cache_l1 *next;
+};
+
+static __thread struct uwsgi_cache_l1 *cache_l1_tables;
+
+// local caches are identified by uc, remote ones by their name
+static struct uwsgi_cache_l1 *cache_l1_table(struct uwsgi_cache *uc, char *name, int create) {
+	struct uwsgi_cache_l1 *l1 = cache_l1_tables;
+	while(l1) {
+		if (uc ? l1->uc == uc : (l1->name && !strcmp(l1->name, name))) return l1;
+		l1 = l1->next;
+	}
+	if (!create) return NULL;
+
+	l1 = uwsgi_calloc(sizeof(struct uwsgi_cache_l1));
+	l1->uc = uc;
+	l1->name = uc ? NULL : uwsgi_str(name);
+	l1->max_items = uc ? uc->l1_items : uwsgi.cache_remote_l1;
+	l1->max_value = uc ? uc->l1_max_value : 4096;
+	l1->hashsize = 8;
+	while(l1->hashsize < l1->max_items) l1->hashsize <<= 1;
+	l1->hashtable = uwsgi_calloc(sizeof(uint64_t) * l1->hashsize);
+	// slot 0 is unused
+	l1->items = uwsgi_calloc(sizeof(struct uwsgi_cache_l1_item) * (l1->max_items + 1));
+	uint64_t i;
+	for(i=1;i<=l1->max_items;i++) {
+		l1->items[i].hnext = i < l1->max_items ? i + 1 : 0;
+	}
+	l1->free_head = 1;
+	l1->hash = uwsgi_hash_algo_get("wyhash");
+	l1->next = cache_l1_tables;
+	cache_l1_tables = l1;
+	return l1;
+}
+
+static uint64_t cache_l1_find(struct uwsgi_cache_l1 *l1, uint64_t hash, char *key, uint16_t keylen) {
+	uint64_t index = l1->hashtable[hash & (l1->hashsize - 1)];
+	while(index) {
+		struct uwsgi_cache_l1_item *item = &l1->items[index];
+		if (item->hash == hash && !uwsgi_strncmp(item->key, item->keylen, key, keylen)) return index;
+		index = item->hnext;
+	}
+	return 0;
+}
+
+static void cache_l1_lru_unlink(struct uwsgi_cache_l1 *l1, uint64_t index) {
+	struct uwsgi_cache_l1_item *item = &l1->items[index];
+	if (item->lru_prev) l1->items[item->lru_prev].lru_next = item->lru_next;
+	else l1->lru_head = item->lru_next;
+	if (item->lru_next) l1->items[item->lru_next].lru_prev = item->lru_prev;
+	else l1->lru_tail = item->lru_prev;
+	item->lru_prev = 0;
+	item->lru_next = 0;
+}
+
+static void cache_l1_lru_push(struct uwsgi_cache_l1 *l1, uint64_t index) {
+	struct uwsgi_cache_l1_item *item = &l1->items[index];
+	item->lru_prev = 0;
+	item->lru_next = l1->lru_head;
+	if (l1->lru_head) l1->items[l1->lru_head].lru_prev = index;
+	else l1->lru_tail = index;
+	l1->lru_head = index;
+}
+
+static void cache_l1_remove(struct uwsgi_cache_l1 *l1, uint64_t index) {
+	struct uwsgi_cache_l1_item *item = &l1->items[index];
+	uint64_t *ptr = &l1->hashtable[item->hash & (l1->hashsize - 1)];
+	while(*ptr != index) ptr = &l1->items[*ptr].hnext;
+	*ptr = item->hnext;
+	cache_l1_lru_unlink(l1, index);
+	free(item->key);
+	free(item->value);
+	memset(item, 0, sizeof(struct uwsgi_cache_l1_item));
+	item->hnext = l1->free_head;
+	l1->free_head = index;
+}
+
+// returns a copy of the value, or NULL if the item is missing or stale
+static char *cache_l1_get(struct uwsgi_cache_l1 *l1, char *key, uint16_t keylen, uint64_t generation, uint64_t *vallen, uint64_t *expires) {
+	uint64_t hash = uwsgi_hash_algo_64(l1->hash, key, keylen);
+	uint64_t index = cache_l1_find(l1, hash, key, keylen);
+	if (!index) return NULL;
+	struct uwsgi_cache_l1_item *item = &l1->items[index];
+	if (item->generation != generation || item->deadline || item->expires) {
+		uint64_t now = uwsgi_now();
+		if (item->generation != generation || (item->deadline && item->deadline <= now) || (item->expires && item->expires <= now)) {
+			cache_l1_remove(l1, index);
+			return NULL;
+		}
+	}
+	cache_l1_lru_unlink(l1, index);
+	cache_l1_lru_push(l1, index);
+	char *value = uwsgi_malloc(item->vallen);
+	memcpy(value, item->value, item->vallen);
+	*vallen = item->vallen;
+	if (expires) *expires = item->expires;
+	return value;
+}
+
+static void cache_l1_put(struct uwsgi_cache_l1 *l1, char *key, uint16_t keylen, char *value, uint64_t vallen, uint64_t expires, uint64_t generation, uint64_t deadline) {
+	if (vallen > l1->max_value) return;
+	uint64_t hash = uwsgi_hash_algo_64(l1->hash, key, keylen);
+	uint64_t index = cache_l1_find(l1, hash, key, keylen);
+	if (index) cache_l1_remove(l1, index);
+	if (!l1->free_head) cache_l1_remove(l1, l1->lru_tail);
+	index = l1->free_head;
+	struct uwsgi_cache_l1_item *item = &l1->items[index];
+	l1->free_head = item->hnext;
+	item->key = uwsgi_concat2n(key, keylen, "", 0);
+	item->keylen = keylen;
+	item->value = uwsgi_malloc(vallen);
+	memcpy(item->value, value, vallen);
+	item->vallen = vallen;
+	item->hash = hash;
+	item->expires = expires;
+	item->generation = generation;
+	item->deadline = deadline;
+	uint64_t slot = hash & (l1->hashsize - 1);
+	item->hnext = l1->hashtable[slot];
+	l1->hashtable[slot] = index;
+	cache_l1_lru_push(l1, index);
+}
+
+// forget a key (or the whole table with key == NULL) of a remote cache
+static void cache_l1_forget(char *cache, char *key, uint16_t keylen) {
+	if (!uwsgi.cache_remote_l1 || !cache || !strchr(cache, '@')) return;
+	struct uwsgi_cache_l1 *l1 = cache_l1_table(NULL, cache, 0);
+	if (!l1) return;
+	if (key) {
+		uint64_t index = cache_l1_find(l1, uwsgi_hash_algo_64(l1->hash, key, keylen), key, keylen);
+		if (index) cache_l1_remove(l1, index);
+		return;
+	}
+	while(l1->lru_tail) cache_l1_remove(l1, l1->lru_tail);
+}
+
+static char *cache_local_get(struct uwsgi_cache *uc, char *key, uint16_t keylen, uint64_t *vallen, uint64_t *expires) {
+	if (uc->optimistic) {
+		return uwsgi_cache_get_optimistic(uc, key, keylen, vallen, expires);
+	}
+	struct uwsgi_lock_item *cl = uwsgi_cache_key_lock(uc, key, keylen);
+	if (uc->purge_lru)
+		uwsgi_wlock(cl);
+	else
+		uwsgi_rlock(cl);
+	char *value = uwsgi_cache_get3(uc, key, keylen, vallen, expires);
+	if (!value) {
+		uwsgi_rwunlock(cl);
+		return NULL;
+	}
+	char *buf = uwsgi_malloc(*vallen);
+	memcpy(buf, value, *vallen);
+	uwsgi_rwunlock(cl);
+	return buf;
+}
+
+static char *uwsgi_cache_magic_get_do(char *key, uint16_t keylen, uint64_t *vallen, uint64_t *expires, char *cache) {
 	struct uwsgi_cache_magic_context ucmc;
 	struct uwsgi_cache *uc = NULL;
 	char *cache_server = NULL;
@@ -1658,23 +3279,30 @@ char *uwsgi_cache_magic_get(char *key, uint16_t keylen, uint64_t *vallen, uint64
 
 	// we have a local cache !!!
 	if (uc) {
-		if (uc->purge_lru)
-			uwsgi_wlock(uc->lock);
-		else
-			uwsgi_rlock(uc->lock);
-		char *value = uwsgi_cache_get3(uc, key, keylen, vallen, expires);
-		if (!value) {
-			uwsgi_rwunlock(uc->lock);
-			return NULL;
-		}
-		char *buf = uwsgi_malloc(*vallen);
-		memcpy(buf, value, *vallen);
-		uwsgi_rwunlock(uc->lock);
-		return buf;
+		if (!uc->l1_items || keylen > uc->keysize) return cache_local_get(uc, key, keylen, vallen, expires);
+		// the generation has to be read before the value
+		struct uwsgi_cache *ucs = uc->segments ? cache_segment(uc, key, keylen) : uc;
+		uint64_t generation = __atomic_load_n(ucs->generation, __ATOMIC_ACQUIRE);
+		struct uwsgi_cache_l1 *l1 = cache_l1_table(uc, NULL, 1);
+		char *value = cache_l1_get(l1, key, keylen, generation, vallen, expires);
+		if (value) return value;
+		uint64_t item_expires = 0;
+		value = cache_local_get(uc, key, keylen, vallen, &item_expires);
+		if (!value) return NULL;
+		cache_l1_put(l1, key, keylen, value, *vallen, item_expires, generation, 0);
+		if (expires) *expires = item_expires;
+		return value;
 	}
 
 	// we have a remote one
 	if (cache_server) {
+		struct uwsgi_cache_l1 *l1 = NULL;
+		if (uwsgi.cache_remote_l1) {
+			l1 = cache_l1_table(NULL, cache, 1);
+			char *value = cache_l1_get(l1, key, keylen, 0, vallen, expires);
+			if (value) return value;
+		}
+
 		int fd = uwsgi_connect(cache_server, 0, 1);
 		if (fd < 0) return NULL;
 
@@ -1731,10 +3359,14 @@ char *uwsgi_cache_magic_get(char *key, uint16_t keylen, uint64_t *vallen, uint64
 		char *value = ub->buf;
 		ub->buf = NULL;
 		uwsgi_buffer_destroy(ub);
+		close(fd);
 		*vallen = ucmc.size;
 		if (expires) {
 			*expires = ucmc.expires;
 		}
+		if (l1) {
+			cache_l1_put(l1, key, keylen, value, *vallen, ucmc.expires, 0, uwsgi_now() + (uwsgi.cache_remote_l1_ttl ? uwsgi.cache_remote_l1_ttl : 1));
+		}
 		return value;
 		
 	}
@@ -1742,6 +3374,14 @@ char *uwsgi_cache_magic_get(char *key, uint16_t keylen, uint64_t *vallen, uint64
 	return NULL;
 }
 
+char *uwsgi_cache_magic_get(char *key, uint16_t keylen, uint64_t *vallen, uint64_t *expires, char *cache) {
+	if (!uwsgi.metric_cache_get_latency) return uwsgi_cache_magic_get_do(key, keylen, vallen, expires, cache);
+	uint64_t start = uwsgi_micros();
+	char *value = uwsgi_cache_magic_get_do(key, keylen, vallen, expires, cache);
+	uwsgi_metric_histogram_add(uwsgi.metric_cache_get_latency, NULL, uwsgi_micros() - start);
+	return value;
+}
+
 int uwsgi_cache_magic_exists(char *key, uint16_t keylen, char *cache) {
         struct uwsgi_cache_magic_context ucmc;
         struct uwsgi_cache *uc = NULL;
@@ -1766,12 +3406,13 @@ int uwsgi_cache_magic_exists(char *key, uint16_t keylen, char *cache) {
 
         // we have a local cache !!!
         if (uc) {
-                uwsgi_rlock(uc->lock);
+                struct uwsgi_lock_item *cl = uwsgi_cache_key_lock(uc, key, keylen);
+                uwsgi_rlock(cl);
                 if (!uwsgi_cache_exists2(uc, key, keylen)) {
-                        uwsgi_rwunlock(uc->lock);
+                        uwsgi_rwunlock(cl);
                         return 0;
                 }
-		uwsgi_rwunlock(uc->lock);
+		uwsgi_rwunlock(cl);
 		return 1;
         }
 
@@ -1818,6 +3459,8 @@ int uwsgi_cache_magic_set(char *key, uint16_t keylen, char *value, uint64_t vall
         char *cache_name = NULL;
         uint16_t cache_name_len = 0;
 
+	cache_l1_forget(cache, key, keylen);
+
         if (cache) {
                 char *at = strchr(cache, '@');
                 if (!at) {
@@ -1836,9 +3479,16 @@ int uwsgi_cache_magic_set(char *key, uint16_t keylen, char *value, uint64_t vall
 
 	// we have a local cache !!!
 	if (uc) {
-                uwsgi_wlock(uc->lock);
+                struct uwsgi_lock_item *cl = uwsgi_cache_key_lock(uc, key, keylen);
+		if (cache_math_can_fast(uc, vallen, flags)) {
+			uwsgi_rlock(cl);
+			int ret = cache_math_fast(uc->segments ? cache_segment(uc, key, keylen) : uc, key, keylen, value, flags);
+			uwsgi_rwunlock(cl);
+			if (!ret) return 0;
+		}
+                uwsgi_wlock(cl);
                 int ret = uwsgi_cache_set2(uc, key, keylen, value, vallen, expires, flags);
-                uwsgi_rwunlock(uc->lock);
+                uwsgi_rwunlock(cl);
 		return ret;
         }
 
@@ -1878,6 +3528,7 @@ int uwsgi_cache_magic_set(char *key, uint16_t keylen, char *value, uint64_t vall
                 }
 
 		uwsgi_buffer_destroy(ub);
+		close(fd);
 		return 0;
 
         }
@@ -1893,6 +3544,9 @@ int uwsgi_cache_magic_del(char *key, uint16_t keylen, char *cache) {
         char *cache_server = NULL;
         char *cache_name = NULL;
         uint16_t cache_name_len = 0;
+
+	cache_l1_forget(cache, key, keylen);
+
         if (cache) {
                 char *at = strchr(cache, '@');
                 if (!at) {
@@ -1911,12 +3565,13 @@ int uwsgi_cache_magic_del(char *key, uint16_t keylen, char *cache) {
 
         // we have a local cache !!!
         if (uc) {
-                uwsgi_wlock(uc->lock);
+                struct uwsgi_lock_item *cl = uwsgi_cache_key_lock(uc, key, keylen);
+                uwsgi_wlock(cl);
                 if (uwsgi_cache_del2(uc, key, keylen, 0, 0)) {
-                        uwsgi_rwunlock(uc->lock);
+                        uwsgi_rwunlock(cl);
                         return -1;
                 }
-                uwsgi_rwunlock(uc->lock);
+                uwsgi_rwunlock(cl);
                 return 0;
         }
 
@@ -1949,6 +3604,8 @@ int uwsgi_cache_magic_del(char *key, uint16_t keylen, char *cache) {
                         return -1;
                 }
 
+                uwsgi_buffer_destroy(ub);
+                close(fd);
                 return 0;
         }
 
@@ -1963,6 +3620,9 @@ int uwsgi_cache_magic_clear(char *cache) {
         char *cache_server = NULL;
         char *cache_name = NULL;
         uint16_t cache_name_len = 0;
+
+	cache_l1_forget(cache, NULL, 0);
+
         if (cache) {
                 char *at = strchr(cache, '@');
                 if (!at) {
@@ -1982,14 +3642,14 @@ int uwsgi_cache_magic_clear(char *cache) {
         // we have a local cache !!!
         if (uc) {
 		uint64_t i;
-                uwsgi_wlock(uc->lock);
+                uwsgi_cache_wlock(uc);
 		for (i = 1; i < uc->max_items; i++) {
                 	if (uwsgi_cache_del2(uc, NULL, 0, i, 0)) {
-                        	uwsgi_rwunlock(uc->lock);
+                        	uwsgi_cache_rwunlock(uc);
                         	return -1;
                 	}
 		}
-                uwsgi_rwunlock(uc->lock);
+                uwsgi_cache_rwunlock(uc);
                 return 0;
         }
 
@@ -2022,6 +3682,8 @@ int uwsgi_cache_magic_clear(char *cache) {
                         return -1;
                 }
 
+                uwsgi_buffer_destroy(ub);
+                close(fd);
                 return 0;
         }
 
@@ -2030,8 +3692,238 @@ int uwsgi_cache_magic_clear(char *cache) {
 }
 
 
+/*
+	batched magic functions
+
+	mget: the request is a dictionary with cmd=mget and a "key" entry for each key,
+	the response body is a sequence of 64bit big endian sizes (0xffffffffffffffff for
+	missing keys) each one followed by the value.
+
+	mset/mupdate: the request is a dictionary with a key/size pair for each item
+	followed by the concatenated values. The response reports the number of failed items.
+*/
+
+static struct uwsgi_cache *cache_magic_resolve(char *cache, char **cache_server, char **cache_name, uint16_t *cache_name_len) {
+	*cache_server = NULL;
+	*cache_name = NULL;
+	*cache_name_len = 0;
+	if (!cache) return uwsgi.caches;
+	char *at = strchr(cache, '@');
+	if (!at) return uwsgi_cache_by_name(cache);
+	*cache_server = at + 1;
+	*cache_name = cache;
+	*cache_name_len = at - cache;
+	return NULL;
+}
+
+static int cache_magic_remote_batch(char *cache_server, struct uwsgi_buffer *ub, char *stream, uint64_t stream_len, struct uwsgi_cache_magic_context *ucmc) {
+	int fd = uwsgi_connect(cache_server, 0, 1);
+	if (fd < 0) return -1;
+
+	int ret = uwsgi.wait_write_hook(fd, uwsgi.socket_timeout);
+	if (ret <= 0) goto error;
+
+	if (cache_magic_send_and_manage(fd, ub, stream, stream_len, uwsgi.socket_timeout, ucmc)) goto error;
+	if (uwsgi_strncmp(ucmc->status, ucmc->status_len, "ok", 2)) goto error;
+
+	// read the body (if any) reusing the buffer
+	if (ucmc->size > 0) {
+		ub->pos = 0;
+		if (uwsgi_buffer_ensure(ub, ucmc->size)) goto error;
+		if (uwsgi_read_whole_true_nb(fd, ub->buf, ucmc->size, uwsgi.socket_timeout)) goto error;
+		ub->pos = ucmc->size;
+	}
+	close(fd);
+	return 0;
+error:
+	close(fd);
+	return -1;
+}
+
+// fill values/values_len (values are allocated and must be freed), returns the number of hits or -1 on error
+int uwsgi_cache_magic_mget(uint64_t n, char **keys, uint16_t *keys_len, char **values, uint64_t *values_len, char *cache) {
+	char *cache_server, *cache_name;
+	uint16_t cache_name_len;
+	uint64_t i;
+	int hits = 0;
+
+	for(i=0;i<n;i++) {
+		values[i] = NULL;
+		values_len[i] = 0;
+	}
+
+	struct uwsgi_cache *uc = cache_magic_resolve(cache, &cache_server, &cache_name, &cache_name_len);
+
+	if (uc) {
+		if (uc->optimistic) {
+			for(i=0;i<n;i++) {
+				values[i] = uwsgi_cache_get_optimistic(uc, keys[i], keys_len[i], &values_len[i], NULL);
+				if (values[i]) hits++;
+			}
+			return hits;
+		}
+		// a single lock round for the whole batch
+		if (uc->purge_lru)
+			uwsgi_cache_wlock(uc);
+		else
+			uwsgi_cache_rlock(uc);
+		for(i=0;i<n;i++) {
+			char *value = uwsgi_cache_get3(uc, keys[i], keys_len[i], &values_len[i], NULL);
+			if (!value) continue;
+			values[i] = uwsgi_malloc(values_len[i]);
+			memcpy(values[i], value, values_len[i]);
+			hits++;
+		}
+		uwsgi_cache_rwunlock(uc);
+		return hits;
+	}
+
+	if (!cache_server) return -1;
+
+	struct uwsgi_cache_magic_context ucmc;
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(uwsgi.page_size);
+	ub->pos = 4;
+	if (uwsgi_buffer_append_keyval(ub, "cmd", 3, "mget", 4)) goto error;
+	for(i=0;i<n;i++) {
+		if (uwsgi_buffer_append_keyval(ub, "key", 3, keys[i], keys_len[i])) goto error;
+	}
+	if (cache_name) {
+		if (uwsgi_buffer_append_keyval(ub, "cache", 5, cache_name, cache_name_len)) goto error;
+	}
+
+	if (cache_magic_remote_batch(cache_server, ub, NULL, 0, &ucmc)) goto error;
+
+	char *ptr = ub->buf;
+	char *watermark = ub->buf + ucmc.size;
+	for(i=0;i<n;i++) {
+		if (ptr + 8 > watermark) goto error2;
+		uint64_t vallen = uwsgi_be64(ptr);
+		ptr += 8;
+		if (vallen == 0xffffffffffffffffLLU) continue;
+		if (vallen > (uint64_t) (watermark - ptr)) goto error2;
+		values[i] = uwsgi_malloc(vallen);
+		memcpy(values[i], ptr, vallen);
+		values_len[i] = vallen;
+		ptr += vallen;
+		hits++;
+	}
+	uwsgi_buffer_destroy(ub);
+	return hits;
+
+error2:
+	for(i=0;i<n;i++) {
+		if (values[i]) {
+			free(values[i]);
+			values[i] = NULL;
+		}
+	}
+error:
+	uwsgi_buffer_destroy(ub);
+	return -1;
+}
+
+// returns the number of items that could not be stored or -1 on error
+int uwsgi_cache_magic_mset(uint64_t n, char **keys, uint16_t *keys_len, char **values, uint64_t *values_len, uint64_t expires, uint64_t flags, char *cache) {
+	char *cache_server, *cache_name;
+	uint16_t cache_name_len;
+	uint64_t i;
+	int failed = 0;
+
+	struct uwsgi_cache *uc = cache_magic_resolve(cache, &cache_server, &cache_name, &cache_name_len);
+
+	if (uc) {
+		uwsgi_cache_wlock(uc);
+		for(i=0;i<n;i++) {
+			if (uwsgi_cache_set2(uc, keys[i], keys_len[i], values[i], values_len[i], expires, flags)) failed++;
+		}
+		uwsgi_cache_rwunlock(uc);
+		return failed;
+	}
+
+	if (!cache_server) return -1;
+
+	struct uwsgi_cache_magic_context ucmc;
+	uint64_t stream_len = 0;
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(uwsgi.page_size);
+	ub->pos = 4;
+	if (flags & UWSGI_CACHE_FLAG_UPDATE) {
+		if (uwsgi_buffer_append_keyval(ub, "cmd", 3, "mupdate", 7)) goto error;
+	}
+	else {
+		if (uwsgi_buffer_append_keyval(ub, "cmd", 3, "mset", 4)) goto error;
+	}
+	if (expires > 0) {
+		if (uwsgi_buffer_append_keynum(ub, "expires", 7, expires)) goto error;
+	}
+	for(i=0;i<n;i++) {
+		if (uwsgi_buffer_append_keyval(ub, "key", 3, keys[i], keys_len[i])) goto error;
+		if (uwsgi_buffer_append_keynum(ub, "size", 4, values_len[i])) goto error;
+		stream_len += values_len[i];
+	}
+	if (cache_name) {
+		if (uwsgi_buffer_append_keyval(ub, "cache", 5, cache_name, cache_name_len)) goto error;
+	}
+
+	// the values are appended to the header
+	char *stream = NULL;
+	if (stream_len > 0) {
+		stream = uwsgi_malloc(stream_len);
+		char *ptr = stream;
+		for(i=0;i<n;i++) {
+			memcpy(ptr, values[i], values_len[i]);
+			ptr += values_len[i];
+		}
+	}
+
+	int ret = cache_magic_remote_batch(cache_server, ub, stream, stream_len, &ucmc);
+	if (stream) free(stream);
+	if (ret) goto error;
+	uwsgi_buffer_destroy(ub);
+	return ucmc.failed;
+error:
+	uwsgi_buffer_destroy(ub);
+	return -1;
+}
+
+
+/*
+	zero-copy access for caches backed by a store file (store_sendfile=N):
+	for values of at least N bytes the file descriptor of the store and the position
+	of the value are returned (the caller must not close it), so they can be sent with sendfile().
+	The value is not copied, so an update during the transfer could be partially visible.
+
+	returns -1 if the value is not available this way (the caller can fallback to uwsgi_cache_magic_get())
+*/
+int uwsgi_cache_magic_get_fd(char *key, uint16_t keylen, int *fd, uint64_t *pos, uint64_t *vallen, uint64_t *expires, char *cache) {
+	char *cache_server, *cache_name;
+	uint16_t cache_name_len;
+	struct uwsgi_cache *uc = cache_magic_resolve(cache, &cache_server, &cache_name, &cache_name_len);
+	if (!uc || !uc->store_sendfile) return -1;
+
+	if (uc->segments) uc = cache_segment(uc, key, keylen);
+	if (uc->store_fd <= 0) return -1;
+
+	if (uc->purge_lru)
+		uwsgi_wlock(uc->lock);
+	else
+		uwsgi_rlock(uc->lock);
+	char *value = uwsgi_cache_get3(uc, key, keylen, vallen, expires);
+	if (!value || *vallen < uc->store_sendfile) {
+		uwsgi_rwunlock(uc->lock);
+		return -1;
+	}
+	*fd = uc->store_fd;
+	*pos = value - (char *) uc->items;
+	uwsgi_rwunlock(uc->lock);
+	return 0;
+}
+
 void uwsgi_cache_sync_from_nodes(struct uwsgi_cache *uc) {
 	struct uwsgi_string_list *usl = uc->sync_nodes;
+	if (usl && uc->segments) {
+		uwsgi_log("[cache-sync] segmented cache \"%s\" cannot be synced from a dump\n", uc->name);
+		return;
+	}
 	while(usl) {
 		uwsgi_log("[cache-sync] getting cache dump from %s ...\n", usl->value);
 		int fd = uwsgi_connect(usl->value, 0, 0);
@@ -2079,9 +3971,26 @@ void uwsgi_cache_sync_from_nodes(struct uwsgi_cache *uc) {
                 }
 
 		// reset the hashtable
-		memset(uc->hashtable, 0, sizeof(uint64_t) * UMAX16);
+		if (uc->buckets) {
+			memset(uc->buckets, 0, sizeof(struct uwsgi_cache_bucket) * uc->hashsize);
+		}
+		else {
+			memset(uc->hashtable, 0, sizeof(uint64_t) * uc->hashsize);
+		}
+		if (uc->blocks_bitmap) {
+			memset(uc->blocks_bitmap, 0, uc->blocks_bitmap_size);
+			if (uc->blocks % 8) uc->blocks_bitmap[uc->blocks_bitmap_size-1] = 0xff >> (uc->blocks % 8);
+		}
+		if (uc->wheel) {
+			memset(uc->wheel, 0, sizeof(uint64_t) * uc->wheel_slots);
+			memset(uc->wheel_next, 0, sizeof(uint64_t) * uc->max_items);
+			memset(uc->wheel_prev, 0, sizeof(uint64_t) * uc->max_items);
+		}
 		// re-fill the hashtable
                 uwsgi_cache_fix(uc);
+		if (uc->slab_blocks) cache_rebuild_slabs(uc);
+		// the whole store has been replaced
+		if (uc->store_dirty) cache_store_dirty(uc, uc->items, uc->filesize);
 
 		uwsgi_buffer_destroy(ub);
 		close(fd);
@@ -2115,8 +4024,41 @@ void uwsgi_cache_setup_nodes(struct uwsgi_cache *uc) {
 
 struct uwsgi_cache_item *uwsgi_cache_keys(struct uwsgi_cache *uc, uint64_t *pos, struct uwsgi_cache_item **uci) {
 
+	// on segmented caches *pos spans the hashtables of all of the segments
+	if (uc->segments) {
+		uint64_t seg_hashsize = uc->hashsize / uc->segments;
+		while(*pos < uc->hashsize) {
+			uint64_t base = (*pos / seg_hashsize) * seg_hashsize;
+			uint64_t local_pos = *pos - base;
+			struct uwsgi_cache_item *item = uwsgi_cache_keys(uc->segment[*pos / seg_hashsize], &local_pos, uci);
+			*pos = base + local_pos;
+			if (item) return item;
+			// the sub-iterator moved past its own end, restart from the next segment
+			*pos = base + seg_hashsize;
+			*uci = NULL;
+		}
+		(*pos)++;
+		return NULL;
+	}
+
 	// security check
 	if (*pos >= uc->hashsize) return NULL;
+
+	// every bucket holds (at most) one item
+	if (uc->buckets) {
+		uint64_t i = *pos;
+		if (*uci) i++;
+		for(;i<uc->hashsize;i++) {
+			if (uc->buckets[i].slot) {
+				*pos = i;
+				*uci = cache_item(uc->buckets[i].slot);
+				return *uci;
+			}
+		}
+		*pos = i + 1;
+		return NULL;
+	}
+
 	// iterate hashtable
 	uint64_t orig_pos = *pos;
 	for(;*pos<uc->hashsize;(*pos)++) {
@@ -2135,12 +4077,197 @@ struct uwsgi_cache_item *uwsgi_cache_keys(struct uwsgi_cache *uc, uint64_t *pos,
 	return NULL;
 }
 
+/*
+	cursor based (SCAN-like) iteration
+
+	every call visits (at most) count slots of the index with only the involved segment locked,
+	the keys matching the pattern (a glob, NULL for all of the keys) are appended to ub as
+	16bit little endian size + key. The returned value is the cursor for the next call, 0 means
+	the iteration is complete.
+
+	Keys present for the whole iteration are reported exactly once, keys added or removed in
+	the meantime could be reported or not. With the open index a cursor always stops on an
+	empty bucket, so backward shifts cannot move a key behind it.
+*/
+static int cache_scan_match(char *pattern, size_t prefix_len, char *key, uint16_t keylen, char *tmp) {
+	if (!pattern) return 1;
+	// "prefix*" patterns do not need fnmatch
+	if (prefix_len) {
+		return keylen >= prefix_len && !memcmp(key, pattern, prefix_len);
+	}
+	memcpy(tmp, key, keylen);
+	tmp[keylen] = 0;
+	return !fnmatch(pattern, tmp, 0);
+}
+
+static int cache_scan_add(struct uwsgi_buffer *ub, struct uwsgi_cache_item *uci, char *pattern, size_t prefix_len, char *tmp) {
+	if (!uci->keysize || !cache_scan_match(pattern, prefix_len, uci->key, uci->keysize, tmp)) return 0;
+	if (uwsgi_buffer_u16le(ub, uci->keysize)) return -1;
+	return uwsgi_buffer_append(ub, uci->key, uci->keysize);
+}
+
+// scan the slots of a single (locked) cache starting from i, returns the next slot
+static uint64_t cache_scan_slots(struct uwsgi_cache *uc, uint64_t i, uint64_t *count, char *pattern, size_t prefix_len, char *tmp, struct uwsgi_buffer *ub, int *failed) {
+	if (uc->buckets) {
+		for(;i<uc->hashsize;i++) {
+			if (!uc->buckets[i].slot) {
+				// end of a cluster, we can stop here
+				if (!*count) break;
+				(*count)--;
+				continue;
+			}
+			if (*count) (*count)--;
+			if (cache_scan_add(ub, cache_item(uc->buckets[i].slot), pattern, prefix_len, tmp)) {
+				*failed = 1;
+				break;
+			}
+		}
+		return i;
+	}
+
+	for(;i<uc->hashsize && *count;i++, (*count)--) {
+		uint64_t slot = uc->hashtable[i];
+		uint64_t rounds = 0;
+		while(slot && rounds++ < uc->max_items) {
+			struct uwsgi_cache_item *uci = cache_item(slot);
+			if (cache_scan_add(ub, uci, pattern, prefix_len, tmp)) {
+				*failed = 1;
+				return i;
+			}
+			slot = uci->next;
+		}
+	}
+	return i;
+}
+
+uint64_t uwsgi_cache_scan(struct uwsgi_cache *uc, uint64_t cursor, uint64_t count, char *pattern, struct uwsgi_buffer *ub) {
+	uint64_t seg_hashsize = uc->segments ? uc->hashsize / uc->segments : uc->hashsize;
+	size_t prefix_len = 0;
+	char *tmp = NULL;
+	int failed = 0;
+
+	if (!count) count = 1;
+	if (pattern) {
+		size_t len = strlen(pattern);
+		if (len > 1 && pattern[len-1] == '*' && !strpbrk(pattern, "?[\\") && !memchr(pattern, '*', len-1)) {
+			prefix_len = len - 1;
+		}
+		else if (len == 1 && pattern[0] == '*') {
+			pattern = NULL;
+		}
+		else {
+			tmp = uwsgi_malloc(uc->keysize + 1);
+		}
+	}
+
+	while(count && cursor < uc->hashsize) {
+		struct uwsgi_cache *ucs = uc->segments ? uc->segment[cursor / seg_hashsize] : uc;
+		uint64_t base = cursor - (cursor % seg_hashsize);
+		uwsgi_rlock(ucs->lock);
+		cursor = base + cache_scan_slots(ucs, cursor - base, &count, pattern, prefix_len, tmp, ub, &failed);
+		uwsgi_rwunlock(ucs->lock);
+		// the caller can retry from the same slot
+		if (failed) break;
+	}
+
+	free(tmp);
+	if (cursor >= uc->hashsize) return 0;
+	return cursor;
+}
+
+// whole-cache locking, on segmented caches all of the segments are locked (always in the same order)
 void uwsgi_cache_rlock(struct uwsgi_cache *uc) {
-	uwsgi_rlock(uc->lock);
+	uint64_t i;
+	if (!uc->segments) {
+		uwsgi_rlock(uc->lock);
+		return;
+	}
+	for(i=0;i<uc->segments;i++) {
+		uwsgi_rlock(uc->segment[i]->lock);
+	}
+}
+
+void uwsgi_cache_wlock(struct uwsgi_cache *uc) {
+	uint64_t i;
+	if (!uc->segments) {
+		uwsgi_wlock(uc->lock);
+		return;
+	}
+	for(i=0;i<uc->segments;i++) {
+		uwsgi_wlock(uc->segment[i]->lock);
+	}
 }
 
 void uwsgi_cache_rwunlock(struct uwsgi_cache *uc) {
+	uint64_t i;
+	if (!uc->segments) {
+		uwsgi_rwunlock(uc->lock);
+		return;
+	}
+	for(i=uc->segments;i>0;i--) {
+		uwsgi_rwunlock(uc->segment[i-1]->lock);
+	}
+}
+
+/*
+	copy an item for long-lived readers (like the offload snapshots). The generation is the
+	sequence counter of the item slot: as long as uwsgi_cache_generation() returns the same
+	value the copy is still valid.
+*/
+char *uwsgi_cache_snapshot(struct uwsgi_cache *uc, char *key, uint16_t keylen, uint64_t *valsize, uint64_t *expires, uint64_t *generation) {
+
+	if (uc->segments) uc = cache_segment(uc, key, keylen);
+
+	uint64_t hash = uwsgi_hash_algo_64(uc->hash, key, keylen);
+	char *buf = NULL;
+
+	if (uc->purge_lru)
+		uwsgi_wlock(uc->lock);
+	else
+		uwsgi_rlock(uc->lock);
+	char *value = uwsgi_cache_get3(uc, key, keylen, valsize, expires);
+	if (value) {
+		*generation = uc->seqlocks[cache_seqlock_slot(uc, hash)];
+		buf = uwsgi_malloc(*valsize);
+		memcpy(buf, value, *valsize);
+	}
 	uwsgi_rwunlock(uc->lock);
+	return buf;
+}
+
+uint64_t uwsgi_cache_generation(struct uwsgi_cache *uc, char *key, uint16_t keylen) {
+	if (uc->segments) uc = cache_segment(uc, key, keylen);
+	uint64_t hash = uwsgi_hash_algo_64(uc->hash, key, keylen);
+	volatile uint32_t *seq = &uc->seqlocks[cache_seqlock_slot(uc, hash)];
+	return *seq;
+}
+
+/*
+	returns the lock protecting the specified key, on segmented caches it is the lock of
+	the segment the key maps to. Code working on a single key should always use this
+	lock instead of uc->lock
+*/
+struct uwsgi_lock_item *uwsgi_cache_key_lock(struct uwsgi_cache *uc, char *key, uint16_t keylen) {
+	if (!uc->segments) return uc->lock;
+	return cache_segment(uc, key, keylen)->lock;
+}
+
+void uwsgi_cache_counters(struct uwsgi_cache *uc, uint64_t *n_items, uint64_t *hits, uint64_t *miss, uint64_t *full) {
+	uint64_t i;
+	if (!uc->segments) {
+		*n_items = uc->n_items;
+		*hits = uc->hits;
+		*miss = uc->miss;
+		*full = uc->full;
+		return;
+	}
+	*n_items = 0; *hits = 0; *miss = 0; *full = 0;
+	for(i=0;i<uc->segments;i++) {
+		*n_items += uc->segment[i]->n_items;
+		*hits += uc->segment[i]->hits;
+		*miss += uc->segment[i]->miss;
+		*full += uc->segment[i]->full;
+	}
 }
 
 char *uwsgi_cache_item_key(struct uwsgi_cache_item *uci) {
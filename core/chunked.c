@@ -17,7 +17,7 @@ extern struct uwsgi_server uwsgi;
 
 */
 
-static ssize_t uwsgi_chunked_input_recv(struct wsgi_request *wsgi_req, int timeout, int nb) {
+static ssize_t uwsgi_chunked_input_recv(struct wsgi_request *wsgi_req, char *buf, size_t len, int timeout, int nb) {
 
 	if (timeout == 0) timeout = uwsgi.chunked_input_timeout;
 	if (timeout == 0) timeout = uwsgi.socket_timeout;
@@ -25,7 +25,7 @@ static ssize_t uwsgi_chunked_input_recv(struct wsgi_request *wsgi_req, int timeo
 	int ret = -1;
 
 	for(;;) {
-		ssize_t rlen = wsgi_req->socket->proto_read_body(wsgi_req, wsgi_req->chunked_input_buf->buf + wsgi_req->chunked_input_buf->pos, wsgi_req->chunked_input_buf->len - wsgi_req->chunked_input_buf->pos);
+		ssize_t rlen = wsgi_req->socket->proto_read_body(wsgi_req, buf, len);
 		if (rlen > 0) return rlen;
 		if (rlen == 0) return -1;
 		if (rlen < 0) {
@@ -40,7 +40,7 @@ static ssize_t uwsgi_chunked_input_recv(struct wsgi_request *wsgi_req, int timeo
 wait:
                 ret = uwsgi.wait_read_hook(wsgi_req->fd, timeout);
                 if (ret > 0) {
-			rlen = wsgi_req->socket->proto_read_body(wsgi_req, wsgi_req->chunked_input_buf->buf + wsgi_req->chunked_input_buf->pos, wsgi_req->chunked_input_buf->len - wsgi_req->chunked_input_buf->pos);
+			rlen = wsgi_req->socket->proto_read_body(wsgi_req, buf, len);
 			if (rlen > 0) return rlen;
 			if (rlen <= 0) return -1;
 		}
@@ -53,42 +53,81 @@ wait:
         return -1;
 }
 
+/*
+	read more data after the parser cursor (at least need bytes must fit),
+	the consumed memory is reclaimed only when the tail of the buffer is too small
+*/
+static int uwsgi_chunked_fill(struct wsgi_request *wsgi_req, size_t need, int timeout, int nb) {
+	struct uwsgi_buffer *ub = wsgi_req->chunked_input_buf;
+	if (wsgi_req->chunked_input_offset > 0 && (ub->len - ub->pos < (size_t) uwsgi.page_size || ub->len - wsgi_req->chunked_input_offset < need)) {
+		memmove(ub->buf, ub->buf + wsgi_req->chunked_input_offset, ub->pos - wsgi_req->chunked_input_offset);
+		ub->pos -= wsgi_req->chunked_input_offset;
+		wsgi_req->chunked_input_offset = 0;
+	}
+	size_t avail = ub->pos - wsgi_req->chunked_input_offset;
+	if (uwsgi_buffer_ensure(ub, UMAX((size_t) uwsgi.page_size, need > avail ? need - avail : 0))) return -1;
+	// as much as possible is read, so multiple chunks are parsed with a single syscall
+	ssize_t rlen = uwsgi_chunked_input_recv(wsgi_req, ub->buf + ub->pos, ub->len - ub->pos, timeout, nb);
+	if (rlen <= 0) return -1;
+	ub->pos += rlen;
+	return 0;
+}
+
+// hex digit value + 1 (0 for invalid chars)
+static const uint8_t uwsgi_chunked_hex[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5, ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+};
+
+/*
+	parse the chunk size line at the cursor (the line end is found with memchr())
+
+	returns the chunk size, -2 if more data is needed, -1 on error
+*/
 static ssize_t uwsgi_chunked_readline(struct wsgi_request *wsgi_req) {
-	size_t i;
-	int found = 0;
-	for(i=0;i<wsgi_req->chunked_input_buf->pos;i++) {
-		if (found) {
-			if (wsgi_req->chunked_input_buf->buf[i] == '\n') {
-				// strtoul will stop at \r
-				size_t num =  strtoul(wsgi_req->chunked_input_buf->buf, NULL, 16);
-				if (uwsgi_buffer_decapitate(wsgi_req->chunked_input_buf, i+1)) return -1;
-				return num;
-			}
-			return -1;
-		}
-		if ((wsgi_req->chunked_input_buf->buf[i] >= '0' && wsgi_req->chunked_input_buf->buf[i] <= '9') || 
-			(wsgi_req->chunked_input_buf->buf[i] >= 'a' && wsgi_req->chunked_input_buf->buf[i] <= 'z') ||
-			(wsgi_req->chunked_input_buf->buf[i] >= 'A' && wsgi_req->chunked_input_buf->buf[i] <= 'Z')) continue;
-		if (wsgi_req->chunked_input_buf->buf[i] == '\r') { found = 1; continue; }
-		return -1;
+	char *base = wsgi_req->chunked_input_buf->buf + wsgi_req->chunked_input_offset;
+	size_t avail = wsgi_req->chunked_input_buf->pos - wsgi_req->chunked_input_offset;
+	// up to 15 hex digits + \r\n
+	char *lf = memchr(base, '\n', UMIN(avail, 17));
+	if (!lf) {
+		if (avail >= 17) return -1;
+		return -2;
+	}
+	if (lf - base < 2 || *(lf - 1) != '\r') return -1;
+
+	size_t num = 0;
+	char *ptr;
+	for(ptr=base;ptr<lf-1;ptr++) {
+		uint8_t digit = uwsgi_chunked_hex[(uint8_t) *ptr];
+		if (!digit) return -1;
+		num = (num << 4) | (digit - 1);
 	}
+	wsgi_req->chunked_input_offset += (lf - base) + 1;
+	return num;
+}
 
-	return -2;
+static void uwsgi_chunked_init(struct wsgi_request *wsgi_req) {
+	if (!wsgi_req->chunked_input_buf) {
+		wsgi_req->chunked_input_buf = uwsgi_buffer_new(uwsgi.page_size);
+		wsgi_req->chunked_input_buf->limit = uwsgi.chunked_input_limit;
+	}
 }
 
 /*
 
 	0 -> waiting for \r\n
 	1 -> waiting for whole body
+	2 -> streaming the body (uwsgi_chunked_read_into)
+	3 -> waiting for the \r\n after a streamed body
+
+	the returned chunk points to the input buffer and is valid until the next call
 
 */
 
 char *uwsgi_chunked_read(struct wsgi_request *wsgi_req, size_t *len, int timeout, int nb) {
 
-	if (!wsgi_req->chunked_input_buf) {
-		wsgi_req->chunked_input_buf = uwsgi_buffer_new(uwsgi.page_size);
-		wsgi_req->chunked_input_buf->limit = uwsgi.chunked_input_limit;
-	}
+	uwsgi_chunked_init(wsgi_req);
 
 	// the whole chunk stream has been consumed
 	if (wsgi_req->chunked_input_complete) {
@@ -96,67 +135,96 @@ char *uwsgi_chunked_read(struct wsgi_request *wsgi_req, size_t *len, int timeout
 		return wsgi_req->chunked_input_buf->buf;
 	}
 
-	if (wsgi_req->chunked_input_decapitate > 0) {
-		if (uwsgi_buffer_decapitate(wsgi_req->chunked_input_buf, wsgi_req->chunked_input_decapitate)) return NULL;
-		wsgi_req->chunked_input_decapitate = 0;
-	}
-
 	for(;;) {
-		if (wsgi_req->chunked_input_need > 0 || wsgi_req->chunked_input_buf->pos == 0) {
-			if (uwsgi_buffer_ensure(wsgi_req->chunked_input_buf, UMAX((uint64_t)uwsgi.page_size, wsgi_req->chunked_input_need))) return NULL;
-			ssize_t rlen = uwsgi_chunked_input_recv(wsgi_req, timeout, nb);	
-			if (rlen <= 0) return NULL;
-			// update buffer position
-			wsgi_req->chunked_input_buf->pos += rlen;
-			if (wsgi_req->chunked_input_need > 0) {
-				if ((size_t)rlen > wsgi_req->chunked_input_need) {
-					wsgi_req->chunked_input_need = 0;
-				}
-				else {
-					wsgi_req->chunked_input_need -= rlen;
+		char *base = wsgi_req->chunked_input_buf->buf + wsgi_req->chunked_input_offset;
+		size_t avail = wsgi_req->chunked_input_buf->pos - wsgi_req->chunked_input_offset;
+		size_t need = avail + 1;
+		switch(wsgi_req->chunked_input_parser_status) {
+			case 0:
+				wsgi_req->chunked_input_chunk_len = uwsgi_chunked_readline(wsgi_req);
+				if (wsgi_req->chunked_input_chunk_len == -2) break;
+				if (wsgi_req->chunked_input_chunk_len < 0) return NULL;
+				if (wsgi_req->chunked_input_chunk_len == 0) {
+					*len = 0;
+					wsgi_req->chunked_input_complete = 1;
+					return wsgi_req->chunked_input_buf->buf;
 				}
-			}
+				wsgi_req->chunked_input_parser_status = 1;
+				continue;
+			case 1:
+				need = wsgi_req->chunked_input_chunk_len + 2;
+				if (avail < need) break;
+				if (base[need-2] != '\r' || base[need-1] != '\n') return NULL;
+				*len = wsgi_req->chunked_input_chunk_len;
+				wsgi_req->chunked_input_offset += need;
+				wsgi_req->chunked_input_parser_status = 0;
+				return base;
+			// a chunk is being streamed
+			default:
+				return NULL;
 		}
+		if (uwsgi_chunked_fill(wsgi_req, need, timeout, nb)) return NULL;
+	}
+}
 
-		if (wsgi_req->chunked_input_need > 0) continue;
-
-		// ok we have a frame, let's parse it
-		if (wsgi_req->chunked_input_buf->pos > 0) {
-			switch(wsgi_req->chunked_input_parser_status) {
-				case 0:
-					wsgi_req->chunked_input_chunk_len = uwsgi_chunked_readline(wsgi_req);
-					if (wsgi_req->chunked_input_chunk_len == -2) {
-						wsgi_req->chunked_input_need++;
-						break;
-					}
-					else if (wsgi_req->chunked_input_chunk_len < 0) {
-						return NULL;
-					}
-					else if (wsgi_req->chunked_input_chunk_len == 0) {
-						*len = 0;
-						wsgi_req->chunked_input_complete = 1;
-						return wsgi_req->chunked_input_buf->buf;
-					}
-					// if here the buffer has been already decapitated
-					if ((size_t)(wsgi_req->chunked_input_chunk_len+2) > wsgi_req->chunked_input_buf->pos) {
-						wsgi_req->chunked_input_need = (wsgi_req->chunked_input_chunk_len+2) - wsgi_req->chunked_input_buf->pos;
-						wsgi_req->chunked_input_parser_status = 1;
-						break;
-					}
-					*len = wsgi_req->chunked_input_chunk_len;
-					wsgi_req->chunked_input_decapitate = wsgi_req->chunked_input_chunk_len+2;
-					return wsgi_req->chunked_input_buf->buf;
-				case 1:
-					if ((size_t)(wsgi_req->chunked_input_chunk_len+2) > wsgi_req->chunked_input_buf->pos) {
-                                                wsgi_req->chunked_input_need = (wsgi_req->chunked_input_chunk_len+2) - wsgi_req->chunked_input_buf->pos;
-						break;
-                                        }	
-					*len = wsgi_req->chunked_input_chunk_len;
-					wsgi_req->chunked_input_decapitate = wsgi_req->chunked_input_chunk_len+2;
-					wsgi_req->chunked_input_parser_status = 0;
-                                        return wsgi_req->chunked_input_buf->buf;
-					
-			}
+/*
+	fill buf with the decoded stream (across chunk boundaries)
+
+	the big chunks are directly read in the caller buffer, blocks only when no data is available,
+	returns 0 at the end of the stream
+*/
+ssize_t uwsgi_chunked_read_into(struct wsgi_request *wsgi_req, char *buf, size_t len, int timeout, int nb) {
+
+	uwsgi_chunked_init(wsgi_req);
+
+	size_t got = 0;
+	while (!wsgi_req->chunked_input_complete && got < len) {
+		char *base = wsgi_req->chunked_input_buf->buf + wsgi_req->chunked_input_offset;
+		size_t avail = wsgi_req->chunked_input_buf->pos - wsgi_req->chunked_input_offset;
+		size_t need = avail + 1;
+		switch(wsgi_req->chunked_input_parser_status) {
+			case 0:
+				wsgi_req->chunked_input_chunk_len = uwsgi_chunked_readline(wsgi_req);
+				if (wsgi_req->chunked_input_chunk_len == -2) break;
+				if (wsgi_req->chunked_input_chunk_len < 0) return -1;
+				if (wsgi_req->chunked_input_chunk_len == 0) {
+					wsgi_req->chunked_input_complete = 1;
+					continue;
+				}
+				wsgi_req->chunked_input_parser_status = 2;
+				continue;
+			case 2:
+				if (avail > 0) {
+					size_t remains = UMIN(UMIN(avail, (size_t) wsgi_req->chunked_input_chunk_len), len - got);
+					memcpy(buf + got, base, remains);
+					got += remains;
+					wsgi_req->chunked_input_offset += remains;
+					wsgi_req->chunked_input_chunk_len -= remains;
+					if (wsgi_req->chunked_input_chunk_len == 0) wsgi_req->chunked_input_parser_status = 3;
+					continue;
+				}
+				if (got > 0) return got;
+				if ((size_t) wsgi_req->chunked_input_chunk_len >= (size_t) uwsgi.page_size && len >= (size_t) uwsgi.page_size) {
+					ssize_t rlen = uwsgi_chunked_input_recv(wsgi_req, buf, UMIN((size_t) wsgi_req->chunked_input_chunk_len, len), timeout, nb);
+					if (rlen <= 0) return -1;
+					wsgi_req->chunked_input_chunk_len -= rlen;
+					if (wsgi_req->chunked_input_chunk_len == 0) wsgi_req->chunked_input_parser_status = 3;
+					return rlen;
+				}
+				break;
+			case 3:
+				need = 2;
+				if (avail < need) break;
+				if (base[0] != '\r' || base[1] != '\n') return -1;
+				wsgi_req->chunked_input_offset += 2;
+				wsgi_req->chunked_input_parser_status = 0;
+				continue;
+			default:
+				return -1;
 		}
+		// do not wait if something is ready
+		if (got > 0) return got;
+		if (uwsgi_chunked_fill(wsgi_req, need, timeout, nb)) return -1;
 	}
+	return got;
 }
@@ -16,6 +16,17 @@ uint64_t uwsgi_micros() {
 	return uwsgi.clock->microseconds();
 }
 
+// not affected by wall clock adjustments (used for intervals)
+uint64_t uwsgi_micros_monotonic() {
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+	if (!clock_gettime(CLOCK_MONOTONIC, &ts)) {
+		return ((uint64_t) ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+	}
+#endif
+	return uwsgi_micros();
+}
+
 
 void uwsgi_register_clock(struct uwsgi_clock *clock) {
 	struct uwsgi_clock *clocks = uwsgi.clocks;
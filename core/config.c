@@ -356,6 +356,10 @@ retry:
                 op++;
         }
 
+	if (uwsgi.lazy_plugins_list) {
+		if (uwsgi_lazy_plugin_option(name)) goto retry;
+	}
+
 	if (uwsgi.autoload) {
 		if (uwsgi_try_autoload(name)) goto retry;
 	}
@@ -371,8 +375,35 @@ end:
 
 
 
+static void config_cache_record(struct uwsgi_config_cache *ucc, char *key, char *value) {
+	if (!ucc->ub) return;
+	if (!value) goto broken;
+	size_t klen = strlen(key);
+	size_t vlen = strlen(value);
+	if (klen > 0xffff) goto broken;
+	if (uwsgi_buffer_u16le(ucc->ub, klen)) goto broken;
+	if (uwsgi_buffer_append(ucc->ub, key, klen + 1)) goto broken;
+	if (uwsgi_buffer_u32le(ucc->ub, vlen)) goto broken;
+	if (uwsgi_buffer_append(ucc->ub, value, vlen + 1)) goto broken;
+	ucc->items++;
+	return;
+broken:
+	// the file will simply not be cached
+	uwsgi_buffer_destroy(ucc->ub);
+	ucc->ub = NULL;
+}
+
 void add_exported_option(char *key, char *value, int configured) {
+	struct uwsgi_config_cache *ucc = uwsgi.config_cache_capture;
+	if (!ucc) {
+		add_exported_option_do(key, value, configured, 0);
+		return;
+	}
+	config_cache_record(ucc, key, value);
+	// immediate options, logic blocks and nested includes are evaluated again on replay
+	uwsgi.config_cache_capture = NULL;
 	add_exported_option_do(key, value, configured, 0);
+	uwsgi.config_cache_capture = ucc;
 }
 
 void add_exported_option_do(char *key, char *value, int configured, int placeholder_only) {
@@ -585,6 +616,251 @@ restart:
 
 }
 
+/*
+	--config-cache
+
+	the options emitted by the ini/xml/yaml/json parsers are stored in a per-file
+	cache, together with the raw content of the file and a hash of the magic vars
+	used to expand it. On the next start, if both match, the options are fed back
+	without reading, expanding and parsing the file again.
+
+	Placeholders, logic blocks, @() and $() are still resolved at every start,
+	as they depend on the environment.
+
+	File layout (little endian):
+
+	"uWSGIcf1" content_hash(32) magic_hash(32) content_len(64) content items(32)
+	(key_len(16) key\0 value_len(32) value\0)*
+*/
+
+#define UWSGI_CONFIG_CACHE_MAGIC "uWSGIcf1"
+
+static uint64_t config_cache_le(char *ptr, int n) {
+	uint64_t value = 0;
+	while (n--) {
+		value = (value << 8) | (uint8_t) ptr[n];
+	}
+	return value;
+}
+
+static uint32_t config_cache_magic_hash() {
+	uint32_t hash = 5381;
+	int i;
+	for (i = 0; i < 256; i++) {
+		// time based vars change at every start, files using them are never cached
+		if (i == 't' || i == 'T')
+			continue;
+		char *value = uwsgi.magic_table[i];
+		if (!value)
+			value = "";
+		hash = (hash * 33) ^ djb33x_hash(value, strlen(value)) ^ i;
+	}
+	return hash;
+}
+
+// returns the number of cached options, or -1 if the cache is stale or corrupted
+static int64_t config_cache_check(struct uwsgi_config_cache *ucc, char *buf, size_t len) {
+	size_t header = strlen(UWSGI_CONFIG_CACHE_MAGIC) + 4 + 4 + 8;
+	if (len < header + 4)
+		return -1;
+	if (memcmp(buf, UWSGI_CONFIG_CACHE_MAGIC, strlen(UWSGI_CONFIG_CACHE_MAGIC)))
+		return -1;
+	char *ptr = buf + strlen(UWSGI_CONFIG_CACHE_MAGIC);
+	if (config_cache_le(ptr, 4) != ucc->content_hash)
+		return -1;
+	if (config_cache_le(ptr + 4, 4) != ucc->magic_hash)
+		return -1;
+	if (config_cache_le(ptr + 8, 8) != ucc->content_len)
+		return -1;
+	ptr += 16;
+	len -= header;
+	if (len < ucc->content_len + 4)
+		return -1;
+	if (memcmp(ptr, ucc->content, ucc->content_len))
+		return -1;
+	ptr += ucc->content_len;
+	len -= ucc->content_len;
+
+	uint32_t items = config_cache_le(ptr, 4);
+	ptr += 4;
+	len -= 4;
+
+	uint32_t i;
+	for (i = 0; i < items; i++) {
+		if (len < 2)
+			return -1;
+		size_t klen = config_cache_le(ptr, 2);
+		if (len < 2 + klen + 1 + 4)
+			return -1;
+		if (ptr[2 + klen] != 0)
+			return -1;
+		ptr += 2 + klen + 1;
+		len -= 2 + klen + 1;
+		size_t vlen = config_cache_le(ptr, 4);
+		if (len < 4 + vlen + 1)
+			return -1;
+		if (ptr[4 + vlen] != 0)
+			return -1;
+		ptr += 4 + vlen + 1;
+		len -= 4 + vlen + 1;
+	}
+
+	if (len != 0)
+		return -1;
+
+	return items;
+}
+
+static void config_cache_free(struct uwsgi_config_cache *ucc) {
+	if (ucc->ub)
+		uwsgi_buffer_destroy(ucc->ub);
+	free(ucc->content);
+	free(ucc->path);
+	free(ucc);
+}
+
+/*
+	called by the loaders after config_magic_table_fill()
+
+	returns 1 if the options have been loaded from the cache, otherwise *ucc
+	is set (if the file can be cached) and must be passed to uwsgi_config_cache_store()
+	after parsing
+*/
+int uwsgi_config_cache_replay(char *filename, char *type, struct uwsgi_config_cache **ucc) {
+
+	*ucc = NULL;
+
+	if (!uwsgi.config_cache)
+		return 0;
+
+	// only plain local files can be validated
+	if (filename[0] == 0 || filename[0] == ':' || !strcmp(filename, "-") || uwsgi_check_scheme(filename))
+		return 0;
+	if (uwsgi.inject_before || uwsgi.inject_after)
+		return 0;
+
+	char *path = uwsgi.magic_table['p'];
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	size_t content_len = 0;
+	char *content = uwsgi_read_fd(fd, &content_len, 0);
+	close(fd);
+	if (!content)
+		return 0;
+
+	size_t i;
+	for (i = 0; i + 1 < content_len; i++) {
+		if (content[i] == '%' && (content[i + 1] == 't' || content[i + 1] == 'T')) {
+			free(content);
+			return 0;
+		}
+	}
+
+	struct uwsgi_config_cache *cache = uwsgi_calloc(sizeof(struct uwsgi_config_cache));
+	cache->content = content;
+	cache->content_len = content_len;
+	cache->content_hash = djb33x_hash(content, content_len);
+	cache->magic_hash = config_cache_magic_hash();
+
+	char *key = uwsgi_concat4(type, "\n", filename, "\n");
+	char *full_key = uwsgi_concat2(key, path);
+	free(key);
+	uint32_t key_hash = djb33x_hash(full_key, strlen(full_key));
+	free(full_key);
+	char *hex = uwsgi_str_to_hex((char *) &key_hash, 4);
+	cache->path = uwsgi_concat4n(uwsgi.config_cache, strlen(uwsgi.config_cache), "/", 1, hex, 8, ".cfgcache", 9);
+	free(hex);
+
+	fd = open(cache->path, O_RDONLY);
+	if (fd >= 0) {
+		size_t len = 0;
+		// this memory is never freed, the options point to it
+		char *buf = uwsgi_read_fd(fd, &len, 0);
+		close(fd);
+		int64_t items = -1;
+		if (buf)
+			items = config_cache_check(cache, buf, len);
+		if (items >= 0) {
+			uwsgi_log_initial("[uWSGI] getting %s configuration from %s (cached)\n", type, filename);
+			char *ptr = buf + strlen(UWSGI_CONFIG_CACHE_MAGIC) + 16 + content_len + 4;
+			int64_t j;
+			for (j = 0; j < items; j++) {
+				size_t klen = config_cache_le(ptr, 2);
+				char *opt_key = ptr + 2;
+				ptr += 2 + klen + 1;
+				size_t vlen = config_cache_le(ptr, 4);
+				char *opt_value = ptr + 4;
+				ptr += 4 + vlen + 1;
+				add_exported_option(opt_key, opt_value, 0);
+			}
+			config_cache_free(cache);
+			return 1;
+		}
+		free(buf);
+	}
+
+	cache->ub = uwsgi_buffer_new(4096);
+	cache->prev = uwsgi.config_cache_capture;
+	uwsgi.config_cache_capture = cache;
+	*ucc = cache;
+	return 0;
+}
+
+void uwsgi_config_cache_store(struct uwsgi_config_cache *ucc) {
+
+	if (!ucc)
+		return;
+
+	uwsgi.config_cache_capture = ucc->prev;
+
+	char *tmp_path = NULL;
+	struct uwsgi_buffer *ub = NULL;
+
+	if (!ucc->ub)
+		goto end;
+
+	ub = uwsgi_buffer_new(strlen(UWSGI_CONFIG_CACHE_MAGIC) + 16 + ucc->content_len + 4 + ucc->ub->pos);
+	if (uwsgi_buffer_append(ub, UWSGI_CONFIG_CACHE_MAGIC, strlen(UWSGI_CONFIG_CACHE_MAGIC)))
+		goto end;
+	if (uwsgi_buffer_u32le(ub, ucc->content_hash))
+		goto end;
+	if (uwsgi_buffer_u32le(ub, ucc->magic_hash))
+		goto end;
+	if (uwsgi_buffer_u64le(ub, ucc->content_len))
+		goto end;
+	if (uwsgi_buffer_append(ub, ucc->content, ucc->content_len))
+		goto end;
+	if (uwsgi_buffer_u32le(ub, ucc->items))
+		goto end;
+	if (uwsgi_buffer_append(ub, ucc->ub->buf, ucc->ub->pos))
+		goto end;
+
+	// write and rename, concurrent instances must never see a partial file
+	tmp_path = uwsgi_concat2(ucc->path, ".XXXXXX");
+	int fd = mkstemp(tmp_path);
+	if (fd < 0) {
+		uwsgi_error_open(tmp_path);
+		goto end;
+	}
+	if (write(fd, ub->buf, ub->pos) != (ssize_t) ub->pos) {
+		uwsgi_error("uwsgi_config_cache_store()/write()");
+		close(fd);
+		unlink(tmp_path);
+		goto end;
+	}
+	close(fd);
+	if (rename(tmp_path, ucc->path)) {
+		uwsgi_error("uwsgi_config_cache_store()/rename()");
+		unlink(tmp_path);
+	}
+
+end:
+	if (ub)
+		uwsgi_buffer_destroy(ub);
+	free(tmp_path);
+	config_cache_free(ucc);
+}
 
 void uwsgi_opt_custom(char *key, char *value, void *data ) {
         struct uwsgi_custom_option *uco = (struct uwsgi_custom_option *)data;
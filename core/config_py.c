@@ -0,0 +1 @@
+char *uwsgi_config_py = "78daed7dfb73ebb6b1f0effa2b589df1504a24f93cd24eeb4699f1b1754ed4fad8ae1f797c8e87435194cc634a64f8f02377eeff7e77170009802045e938f7b6fd9a69138b582c168bddc562b1005e59f98f971fa7d62c0fc2b9953ea799bfea74f2c77419380f7e9206d1da1a5bf6dbd11bbbd3095671946456948abf125ffc95052b9f578b52a811a5a37cedaefc5effe6f56d51e0dc4351e28fd2380cb29e7d33fcfad61ec8b06f6f55f80715d53b51e4c5b95af2cd6d411e74a2f8339fc549e4f969da5924d1cacaee12df9d07eba5c501aee8c3c03a89bc7b0612c559ec26a92f20cee20c78708e9f924e274b9e0f3a16fc43b0bfe67e5e00fe037f74fc27cf8f3309e61f5518d6d03c48b33c0bc2d42ae9f6a2f522584acdf0a223face89909be0e5ac1ed19d586eaac2773e1e1d3166f9eb872089d6a3a50fcc3f3a02d6176de23787fde93cb80915f7fb9d6061ada3cc020cac3d86ca5e7a1e884367ee2f2cac17273e677394f4fa9cb285657ba1bb5eda56b02e11e03f899fe5c99a175bc3270fe84ffc7dfae92cdc7b7f04d815c03886e68ececf4ddd383f877e54a9e84b5c3c3abf3e3abb3ebd82eac13aeb5551b062c0337c031565064b55876f3ac88fe2cbb7d61b0653b4238dc82a0fb3809303f256144bf8349011c8348c400e04f6095c26a3d28cb95b7c387bf6e591737a7e717634b9bc3cbbb874ce4e4f4e7138454d1db5860d3ada79652da2c4f32d242df42d54381847ef79f908ff5945731f7921f47494666e92a58f417607ecfcf9e38f5368aec240403b0bd66ef2ec8420fbf0e10694966afa73c7c50f684546f82f60015090dd05a01da995a7fe1cc9018140e6a2fef6003ebbf32d7f3db7a205fd4926ac4fd5806c3f01f3c515234f5c54e20eab0eedfc179166dffbc9da0fed03eb831ba6fe807df49f7c2f582f22ed73b070e7f324d5be866037801c1dc583bfceb46fd8ab44fbb608427f15ad832cd24b622ff1b54f499467d5a63c3776670158d3c0d769cbd3b94ec4b3bbd2bbfb398dd6daa734d5819e2ad5e6fe2cd76989c37c19ac9d79a0f7e6b73098959ffebbd381a19945a9efb05967cc4ab841891310665084551c84346c0e743cceb31e14baa0324e9a25034b60801fa5c151d096d24d187b720da65f21549190a2a4a1b13b8dd6be5e590203c964c4f90eb3ff63aad16174a340882f6cb6e15d81b9944b3cf5522bebadf315efc7e31d7cb0ae925c22a217cd3ea3b00c2c6f350f83b5df075c0a1564c94a05879ef12aaa9297448e5cefd73c487ca9520960e07ef786916cedcd6f6ff6d25b6b2fed5a7b16123e40f33e100df607960cabc009eafb7544257ee8bba94e14cc03ccf233ffa427d02840d06584fbc3d87aadf619ff81ba8eff043ec71bc908e2f87354bb70c94c4663677c10f303bd6b30c571a120eb18fce6f7d0a9e1e2c0e740fc0208e3d0f5fc9ebd0f5395edd8fdf2cba8f265c8bf70dc69ecb961883473c431b0b4f48f46e751ecafb1189c823b3f0cc72881f07736070118cb80d3f3097df793644c956c9a0648e94661b4c4761f71b6116a198f1e5d603dc8ac32365002e339e25ea68336177c3feb3bebad89458085d13242c9ea414741178318fe98fb1e4c4712973754e8544782d720adc58907e41fa6b8207bb616f9da4335b0b208a056d1836f0d7ffcca9ae7e0c17a6ee6a7c4dc7c1dfcea3cbac91a0c74da83615fc104907246affd47477c6226809c4398cef8579c580580c21efe51995d873f8a99b50a48e60b90c92d5675412e1db9318ce05c90dc24a98dd5145195003ba597c0c7195cafb9e8cadc7fb0fb968b53783a8addec6e043a9a6669cfde4bf747cb20b3c17288229856c8d717bfdd598affed390e5a1dc7e9f7fb06774c5dc97c0dbeeb702f45b45c1f6c6805087f1832a77f384cefd045f87e72786c9bddb0d885d584ac536f77512a541e4da97e17858176b6531843858d0a53f2e2dd2ebc08d6dc8eec8340ecaff330b4fb754caab348ffdacc03d7d2897a4fa527f384d433bb6a97159f70edb57283b55d3a304f92428d5c5027b02bcab748b617bce9a78e40f7647d6d214c4729e59e589ede396caa5ba5cb9238b4328af3a17b4b086de8b7eab0a053d1431e0c2c84efcb8da2fd05b350757b5ad360766124bf4573592a73f9469fa3d6df4031937d8d8d4ca8f452f082c3f6bc45e82ed38115ba29748c7e38595a900f3a9178d40fd64c1ae5b072035fd5155d80bf7a028640ee4048fd4407610237bae3964f5dd72e2a4bef6b8c1c391fce2e8e26cec5e4fdf5f4e418e67e1c526d864adc00dc7b59134b0a6ffe0c4a38d6bab6a1ba44fdd6d58167be97e93d1782a039d002125bf976ac91bd81c86a7595eca6eae81c80754392703e072a71c50c3360cf26370b97b5ba1bc0e12b635a54d867131f87ab38cf557a658c1582ab4433ddefeeb1257b8c1ed31c3c24d4b60a7bb9db5b3bbf92a6306d80be20cea167e1bf23fcb7acc242372abac0e6a0466b22dc6ee49043b2dfcbbd013720d13a7c1eb325abb5f460bee2824d789761347343c9d91fa88a3dd0177869313f150191ef44fc485d36407f311a29cd30fa7293a288bd95fb94c25a612cf0f515e909506e1277bdf47baf07459b9ac8a09cb008680f3c4cd0e9b146f5c082cfe9b8170cb4255b369abb18ba4004308d6b65e4af6a4b269d1fc285ccca991b6d3a72ba2472e979142b2a87399c8b3f82197ad3b947914bac669c6b3763c0aa0509dca64d3ebd9f1c3be727d71fa7a7973657416efb4adc7e5c10d0b3fdd5cc9fcffdb9c3a220a9add8123f56390fb55263ad016285297960c3bfcb466f8c84dd36f9eb0d4db4c02b1852dfbdd67c10d1fe81c4123ff650af87c7acf9e3c9d1c9e1c58491715c5232fea5db95ea844aa593b3c3e3e61aa4083079d3024b1b815716b8abd1232dacc7b89080797b9db94f0ad03dee3f2006d187b1adadf6a1fcfe01b72c346b1aa311448b81fe584cde1cfeb2ab46144c7316ac351d42bce851962ea4829b9cc365e2fb6b0342292e4b8067a067ef2f8f6da4a4d83db9797df0ee968add642515f13adfbbc17dae7c36867811a0a7543c769347f04f695157eefa2895ff6cf7fb55aa6b5981a202ebb6eef5f1e4bcb797f6ff8ab63fd640420e73628411282ad2243e96a6966c43b1bc8dbd7e6d51e8496b8e62c6d05d611bbcebcf51b0e63e9c64460b37f17589c73e3c3f9f9c1e3b471f4e0e3fd61b1e860ba9973559ad7bcb459623e793f3dccf6092f7e73823d0ae4b7a60edcd915bea34c2c145f81c2b10da033ef756bbd5695a648dad77951d120c76a55e10684b75deb771513e9abd759d3bffa9c24ae8392dc56c0203a1126b33f1c1301d686dd4a284f66cde27d5b5844aaf8bbeea510b390e06b55825d952e664c1aa41b3127860d9896463a4c6d1c6861e5f5eca18475e182951c6c200f08a7f50fc6355f5aa5381eacfdf2297ded80df34c853fea6aa2ca0e70251907d11c6c62c623068852eca6c2c5d1630266b92777930fd72b8b66208b2f655085a4fd20b6ff34b2a61827f3120ccfa66cf3880a2cf4a806e01066405c185a331ff7149e71036a91871c3fce2a0f6e124439544d02ef3eb57a6170ef835a2ed0edcafc25db6feaf30a6820a2340d66e47c526be03ee20481de10e860eacfdbab0febf33cca1cf46ca1b575a6ca14acdf508a66140c2e84c5a407cd4894eab4da45bdbd61bb39b7157dc6cf9d727605f73458e52b2bf41ffc10b7e8445f7123ae990cc43412e03d03ccc0fa4bffa5ec0d2136991b43bbed2d8cc06a40a2d9185242e23b6d8213e8c8e3a2cfc5dcf6eedcc4fa4a450d8ba2ee5f7f59e3924e2a600885d72b662b09b76dd2139e03103fff0eeaf27b483f4f54889fcdc25b74a7ad22b4c6f7bfa613268a4c7a51817b49dd2890d7eb47a5fd2d6661097b0db2665d29c01bf5456ea6a233456193de14404277dcf93c4003ef860e0b09a586c414369b1e1e1f4fafa667a78727cee5d935ccac97765f5eef5651956c323623d659d5c212711352794d548593d66aea2caf73065128ab448cacd02665197af62210be207b1e05eb40c6a77ad2b658cf310f73fccb2f5df89f516e3656dc4bb16a39badc3168a84b5e8e737c783519770502c240a928b0005b503a4a776f6eedbdb7f67eb6f6be3fd8fb74b077d9153e2f18b7ac4864b8e1ae8d143aef7ef5d5573cc98e053f307da5484f497c0bcabbfd624f50c4fc04c30fe4c825158e09c6b0d56fdc33506b4abb079210f2727d2701d77035c5916113d200e6b125a2a9a4be68555bb2ac345bdfb419d624093faea3a19f2451a2adeda5d05b65ed511b8be7db2903ab1a63fd025ae3480f0354fd70832c48b37e3b562c5f9c05f4c3b3fb2f452ae3c4ef149d92f502ac192cf2fbd677faf6ce26d5164d58bc0949bfdbc4a5a4d854da1c9c6a15a0927a73ffd05763ce8640d69bdbda5273384a6a23481dcc90c87ccedc5e5c23d40223066ef51ae6e69103634bdff937409bd5a23e52d7be839c069ee4968acd948e89dbed837f4ad4cb8caa31d6f7af1def6bee3de7380d39df4db7f70de28d0003dc706212c5b310f3b887057d03de32a0c2feb839b8ad07fa1a8c477c638ba85aa729dcda9006abff5349e635353e62194760981780d9bb1fc64984f13be3545597d7abb22a4d8d3dc0bc6e30463d9eb23d7821aa61665dc024315cc148d4906caeb95cce67ef5eb493a20d67160227790272cf88045c0258c3842e8be20cdd45e627430c69514e933da8ab444ec478a7aab46e19a290af31eed5dcc226e02adb70c2a1eee3205739f102834dbf5e72bc6a5b477d03852cdd6efbb6017701259c1cbdae610e69a0d74c2b632f77dcb1015027e7647a7955471a269e1a3ceefa7ee8cb2fcfec5e9669ad1b1df626ec987ec7e6b71e33aeacb986f6281dc7e4fd8b3584675c00d496a2475c5fbab21b2714cd5f55933385e0f6ab0e6c2d4a65460287761f37673dc5d7ad29f21aacde1772bdced1a993af65a308283add6a69f4cfc6efdf81d1a8d7b352afd912e2fdf4f4f0e267a6de0358f0ef325516c760d6f78eb7c2c041379c5bc3c41ace446895325d80cc11ff6fb724974802577d60a9bf1b26585aae68adf69bc4a74c7cd36bd564d857f282ac09d95198067b76be7667c0c52cb2108de82292dd2058c8fdfb006c003926e45a61980f46709320c3c2d28b308ac858cb7f5ac361e2cffd45b086c9f3796539bc677b29fc6f4cff162c276617d9f8157929180e328d148a2faf6fc5efb603530e8e447333b8323872ad1603f3728363d629504d13975ed02da0a41dee939f4cdf6ff2c8e5358ab9a94594afe78e9b7877c539241358eaae830c8461eef0fca13293df24b7c2d722328ff9daa1d15e530da47688b4d8cde3a8105d49c06a9556a1375f60dca2e57a76b56ebac2572150f5fea4180090824aed2d0202121a65942ac12529a6542677f0d8ceb80a654a77e211180ed33aa8442e2ac694d45052259614935bcf60aa9d6d8e6de82d6b6d62c207358bc18e6a6d963ac9a337dd323642e0b028f76af2ee7827c0d63818e3aadd3e81c9d6393dfc34b10705a3451df984119451d88defe754d3ff84547585752f8cbb56b55f46e2fd05b2553ab1da02adbf2889aa494f47d419db67553322d591ab4d96a734d4feb6e832e69ba9d940a5a4a1e5c7412f6395a1927ccbd36ea5e4db023b66e17624c78606a7fc52e31672698019b40ab972e31e9d8818148c36c2691851ac18ed720e5328a5edeb39fd7299319d5fe213b9c1059f18d7d4c8ae9cf7afdb9055e025d1cc5f8365977c17a63d65596f43b6aa3a7aaff47f8a50b474e6d9aa4075950c2f69e789ed653bf73e6501b05f0786eceeb11081b2c2406c84979fc4b4afb663245d1ce2de487e57654016656ec86faec05d3a4c65b3521f10cc1981d271726b689527cd25cb210476046e21e8f17eb76f7d2b4b8064a1ec112d36c4177d88ddd449efdc04e7a2609680cd9047baa2700cd4e2a016262d62d0185518b849e70c830c7d32b780990709c5fe9e853d169498b64a2b0d96c84337075943f4948055daf7125f2113f18ca696225e22353003d3a966d06f21c807cd66a8c4b472937b790b859d52d0ce518abd1493e13890f22f30f984b65cefdc14793bf38127483b6345946716ee8faaa97484bcd8a262c95191e69f3118cbcef64bca0b50d5ac9b0e35f0bde8c34be7f2fbc38bc9312c2edf5fc02293db5da961af3cf850dd8f637bf22d4f73eb47a1a8b2e11c5465c9519c40372f37f4d34fd2a0a9b903a64946e15ff92732a1a668e4b599962abcfa92e989f7e645662485b3a191b1b573104a73bda298c64242a557046ba4d90740bf621662b45f372edc1f251b8089390e3f32d413d920e581bd223f44de23b9cbb2f8607f9f6d2cd542a4cd200b8ea364d963829236afac502a31199efe9427218cd5dbc6eb5114d051e2835f96660a44d92aadc8641bc28b8c1883c874fe34884657fe53363dfb91aa263db5e111fca44ca882d1038b72a54030c6769e2d867fb62b47547937ab75e5c39f5a49a7e385b010b772bc52888bbe5808e1a83b4e004b30c7e9a57eb81814030453589ef9ecf8943430fcd814e866c91eac58640ff1e496627e2d00985700c5f2d54623f9876ab5316e8c24182e76e875f39416384c56454abbd467d5ee35a578731c7a402a0fe3ba3c6f51434bf42e32a9c5b13fccf68ef56c6f8ebb92f12dd69832823f94ac34de87d12aedbb54a9da5c6da94345b2765c6107cfcc3330591a5eeaee22ee994d495fad226678740594d6f8448d576b2151f40b374e232f0a8b0f69e4ddfb59f1338c964bbc5c6760c0b4824efa4901ca7e3a2a7e7f053a1a9540207ec1e2d98c2e67cc6264e4b3d4838539cecde5c7cccd4ad4294c998cc106646efabcf674d2bc3bdfbb2f112c824554fc88168b3072e7466441a4901094881ffd19639844561c4521b2c580285dafe2923522d258d665a32df530cb63c150033a0f8f4516d0686f8a1fb37cb190c626a113b64624247f25a41b621e44415022b1ff2e8aeecd849427e884d44874792ef0bdf8c58e479ad1d0345e620167f44e1f42ba414a62d85dbebef7cda346018292db74f554c1d960b97625a1376e19171ab2c4bce20218d74db3683593195fca54ba428e99c41b6f302bbbe3e3098912296ab6fe8d73952d30ea248a964bf07fb724214aee1d9647597cfbed7919652533d6f9ca956578ee3e94a07e6e66441297720f8b503f0c5692c02de1cba3fb2c8940144b721ddd077edd2825cf8cff25f69943b782493c4fdc750a1d5bb9aac2c0c044a1dcd1cc4defb99930d93eca012d4b6ea53510ac8f2c610d53b3452d62fa04b73f73537927a0099435dc0e163dbb96a09843e2b5469cb6078d8d04076b2fcce7bec313906e6e158f80cf97d3d3a393ebe349fd213d333aedcc9e86ebd6988dc866c862d7411df0e1d95b5d0686d351e5d38f6e18563fb2bd5dfd33ac3f0f2f3e4e3e4c4f263c69dd0042a5671f3e5c4eae9cf7d3abcbf19fbe2957bab7cae1658a8f74590655776075bb2246de0730363c1840290f7d1541748909e2a405bfb3efb6383410a59d4eddcecf49b0ce9fec4aa672798728384976e002e98685ac516ec081de0f11aba31cf1aeddf10deff1f22189584c8e63633c32a76ad212916addbcbeede33d0c6f291342fafe867dff93fefd2dfbfe17f386872446521afcd9fbcbb393c9d5c439999e5effe4fc7d72713a39a9d9f8338c817d16ce2dc6e64e9bdd3d75574f1faf8fa7d7b641832a443bcef7d717f06f594b70a8ca1b6bf9f54e145798e7ab9897a0a30fab8fca5241ae8c4c0518658d89179ef66be468d32e23bf33350c1f56430c20e2ea67f316957cd3aabef1dabe9bf54b5f8c9305997113cf8b6347182dee61c3ccd513373c51630fecccf0795fa86af797b521cb99c23b786fa886d298ba8ec00ad75ff12ad6b7a3d1e83b9005da776410d69d9ff80775990045ef8c9ba394b254696dc2a2d0bc15d2fa8de8cd3ba0849fc134a8a23c2f08d9e644b1aba6b80d4433d0d1450f85b68265d30d2d26a534ce78f67e9e26fbfc2b5a64fa0deeae1b165fa559513a472463c2d9aa34ef7540ea36691dd44135819e88554f31295504ff6a4cbb89fd8196325c4ef717934f673f4cdacdfa44ddda53416e6a10ddd61eb96acc22aa76812762c2b72f4969dc143a292e1010aa4972c7432815a29a0c101ab295fb394af8f5c5926193664812fe4ab560bda99a9c7463eabd9e05d37d8e726bed43c75ceb486cbe26b44940fb4bb43f211938e648538633aaab970ddd307029ae84d740c0bfacf839bb8bd66cf2062aad6fad6f46ef6446f74ce733612a79cbf2ec4b06414dfd13807d2330737e7c6bbdebd74e9ee878ded8267aed5b99a6b285efa0854de87ef49f60c98206825205f335ded48c5729bab0c863cb152a580574c5f57011f8e17c882bf8009aff0d973e35ad1bfbf79716be0136c7565096f4f730f5bd1ccf2256fcea329d477758794688eab16a95d91542c0893066fbefd4e590220bc364febc765781a7f6b1701a28ad8db94e03e6fab0ffecdf7f487c1f4f709886139b2c7b1bce43bbdfe44e95c8daf95550c51155c8bfda44c02c9dcb3c7d6551f489dbc03b3cff8957eacb079cc5677972e0dfd4bef08f15b70b933ef94da74610b591ca0568bcc838a5f232396f563bbc6a68602f25a05ad46b508538621b70282efff5df95e982b1087b248743d9571175365321e3be61156e65d6b24f5aa8b845345dc56cac6f0cd77216f40d694a400a8d59fbde497e0eaf74e7a64e241217599803f1f61b66c994716150344c122757ee9b3d389987fdda447e054a7128bf6eca536d499abc42c6df376f0e6e1bf2f01558b201749dea06328ae1440fc2c8de72c30749667b3d94f7f1e086b9bcc323e34be5ce48d025b2a58a8cdfb23ed6ae90acb80e844608b9897380adb239c22b8dc19a5b74838bf8b9401fbe6bf09da56b5a0ddf0941f3966171bdbcf96a790d2187edd4d150706deea3f1053d5873e63ddeb919724f3e70890a47a9d373fd84a9ac55c8b5b9414acb6c1ff48968833dcd635cfd8f689b9db768d09c4a1614528c5acbfd4289648d5ae1510a2358bfb2a9eecb75cb1c795e8d37d1af65b7b232e4dff83b049278b29b05911e39fd93ef632a974b97a5f70fab6267ca16d3efa03c98097f9efa19ffeb387197d1fa43f86c1bc38ce717672cd2f6c3e4e2627a3cd9bcf0e0b930d595470555b1f4f8abc950dd83ba560e170fac37fd4ead29c32ac6d5d3e125a6b46c0e95a6e6442a605306a365f246522525d474b5216ffb56258c2acb62291ef818ddd9fd36ae1243fe3d609f7e383c3ebeb8b4f5370b58ac4cbc1b726bca0b507d4183a854634e55c2c5832548395d9ca06d5957d7eefb7215f32d025f8aa39671534328a15f5f5dcb0ab78727527dbc74a7461c1bc66bf2d3e4687afae1acaeaae6e016efc1f43b75f1d002a4799037b8e41b07f7e025bbda8ef62a417409d1563af2ff50fd362f247e33c1982fe4f9ad3af0ea454c1b8741e8d7c1e6087e042b1c2550618ce457e2146555295861ae6a3a2044d763140dc35afc8fec9d8412e37775877d9ac6e274f2a373763e3925dbd23ac67fea3f5a82632f10e5bfccd76797f6e6b56d91f9b0597892ac95f4e0ee4d9aaf9d45f0e4a746b45573539535ee40958fd4295eff2968d43a736bd595282f0eba173182fecbd90cf03fcce642382645f7d46843edd424ea6d1e32806cea09bb66a20e8d89291b208bb04b0b1189a2ac8936e3fe8d0454bdd5a2b53d3ebd9c5c4d4e7f707e389b1eb79eb04ecf9ccbc9e931ba6cdbd4d934bb5537004f8e9d8bc9e1c9f9e1d5f72636ea15562bd78bd2a721777b87608dc66f5e8ffe58559216974ab4d4885722226b51c03195965df8530925b14fe22102e5126e2aa9baccf49deee22180c680bcd1ae503d855c704b2dfe361cbe81c2dfd52c3685598983cfe829b48be7e4c00374f32cd2af2452aa8d394cf3ae248b2f56ee7b319960036536572f07f703b41dde5716371c56beca9e70859b667809249a46ca2416af18e01b2dc57907865f43447a85aca2873105dabfe0b983e009d8b372e33bbcabd8f2dc3526ed7364333f7bf4fdb568c34f3b957848ad83dd14676ddc7859ecee0e884c68655eff4b7d6ca63218c80e07d8616fbfc153cf19f3befb16ed57d1d56e85eb18c18e38691cac2991ae1e69cb7b7574ec40c33c7a4c85f036aa922ae8ed9ddb93b3a3bf3bd79713e7d3f5d5e4275bde207a01f5601bd5155a8b71d881cef3b3cbe94f30b37cb2fb1b9a5106678796ce2ea19df3e9297ed8d8983a563bb40632717cf6e365651caad9154de8a6e747c01ae710704caf7630bfc27b16869cdc67b0fe0f9215b31b9f03acd697dbd5e7184af734cc30f4bd3abf14d9a186d945aeb2cddc52d543a5711b7a14867623a2bad9484534f71faaa86840c1a3277b3a607ff205d7561957058e3e2db66aa3fd052c3642b06f1aee5c503b80436b6f9aa3b8ed8431aa9bad364712fb9b5879cf9286b7b4b8152fc23c6de89dc6216b1034261fed5574f2c3e4f48a547e727e7672a25b160d7b10393925ddeed2c0f4ccb9be989e7edcd006e7e62e2dfcfd1fd793ebc906fc42f07769e078f2430b2e9164ee82fefcece26a23ee1d49e774573240991143cb58b6a4db45caab36d845fa5eb58bec7166b35d94ab7c995dbc775c7000da1aa67b0713aff1d64aac66bab8f21514094f940119aeef14977f6279bffadc61d99a309b0cd3dbdb2daed2282bbfaeb3afac370d042823c3066431b7cd1bb30c616982dffef10b71d6754c45b0c63b3c3b1b7cdfbab9ec9f7792523bc926a9ffa3594a2545cc520dda28c6745bfb7235fd34b9202b437f7d383687f8aab135b027fbbcd1ed43f2356d3ba767d3d323dd8c6a3ddd7192291b334f355a2b3b4d04651b95e9601bdf5b47767a763a31d97f66acd1fe97c4ebf61fc3c6ab681d64916916904aab73815458332354ab7fd9bc6020c70ef809c27f3b6b63eaecffa5636ca2c764788c832e46695b21c7a0eea7b3d3e9d51913f5e9e9d9d5f4c3cfba721adbdcd110e84d9acd81b1c59d8c82dede0b98061d659d819035f8969f28973b55dde16477f4e0a5eb9e13ac62f6783965bed9741d036e1c79355b2f8d75698ef258a97dd06abfb900efefd6dc677fabe60a7003237989924f58d7760d531b6fc5a9df7663753416bcc2ac6aef790966c07af4ad79447334256d9f4f8fac5e4079564858e00559e39e5dcb88a299b805b4d6767bc500db24e8952b60aa52d02ed26aa69c6fad34e44d54aae46b7665e6dce2959d308aeef3b876c48b5ba5b7c911787f7278f477bc52557b85c588b6aee5c7bb008feb6ed7f28fdf4faf268d2d4b68a596d12b8cbdc42f0e01491e48e20f7d76a9265d006e11dc227832938da575893e12409d9741217e80c03cc8f24418551af23cdfe11095de3cd38baa0db904b2c510e0358f2454e8e8aa74b041e8f6db262e3437d7902292f84bff29b65b3754bc2a7b7e7431a9a14f1a7235bba47e11f9020323de92a8d9dc29aff40154441d7b663cb5f2b5fbe00621cae148be50928c24667727799cf9f391f5739443df1ee80ad8600d96310c99c8cef19db228462b6fc5a07eee925eb49807290937c2d40da5e116a8cdcbedff485b1b690b16459979f380ec457d3a17d99424ca71c7b5d1ee14304da6a7969a366c130d6ccdb78bb3ebabe9e9c76e730e93c07f6b3a086a16c39da8dd8dd25a2a9b13f03002e1b9b13b0b427c5bed8e5f94bf71a5d944e4d1e1797773060db45a937557d013f8e936fd48e759ab5cc282d0ebcbe3abae99861c90b56d3bcf83f93efe6bcbd6afa7c7dd7a87acc581ae562fec98936fe9e28119119d461b337ddb8307b33f7db32566ad42bb850682d72f13084ca4d21bac927262a102aeb07268a24849d5c7d38b00d66904a86fad5d0ab736f0a8a35541fc0c13f4f619e71f2e26133c9f076b84bf1d4e4f5a24bf613b95a38ff2bdc7a037e52113bd6bfcb05d198331d1ab6133dfe73cf9f41ed6364767a71fa61f1b42aee6cb9c9b9a93f6b8a5829a357433fab68f33d0cb0cea4b0115ecfd41b5c57ecd699b8dcf33d4bfc9b0d58c248fc1587a04817448b91bbb4afaee2d3993d363b93500dcaa2d5684a19c7483746198e8d22c5c1212c3beb5d2822e50f4bd8ab51163798bb804d6985e48742c9c986eb818c39f4deffa31477bc5b7092be7d4b41d4081b6e11140d63ab5cb60ebde03545b2ea06b1ed793ce9304e93c48809486839174704d5c753c28fe04cf825d2f99f253448f6e78df8c4960a311a819a20a3cbf85523a502611b3e86f44f005d663c12ff25c94977236fdb3e5a32e3b5811d3695736ea9b192998bfdb0b2eea298aed5f73297fb1775d68e16b78da45b09cbfe2521823d6cbbef489206f9822f50f6eab7516da2595ed86aff5b32fe621dcaabaf4948130d5ada86f7e6bea0b041e3839a027135e48c47710ed269e00658d6f24b5d2852fd3812f93fd26c927ded78abd56d0c8892f10e81a41eeb471847f985c5c4ecf4e296c8bd76a690ebc6553245742964399f37817b1cb75656831c90ed5f3ad7ce22ceb5120449b3ba9d4cbd32ca21be09b923b55d0122dceb22a95f388a67f09e4f5adbc63ab42f369b8a829cfc3f471e57e56cadfe8e501de2566bfb6d5cf89ffc03f1b5982a80c093d12c6b2c5b7b7cd38de1970b0e64b1cef6eb7120ce7fde1e564cc44a3e012884557bfee71039a4f877f3bbb90f020337741333d55d104eb5dd05c4c7e9832b12f30219f76c074747d7975f6a9541f49380dcaa3acd69fdd55b84ddce4e7c34f27ddd6a73b1976638c878a28a75abcb26dd7872f191e8a87c16a987e1d6cb57c81e5b581f2ba25b6816c33e982981ae67e4e8d01101d80cd2714942d8ec757bb87b07a88fc7ea947c8adcfee3a05c8ae712342e0687dda5454d83eacfbb7cbb3d3eed6d177c690763b0a462ed0354e050f9a63cad4188d23af60375c1ea3c57a087eabf3f2ff8b9ca12811ebd10b70a0ce2d6a2990cfeee7b05b7b82aa59223520e92e2771750162dfe47d49841698c42be4acfe863b75b650892f18fcdd05604bf56023b23bfd3009fceda4a11355e9222eb7b8ea481844cab5492aa95135bba55c76292e8b2dbdccb6a9c00a4e3f219577504503d20eeaa681add945adefbfd0c8ffcc04ff9909fec96702832ebea80ad6242fe4b00a20d56ca786dbab2099ad9df5af66e2fbff47f99ae6992f9963dace2f352a8bc0e4373859e2fbffc49adbe09bfc53b02fc6eb25ff8df9e79c9d1c6fc543270ae73bdacd97f35b2ace8a663125bf664ba3695ee4a669d8b8c6a5f20d69475529c38b48a1e63efc7f3709bbbc3ce9b6171522b235b4973cc759646f2dbf1b5a31570afd65b071fa46ccdba6466dc5b8f64cdb8a615b336b174619996416e6a755b3303fad360833006849a2f0e56d9b24515eb3653a2587364b458588ae4ac4b6c9948d8d35c9d24f9f4e2ce96f0cc3c17fde6e6ff939051bb4e0498acb618f5bcf69fe53ec66bbd919bd8b939fce0fafb6b03cd4b4fd7b3384b5d2e4f63ec9115662deef20dcdb244023ea97991105b2864911408845f2acf8d3a793df3725faf7d3e1b61cff97e2fa26ce6fdedfded6b4bdac79fb228d6e6fe66af59ad980ed9c81b6d66d1bcbb6130fea2c5acd391c7a87d09907c936f998e727d71fa7a7cef1f4a2f600918cd8bcaf2541a887ede4aa3564cffd59bedc6637ee78f2fefa63b7bf197e599369cd5adce014e5eb5990b524ebf4fd14e543bf8d5b19f3815c79a01c561b9492c4dfa20e5207ef13cc7c8731b0478fd11cc8ef1cbbeb67fa2aa70ec78ba73ebb966bf1c4f6d7c403d503ab7c891afe5e0619ff2b4defe8f169f10a365e195edb3454c3a104c6b196d9863ed41ec551dc2b5e04e760f223144b95972522fed7cdc1f09bdb8e94e9a826dc71280983f2f038f6c7f242b0f8167b228368363cf0ae5b52d572aa38bd39de1aff57a4d08af11102c02be868819a0f13af217197ab441ecb9ccde3f25d0d25dd90dea4900029e787e7f80928cc0cc04f0c4e3ac7173dc06c15f0478eca07d9d92359a2365067a89cc737f6c7a323074f1692aadc50abb70ac0e9e1a70915ced8a3e6f2f581fa8b4cd55bf0391d00df294cb83aec5abf2b771ae2ddcfc4207b2f656f7732e68ee26721050320b4f925a545f1d2752d927ea5d5de823f6dade2277ccaebd6aa8471b76382cf561ea0a781933fb80f0b4cb02af234f14516bb5b69bb1295c0fbe9d9ab94c57b32b9f456028e102fbe959e01c55afc69a0da6aa2bc526ffabea11216ea352e26ffb89e5e4cea6b1500724dae3cbd720499fe9023261b2628f4069630aa853d45533ab05028e5b738b8c0b1d7c6f856e8be9897b85a9235f5e78e9bf1fb3946f8af5ec9f126d3ac9936b329add3437796e27f0b5bd729681e30f360301e1cc6291e57657fdc1cdcaa055f8f156910d5cab7a3f85f654551c46b16025154652f4795e32e06eed73c487c51540e2eaf17a5197b27594ef856f45a01411ce507fe0e95aec4e565dda2bf2370c7fd24ebbd1eb0c764cbd123cb59591d707b5a9a3493ea3a95797f2fe5e3312efea21cc5120f934171ec5ae9a7f4a050eee90f26512dcd5a3acd0e1ccb9d04ff8d9c37c230ca0134411b0578cb1f6573e8e820200100afde801fd0dfc0633c57e34905dcc1f3e9b910405d71fb301b6b1f33b488cbf083b3ca363159c156a94070fc3a066406ce1ee2aa055628bc2dd50a355f39a0232c2f19b0ea6f0f60b87110690662964d9e3215b78260647fa872bdbabe34a01adae52668412b983c7e36cb5cd858ba6a2a5c464da5d126fad963d17ce4198be0d7c86bbc42c5c4a9a5f1805e551bf0ad3cf61c747f4bc2fac550cecaa16472fc7e7a7a78f1331bd10148549333d2368f7c9fa7928be319ccc253d3376fc062a8bffb9d2df3c91527568734f8ad64b5b5c724edd233c1aa827cc35b06db6587ef920dceb2c039db88619dda3c784cf5b609d4ae72b6df1f982fffc35471334eaaf9fa76db7ad46e0346c3a1a4ba33758dd9e8ca50cb9035c3fc65435d095ef03131b2bad1e396276cee6738c5f5282018a8cde16038a41739b9fdb507a59ab23a287286fa0d1a5a408bcbfad9cff6c47a065a0b60207aee7ba19bd0854243ba3965081a91d12d43d20bf4e2ddfa716bf0c724c87c7af7748d0fcc57313500046b7c9359f91607e2775f9ac50a967adb70d45318ea6dc3cfe6171636b6c51e835db869365c81f469d25a855e2ee7b377f616c4b5bc6ba90da180c1bb1fc64994d10aaf42ab26978d359ae9c6dba49c38f0d093b1d8ed4d1d1e0c68b87b6acb2eab8d9c8cac61c85e2e2c9c307a379d4e2192f1e627a852fc77f13fd59883280c2a0d0c4c4edac0e42e4af20d6ec6e708565bf93af8d5797493352a454f8c8a3c0d14a0c2b6f55ba0e163d56f050bab246e0cd9bfc9aa3bec3110527c27cab338cf7add9bbdf496f188f882ec90fb077e3b676bbf5822b3c523b7ff45291f4a2c57a70169cfa334fa6ca505e3c1dab2a014db574f7056220f8acc53636cd95717591931c1126b6c1069dcb40647e1d1e04f2431da04334a16602173d7eb0a10f0117ea19557d2188a91bc10219ec20361b2391cbaf3f99053c774616ca45c1a27590495f1aafa6da661c775e84050a491294fedc6e21c4dfb7d1d775b2ce4caa5b569fdddcb3d11606092c36405e32107d61ede0601cbc83953632952620dabb1947ebfa3496029718835a39546b1ef86e30f005c16f912555e1be252026fee1071a107984693a5835b8633b09bfcd1605ad60215097fb8157d6b7c1b985b32e0849f64fc21551e13a002f13cebcd6d313d02769a1cd943c3d8982498f8004c14a3811d0e17113a52f73e7f113995b5046add1cbca527d2bbc36197fa8c27c9e0bbe11cda2cf1dd7b531b2e385a79c6a2e4f0f31d6e240edf8d5e579a7ac39baab4f4a6a925eabd70f2b082784f3454ba7f738008d983b88c4fa90fde4b86515b82a2a274c01931621a221ed005121d7af2d2718846c759b930b84e5744ea10050cc11955e64f3af7a5b211a8aa78e9b73b9ce123e7c3210928fce992068cbb421ee093f873ac890a3e3b9b66e3aea87ae78731ff65b9561afb5eb080898ebf0e4d4a93440fc11ce64ddcbf654fdee2f3d95077050c00f4e32e7fa9b45b4ff08211ccf7b377a2b8a8cb484e3158e2c24ccbb8402212e2d32c0f7e320323b81d7d39a38f36c124f2400613dfc1430a5d418600911947df04cf1a5a89592b3c74b613178abaeac071dbe2962fd3b0db3b85380296672b73effd1480592531c428950ab328be66dd70a6dd36f4e789f5879ed3dab157bc5b84c231778edef9f213e843433779dfd6457f8be789e74162ea1e062c9bfab6627d5b055e12cdfcb577b7db7829f51b241726b6d4caee7c0bb7c82daa6551b5959b600998d95eb65f62eb6f27df1ed7bfd077d7cdf22d4018adf48be86206a3be059fb770e7135f9a5ae020ac8524073f3d8ed9c77af40f0c7da9dc0d0d9440ac8915b2947fdcd88f256b88f6cc9b9b1120b2b0e20ac2a202ba6d200a614270170b70515298bc40071779186ea4c16534b8e9a6c1e210150af009637aa6ca5d0759f09b0f1e4190d9a8fb8c36d61273426aa923f2b86b81dd8049b04fdb494430fdc7c18fd26611071e716697d32eff506c74948908d8f1623b877b20f8addcab9102db023ff5a2c45ee228e3a3f25d52123e1540c78bfc34a2450b04b56eb01a6eb22c0467c79cd5ec2b2cd0a355900d1709e8f8308e287fcabe3553b219e76d95c222354b3c4f6fb17d152ae47cac292d8d87f979fb202d07a21e637d1c40a27253538527c6b3dfaaf5f4bb898a0d8182cacdd888575544690b42f8bea254d71486286a196fb7e25619c756f29becbe9e2930d34ebd3228534b780d1e952a4fb6ef177bcdb36a6eb120d12666e00f1e2da602e9620a0c6ee447f0ad47258392d10ac1db8c70eeb1e7de4b58c3cbf0e8bc972600971ea58a98b75c6af6bf8bed3867e98561afb24b50b6521d7e55cb4b4823122371f88fa6d812ac1e59a667857a1b3ad4b473c451280ac99205686ddcc32c81620007043ec67ff5a5d4133e92e4bc1e98b1903c48a243b04c3e0d989877d6b465a46919ab20ef0ffc7b6a599d929544ee2adb15168b542995c36f9b39cc2b29d22447cfcaa4607cf49516d7e0afe2dfdc212f83175ac3f2b3aa4a324b056e63668b41e0e455c3c16e94d30bb655f265cc4a27ca19b290c61b5b4e4cb874de5f4f4f8e27178ec83ee179629818a089709781a0b7d7ed0b30ada9d261992a71af94f9527eb22fc97ae934e92df184969aa64c02b049b414166d5061e5495ba31c680c67af411be4817dae91075aad942d9711c56eb2b2860b5a5bed7f358aa43cd90a0c6e41449b80f0b6de4d78d828ed7fb509905df8b501485efa21acfa415a64f637f47e1e65ceddc8db08c732669cf8b98055398dcb3523a7c55a0e96b72bf7891f6548c76f5ebf7e0d9fd8330b633c3a30fc95b554708ab39e986bb9b10b68deee778d69857c094251665cfcf4ccb1fbff01346dc604";
@@ -0,0 +1 @@
+char *uwsgi_dot_h = "78dad4bd79771bc79538fa37f5293aca991980212592a264c59cf877680a9239a148858be38ce2d7a7816e806d01dd702f5cece4bbbfbbd5dad500e8ccbc2527a6d055b7f6edeef7e576d4fef5eac369b4fdf2d9b397db515ea459d144bbf9db68775ce17f35fe9946bbf3bd68b758d673f89b2ff1e7a4560969be0f2500002bf97d3e4db36914c793e5bcadf1bf67d943935545f4fce479f4ebb3df67459a4f010ea0f2228b6eb0f9f8d3d9cd87d3f3f8f8d3e9d6819ff7ddf1557cf1fefdd9c5f1bbf8e6db9bf757d1be05f2f1f887fd375b6f5ebf7ef5c6497cbb75f0fa8d0bf7e630bebabe8c9eefbf3d3c7cf3d5e1e1de57afbedafbe3ebd7fb6ff65f3fd79016e0ee1f0f0e5ebdfaea60efd59bb7af0fbffaeaf5dbbdb7cffdee8dcedf41f7e28b4fd7a717e757d1afd1f9cdd9d94eb447ffe7dff6dfbd7fee981adafb7a96c7595595d5e06118c9f7bc9c0d9eff5bfd75f46f75f419fe9b23e8bfa53ffebd78be133dec4475537111f85b94c31d98ecf7a767a338c65f67a7e7f06b78146a23aeb264be4c9a5bbf319d3e8cca29363b4df27996fe8ff6001a8aeb649a51dbf9341a50f28bb2ca677991cc297f9a46bffb5374308cd276791006d8c1ec23abf30f3d63fddf68eb7f7a55b099bcc89b3c9953377fc7dd284a951a976db36c9ba1810fd490cc936a31802ebc78f16268f7f633fddea5fce7d8c738fefe383ebefc70057df12a9a260d34a7b7a2bb338fa2ec216f06fb3d535d2eb3c2df5294f67798b0bf3f1ffe8fce5995fd6c9d189c3595bcfb4d5b41eb59117d13ed45fffeef91c95864cd6d9986f3aa6c5136599ca469a500ac598cefb26a5cd65970ed61ef5479318bfeedc576cd7f06f877f884f1edfcfdd9d656a8a33b9deedb2932522f69a77f583d59b8b4f33a0b8fb7335c1cd76f5cb6341bb7b3f026a507e8dde8db9b0f3f469d6dda59fee49e4f3d2f7d9537d9e0404df69cf6e1100fb6f565efe5e75c62f8dcdfff006ff6fda42c26497380dd1d4c6e932ada1e3e87125e91a26cf2e9a3ea8a3aba9826f5bcd010c192781da78f03055c4343598aab03a9d19fa27db87afc8ab9885bbdaac6ef5eb25cd602785f565fb2aae6fbe0c5e2f13e4f7f7c81f98122f104108035c510c634a78f65932fb268609d4778ebe3728abfdbac6e764d46dd245563650d5feeefeded5943686e5b404560e796932ff6d598d77106d7e1af7f7f16f5fccf4c595b67b15dcfca62ea7f6a674ebe482dcdad57cb517f25ffeccfa25366fad6dce2aad570d9ec6fd4ad251788176d933d70f7fe5dd5c47da39cdfd0b97f7627bd2dfe5f9a766ef8ffc3132f1dfc1f9a7a997eff72787388770a5c484dd9cef10e62cc71df3e1f2ddf16ced5e163a68092c6a71f3f8ede9d1e5f8fb606fbd17ffe273c6d01a08fc757d7a34b81d80f419c5d7c70a10e4250d7df5d8e8edf5d09c8ab10c8c977a3e34fba96c310c8f7df5d5c5d6f09c4eb607f471f2f2eff26106f42109f2e2f4ece8f3faa517f151cd3f17fff4d35f33604707e119f9e9f5e9f1e9f09d41f7ba0ae4697df9bf90b4ef12718530cc4cbfbd1e5e9f907051a9ceb93b31b7b398233fdf114c6a62082137d39fa4b77d5f60fc3d3797d797aa2966dffb5b5cd80188a3f8ccea1d32742a301f575f0d6cd87ddf5d7e3bf5d456f0e9df46be8e36527f5e412a92448f43af2fde931cce3f93b4424b6f60399971737b08b0f0239421c6ebdf2ebbcfaee63fcddcd87d1a7e30fa32bd89d9f3a15bb10f8ebfaec5b2241f36981742c8311ed39faf8ede8ddbbd13b35115e553d308adc75ea7b373a393bbe1cadabb21fccd46a2a25a8f8e4e2fcfde987675b427413f6d2cd3f5a078064ed5197587f37fa345816c9221b46521eaea9762208430ce43ed04f1141fcfef7f27964953fd3e501edc54bd9057da1d001bc99b7f86e5b7ef6601625f429cfaafd1f0149fa77af2da9766dd1dd6fca025e9524c58e6c6d0e3ec06b7e0beef32d7a577e75da9b2d0979fae64fa173c363dab230dfc7b28d6e93bb2cca16e32c4de1366fca325ab493db68961559954f22ee481dfdee77bf03dc9bdade52a498f44335fdd9eec3daa9f1e143f3d10bc39360e7fde10fd21db3d6d37c3e97a6e32619cf337cc9daa55af87689986e60b51fb0efedf2ff37d3cc5d0d4f8647629780494c6e711e00859f2205fba7c7a387a307a8e561f79b024ed430ea291437e5172467a0e84ef40b10735cc12f7f2234e14b5c49d6bfdf0f8f7e39fa25fa53a433187be0bce1337315c5719165697c7af13d3c123fe866fd64f7aa89e3ba2de2d854f2c3a70f87b1b995f53717336d8d7eb81e9d5f218b0c4bebb6dc6429e4dd99f187f39bf8eae2e6f264644ada69aaad62326fd32cfacfba49f3f2c5ed37a6d3372767a7df9e50bf35d0e4364b09488ab79dc6dc2ae7f998ebb4d2a0849796cf8a64eea62d92e616536cb0c7fa65f3b8cc6aa7974067b70ff6e46e3a7035c9375723ccb7e657a73853eb76a40694366bdc3e1759f3329faeecddc7ab0ff17bc02e2e3e8dcecd136f250276bbf770b0c7fff37bd09d6da7f19c3a5078d3062fce222f6b49b5debe9b9bd377165cdbe6e94bfc63adefb397dbcfb66eaede5dc3c9481a3cf45539ce6a7882aaf22e07343e7a4e27eef970274aa23a2f66f32c2aca65747f9b15f0a3899a2a9964e9d7cf9e6d8d9753fa8876e7d17fb475da7cfd12d9a72f9bf225d5f135ffddfe8f67db2fbd8e4207fce94f79ee9d634f9d1b14c3e8ddf5e5f1c90811da6f477cffed44c53004bd3f28a0e76e897d5d04b342a50ea8d44e34760b1ed805313754f6952abb134ddce2afbce20810aae1d0aa61274add4a0ebb95204ca89ed76e3d3b51e656f53a581582856a7bd3a96d279aba15bee9ab102143757e15aa73279ab9d57eb5a25a0486cd0cef61cf5e59b12956affcdab5dd64e9365c96cde7fb49b3683d1ae67a46deac773de37983e3dfb9ece8be6926cb9537def5c9a7ee8d67274607affc4bd9ce46dcfa7c74721d2cab32a3577b7e1d5717403a5efd0d88c8b3335dd64e8c0edf04ca7cba1c01b9192eeae7456ffed8fb46c0d4a46375e7465c473a88e9eefef2becab26fafde9140419718d770fd16393c90f605ec963605a37ffc63a35a69f11eeb4933ef2eea32a992453779b26c6bff69c3f49f927c6e2db51134bebf1c8db0614017feebf8f4cc2aa68bf8488a5d6fbe9c04365cb6f09fff264d2a6f6b122f5dfa643de7a75717277ffca3f7a2ab447fa5268853743b807c5937d52c4e770a4edf1fbf7b77796541e7531415d4f65a5ab9cbfbd4ad7c56d131f2e7a66d6a24485456e78c7511337785abcec253d997f37c913775ff4623286f93fdb6cdb728dba2f11a72472144710ee4c932bf2b9bb82acb6630298bba614a7bbbc8ee29112e302b75d93671394f8747817d65c66725a67995715f3cd68248d2bf3dbe1a8565ec98133d7f1e6828a996c94bbc08bb93bf582445371548bcacbbb373dd2f1bf63ec91b7bbfc5f1f1a74f283332f8e4f1497c7115ff107f3fba448a20fe08bdbd1cfde5e6f472f4cee221ad80eae6eeefc587dd73b2008a6ab77c993ecebd0b4a4fef7c3af191cf65390f5c3cada2349c44bf2cd4e66f5e612c07a6aacaeab2ad26fed4ceb2a65cf6cea1d92de32fb0055f5e5c1d37e5229ff8a4c804b0d4a4fe1248c63f24770eedf04f1757a73fc4271a5717f4dd4fd66f9075a6886034aff95f8f4fafe3e3f3bf4583ddfd617743c9740af0a7cbd30b2443a3e860afe7787f777cfae79bce413ef9db87bfc2c6a023ccdb4bb5dbd711e9faea869dbbbe940b69e56546f77f91aaa3e2e6647a4f65f30d9fd63515de65ea869a071761c37ad2ecaeaf6b6abe3b19d694fb456e2edf493a22af7d3d0ef0344f8e3ff92f7ab24cc6b04d9ac7e0452cbdb30ae169c8e6701e1c78d9bf3f10e6a5095097c5d106591741fda593e393ef46f1fbb3e30ff1cdf987d1f5f5f1b767a3adbd87bdfd15809fdea15c8699eefd60671727c7670c75d00f75fcedd5e8874f700732e4ab7ec88fc7d7df31d0613fd0e9f909c3bcee8779371298372b1abb91ae7fb5a29ed3ef19e66d3fccfbd31fece1fd313cffa3ef4f4f500b2b3ebf3887d95f0d737679b3b5bf1ae404e6fecf5b07ab81ae8e3fc21dfc8eea7bb5a6c9f7375b87de0ebfbab2904cd29aa9ebf94bc00da62f6e9f0772e03f27e33f5506e08fe1b76c362f3dc6d5b45824cde4d6bdbbd4f1b5504df83eb9fcdba7ebf83be744dde7455aded71dfc9999307c6a90f912371eb7e704b943b0e98f751b3a653059d4400babff1979e960d016c854cb52419586902442072c739b629a14ff43b43f1cf61cd1771f2e8f3f02f6737df25db4ffe6d9b3972f11032bb24993032216259349b66ca095f163941451523f1693685e96cba82c0c3fe83ef992b5c2126a6eb36891d480f045155ce45503954473c0ab21efe7366b33af03c7272723984beec15beac02279809a7fc950eb0eab4b93268996495d433feef3e6162a347d8c6e9302b9d7e5748a9d44f8aa6ca1f9baa33079feeee2fd7b7abe583112dbc2ba674024d5d0db4996df9926646c485a25f3f93347a2936291788cdb25faf5d91622b6d0e9a3675bd8edb8a1dec3172fcdb89d620e9747ae22291fd54d5925b32cdac62fcc878c795640e16da59c84a952e1367d765e54556b5ede6593681bfe312d2dd436807f6b8d41fff3c8df012c7e8daf3e1e03bd4bdaa1ce50a1f75358cb5fbdd170b796656d3ea4c7f281e8397cc214e3922c934714914453783ee190501a37d3565934a81730c5505b39c7ad462dd6439ed7bc403dabd89944a767db582c4631c1917bf048774a86c7754d0175489da9702a64d6488c9bd58cf72e99b7993fc8166a7b73089f9316d671d14d3980a4bb324fa36dfe8e974de5f7df6e6e9bfbdfe99294060c17b7baee14528c477e0f7184b7491d030d5dfb6db9f5f4b5865a1c71de640bd3529eea91502e8f039baaeee1c712ef3320ea52499c24459c02fe8eb07e1f4ced56fb810e94cb1adbef2b3be08e204a3ed47a68aa2b9209b4326ad80cfaea18aa4131fc6690ace5b21a7655b7abfb951d97ec2774bddabceff79b8356f79b0cd4be47ec7c189c56187ca196f3859d172a4683ee2ba73203057b8a74814543a90bae33fce158ab1528e6e6868bf60dcacbf60bf774b40a0fecbe07fc3e0cae1637d82d6b2ef015ce1665f5188d93aacae13a86e73f8d12229e2340aeaa841184c16c3279399927c50ceeed7cdee4454d32d808abdac50b37129d2ca90f318adad7b094460643243300c5a03fb75559c0a53bf0c7c09d80b99fe028a400bc9931f4309e660dcb92f77b8a952413bed305a900155539e172b3ac21a8c93c4b2aab61531efec30af67a2a982435669728a85285c7f8744dcac5126688eaa8ef93a5860ad7f330b99db943a0256cb29a3b58678d8cc3df2a49de90562caa979a0d60926fcb12567ff71b54f1170d3a928192066b89faf6472891af014182cd5bffe10fa1064893d869c14b8fd332b02f594f16de43ec7b6deb0e9baca1055c03da9631ac473a7c3ab9b4a5a6cb4995d914808bc73dc273954ff0b9570fde97ec51de32f8c5af7df79985df9465bdfbb779534b2e8a52dabaf318e8c6b697557677d49bcb8f6360505b3816289d34c84e3de2ef18a0ab44a7f2a7619876de785ce40e2281bd1e6c4fdb6232b41ea66e39ebe1ee76cf01afb259f6b054b8d493ba1e42afb85382c5d48483ac43afec1e987e87a92052ca8bfffadd6874165f9d5d5c5f45877b7f7ce38e080f4115038d93cd71fe741fc7499d390820b2c33b9d1973f968bb9e974dfdb9a7d91f034859356ef016fdb5b746e49baf682f2b508c37f721ece16cd33fc1b6a51a19f05b1adfbcacfadbc3ab6cd5f8e7d974456e95cf6e1b7b36d5a9e3d5466aad7f8ab6f90b1f655de5000bc266ee698fbfe17231058235ef443d15acab1adfa57555abc1c2a54da3843ae987321199ff6f75aecae0b1f8ad959b7e23defbac2d90b210ca46885c6bd3eaa43a0910c37901e9715e04b25aca6a0df57bfc3e3e3d1f5dbf09d5f286ab79e3d078a19ee18511eadd765ff7b657f46ffb291ddc0ef410b0ad0f4993dd278f8066c13db9ac4a4492500d679114f0d0a58ab5c19c9521fc4e1ad2352d5222a6b18a3aabee60612625d430cd12a4ac6b4cdfdd35b5037d06b56780a07d890049ab97c93db26c58f97f77d73b57332e66bd8e0ee1396de77349d0c454b904ba01f685b5973b4462d12ee4171a45b06e183d974cefe35b90cce3ba1dd7932a278a355ee6cbecf3c18ff6cd00a3c3ded7fc60600b2db530a3df33fcbde6da90e1c58ce5744729243f7e093b869808a99e805fb26a76a44b21b34b60f0672c18028db884633ccd2abf4b8c2e5803554984329baacbfb22ebdcb96a75b6e54707e1f0c6a7108b2de2f1b573d854683191c13212c65ed773fdaa360f47bd70a2162a6caf32cda4ce9275282e473757a34f1797d7c2f5832d89a5505d33525d960dce556ce368d3da1a7a4aa654478cbde0167e9700f150f0e160617232b74ec9228192098a55dc73e2637b548b417e00f186e3957a3b34b0c1b6f0cac3a7be24dc45bee6d0464c201edec7ec916c86c3976554bc19ee02ec2b6b71a159143749390d21b3dadce67584ff2f00635ac0d30a83cce09cc338d1ae2c89a438c2a03ade14d08fd41a856433b959f3aa4e49c5b8983c22875595678068001b3569e74db4bf0737ca44b1e1b0881ac8a42c9aaaec601432bd7a9bf194944b39e17a5e9011a8d3dcb3dbda6797e6ac2cca1699a52969ccaf60a035653bb93d0a88116496e7b01e78be1402c8e7b28ecdb504d760d934f3ccaccce436cdab209f6cc6ccdf40c6cc66963ad7253514094757b0ed0e8f85cac3dbca457622861e1ee9999fe6b3963695b98c9c1b25f80e7778cc168b99eb757056e11cc33f1e131bf64e5bf3299b004100b865c45d5660095e888ae92ba3a9e9916ae7bbdf4085cc5da75c44bfe16585c4382fef3e531f7e8c0634b1193f55d01815475eb66c4462bd77598bb220d0515e97ade0bc1af205d55eb107355d4e89ea2b5e30c964d22eda7982276d90d4d1ab8371ce2cfde80fd4eb21f14210b126b188bc9fcfb6445cc1770f2c5da96701ada1f1d440f35181a737429a98db4698226bd0aa14f5627bc6f56bcf885a3c57ae355e1309f7552543cb2921ee85da36746bd1260a73d4f18c14b3beece9bcad6f395f5f333497760201b94969552eeb154bd7435ce221768bd0518e0b787a3a470d1bdb7fe3beda363141a40b954059dce7575ffda8b7383cc2e57c6ed7c1297e2d7c51b60ed71fea4d63a77a4ae136defce83f1a19d508c7e4364baa660cc81ae33dbbc807836a5819bb6ef209a280f91caeb80c974f786b2451b9cd71a7562d40a759934d9ab2b23ba4da89e9454acb768c6f043602f5c78b2c2902c9774925a37a7580e34f16cb79d65d326bfe83bc0c07a04fd6403066fdd4fd6c665f6a59b5864a78b6760bd80fbcbffa7420084552afcecf6d59691c15c08b199d1558af7c0ae7be91330b877999106a750f4b845852024b9134b7bb4901cf5631c9e4ca824328af39152ea3fd689a57f06ad1134e62536e121f71326cc9522efa5399178c2b04b6df661b574f306ec82ea8956c4d7527ab168c24b8b783c7406f79208217319a2d63ae950e2fd503a3255622eddbfba42ae87ee917a7f015f76c6bf4fda7f8e4f4d377a3cbf8e4fa87681bb09aea71d9c48cc1fab96966e5bad3e7dc5492e4ef3d95bc481ef484203a85285784bbbd8ed247d875f98470df7ae5b140f0f896b6c65a30406ee76a07b19906213df0e070abb0a5f0998cd4bec39495d2462cb5521e492b893cbfd5602832d80810367ebbdc008ececf067078303600c381c67c88368546069582d5dbb26e6b7c14a196269f87176ccd4d172793a00cd762bdfac8a054ab90c1e19139cab39891b3150d75799e0e30e962d0fe33ec3d26184ae7282c5b3458c4b4cec0b80a252f36a784951f64e61a29095bd78884c6786200bdfaf8e9e34944be6206df3fb65fca3bd8de8ff36cb883bdc84505a5ca14ce5425cb25dc8c814e501dbf222a0c781b5233ba3759c1103c2c9abf6592ee7d7e4d3757173ecd42f0fb0c2f03411de5768142b17a9e654b6c1b9fe522bb8f7036e0cd9e2226863a3275f6f34e244f3629f54d53c63849930679354061050684f82136e08f89df65a4c502e95248f73389164020a39609207c309548a143db0be410e118b249dbe477f03b835b6d87fa881b82e06ecb792a7a1ab09e75a88f582c3ce9dc41dd2faadf412c688b746513497d1b27f359d939257a8cfaa82802c962426ee90f867a73d803d7d3a84d1e3005831caee8cd21e2ffc4888e0639e3f8040f2571aa7c5996ae307e7338686f931d9424ed883809f5b4206db8fb0df730fa3f91f33d7060bf864cd56f1bce811af6cee2b6dfa159d618f98ec56336108a6de1cc1b4ffcb03b97eb6a81f16c54cf8eb572bfa119f89a2b463fef7bc4b3e07544160eeef388efb91a79a4793247fe0bacdc2423faeef99fb3c7af797dff5efdbd78ceb48cef12028daabf1b1dbf0354e27af4f1d3d9f1f5e82a7a2badb184fbc3c9e5715401ddc8da4f70630d0003a743fe129329f5c5c43bef3a2748cbb088a9452cb3d60438500563a01801bb8fc4585cc4f3a85c451a54805c5ae5157e6fd7d994f3ac4a600eecc46c5912f1ac13585ce5a454d94f406c7489476bdbe1cf8e8c470fb3ef9de4358ae1025d22f1dd998e202dda8e6d8c35287bf3eb758ff9e4b62dbed44ad55056128a2ce9e119bc3a40cdda09a0a5407b8d1f9b0cee49793445c49c769c671c5f8edea14397f8e4ecf8ea0ab6c9c19eaf6946cdc07f89521fd45ca8255cd7b5cddd598d016bbe4b96d8ab8418aaf790b7cb1446ef2489cc5a49f684d9861c1ea7207f3397a91cff64183c34801cf9af2ca44850d71368c81c1d1bec12c784667290d0db6ff8c094c5936a350fa02bc68bd9f4ada4a7dd89fe715df171f525967943bc9d1ee97b4060e9f4d8cfb3bf4cf41e0f86d613265ec6bc974ebfc0b47ed9d499485cdad83c7d84cc97b8dd9246142293aa513b115b0d6d1a9ad05f9da59ee593a32efe656e8f4ac65b4ea7702feabdce2428e1637408309d568716c666e5000861c82b275e83e32d3441eed92a709980256add2205c32c6dee87288bf68d3e66a85fad69b7e7402318318dc3214f919c9396e538d08a21020724d43863a65ec38cbb09d2e142600d504269eb31799738c1c27bb49ce79344e1f96b4e2eee10c4d5ef9cd5221ac41544983d1642d0fde5664ebdcb755b66a9cbc99549402d79e205039a8893808e6e1fe4b989066fa325ca137168c4f6dc89f03588f622e41ec1922d96cd63681aa4bcbd40f22298f59997e60a56e21bd839f9ac401907dc0570f9feee77bf0b55af080e64c7e04fa0cc26f91468e2e93c9939fb16bf79ebdbeae480365940f0253388ec38e866184c06e0552548216188439749652a1dd3dda7081ada4a4559ec4291051c6514a0c10c2c6bb5eda05d5e07bb423aabf1d8dc5d8c94660fcb9c35f1a2c11e5d5cf902766793ccedc20495d57641bcf9bb0f011fc8bbbc6c6be4fd65bb341f38c9f6f663861fc01207ac178e5f59a7ce79d5fa5090147b35f64099fa7086702fc3e1419c4e74ca5fbc78215b1cf23fe31513c571d2007d3f867b3e8e01f18e63e2d7a5718c2865606f6dc24e0eee1d73d9d20bd54d116ed11a8cc960599840fe818ebc53a46af2b6467297e47384d79bc4d4d516f88473468d9a736e7e209bf5a9ccd38c727ac9e76d6b610ddba10c6be492e1a3236e66675488c0102d7d14488cfd592f346cdf7db12d00ee9888db28feac528f49af92610ff9627b534951c67cba9c1bb89dcf7bd02c1e465ed716fb117100a73890d2fe000988b43d85472df3d1dc2a9fc8aba5a38ae1474a17e992988bb1627aaf62dba17ee97a6e2156c9ea27f5264cdbc0c173a4c6f00ae070791ebd2b25ae2789125b2edb0a302ab81c8ebcbb42d8aa4e9ae2a18a581aea4fb379d6281edc3cf9e531b096355059cbb82ca4332c1140156093467712ddf13827c80dfa9a6e062220c816298d06e3473abd43bce5f176276e62d1cc1fa92440d4ed7897a6a2765efe193e87e18d1d6d6f4bbe52c058a29e2c4a8d90f0fc9995f849b5e76b62e9d42cf5cf984cb2f532f46d430f338fd2d4665f41db52712d6d26cb65553ee48b84f51272e63d2e4bc08372c49b2608bc2392a474171662279a4f5bc025e89a37b4034c905e4e73be548d0e912a69b1114f19e108edb65bd2ea903971319c016232c8d3abca31a914d353bbc362edbca81be27f4dad1919a85b177b4b829f763186c90320a1cb876ac232b887b0baf03d2468d1b6a6e61985517a1da8d102e787746626d90eacd89c7559d2bc6a1e992ea42d859ad4684d27f802ed657b5b5b351ed9e92e31b22d67002befde344285520f09c9a9a3714e12e70626979552b02f74e853ec6236c1cd3cadca85e9155d65dd5b4cecaba57a0b876135ef88b451bf16562ab6026bf6450e116346a83740ad203ecab8585ed935b1b8d46a9aea8c3bdc0c4ef69e26a50eeba72814c44f66fc8571bd76b124de921034fc883049b003bd86b9cc99ee20196e56edb28c3ea24dc9e71ff6e8be8dbe6d933fbec43f06f3fdee030969f8468ad22c235fc4feb570563dad499834e571901246baa3ef8c34b2891bd97a70ed337d14dcef76816deb4309b2a0b55d22d114c558f28d6421c65f5bec9983ffab10a401e689761d6db61ab01ecac71f82a4089cbdf34ce691976c7340088cfae45e2bdb948174b08df818e82eaccf4491d4c24fb79219e9eab0c57a6cff4863e9719969b53940fb276da3c93ca0d9964631d3639aab7f8d8ea6ab43e45150a13e990eb1c544d748c25656d2f426cb74b2055e616c552c70b005ab1ad5662680ce13839136c3ee2e67f3dbe8a1ec94e363eee872ce580ca0d20db304599953122cc92e4b2824d9a75389b1d0490d229b0e47b2bf9fa230d1b5c3bdf873c736fff8c3f1e979c71c9f2da6d15fb26f83ffe9f8e66ac41e7ffb7d6fa03050dcd66ce20d03799e65956695ed03ec5b76857b7a7c6ed9c59b4420b6f68d4728b711f1cd320c3a67f9161abbd08d6dea62433bd2505e4a8eafbf2333efb7fb7f345374797df62e7e377a7f7c73764d16f4b2f9c960cb73c1814e5fa0cc4b7bae427623579f2e2ece4697e40be3f2fcf86c6b6bdf07f978f1eef4fd29c01cbf533e794657d75bfb7b7d7054a781fbaa0f6ef43db67770d0978f1ed4dedf9c9f00cc9b3e988fc7e7c71f46314dd8e9f9fb8bad57bdddfa38baba02d8adad57fb6b40e2e3cbcbe3bf6dbd3a5807f7f1f8f2ea3b18c4ab57bd90b056a7273090f8f8fcfc020633dafa6a3df0d657877d309ff0d8c0e4ef31e3a99d3739a0900f70d92ce9acc29b02d72b2a5d8993e30385f55106ddb83b8e453b316d6ba3d6280299284f87bd9de0eff797e88afde0b5df59c9563ba0732b48feb717effeb6d5b91c7461d846e757b05c07610038a8b094cadb821a0c3ca3898c74904c9b8ce5d6872cf85831347b4478f2b6b6067b0f53f85fb48bdeecb1192d8a5b644d421e1d9402254ffc183933a8283a46eb848c1afeeefafa9316dd0d965f1a1b0db7711a91c88c99d8306b470b876f58ef5aa8898abf3b3dbf86c5f07797934f8ee0ae4effbbeb8add053bbf0050e8fbfe7e67fa5dc093b30b58a3c3b56d8a13c4d38bf3adb76b8147e727303ad8e7fb6f56c272da87ff3efd846775dd04c14e7afdda409d9fd14458ce77be8baf469f5462a761f2030ffd1a459d1b0d4385514ee7f219fd80f17328af7387bd3f3e45ff32f09c08c041c74d3c0cf3bf8e4ffe3cd20dbfead44f2f29fab44100dfabcf5f6e4e47d752fb1f7daf199737d7c767cec03a17e3870b0eec20cdbf7603087c7fcc61007c8ddf72d9c1f55ceb1a11746f75cb7525abca5e16cf6dc7dd85327bf1cd5a2c0cd3b77d4916f95cd9c792128f926390deb7653c622191a42ce2b3f154a26f1d4395b54d198b350d4a1aab964295583e5f162d5c4363545c25de17c9f3353363a2e961a0afe20971d71c530ababeabb22901d5d4f64634548d43626eccf3c07630e89f848cae485b333177a1f191a374b9b830a71a9d2e7b2510f506d8e1915737905584053b0fc9009f96b26511e1b84c1f874e437d2d842a271b6c72cb0317b1db5dcaeaef6dd71c215cb7beac737c49483203533b496ab64fc9b254560a06b31806ba20d2fafa377785d647b1180643369db92bbff8eba34056ae906a65d5c0897c576bc32fa85e3a369f426a1600d1a51032aca8c46038d4de7d549748599f56f8698327d36c6880ba25fb1375d150d925ab837a30302b13688e766d908a517d026a859c136cbc2c4a62b2a26ff25aab439c60f48135dd40335a2eb6790f7afb84ecfd082962c5cba0ce09de51b3ed839e29250c9ee780aeb85b689a3fac9b9715b360dd20937959e314c83dcfb553e29a7ad50173eac7b3c7278df86484e40a9709792a5e33622302636997be06aa321cb46f2b660bffc26c1d3cc977647a5007cef25dff5ab97eabd47e16173aa43a91ce20a1229ea33c13db55d6548fda082d29e2723a45b4d5bbdecdbd83070fbb789bdce192f27076bf5193912c91592f954f53990a1184f6d306c99c63d151259ae169bd4e5a8f821ea2e0bede5e8a56d483749e797cf3f9a336b0fa2583aa7f26f76673f466d6b15be0d77649fc06f57b6e9b037dc91e5948896d846d84d48327cecff4139ce63532bf536db437b98b1191ee4a991cdb522d49f1ec58c584107d3768cb56654b46dab0d87f5ca2bb64d2b60b525bc5422529af3dc9c494a3f3adb52cdd22c368d9113f97b27d97555ec2ce55ddbfcfc41d01cf0133bb1deedd2d0a4e817299973397db77ab2c46ea45590269c855211b958c0548fa40bafc406939988b3c8adbd0a778d256ec4c2160d5087fd8a6a1aee76ccfd0ebf243e33abf6aff8136a2a7d26c5661f81e181ae070037daa7d2c1bf4bc11a0b48515103dc16242c29150082532d1b6dd468b7da59504d86062b37475b4229fc929c355017e0c5ecdf798b8e95289eace2ceb265e918586f57d28ba72be264c5053322b48702fd74fb7667268c1b96c5c6f7aa96305f53f13520991f3f1e6f0f0f053bb18d8b2a74be12c9c8715d9eaa1f192d968523f4332483773f238217ccd5d28723f8e8d75f8db160c0919e336b58108bfb33eac06c5dc638369825ba15dac7aa635242aac7cc9ab5c8fcee4e43fa1ce05df5cdda9a9c92f62d5b3ede00679b0d3cd9067f9243425ea18e0be9b901a0049f21d9774fc6b80f6520e84911770236cc51dcb1b35646df5b78e27135d57a82d33fffebf16caa61be3790814ee627c1a3f369732acd572a2c7c085de9a325635a66a670131d4012f5e845aea32421bd4b90a04dc5b2ec632e1c6ccef80f89865758cfa7981e56b69ab77363224c7e4d4751018aa775ce65952b44edd015c641b3b05db8f22f70c7bb771f0de3735640f48eda2509eb57afff57a7090ff7a2d40bd54ebab51f7b02e06cff970fd89be83912673efad54af9a734b30642c8b0f38e5a4b794bbf59071da164adcfdcbe3ac0484c1706629983149c8e1092309391331f80c91249d43150f7547b80689976cf6052a72a469f41c70c5e75f930c6f47e4c442fe946354fa67ea962b557d125fbff46aab5dca10fc92fba804a6990bd71fa17458719f359534ec3817669be75ab9155ca282475b19ea86d36395ae071bf65d96179edb30746698ea33c6decbe487725b862bd429472ea4070cef82fb6f4db8688c14d1faf2f467455d255365c18a009e6b724ac0569a3f72eb7d0fa4d7a80e7ae2a26a5011e16901044c1e037ab19725e47f4629c18f0eb6a6b294b2255fb3c4a583b56c32cbf51b904bac21a952b6c5f5ad7c65c55d5e95562d46f34457bb2491397f512c74fd85e1dc9385e2ff919b39a50a83b113957b0a52ba553cc4655bc1ddaf36e136b35dd2acda3bea24ed77930e4c4fc516810eea919f48c4b5fd90cb21419749e6295e4d799bb5dab6b14966136d50917eaa60ca27aed71c36487234b6d4c56ad41ec9b58a5e7e4a220f2e31fb875139c68cd4ca8c1798682640f93942f5435692e1741e6338d5222a897a48c8f4c6985fc8ded981fba59a916a9868f4c8f8f49a309cb62e123701b42150238eb3491fd02f8269b689310a1245ddd4496b97b11aafb1b1b89bc57ab538b74b7431be24ce4ee40b7a3423b727aca085762f40eb4fca3b7951300a4a0d2d3d87e5791e0d48ff8c1d020d23d4bc14d91b56265a5f70cbee44cf73b687798e67220883e1459f6d11339b9893d450c408a4f1dbc46129d8c1caf3fa76f11c52b22555b8c035483c6fb2884d76bca628849987da91a608039717d57a518c75924c95fd9a0e1dd2a7c32893129a2fc7934b83dc812dd3b415cc1c7a7c2948b68ac147c58ae2f994988f8081098f98a60d6fa9e743833c2f5bd41ded69743d22bc13f1865ac13d37d321f59a7ea3570bf650868cfb3242ff544a59cb2ce560779fdd8365550e57fe44b60baa316a46ff345d3773880b1066a3f4d9b9f61d36c5cdeb688f31817b0cfc1ab54bb57164ad4d470d85d6162b66ce303615df6d7757b27727686da4f99acc175ed77fbb2f72ae6a66c6eb75adb115d80bd97c1a0d8a9278b5244149be6438226b0d58ade0eaf4c3cdd5e5fe5049cb1aa5aebe6ad7f7b262a466eded0eef61a531f3e31a5f682ef78b5666bd85a2dc658afe352930e3556c925d8772c4726b0be5078418784c6d6a5f80e10930aae4b6363ff635165de3be927aeaf85ff3eed2672c7c23326861366134f8c3fe50bd18d84234ce10ed867ee3e901fa8bb48aa74ae288eeea60beb35ae99127d043e113fe54b68442c0758906890351edc6e01d741bb2f1ded06e419b5dced0782ad88ca5184d6dc55a63bc9bc52d0430648c317f7afe81d43866a52209c85687d4db7d613f86a48fcf473f5c477be22da1c98b365305150e211846b0f4c9c5393479338af6a9061485d8658365bebd1c1dff19750f5cbb63eca1f53c77339fee9f589c3256f98c6b0078cd9e0e88a1b7cb3b2540dfde16ccbc4f7b1035165332148b91b1af8d445a22c0c4f5b18a3262126327f8866474212d9794f0904d6387d7bb1253e499d2b822942db259a2ad27e0db78bd0eb934d9b0728f472bddc72f971ec0940317e0a00bf1ca8578d5853874210e15843694630b3f5c5421015af4a7117051dd31d014572dc9987d2f4bf810fc74fd3231fd652cb927968eb41269a9b70910c7061d7ef184c17922eb5d1519af364c5648f6086f7b8e492dbcc23a991fa74d82196880fb980c7b7cc9c48a93055b57fdac75efd1510691464a2e4603e256f85263152db2e0c37bad44d47430038825ce12a124259b33225a053344b6baf842222225fb1a4353a35155547fc919590424016ef4882a52879b6b0d1f71274f1d74a3f0ab3bd4793a645ae5c95106ad809c924e0aaf2d2e1020d0354f2c63c4bb0bf26513b18d8937cfa1dbede3e8e3457c75f3ed7f61305c0cd3d30b74f1fde80475a9028b851d638f2d242ed45311b2d3654762f6c5c1e887fc2bf7d8e760f39aa693f29ffb461274784e5dd5f7e04a67f54fbcba56b6d3873131dc5d526de46c5061ec2bfbd7c5d70def595db188162a93839efeacec71f50457533245b6e02454a1eda131e4532a9927d5e2289066f89b61d7a8b6fa185df6eccf5f718530e9ad3ddf98b0ffc6deb874bf1f3876ef90f2e6d0c703abd6768947769eec484bddcf9c62dbc2eceed21876c9ab0a6a7b218f8a1407a4628efc1613b1ee181771ba724a62a4c6ed92d892014c945a4221264de4d6aa99ec5b7caea247853044bcfaf50e3b66232bc1433465684cabba1b4f53470f51560390223955bc35d8092d37e72c1bae986040abbaba625aa1036b7b68b9f45769038747aa88edae68664db40cae8ebd69fdd611cce76b46302fc945da13305db987669aaf8591fc1ad45351e66de4b815fd60a1f251c95e1c48f7af78d4dc0b2962c786a30459314114e4a904f4c066c34dcac598fc7ac3cba9ac8a38a57f12e857dd930f73d0eb18cf7717c0ce028643c78f901d0ac3d62dd077532c7aea011d8483d0da70142177ff9306d45d208e86860efa5d35b98e8b23797876eb49b934acb341875a195a44abd2cb673534f5760d7cdf55d9cf31c6fb487ae203ca3c38d102711bb1bd1f998291cff2bc69d8fd081e79cdbf87159b6561f7dbf66b8cee1e0e5ebfb1c5086ee81ec0e17d0015c0672b54717f78bc59cc32f33e17df41ed19bbd876f7b2b054dfba3ebe4550032b30b5bddeda620e452af536d9331a38e1450db52eb4bf9aa722565e0d5db44111b564c469cd3eeaee29f18a4ecceb18f059eda4ecadf6219df69a27569606fa345deb22ccf800f2c937c41378634a940ce2876a9123cc3a32586a642f3655f98892563c9e8ae742fd16cdae344f694f23db71153db676f27c00e74853f82b43b6c90289fdf460771752762568d6b3ac68091fd06645f1d5359a5ffde5667433dae9a67f3abebc0aa5a3c1512059b843819ce34f9f02a97fbd3cbd0e554fb63081f48fc73fecf49934b84843d7e91b2cfead16542d97b1f6b2266e7ab5cfb5aab62332a062686adfe9946078038a2c1fe7b3282bca76766bbf7f56b89760b8180a56a7945a27a6565286f543badec25f87b94058665c4e8d55477f1ef420ae33473c9761a03bab30ebbae693aa140fe3a83c4b61584416821b0dcde1604f97453e610f0bf052b0be3fbbb12717ada5c68d999d5dc2ceac64a3da4c63da95f122a91c273492cc3600e1cccf819df1a359b49658cb7ac9e0d3a1c82a78f5a06a997a0d662587c091451d0027ceb50d0eb3593d8a76930d6fa73b0594caa40dacd21cc045d6dc96ce66e41407a89edc662e45ca290ed06dd32c6b1b8612bc7a507812fbe4ad956c7102ec547ada7543a5de96dc0eaa43393c2f656e2d06ec96ff4693ee9648cb498b8ceb58a29d1952d0ce70cbd02ac1f62b9c0226d585a6f7d25b3e95e673ece05df1f70525f9a32cbfe4def830c5855ab2139f69e96c059568cdb74973663b69613b54a291ef5c5a7686edbb8a72eff2c471810e4b195872672796693b7786c3290e9051cab0462d69ee6e2cdd3d86dfeec488a68686a03036ded4d54de64e1b24788bc0315cacde60820b632b17d8a08ed2815b2b79b898658d3b4e497461f3a9f12555e7c6e32a95e964da3cfa69cae8b70e87a31458629b4ab61263856905b204172fa7532f83d172574326263f9ff676492ad69cb7568cfdaa722a3a6fd37e71f0d1527e46c4584264cb504dcd3e5cdcba6b769c63469a967181e7b99c7929487da34110913aca8a506848d153477a748cce7175f47a16a35e9cfc19b18cd10fa3137b7e511dcf6f64224c1b2fb05310bf141320e2e5f0b41b3d1a87fe1140cd5b22ac84c6a1f112fe7445292adeaaa9885f49b9054cb186c5786de35446f31f4fdd16981766727a62fc997ab9d61e6a537c68c2efda8857381b30a723378599e15ee2729e4c3274396ee977490536adc3495aafcb497575b964222d574366f08054c33923a9a99b01bd98b5d669534eff1da61ecd3da98ad5ae841cee0895ace57e5ad6a729e006b69c97c007d04ec1ca28ec7d8780b6f25614bb4f9aac122ceafde9d92812eb04be51e5b490bd628e9a40488989371694d290519544358a06587297f73aacf12e435b6e7ba9664dcd71f43b9d125b66c56e1775402947c6452457515215916e948d3823da249dda6287e3e024abe9b34ae83a4d07c4621448f1b42434964269480c12b8c1c6687c3b4e300c1e1a9295ad3276a30aed582572fa315e4c8cd64e475e5a535afcaee43ebac454b916347281690e6a41458d5c528c82d465a7e448a5d14c0bdaee980837e4f43a9b7c41ea55593952dc2bb9aa6b6de8a82f2c46a1eca40e5d22e6a2e4c4c777a8e5e42dca3b114674f3f4452b022a3b8fd72b5ca7b5d6819280b4c351afbd8d1280b0b991ca60967c5a9f305eba7b961533784906da519b41da95173865ca2b2f00d90ca67d26855f5b3e35ece28bf6c1166ee8447e2828821f9d58ddf8d7caa8567304488b849545c8d1068a5b9156e3a162b272b32c412ed8a415eb8d6fd3eaf35b9b5de6655af3e5cc26033893894a1e70a3c86e857e2a572289d6f913e19228db010a572b19afb1a9740df3a5d2d082aa2c471fc2cd72b067be0fd48d8d7c33bc8f2c8d237cdb8e1cfd23b1954c039e2e997dc8ffaef69809680c491dd17a46e10f2bc091eebccbfa403b1eeebd04e5313d14c3e047e7609b22ca4e3288f2dc6763090d2f4bb01a082f5477b14c1e8a39b5b9a54a5cde9aa0da6f1df072392105b16e45185e7391d45f4279ee336ab5a359f54a94a7b308435a323dd8935952a6db7385af938e05bcc11c7f6537cda6b43262f1f98b3c8feae21587e9683a9b93ba6477e052437052d8bc324673d9e44b56de6555108c6dd8d782496df763373a40a79e7e80695e04d3abfa6e3f5c63b9d01251b9c14de62f66e89d2c208725abb346bfe022c90baf128daf703949366f045965b129cf6eed1c664917a2c36089512b2c2f3a2539b90beed618e20aad005b571d0588aec5d87455850650aa7cb68a930f440621dbd6934c5c7d27cf7fd16be580cf81a22fcb195fb71edc1ae2a657a92da12e565593dd45d4e990f1f4e7e428e546875b4a186aaeacd1c9089d5e237c7fd0a18ee079791d4bea914e20967f379908806eb246074c8e4234f8f1837b4b99c2073c65dd926426e0c369a84dd3b97a0454e6ea58714d663db965c76ff5c3c9d5460ba25d46c6f80b7c3931deaaf2186ce124ac85b2749c039bd1fb396ec35ea6994bc90975665692e764de958411785d4180becef8795e77fc6cbb439ce7f8a546c2a9f334fae21af7db2804eaf4acc3ade964d9bc20dc45c97d9f2b0072036005378619146286e35cb0c14823a6839a52e8b23c62063c72fd3368037f3e7fec0a2e27d26c74f15e1023ed4bc341adb372aabc3d608fa38317fba1881cae6c726ac7e946aa1599ccda5ac81193e76920e0b671e89acf42a24fe26e88ecc87659fa2fd5aad0c3717ffd4e6dd44e239e7deb4e429c9645e637dac7a871bf039d235b068a9445d1d55669868949447ff13e8932a08e199e3934fca078f59ebf07ccce31f8acd88ffcda115facd052f22a5faba614845fdd9fbe7191c8ab23f1678463b0ad23f36a536f63716e0bd6fadc4270edbde61aed1859f1e32ce690295d63da186d833ace35ec2ccbd386efb7f1f2e2fa2246bfa427df8d4efe1c1d86f3816ce0fc577e202b6116c5ca624202e7d514bf88ed114a78f9c9b37c437eafd184b888548fc21e41046b50276886a6e968fff328bc78f3b68eabb6494219561911da070a757248d0dfa94b8c923be970254f246895fa44937b02e86e2251eb489c9def6ae7b1ea85ebdda0bb6f9d9accbe5901a30d7d395a9e9d39705c41dbd1f754f36ef0bd128542250715874afa3d4a7b4111f5d2c22ca58fa4a540192f78a95f04d72bfac73f22072ab072c3150de905eb6fcc80f4b6a541866650e87363f0a034c3e4cb5b7140df2a5431e828116138f858b9c2963dce3e60d4b320c6ebe8a9af52081dfa83929ff1e1c383faf95affb4ac9b693b96ca9ed98eba74efc460c9d55646c6c70332c6ef930aa3dc92b651203e27db6af99d9703a283cb933595fa4497152a0a533bdee5db501bfaab2aa3814a6103010a0fdb2e87ee095c849c914f6b1b5b50febfbbcf79c8fb4f405d8babeb1e3b495f7d4f2b1f1839714c7b6ef2096bd9875c24d1d3ac0d48d938955c519310dd7251a93e95621bb17024cd6216130687d1a1757db85723e4a130b541de63c87f5cadbc77d50d6de8786259e229bf6e04f839f838fcb8de335fc81fdf8a6bcbfeb258766c789554b33b8d546fcb9765904e5b0fa32056e5c4c272d8b7a84993f246a4a4f98c13566ca8e0c03f74d391eb5ea4dd74b625eea4877885ce35e07d77836b7a27cf4f70e2d85b123bc63a1177534f1cde4ccc42731cb286ecf617f0188a2f8f793ecdd8cedc2dd6c966da23810bac68e01ea877e7f91732a74ff36a158793216a5bcb823a94a58c21f5a04d1315d3a137d3d2f0c08075d243205f326d5fafddd08a3f5994a19230d1c7183dfcc4c869fbc745ea00b956b5e27b5e846b72e49073697c0f4a57242166fe33cf2a1be2a3369a9617481acb59adf8e04d7960870b6742d45cf6fc8d3d9dcaaaba19e2d431a057cac117b7d5af152086d8896d68edcc7896aff44316368f345de4a4bad3f59f6a6d3e87879d6499ec3eae365780687a204789b394071d8abac3524872a169058712c8957c7a1b50967d05b402640d957eb8f11c5d0caeabedfe36c710bbb58901a2cbc5a458f5607234acc981835d20094b8e00f0d2c01951a67c80d7de69470962968de15e51e94addb51c89b9561a5a38b7f0202d51cddcb8bba27094b275e157cc6ee9f0dc1d7552d1bb91360be7ea09a9437f0c212b6e7b32b43fb96979e4d48029461bc24e64028bc7fb25270fbf44b5c04d020fffd5e987ebd1e547248f7590284611230b4114e799594c2e412ae53e86340eaca0abe2b12452ae9d13e988a02da49f2030eaecb3434e4069b4840c3ad516f983dcf9fae2408d1e8638f27109253ac623af39e692d8f531627bddd3eb5065a88c6ea1a5262176d1402b232f2625a9774e96ad70e4d98794b015450c329b55646be27855add85f82f1d3619d48dbcf940a893359c6534461301a57284d236726963645f2aa1f316ad95c26f6fae49312594683ab8bf8db9babbfc59f2ecece86ea9d8db1488c45f4d34bc80249a3758e8ddc23daf1f068f1f8ed403bd03d79991d8b9260a663e646dcfc603127a753a6ee2f54874bd5bd1dac7b7b5725f7e12276c681fb36e2d28aa762cb9dac9bbf4b9ecf5c20b92f381a1f1c5002219f31e2374d7945b31c8d096945f947f6075f11ec0b4352969a2998c7c9224ee250316c34e6b7c4e9b430d0ac2e4bca5100dfb1986dab1971f657adf97876aaeb3054e540334ea44e958e3241f334c291cd17e8195f2bf6a99b5fd36a45ffc0b4dda39da683555a5393a7f0c714c74fa3a6a2eb56664b647f1f5124f93a3082aac6771732e3ba9c36472b21d01fb076272db9f412a4d99cc37c12d2459c06eb3120ec007be9dcf656b7cd850b045f46ca45756d2931706a2ca9ca585ea21ca0031ca47ed91d9370310d9e280947164e4b6cce0e4963653c287fc62acdd898e984209c1da441a515255beb7bc9cd6395e8d57613fb8a4c151349a527d5fcd11aa053d32ddc9acddcef8cc4ba7692904c0fa5a110ce840e555948c3f454ceb1bf583bd4c980ad5235e32cf1870b6da4d9222952d90c3d99f04adcb315a79d4f91c0f3c663faa85c1478a2fed83cab9891bb8a92923264c46944bbc28281be4f6e45d288dc2213b94864e3e8b54c95d191e9d1d9c23cbbcbe626f2357ab494008fee8e3323f5da1ee745ca4eae2cbc055f5bb775e332ac202527fdfd921b7da1109ebe667501e3520afd866580d2318fc65132929124ec3782f0ffa49a914dc18e9cfa147134a5a22880eb3ae1681533f216172d878e1db36a8246c128aeadbfabecefb58bbd5eb6a1773527d49d8b2219d7e51c259e4c8d78b748ae588bfc245ae9de4e1d03fa9fcecbaa37bd6b0fdf058117a7d3051bcb73d2021accce14f102d7b1e59e6403688905573fad6a71f1faa4169e52867418ece7625e3ec2e615cf4ace6b41390ab3e20c8e130124375237f076a778a2cb256ef5a189e0282d912d191638ea660189c639ff8fa9b839a0122232b635ef7b813b8a6d6b0969136ca47fcfac55b93b52be23d2745774335105d34ed8d5a56b3aace432a644a9d89ab6ba336b39b8926b1e509a651b25d329a25c8f82e42cdb58a5284e53bb486252b62012df4ed5e49ca2e7d8f766564d1e1dc158ece5504cb9a56220e0de4ce116bb95938b9ce5b2d0c63616c2249c4c756556f0163af801e7eb08cb8ceb221b69824cd0a0f777cdff629898fd8cf8a92212103692246adf735eba2287d7f9f6976c95312f1de6ae208218b4b58fe58b3156b7b7b307c406d0ac63696e3f3b4dec6f5c22818c9a75a79ccfda750025c157d92f21c75835367a3a6ae9ea88a6f617fc5d36ad0eb995b68ba5e58f09b7252010ee4a03883507e4e6a9bcc7d05e18a90aa36e148de53fca7031b8591dfef6deec16435be0b99eb053417478307fb4543074345a74e53bcee87557e43d1553bc2fbc14843d38859d0ca3ab5da201092db956828ef38c4256a5c0585187091eefad561714a9d2b8ac44d98a333cf14e125cc8d6374741b712d82586e6430779aeeacbe6c0c339d654ba4ba4ff9255338b68dbc66fbdaff143c7fc5871d1121c7be25522ce598cfe50d11daa9d262aa953214c8d5eb876508e602877ac778cd6127101189daead6e0a86cdd64aa60d936a8588a933d86d747f2a6b42e16ece080d9a899938fe6e73cb61439e3ac4d84c7f5b8206722ab6b196385451fbda5f27c79fa0055823d23142271213ad8d80c90ad372403449a141ad14554487bbf5e3085381b6202fbc47ced7815fdb9cf597441096df95da78576ebfac819dadec5256cc820d18a38b37b70a2dfeb6a03485cba9708d58fc404e8385fefce6f0473fcd9b010f09bdaf50f0a7ed0530c603327a7eefc4237e0fe4fdb757189218950a4cfa87f39bf88bc9547563252bc78f0071be3cd4b7cbf1fbf8f47c74fd6683426fcc4856c31a71d14f1ad737fd43cf3870bdbb171773e28fec0f8bff6f25ea78189e22659dcfd099eb9193d8676067a73b9430612276a689e38037fe914b8309a402d11808a2c4f7c22084b7266f2c112e4e47653935e4604eea3d5252c11de3a631a9f2b2c5b86e2d3e352fe763745b849290c2615a39f1a54832ad52188b8269e38060738a87a5cdb0d5eb0a047582b10fc80b93e16ac28b423e2a45d4c3489af0313a6907b6ab491592efe67c97fd6c7bbb46795a574665ee774dd2137b7d1d77022c6fa1403cdd0cc121cbc25e1ab9c8302c82ed427e2511d1a9463919785a21a5b5f9b45288b074a811932d1e6fa3ed4ed2ea5175c12d953e4f0d99ad36bb452427e8965fc3589eefecd0ac46c24c18006a8c608cc1729724d14a766ab92d1469b408b3be8ccbc51899aac9a36568951aefb1a87dc4aa9236766e49a7957e4b51b648f4a7b9e5ba09c56c7959ab7f8da63b1215713391fdcd854d5869d7f6d2aa5e0c309975c49e4ae79aed05ddd228874843c5e1b26af66772bea4d540f4f05cbd1093e4da45b9e9629be4d6e1dada5ae9d8b6e35549c563a01e89679215a26b001ae35973bc25a9c4d87269e6e52c9207ab339c268cd98e532acab5da328245eaa3fd4a932d1e50611363f5a41b86261dd35eae6ff2a55d2a651b2218c9e6061dcd95338311a809991aea13c88b09334311d1d47aece40881504fa53143daa3181906b6eb02396593668d181ac19405ba4bd4232b669bf4a9d6f02f0024264f141bc0253561756ba0001d92e73818482950c03ce01b96c88ba7c16bbc617378f6cdf334f89815de361f7895f165f694897a4a0176514167f3a925f69f5e242ee9c978724b526eedc6b2f8b255b37e1fea0b8da09f507bb9c12657d0daadcb86f073f25ef4847dc56cd1a7ec44cdb4dfbcc8825cef6c0eafb547b69eadc62cb2c9fa4b83a0cca5b116d2dc16eb40f535b1be8f8aae580f284ebb3603d437c226e3671c6893e13306b47ebd545736df44aa84de442b39e580bbac5f5f827acaa3c0059ef2285089273c0ad2f18d1f0505bfe9a360c33fe151d033b5e11d6f266ad30da13ab6f986704bec3fbdc8ab2775ec0997975764ff379439f80d650ed7e0646ce7b8ee5030d8534e859478cab1e0224f3817aaf372309e5262f31da58b6c74c7b41b4e68fbf4196d7fc394b64f9ed3f6e993dafe86596d03d3babe9413b739de805e408571b4df61a9de34313cb24e86b11330cc2e51d44d63662ec54b210985b15dac83e8c977446fbdb53054c0542263226f960575d267ec9aa02cebac90ef75504205ced6600a4629ef49c076edab5c335b1ff5e6fdf82d45b047a658c01f3d8b9bd017fc4fb9a39da1d262d27ed3ae545c37e01442d4f011d28aec28db80a4b4030bd431edf08d8055b8a53550305881d416f124a9a8e1e11e979576ec276efc995961822b52aae185ad12d0b057f9b51a05caf97c58fbc0441850bfea0daa9ba69b365c6733e2e16d008a5c1472bad81f97a2de28cc82fe5ee589dfcccb515fc4208bf9c6aeff5907b89c71540e891b506fd2466cc50ef0169b627bf4f1521944f14f45a79cbeec7b61c94940a9013619772062658b4472c83a99669600527d2ac923092cc886aa8ec35c4fee21c3a05123c11eb925b9b2aebf081d524c5b2cd6e4bc2026b770a2ffc50e107b406cf10b854f8d46df7f8a3fbe5b51eb6235091e288792be98a4aafa106f5a1eaeac342b50d3b85e3328bc122ce8ce759d3e16c4e6c378c0c8268c174957661b043ae887e22e316c3f14f20e5176b1fa2e901669b2d8c2672dacd2a0595f296ccb2ee332a96f45fd5cff543b0f6753cab236081ae35afa2e9d2c250272b54b58ad24589172c79a4f487f58945302a971d3cc3719a386bf173486654e9802f74a5e65b69231a72b4d810a451de4e6d6d133171872148ee498535252a57726a728a5b96e55a8a2dcd3ca98ac1f6d4e38a793ecc3a99fa521e8e5740d2700800fdc9259d32e354f7e820252278da170e539789278335e7f9278bc75503eb712d8c47fdea8ccc6753fadda981dce6f0cfbd4ea6dbfe04f2c619ab20ec6ec17b82192f946878260d75925dab01bde3c4bf44b69b97a73ae05aa48eddc6e8e9cf500e6da8f0c5ae5fb5e11d78349b4ed7e77b5f256825b0e879f548c3d3f75c98b35c5d824e6898544e3e249a32ae03dbbed725fd71443579f244d7dea2cb283ad2715d1beec94b2a864bb76d55e6a4c3196fa32abcacb20833a8c479eccf3bb5ec9fbb65b8f6560a4dffc382d2796968c524db1bd554bd403c2e4ecfb5da7a84b5adc77412eba096ec503a631fc360e41e40b40cbfbc2d5e6bb43d711963adf9d8470d0bf634e60ab6a7c451019c7ab1e55e382ea84e281dbb8068f1b890bb00a5cfcc876806d8fe3ba8c7cb605d929a937b2731fa81055dbfa67ed0bc829d58ef9b7c4f0dfac948c7ee4d314af2c0e5105b8931f7787bcda0fc8ebfdb2ac73564cfc43b43fb4bc2e6e1b2ff74741dff7e2bc54c80b74e315dfdf66d9dc7551ce436d0b5435922889abe6d306b7fce4b351f334e20cb1b24557e0a4f4a3ec6d7777a9925dedacc02771025d122ac752ebaec8d84e77933fe19fa36e525ca032851d280ecdf49666eba1feb00a70ad82702b9f7379a98caddba2781485a2a87eac715b3886d5598337271912425bd87a6c2b20d1f6e8a456b5959cdde5f3385cc2cba262acb44afa9ed1dd81b264a467b0add0f691f47eb5de8178ff51f9562818273de61a8f8285e2db7c76db93b5acf39e9c4959ce53ba1d82d964a3e6ba00f120ea2c1023b7476d6a8dd90e1bd7c72efcaa025e148f7580b6af2ff1555ddea382daa3366f15c5708641d32fcb1a0e4fa83a285455d7839865106fa2f0d5ec8ebb2939be5291dd2bad3d7180ada5ee2b99bcacc0877684ed7283c1ba2ecc362860b9c85a2b6ee712f0bcc0e59d34d986b04ad7671dac282eae0363ef8b475aa36730a4a5a1ccdd6d3170e0a89564c211597e1c5abadac94a54ae5faa52fc01acde75d38d2615a09cfdbc0e588d26ec834a6c5c5722dcec8c92de91357ce271ec01af958a2d4b9824e1aca8e709aee565825a074657c9e0173378a46dfc82be3bd6d2469df5567b30d1c2815bcb116a62cc87b448215dc626c481f81d03540b4952436b9b3434993017ab4e961bd59f01f66806b3eaba36934f3457540f57b098f80b906f43dd487115a2c8ae92ec920121f09b2aabd4721faa52c99b919736a50ba720932cb73de5ac31d85b8d60bbdf0ecaa4b2eadb85ee646f664773500364330adc656939ea1901e4326f58507597ac2159a58cc207d8b8dfb8f02f1696bd007ca81070560a36d78a519c27ac019c1df14a01144754aa5e799288f3952e8d46219b32a21f1d7477bb13ddc2929145caf1b7a7a4090e44c0389f13f262e2c68a4723673ef860baaaa092382913b8d2b4746f220af5057131dd784c0a348dd20c49972a37b123b988448a603de0d47619a81a3307d68dcde2465ed1c9762818137345792d3bea29e58dd4cbd4caada8fa0eb4070ea240eae9cbd7114f38d9b2d7cb793ec906c39d088d22e5e6d736e1e19aa9485fa4186184484c6aa04d39c08c15f9c5722524e8a9eb5fc876a4a03c19e9bd2d1693395aa7e5353ebab457b435b44d9791b0192ebada086a6c456dd46521f4e1487b07d3499e53b8ba74485949a2480d06d09c59c82a522f040b2456933b4a5411ea6699bd7d27cbd672e8b6f4ec4ae4fbc08af886e7cb18a2d027519007aa051c7583a8098c7669de04ed0d0ff6f6b8ac55fb3a196627a96ecd4aa13127519831f9638a552059790e4cbeb857d456b172cd6b7acc8db4e5988c4aec2ccd7ff0ecd6746c328ebac44435be4ab8a79308311274ce907cc9947f3a5946a5a31da08ca9f8b6f95d5b3e066c5a0dfdd7b7c63d11be3512b084365936b149e10a4d8ee94e257f392b1089045d8ae1dd6b9b1ea6288eb118f26e5a509aaceab1ab54c80213a8f02759f926101842397db1930366b3261be8670bd6890fd0dc927716ba2db32ae5c0762ce9a3835a8724815484bf0392c23a7f88a71950a50c268f8c0f458741cb8c82b98af3a4f875fa1144eebcea45c899a2f5ce35b73e280c7e9b8d1f706ee1d950e4d1f64baf1a2164b65d4760b8bd942b37af26f20ddbadc7c5381186d543ba8c44cc1490d528b565ffeaa1d424d89e8a5c5b39acb5a5ff86d8c58c901d85cee0aed0cf180849bb427effd85b74b746f46aa70f1dbbd8583c1ae71a8bc7fb3cb510dbcce4d0ec4cb4eb1d1ea888913513436982e05210d92d39eadb18d3c065018f9244126eee34f3695ce3b5db681c3b6c188a2231f4f2e2e95d4c6ee164184b4f654a5bde172611cf4eec826a232c274fb1316dbffa730ac6a59e59fd7e8825b1360cefb1ce766f1f0ec8b1cdff763552c8228873fb32adf0117d2056708ade26dc581d41281c195b084b974c424f010a50a57fd65e34f586650ae1a2980317a3f9e027b2de483ecf032604e170efd5d1c6a0879b82bededb3351bbf0ed640c6b59654d400b4bde11b9e56d73b7b25a0216acc92e14ab5b9eb7e95ba90beb7d466cc5c97d7ae4079db5be0e5633bbf2a2d6f8c95d3269db853116d796f48ce72fc8bfd0c2f2cefcb098330a63e152d41d8575282b72e566d85858a14b70dbf7af4ac7315bbe585432b9d055f2199588ac462d8b0adc0c2bc4cd8a83b90e041d4498f9e4240ce32b7659e24cbfb67ec6c51aab72004104385eb8f6de2bde905c9b0f2b470a7e2c6f874073e4518bc7d84bf69ad221567475dd17cd09e5d89f4d7bdad8e4ead844eb6cd592e546d6f87c37ff5cba3ea76b4ef155392a724052f17da43c8e566472aa48419d8e375e725f18f77b6bd8501abd21f985ab99555b3852d2349556c8aae9d30aba23a9241331682f99437fc91ea3729e12cad26ad90af70a19f74b72610a3f5e4a35a64d8c0d0695b715c711eb73ba31d856ee5755ba0913a25d251765934f1fb5831b2bf009e770205f2bbe08df1b0d063ae3e0df53e3ffde492fc73f65dacf09ca6f801891a8b72f314e2f7a7de33858d220466aa198df188f1248d6550e9c03459cf17500a6f9c38afa34fc6c3cb92745689c11523ed3f3a2dd9fd4191b666bdf7d4e9a2627d1332cfa1f11cb642535edf2bb99b2d234957b72c9470b9c5be58b3f983b5b7e4657f91f46e7a3cbd393f8d3d9cd87d3731d7d71b654389b0475477f8959aa9daf586474bb241c9f227365751d5030d6b8bce3817b12f2d58d44c3b28ed40f4b720c099a4f28cf5c537e7101f2d4b65cb6948325e8edbd95b8cee116d383d8ef3556ca3076ba89f322a812f2df67a7df3ead02573d44cd32ea0592c83eec00493c1fad87489491f31aa5ab9838d8eb7de618e042300047f18b7812b6a097044e58abad53636bd2d596b314fa443507270105351cccc455e5ab4577df01168ebd5727ba9265adb08d34d6ede84501c2ce64aa8e6c006a29280793dd39914ce5fcc057117780164d1b2acb2a19a93821b10a3313c6a72e39d5d6e8e30b5bf10e9d8131b0f895dbb6bfba550ac51a488d27d97c1e62c1181055b9225f534b7ee15714ae05f977c42d703e65c2382db3a284cbe4881a98dc249c489c5cc35db420d5be375a8aaa0113a939ce97933a5bacba2fb9c6350c926d32195c03a4246ac4635c038bc1ee368364ad908d405528b8cda00923dbacdee56433c03a590721578ae132bd8ca0769b205d4ec4b9844b8d2e27563f8eb694c28e8ac88df916a755bc3e2cd130b7541c48f5697beac534f1c96c1b4671dc22ad321eb1fff8902e399d5d239bd3f17e2c0562274c90efc4c8c914245879d8d295419692cd6f224b767ab839e441f7c5d23dc077073157a7bbe26b7c45ec3af4ccb8b2c670b61d5189f1caee54950d0a70c4332a45578ab03f5f477779d5b4e8c11c19b384ae8beb2694f6ed20fb8b9dc46140f7495668974e09bc97c92cdb89f6a23f01ec98e3510d036d536bf11d3570d49b2fcbd4c9cdee1709acf424b184b4767ebed42af6a1e2b043615e2ae32cab1fe2273e0d5a94819a10717d8fecc8808508d553cf95bb76744c7a64528d9045ba0c697270c4a0c256cbb7338d6429a8f06f83aa3a4c13cd4274929fa6025ca8041fc5c31c9b4d23dff10466dd92f143aa8420509fc83595b0290e038d6a98658544f0540eb76940519373340920076d3d3bcbbc492487b05107ac4893ba812f866642a5b2582bdc58b324597536a90294bc8170c0adc5fad2cceb8e03406b6fb8d7395018e4de94feed1218944c7a63064a3e355b89136d11a92459f7a695122fbc92fe352ac9cb5bd6c9ad6f818477b3ea2fd9bd534c0be115003c88f3392d74c7ef91034121742c30ab11727a8bd73579b496587cbd7e1525e1e3f1bbefe38fa3cb0fa3e36fcf468ab98d205f6ae3121b7e13e70b2f70695425599fae3a81553259625cfb3a9600e9811c614a1804ac53ce23f542a505c4f618d8dc2e4906a2b95229b2d444376d62d689f1e8890e19404a264cb7a8ea505faf9d652473ae4960ce2a443375b844cb9224784afcb788b10c15715c0b4a0f2cf9754ffc29ad660ec001415008ac347144ddc2f6fef60a7436a7b80bd440de96b3726017cd8d67b56e467c9f1769790f749a3ef5012098bc98fcfdf783acc92e4a7547029ef6252b0d073b002c585868a4ba4740ae87472c52cf9ef24a262a5490f83fece64beccb35b5504441dc81ddb5b7a09970f2128c21801d973ea06be10290f8bbb31f1977d638f451303b163fe965a5004d4a7d64628af8b4bd42cc8d569a95128b673d570b98b3033275d5515d29c7be5c030484af02d48fabcac3e39dd6a1e63987b05a7d11aa3c14a3a8825efa2ddce114e5be3e5a39cbda0903ee47d6ab5b052dbca56c5378e51f5a032b6775b0454232e74edf90db01179b44e7bc1cfd25beba3efe30c2089d3f6eea65b8673fb9bc77993aeb7155ded8c9c5048b4884419b63140d2b0291c0108f7c35c8229f437b1c3bdb020d5474e0d764fe08577805d543a1c7958a475e209e1ce1ad257a6383d6686425e91d5ec96924cef629e2db7a0f1e5ca98ef2b07101f2fc617b6785ffbba153aa6c92e5e8af9022b65405513a86bd0fbda7e09b0ef95a65402a65b5f63e2c22044758e5a4c51673c6a12dbc92d8cf16b75e74f062efc5eb67b6ee43377400dbd4dbe1b34d80a1d88e77e81d5611f55858425fa2deca2cdcd03dfbca57a5eb40bcddc8bdca74f529d170ebcc284d85c654cb6aa48f660ad761d4b38ffac9babbd5f2772402b43ffef56251e3f790bd417b93f9476fef8c110301c4d88e0ab72242663b9fdb613e9caaf7f7360983242ebb29b6993c0c9b1732cee8fdb6f7375a0fe75879a99e4226a25cfa7916dcd06974dfd237f8e21d58a06724eeb104349694bb4e181da4cfb982f5b2063923043e4eeacda64e056741316b3e16d515b70f56fb5a1abbb65e2a648757e919978984126a55e5aa769d6842247d8607870998c96330dfac9a179f8872b516bad41f741f1f6cbc1dab38cd9b7b7934e1a6941baa705067cd4d74bb438a29eb57a0c3e80bb29a2ccb90a30dfcd46a7f9bfc2e9a016cea705315c480b14f6ad00e1a60ed8d49a6c29a842ca4fba65f8ae8de1bcd5f540f8ff3a9484158df56c7c7681d04b6abf8ef45d073c245c8758a2e637c956a3bf1c0441f23ae313c89ae5ea6313f318fb08ed368a2192e8198466f032a18236e00d8e1b70b2fa46402072b33cc19952ec50145abf25f9029f6cf232ff23df2eb7f95115048fb1bc058dffea80560d396f4ac71b6dec614dfbdb63e9506578f4c9efee546518557e9554f84ef261e15ca98640d68063418767a1713f4af0663b2748eba9d9b74a2d21b1b604ca82d5bd6f163b8073a000bab00bafca74223ab82f321ca2306025aec5ade179ae0a648bc8ab225ab0e14dccb9408352b4a4b64169228a3103c08d16077973f77951989374322eba27d8eb3643c8771d59f29c8866e9b4c494455a2b317a4aeac68aa47ac8b9ecd3cb566d8c61b68961809ce2a09e6c17b461cdacb28b79f35b719b1828c290ebeea48f0d79e41cef6cb67bfe7901dd1d5f9c74ff1c9c5cdf9f5e8f2d541b4f770b8efe67d38bef930c2f4836099378798f7c61f22591c714826d261557386a3135f287a0ac94004c74062202e8fbe57a816ad28d4ad5f1ed7b5f56feb06ba6a5bbf2a143e2f5acd50ba2ddb4abb99d20ace65d1dc6ac64cf6c5d2e9225ee14fe5d83eb1a48aaba34c913aa3d106c203351c0494c87622ae7268d54e6aca186f4049ea3092a236fba00200b258ea0296019263212574269ae52296a66c71f1e0b35d94d488f2bf4a59890a3d634606b4d9cfad0992b8ccd31e85b88223aef7b9e6620eb246bebba784399cbfd298ef6649f4762f7a3878ad62684ea2df494d62a204b4508dd6ee9fdfee93314b399db2237dc5eb2460d714eef35707e8c2a0cb39e86c2f4a99d1efcffb7b7be112ce86a714bb80134e4eee00bc7c3e1ffcb8c2aad14e0f1622e2b33f875f669dc181c9132098dba51de08148ff82c2d3c2bd63f6420a64c91ccffc00f0a05dde413a77e8592099e6fdf8ea6ce2a322bab4f0f07b721f0e389c44700f93f5c7ee34dd25e6d22eb9acb2e2a5b2c649ede9a9d84eae6ce9143508f770448e33a2ed6840ebf542cc9cc48145fff5ec2839744d95d1529978282aae59965af196bc1ca5fde67a5441050676855193f2dcf5e9c7d1a5d699e38c6049e999528288d48f50353a4fd5642e477afb95e5a3b54351e9d92ca8a84ed23e510a8b8e9eb50e93f8b35bd2096ae132b011790fc9f6e9fac03f349093cb0ba342483a1cfe108c3b473f490b8d6900e22ebe0ec7fbd1d9acc2787c3dfaebf1df8ceea2640afb576e5a9daa8e805fd6b73c482deb559dd316fd79daaad56486b7016326eeed12d4aa72e0bd9b657d01fbb6d19628168e5f3f5a08b84eb7456076ba0ac59ea5abae068ca65c7fb123da63129ae188fc6b85af8e595698d89e096af477f1007c047f7df6cc7597a36c0574da94c2a0c5a12cb9804259b2b2a12c11b738b93da1c05c573e491a48b66347192b42257617a3353ae7387f8369394f3b130dc40421e7e2e50945ad43ab09a2af8343691e9c1eb28968ccfed92c2fa477680226063fca799bd225574aeab1b101d3522dc5202ee11d6aea5da0b892e55261c1db46459e9c9250ef0ceec564a7d9d379891e8cb6d18f51c714ba2f6c64904dd545b6248554e75c1cacfb9ce2545bbc7f547bcf50afaaa30da1674fbfb2aa0e6d87af6f632322d6d69ae2121ae81b80db458fb21571f4bbfe9a599ee7465292f0be7842843eaa1deb0ff33eacb8629ccb02dd65a04b183a7484d9d61c89ae466a8efd2ce2e076a2ba54660b515a22b79ec3e58a935cd9c7b2bdcb0695599efd338a0d472e8ea3c1209943eb300d833787c3e190c9a42d218fe1fd4fdb094e4e62ce47950da3979a80869ddae2d33a08cce93062cf00d0056b0990522b91e0824a5f1d8c739caa5f9018635d77b5bc38c4e18b675bc8f5a590c90ddc2e1c977d5695f714933daf60c4b87933d4e7cd39223b3dc2f53299642f6c2ace88c3ce2e3ec497a7e71fe24f176767d1fe9e77d9e995fe15cf0fca77609c668f79c1d390ed541f8520a9bfeb669b8f17461efefce35a6021d561198a6c8e76e0b8c614a81089755920c452e90dc21dad1526864c36d544fcd2c9c2306b7cb2dce1eb220e0d8f21a3fdcb0a860ceda396777d9f2bb35cf3a015abf3e92643d78081e88e9d646c5ecc33aca774fe252f5572e7cd92e9f8556998f8e498f334b5b54fab121bd7edafe20bb71e7215baeefb1f82ce23295714b2bc94ab9068709fd4d17fa8fbec3f869dbbd4f1e5162cecdcb1560d4ebaa9a67b89aaa8b118fa180e661591fa633458c0b619aa6ba5736dd7c64b37cc186a4e5288c0220b35c1f4af28681393c8b107333badfea5a38055d5b5d6d1e979579d5893d896fdf6b15f0cd832a58e4688d6e921e5050c6fb8ad4cd79d175da8bbfca744347ecd18254d4fa361861a1550b2b032dff9cc658f14edc2da9693162375138f43259178b39a3c1ac68762dff1a0e532858b914f83bdeb0daefc2fbd56eb90972e1eb9ed98e95981cf6cdeefdec374faa385d390aaf892983484f16843bba07350c193f81ad38e3895c58b90f740ddb3f06c99e4d63ba9504e4bed27ba6dc7f05c35f7a5d0c8dd8e089d6f2bfb40219acf2e3d62ae584ba10d2fb0675da706bdf7d7bfb46a96e18445863eedfe13c490dd90acdc7c3890d0d6db64d7af451e83bbe62947667717fbb75b755ded59fe1c2c5f46240072c87ec24671b1d075e63ccb50ab2f128fa7cc0ec01fc27cabad5a0466f30d42b899a3d728b57213036b2c4374fc2098163efa0ad91263a1c13c2b66cded4ec422fe640e7815b94dc2c130aef4f1e66cc488d2e5e87d349d27b3a18da5c194a2b672f288c76007eaafb2a9fa54b818f3df197d232753bf642259a041e075c87a6e0154cd6d7eefe1ed1effef59cf1afdda6f62221628d60e74df121fa96b38169d79b36da91d226b017c833a425e447eed754e127418c29e47f829ecd4aa2ad4774060b3ff2fdc047dbd140f2bebce09dd65cfc48292394859839e11b4a8820853128d62ab2a99536f93262657796909b53979b3b24cc78f18aaa1cde688e2cd53c7f677277af1e2850636be2bbf0021295a63948522767825b2057a42b73310309841950573d055d6229314724e95a3f3ac324615ad81ea97a38ee6013693a50ba70d999dead265a7b6408b718a3a8c03a70abcfb1013216328255441b796186b6627e21994647cbed0355e5fa7d54bce75f57448a4af685915805433674155d93c4bea2c549fbd8d4877933cf76948d63cdf89dcef5067ad19846cd7973ece998a4adc4902dcf19e950a0395db7070dfde09606fed5058dd73dd0ac6ed74d0a66318fa10e83ff835dcfd06d2a23fc01724216f9ed2b01fc361a717e4b68d6c909c5e08434766b55f9f213469859e6825be76168717527b2337d34be9404a37a549d3890a0fef35f2e7236739681e186efc8e21b135a84207dcfb851e4e3998ae90ed878f67f61644c729acc161b655a8676a977dfe71686c38ac7a5eefedad1e12831deebdda0cec7033b0d79b80a1fe050a88f09ea801c5bbedf7b040a5846c2201332db842d1bc7da4ee8b18f52c549324d9436d157741e4b9608197d7000239475dee85151bc53ff4814b807bc32cfc41d82b2b403162ad39fdc873eb07c69d14f1094e07f187f39bf8eae2e6f264348cfef10f931edf9c9c9d7e7b12c743efb8dfa1852a5cb865852ef6f46fd84ef33ab3ce9f9537702e685c4624350011f1ae6e93330eef4fc2876d456b3f8f9ef21e002196636d9fe61d3638adfa18f62c975527823b98fc866508d7d065bc4cb582a1fcbc986cd896b1cafaf6f4433c3a7f777a7c1ec7cfb4fa8e6c89fb64b9ff66a052a19c566d3100af0e062a5500589ca501de1cea9bcd5a32eb094d7055d429b0cf5db8ef7e4974eed57fd00d7426c113849c70df6139f9d68fc033eddc1a40540c5c4cc6ee19be38f84aad188f7765b02a9d7da150a6717139302fba5bd1145123f6ee99dc015a4f36eb0a4455b6b6a40e9cbe79491d75628c5e3064276e069ea7f6c6e5417aee73e25995654560323c387d468d42227a5999a66c9eb1e220d83bca2988ec8e0dca597daa323c9cebdefcf0e410db4ecf7a6f59bb39eca768e7ae39e8ce0ea3a8afa1f78a7d06aded3e132f6a19493d6be534059d76c984eb6a3a1865a75d075ccd3714da0c9e36f6131aa87352ef94726bae5179f77cd75603c06df9917fd1f17a3518aae724419b7378c551cfd35d95acb8c3dd0d19fa9a72d14ebefaeac71aaeb5bb5a80fc2b05d0d07ed2d14882c4c87d0350e3172e082c8d6f2b78f4dd445aa9f645d9b9300b464b5bd48d4175e3c126b725dc933e3a6be1ad1e604d966968b601fdb77075075ffedbb18b303f265d8c39801a3b75fcd7d5c5b95dc74fb5d69b5e5587a5f1d854c564112495bbcf1f02e74f8046312bf2bfbcaee8cdece0a6681b90c8b1e1d5ede616abb30fba7b370054acea7e08bebf80b183eb967bd519f58a4ebd5ad5c6ba1e1ef6b4b4b2c5c30d5bec2e9a5961242693e512dfd635b48443e7fafc07dc82e5f2d1e3663cb31cba133622578eaa549f677eea5903097a427487b91be47255f80cdf1756227a161f70aa7b8e9d3030ce93afa611238e8b31974bd970e28a0758daef5ce2ab10201df3b6af14777edce6f35477abdb6d543a119b88b4443f6de8e37fe5c3162ac7e102362191ad725c889ffe27b7083d5d648b8dae6ae59acfde363b91e8400f794ef456303bd982d61522da933d6048d24c4d6acf65d6070e7d0f95d0bbbc162f0f4a011df6323b825d7e69dc57cca718dc7545b107209214756fe0f3185d6a99410740e98e87a1d298b113a122c7e9f93058569ee40d6ab8b8b91edaddc4f716a3ab113641c62bcc5a7546aa380f5d1a492f62f762e9a6c8a9d63f8e7afad1617bfeafb402b855953cf6b6150d9ed688770d5bb3b801652a1c4adc6d4d39e8a14703bc6bfc3dcf8a2057c83e8114505b55bf6aff729e684e67ca7813453136d6a444581f4fcf616b8d918d9b0cbf198c87ff07fefb1a7e0f2d98e31f0ccc7f3a30a1b3a668f33534b9c7a7add5ea594f95e56e09f1bf8341c80d53a8463b057916a15f2e1799da48b3f9e66db8350a6fc5410a944785a7d7d94530545daf7e435d9bd47bf8bf542f5dd90b783bf2c9ff460b2a74c4bf58b7d78ec700f36d11366caccb6a5371ba613aea83cd6b0901da154e000768b21e9151007efce85d071b16806b6a10e89ecd82b0fa43f2479bf1e3ac1bd2ffd3aa5c881828d4836039b2265b5926b47645bb78c27cf77477d578a6f3961cdfad183185a8a8efb30c7d3fae03231619592d1984d3c1ae16e872198e942340d08be6e6f1654a68848aa8e37328b7ed5c2e6e684f27cf62ae79dcb70018e3342be0e0c615ae6387996783212634e87a4a0981c58b7a6348325f35c03c137d7d20fb5578f8393cf0e029c0e81c8815fdd7145353c65cd1d5532cab80a06ba759609f5ab786dfb40155f726f04e67d616f02634af790c4f5a0528c4edb8a53c7d9ed1f7a3f3ebf82f37a39b517c393a7eb7b5bf02e0af97a7d7a3ad8367a25d35c5e0c4ed1c45baf97ccec15893f4311a64e92cdb050c11d5cd33658fb1b2ddcb8f5b8756b5791dcd50cd04ed65a05a22f8d215359c9c5d5c8db6de060e1c107f6b56464d5be758325bd306c66b6f60616cfe1d40a66a037314554d01c339f70a9a7c3165fb2a274ea6d8e40d7cbe4af7612313bf4e2bdd4aba4c194dfdb24ed2a083cbaa0d65d07053b8d353af740798c7ada13a3c40d68b4248650be800f7961023f33ebe924542d8843f85cf71c7ed133e28860e11517adaaae5c4575870fd1ef8e4680009b3ebf066d07abd23879765e38becb2a0c337585d9583155a5a2cb6fb83b0fb85900611663aca060e3e8b4a86424586d876b6b4d4257b7db2273086b7b1923f05ed2575e40595d2e5f0580fa44d32b3020c178a45f576d0955a298859c9e31c0419bece7ca017ff185dc5d03def92c61e1f95f8f0be161fc90a30d159f25580455057cb27c339e40b2912b94bcf693eda9a660de07592590f8c70483ca610874cf683dd33c458a1fa4197b7fbe6709c372a4f08d9677624c8ba1d774662e6cd97b0e0868cad1092030bc06997e4704bb404d89c331d40aeedeb4155480193e1684c4b76b6951769f6b0692b52273ceebe22a3c94962f69d607140dca1d5e5fc0ef085a5a718266ba8e33f76f0661f6099173ebf538bb0e4d509ad363f47b01b075d3e4587f2152dd8763e1ff4dc4f0aa2be1df89c90705db0075756553b3d0bd4e91760e5f38d3b20e0fe88c2a3666ac026de9d67bbc7693bec20e31387821c194737f0297e6a249c4d9a72ac1a032249b10bd7921f110304df0a22e400c64f3b70ec52945bc05e2b7b76066fbc27c1a36cb78edfaa756583808ab63aeeb998d126b5e3431abfdd61a15f706f8624a90b37a91a1f0e92027049072c515096bd0880e0ef967ecfe8f78ced486cf78f7655e2d6d19a75ed36a05d2aafbf4ee833bb3425a8c26b0208fc3f1733e09feedd51b493799654e867129072ef62a12516fccc3cd2f2640ffd9b0e1f3c5b9a32088a33453b6a394f26197a4c752ece20268ade1cba58e84acd6c8ee1517f898b2c4b6b0a74d5dadcb566d151ed764fba3f2e180e72a94833891e900ef644eecf911687d7a01fc7d250f8c676f51dbabc9ffca18f17f54cccc2d0b8c6184b0fa87be2509f35c6d2a1984967681bc8061014f42022660cba107c1688a0ac9ec55ffb02b6a9af7000660db6acb2bb3520960d24752f35364534a8458b61d63338ae4060d1f1634730b073c9e5ab3d34e5c58174e9b5bdb08a00a55d1dd841a6d118476ce9fa2249dbe627ba9b47268044c0d39f3746d5bf0dc194477a97021837e8ce625b34bbac267b57864c63136d514e26f0da621eb7cee4b62c6b3589b89fb4a21fcc8a891d635977d3fceaf8de4e32da5368eb97dea8dc7e0a2127b6e8dba6a3352b26c469d31c17eff0dc66f365871c0b690d2c013b4096e8a21fda95c31d58e7db57b679b522efd0cd0b463d887e6754a7f3049e9a7828e60204831710d9f4fb647110e6a724d70c63d123ead73f473790830e4dc9c921ac9572d07d0a52525e2bf684258b9fd18f16f947100c35a0e9b5ee5fef05b12b35824085af79da26c29e411e09f1bc7f3b7dd1a731153b2a53eb54acd003cc3dfab1c4487b9ba9f45b4f3b56d0990fbbd6ac98946843fe1b6b36192ee788ae045d79fcf30a49bb2b35707a88de052b892ac5baa1eae8ead350b7059c05c130f19fd9c27eb3ad5de6ca869b2af0ee7640cac9a4253f19bdd4b8c50d21ec8d10d8956ac22b6caefc2aeefaeaf06d94828bc0b54d2b7473f01beb0ba84c6c36aa61c085b6df33f495fdb49992a5ec9f307177bd7185aec280551b3bda28d3c77fa9aa82f4cf9e5c5567e64275e3ecfd86aabb57ae35ea4d34949db75097dc58e78b8a20f317fd286ed25e68ecaafc2aadfa8d16c8aee85f5ca3d0eefe4df38905574fa72ca2f1156bad20903f0aa3d9e424ace48ead6ee02ef9d76a2707ba2a5c77771a2c87ad833eadff4ea1e56f2a5525f74f2d82715e7f4b99fdfda79692d5948dfa5bbab959d9ce860e56563fb507f5262b221bda8d453cbabcf8f8976e85bf2c7edeacb64ec929a0b093a7ef0e55ac58deae291a18fd6f68afdeb03173e1087bfec0b71e734c75d254c724414d97691aae39acbb4f21225f0591204bd0e3f3f55727f948293671f83fdbc4fa568bacf1a45cae55ac5bd2576be74ec70592a3e18efb228fae62a752896c17bd4b1d4c57fdbf97941e05aa00387911794a29d48b11f04db63e9b7e25735528a85fa461dac2e950dde398db36b977927048983ce887b7e9c26efccbfef0974e9238610e37e7140b91a3ae92b580ebba1e76a2c761b4b23904d989ce6fcecec256ca32605caaf5b3b1d29b41475084ab848ebc02cb88c65e44d4a257f5866c601d2bae80bcc5af5dcc302802465f33ea8c8c032c07ce220fb1c84cea8718f8c435530c5c695737dd8726147135b08b61b20a52d53eb189fbdb120d519f5c8efcc8b9e582ac6e026e494f269aa6de5e5041d10396d155f9f08835af439043211dfdae77c68c7256f8a554fd8257b9ef4fc15625f0177583e90b59e96f66ae2adbeab16eb245ca52d82043bec67028495b07198ef9aca0b871010b1ee5348c4f86121c68d5fc484540229b19c7ad8bc353ea713511aaa7f5eaf18bb6fd45a50b6f36edc39be01b68bf00a8f4853abeed621050cf725fa66e61a7e4daa2a132abbab6ea95ee72685dfe673ca128346ac1e7653133f89b2065c69a545bf674af7a83cad5b802169734e07e423fc2dc8206f6b65c5bc4124d82d45c48a8dd79c4c2f0cbb641e3e29e62b61e5051b36bd68ef48d7085c7c5b89c874f92e23ab3888fc47b3a9e05cb6b3bdd1a38da77a1432f95aa61b8b552ef14fbb821ad194b3338c811e8980e2a846695cdbac56d664dfc55b24da51895a561e537d82a21735c9f1498dc96f74500c617618ef302fdd0a23a4c8faa0ab9381dac60682acaa41804d8dcd42551cf0744c2f669d641b4311c6e926be182c536f7678a0c2fd7f9f108998e5b33c436960bdc0c68c2d6e7ffeab1a06c8d26cbf7ff5ddcb53ec76d24f7cfd65f81ca172d19d2162959e73b5d5225fb185b7596e512e5ab248e83c22eb05c1cb1c01a0f8a94cbff7ba6bb6706f3e819002bb97255677181e99e07e6d1d38f5f23f255a0e46934f6d65cb98a9958c22166010a40b00fd6efdd0b0f87ea4127efca3a39c2b41a55fbc650b913771149e81be69b8150892e6d93e2a88112e67d8a6d792f64cb6d6efad1f36e83eee92baa96a83b4eb819815f816664682b31be1b40557115543e4082a640abc60485b52d41f23ca37e06e7f04681f4984026213c41e7813fdd8cb2ae4446d539b62e6082b98ce163fa488abc9f34bd828623bd17c6f368d2b9e43723edd6504340f5b8455240a2fa8bccd2d9760bc2d603784825aba12dcf242e27c0051082b9345a6f20ff31265b1b532535b7a5e569444fc8dbe6f717414f2d7495f9ed9195e6be7eb1c0a3cac487d5ce4fd09b75d754e2e834122929786b1e26dbcab9a49e03a4fca640ee76aada0322b38ede5b503d9b0fc2c9b1703fc23c831be43e6b6f6d405b091cff6289af18c077bbd955b4ff980163de06bdc5549e1848fa06497cc5b1918b395462e680f92e5be49ff5f3c51306b1d3f59e82ff4e3a62c964544e0e8780e397288529d4d0b7043e3e7c284c4c8c18b3a2acb8e2bf17ef218f12865a00909298707d4f5f1db163414998ac1e0f8fcf1effcf93c7c9f9bf53d3ce92c73bfc05fb94f8b1c51f5279297e77f81b948b2a459ef43fa3448545767b5ebcdf67aa1a68790108b4e26b605a146c0a60cc635ae70d80e36fc7154709b8c5b7c89b615dc1845499b88d29888f524c2aa650aa871ef342e5454f5e237f41703674beba2b124a477266ccfbe29f54ae43785c68a0424e27d0045d20593d49fe0dd33be0932237735e30694e14df11f458d2a5902ea0528b56fa3fe523ec2fce030006c6c1e9927f05dfa0a2dd0be1097d623e146d736242d0fe12dd6f70ee59fbcde80faa033829bdbb059cde77d37315021527a73de77de59609a660bbfac78fe98f7fbffa2ff20715578375556ea4fb26bc7bfdb7f49b77ff29df6ef4d6f395f4c22c6a70facec75b8fb5ae9215ece8b06060232b5bf8a67cbad7ff476f499997451c3fad4c32611f48c90a844b580d1fcaeae12438d04471ba519f9a9f7cd8f215cd9019f34f1454d30fd63c26288016be6f50fccacf125abe3979cbe1f41ed3fc89ba3acc0754e49df36e3de0552734a9d197df8378763fc0a9e412039d9640ea2aab23a58dc238ffee86d3f658b7110db94ccee0be2ca9c49d291e28ae7537a64c1a525849d9582fddfc9feba74fef41dc62bdd19d18ed7f0efb0395b55df12536a2798332c0ac572a86c57c2fda6bbc64453af783185a10ebcd2afa9967848dbb6b8bab08de68a97269859fae0947543d6b9f30d57dfbe6ae585a6db433f33a8b7aa44f522b8433ccac5408904258dcfd91152bad33f301788406af3ec7806072c069294599d5c481c15b3d7c76420ada34e159aed8b18042e67ee46d4711bdbbdc2e506317f7bff192ba8cb347fc7480552ce5860a4465807364f5b0755b1cbc9531ee6c58d68994742d8f0af76fe5eae350bd411ef26d71a88ca042d670611290d2c4ab45432488cbcf2a42cc983b54be17e604b20c30a1e851a9e442ada11190e82940eadc9a6c7e9783304cdef79cf4b78d55ac3d0e5857de4fd90a669dad0b66d270c52eb9c9357eb9b24bd799ce0700c3e9aab141a32fb59d5ad58d5a7ef88f07b317b31690fe515ac6576e1cb9a47cfdf26fff485f5fbdfdf6eae5d7df5f39d1f77fbf7e9dbefcfefbe409f7fc87373f2417cc8b1fdfbef9e6eafa3ab9b44cbcd8bcdb6e9feeb343d83f9c8af5bb034ce1d1886b874d5321a99513fcf2bbb22b24015ee2d94dc7decf471ecedc376366a04827da0bf8b455351c14f73820bee5e98eaa87d4cc309a52f618c63e2d4974de19d7c1ddba287df3f247a3adf4a9374614b2f89bf23ba7bdb7f5486d2d94364b458c4506561ec03d8cca7a5a763267b8733592d91d59b75e8e372552f8036a9011b99233cb812590e9266344ec73132cd0e8ccdce2b4d195f92a6854018d264ab47e2835b059e453392a9e3d75ab0a71f7bd7fec37be15e82836dc063f06977762ae8a837257801f491bf2b4d2881e541c806ec32519f42169a98d8110458becf78078601688e3706d21501c8d921fd4d7744a601cf9584637de29b61b6e8ab114effda43229185e5c323d4348df6e53dc1838ffb6a69e37607e28da1b69f764c379f0bd10a49ab60741d077ba310b40d816e7d483e8594641c615c240c68f9ef5a2004566cd8ae182d2e02132bbf036abbaf9a531a942dfce2e4fae5e8bd8d7109dbe84c0d99be790187be8c29ea7185096cf26c38be868135c44876e258ba98cda960e3f902b7bea6c22694a97a71324430b93fa1e8aee44dfb4627f2c97f558ba152e6eb941bb78946d57c638b92f51aa09b564550fe5fc5977b3a02cae87ecfd92a600c9c5f375b98c02f15496adb7dd5e1f21dd22ca7d7193a1ce78119598418bcafb71fb339728e3a63c9372822416e9a07974d5341f76ca1a8ef6752311ce96b4beca3e3c1cd36bf45f5a4a70b98862a84b218e2eabc9ccd9b08826af16959f3f27b32de0ca7ddcf4a8c4cd07f4b94bc75c8ee031e45d5d86cb8a6692614d8a561d0161804d0d9279ae8e52e37415f90fba4c78b4555c31355c59f07338971b72cb3d147bf058b4dc1c83323ebfbcb6909674bee086f94c59b7c4e8e42b63831d4b8aa739dcefabc99d239a2d44737a58cac9cd19a2395977aa102b6e0f1ff65977bb6c0fb6ae2733a52ac2315b4e72b9e8401a169efb4be58472bf2ff2124c6ec3d1944beb2ceabbf93252bd94e250e6848740c03e61e00bf762832a348ae59fbf64454d08bc90ee4d2fbbc95120c4807d7698df3e9841e8f3b664ca6136df451460559edfa8a5838ca920e71f22fb037a3c0fe04837bf1295a969b3131f6511195c76e60f30f29f947e5caa7d764fbebe73abc98b435ba02bc5fc4a6a33d7c89c9ec7e6bc693400b0439cf84d1b73b9b70aa63755b39e5f1a3c9abaf9c541af0ee144f328ca2db39984cbd64dbfa83cabfb89f05e52de72b99fd9f465248ca813e7bf88202fdb45cc97949772dc12f60b49d85b41bc868524bba6eb2d5de79c3ac244de2a97509d916dc1b3fc3087f7263b2c3bec255a6b94ce160c592ba316881c3b6350321c07addf1fb628e33b8f521371f43f5e7d7fa5e47f780b33db1b93b76f7e7af7ea876f9d285cf4263502702572333eb6eca106228d416a7cb580660a4acdd99ec9e086c5bb39d9b0a8fcb6c4709d38955b093aa52e2552ae048be9b038e4aee2476f3edc2d670f2cf6eb22875466d22d98d1fec31b0c581ef6661e5acee2ab8af66d5677e07a338162c44e8428f2d48cca8bfb4316061b3eba66c33304b1cdb3439982bd7476d8925f33b828e42525a8e316d0f8de5d49c992ee392b8be274ec5968970f98a78d23e3d487216ff6071e15145f5d72d67f1454fb86b52844c290ecee80fbbb986f9bc2376dd1ad461c1b6d03f8901c823215e99b41fcd1ad6647db4b6b1798c40259430c079b40290585262d85cd7b2eb361566d08fabc684da44403fb5d4c16f056064b4e5b789e2e7e91cb7819184ec81d3ba7d0042b31484356c5cb08e91e8d1cac59563a6b7419a588849551db60d8960152394ff80325df493b19b3c7511e1ef1aee322c0f5aa349bee1d6e0a37d7339c82660b704bbc666d37755fe16b6f90e855d9e1db2267b0f10b71bdcd708f788f5701046460e2fbd08f4d19fc2d9767b6b190ea516eac469b5da70af0b7e98bfd185d0a0f0e9baed847a2eca566915414acb1da2a011b79556e0c85a0ca27ea620888df4c3cb68bd743312284d715022ca332639a1be517c99c02d272007ae2103ecf7438b1640250f315a67c49d7cda09d2741b6753f279d6e66a8afe580680b7a60c81cfac6d8b86d811a0c1824a8db193583a56c4ede7a2d376da35710fb12b299347d53971b7f39607225faa2b05247892726c64149c814574b7893b93484813217efcda82598c8c0ea8bf8a2f62cf75e5d7a180e0a00d42a3a5e04dd37e29e70cb2fb4b6d814e59dd602c6b2b407a39a01573b15fbcbbd9177c4391eb3be1ba1f1253c3ca097015630e217d3eaeab3b5f16bb31beadbf1a78c1ac10811b1736ccb42c1308b8ef70f5c0016d48b61219064b8163f31c6315c686c23ac27843546804cced98d650ee34367352316122475f6de0bc4325b20c3b0e6f5c58fbeb158d1bf1acd3f6b6f54974ec15bc168d167f4e798625dbedb127cb419eeda0eb5029416524fd129f46b405887470f8a2dbd565f2cbb4fed2758166c51d9c35803745e71c14a300616fb9127e819d925abf373ece63975ef5c74aebe29f2f3a6ae1e4e607a6ae4730867da43a51b98662501586bef2fec0df1944d329ea432262932bec6471fbf99ed7f7bfdeee5bbebf4c79faebfbb7a9bbe7e7dfd6df2fc1946696d9aac2aba8d6e1ee2fc88a627f05dc0efb24b8603446862b59f5bd5eefb01e3243b8ce4dc89a31523c7e0e71ee2054e2213077d3aad186d2f5fac0ccd1e6161c81907e3a3f92bd59ae6838cdb24107a4c1e961c323cc844bf86b55ec70068f173607c7e915f82088dbd801ed0be3db53aa893a7a137185acf01d958b9723dc466870938c84d36611a0fd9e14ad9ce26f9861b2717c3ccad4a5d32548e1f3b671ac2c3875b8c7985180adf67dfa4b2109fbdf802f4b3f60328e80039d51bb1950cdca5977e594ac0fde2f4d167599dbc3914f56b5c6c9d582a322c99520b5495f8ddb409397275c936db9795d8a86895e18da283b50840f87b3111fb846a4854e0d199d8bf04277102f614c82ab620c8c197dd6462eac3be34865e2a1a7168c1f211b5b5cd5ec680177765337400bfffe8f48b474e72faa2a6bd02c03a29185a2ee3d5a9ec82a3341b71bab40accdefcd9d2ccf9a45ed1e61c7edfeb5d709c9c66bb715c1f428d0c7a2ff0cce8bb4c31d3f19538a7005222c88f0635a58fb79a1cfc102a5a5cf16472a29ba62fdbd224c6f94cc4cc8208d526178a75951df3749b510c11b1c14b4968bcf5d3b67d9450141015adbd1b9150984b150d13014c713c3492904b83e0502c0953b8590362007eb8852416dcf3140d3aad2ea984bc5c9754715b3cdc65b1a10aac3a933a3276b379f8706b3c03035b4c075cc5982e68db32d6335972691e348f458d0b728ad2f324d0b5896ae78e05bc99d50f96a167b4726b1803ad78eeb6a8a10a9b3a68a6cddd8cfe4f74bb9bddef1823881d98f87a7638e8b0eefab2e72c5ac16009740025bfec860f0e0dba686cabec66beab05c5b72d7400cdc10c3bbf4512bcec6109050471fa193da70885d8d26631ef792fa28bbac2847a8dade65ed2202f8041d679c2d055334cc4011762eb653e68c1a3cd6ecbb65c8574b912f874c545f30c07529785227dd817652d4480b23720a0b952d2eaed5b90314186d5dfae4afb122f818014f61ba08bc95d6644e1b978fecb0bf74556e02afef9e9a5ff6eb7cf36e64b9d1a4134bdc935a64aa6615fb6cd80802b5db2027c152db213417766a11665743f47a50608f527f49ac4b204b5971ddd0e30e9560580b528fc073a8e2a34af8d9fc586099afaf3b35fbc7c7f502c9069d4a82fb58d618c3f3206ad815f1f81398a8eae8e4ae6d47619aa20c3d1ec06cca88f329f01ecae28b8295a72b6615c3d42f66d7498d8e473fc066cd409443b029be09108440ae6c2eeca2ebb084748ba25d3cb5038e504f13eff7235e5a3ed0d5297cd4a8f5637d640758b603972f0520313118dac32e37856a51b540e7bfa5a9983b36f47cd1169aea07977c546fc858734699dd59fe958a67f3814a3ee13d3f4f111cfbc0dff54a97957a7a44d98697e37ee739ff13d35748c1ea60078646e9b769ff5a1346d685ad48518bb25c63fc8ba8288234cc4b46c9c1f964e9c9cb0f1e95c53a7279c4d0edcb97a899031c76a43e5abed92b270a26ee19a1a060a773b7f6782e6c22f4c6138c3cbc6c3ab90e4865271829ce3074755b7c98414d47649d6422e46ba807770743d2ee1ac2dc51d6edf88edb2691fdbfd510e6892c3b8b4c86ca015c6960a496a01281b23672571b9fa33dc6d56722aff700b7aac64be50d16b742f47098612437689e401c7f6eafc5c929e6f3bf1fcc4b667003bdf22630857efb35e6c463998d73a6f01ea29ef76634251e28fcbfc92d699a45e971d582e2c9402905c6a3d099215c4cba31945ece4d5096154120e9f28b1b955d93c81ae44456689689c606853d614d866613295628849d6c5b12721891803e1e3aa79c8aac749d6255dd3d4f06f093620f084815ae5bcb62760d0a835ea910630bdfb4886560105de394a854feeb75b10ef0c44519acf70051b0c70c875d3d68eb56b8f2296f904bbe63cd3c9525d5b19d8e95dbc5832a0c92788c0498fec52bb4288dceb22b3f15565160165b01aba425e395497000ceee74b6d4611bf64819f091c5501e712cd083e292f2e1293128d61d44ffa0162befa5b760aff363a3eb55ae51fd49d009c2bb014a2555e20783b6e3732bfb78cbda4535e8e9390b33bb12e6988b035b990538afc8507314933f3b1987abd58d96b706773411a47346d28d3491eb217d2a828a47e5c0020d81f003c1ad01c4503c5fc3bc1873b7117286e8be2809974452bdbe04cc53cd272070b1481f9ca9568d7e8fbdf5206e05636152786d8ffc55635545031ce70cc397110370571db501f4d3e0429afbe319f5913189fc8e10db550b18f2d492a6340ea36f5397d60317bfaf20eb09f57f85701767df83670b781b1d4f0b879f670e2ae382235c19fd5b37427b6e49f2f9ffd624e70fd52f0a2779e11716cb39abc37944762cb8277b3c51d014caf82deb5958dd46e599cd6730bcb0d21545c29de5d32cf7ae92dd751c07055f76a48e12fc45fbaa17ff89e83608999607059fd41953ad2b40fa6af6a026f4470236d6a9a829161f63c5c544e09ea4d7bd3f11e35ae2080513d74d99e948c626c84f88166ca874fc9ebe3d860bcd22407de3d125d196d843d78c4dc5d6459dbcfcd4d389517db6ca8fa20228d7449f65f2ba737a9cdec7ccc7b0b2410a700786bc86395bb4be9fb56b0357017b3cd7f8c468e4fa0e695c3d045547a424862a4a0043c6391ce0e91ac6eb2397402ffda748cc552bf333210f28e721e1178f6ccb9a60d871c538a989ebd33b22f5a8d8721cdb92eca64306c316f361e8654252d6058d5c33e0b3a39e0cbfd5a48132bcf5dd42d46e056e0ae6ba58cb2d2b0642ad19a6894efd36e14e03a339e4d59cbea04a09df179a1d310e994afbc03a06d04a75f21bbae7c4bea9329fb7e987e5bdeafa269cb38a2a2ee86b698a4b314304828738dad8e7009901c507310aee030f441e67e69211514e1f25eb787af425de6005c251180ccc43e0f5bd1c5f3b0cf86a19ee508d7c7113ebd8c134ad06d8eb03a8ef0f9b338a174b6f2676caca95b7146f1d55d3e5b1fdbcef571ed8c1112d43c472676a3e7cf426491ea24bc16e7bde0ef0751a8f038eba7977398930cea3e8933f71c1e62ed9e1e09ce8562c9489687bb67939e6291eec4e8fdfe8439e6c5263b947dd617cb376ad91af0247ffeecf84342c87b45dbaf26d25bcee593a2cebbc8a7f84d766b169f083d42c21c3d28183dbc9b3811027a6cc902003be6d63f7d34ba59147dbc7459900242626682b0d925d60e99267d3e88eb549e0296fde5f1fc67202cabbcf1f9b05f7f5447dc5028997dc2ca8ce117411cd4dc4cf716c2b0d7b3302cfd7992ae4277ae8aac16e2feae696e4749d44cda46d042a2eacb55481a26187637863aa2aa70551631ad48a0ae63342473aa8de945c0df22a168857ca5bdb24e9c0886abefffc38e29034399844ae76df521137256414639b8f9926937e6194f65dbc1d9c5e8b1a9dd8a31d1ba06249bb0c7b8ac4fe6169c8ba6ada3e79181eb0d430f49b3c30d85f4e3090c79c0751f0c2907fa1362ab50ddae7ec35cc380ab1e6de5bee9006fd8a3f93b69c9466e59ff6438d7b0e5a3b9c69c7a94e5073dd39ef88f2efc4797fea3a764ea835036f02c04d39cb81c27a25e50df884763a23ddb799b0a8cfb9cf3a0c3f40c2f1653f51924108b458819e110a8f7260e093d26cf9fa95afd6a511d2dbf917a09c155866d563ddea9c81cc0bb4fc02c9155a0651fb31d6058031c0b09f8788966ed43a3a7de8fdc35056ad2d98e9bbff0bacf2f293d4e2733f9d0768980bb131c95fc0965bd55e28ef66f385898f84e3e21f586b490bcd0af0f85b2afe84fb1cd2fa57943ecaa4282b21cc114bb12326d1d307018061e02a6c4897587491d256b7b9288eb149a5affd9acc79c6a9048b0b9d3761ff1b468ebac426b66611b3629c358a23ca2cec4dfd4a5cf3fffdcf69cb117b0bfb0c5df29be1b63351b92b7dcf52e7fc0bb9eac89d806eb0c5fbd2fab2a591789d49b40ac0c0d9991fc0f5c7c4f823167d0b6c05c2dea1b38c04ee95fd9827e27461fb638f80a987512760f4c1d596e325c0cce3638b53639b39757c8b07b65b0fd432c1c66930c76ebe245e4e565ece5d3d8cb67b1975fc65e3e8fbdfc53ece557d230ebecf5fe56efeff4f69367de932fbd27cfbd277ff29e6083380716f0f572f610ef539e8cfea0356da9d6ce696cab674903a653709ac82097eb4de52eec47f14dd6756b1b33ea5aa95f611abf98dcb00301c5ce6ae1aa5cc11c07201072ed9975a5e2864d320b7b09a9fd7a8a9712fde3eb1e3bfcd9648f4fb9a7bef967018b51d8c3d7214cab85e3e723f91c33686eb8802c45968a681fa7f907fac56a081439a7df9fdb239e23130cb580a11115a8de8ed78f655f6cc4ed615a49a3da99b7938a379a280a29f768100538cc20fa458917d583f4acd25e5ab2db2b7dcce56577002f36b115991973c9ebc2dc5690b1f900a1e45fc0a6470638ac83425741b291b2eca3df9334d5be35699aac5642d4447fedd5f367272727da8fbed862603d38e037870738eab38472aa21480c0af4b069a2f153fc5f904040333f323a967694dc88d74af0c1605bcde644edfb5d33b49bd15598b2d87a69790d37fbc61a0f6c0d49825df12b5aaca943da57855a80bedf5e2be420768ac6602ca334c5e9616530be3f949486db14c9c65340fb2dc3c0d6dc366fcbd0fe9c72d59fecac0b2c109af0a8aa41149e100c8ba5f299c70ac7791ec3a02e514c5d64d3c56a1c4b4dd6c6339f189c75933fc43947c96b8c369a52d84d5bfa5cbea40bfc0318533ab539aca767032a0e3fc1a492db4484557c7b390deecd6311fe39e58b74fc5c2885e4b496787625e30633a6dd1cd30afbc94a3d066d21eea1eee1c90f8399ed13b5976ac92e5ba91e1bbc4bce9e338f82b957c17a6160ae85f3d7caf01386053a14edb8cc5504011883252305739792d7239ced36077a3f328280977eb7f2e1cabc82d2834995e4eadc67adc4675fb11e40724f1703bba2ec95b3c2231a00176f41641102111da220cc4ac39eddbddb3b0c59147786ae60038cd47f5d2806843bc04d496380c4de5fae6c7c44dbe020a7945aff180cba7c37923866fb260717f8f6c275f73ba55cb1437e5021708888c285440941ace5c1fbf0cd501bef88b9ec028ebe1877cc97c420f641a08281a53999e6847294cc4f9b41294df69b2c96e5c90e8b41121d16430c94b07b54ca12a321f5dce4014ebd4c3a6ad5cec93a7f1d9a76d82f1d3230411dd552248cb674b2c562276b66669293149e3bb0aa932f5dd7427cdd1472ef62a0522134b445f75a1ef6a8556d659c099d4a82ed9a9e75d27b3b729d57756d7a9f9a1eda3edd4b89bd79cfa25b7b53911d0fe208313c3cf0edc8250a4dcb7c4e0bb94f59ee1c001cb38f9867cd1c161351c701d3b7de6280d2e84d6f3ad6c2dd1d8e4bf1b6b30e5e3a0077c5fd2a883f380c258b5909cfd38d9748c3de9ae5209469b617e723ecb86dce8313cb9250c05d6256d2563baa1251e7b24ae6009f1be1c7c170ef9bbb42b259c0c24a870ad8949458352808ab056be3c20208665be7c361f639ea20620ae1b4ce6cbf443fbed241616dc8906f7bd35a0d23ff1ff024320f065bd8f4bea3242aea292236a138ca74da0946666896267339ed6abbf009cbe2e22cb938b1316f8bb572a73543f30dd05355c0728e5820d1d80c144eda47f3d967f5c3c4c5aa147377630eb30267fbc230e08e0300319be3af7359c4013634c60be33c7ff342a735f430fc69ea4d249428a8a4048f0aa0cc451d60b6934a1c846c68c5b46a73834c1a8a6964c880f0fb8bc027dc0d6b7be2da10b7e310cace2d58d2dc87380c6bb1c5ef5653e8f4bec6c16b492a95fe47abfb63bc5dbf9aa59a7f86378d351a1742bcbd23c32106bc8ba0ed3ee25435f64fcc95bbe0c6369b435aafc3bba38d458f1e82d1ab8d05e0cd7b66996ce08a31536963717ca40f3fd9bfe2e2b99d161be3efd4cba797c19cd96bf0e5e4cee871907642a8ec76d96df131be72dc2969a46c50c93794ed8b8edceea8051a6286f7b9992a41cd0342e9969dff735b37728680934df1a9f943dc54d9c74792a75ca65be6737030bc841c5ddb06a3195cf58c8fac67925b40c4f8549f8b51958de0e7785b3416235f1697f7fca29776d970c60a836e5f56e2fc29200b49a7c9f9cf205b2e174204badd114147757a74d7931bdcf8d7a9b7ed79cc82fb2e2306455b8509d6e22db31b668bc923b3ae286e438cd02367fe3c3c7e1f9bc77f833f3fe15e491364c270e27d1721ccdd61502be0fbd660b94c644827f8dc683f0caeae3b5dd9490217ec64b56fda022154e0b2f4bec85db7d8b757d73fbef9e1fa2a7df5e61f80e91deac5dd543778f9d85ef6c6581fa76cf7b4822e6f4cf37b1c6ba52eb015b0c6aeedbb7c73bad6b18bdbf2fe988302b10f0182ac06dd527dd3ef5611b7042f4486e58306be293601738bbd78e4e12a2e2307c8c4a25691f3d8d0aac44f32e3bc56b4b3a475af19f60ee4bc766fde6285e1ba90764f4418baa91b40ba5ec1a5e9fdaea9c077924cece067070bd15d3aaf5ffe67faf6e50fdf5e5d2717cfdd6102053fb2b7a0ee2000c4f25268f0e2654c1fb03718d41d730f1abf52a8ca53f35a9a25fba1ea4bc1b9ffc230f6c2723e4be0692227a986f9037102eea1989605e0c16180ba1ec78710f0790b728adcccfeeef23675fc0e761a833fe499806f3df3bfd174e5e1a5daf7f3c59f7e99c2f4877e610a86a6c60fcaf67385f907ea0693179cc87c101e67bbbba7f05fc3a596e60e8cee922e9dba4f28a838fa7dcd991057b999ae016c7c6fc807c05aa7069789d37121f34fe0b93071d990de27c76fa40a420931a48e679367fd822b89b9098b9dbceb135364d336c4a14b215b06abc275c17b219f2125239e014d0cc652f7060b270ac004a553788dee457f3848954c732386a44b3742caec6367b4ab0377e8c901699e478585be60b351eb219c460bc392d6cd7e6dde39fc902d991d4fe1c072d81466b9213f3010b6a4ac2910c110d06e091287413450716268530017de708542a06dda116768b2202064a5018c11d507728d39c0080e6d110260b51ae9d030c5150244acb897de8e4a4b441002dd849b4bbcf88d9839efb387d9e50999646661b1dcc50930bf319b165c1e8e602e044377d3b3caaa90bb19457507a70a9a233755567973984583d3c3b2c006187ad9381966a49fa16d716a4a22e05964758100afeeb2d2cfb10b3651ad7f446d5c8576098460042f18cefdc52dd3d98826d192a4029a681cf8fb706915d768619099d37cab64cdbc37959ab46ecb4e085ddd03c31ed32b12c0de9c0cc058505ca144df98aef79b033a415499aeca0e34bd47203ff05c0080232b5f5abc602072c08a1898aa83bdd07f36516f28b02152cd6fd34ce51f2f988468261cea089c48212b4cc0e2f3673a224f82f2232ef1ef2eb4986a02f968c9faf93c2d4c7b437df61c1f989cb49a6aae2a5a13889583132d342f1dcdbe9ceb23399fc4551613b3b4cf74c46334df2ba624d2e0f6f34e3bb7b87f96aa1232c3a6756998fd49c66010b744dc1b64d12a19c545219add3f5c589e7762ba2902b1e515ed3e6b6f35ce72d76e4ca157fc84fba57e9d77bdf93aef7a7a6d90a720f7b83c501672187905d53328e8384c740ff586d0bd30f9e550552b8d60e8e65358aa5cb7447c26c6daf489f7e78631f7d587e1281c670057af2423c4e4c1737f12b1f1dc9f256af5fecb379af25fce928b27c61b64241e7e793251336ab400de1c183f9c251f16d40db4e7ef042dd47e29c96725a8e4b2f04553e7f97e3ad20f5365bd2567819579b373d72451685535d1a36ecd267ae4fb658b2de3a6dca86406e3d9b6d9e7669c88f829d531a13012575b235d0e82911d1a8b5833919754b31a6ca2d50e6cb353d5362bab4266afb08cc646074d4da37f7536afe581044326b38e65663e09294a27598bb320c83a486479a02da003fc103685ae59680f43e7b6df5220380f670ee2be3b92ef11a30abbe7365fb13032c969781eb0dd31ddf8fc25647bc2c6ccf27cba1dcba7d5fea6d412160d9d009fb9f8261be3d5b28cfcf7f7afbe164fea4d35e445f2d70f55b9fe7cf7efa64f7eb145353d5edc3fa42ac036ea2b55d67369cc5ecb9a220496a79af909dacdd3cb95164f17222edd7c280fab25043048e87fb7479d43cc7a01bc1196d1ecd488a9360576659dfec08a324c70cc2646cb699272778a8df5c839e047a4e706449207c562652df3d34635b76571a424e332fbb53b5624b251c61b08e5bcb379eb87ab2973b147aee5619f07fd3b991b24d07026dbacd87eb6b9dc8d2c1b963b567b942d4128326472c60954c2e3d3ce8691430048e6fad8fffc8b036505c8cf7da325acd9b66c5b2e6947d76bf81be5a740b278212f5b50653eccd9589e4200619791c0ea3def219d1d0ed543dab759dd51fe1833a98fdd15f52bba23123f21a98a0d7a16577bc9c1029b4d67fbf459446a4841eab5df4cf58d5170444d396ebd27e65967f6ac5471709e9ba4ebc56f0ca798e825a4c3dd16be0e0afa066f52567f551e365db197520f17c50110518de57b3f1a2914a4cad3040682c08476d95d91ac8ba2965827179ffff9f38b27983a19dc28b43f0620d8c8dccb752fcef504e06c127183dd8823a4e8981bb90a3d73f479034479b1afa4c637f05641e8f04ee5e8162d6ed2a366d55e6598d6d981e9cacb4edeee66392dc045669bcff2842feabbbc6cd960437ad5ade6067c607486c98e4be4e54c1fd21e635886f3d65297ebf01153a07a799d5e7ff7f2edd5df522159bd7df9f6bf2cb9a8ec57468e292b85963a2723ba7f4b3f6e0d0026f9f14e1d7c3a010227295dd42863ad4101e96aec2d367a49c70d43455a6718fbd19d8e15d4a9b8286868c58d165b79b9e467e383bb8851df0c62d43aeed66d4f14b705486875962fd1dd9687b99cadcf285bc66293dfd3ec38f17025d2143c4efaa1add3d4c1dadb8a5d06133c4868fec00d9f4202cc2790253110a36dde7882bc188da7943d36593dc19873479801f44dfc5b268b0255c0957ebfa874fb5e86a5060842b116cec0a6411e53ee17c4425b90a6bfcff4dfce01377e433fb9b2f97d9913a263ac6e787e43aa90012544d6957d0fdd991f066b18f2394a7b6d4101f3bacdd03baf4d691043ad20d498f2e7c20a9b9571361896a739ce62e391db11b1aeca7c8c94b4bd7d4459ede921fe8e66f3d035a0dfa10d1acba6eca09031368586f9da07fde4d89ac9121569f846e4d512bde33a023cd9108d11ee860e81a2c5c56400d17f27560004a505adcddb72dbe88b32b7a34381e00b696f5ab1891dc11b5fe69975a7143a3a335303a82409f3a26844df56eea7462946a54071361a30682b33b94b27e4f65b95ab85cd4822d12046a6376db629e026f690de8a3ba23bbaa601b9153b0594f39be7085ad90195eae0fdd3155ef3e9755eb0af6f1a2ab11a773125df1faab287f8f6bec827dc92180b22e3be93a2118a091cf05038fc8cd77a394006332f79afb1e69dc0a61336df0bf2082423612a975e2266cdde6a852439dbdc14bfb84ce2653f2791b0741f811df9d094359fb6d57635d165c75e15f5805081d2aff6eadddb57dfa4dfbcf9e98777576fcf9cc7dfbefce9db2bf7e1cbafafdf7cffd33bfff9f7af5e5ebb0fbf7b75fdeecdb76f5fbe3ef34deefb428ce94634b5ac72c30466d25fa7dfbdbcfe2ebd7ef5df57c9c593cb67788314ebf51cdc77c02b75c070bcbf2417cf13f9a81bd6e7f231a29815e2484e0ecd7b89b5f5be4986035c2e2ffff7d913b6ceb1cde9f54f5fa75fbf7a779d3c9b2a09fec9547292e9d73f7df3f72b5172b59ae2753ed9ae7f4d2e4e92bffe75aadc093ff290f1ae111bcf5e42a111225042ee607f01e03571fd1683e60d27382b9ec1c5bc4317dfad842c6bfa9d75231f8d4ba7928565dbaa1ad397171d86f7450b88741a3c687568cb3bf039171f8caefe5585e11a2620dd29904a46627faf1231c3d7f4b9bb0c828d3a03d113560495159bcf0632955694e956b741d6014a1744c9bdcbaa91fef0e513031ff4f0e73fdbbffefc223ccd55d339d717a467dd5f889ac980ebb10d79b6c882607616635a21c0b7aa52f46d50a6c1af285368d11b4dc2dfa92aa5d4d96dd68f58786806d7bff6ddcd88e62b7e482ba395845112c41b19ef8de84322ff670ea5fdaca1f4a0b231983ad3021b16ef65ea524507b3a22dcec12e31f4380ff707310660a410330515714e1d59578fd54abee299cf57ed9a5fc8adf60bdc5b75090dd38c99c44d42d49789692bc6645da012acc6d00689d08cb102e234c58082fd20e6ef1ae28fc06f50ead3c4d2c10fa8701ec719b392f9ef922727ba46f5e541d30259fbe4b7b71a54488672d5c84fb2c28306f576f64e921094a25bc3a9646df2cea41754024af0e4a1191271174e28d11a71a6ca348de929e58e5b612ee52d6acaeacd8335e4389de1d5d84373aa92b066f3155713fa264a8309ed92158d6333b958f59f2f3eb35aad949c34c2f8a10984bac1cd8806e1f9b3752917af3face82f66b0bc91b8e2f28b7a9c61169de1f4c1b013dae1a9e7108152f6ce9457b8e012a0da6898fcdc7b4069cdd5c4d43b43765090d6ed8db83fd4f240d103d119be7217a6e3dca5f9e3a9890e0d25eb17d6ef4be7f7d3dac3e436e50ef121e09fb6a8a77724fda7c2481727c839faeda3ef5997aca03f44d799c8a730fa60bf9090e12763034f296b60a889e3017daaff3466237b508cf9cd31d130e62096e9869395688cce452cfe069190ad59d4c7e510562f9b9d89508e5a7af1f9f1b0d0fdcfb6302b48fa1aba9d73c6a4f81abd775ec42543cffd523562081d22f2c38e07889ffd92dac81907e88d849bd2739351e9cbca4c2f1643dde085a6c8e2e236b6a4b8b89d2d29be1faa45dccbbb7871d37592486e0a5e9bc4969c11b6c28d2764a658d20d2429eb08093f7fec1ba4bbe45693aa2a97c25796abaaa260d76ce8a77f60f0cd1d67a8d36bdf4ea125c94503e20d834631b26faaa653066b16522b6bdcef6d237ba449b2af5bc82c1a87669ba4ab27fc54ec2dc47a861e91f07ce21b7b72fb8226362626d922b2791d0bd00b899531d61a2e0959575c5c7e3595f7d185bab0673b56a6a1bd64ecb69126ddf1c694b961bd69a95e4c58e574625f47d3a310a8e018d0ac584ad3afc1c51883a4b5234e1f9705771013453a91ca96e665ebea883502ef98c4c9521f0901a22af7a583ed657bcca8327aa0d48310dade5820dbfc3a946ee65a83612c4e9299d90662f9a9fb445b6e3da5de1411c43f780e7ccbb96c7317e5580362d8c7974188882191e05fd912cbfb61a4564a8c10ba72c421d1e04208c7d38d6089a103cf9fb9d4f3ea3c820eaafb8aa1fa6ab2b2c55450d5c573868a8bc6752a3b820eaa7b7ac99069f7be707547d00929313022118a60b72234c1b64568821323442384d885bd11148b7b236816f746d02ceecdb6008f0c210c042967ac94fbcdeee663e83759374d3e838f109b3fa6194250ff18723d94c10f3763adc0507e0cbd18ca69f2197cc4507e4c33c4507e0c39c069790955d992166c38bfd94d15783f5540e20570725df4a496d8cba51f3d3770873418285302a675cbbbcdc2a2e8653dabe48253976fd54cd121485f899b4ab8a50e942aa63a36d239c4701a58d8a109b0d78faf20e4c280def861ff89a0ab9f21cd8eae9ab6bfa574ac2c726fa21e3282c4c86daf380e604a95bce48aea1b1f8c98d8c5c2004c9bbb607d6709651a3e95b978e18f1bfa8341a0938c2e977332a6b9c47e157d538d72c61e814bc8adc0b15cef9b7c6c0efdb09c6c1cf7204c94f8a06ab4fc39bc4226ac0a8f0badc2739ace498f418b20efd00909d0802c6749fe230746165980db2a4385e92c314a3538d066a59e6325f88450ce07de5be0c3c34d0399c8cdc0d0b193ea2da29478ba28f956baa3c4439a65d910548472cb10d726995cdafb2c7c7ae853362537040c98e831aef24007ea86f2d2dfefabd969e1274073f3ec2e45802e192509b84feef60765c41dff80ea0af4f2f3d47a7e0338c0309562fb487059af5166c399ac756c9e25865407ee7aa0578b397c442b6084e1cfe35ba1397c642b3eae0513b587d20801a80678ea317984200d91a1ba49c6a8fd558019668df332383875f1af0f32acbc2cea207abd91de08dac6594d46372cb7277cd6097f20dc34957f44ef5c558d37eaa858e632f12058add8bfd36de78057316538072da6181d8aac0f974e60504f7bc2e251240f22790ce97eca0313b3b6df14c19056c72fd8a1a2293f451b80a5e00afad107e629570c2a0d96a28d45e24a63bd87e7989b8ea1bca3b88af541374799ff8a53b0aa7276f2d671c65bafa794d25438e084687172ac23c172a458e56b19236bd27403de5af0ff47bfab4099ff03826fbe22";
@@ -9,6 +9,7 @@ extern struct uwsgi_server uwsgi;
 extern char **environ;
 
 void emperor_send_stats(int);
+void emperor_del(struct uwsgi_instance *);
 
 time_t emperor_throttle;
 int emperor_throttle_level;
@@ -18,6 +19,261 @@ struct uwsgi_instance *ui;
 
 time_t on_royal_death = 0;
 
+/*
+
+	vassal indexes
+
+	with thousands of vassals walking the list for every event does not scale,
+	so instances are indexed by name, by pid and by file descriptor (both the
+	control pipe and the on-demand socket). Per-vassal deadlines (curse tolerance
+	and heartbeats) are managed with an rb timer instead of sweeping the list.
+
+*/
+#define UWSGI_EMPEROR_HASH_SIZE 4096
+
+static struct uwsgi_instance *emperor_names[UWSGI_EMPEROR_HASH_SIZE];
+static struct uwsgi_instance *emperor_pids[UWSGI_EMPEROR_HASH_SIZE];
+static struct uwsgi_instance **emperor_fds;
+static int emperor_fds_size;
+static struct uwsgi_instance *emperor_last;
+static int emperor_running;
+static struct uwsgi_rbtree *emperor_timers;
+
+static struct uwsgi_instance **emperor_name_slot(char *name) {
+	return &emperor_names[djb33x_hash(name, strlen(name)) % UWSGI_EMPEROR_HASH_SIZE];
+}
+
+static void emperor_name_unlink(struct uwsgi_instance *c_ui) {
+	struct uwsgi_instance **slot = emperor_name_slot(c_ui->name);
+	while (*slot) {
+		if (*slot == c_ui) {
+			*slot = c_ui->name_next;
+			return;
+		}
+		slot = &(*slot)->name_next;
+	}
+}
+
+// pid == -1 means the vassal is not running
+static void emperor_set_pid(struct uwsgi_instance *c_ui, pid_t pid) {
+	struct uwsgi_instance **slot;
+	if (c_ui->pid > -1) {
+		slot = &emperor_pids[c_ui->pid % UWSGI_EMPEROR_HASH_SIZE];
+		while (*slot) {
+			if (*slot == c_ui) {
+				*slot = c_ui->pid_next;
+				break;
+			}
+			slot = &(*slot)->pid_next;
+		}
+		c_ui->pid_next = NULL;
+		emperor_running--;
+	}
+	c_ui->pid = pid;
+	if (pid > -1) {
+		slot = &emperor_pids[pid % UWSGI_EMPEROR_HASH_SIZE];
+		c_ui->pid_next = *slot;
+		*slot = c_ui;
+		emperor_running++;
+	}
+}
+
+static struct uwsgi_instance *emperor_get_by_pid(pid_t pid) {
+	struct uwsgi_instance *c_ui = emperor_pids[pid % UWSGI_EMPEROR_HASH_SIZE];
+	while (c_ui) {
+		if (c_ui->pid == pid)
+			return c_ui;
+		c_ui = c_ui->pid_next;
+	}
+	return NULL;
+}
+
+static void emperor_fd_map(int fd, struct uwsgi_instance *c_ui) {
+	if (fd < 0 || fd >= emperor_fds_size)
+		return;
+	emperor_fds[fd] = c_ui;
+}
+
+static void emperor_fd_unmap(int fd, struct uwsgi_instance *c_ui) {
+	if (fd < 0 || fd >= emperor_fds_size)
+		return;
+	if (emperor_fds[fd] == c_ui)
+		emperor_fds[fd] = NULL;
+}
+
+// vassals can be cursed by signal handlers, so the timers tree is modified with signals blocked
+static void emperor_timer_clear(struct uwsgi_instance *c_ui) {
+	if (!c_ui->timer)
+		return;
+	sigset_t mask, old_mask;
+	sigfillset(&mask);
+	sigprocmask(SIG_BLOCK, &mask, &old_mask);
+	uwsgi_del_rb_timer(emperor_timers, c_ui->timer);
+	free(c_ui->timer);
+	c_ui->timer = NULL;
+	sigprocmask(SIG_SETMASK, &old_mask, NULL);
+}
+
+// arm (or anticipate) the housekeeping timer of a vassal
+static void emperor_wakeup_at(struct uwsgi_instance *c_ui, time_t when) {
+	if (!emperor_timers)
+		return;
+	if (c_ui->timer && c_ui->timer->value <= (uint64_t) when)
+		return;
+	emperor_timer_clear(c_ui);
+	sigset_t mask, old_mask;
+	sigfillset(&mask);
+	sigprocmask(SIG_BLOCK, &mask, &old_mask);
+	c_ui->timer = uwsgi_add_rb_timer(emperor_timers, when, c_ui);
+	sigprocmask(SIG_SETMASK, &old_mask, NULL);
+}
+
+static void emperor_wakeup_cursed(struct uwsgi_instance *c_ui) {
+	if (c_ui->pid == -1) {
+		emperor_wakeup_at(c_ui, c_ui->cursed_at);
+	}
+	else {
+		emperor_wakeup_at(c_ui, c_ui->cursed_at + uwsgi.emperor_curse_tolerance);
+	}
+}
+
+/*
+
+	on-demand activity history
+
+	every hour of the day has a counter of the minutes with activity, halved
+	for every day passed, used for predicting when a vassal will be needed
+
+*/
+static int emperor_activity_slot(time_t t, uint32_t *day) {
+	struct tm tm;
+	localtime_r(&t, &tm);
+	*day = (t + tm.tm_gmtoff) / 86400;
+	return tm.tm_hour;
+}
+
+static void emperor_vassal_activity(struct uwsgi_instance *c_ui, time_t now) {
+	if (c_ui->last_activity / 60 != now / 60) {
+		uint32_t day;
+		int slot = emperor_activity_slot(now, &day);
+		if (c_ui->activity_day[slot] != day) {
+			uint32_t days = day - c_ui->activity_day[slot];
+			c_ui->activity_hist[slot] = days > 15 ? 0 : c_ui->activity_hist[slot] >> days;
+			c_ui->activity_day[slot] = day;
+		}
+		if (c_ui->activity_hist[slot] < 0xffff)
+			c_ui->activity_hist[slot]++;
+	}
+	c_ui->last_activity = now;
+}
+
+// the (decayed) active minutes expected at time t
+static int emperor_activity_predicted(struct uwsgi_instance *c_ui, time_t t) {
+	uint32_t day;
+	int slot = emperor_activity_slot(t, &day);
+	// a value collected yesterday is not decayed
+	uint32_t days = day > c_ui->activity_day[slot] ? day - c_ui->activity_day[slot] - 1 : 0;
+	if (days > 15)
+		return 0;
+	return c_ui->activity_hist[slot] >> days;
+}
+
+// an on-demand vassal is scaled to zero after emperor-on-demand-idle seconds without activity
+static time_t emperor_idle_deadline(struct uwsgi_instance *c_ui) {
+	time_t last = c_ui->last_activity > c_ui->spawned_at ? c_ui->last_activity : c_ui->spawned_at;
+	return last + uwsgi.emperor_on_demand_idle;
+}
+
+/*
+
+	spawn scheduler
+
+	when --emperor-spawn-concurrency is set, only that number of vassals can be
+	in the spawning phase (started but not ready), the others wait in a queue
+	sorted by priority (higher first, FIFO for the same priority)
+
+*/
+static struct uwsgi_instance *emperor_spawn_head;
+static struct uwsgi_instance *emperor_spawn_tail;
+static int emperor_spawn_queued;
+static int emperor_spawning;
+
+static void emperor_spawn_enqueue(struct uwsgi_instance *n_ui) {
+	struct uwsgi_instance *c_ui = emperor_spawn_tail;
+	while (c_ui && c_ui->spawn_priority < n_ui->spawn_priority) {
+		c_ui = c_ui->spawn_prev;
+	}
+	// insert after c_ui
+	n_ui->spawn_prev = c_ui;
+	if (c_ui) {
+		n_ui->spawn_next = c_ui->spawn_next;
+		c_ui->spawn_next = n_ui;
+	}
+	else {
+		n_ui->spawn_next = emperor_spawn_head;
+		emperor_spawn_head = n_ui;
+	}
+	if (n_ui->spawn_next) {
+		n_ui->spawn_next->spawn_prev = n_ui;
+	}
+	else {
+		emperor_spawn_tail = n_ui;
+	}
+	n_ui->spawn_pending = 1;
+	emperor_spawn_queued++;
+}
+
+static void emperor_spawn_dequeue(struct uwsgi_instance *c_ui) {
+	if (!c_ui->spawn_pending)
+		return;
+	if (c_ui->spawn_prev) {
+		c_ui->spawn_prev->spawn_next = c_ui->spawn_next;
+	}
+	else {
+		emperor_spawn_head = c_ui->spawn_next;
+	}
+	if (c_ui->spawn_next) {
+		c_ui->spawn_next->spawn_prev = c_ui->spawn_prev;
+	}
+	else {
+		emperor_spawn_tail = c_ui->spawn_prev;
+	}
+	c_ui->spawn_prev = NULL;
+	c_ui->spawn_next = NULL;
+	c_ui->spawn_pending = 0;
+	emperor_spawn_queued--;
+}
+
+// the vassal is ready (or gone), release its spawn slot
+static void emperor_spawn_done(struct uwsgi_instance *c_ui) {
+	if (!c_ui->spawning)
+		return;
+	c_ui->spawning = 0;
+	emperor_spawning--;
+}
+
+static void emperor_spawn(struct uwsgi_instance *n_ui) {
+	if (uwsgi.emperor_spawn_concurrency > 0 && !uwsgi.zeus && emperor_spawning >= uwsgi.emperor_spawn_concurrency) {
+		emperor_spawn_enqueue(n_ui);
+		return;
+	}
+	if (uwsgi_emperor_vassal_start(n_ui)) {
+		// clear the vassal
+		emperor_del(n_ui);
+	}
+}
+
+// start queued vassals until the free slots are exhausted
+static void emperor_spawn_queue_run() {
+	while (emperor_spawn_head && emperor_spawning < uwsgi.emperor_spawn_concurrency) {
+		struct uwsgi_instance *c_ui = emperor_spawn_head;
+		emperor_spawn_dequeue(c_ui);
+		if (uwsgi_emperor_vassal_start(c_ui)) {
+			emperor_del(c_ui);
+		}
+	}
+}
+
 /*
 
 	blacklist subsystem
@@ -66,7 +322,8 @@ int vassal_attr_get_multi(struct uwsgi_instance *c_ui, char *attr, int (*func)(s
 // this generates the argv for the new vassal
 static char **vassal_new_argv(struct uwsgi_instance *n_ui, int *slot_to_free) {
 
-	int counter = 4;
+	// leave space for --emperor-activity-report too
+	int counter = 6;
 	struct uwsgi_string_list *uct;
 	uwsgi_foreach(uct, uwsgi.vassals_templates_before) counter += 2;
 	uwsgi_foreach(uct, uwsgi.vassals_includes_before) counter += 2;
@@ -167,6 +424,20 @@ static char **vassal_new_argv(struct uwsgi_instance *n_ui, int *slot_to_free) {
 		counter += 2;
 	}
 
+	// on-demand vassals report their activity (at least once per minute) for the idle and pre-warm policies
+	if ((uwsgi.emperor_on_demand_idle > 0 || uwsgi.emperor_on_demand_prewarm > 0) && n_ui->on_demand_fd > -1) {
+		static char activity_report[11];
+		int report_freq = 60;
+		if (uwsgi.emperor_on_demand_idle > 0 && uwsgi.emperor_on_demand_idle / 10 < report_freq)
+			report_freq = uwsgi.emperor_on_demand_idle / 10;
+		if (report_freq < 1)
+			report_freq = 1;
+		snprintf(activity_report, 11, "%d", report_freq);
+		vassal_argv[counter] = "--emperor-activity-report";
+		vassal_argv[counter + 1] = activity_report;
+		counter += 2;
+	}
+
 	vassal_argv[counter] = NULL;
 
 	return vassal_argv;
@@ -420,108 +691,101 @@ static char *emperor_check_on_demand_socket(char *filename, struct uwsgi_dyn_dic
 	return NULL;
 }
 
-// this is the monitor for non-glob directories
-void uwsgi_imperial_monitor_directory(struct uwsgi_emperor_scanner *ues) {
-	struct uwsgi_instance *ui_current;
-	struct dirent *de;
+// check a single vassal file (new, changed or removed)
+static void emperor_scan_file(struct uwsgi_emperor_scanner *ues, char *name) {
 	struct stat st;
+	struct uwsgi_instance *ui_current = emperor_get(name);
 
-	if (chdir(ues->arg)) {
-		uwsgi_error("chdir()");
-		return;
+	if (uwsgi.emperor_nofollow) {
+		if (lstat(name, &st))
+			goto removed;
+		if (!S_ISLNK(st.st_mode) && !S_ISREG(st.st_mode))
+			return;
+	}
+	else {
+		if (stat(name, &st))
+			goto removed;
+		if (!S_ISREG(st.st_mode))
+			return;
 	}
 
-	DIR *dir = opendir(".");
-	while ((de = readdir(dir)) != NULL) {
-
-		if (!uwsgi_emperor_is_valid(de->d_name))
-			continue;
+	uid_t t_uid = st.st_uid;
+	gid_t t_gid = st.st_gid;
 
-		if (uwsgi.emperor_nofollow) {
-			if (lstat(de->d_name, &st))
-				continue;
-			if (!S_ISLNK(st.st_mode) && !S_ISREG(st.st_mode))
-				continue;
-		}
-		else {
-			if (stat(de->d_name, &st))
-				continue;
-			if (!S_ISREG(st.st_mode))
-				continue;
+	if (uwsgi.emperor_tyrant && uwsgi.emperor_tyrant_nofollow) {
+		struct stat lst;
+		if (lstat(name, &lst)) {
+			uwsgi_error("[emperor-tyrant]/lstat()");
+			if (ui_current) {
+				uwsgi_log("!!! availability of file %s changed. stopping the instance... !!!\n", name);
+				emperor_stop(ui_current);
+			}
+			return;
 		}
+		t_uid = lst.st_uid;
+		t_gid = lst.st_gid;
+	}
 
-		ui_current = emperor_get(de->d_name);
-
-		uid_t t_uid = st.st_uid;
-		gid_t t_gid = st.st_gid;
-
-		if (uwsgi.emperor_tyrant && uwsgi.emperor_tyrant_nofollow) {
-			struct stat lst;
-			if (lstat(de->d_name, &lst)) {
-				uwsgi_error("[emperor-tyrant]/lstat()");
-				if (ui_current) {
-					uwsgi_log("!!! availability of file %s changed. stopping the instance... !!!\n", de->d_name);
-					emperor_stop(ui_current);
-				}
-				continue;
+	if (ui_current) {
+		// check if uid or gid are changed, in such case, stop the instance
+		if (uwsgi.emperor_tyrant) {
+			if (t_uid != ui_current->uid || t_gid != ui_current->gid) {
+				uwsgi_log("!!! permissions of file %s changed. stopping the instance... !!!\n", name);
+				emperor_stop(ui_current);
+				return;
 			}
-			t_uid = lst.st_uid;
-			t_gid = lst.st_gid;
 		}
-
-		if (ui_current) {
-			// check if uid or gid are changed, in such case, stop the instance
-			if (uwsgi.emperor_tyrant) {
-				if (t_uid != ui_current->uid || t_gid != ui_current->gid) {
-					uwsgi_log("!!! permissions of file %s changed. stopping the instance... !!!\n", de->d_name);
+		// check if mtime is changed and the uWSGI instance must be reloaded
+		if (st.st_mtime > ui_current->last_mod) {
+			if (uwsgi.emperor_force_config_pipe) {
+				char *config = uwsgi_simple_file_read(name);
+				if (!config) {
+					uwsgi_log_verbose("[emperor] unable to read %s\n", name);
 					emperor_stop(ui_current);
-					continue;
+					return;
 				}
+				if (ui_current->config)
+					free(ui_current->config);
+				ui_current->config = config;
+				ui_current->config_len = strlen(ui_current->config);
 			}
-			// check if mtime is changed and the uWSGI instance must be reloaded
-			if (st.st_mtime > ui_current->last_mod) {
-				if (uwsgi.emperor_force_config_pipe) {
-					char *config = uwsgi_simple_file_read(de->d_name);
-					if (!config) {
-						uwsgi_log_verbose("[emperor] unable to read %s\n", de->d_name);
-						emperor_stop(ui_current);
-                                        	continue;
-					}
-					if (ui_current->config)
-                                        	free(ui_current->config);
-                                	ui_current->config = config;
-                                	ui_current->config_len = strlen(ui_current->config);
-				}
-				emperor_respawn(ui_current, st.st_mtime);
-			}
+			emperor_respawn(ui_current, st.st_mtime);
 		}
-		else {
-			struct uwsgi_dyn_dict *attrs = NULL;
-			if (uwsgi.emperor_collect_attributes) {
-				if (uwsgi_endswith(de->d_name, ".ini")) {
-					uwsgi_emperor_ini_attrs(de->d_name, NULL, &attrs);
-				}
+	}
+	else {
+		struct uwsgi_dyn_dict *attrs = NULL;
+		if (uwsgi.emperor_collect_attributes) {
+			if (uwsgi_endswith(name, ".ini")) {
+				uwsgi_emperor_ini_attrs(name, NULL, &attrs);
 			}
-			char *socket_name = emperor_check_on_demand_socket(de->d_name, attrs);
-			if (uwsgi.emperor_force_config_pipe) {
-				char *config = uwsgi_simple_file_read(de->d_name);
-				if (config) {
-					emperor_add_with_attrs(ues, de->d_name, st.st_mtime, config, strlen(config), t_uid, t_gid, socket_name, attrs);
-				}
-				else {
-					uwsgi_log_verbose("[emperor] unable to read %s\n", de->d_name);
-				}
+		}
+		char *socket_name = emperor_check_on_demand_socket(name, attrs);
+		if (uwsgi.emperor_force_config_pipe) {
+			char *config = uwsgi_simple_file_read(name);
+			if (config) {
+				emperor_add_with_attrs(ues, name, st.st_mtime, config, strlen(config), t_uid, t_gid, socket_name, attrs);
 			}
 			else {
-				emperor_add_with_attrs(ues, de->d_name, st.st_mtime, NULL, 0, t_uid, t_gid, socket_name, attrs);
+				uwsgi_log_verbose("[emperor] unable to read %s\n", name);
 			}
-			if (socket_name)
-				free(socket_name);
 		}
+		else {
+			emperor_add_with_attrs(ues, name, st.st_mtime, NULL, 0, t_uid, t_gid, socket_name, attrs);
+		}
+		if (socket_name)
+			free(socket_name);
 	}
-	closedir(dir);
+	return;
 
-	// now check for removed instances
+removed:
+	if (ui_current && ui_current->scanner == ues) {
+		emperor_stop(ui_current);
+	}
+}
+
+// stop the instances whose file is gone
+static void emperor_check_removed(struct uwsgi_emperor_scanner *ues) {
+	struct stat st;
 	struct uwsgi_instance *c_ui = ui->ui_next;
 
 	while (c_ui) {
@@ -564,13 +828,110 @@ void uwsgi_imperial_monitor_directory(struct uwsgi_emperor_scanner *ues) {
 	}
 }
 
+static void emperor_fsmon_event(struct uwsgi_emperor_scanner *);
+
+// watch a directory of the scanner with filesystem events (--emperor-fsmon)
+static void emperor_fsmon_watch(struct uwsgi_emperor_scanner *ues, char *dir) {
+	// patterns (or unmatched globs) are covered by the full rescans
+	if (strpbrk(dir, "*?[")) return;
+	if (uwsgi_string_list_has_item(ues->watched_dirs, dir, strlen(dir))) return;
+	int fd = ues->fd;
+	int wd = uwsgi_fsmon_watch_dir(uwsgi.emperor_queue, &ues->fd, dir);
+	// failed directories are remembered too (they are not retried)
+	struct uwsgi_string_list *usl = uwsgi_string_new_list(&ues->watched_dirs, uwsgi_str(dir));
+	usl->custom = (uint64_t) -1;
+	if (wd < 0) {
+		// without any watch, keep rescanning on every cycle
+		if (fd == -1 && ues->fd > -1) {
+			close(ues->fd);
+			ues->fd = -1;
+		}
+		if (ues->fd == -1) uwsgi_log("[emperor] unable to monitor %s with filesystem events\n", dir);
+		return;
+	}
+	usl->custom = wd;
+	ues->event_func = emperor_fsmon_event;
+	uwsgi_log("[emperor] monitoring %s with filesystem events\n", dir);
+}
+
+static int emperor_scanner_is_glob(struct uwsgi_emperor_scanner *);
+
+static void emperor_fsmon_entry(int wd, char *name, void *data) {
+	struct uwsgi_emperor_scanner *ues = (struct uwsgi_emperor_scanner *) data;
+	// force a full rescan
+	if (!name) {
+		ues->last_scan = 0;
+		return;
+	}
+
+	if (!emperor_scanner_is_glob(ues)) {
+		if (uwsgi_emperor_is_valid(name))
+			emperor_scan_file(ues, name);
+		return;
+	}
+
+	// glob entries are named after the watched directory
+	struct uwsgi_string_list *usl = NULL;
+	uwsgi_foreach(usl, ues->watched_dirs) {
+		if (usl->custom == (uint64_t) wd) break;
+	}
+	if (!usl) return;
+	char *path = !strcmp(usl->value, ".") ? uwsgi_str(name) : uwsgi_concat3(usl->value, "/", name);
+	if (!fnmatch(ues->arg, path, FNM_PATHNAME) && uwsgi_emperor_is_valid(path)) {
+		emperor_scan_file(ues, path);
+	}
+	free(path);
+}
+
+static void emperor_fsmon_event(struct uwsgi_emperor_scanner *ues) {
+	if (chdir(emperor_scanner_is_glob(ues) ? uwsgi.cwd : ues->arg)) {
+		uwsgi_error("emperor_fsmon_event()/chdir()");
+		return;
+	}
+	uwsgi_fsmon_dir_events(ues->fd, emperor_fsmon_entry, ues);
+}
+
+// with filesystem events the periodic full scan is only a safety net
+static int emperor_scanner_skip(struct uwsgi_emperor_scanner *ues) {
+	if (ues->event_func != emperor_fsmon_event) return 0;
+	time_t now = uwsgi_now();
+	if (ues->last_scan > 0 && now - ues->last_scan < uwsgi.emperor_fsmon_rescan) return 1;
+	ues->last_scan = now;
+	return 0;
+}
+
+// this is the monitor for non-glob directories
+void uwsgi_imperial_monitor_directory(struct uwsgi_emperor_scanner *ues) {
+	struct dirent *de;
+
+	if (emperor_scanner_skip(ues))
+		return;
+
+	if (chdir(ues->arg)) {
+		uwsgi_error("chdir()");
+		return;
+	}
+
+	DIR *dir = opendir(".");
+	while ((de = readdir(dir)) != NULL) {
+		if (!uwsgi_emperor_is_valid(de->d_name))
+			continue;
+		emperor_scan_file(ues, de->d_name);
+	}
+	closedir(dir);
+
+	// now check for removed instances
+	emperor_check_removed(ues);
+}
+
 // this is the monitor for glob patterns
 void uwsgi_imperial_monitor_glob(struct uwsgi_emperor_scanner *ues) {
 
 	glob_t g;
 	int i;
-	struct stat st;
-	struct uwsgi_instance *ui_current;
+
+	if (emperor_scanner_skip(ues))
+		return;
 
 	if (chdir(uwsgi.cwd)) {
 		uwsgi_error("uwsgi_imperial_monitor_glob()/chdir()");
@@ -587,134 +948,24 @@ void uwsgi_imperial_monitor_glob(struct uwsgi_emperor_scanner *ues) {
 		if (!uwsgi_emperor_is_valid(g.gl_pathv[i]))
 			continue;
 
-		if (uwsgi.emperor_nofollow) {
-			if (lstat(g.gl_pathv[i], &st))
-				continue;
-			if (!S_ISREG(st.st_mode) && !S_ISLNK(st.st_mode))
-				continue;
-		}
-		else {
-			if (stat(g.gl_pathv[i], &st))
-				continue;
-			if (!S_ISREG(st.st_mode))
-				continue;
-		}
-
-		ui_current = emperor_get(g.gl_pathv[i]);
-
-		uid_t t_uid = st.st_uid;
-		gid_t t_gid = st.st_gid;
-
-		if (uwsgi.emperor_tyrant && uwsgi.emperor_tyrant_nofollow) {
-			struct stat lst;
-			if (lstat(g.gl_pathv[i], &lst)) {
-				uwsgi_error("[emperor-tyrant]/lstat()");
-				if (ui_current) {
-					uwsgi_log("!!! availability of file %s changed. stopping the instance... !!!\n", g.gl_pathv[i]);
-					emperor_stop(ui_current);
-				}
-				continue;
-			}
-			t_uid = lst.st_uid;
-			t_gid = lst.st_gid;
-		}
-
-		if (ui_current) {
-			// check if uid or gid are changed, in such case, stop the instance
-			if (uwsgi.emperor_tyrant) {
-				if (t_uid != ui_current->uid || t_gid != ui_current->gid) {
-					uwsgi_log("!!! permissions of file %s changed. stopping the instance... !!!\n", g.gl_pathv[i]);
-					emperor_stop(ui_current);
-					continue;
-				}
-			}
-			// check if mtime is changed and the uWSGI instance must be reloaded
-			if (st.st_mtime > ui_current->last_mod) {
-				if (uwsgi.emperor_force_config_pipe) {
-                                        char *config = uwsgi_simple_file_read(g.gl_pathv[i]);
-                                        if (!config) {
-                                                uwsgi_log_verbose("[emperor] unable to read %s\n", g.gl_pathv[i]);
-                                                emperor_stop(ui_current);
-                                                continue;
-                                        }
-                                        if (ui_current->config)
-                                                free(ui_current->config);
-                                        ui_current->config = config;
-                                        ui_current->config_len = strlen(ui_current->config);
-                                }
-				emperor_respawn(ui_current, st.st_mtime);
-			}
-		}
-		else {
-			struct uwsgi_dyn_dict *attrs = NULL;
-                        if (uwsgi.emperor_collect_attributes) {
-                                if (uwsgi_endswith(g.gl_pathv[i], ".ini")) {
-                                        uwsgi_emperor_ini_attrs(g.gl_pathv[i], NULL, &attrs);
-                                }
-                        }
-                        char *socket_name = emperor_check_on_demand_socket(g.gl_pathv[i], attrs);
-			if (uwsgi.emperor_force_config_pipe) {
-                                char *config = uwsgi_simple_file_read(g.gl_pathv[i]);
-                                if (config) {
-                                        emperor_add_with_attrs(ues, g.gl_pathv[i], st.st_mtime, config, strlen(config), t_uid, t_gid, socket_name, attrs);
-                                }
-                                else {
-                                        uwsgi_log_verbose("[emperor] unable to read %s\n", g.gl_pathv[i]);
-                                }
-                        }
-                        else {
-                                emperor_add_with_attrs(ues, g.gl_pathv[i], st.st_mtime, NULL, 0, t_uid, t_gid, socket_name, attrs);
-                        }	
-                        if (socket_name)
-                                free(socket_name);
+		// the directories matched by the pattern can change
+		if (uwsgi.emperor_fsmon) {
+			char *slash = strrchr(g.gl_pathv[i], '/');
+			char *dir = slash ? uwsgi_concat2n(g.gl_pathv[i], slash - g.gl_pathv[i], "", 0) : uwsgi_str(".");
+			emperor_fsmon_watch(ues, dir);
+			free(dir);
 		}
 
+		emperor_scan_file(ues, g.gl_pathv[i]);
 	}
 	globfree(&g);
 
 	// now check for removed instances
-	struct uwsgi_instance *c_ui = ui->ui_next;
-
-	while (c_ui) {
-		if (c_ui->scanner == ues) {
-			if (c_ui->zerg) {
-				char *colon = strrchr(c_ui->name, ':');
-				if (!colon) {
-					emperor_stop(c_ui);
-				}
-				else {
-					char *filename = uwsgi_calloc(0xff);
-					memcpy(filename, c_ui->name, colon - c_ui->name);
-					if (uwsgi.emperor_nofollow) {
-						if (lstat(filename, &st)) {
-							emperor_stop(c_ui);
-						}
-					}
-					else {
-						if (stat(filename, &st)) {
-							emperor_stop(c_ui);
-						}
-					}
-					free(filename);
-				}
-			}
-			else {
-				if (uwsgi.emperor_nofollow) {
-					if (lstat(c_ui->name, &st)) {
-						emperor_stop(c_ui);
-					}
-				}
-				else {
-					if (stat(c_ui->name, &st)) {
-						emperor_stop(c_ui);
-					}
-				}
-			}
-		}
-		c_ui = c_ui->ui_next;
-	}
-
+	emperor_check_removed(ues);
+}
 
+static int emperor_scanner_is_glob(struct uwsgi_emperor_scanner *ues) {
+	return ues->monitor->func == uwsgi_imperial_monitor_glob;
 }
 
 void uwsgi_register_imperial_monitor(char *name, void (*init) (struct uwsgi_emperor_scanner *), void (*func) (struct uwsgi_emperor_scanner *)) {
@@ -806,29 +1057,22 @@ static void emperor_stats() {
 
 struct uwsgi_instance *emperor_get_by_fd(int fd) {
 
-	struct uwsgi_instance *c_ui = ui;
-
-	while (c_ui->ui_next) {
-		c_ui = c_ui->ui_next;
-
-		if (c_ui->pipe[0] == fd) {
-			return c_ui;
-		}
+	if (fd < 0 || fd >= emperor_fds_size)
+		return NULL;
+	struct uwsgi_instance *c_ui = emperor_fds[fd];
+	if (c_ui && c_ui->pipe[0] == fd) {
+		return c_ui;
 	}
 	return NULL;
 }
 
 struct uwsgi_instance *emperor_get_by_socket_fd(int fd) {
 
-	struct uwsgi_instance *c_ui = ui;
-
-	while (c_ui->ui_next) {
-		c_ui = c_ui->ui_next;
-
-		// over engineering...
-		if (c_ui->on_demand_fd > -1 && c_ui->on_demand_fd == fd) {
-			return c_ui;
-		}
+	if (fd < 0 || fd >= emperor_fds_size)
+		return NULL;
+	struct uwsgi_instance *c_ui = emperor_fds[fd];
+	if (c_ui && c_ui->on_demand_fd == fd) {
+		return c_ui;
 	}
 	return NULL;
 }
@@ -837,14 +1081,13 @@ struct uwsgi_instance *emperor_get_by_socket_fd(int fd) {
 
 struct uwsgi_instance *emperor_get(char *name) {
 
-	struct uwsgi_instance *c_ui = ui;
-
-	while (c_ui->ui_next) {
-		c_ui = c_ui->ui_next;
+	struct uwsgi_instance *c_ui = *emperor_name_slot(name);
 
+	while (c_ui) {
 		if (!strcmp(c_ui->name, name)) {
 			return c_ui;
 		}
+		c_ui = c_ui->name_next;
 	}
 	return NULL;
 }
@@ -858,6 +1101,17 @@ void emperor_del(struct uwsgi_instance *c_ui) {
 	if (child_ui) {
 		child_ui->ui_prev = parent_ui;
 	}
+	if (emperor_last == c_ui) {
+		emperor_last = parent_ui;
+	}
+
+	emperor_name_unlink(c_ui);
+	emperor_set_pid(c_ui, -1);
+	emperor_timer_clear(c_ui);
+	emperor_fd_unmap(c_ui->pipe[0], c_ui);
+	emperor_fd_unmap(c_ui->on_demand_fd, c_ui);
+	emperor_spawn_dequeue(c_ui);
+	emperor_spawn_done(c_ui);
 
 	// this will destroy the whole uWSGI instance (and workers)
 	if (c_ui->pipe[0] != -1) close(c_ui->pipe[0]);
@@ -923,6 +1177,7 @@ void emperor_back_to_ondemand(struct uwsgi_instance *c_ui) {
 
 	c_ui->status = 2;
 	c_ui->cursed_at = uwsgi_now();
+	emperor_wakeup_cursed(c_ui);
 
 	uwsgi_log_verbose("[emperor] bringing back instance %s to on-demand mode\n", c_ui->name);
 }
@@ -946,6 +1201,7 @@ void emperor_stop(struct uwsgi_instance *c_ui) {
 
 	c_ui->status = 1;
 	c_ui->cursed_at = uwsgi_now();
+	emperor_wakeup_cursed(c_ui);
 
 	uwsgi_log_verbose("[emperor] stop the uwsgi instance %s\n", c_ui->name);
 }
@@ -959,6 +1215,7 @@ void emperor_curse(struct uwsgi_instance *c_ui) {
 	if (c_ui->status == 0)
 		c_ui->status = 1;
 	c_ui->cursed_at = uwsgi_now();
+	emperor_wakeup_cursed(c_ui);
 
 	uwsgi_log_verbose("[emperor] curse the uwsgi instance %s (pid: %d)\n", c_ui->name, (int) c_ui->pid);
 
@@ -995,6 +1252,12 @@ void emperor_respawn(struct uwsgi_instance *c_ui, time_t mod) {
 		return;
 	}
 
+	// still waiting in the spawn queue, it will get the new config
+	if (c_ui->spawn_pending) {
+		c_ui->last_mod = mod;
+		return;
+	}
+
 	// check if we are in on_demand mode (the respawn will be ignored)
 	if (c_ui->pid == -1 && c_ui->on_demand_fd > -1) {
 		c_ui->last_mod = mod;
@@ -1089,7 +1352,7 @@ void emperor_add_with_attrs(struct uwsgi_emperor_scanner *ues, char *name, time_
 			usleep(10);
 		}
 	}
-	else {
+	else if (!uwsgi.emperor_spawn_concurrency) {
 		usleep(emperor_throttle_level);
 	}
 
@@ -1100,9 +1363,8 @@ void emperor_add_with_attrs(struct uwsgi_emperor_scanner *ues, char *name, time_
 		}
 	}
 
-	while (c_ui->ui_next) {
-		c_ui = c_ui->ui_next;
-	}
+	if (emperor_last)
+		c_ui = emperor_last;
 
 	n_ui = uwsgi_calloc(sizeof(struct uwsgi_instance));
 
@@ -1117,6 +1379,7 @@ void emperor_add_with_attrs(struct uwsgi_emperor_scanner *ues, char *name, time_
 	uwsgi_log("c_ui->ui_next = %p\n", c_ui->ui_next);
 #endif
 	n_ui->ui_prev = c_ui;
+	emperor_last = n_ui;
 
 	if (strchr(name, ':')) {
 		n_ui->zerg = 1;
@@ -1125,6 +1388,9 @@ void emperor_add_with_attrs(struct uwsgi_emperor_scanner *ues, char *name, time_
 
 	n_ui->scanner = ues;
 	memcpy(n_ui->name, name, strlen(name));
+	struct uwsgi_instance **slot = emperor_name_slot(n_ui->name);
+	n_ui->name_next = *slot;
+	*slot = n_ui;
 	n_ui->born = born;
 	n_ui->uid = uid;
 	n_ui->gid = gid;
@@ -1160,6 +1426,7 @@ void emperor_add_with_attrs(struct uwsgi_emperor_scanner *ues, char *name, time_
 			emperor_del(n_ui);
 			return;
 		}
+		emperor_fd_map(n_ui->on_demand_fd, n_ui);
 
 		event_queue_add_fd_read(uwsgi.emperor_queue, n_ui->on_demand_fd);
 		uwsgi_log("[uwsgi-emperor] %s -> \"on demand\" instance detected, waiting for connections on socket \"%s\" ...\n", name, socket_name);
@@ -1169,10 +1436,12 @@ void emperor_add_with_attrs(struct uwsgi_emperor_scanner *ues, char *name, time_
 		return;
 	}
 
-	if (uwsgi_emperor_vassal_start(n_ui)) {
-		// clear the vassal
-		emperor_del(n_ui);
+	char *priority = vassal_attr_get(n_ui, uwsgi.emperor_spawn_priority_attr);
+	if (priority) {
+		n_ui->spawn_priority = atoi(priority);
 	}
+
+	emperor_spawn(n_ui);
 }
 
 static void uwsgi_emperor_spawn_vassal(struct uwsgi_instance *);
@@ -1188,6 +1457,205 @@ static void vassal_fork_server_parser_hook(char *key, uint16_t key_len, char *va
 }
 
 
+/*
+
+	fork-server templates
+
+	--emperor-fork-template <name>=<config> spawns an instance suspended in fork-server
+	mode right after loading <config> (plugins, early-python and so on). Vassals
+	using the template are forked from it instead of being started from scratch.
+
+*/
+struct uwsgi_emperor_fork_template {
+	char *name;
+	char *config;
+	char *socket;
+	pid_t pid;
+	int fd;
+	time_t last_spawn;
+	struct uwsgi_emperor_fork_template *next;
+};
+
+static struct uwsgi_emperor_fork_template *emperor_fork_templates;
+static char *emperor_fork_templates_dir;
+static int emperor_fork_templates_running;
+
+static void emperor_fork_template_spawn(struct uwsgi_emperor_fork_template *uft) {
+	int pipe[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, pipe)) {
+		uwsgi_error("emperor_fork_template_spawn()/socketpair()");
+		return;
+	}
+
+	// remove the stale socket, it will be used for knowing when the template is ready
+	unlink(uft->socket);
+	uft->last_spawn = uwsgi_now();
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		uwsgi_error("emperor_fork_template_spawn()/fork()");
+		close(pipe[0]);
+		close(pipe[1]);
+		return;
+	}
+
+	if (pid == 0) {
+		int i;
+		for (i = 3; i < (int) uwsgi.max_fd; i++) {
+			if (i == pipe[1] || uwsgi_fd_is_safe(i))
+				continue;
+			close(i);
+		}
+		uwsgi_remap_fd(0, "/dev/null");
+		unsetenv("UWSGI_RELOADS");
+		unsetenv("NOTIFY_SOCKET");
+		// the template exits when the Emperor pipe is closed
+		char *uef = uwsgi_num2str(pipe[1]);
+		if (setenv("UWSGI_EMPEROR_FD", uef, 1)) {
+			uwsgi_error("emperor_fork_template_spawn()/setenv()");
+			exit(1);
+		}
+		free(uef);
+		unsetenv("UWSGI_EMPEROR_FD_CONFIG");
+		char *argv[5];
+		argv[0] = uwsgi.binary_path;
+		argv[1] = "--fork-server";
+		argv[2] = uft->socket;
+		argv[3] = uft->config;
+		argv[4] = NULL;
+		execvp(argv[0], argv);
+		uwsgi_error("emperor_fork_template_spawn()/execvp()");
+		exit(1);
+	}
+
+	close(pipe[1]);
+	uft->fd = pipe[0];
+	uft->pid = pid;
+	emperor_fork_templates_running++;
+	uwsgi_log_verbose("[emperor] spawned fork-server template \"%s\" (pid: %d)\n", uft->name, (int) pid);
+}
+
+static void emperor_fork_template_reset(struct uwsgi_emperor_fork_template *uft) {
+	uft->pid = -1;
+	close(uft->fd);
+	uft->fd = -1;
+	emperor_fork_templates_running--;
+}
+
+// wait (up to socket-timeout) for the template to bind its socket
+static void emperor_fork_template_wait(struct uwsgi_emperor_fork_template *uft) {
+	int i;
+	for (i = 0; i < uwsgi.socket_timeout * 100; i++) {
+		struct stat st;
+		if (!stat(uft->socket, &st))
+			return;
+		if (waitpid(uft->pid, NULL, WNOHANG) == uft->pid) {
+			uwsgi_log("[emperor] fork-server template \"%s\" died during initialization\n", uft->name);
+			emperor_fork_template_reset(uft);
+			return;
+		}
+		usleep(10000);
+	}
+	uwsgi_log("[emperor] fork-server template \"%s\" is not ready after %d seconds\n", uft->name, uwsgi.socket_timeout);
+}
+
+static void emperor_fork_templates_init() {
+	struct uwsgi_emperor_fork_template *uft, *last = NULL;
+	struct uwsgi_string_list *usl;
+	uwsgi_foreach(usl, uwsgi.emperor_fork_templates) {
+		char *equal = strchr(usl->value, '=');
+		if (!equal || equal == usl->value) {
+			uwsgi_log("invalid --emperor-fork-template syntax: %s (expected <name>=<config>)\n", usl->value);
+			exit(1);
+		}
+		// the sockets live in a private directory, only the Emperor can connect to them
+		if (!emperor_fork_templates_dir) {
+			char *tmpdir = getenv("TMPDIR");
+			emperor_fork_templates_dir = uwsgi_concat2(tmpdir ? tmpdir : "/tmp", "/uwsgi-emperor-XXXXXX");
+			if (!mkdtemp(emperor_fork_templates_dir)) {
+				uwsgi_error("emperor_fork_templates_init()/mkdtemp()");
+				exit(1);
+			}
+		}
+		uft = uwsgi_calloc(sizeof(struct uwsgi_emperor_fork_template));
+		uft->name = uwsgi_concat2n(usl->value, equal - usl->value, "", 0);
+		uft->config = equal + 1;
+		uft->socket = uwsgi_concat4(emperor_fork_templates_dir, "/", uft->name, ".sock");
+		uft->pid = -1;
+		uft->fd = -1;
+		if (last) {
+			last->next = uft;
+		}
+		else {
+			emperor_fork_templates = uft;
+		}
+		last = uft;
+	}
+
+	if (uwsgi.emperor_tyrant && emperor_fork_templates) {
+		uwsgi_log("*** fork-server templates cannot be used in tyrant mode, vassals will be spawned with fork() ***\n");
+	}
+
+	// spawn all of the templates in parallel, then wait for them
+	for (uft = emperor_fork_templates; uft; uft = uft->next) {
+		emperor_fork_template_spawn(uft);
+	}
+	for (uft = emperor_fork_templates; uft; uft = uft->next) {
+		if (uft->pid > 0)
+			emperor_fork_template_wait(uft);
+	}
+}
+
+static int emperor_fork_template_died(pid_t pid) {
+	struct uwsgi_emperor_fork_template *uft;
+	for (uft = emperor_fork_templates; uft; uft = uft->next) {
+		if (uft->pid == pid) {
+			uwsgi_log_verbose("[emperor] fork-server template \"%s\" (pid: %d) died\n", uft->name, (int) pid);
+			emperor_fork_template_reset(uft);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void emperor_fork_templates_respawn(time_t now) {
+	struct uwsgi_emperor_fork_template *uft;
+	for (uft = emperor_fork_templates; uft; uft = uft->next) {
+		// vassals fall back to fork() until the template is back
+		if (uft->pid == -1 && now - uft->last_spawn >= 1) {
+			emperor_fork_template_spawn(uft);
+		}
+	}
+}
+
+static void emperor_fork_templates_destroy() {
+	struct uwsgi_emperor_fork_template *uft;
+	for (uft = emperor_fork_templates; uft; uft = uft->next) {
+		unlink(uft->socket);
+	}
+	if (emperor_fork_templates_dir) {
+		rmdir(emperor_fork_templates_dir);
+	}
+}
+
+static struct uwsgi_emperor_fork_template *emperor_vassal_fork_template(struct uwsgi_instance *n_ui) {
+	if (!emperor_fork_templates || uwsgi.emperor_tyrant)
+		return NULL;
+	char *name = vassal_attr_get(n_ui, uwsgi.emperor_fork_template_attr);
+	if (!name)
+		name = uwsgi.emperor_use_fork_template;
+	if (!name)
+		return NULL;
+	struct uwsgi_emperor_fork_template *uft;
+	for (uft = emperor_fork_templates; uft; uft = uft->next) {
+		if (!strcmp(uft->name, name)) {
+			return uft->pid > 0 ? uft : NULL;
+		}
+	}
+	uwsgi_log("[emperor] unknown fork-server template \"%s\" for vassal %s\n", name, n_ui->name);
+	return NULL;
+}
+
 /*
 	there are max 3 file descriptors we need to pass to the fork server:
 
@@ -1210,6 +1678,11 @@ static pid_t emperor_connect_to_fork_server(char *socket, struct uwsgi_instance
 	// leave space for uwsgi header
 	ub->pos = 4;
 	int error = 0, counter = 0;
+	// the first item is the Emperor cwd (vassal names could be relative)
+	char *cwd = uwsgi_get_cwd();
+	if (uwsgi_buffer_u16le(ub, strlen(cwd)) || uwsgi_buffer_append(ub, cwd, strlen(cwd)))
+		error = 1;
+	free(cwd);
 	while (vassal_argv[counter]) {
 		if (!error && uwsgi_buffer_u16le(ub, strlen(vassal_argv[counter])))
 			error = 1;
@@ -1229,7 +1702,8 @@ static pid_t emperor_connect_to_fork_server(char *socket, struct uwsgi_instance
 	// bit 0 -> pipe (0x01)
 	// bit 1 -> config_pipe (0x02)
 	// bit 2 -> on_demand (0x04)
-	uint8_t modifier2_mask = 0x01;
+	// bit 3 -> cwd (0x08)
+	uint8_t modifier2_mask = 0x01 | 0x08;
 	int fds[8];
 	int fds_count = 1;
 	fds[0] = n_ui->pipe[1];
@@ -1297,6 +1771,7 @@ int uwsgi_emperor_vassal_start(struct uwsgi_instance *n_ui) {
 		return -1;
 	}
 	uwsgi_socket_nb(n_ui->pipe[0]);
+	emperor_fd_map(n_ui->pipe[0], n_ui);
 
 	event_queue_add_fd_read(uwsgi.emperor_queue, n_ui->pipe[0]);
 
@@ -1326,11 +1801,19 @@ int uwsgi_emperor_vassal_start(struct uwsgi_instance *n_ui) {
 	char *fork_server = uwsgi.emperor_use_fork_server;
 	char *fork_server_attr = vassal_attr_get(n_ui, uwsgi.emperor_fork_server_attr);
 	if (fork_server_attr) fork_server = fork_server_attr;
+	struct uwsgi_emperor_fork_template *uft = emperor_vassal_fork_template(n_ui);
+	if (uft) fork_server = uft->socket;
 	// a new uWSGI instance will start
 	if (fork_server && !uwsgi_string_list_has_item(uwsgi.vassal_fork_base, n_ui->name, strlen(n_ui->name))) {
 		// pid can only be > 0 or -1
 		n_ui->adopted = 1;
 		pid = emperor_connect_to_fork_server(fork_server, n_ui);
+		// templates are managed by the Emperor, fallback to plain fork() if they are not available
+		if (pid < 0 && uft) {
+			uwsgi_log_verbose("[emperor] unable to use fork-server template \"%s\" for vassal %s, falling back to fork()\n", uft->name, n_ui->name);
+			n_ui->adopted = 0;
+			pid = fork();
+		}
 	}
 #if defined(__linux__) && !defined(OBSOLETE_LINUX_KERNEL) && !defined(__ia64__)
 	else if (uwsgi.emperor_clone) {
@@ -1346,7 +1829,16 @@ int uwsgi_emperor_vassal_start(struct uwsgi_instance *n_ui) {
 		uwsgi_error("uwsgi_emperor_spawn_vassal()/fork()")
 	}
 	else if (pid > 0) {
-		n_ui->pid = pid;
+		emperor_set_pid(n_ui, pid);
+		n_ui->spawned_at = uwsgi_now();
+		if (uwsgi.emperor_spawn_concurrency > 0 && !n_ui->spawning) {
+			n_ui->spawning = 1;
+			emperor_spawning++;
+			emperor_wakeup_at(n_ui, n_ui->spawned_at + uwsgi.emperor_spawn_timeout);
+		}
+		if (uwsgi.emperor_on_demand_idle > 0 && n_ui->on_demand_fd > -1) {
+			emperor_wakeup_at(n_ui, emperor_idle_deadline(n_ui));
+		}
 		// close the right side of the pipe
 		close(n_ui->pipe[1]);
 		n_ui->pipe[1] = -1;
@@ -1792,6 +2284,14 @@ void uwsgi_imperial_monitor_glob_init(struct uwsgi_emperor_scanner *ues) {
 	if (!uwsgi_startswith(ues->arg, "glob://", 7)) {
 		ues->arg += 7;
 	}
+
+	if (uwsgi.emperor_fsmon) {
+		// directories added later are watched by the full rescans
+		char *slash = strrchr(ues->arg, '/');
+		char *dir = slash ? uwsgi_concat2n(ues->arg, slash - ues->arg, "", 0) : uwsgi_str(".");
+		emperor_fsmon_watch(ues, dir);
+		free(dir);
+	}
 }
 
 void uwsgi_imperial_monitor_directory_init(struct uwsgi_emperor_scanner *ues) {
@@ -1813,6 +2313,9 @@ void uwsgi_imperial_monitor_directory_init(struct uwsgi_emperor_scanner *ues) {
 
 	ues->arg = uwsgi.emperor_absolute_dir;
 
+	if (uwsgi.emperor_fsmon) {
+		emperor_fsmon_watch(ues, ues->arg);
+	}
 }
 
 struct uwsgi_imperial_monitor *imperial_monitor_get_by_id(char *scheme) {
@@ -1930,17 +2433,111 @@ static void emperor_cleanup() {
 	}
 }
 
+// run the expired vassal timers, returns 1 if an instance has been removed
+static int emperor_housekeeping(time_t now) {
+	int removed = 0;
+	for (;;) {
+		struct uwsgi_rb_timer *urbt = uwsgi_min_rb_timer(emperor_timers, NULL);
+		if (!urbt || urbt->value > (uint64_t) now)
+			break;
+		struct uwsgi_instance *c_ui = (struct uwsgi_instance *) urbt->data;
+		emperor_timer_clear(c_ui);
+
+		if (c_ui->cursed_at > 0) {
+			if (c_ui->pid == -1) {
+				emperor_del(c_ui);
+				removed = 1;
+				continue;
+			}
+			if (now - c_ui->cursed_at >= uwsgi.emperor_curse_tolerance) {
+				c_ui->cursed_at = now;
+				if (kill(c_ui->pid, SIGKILL) < 0) {
+					uwsgi_error("[emperor] kill()");
+					// delete the vassal, something is seriously wrong better to not leak memory...
+					emperor_del(c_ui);
+					removed = 1;
+					continue;
+				}
+			}
+			emperor_wakeup_cursed(c_ui);
+		}
+
+		// do not let a vassal never reporting its readyness block the spawn queue
+		if (c_ui->spawning) {
+			if (now - c_ui->spawned_at >= uwsgi.emperor_spawn_timeout) {
+				uwsgi_log_verbose("[emperor] vassal %s not ready after %d seconds, releasing its spawn slot\n", c_ui->name, uwsgi.emperor_spawn_timeout);
+				emperor_spawn_done(c_ui);
+			}
+			else {
+				emperor_wakeup_at(c_ui, c_ui->spawned_at + uwsgi.emperor_spawn_timeout);
+			}
+		}
+
+		// scale to zero idle on-demand vassals (unless they are expected to be busy)
+		if (uwsgi.emperor_on_demand_idle > 0 && c_ui->on_demand_fd > -1 && c_ui->pid > 0 && c_ui->status == 0) {
+			if (now >= emperor_idle_deadline(c_ui)) {
+				if (uwsgi.emperor_on_demand_prewarm > 0 && emperor_activity_predicted(c_ui, now) >= uwsgi.emperor_on_demand_prewarm) {
+					emperor_wakeup_at(c_ui, now + uwsgi.emperor_on_demand_idle);
+				}
+				else {
+					uwsgi_log_verbose("[emperor] vassal %s idle for %d seconds\n", c_ui->name, (int) (now - (emperor_idle_deadline(c_ui) - uwsgi.emperor_on_demand_idle)));
+					emperor_back_to_ondemand(c_ui);
+				}
+			}
+			else {
+				emperor_wakeup_at(c_ui, emperor_idle_deadline(c_ui));
+			}
+		}
+
+		// check for heartbeat (if required)
+		if (c_ui->last_heartbeat > 0) {
+			if ((c_ui->last_heartbeat + uwsgi.emperor_heartbeat) < now) {
+				uwsgi_log("[emperor] vassal %s sent no heartbeat in last %d seconds, brutally respawning it...\n", c_ui->name, uwsgi.emperor_heartbeat);
+				// set last_heartbeat to 0 avoiding races
+				c_ui->last_heartbeat = 0;
+				if (c_ui->pid > 0) {
+					if (kill(c_ui->pid, SIGKILL) < 0) {
+						uwsgi_error("[emperor] kill()");
+						emperor_del(c_ui);
+						removed = 1;
+					}
+				}
+			}
+			else {
+				emperor_wakeup_at(c_ui, c_ui->last_heartbeat + uwsgi.emperor_heartbeat + 1);
+			}
+		}
+	}
+	return removed;
+}
+
+// spawn on-demand vassals expected to be busy in the next minutes
+static void emperor_prewarm(time_t now) {
+	struct uwsgi_instance *c_ui = ui->ui_next;
+	while (c_ui) {
+		struct uwsgi_instance *n_ui = c_ui;
+		c_ui = c_ui->ui_next;
+		if (n_ui->on_demand_fd < 0 || n_ui->pid != -1 || n_ui->status != 0 || n_ui->spawn_pending)
+			continue;
+		if (emperor_activity_predicted(n_ui, now + 300) < uwsgi.emperor_on_demand_prewarm)
+			continue;
+		uwsgi_log_verbose("[emperor] pre-warming on-demand vassal %s\n", n_ui->name);
+		event_queue_del_fd(uwsgi.emperor_queue, n_ui->on_demand_fd, event_queue_read());
+		emperor_spawn(n_ui);
+	}
+}
+
 void emperor_loop() {
 
 #if defined(__linux__) && defined(PR_SET_CHILD_SUBREAPER)
-        if (uwsgi.emperor_use_fork_server || uwsgi.emperor_subreaper || uwsgi.emperor_fork_server_attr) {
+        if (uwsgi.emperor_use_fork_server || uwsgi.emperor_subreaper || uwsgi.emperor_fork_server_attr || uwsgi.emperor_fork_templates) {
                 if (prctl(PR_SET_CHILD_SUBREAPER, 1, 0, 0, 0)) {
                         uwsgi_error("uwsgi_fork_server()/fork()");
                         exit(1);
                 }
         }
 #else
-	if (uwsgi.emperor_use_fork_server || uwsgi.emperor_subreaper || uwsgi.emperor_fork_server_attr) {
+	if (uwsgi.emperor_use_fork_server || uwsgi.emperor_subreaper || uwsgi.emperor_fork_server_attr || uwsgi.emperor_fork_templates) {
 		uwsgi_log("*** DANGER: your kernel misses PR_SET_CHILD_SUBREAPER feature, required by the fork server ***\n");
 		uwsgi_log("*** your Emperor will not be able to correctly wait() on vassals ***\n");
 	}
@@ -1989,11 +2586,20 @@ void emperor_loop() {
 
 	uwsgi.max_fd = rl.rlim_cur;
 
+	emperor_fds_size = uwsgi.max_fd;
+	emperor_fds = uwsgi_calloc(sizeof(struct uwsgi_instance *) * emperor_fds_size);
+	emperor_timers = uwsgi_init_rb_timer();
+
 	emperor_throttle_level = uwsgi.emperor_throttle;
 
 	// the queue must be initialized before adding scanners
 	uwsgi.emperor_queue = event_queue_init();
 
+	if (!uwsgi.emperor_fsmon_rescan)
+		uwsgi.emperor_fsmon_rescan = 60;
+
+	emperor_fork_templates_init();
+
 	emperor_build_scanners();
 
 	events = event_queue_alloc(64);
@@ -2023,8 +2629,10 @@ void emperor_loop() {
 	}
 
 	ui = &ui_base;
+	emperor_last = ui;
 
 	int freq = 0;
+	time_t next_prewarm = 0;
 
 	uwsgi_hooks_run(uwsgi.hook_emperor_start, "emperor-start", 1);
 
@@ -2076,6 +2684,15 @@ void emperor_loop() {
 			}
 		}
 
+		// do not sleep past the next vassal deadline
+		struct uwsgi_rb_timer *next_timer = uwsgi_min_rb_timer(emperor_timers, NULL);
+		if (next_timer) {
+			time_t now = uwsgi_now();
+			int next_freq = next_timer->value > (uint64_t) now ? (int) (next_timer->value - now) : 0;
+			if (next_freq < freq)
+				freq = next_freq;
+		}
+
 		nevents = event_queue_wait_multi(uwsgi.emperor_queue, freq, events, 64);
 		freq = uwsgi.emperor_freq;
 
@@ -2119,6 +2736,7 @@ void emperor_loop() {
 					// heartbeat can be used for spotting blocked instances
 					else if (byte == 26) {
 						ui_current->last_heartbeat = uwsgi_now();
+						emperor_wakeup_at(ui_current, ui_current->last_heartbeat + uwsgi.emperor_heartbeat + 1);
 					}
 					else if (byte == 22) {
 						// command 22 changes meaning when in "on_demand" mode
@@ -2129,6 +2747,9 @@ void emperor_loop() {
 							emperor_stop(ui_current);
 						}
 					}
+					else if (byte == 27) {
+						emperor_vassal_activity(ui_current, uwsgi_now());
+					}
 					else if (byte == 30 && uwsgi.emperor_broodlord > 0 && uwsgi.emperor_broodlord_count < uwsgi.emperor_broodlord) {
 						uwsgi_log_verbose("[emperor] going in broodlord mode: launching zergs for %s\n", ui_current->name);
 						char *zerg_name = uwsgi_concat3(ui_current->name, ":", "zerg");
@@ -2144,6 +2765,7 @@ void emperor_loop() {
 					else if (byte == 1) {
 						ui_current->ready = 1;
 						ui_current->last_ready = uwsgi_now();
+						emperor_spawn_done(ui_current);
 						uwsgi_log_verbose("[emperor] vassal %s has been spawned\n", ui_current->name);
 					}
 					else if (byte == 2) {
@@ -2169,40 +2791,8 @@ void emperor_loop() {
 
 		uwsgi_emperor_run_scanners();
 
-		// check for heartbeat (if required)
-		ui_current = ui->ui_next;
-		while (ui_current) {
-			if (ui_current->last_heartbeat > 0) {
-#ifdef UWSGI_DEBUG
-				uwsgi_log("%d %d %d %d\n", ui_current->last_heartbeat, uwsgi.emperor_heartbeat, ui_current->last_heartbeat + uwsgi.emperor_heartbeat, uwsgi_now());
-#endif
-				if ((ui_current->last_heartbeat + uwsgi.emperor_heartbeat) < uwsgi_now()) {
-					uwsgi_log("[emperor] vassal %s sent no heartbeat in last %d seconds, brutally respawning it...\n", ui_current->name, uwsgi.emperor_heartbeat);
-					// set last_heartbeat to 0 avoiding races
-					ui_current->last_heartbeat = 0;
-					if (ui_current->pid > 0) {
-						if (kill(ui_current->pid, SIGKILL) < 0) {
-							uwsgi_error("[emperor] kill()");
-							emperor_del(ui_current);
-							break;
-						}
-					}
-				}
-			}
-			ui_current = ui_current->ui_next;
-		}
-
-
 recheck:
-		// check for removed instances
-		ui_current = ui;
-		has_children = 0;
-		while (ui_current->ui_next) {
-			ui_current = ui_current->ui_next;
-			if (ui_current->pid > -1) {
-				has_children++;
-			}
-		}
+		has_children = emperor_running + emperor_fork_templates_running;
 
 		if (uwsgi.notify) {
 			if (snprintf(notification_message, 64, "The Emperor is governing %d vassals", has_children) >= 34) {
@@ -2235,82 +2825,85 @@ recheck:
 			}
 		}
 
-		ui_current = ui;
-		while (ui_current->ui_next) {
-			ui_current = ui_current->ui_next;
-			time_t now = uwsgi_now();
-			if (diedpid > 0 && ui_current->pid == diedpid) {
-				if (ui_current->status == 0) {
-					// respawn an accidentally dead instance if its exit code is not UWSGI_EXILE_CODE
-					if (WIFEXITED(waitpid_status) && WEXITSTATUS(waitpid_status) == UWSGI_EXILE_CODE) {
-						// SAFE
-						emperor_del(ui_current);
+		ui_current = diedpid > 0 ? emperor_get_by_pid(diedpid) : NULL;
+		if (!ui_current && diedpid > 0) {
+			emperor_fork_template_died(diedpid);
+		}
+		if (ui_current) {
+			if (ui_current->status == 0) {
+				// respawn an accidentally dead instance if its exit code is not UWSGI_EXILE_CODE
+				if (WIFEXITED(waitpid_status) && WEXITSTATUS(waitpid_status) == UWSGI_EXILE_CODE) {
+					// SAFE
+					emperor_del(ui_current);
+				}
+				else {
+					// UNSAFE
+					char *config = NULL;
+					if (ui_current->config) {
+						config = uwsgi_str(ui_current->config);
 					}
-					else {
-						// UNSAFE
-						char *config = NULL;
-						if (ui_current->config) {
-							config = uwsgi_str(ui_current->config);
-						}
-						char *socket_name = NULL;
-						if (ui_current->socket_name) {
-							socket_name = uwsgi_str(ui_current->socket_name);
-						}
-						emperor_add(ui_current->scanner, ui_current->name, ui_current->last_mod, config, ui_current->config_len, ui_current->uid, ui_current->gid, socket_name);
-						emperor_del(ui_current);
-						// temporarily set frequency to 1, so we can eventually fast-restart the instance
-						freq = 1;
+					char *socket_name = NULL;
+					if (ui_current->socket_name) {
+						socket_name = uwsgi_str(ui_current->socket_name);
+					}
+					emperor_add(ui_current->scanner, ui_current->name, ui_current->last_mod, config, ui_current->config_len, ui_current->uid, ui_current->gid, socket_name);
+					if (emperor_last != ui_current && !strcmp(emperor_last->name, ui_current->name)) {
+						memcpy(emperor_last->activity_hist, ui_current->activity_hist, sizeof(ui_current->activity_hist));
+						memcpy(emperor_last->activity_day, ui_current->activity_day, sizeof(ui_current->activity_day));
 					}
-					break;
-				}
-				else if (ui_current->status == 1) {
-					// remove 'marked for dead' instance
 					emperor_del(ui_current);
 					// temporarily set frequency to 1, so we can eventually fast-restart the instance
 					freq = 1;
-					break;
-				}
-				// back to on_demand mode ...
-				else if (ui_current->status == 2) {
-					event_queue_add_fd_read(uwsgi.emperor_queue, ui_current->on_demand_fd);
-					close(ui_current->pipe[0]);
-					ui_current->pipe[0] = -1;
-					if (ui_current->use_config) {
-						close(ui_current->pipe_config[0]);
-						ui_current->pipe_config[0] = -1;
-					}
-					ui_current->pid = -1;
-					ui_current->status = 0;
-					ui_current->cursed_at = 0;
-					ui_current->ready = 0;
-					ui_current->accepting = 0;
-					uwsgi_log("[uwsgi-emperor] %s -> back to \"on demand\" mode, waiting for connections on socket \"%s\" ...\n", ui_current->name, ui_current->socket_name);
-					if (uwsgi_hooks_run_and_return(uwsgi.hook_as_on_demand_vassal, "as-on-demand-vassal", ui_current->name, 0)) {
-						emperor_del(ui_current);
-						freq = 1;
-					}
-					break;
 				}
 			}
-			else if (ui_current->cursed_at > 0) {
-				if (ui_current->pid == -1) {
+			else if (ui_current->status == 1) {
+				// remove 'marked for dead' instance
+				emperor_del(ui_current);
+				// temporarily set frequency to 1, so we can eventually fast-restart the instance
+				freq = 1;
+			}
+			// back to on_demand mode ...
+			else if (ui_current->status == 2) {
+				event_queue_add_fd_read(uwsgi.emperor_queue, ui_current->on_demand_fd);
+				emperor_fd_unmap(ui_current->pipe[0], ui_current);
+				close(ui_current->pipe[0]);
+				ui_current->pipe[0] = -1;
+				if (ui_current->use_config) {
+					close(ui_current->pipe_config[0]);
+					ui_current->pipe_config[0] = -1;
+				}
+				emperor_set_pid(ui_current, -1);
+				emperor_spawn_done(ui_current);
+				ui_current->status = 0;
+				ui_current->cursed_at = 0;
+				ui_current->ready = 0;
+				ui_current->accepting = 0;
+				uwsgi_log("[uwsgi-emperor] %s -> back to \"on demand\" mode, waiting for connections on socket \"%s\" ...\n", ui_current->name, ui_current->socket_name);
+				if (uwsgi_hooks_run_and_return(uwsgi.hook_as_on_demand_vassal, "as-on-demand-vassal", ui_current->name, 0)) {
 					emperor_del(ui_current);
-					// temporarily set frequency to 1, so we can eventually fast-restart the instance
 					freq = 1;
-					break;
-				}
-				else if (now - ui_current->cursed_at >= uwsgi.emperor_curse_tolerance) {
-					ui_current->cursed_at = now;
-					if (kill(ui_current->pid, SIGKILL) < 0) {
-						uwsgi_error("[emperor] kill()");
-						// delete the vassal, something is seriously wrong better to not leak memory...
-						emperor_del(ui_current);
-					}
-					break;
 				}
 			}
 		}
 
+		if (emperor_housekeeping(uwsgi_now())) {
+			// temporarily set frequency to 1, so we can eventually fast-restart the instance
+			freq = 1;
+		}
+
+		if (emperor_fork_templates) {
+			emperor_fork_templates_respawn(uwsgi_now());
+		}
+
+		if (uwsgi.emperor_on_demand_prewarm > 0 && uwsgi_now() >= next_prewarm) {
+			emperor_prewarm(uwsgi_now());
+			next_prewarm = uwsgi_now() + 60;
+		}
+
+		if (uwsgi.emperor_spawn_concurrency > 0) {
+			emperor_spawn_queue_run();
+		}
+
 		// if waitpid returned an item, let's check for another (potential) one
 		if (diedpid > 0)
 			goto recheck;
@@ -2318,6 +2911,7 @@ recheck:
 
 	}
 
+	emperor_fork_templates_destroy();
 	uwsgi_log_verbose("The Emperor is buried.\n");
 	uwsgi_notify("The Emperor is buried.");
 	exit(0);
@@ -2383,6 +2977,12 @@ void emperor_send_stats(int fd) {
 	if (uwsgi_stats_keylong_comma(us, "throttle_level", (unsigned long long) emperor_throttle_level / 1000))
 		goto end0;
 
+	if (uwsgi_stats_keylong_comma(us, "spawning", (unsigned long long) emperor_spawning))
+		goto end0;
+
+	if (uwsgi_stats_keylong_comma(us, "spawn_queue", (unsigned long long) emperor_spawn_queued))
+		goto end0;
+
 
 	if (uwsgi_stats_key(us, "vassals"))
 		goto end0;
@@ -2406,6 +3006,9 @@ void emperor_send_stats(int fd) {
 			goto end0;
 		if (uwsgi_stats_keylong_comma(us, "last_heartbeat", (unsigned long long) c_ui->last_heartbeat))
 			goto end0;
+
+		if (uwsgi_stats_keylong_comma(us, "last_activity", (unsigned long long) c_ui->last_activity))
+			goto end0;
 		if (uwsgi_stats_keylong_comma(us, "loyal", (unsigned long long) c_ui->loyal))
 			goto end0;
 		if (uwsgi_stats_keylong_comma(us, "ready", (unsigned long long) c_ui->ready))
@@ -12,61 +12,74 @@ struct uwsgi_poll_event {
 	int max_events;
 	pthread_mutex_t lock;
 	struct pollfd *poll;
+	// fd -> position in the pollfd array + 1 (0 means not registered)
+	int *index;
 };
 
 struct uwsgi_poll_event **uwsgi_poll_event_queue;
 
 // all of the public functions must be heavy locked
 
+static struct pollfd *uwsgi_poll_fd_get(struct uwsgi_poll_event *upe, int fd) {
+	if (fd < 0 || fd >= upe->max_events || !upe->index[fd]) return NULL;
+	return &upe->poll[upe->index[fd]-1];
+}
+
 static int uwsgi_poll_fd_is_registered(struct uwsgi_poll_event *upe, int fd) {
-	int i;
-	for(i=0;i<upe->nevents;i++) {
-		if (upe->poll[i].fd == fd) {
-			return 1;
-		}
-	}
-	return 0;
+	return uwsgi_poll_fd_get(upe, fd) != NULL;
 }
 
 static int uwsgi_poll_fd_add(struct uwsgi_poll_event *upe, int fd, int event) {
 	int pos = upe->nevents;
-	if (pos > upe->max_events) return -1;
+	if (fd < 0 || fd >= upe->max_events || pos >= upe->max_events) return -1;
 	upe->poll[pos].fd = fd;
 	upe->poll[pos].events = event;
+	upe->poll[pos].revents = 0;
+	upe->index[fd] = pos+1;
 	upe->nevents++;
 	return 0;
 }
 
+// the last item takes the place of the removed one
 static int uwsgi_poll_fd_del(struct uwsgi_poll_event *upe, int fd) {
-	int i;
-	for(i=0;i<upe->nevents;i++) {
-		if (upe->poll[i].fd == fd) {
-			if (i < upe->nevents-1) {
-				memcpy(&upe->poll[i], &upe->poll[i+1], sizeof(struct uwsgi_poll_event) * (upe->nevents - (i+1))); 
-			}
-			upe->nevents--;
-			return 0;
-		}
-	}
-	return -1;
+	if (!uwsgi_poll_fd_is_registered(upe, fd)) return -1;
+	int pos = upe->index[fd]-1;
+	int last = upe->nevents-1;
+	if (pos < last) {
+		upe->poll[pos] = upe->poll[last];
+		upe->index[upe->poll[pos].fd] = pos+1;
+	}
+	upe->index[fd] = 0;
+	upe->nevents--;
+	return 0;
 }
 
-static void uwsgi_poll_queue_rebuild(struct uwsgi_poll_event *upe) {
-	// we need to check if some file descriptor is no more valid
-	int i;
-	for(i=0;i<upe->nevents;i++) {
-		if (!uwsgi_valid_fd(upe->poll[i].fd)) {
+static int uwsgi_poll_fd_set(struct uwsgi_poll_event *upe, int fd, int event) {
+	struct pollfd *upoll = uwsgi_poll_fd_get(upe, fd);
+	if (!upoll) return -1;
+	upoll->events = event;
+	return 0;
+}
+
+// closed file descriptors (never removed) are reported as POLLNVAL
+static void uwsgi_poll_queue_prune(struct uwsgi_poll_event *upe) {
+	int i = 0;
+	while(i < upe->nevents) {
+		if (upe->poll[i].revents & POLLNVAL) {
+			// the swapped item is checked in the next round
 			uwsgi_poll_fd_del(upe, upe->poll[i].fd);
+			continue;
 		}
+		i++;
 	}
 }
 
-int event_queue_wait(int eq, int timeout, int *interesting_fd) {
+int event_queue_wait_ms(int eq, int timeout, int *interesting_fd) {
 	struct uwsgi_poll_event *upe = uwsgi_poll_event_queue[eq];
 	pthread_mutex_lock(&upe->lock);
-	uwsgi_poll_queue_rebuild(upe);
-	int ret = poll(upe->poll, upe->nevents, timeout * 1000);
+	int ret = poll(upe->poll, upe->nevents, timeout);
 	if (ret > 0) {
+		uwsgi_poll_queue_prune(upe);
 		int i;
 		for(i=0;i<upe->nevents;i++) {
 			if (upe->poll[i].revents) {
@@ -75,6 +88,8 @@ int event_queue_wait(int eq, int timeout, int *interesting_fd) {
 				return 1;
 			}
 		}
+		// only pruned file descriptors
+		ret = 0;
 	}
 	pthread_mutex_unlock(&upe->lock);
 	return ret;
@@ -88,6 +103,7 @@ int event_queue_init() {
 	uwsgi_poll_event_queue[eq] = uwsgi_calloc(sizeof(struct uwsgi_poll_event));
 	uwsgi_poll_event_queue_max++;
 	uwsgi_poll_event_queue[eq]->poll = uwsgi_malloc(sizeof(struct pollfd) * uwsgi.max_fd);
+	uwsgi_poll_event_queue[eq]->index = uwsgi_calloc(sizeof(int) * uwsgi.max_fd);
 	uwsgi_poll_event_queue[eq]->max_events = uwsgi.max_fd;
 	pthread_mutex_init(&uwsgi_poll_event_queue[eq]->lock, NULL);
 	return eq;
@@ -109,16 +125,9 @@ int event_queue_interesting_fd_is_read(void *events, int id) {
 int event_queue_fd_write_to_readwrite(int eq, int fd) {
 	struct uwsgi_poll_event *upe = uwsgi_poll_event_queue[eq];
 	pthread_mutex_lock(&upe->lock);
-	int i;
-	for(i=0;i<upe->nevents;i++) {
-		if (upe->poll[i].fd == fd) {
-			upe->poll[i].events = POLLIN|POLLOUT;
-			pthread_mutex_unlock(&upe->lock);
-			return 0;
-		}
-	}	
+	int ret = uwsgi_poll_fd_set(upe, fd, POLLIN|POLLOUT);
 	pthread_mutex_unlock(&upe->lock);
-	return -1;
+	return ret;
 }
 
 int event_queue_fd_read_to_readwrite(int eq, int fd) {
@@ -166,12 +175,12 @@ int event_queue_del_fd(int eq, int fd, int event) {
 int event_queue_wait_multi(int eq, int timeout, void *events, int nevents) {
 	struct uwsgi_poll_event *upe = uwsgi_poll_event_queue[eq];
 	pthread_mutex_lock(&upe->lock);
-        uwsgi_poll_queue_rebuild(upe);
         int ret = poll(upe->poll, upe->nevents, timeout * 1000);
 	int cnt = 0;
         if (ret > 0) {
+		uwsgi_poll_queue_prune(upe);
                 int i;
-                for(i=0;i<upe->nevents;i++) {
+                for(i=0;i<upe->nevents && cnt < nevents;i++) {
                         if (upe->poll[i].revents) {
 				struct pollfd *pevents = (struct pollfd *)events;	
 				struct pollfd *upoll = &pevents[cnt];
@@ -202,30 +211,16 @@ int event_queue_interesting_fd(void *events, int id) {
 int event_queue_fd_write_to_read(int eq, int fd) {
 	struct uwsgi_poll_event *upe = uwsgi_poll_event_queue[eq];
 	pthread_mutex_lock(&upe->lock);
-	int i;
-	for(i=0;i<upe->nevents;i++) {
-		if (upe->poll[i].fd == fd) {
-			upe->poll[i].events = POLLIN;
-			pthread_mutex_unlock(&upe->lock);
-			return 0;
-		}
-	}	
+	int ret = uwsgi_poll_fd_set(upe, fd, POLLIN);
 	pthread_mutex_unlock(&upe->lock);
-	return -1;
+	return ret;
 }
 int event_queue_fd_read_to_write(int eq, int fd) {
 	struct uwsgi_poll_event *upe = uwsgi_poll_event_queue[eq];
 	pthread_mutex_lock(&upe->lock);
-	int i;
-	for(i=0;i<upe->nevents;i++) {
-		if (upe->poll[i].fd == fd) {
-			upe->poll[i].events = POLLOUT;
-			pthread_mutex_unlock(&upe->lock);
-			return 0;
-		}
-	}	
+	int ret = uwsgi_poll_fd_set(upe, fd, POLLOUT);
 	pthread_mutex_unlock(&upe->lock);
-	return -1;
+	return ret;
 }
 #endif
 
@@ -438,15 +433,15 @@ int event_queue_wait_multi(int eq, int timeout, void *events, int nevents) {
 
 
 
-int event_queue_wait(int eq, int timeout, int *interesting_fd) {
+int event_queue_wait_ms(int eq, int timeout, int *interesting_fd) {
 
 	int ret;
 	port_event_t pe;
 	timespec_t ts;
 
-	if (timeout > 0) {
-		ts.tv_sec = timeout;
-		ts.tv_nsec = 0;
+	if (timeout >= 0) {
+		ts.tv_sec = timeout / 1000;
+		ts.tv_nsec = (timeout % 1000) * 1000000;
 		ret = port_get(eq, &pe, &ts);
 	}
 	else {
@@ -486,13 +481,511 @@ int event_queue_wait(int eq, int timeout, int *interesting_fd) {
 #endif
 
 
-#ifdef UWSGI_EVENT_USE_EPOLL
+#if defined(UWSGI_EVENT_USE_EPOLL) || defined(UWSGI_EVENT_USE_IO_URING)
 
 #include <sys/epoll.h>
 
 #define UWSGI_EVENT_IN EPOLLIN
 #define UWSGI_EVENT_OUT EPOLLOUT
 
+#ifdef UWSGI_EVENT_USE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/*
+	the io_uring backend is epoll with batched control operations:
+	every epoll_ctl() is queued as an IORING_OP_EPOLL_CTL request and all of them are
+	submitted with a single io_uring_enter() before waiting for events.
+
+	Requests are hard-linked (so they are run in order) and the submission waits
+	for their completion, so the epoll set is always updated before epoll_wait().
+	Errors are only logged (closed file descriptors are silently skipped, as epoll
+	already removed them).
+
+	Queues fall back to plain epoll_ctl() when io_uring (or IORING_OP_EPOLL_CTL) is not available,
+	and in processes forked after their creation (the ring cannot be shared).
+*/
+
+struct uwsgi_io_uring {
+	pthread_mutex_t lock;
+	int fd;
+	unsigned entries;
+	unsigned pending;
+
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	struct io_uring_sqe *sqes;
+
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	struct epoll_event *events;
+
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	size_t sqes_size;
+};
+
+static struct uwsgi_io_uring **uwsgi_io_uring_queues;
+static int uwsgi_io_uring_max_queue;
+static pthread_mutex_t uwsgi_io_uring_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void uwsgi_io_uring_destroy(struct uwsgi_io_uring *uu) {
+	if (uu->sqes) munmap(uu->sqes, uu->sqes_size);
+	if (uu->cq_ring && uu->cq_ring != uu->sq_ring) munmap(uu->cq_ring, uu->cq_ring_size);
+	if (uu->sq_ring) munmap(uu->sq_ring, uu->sq_ring_size);
+	if (uu->events) free(uu->events);
+	close(uu->fd);
+	free(uu);
+}
+
+// the rings of the parent cannot be used
+static void uwsgi_io_uring_atfork(void) {
+	int i;
+	for(i=0;i<=uwsgi_io_uring_max_queue;i++) {
+		if (uwsgi_io_uring_queues[i]) {
+			uwsgi_io_uring_destroy(uwsgi_io_uring_queues[i]);
+			uwsgi_io_uring_queues[i] = NULL;
+		}
+	}
+}
+
+static void uwsgi_io_uring_init(int eq) {
+	static int warned = 0;
+	struct io_uring_params params;
+
+	if (eq < 0 || (rlim_t) eq >= uwsgi.max_fd) return;
+
+	memset(&params, 0, sizeof(struct io_uring_params));
+	int fd = syscall(__NR_io_uring_setup, 256, &params);
+	if (fd < 0) {
+		if (!warned) {
+			uwsgi_error("io_uring_setup()");
+			uwsgi_log("*** io_uring not available, using plain epoll ***\n");
+			warned = 1;
+		}
+		return;
+	}
+
+	struct uwsgi_io_uring *uu = uwsgi_calloc(sizeof(struct uwsgi_io_uring));
+	uu->fd = fd;
+
+	size_t probe_size = sizeof(struct io_uring_probe) + (256 * sizeof(struct io_uring_probe_op));
+	struct io_uring_probe *probe = uwsgi_calloc(probe_size);
+	if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) < 0 || probe->last_op < IORING_OP_EPOLL_CTL || !(probe->ops[IORING_OP_EPOLL_CTL].flags & IO_URING_OP_SUPPORTED)) {
+		free(probe);
+		if (!warned) {
+			uwsgi_log("*** io_uring does not support IORING_OP_EPOLL_CTL, using plain epoll ***\n");
+			warned = 1;
+		}
+		goto error;
+	}
+	free(probe);
+
+	uu->sq_ring_size = params.sq_off.array + (params.sq_entries * sizeof(unsigned));
+	uu->cq_ring_size = params.cq_off.cqes + (params.cq_entries * sizeof(struct io_uring_cqe));
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (uu->cq_ring_size > uu->sq_ring_size) uu->sq_ring_size = uu->cq_ring_size;
+		uu->cq_ring_size = uu->sq_ring_size;
+	}
+
+	uu->sq_ring = mmap(NULL, uu->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (uu->sq_ring == MAP_FAILED) {
+		uu->sq_ring = NULL;
+		uwsgi_error("io_uring/mmap()");
+		goto error;
+	}
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		uu->cq_ring = uu->sq_ring;
+	}
+	else {
+		uu->cq_ring = mmap(NULL, uu->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (uu->cq_ring == MAP_FAILED) {
+			uu->cq_ring = NULL;
+			uwsgi_error("io_uring/mmap()");
+			goto error;
+		}
+	}
+
+	uu->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	uu->sqes = mmap(NULL, uu->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (uu->sqes == MAP_FAILED) {
+		uu->sqes = NULL;
+		uwsgi_error("io_uring/mmap()");
+		goto error;
+	}
+
+	uu->entries = params.sq_entries;
+	uu->sq_tail = uu->sq_ring + params.sq_off.tail;
+	uu->sq_mask = uu->sq_ring + params.sq_off.ring_mask;
+	uu->sq_array = uu->sq_ring + params.sq_off.array;
+	uu->cq_head = uu->cq_ring + params.cq_off.head;
+	uu->cq_tail = uu->cq_ring + params.cq_off.tail;
+	uu->cq_mask = uu->cq_ring + params.cq_off.ring_mask;
+	uu->cqes = uu->cq_ring + params.cq_off.cqes;
+	uu->events = uwsgi_calloc(sizeof(struct epoll_event) * uu->entries);
+	pthread_mutex_init(&uu->lock, NULL);
+
+	pthread_mutex_lock(&uwsgi_io_uring_lock);
+	if (!uwsgi_io_uring_queues) {
+		uwsgi_io_uring_queues = uwsgi_calloc(sizeof(struct uwsgi_io_uring *) * uwsgi.max_fd);
+		pthread_atfork(NULL, NULL, uwsgi_io_uring_atfork);
+	}
+	uwsgi_io_uring_queues[eq] = uu;
+	if (eq > uwsgi_io_uring_max_queue) uwsgi_io_uring_max_queue = eq;
+	pthread_mutex_unlock(&uwsgi_io_uring_lock);
+	return;
+
+error:
+	uwsgi_io_uring_destroy(uu);
+}
+
+static void uwsgi_io_uring_reap(struct uwsgi_io_uring *uu) {
+	unsigned head = *uu->cq_head;
+	unsigned tail = __atomic_load_n(uu->cq_tail, __ATOMIC_ACQUIRE);
+	while(head != tail) {
+		struct io_uring_cqe *cqe = &uu->cqes[head & *uu->cq_mask];
+		// the file descriptor could have been closed (and removed by epoll) before the submission
+		if (cqe->res < 0 && cqe->res != -EBADF && cqe->res != -ENOENT) {
+			uwsgi_log("epoll_ctl() on fd %d: %s [io_uring]\n", (int) cqe->user_data, strerror(-cqe->res));
+		}
+		head++;
+	}
+	__atomic_store_n(uu->cq_head, head, __ATOMIC_RELEASE);
+}
+
+// must be called with the queue locked
+static void uwsgi_io_uring_submit(struct uwsgi_io_uring *uu) {
+	if (!uu->pending) return;
+	// the last request closes the chain
+	unsigned tail = *uu->sq_tail;
+	uu->sqes[(tail - 1) & *uu->sq_mask].flags &= ~IOSQE_IO_HARDLINK;
+	while(uu->pending) {
+		int ret = syscall(__NR_io_uring_enter, uu->fd, uu->pending, uu->pending, IORING_ENTER_GETEVENTS, NULL, 0);
+		if (ret < 0) {
+			if (errno == EINTR) continue;
+			if (errno == EAGAIN || errno == EBUSY) {
+				uwsgi_io_uring_reap(uu);
+				continue;
+			}
+			uwsgi_error("io_uring_enter()");
+			break;
+		}
+		uu->pending -= ret;
+	}
+	uwsgi_io_uring_reap(uu);
+}
+
+static int uwsgi_epoll_queue_ctl(int eq, int op, int fd, struct epoll_event *ee) {
+	struct uwsgi_io_uring *uu = uwsgi_io_uring_queues ? uwsgi_io_uring_queues[eq] : NULL;
+	if (!uu) return epoll_ctl(eq, op, fd, ee);
+
+	pthread_mutex_lock(&uu->lock);
+	if (uu->pending >= uu->entries) {
+		uwsgi_io_uring_submit(uu);
+	}
+	unsigned tail = *uu->sq_tail;
+	unsigned idx = tail & *uu->sq_mask;
+	struct io_uring_sqe *sqe = &uu->sqes[idx];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	memcpy(&uu->events[idx], ee, sizeof(struct epoll_event));
+	sqe->opcode = IORING_OP_EPOLL_CTL;
+	sqe->flags = IOSQE_IO_HARDLINK;
+	sqe->fd = eq;
+	sqe->addr = (uint64_t) (uintptr_t) &uu->events[idx];
+	sqe->len = op;
+	sqe->off = fd;
+	sqe->user_data = fd;
+	uu->sq_array[idx] = idx;
+	__atomic_store_n(uu->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	uu->pending++;
+	pthread_mutex_unlock(&uu->lock);
+	return 0;
+}
+
+static int uwsgi_epoll_has_ring(int eq) {
+	return uwsgi_io_uring_queues && uwsgi_io_uring_queues[eq];
+}
+
+static void uwsgi_epoll_submit(int eq) {
+	struct uwsgi_io_uring *uu = uwsgi_io_uring_queues ? uwsgi_io_uring_queues[eq] : NULL;
+	if (!uu || !uu->pending) return;
+	pthread_mutex_lock(&uu->lock);
+	uwsgi_io_uring_submit(uu);
+	pthread_mutex_unlock(&uu->lock);
+}
+
+#else
+#define uwsgi_epoll_queue_ctl epoll_ctl
+#define uwsgi_epoll_has_ring(x) 0
+#define uwsgi_epoll_submit(x)
+#endif
+
+/*
+	deferred interest changes
+
+	event_queue_fd_interest() only records the events wanted for a file descriptor,
+	the epoll set is updated by event_queue_flush() (automatically called before waiting)
+	so a read -> readwrite -> read flip in the same loop iteration costs no syscall at all.
+
+	A registration from 0 is always sent to the kernel (the fd could be a new one with the same number),
+	falling back from EPOLL_CTL_MOD to EPOLL_CTL_ADD (and vice versa) as needed.
+	Before closing a file descriptor the user must pass UWSGI_EVENT_QUEUE_CLOSE, the kernel
+	removes it from the epoll set by itself, so it is only forgotten.
+
+	In edge-triggered mode a file descriptor is registered once for both directions and
+	never modified again: events for disabled directions are filtered out by event_queue_wait_multi()
+	and, as their edge could be lost, enabling a direction queues a synthetic event
+	returned by the next wait (the user will get EAGAIN if it was not really ready).
+
+	Immediate operations flush the pending ones first, so the order is always honoured.
+*/
+
+#define UWSGI_EPOLL_REGISTERED	1
+#define UWSGI_EPOLL_PENDING	2
+#define UWSGI_EPOLL_FORCE	4
+#define UWSGI_EPOLL_SYNTH	8
+
+struct uwsgi_epoll_fd {
+	uint8_t mask;
+	uint8_t desired;
+	uint8_t flags;
+	uint8_t ready;
+};
+
+struct uwsgi_epoll_deferred {
+	int edge;
+	struct uwsgi_epoll_fd *fds;
+	int *pending;
+	int pending_cnt;
+	int pending_max;
+	int *synth;
+	int synth_cnt;
+};
+
+static struct uwsgi_epoll_deferred **uwsgi_epoll_deferred_queues;
+
+int event_queue_defer(int eq, int edge) {
+	if (eq < 0 || (rlim_t) eq >= uwsgi.max_fd) return -1;
+	if (!uwsgi_epoll_deferred_queues) {
+		uwsgi_epoll_deferred_queues = uwsgi_calloc(sizeof(struct uwsgi_epoll_deferred *) * uwsgi.max_fd);
+	}
+	struct uwsgi_epoll_deferred *ued = uwsgi_epoll_deferred_queues[eq];
+	if (!ued) {
+		ued = uwsgi_calloc(sizeof(struct uwsgi_epoll_deferred));
+		ued->fds = uwsgi_calloc(sizeof(struct uwsgi_epoll_fd) * uwsgi.max_fd);
+		ued->pending_max = 64;
+		ued->pending = uwsgi_malloc(sizeof(int) * ued->pending_max);
+		ued->synth = uwsgi_malloc(sizeof(int) * uwsgi.max_fd);
+		uwsgi_epoll_deferred_queues[eq] = ued;
+	}
+	ued->edge = edge;
+	return 0;
+}
+
+static int uwsgi_epoll_deferred_pending(struct uwsgi_epoll_deferred *ued, int fd) {
+	struct uwsgi_epoll_fd *uef = &ued->fds[fd];
+	if (uef->flags & UWSGI_EPOLL_PENDING) return 0;
+	if (ued->pending_cnt >= ued->pending_max) {
+		int *pending = realloc(ued->pending, sizeof(int) * ued->pending_max * 2);
+		if (!pending) {
+			uwsgi_error("event_queue_fd_interest()/realloc()");
+			return -1;
+		}
+		ued->pending = pending;
+		ued->pending_max *= 2;
+	}
+	ued->pending[ued->pending_cnt++] = fd;
+	uef->flags |= UWSGI_EPOLL_PENDING;
+	return 0;
+}
+
+int event_queue_fd_interest(int eq, int fd, int events) {
+	struct uwsgi_epoll_deferred *ued = uwsgi_epoll_deferred_queues ? uwsgi_epoll_deferred_queues[eq] : NULL;
+	if (!ued || fd < 0 || (rlim_t) fd >= uwsgi.max_fd) return -1;
+	struct uwsgi_epoll_fd *uef = &ued->fds[fd];
+
+	// pending changes and synthetic events are skipped as the fd is no more registered
+	if (events & UWSGI_EVENT_QUEUE_CLOSE) {
+		uef->mask = 0;
+		uef->desired = 0;
+		uef->ready = 0;
+		uef->flags &= ~(UWSGI_EPOLL_REGISTERED | UWSGI_EPOLL_FORCE);
+		return 0;
+	}
+
+	int rearm = events & UWSGI_EVENT_QUEUE_REARM;
+	events &= (UWSGI_EVENT_QUEUE_READ | UWSGI_EVENT_QUEUE_WRITE);
+
+	if (ued->edge && (uef->flags & UWSGI_EPOLL_REGISTERED)) {
+		int added = rearm ? events : (events & ~uef->desired);
+		uef->desired = events;
+		if (added) {
+			uef->ready |= added;
+			if (!(uef->flags & UWSGI_EPOLL_SYNTH)) {
+				ued->synth[ued->synth_cnt++] = fd;
+				uef->flags |= UWSGI_EPOLL_SYNTH;
+			}
+		}
+		return 0;
+	}
+
+	if (uwsgi_epoll_deferred_pending(ued, fd)) return -1;
+
+	if (rearm || ((events & ~uef->desired) && !uef->desired)) {
+		uef->flags |= UWSGI_EPOLL_FORCE;
+	}
+	uef->desired = events;
+	return 0;
+}
+
+static void uwsgi_epoll_deferred_ctl(int eq, int op, int fd, struct epoll_event *ee, struct uwsgi_epoll_fd *uef) {
+	if (!uwsgi_epoll_queue_ctl(eq, op, fd, ee)) return;
+	// the file descriptor has been closed (and removed by epoll)
+	if (errno == EBADF) {
+		uef->flags &= ~UWSGI_EPOLL_REGISTERED;
+		return;
+	}
+	if (op == EPOLL_CTL_DEL && errno == ENOENT) return;
+	if (op == EPOLL_CTL_MOD && errno == ENOENT) {
+		if (!uwsgi_epoll_queue_ctl(eq, EPOLL_CTL_ADD, fd, ee)) return;
+	}
+	else if (op == EPOLL_CTL_ADD && errno == EEXIST) {
+		if (!uwsgi_epoll_queue_ctl(eq, EPOLL_CTL_MOD, fd, ee)) return;
+	}
+	uwsgi_error("epoll_ctl()");
+	uef->flags &= ~UWSGI_EPOLL_REGISTERED;
+}
+
+static void uwsgi_epoll_deferred_flush(int eq) {
+	struct uwsgi_epoll_deferred *ued = uwsgi_epoll_deferred_queues ? uwsgi_epoll_deferred_queues[eq] : NULL;
+	if (!ued || !ued->pending_cnt) return;
+
+	int i;
+	for(i=0;i<ued->pending_cnt;i++) {
+		int fd = ued->pending[i];
+		struct uwsgi_epoll_fd *uef = &ued->fds[fd];
+		struct epoll_event ee;
+
+		memset(&ee, 0, sizeof(struct epoll_event));
+		ee.data.fd = fd;
+		if (ued->edge) {
+			ee.events = EPOLLIN | EPOLLOUT | EPOLLET;
+			// the kernel reports the initial readiness on registration
+			if (uef->desired && !(uef->flags & UWSGI_EPOLL_REGISTERED)) {
+				uef->flags |= UWSGI_EPOLL_REGISTERED;
+				uwsgi_epoll_deferred_ctl(eq, EPOLL_CTL_ADD, fd, &ee, uef);
+			}
+			uef->flags &= ~(UWSGI_EPOLL_PENDING | UWSGI_EPOLL_FORCE);
+			continue;
+		}
+
+		if (uef->desired & UWSGI_EVENT_QUEUE_READ) ee.events |= EPOLLIN;
+		if (uef->desired & UWSGI_EVENT_QUEUE_WRITE) ee.events |= EPOLLOUT;
+
+		if (!uef->desired) {
+			if (uef->flags & UWSGI_EPOLL_REGISTERED) {
+				uwsgi_epoll_deferred_ctl(eq, EPOLL_CTL_DEL, fd, &ee, uef);
+			}
+			uef->flags &= ~UWSGI_EPOLL_REGISTERED;
+		}
+		else if (!(uef->flags & UWSGI_EPOLL_REGISTERED)) {
+			uef->flags |= UWSGI_EPOLL_REGISTERED;
+			uwsgi_epoll_deferred_ctl(eq, EPOLL_CTL_ADD, fd, &ee, uef);
+		}
+		else if (uef->desired != uef->mask || (uef->flags & UWSGI_EPOLL_FORCE)) {
+			// io_uring errors are asynchronous, so the fd is registered from scratch
+			if ((uef->flags & UWSGI_EPOLL_FORCE) && uwsgi_epoll_has_ring(eq)) {
+				uwsgi_epoll_queue_ctl(eq, EPOLL_CTL_DEL, fd, &ee);
+				uwsgi_epoll_queue_ctl(eq, EPOLL_CTL_ADD, fd, &ee);
+			}
+			else {
+				uwsgi_epoll_deferred_ctl(eq, EPOLL_CTL_MOD, fd, &ee, uef);
+			}
+		}
+		uef->mask = uef->desired;
+		uef->flags &= ~(UWSGI_EPOLL_PENDING | UWSGI_EPOLL_FORCE);
+	}
+	ued->pending_cnt = 0;
+}
+
+static uint32_t uwsgi_epoll_deferred_events(uint8_t mask) {
+	uint32_t events = 0;
+	if (mask & UWSGI_EVENT_QUEUE_READ) events |= EPOLLIN;
+	if (mask & UWSGI_EVENT_QUEUE_WRITE) events |= EPOLLOUT;
+	return events;
+}
+
+// edge-triggered mode: drop the disabled directions and append the synthetic events
+static int uwsgi_epoll_edge_events(int eq, struct epoll_event *events, int ret, int nevents) {
+	struct uwsgi_epoll_deferred *ued = uwsgi_epoll_deferred_queues ? uwsgi_epoll_deferred_queues[eq] : NULL;
+	if (!ued || !ued->edge) return ret;
+
+	int i;
+	int cnt = 0;
+	for(i=0;i<ret;i++) {
+		int fd = events[i].data.fd;
+		if (fd >= 0 && (rlim_t) fd < uwsgi.max_fd && (ued->fds[fd].flags & UWSGI_EPOLL_REGISTERED)) {
+			struct uwsgi_epoll_fd *uef = &ued->fds[fd];
+			if (!uef->desired) continue;
+			// a synthetic event is merged with the real one
+			if (uef->flags & UWSGI_EPOLL_SYNTH) {
+				events[i].events |= uwsgi_epoll_deferred_events(uef->ready);
+			}
+			events[i].events &= uwsgi_epoll_deferred_events(uef->desired) | EPOLLERR | EPOLLHUP;
+			uef->ready = 0;
+			uef->flags &= ~UWSGI_EPOLL_SYNTH;
+			if (!events[i].events) continue;
+		}
+		events[cnt++] = events[i];
+	}
+
+	int remains = 0;
+	for(i=0;i<ued->synth_cnt;i++) {
+		int fd = ued->synth[i];
+		struct uwsgi_epoll_fd *uef = &ued->fds[fd];
+		// already merged or closed
+		if (!(uef->flags & UWSGI_EPOLL_SYNTH)) continue;
+		if (cnt >= nevents) {
+			ued->synth[remains++] = fd;
+			continue;
+		}
+		uint8_t ready = uef->ready & uef->desired;
+		uef->ready = 0;
+		uef->flags &= ~UWSGI_EPOLL_SYNTH;
+		if (!ready) continue;
+		memset(&events[cnt], 0, sizeof(struct epoll_event));
+		events[cnt].data.fd = fd;
+		events[cnt].events = uwsgi_epoll_deferred_events(ready);
+		cnt++;
+	}
+	ued->synth_cnt = remains;
+	return cnt;
+}
+
+static int uwsgi_epoll_has_synth(int eq) {
+	struct uwsgi_epoll_deferred *ued = uwsgi_epoll_deferred_queues ? uwsgi_epoll_deferred_queues[eq] : NULL;
+	return ued && ued->synth_cnt;
+}
+
+void event_queue_flush(int eq) {
+	uwsgi_epoll_deferred_flush(eq);
+	uwsgi_epoll_submit(eq);
+}
+
+static int uwsgi_epoll_ctl(int eq, int op, int fd, struct epoll_event *ee) {
+	uwsgi_epoll_deferred_flush(eq);
+	return uwsgi_epoll_queue_ctl(eq, op, fd, ee);
+}
+
 int event_queue_init() {
 
 	int epfd;
@@ -505,6 +998,10 @@ int event_queue_init() {
 		return -1;
 	}
 
+#ifdef UWSGI_EVENT_USE_IO_URING
+	uwsgi_io_uring_init(epfd);
+#endif
+
 	return epfd;
 }
 
@@ -517,7 +1014,7 @@ int event_queue_add_fd_read(int eq, int fd) {
 	ee.events = EPOLLIN;
 	ee.data.fd = fd;
 
-	if (epoll_ctl(eq, EPOLL_CTL_ADD, fd, &ee)) {
+	if (uwsgi_epoll_ctl(eq, EPOLL_CTL_ADD, fd, &ee)) {
 		uwsgi_error("epoll_ctl()");
 		return -1;
 	}
@@ -533,7 +1030,7 @@ int event_queue_fd_write_to_read(int eq, int fd) {
 	ee.events = EPOLLIN;
 	ee.data.fd = fd;
 
-	if (epoll_ctl(eq, EPOLL_CTL_MOD, fd, &ee)) {
+	if (uwsgi_epoll_ctl(eq, EPOLL_CTL_MOD, fd, &ee)) {
 		uwsgi_error("epoll_ctl()");
 		return -1;
 	}
@@ -549,7 +1046,7 @@ int event_queue_fd_read_to_write(int eq, int fd) {
 	ee.events = EPOLLOUT;
 	ee.data.fd = fd;
 
-	if (epoll_ctl(eq, EPOLL_CTL_MOD, fd, &ee)) {
+	if (uwsgi_epoll_ctl(eq, EPOLL_CTL_MOD, fd, &ee)) {
 		uwsgi_error("epoll_ctl()");
 		return -1;
 	}
@@ -565,7 +1062,7 @@ int event_queue_fd_readwrite_to_read(int eq, int fd) {
 	ee.events = EPOLLIN;
 	ee.data.fd = fd;
 
-	if (epoll_ctl(eq, EPOLL_CTL_MOD, fd, &ee)) {
+	if (uwsgi_epoll_ctl(eq, EPOLL_CTL_MOD, fd, &ee)) {
 		uwsgi_error("epoll_ctl()");
 		return -1;
 	}
@@ -581,7 +1078,7 @@ int event_queue_fd_readwrite_to_write(int eq, int fd) {
 	ee.events = EPOLLOUT;
 	ee.data.fd = fd;
 
-	if (epoll_ctl(eq, EPOLL_CTL_MOD, fd, &ee)) {
+	if (uwsgi_epoll_ctl(eq, EPOLL_CTL_MOD, fd, &ee)) {
 		uwsgi_error("epoll_ctl()");
 		return -1;
 	}
@@ -598,7 +1095,7 @@ int event_queue_fd_read_to_readwrite(int eq, int fd) {
 	ee.events = EPOLLIN | EPOLLOUT;
 	ee.data.fd = fd;
 
-	if (epoll_ctl(eq, EPOLL_CTL_MOD, fd, &ee)) {
+	if (uwsgi_epoll_ctl(eq, EPOLL_CTL_MOD, fd, &ee)) {
 		uwsgi_error("epoll_ctl()");
 		return -1;
 	}
@@ -614,7 +1111,7 @@ int event_queue_fd_write_to_readwrite(int eq, int fd) {
 	ee.events = EPOLLIN | EPOLLOUT;
 	ee.data.fd = fd;
 
-	if (epoll_ctl(eq, EPOLL_CTL_MOD, fd, &ee)) {
+	if (uwsgi_epoll_ctl(eq, EPOLL_CTL_MOD, fd, &ee)) {
 		uwsgi_error("epoll_ctl()");
 		return -1;
 	}
@@ -632,7 +1129,7 @@ int event_queue_del_fd(int eq, int fd, int event) {
 	ee.data.fd = fd;
 	ee.events = event;
 
-	if (epoll_ctl(eq, EPOLL_CTL_DEL, fd, &ee)) {
+	if (uwsgi_epoll_ctl(eq, EPOLL_CTL_DEL, fd, &ee)) {
 		uwsgi_error("epoll_ctl()");
 		return -1;
 	}
@@ -648,7 +1145,7 @@ int event_queue_add_fd_write(int eq, int fd) {
 	ee.events = EPOLLOUT;
 	ee.data.fd = fd;
 
-	if (epoll_ctl(eq, EPOLL_CTL_ADD, fd, &ee)) {
+	if (uwsgi_epoll_ctl(eq, EPOLL_CTL_ADD, fd, &ee)) {
 		uwsgi_error("epoll_ctl()");
 		return -1;
 	}
@@ -699,24 +1196,27 @@ int event_queue_wait_multi(int eq, int timeout, void *events, int nevents) {
 		timeout = timeout * 1000;
 	}
 
+	event_queue_flush(eq);
+	// synthetic events are ready
+	if (uwsgi_epoll_has_synth(eq)) timeout = 0;
 	ret = epoll_wait(eq, (struct epoll_event *) events, nevents, timeout);
 	if (ret < 0) {
 		if (errno != EINTR)
 			uwsgi_error("epoll_wait()");
+		return ret;
 	}
 
+	ret = uwsgi_epoll_edge_events(eq, (struct epoll_event *) events, ret, nevents);
+
 	return ret;
 }
 
-int event_queue_wait(int eq, int timeout, int *interesting_fd) {
+int event_queue_wait_ms(int eq, int timeout, int *interesting_fd) {
 
 	int ret;
 	struct epoll_event ee;
 
-	if (timeout > 0) {
-		timeout = timeout * 1000;
-	}
-
+	event_queue_flush(eq);
 	ret = epoll_wait(eq, &ee, 1, timeout);
 	if (ret < 0) {
 		if (errno != EINTR)
@@ -942,7 +1442,7 @@ int event_queue_interesting_fd_is_write(void *events, int id) {
 	return 0;
 }
 
-int event_queue_wait(int eq, int timeout, int *interesting_fd) {
+int event_queue_wait_ms(int eq, int timeout, int *interesting_fd) {
 
 	int ret;
 	struct timespec ts;
@@ -953,7 +1453,8 @@ int event_queue_wait(int eq, int timeout, int *interesting_fd) {
 	}
 	else {
 		memset(&ts, 0, sizeof(struct timespec));
-		ts.tv_sec = timeout;
+		ts.tv_sec = timeout / 1000;
+		ts.tv_nsec = (timeout % 1000) * 1000000;
 		ret = kevent(eq, NULL, 0, &ev, 1, &ts);
 	}
 
@@ -971,6 +1472,25 @@ int event_queue_wait(int eq, int timeout, int *interesting_fd) {
 }
 #endif
 
+// timeout in seconds
+int event_queue_wait(int eq, int timeout, int *interesting_fd) {
+	return event_queue_wait_ms(eq, timeout > 0 ? timeout * 1000 : timeout, interesting_fd);
+}
+
+#if !defined(UWSGI_EVENT_USE_EPOLL) && !defined(UWSGI_EVENT_USE_IO_URING)
+// deferred interest changes are only supported by epoll
+int event_queue_defer(int eq, int edge) {
+	return -1;
+}
+
+int event_queue_fd_interest(int eq, int fd, int events) {
+	return -1;
+}
+
+void event_queue_flush(int eq) {
+}
+#endif
+
 #ifdef UWSGI_EVENT_FILEMONITOR_USE_NONE
 int event_queue_add_file_monitor(int eq, char *filename, int *id) {
 	return -1;
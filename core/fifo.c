@@ -85,6 +85,9 @@ void uwsgi_master_fifo_prepare() {
 	uwsgi_fifo_table['C'] = uwsgi_go_cheap;
 	uwsgi_fifo_table['E'] = emperor_rescan;
 	uwsgi_fifo_table['f'] = uwsgi_refork_master;
+#ifdef UWSGI_SSL
+	uwsgi_fifo_table['K'] = uwsgi_ssl_sni_reload;
+#endif
 	uwsgi_fifo_table['l'] = uwsgi_log_reopen;
 	uwsgi_fifo_table['L'] = uwsgi_log_rotate;
 	uwsgi_fifo_table['p'] = suspend_resume_them_all;
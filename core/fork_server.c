@@ -16,6 +16,7 @@ from now on, we can consider the new child as a full-featured vassal
 
 #define VASSAL_HAS_CONFIG 0x02
 #define VASSAL_HAS_ON_DEMAND 0x04
+#define VASSAL_HAS_CWD 0x08
 
 static void parse_argv_hook(uint16_t item, char *value, uint16_t vlen, void *data) {
 	struct uwsgi_string_list **usl = (struct uwsgi_string_list **) data;
@@ -188,6 +189,20 @@ void uwsgi_fork_server(char *socket) {
 				uwsgi_hooked_parse_array(body_argv, uh->_pktsize, parse_argv_hook, &usl_argv);
 				free(body_argv);
 
+				// the first item is the working directory of the Emperor
+				if (uh->modifier2 & VASSAL_HAS_CWD && usl_argv) {
+					usl = usl_argv;
+					usl_argv = usl_argv->next;
+					if (chdir(usl->value)) {
+						uwsgi_error("uwsgi_fork_server()/chdir()");
+						exit(1);
+					}
+					free(usl->value);
+					free(usl);
+					usl = NULL;
+					uwsgi.cwd = uwsgi_get_cwd();
+				}
+
 				// build new argc/argv
 				uwsgi.new_argc = 0;
 				size_t procname_len = 1;
@@ -180,3 +180,230 @@ int uwsgi_fsmon_event(int interesting_fd) {
 	fs->func(fs);
 	return 1;
 }
+
+/*
+	directory watches for subsystems running their own event loop (like the Emperor monitors)
+
+	*fd is the descriptor to monitor (created and added to the queue on the first call),
+	the return value identifies the directory in the events
+*/
+int uwsgi_fsmon_watch_dir(int queue, int *fd, char *path) {
+#ifdef UWSGI_EVENT_FILEMONITOR_USE_INOTIFY
+#ifndef OBSOLETE_LINUX_KERNEL
+	if (*fd == -1) {
+		*fd = inotify_init();
+		if (*fd < 0) {
+			uwsgi_error("uwsgi_fsmon_watch_dir()/inotify_init()");
+			return -1;
+		}
+		uwsgi_socket_nb(*fd);
+		if (event_queue_add_fd_read(queue, *fd)) {
+			uwsgi_error("uwsgi_fsmon_watch_dir()/event_queue_add_fd_read()");
+			close(*fd);
+			*fd = -1;
+			return -1;
+		}
+	}
+	int wd = inotify_add_watch(*fd, path, IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+	if (wd < 0) {
+		uwsgi_error("uwsgi_fsmon_watch_dir()/inotify_add_watch()");
+		return -1;
+	}
+	return wd;
+#endif
+#endif
+#ifdef UWSGI_EVENT_FILEMONITOR_USE_KQUEUE
+	// a single directory per descriptor
+	if (*fd != -1) return -1;
+	struct kevent kev;
+	int dfd = open(path, O_RDONLY);
+	if (dfd < 0) {
+		uwsgi_error_open(path);
+		return -1;
+	}
+	EV_SET(&kev, dfd, EVFILT_VNODE, EV_ADD | EV_CLEAR, NOTE_WRITE | NOTE_DELETE | NOTE_EXTEND | NOTE_ATTRIB | NOTE_RENAME | NOTE_REVOKE, 0, 0);
+	if (kevent(queue, &kev, 1, NULL, 0, NULL) < 0) {
+		uwsgi_error("uwsgi_fsmon_watch_dir()/kevent()");
+		close(dfd);
+		return -1;
+	}
+	*fd = dfd;
+	return dfd;
+#endif
+	return -1;
+}
+
+/*
+	consume the events of a directory watch, func receives the directory id and the name of the changed entry
+	(NULL when only a full rescan can tell what changed, like queue overflows or kqueue events)
+*/
+int uwsgi_fsmon_dir_events(int fd, void (*func) (int, char *, void *), void *data) {
+#ifdef UWSGI_EVENT_FILEMONITOR_USE_INOTIFY
+#ifndef OBSOLETE_LINUX_KERNEL
+	char buf[8192] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	for (;;) {
+		ssize_t len = read(fd, buf, sizeof(buf));
+		if (len < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+			uwsgi_error("uwsgi_fsmon_dir_events()/read()");
+			return -1;
+		}
+		if (len == 0) return 0;
+		char *ptr = buf;
+		while (ptr < buf + len) {
+			struct inotify_event *ie = (struct inotify_event *) ptr;
+			func(ie->wd, ie->len > 0 && !(ie->mask & IN_Q_OVERFLOW) ? ie->name : NULL, data);
+			ptr += sizeof(struct inotify_event) + ie->len;
+		}
+	}
+#endif
+#endif
+#ifdef UWSGI_EVENT_FILEMONITOR_USE_KQUEUE
+	func(fd, NULL, data);
+	return 0;
+#endif
+	return -1;
+}
+
+/*
+	touch-* files
+
+	with inotify the directory of every file is watched (so we can see it being created or replaced),
+	with kqueue the file itself. uwsgi_check_touches() stat()s only the files with a pending event,
+	files we cannot monitor are stat()ed every cycle as before.
+	Events without a name (queue overflows, removed directories, kqueue) mark all of the files
+	of the watch as pending and re-create it.
+*/
+struct uwsgi_fsmon_touch {
+	struct uwsgi_string_list *touch;
+	char *dir;
+	char *name;
+	// inotify watch descriptor or kqueue file descriptor, -1 means polling
+	int id;
+	int pending;
+	struct uwsgi_fsmon_touch *next;
+};
+
+static struct uwsgi_fsmon_touch *fsmon_touches;
+static int fsmon_touches_fd = -1;
+
+static int fsmon_touch_watch(struct uwsgi_fsmon_touch *ft) {
+#ifdef UWSGI_EVENT_FILEMONITOR_USE_INOTIFY
+#ifndef OBSOLETE_LINUX_KERNEL
+	return uwsgi_fsmon_watch_dir(uwsgi.master_queue, &fsmon_touches_fd, ft->dir);
+#endif
+#endif
+#ifdef UWSGI_EVENT_FILEMONITOR_USE_KQUEUE
+	struct kevent kev;
+	int fd = open(ft->touch->value, O_RDONLY);
+	if (fd < 0) return -1;
+	EV_SET(&kev, fd, EVFILT_VNODE, EV_ADD | EV_CLEAR, NOTE_WRITE | NOTE_DELETE | NOTE_EXTEND | NOTE_ATTRIB | NOTE_RENAME | NOTE_REVOKE, 0, 0);
+	if (kevent(uwsgi.master_queue, &kev, 1, NULL, 0, NULL) < 0) {
+		uwsgi_error("fsmon_touch_watch()/kevent()");
+		close(fd);
+		return -1;
+	}
+	return fd;
+#endif
+	return -1;
+}
+
+void uwsgi_fsmon_touches_add(struct uwsgi_string_list *list) {
+	if (uwsgi.touch_polling) return;
+	struct uwsgi_string_list *usl;
+	uwsgi_foreach(usl, list) {
+		struct uwsgi_fsmon_touch *ft = uwsgi_calloc(sizeof(struct uwsgi_fsmon_touch));
+		ft->touch = usl;
+		char *slash = strrchr(usl->value, '/');
+		if (slash) {
+			ft->dir = slash == usl->value ? uwsgi_str("/") : uwsgi_concat2n(usl->value, slash - usl->value, "", 0);
+			ft->name = slash + 1;
+		}
+		else {
+			ft->dir = uwsgi_str(".");
+			ft->name = usl->value;
+		}
+		ft->id = fsmon_touch_watch(ft);
+		if (ft->id < 0) {
+			uwsgi_log("[uwsgi-fsmon] unable to monitor \"%s\", it will be polled\n", usl->value);
+		}
+		ft->next = fsmon_touches;
+		fsmon_touches = ft;
+	}
+}
+
+static void fsmon_touch_rewatch(int id) {
+	struct uwsgi_fsmon_touch *ft;
+	int new_id = -2;
+	for (ft = fsmon_touches; ft; ft = ft->next) {
+		if (ft->id != id) continue;
+		ft->pending = 1;
+#ifdef UWSGI_EVENT_FILEMONITOR_USE_KQUEUE
+		// closing the descriptor removes the old event too
+		close(ft->id);
+		new_id = fsmon_touch_watch(ft);
+#else
+		// all of the files of a directory share the watch
+		if (new_id == -2) new_id = fsmon_touch_watch(ft);
+#endif
+		ft->id = new_id;
+		if (ft->id < 0) {
+			uwsgi_log("[uwsgi-fsmon] unable to monitor \"%s\", it will be polled\n", ft->touch->value);
+		}
+	}
+}
+
+static void fsmon_touch_dir_event(int id, char *name, void *data) {
+	struct uwsgi_fsmon_touch *ft;
+	// queue overflow, we do not know what changed
+	if (id < 0) {
+		for (ft = fsmon_touches; ft; ft = ft->next) ft->pending = 1;
+		return;
+	}
+	if (!name) {
+		fsmon_touch_rewatch(id);
+		return;
+	}
+	for (ft = fsmon_touches; ft; ft = ft->next) {
+		if (ft->id == id && !strcmp(ft->name, name)) {
+			ft->pending = 1;
+		}
+	}
+}
+
+// returns 1 if the descriptor belongs to the touch-* monitors
+int uwsgi_fsmon_touch_event(int fd) {
+	if (!fsmon_touches) return 0;
+#ifdef UWSGI_EVENT_FILEMONITOR_USE_INOTIFY
+#ifndef OBSOLETE_LINUX_KERNEL
+	if (fd != fsmon_touches_fd) return 0;
+	uwsgi_fsmon_dir_events(fd, fsmon_touch_dir_event, NULL);
+	return 1;
+#endif
+#endif
+#ifdef UWSGI_EVENT_FILEMONITOR_USE_KQUEUE
+	struct uwsgi_fsmon_touch *ft;
+	for (ft = fsmon_touches; ft; ft = ft->next) {
+		if (ft->id == fd) {
+			fsmon_touch_rewatch(fd);
+			return 1;
+		}
+	}
+#endif
+	return 0;
+}
+
+// returns 1 if the touch file is monitored and nothing happened to it
+int uwsgi_fsmon_touch_skip(struct uwsgi_string_list *touch) {
+	struct uwsgi_fsmon_touch *ft;
+	for (ft = fsmon_touches; ft; ft = ft->next) {
+		if (ft->touch != touch) continue;
+		if (ft->id < 0) return 0;
+		if (ft->pending) {
+			ft->pending = 0;
+			return 0;
+		}
+		return 1;
+	}
+	return 0;
+}
@@ -15,6 +15,17 @@ uint32_t djb33x_hash(char *key, uint64_t keylen) {
         return hash;
 }
 
+// jump consistent hash (Lamping, Veach), maps a key to a bucket moving only 1/n of the keys on resize
+uint32_t uwsgi_jump_hash(uint64_t key, uint32_t buckets) {
+	int64_t b = -1, j = 0;
+	while (j < (int64_t) buckets) {
+		b = j;
+		key = key * 2862933555777941757ULL + 1;
+		j = (int64_t) ((double) (b + 1) * ((double) (1LL << 31) / (double) ((key >> 33) + 1)));
+	}
+	return (uint32_t) b;
+}
+
 // Murmur2 hash Copyright (C) Austin Appleby
 // adapted from nginx
 static uint32_t murmur2_hash(char *key, uint64_t keylen) {
@@ -56,6 +67,165 @@ static uint32_t murmur2_hash(char *key, uint64_t keylen) {
 	return h;
 }
 
+/*
+	64bit hashes
+
+	wyhash (final version, Wang Yi, public domain) and XXH64 (Yann Collet, BSD), both are much
+	faster than the byte-at-time ones on long keys (they consume 8 bytes per step) and have
+	a far better distribution. The 32bit versions (for the classic api) fold the two halves.
+*/
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define hash_read64(p) ({ uint64_t v; memcpy(&v, p, 8); __builtin_bswap64(v); })
+#define hash_read32(p) ({ uint32_t v; memcpy(&v, p, 4); (uint64_t) __builtin_bswap32(v); })
+#else
+#define hash_read64(p) ({ uint64_t v; memcpy(&v, p, 8); v; })
+#define hash_read32(p) ({ uint32_t v; memcpy(&v, p, 4); (uint64_t) v; })
+#endif
+
+#define hash_rotl64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static inline void wyhash_mum(uint64_t *a, uint64_t *b) {
+#ifdef __SIZEOF_INT128__
+	__uint128_t r = *a;
+	r *= *b;
+	*a = (uint64_t) r;
+	*b = (uint64_t) (r >> 64);
+#else
+	uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t) *a, lb = (uint32_t) *b;
+	uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb, t = rl + (rm0 << 32), c = t < rl;
+	uint64_t lo = t + (rm1 << 32);
+	c += lo < t;
+	*a = lo;
+	*b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t wyhash_mix(uint64_t a, uint64_t b) {
+	wyhash_mum(&a, &b);
+	return a ^ b;
+}
+
+static const uint64_t wyhash_secret[4] = {0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL, 0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL};
+
+static uint64_t wyhash64(char *key, uint64_t keylen) {
+	const uint8_t *p = (const uint8_t *) key;
+	const uint64_t *secret = wyhash_secret;
+	uint64_t seed = wyhash_mix(secret[0], secret[1]);
+	uint64_t a, b;
+	if (keylen <= 16) {
+		if (keylen >= 4) {
+			a = (hash_read32(p) << 32) | hash_read32(p + ((keylen >> 3) << 2));
+			b = (hash_read32(p + keylen - 4) << 32) | hash_read32(p + keylen - 4 - ((keylen >> 3) << 2));
+		}
+		else if (keylen > 0) {
+			a = (((uint64_t) p[0]) << 16) | (((uint64_t) p[keylen >> 1]) << 8) | p[keylen - 1];
+			b = 0;
+		}
+		else {
+			a = b = 0;
+		}
+	}
+	else {
+		uint64_t i = keylen;
+		if (i >= 48) {
+			uint64_t see1 = seed, see2 = seed;
+			do {
+				seed = wyhash_mix(hash_read64(p) ^ secret[1], hash_read64(p + 8) ^ seed);
+				see1 = wyhash_mix(hash_read64(p + 16) ^ secret[2], hash_read64(p + 24) ^ see1);
+				see2 = wyhash_mix(hash_read64(p + 32) ^ secret[3], hash_read64(p + 40) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i >= 48);
+			seed ^= see1 ^ see2;
+		}
+		while (i > 16) {
+			seed = wyhash_mix(hash_read64(p) ^ secret[1], hash_read64(p + 8) ^ seed);
+			i -= 16;
+			p += 16;
+		}
+		a = hash_read64(p + i - 16);
+		b = hash_read64(p + i - 8);
+	}
+	a ^= secret[1];
+	b ^= seed;
+	wyhash_mum(&a, &b);
+	return wyhash_mix(a ^ secret[0] ^ keylen, b ^ secret[1]);
+}
+
+static uint32_t wyhash_hash(char *key, uint64_t keylen) {
+	uint64_t h = wyhash64(key, keylen);
+	return (uint32_t) (h ^ (h >> 32));
+}
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+	acc += input * XXH_PRIME64_2;
+	acc = hash_rotl64(acc, 31);
+	return acc * XXH_PRIME64_1;
+}
+
+static inline uint64_t xxh64_merge(uint64_t acc, uint64_t val) {
+	acc ^= xxh64_round(0, val);
+	return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+static uint64_t xxh64(char *key, uint64_t keylen) {
+	const uint8_t *p = (const uint8_t *) key;
+	const uint8_t *end = p + keylen;
+	uint64_t h;
+	if (keylen >= 32) {
+		uint64_t v1 = XXH_PRIME64_1 + XXH_PRIME64_2, v2 = XXH_PRIME64_2, v3 = 0, v4 = -XXH_PRIME64_1;
+		do {
+			v1 = xxh64_round(v1, hash_read64(p));
+			v2 = xxh64_round(v2, hash_read64(p + 8));
+			v3 = xxh64_round(v3, hash_read64(p + 16));
+			v4 = xxh64_round(v4, hash_read64(p + 24));
+			p += 32;
+		} while (p + 32 <= end);
+		h = hash_rotl64(v1, 1) + hash_rotl64(v2, 7) + hash_rotl64(v3, 12) + hash_rotl64(v4, 18);
+		h = xxh64_merge(h, v1);
+		h = xxh64_merge(h, v2);
+		h = xxh64_merge(h, v3);
+		h = xxh64_merge(h, v4);
+	}
+	else {
+		h = XXH_PRIME64_5;
+	}
+	h += keylen;
+	while (p + 8 <= end) {
+		h ^= xxh64_round(0, hash_read64(p));
+		h = hash_rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+		p += 8;
+	}
+	if (p + 4 <= end) {
+		h ^= hash_read32(p) * XXH_PRIME64_1;
+		h = hash_rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+		p += 4;
+	}
+	while (p < end) {
+		h ^= (*p) * XXH_PRIME64_5;
+		h = hash_rotl64(h, 11) * XXH_PRIME64_1;
+		p++;
+	}
+	h ^= h >> 33;
+	h *= XXH_PRIME64_2;
+	h ^= h >> 29;
+	h *= XXH_PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+static uint32_t xxh64_hash(char *key, uint64_t keylen) {
+	uint64_t h = xxh64(key, keylen);
+	return (uint32_t) (h ^ (h >> 32));
+}
+
 static uint32_t random_hash(char *key, uint64_t keylen) {
 	return (uint32_t) rand();
 }
@@ -85,6 +255,11 @@ struct uwsgi_hash_algo *uwsgi_hash_algo_get(char *name) {
 	return NULL;
 }
 void uwsgi_hash_algo_register(char *name, uint32_t (*func)(char *, uint64_t)) {
+	uwsgi_hash_algo_register64(name, func, NULL);
+}
+
+// func64 is optional, users of the 64bit api get the 32bit value otherwise
+void uwsgi_hash_algo_register64(char *name, uint32_t (*func)(char *, uint64_t), uint64_t (*func64)(char *, uint64_t)) {
 
 	struct uwsgi_hash_algo *old_uha = NULL, *uha = uwsgi.hash_algos;
 	while(uha) {
@@ -96,6 +271,7 @@ void uwsgi_hash_algo_register(char *name, uint32_t (*func)(char *, uint64_t)) {
 	uha = uwsgi_calloc(sizeof(struct uwsgi_hash_algo));
 	uha->name = name;
 	uha->func = func;
+	uha->func64 = func64;
 	if (old_uha) {
 		old_uha->next = uha;
 	}
@@ -110,4 +286,6 @@ void uwsgi_hash_algo_register_all() {
 	uwsgi_hash_algo_register("random", random_hash);
 	uwsgi_hash_algo_register("rand", random_hash);
 	uwsgi_hash_algo_register("rr", rr_hash);
+	uwsgi_hash_algo_register64("wyhash", wyhash_hash, wyhash64);
+	uwsgi_hash_algo_register64("xxh64", xxh64_hash, xxh64);
 }
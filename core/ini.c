@@ -173,6 +173,20 @@ void uwsgi_ini_config(char *file, char *magic_table[]) {
 
 }
 
+// a cached ini file still has to be the target of later ":section" references
+void uwsgi_ini_set_last_file(char *file) {
+	char *colon = uwsgi_get_last_char(file, ':');
+	if (last_file) {
+		free(last_file);
+	}
+	if (colon) {
+		last_file = uwsgi_concat2n(file, colon - file, "", 0);
+	}
+	else {
+		last_file = uwsgi_str(file);
+	}
+}
+
 void uwsgi_emperor_ini_attrs(char *filename, char *section_asked, struct uwsgi_dyn_dict **attrs) {
 	if (!section_asked) section_asked = "emperor";
 
@@ -71,8 +71,10 @@ void uwsgi_init_default() {
 	uwsgi.signal_socket = -1;
 	uwsgi.my_signal_socket = -1;
 	uwsgi.stats_fd = -1;
+	uwsgi.stats_binary_fd = -1;
 
 	uwsgi.stats_pusher_default_freq = 3;
+	uwsgi.stats_pusher_mtu = 1400;
 
 	uwsgi.original_log_fd = 2;
 
@@ -83,6 +85,7 @@ void uwsgi_init_default() {
 	uwsgi.emperor_throttle = 1000;
 	uwsgi.emperor_heartbeat = 30;
 	uwsgi.emperor_curse_tolerance = 30;
+	uwsgi.emperor_spawn_timeout = 30;
 	// max 3 minutes throttling
 	uwsgi.emperor_max_throttle = 1000 * 180;
 	uwsgi.emperor_pid = -1;
@@ -95,6 +98,8 @@ void uwsgi_init_default() {
 
 	// default max number of rpc slot
 	uwsgi.rpc_max = 64;
+	uwsgi.rpc_pool_idle = 30;
+	uwsgi.rpc_session_timeout = 60;
 
 	uwsgi.offload_threads_events = 64;
 
@@ -108,10 +113,15 @@ void uwsgi_init_default() {
 
 	uwsgi.async = 0;
 	uwsgi.async_warn_if_queue_full = 1;
+	uwsgi.req_arena_size = 16 * 1024;
 	uwsgi.listen_queue = 100;
 
 	uwsgi.cheaper_overload = 3;
 	uwsgi.cheaper_idle = 10;
+	uwsgi.cheaper_sample_ms = 100;
+	uwsgi.cheaper_predict_horizon = 500;
+
+	uwsgi.static_fd_cache_ttl = 5;
 
 	uwsgi.log_master_bufsize = 8192;
 
@@ -122,6 +132,12 @@ void uwsgi_init_default() {
 	uwsgi.vec_size = 4 + 1 + (4 * MAX_VARS);
 
 	uwsgi.socket_timeout = 4;
+
+#ifdef UWSGI_PCRE
+	// jit is enabled by default (when available)
+	uwsgi_opt_pcre_jit(NULL, NULL, NULL);
+	uwsgi.pcre_jit_stack_size = 512 * 1024;
+#endif
 	uwsgi.logging_options.enabled = 1;
 
 	// a workers hould be running for at least 10 seconds
@@ -129,6 +145,9 @@ void uwsgi_init_default() {
 
 	uwsgi.spooler_frequency = 30;
 
+	uwsgi.mule_ring_heap = -1;
+	uwsgi.mule_ring_ref_size = 4096;
+
 	uwsgi.shared->spooler_signal_pipe[0] = -1;
 	uwsgi.shared->spooler_signal_pipe[1] = -1;
 
@@ -138,6 +157,9 @@ void uwsgi_init_default() {
 	uwsgi.shared->mule_queue_pipe[0] = -1;
 	uwsgi.shared->mule_queue_pipe[1] = -1;
 
+	uwsgi.shared->harakiri_pipe[0] = -1;
+	uwsgi.shared->harakiri_pipe[1] = -1;
+
 	uwsgi.shared->worker_log_pipe[0] = -1;
 	uwsgi.shared->worker_log_pipe[1] = -1;
 
@@ -170,6 +192,10 @@ void uwsgi_init_default() {
 
 #ifdef __linux__
 	uwsgi.cgroup_dir_mode = "0700";
+
+	uwsgi.memory_pressure_high = 90;
+	uwsgi.memory_pressure_psi = 10;
+	uwsgi.memory_pressure_cooldown = 5;
 #endif
 
 	uwsgi.wait_read_hook = uwsgi_simple_wait_read_hook;
@@ -268,9 +294,31 @@ void uwsgi_commandline_config() {
 
 
 	char *optname;
-	while ((i = getopt_long(argc, argv, uwsgi.short_options, uwsgi.long_options, &uwsgi.option_index)) != -1) {
+	for (;;) {
+		// unknown options could be exposed by a deferred plugin, report them by ourselves
+		opterr = uwsgi.lazy_plugins_list ? 0 : 1;
+		i = getopt_long(argc, argv, uwsgi.short_options, uwsgi.long_options, &uwsgi.option_index);
+		if (i == -1)
+			break;
 
 		if (i == '?') {
+			if (!opterr && optind > 0) {
+				char *arg = argv[optind - 1];
+				if (!uwsgi_startswith(arg, "--", 2)) {
+					char *name = uwsgi_str(arg + 2);
+					char *equal = strchr(name, '=');
+					if (equal)
+						*equal = 0;
+					int found = uwsgi_lazy_plugin_option(name);
+					free(name);
+					if (found) {
+						// parse it again with the new options table
+						optind--;
+						continue;
+					}
+				}
+				uwsgi_log("%s: unrecognized option '%s'\n", argv[0], arg);
+			}
 			uwsgi_log("getopt_long() error\n");
 			exit(1);
 		}
@@ -329,9 +377,18 @@ void uwsgi_commandline_config() {
 void uwsgi_setup_workers() {
 	int i, j;
 	// allocate shared memory for workers + master
-	uwsgi.workers = (struct uwsgi_worker *) uwsgi_calloc_shared(sizeof(struct uwsgi_worker) * (uwsgi.numproc + 1));
+	size_t workers_size = sizeof(struct uwsgi_worker) * (uwsgi.numproc + 1);
+	uwsgi.workers = (struct uwsgi_worker *) uwsgi_mmap_shared(workers_size, &uwsgi.workers_page_size);
+	if ((void *) uwsgi.workers == MAP_FAILED) {
+		uwsgi_error("uwsgi_setup_workers()/mmap()");
+		exit(1);
+	}
+	memset(uwsgi.workers, 0, workers_size);
 
 	for (i = 0; i <= uwsgi.numproc; i++) {
+		// place the areas of the worker on its NUMA node (if required)
+		uwsgi_numa_alloc_for_worker(i);
+
 		// allocate memory for apps
 		uwsgi.workers[i].apps = (struct uwsgi_app *) uwsgi_calloc_shared(sizeof(struct uwsgi_app) * uwsgi.max_apps);
 
@@ -357,6 +414,16 @@ void uwsgi_setup_workers() {
 			uwsgi.workers[i].cores[j].hvec = hvec + ((sizeof(struct iovec) * uwsgi.vec_size) * j);
 			if (post_buf)
 				uwsgi.workers[i].cores[j].post_buf = post_buf + (uwsgi.post_buffering_bufsize * j);
+			// request log ring (only the workers log requests)
+			if (i > 0 && uwsgi.req_log_ring)
+				uwsgi.workers[i].cores[j].req_log_ring = uwsgi_calloc_shared(sizeof(struct uwsgi_log_ring) + uwsgi.req_log_ring);
+			// core signal pipes are created only with --core-signals
+			uwsgi.workers[i].cores[j].signal_pipe[0] = -1;
+			uwsgi.workers[i].cores[j].signal_pipe[1] = -1;
+		}
+
+		if (uwsgi.offload_threads > 0) {
+			uwsgi.workers[i].offload_stats = uwsgi_calloc_shared(sizeof(struct uwsgi_offload_thread_stats) * uwsgi.offload_threads);
 		}
 
 		// master does not need to following steps...
@@ -366,6 +433,7 @@ void uwsgi_setup_workers() {
 		uwsgi.workers[i].signal_pipe[1] = -1;
 		snprintf(uwsgi.workers[i].name, 0xff, "uWSGI worker %d", i);
 	}
+	uwsgi_numa_alloc_for_worker(0);
 
 	uint64_t total_memory = (sizeof(struct uwsgi_app) * uwsgi.max_apps) + (sizeof(struct uwsgi_core) * uwsgi.cores) + (sizeof(void *) * uwsgi.max_apps * uwsgi.cores) + (uwsgi.buffer_size * uwsgi.cores) + (sizeof(struct iovec) * uwsgi.vec_size * uwsgi.cores);
 	if (uwsgi.post_buffering > 0) {
@@ -379,6 +447,15 @@ void uwsgi_setup_workers() {
 	// allocate signal table
         uwsgi.shared->signal_table = uwsgi_calloc_shared(sizeof(struct uwsgi_signal_entry) * 256 * (uwsgi.numproc + 1));
 
+	// process-local, the memory is allocated by the workers on the first usage
+	uwsgi.req_arenas = uwsgi_calloc(sizeof(struct uwsgi_req_arena) * uwsgi.cores);
+
+	// at least twice the number of vars, so probing always ends on a free slot
+	int vars_index_size = 1;
+	while (vars_index_size < uwsgi.vec_size) vars_index_size <<= 1;
+	uwsgi.vars_index_mask = vars_index_size - 1;
+	uwsgi.vars_index = uwsgi_calloc(sizeof(uint16_t) * vars_index_size * uwsgi.cores);
+
 #ifdef UWSGI_ROUTING
 	uwsgi_fixup_routes(uwsgi.routes);
 	uwsgi_fixup_routes(uwsgi.error_routes);
@@ -425,11 +502,28 @@ void sanitize_args() {
                 uwsgi.cores = uwsgi.async;
         }
 
+	if (uwsgi.async_threads > 1) {
+		if (uwsgi.async < uwsgi.async_threads) {
+			uwsgi_log("--async-threads requires at least one async core for each thread\n");
+			exit(1);
+		}
+		if (uwsgi.threads > 1) {
+			uwsgi_log("--async-threads and --threads are mutually exclusive\n");
+			exit(1);
+		}
+		uwsgi.has_threads = 1;
+	}
+
         if (uwsgi.threads > 1) {
                 uwsgi.has_threads = 1;
                 uwsgi.cores = uwsgi.threads;
         }
 
+	// the seconds value is used by the non-master fallback (alarm) and the checks of the plugins
+	if (uwsgi.harakiri_options.workers_ms > 0) {
+		uwsgi.harakiri_options.workers = (uwsgi.harakiri_options.workers_ms + 999) / 1000;
+	}
+
         if (uwsgi.harakiri_options.workers > 0) {
                 if (!uwsgi.post_buffering) {
                         uwsgi_log(" *** WARNING: you have enabled harakiri without post buffering. Slow upload could be rejected on post-unbuffered webservers *** \n");
@@ -485,13 +579,73 @@ void sanitize_args() {
 		exit(1);
 	}
 
+#ifdef UWSGI_ZLIB
+	if (uwsgi.websockets_deflate_window_bits < 9 || uwsgi.websockets_deflate_window_bits > 15) {
+		uwsgi_log("invalid websockets-deflate-window-bits value (%d), must be between 9 and 15\n", uwsgi.websockets_deflate_window_bits);
+		exit(1);
+	}
+	if (uwsgi.websockets_deflate_mem_level < 1 || uwsgi.websockets_deflate_mem_level > 9) {
+		uwsgi_log("invalid websockets-deflate-mem-level value (%d), must be between 1 and 9\n", uwsgi.websockets_deflate_mem_level);
+		exit(1);
+	}
+#endif
+
 	if (uwsgi.evil_reload_on_rss || uwsgi.evil_reload_on_as) {
 		if (!uwsgi.mem_collector_freq) uwsgi.mem_collector_freq = 3;
 	}
 
+#if defined(__linux__) && defined(MADV_MERGEABLE)
+	if (uwsgi.ksm_mode_str) {
+		if (!strcmp(uwsgi.ksm_mode_str, "all")) {
+			uwsgi.ksm_mode = UWSGI_KSM_ALL;
+		}
+		else if (!strcmp(uwsgi.ksm_mode_str, "anon")) {
+			uwsgi.ksm_mode = UWSGI_KSM_ANON;
+		}
+		else if (!strcmp(uwsgi.ksm_mode_str, "process")) {
+			uwsgi.ksm_mode = UWSGI_KSM_PROCESS;
+		}
+		else {
+			uwsgi_log("invalid --ksm-mode value: %s (must be all, anon or process)\n", uwsgi.ksm_mode_str);
+			exit(1);
+		}
+		// the mode implies ksm
+		if (!uwsgi.linux_ksm) uwsgi.linux_ksm = 1;
+	}
+#endif
+
+	// threads only update their core counters
+	if (uwsgi.master_process && uwsgi.threads > 1) {
+		uwsgi.lazy_worker_stats = 1;
+	}
+
+	if (uwsgi.zygote) {
+#if defined(__linux__) && defined(PR_SET_CHILD_SUBREAPER)
+		// the apps are loaded by the zygote
+		uwsgi.lazy_apps = 1;
+#else
+		uwsgi_log("the zygote requires PR_SET_CHILD_SUBREAPER support\n");
+		exit(1);
+#endif
+	}
+
+	if (uwsgi.reuse_port_workers) {
+		// connections queued to a not running worker would wait for it
+		if (uwsgi.cheaper) {
+			uwsgi_log("reuse-port-workers cannot be used in cheaper mode\n");
+			exit(1);
+		}
+		// all of the listeners must have the flag
+		uwsgi.reuse_port = 1;
+		if (uwsgi.use_thunder_lock) {
+			uwsgi_log("thunder lock is useless with per-worker listeners, disabling it\n");
+			uwsgi.use_thunder_lock = 0;
+		}
+	}
+
 	/* here we try to choose if thunder lock is a good thing */
 #ifdef UNBIT
-	if (uwsgi.numproc > 1 && !uwsgi.map_socket) {
+	if (uwsgi.numproc > 1 && !uwsgi.map_socket && !uwsgi.reuse_port_workers) {
 		uwsgi.use_thunder_lock = 1;
 	}
 #endif
@@ -1031,6 +1031,26 @@ int uwsgi_read_whole_true_nb(int fd, char *buf, size_t remains, int timeout) {
 	return 0;
 }
 
+/*
+	consume exactly the specified number of lines (short replies of persistent connections),
+	returns -1 on error or if more data than expected has been received
+*/
+int uwsgi_read_lines_true_nb(int fd, int lines, int timeout) {
+	char buf[256];
+	while (lines > 0) {
+		ssize_t len = uwsgi_read_true_nb(fd, buf, 256, timeout);
+		if (len <= 0) return -1;
+		ssize_t i;
+		for (i = 0; i < len; i++) {
+			if (buf[i] == '\n') {
+				lines--;
+				if (lines == 0 && i != len - 1) return -1;
+			}
+		}
+	}
+	return 0;
+}
+
 /*
 	this is a pretty magic function used for reading a full uwsgi response
 	it is true non blocking, so you can use it in request plugins
@@ -198,18 +198,79 @@ next:
 	return NULL;
 }
 
+// set when a node left (or announced its death), the new lord is elected and announced without waiting for the next round
+static int legion_fast_election = 0;
+
+static uint64_t legion_freq_ms() {
+	if (uwsgi.legion_freq_ms > 0)
+		return uwsgi.legion_freq_ms;
+	return (uint64_t) uwsgi.legion_freq * 1000;
+}
+
+/*
+	phi accrual failure detector
+
+	the inter-arrival times of the announces are tracked (exponentially weighted mean/variance),
+	phi is the suspicion level that the node is dead given the time elapsed since its last
+	announce: -log10(P(next announce arrives even later)) assuming a normal distribution.
+	Announces closer than half of the frequency (fast elections) are not accounted.
+*/
+static void legion_node_heartbeat(struct uwsgi_legion_node *node, uint64_t now_us) {
+	if (node->last_seen_us && now_us > node->last_seen_us) {
+		double interval = (now_us - node->last_seen_us) / 1000.0;
+		if (interval < legion_freq_ms() / 2.0)
+			return;
+		if (!node->samples) {
+			node->interval_mean = interval;
+			node->interval_var = 0;
+		}
+		else {
+			double diff = interval - node->interval_mean;
+			node->interval_mean += 0.1 * diff;
+			node->interval_var = 0.9 * (node->interval_var + 0.1 * diff * diff);
+		}
+		node->samples++;
+	}
+	node->last_seen_us = now_us;
+}
+
+static double legion_node_phi(struct uwsgi_legion_node *node, uint64_t now_us) {
+	// not enough history
+	if (node->samples < 3 || now_us <= node->last_seen_us)
+		return 0;
+	double elapsed = (now_us - node->last_seen_us) / 1000.0;
+	double stddev = sqrt(node->interval_var);
+	// absorb the jitter of very regular nodes
+	if (stddev < legion_freq_ms() / 4.0)
+		stddev = legion_freq_ms() / 4.0;
+	double p_later = 0.5 * erfc(((elapsed - node->interval_mean) / stddev) / M_SQRT2);
+	if (p_later <= 0)
+		return HUGE_VAL;
+	return -log10(p_later);
+}
+
 static void legions_check_nodes() {
 
 	struct uwsgi_legion *legion = uwsgi.legions;
 	while (legion) {
 		time_t now = uwsgi_now();
+		uint64_t now_us = uwsgi_micros();
 
 		struct uwsgi_legion_node *node = legion->nodes_head;
 		while (node) {
-			if (now - node->last_seen > uwsgi.legion_tolerance) {
+			double phi = 0;
+			if (uwsgi.legion_phi_threshold > 0)
+				phi = legion_node_phi(node, now_us);
+			if (now - node->last_seen > uwsgi.legion_tolerance || phi > uwsgi.legion_phi_threshold) {
 				struct uwsgi_legion_node *tmp_node = node;
 				node = node->next;
-				uwsgi_log("[uwsgi-legion] %s: %.*s valor: %llu uuid: %.*s left Legion %s\n", tmp_node->valor > 0 ? "node" : "arbiter", tmp_node->name_len, tmp_node->name, tmp_node->valor, 36, tmp_node->uuid, legion->legion);
+				if (phi > 0) {
+					uwsgi_log("[uwsgi-legion] %s: %.*s valor: %llu uuid: %.*s left Legion %s (phi: %.1f)\n", tmp_node->valor > 0 ? "node" : "arbiter", tmp_node->name_len, tmp_node->name, tmp_node->valor, 36, tmp_node->uuid, legion->legion, phi);
+				}
+				else {
+					uwsgi_log("[uwsgi-legion] %s: %.*s valor: %llu uuid: %.*s left Legion %s\n", tmp_node->valor > 0 ? "node" : "arbiter", tmp_node->name_len, tmp_node->name, tmp_node->valor, 36, tmp_node->uuid, legion->legion);
+				}
+				legion_fast_election = 1;
 				uwsgi_wlock(legion->lock);
 				uwsgi_legion_remove_node(legion, tmp_node);
 				uwsgi_rwunlock(legion->lock);
@@ -476,11 +537,124 @@ next:
 }
 
 
+static void legion_manage_packet(struct uwsgi_legion *ul, unsigned char *crypted_buf, ssize_t len, unsigned char *clear_buf, struct uwsgi_legion *legion_msg) {
+	if (len < 4) {
+		uwsgi_log("[uwsgi-legion] invalid packet size: %d\n", (int) len);
+		return;
+	}
+
+	struct uwsgi_header *uh = (struct uwsgi_header *) crypted_buf;
+
+	if (uh->modifier1 != 109) {
+		uwsgi_log("[uwsgi-legion] invalid modifier1");
+		return;
+	}
+
+	int d_len = 0;
+	int d2_len = 0;
+	// decrypt packet using the secret
+	if (EVP_DecryptInit_ex(ul->decrypt_ctx, NULL, NULL, NULL, NULL) <= 0) {
+		uwsgi_error("[uwsgi-legion] EVP_DecryptInit_ex()");
+		return;
+	}
+
+	if (EVP_DecryptUpdate(ul->decrypt_ctx, clear_buf, &d_len, crypted_buf + 4, len - 4) <= 0) {
+		uwsgi_error("[uwsgi-legion] EVP_DecryptUpdate()");
+		return;
+	}
+
+	if (EVP_DecryptFinal_ex(ul->decrypt_ctx, clear_buf + d_len, &d2_len) <= 0) {
+		ERR_print_errors_fp(stderr);
+		uwsgi_log("[uwsgi-legion] EVP_DecryptFinal_ex()\n");
+		return;
+	}
+
+	d_len += d2_len;
+
+	if (d_len != uh->_pktsize) {
+		uwsgi_log("[uwsgi-legion] invalid packet size\n");
+		return;
+	}
+
+	// parse packet
+	memset(legion_msg, 0, sizeof(struct uwsgi_legion));
+	if (uwsgi_hooked_parse((char *) clear_buf, d_len, uwsgi_parse_legion, legion_msg)) {
+		uwsgi_log("[uwsgi-legion] invalid packet\n");
+		return;
+	}
+
+	if (uwsgi_strncmp(ul->legion, ul->legion_len, legion_msg->legion, legion_msg->legion_len)) {
+		uwsgi_log("[uwsgi-legion] invalid legion name\n");
+		return;
+	}
+
+	// check for loop packets... (expecially when in multicast mode)
+	if (!uwsgi_strncmp(uwsgi.hostname, uwsgi.hostname_len, legion_msg->name, legion_msg->name_len)) {
+		if (legion_msg->pid == ul->pid) {
+			if (legion_msg->valor == ul->valor) {
+				if (!memcmp(legion_msg->uuid, ul->uuid, 36)) {
+					return;
+				}
+			}
+		}
+	}
+
+	// check for "tolerable" unix time
+	if (legion_msg->unix_check < (uwsgi_now() - uwsgi.legion_skew_tolerance)) {
+		uwsgi_log("[uwsgi-legion] untolerable packet received for Legion %s , check your clock !!!\n", ul->legion);
+		return;
+	}
+
+	// check if the node is already accounted
+	struct uwsgi_legion_node *node = uwsgi_legion_get_node(ul, legion_msg->valor, legion_msg->name, legion_msg->name_len, legion_msg->uuid);
+	if (!node) {
+		// if a lord hook election fails, a node can announce itself as dead for long time...
+		if (legion_msg->dead) return;
+		// add the new node
+		uwsgi_wlock(ul->lock);
+		node = uwsgi_legion_add_node(ul, legion_msg->valor, legion_msg->name, legion_msg->name_len, legion_msg->uuid);
+		if (!node) return;
+		if (legion_msg->scroll_len > 0) {
+			node->scroll = uwsgi_malloc(legion_msg->scroll_len);
+			node->scroll_len = legion_msg->scroll_len;
+			memcpy(node->scroll, legion_msg->scroll, node->scroll_len);
+		}
+		// we are still locked (and safe), let's rebuild the scrolls list
+		legion_rebuild_scrolls(ul);
+		uwsgi_rwunlock(ul->lock);
+		uwsgi_log("[uwsgi-legion] %s: %.*s valor: %llu uuid: %.*s joined Legion %s\n", node->valor > 0 ? "node" : "arbiter", node->name_len, node->name, node->valor, 36, node->uuid, ul->legion);
+		// trigger node_joined hooks
+		struct uwsgi_string_list *usl = ul->node_joined_hooks;
+		while (usl) {
+			int ret = uwsgi_legion_action_call("node_joined", ul, usl);
+			if (ret) {
+				uwsgi_log("[uwsgi-legion] ERROR, node_joined hook returned: %d\n", ret);
+			}
+			usl = usl->next;
+		}
+	}
+	// remove node announcing death
+	else if (legion_msg->dead) {
+		uwsgi_log("[uwsgi-legion] %s: %.*s valor: %llu uuid: %.*s announced its death to Legion %s\n", node->valor > 0 ? "node" : "arbiter", node->name_len, node->name, node->valor, 36, node->uuid, ul->legion);
+		uwsgi_wlock(ul->lock);
+		uwsgi_legion_remove_node(ul, node);
+		uwsgi_rwunlock(ul->lock);
+		legion_fast_election = 1;
+		return;
+	}
+
+	node->last_seen = uwsgi_now();
+	legion_node_heartbeat(node, uwsgi_micros());
+	node->lord_valor = legion_msg->lord_valor;
+	node->checksum = legion_msg->checksum;
+	memcpy(node->lord_uuid, legion_msg->lord_uuid, 36);
+}
+
 static void *legion_loop(void *foobar) {
 
-	time_t last_round = uwsgi_now();
+	uint64_t last_round = uwsgi_micros() / 1000;
 
-	unsigned char *crypted_buf = uwsgi_malloc(UMAX16 - EVP_MAX_BLOCK_LENGTH - 4);
+	struct uwsgi_dgram_batch *udb = uwsgi_dgram_batch_new(UWSGI_DGRAM_BATCH, UMAX16 - EVP_MAX_BLOCK_LENGTH - 4);
 	unsigned char *clear_buf = uwsgi_malloc(UMAX16);
 
 	struct uwsgi_legion legion_msg;
@@ -492,21 +666,19 @@ static void *legion_loop(void *foobar) {
 	if (!uwsgi.legion_skew_tolerance)
 		uwsgi.legion_skew_tolerance = 60;
 
+	uint64_t freq = legion_freq_ms();
+
 	int first_round = 1;
 	for (;;) {
-		int timeout = uwsgi.legion_freq;
-		time_t now = uwsgi_now();
-		if (now > last_round) {
-			timeout -= (now - last_round);
-			if (timeout < 0) {
-				timeout = 0;
-			}
+		int timeout = 0;
+		uint64_t now = uwsgi_micros() / 1000;
+		if (now < last_round + freq) {
+			timeout = last_round + freq - now;
 		}
-		last_round = now;
 		// wait for event
 		int interesting_fd = -1;
 		if (uwsgi_instance_is_reloading || uwsgi_instance_is_dying) return NULL;
-		int rlen = event_queue_wait(uwsgi.legion_queue, timeout, &interesting_fd);
+		int rlen = event_queue_wait_ms(uwsgi.legion_queue, timeout, &interesting_fd);
 
 		if (rlen < 0 && errno != EINTR) {
 			if (uwsgi_instance_is_reloading || uwsgi_instance_is_dying) return NULL;
@@ -514,8 +686,8 @@ static void *legion_loop(void *foobar) {
 			return NULL;	
 		}
 
-		now = uwsgi_now();
-		if (timeout == 0 || rlen == 0 || (now - last_round) >= timeout) {
+		now = uwsgi_micros() / 1000;
+		if (now >= last_round + freq) {
 			struct uwsgi_legion *legions = uwsgi.legions;
 			while (legions) {
 				uwsgi_legion_announce(legions);
@@ -531,121 +703,16 @@ static void *legion_loop(void *foobar) {
 			struct uwsgi_legion *ul = uwsgi_legion_get_by_socket(interesting_fd);
 			if (!ul)
 				continue;
-			// ensure the first 4 bytes are valid
-			ssize_t len = read(ul->socket, crypted_buf, (UMAX16 - EVP_MAX_BLOCK_LENGTH - 4));
-			if (len < 0) {
-				uwsgi_error("[uwsgi-legion] read()");
-				continue;
-			}
-			else if (len < 4) {
-				uwsgi_log("[uwsgi-legion] invalid packet size: %d\n", (int) len);
-				continue;
-			}
-
-			struct uwsgi_header *uh = (struct uwsgi_header *) crypted_buf;
-
-			if (uh->modifier1 != 109) {
-				uwsgi_log("[uwsgi-legion] invalid modifier1");
-				continue;
-			}
-
-			int d_len = 0;
-			int d2_len = 0;
-			// decrypt packet using the secret
-			if (EVP_DecryptInit_ex(ul->decrypt_ctx, NULL, NULL, NULL, NULL) <= 0) {
-				uwsgi_error("[uwsgi-legion] EVP_DecryptInit_ex()");
-				continue;
-			}
-
-			if (EVP_DecryptUpdate(ul->decrypt_ctx, clear_buf, &d_len, crypted_buf + 4, len - 4) <= 0) {
-				uwsgi_error("[uwsgi-legion] EVP_DecryptUpdate()");
-				continue;
-			}
-
-			if (EVP_DecryptFinal_ex(ul->decrypt_ctx, clear_buf + d_len, &d2_len) <= 0) {
-				ERR_print_errors_fp(stderr);
-				uwsgi_log("[uwsgi-legion] EVP_DecryptFinal_ex()\n");
-				continue;
-			}
-
-			d_len += d2_len;
-
-			if (d_len != uh->_pktsize) {
-				uwsgi_log("[uwsgi-legion] invalid packet size\n");
-				continue;
-			}
-
-			// parse packet
-			memset(&legion_msg, 0, sizeof(struct uwsgi_legion));
-			if (uwsgi_hooked_parse((char *) clear_buf, d_len, uwsgi_parse_legion, &legion_msg)) {
-				uwsgi_log("[uwsgi-legion] invalid packet\n");
-				continue;
-			}
-
-			if (uwsgi_strncmp(ul->legion, ul->legion_len, legion_msg.legion, legion_msg.legion_len)) {
-				uwsgi_log("[uwsgi-legion] invalid legion name\n");
-				continue;
-			}
-
-			// check for loop packets... (expecially when in multicast mode)
-			if (!uwsgi_strncmp(uwsgi.hostname, uwsgi.hostname_len, legion_msg.name, legion_msg.name_len)) {
-				if (legion_msg.pid == ul->pid) {
-					if (legion_msg.valor == ul->valor) {
-						if (!memcmp(legion_msg.uuid, ul->uuid, 36)) {
-							continue;
-						}
-					}
-				}
-			}
-
-			// check for "tolerable" unix time
-			if (legion_msg.unix_check < (uwsgi_now() - uwsgi.legion_skew_tolerance)) {
-				uwsgi_log("[uwsgi-legion] untolerable packet received for Legion %s , check your clock !!!\n", ul->legion);
+			// all of the queued announces are received with a single syscall
+			int i, n = uwsgi_dgram_batch_recv(ul->socket, udb);
+			if (n < 0) {
+				uwsgi_error("[uwsgi-legion] recvmmsg()");
 				continue;
 			}
-
-			// check if the node is already accounted
-			struct uwsgi_legion_node *node = uwsgi_legion_get_node(ul, legion_msg.valor, legion_msg.name, legion_msg.name_len, legion_msg.uuid);
-			if (!node) {
-				// if a lord hook election fails, a node can announce itself as dead for long time...
-				if (legion_msg.dead) continue;
-				// add the new node
-				uwsgi_wlock(ul->lock);
-				node = uwsgi_legion_add_node(ul, legion_msg.valor, legion_msg.name, legion_msg.name_len, legion_msg.uuid);
-				if (!node) continue;
-				if (legion_msg.scroll_len > 0) {
-					node->scroll = uwsgi_malloc(legion_msg.scroll_len);
-					node->scroll_len = legion_msg.scroll_len;
-					memcpy(node->scroll, legion_msg.scroll, node->scroll_len);
-				}
-				// we are still locked (and safe), let's rebuild the scrolls list
-				legion_rebuild_scrolls(ul);
-				uwsgi_rwunlock(ul->lock);
-				uwsgi_log("[uwsgi-legion] %s: %.*s valor: %llu uuid: %.*s joined Legion %s\n", node->valor > 0 ? "node" : "arbiter", node->name_len, node->name, node->valor, 36, node->uuid, ul->legion);
-				// trigger node_joined hooks
-				struct uwsgi_string_list *usl = ul->node_joined_hooks;
-				while (usl) {
-					int ret = uwsgi_legion_action_call("node_joined", ul, usl);
-					if (ret) {
-						uwsgi_log("[uwsgi-legion] ERROR, node_joined hook returned: %d\n", ret);
-					}
-					usl = usl->next;
-				}
-			}
-			// remove node announcing death
-			else if (legion_msg.dead) {
-				uwsgi_log("[uwsgi-legion] %s: %.*s valor: %llu uuid: %.*s announced its death to Legion %s\n", node->valor > 0 ? "node" : "arbiter", node->name_len, node->name, node->valor, 36, node->uuid, ul->legion);
-                                uwsgi_wlock(ul->lock);
-                                uwsgi_legion_remove_node(ul, node);
-                                uwsgi_rwunlock(ul->lock);
-				continue;
+			for(i=0;i<n;i++) {
+				legion_manage_packet(ul, (unsigned char *) uwsgi_dgram_batch_buf(udb, i), udb->len[i], clear_buf, &legion_msg);
 			}
 
-			node->last_seen = uwsgi_now();
-			node->lord_valor = legion_msg.lord_valor;
-			node->checksum = legion_msg.checksum;
-			memcpy(node->lord_uuid, legion_msg.lord_uuid, 36);
-
 		}
 
 		// skip the first round if i no packet is received
@@ -654,6 +721,16 @@ static void *legion_loop(void *foobar) {
 			continue;
 		}
 		legions_check_nodes_step2();
+
+		// a node left, spread our new view immediately so the peers can agree on the new lord
+		if (legion_fast_election) {
+			legion_fast_election = 0;
+			struct uwsgi_legion *legions = uwsgi.legions;
+			while (legions) {
+				uwsgi_legion_announce(legions);
+				legions = legions->next;
+			}
+		}
 	}
 
 	return NULL;
@@ -838,12 +915,12 @@ int uwsgi_legion_announce(struct uwsgi_legion *ul) {
 	encrypted[2] = (unsigned char) ((pktsize >> 8) & 0xff);
 	encrypted[3] = 0;
 
-	struct uwsgi_string_list *usl = ul->nodes;
-	while (usl) {
-		if (sendto(ul->socket, encrypted, e_len + 4, 0, usl->custom_ptr, usl->custom) != e_len + 4) {
-			uwsgi_error("[uwsgi-legion] sendto()");
-		}
-		usl = usl->next;
+	// a single sendmmsg() for all of the nodes
+	struct iovec iov;
+	iov.iov_base = encrypted;
+	iov.iov_len = e_len + 4;
+	if (uwsgi_dgram_send_nodes(ul->socket, &iov, 1, ul->nodes)) {
+		uwsgi_log("[uwsgi-legion] unable to announce to all of the nodes\n");
 	}
 
 	uwsgi_buffer_destroy(ub);
@@ -1074,8 +1151,12 @@ struct uwsgi_legion *uwsgi_legion_register(char *legion, char *addr, char *valor
 		uwsgi_ssl_init();
 	}
 
-	EVP_CIPHER_CTX *ctx = uwsgi_malloc(sizeof(EVP_CIPHER_CTX));
-	EVP_CIPHER_CTX_init(ctx);
+	// the contexts are initialized only once, every packet just resets them
+	EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+	if (!ctx) {
+		uwsgi_log("[uwsgi-legion] unable to allocate cipher context\n");
+		exit(1);
+	}
 
 	const EVP_CIPHER *cipher = EVP_get_cipherbyname(algo);
 	if (!cipher) {
@@ -1109,8 +1190,11 @@ struct uwsgi_legion *uwsgi_legion_register(char *legion, char *addr, char *valor
 		exit(1);
 	}
 
-	EVP_CIPHER_CTX *ctx2 = uwsgi_malloc(sizeof(EVP_CIPHER_CTX));
-	EVP_CIPHER_CTX_init(ctx2);
+	EVP_CIPHER_CTX *ctx2 = EVP_CIPHER_CTX_new();
+	if (!ctx2) {
+		uwsgi_log("[uwsgi-legion] unable to allocate cipher context\n");
+		exit(1);
+	}
 
 	if (EVP_DecryptInit_ex(ctx2, cipher, NULL, (const unsigned char *) secret, (const unsigned char *) iv) <= 0) {
 		uwsgi_error("EVP_DecryptInit_ex()");
@@ -639,6 +639,280 @@ pid_t uwsgi_rwlock_ipcsem_check(struct uwsgi_lock_item *uli) {
 	return uwsgi_lock_ipcsem_check(uli);
 }
 
+#ifdef __linux__
+/*
+	futex based locks (--lock-engine futex)
+
+	the mutex is the classic futex word: 0 (free), 1 (locked), 2 (locked with waiters).
+
+	the rwlock prefers writers: the state word holds the number of readers and the writer bit,
+	new readers wait while a writer holds the lock or is queued for it, so a constant
+	read load cannot starve the writers (pthread rwlocks are reader-preferring on glibc).
+
+	both spin for a while before sleeping in the kernel, the spin budget is adapted
+	per lock (doubled when spinning was enough, halved when we had to sleep).
+
+	the owner pid (and the pid of every reader, up to UWSGI_FUTEX_READERS processes)
+	is tracked in the lock itself, so the master can release the locks held by a dead process
+*/
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#define UWSGI_FUTEX_WRITER 0x80000000
+#define UWSGI_FUTEX_READERS 32
+#define UWSGI_FUTEX_SPIN_MIN 16
+#define UWSGI_FUTEX_SPIN_MAX 2048
+
+struct uwsgi_futex_lock {
+	uint32_t state;
+	uint32_t spin;
+	pid_t owner;
+};
+
+struct uwsgi_futex_rwlock {
+	uint32_t state;
+	// queued writers
+	uint32_t writers;
+	// sleeping readers
+	uint32_t rwaiters;
+	uint32_t rseq;
+	uint32_t wseq;
+	uint32_t spin;
+	pid_t owner;
+	// (pid << 32) | number of read locks held by the process
+	uint64_t readers[UWSGI_FUTEX_READERS];
+};
+
+static void uwsgi_futex_wait(uint32_t *addr, uint32_t val) {
+	syscall(SYS_futex, addr, FUTEX_WAIT, val, NULL, NULL, 0);
+}
+
+static void uwsgi_futex_wake(uint32_t *addr, int n) {
+	syscall(SYS_futex, addr, FUTEX_WAKE, n, NULL, NULL, 0);
+}
+
+static inline void uwsgi_futex_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+static uint32_t uwsgi_futex_spin_budget(uint32_t *spin) {
+	// spinning on a single cpu only delays the holder
+	if (uwsgi.cpus < 2) return 0;
+	return __atomic_load_n(spin, __ATOMIC_RELAXED);
+}
+
+static void uwsgi_futex_spin_adapt(uint32_t *spin, int slept) {
+	uint32_t s = __atomic_load_n(spin, __ATOMIC_RELAXED);
+	if (slept) {
+		if (s > UWSGI_FUTEX_SPIN_MIN) __atomic_store_n(spin, s >> 1, __ATOMIC_RELAXED);
+	}
+	else if (s < UWSGI_FUTEX_SPIN_MAX) {
+		__atomic_store_n(spin, s << 1, __ATOMIC_RELAXED);
+	}
+}
+
+struct uwsgi_lock_item *uwsgi_lock_futex_init(char *id) {
+	struct uwsgi_lock_item *uli = uwsgi_register_lock(id, 0);
+	struct uwsgi_futex_lock *ufl = (struct uwsgi_futex_lock *) uli->lock_ptr;
+	memset(ufl, 0, sizeof(struct uwsgi_futex_lock));
+	ufl->spin = UWSGI_FUTEX_SPIN_MIN;
+	uli->can_deadlock = 1;
+	return uli;
+}
+
+pid_t uwsgi_lock_futex_check(struct uwsgi_lock_item *uli) {
+	struct uwsgi_futex_lock *ufl = (struct uwsgi_futex_lock *) uli->lock_ptr;
+	if (!__atomic_load_n(&ufl->state, __ATOMIC_ACQUIRE)) return 0;
+	return ufl->owner;
+}
+
+void uwsgi_lock_futex(struct uwsgi_lock_item *uli) {
+	struct uwsgi_futex_lock *ufl = (struct uwsgi_futex_lock *) uli->lock_ptr;
+	uint32_t c = 0;
+	if (__atomic_compare_exchange_n(&ufl->state, &c, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) goto locked;
+
+	uint32_t i, spin = uwsgi_futex_spin_budget(&ufl->spin);
+	for (i = 0; i < spin; i++) {
+		uwsgi_futex_relax();
+		c = 0;
+		if (__atomic_load_n(&ufl->state, __ATOMIC_RELAXED) == 0 &&
+			__atomic_compare_exchange_n(&ufl->state, &c, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			uwsgi_futex_spin_adapt(&ufl->spin, 0);
+			goto locked;
+		}
+	}
+	if (spin) uwsgi_futex_spin_adapt(&ufl->spin, 1);
+
+	// mark the lock as contended and sleep
+	while (__atomic_exchange_n(&ufl->state, 2, __ATOMIC_ACQUIRE) != 0) {
+		uwsgi_futex_wait(&ufl->state, 2);
+	}
+locked:
+	ufl->owner = uwsgi.mypid;
+	uli->pid = uwsgi.mypid;
+}
+
+void uwsgi_unlock_futex(struct uwsgi_lock_item *uli) {
+	struct uwsgi_futex_lock *ufl = (struct uwsgi_futex_lock *) uli->lock_ptr;
+	ufl->owner = 0;
+	uli->pid = 0;
+	if (__atomic_exchange_n(&ufl->state, 0, __ATOMIC_RELEASE) == 2) {
+		uwsgi_futex_wake(&ufl->state, 1);
+	}
+}
+
+// update the read locks held by the current process (untracked when all of the slots are busy)
+static void uwsgi_futex_readers_track(struct uwsgi_futex_rwlock *ufr, int delta) {
+	uint64_t pid = (uint32_t) uwsgi.mypid;
+	int i;
+	for (i = 0; i < UWSGI_FUTEX_READERS; i++) {
+		uint64_t *slot = &ufr->readers[(pid + i) % UWSGI_FUTEX_READERS];
+		uint64_t w = __atomic_load_n(slot, __ATOMIC_RELAXED);
+		for (;;) {
+			uint64_t n;
+			if ((w >> 32) == pid) {
+				uint32_t count = (w & 0xffffffff) + delta;
+				n = count ? (pid << 32) | count : 0;
+			}
+			else if (w == 0 && delta > 0) {
+				n = (pid << 32) | 1;
+			}
+			else {
+				break;
+			}
+			if (__atomic_compare_exchange_n(slot, &w, n, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) return;
+		}
+	}
+}
+
+static void uwsgi_futex_rwlock_wake(struct uwsgi_futex_rwlock *ufr) {
+	if (__atomic_load_n(&ufr->writers, __ATOMIC_SEQ_CST)) {
+		__atomic_add_fetch(&ufr->wseq, 1, __ATOMIC_RELEASE);
+		uwsgi_futex_wake(&ufr->wseq, 1);
+	}
+	else if (__atomic_load_n(&ufr->rwaiters, __ATOMIC_SEQ_CST)) {
+		__atomic_add_fetch(&ufr->rseq, 1, __ATOMIC_RELEASE);
+		uwsgi_futex_wake(&ufr->rseq, INT_MAX);
+	}
+}
+
+struct uwsgi_lock_item *uwsgi_rwlock_futex_init(char *id) {
+	struct uwsgi_lock_item *uli = uwsgi_register_lock(id, 1);
+	struct uwsgi_futex_rwlock *ufr = (struct uwsgi_futex_rwlock *) uli->lock_ptr;
+	memset(ufr, 0, sizeof(struct uwsgi_futex_rwlock));
+	ufr->spin = UWSGI_FUTEX_SPIN_MIN;
+	uli->can_deadlock = 1;
+	return uli;
+}
+
+pid_t uwsgi_rwlock_futex_check(struct uwsgi_lock_item *uli) {
+	struct uwsgi_futex_rwlock *ufr = (struct uwsgi_futex_rwlock *) uli->lock_ptr;
+	if (!(__atomic_load_n(&ufr->state, __ATOMIC_ACQUIRE) & UWSGI_FUTEX_WRITER)) return 0;
+	return ufr->owner;
+}
+
+void uwsgi_rlock_futex(struct uwsgi_lock_item *uli) {
+	struct uwsgi_futex_rwlock *ufr = (struct uwsgi_futex_rwlock *) uli->lock_ptr;
+	uint32_t i = 0, spin = uwsgi_futex_spin_budget(&ufr->spin);
+	int contended = 0, slept = 0;
+	for (;;) {
+		uint32_t s = __atomic_load_n(&ufr->state, __ATOMIC_RELAXED);
+		if (!(s & UWSGI_FUTEX_WRITER) && !__atomic_load_n(&ufr->writers, __ATOMIC_RELAXED)) {
+			if (__atomic_compare_exchange_n(&ufr->state, &s, s + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) break;
+			continue;
+		}
+		contended = 1;
+		if (i < spin) {
+			i++;
+			uwsgi_futex_relax();
+			continue;
+		}
+		slept = 1;
+		__atomic_add_fetch(&ufr->rwaiters, 1, __ATOMIC_SEQ_CST);
+		uint32_t seq = __atomic_load_n(&ufr->rseq, __ATOMIC_ACQUIRE);
+		if ((__atomic_load_n(&ufr->state, __ATOMIC_SEQ_CST) & UWSGI_FUTEX_WRITER) || __atomic_load_n(&ufr->writers, __ATOMIC_SEQ_CST)) {
+			uwsgi_futex_wait(&ufr->rseq, seq);
+		}
+		__atomic_sub_fetch(&ufr->rwaiters, 1, __ATOMIC_RELAXED);
+	}
+	if (contended && spin) uwsgi_futex_spin_adapt(&ufr->spin, slept);
+	uwsgi_futex_readers_track(ufr, 1);
+	uli->pid = uwsgi.mypid;
+}
+
+void uwsgi_wlock_futex(struct uwsgi_lock_item *uli) {
+	struct uwsgi_futex_rwlock *ufr = (struct uwsgi_futex_rwlock *) uli->lock_ptr;
+	uint32_t i = 0, spin = uwsgi_futex_spin_budget(&ufr->spin);
+	int contended = 0, slept = 0;
+	// from now on new readers wait for us
+	__atomic_add_fetch(&ufr->writers, 1, __ATOMIC_SEQ_CST);
+	for (;;) {
+		uint32_t s = 0;
+		if (__atomic_compare_exchange_n(&ufr->state, &s, UWSGI_FUTEX_WRITER, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) break;
+		contended = 1;
+		if (i < spin) {
+			i++;
+			uwsgi_futex_relax();
+			continue;
+		}
+		slept = 1;
+		uint32_t seq = __atomic_load_n(&ufr->wseq, __ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&ufr->state, __ATOMIC_SEQ_CST)) {
+			uwsgi_futex_wait(&ufr->wseq, seq);
+		}
+	}
+	__atomic_sub_fetch(&ufr->writers, 1, __ATOMIC_SEQ_CST);
+	if (contended && spin) uwsgi_futex_spin_adapt(&ufr->spin, slept);
+	ufr->owner = uwsgi.mypid;
+	uli->pid = uwsgi.mypid;
+}
+
+void uwsgi_rwunlock_futex(struct uwsgi_lock_item *uli) {
+	struct uwsgi_futex_rwlock *ufr = (struct uwsgi_futex_rwlock *) uli->lock_ptr;
+	uli->pid = 0;
+	if (__atomic_load_n(&ufr->state, __ATOMIC_RELAXED) & UWSGI_FUTEX_WRITER) {
+		ufr->owner = 0;
+		__atomic_store_n(&ufr->state, 0, __ATOMIC_SEQ_CST);
+		uwsgi_futex_rwlock_wake(ufr);
+		return;
+	}
+	uwsgi_futex_readers_track(ufr, -1);
+	// the last reader hands the lock to a queued writer
+	if (__atomic_sub_fetch(&ufr->state, 1, __ATOMIC_SEQ_CST) == 0) {
+		uwsgi_futex_rwlock_wake(ufr);
+	}
+}
+
+// called by the master when a process dies, releases both its write and read locks
+static void uwsgi_rwlock_futex_recover(struct uwsgi_lock_item *uli, pid_t diedpid) {
+	struct uwsgi_futex_rwlock *ufr = (struct uwsgi_futex_rwlock *) uli->lock_ptr;
+	if (uwsgi_rwlock_futex_check(uli) == diedpid) {
+		uwsgi_log("[deadlock-detector] pid %d was holding lock %s (%p)\n", (int) diedpid, uli->id, uli->lock_ptr);
+		uwsgi_rwunlock_futex(uli);
+		return;
+	}
+	uint32_t held = 0;
+	int i;
+	for (i = 0; i < UWSGI_FUTEX_READERS; i++) {
+		uint64_t w = __atomic_load_n(&ufr->readers[i], __ATOMIC_RELAXED);
+		if ((uint32_t) (w >> 32) != (uint32_t) diedpid) continue;
+		if (__atomic_compare_exchange_n(&ufr->readers[i], &w, 0, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+			held += w & 0xffffffff;
+		}
+	}
+	if (!held) return;
+	uwsgi_log("[deadlock-detector] pid %d was holding %u read locks on %s (%p)\n", (int) diedpid, held, uli->id, uli->lock_ptr);
+	if (__atomic_sub_fetch(&ufr->state, held, __ATOMIC_SEQ_CST) == 0) {
+		uwsgi_futex_rwlock_wake(ufr);
+	}
+}
+#endif
+
 #ifdef UNBIT
 /*
 	Unbit-specific workaround for robust-mutexes
@@ -691,6 +965,23 @@ void uwsgi_setup_locking() {
 			uwsgi.rwlock_size = 8;
 			goto ready;
 		}
+#ifdef __linux__
+		if (!strcmp(uwsgi.lock_engine, "futex")) {
+			uwsgi_log_initial("lock engine: futex\n");
+			uwsgi.lock_ops.lock_init = uwsgi_lock_futex_init;
+			uwsgi.lock_ops.lock_check = uwsgi_lock_futex_check;
+			uwsgi.lock_ops.lock = uwsgi_lock_futex;
+			uwsgi.lock_ops.unlock = uwsgi_unlock_futex;
+			uwsgi.lock_ops.rwlock_init = uwsgi_rwlock_futex_init;
+			uwsgi.lock_ops.rwlock_check = uwsgi_rwlock_futex_check;
+			uwsgi.lock_ops.rlock = uwsgi_rlock_futex;
+			uwsgi.lock_ops.wlock = uwsgi_wlock_futex;
+			uwsgi.lock_ops.rwunlock = uwsgi_rwunlock_futex;
+			uwsgi.lock_size = sizeof(struct uwsgi_futex_lock);
+			uwsgi.rwlock_size = sizeof(struct uwsgi_futex_rwlock);
+			goto ready;
+		}
+#endif
 		uwsgi_log("unable to find lock engine \"%s\"\n", uwsgi.lock_engine);
 		exit(1);
 	}
@@ -806,6 +1097,13 @@ void uwsgi_deadlock_check(pid_t diedpid) {
 	while (uli) {
 		if (!uli->can_deadlock)
 			goto nextlock;
+#ifdef __linux__
+		// futex rwlocks track their readers too
+		if (uli->rw && uwsgi.lock_ops.rwlock_init == uwsgi_rwlock_futex_init) {
+			uwsgi_rwlock_futex_recover(uli, diedpid);
+			goto nextlock;
+		}
+#endif
 		pid_t locked_pid = 0;
 		if (uli->rw) {
 			locked_pid = uwsgi_rwlock_check(uli);
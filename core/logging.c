@@ -238,6 +238,65 @@ void create_logpipe(void) {
 
 }
 
+static void log_ring_copy_in(struct uwsgi_log_ring *ring, uint64_t pos, char *buf, size_t len) {
+	uint64_t off = pos % uwsgi.req_log_ring;
+	size_t chunk = uwsgi.req_log_ring - off;
+	if (chunk > len) chunk = len;
+	memcpy(ring->data + off, buf, chunk);
+	if (len > chunk) memcpy(ring->data, buf + chunk, len - chunk);
+}
+
+static void log_ring_copy_out(struct uwsgi_log_ring *ring, uint64_t pos, char *buf, size_t len) {
+	uint64_t off = pos % uwsgi.req_log_ring;
+	size_t chunk = uwsgi.req_log_ring - off;
+	if (chunk > len) chunk = len;
+	memcpy(buf, ring->data + off, chunk);
+	if (len > chunk) memcpy(buf + chunk, ring->data, len - chunk);
+}
+
+// the worker side: never blocks, when the ring is full the record is dropped (and counted)
+static void uwsgi_req_log_ring_push(struct uwsgi_log_ring *ring, struct iovec *iov, int iovcnt) {
+	int i;
+	size_t len = 0;
+	for (i = 0; i < iovcnt; i++) {
+		len += iov[i].iov_len;
+	}
+	// bigger log lines would be truncated by the master
+	if (len > uwsgi.log_master_bufsize) len = uwsgi.log_master_bufsize;
+
+	uint64_t head = ring->head;
+	uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	if (sizeof(uint32_t) + len > uwsgi.req_log_ring - (head - tail)) {
+		ring->drops++;
+		return;
+	}
+
+	uint32_t rlen = len;
+	log_ring_copy_in(ring, head, (char *) &rlen, sizeof(uint32_t));
+	uint64_t pos = head + sizeof(uint32_t);
+	for (i = 0; i < iovcnt && len > 0; i++) {
+		size_t chunk = iov[i].iov_len;
+		if (chunk > len) chunk = len;
+		log_ring_copy_in(ring, pos, iov[i].iov_base, chunk);
+		pos += chunk;
+		len -= chunk;
+	}
+	__atomic_store_n(&ring->head, pos, __ATOMIC_RELEASE);
+}
+
+static void uwsgi_req_log_write(struct wsgi_request *wsgi_req, struct iovec *iov, int iovcnt) {
+	if (uwsgi.req_log_ring && uwsgi.mywid > 0) {
+		struct uwsgi_log_ring *ring = uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].req_log_ring;
+		if (ring) {
+			uwsgi_req_log_ring_push(ring, iov, iovcnt);
+			return;
+		}
+	}
+	// do not check for errors
+	ssize_t rlen = writev(uwsgi.req_log_fd, iov, iovcnt);
+	(void) rlen;
+}
+
 // log to the specified file or udp address
 void logto(char *logfile) {
 
@@ -375,6 +434,9 @@ static struct uwsgi_logger *setup_choosen_logger(struct uwsgi_string_list *usl)
 	}
 
 	struct uwsgi_logger *choosen_logger = uwsgi_get_logger(name);
+	while (!choosen_logger && uwsgi_lazy_plugin_load(name)) {
+		choosen_logger = uwsgi_get_logger(name);
+	}
 	if (!choosen_logger) {
 		uwsgi_log("unable to find logger %s\n", name);
 		exit(1);
@@ -398,8 +460,21 @@ static struct uwsgi_logger *setup_choosen_logger(struct uwsgi_string_list *usl)
 	return choosen_logger;
 }
 
+static void uwsgi_log_batch_setup(struct uwsgi_logger *);
+
 void uwsgi_setup_log_master(void) {
 
+	// the request log rings are consumed by the logger thread
+	if (uwsgi.req_log_ring) {
+		if (!uwsgi.req_log_master) {
+			uwsgi.req_log_ring = 0;
+		}
+		else if (!uwsgi.threaded_logger) {
+			uwsgi_log("--req-log-ring requires the threaded logger, enabling it\n");
+			uwsgi.threaded_logger = 1;
+		}
+	}
+
 	struct uwsgi_string_list *usl = uwsgi.requested_logger;
 	while (usl) {
 		struct uwsgi_logger *choosen_logger = setup_choosen_logger(usl);
@@ -414,6 +489,15 @@ void uwsgi_setup_log_master(void) {
                 usl = usl->next;
         }
 
+	if (uwsgi.log_batch) {
+		if (!uwsgi.log_batch_size) uwsgi.log_batch_size = 64 * 1024;
+		if (!uwsgi.log_batch_max) uwsgi.log_batch_max = 1024 * 1024;
+		if (!uwsgi.log_batch_freq) uwsgi.log_batch_freq = 100;
+		if (uwsgi.log_batch_max < uwsgi.log_batch_size) uwsgi.log_batch_max = uwsgi.log_batch_size;
+		uwsgi_log_batch_setup(uwsgi.choosen_logger);
+		uwsgi_log_batch_setup(uwsgi.choosen_req_logger);
+	}
+
 #ifdef UWSGI_PCRE
 	// set logger by its id
 	struct uwsgi_regexp_list *url = uwsgi.log_route;
@@ -458,7 +542,7 @@ void uwsgi_logvar_add(struct wsgi_request *wsgi_req, char *key, uint8_t keylen,
 	if (lv) {
 		while (lv) {
 			if (!lv->next) {
-				lv->next = uwsgi_malloc(sizeof(struct uwsgi_logvar));
+				lv->next = uwsgi_req_malloc(wsgi_req, sizeof(struct uwsgi_logvar));
 				lv = lv->next;
 				break;
 			}
@@ -466,7 +550,7 @@ void uwsgi_logvar_add(struct wsgi_request *wsgi_req, char *key, uint8_t keylen,
 		}
 	}
 	else {
-		lv = uwsgi_malloc(sizeof(struct uwsgi_logvar));
+		lv = uwsgi_req_malloc(wsgi_req, sizeof(struct uwsgi_logvar));
 		wsgi_req->logvars = lv;
 	}
 
@@ -728,8 +812,7 @@ void uwsgi_logit_simple(struct wsgi_request *wsgi_req) {
 	logvec[logvecpos].iov_base = logpkt;
 	logvec[logvecpos].iov_len = rlen;
 
-	// do not check for errors
-	rlen = writev(uwsgi.req_log_fd, logvec, logvecpos + 1);
+	uwsgi_req_log_write(wsgi_req, logvec, logvecpos + 1);
 }
 
 void get_memusage(uint64_t * rss, uint64_t * vsz) {
@@ -875,6 +958,8 @@ void uwsgi_register_logger(char *name, ssize_t(*func) (struct uwsgi_logger *, ch
 	ul->fd = -1;
 	ul->data = NULL;
 	ul->buf = NULL;
+	ul->dgram = 0;
+	ul->batch = NULL;
 
 
 #ifdef UWSGI_DEBUG
@@ -882,6 +967,12 @@ void uwsgi_register_logger(char *name, ssize_t(*func) (struct uwsgi_logger *, ch
 #endif
 }
 
+void uwsgi_register_dgram_logger(char *name, ssize_t(*func) (struct uwsgi_logger *, char *, size_t)) {
+	uwsgi_register_logger(name, func);
+	struct uwsgi_logger *ul = uwsgi_get_logger(name);
+	if (ul) ul->dgram = 1;
+}
+
 void uwsgi_append_logger(struct uwsgi_logger *ul) {
 
 	if (!uwsgi.choosen_logger) {
@@ -944,83 +1035,96 @@ struct uwsgi_logger *uwsgi_get_logger_from_id(char *id) {
 }
 
 
+// append a (string) value to the log line, empty values are logged as "-" (null in json mode)
+static int uwsgi_lf_value(struct uwsgi_buffer *ub, char *value, size_t len, int json) {
+	if (json) {
+		if (!value || !len) return uwsgi_buffer_append(ub, "null", 4);
+		if (uwsgi_buffer_byte(ub, '"')) return -1;
+		if (uwsgi_buffer_append_json(ub, value, len)) return -1;
+		return uwsgi_buffer_byte(ub, '"');
+	}
+	if (!value || !len) return uwsgi_buffer_byte(ub, '-');
+	return uwsgi_buffer_append(ub, value, len);
+}
+
+/*
+	the whole line is built in a per-core buffer and sent with a single write.
+	with --logformat-json the variables are emitted as a json object (raw text is skipped)
+*/
 void uwsgi_logit_lf(struct wsgi_request *wsgi_req) {
 	struct uwsgi_logchunk *logchunk = uwsgi.logchunks;
-	ssize_t rlen = 0;
-	const char *empty_var = "-";
+	struct uwsgi_buffer *ub = uwsgi.logformat_buffers[wsgi_req->async_id];
+	int json = uwsgi.logformat_json;
+	int first = 1;
+
+	uwsgi_buffer_reset(ub);
+	if (json && uwsgi_buffer_byte(ub, '{')) return;
+
 	while (logchunk) {
-		int pos = logchunk->vec;
 		// raw string
 		if (logchunk->type == 0) {
-			uwsgi.logvectors[wsgi_req->async_id][pos].iov_base = logchunk->ptr;
-			uwsgi.logvectors[wsgi_req->async_id][pos].iov_len = logchunk->len;
+			if (!json && uwsgi_buffer_append(ub, logchunk->ptr, logchunk->len)) return;
+			goto next;
+		}
+
+		if (json) {
+			if (!first && uwsgi_buffer_byte(ub, ',')) return;
+			first = 0;
+			if (uwsgi_buffer_byte(ub, '"')) return;
+			if (uwsgi_buffer_append_json(ub, logchunk->ptr, logchunk->len)) return;
+			if (uwsgi_buffer_append(ub, "\":", 2)) return;
 		}
+
 		// offsetof
-		else if (logchunk->type == 1) {
+		if (logchunk->type == 1) {
 			char **var = (char **) (((char *) wsgi_req) + logchunk->pos);
 			uint16_t *varlen = (uint16_t *) (((char *) wsgi_req) + logchunk->pos_len);
-			uwsgi.logvectors[wsgi_req->async_id][pos].iov_base = *var;
-			uwsgi.logvectors[wsgi_req->async_id][pos].iov_len = *varlen;
+			if (uwsgi_lf_value(ub, *var, *varlen, json)) return;
 		}
 		// logvar
 		else if (logchunk->type == 2) {
 			struct uwsgi_logvar *lv = uwsgi_logvar_get(wsgi_req, logchunk->ptr, logchunk->len);
 			if (lv) {
-				uwsgi.logvectors[wsgi_req->async_id][pos].iov_base = lv->val;
-				uwsgi.logvectors[wsgi_req->async_id][pos].iov_len = lv->vallen;
+				if (uwsgi_lf_value(ub, lv->val, lv->vallen, json)) return;
 			}
 			else {
-				uwsgi.logvectors[wsgi_req->async_id][pos].iov_base = NULL;
-				uwsgi.logvectors[wsgi_req->async_id][pos].iov_len = 0;
+				if (uwsgi_lf_value(ub, NULL, 0, json)) return;
 			}
 		}
 		// func
 		else if (logchunk->type == 3) {
-			rlen = logchunk->func(wsgi_req, (char **) &uwsgi.logvectors[wsgi_req->async_id][pos].iov_base);
-			if (rlen > 0) {
-				uwsgi.logvectors[wsgi_req->async_id][pos].iov_len = rlen;
-			}
-			else {
-				uwsgi.logvectors[wsgi_req->async_id][pos].iov_len = 0;
-			}
+			char *value = NULL;
+			ssize_t rlen = logchunk->func(wsgi_req, &value);
+			int ret = uwsgi_lf_value(ub, value, rlen > 0 ? rlen : 0, json);
+			if (logchunk->free && value) free(value);
+			if (ret) return;
+		}
+		// metric
+		else if (logchunk->type == 4) {
+			if (uwsgi_buffer_num64(ub, uwsgi_metric_get(logchunk->ptr, NULL))) return;
 		}
 		// var
 		else if (logchunk->type == 5) {
 			uint16_t value_len = 0;
-			char *value = uwsgi_get_var(wsgi_req, logchunk->ptr, logchunk->len, &value_len);
 			// could be NULL
-                        uwsgi.logvectors[wsgi_req->async_id][pos].iov_base = value;
-                        uwsgi.logvectors[wsgi_req->async_id][pos].iov_len = (size_t) value_len;
+			char *value = uwsgi_get_var(wsgi_req, logchunk->ptr, logchunk->len, &value_len);
+			if (uwsgi_lf_value(ub, value, value_len, json)) return;
                 }
-		// metric
-		else if (logchunk->type == 4) {
-			int64_t metric = uwsgi_metric_get(logchunk->ptr, NULL);
-			uwsgi.logvectors[wsgi_req->async_id][pos].iov_base = uwsgi_64bit2str(metric);
-			uwsgi.logvectors[wsgi_req->async_id][pos].iov_len = strlen(uwsgi.logvectors[wsgi_req->async_id][pos].iov_base);
-		}
-
-		if (uwsgi.logvectors[wsgi_req->async_id][pos].iov_len == 0 && logchunk->type != 0) {
-			uwsgi.logvectors[wsgi_req->async_id][pos].iov_base = (char *) empty_var;
-			uwsgi.logvectors[wsgi_req->async_id][pos].iov_len = 1;	
+		// numeric func, writes directly in the line buffer
+		else if (logchunk->type == 6) {
+			if (logchunk->append(wsgi_req, ub)) return;
 		}
+next:
 		logchunk = logchunk->next;
 	}
 
-	// do not check for errors
-	rlen = writev(uwsgi.req_log_fd, uwsgi.logvectors[wsgi_req->async_id], uwsgi.logformat_vectors);
+	if (json && uwsgi_buffer_byte(ub, '}')) return;
+	if (uwsgi_buffer_byte(ub, '\n')) return;
 
-	// free allocated memory
-	logchunk = uwsgi.logchunks;
-	while (logchunk) {
-		if (logchunk->free) {
-			if (uwsgi.logvectors[wsgi_req->async_id][logchunk->vec].iov_len > 0) {
-				if (uwsgi.logvectors[wsgi_req->async_id][logchunk->vec].iov_base != empty_var) {
-					free(uwsgi.logvectors[wsgi_req->async_id][logchunk->vec].iov_base);
-				}
-			}
-		}
-		logchunk = logchunk->next;
-	}
+	struct iovec iov;
+	iov.iov_base = ub->buf;
+	iov.iov_len = ub->pos;
+	uwsgi_req_log_write(wsgi_req, &iov, 1);
 }
 
 void uwsgi_build_log_format(char *format) {
@@ -1073,177 +1177,218 @@ void uwsgi_build_log_format(char *format) {
 
 }
 
-static ssize_t uwsgi_lf_status(struct wsgi_request *wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->status);
-	return strlen(*buf);
+static int uwsgi_lf_status(struct wsgi_request *wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, wsgi_req->status);
 }
 
 
-static ssize_t uwsgi_lf_rsize(struct wsgi_request *wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->response_size);
-	return strlen(*buf);
+static int uwsgi_lf_rsize(struct wsgi_request *wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, wsgi_req->response_size);
 }
 
-static ssize_t uwsgi_lf_hsize(struct wsgi_request *wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->headers_size);
-	return strlen(*buf);
+static int uwsgi_lf_hsize(struct wsgi_request *wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, wsgi_req->headers_size);
 }
 
-static ssize_t uwsgi_lf_size(struct wsgi_request *wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->headers_size+wsgi_req->response_size);
-	return strlen(*buf);
+static int uwsgi_lf_size(struct wsgi_request *wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, wsgi_req->headers_size+wsgi_req->response_size);
 }
 
-static ssize_t uwsgi_lf_cl(struct wsgi_request *wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->post_cl);
-	return strlen(*buf);
+static int uwsgi_lf_cl(struct wsgi_request *wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, wsgi_req->post_cl);
 }
 
 
-static ssize_t uwsgi_lf_epoch(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(uwsgi_now());
-	return strlen(*buf);
+static int uwsgi_lf_epoch(struct wsgi_request * wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, uwsgi_now());
 }
 
-static ssize_t uwsgi_lf_ctime(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_malloc(26);
+/*
+	time strings are formatted only once per second (per core)
+*/
+struct uwsgi_lf_time_cache {
+	time_t t;
+	size_t len;
+	char buf[64];
+};
+
+#define UWSGI_LF_CTIME 0
+#define UWSGI_LF_LTIME 1
+#define UWSGI_LF_FTIME 2
+static struct uwsgi_lf_time_cache *uwsgi_lf_time_caches;
+
+static struct uwsgi_lf_time_cache *uwsgi_lf_time_cache_get(struct wsgi_request *wsgi_req, int type, time_t now) {
+	struct uwsgi_lf_time_cache *cache = &uwsgi_lf_time_caches[(wsgi_req->async_id * 3) + type];
+	if (cache->len > 0 && cache->t == now) return cache;
+	cache->t = now;
+	cache->len = 0;
+	if (type == UWSGI_LF_CTIME) {
 #if defined(__sun__) && !defined(__clang__)
-	ctime_r((const time_t *) &wsgi_req->start_of_request_in_sec, *buf, 26);
+		ctime_r(&now, cache->buf, 26);
 #else
-	ctime_r((const time_t *) &wsgi_req->start_of_request_in_sec, *buf);
+		ctime_r(&now, cache->buf);
 #endif
-	return 24;
+		cache->len = 24;
+	}
+	else {
+		struct tm tm;
+		char *fmt = "%d/%b/%Y:%H:%M:%S %z";
+		if (type == UWSGI_LF_FTIME) fmt = uwsgi.log_strftime;
+		cache->len = strftime(cache->buf, 64, fmt, localtime_r(&now, &tm));
+	}
+	return cache;
+}
+
+static ssize_t uwsgi_lf_ctime(struct wsgi_request * wsgi_req, char **buf) {
+	struct uwsgi_lf_time_cache *cache = uwsgi_lf_time_cache_get(wsgi_req, UWSGI_LF_CTIME, (time_t) wsgi_req->start_of_request_in_sec);
+	*buf = cache->buf;
+	return cache->len;
 }
 
-static ssize_t uwsgi_lf_time(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->start_of_request / 1000000);
-	return strlen(*buf);
+static int uwsgi_lf_time(struct wsgi_request * wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, wsgi_req->start_of_request / 1000000);
 }
 
 
 static ssize_t uwsgi_lf_ltime(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_malloc(64);
-	time_t now = wsgi_req->start_of_request / 1000000;
-	size_t ret = strftime(*buf, 64, "%d/%b/%Y:%H:%M:%S %z", localtime(&now));
-	if (ret == 0) {
-		*buf[0] = 0;
-		return 0;
-	}
-	return ret;
+	struct uwsgi_lf_time_cache *cache = uwsgi_lf_time_cache_get(wsgi_req, UWSGI_LF_LTIME, wsgi_req->start_of_request / 1000000);
+	*buf = cache->buf;
+	return cache->len;
 }
 
 static ssize_t uwsgi_lf_ftime(struct wsgi_request * wsgi_req, char **buf) {
 	if (!uwsgi.logformat_strftime || !uwsgi.log_strftime) {
 		return uwsgi_lf_ltime(wsgi_req, buf);
 	}
-	*buf = uwsgi_malloc(64);
-	time_t now = wsgi_req->start_of_request / 1000000;
-	size_t ret = strftime(*buf, 64, uwsgi.log_strftime, localtime(&now));
-	if (ret == 0) {
-		*buf[0] = 0;
-		return 0;
-	}
-	return ret;
+	struct uwsgi_lf_time_cache *cache = uwsgi_lf_time_cache_get(wsgi_req, UWSGI_LF_FTIME, wsgi_req->start_of_request / 1000000);
+	*buf = cache->buf;
+	return cache->len;
 }
 
-static ssize_t uwsgi_lf_tmsecs(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_64bit2str(wsgi_req->start_of_request / (int64_t) 1000);
-	return strlen(*buf);
+static int uwsgi_lf_tmsecs(struct wsgi_request * wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, wsgi_req->start_of_request / (int64_t) 1000);
 }
 
-static ssize_t uwsgi_lf_tmicros(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_64bit2str(wsgi_req->start_of_request);
-	return strlen(*buf);
+static int uwsgi_lf_tmicros(struct wsgi_request * wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, wsgi_req->start_of_request);
 }
 
-static ssize_t uwsgi_lf_micros(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->end_of_request - wsgi_req->start_of_request);
-	return strlen(*buf);
+static int uwsgi_lf_micros(struct wsgi_request * wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, wsgi_req->end_of_request - wsgi_req->start_of_request);
 }
 
-static ssize_t uwsgi_lf_msecs(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str((wsgi_req->end_of_request - wsgi_req->start_of_request) / 1000);
-	return strlen(*buf);
+static int uwsgi_lf_msecs(struct wsgi_request * wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, (wsgi_req->end_of_request - wsgi_req->start_of_request) / 1000);
 }
 
-static ssize_t uwsgi_lf_pid(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(uwsgi.mypid);
-	return strlen(*buf);
+static int uwsgi_lf_pid(struct wsgi_request * wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, uwsgi.mypid);
 }
 
-static ssize_t uwsgi_lf_wid(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(uwsgi.mywid);
-	return strlen(*buf);
+static int uwsgi_lf_wid(struct wsgi_request * wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, uwsgi.mywid);
 }
 
-static ssize_t uwsgi_lf_switches(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->switches);
-	return strlen(*buf);
+static int uwsgi_lf_switches(struct wsgi_request * wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, wsgi_req->switches);
 }
 
-static ssize_t uwsgi_lf_vars(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->var_cnt);
-	return strlen(*buf);
+static int uwsgi_lf_vars(struct wsgi_request * wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, wsgi_req->var_cnt);
 }
 
-static ssize_t uwsgi_lf_core(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->async_id);
-	return strlen(*buf);
+static int uwsgi_lf_core(struct wsgi_request * wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, wsgi_req->async_id);
 }
 
-static ssize_t uwsgi_lf_vsz(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(uwsgi.workers[uwsgi.mywid].vsz_size);
-	return strlen(*buf);
+static int uwsgi_lf_vsz(struct wsgi_request * wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, uwsgi.workers[uwsgi.mywid].vsz_size);
 }
 
-static ssize_t uwsgi_lf_rss(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(uwsgi.workers[uwsgi.mywid].rss_size);
-	return strlen(*buf);
+static int uwsgi_lf_rss(struct wsgi_request * wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, uwsgi.workers[uwsgi.mywid].rss_size);
 }
 
-static ssize_t uwsgi_lf_vszM(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(uwsgi.workers[uwsgi.mywid].vsz_size / 1024 / 1024);
-	return strlen(*buf);
+static int uwsgi_lf_vszM(struct wsgi_request * wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, uwsgi.workers[uwsgi.mywid].vsz_size / 1024 / 1024);
 }
 
-static ssize_t uwsgi_lf_rssM(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(uwsgi.workers[uwsgi.mywid].rss_size / 1024 / 1024);
-	return strlen(*buf);
+static int uwsgi_lf_rssM(struct wsgi_request * wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, uwsgi.workers[uwsgi.mywid].rss_size / 1024 / 1024);
 }
 
-static ssize_t uwsgi_lf_pktsize(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->len);
-	return strlen(*buf);
+static int uwsgi_lf_pktsize(struct wsgi_request * wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, wsgi_req->len);
 }
 
-static ssize_t uwsgi_lf_modifier1(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->uh->modifier1);
-	return strlen(*buf);
+static int uwsgi_lf_modifier1(struct wsgi_request * wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, wsgi_req->uh->modifier1);
 }
 
-static ssize_t uwsgi_lf_modifier2(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->uh->modifier2);
-	return strlen(*buf);
+static int uwsgi_lf_modifier2(struct wsgi_request * wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, wsgi_req->uh->modifier2);
 }
 
-static ssize_t uwsgi_lf_headers(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->header_cnt);
-	return strlen(*buf);
+static int uwsgi_lf_headers(struct wsgi_request * wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, wsgi_req->header_cnt);
 }
 
-static ssize_t uwsgi_lf_werr(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str((int) wsgi_req->write_errors);
-	return strlen(*buf);
+static int uwsgi_lf_werr(struct wsgi_request * wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, (int) wsgi_req->write_errors);
 }
 
-static ssize_t uwsgi_lf_rerr(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str((int) wsgi_req->read_errors);
-	return strlen(*buf);
+static int uwsgi_lf_rerr(struct wsgi_request * wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, (int) wsgi_req->read_errors);
 }
 
-static ssize_t uwsgi_lf_ioerr(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str((int) (wsgi_req->write_errors + wsgi_req->read_errors));
-	return strlen(*buf);
+static int uwsgi_lf_ioerr(struct wsgi_request * wsgi_req, struct uwsgi_buffer *ub) {
+	return uwsgi_buffer_num64(ub, (int) (wsgi_req->write_errors + wsgi_req->read_errors));
+}
+
+// per-stage latency breakdown (requires --req-timing)
+#define uwsgi_lf_stage(x, y) static int uwsgi_lf_ ## x(struct wsgi_request * wsgi_req, struct uwsgi_buffer *ub) {\
+	return uwsgi_buffer_num64(ub, wsgi_req->timing[y]);\
+}
+
+uwsgi_lf_stage(queue_time, UWSGI_REQ_STAGE_QUEUE)
+uwsgi_lf_stage(parse_time, UWSGI_REQ_STAGE_PARSE)
+uwsgi_lf_stage(body_time, UWSGI_REQ_STAGE_BODY)
+uwsgi_lf_stage(routing_time, UWSGI_REQ_STAGE_ROUTING)
+uwsgi_lf_stage(app_time, UWSGI_REQ_STAGE_APP)
+uwsgi_lf_stage(write_time, UWSGI_REQ_STAGE_WRITE)
+uwsgi_lf_stage(close_time, UWSGI_REQ_STAGE_CLOSE)
+
+// W3C traceparent: 00-<32 hex trace-id>-<16 hex parent-id>-<2 hex flags>
+static ssize_t uwsgi_lf_traceparent(struct wsgi_request * wsgi_req, char **buf) {
+	uint16_t len = 0;
+	*buf = uwsgi_get_var(wsgi_req, "HTTP_TRACEPARENT", 16, &len);
+	return len;
+}
+
+static ssize_t uwsgi_lf_trace_id(struct wsgi_request * wsgi_req, char **buf) {
+	uint16_t len = 0;
+	char *tp = uwsgi_get_var(wsgi_req, "HTTP_TRACEPARENT", 16, &len);
+	if (!tp || len < 55 || tp[2] != '-' || tp[35] != '-') return 0;
+	*buf = tp + 3;
+	return 32;
+}
+
+static ssize_t uwsgi_lf_span_id(struct wsgi_request * wsgi_req, char **buf) {
+	uint16_t len = 0;
+	char *tp = uwsgi_get_var(wsgi_req, "HTTP_TRACEPARENT", 16, &len);
+	if (!tp || len < 55 || tp[2] != '-' || tp[35] != '-') return 0;
+	*buf = tp + 36;
+	return 16;
+}
+
+// allocate the per-core line buffers and time caches (called after the logformat has been parsed)
+void uwsgi_setup_log_format(void) {
+	int i;
+	uwsgi.logformat_buffers = uwsgi_malloc(sizeof(struct uwsgi_buffer *) * uwsgi.cores);
+	for (i = 0; i < uwsgi.cores; i++) {
+		uwsgi.logformat_buffers[i] = uwsgi_buffer_new(uwsgi.page_size);
+	}
+	uwsgi_lf_time_caches = uwsgi_calloc(sizeof(struct uwsgi_lf_time_cache) * 3 * uwsgi.cores);
 }
 
 struct uwsgi_logchunk *uwsgi_register_logchunk(char *name, ssize_t (*func)(struct wsgi_request *, char **), int need_free) {
@@ -1305,6 +1450,7 @@ void uwsgi_add_logchunk(int variable, int pos, char *ptr, size_t len) {
 	   3 -> func
 	   4 -> metric
 	   5 -> request variable
+	   6 -> func appending to the line buffer
 	 */
 
 	logchunk->type = variable;
@@ -1325,6 +1471,10 @@ void uwsgi_add_logchunk(int variable, int pos, char *ptr, size_t len) {
 				logchunk->func = rlc->func;
 				logchunk->free = rlc->free;
 			}
+			else if (rlc->type == 6) {
+				logchunk->type = 6;
+				logchunk->append = rlc->append;
+			}
 		}
 		// var
 		else if (!uwsgi_starts_with(ptr, len, "var.", 4)) {
@@ -1346,6 +1496,137 @@ void uwsgi_add_logchunk(int variable, int pos, char *ptr, size_t len) {
 	}
 }
 
+#define UWSGI_LOG_BATCH_MMSG 64
+
+// send the records of a batch, datagram loggers get a sendmmsg() per UWSGI_LOG_BATCH_MMSG lines
+static void uwsgi_log_batch_flush(struct uwsgi_log_batch *ulb, struct uwsgi_buffer *ub) {
+	struct uwsgi_logger *ul = ulb->ul;
+	size_t pos = 0;
+#ifdef __linux__
+	struct mmsghdr msgs[UWSGI_LOG_BATCH_MMSG];
+	struct iovec iovs[UWSGI_LOG_BATCH_MMSG][2];
+	int n = 0;
+#endif
+	while (pos + sizeof(uint32_t) <= ub->pos) {
+		uint32_t len;
+		memcpy(&len, ub->buf + pos, sizeof(uint32_t));
+		char *line = ub->buf + pos + sizeof(uint32_t);
+		pos += sizeof(uint32_t) + len;
+		ulb->lines++;
+#ifdef __linux__
+		// the first line configures the logger
+		if (ul->dgram && ul->configured && ul->fd > -1 && ul->count < 2) {
+			memset(&msgs[n], 0, sizeof(struct mmsghdr));
+			msgs[n].msg_hdr.msg_name = ul->msg.msg_name;
+			msgs[n].msg_hdr.msg_namelen = ul->msg.msg_namelen;
+			msgs[n].msg_hdr.msg_iov = iovs[n];
+			msgs[n].msg_hdr.msg_iovlen = ul->count + 1;
+			if (ul->count > 0) iovs[n][0] = ul->msg.msg_iov[0];
+			iovs[n][ul->count].iov_base = line;
+			iovs[n][ul->count].iov_len = len;
+			n++;
+			if (n < UWSGI_LOG_BATCH_MMSG && pos + sizeof(uint32_t) <= ub->pos) continue;
+			int j;
+			for (j = 0; j < n;) {
+				int ret = sendmmsg(ul->fd, msgs + j, n - j, 0);
+				if (ret <= 0) {
+					ulb->drops += n - j;
+					break;
+				}
+				j += ret;
+			}
+			n = 0;
+			continue;
+		}
+#endif
+		ul->func(ul, line, len);
+	}
+	ulb->flushes++;
+}
+
+static void *uwsgi_log_batch_loop(void *arg) {
+	struct uwsgi_log_batch *ulb = (struct uwsgi_log_batch *) arg;
+
+	// block all signals
+	sigset_t smask;
+	sigfillset(&smask);
+	pthread_sigmask(SIG_BLOCK, &smask, NULL);
+
+	for (;;) {
+		pthread_mutex_lock(&ulb->lock);
+		if (ulb->pending->pos < uwsgi.log_batch_size) {
+			struct timespec ts;
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_sec += uwsgi.log_batch_freq / 1000;
+			ts.tv_nsec += (uwsgi.log_batch_freq % 1000) * 1000000;
+			if (ts.tv_nsec >= 1000000000) {
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000;
+			}
+			pthread_cond_timedwait(&ulb->cond, &ulb->lock, &ts);
+		}
+		struct uwsgi_buffer *ub = ulb->pending;
+		ulb->pending = ulb->flushing;
+		ulb->flushing = ub;
+		pthread_mutex_unlock(&ulb->lock);
+		if (ub->pos > 0) {
+			uwsgi_log_batch_flush(ulb, ub);
+			ub->pos = 0;
+		}
+	}
+	return NULL;
+}
+
+// called by the logging context (master or threaded logger), never blocks on the logger
+static void uwsgi_log_batch_push(struct uwsgi_log_batch *ulb, char *msg, size_t len) {
+	pthread_mutex_lock(&ulb->lock);
+	// the thread is spawned lazily, in the master
+	if (!ulb->spawned) {
+		pthread_t t;
+		ulb->spawned = 1;
+		if (pthread_create(&t, NULL, uwsgi_log_batch_loop, ulb)) {
+			uwsgi_error("uwsgi_log_batch_push()/pthread_create()");
+			ulb->spawned = -1;
+		}
+	}
+	if (ulb->spawned < 0) {
+		pthread_mutex_unlock(&ulb->lock);
+		ulb->ul->func(ulb->ul, msg, len);
+		return;
+	}
+	if (ulb->pending->pos + sizeof(uint32_t) + len > uwsgi.log_batch_max) {
+		ulb->drops++;
+		goto end;
+	}
+	uint32_t rlen = len;
+	if (uwsgi_buffer_append(ulb->pending, (char *) &rlen, sizeof(uint32_t))) goto end;
+	if (uwsgi_buffer_append(ulb->pending, msg, len)) goto end;
+	if (ulb->pending->pos >= uwsgi.log_batch_size) {
+		pthread_cond_signal(&ulb->cond);
+	}
+end:
+	pthread_mutex_unlock(&ulb->lock);
+}
+
+static void uwsgi_log_batch_setup(struct uwsgi_logger *ul) {
+	for (; ul; ul = ul->next) {
+		struct uwsgi_string_list *usl;
+		uwsgi_foreach(usl, uwsgi.log_batch) {
+			if (!strcmp(usl->value, "all") || !strcmp(usl->value, ul->name) || (ul->id && !strcmp(usl->value, ul->id))) break;
+		}
+		if (!usl) continue;
+		struct uwsgi_log_batch *ulb = uwsgi_calloc(sizeof(struct uwsgi_log_batch));
+		ulb->ul = ul;
+		pthread_mutex_init(&ulb->lock, NULL);
+		pthread_cond_init(&ulb->cond, NULL);
+		ulb->pending = uwsgi_buffer_new(uwsgi.log_batch_size);
+		ulb->flushing = uwsgi_buffer_new(uwsgi.log_batch_size);
+		ulb->next = uwsgi.log_batches;
+		uwsgi.log_batches = ulb;
+		ul->batch = ulb;
+	}
+}
+
 static void uwsgi_log_func_do(struct uwsgi_string_list *encoders, struct uwsgi_logger *ul, char *msg, size_t len) {
 	struct uwsgi_string_list *usl = encoders;
 	// note: msg must not be freed !!!
@@ -1374,7 +1655,12 @@ next:
 		usl = usl->next;
 	}
 	if (ul) {
-		ul->func(ul, new_msg, new_msg_len);
+		if (ul->batch) {
+			uwsgi_log_batch_push(ul->batch, new_msg, new_msg_len);
+		}
+		else {
+			ul->func(ul, new_msg, new_msg_len);
+		}
 	}
 	else {
 		new_msg_len = (size_t) write(uwsgi.original_log_fd, new_msg, new_msg_len);
@@ -1451,48 +1737,77 @@ next:
         return -1;
 }
 
-int uwsgi_master_req_log(void) {
-
-        ssize_t rlen = read(uwsgi.shared->worker_req_log_pipe[0], uwsgi.log_master_buf, uwsgi.log_master_bufsize);
-        if (rlen > 0) {
+static void uwsgi_req_log_dispatch(ssize_t rlen) {
 #ifdef UWSGI_PCRE
-                struct uwsgi_regexp_list *url = uwsgi.log_req_route;
-                int finish = 0;
-                while (url) {
-                        if (uwsgi_regexp_match(url->pattern, url->pattern_extra, uwsgi.log_master_buf, rlen) >= 0) {
-                                struct uwsgi_logger *ul_route = (struct uwsgi_logger *) url->custom_ptr;
-                                if (ul_route) {
-                                        uwsgi_log_func_do(uwsgi.requested_log_req_encoders, ul_route, uwsgi.log_master_buf, rlen);
-                                        finish = 1;
-                                }
-                        }
-                        url = url->next;
-                }
-                if (finish)
-                        return 0;
+	struct uwsgi_regexp_list *url = uwsgi.log_req_route;
+	int finish = 0;
+	while (url) {
+		if (uwsgi_regexp_match(url->pattern, url->pattern_extra, uwsgi.log_master_buf, rlen) >= 0) {
+			struct uwsgi_logger *ul_route = (struct uwsgi_logger *) url->custom_ptr;
+			if (ul_route) {
+				uwsgi_log_func_do(uwsgi.requested_log_req_encoders, ul_route, uwsgi.log_master_buf, rlen);
+				finish = 1;
+			}
+		}
+		url = url->next;
+	}
+	if (finish)
+		return;
 #endif
 
-                int raw_log = 1;
+	int raw_log = 1;
 
-                struct uwsgi_logger *ul = uwsgi.choosen_req_logger;
-                while (ul) {
-                        // check for named logger
-                        if (ul->id) {
-                                goto next;
-                        }
-                        uwsgi_log_func_do(uwsgi.requested_log_req_encoders, ul, uwsgi.log_master_buf, rlen);
-                        raw_log = 0;
+	struct uwsgi_logger *ul = uwsgi.choosen_req_logger;
+	while (ul) {
+		// check for named logger
+		if (ul->id) {
+			goto next;
+		}
+		uwsgi_log_func_do(uwsgi.requested_log_req_encoders, ul, uwsgi.log_master_buf, rlen);
+		raw_log = 0;
 next:
-                        ul = ul->next;
-                }
+		ul = ul->next;
+	}
 
-                if (raw_log) {
-			uwsgi_log_func_do(uwsgi.requested_log_req_encoders, NULL, uwsgi.log_master_buf, rlen);
-                }
-                return 0;
-        }
+	if (raw_log) {
+		uwsgi_log_func_do(uwsgi.requested_log_req_encoders, NULL, uwsgi.log_master_buf, rlen);
+	}
+}
 
-        return -1;
+int uwsgi_master_req_log(void) {
+
+	ssize_t rlen = read(uwsgi.shared->worker_req_log_pipe[0], uwsgi.log_master_buf, uwsgi.log_master_bufsize);
+	if (rlen > 0) {
+		uwsgi_req_log_dispatch(rlen);
+		return 0;
+	}
+
+	return -1;
+}
+
+// the logger thread side: consume all of the records available in the rings of the workers
+static uint64_t uwsgi_req_log_ring_drain(void) {
+	uint64_t records = 0;
+	int i, j;
+	for (i = 1; i <= uwsgi.numproc; i++) {
+		for (j = 0; j < uwsgi.cores; j++) {
+			struct uwsgi_log_ring *ring = uwsgi.workers[i].cores[j].req_log_ring;
+			if (!ring) continue;
+			uint64_t tail = ring->tail;
+			uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+			while (tail < head) {
+				uint32_t rlen = 0;
+				log_ring_copy_out(ring, tail, (char *) &rlen, sizeof(uint32_t));
+				log_ring_copy_out(ring, tail + sizeof(uint32_t), uwsgi.log_master_buf, rlen);
+				tail += sizeof(uint32_t) + rlen;
+				// give the space back as soon as possible
+				__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+				uwsgi_req_log_dispatch(rlen);
+				records++;
+			}
+		}
+	}
+	return records;
 }
 
 static void *logger_thread_loop(void *noarg) {
@@ -1511,11 +1826,19 @@ static void *logger_thread_loop(void *noarg) {
         if (uwsgi.req_log_master) {
                 logpoll[1].events = POLLIN;
                 logpoll[1].fd = uwsgi.shared->worker_req_log_pipe[0];
+                logpolls++;
         }
 
+	// rings are polled, without waking up the logger from the workers
+	int timeout = uwsgi.req_log_ring ? UWSGI_REQ_LOG_RING_POLL : -1;
 
         for (;;) {
-                int ret = poll(logpoll, logpolls, -1);
+                int ret = poll(logpoll, logpolls, timeout);
+		if (uwsgi.req_log_ring && ret >= 0) {
+			pthread_mutex_lock(&uwsgi.threaded_logger_lock);
+			uwsgi_req_log_ring_drain();
+			pthread_mutex_unlock(&uwsgi.threaded_logger_lock);
+		}
                 if (ret > 0) {
                         if (logpoll[0].revents & POLLIN) {
                                 pthread_mutex_lock(&uwsgi.threaded_logger_lock);
@@ -1909,7 +2232,8 @@ end:
         return buf;
 }
 
-#define r_logchunk(x) uwsgi_register_logchunk(#x, uwsgi_lf_ ## x, 1)
+#define r_logchunk(x) uwsgi_register_logchunk(#x, uwsgi_lf_ ## x, 0)
+#define r_logchunk_append(x) { struct uwsgi_logchunk *lc = uwsgi_register_logchunk(#x, NULL, 0); lc->append = uwsgi_lf_ ## x; lc->type = 6;}
 #define r_logchunk_offset(x, y) { struct uwsgi_logchunk *lc = uwsgi_register_logchunk(#x, NULL, 0); lc->pos = offsetof(struct wsgi_request, y); lc->pos_len = offsetof(struct wsgi_request, y ## _len); lc->type = 1; lc->free=0;}
 void uwsgi_register_logchunks() {
 	// offsets
@@ -1923,36 +2247,46 @@ void uwsgi_register_logchunks() {
 	r_logchunk_offset(referer, referer);
 
 	// funcs
-	r_logchunk(status);
-	r_logchunk(rsize);
-	r_logchunk(hsize);
-	r_logchunk(size);
-	r_logchunk(cl);
-	r_logchunk(micros);
-	r_logchunk(msecs);
-	r_logchunk(tmsecs);
-	r_logchunk(tmicros);
-	r_logchunk(time);
+	r_logchunk_append(status);
+	r_logchunk_append(rsize);
+	r_logchunk_append(hsize);
+	r_logchunk_append(size);
+	r_logchunk_append(cl);
+	r_logchunk_append(micros);
+	r_logchunk_append(msecs);
+	r_logchunk_append(tmsecs);
+	r_logchunk_append(tmicros);
+	r_logchunk_append(time);
 	r_logchunk(ltime);
 	r_logchunk(ftime);
 	r_logchunk(ctime);
-	r_logchunk(epoch);
-	r_logchunk(pid);
-	r_logchunk(wid);
-	r_logchunk(switches);
-	r_logchunk(vars);
-	r_logchunk(core);
-	r_logchunk(vsz);
-	r_logchunk(rss);
-	r_logchunk(vszM);
-	r_logchunk(rssM);
-	r_logchunk(pktsize);
-	r_logchunk(modifier1);
-	r_logchunk(modifier2);
-	r_logchunk(headers);
-	r_logchunk(werr);
-	r_logchunk(rerr);
-	r_logchunk(ioerr);
+	r_logchunk_append(epoch);
+	r_logchunk_append(pid);
+	r_logchunk_append(wid);
+	r_logchunk_append(switches);
+	r_logchunk_append(vars);
+	r_logchunk_append(core);
+	r_logchunk_append(vsz);
+	r_logchunk_append(rss);
+	r_logchunk_append(vszM);
+	r_logchunk_append(rssM);
+	r_logchunk_append(pktsize);
+	r_logchunk_append(modifier1);
+	r_logchunk_append(modifier2);
+	r_logchunk_append(headers);
+	r_logchunk_append(werr);
+	r_logchunk_append(rerr);
+	r_logchunk_append(ioerr);
+	r_logchunk_append(queue_time);
+	r_logchunk_append(parse_time);
+	r_logchunk_append(body_time);
+	r_logchunk_append(routing_time);
+	r_logchunk_append(app_time);
+	r_logchunk_append(write_time);
+	r_logchunk_append(close_time);
+	r_logchunk(traceparent);
+	r_logchunk(trace_id);
+	r_logchunk(span_id);
 }
 
 void uwsgi_log_encoders_register_embedded() {
@@ -129,6 +129,10 @@ void *simple_loop_run(void *arg1) {
 	if (uwsgi.signal_socket > -1) {
 		event_queue_add_fd_read(main_queue, uwsgi.signal_socket);
 		event_queue_add_fd_read(main_queue, uwsgi.my_signal_socket);
+		// only this thread is woken up by signals targeting this core
+		if (uwsgi.workers[uwsgi.mywid].cores[core_id].signal_pipe[1] > -1) {
+			event_queue_add_fd_read(main_queue, uwsgi.workers[uwsgi.mywid].cores[core_id].signal_pipe[1]);
+		}
 	}
 
 
@@ -164,3 +168,85 @@ void *simple_loop_run(void *arg1) {
 	}
 	return NULL;
 }
+
+static void *worker_warmup_drain(void *arg) {
+	int fd = (long) arg;
+	char buf[8192];
+	while (read(fd, buf, 8192) > 0);
+	return NULL;
+}
+
+/*
+	run the --worker-warmup requests (plain HTTP GET) through the apps of the worker, using
+	a socketpair as the client connection. Responses are discarded.
+*/
+void uwsgi_worker_warmup() {
+
+	// only the standard loop can run a request synchronously
+	if (uwsgi.async > 0 || uwsgi.loop) {
+		uwsgi_log("worker warmup is not supported with async modes or custom loop engines\n");
+		return;
+	}
+
+	struct uwsgi_socket warmup_sock;
+	memset(&warmup_sock, 0, sizeof(struct uwsgi_socket));
+	warmup_sock.name = "warmup";
+	warmup_sock.name_len = 6;
+	warmup_sock.family = AF_UNIX;
+	warmup_sock.fd = -1;
+	uwsgi_socket_setup_protocol(&warmup_sock, "http");
+
+	struct wsgi_request *wsgi_req = &uwsgi.workers[uwsgi.mywid].cores[0].req;
+	if (uwsgi.threads > 1) {
+		uwsgi_setup_thread_req(0, wsgi_req);
+	}
+
+	struct uwsgi_string_list *usl;
+	uwsgi_foreach(usl, uwsgi.worker_warmup) {
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+			uwsgi_error("uwsgi_worker_warmup()/socketpair()");
+			return;
+		}
+
+		char *request = uwsgi_concat3("GET ", usl->value, " HTTP/1.0\r\nHost: localhost\r\nUser-Agent: uWSGI warmup\r\n\r\n");
+		size_t request_len = strlen(request);
+		if (write(fds[0], request, request_len) != (ssize_t) request_len) {
+			uwsgi_error("uwsgi_worker_warmup()/write()");
+			free(request);
+			close(fds[0]);
+			close(fds[1]);
+			continue;
+		}
+		free(request);
+
+		pthread_t t;
+		if (pthread_create(&t, NULL, worker_warmup_drain, (void *) (long) fds[0])) {
+			uwsgi_error("uwsgi_worker_warmup()/pthread_create()");
+			close(fds[0]);
+			close(fds[1]);
+			return;
+		}
+
+		uint64_t start = uwsgi_micros();
+		wsgi_req_setup(wsgi_req, 0, &warmup_sock);
+		wsgi_req->fd = fds[1];
+		wsgi_req->do_not_log = 1;
+		wsgi_req->do_not_account = 1;
+		wsgi_req->do_not_account_avg_rt = 1;
+		if (wsgi_req_recv(-1, wsgi_req)) {
+			uwsgi_log("[warmup] worker %d: request %s failed\n", uwsgi.mywid, usl->value);
+			uwsgi_destroy_request(wsgi_req);
+		}
+		else {
+			uwsgi_close_request(wsgi_req);
+			uwsgi_log("[warmup] worker %d: %s done in %llu msecs\n", uwsgi.mywid, usl->value, (unsigned long long) ((uwsgi_micros() - start) / 1000));
+		}
+
+		// the request closed its side of the pair
+		pthread_join(t, NULL);
+		close(fds[0]);
+	}
+
+	memset(wsgi_req, 0, sizeof(struct wsgi_request));
+}
@@ -83,50 +83,55 @@ void uwsgi_unblock_signal(int signum) {
 	}
 }
 
-void uwsgi_master_manage_udp(int udp_fd) {
-	char buf[4096];
-	struct sockaddr_in udp_client;
+static void uwsgi_master_manage_udp_packet(int udp_fd, char *buf, ssize_t rlen, struct sockaddr_in *udp_client) {
 	char udp_client_addr[16];
 	int i;
 
-	socklen_t udp_len = sizeof(udp_client);
-	ssize_t rlen = recvfrom(udp_fd, buf, 4096, 0, (struct sockaddr *) &udp_client, &udp_len);
-
-	if (rlen < 0) {
-		uwsgi_error("uwsgi_master_manage_udp()/recvfrom()");
-	}
-	else if (rlen > 0) {
-
-		memset(udp_client_addr, 0, 16);
-		if (inet_ntop(AF_INET, &udp_client.sin_addr.s_addr, udp_client_addr, 16)) {
-			if (buf[0] == UWSGI_MODIFIER_MULTICAST_ANNOUNCE) {
-			}
-			else if (buf[0] == 0x30 && uwsgi.snmp) {
-				manage_snmp(udp_fd, (uint8_t *) buf, rlen, &udp_client);
-			}
-			else {
+	memset(udp_client_addr, 0, 16);
+	if (inet_ntop(AF_INET, &udp_client->sin_addr.s_addr, udp_client_addr, 16)) {
+		if (buf[0] == UWSGI_MODIFIER_MULTICAST_ANNOUNCE) {
+		}
+		else if (buf[0] == 0x30 && uwsgi.snmp) {
+			manage_snmp(udp_fd, (uint8_t *) buf, rlen, udp_client);
+		}
+		else {
 
-				// loop the various udp manager until one returns true
-				int udp_managed = 0;
-				for (i = 0; i < 256; i++) {
-					if (uwsgi.p[i]->manage_udp) {
-						if (uwsgi.p[i]->manage_udp(udp_client_addr, udp_client.sin_port, buf, rlen)) {
-							udp_managed = 1;
-							break;
-						}
+			// loop the various udp manager until one returns true
+			int udp_managed = 0;
+			for (i = 0; i < 256; i++) {
+				if (uwsgi.p[i]->manage_udp) {
+					if (uwsgi.p[i]->manage_udp(udp_client_addr, udp_client->sin_port, buf, rlen)) {
+						udp_managed = 1;
+						break;
 					}
 				}
+			}
 
-				// else a simple udp logger
-				if (!udp_managed) {
-					uwsgi_log("[udp:%s:%d] %.*s", udp_client_addr, ntohs(udp_client.sin_port), (int) rlen, buf);
-				}
+			// else a simple udp logger
+			if (!udp_managed) {
+				uwsgi_log("[udp:%s:%d] %.*s", udp_client_addr, ntohs(udp_client->sin_port), (int) rlen, buf);
 			}
 		}
-		else {
-			uwsgi_error("uwsgi_master_manage_udp()/inet_ntop()");
-		}
+	}
+	else {
+		uwsgi_error("uwsgi_master_manage_udp()/inet_ntop()");
+	}
+}
 
+// all of the queued datagrams are received with a single syscall
+void uwsgi_master_manage_udp(int udp_fd) {
+	static struct uwsgi_dgram_batch *udb = NULL;
+	if (!udb) udb = uwsgi_dgram_batch_new(UWSGI_DGRAM_BATCH, 4096);
+
+	int i, n = uwsgi_dgram_batch_recv(udp_fd, udb);
+	if (n < 0) {
+		uwsgi_error("uwsgi_master_manage_udp()/recvmmsg()");
+		return;
+	}
+
+	for(i=0;i<n;i++) {
+		if (udb->len[i] <= 0) continue;
+		uwsgi_master_manage_udp_packet(udp_fd, uwsgi_dgram_batch_buf(udb, i), udb->len[i], (struct sockaddr_in *) &udb->addr[i]);
 	}
 }
 
@@ -266,21 +271,39 @@ static void get_linux_unbit_SIOBKLGQ(struct uwsgi_socket *uwsgi_sock) {
 #endif
 #endif
 
+void uwsgi_update_listen_queue(struct uwsgi_socket *uwsgi_sock) {
+	if (uwsgi_sock->family == AF_INET) {
+		get_tcp_info(uwsgi_sock);
+	}
+#ifdef __linux__
+#ifdef SIOBKLGQ
+	else if (uwsgi_sock->family == AF_UNIX) {
+		get_linux_unbit_SIOBKLGQ(uwsgi_sock);
+	}
+#endif
+#endif
+}
+
+// quick probe of the listen queues (no alarms or logging), used by the predict cheaper algo
+uint64_t uwsgi_master_sample_listen_queue() {
+	uint64_t backlog = 0;
+	struct uwsgi_socket *uwsgi_sock = uwsgi.sockets;
+	while(uwsgi_sock) {
+		uwsgi_update_listen_queue(uwsgi_sock);
+		if (uwsgi_sock->queue > backlog) {
+			backlog = uwsgi_sock->queue;
+		}
+		uwsgi_sock = uwsgi_sock->next;
+	}
+	return backlog;
+}
+
 static void master_check_listen_queue() {
 
 	uint64_t backlog = 0;
 	struct uwsgi_socket *uwsgi_sock = uwsgi.sockets;
 	while(uwsgi_sock) {
-		if (uwsgi_sock->family == AF_INET) {
-			get_tcp_info(uwsgi_sock);
-                }
-#ifdef __linux__
-#ifdef SIOBKLGQ
-                else if (uwsgi_sock->family == AF_UNIX) {
-                	get_linux_unbit_SIOBKLGQ(uwsgi_sock);
-                }
-#endif
-#endif
+		uwsgi_update_listen_queue(uwsgi_sock);
 
 		if (uwsgi_sock->queue > backlog) {
 			backlog = uwsgi_sock->queue;
@@ -305,6 +328,7 @@ static void master_check_listen_queue() {
 	// TODO load should be something more advanced based on different values
 	uwsgi.shared->load = backlog;
 
+	// the async loops accept in batches while it is not 0 (see uwsgi_accept_batch())
 	uwsgi.shared->backlog = backlog;
 
         if (uwsgi.vassal_sos_backlog > 0 && uwsgi.has_emperor) {
@@ -327,6 +351,79 @@ void vassal_sos() {
         }
 }
 
+/*
+	react to touch-* files changes, returns 1 when the rest of the master cycle has to be skipped.
+	Called every master cycle and when the fsmon subsystem reports an event on them
+*/
+int uwsgi_master_check_touches() {
+	if (!uwsgi_instance_is_reloading && !uwsgi_instance_is_dying) {
+		char *touched = uwsgi_check_touches(uwsgi.touch_reload);
+		if (touched) {
+			uwsgi_log_verbose("*** %s has been touched... grace them all !!! ***\n", touched);
+			uwsgi_block_signal(SIGHUP);
+			grace_them_all(0);
+			uwsgi_unblock_signal(SIGHUP);
+			return 1;
+		}
+		touched = uwsgi_check_touches(uwsgi.touch_workers_reload);
+		if (touched) {
+			uwsgi_log_verbose("*** %s has been touched... workers reload !!! ***\n", touched);
+			uwsgi_reload_workers();
+			return 1;
+		}
+		touched = uwsgi_check_touches(uwsgi.touch_chain_reload);
+		if (touched) {
+			if (uwsgi.status.chain_reloading == 0) {
+				uwsgi_log_verbose("*** %s has been touched... chain reload !!! ***\n", touched);
+				uwsgi.status.chain_reloading = 1;
+			}
+			else {
+				uwsgi_log_verbose("*** %s has been touched... but chain reload is already running ***\n", touched);
+			}
+		}
+
+		// be sure to run it as the last touch check
+		touched = uwsgi_check_touches(uwsgi.touch_exec);
+		if (touched) {
+			if (uwsgi_run_command(touched, NULL, -1) >= 0) {
+				uwsgi_log_verbose("[uwsgi-touch-exec] running %s\n", touched);
+			}
+		}
+		touched = uwsgi_check_touches(uwsgi.touch_signal);
+		if (touched) {
+			uint8_t signum = atoi(touched);
+			uwsgi_route_signal(signum);
+			uwsgi_log_verbose("[uwsgi-touch-signal] raising %u\n", signum);
+		}
+
+		// daemon touches
+        			struct uwsgi_daemon *ud = uwsgi.daemons;
+        			while (ud) {
+                			if (ud->pid > 0 && ud->touch) {
+                        			touched = uwsgi_check_touches(ud->touch);
+				if (touched) {
+					uwsgi_log_verbose("*** %s has been touched... reloading daemon \"%s\" (pid: %d) !!! ***\n", touched, ud->command, (int) ud->pid);
+					if (kill(-ud->pid, ud->stop_signal)) {
+						// killing process group failed, try to kill by process id
+						if (kill(ud->pid, ud->stop_signal)) {
+							uwsgi_error("[uwsgi-daemon/touch] kill()");
+						}
+					}
+				}
+                			}
+			ud = ud->next;
+                		}
+
+		// hook touches
+		touched = uwsgi_check_touches(uwsgi.hook_touch);
+		if (touched) {
+			uwsgi_hooks_run((struct uwsgi_string_list *) touched, "touch", 0);
+		}
+
+	}
+	return 0;
+}
+
 int master_loop(char **argv, char **environ) {
 
 	struct timeval last_respawn;
@@ -370,6 +467,8 @@ int master_loop(char **argv, char **environ) {
 	atexit(uwsgi_master_cleanup_hooks);
 
 	uwsgi.master_queue = event_queue_init();
+	// the processes forked until now
+	uwsgi_master_watch_pids_start();
 
 	/* route signals to workers... */
 #ifdef UWSGI_DEBUG
@@ -396,6 +495,10 @@ int master_loop(char **argv, char **environ) {
 		event_queue_add_fd_read(uwsgi.master_queue, uwsgi.shared->mule_signal_pipe[0]);
 	}
 
+	if (uwsgi.shared->harakiri_pipe[0] > -1) {
+		event_queue_add_fd_read(uwsgi.master_queue, uwsgi.shared->harakiri_pipe[0]);
+	}
+
 	if (uwsgi.log_master) {
 		uwsgi.log_master_buf = uwsgi_malloc(uwsgi.log_master_bufsize);
 		if (!uwsgi.threaded_logger) {
@@ -475,6 +578,22 @@ int master_loop(char **argv, char **environ) {
 		uwsgi_log("*** Stats server enabled on %s fd: %d ***\n", uwsgi.stats, uwsgi.stats_fd);
 	}
 
+	if (uwsgi.stats_binary) {
+		char *tcp_port = strrchr(uwsgi.stats_binary, ':');
+		if (tcp_port) {
+			int current_defer_accept = uwsgi.no_defer_accept;
+			uwsgi.no_defer_accept = 1;
+			uwsgi.stats_binary_fd = bind_to_tcp(uwsgi.stats_binary, uwsgi.listen_queue, tcp_port);
+			uwsgi.no_defer_accept = current_defer_accept;
+		}
+		else {
+			uwsgi.stats_binary_fd = bind_to_unix(uwsgi.stats_binary, uwsgi.listen_queue, uwsgi.chmod_socket, uwsgi.abstract_socket);
+		}
+
+		event_queue_add_fd_read(uwsgi.master_queue, uwsgi.stats_binary_fd);
+		uwsgi_log("*** Binary stats server enabled on %s fd: %d ***\n", uwsgi.stats_binary, uwsgi.stats_binary_fd);
+	}
+
 
 	if (uwsgi.stats_pusher_instances) {
 		if (!uwsgi_thread_new(uwsgi_stats_pusher_loop)) {
@@ -587,6 +706,20 @@ int master_loop(char **argv, char **environ) {
 	// fsmon
 	uwsgi_fsmon_setup();
 
+	// from now on the touch-* files are stat()ed only on filesystem events (if possible)
+	uwsgi_fsmon_touches_add(uwsgi.touch_reload);
+	uwsgi_fsmon_touches_add(uwsgi.touch_logrotate);
+	uwsgi_fsmon_touches_add(uwsgi.touch_logreopen);
+	uwsgi_fsmon_touches_add(uwsgi.touch_chain_reload);
+	uwsgi_fsmon_touches_add(uwsgi.touch_workers_reload);
+	uwsgi_fsmon_touches_add(uwsgi.touch_gracefully_stop);
+	uwsgi_fsmon_touches_add(uwsgi.touch_exec);
+	uwsgi_fsmon_touches_add(uwsgi.touch_signal);
+	uwsgi_fsmon_touches_add(uwsgi.hook_touch);
+	for (ud = uwsgi.daemons; ud; ud = ud->next) {
+		if (ud->touch) uwsgi_fsmon_touches_add(ud->touch);
+	}
+
 	uwsgi_foreach(usl, uwsgi.signal_timers) {
 		char *space = strchr(usl->value, ' ');
 		if (!space) {
@@ -629,6 +762,8 @@ int master_loop(char **argv, char **environ) {
 
 	}
 
+	uwsgi_master_memory_pressure_init();
+
 	// here really starts the master loop
 	uwsgi_hooks_run(uwsgi.hook_master_start, "master-start", 1);
 
@@ -749,8 +884,28 @@ int master_loop(char **argv, char **environ) {
 				}
 			}
 
+			int wait_ms = check_interval * 1000;
+			// wake up for the first harakiri deadline
+			uint64_t next_harakiri = uwsgi_master_next_harakiri();
+			if (next_harakiri) {
+				uint64_t now_ms = uwsgi_micros() / 1000;
+				if (next_harakiri <= now_ms) {
+					wait_ms = 0;
+				}
+				else if (next_harakiri - now_ms < (uint64_t) wait_ms) {
+					wait_ms = next_harakiri - now_ms;
+				}
+			}
+
+			// the predict cheaper algo samples at sub-second intervals
+			if (uwsgi.cheaper && uwsgi.cheaper_algo == uwsgi_cheaper_algo_predict && uwsgi.cheaper_sample_ms > 0 && wait_ms > uwsgi.cheaper_sample_ms) {
+				wait_ms = uwsgi.cheaper_sample_ms;
+			}
+
+			ushared->master_wakeup = (uwsgi_micros() / 1000) + wait_ms;
+
 			// wait for event
-			rlen = event_queue_wait(uwsgi.master_queue, check_interval, &interesting_fd);
+			rlen = event_queue_wait_ms(uwsgi.master_queue, wait_ms, &interesting_fd);
 
 			if (rlen == 0) {
 				if (ushared->rb_timers_cnt > 0) {
@@ -763,6 +918,9 @@ int master_loop(char **argv, char **environ) {
 
 			master_check_processes();
 
+			// harakiri has sub-second resolution
+			uwsgi_master_check_workers_harakiri();
+
 
 			// check uwsgi-cron table
 			if (ushared->cron_cnt) {
@@ -802,6 +960,18 @@ int master_loop(char **argv, char **environ) {
 			// check for idle
 			uwsgi_master_check_idle();
 
+			// tell the Emperor we are serving requests
+			uwsgi_master_report_activity();
+
+			// tell the zergpools about our load
+			uwsgi_master_report_zerg_load();
+
+			uwsgi_master_check_memory_pressure();
+#ifdef __linux__
+			uwsgi_master_check_idle_workers_memory();
+			uwsgi_master_taskstats();
+#endif
+
 			check_interval = uwsgi.master_interval;
 			if (!check_interval) {
 				check_interval = 1;
@@ -838,6 +1008,12 @@ int master_loop(char **argv, char **environ) {
 
 			uwsgi_cache_sync_all();
 
+#ifdef UWSGI_SSL
+			if (uwsgi.ssl_tickets) {
+				uwsgi_ssl_tickets_rotate();
+			}
+#endif
+
 			if (uwsgi.queue_store && uwsgi.queue_filesize && uwsgi.queue_store_sync && ((uwsgi.master_cycles % uwsgi.queue_store_sync) == 0)) {
 				if (msync(uwsgi.queue_header, uwsgi.queue_filesize, MS_ASYNC)) {
 					uwsgi_error("msync()");
@@ -845,71 +1021,7 @@ int master_loop(char **argv, char **environ) {
 			}
 
 			// check touch_reload
-			if (!uwsgi_instance_is_reloading && !uwsgi_instance_is_dying) {
-				char *touched = uwsgi_check_touches(uwsgi.touch_reload);
-				if (touched) {
-					uwsgi_log_verbose("*** %s has been touched... grace them all !!! ***\n", touched);
-					uwsgi_block_signal(SIGHUP);
-					grace_them_all(0);
-					uwsgi_unblock_signal(SIGHUP);
-					continue;
-				}
-				touched = uwsgi_check_touches(uwsgi.touch_workers_reload);
-				if (touched) {
-					uwsgi_log_verbose("*** %s has been touched... workers reload !!! ***\n", touched);
-					uwsgi_reload_workers();
-					continue;
-				}
-				touched = uwsgi_check_touches(uwsgi.touch_chain_reload);
-				if (touched) {
-					if (uwsgi.status.chain_reloading == 0) {
-						uwsgi_log_verbose("*** %s has been touched... chain reload !!! ***\n", touched);
-						uwsgi.status.chain_reloading = 1;
-					}
-					else {
-						uwsgi_log_verbose("*** %s has been touched... but chain reload is already running ***\n", touched);
-					}
-				}
-
-				// be sure to run it as the last touch check
-				touched = uwsgi_check_touches(uwsgi.touch_exec);
-				if (touched) {
-					if (uwsgi_run_command(touched, NULL, -1) >= 0) {
-						uwsgi_log_verbose("[uwsgi-touch-exec] running %s\n", touched);
-					}
-				}
-				touched = uwsgi_check_touches(uwsgi.touch_signal);
-				if (touched) {
-					uint8_t signum = atoi(touched);
-					uwsgi_route_signal(signum);
-					uwsgi_log_verbose("[uwsgi-touch-signal] raising %u\n", signum);
-				}
-
-				// daemon touches
-        			struct uwsgi_daemon *ud = uwsgi.daemons;
-        			while (ud) {
-                			if (ud->pid > 0 && ud->touch) {
-                        			touched = uwsgi_check_touches(ud->touch);
-						if (touched) {
-							uwsgi_log_verbose("*** %s has been touched... reloading daemon \"%s\" (pid: %d) !!! ***\n", touched, ud->command, (int) ud->pid);
-							if (kill(-ud->pid, ud->stop_signal)) {
-								// killing process group failed, try to kill by process id
-								if (kill(ud->pid, ud->stop_signal)) {
-									uwsgi_error("[uwsgi-daemon/touch] kill()");
-								}
-							}
-						}
-                			}
-					ud = ud->next;
-                		}
-
-				// hook touches
-				touched = uwsgi_check_touches(uwsgi.hook_touch);
-				if (touched) {
-					uwsgi_hooks_run((struct uwsgi_string_list *) touched, "touch", 0);
-				}
-
-			}
+			if (uwsgi_master_check_touches()) continue;
 
 			// allows the KILL signal to be delivered;
 			if (someone_killed > 0) sleep(1);
@@ -933,6 +1045,8 @@ int master_loop(char **argv, char **environ) {
 				continue;
 			if (uwsgi_master_check_mules_death(diedpid))
 				continue;
+			if (uwsgi_master_check_zygote_death(diedpid))
+				continue;
 			if (uwsgi_master_check_gateways_death(diedpid))
 				continue;
 			if (uwsgi_master_check_daemons_death(diedpid))
@@ -1001,7 +1115,9 @@ next:
 		// only to be safe :P
 		for(i=0;i<uwsgi.cores;i++) {
 			uwsgi.workers[thewid].cores[i].harakiri = 0;
+			uwsgi.workers[thewid].cores[i].harakiri_deadline = 0;
 		}
+		uwsgi.workers[thewid].harakiri_next = 0;
 
 		// ok, if we are reloading or dying, just continue the master loop
 		// as soon as all of the workers have pid == 0, the action (exit, or reload) is triggered
@@ -1081,11 +1197,6 @@ next:
 		gettimeofday(&last_respawn, NULL);
 		uwsgi.respawn_delta = last_respawn.tv_sec;
 
-		// are we chain reloading it ?
-		if (uwsgi.status.chain_reloading == thewid) {
-			uwsgi.status.chain_reloading++;
-		}
-
 		// respawn the worker (if needed)
 		if (uwsgi_respawn_worker(thewid))
 			return 0;
@@ -1098,6 +1209,8 @@ next:
 
 void uwsgi_reload_workers() {
 	int i;
+	// new workers must get the new code
+	uwsgi_zygote_reload();
 	uwsgi_block_signal(SIGHUP);
 	for (i = 1; i <= uwsgi.numproc; i++) {
 		if (uwsgi.workers[i].pid > 0) {
@@ -11,6 +11,7 @@ void uwsgi_master_check_death() {
 				return;
 			}
 		}
+		uwsgi_cache_flush_all();
 		uwsgi_log("goodbye to uWSGI.\n");
 		exit(0);
 	}
@@ -30,6 +31,7 @@ int uwsgi_master_check_reload(char **argv) {
 				return 0;
 			}
 		}
+		uwsgi_cache_flush_all();
 		uwsgi_reload(argv);
 		// never here (unless in shared library mode)
 		return -1;
@@ -40,48 +42,56 @@ int uwsgi_master_check_reload(char **argv) {
 // check for chain reload
 void uwsgi_master_check_chain() {
 	static time_t last_check = 0;
+	static int zygote_reloaded = 0;
 
 	if (!uwsgi.status.chain_reloading) return;
 
-	// we need to ensure the previous worker (if alive) is accepting new requests
-	// before going on
-	if (uwsgi.status.chain_reloading > 1) {
-		struct uwsgi_worker *previous_worker = &uwsgi.workers[uwsgi.status.chain_reloading-1];
-		// is the previous worker alive ?
-		if (previous_worker->pid > 0 && !previous_worker->cheaped) {
-			// the worker has been respawned but it is still not ready
-			if (previous_worker->accepting == 0) {
-				time_t now = uwsgi_now();
-				if (now != last_check) {
-					uwsgi_log_verbose("chain is still waiting for worker %d...\n", uwsgi.status.chain_reloading-1);
-					last_check = now;
-				}
-				return;
-			}
+	// the new workers must get the new code
+	if (!zygote_reloaded) {
+		uwsgi_zygote_reload();
+		zygote_reloaded = 1;
+	}
+
+	int max_reloading = uwsgi.chain_reload_workers > 0 ? uwsgi.chain_reload_workers : 1;
+
+	// chain_reloading is the next worker to recycle, the previous ones are still in the chain
+	// until the old process is dead and the new one is accepting requests (apps loaded and warmed up)
+	int i;
+	int reloading = 0;
+	int waiting_for = 0;
+	for(i=1;i<uwsgi.status.chain_reloading && i<=uwsgi.numproc;i++) {
+		struct uwsgi_worker *uw = &uwsgi.workers[i];
+		if (uw->pid > 0 && !uw->cheaped && (uw->cursed_at > 0 || !uw->accepting)) {
+			reloading++;
+			waiting_for = i;
 		}
 	}
 
+	if (reloading >= max_reloading || (reloading > 0 && uwsgi.status.chain_reloading > uwsgi.numproc)) {
+		time_t now = uwsgi_now();
+		if (now != last_check) {
+			uwsgi_log_verbose("chain is still waiting for worker %d...\n", waiting_for);
+			last_check = now;
+		}
+		return;
+	}
+
 	// if all the processes are recycled, the chain is over
 	if (uwsgi.status.chain_reloading > uwsgi.numproc) {
 		uwsgi.status.chain_reloading = 0;
+		zygote_reloaded = 0;
                 uwsgi_log_verbose("chain reloading complete\n");
 		return;
 	}
 
 	uwsgi_block_signal(SIGHUP);
-	int i;
-	for(i=uwsgi.status.chain_reloading;i<=uwsgi.numproc;i++) {
+	for(i=uwsgi.status.chain_reloading;i<=uwsgi.numproc && reloading < max_reloading;i++) {
 		struct uwsgi_worker *uw = &uwsgi.workers[i];
-		if (uw->pid > 0 && !uw->cheaped && uw->accepting) {
-			// the worker could have been already cursed
-			if (uw->cursed_at == 0) {
-				uwsgi_log_verbose("chain next victim is worker %d\n", i);
-				uwsgi_curse(i, SIGHUP);
-			}
-			break;
-		}
-		else {
-			uwsgi.status.chain_reloading++;
+		uwsgi.status.chain_reloading = i + 1;
+		if (uw->pid > 0 && !uw->cheaped && uw->accepting && uw->cursed_at == 0) {
+			uwsgi_log_verbose("chain next victim is worker %d\n", i);
+			uwsgi_curse(i, SIGHUP);
+			reloading++;
 		}
         }
 	uwsgi_unblock_signal(SIGHUP);
@@ -96,6 +106,70 @@ void uwsgi_master_commit_status() {
 	}
 }
 
+// the Emperor uses activity reports for scaling on-demand vassals to zero
+void uwsgi_master_report_activity() {
+
+	static time_t last_report = 0;
+	static uint64_t last_request_count = 0;
+	int i;
+
+	if (!uwsgi.emperor_activity_report || !uwsgi.has_emperor)
+		return;
+
+	if (uwsgi.current_time - last_report < uwsgi.emperor_activity_report)
+		return;
+
+	int active = last_request_count != uwsgi.workers[0].requests;
+	// long running requests are activity too
+	for (i = 1; i <= uwsgi.numproc && !active; i++) {
+		if (uwsgi.workers[i].cheaped == 0 && uwsgi.workers[i].pid > 0 && uwsgi_worker_is_busy(i)) {
+			active = 1;
+		}
+	}
+
+	if (!active)
+		return;
+
+	last_report = uwsgi.current_time;
+	last_request_count = uwsgi.workers[0].requests;
+	char byte = 27;
+	if (write(uwsgi.emperor_fd, &byte, 1) != 1) {
+		uwsgi_error("uwsgi_master_report_activity()/write()");
+	}
+}
+
+// tell the zergpools how busy we are (permille of busy workers)
+void uwsgi_master_report_zerg_load() {
+	int i;
+	if (!uwsgi.zerg_report_fds_cnt) return;
+
+	int active = 0, busy = 0;
+	for (i = 1; i <= uwsgi.numproc; i++) {
+		if (uwsgi.workers[i].cheaped == 0 && uwsgi.workers[i].pid > 0) {
+			active++;
+			if (uwsgi_worker_is_busy(i)) busy++;
+		}
+	}
+
+	int dropped = 0;
+	char buf[16];
+	int len = snprintf(buf, 16, "%d\n", active ? (busy * 1000) / active : 1000);
+
+	for (i = 0; i < uwsgi.zerg_report_fds_cnt; i++) {
+		int fd = uwsgi.zerg_report_fds[i];
+		if (fd < 0) continue;
+		// classic zergpools and zerg servers close the connection after sending the fds
+		if (send(fd, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL) != len) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) continue;
+			close(fd);
+			uwsgi.zerg_report_fds[i] = -1;
+			dropped++;
+		}
+	}
+
+	if (dropped) uwsgi_zerg_report_sync();
+}
+
 void uwsgi_master_check_idle() {
 
 	static time_t last_request_timecheck = 0;
@@ -175,30 +249,86 @@ done:
 
 }
 
-int uwsgi_master_check_workers_deadline() {
+/*
+	harakiri deadlines
+
+	each worker keeps a lower bound of the deadlines of its cores (harakiri_next), lowered
+	by the cores with a compare-and-swap only when a new deadline is earlier (so rarely under load).
+	The master only scans the cores of a worker whose bound expired: the bound is cleared before
+	scanning and then lowered to the earliest deadline found, so a deadline set during the scan is never lost.
+*/
+
+void uwsgi_worker_harakiri_bound(int wid, uint64_t deadline) {
+	uint64_t *next = &uwsgi.workers[wid].harakiri_next;
+	for(;;) {
+		uint64_t current = *next;
+		if (current && current <= deadline) return;
+		if (uwsgi_atomic_cas(next, current, deadline)) break;
+	}
+	// the master would wake up too late
+	if (ushared->harakiri_pipe[1] > -1 && uwsgi.mywid > 0 && deadline < ushared->master_wakeup) {
+		char byte = 1;
+		if (write(ushared->harakiri_pipe[1], &byte, 1) < 0 && errno != EAGAIN) {
+			uwsgi_error("uwsgi_worker_harakiri_bound()/write()");
+		}
+	}
+}
+
+// the first deadline the master has to wake up for (0 if none)
+uint64_t uwsgi_master_next_harakiri() {
+	uint64_t next = 0;
+	int i;
+	for (i = 1; i <= uwsgi.numproc; i++) {
+		uint64_t wnext = uwsgi.workers[i].harakiri_next;
+		if (wnext && (!next || wnext < next)) next = wnext;
+	}
+	return next;
+}
+
+int uwsgi_master_check_workers_harakiri() {
 	int i,j;
 	int ret = 0;
+	uint64_t now = uwsgi_micros() / 1000;
 	for (i = 1; i <= uwsgi.numproc; i++) {
+		uint64_t wnext = uwsgi.workers[i].harakiri_next;
+		if (!wnext || wnext > now) continue;
+		uwsgi_atomic_xchg(&uwsgi.workers[i].harakiri_next, 0);
+		uint64_t next = 0;
 		for(j=0;j<uwsgi.cores;j++) {
+			struct uwsgi_core *uc = &uwsgi.workers[i].cores[j];
+			uint64_t deadline = uc->harakiri_deadline;
 			/* first check for harakiri */
-			if (uwsgi.workers[i].cores[j].harakiri > 0) {
-				if (uwsgi.workers[i].cores[j].harakiri < (time_t) uwsgi.current_time) {
-					uwsgi_log_verbose("HARAKIRI triggered by worker %d core %d !!!\n", i, j);
-					trigger_harakiri(i);
-					ret = 1;
-					break;
-				}
+			if (deadline > 0 && deadline <= now) {
+				uwsgi_log_verbose("HARAKIRI triggered by worker %d core %d !!!\n", i, j);
+				trigger_harakiri(i);
+				ret = 1;
+				// try again in a second
+				next = now + 1000;
+				break;
 			}
 			/* then user-defined harakiri */
-			if (uwsgi.workers[i].cores[j].user_harakiri > 0) {
-				uwsgi_log_verbose("HARAKIRI (user) triggered by worker %d core %d !!!\n", i, j);
-				if (uwsgi.workers[i].cores[j].user_harakiri < (time_t) uwsgi.current_time) {
+			if (uc->user_harakiri > 0) {
+				if (uc->user_harakiri < (time_t) (now / 1000)) {
+					uwsgi_log_verbose("HARAKIRI (user) triggered by worker %d core %d !!!\n", i, j);
 					trigger_harakiri(i);
 					ret = 1;
+					next = now + 1000;
 					break;
 				}
+				uint64_t user_deadline = (uc->user_harakiri + 1) * 1000;
+				if (!next || user_deadline < next) next = user_deadline;
 			}
+			if (deadline > 0 && (!next || deadline < next)) next = deadline;
 		}
+		if (next) uwsgi_worker_harakiri_bound(i, next);
+	}
+	return ret;
+}
+
+int uwsgi_master_check_workers_deadline() {
+	int i;
+	int ret = 0;
+	for (i = 1; i <= uwsgi.numproc; i++) {
 		// then for evil memory checkers
 		if (uwsgi.evil_reload_on_as) {
 			if ((rlim_t) uwsgi.workers[i].vsz_size >= uwsgi.evil_reload_on_as) {
@@ -414,3 +544,226 @@ void uwsgi_master_check_mountpoints() {
 		}
 	}
 }
+
+/*
+	cgroup v2 memory pressure
+
+	the master monitors memory.current/memory.max and the 'some' avg10 of memory.pressure (PSI).
+	When the cgroup is under pressure, cheaper spawns are paused and the workers are asked to
+	free memory (the memory_pressure plugin hook, gc.collect() for python). If the pressure does
+	not go away, the fattest worker is gracefully recycled every cooldown period.
+*/
+#ifdef __linux__
+static char *memory_current_file = NULL;
+static char *memory_max_file = NULL;
+static char *memory_pressure_file = NULL;
+
+// cgroup and proc files report a 0 size, so uwsgi_simple_file_read() cannot be used
+static ssize_t memory_pressure_read(char *file, char *buf, size_t len) {
+	int fd = open(file, O_RDONLY);
+	if (fd < 0) return -1;
+	ssize_t rlen = read(fd, buf, len - 1);
+	close(fd);
+	if (rlen < 0) return -1;
+	buf[rlen] = 0;
+	return rlen;
+}
+
+// "max" (no limit) is reported as 0
+static int64_t memory_pressure_read_num(char *file) {
+	char buf[64];
+	if (memory_pressure_read(file, buf, sizeof(buf)) <= 0) return -1;
+	if (!strncmp(buf, "max", 3)) return 0;
+	return strtoll(buf, NULL, 10);
+}
+
+static double memory_pressure_psi_some() {
+	char buf[256];
+	if (memory_pressure_read(memory_pressure_file, buf, sizeof(buf)) <= 0) return -1;
+	char *avg10 = strstr(buf, "some avg10=");
+	if (!avg10) return -1;
+	return strtod(avg10 + 11, NULL);
+}
+
+static uint64_t memory_pressure_worker_rss(pid_t pid) {
+	char file[64];
+	char buf[128];
+	unsigned long long size = 0, resident = 0;
+	snprintf(file, sizeof(file), "/proc/%d/statm", (int) pid);
+	if (memory_pressure_read(file, buf, sizeof(buf)) <= 0) return 0;
+	if (sscanf(buf, "%llu %llu", &size, &resident) != 2) return 0;
+	return resident * uwsgi.page_size;
+}
+
+// the cgroup of the instance, from the "0::/path" line of /proc/self/cgroup
+static char *memory_pressure_detect_cgroup() {
+	char buf[4096];
+	char *mounts[] = { "/sys/fs/cgroup", "/sys/fs/cgroup/unified", NULL };
+	if (memory_pressure_read("/proc/self/cgroup", buf, sizeof(buf)) <= 0) return NULL;
+	char *line = strstr(buf, "0::/");
+	if (!line || (line != buf && line[-1] != '\n')) return NULL;
+	char *path = line + 3;
+	char *nl = strchr(path, '\n');
+	if (nl) *nl = 0;
+	int i;
+	for (i = 0; mounts[i]; i++) {
+		char *dir = uwsgi_concat2(mounts[i], path);
+		char *current = uwsgi_concat2(dir, "/memory.current");
+		int found = !access(current, R_OK);
+		free(current);
+		if (found) return dir;
+		free(dir);
+	}
+	return NULL;
+}
+#endif
+
+void uwsgi_master_memory_pressure_init() {
+#ifdef __linux__
+	if (!uwsgi.memory_pressure && !uwsgi.memory_pressure_cgroup) return;
+
+	char *dir = uwsgi.memory_pressure_cgroup;
+	if (!dir) {
+		dir = memory_pressure_detect_cgroup();
+		if (!dir) {
+			uwsgi_log("unable to find the cgroup v2 of the instance, memory pressure monitoring requires cgroup v2\n");
+			exit(1);
+		}
+	}
+
+	memory_current_file = uwsgi_concat2(dir, "/memory.current");
+	memory_max_file = uwsgi_concat2(dir, "/memory.max");
+	memory_pressure_file = uwsgi_concat2(dir, "/memory.pressure");
+
+	if (memory_pressure_read_num(memory_current_file) < 0) {
+		uwsgi_log("unable to read %s, memory pressure monitoring requires cgroup v2\n", memory_current_file);
+		exit(1);
+	}
+
+	uwsgi_log("monitoring memory pressure of cgroup %s (high: %d%% of memory.max, psi: %d%%)\n", dir, uwsgi.memory_pressure_high, uwsgi.memory_pressure_psi);
+#endif
+}
+
+void uwsgi_master_check_memory_pressure() {
+#ifdef __linux__
+	static time_t last_action = 0;
+	int i;
+
+	if (!memory_current_file) return;
+	if (uwsgi_instance_is_reloading || uwsgi_instance_is_dying) return;
+
+	int64_t current = memory_pressure_read_num(memory_current_file);
+	int64_t max = memory_pressure_read_num(memory_max_file);
+	double psi = uwsgi.memory_pressure_psi > 0 ? memory_pressure_psi_some() : -1;
+
+	int pressure = 0;
+	if (current > 0 && max > 0 && current * 100 >= max * uwsgi.memory_pressure_high) pressure = 1;
+	if (uwsgi.memory_pressure_psi > 0 && psi >= uwsgi.memory_pressure_psi) pressure = 1;
+
+	if (!pressure) {
+		if (uwsgi.memory_pressure_active) {
+			uwsgi_log_verbose("cgroup memory pressure is over (current: %lld max: %lld psi: %.2f)\n", (long long) current, (long long) max, psi);
+			uwsgi.memory_pressure_active = 0;
+		}
+		return;
+	}
+
+	// new workers inherit the generation, they do not need to free anything
+	if (!uwsgi.memory_pressure_active) {
+		uwsgi_log_verbose("*** cgroup memory pressure detected (current: %lld max: %lld psi: %.2f), pausing cheaper spawns ***\n", (long long) current, (long long) max, psi);
+		uwsgi.memory_pressure_active = 1;
+		uwsgi.memory_pressure_seen = ++ushared->memory_pressure_gen;
+		last_action = uwsgi.current_time;
+		return;
+	}
+
+	if (uwsgi.current_time - last_action < uwsgi.memory_pressure_cooldown) return;
+	last_action = uwsgi.current_time;
+	uwsgi.memory_pressure_seen = ++ushared->memory_pressure_gen;
+
+	// freeing memory was not enough, recycle the fattest worker (one at a time)
+	int fattest = 0;
+	uint64_t fattest_rss = 0;
+	for (i = 1; i <= uwsgi.numproc; i++) {
+		struct uwsgi_worker *uw = &uwsgi.workers[i];
+		if (uw->pid <= 0 || uw->cheaped) continue;
+		if (uw->cursed_at > 0) return;
+		if (uwsgi.current_time - uw->last_spawn < (time_t) uwsgi.min_worker_lifetime) continue;
+		uint64_t rss = memory_pressure_worker_rss(uw->pid);
+		if (rss > fattest_rss) {
+			fattest_rss = rss;
+			fattest = i;
+		}
+	}
+
+	if (fattest) {
+		uwsgi_log_verbose("*** memory pressure: recycling worker %d (pid: %d, rss: %llu MB) ***\n", fattest, (int) uwsgi.workers[fattest].pid, (unsigned long long) (fattest_rss / (1024 * 1024)));
+		uwsgi_curse(fattest, SIGHUP);
+	}
+#endif
+}
+
+// called by the workers after each request
+void uwsgi_worker_check_memory_pressure() {
+	uint64_t seen = uwsgi.memory_pressure_seen;
+	uint64_t gen = ushared->memory_pressure_gen;
+	if (seen == gen) return;
+	// only one core runs the hooks
+	if (!__sync_bool_compare_and_swap(&uwsgi.memory_pressure_seen, seen, gen)) return;
+
+	int i;
+	for (i = 0; i < uwsgi.gp_cnt; i++) {
+		if (uwsgi.gp[i]->memory_pressure) {
+			uwsgi.gp[i]->memory_pressure();
+		}
+	}
+	for (i = 0; i < 256; i++) {
+		if (uwsgi.p[i]->memory_pressure) {
+			uwsgi.p[i]->memory_pressure();
+		}
+	}
+}
+
+#ifdef __linux__
+// the private memory of idle workers is the first candidate for reclaim
+void uwsgi_master_check_idle_workers_memory() {
+#ifdef MADV_COLD
+	static pid_t *last_pid = NULL;
+	static uint64_t *last_requests = NULL;
+	static time_t *last_activity = NULL;
+	static int disabled = 0;
+	int i;
+
+	if (!uwsgi.idle_workers_cold || disabled) return;
+
+	if (!last_pid) {
+		last_pid = uwsgi_calloc(sizeof(pid_t) * (uwsgi.numproc + 1));
+		last_requests = uwsgi_calloc(sizeof(uint64_t) * (uwsgi.numproc + 1));
+		last_activity = uwsgi_calloc(sizeof(time_t) * (uwsgi.numproc + 1));
+	}
+
+	for (i = 1; i <= uwsgi.numproc; i++) {
+		struct uwsgi_worker *uw = &uwsgi.workers[i];
+		if (uw->pid <= 0 || uw->cheaped) continue;
+		if (uw->pid != last_pid[i] || uw->requests != last_requests[i] || uwsgi_worker_is_busy(i)) {
+			last_pid[i] = uw->pid;
+			last_requests[i] = uw->requests;
+			last_activity[i] = uwsgi.current_time;
+			continue;
+		}
+		// 0 means already advised
+		if (!last_activity[i] || uwsgi.current_time - last_activity[i] < uwsgi.idle_workers_cold) continue;
+		last_activity[i] = 0;
+
+		int64_t advised = uwsgi_linux_process_madvise_heaps(uw->pid, MADV_COLD);
+		if (advised < 0) {
+			uwsgi_error("uwsgi_master_check_idle_workers_memory()/process_madvise()");
+			uwsgi_log("disabling --idle-workers-cold\n");
+			disabled = 1;
+			return;
+		}
+		uwsgi_log_verbose("worker %d idle for %d seconds, %llu MB of heaps marked as cold\n", i, uwsgi.idle_workers_cold, (unsigned long long) (advised / (1024 * 1024)));
+	}
+#endif
+}
+#endif
@@ -4,6 +4,11 @@ extern struct uwsgi_server uwsgi;
 
 int uwsgi_master_manage_events(int interesting_fd) {
 
+	// a child exited, it will be reaped by the next cycle
+	if (uwsgi_master_manage_pidfd(interesting_fd)) {
+		return 0;
+	}
+
 	// is a logline ?
 	if (uwsgi.log_master && !uwsgi.threaded_logger) {
 		// stderr log ?
@@ -18,6 +23,13 @@ int uwsgi_master_manage_events(int interesting_fd) {
 		}
 	}
 
+	// the harakiri deadlines are checked after every event
+	if (uwsgi.shared->harakiri_pipe[0] > -1 && interesting_fd == uwsgi.shared->harakiri_pipe[0]) {
+		char buf[64];
+		while (read(interesting_fd, buf, 64) > 0);
+		return 0;
+	}
+
 	if (uwsgi.master_fifo_fd > -1 && interesting_fd == uwsgi.master_fifo_fd) {
 		return uwsgi_master_fifo_manage(uwsgi.master_fifo_fd);
 	}
@@ -34,6 +46,11 @@ int uwsgi_master_manage_events(int interesting_fd) {
 		}
 	}
 
+	if (uwsgi.stats_binary_fd > -1 && interesting_fd == uwsgi.stats_binary_fd) {
+		uwsgi_send_stats_binary(uwsgi.stats_binary_fd);
+		return 0;
+	}
+
 	// a zerg connection ?
 	if (uwsgi.zerg_server) {
 		if (interesting_fd == uwsgi.zerg_server_fd) {
@@ -61,6 +78,13 @@ int uwsgi_master_manage_events(int interesting_fd) {
 	}
 #endif
 
+	if (uwsgi_fsmon_touch_event(interesting_fd)) {
+		// no need to wait for the next cycle
+		if (uwsgi.logfile) uwsgi_check_logrotate();
+		uwsgi_master_check_touches();
+		return 0;
+	}
+
 	if (uwsgi_fsmon_event(interesting_fd)) {
                 return 0;
 	}
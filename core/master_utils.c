@@ -1,4 +1,7 @@
 #include "uwsgi.h"
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 
 extern struct uwsgi_server uwsgi;
 
@@ -15,6 +18,17 @@ uint64_t uwsgi_worker_exceptions(int wid) {
 	return total;
 }
 
+uint64_t uwsgi_worker_delta_requests(int wid) {
+	if (!uwsgi.lazy_worker_stats) return uwsgi.workers[wid].delta_requests;
+	uint64_t total = 0;
+	int i;
+	for(i=0;i<uwsgi.cores;i++) {
+		total += uwsgi.workers[wid].cores[i].delta_requests;
+	}
+
+	return total;
+}
+
 void uwsgi_curse(int wid, int sig) {
 	uwsgi.workers[wid].cursed_at = uwsgi_now();
         uwsgi.workers[wid].no_mercy_at = uwsgi.workers[wid].cursed_at + uwsgi.worker_reload_mercy;
@@ -155,6 +169,11 @@ int uwsgi_calc_cheaper(void) {
 		}
 	}
 
+	// do not spawn workers while the cgroup is near its memory limit
+	if (uwsgi.memory_pressure_active) {
+		ignore_algo = 1;
+	}
+
 	// then check for fifo
 	if (uwsgi.cheaper_fifo_delta != 0) {
 		if (!ignore_algo) {
@@ -449,6 +468,110 @@ int uwsgi_cheaper_algo_backlog(int can_spawn) {
 	return 0;
 }
 
+/*
+
+	-- Cheaper, predict algorithm --
+
+	samples the listen queue and the request latency every cheaper-sample-ms (default 100) milliseconds.
+
+	The request rate and the latency are smoothed with an EWMA, the rate trend is projected
+	cheaper-predict-horizon milliseconds ahead and the needed concurrency is estimated with
+	Little's law (rate * latency) plus the requests waiting in the listen queue.
+
+	The resulting number of workers (plus one spare) is spawned in a single batch, while
+	workers are cheaped one at a time only after the estimate stayed below the active
+	workers for cheaper-idle seconds.
+
+*/
+
+#define CHEAPER_PREDICT_ALPHA 0.3
+
+int uwsgi_cheaper_algo_predict(int can_spawn) {
+	static uint64_t last_sample = 0;
+	static uint64_t last_requests = 0;
+	static uint64_t last_running_time = 0;
+	static uint64_t below_since = 0;
+	static double rate = 0;
+	static double trend = 0;
+	static double latency = 0;
+
+	int i, j;
+	uint64_t now = uwsgi_micros();
+
+	if (last_sample && now - last_sample < (uint64_t) uwsgi.cheaper_sample_ms * 1000) return 0;
+
+	// per-core counters are always up to date (even with lazy worker stats)
+	uint64_t requests = 0, running_time = 0;
+	int active_workers = 0;
+	for (i = 1; i <= uwsgi.numproc; i++) {
+		if (uwsgi.workers[i].cheaped == 0 && uwsgi.workers[i].pid > 0) {
+			active_workers++;
+		}
+		for (j = 0; j < uwsgi.cores; j++) {
+			requests += uwsgi.workers[i].cores[j].requests;
+			running_time += uwsgi.workers[i].cores[j].running_time;
+		}
+	}
+
+	uint64_t backlog = uwsgi_master_sample_listen_queue();
+
+	if (!last_sample) {
+		last_sample = now;
+		last_requests = requests;
+		last_running_time = running_time;
+		return 0;
+	}
+
+	double dt = (now - last_sample) / 1000000.0;
+	// counters can go backward when a worker is respawned
+	uint64_t d_requests = requests > last_requests ? requests - last_requests : 0;
+	uint64_t d_running_time = running_time > last_running_time ? running_time - last_running_time : 0;
+	last_sample = now;
+	last_requests = requests;
+	last_running_time = running_time;
+
+	double prev_rate = rate;
+	rate += CHEAPER_PREDICT_ALPHA * ((d_requests / dt) - rate);
+	trend += CHEAPER_PREDICT_ALPHA * (((rate - prev_rate) / dt) - trend);
+	if (d_requests > 0) {
+		latency += CHEAPER_PREDICT_ALPHA * (((d_running_time / (double) d_requests) / 1000000.0) - latency);
+	}
+
+	double forecast = rate;
+	if (trend > 0) forecast += trend * (uwsgi.cheaper_predict_horizon / 1000.0);
+
+	double concurrency = (forecast * latency) + backlog;
+	int needed_workers = (int) ((concurrency + uwsgi.cores - 1) / uwsgi.cores) + 1;
+	if (needed_workers < uwsgi.cheaper_count) needed_workers = uwsgi.cheaper_count;
+	if (needed_workers > uwsgi.numproc) needed_workers = uwsgi.numproc;
+
+#ifdef UWSGI_DEBUG
+	uwsgi_log("cheaper-predict: rate=%.1f trend=%.1f latency=%.4f backlog=%llu active=%d needed=%d\n",
+		rate, trend, latency, (unsigned long long) backlog, active_workers, needed_workers);
+#endif
+
+	if (needed_workers > active_workers) {
+		below_since = 0;
+		if (!can_spawn) return 0;
+		return needed_workers - active_workers;
+	}
+
+	if (needed_workers == active_workers) {
+		below_since = 0;
+		return 0;
+	}
+
+	// decrease workers slowly
+	if (!below_since) {
+		below_since = now;
+		return 0;
+	}
+	if (now - below_since < (uint64_t) uwsgi.cheaper_idle * 1000000) return 0;
+
+	below_since = now;
+	return -1;
+}
+
 
 // reload uWSGI, close unneded file descriptor, restore the original environment and re-exec the binary
 
@@ -635,6 +758,14 @@ void uwsgi_fixup_fds(int wid, int muleid, struct uwsgi_gateway *ug) {
 				if (uwsgi.workers[i].signal_pipe[1] != -1)
 					close(uwsgi.workers[i].signal_pipe[1]);
 			}
+			int j;
+			for (j = 0; j < uwsgi.cores; j++) {
+				struct uwsgi_core *uc = &uwsgi.workers[i].cores[j];
+				if (uc->signal_pipe[0] != -1)
+					close(uc->signal_pipe[0]);
+				if (i != wid && uc->signal_pipe[1] != -1)
+					close(uc->signal_pipe[1]);
+			}
 		}
 
 		
@@ -663,6 +794,8 @@ void uwsgi_fixup_fds(int wid, int muleid, struct uwsgi_gateway *ug) {
 					close(uwsgi.mules[i].signal_pipe[1]);
 				if (uwsgi.mules[i].queue_pipe[1] != -1)
 					close(uwsgi.mules[i].queue_pipe[1]);
+				if (uwsgi.mules[i].ring)
+					close(uwsgi.mules[i].ring_pipe[1]);
 			}
 		}
 
@@ -701,7 +834,15 @@ void uwsgi_fixup_fds(int wid, int muleid, struct uwsgi_gateway *ug) {
 
 int uwsgi_respawn_worker(int wid) {
 	int i;
+
+	// the zygote does all of the work
+	if (uwsgi.zygote_pid > 0) {
+		if (!uwsgi_zygote_spawn(wid)) return 0;
+		uwsgi_log("unable to spawn worker %d from the zygote, falling back to fork()\n", wid);
+	}
+
 	int respawns = uwsgi.workers[wid].respawn_count;
+	uwsgi_probe3(worker_respawn, wid, uwsgi.workers[wid].pid, respawns);
 	// the workers is not accepting (obviously)
 	uwsgi.workers[wid].accepting = 0;
 	// we count the respawns before errors...
@@ -712,8 +853,10 @@ int uwsgi_respawn_worker(int wid) {
 	for(i=0;i<uwsgi.cores;i++) {
 		uwsgi.workers[wid].cores[i].harakiri = 0;
 		uwsgi.workers[wid].cores[i].user_harakiri = 0;
+		uwsgi.workers[wid].cores[i].harakiri_deadline = 0;
 	}
 	uwsgi.workers[wid].pending_harakiri = 0;
+	uwsgi.workers[wid].harakiri_next = 0;
 	uwsgi.workers[wid].rss_size = 0;
 	uwsgi.workers[wid].vsz_size = 0;
 	// ... reset stopped_at
@@ -729,6 +872,9 @@ int uwsgi_respawn_worker(int wid) {
 
 	// this is required for various checks
 	uwsgi.workers[wid].delta_requests = 0;
+	for(i=0;i<uwsgi.cores;i++) {
+		uwsgi.workers[wid].cores[i].delta_requests = 0;
+	}
 
 	if (uwsgi.threaded_logger) {
 		pthread_mutex_lock(&uwsgi.threaded_logger_lock);
@@ -767,6 +913,10 @@ int uwsgi_respawn_worker(int wid) {
 
 		// reset the apps count with a copy from the master 
 		uwsgi.workers[uwsgi.mywid].apps_cnt = uwsgi.workers[0].apps_cnt;
+		// the zygote only fills the master slot (the others could still be used by the workers of a previous zygote)
+		if (uwsgi.zygote_apps_loaded) {
+			memcpy(uwsgi.workers[uwsgi.mywid].apps, uwsgi.workers[0].apps, sizeof(struct uwsgi_app) * uwsgi.max_apps);
+		}
 
 		// reset wsgi_request structures
 		for(i=0;i<uwsgi.cores;i++) {
@@ -819,10 +969,15 @@ int uwsgi_respawn_worker(int wid) {
 
 struct uwsgi_stats *uwsgi_master_generate_stats() {
 
-	int i;
+	int i, j;
 
 	struct uwsgi_stats *us = uwsgi_stats_new(8192);
 
+	// aggregate the counters of the cores
+	if (uwsgi.lazy_worker_stats) {
+		uwsgi_master_fix_request_counters();
+	}
+
 	if (uwsgi_stats_keyval_comma(us, "version", UWSGI_VERSION))
 		goto end;
 
@@ -843,6 +998,8 @@ struct uwsgi_stats *uwsgi_master_generate_stats() {
 
 	if (uwsgi_stats_keylong_comma(us, "load", (unsigned long long) uwsgi.shared->load))
 		goto end;
+	if (uwsgi_stats_keylong_comma(us, "workers_page_size", (unsigned long long) uwsgi.workers_page_size))
+		goto end;
 	if (uwsgi_stats_keylong_comma(us, "pid", (unsigned long long) getpid()))
 		goto end;
 	if (uwsgi_stats_keylong_comma(us, "uid", (unsigned long long) getuid()))
@@ -896,6 +1053,39 @@ struct uwsgi_stats *uwsgi_master_generate_stats() {
 			goto end;
 	}
 
+	if (uwsgi.log_batches) {
+		if (uwsgi_stats_key(us, "log_batches"))
+			goto end;
+		if (uwsgi_stats_list_open(us))
+			goto end;
+		struct uwsgi_log_batch *ulb = uwsgi.log_batches;
+		while (ulb) {
+			if (uwsgi_stats_object_open(us))
+				goto end;
+			if (uwsgi_stats_keyval_comma(us, "logger", ulb->ul->name))
+				goto end;
+			if (uwsgi_stats_keyval_comma(us, "id", ulb->ul->id ? ulb->ul->id : ""))
+				goto end;
+			if (uwsgi_stats_keylong_comma(us, "lines", (unsigned long long) ulb->lines))
+				goto end;
+			if (uwsgi_stats_keylong_comma(us, "flushes", (unsigned long long) ulb->flushes))
+				goto end;
+			if (uwsgi_stats_keylong(us, "drops", (unsigned long long) ulb->drops))
+				goto end;
+			if (uwsgi_stats_object_close(us))
+				goto end;
+			if (ulb->next) {
+				if (uwsgi_stats_comma(us))
+					goto end;
+			}
+			ulb = ulb->next;
+		}
+		if (uwsgi_stats_list_close(us))
+			goto end;
+		if (uwsgi_stats_comma(us))
+			goto end;
+	}
+
 	if (uwsgi_stats_key(us, "locks"))
 		goto end;
 	if (uwsgi_stats_list_open(us))
@@ -931,6 +1121,9 @@ struct uwsgi_stats *uwsgi_master_generate_stats() {
 
 		struct uwsgi_cache *uc = uwsgi.caches;
 		while(uc) {
+			uint64_t c_items = 0, c_hits = 0, c_miss = 0, c_full = 0;
+			uwsgi_cache_counters(uc, &c_items, &c_hits, &c_miss, &c_full);
+
 			if (uwsgi_stats_object_open(us))
                         	goto end;
 
@@ -955,16 +1148,22 @@ struct uwsgi_stats *uwsgi_master_generate_stats() {
 			if (uwsgi_stats_keylong_comma(us, "blocksize", (unsigned long long) uc->blocksize))
 				goto end;
 
-			if (uwsgi_stats_keylong_comma(us, "items", (unsigned long long) uc->n_items))
+			if (uwsgi_stats_keylong_comma(us, "segments", (unsigned long long) uc->segments))
+				goto end;
+
+			if (uwsgi_stats_keylong_comma(us, "page_size", (unsigned long long) uc->page_size))
+				goto end;
+
+			if (uwsgi_stats_keylong_comma(us, "items", (unsigned long long) c_items))
 				goto end;
 
-			if (uwsgi_stats_keylong_comma(us, "hits", (unsigned long long) uc->hits))
+			if (uwsgi_stats_keylong_comma(us, "hits", (unsigned long long) c_hits))
 				goto end;
 
-			if (uwsgi_stats_keylong_comma(us, "miss", (unsigned long long) uc->miss))
+			if (uwsgi_stats_keylong_comma(us, "miss", (unsigned long long) c_miss))
 				goto end;
 
-			if (uwsgi_stats_keylong_comma(us, "full", (unsigned long long) uc->full))
+			if (uwsgi_stats_keylong_comma(us, "full", (unsigned long long) c_full))
 				goto end;
 
 			if (uwsgi_stats_keylong(us, "last_modified_at", (unsigned long long) uc->last_modified_at))
@@ -987,6 +1186,42 @@ struct uwsgi_stats *uwsgi_master_generate_stats() {
 		goto end;
 	}
 
+	if (uwsgi.sharedareas_cnt > 0) {
+		if (uwsgi_stats_key(us, "sharedareas"))
+			goto end;
+
+		if (uwsgi_stats_list_open(us)) goto end;
+
+		int i;
+		for (i = 0; i < uwsgi.sharedareas_cnt; i++) {
+			struct uwsgi_sharedarea *sa = uwsgi.sharedareas[i];
+			if (uwsgi_stats_object_open(us))
+				goto end;
+			if (uwsgi_stats_keylong_comma(us, "id", (unsigned long long) sa->id))
+				goto end;
+			if (uwsgi_stats_keylong_comma(us, "size", (unsigned long long) sa->max_pos + 1))
+				goto end;
+			if (uwsgi_stats_keylong_comma(us, "page_size", (unsigned long long) sa->page_size))
+				goto end;
+			if (uwsgi_stats_keylong_comma(us, "updates", (unsigned long long) sa->updates))
+				goto end;
+			if (uwsgi_stats_keylong(us, "hits", (unsigned long long) sa->hits))
+				goto end;
+			if (uwsgi_stats_object_close(us))
+				goto end;
+			if (i < uwsgi.sharedareas_cnt - 1) {
+				if (uwsgi_stats_comma(us))
+					goto end;
+			}
+		}
+
+		if (uwsgi_stats_list_close(us))
+		goto end;
+
+		if (uwsgi_stats_comma(us))
+		goto end;
+	}
+
 	if (uwsgi.has_metrics && !uwsgi.stats_no_metrics) {
 		if (uwsgi_stats_key(us, "metrics"))
                 	goto end;
@@ -1077,7 +1312,10 @@ struct uwsgi_stats *uwsgi_master_generate_stats() {
 		if (uwsgi_stats_keylong_comma(us, "shared", (unsigned long long) uwsgi_sock->shared))
 			goto end;
 
-		if (uwsgi_stats_keylong(us, "can_offload", (unsigned long long) uwsgi_sock->can_offload))
+		if (uwsgi_stats_keylong_comma(us, "can_offload", (unsigned long long) uwsgi_sock->can_offload))
+			goto end;
+
+		if (uwsgi_stats_keylong(us, "shed", uwsgi_sock->shed ? (unsigned long long) *uwsgi_sock->shed : 0))
 			goto end;
 
 		if (uwsgi_stats_object_close(us))
@@ -1156,6 +1394,25 @@ struct uwsgi_stats *uwsgi_master_generate_stats() {
 			goto end;
 		if (uwsgi_stats_keylong_comma(us, "vsz", (unsigned long long) uwsgi.workers[i + 1].vsz_size))
 			goto end;
+#ifdef __linux__
+		// memory lost to CoW is the private one
+		if (uwsgi.stats_cow) {
+			uint64_t shared_mem = 0, private_mem = 0;
+			if (uwsgi.workers[i + 1].pid > 0) {
+				uwsgi_linux_smaps_rollup(uwsgi.workers[i + 1].pid, &shared_mem, &private_mem);
+			}
+			if (uwsgi_stats_keylong_comma(us, "shared_memory", (unsigned long long) shared_mem))
+				goto end;
+			if (uwsgi_stats_keylong_comma(us, "private_memory", (unsigned long long) private_mem))
+				goto end;
+		}
+		if (uwsgi.taskstats) {
+			if (uwsgi_stats_taskstats(us, &uwsgi.workers[i + 1].taskstats))
+				goto end;
+			if (uwsgi_stats_comma(us))
+				goto end;
+		}
+#endif
 
 		if (uwsgi_stats_keylong_comma(us, "running_time", (unsigned long long) uwsgi.workers[i + 1].running_time))
 			goto end;
@@ -1169,14 +1426,17 @@ struct uwsgi_stats *uwsgi_master_generate_stats() {
 		if (uwsgi_stats_keylong_comma(us, "avg_rt", (unsigned long long) uwsgi.workers[i + 1].avg_response_time))
 			goto end;
 
+		for (j = 0; j < 256; j++) {
+			if (uwsgi.p[j]->worker_stats && uwsgi.p[j]->worker_stats(us, i + 1))
+				goto end;
+		}
+
 		// applications list
 		if (uwsgi_stats_key(us, "apps"))
 			goto end;
 		if (uwsgi_stats_list_open(us))
 			goto end;
 
-		int j;
-
 		for (j = 0; j < uwsgi.workers[i + 1].apps_cnt; j++) {
 			struct uwsgi_app *ua = &uwsgi.workers[i + 1].apps[j];
 
@@ -1258,6 +1518,11 @@ struct uwsgi_stats *uwsgi_master_generate_stats() {
 			if (uwsgi_stats_keylong_comma(us, "in_request", (unsigned long long) uc->in_request))
 				goto end;
 
+			if (uc->req_log_ring) {
+				if (uwsgi_stats_keylong_comma(us, "req_log_drops", (unsigned long long) uc->req_log_ring->drops))
+					goto end;
+			}
+
 			if (uwsgi_stats_key(us, "vars"))
 				goto end;
 
@@ -1284,6 +1549,36 @@ struct uwsgi_stats *uwsgi_master_generate_stats() {
 
 nocores:
 
+		if (uwsgi.offload_threads > 0) {
+			if (uwsgi_stats_comma(us))
+				goto end;
+			if (uwsgi_stats_key(us, "offload_threads"))
+				goto end;
+			if (uwsgi_stats_list_open(us))
+				goto end;
+			for (j = 0; j < uwsgi.offload_threads; j++) {
+				struct uwsgi_offload_thread_stats *uots = &uwsgi.workers[i + 1].offload_stats[j];
+				if (uwsgi_stats_object_open(us))
+					goto end;
+				if (uwsgi_stats_keylong_comma(us, "id", (unsigned long long) j))
+					goto end;
+				if (uwsgi_stats_keylong_comma(us, "active", (unsigned long long) uots->active))
+					goto end;
+				if (uwsgi_stats_keylong_comma(us, "tasks", (unsigned long long) uots->tasks))
+					goto end;
+				if (uwsgi_stats_keylong(us, "bytes", (unsigned long long) uots->bytes))
+					goto end;
+				if (uwsgi_stats_object_close(us))
+					goto end;
+				if (j < uwsgi.offload_threads - 1) {
+					if (uwsgi_stats_comma(us))
+						goto end;
+				}
+			}
+			if (uwsgi_stats_list_close(us))
+				goto end;
+		}
+
 		if (uwsgi_stats_object_close(us))
 			goto end;
 
@@ -1297,6 +1592,41 @@ nocores:
 	if (uwsgi_stats_list_close(us))
 		goto end;
 
+	if (uwsgi.mules_cnt > 0) {
+		if (uwsgi_stats_comma(us))
+			goto end;
+		if (uwsgi_stats_key(us, "mules"))
+			goto end;
+		if (uwsgi_stats_list_open(us))
+			goto end;
+		for (i = 0; i < uwsgi.mules_cnt; i++) {
+			if (uwsgi_stats_object_open(us))
+				goto end;
+			if (uwsgi_stats_keylong_comma(us, "id", (unsigned long long) uwsgi.mules[i].id))
+				goto end;
+			if (uwsgi_stats_keylong_comma(us, "pid", (unsigned long long) uwsgi.mules[i].pid))
+				goto end;
+#ifdef __linux__
+			if (uwsgi.taskstats) {
+				if (uwsgi_stats_taskstats(us, &uwsgi.mules[i].taskstats))
+					goto end;
+				if (uwsgi_stats_comma(us))
+					goto end;
+			}
+#endif
+			if (uwsgi_stats_keylong(us, "respawn_count", (unsigned long long) uwsgi.mules[i].respawn_count))
+				goto end;
+			if (uwsgi_stats_object_close(us))
+				goto end;
+			if (i < uwsgi.mules_cnt - 1) {
+				if (uwsgi_stats_comma(us))
+					goto end;
+			}
+		}
+		if (uwsgi_stats_list_close(us))
+			goto end;
+	}
+
 	struct uwsgi_spooler *uspool = uwsgi.spoolers;
 	if (uspool) {
 		if (uwsgi_stats_comma(us))
@@ -1576,6 +1906,7 @@ void uwsgi_register_cheaper_algo(char *name, int (*func) (int)) {
 void trigger_harakiri(int i) {
 	int j;
 	uwsgi_log_verbose("*** HARAKIRI ON WORKER %d (pid: %d, try: %d) ***\n", i, uwsgi.workers[i].pid, uwsgi.workers[i].pending_harakiri + 1);
+	uwsgi_probe3(harakiri, i, uwsgi.workers[i].pid, uwsgi.workers[i].pending_harakiri + 1);
 	if (uwsgi.harakiri_verbose) {
 #ifdef __linux__
 		int proc_file;
@@ -1637,12 +1968,29 @@ void uwsgi_master_fix_request_counters() {
 	uint64_t total_counter = 0;
         for (i = 1; i <= uwsgi.numproc;i++) {
 		uint64_t tmp_counter = 0;
+		uint64_t delta = 0, tx = 0, running_time = 0, avg_rt = 0;
+		int active_cores = 0;
 		int j;
 		for(j=0;j<uwsgi.cores;j++) {
-			tmp_counter += uwsgi.workers[i].cores[j].requests;
+			struct uwsgi_core *uc = &uwsgi.workers[i].cores[j];
+			tmp_counter += uc->requests;
+			delta += uc->delta_requests;
+			tx += uc->tx;
+			running_time += uc->running_time;
+			if (uc->avg_response_time) {
+				avg_rt += uc->avg_response_time;
+				active_cores++;
+			}
 		}
 		uwsgi.workers[i].requests = tmp_counter;
 		total_counter += tmp_counter;
+		// in multithread mode the workers only update their cores
+		if (uwsgi.lazy_worker_stats) {
+			uwsgi.workers[i].delta_requests = delta;
+			uwsgi.workers[i].tx = tx;
+			uwsgi.workers[i].running_time = running_time;
+			if (active_cores) uwsgi.workers[i].avg_response_time = avg_rt / active_cores;
+		}
 	}
 
 	uwsgi.workers[0].requests = total_counter;
@@ -1936,4 +2284,77 @@ void uwsgi_dump_worker(int wid, char *msg) {
 	uwsgi_log_verbose("%s !!! end of worker %d status !!!\n",msg, wid);
 }
 
+/*
+	child death notification
+
+	every process forked by the master with uwsgi_fork() (workers, mules, spoolers, gateways,
+	daemons...) gets a pidfd (Linux >= 5.3) in the master queue. It becomes readable as soon
+	as the process exits, so the master loop wakes up and reaps/respawns it immediately instead
+	of waiting for the end of the current --master-interval cycle.
+	Processes forked before the master loop starts are added to the queue by uwsgi_master_watch_pids_start()
+*/
+struct uwsgi_pidfd {
+	int fd;
+	pid_t pid;
+};
+
+static struct uwsgi_pidfd *master_pidfds;
+static int master_pidfds_cnt;
+static int master_pidfds_size;
+
+void uwsgi_master_watch_pid(pid_t pid) {
+#if defined(__linux__) && defined(SYS_pidfd_open)
+	if (!uwsgi.master_process || !uwsgi.workers || getpid() != uwsgi.workers[0].pid) return;
+	int fd = syscall(SYS_pidfd_open, pid, 0);
+	// older kernels: the processes are reaped on the master cycles
+	if (fd < 0) return;
+	if (master_pidfds_cnt >= master_pidfds_size) {
+		int new_size = master_pidfds_size ? master_pidfds_size * 2 : 64;
+		struct uwsgi_pidfd *tmp = realloc(master_pidfds, sizeof(struct uwsgi_pidfd) * new_size);
+		if (!tmp) {
+			uwsgi_error("uwsgi_master_watch_pid()/realloc()");
+			close(fd);
+			return;
+		}
+		master_pidfds = tmp;
+		master_pidfds_size = new_size;
+	}
+	master_pidfds[master_pidfds_cnt].fd = fd;
+	master_pidfds[master_pidfds_cnt].pid = pid;
+	master_pidfds_cnt++;
+	if (uwsgi.master_queue > -1) {
+		event_queue_add_fd_read(uwsgi.master_queue, fd);
+	}
+#endif
+}
+
+void uwsgi_master_watch_pids_start() {
+	int i;
+	for (i = 0; i < master_pidfds_cnt; i++) {
+		event_queue_add_fd_read(uwsgi.master_queue, master_pidfds[i].fd);
+	}
+}
+
+// children do not need the pidfds of their siblings
+void uwsgi_master_watch_pids_close() {
+	int i;
+	for (i = 0; i < master_pidfds_cnt; i++) {
+		close(master_pidfds[i].fd);
+	}
+	master_pidfds_cnt = 0;
+}
+
+// returns 1 if the fd was a pidfd, the exited process is reaped by the next master cycle
+int uwsgi_master_manage_pidfd(int fd) {
+	int i;
+	for (i = 0; i < master_pidfds_cnt; i++) {
+		if (master_pidfds[i].fd != fd) continue;
+		close(fd);
+		master_pidfds[i] = master_pidfds[master_pidfds_cnt - 1];
+		master_pidfds_cnt--;
+		return 1;
+	}
+	return 0;
+}
+
 /* vim: set ts=8 sts=0 sw=0 noexpandtab : */
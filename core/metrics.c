@@ -26,8 +26,8 @@ extern struct uwsgi_server uwsgi;
 	counter
 	absolute
 
-	metrics are managed by a dedicated thread (in the master) holding a linked list of all the items. For few metrics it is a good (read: simple) approach,
-	but you can cache lookups in a uWSGI cache for really big list. (TODO)
+	metrics are managed by a dedicated thread (in the master) holding a linked list of all the items. Lookups by name and by oid
+	go through a hash index (UWSGI_METRICS_HASH_SIZE buckets) so even really big lists are cheap to query.
 
 	struct uwsgi_metric *um = uwsgi_register_metric("worker.1.requests", "3.1.1", UWSGI_METRIC_COUNTER, "ptr", &uwsgi.workers[1].requests, 0, NULL);
 	prototype: struct uwsgi_metric *uwsgi_register_metric(char *name, char *oid, uint8_t value_type, char *collector, void *ptr, uint32_t freq, void *custom);
@@ -53,7 +53,20 @@ extern struct uwsgi_server uwsgi;
 
 	uwsgi.metric_get("worker.1.requests")
 
-	Updating metrics from your app MUST BE ATOMIC, for such a reason a uWSGI rwlock is initialized on startup and used for each operation (simple reading from a metric does not require locking)
+	Updating metrics from your app MUST BE ATOMIC. inc/dec are lock-free: metrics without a collector get a 64bit shard for each core,
+	a worker core adds to its own shard (a cache-local atomic add) and the collector thread folds the shards into the shared value
+	at every collection (so *um->value lags at most 'freq' seconds, use --metrics-no-shards to disable them).
+	set/mul/div/set_max/set_min are rare: they fold the shards and then apply a CAS loop under the uWSGI rwlock initialized on startup.
+	uwsgi.metric_get() always returns the value plus the pending shards.
+
+	Histograms (UWSGI_METRIC_HISTOGRAM) record latencies (in microseconds) in a fixed log-linear (HDR-like) layout:
+	16 linear sub-buckets for each power of two, so every value is accounted with at most 6.25% of error.
+	Each core records in its own row of buckets (other processes, like routers, share an additional row) with
+	a single atomic add. The collector merges the rows without locking, and exposes the percentiles of the last
+	interval with samples as the gauges NAME.p50, NAME.p99 and NAME.p999 (the histogram value is the total number of samples),
+	so the stats server and the pushers export them like any other metric.
+
+	By default core.request_latency, core.cache_get_latency and core.router_latency are recorded.
 
 	Metrics can be updated from the internal routing subsystem too:
 
@@ -204,7 +217,7 @@ struct uwsgi_metric_collector *uwsgi_metric_collector_by_name(char *name) {
 
 struct uwsgi_metric *uwsgi_register_metric_do(char *name, char *oid, uint8_t value_type, char *collector, void *ptr, uint32_t freq, void *custom, int do_not_push) {
 	if (!uwsgi.has_metrics) return NULL;
-	struct uwsgi_metric *old_metric=NULL,*metric=uwsgi.metrics;
+	struct uwsgi_metric *metric = NULL;
 
 	if (!uwsgi_validate_metric_name(name)) {
 		uwsgi_log("invalid metric name: %s\n", name);
@@ -216,28 +229,23 @@ struct uwsgi_metric *uwsgi_register_metric_do(char *name, char *oid, uint8_t val
 		exit(1);
 	}
 
-	while(metric) {
-		if (!strcmp(metric->name, name)) {
-			goto found;
-		}
-		old_metric = metric;
-		metric = metric->next;
-	}
+	metric = uwsgi_metric_find_by_name(name);
+	if (metric) goto found;
 
 	metric = uwsgi_calloc(sizeof(struct uwsgi_metric));
 	// always make a copy of the name (so we can use stack for building strings)
 	metric->name = uwsgi_str(name);
 	metric->name_len = strlen(metric->name);
 
-	if (!do_not_push) {
-		if (old_metric) {
-			old_metric->next = metric;
-		}
-		else {
-			uwsgi.metrics = metric;
-		}
+	if (!uwsgi.metrics_hash) {
+		uwsgi.metrics_hash = uwsgi_calloc(sizeof(struct uwsgi_metric *) * UWSGI_METRICS_HASH_SIZE);
+	}
+	uint32_t hash = djb33x_hash(metric->name, metric->name_len) % UWSGI_METRICS_HASH_SIZE;
+	metric->hnext = uwsgi.metrics_hash[hash];
+	uwsgi.metrics_hash[hash] = metric;
 
-		uwsgi.metrics_cnt++;
+	if (!do_not_push) {
+		uwsgi_metric_append(metric);
 	}
 
 found:
@@ -437,6 +445,18 @@ struct uwsgi_metric *uwsgi_register_keyval_metric(char *arg) {
 	return um;
 }
 
+// move the per-core deltas to the shared value (call it in wlocked context)
+static void uwsgi_metric_fold(struct uwsgi_metric *um) {
+	if (!um->shards) return;
+	int64_t delta = 0;
+	uint64_t i, slots = uwsgi.numproc * uwsgi.cores;
+	for(i=0;i<slots;i++) {
+		int64_t *shard = &um->shards[i * uwsgi.metrics_shards_stride];
+		if (*shard) delta += uwsgi_atomic_xchg(shard, 0);
+	}
+	if (delta) __sync_add_and_fetch(um->value, delta);
+}
+
 static void *uwsgi_metrics_loop(void *arg) {
 
 	// block signals on this thread
@@ -464,6 +484,9 @@ static void *uwsgi_metrics_loop(void *arg) {
 			if (metric->collector) {
 				*metric->value = metric->initial_value + metric->collector->func(metric);
 			}
+			else {
+				uwsgi_metric_fold(metric);
+			}
 			int64_t new_value = *metric->value;
 			uwsgi_rwunlock(uwsgi.metrics_lock);
 
@@ -519,28 +542,21 @@ void uwsgi_metrics_start_collector() {
 	uwsgi_log("metrics collector thread started\n");
 }
 
-struct uwsgi_metric *uwsgi_metric_find_by_name(char *name) {
-	struct uwsgi_metric *um = uwsgi.metrics;
+struct uwsgi_metric *uwsgi_metric_find_by_namen(char *name, size_t len) {
+	if (!uwsgi.metrics_hash) return NULL;
+	struct uwsgi_metric *um = uwsgi.metrics_hash[djb33x_hash(name, len) % UWSGI_METRICS_HASH_SIZE];
 	while(um) {
-		if (!strcmp(um->name, name)) {
+		if (!uwsgi_strncmp(um->name, um->name_len, name, len)) {
 			return um;
-		}	
-		um = um->next;
+		}
+		um = um->hnext;
 	}
 
 	return NULL;
 }
 
-struct uwsgi_metric *uwsgi_metric_find_by_namen(char *name, size_t len) {
-        struct uwsgi_metric *um = uwsgi.metrics;
-        while(um) {
-                if (!uwsgi_strncmp(um->name, um->name_len, name, len)) {
-                        return um;
-                }
-                um = um->next;
-        }
-
-        return NULL;
+struct uwsgi_metric *uwsgi_metric_find_by_name(char *name) {
+	return uwsgi_metric_find_by_namen(name, strlen(name));
 }
 
 struct uwsgi_metric_child *uwsgi_metric_add_child(struct uwsgi_metric *parent, struct uwsgi_metric *child) {
@@ -561,28 +577,33 @@ struct uwsgi_metric_child *uwsgi_metric_add_child(struct uwsgi_metric *parent, s
 	return umc;
 }
 
-struct uwsgi_metric *uwsgi_metric_find_by_oid(char *oid) {
-        struct uwsgi_metric *um = uwsgi.metrics;
-        while(um) {
-                if (um->oid && !strcmp(um->oid, oid)) {
-                        return um;
-                }
-                um = um->next;
-        }
+struct uwsgi_metric *uwsgi_metric_find_by_oidn(char *oid, size_t len) {
+	struct uwsgi_metric *um;
+	// the oid index is built at the end of uwsgi_setup_metrics()
+	if (!uwsgi.metrics_oid_hash) {
+		um = uwsgi.metrics;
+		while(um) {
+			if (um->oid && !uwsgi_strncmp(um->oid, um->oid_len, oid, len)) {
+				return um;
+			}
+			um = um->next;
+		}
+		return NULL;
+	}
 
-        return NULL;
-}
+	um = uwsgi.metrics_oid_hash[djb33x_hash(oid, len) % UWSGI_METRICS_HASH_SIZE];
+	while(um) {
+		if (!uwsgi_strncmp(um->oid, um->oid_len, oid, len)) {
+			return um;
+		}
+		um = um->ohnext;
+	}
 
-struct uwsgi_metric *uwsgi_metric_find_by_oidn(char *oid, size_t len) {
-        struct uwsgi_metric *um = uwsgi.metrics;
-        while(um) {
-                if (um->oid && !uwsgi_strncmp(um->oid, um->oid_len, oid, len)) {
-                        return um;
-                }
-                um = um->next;
-        }
+	return NULL;
+}
 
-        return NULL;
+struct uwsgi_metric *uwsgi_metric_find_by_oid(char *oid) {
+	return uwsgi_metric_find_by_oidn(oid, strlen(oid));
 }
 
 struct uwsgi_metric *uwsgi_metric_find_by_asn(char *asn, size_t len) {
@@ -610,58 +631,92 @@ struct uwsgi_metric *uwsgi_metric_find_by_asn(char *asn, size_t len) {
 
 */
 
-#define um_op struct uwsgi_metric *um = NULL;\
-	if (!uwsgi.has_metrics) return -1;\
-	if (name) {\
-                um = uwsgi_metric_find_by_name(name);\
-        }\
-        else if (oid) {\
-                um = uwsgi_metric_find_by_oid(oid);\
-        }\
-        if (!um) return -1;\
-	if (um->collector || um->type == UWSGI_METRIC_ALIAS) return -1;\
-	uwsgi_wlock(uwsgi.metrics_lock)
+static struct uwsgi_metric *uwsgi_metric_writable(char *name, char *oid) {
+	struct uwsgi_metric *um = NULL;
+	if (!uwsgi.has_metrics) return NULL;
+	if (name) {
+		um = uwsgi_metric_find_by_name(name);
+	}
+	else if (oid) {
+		um = uwsgi_metric_find_by_oid(oid);
+	}
+	if (!um) return NULL;
+	if (um->collector || um->type == UWSGI_METRIC_ALIAS) return NULL;
+	return um;
+}
 
-int uwsgi_metric_set(char *name, char *oid, int64_t value) {
-	um_op;
-	*um->value = value;
-	uwsgi_rwunlock(uwsgi.metrics_lock);
+// the shard of the current core (NULL outside of the request cores)
+static int64_t *uwsgi_metric_shard(struct uwsgi_metric *um) {
+	if (!um->shards || uwsgi.mywid < 1) return NULL;
+	struct wsgi_request *wsgi_req = current_wsgi_req();
+	if (!wsgi_req || wsgi_req->async_id < 0 || wsgi_req->async_id >= uwsgi.cores) return NULL;
+	return &um->shards[((uwsgi.mywid - 1) * uwsgi.cores + wsgi_req->async_id) * uwsgi.metrics_shards_stride];
+}
+
+static int uwsgi_metric_add(char *name, char *oid, int64_t value) {
+	struct uwsgi_metric *um = uwsgi_metric_writable(name, oid);
+	if (!um) return -1;
+	int64_t *shard = uwsgi_metric_shard(um);
+	__sync_add_and_fetch(shard ? shard : um->value, value);
 	return 0;
 }
 
+/*
+	the slow path: fold the shards and apply the operation with a CAS loop
+	(inc/dec on non-sharded metrics never take the lock)
+*/
+#define um_op(x) struct uwsgi_metric *um = uwsgi_metric_writable(name, oid);\
+	if (!um) return -1;\
+	uwsgi_wlock(uwsgi.metrics_lock);\
+	uwsgi_metric_fold(um);\
+	int64_t old_value, new_value;\
+	do {\
+		old_value = *um->value;\
+		new_value = x;\
+	} while(!uwsgi_atomic_cas(um->value, old_value, new_value));\
+	uwsgi_rwunlock(uwsgi.metrics_lock);\
+	return 0
+
+int uwsgi_metric_set(char *name, char *oid, int64_t value) {
+	um_op(value);
+}
+
 int uwsgi_metric_inc(char *name, char *oid, int64_t value) {
-        um_op;
-	*um->value += value;
-	uwsgi_rwunlock(uwsgi.metrics_lock);
-	return 0;
+	return uwsgi_metric_add(name, oid, value);
 }
 
 int uwsgi_metric_dec(char *name, char *oid, int64_t value) {
-        um_op;
-	*um->value -= value;
-	uwsgi_rwunlock(uwsgi.metrics_lock);
-	return 0;
+	return uwsgi_metric_add(name, oid, -value);
 }
 
 int uwsgi_metric_mul(char *name, char *oid, int64_t value) {
-        um_op;
-	*um->value *= value;
-	uwsgi_rwunlock(uwsgi.metrics_lock);
-	return 0;
+	um_op(old_value * value);
 }
 
 int uwsgi_metric_div(char *name, char *oid, int64_t value) {
 	// avoid division by zero
 	if (value == 0) return -1;
-        um_op;
-	*um->value /= value;
+	um_op(old_value / value);
+}
+
+static int64_t uwsgi_metric_read(struct uwsgi_metric *um) {
+	// now (in rlocked context) we get the value from
+	// the map and add the pending shards
+	uwsgi_rlock(uwsgi.metrics_lock);
+	int64_t ret = *um->value;
+	if (um->shards) {
+		uint64_t i, slots = uwsgi.numproc * uwsgi.cores;
+		for(i=0;i<slots;i++) {
+			ret += um->shards[i * uwsgi.metrics_shards_stride];
+		}
+	}
+	// unlock
 	uwsgi_rwunlock(uwsgi.metrics_lock);
-	return 0;
+	return ret;
 }
 
 int64_t uwsgi_metric_get(char *name, char *oid) {
 	if (!uwsgi.has_metrics) return 0;
-	int64_t ret = 0;
 	struct uwsgi_metric *um = NULL;
 	if (name) {
 		um = uwsgi_metric_find_by_name(name);
@@ -670,19 +725,11 @@ int64_t uwsgi_metric_get(char *name, char *oid) {
 		um = uwsgi_metric_find_by_oid(oid);
 	}
 	if (!um) return 0;
-
-	// now (in rlocked context) we get the value from
-	// the map
-	uwsgi_rlock(uwsgi.metrics_lock);
-	ret = *um->value;
-	// unlock
-	uwsgi_rwunlock(uwsgi.metrics_lock);
-	return ret;
+	return uwsgi_metric_read(um);
 }
 
 int64_t uwsgi_metric_getn(char *name, size_t nlen, char *oid, size_t olen) {
         if (!uwsgi.has_metrics) return 0;
-        int64_t ret = 0;
         struct uwsgi_metric *um = NULL;
         if (name) {
                 um = uwsgi_metric_find_by_namen(name, nlen);
@@ -691,30 +738,128 @@ int64_t uwsgi_metric_getn(char *name, size_t nlen, char *oid, size_t olen) {
                 um = uwsgi_metric_find_by_oidn(oid, olen);
         }
         if (!um) return 0;
-
-        // now (in rlocked context) we get the value from
-        // the map
-        uwsgi_rlock(uwsgi.metrics_lock);
-        ret = *um->value;
-        // unlock
-        uwsgi_rwunlock(uwsgi.metrics_lock);
-        return ret;
+	return uwsgi_metric_read(um);
 }
 
 int uwsgi_metric_set_max(char *name, char *oid, int64_t value) {
-	um_op;
-    if (value > *um->value)
-        *um->value = value;
-	uwsgi_rwunlock(uwsgi.metrics_lock);
-	return 0;
+	um_op(value > old_value ? value : old_value);
 }
 
 int uwsgi_metric_set_min(char *name, char *oid, int64_t value) {
-	um_op;
-    if ((value > um->initial_value || 0) && value < *um->value)
-        *um->value = value;
-	uwsgi_rwunlock(uwsgi.metrics_lock);
-	return 0;
+	um_op((value > um->initial_value && value < old_value) ? value : old_value);
+}
+
+static uint64_t uwsgi_metric_histogram_bucket(uint64_t value) {
+	if (value < (1 << UWSGI_METRIC_HISTOGRAM_SUB_BITS)) return value;
+	uint64_t bits = 63 - __builtin_clzll(value);
+	if (bits >= UWSGI_METRIC_HISTOGRAM_MAX_BITS) return UWSGI_METRIC_HISTOGRAM_BUCKETS - 1;
+	uint64_t shift = bits - UWSGI_METRIC_HISTOGRAM_SUB_BITS;
+	return ((shift + 1) << UWSGI_METRIC_HISTOGRAM_SUB_BITS) + ((value >> shift) & ((1 << UWSGI_METRIC_HISTOGRAM_SUB_BITS) - 1));
+}
+
+// the middle of the bucket
+static int64_t uwsgi_metric_histogram_value(uint64_t bucket) {
+	if (bucket < (1 << UWSGI_METRIC_HISTOGRAM_SUB_BITS)) return bucket;
+	uint64_t shift = (bucket >> UWSGI_METRIC_HISTOGRAM_SUB_BITS) - 1;
+	uint64_t low = ((1 << UWSGI_METRIC_HISTOGRAM_SUB_BITS) + (bucket & ((1 << UWSGI_METRIC_HISTOGRAM_SUB_BITS) - 1))) << shift;
+	return low + ((1ULL << shift) >> 1);
+}
+
+void uwsgi_metric_histogram_add(struct uwsgi_metric *um, struct wsgi_request *wsgi_req, uint64_t value) {
+	struct uwsgi_metric_histogram *h = um->histogram;
+	uint64_t slot = h->slots - 1;
+	if (h->slots > 1 && uwsgi.mywid > 0) {
+		if (!wsgi_req) wsgi_req = current_wsgi_req();
+		if (wsgi_req && wsgi_req->async_id >= 0 && wsgi_req->async_id < uwsgi.cores) {
+			slot = (uwsgi.mywid - 1) * uwsgi.cores + wsgi_req->async_id;
+		}
+	}
+	__sync_add_and_fetch(&h->buckets[(slot * UWSGI_METRIC_HISTOGRAM_BUCKETS) + uwsgi_metric_histogram_bucket(value)], 1);
+}
+
+static int64_t uwsgi_metric_collector_histogram(struct uwsgi_metric *um) {
+	struct uwsgi_metric_histogram *h = um->histogram;
+	if (!h) return 0;
+	if (!h->last) {
+		h->last = uwsgi_calloc(sizeof(uint64_t) * UWSGI_METRIC_HISTOGRAM_BUCKETS);
+	}
+
+	// merge the rows (the counters only grow, so no locking is needed)
+	uint64_t delta[UWSGI_METRIC_HISTOGRAM_BUCKETS];
+	memset(delta, 0, sizeof(delta));
+	uint64_t i, j;
+	for(i=0;i<h->slots;i++) {
+		uint64_t *row = &h->buckets[i * UWSGI_METRIC_HISTOGRAM_BUCKETS];
+		for(j=0;j<UWSGI_METRIC_HISTOGRAM_BUCKETS;j++) {
+			delta[j] += row[j];
+		}
+	}
+
+	uint64_t samples = 0;
+	for(j=0;j<UWSGI_METRIC_HISTOGRAM_BUCKETS;j++) {
+		uint64_t total = delta[j];
+		delta[j] = total - h->last[j];
+		h->last[j] = total;
+		samples += delta[j];
+	}
+
+	h->count += samples;
+	// keep the last percentiles on idle intervals
+	if (!samples) return h->count;
+	h->p50 = 0;
+	h->p99 = 0;
+	h->p999 = 0;
+
+	uint64_t p50 = (samples * 500 + 999) / 1000;
+	uint64_t p99 = (samples * 990 + 999) / 1000;
+	uint64_t p999 = (samples * 999 + 999) / 1000;
+	uint64_t seen = 0;
+	for(j=0;j<UWSGI_METRIC_HISTOGRAM_BUCKETS;j++) {
+		if (!delta[j]) continue;
+		seen += delta[j];
+		if (!h->p50 && seen >= p50) h->p50 = uwsgi_metric_histogram_value(j);
+		if (!h->p99 && seen >= p99) h->p99 = uwsgi_metric_histogram_value(j);
+		if (seen >= p999) {
+			h->p999 = uwsgi_metric_histogram_value(j);
+			break;
+		}
+	}
+
+	return h->count;
+}
+
+/*
+	register a latency histogram and its percentile gauges.
+	per_core = 0 allocates only the shared row (for metrics recorded outside of the workers)
+*/
+struct uwsgi_metric *uwsgi_register_metric_histogram(char *name, char *oid, int per_core) {
+	struct uwsgi_metric *um = uwsgi_register_metric(name, oid, UWSGI_METRIC_HISTOGRAM, "histogram", NULL, 0, NULL);
+	if (!um) return NULL;
+	if (um->histogram) return um;
+
+	struct uwsgi_metric_histogram *h = uwsgi_calloc(sizeof(struct uwsgi_metric_histogram));
+	h->slots = 1;
+	if (per_core && uwsgi.numproc > 0 && uwsgi.cores > 0) {
+		h->slots += uwsgi.numproc * uwsgi.cores;
+	}
+	h->buckets = uwsgi_calloc_shared(sizeof(uint64_t) * UWSGI_METRIC_HISTOGRAM_BUCKETS * h->slots);
+	um->histogram = h;
+
+	char *percentiles[] = { "p50", "p99", "p999" };
+	int64_t *ptrs[] = { &h->p50, &h->p99, &h->p999 };
+	int i;
+	for(i=0;i<3;i++) {
+		char *p_name = uwsgi_concat3(name, ".", percentiles[i]);
+		char *p_oid = NULL;
+		if (oid) {
+			char num[2] = { '1' + i, 0 };
+			p_oid = uwsgi_concat3(oid, ".", num);
+		}
+		uwsgi_register_metric(p_name, p_oid, UWSGI_METRIC_GAUGE, "ptr", ptrs[i], 0, NULL);
+		free(p_name);
+		if (p_oid) free(p_oid);
+	}
+	return um;
 }
 
 #define uwsgi_metric_name(f, n) ret = snprintf(buf, 4096, f, n); if (ret <= 1 || ret >= 4096) { uwsgi_log("unable to register metric name %s\n", f); exit(1);}
@@ -723,6 +868,36 @@ int uwsgi_metric_set_min(char *name, char *oid, int64_t value) {
 #define uwsgi_metric_oid(f, n) ret = snprintf(buf2, 4096, f, n); if (ret <= 1 || ret >= 4096) { uwsgi_log("unable to register metric oid %s\n", f); exit(1);}
 #define uwsgi_metric_oid2(f, n, n2) ret = snprintf(buf2, 4096, f, n, n2); if (ret <= 1 || ret >= 4096) { uwsgi_log("unable to register metric oid %s\n", f); exit(1);}
 
+#ifdef __linux__
+// --taskstats, collected by the master
+static void uwsgi_setup_metrics_taskstats(char *ns, char *oid, int id, struct uwsgi_taskstats *uts) {
+	char buf[4096];
+	char buf2[4096];
+	int ret;
+
+	uwsgi_metric_name2("%s.%d.cpu_time", ns, id) ; uwsgi_metric_oid2("%s.%d.15", oid, id);
+	uwsgi_register_metric(buf, buf2, UWSGI_METRIC_COUNTER, "ptr", &uts->cpu_time, 0, NULL);
+
+	uwsgi_metric_name2("%s.%d.voluntary_switches", ns, id) ; uwsgi_metric_oid2("%s.%d.16", oid, id);
+	uwsgi_register_metric(buf, buf2, UWSGI_METRIC_COUNTER, "ptr", &uts->voluntary_switches, 0, NULL);
+
+	uwsgi_metric_name2("%s.%d.involuntary_switches", ns, id) ; uwsgi_metric_oid2("%s.%d.17", oid, id);
+	uwsgi_register_metric(buf, buf2, UWSGI_METRIC_COUNTER, "ptr", &uts->involuntary_switches, 0, NULL);
+
+	uwsgi_metric_name2("%s.%d.read_bytes", ns, id) ; uwsgi_metric_oid2("%s.%d.18", oid, id);
+	uwsgi_register_metric(buf, buf2, UWSGI_METRIC_COUNTER, "ptr", &uts->read_bytes, 0, NULL);
+
+	uwsgi_metric_name2("%s.%d.write_bytes", ns, id) ; uwsgi_metric_oid2("%s.%d.19", oid, id);
+	uwsgi_register_metric(buf, buf2, UWSGI_METRIC_COUNTER, "ptr", &uts->write_bytes, 0, NULL);
+
+	uwsgi_metric_name2("%s.%d.cpu_delay", ns, id) ; uwsgi_metric_oid2("%s.%d.20", oid, id);
+	uwsgi_register_metric(buf, buf2, UWSGI_METRIC_COUNTER, "ptr", &uts->cpu_delay, 0, NULL);
+
+	uwsgi_metric_name2("%s.%d.blkio_delay", ns, id) ; uwsgi_metric_oid2("%s.%d.21", oid, id);
+	uwsgi_register_metric(buf, buf2, UWSGI_METRIC_COUNTER, "ptr", &uts->blkio_delay, 0, NULL);
+}
+#endif
+
 void uwsgi_setup_metrics() {
 
 	if (!uwsgi.has_metrics) return;
@@ -750,6 +925,26 @@ void uwsgi_setup_metrics() {
 	uwsgi_register_metric("core.busy_workers", "5.3", UWSGI_METRIC_GAUGE, "ptr", &uwsgi.shared->busy_workers, 0, NULL);
 	uwsgi_register_metric("core.idle_workers", "5.4", UWSGI_METRIC_GAUGE, "ptr", &uwsgi.shared->idle_workers, 0, NULL);
 	uwsgi_register_metric("core.overloaded", "5.5", UWSGI_METRIC_COUNTER, "ptr", &uwsgi.shared->overloaded, 0, NULL);
+	uwsgi_register_metric("core.coalesced_signals", "5.6", UWSGI_METRIC_COUNTER, "ptr", &uwsgi.shared->coalesced_signals, 0, NULL);
+
+	// latency histograms
+	if (!uwsgi.metrics_no_histograms) {
+		uwsgi.metric_request_latency = uwsgi_register_metric_histogram("core.request_latency", "5.110", 1);
+		if (uwsgi.caches) {
+			uwsgi.metric_cache_get_latency = uwsgi_register_metric_histogram("core.cache_get_latency", "5.111", 1);
+		}
+		uwsgi.metric_router_latency = uwsgi_register_metric_histogram("core.router_latency", "5.112", 0);
+		// per-stage latency breakdown
+		if (uwsgi.req_timing) {
+			char *stages[] = { "queue", "parse", "body", "routing", "app", "write", "close" };
+			int ret, stage;
+			for (stage = 0; stage < UWSGI_REQ_STAGE_MAX; stage++) {
+				uwsgi_metric_name("core.request_%s_time", stages[stage]);
+				uwsgi_metric_oid("5.%d", 120 + stage);
+				uwsgi.metric_req_stages[stage] = uwsgi_register_metric_histogram(buf, buf2, 1);
+			}
+		}
+	}
 
 	// parents are appended only at the end
 	struct uwsgi_metric *total_tx = uwsgi_register_metric_do("core.total_tx", "5.100", UWSGI_METRIC_COUNTER, "sum", NULL, 0, NULL, 1);
@@ -822,6 +1017,18 @@ void uwsgi_setup_metrics() {
 		}
 	}
 
+#ifdef __linux__
+	if (uwsgi.taskstats) {
+		for(i=1;i<=uwsgi.numproc;i++) {
+			uwsgi_setup_metrics_taskstats("worker", "3", i, &uwsgi.workers[i].taskstats);
+		}
+		// the 'mule' namespace
+		for(i=0;i<uwsgi.mules_cnt;i++) {
+			uwsgi_setup_metrics_taskstats("mule", "8", i + 1, &uwsgi.mules[i].taskstats);
+		}
+	}
+#endif
+
 	// append parents
 	uwsgi_metric_append(total_tx);
 	uwsgi_metric_append(total_rss);
@@ -873,6 +1080,7 @@ void uwsgi_setup_metrics() {
 			}
 			metric->value = alias->value;
 			metric->oid = alias->oid;
+			metric->oid_len = alias->oid_len;
 		}
 		if (metric->initial_value) {
 			*metric->value = metric->initial_value;
@@ -880,6 +1088,56 @@ void uwsgi_setup_metrics() {
 		metric = metric->next;
 	}
 
+	// allocate per-core shards for metrics updated by the application
+	if (!uwsgi.metrics_no_shards && uwsgi.numproc > 0 && uwsgi.cores > 0) {
+		uint64_t shardable = 0;
+		metric = uwsgi.metrics;
+		while(metric) {
+			if (!metric->collector && metric->type != UWSGI_METRIC_ALIAS) shardable++;
+			metric = metric->next;
+		}
+		if (shardable) {
+			// each core gets its own group of cache lines
+			uwsgi.metrics_shards_stride = (shardable + 7) & ~((uint64_t) 7);
+			uwsgi.metrics_shards = uwsgi_calloc_shared(sizeof(int64_t) * uwsgi.metrics_shards_stride * uwsgi.numproc * uwsgi.cores);
+			pos = 0;
+			metric = uwsgi.metrics;
+			while(metric) {
+				if (!metric->collector && metric->type != UWSGI_METRIC_ALIAS) {
+					metric->shards = &uwsgi.metrics_shards[pos];
+					pos++;
+				}
+				metric = metric->next;
+			}
+		}
+	}
+
+	// build the oid index (the first registered metric wins, like the old linear scan)
+	struct uwsgi_metric **oid_hash = uwsgi_calloc(sizeof(struct uwsgi_metric *) * UWSGI_METRICS_HASH_SIZE);
+	metric = uwsgi.metrics;
+	while(metric) {
+		if (metric->oid && metric->type != UWSGI_METRIC_ALIAS) {
+			metric->oid_len = strlen(metric->oid);
+			uint32_t hash = djb33x_hash(metric->oid, metric->oid_len) % UWSGI_METRICS_HASH_SIZE;
+			struct uwsgi_metric *um = oid_hash[hash], *last = NULL;
+			while(um) {
+				if (!uwsgi_strncmp(um->oid, um->oid_len, metric->oid, metric->oid_len)) break;
+				last = um;
+				um = um->ohnext;
+			}
+			if (!um) {
+				if (last) {
+					last->ohnext = metric;
+				}
+				else {
+					oid_hash[hash] = metric;
+				}
+			}
+		}
+		metric = metric->next;
+	}
+	uwsgi.metrics_oid_hash = oid_hash;
+
 	// setup thresholds
 	uwsgi_foreach(usl, uwsgi.metrics_threshold) {
 		char *m_key = NULL;
@@ -1078,4 +1336,5 @@ void uwsgi_metrics_collectors_setup() {
 	uwsgi_register_metric_collector("multiplier", uwsgi_metric_collector_multiplier);
 	uwsgi_register_metric_collector("avg", uwsgi_metric_collector_avg);
 	uwsgi_register_metric_collector("func", uwsgi_metric_collector_func);
+	uwsgi_register_metric_collector("histogram", uwsgi_metric_collector_histogram);
 }
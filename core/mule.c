@@ -12,7 +12,7 @@ extern struct uwsgi_server uwsgi;
 
 void uwsgi_mule_handler(void);
 
-void mule_send_msg(int fd, char *message, size_t len) {
+int mule_send_msg(int fd, char *message, size_t len) {
 
 	socklen_t so_bufsize_len = sizeof(int);
 	int so_bufsize = 0;
@@ -27,6 +27,241 @@ void mule_send_msg(int fd, char *message, size_t len) {
 		else {
 			uwsgi_error("mule_send_msg()");
 		}
+		return -1;
+	}
+	return 0;
+}
+
+/*
+	shared memory rings (--mule-ring)
+
+	producers append records under the ring lock, consumers take the lock only once
+	for a whole batch. A consumer about to sleep announces itself in ring_waiting, so a producer
+	wakes a single sleeping mule (instead of all of them) with one byte on its ring_pipe.
+*/
+
+static struct uwsgi_mule_ring *uwsgi_mule_ring_new(char *name) {
+	struct uwsgi_mule_ring *ring = uwsgi_calloc_shared(sizeof(struct uwsgi_mule_ring));
+	ring->size = uwsgi.mule_ring;
+	ring->data = uwsgi_calloc_shared(ring->size);
+	ring->lock = uwsgi_lock_init(name);
+	return ring;
+}
+
+static void mule_ring_copy_in(struct uwsgi_mule_ring *ring, uint64_t pos, void *buf, uint64_t len) {
+	uint64_t off = pos % ring->size;
+	uint64_t chunk = ring->size - off;
+	if (chunk > len) chunk = len;
+	memcpy(ring->data + off, buf, chunk);
+	if (len > chunk) memcpy(ring->data, (char *) buf + chunk, len - chunk);
+}
+
+static void mule_ring_copy_out(struct uwsgi_mule_ring *ring, uint64_t pos, void *buf, uint64_t len) {
+	uint64_t off = pos % ring->size;
+	uint64_t chunk = ring->size - off;
+	if (chunk > len) chunk = len;
+	memcpy(buf, ring->data + off, chunk);
+	if (len > chunk) memcpy((char *) buf + chunk, ring->data, len - chunk);
+}
+
+static int mule_ring_put(struct uwsgi_mule_ring *ring, char *message, size_t len) {
+	uint64_t ref[2] = {0, 0};
+	char *payload = message;
+	uint32_t hdr = len;
+
+	if (len >= UWSGI_MULE_RING_REF) {
+		uwsgi_log("*** MULE MSG TOO BIG: %llu bytes ***\n", (unsigned long long) len);
+		return -1;
+	}
+
+	// big messages go to the sharedheap, only the handle is queued
+	if (uwsgi.mule_ring_heap > -1 && len > uwsgi.mule_ring_ref_size) {
+		ref[0] = uwsgi_sharedheap_alloc(uwsgi.mule_ring_heap, len);
+		if (ref[0]) {
+			if (uwsgi_sharedheap_write(uwsgi.mule_ring_heap, ref[0], message, len)) {
+				uwsgi_sharedheap_free(uwsgi.mule_ring_heap, ref[0]);
+				ref[0] = 0;
+			}
+			else {
+				ref[1] = len;
+				payload = (char *) ref;
+				hdr = sizeof(ref) | UWSGI_MULE_RING_REF;
+			}
+		}
+	}
+
+	uint64_t rlen = 4 + (hdr & ~UWSGI_MULE_RING_REF);
+
+	uwsgi_lock(ring->lock);
+	if (ring->size - (ring->head - ring->tail) < rlen) {
+		ring->full++;
+		uwsgi_unlock(ring->lock);
+		if (ref[0]) uwsgi_sharedheap_free(uwsgi.mule_ring_heap, ref[0]);
+		uwsgi_log("*** MULE MSG RING IS FULL: %llu bytes (you can tune it with --mule-ring) ***\n", (unsigned long long) ring->size);
+		return -1;
+	}
+	mule_ring_copy_in(ring, ring->head, &hdr, 4);
+	mule_ring_copy_in(ring, ring->head + 4, payload, rlen - 4);
+	ring->head += rlen;
+	uwsgi_unlock(ring->lock);
+	return 0;
+}
+
+// dequeue up to max messages (allocated with malloc), returns the number of messages
+static int mule_ring_get(struct uwsgi_mule_ring *ring, char **messages, size_t *lens, int max) {
+	int n = 0;
+	if (!ring || max < 1) return 0;
+	// unlocked peek, a stale value is fixed by the ring_waiting protocol
+	if (ring->head == ring->tail) return 0;
+
+	uwsgi_lock(ring->lock);
+	while (n < max && ring->tail < ring->head) {
+		uint32_t hdr = 0;
+		mule_ring_copy_out(ring, ring->tail, &hdr, 4);
+		uint32_t len = hdr & ~UWSGI_MULE_RING_REF;
+		if (hdr & UWSGI_MULE_RING_REF) {
+			uint64_t ref[2];
+			mule_ring_copy_out(ring, ring->tail + 4, ref, sizeof(ref));
+			messages[n] = uwsgi_malloc(ref[1] + 1);
+			int64_t rlen = uwsgi_sharedheap_read(uwsgi.mule_ring_heap, ref[0], messages[n], ref[1]);
+			uwsgi_sharedheap_free(uwsgi.mule_ring_heap, ref[0]);
+			lens[n] = rlen < 0 ? 0 : rlen;
+		}
+		else {
+			messages[n] = uwsgi_malloc(len + 1);
+			mule_ring_copy_out(ring, ring->tail + 4, messages[n], len);
+			lens[n] = len;
+		}
+		ring->tail += 4 + len;
+		n++;
+	}
+	uwsgi_unlock(ring->lock);
+	return n;
+}
+
+static int mule_ring_wake(struct uwsgi_mule *um) {
+	if (!uwsgi_atomic_cas(&um->ring_waiting, 1, 0)) return 0;
+	char byte = 1;
+	if (write(um->ring_pipe[0], &byte, 1) < 0 && !uwsgi_is_again()) {
+		uwsgi_error("mule_ring_wake()/write()");
+	}
+	return 1;
+}
+
+// mule_id 0 means "any mule", farm (if not NULL) has precedence over mule_id
+int uwsgi_mule_ring_push(int mule_id, struct uwsgi_farm *farm, char *message, size_t len) {
+	int i;
+	if (!uwsgi.mule_ring || uwsgi.mules_cnt < 1) return -1;
+
+	if (farm) {
+		if (mule_ring_put(farm->ring, message, len)) return -1;
+		uwsgi_barrier();
+		struct uwsgi_mule_farm *umf = farm->mules;
+		while (umf) {
+			if (mule_ring_wake(umf->mule)) break;
+			umf = umf->next;
+		}
+		return 0;
+	}
+
+	if (mule_id > 0) {
+		if (mule_id > uwsgi.mules_cnt) return -1;
+		if (mule_ring_put(uwsgi.mules[mule_id - 1].ring, message, len)) return -1;
+		uwsgi_barrier();
+		mule_ring_wake(&uwsgi.mules[mule_id - 1]);
+		return 0;
+	}
+
+	if (mule_ring_put(uwsgi.mule_ring_any, message, len)) return -1;
+	uwsgi_barrier();
+	for (i = 0; i < uwsgi.mules_cnt; i++) {
+		if (mule_ring_wake(&uwsgi.mules[i])) break;
+	}
+	return 0;
+}
+
+// collect messages from all of the rings the current mule is subscribed to
+static int mule_rings_get(int manage_farms, char **messages, size_t *lens, int max) {
+	int i;
+	int n = mule_ring_get(uwsgi.mules[uwsgi.muleid - 1].ring, messages, lens, max);
+	if (manage_farms) {
+		for (i = 0; i < uwsgi.farms_cnt && n < max; i++) {
+			if (uwsgi_farm_has_mule(&uwsgi.farms[i], uwsgi.muleid)) {
+				n += mule_ring_get(uwsgi.farms[i].ring, messages + n, lens + n, max - n);
+			}
+		}
+	}
+	n += mule_ring_get(uwsgi.mule_ring_any, messages + n, lens + n, max - n);
+	return n;
+}
+
+/*
+	announce we are going to sleep and recheck the rings (a producer could have pushed
+	a message before seeing us waiting), returns the number of dequeued messages
+*/
+static int mule_rings_prepare_wait(int manage_farms, char **messages, size_t *lens, int max) {
+	struct uwsgi_mule *um = &uwsgi.mules[uwsgi.muleid - 1];
+	uwsgi_atomic_xchg(&um->ring_waiting, 1);
+	uwsgi_barrier();
+	int n = mule_rings_get(manage_farms, messages, lens, max);
+	if (n > 0) uwsgi_atomic_xchg(&um->ring_waiting, 0);
+	return n;
+}
+
+static void mule_rings_wakeup_ack(void) {
+	struct uwsgi_mule *um = &uwsgi.mules[uwsgi.muleid - 1];
+	char buf[64];
+	uwsgi_atomic_xchg(&um->ring_waiting, 0);
+	while (read(um->ring_pipe[1], buf, 64) > 0);
+}
+
+// batched consumer, messages must be freed by the caller
+int uwsgi_mule_get_msgs(int manage_signals, int manage_farms, char **messages, size_t *lens, int max, int timeout) {
+	struct pollfd mulepoll[3];
+	int nfds = 1;
+
+	if (uwsgi.muleid == 0 || !uwsgi.mule_ring)
+		return -1;
+
+	struct uwsgi_mule *um = &uwsgi.mules[uwsgi.muleid - 1];
+
+	int n = mule_rings_get(manage_farms, messages, lens, max);
+	if (n > 0) return n;
+
+	if (timeout > -1)
+		timeout = timeout * 1000;
+
+	mulepoll[0].fd = um->ring_pipe[1];
+	mulepoll[0].events = POLLIN;
+	if (manage_signals) {
+		mulepoll[1].fd = uwsgi.signal_socket;
+		mulepoll[1].events = POLLIN;
+		mulepoll[2].fd = uwsgi.my_signal_socket;
+		mulepoll[2].events = POLLIN;
+		nfds = 3;
+	}
+
+	for (;;) {
+		n = mule_rings_prepare_wait(manage_farms, messages, lens, max);
+		if (n > 0) return n;
+		int ret = poll(mulepoll, nfds, timeout);
+		mule_rings_wakeup_ack();
+		if (ret < 0) {
+			if (errno == EINTR) continue;
+			uwsgi_error("uwsgi_mule_get_msgs()/poll()");
+			return -1;
+		}
+		if (ret == 0) return 0;
+		if (manage_signals) {
+			int i;
+			for (i = 1; i < 3; i++) {
+				if (!(mulepoll[i].revents & POLLIN)) continue;
+				uwsgi_receive_signal(NULL, mulepoll[i].fd, "mule", uwsgi.muleid);
+				return -1;
+			}
+		}
+		n = mule_rings_get(manage_farms, messages, lens, max);
+		if (n > 0) return n;
 	}
 }
 
@@ -163,10 +398,21 @@ void uwsgi_mule_add_farm_to_queue(int queue) {
 	}
 }
 
+static void uwsgi_mule_dispatch_msg(char *message, size_t len) {
+	int i;
+	for (i = 0; i < 256; i++) {
+		if (uwsgi.p[i]->mule_msg) {
+			if (uwsgi.p[i]->mule_msg(message, len)) {
+				return;
+			}
+		}
+	}
+	uwsgi_log("*** mule %d received a %ld bytes message ***\n", uwsgi.muleid, (long) len);
+}
+
 void uwsgi_mule_handler() {
 
 	ssize_t len;
-	uint8_t uwsgi_signal;
 	int rlen;
 	int interesting_fd;
 
@@ -182,25 +428,35 @@ void uwsgi_mule_handler() {
 
 	uwsgi_mule_add_farm_to_queue(mule_queue);
 
+	if (uwsgi.mule_ring) {
+		event_queue_add_fd_read(mule_queue, uwsgi.mules[uwsgi.muleid - 1].ring_pipe[1]);
+	}
+
 	for (;;) {
+		if (uwsgi.mule_ring) {
+			char *messages[64];
+			size_t lens[64];
+			int i, n = mule_rings_prepare_wait(1, messages, lens, 64);
+			for (i = 0; i < n; i++) {
+				uwsgi_mule_dispatch_msg(messages[i], lens[i]);
+				free(messages[i]);
+			}
+			// more messages could be available
+			if (n > 0) continue;
+		}
+
 		rlen = event_queue_wait(mule_queue, -1, &interesting_fd);
+		if (uwsgi.mule_ring) mule_rings_wakeup_ack();
 		if (rlen <= 0) {
 			continue;
 		}
 
+		if (uwsgi.mule_ring && interesting_fd == uwsgi.mules[uwsgi.muleid - 1].ring_pipe[1]) {
+			continue;
+		}
+
 		if (interesting_fd == uwsgi.signal_socket || interesting_fd == uwsgi.my_signal_socket || farm_has_signaled(interesting_fd)) {
-			len = read(interesting_fd, &uwsgi_signal, 1);
-			if (len <= 0) {
-				if (len < 0 && (errno == EAGAIN || errno == EINTR || errno == EWOULDBLOCK)) continue;
-				uwsgi_log_verbose("uWSGI mule %d braying: my master died, i will follow him...\n", uwsgi.muleid);
-				end_me(0);
-			}
-#ifdef UWSGI_DEBUG
-			uwsgi_log_verbose("master sent signal %d to mule %d\n", uwsgi_signal, uwsgi.muleid);
-#endif
-			if (uwsgi_signal_handler(NULL, uwsgi_signal)) {
-				uwsgi_log_verbose("error managing signal %d on mule %d\n", uwsgi_signal, uwsgi.muleid);
-			}
+			uwsgi_receive_signal(NULL, interesting_fd, "mule", uwsgi.muleid);
 		}
 		else if (interesting_fd == uwsgi.mules[uwsgi.muleid - 1].queue_pipe[1] || interesting_fd == uwsgi.shared->mule_queue_pipe[1] || farm_has_msg(interesting_fd)) {
 			len = read(interesting_fd, message, 65536);
@@ -210,17 +466,7 @@ void uwsgi_mule_handler() {
 				}
 			}
 			else {
-				int i, found = 0;
-				for (i = 0; i < 256; i++) {
-					if (uwsgi.p[i]->mule_msg) {
-						if (uwsgi.p[i]->mule_msg(message, len)) {
-							found = 1;
-							break;
-						}
-					}
-				}
-				if (!found)
-					uwsgi_log("*** mule %d received a %ld bytes message ***\n", uwsgi.muleid, (long) len);
+				uwsgi_mule_dispatch_msg(message, len);
 			}
 		}
 	}
@@ -284,7 +530,6 @@ ssize_t uwsgi_mule_get_msg(int manage_signals, int manage_farms, char *message,
 	struct pollfd *mulepoll;
 	int count = 4;
 	int farms_count = 0;
-	uint8_t uwsgi_signal;
 	int i;
 
 	if (uwsgi.muleid == 0)
@@ -305,7 +550,14 @@ next:
 	if (timeout > -1)
 		timeout = timeout * 1000;
 
-	mulepoll = uwsgi_malloc(sizeof(struct pollfd) * (count + farms_count));
+	// the last slot is for the ring wakeup pipe
+	mulepoll = uwsgi_malloc(sizeof(struct pollfd) * (count + farms_count + 1));
+	int nfds = count + farms_count;
+	if (uwsgi.mule_ring) {
+		mulepoll[nfds].fd = uwsgi.mules[uwsgi.muleid - 1].ring_pipe[1];
+		mulepoll[nfds].events = POLLIN;
+		nfds++;
+	}
 
 	mulepoll[0].fd = uwsgi.mules[uwsgi.muleid - 1].queue_pipe[1];
 	mulepoll[0].events = POLLIN;
@@ -331,11 +583,26 @@ next:
 
 	int ret = -1;
 retry:
-	ret = poll(mulepoll, count + farms_count, timeout);
+	if (uwsgi.mule_ring) {
+		char *ring_msg = NULL;
+		size_t ring_len = 0;
+		if (mule_rings_prepare_wait(manage_farms, &ring_msg, &ring_len, 1) > 0) {
+			len = UMIN(ring_len, buffer_size);
+			memcpy(message, ring_msg, len);
+			free(ring_msg);
+			goto clear;
+		}
+	}
+	ret = poll(mulepoll, nfds, timeout);
+	if (uwsgi.mule_ring)
+		mule_rings_wakeup_ack();
 	if (ret < 0) {
 		uwsgi_error("uwsgi_mule_get_msg()/poll()");
 	}
 	else if (ret > 0 ) {
+		if (uwsgi.mule_ring && (mulepoll[nfds - 1].revents & POLLIN)) {
+			goto retry;
+		}
 		if (mulepoll[0].revents & POLLIN) {
 			len = read(uwsgi.mules[uwsgi.muleid - 1].queue_pipe[1], message, buffer_size);
 		}
@@ -353,18 +620,7 @@ retry:
 				}
 
 				if (interesting_fd > -1) {
-					len = read(interesting_fd, &uwsgi_signal, 1);
-					if (len <= 0) {
-						if (uwsgi_is_again()) goto retry;
-						uwsgi_log_verbose("uWSGI mule %d braying: my master died, i will follow him...\n", uwsgi.muleid);
-						end_me(0);
-					}
-#ifdef UWSGI_DEBUG
-					uwsgi_log_verbose("master sent signal %d to mule %d\n", uwsgi_signal, uwsgi.muleid);
-#endif
-					if (uwsgi_signal_handler(NULL, uwsgi_signal)) {
-						uwsgi_log_verbose("error managing signal %d on mule %d\n", uwsgi_signal, uwsgi.muleid);
-					}
+					uwsgi_receive_signal(NULL, interesting_fd, "mule", uwsgi.muleid);
 					// set the error condition
 					len = -1;
 					goto clear;
@@ -422,11 +678,21 @@ void uwsgi_setup_mules_and_farms() {
 		create_signal_pipe(uwsgi.shared->mule_signal_pipe);
 		create_msg_pipe(uwsgi.shared->mule_queue_pipe, uwsgi.mule_msg_size);
 
+		if (uwsgi.mule_ring) {
+			uwsgi.mule_ring_any = uwsgi_mule_ring_new("mule ring");
+			uwsgi_log("mules message rings: %llu bytes\n", (unsigned long long) uwsgi.mule_ring);
+		}
+
 		for (i = 0; i < uwsgi.mules_cnt; i++) {
 			// create the socket pipe
 			create_signal_pipe(uwsgi.mules[i].signal_pipe);
 			create_msg_pipe(uwsgi.mules[i].queue_pipe, uwsgi.mule_msg_size);
 
+			if (uwsgi.mule_ring) {
+				uwsgi.mules[i].ring = uwsgi_mule_ring_new("mule ring");
+				create_signal_pipe(uwsgi.mules[i].ring_pipe);
+			}
+
 			uwsgi.mules[i].id = i + 1;
 
 			snprintf(uwsgi.mules[i].name, 0xff, "uWSGI mule %d", i + 1);
@@ -457,6 +723,10 @@ void uwsgi_setup_mules_and_farms() {
 			create_signal_pipe(uwsgi.farms[i].signal_pipe);
 			create_msg_pipe(uwsgi.farms[i].queue_pipe, uwsgi.mule_msg_size);
 
+			if (uwsgi.mule_ring) {
+				uwsgi.farms[i].ring = uwsgi_mule_ring_new("farm ring");
+			}
+
 			char *p, *ctx = NULL;
 			uwsgi_foreach_token(mules_list, ",", p, ctx) {
 				struct uwsgi_mule *um = get_mule_by_id(atoi(p));
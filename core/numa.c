@@ -0,0 +1,197 @@
+#include <uwsgi.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+extern struct uwsgi_server uwsgi;
+
+/*
+
+	NUMA support (Linux only)
+
+	--numa-interleave spreads the pages of the shared memory areas (workers table, sharedareas, caches...)
+	over all of the nodes, so no worker pays the remote memory penalty alone.
+
+	--numa-workers groups the workers by node (contiguous blocks of ids), pins them to the cpus
+	of their node, prefers the local node for their private memory and binds the per-worker
+	shared areas (cores, buffers...) to the node of the worker.
+
+	the libnuma api is not used, only the mbind/set_mempolicy syscalls.
+
+*/
+
+#if defined(__linux__) && defined(__NR_mbind) && defined(__NR_set_mempolicy)
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3
+#endif
+
+#define UWSGI_NUMA_MAX_NODES (sizeof(unsigned long) * 8)
+
+static int numa_nodes;
+static unsigned long numa_online;
+static cpu_set_t *numa_cpus;
+// the node the next shared memory allocation is bound to (-1 for the global policy)
+static int numa_alloc_node = -1;
+
+// parse a kernel list ("0-3,8,10-11") calling the hook for each item
+static int numa_parse_list(char *list, void (*hook)(int, void *), void *data) {
+	char *ctx = NULL;
+	char *p = strtok_r(list, ",\n", &ctx);
+	while (p) {
+		char *dash = strchr(p, '-');
+		int from = atoi(p);
+		int to = dash ? atoi(dash + 1) : from;
+		if (from < 0 || to < from) return -1;
+		int i;
+		for (i = from; i <= to; i++) {
+			hook(i, data);
+		}
+		p = strtok_r(NULL, ",\n", &ctx);
+	}
+	return 0;
+}
+
+static void numa_add_node(int node, void *data) {
+	if (node >= (int) UWSGI_NUMA_MAX_NODES) return;
+	numa_online |= (1UL << node);
+	if (node + 1 > numa_nodes) numa_nodes = node + 1;
+}
+
+static void numa_add_cpu(int cpu, void *data) {
+	cpu_set_t *cpuset = (cpu_set_t *) data;
+	if (cpu < CPU_SETSIZE) CPU_SET(cpu, cpuset);
+}
+
+static char *numa_read(char *path) {
+	size_t len = 0;
+	return uwsgi_open_and_read(path, &len, 1, NULL);
+}
+
+static int numa_worker_node(int wid) {
+	if (!uwsgi.numa_workers || numa_nodes < 1 || wid < 1) return -1;
+	int node = ((wid - 1) * numa_nodes) / uwsgi.numproc;
+	// skip holes (offline nodes)
+	while (node < numa_nodes && !(numa_online & (1UL << node))) node++;
+	if (node >= numa_nodes) return -1;
+	return node;
+}
+
+void uwsgi_numa_setup() {
+	int i;
+	if (!uwsgi.numa_interleave && !uwsgi.numa_workers) return;
+
+	if (access("/sys/devices/system/node/online", R_OK)) {
+		uwsgi_log("unable to detect NUMA nodes, NUMA support disabled\n");
+		uwsgi.numa_interleave = 0;
+		uwsgi.numa_workers = 0;
+		return;
+	}
+
+	char *online = numa_read("/sys/devices/system/node/online");
+	if (numa_parse_list(online, numa_add_node, NULL) || numa_nodes < 1) {
+		uwsgi_log("unable to parse the list of NUMA nodes: %s\n", online);
+		exit(1);
+	}
+	free(online);
+
+	numa_cpus = uwsgi_calloc(sizeof(cpu_set_t) * numa_nodes);
+	for (i = 0; i < numa_nodes; i++) {
+		CPU_ZERO(&numa_cpus[i]);
+		if (!(numa_online & (1UL << i))) continue;
+		char *num = uwsgi_num2str(i);
+		char *path = uwsgi_concat3("/sys/devices/system/node/node", num, "/cpulist");
+		free(num);
+		char *cpulist = numa_read(path);
+		if (numa_parse_list(cpulist, numa_add_cpu, &numa_cpus[i])) {
+			uwsgi_log("unable to parse %s\n", path);
+			exit(1);
+		}
+		free(cpulist);
+		free(path);
+		uwsgi_log_initial("NUMA node %d: %d cpus\n", i, CPU_COUNT(&numa_cpus[i]));
+	}
+
+	uwsgi_log_initial("NUMA nodes: %d (interleave: %s, workers grouped by node: %s)\n", __builtin_popcountl(numa_online),
+		uwsgi.numa_interleave ? "yes" : "no", uwsgi.numa_workers ? "yes" : "no");
+}
+
+// called by uwsgi_malloc_shared() on new mappings, before touching them
+void uwsgi_numa_mbind(void *addr, size_t len) {
+	unsigned long mask;
+	int mode;
+	if (numa_nodes < 1) return;
+	if (numa_alloc_node >= 0) {
+		mode = MPOL_BIND;
+		mask = 1UL << numa_alloc_node;
+	}
+	else if (uwsgi.numa_interleave) {
+		mode = MPOL_INTERLEAVE;
+		mask = numa_online;
+	}
+	else {
+		return;
+	}
+	if (syscall(__NR_mbind, addr, len, mode, &mask, UWSGI_NUMA_MAX_NODES + 1, 0)) {
+		uwsgi_error("uwsgi_numa_mbind()/mbind()");
+	}
+}
+
+// bind the next shared memory allocations to the node of the specified worker (0 to reset)
+void uwsgi_numa_alloc_for_worker(int wid) {
+	numa_alloc_node = numa_worker_node(wid);
+}
+
+// returns the first cpu of the node of the worker (or -1)
+int uwsgi_numa_worker_cpu(int wid) {
+	int node = numa_worker_node(wid);
+	if (node < 0) return -1;
+	int i;
+	for (i = 0; i < CPU_SETSIZE; i++) {
+		if (CPU_ISSET(i, &numa_cpus[node])) return i;
+	}
+	return -1;
+}
+
+// called in the worker after the cpu affinity setup
+void uwsgi_numa_worker() {
+	int node = numa_worker_node(uwsgi.mywid);
+	if (node < 0) return;
+
+	// --cpu-affinity wins
+	if (!uwsgi.cpu_affinity && CPU_COUNT(&numa_cpus[node]) > 0) {
+		if (sched_setaffinity(0, sizeof(cpu_set_t), &numa_cpus[node])) {
+			uwsgi_error("uwsgi_numa_worker()/sched_setaffinity()");
+		}
+	}
+
+	unsigned long mask = 1UL << node;
+	if (syscall(__NR_set_mempolicy, MPOL_PREFERRED, &mask, UWSGI_NUMA_MAX_NODES + 1)) {
+		uwsgi_error("uwsgi_numa_worker()/set_mempolicy()");
+	}
+
+	uwsgi_log("mapping worker %d to NUMA node %d\n", uwsgi.mywid, node);
+}
+
+#else
+
+void uwsgi_numa_setup() {
+	if (uwsgi.numa_interleave || uwsgi.numa_workers) {
+		uwsgi_log("NUMA support is not available on this platform\n");
+		uwsgi.numa_interleave = 0;
+		uwsgi.numa_workers = 0;
+	}
+}
+
+void uwsgi_numa_mbind(void *addr, size_t len) {}
+void uwsgi_numa_alloc_for_worker(int wid) {}
+int uwsgi_numa_worker_cpu(int wid) { return -1; }
+void uwsgi_numa_worker() {}
+
+#endif
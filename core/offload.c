@@ -42,14 +42,27 @@ void uwsgi_offload_setup(struct uwsgi_offload_engine *uoe, struct uwsgi_offload_
 
 static int uwsgi_offload_enqueue(struct wsgi_request *wsgi_req, struct uwsgi_offload_request *uor) {
 	struct uwsgi_core *uc = &uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id];
+	struct uwsgi_offload_thread_stats *uots = uwsgi.workers[uwsgi.mywid].offload_stats;
 	uc->offloaded_requests++;
 	// round robin
 	if (uc->offload_rr >= uwsgi.offload_threads) {
 		uc->offload_rr = 0;
 	}
-	struct uwsgi_thread *ut = uwsgi.offload_thread[uc->offload_rr];
+	int t = uc->offload_rr;
 	uc->offload_rr++;
+	// choose the thread with less active tasks (starting from the round robin one for ties)
+	if (!uwsgi.offload_threads_rr) {
+		int i;
+		for (i = 1; i < uwsgi.offload_threads; i++) {
+			int candidate = (uc->offload_rr - 1 + i) % uwsgi.offload_threads;
+			if (uots[candidate].active < uots[t].active) t = candidate;
+		}
+	}
+	struct uwsgi_thread *ut = uwsgi.offload_thread[t];
+	// account it before the thread could close it
+	__sync_add_and_fetch(&uots[t].active, 1);
 	if (write(ut->pipe[0], uor, sizeof(struct uwsgi_offload_request)) != sizeof(struct uwsgi_offload_request)) {
+		__sync_sub_and_fetch(&uots[t].active, 1);
 		if (uor->takeover) {
 			wsgi_req->fd_closed = 0;
 		}
@@ -77,6 +90,23 @@ static int u_offload_pipe_prepare(struct wsgi_request *wsgi_req, struct uwsgi_of
         return 0;
 }
 
+/*
+
+	body offload engine (reads the request body from the client):
+		s -> a dup() of the client socket (closed at the end)
+		fd -> the stream (the worker reads the other side)
+		len -> amount of body to transfer
+
+*/
+
+static int u_offload_body_prepare(struct wsgi_request *wsgi_req, struct uwsgi_offload_request *uor) {
+
+        if (uor->s < 0 || uor->fd < 0 || !uor->len) {
+                return -1;
+        }
+        return 0;
+}
+
 /*
 
         memory offload engine:
@@ -94,6 +124,22 @@ static int u_offload_memory_prepare(struct wsgi_request *wsgi_req, struct uwsgi_
 }
 
 
+/*
+
+        snapshot offload engine:
+                data -> the uwsgi_offload_snapshot to transfer (the reference is released at the end)
+                len -> amount of data to transfer
+
+*/
+
+static int u_offload_snapshot_prepare(struct wsgi_request *wsgi_req, struct uwsgi_offload_request *uor) {
+
+        if (!uor->data || !uor->len) {
+                return -1;
+        }
+        return 0;
+}
+
 /*
 
 	transfer offload engine:
@@ -108,6 +154,15 @@ static int u_offload_transfer_prepare(struct wsgi_request *wsgi_req, struct uwsg
 		return -1;
 	}
 
+	// keepalive upstreams are picked (or connected) by the offload thread, keep a copy of the name
+	if (uor->custom1) {
+		size_t name_len = strlen(uor->name);
+		uor->ubuf1 = uwsgi_buffer_new(name_len + 1);
+		if (uwsgi_buffer_append(uor->ubuf1, uor->name, name_len + 1)) return -1;
+		uor->name = uor->ubuf1->buf;
+		return 0;
+	}
+
 	uor->fd = uwsgi_connect(uor->name, 0, 1);
 	if (uor->fd < 0) {
 		uwsgi_error("u_offload_transfer_prepare()/connect()");
@@ -161,7 +216,48 @@ static int u_offload_sendfile_prepare(struct wsgi_request *wsgi_req, struct uwsg
 	return 0;
 }
 
-static void uwsgi_offload_close(struct uwsgi_thread *ut, struct uwsgi_offload_request *uor) {
+/*
+
+	byteranges offload engine:
+		fd -> the file descriptor
+		ubuf -> the part headers and the closing boundary
+		data -> the array of parts (freed at the end)
+		custom1 -> number of parts
+		len -> size of the whole body
+
+*/
+
+static int u_offload_byteranges_prepare(struct wsgi_request *wsgi_req, struct uwsgi_offload_request *uor) {
+
+	if (uor->fd == -1 || !uor->ubuf || !uor->data || uor->custom1 < 1) return -1;
+
+	uor->fd2 = uor->s;
+	uor->s = -1;
+
+	return 0;
+}
+
+// fd -> task map, so dispatching does not depend on the number of tasks (think about idle websockets)
+static void uwsgi_offload_index(struct uwsgi_thread *ut, struct uwsgi_offload_request *uor, struct uwsgi_offload_request *value) {
+	int fds[3] = {uor->s, uor->fd, uor->fd2};
+	int i;
+	for (i = 0; i < 3; i++) {
+		if (fds[i] < 0 || fds[i] >= ut->offload_max_fd) continue;
+		// do not clear the entry of another task
+		if (!value && ut->offload_requests_by_fd[fds[i]] != uor) continue;
+		ut->offload_requests_by_fd[fds[i]] = value;
+	}
+}
+
+void uwsgi_offload_close(struct uwsgi_thread *ut, struct uwsgi_offload_request *uor) {
+
+	struct uwsgi_offload_thread_stats *uots = (struct uwsgi_offload_thread_stats *) ut->data;
+	uwsgi_offload_index(ut, uor, NULL);
+	__sync_sub_and_fetch(&uots->active, 1);
+	uots->tasks++;
+	uots->bytes += uor->written;
+
+	uwsgi_probe4(offload_end, uor->engine->name, uor->s, uor->fd, uor->written);
 
 	// call the free function asap
 	if (uor->free) {
@@ -243,7 +339,9 @@ static void uwsgi_offload_close(struct uwsgi_thread *ut, struct uwsgi_offload_re
 #endif
 }
 
-static void uwsgi_offload_append(struct uwsgi_thread *ut, struct uwsgi_offload_request *uor) {
+void uwsgi_offload_append(struct uwsgi_thread *ut, struct uwsgi_offload_request *uor) {
+
+	uwsgi_offload_index(ut, uor, uor);
 
 	if (!ut->offload_requests_head) {
 		ut->offload_requests_head = uor;
@@ -258,6 +356,9 @@ static void uwsgi_offload_append(struct uwsgi_thread *ut, struct uwsgi_offload_r
 }
 
 static struct uwsgi_offload_request *uwsgi_offload_get_by_fd(struct uwsgi_thread *ut, int s) {
+	if (s >= 0 && s < ut->offload_max_fd) {
+		return ut->offload_requests_by_fd[s];
+	}
 	struct uwsgi_offload_request *uor = ut->offload_requests_head;
 	while (uor) {
 		if (uor->s == s || uor->fd == s || uor->fd2 == s) {
@@ -273,12 +374,16 @@ static void uwsgi_offload_loop(struct uwsgi_thread *ut) {
 
 	int i;
 	void *events = event_queue_alloc(uwsgi.offload_threads_events);
+	// higher fds (if any) are looked up in the list
+	ut->offload_max_fd = UMIN(uwsgi.max_fd, 1024 * 1024);
+	ut->offload_requests_by_fd = uwsgi_calloc(sizeof(struct uwsgi_offload_request *) * ut->offload_max_fd);
 
 	for (;;) {
-		// TODO make timeout tunable
-		int nevents = event_queue_wait_multi(ut->queue, -1, events, uwsgi.offload_threads_events);
+		// offloaded websockets need a periodic check (ping/pong)
+		int nevents = event_queue_wait_multi(ut->queue, ut->offload_hub ? 1 : -1, events, uwsgi.offload_threads_events);
 		for (i = 0; i < nevents; i++) {
 			int interesting_fd = event_queue_interesting_fd(events, i);
+			if (ut->offload_hub && uwsgi_websockets_hub_event(ut, interesting_fd)) continue;
 			if (interesting_fd == ut->pipe[1]) {
 				struct uwsgi_offload_request *uor = uwsgi_malloc(sizeof(struct uwsgi_offload_request));
 				ssize_t len = read(ut->pipe[1], uor, sizeof(struct uwsgi_offload_request));
@@ -305,11 +410,14 @@ static void uwsgi_offload_loop(struct uwsgi_thread *ut) {
 				uwsgi_offload_close(ut, uor);
 			}
 		}
+		if (ut->offload_hub) {
+			uwsgi_websockets_hub_tick(ut);
+		}
 	}
 }
 
-struct uwsgi_thread *uwsgi_offload_thread_start() {
-	return uwsgi_thread_new(uwsgi_offload_loop);
+struct uwsgi_thread *uwsgi_offload_thread_start(struct uwsgi_offload_thread_stats *uots) {
+	return uwsgi_thread_new_with_data(uwsgi_offload_loop, uots);
 }
 
 /*
@@ -345,6 +453,46 @@ static int u_offload_memory_do(struct uwsgi_thread *ut, struct uwsgi_offload_req
 }
 
 
+/*
+
+	offload snapshot transfer
+
+	like the memory one, but the buffer is shared with other tasks
+
+        uor->data -> the snapshot
+        uor->len -> the size of the snapshot
+	uor->written -> written bytes
+
+        status: none
+
+*/
+
+static int u_offload_snapshot_do(struct uwsgi_thread *ut, struct uwsgi_offload_request *uor, int fd) {
+	struct uwsgi_offload_snapshot *uos = (struct uwsgi_offload_snapshot *) uor->data;
+	if (fd == -1) {
+                if (event_queue_add_fd_write(ut->queue, uor->s)) return -1;
+                return 0;
+        }
+	ssize_t rlen = write(uor->s, uos->buf + uor->written, uor->len - uor->written);
+	if (rlen > 0) {
+		uor->written += rlen;
+		if (uor->written >= uor->len) {
+			return -1;
+		}
+		return 0;
+	}
+        else if (rlen < 0) {
+		uwsgi_offload_retry
+                uwsgi_error("u_offload_snapshot_do()");
+	}
+	return -1;
+}
+
+static void u_offload_snapshot_free(struct uwsgi_offload_request *uor) {
+	uwsgi_offload_snapshot_release((struct uwsgi_offload_snapshot *) uor->data);
+}
+
+
 /*
 
 the offload task starts after having acquired the file fd
@@ -363,7 +511,8 @@ static int u_offload_sendfile_do(struct uwsgi_thread *ut, struct uwsgi_offload_r
 		return 0;
 	}
 #if defined(__linux__) || defined(__sun__) || defined(__GNU_kFreeBSD__)
-	ssize_t len = sendfile(uor->fd2, uor->fd, &uor->pos, 128 * 1024);
+	// never go over the requested range (the file could be bigger)
+	ssize_t len = sendfile(uor->fd2, uor->fd, &uor->pos, UMIN(128 * 1024, uor->len - uor->written));
 	if (len > 0) {
         	uor->written += len;
                 if (uor->written >= uor->len) {
@@ -398,12 +547,86 @@ static int u_offload_sendfile_do(struct uwsgi_thread *ut, struct uwsgi_offload_r
 
 }
 
+/*
+
+	multipart/byteranges transfer
+
+	status -> the current part
+	custom2 -> 0 sending the header of the part, 1 sending the file slice
+	buf_pos -> bytes of the current header already sent
+	pos -> current position in the file
+	uor->written -> written bytes
+
+*/
+
+static int u_offload_byteranges_do(struct uwsgi_thread *ut, struct uwsgi_offload_request *uor, int fd) {
+
+	if (fd == -1) {
+		if (event_queue_add_fd_write(ut->queue, uor->fd2)) return -1;
+		return 0;
+	}
+
+	struct uwsgi_byterange_part *part = ((struct uwsgi_byterange_part *) uor->data) + uor->status;
+	ssize_t rlen;
+
+	if (!uor->custom2) {
+		rlen = write(uor->fd2, uor->ubuf->buf + part->hdr_pos + uor->buf_pos, part->hdr_len - uor->buf_pos);
+		if (rlen > 0) {
+			uor->written += rlen;
+			uor->buf_pos += rlen;
+			if ((uint64_t) uor->buf_pos < part->hdr_len) return 0;
+			uor->buf_pos = 0;
+			// the closing boundary
+			if (!part->len) return -1;
+			uor->custom2 = 1;
+			uor->pos = part->pos;
+			return 0;
+		}
+		if (rlen < 0) {
+			uwsgi_offload_retry
+			uwsgi_error("u_offload_byteranges_do()/write()");
+		}
+		return -1;
+	}
+
+	size_t remains = (part->pos + part->len) - uor->pos;
+#if defined(__linux__) || defined(__sun__) || defined(__GNU_kFreeBSD__)
+	rlen = sendfile(uor->fd2, uor->fd, &uor->pos, UMIN(128 * 1024, remains));
+#else
+	char buf[32768];
+	rlen = pread(uor->fd, buf, UMIN(sizeof(buf), remains), uor->pos);
+	if (rlen > 0) {
+		rlen = write(uor->fd2, buf, rlen);
+		if (rlen > 0) uor->pos += rlen;
+	}
+#endif
+	if (rlen > 0) {
+		uor->written += rlen;
+		if ((uint64_t) uor->pos >= part->pos + part->len) {
+			uor->status++;
+			uor->custom2 = 0;
+		}
+		return 0;
+	}
+	if (rlen < 0) {
+		uwsgi_offload_retry
+		uwsgi_error("u_offload_byteranges_do()");
+	}
+	return -1;
+}
+
+static void u_offload_byteranges_free(struct uwsgi_offload_request *uor) {
+	free(uor->data);
+}
+
+
 /*
 
 	pipe offloading
 	status:
 		0 -> waiting for data on fd
 		1 -> waiting for write to s
+	uor->written -> written bytes
 */
 
 static int u_offload_pipe_do(struct uwsgi_thread *ut, struct uwsgi_offload_request *uor, int fd) {
@@ -442,6 +665,7 @@ static int u_offload_pipe_do(struct uwsgi_thread *ut, struct uwsgi_offload_reque
 			if (rlen > 0) {
 				uor->to_write -= rlen;
 				uor->pos += rlen;
+				uor->written += rlen;
 				if (uor->to_write == 0) {
 					if (event_queue_del_fd(ut->queue, uor->s, event_queue_write())) return -1;
 					if (event_queue_add_fd_read(ut->queue, uor->fd)) return -1;
@@ -463,6 +687,211 @@ static int u_offload_pipe_do(struct uwsgi_thread *ut, struct uwsgi_offload_reque
 
 
 
+/*
+
+	request body streaming
+
+	status:
+		0 -> waiting for data from the client
+		1 -> waiting for the worker to make room in the stream
+
+	the stream (and the dup of the socket) is closed at the end,
+	the worker gets EOF (or an error if the body is truncated)
+
+*/
+static int u_offload_body_do(struct uwsgi_thread *ut, struct uwsgi_offload_request *uor, int fd) {
+
+	ssize_t rlen;
+
+	// setup
+	if (fd == -1) {
+		uor->buf = uwsgi_malloc(uwsgi.post_buffering_bufsize);
+		event_queue_add_fd_read(ut->queue, uor->s);
+		return 0;
+	}
+
+	switch(uor->status) {
+		// read event from s
+		case 0:
+			rlen = read(uor->s, uor->buf, UMIN(uwsgi.post_buffering_bufsize, uor->len - uor->written));
+			if (rlen > 0) {
+				uor->to_write = rlen;
+				uor->buf_pos = 0;
+				if (event_queue_del_fd(ut->queue, uor->s, event_queue_read())) return -1;
+				if (event_queue_add_fd_write(ut->queue, uor->fd)) return -1;
+				uor->status = 1;
+				return 0;
+			}
+			if (rlen < 0) {
+				uwsgi_offload_retry
+				uwsgi_error("u_offload_body_do() -> read()");
+			}
+			return -1;
+		// write event on fd
+		case 1:
+#ifdef MSG_NOSIGNAL
+			rlen = send(uor->fd, uor->buf + uor->buf_pos, uor->to_write, MSG_NOSIGNAL);
+#else
+			rlen = send(uor->fd, uor->buf + uor->buf_pos, uor->to_write, 0);
+#endif
+			if (rlen > 0) {
+				uor->to_write -= rlen;
+				uor->buf_pos += rlen;
+				uor->written += rlen;
+				if (uor->to_write == 0) {
+					// the whole body has been transferred
+					if (uor->written >= uor->len) return -1;
+					if (event_queue_del_fd(ut->queue, uor->fd, event_queue_write())) return -1;
+					if (event_queue_add_fd_read(ut->queue, uor->s)) return -1;
+					uor->status = 0;
+				}
+				return 0;
+			}
+			else if (rlen < 0) {
+				uwsgi_offload_retry
+				// the worker closed the stream
+				if (errno == EPIPE || errno == ECONNRESET) return -1;
+				uwsgi_error("u_offload_body_do() -> send()");
+			}
+			return -1;
+		default:
+			break;
+	}
+
+	return -1;
+}
+
+static void u_offload_body_free(struct uwsgi_offload_request *uor) {
+	close(uor->s);
+	uor->s = -1;
+}
+
+/*
+	http upstream keepalive (--offload-http-keepalive)
+
+	each offload thread keeps its own list of idle connections (so no locking is needed),
+	a connection is reused only if the upstream explicitely asked for keepalive and the response
+	has a known size, so the end of the exchange can be detected without parsing the body.
+
+	uor->custom1 -> keepalive mode
+	uor->custom2 -> HEAD request (no body in the response)
+	uor->custom3 -> full size of the response (0 until the headers are parsed)
+	uor->custom4 -> bytes received from the upstream
+	uor->ubuf2 -> response headers
+*/
+
+static int offload_upstream_get(struct uwsgi_thread *ut, char *name) {
+	uint64_t now = uwsgi_now();
+	struct uwsgi_offload_upstream *uou = ut->offload_upstreams, *prev = NULL;
+	while (uou) {
+		struct uwsgi_offload_upstream *next = uou->next;
+		if (strcmp(uou->name, name)) {
+			prev = uou;
+			uou = next;
+			continue;
+		}
+		if (prev) prev->next = next;
+		else ut->offload_upstreams = next;
+		int fd = uou->fd;
+		int too_old = now - uou->last_used > (uint64_t) uwsgi.socket_timeout;
+		free(uou->name);
+		free(uou);
+		if (!too_old) {
+			// an idle connection must have nothing to read (neither data nor EOF)
+			char peek;
+			ssize_t rlen = recv(fd, &peek, 1, MSG_PEEK | MSG_DONTWAIT);
+			if (rlen < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return fd;
+		}
+		close(fd);
+		uou = next;
+	}
+	return -1;
+}
+
+static void offload_upstream_put(struct uwsgi_thread *ut, char *name, int fd) {
+	int count = 0;
+	struct uwsgi_offload_upstream *uou = ut->offload_upstreams;
+	while (uou) {
+		if (!strcmp(uou->name, name)) count++;
+		uou = uou->next;
+	}
+	if (count >= uwsgi.offload_http_keepalive) {
+		close(fd);
+		return;
+	}
+	uou = uwsgi_malloc(sizeof(struct uwsgi_offload_upstream));
+	uou->name = uwsgi_str(name);
+	uou->fd = fd;
+	uou->last_used = uwsgi_now();
+	uou->next = ut->offload_upstreams;
+	ut->offload_upstreams = uou;
+}
+
+// returns the full size of the response, 0 if the connection cannot be reused
+static uint64_t offload_http_response_size(char *buf, size_t len, size_t headers_len, int is_head) {
+	if (len < 12) return 0;
+	int status = uwsgi_str3_num(buf + 9);
+	int keepalive = 0;
+	int has_cl = 0;
+	uint64_t cl = 0;
+	char *p = buf, *end = buf + headers_len;
+	while (p < end) {
+		char *eol = memchr(p, '\n', end - p);
+		if (!eol) break;
+		char *colon = memchr(p, ':', eol - p);
+		if (colon) {
+			char *value = colon + 1;
+			while (value < eol && *value == ' ') value++;
+			size_t value_len = eol - value;
+			if (value_len > 0 && value[value_len - 1] == '\r') value_len--;
+			if (!uwsgi_strnicmp(p, colon - p, "Content-Length", 14)) {
+				has_cl = 1;
+				cl = uwsgi_str_num(value, value_len);
+			}
+			else if (!uwsgi_strnicmp(p, colon - p, "Connection", 10)) {
+				keepalive = !uwsgi_strnicmp(value, value_len, "keep-alive", 10);
+			}
+			else if (!uwsgi_strnicmp(p, colon - p, "Transfer-Encoding", 17)) {
+				return 0;
+			}
+		}
+		p = eol + 1;
+	}
+	if (!keepalive) return 0;
+	if (is_head || status == 204 || status == 304 || (status >= 100 && status < 200)) return headers_len;
+	if (!has_cl) return 0;
+	return headers_len + cl;
+}
+
+// account the bytes read from the upstream, turns off keepalive on anything unexpected
+static void offload_http_keepalive_feed(struct uwsgi_offload_request *uor, char *buf, size_t len) {
+	uor->custom4 += len;
+	if (!uor->custom3) {
+		if (!uor->ubuf2) {
+			uor->ubuf2 = uwsgi_buffer_new(4096);
+			uor->ubuf2->limit = UMAX16;
+		}
+		if (uwsgi_buffer_append(uor->ubuf2, buf, len)) {
+			uor->custom1 = 0;
+			return;
+		}
+		size_t i, headers_len = 0;
+		for (i = 3; i < uor->ubuf2->pos; i++) {
+			if (!memcmp(uor->ubuf2->buf + i - 3, "\r\n\r\n", 4)) {
+				headers_len = i + 1;
+				break;
+			}
+		}
+		if (!headers_len) return;
+		uor->custom3 = offload_http_response_size(uor->ubuf2->buf, uor->ubuf2->pos, headers_len, uor->custom2);
+		if (!uor->custom3) {
+			uor->custom1 = 0;
+			return;
+		}
+	}
+	if (uor->custom4 > uor->custom3) uor->custom1 = 0;
+}
+
 /*
 the offload task starts soon after the call to connect()
 
@@ -479,6 +908,16 @@ static int u_offload_transfer_do(struct uwsgi_thread *ut, struct uwsgi_offload_r
 
 	// setup
 	if (fd == -1) {
+		if (uor->custom1) {
+			uor->fd = offload_upstream_get(ut, uor->name);
+			if (uor->fd < 0) {
+				uor->fd = uwsgi_connect(uor->name, 0, 1);
+				if (uor->fd < 0) {
+					uwsgi_error("u_offload_transfer_do()/connect()");
+					return -1;
+				}
+			}
+		}
 		event_queue_add_fd_write(ut->queue, uor->fd);
 		return 0;
 	}
@@ -507,7 +946,8 @@ static int u_offload_transfer_do(struct uwsgi_thread *ut, struct uwsgi_offload_r
 					uor->written += rlen;
 					if (uor->written >= (size_t)uor->ubuf->pos) {
 						uor->status = 2;
-						if (event_queue_add_fd_read(ut->queue, uor->s)) return -1;
+						// in keepalive mode the whole request is in the buffer, nothing more must reach the upstream
+						if (!uor->custom1 && event_queue_add_fd_read(ut->queue, uor->s)) return -1;
 						if (event_queue_fd_write_to_read(ut->queue, uor->fd)) return -1;
 					}
 					return 0;
@@ -526,6 +966,7 @@ static int u_offload_transfer_do(struct uwsgi_thread *ut, struct uwsgi_offload_r
 			if (fd == uor->fd) {
 				rlen = read(uor->fd, uor->buf, 4096);
 				if (rlen > 0) {
+					if (uor->custom1) offload_http_keepalive_feed(uor, uor->buf, rlen);
 					uor->to_write = rlen;
 					uor->pos = 0;
 					uwsgi_offload_0r_1w(uor->fd, uor->s)
@@ -558,7 +999,16 @@ static int u_offload_transfer_do(struct uwsgi_thread *ut, struct uwsgi_offload_r
 			if (rlen > 0) {
 				uor->to_write -= rlen;
 				uor->pos += rlen;
+				// (the request has already been sent, now it counts all of the written bytes)
+				uor->written += rlen;
 				if (uor->to_write == 0) {
+					// the whole response has been relayed, give back the upstream connection
+					if (uor->custom1 && uor->custom3 && uor->custom4 == uor->custom3) {
+						uwsgi_offload_index(ut, uor, NULL);
+						offload_upstream_put(ut, uor->name, uor->fd);
+						uor->fd = -1;
+						return -1;
+					}
 					if (event_queue_fd_write_to_read(ut->queue, uor->s)) return -1;
 					if (event_queue_add_fd_read(ut->queue, uor->fd)) return -1;
 					uor->status = 2;
@@ -576,6 +1026,7 @@ static int u_offload_transfer_do(struct uwsgi_thread *ut, struct uwsgi_offload_r
 			if (rlen > 0) {
 				uor->to_write -= rlen;
 				uor->pos += rlen;
+				uor->written += rlen;
 				if (uor->to_write == 0) {
 					if (event_queue_fd_write_to_read(ut->queue, uor->fd)) return -1;
 					if (event_queue_add_fd_read(ut->queue, uor->s)) return -1;
@@ -627,6 +1078,8 @@ int uwsgi_offload_run(struct wsgi_request *wsgi_req, struct uwsgi_offload_reques
 		return -1;
         }
 
+	uwsgi_probe3(offload_start, uor->engine->name, uor->s, uor->fd);
+
         return 0;
 	
 };
@@ -672,16 +1125,57 @@ void uwsgi_offload_engines_register_all() {
 	uwsgi.offload_engine_transfer = uwsgi_offload_register_engine("transfer", u_offload_transfer_prepare, u_offload_transfer_do);
 	uwsgi.offload_engine_memory = uwsgi_offload_register_engine("memory", u_offload_memory_prepare, u_offload_memory_do);
 	uwsgi.offload_engine_pipe = uwsgi_offload_register_engine("pipe", u_offload_pipe_prepare, u_offload_pipe_do);
+	uwsgi.offload_engine_snapshot = uwsgi_offload_register_engine("snapshot", u_offload_snapshot_prepare, u_offload_snapshot_do);
+	uwsgi.offload_engine_byteranges = uwsgi_offload_register_engine("byteranges", u_offload_byteranges_prepare, u_offload_byteranges_do);
+	uwsgi.offload_engine_body = uwsgi_offload_register_engine("body", u_offload_body_prepare, u_offload_body_do);
+	uwsgi.offload_engine_websocket = uwsgi_offload_register_engine("websocket", uwsgi_websocket_offload_prepare, uwsgi_websocket_offload_do);
 }
 
 int uwsgi_offload_request_sendfile_do(struct wsgi_request *wsgi_req, int fd, size_t len) {
+	return uwsgi_offload_request_sendfile_range_do(wsgi_req, fd, 0, len);
+}
+
+int uwsgi_offload_request_sendfile_range_do(struct wsgi_request *wsgi_req, int fd, size_t pos, size_t len) {
 	struct uwsgi_offload_request uor;
 	uwsgi_offload_setup(uwsgi.offload_engine_sendfile, &uor, wsgi_req, 1);
 	uor.fd = fd;
+	uor.pos = pos;
 	uor.len = len;
 	return uwsgi_offload_run(wsgi_req, &uor, NULL);
 }
 
+// the fd, the part headers and the parts array are released by the offload engine
+int uwsgi_offload_request_byteranges_do(struct wsgi_request *wsgi_req, int fd, struct uwsgi_byteranges *ubr) {
+	struct uwsgi_offload_request uor;
+	uwsgi_offload_setup(uwsgi.offload_engine_byteranges, &uor, wsgi_req, 1);
+	uor.fd = fd;
+	uor.ubuf = ubr->ub;
+	uor.data = ubr->parts;
+	uor.custom1 = ubr->n;
+	uor.len = ubr->len;
+	uor.free = u_offload_byteranges_free;
+	return uwsgi_offload_run(wsgi_req, &uor, NULL);
+}
+
+// fd is the offload side of the stream, the worker keeps the socket
+int uwsgi_offload_request_body_do(struct wsgi_request *wsgi_req, int fd) {
+	struct uwsgi_offload_request uor;
+	uwsgi_offload_setup(uwsgi.offload_engine_body, &uor, wsgi_req, 0);
+	uor.s = dup(wsgi_req->fd);
+	if (uor.s < 0) {
+		uwsgi_req_error("uwsgi_offload_request_body_do()/dup()");
+		return -1;
+	}
+	uor.fd = fd;
+	uor.len = wsgi_req->post_cl - wsgi_req->proto_parser_remains;
+	uor.free = u_offload_body_free;
+	if (uwsgi_offload_run(wsgi_req, &uor, NULL)) {
+		close(uor.s);
+		return -1;
+	}
+	return 0;
+}
+
 int uwsgi_offload_request_net_do(struct wsgi_request *wsgi_req, char *socketname, struct uwsgi_buffer *ubuf) {
 	struct uwsgi_offload_request uor;
 	uwsgi_offload_setup(uwsgi.offload_engine_transfer, &uor, wsgi_req, 1);
@@ -690,6 +1184,17 @@ int uwsgi_offload_request_net_do(struct wsgi_request *wsgi_req, char *socketname
 	return uwsgi_offload_run(wsgi_req, &uor, NULL);
 }
 
+// the upstream connection could be reused (the whole request, body included, must be in ubuf)
+int uwsgi_offload_request_http_do(struct wsgi_request *wsgi_req, char *socketname, struct uwsgi_buffer *ubuf) {
+	struct uwsgi_offload_request uor;
+	uwsgi_offload_setup(uwsgi.offload_engine_transfer, &uor, wsgi_req, 1);
+	uor.name = socketname;
+	uor.ubuf = ubuf;
+	uor.custom1 = 1;
+	uor.custom2 = !uwsgi_strncmp(wsgi_req->method, wsgi_req->method_len, "HEAD", 4);
+	return uwsgi_offload_run(wsgi_req, &uor, NULL);
+}
+
 int uwsgi_offload_request_memory_do(struct wsgi_request *wsgi_req, char *buf, size_t len) {
         struct uwsgi_offload_request uor;
         uwsgi_offload_setup(uwsgi.offload_engine_memory, &uor, wsgi_req, 1);
@@ -705,3 +1210,107 @@ int uwsgi_offload_request_pipe_do(struct wsgi_request *wsgi_req, int fd, size_t
         uor.len = len;
         return uwsgi_offload_run(wsgi_req, &uor, NULL);
 }
+
+/*
+	snapshots of cache items and sharedarea ranges
+
+	Offloaded transfers cannot hold the cache (or sharedarea) lock for the whole
+	duration of a slow client, so the data is copied once in a refcounted snapshot
+	shared by all of the tasks of the worker. Every snapshot is bound to the generation
+	of its source (the seqlock counter of the cache slot or the updates counter of the area):
+	as soon as it changes, new requests get a fresh copy while running transfers keep
+	streaming the old (consistent) one until they release it.
+
+	The table holds a reference too, it is modified only by the cores of the worker
+	(offload threads only release references).
+*/
+
+#define UWSGI_OFFLOAD_SNAPSHOTS 64
+
+static struct uwsgi_offload_snapshot *offload_snapshots[UWSGI_OFFLOAD_SNAPSHOTS];
+
+void uwsgi_offload_snapshot_release(struct uwsgi_offload_snapshot *uos) {
+	if (__sync_sub_and_fetch(&uos->refcnt, 1) > 0) return;
+	if (uos->key) free(uos->key);
+	free(uos->buf);
+	free(uos);
+}
+
+// returns a referenced snapshot (or NULL) if the one in the slot is still valid
+static struct uwsgi_offload_snapshot *offload_snapshot_get(uint32_t slot, void *source, char *key, uint16_t keylen, uint64_t pos, uint64_t range, uint64_t generation) {
+	struct uwsgi_offload_snapshot *uos = NULL;
+	if (uwsgi.threads > 1) pthread_mutex_lock(&uwsgi.lock_offload_snapshots);
+	uos = offload_snapshots[slot];
+	if (!uos || uos->source != source || uos->pos != pos || uos->range != range || uwsgi_strncmp(uos->key, uos->keylen, key, keylen)
+		|| uos->generation != generation || (uos->expires && uos->expires <= (uint64_t) uwsgi_now())) {
+		uos = NULL;
+		goto end;
+	}
+	__sync_add_and_fetch(&uos->refcnt, 1);
+end:
+	if (uwsgi.threads > 1) pthread_mutex_unlock(&uwsgi.lock_offload_snapshots);
+	return uos;
+}
+
+// the buffer is owned by the new snapshot, the caller gets a reference
+static struct uwsgi_offload_snapshot *offload_snapshot_add(uint32_t slot, void *source, char *key, uint16_t keylen, uint64_t pos, uint64_t range, uint64_t generation, char *buf, uint64_t len, uint64_t expires) {
+	struct uwsgi_offload_snapshot *uos = uwsgi_calloc(sizeof(struct uwsgi_offload_snapshot));
+	uos->source = source;
+	if (keylen > 0) {
+		uos->key = uwsgi_concat2n(key, keylen, "", 0);
+		uos->keylen = keylen;
+	}
+	uos->pos = pos;
+	uos->range = range;
+	uos->generation = generation;
+	uos->buf = buf;
+	uos->len = len;
+	uos->expires = expires;
+	// one for the table and one for the caller
+	uos->refcnt = 2;
+
+	if (uwsgi.threads > 1) pthread_mutex_lock(&uwsgi.lock_offload_snapshots);
+	struct uwsgi_offload_snapshot *old = offload_snapshots[slot];
+	offload_snapshots[slot] = uos;
+	if (uwsgi.threads > 1) pthread_mutex_unlock(&uwsgi.lock_offload_snapshots);
+
+	if (old) uwsgi_offload_snapshot_release(old);
+	return uos;
+}
+
+struct uwsgi_offload_snapshot *uwsgi_offload_snapshot_cache(struct uwsgi_cache *uc, char *key, uint16_t keylen) {
+	uint32_t slot = (djb33x_hash(key, keylen) ^ (uint32_t) (uintptr_t) uc) % UWSGI_OFFLOAD_SNAPSHOTS;
+	uint64_t generation = uwsgi_cache_generation(uc, key, keylen);
+	struct uwsgi_offload_snapshot *uos = offload_snapshot_get(slot, uc, key, keylen, 0, 0, generation);
+	if (uos) return uos;
+
+	uint64_t valsize = 0, expires = 0;
+	char *buf = uwsgi_cache_snapshot(uc, key, keylen, &valsize, &expires, &generation);
+	if (!buf) return NULL;
+	return offload_snapshot_add(slot, uc, key, keylen, 0, 0, generation, buf, valsize, expires);
+}
+
+// range 0 means "up to the end of the area"
+struct uwsgi_offload_snapshot *uwsgi_offload_snapshot_sharedarea(int id, uint64_t pos, uint64_t range) {
+	struct uwsgi_sharedarea *sa = uwsgi_sharedarea_get_by_id(id, pos);
+	if (!sa) return NULL;
+	uint32_t slot = (id * 31 + pos * 7 + range) % UWSGI_OFFLOAD_SNAPSHOTS;
+	uint64_t generation = ((volatile struct uwsgi_sharedarea *) sa)->updates;
+	struct uwsgi_offload_snapshot *uos = offload_snapshot_get(slot, sa, NULL, 0, pos, range, generation);
+	if (uos) return uos;
+
+	uint64_t len = range;
+	char *buf = uwsgi_sharedarea_snapshot(id, pos, &len, &generation);
+	if (!buf) return NULL;
+	return offload_snapshot_add(slot, sa, NULL, 0, pos, range, generation, buf, len, 0);
+}
+
+// on success the reference is transferred to the offload thread
+int uwsgi_offload_request_snapshot_do(struct wsgi_request *wsgi_req, struct uwsgi_offload_snapshot *uos) {
+        struct uwsgi_offload_request uor;
+        uwsgi_offload_setup(uwsgi.offload_engine_snapshot, &uor, wsgi_req, 1);
+        uor.data = uos;
+        uor.len = uos->len;
+        uor.free = u_offload_snapshot_free;
+        return uwsgi_offload_run(wsgi_req, &uor, NULL);
+}
@@ -0,0 +1,344 @@
+#include <uwsgi.h>
+
+extern struct uwsgi_server uwsgi;
+
+/*
+
+	OpenMetrics text exposition for the stats servers
+
+	sections (workers, cores, sockets, caches, metrics, routers) are collected in a compact binary snapshot:
+
+	'F' <name ptr> <type ptr> <help ptr>
+	'S' <suffix ptr> <int64 value> <uint8 labels> (<key ptr> <uint16 len> <value bytes>)*
+
+	names, types, suffixes and label keys are static strings, so only their pointers are stored.
+	Collecting a section only copies numbers and short strings, the expensive part (formatting, escaping)
+	happens in the renderer, that runs only when the snapshot of a section differs from the previous one:
+	unchanged sections are served from their cached text.
+
+	families of type "counter" get the "_total" suffix on their samples (pass it as the suffix)
+
+*/
+
+int uwsgi_openmetrics_family(struct uwsgi_buffer *raw, char *name, char *type, char *help) {
+	if (uwsgi_buffer_byte(raw, 'F')) return -1;
+	if (uwsgi_buffer_append(raw, (char *) &name, sizeof(char *))) return -1;
+	if (uwsgi_buffer_append(raw, (char *) &type, sizeof(char *))) return -1;
+	return uwsgi_buffer_append(raw, (char *) &help, sizeof(char *));
+}
+
+// labels are passed as (char *key, char *value, size_t value_len) triples
+int uwsgi_openmetrics_sample(struct uwsgi_buffer *raw, char *suffix, int64_t value, int labels, ...) {
+	if (uwsgi_buffer_byte(raw, 'S')) return -1;
+	if (uwsgi_buffer_append(raw, (char *) &suffix, sizeof(char *))) return -1;
+	if (uwsgi_buffer_append(raw, (char *) &value, sizeof(int64_t))) return -1;
+	if (uwsgi_buffer_u8(raw, labels)) return -1;
+	va_list ap;
+	va_start(ap, labels);
+	int i;
+	for(i=0;i<labels;i++) {
+		char *key = va_arg(ap, char *);
+		char *val = va_arg(ap, char *);
+		size_t vlen = va_arg(ap, size_t);
+		uint16_t len = vlen > 0xffff ? 0xffff : vlen;
+		if (uwsgi_buffer_append(raw, (char *) &key, sizeof(char *))) goto error;
+		if (uwsgi_buffer_append(raw, (char *) &len, 2)) goto error;
+		if (uwsgi_buffer_append(raw, val, len)) goto error;
+	}
+	va_end(ap);
+	return 0;
+error:
+	va_end(ap);
+	return -1;
+}
+
+static int openmetrics_escape(struct uwsgi_buffer *ub, char *buf, size_t len) {
+	size_t i;
+	for(i=0;i<len;i++) {
+		if (buf[i] == '\\' || buf[i] == '"') {
+			if (uwsgi_buffer_byte(ub, '\\')) return -1;
+			if (uwsgi_buffer_byte(ub, buf[i])) return -1;
+		}
+		else if (buf[i] == '\n') {
+			if (uwsgi_buffer_append(ub, "\\n", 2)) return -1;
+		}
+		else {
+			if (uwsgi_buffer_byte(ub, buf[i])) return -1;
+		}
+	}
+	return 0;
+}
+
+#define om_get(dst, size) if (pos + size > raw->pos) return -1; memcpy(dst, raw->buf + pos, size); pos += size
+
+static int openmetrics_render(struct uwsgi_buffer *raw, struct uwsgi_buffer *ub) {
+	size_t pos = 0;
+	char *family = NULL;
+	while(pos < raw->pos) {
+		char kind = raw->buf[pos++];
+		if (kind == 'F') {
+			char *type, *help;
+			om_get(&family, sizeof(char *));
+			om_get(&type, sizeof(char *));
+			om_get(&help, sizeof(char *));
+			if (uwsgi_buffer_append(ub, "# TYPE ", 7)) return -1;
+			if (uwsgi_buffer_append(ub, family, strlen(family))) return -1;
+			if (uwsgi_buffer_byte(ub, ' ')) return -1;
+			if (uwsgi_buffer_append(ub, type, strlen(type))) return -1;
+			if (uwsgi_buffer_append(ub, "\n# HELP ", 8)) return -1;
+			if (uwsgi_buffer_append(ub, family, strlen(family))) return -1;
+			if (uwsgi_buffer_byte(ub, ' ')) return -1;
+			if (uwsgi_buffer_append(ub, help, strlen(help))) return -1;
+			if (uwsgi_buffer_byte(ub, '\n')) return -1;
+		}
+		else if (kind == 'S') {
+			char *suffix;
+			int64_t value;
+			uint8_t labels;
+			om_get(&suffix, sizeof(char *));
+			om_get(&value, sizeof(int64_t));
+			om_get(&labels, 1);
+			if (!family) return -1;
+			if (uwsgi_buffer_append(ub, family, strlen(family))) return -1;
+			if (suffix && uwsgi_buffer_append(ub, suffix, strlen(suffix))) return -1;
+			uint8_t i;
+			for(i=0;i<labels;i++) {
+				char *key;
+				uint16_t len;
+				om_get(&key, sizeof(char *));
+				om_get(&len, 2);
+				if (pos + len > raw->pos) return -1;
+				if (uwsgi_buffer_byte(ub, i == 0 ? '{' : ',')) return -1;
+				if (uwsgi_buffer_append(ub, key, strlen(key))) return -1;
+				if (uwsgi_buffer_append(ub, "=\"", 2)) return -1;
+				if (openmetrics_escape(ub, raw->buf + pos, len)) return -1;
+				if (uwsgi_buffer_byte(ub, '"')) return -1;
+				pos += len;
+			}
+			if (labels > 0 && uwsgi_buffer_byte(ub, '}')) return -1;
+			if (uwsgi_buffer_byte(ub, ' ')) return -1;
+			if (uwsgi_buffer_num64(ub, value)) return -1;
+			if (uwsgi_buffer_byte(ub, '\n')) return -1;
+		}
+		else {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int uwsgi_openmetrics_section_render(struct uwsgi_openmetrics_section *uos, struct uwsgi_buffer *ub) {
+	if (!uos->next_raw) {
+		uos->raw = uwsgi_buffer_new(uwsgi.page_size);
+		uos->next_raw = uwsgi_buffer_new(uwsgi.page_size);
+		uos->text = uwsgi_buffer_new(uwsgi.page_size);
+	}
+
+	uos->next_raw->pos = 0;
+	if (uos->collect(uos->next_raw, uos->data)) return -1;
+
+	// unchanged section ?
+	if (uos->next_raw->pos != uos->raw->pos || memcmp(uos->next_raw->buf, uos->raw->buf, uos->raw->pos)) {
+		struct uwsgi_buffer *tmp = uos->raw;
+		uos->raw = uos->next_raw;
+		uos->next_raw = tmp;
+		uos->text->pos = 0;
+		if (openmetrics_render(uos->raw, uos->text)) {
+			// force a new rendering on the next run
+			uos->raw->pos = 0;
+			uos->text->pos = 0;
+			return -1;
+		}
+	}
+
+	return uwsgi_buffer_append(ub, uos->text->buf, uos->text->pos);
+}
+
+#define om_num(buf, n) buf, (size_t) uwsgi_long2str2n(n, buf, sizeof(buf))
+
+static int openmetrics_collect_workers(struct uwsgi_buffer *raw, void *data) {
+	char wid[sizeof(UMAX64_STR)+1];
+	int i;
+
+	if (uwsgi_openmetrics_family(raw, "uwsgi_info", "gauge", "uWSGI version")) return -1;
+	if (uwsgi_openmetrics_sample(raw, NULL, 1, 1, "version", UWSGI_VERSION, strlen(UWSGI_VERSION))) return -1;
+
+	if (uwsgi_openmetrics_family(raw, "uwsgi_listen_queue", "gauge", "listen queue of the first socket")) return -1;
+	if (uwsgi_openmetrics_sample(raw, NULL, uwsgi.shared->backlog, 0)) return -1;
+	if (uwsgi_openmetrics_family(raw, "uwsgi_listen_queue_errors", "counter", "listen queue overflows")) return -1;
+	if (uwsgi_openmetrics_sample(raw, "_total", uwsgi.shared->backlog_errors, 0)) return -1;
+
+#define om_worker_family(name, type, suffix, help, value) \
+	if (uwsgi_openmetrics_family(raw, name, type, help)) return -1;\
+	for(i=1;i<=uwsgi.numproc;i++) {\
+		if (uwsgi_openmetrics_sample(raw, suffix, (int64_t) (value), 1, "worker", om_num(wid, i))) return -1;\
+	}
+
+	om_worker_family("uwsgi_worker_requests", "counter", "_total", "requests managed by the worker", uwsgi.workers[i].requests);
+	om_worker_family("uwsgi_worker_exceptions", "counter", "_total", "exceptions raised in the worker", uwsgi_worker_exceptions(i));
+	om_worker_family("uwsgi_worker_harakiri", "counter", "_total", "harakiri of the worker", uwsgi.workers[i].harakiri_count);
+	om_worker_family("uwsgi_worker_signals", "counter", "_total", "uWSGI signals managed by the worker", uwsgi.workers[i].signals);
+	om_worker_family("uwsgi_worker_respawns", "counter", "_total", "respawns of the worker", uwsgi.workers[i].respawn_count);
+	om_worker_family("uwsgi_worker_tx_bytes", "counter", "_total", "bytes sent by the worker", uwsgi.workers[i].tx);
+	om_worker_family("uwsgi_worker_running_time_microseconds", "counter", "_total", "time spent managing requests", uwsgi.workers[i].running_time);
+	om_worker_family("uwsgi_worker_avg_response_time_microseconds", "gauge", NULL, "average response time", uwsgi.workers[i].avg_response_time);
+	om_worker_family("uwsgi_worker_rss_bytes", "gauge", NULL, "resident memory of the worker", uwsgi.workers[i].rss_size);
+	om_worker_family("uwsgi_worker_vsz_bytes", "gauge", NULL, "virtual memory of the worker", uwsgi.workers[i].vsz_size);
+	om_worker_family("uwsgi_worker_busy", "gauge", NULL, "1 if the worker is managing a request", uwsgi_worker_is_busy(i));
+	om_worker_family("uwsgi_worker_accepting", "gauge", NULL, "1 if the worker is accepting requests", uwsgi.workers[i].accepting);
+	om_worker_family("uwsgi_worker_cheaped", "gauge", NULL, "1 if the worker has been cheaped", uwsgi.workers[i].cheaped);
+#ifdef __linux__
+	if (uwsgi.taskstats) {
+		om_worker_family("uwsgi_worker_cpu_time_microseconds", "counter", "_total", "cpu time (user and system) of the worker", uwsgi.workers[i].taskstats.cpu_time);
+		om_worker_family("uwsgi_worker_voluntary_switches", "counter", "_total", "voluntary context switches of the worker", uwsgi.workers[i].taskstats.voluntary_switches);
+		om_worker_family("uwsgi_worker_involuntary_switches", "counter", "_total", "involuntary context switches of the worker", uwsgi.workers[i].taskstats.involuntary_switches);
+		om_worker_family("uwsgi_worker_read_bytes", "counter", "_total", "bytes read from storage by the worker", uwsgi.workers[i].taskstats.read_bytes);
+		om_worker_family("uwsgi_worker_write_bytes", "counter", "_total", "bytes written to storage by the worker", uwsgi.workers[i].taskstats.write_bytes);
+		om_worker_family("uwsgi_worker_cpu_delay_microseconds", "counter", "_total", "time spent by the worker waiting for a cpu", uwsgi.workers[i].taskstats.cpu_delay);
+		om_worker_family("uwsgi_worker_blkio_delay_microseconds", "counter", "_total", "time spent by the worker waiting for block io", uwsgi.workers[i].taskstats.blkio_delay);
+	}
+#endif
+
+	return 0;
+}
+
+static int openmetrics_collect_cores(struct uwsgi_buffer *raw, void *data) {
+	char wid[sizeof(UMAX64_STR)+1];
+	char cid[sizeof(UMAX64_STR)+1];
+	int i, j;
+
+	if (uwsgi.stats_no_cores) return 0;
+
+#define om_core_family(name, type, suffix, help, field) \
+	if (uwsgi_openmetrics_family(raw, name, type, help)) return -1;\
+	for(i=1;i<=uwsgi.numproc;i++) {\
+		int wid_len = uwsgi_long2str2n(i, wid, sizeof(wid));\
+		for(j=0;j<uwsgi.cores;j++) {\
+			if (uwsgi_openmetrics_sample(raw, suffix, (int64_t) uwsgi.workers[i].cores[j].field, 2, "worker", wid, (size_t) wid_len, "core", om_num(cid, j))) return -1;\
+		}\
+	}
+
+	om_core_family("uwsgi_core_requests", "counter", "_total", "requests managed by the core", requests);
+	om_core_family("uwsgi_core_static_requests", "counter", "_total", "static files served by the core", static_requests);
+	om_core_family("uwsgi_core_routed_requests", "counter", "_total", "requests managed by the internal routing", routed_requests);
+	om_core_family("uwsgi_core_offloaded_requests", "counter", "_total", "requests offloaded by the core", offloaded_requests);
+	om_core_family("uwsgi_core_write_errors", "counter", "_total", "write errors of the core", write_errors);
+	om_core_family("uwsgi_core_read_errors", "counter", "_total", "read errors of the core", read_errors);
+	om_core_family("uwsgi_core_exceptions", "counter", "_total", "exceptions raised in the core", exceptions);
+	om_core_family("uwsgi_core_in_request", "gauge", NULL, "1 if the core is managing a request", in_request);
+
+	return 0;
+}
+
+static int openmetrics_collect_sockets(struct uwsgi_buffer *raw, void *data) {
+	struct uwsgi_socket *uwsgi_sock;
+
+	if (uwsgi_openmetrics_family(raw, "uwsgi_socket_listen_queue", "gauge", "connections waiting in the listen queue")) return -1;
+	uwsgi_foreach(uwsgi_sock, uwsgi.sockets) {
+		if (uwsgi_sock->bound && uwsgi_openmetrics_sample(raw, NULL, uwsgi_sock->queue, 1, "socket", uwsgi_sock->name, strlen(uwsgi_sock->name))) return -1;
+	}
+	if (uwsgi_openmetrics_family(raw, "uwsgi_socket_listen_queue_max", "gauge", "size of the listen queue")) return -1;
+	uwsgi_foreach(uwsgi_sock, uwsgi.sockets) {
+		if (uwsgi_sock->bound && uwsgi_openmetrics_sample(raw, NULL, uwsgi_sock->max_queue, 1, "socket", uwsgi_sock->name, strlen(uwsgi_sock->name))) return -1;
+	}
+	return 0;
+}
+
+static int openmetrics_collect_caches(struct uwsgi_buffer *raw, void *data) {
+	struct uwsgi_cache *uc;
+	if (!uwsgi.caches) return 0;
+
+#define om_cache_family(family, type, suffix, help, value) \
+	if (uwsgi_openmetrics_family(raw, family, type, help)) return -1;\
+	uwsgi_foreach(uc, uwsgi.caches) {\
+		uint64_t c_items = 0, c_hits = 0, c_miss = 0, c_full = 0;\
+		uwsgi_cache_counters(uc, &c_items, &c_hits, &c_miss, &c_full);\
+		char *c_name = uc->name ? uc->name : "default";\
+		if (uwsgi_openmetrics_sample(raw, suffix, (int64_t) (value), 1, "cache", c_name, strlen(c_name))) return -1;\
+	}
+
+	om_cache_family("uwsgi_cache_items", "gauge", NULL, "items in the cache", c_items);
+	om_cache_family("uwsgi_cache_max_items", "gauge", NULL, "max items of the cache", uc->max_items);
+	om_cache_family("uwsgi_cache_hits", "counter", "_total", "cache hits", c_hits);
+	om_cache_family("uwsgi_cache_misses", "counter", "_total", "cache misses", c_miss);
+	om_cache_family("uwsgi_cache_full", "counter", "_total", "items not stored because the cache was full", c_full);
+
+	return 0;
+}
+
+// metric names are sanitized once ("worker.1.requests" -> "uwsgi_metric_worker_1_requests")
+static char **openmetrics_metric_names;
+
+static int openmetrics_collect_metrics(struct uwsgi_buffer *raw, void *data) {
+	struct uwsgi_metric *um;
+	uint64_t pos = 0;
+
+	if (!uwsgi.has_metrics || uwsgi.stats_no_metrics) return 0;
+
+	if (!openmetrics_metric_names) {
+		openmetrics_metric_names = uwsgi_calloc(sizeof(char *) * (uwsgi.metrics_cnt + 1));
+		uwsgi_foreach(um, uwsgi.metrics) {
+			char *name = uwsgi_concat2("uwsgi_metric_", um->name);
+			char *ptr = name;
+			while(*ptr) {
+				if (*ptr == '.' || *ptr == '-') *ptr = '_';
+				ptr++;
+			}
+			openmetrics_metric_names[pos++] = name;
+		}
+		pos = 0;
+	}
+
+	uwsgi_rlock(uwsgi.metrics_lock);
+	uwsgi_foreach(um, uwsgi.metrics) {
+		char *name = openmetrics_metric_names[pos++];
+		if (!name || um->type == UWSGI_METRIC_ALIAS) continue;
+		if (um->type == UWSGI_METRIC_HISTOGRAM && um->histogram) {
+			if (uwsgi_openmetrics_family(raw, name, "summary", um->name)) goto error;
+			if (uwsgi_openmetrics_sample(raw, NULL, um->histogram->p50, 1, "quantile", "0.5", (size_t) 3)) goto error;
+			if (uwsgi_openmetrics_sample(raw, NULL, um->histogram->p99, 1, "quantile", "0.99", (size_t) 4)) goto error;
+			if (uwsgi_openmetrics_sample(raw, NULL, um->histogram->p999, 1, "quantile", "0.999", (size_t) 5)) goto error;
+			if (uwsgi_openmetrics_sample(raw, "_count", *um->value, 0)) goto error;
+		}
+		else if (um->type == UWSGI_METRIC_COUNTER) {
+			if (uwsgi_openmetrics_family(raw, name, "counter", um->name)) goto error;
+			if (uwsgi_openmetrics_sample(raw, "_total", *um->value, 0)) goto error;
+		}
+		else {
+			if (uwsgi_openmetrics_family(raw, name, "gauge", um->name)) goto error;
+			if (uwsgi_openmetrics_sample(raw, NULL, *um->value, 0)) goto error;
+		}
+	}
+	uwsgi_rwunlock(uwsgi.metrics_lock);
+	return 0;
+error:
+	uwsgi_rwunlock(uwsgi.metrics_lock);
+	return -1;
+}
+
+static struct uwsgi_openmetrics_section openmetrics_master_sections[] = {
+	{openmetrics_collect_workers, NULL, NULL, NULL, NULL},
+	{openmetrics_collect_cores, NULL, NULL, NULL, NULL},
+	{openmetrics_collect_sockets, NULL, NULL, NULL, NULL},
+	{openmetrics_collect_caches, NULL, NULL, NULL, NULL},
+	{openmetrics_collect_metrics, NULL, NULL, NULL, NULL},
+	{NULL, NULL, NULL, NULL, NULL},
+};
+
+// the returned buffer is reused by the next call
+struct uwsgi_buffer *uwsgi_openmetrics_master() {
+	static struct uwsgi_buffer *ub = NULL;
+	if (!ub) {
+		ub = uwsgi_buffer_new(uwsgi.page_size);
+	}
+	ub->pos = 0;
+
+	struct uwsgi_openmetrics_section *uos = openmetrics_master_sections;
+	while(uos->collect) {
+		if (uwsgi_openmetrics_section_render(uos, ub)) return NULL;
+		uos++;
+	}
+
+	if (uwsgi_buffer_append(ub, "# EOF\n", 6)) return NULL;
+	return ub;
+}
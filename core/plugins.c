@@ -274,6 +274,79 @@ end:
 	return NULL;
 }
 
+static void lazy_plugin_remove(struct uwsgi_string_list *usl) {
+	struct uwsgi_string_list *prev = NULL, *item = uwsgi.lazy_plugins_list;
+	while (item) {
+		if (item == usl) {
+			if (prev) {
+				prev->next = item->next;
+			}
+			else {
+				uwsgi.lazy_plugins_list = item->next;
+			}
+			free(item->value);
+			free(item);
+			return;
+		}
+		prev = item;
+		item = item->next;
+	}
+}
+
+/*
+	--lazy-plugins
+
+	search the deferred plugins for the one exposing the specified option,
+	the others are dlclose()d without calling their hooks
+*/
+int uwsgi_lazy_plugin_option(char *option) {
+	struct uwsgi_string_list *usl = uwsgi.lazy_plugins_list;
+	while (usl) {
+		if (uwsgi_load_plugin(-1, usl->value, option)) {
+			uwsgi_log_initial("lazy loaded plugin %s for option \"%s\"\n", usl->value, option);
+			lazy_plugin_remove(usl);
+			build_options();
+			return 1;
+		}
+		usl = usl->next;
+	}
+	return 0;
+}
+
+/*
+	loggers, routers and friends register themselves in on_load, so there is no way
+	to know which plugin exposes them without loading it. Plugins whose name contains
+	the hint are tried first, then the first deferred one is loaded.
+	Returns 0 when there is nothing left to load.
+*/
+int uwsgi_lazy_plugin_load(char *hint) {
+	struct uwsgi_string_list *usl = NULL, *candidate = NULL;
+	if (!uwsgi.lazy_plugins_list)
+		return 0;
+	if (hint) {
+		uwsgi_foreach(usl, uwsgi.lazy_plugins_list) {
+			if (strstr(usl->value, hint)) {
+				candidate = usl;
+				break;
+			}
+		}
+	}
+	if (!candidate)
+		candidate = uwsgi.lazy_plugins_list;
+
+	char *name = uwsgi_str(candidate->value);
+	lazy_plugin_remove(candidate);
+	if (uwsgi_load_plugin(-1, name, NULL)) {
+		uwsgi_log_initial("lazy loaded plugin %s for \"%s\"\n", name, hint ? hint : "");
+		build_options();
+	}
+	else {
+		uwsgi_log("unable to load plugin \"%s\"\n", name);
+	}
+	free(name);
+	return 1;
+}
+
 int uwsgi_try_autoload(char *option) {
 	DIR *d;
 	struct dirent *dp;
@@ -256,10 +256,72 @@ static void uwsgi_parse_http_range(char *buf, uint16_t len, size_t *from, size_t
 	}
 }
 
+static int range_is_num(char *buf, size_t len) {
+	size_t i;
+	for(i=0;i<len;i++) {
+		if (!isdigit((int) buf[i])) return 0;
+	}
+	return 1;
+}
+
+/*
+	parse a (multi) range header against a resource of the specified size, returning the number
+	of satisfiable ranges (as absolute and inclusive offsets) or -1 on syntax errors and when
+	there are more than max ranges.
+	Supported forms are: bytes=X-Y, bytes=X- and bytes=-N (the last N bytes)
+*/
+int uwsgi_parse_http_ranges(char *buf, uint16_t len, uint64_t size, struct uwsgi_http_range *ranges, int max) {
+	if (len < 7 || memcmp(buf, "bytes=", 6)) return -1;
+	char *ptr = buf + 6;
+	char *end = buf + len;
+	int n = 0;
+	while(ptr < end) {
+		char *comma = memchr(ptr, ',', end - ptr);
+		if (!comma) comma = end;
+		char *item = ptr;
+		size_t item_len = comma - ptr;
+		ptr = comma + 1;
+		// skip whitespace
+		while(item_len > 0 && (*item == ' ' || *item == '\t')) { item++; item_len--; }
+		while(item_len > 0 && (item[item_len-1] == ' ' || item[item_len-1] == '\t')) item_len--;
+		if (item_len == 0) continue;
+		char *dash = memchr(item, '-', item_len);
+		if (!dash) return -1;
+		size_t from_len = dash - item;
+		size_t to_len = item_len - (from_len + 1);
+		if (!from_len && !to_len) return -1;
+		if (!range_is_num(item, from_len) || !range_is_num(dash + 1, to_len)) return -1;
+		uint64_t from, to;
+		// suffix
+		if (!from_len) {
+			uint64_t suffix = uwsgi_str_num(dash + 1, to_len);
+			if (!suffix || !size) continue;
+			from = suffix >= size ? 0 : size - suffix;
+			to = size - 1;
+		}
+		else {
+			from = uwsgi_str_num(item, from_len);
+			to = to_len ? uwsgi_str_num(dash + 1, to_len) : size - 1;
+			if (to < from) return -1;
+			// unsatisfiable
+			if (from >= size) continue;
+			if (to >= size) to = size - 1;
+		}
+		if (n >= max) return -1;
+		ranges[n].from = from;
+		ranges[n].to = to;
+		n++;
+	}
+	return n;
+}
+
 static int uwsgi_proto_check_10(struct wsgi_request *wsgi_req, char *key, char *buf, uint16_t len) {
 
 	if (uwsgi.honour_range && !uwsgi_proto_key("HTTP_RANGE", 10)) {
 		uwsgi_parse_http_range(buf, len, &wsgi_req->range_from, &wsgi_req->range_to);
+		// the raw value is used for multiple ranges
+		wsgi_req->range = buf;
+		wsgi_req->range_len = len;
 		return 0;
 	}
 
@@ -492,6 +554,15 @@ static int uwsgi_proto_check_18(struct wsgi_request *wsgi_req, char *key, char *
 	return 0;
 }
 
+static int uwsgi_proto_check_19(struct wsgi_request *wsgi_req, char *key, char *buf, uint16_t len) {
+	if (!uwsgi_proto_key("UWSGI_RESPONSE_HINT", 19)) {
+		wsgi_req->response_hint = 1;
+		return 0;
+	}
+
+	return 0;
+}
+
 
 static int uwsgi_proto_check_20(struct wsgi_request *wsgi_req, char *key, char *buf, uint16_t len) {
 	if (uwsgi.logging_options.log_x_forwarded_for && !uwsgi_proto_key("HTTP_X_FORWARDED_FOR", 20)) {
@@ -546,6 +617,17 @@ static int uwsgi_proto_check_27(struct wsgi_request *wsgi_req, char *key, char *
         return 0;
 }
 
+static int uwsgi_proto_check_29(struct wsgi_request *wsgi_req, char *key, char *buf, uint16_t len) {
+
+        if (!uwsgi_proto_key("HTTP_SEC_WEBSOCKET_EXTENSIONS", 29)) {
+                wsgi_req->http_sec_websocket_extensions = buf;
+                wsgi_req->http_sec_websocket_extensions_len = len;
+                return 0;
+        }
+
+        return 0;
+}
+
 
 void uwsgi_proto_hooks_setup() {
 	int i = 0;
@@ -562,9 +644,11 @@ void uwsgi_proto_hooks_setup() {
 	uwsgi.proto_hooks[14] = uwsgi_proto_check_14;
 	uwsgi.proto_hooks[15] = uwsgi_proto_check_15;
 	uwsgi.proto_hooks[18] = uwsgi_proto_check_18;
+	uwsgi.proto_hooks[19] = uwsgi_proto_check_19;
 	uwsgi.proto_hooks[20] = uwsgi_proto_check_20;
 	uwsgi.proto_hooks[22] = uwsgi_proto_check_22;
 	uwsgi.proto_hooks[27] = uwsgi_proto_check_27;
+	uwsgi.proto_hooks[29] = uwsgi_proto_check_29;
 }
 
 
@@ -675,12 +759,17 @@ int uwsgi_parse_vars(struct wsgi_request *wsgi_req) {
 
 next:
 
+	uwsgi_req_timing(wsgi_req, UWSGI_REQ_STAGE_PARSE);
+
 	// manage post buffering (if needed as post_file could be created before)
 	if (uwsgi.post_buffering > 0 && !wsgi_req->post_file) {
 		// read to disk if post_cl > post_buffering (it will eventually do upload progress...)
 		if (wsgi_req->post_cl >= uwsgi.post_buffering) {
-			if (uwsgi_postbuffer_do_in_disk(wsgi_req)) {
-				return -1;
+			// stream it via the offload threads (if possible)
+			if (!uwsgi.post_buffering_stream || uwsgi_postbuffer_do_stream(wsgi_req)) {
+				if (uwsgi_postbuffer_do_in_disk(wsgi_req)) {
+					return -1;
+				}
 			}
 		}
 		// on tiny post use memory
@@ -691,6 +780,7 @@ next:
 		}
 	}
 
+	uwsgi_req_timing(wsgi_req, UWSGI_REQ_STAGE_BODY);
 
 	// check if data are available in the local cache
 	if (wsgi_req->cache_get_len > 0) {
@@ -1,7 +1,17 @@
 #include "uwsgi.h"
 
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
 extern struct uwsgi_server uwsgi;
 
+static void uwsgi_queue_notify(void);
+
+#define uwsgi_queue_ring_cell(pos) ((struct uwsgi_queue_cell *) (uwsgi.queue_ring_cells + (((pos) & (uwsgi.queue_ring - 1)) * uwsgi.queue_ring_cellsize)))
+
 void uwsgi_init_queue() {
 	if (!uwsgi.queue_blocksize)
 		uwsgi.queue_blocksize = 8192;
@@ -11,10 +21,28 @@ void uwsgi_init_queue() {
 		exit(1);
 	}
 
+	size_t queue_mapsize = uwsgi.queue_blocksize * uwsgi.queue_size + 16;
+	size_t ring_offset = 0;
+	if (uwsgi.queue_ring) {
+		if (uwsgi.queue_ring & (uwsgi.queue_ring - 1)) {
+			uwsgi_log("invalid queue ring size %llu: must be a power of 2\n", (unsigned long long) uwsgi.queue_ring);
+			exit(1);
+		}
+		if (!uwsgi.queue_ring_cellsize)
+			uwsgi.queue_ring_cellsize = 256;
+		if (uwsgi.queue_ring_cellsize <= sizeof(struct uwsgi_queue_cell) || uwsgi.queue_ring_cellsize % 8) {
+			uwsgi_log("invalid queue ring cellsize %llu: must be a multiple of 8 bigger than %d\n", (unsigned long long) uwsgi.queue_ring_cellsize, (int) sizeof(struct uwsgi_queue_cell));
+			exit(1);
+		}
+		// the ring lives (cache line aligned) after the blocks in the same mapping
+		ring_offset = (queue_mapsize + 63) & ~((size_t) 63);
+		queue_mapsize = ring_offset + sizeof(struct uwsgi_queue_ring) + (uwsgi.queue_ring * uwsgi.queue_ring_cellsize);
+	}
 
+	int fresh = 1;
 
 	if (uwsgi.queue_store) {
-		uwsgi.queue_filesize = uwsgi.queue_blocksize * uwsgi.queue_size + 16;
+		uwsgi.queue_filesize = queue_mapsize;
 		int queue_fd;
 		struct stat qst;
 
@@ -36,6 +64,7 @@ void uwsgi_init_queue() {
 			}
 			queue_fd = open(uwsgi.queue_store, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
 			uwsgi_log("recovered queue from backing store file: %s\n", uwsgi.queue_store);
+			fresh = 0;
 		}
 
 		if (queue_fd < 0) {
@@ -43,6 +72,10 @@ void uwsgi_init_queue() {
 			exit(1);
 		}
 		uwsgi.queue = mmap(NULL, uwsgi.queue_filesize, PROT_READ | PROT_WRITE, MAP_SHARED, queue_fd, 0);
+		if (uwsgi.queue == MAP_FAILED) {
+			uwsgi_error("mmap()");
+			exit(1);
+		}
 
 		// fix header
 		uwsgi.queue_header = uwsgi.queue;
@@ -50,22 +83,44 @@ void uwsgi_init_queue() {
 		close(queue_fd);
 	}
 	else {
-		uwsgi.queue = mmap(NULL, (uwsgi.queue_blocksize * uwsgi.queue_size) + 16, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+		uwsgi.queue = mmap(NULL, queue_mapsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+		if (uwsgi.queue == MAP_FAILED) {
+			uwsgi_error("mmap()");
+			exit(1);
+		}
 		// fix header
 		uwsgi.queue_header = uwsgi.queue;
 		uwsgi.queue += 16;
 		uwsgi.queue_header->pos = 0;
 		uwsgi.queue_header->pull_pos = 0;
 	}
-	if (uwsgi.queue == MAP_FAILED) {
-		uwsgi_error("mmap()");
-		exit(1);
-	}
-
 
+	if (uwsgi.queue_ring) {
+		uwsgi.queue_ring_header = (struct uwsgi_queue_ring *) (((char *) uwsgi.queue_header) + ring_offset);
+		uwsgi.queue_ring_cells = ((char *) uwsgi.queue_ring_header) + sizeof(struct uwsgi_queue_ring);
+		if (fresh) {
+			uint64_t i;
+			uwsgi.queue_ring_header->enqueue_pos = 0;
+			uwsgi.queue_ring_header->dequeue_pos = 0;
+			for (i = 0; i < uwsgi.queue_ring; i++) {
+				uwsgi_queue_ring_cell(i)->seq = i;
+			}
+		}
+		uwsgi_log("*** Queue ring initialized: %llu cells of %llu bytes ***\n", (unsigned long long) uwsgi.queue_ring, (unsigned long long) uwsgi.queue_ring_cellsize);
+	}
 
 	uwsgi.queue_lock = uwsgi_rwlock_init("queue");
 
+	// blocking consumers
+	uwsgi.queue_waiters = uwsgi_calloc_shared(sizeof(struct uwsgi_queue_waiters));
+	uwsgi.queue_efd = -1;
+#ifdef __linux__
+	uwsgi.queue_efd = eventfd(0, EFD_NONBLOCK);
+	if (uwsgi.queue_efd < 0) {
+		uwsgi_error("uwsgi_init_queue()/eventfd()");
+	}
+#endif
+
 	uwsgi_log("*** Queue subsystem initialized: %luMB preallocated ***\n", (uwsgi.queue_blocksize * uwsgi.queue_size) / (1024 * 1024));
 }
 
@@ -164,6 +219,8 @@ int uwsgi_queue_push(char *message, uint64_t size) {
 	if (uwsgi.queue_header->pos >= uwsgi.queue_size)
 		uwsgi.queue_header->pos = 0;
 
+	uwsgi_queue_notify();
+
 	return 1;
 }
 
@@ -192,3 +249,190 @@ int uwsgi_queue_set(uint64_t pos, char *message, uint64_t size) {
 
 	return 1;
 }
+
+/*
+	lock-free ring: a slot is free for the producer at position pos when its seq is pos,
+	and holds a message for the consumer when its seq is pos + 1.
+	A message of n cells claims n consecutive positions with a single CAS,
+	the consumer gives them back to the next lap with seq = pos + ring size.
+*/
+int uwsgi_queue_ring_push(char *message, uint64_t size) {
+
+	struct uwsgi_queue_ring *ring = uwsgi.queue_ring_header;
+	uint64_t payload = uwsgi.queue_ring_cellsize - sizeof(struct uwsgi_queue_cell);
+
+	if (!ring || !size || size > 0xffffffff)
+		return 0;
+
+	uint64_t cells = (size + payload - 1) / payload;
+	if (cells > uwsgi.queue_ring)
+		return 0;
+
+	uint64_t pos = ring->enqueue_pos;
+	for (;;) {
+		uint64_t i;
+		int64_t dif = 0;
+		for (i = 0; i < cells; i++) {
+			dif = (int64_t) (uwsgi_queue_ring_cell(pos + i)->seq - (pos + i));
+			if (dif) break;
+		}
+		uwsgi_barrier();
+		if (!dif) {
+			if (uwsgi_atomic_cas(&ring->enqueue_pos, pos, pos + cells))
+				break;
+		}
+		// the ring is full
+		else if (dif < 0) {
+			return 0;
+		}
+		pos = ring->enqueue_pos;
+	}
+
+	uint64_t i, done = 0;
+	struct uwsgi_queue_cell *head = uwsgi_queue_ring_cell(pos);
+	for (i = 0; i < cells; i++) {
+		char *ptr = ((char *) uwsgi_queue_ring_cell(pos + i)) + sizeof(struct uwsgi_queue_cell);
+		uint64_t chunk = size - done > payload ? payload : size - done;
+		memcpy(ptr, message + done, chunk);
+		done += chunk;
+	}
+	head->cells = cells;
+	head->size = size;
+	uwsgi_barrier();
+	head->seq = pos + 1;
+
+	uwsgi_queue_notify();
+
+	return 1;
+}
+
+// returns a newly allocated copy of the oldest message (or NULL if the ring is empty)
+char *uwsgi_queue_ring_pull(uint64_t *size) {
+
+	struct uwsgi_queue_ring *ring = uwsgi.queue_ring_header;
+	uint64_t payload = uwsgi.queue_ring_cellsize - sizeof(struct uwsgi_queue_cell);
+	uint64_t cells = 0, msize = 0;
+
+	if (!ring)
+		return NULL;
+
+	uint64_t pos = ring->dequeue_pos;
+	for (;;) {
+		struct uwsgi_queue_cell *head = uwsgi_queue_ring_cell(pos);
+		int64_t dif = (int64_t) (head->seq - (pos + 1));
+		uwsgi_barrier();
+		if (!dif) {
+			cells = head->cells;
+			msize = head->size;
+			if (uwsgi_atomic_cas(&ring->dequeue_pos, pos, pos + cells))
+				break;
+		}
+		// empty
+		else if (dif < 0) {
+			return NULL;
+		}
+		pos = ring->dequeue_pos;
+	}
+
+	char *buf = uwsgi_malloc(msize);
+	uint64_t i, done = 0;
+	for (i = 0; i < cells; i++) {
+		char *ptr = ((char *) uwsgi_queue_ring_cell(pos + i)) + sizeof(struct uwsgi_queue_cell);
+		uint64_t chunk = msize - done > payload ? payload : msize - done;
+		memcpy(buf + done, ptr, chunk);
+		done += chunk;
+	}
+	uwsgi_barrier();
+	for (i = 0; i < cells; i++) {
+		uwsgi_queue_ring_cell(pos + i)->seq = pos + i + uwsgi.queue_ring;
+	}
+
+	*size = msize;
+	return buf;
+}
+
+// wake up the sleeping consumers (if any)
+static void uwsgi_queue_notify(void) {
+	struct uwsgi_queue_waiters *uqw = uwsgi.queue_waiters;
+	__sync_add_and_fetch(&uqw->seq, 1);
+	if (!uqw->waiters) return;
+#ifdef __linux__
+	syscall(SYS_futex, &uqw->seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+	if (uwsgi.queue_efd > -1) {
+		uint64_t one = 1;
+		if (write(uwsgi.queue_efd, &one, sizeof(uint64_t)) < 0 && errno != EAGAIN) {
+			uwsgi_error("uwsgi_queue_notify()/write()");
+		}
+	}
+#endif
+}
+
+static char *uwsgi_queue_pull_copy(uint64_t *size, int pop) {
+	if (uwsgi.queue_ring && !pop) return uwsgi_queue_ring_pull(size);
+	if (!uwsgi.queue_size) return NULL;
+	char *buf = NULL;
+	uwsgi_wlock(uwsgi.queue_lock);
+	char *message = pop ? uwsgi_queue_pop(size) : uwsgi_queue_pull(size);
+	if (message && *size > 0) {
+		buf = uwsgi_malloc(*size);
+		memcpy(buf, message, *size);
+	}
+	uwsgi_rwunlock(uwsgi.queue_lock);
+	return buf;
+}
+
+/*
+	pull (or pop) an item waiting up to timeout milliseconds (forever if < 0) for it,
+	returns a newly allocated copy.
+
+	Blocking cores sleep on a futex, when a suspend engine is installed the eventfd
+	is waited with the wait_read_hook so the other cores can run.
+*/
+char *uwsgi_queue_pull_wait(uint64_t *size, int timeout, int pop) {
+	struct uwsgi_queue_waiters *uqw = uwsgi.queue_waiters;
+	uint64_t deadline = timeout > 0 ? uwsgi_micros() + ((uint64_t) timeout * 1000) : 0;
+
+	for (;;) {
+		uint32_t seq = uqw->seq;
+		uwsgi_barrier();
+		char *buf = uwsgi_queue_pull_copy(size, pop);
+		if (buf || !timeout) return buf;
+
+		int remains = -1;
+		if (deadline) {
+			uint64_t now = uwsgi_micros();
+			if (now >= deadline) return NULL;
+			remains = (deadline - now) / 1000;
+			if (!remains) remains = 1;
+		}
+
+		__sync_add_and_fetch(&uqw->waiters, 1);
+		// a push could have happened before the producer could see us
+		if (uqw->seq != seq) {
+			__sync_sub_and_fetch(&uqw->waiters, 1);
+			continue;
+		}
+#ifdef __linux__
+		if (uwsgi.queue_efd > -1 && uwsgi.wait_read_hook != uwsgi_simple_wait_read_hook) {
+			int ret = uwsgi.wait_read_hook(uwsgi.queue_efd, remains < 0 ? uwsgi.socket_timeout : (remains + 999) / 1000);
+			if (ret > 0) {
+				uint64_t counter;
+				if (read(uwsgi.queue_efd, &counter, sizeof(uint64_t)) < 0 && errno != EAGAIN) {
+					uwsgi_error("uwsgi_queue_pull_wait()/read()");
+				}
+			}
+		}
+		else {
+			struct timespec ts;
+			ts.tv_sec = remains / 1000;
+			ts.tv_nsec = (remains % 1000) * 1000000;
+			// returns immediately if a push happened after we read seq
+			syscall(SYS_futex, &uqw->seq, FUTEX_WAIT, seq, remains < 0 ? NULL : &ts, NULL, 0);
+		}
+#else
+		// no futex here, poll every millisecond
+		usleep(1000);
+#endif
+		__sync_sub_and_fetch(&uqw->waiters, 1);
+	}
+}
@@ -0,0 +1,141 @@
+#include <uwsgi.h>
+
+extern struct uwsgi_server uwsgi;
+
+/*
+
+	shared rate limiters (GCRA)
+
+	every limiter is a table of 64bit words in shared memory: the upper 16 bits are a tag
+	of the key, the lower 48 bits its theoretical arrival time (usec since the limiter creation).
+
+	a key maps to a bucket of 4 words, the state is updated with a single CAS, so workers,
+	mules and routers can share the same limiter without locking.
+
+	a request is allowed when tat - now <= tolerance, then tat = max(tat, now) + interval
+
+*/
+
+#define UWSGI_RATELIMIT_WAYS 4
+#define UWSGI_RATELIMIT_TAT_MASK 0xffffffffffffULL
+
+struct uwsgi_ratelimit *uwsgi_ratelimit_get(char *name) {
+	struct uwsgi_ratelimit *url = uwsgi.ratelimits;
+	while (url) {
+		if (!strcmp(url->name, name)) return url;
+		url = url->next;
+	}
+	return NULL;
+}
+
+static void ratelimit_create(char *arg) {
+	char *rl_name = NULL;
+	char *rl_rate = NULL;
+	char *rl_period = NULL;
+	char *rl_burst = NULL;
+	char *rl_items = NULL;
+
+	if (uwsgi_kvlist_parse(arg, strlen(arg), ',', '=',
+		"name", &rl_name,
+		"rate", &rl_rate,
+		"period", &rl_period,
+		"burst", &rl_burst,
+		"items", &rl_items,
+		NULL)) {
+		uwsgi_log("invalid --ratelimit keyval syntax: %s\n", arg);
+		exit(1);
+	}
+
+	if (!rl_name || !rl_rate) {
+		uwsgi_log("--ratelimit: you need to specify at least 'name' and 'rate'\n");
+		exit(1);
+	}
+
+	if (uwsgi_ratelimit_get(rl_name)) {
+		uwsgi_log("--ratelimit: limiter \"%s\" already defined\n", rl_name);
+		exit(1);
+	}
+
+	uint64_t rate = uwsgi_n64(rl_rate);
+	uint64_t period = rl_period ? uwsgi_n64(rl_period) : 1;
+	uint64_t burst = rl_burst ? uwsgi_n64(rl_burst) : rate;
+	uint64_t items = rl_items ? uwsgi_n64(rl_items) : 65536;
+	if (!rate || !period || !burst || items < UWSGI_RATELIMIT_WAYS) {
+		uwsgi_log("--ratelimit: invalid values for limiter \"%s\"\n", rl_name);
+		exit(1);
+	}
+
+	struct uwsgi_ratelimit *url = uwsgi_calloc(sizeof(struct uwsgi_ratelimit));
+	url->name = rl_name;
+	url->buckets = items / UWSGI_RATELIMIT_WAYS;
+	url->interval = (period * 1000000) / rate;
+	if (!url->interval) url->interval = 1;
+	url->tolerance = url->interval * (burst - 1);
+	url->epoch = uwsgi_micros_monotonic();
+	url->slots = uwsgi_calloc_shared(sizeof(uint64_t) * url->buckets * UWSGI_RATELIMIT_WAYS);
+	url->rejected = uwsgi_calloc_shared(sizeof(uint64_t));
+	url->hash = uwsgi_hash_algo_get("wyhash");
+
+	struct uwsgi_ratelimit **last = &uwsgi.ratelimits;
+	while (*last) last = &(*last)->next;
+	*last = url;
+
+	uwsgi_log_initial("rate limiter \"%s\": %llu requests every %llu seconds (burst %llu, %llu items)\n", url->name,
+		(unsigned long long) rate, (unsigned long long) period, (unsigned long long) burst,
+		(unsigned long long) url->buckets * UWSGI_RATELIMIT_WAYS);
+}
+
+void uwsgi_ratelimits_init() {
+	struct uwsgi_string_list *usl = NULL;
+	uwsgi_foreach(usl, uwsgi.ratelimits_list) {
+		ratelimit_create(uwsgi_str(usl->value));
+	}
+}
+
+/*
+	account a request for the key, returns 0 if allowed, -1 if it has to be rejected
+	(retry_after, if not NULL, is filled with the usecs to wait)
+*/
+int uwsgi_ratelimit_acquire(struct uwsgi_ratelimit *url, char *key, uint16_t keylen, uint64_t *retry_after) {
+	uint64_t now = uwsgi_micros_monotonic() - url->epoch;
+	uint64_t hash = uwsgi_hash_algo_64(url->hash, key, keylen);
+	uint64_t tag = hash >> 48;
+	uint64_t *bucket = url->slots + ((hash % url->buckets) * UWSGI_RATELIMIT_WAYS);
+	int attempts = 8;
+
+	while (attempts--) {
+		int i;
+		uint64_t *slot = NULL;
+		uint64_t old = 0;
+		uint64_t tat = 0;
+		// the key is not in the bucket, take the oldest item
+		uint64_t oldest = UWSGI_RATELIMIT_TAT_MASK + 1;
+		for (i = 0; i < UWSGI_RATELIMIT_WAYS; i++) {
+			uint64_t w = __atomic_load_n(&bucket[i], __ATOMIC_ACQUIRE);
+			if ((w >> 48) == tag) {
+				slot = &bucket[i];
+				old = w;
+				tat = w & UWSGI_RATELIMIT_TAT_MASK;
+				break;
+			}
+			if ((w & UWSGI_RATELIMIT_TAT_MASK) < oldest) {
+				oldest = w & UWSGI_RATELIMIT_TAT_MASK;
+				slot = &bucket[i];
+				old = w;
+			}
+		}
+
+		if (tat < now) tat = now;
+		if (tat - now > url->tolerance) {
+			__sync_add_and_fetch(url->rejected, 1);
+			if (retry_after) *retry_after = tat - now - url->tolerance;
+			return -1;
+		}
+
+		uint64_t new = (tag << 48) | ((tat + url->interval) & UWSGI_RATELIMIT_TAT_MASK);
+		if (__sync_bool_compare_and_swap(slot, old, new)) return 0;
+	}
+
+	// too much contention on the bucket, do not penalize the client
+	return 0;
+}
@@ -12,12 +12,65 @@
 
 #include <uwsgi.h>
 
+extern struct uwsgi_server uwsgi;
+
 #define uwsgi_rbt_red(node)               ((node)->color = 1)
 #define uwsgi_rbt_black(node)             ((node)->color = 0)
 #define uwsgi_rbt_is_red(node)            ((node)->color)
 #define uwsgi_rbt_is_black(node)          (!uwsgi_rbt_is_red(node))
 #define uwsgi_rbt_copy_color(n1, n2)      (n1->color = n2->color)
 
+// the node is in a slot of the timing wheel (left and right are the list pointers)
+#define UWSGI_RB_TIMER_WHEEL 2
+
+/*
+	the (optional) timing wheel has a slot for each second of the [base, base + UWSGI_TIMER_WHEEL_SLOTS) window,
+	so all of the nodes in a slot have the same value. Timers out of the window go to the rbtree.
+	base only moves forward (when looking for the minimum) or when the wheel is empty.
+*/
+static int uwsgi_timer_wheel_add(struct uwsgi_timer_wheel *utw, struct uwsgi_rb_timer *node) {
+	if (!utw->count) utw->base = node->value;
+	if (node->value < utw->base || node->value - utw->base >= UWSGI_TIMER_WHEEL_SLOTS) return -1;
+
+	struct uwsgi_rb_timer **slot = &utw->slots[node->value & (UWSGI_TIMER_WHEEL_SLOTS - 1)];
+	node->color = UWSGI_RB_TIMER_WHEEL;
+	node->parent = NULL;
+	node->left = NULL;
+	node->right = *slot;
+	if (*slot) (*slot)->left = node;
+	*slot = node;
+	utw->count++;
+	return 0;
+}
+
+static void uwsgi_timer_wheel_del(struct uwsgi_timer_wheel *utw, struct uwsgi_rb_timer *node) {
+	if (node->left) {
+		node->left->right = node->right;
+	}
+	else {
+		utw->slots[node->value & (UWSGI_TIMER_WHEEL_SLOTS - 1)] = node->right;
+	}
+	if (node->right) node->right->left = node->left;
+	utw->count--;
+}
+
+static struct uwsgi_rb_timer *uwsgi_timer_wheel_min(struct uwsgi_rbtree *tree) {
+	struct uwsgi_timer_wheel *utw = tree->wheel;
+	struct uwsgi_rb_timer *node = NULL;
+	if (utw->count) {
+		for (;;) {
+			node = utw->slots[utw->base & (UWSGI_TIMER_WHEEL_SLOTS - 1)];
+			if (node) break;
+			utw->base++;
+		}
+	}
+
+	if (tree->root == tree->sentinel) return node;
+	struct uwsgi_rb_timer *rb_node = uwsgi_min_rb_timer(tree, tree->root);
+	if (!node || rb_node->value < node->value) return rb_node;
+	return node;
+}
+
 
 struct uwsgi_rbtree *uwsgi_init_rb_timer() {
 
@@ -27,14 +80,19 @@ struct uwsgi_rbtree *uwsgi_init_rb_timer() {
 	//uwsgi_rbt_black(sentinel);
 	tree->root = sentinel;
 	tree->sentinel = sentinel;
+	if (uwsgi.timer_wheel) {
+		tree->wheel = uwsgi_calloc(sizeof(struct uwsgi_timer_wheel));
+	}
 
 	return tree;
 }
 
 struct uwsgi_rb_timer *uwsgi_min_rb_timer(struct uwsgi_rbtree *tree, struct uwsgi_rb_timer *node) {
 
-	if (!node)
+	if (!node) {
+		if (tree->wheel) return uwsgi_timer_wheel_min(tree);
 		node = tree->root;
+	}
 	struct uwsgi_rb_timer *sentinel = tree->sentinel;
 
 	if (tree->root == sentinel) return NULL;
@@ -125,12 +183,11 @@ static void uwsgi_rbt_add(struct uwsgi_rb_timer *temp, struct uwsgi_rb_timer *no
 }
 
 
-struct uwsgi_rb_timer *uwsgi_add_rb_timer(struct uwsgi_rbtree *tree, uint64_t value, void *data) {
+static struct uwsgi_rb_timer *uwsgi_insert_rb_timer(struct uwsgi_rbtree *tree, struct uwsgi_rb_timer *node) {
 
-	struct uwsgi_rb_timer *node = uwsgi_malloc(sizeof(struct uwsgi_rb_timer));
 	struct uwsgi_rb_timer *new_node = node;
-	node->value = value;
-	node->data = data;
+
+	if (tree->wheel && !uwsgi_timer_wheel_add(tree->wheel, node)) return node;
 
 	struct uwsgi_rb_timer *temp = NULL;
 
@@ -204,10 +261,30 @@ struct uwsgi_rb_timer *uwsgi_add_rb_timer(struct uwsgi_rbtree *tree, uint64_t va
 	return new_node;
 }
 
+struct uwsgi_rb_timer *uwsgi_add_rb_timer(struct uwsgi_rbtree *tree, uint64_t value, void *data) {
+	struct uwsgi_rb_timer *node = uwsgi_malloc(sizeof(struct uwsgi_rb_timer));
+	node->value = value;
+	node->data = data;
+	return uwsgi_insert_rb_timer(tree, node);
+}
+
+// move a timer to a new value reusing its memory (a no-op if the value does not change)
+struct uwsgi_rb_timer *uwsgi_reset_rb_timer(struct uwsgi_rbtree *tree, struct uwsgi_rb_timer *node, uint64_t value) {
+	if (node->value == value) return node;
+	uwsgi_del_rb_timer(tree, node);
+	node->value = value;
+	return uwsgi_insert_rb_timer(tree, node);
+}
+
 void uwsgi_del_rb_timer(struct uwsgi_rbtree *tree, struct uwsgi_rb_timer *node) {
 	uint8_t red;
 	struct uwsgi_rb_timer **root, *sentinel, *subst, *temp, *w;
 
+	if (node->color == UWSGI_RB_TIMER_WHEEL) {
+		uwsgi_timer_wheel_del(tree->wheel, node);
+		return;
+	}
+
 	/* a binary tree delete */
 
 	root = &tree->root;
@@ -62,6 +62,13 @@ int uwsgi_simple_wait_read2_hook(int fd0, int fd1, int timeout, int *fd) {
 */
 
 void uwsgi_request_body_seek(struct wsgi_request *wsgi_req, off_t pos) {
+	// streamed bodies cannot be rewound
+	if (wsgi_req->post_stream) {
+		uwsgi_log("[uwsgi-body-read] unable to seek a streamed request body (post-buffering-stream)\n");
+		wsgi_req->read_errors++;
+		return;
+	}
+
 	if (wsgi_req->post_file) {
 		if (pos < 0) {
 			if (fseek(wsgi_req->post_file, pos, SEEK_CUR)) {
@@ -115,6 +122,23 @@ void uwsgi_request_body_seek(struct wsgi_request *wsgi_req, off_t pos) {
                         (unsigned long long) x,\
                         (unsigned long long) wsgi_req->post_cl, (unsigned long long) wsgi_req->post_pos, (unsigned long long) wsgi_req->post_cl-wsgi_req->post_pos);
 
+// body chunks come from the offload stream (after the data already parsed) or from the socket
+static ssize_t request_body_read_chunk(struct wsgi_request *wsgi_req, char *buf, size_t len) {
+	if (wsgi_req->post_stream && !wsgi_req->proto_parser_remains) {
+		return read(wsgi_req->post_stream_fd, buf, len);
+	}
+	return wsgi_req->socket->proto_read_body(wsgi_req, buf, len);
+}
+
+static int request_body_wait(struct wsgi_request *wsgi_req) {
+	if (wsgi_req->post_stream) {
+		wsgi_req->switches++;
+		return uwsgi.wait_read_hook(wsgi_req->post_stream_fd, uwsgi.socket_timeout);
+	}
+	int ret = uwsgi_wait_read_req(wsgi_req);
+	return ret;
+}
+
 static int consume_body_for_readline(struct wsgi_request *wsgi_req) {
 
 	size_t remains = UMIN(uwsgi.buffer_size, wsgi_req->post_cl - wsgi_req->post_pos);
@@ -159,7 +183,7 @@ static int consume_body_for_readline(struct wsgi_request *wsgi_req) {
 
 
 	// read from post_buffering memory
-	if (uwsgi.post_buffering) {
+	if (uwsgi.post_buffering && !wsgi_req->post_stream) {
 		memcpy(wsgi_req->post_readline_buf + wsgi_req->post_readline_watermark, wsgi_req->post_buffering_buf + wsgi_req->post_pos, remains);
 		wsgi_req->post_pos += remains;
 		wsgi_req->post_readline_watermark += remains;
@@ -167,7 +191,7 @@ static int consume_body_for_readline(struct wsgi_request *wsgi_req) {
 	}
 
 	// read from socket
-	ssize_t len = wsgi_req->socket->proto_read_body(wsgi_req, wsgi_req->post_readline_buf + wsgi_req->post_readline_watermark , remains);
+	ssize_t len = request_body_read_chunk(wsgi_req, wsgi_req->post_readline_buf + wsgi_req->post_readline_watermark , remains);
 	if (len > 0) {
 		wsgi_req->post_pos += len;
 		wsgi_req->post_readline_watermark += len;
@@ -187,9 +211,9 @@ static int consume_body_for_readline(struct wsgi_request *wsgi_req) {
 		return -1;
 	}
 wait:
-	ret = uwsgi_wait_read_req(wsgi_req);
+	ret = request_body_wait(wsgi_req);
         if (ret > 0) {
-        	len = wsgi_req->socket->proto_read_body(wsgi_req, wsgi_req->post_readline_buf + wsgi_req->post_readline_watermark , remains);
+        	len = request_body_read_chunk(wsgi_req, wsgi_req->post_readline_buf + wsgi_req->post_readline_watermark , remains);
                 if (len > 0) {
 			wsgi_req->post_pos += len;
 			wsgi_req->post_readline_watermark += len;
@@ -351,7 +375,7 @@ char *uwsgi_request_body_read(struct wsgi_request *wsgi_req, ssize_t hint, ssize
         }
 
 	// read from post buffering memory
-        if (uwsgi.post_buffering > 0 && !wsgi_req->post_file) {
+        if (uwsgi.post_buffering > 0 && !wsgi_req->post_file && !wsgi_req->post_stream) {
 		*rlen += remains;
                 char *buf = wsgi_req->post_buffering_buf+wsgi_req->post_pos;
 		wsgi_req->post_pos += remains;
@@ -404,7 +428,7 @@ char *uwsgi_request_body_read(struct wsgi_request *wsgi_req, ssize_t hint, ssize
 	// ok read all the required bytes...
 	while(remains > 0) {
 		// here we first try to read (as data could be already available)
-		ssize_t len = wsgi_req->socket->proto_read_body(wsgi_req, wsgi_req->post_read_buf + *rlen , remains);
+		ssize_t len = request_body_read_chunk(wsgi_req, wsgi_req->post_read_buf + *rlen , remains);
 		if (len > 0) {
 			wsgi_req->post_pos+=len;
 			remains -= len;
@@ -427,9 +451,9 @@ char *uwsgi_request_body_read(struct wsgi_request *wsgi_req, ssize_t hint, ssize
 			return NULL;
 		}
 wait:
-		ret = uwsgi_wait_read_req(wsgi_req);
+		ret = request_body_wait(wsgi_req);
         	if (ret > 0) {
-			len = wsgi_req->socket->proto_read_body(wsgi_req, wsgi_req->post_read_buf + *rlen, remains);
+			len = request_body_read_chunk(wsgi_req, wsgi_req->post_read_buf + *rlen, remains);
 			if (len > 0) {
 				wsgi_req->post_pos+=len;
 				remains -= len;
@@ -463,6 +487,66 @@ wait:
 	return wsgi_req->post_read_buf;
 }
 
+/*
+	non-blocking read of the request body, for engines managing readiness by themselves (asyncio/ASGI):
+	copies at most len bytes to buf, returns 0 at the end of the body and -1 on error
+	(errno EAGAIN means no data is available yet, wait for the socket or the post stream fd)
+*/
+ssize_t uwsgi_request_body_read_nb(struct wsgi_request *wsgi_req, char *buf, size_t len) {
+
+	// residual data of readline()
+	if (wsgi_req->post_readline_pos > 0) {
+		size_t avail = UMIN(len, wsgi_req->post_readline_watermark - wsgi_req->post_readline_pos);
+		memcpy(buf, wsgi_req->post_readline_buf + wsgi_req->post_readline_pos, avail);
+		wsgi_req->post_readline_pos += avail;
+		if (wsgi_req->post_readline_pos >= wsgi_req->post_readline_watermark) {
+			wsgi_req->post_readline_pos = 0;
+			wsgi_req->post_readline_watermark = 0;
+		}
+		return avail;
+	}
+
+	if (!wsgi_req->post_cl || wsgi_req->post_pos >= wsgi_req->post_cl) return 0;
+
+	size_t remains = wsgi_req->post_cl - wsgi_req->post_pos;
+	if (len > remains) len = remains;
+
+	if (uwsgi.post_buffering > 0 && !wsgi_req->post_file && !wsgi_req->post_stream) {
+		memcpy(buf, wsgi_req->post_buffering_buf + wsgi_req->post_pos, len);
+		wsgi_req->post_pos += len;
+		return len;
+	}
+
+	if (wsgi_req->post_file) {
+		if (fread(buf, len, 1, wsgi_req->post_file) != 1) {
+			uwsgi_req_error("uwsgi_request_body_read_nb()/fread()");
+			wsgi_req->read_errors++;
+			return -1;
+		}
+		wsgi_req->post_pos += len;
+		return len;
+	}
+
+	ssize_t rlen = request_body_read_chunk(wsgi_req, buf, len);
+	if (rlen > 0) {
+		wsgi_req->post_pos += rlen;
+		return rlen;
+	}
+	if (rlen == 0) {
+		uwsgi_read_error0(remains);
+		wsgi_req->read_errors++;
+		errno = ECONNRESET;
+		return -1;
+	}
+	if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS) {
+		errno = EAGAIN;
+		return -1;
+	}
+	uwsgi_read_error(remains);
+	wsgi_req->read_errors++;
+	return -1;
+}
+
 /*
 
 	post buffering
@@ -523,20 +607,67 @@ wait:
 }
 
 
+/*
+	splice() spooling
+
+	with --post-buffering-splice the body of plain sockets moves socket -> pipe -> file
+	in kernel space. The data already read with the request headers is written as usual.
+	Returns like read() (errno is set for EAGAIN), -2 on errors writing the file.
+*/
+#if defined(__linux__) && defined(SPLICE_F_MOVE)
+static ssize_t postbuffer_splice(struct wsgi_request *wsgi_req, int *pipefd, int fd, size_t len) {
+	ssize_t rlen = splice(wsgi_req->fd, NULL, pipefd[1], NULL, len, SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+	if (rlen <= 0) return rlen;
+	size_t remains = rlen;
+	while(remains > 0) {
+		ssize_t wlen = splice(pipefd[0], NULL, fd, NULL, remains, SPLICE_F_MOVE);
+		if (wlen <= 0) {
+			if (wlen == 0) errno = EIO;
+			uwsgi_req_error("uwsgi_postbuffer_do_in_disk()/splice()");
+			return -2;
+		}
+		remains -= wlen;
+	}
+	return rlen;
+}
+
+#define postbuffer_read(wsgi_req, len) ((spliced = (pipefd[0] >= 0 && !wsgi_req->proto_parser_remains)) ?\
+	postbuffer_splice(wsgi_req, pipefd, fileno(wsgi_req->post_file), len) :\
+	wsgi_req->socket->proto_read_body(wsgi_req, wsgi_req->post_buffering_buf, len))
+#else
+#define postbuffer_read(wsgi_req, len) (spliced = 0, wsgi_req->socket->proto_read_body(wsgi_req, wsgi_req->post_buffering_buf, len))
+#endif
+
 int uwsgi_postbuffer_do_in_disk(struct wsgi_request *wsgi_req) {
 
         size_t post_remains = wsgi_req->post_cl;
         int ret;
         int upload_progress_fd = -1;
         char *upload_progress_filename = NULL;
+	int pipefd[2] = {-1, -1};
+	int spliced = 0;
 
-        wsgi_req->post_file = uwsgi_tmpfile();
+	int fd = uwsgi_tmpfd_in(uwsgi.post_buffering_dir);
+	if (fd >= 0) {
+		wsgi_req->post_file = fdopen(fd, "w+");
+		if (!wsgi_req->post_file) close(fd);
+	}
         if (!wsgi_req->post_file) {
                 uwsgi_req_error("uwsgi_postbuffer_do_in_disk()/uwsgi_tmpfile()");
 		wsgi_req->read_errors++;
                 return -1;
         }
 
+#if defined(__linux__) && defined(SPLICE_F_MOVE)
+	if (uwsgi.post_buffering_splice && wsgi_req->socket->proto_read_body == uwsgi_proto_base_read_body) {
+		if (pipe2(pipefd, O_CLOEXEC)) {
+			uwsgi_req_error("uwsgi_postbuffer_do_in_disk()/pipe2()");
+			pipefd[0] = -1;
+			pipefd[1] = -1;
+		}
+	}
+#endif
+
         if (uwsgi.upload_progress) {
                 // first check for X-Progress-ID size
                 // separator + 'X-Progress-ID' + '=' + uuid     
@@ -557,13 +688,30 @@ int uwsgi_postbuffer_do_in_disk(struct wsgi_request *wsgi_req) {
                 // we use the already available post buffering buffer to read chunks....
                 size_t remains = UMIN(post_remains, uwsgi.post_buffering);
 
+#if defined(__linux__) && defined(SPLICE_F_MOVE)
+		if (pipefd[0] >= 0 && !wsgi_req->proto_parser_remains) {
+			// the buffered chunks must reach the file before the spliced ones
+			if (fflush(wsgi_req->post_file)) {
+				uwsgi_req_error("uwsgi_postbuffer_do_in_disk()/fflush()");
+				wsgi_req->read_errors++;
+				goto end;
+			}
+			// no user space buffer involved, move up to the (default) pipe capacity
+			remains = UMIN(post_remains, UMAX(uwsgi.post_buffering, 65536));
+		}
+#endif
+
                 // first try to read data (there could be something already available
-                ssize_t rlen = wsgi_req->socket->proto_read_body(wsgi_req, wsgi_req->post_buffering_buf, remains);
+                ssize_t rlen = postbuffer_read(wsgi_req, remains);
                 if (rlen > 0) goto write;
                 if (rlen == 0) {
 			uwsgi_read_error0(remains);
 			goto end;
 		}
+		if (rlen == -2) {
+			wsgi_req->read_errors++;
+			goto end;
+		}
                 if (rlen < 0) {
                         if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS) {
                                 goto wait;
@@ -576,11 +724,14 @@ int uwsgi_postbuffer_do_in_disk(struct wsgi_request *wsgi_req) {
 wait:
                 ret = uwsgi_wait_read_req(wsgi_req);
                 if (ret > 0) {
-			rlen = wsgi_req->socket->proto_read_body(wsgi_req, wsgi_req->post_buffering_buf, remains);
+			rlen = postbuffer_read(wsgi_req, remains);
 			if (rlen > 0) goto write;
 			if (rlen == 0) {
 				uwsgi_read_error0(remains);
 			}
+			else if (rlen == -2) {
+				wsgi_req->read_errors++;
+			}
 			else {
 				uwsgi_read_error(remains);
 				wsgi_req->read_errors++;
@@ -596,7 +747,8 @@ wait:
                 goto end;
 
 write:
-                if (fwrite(wsgi_req->post_buffering_buf, rlen, 1, wsgi_req->post_file) != 1) {
+		// spliced data is already in the file
+                if (!spliced && fwrite(wsgi_req->post_buffering_buf, rlen, 1, wsgi_req->post_file) != 1) {
                         uwsgi_req_error("uwsgi_postbuffer_do_in_disk()/fwrite()");
 			wsgi_req->read_errors++;
                         goto end;
@@ -617,13 +769,76 @@ write:
         if (upload_progress_filename) {
                 uwsgi_upload_progress_destroy(upload_progress_filename, upload_progress_fd);
         }
+	if (pipefd[0] >= 0) {
+		close(pipefd[0]);
+		close(pipefd[1]);
+	}
 
         return 0;
 
 end:
+	if (pipefd[0] >= 0) {
+		close(pipefd[0]);
+		close(pipefd[1]);
+	}
         if (upload_progress_filename) {
                 uwsgi_upload_progress_destroy(upload_progress_filename, upload_progress_fd);
         }
         return -1;
 }
 
+
+/*
+
+	post buffering stream
+
+	bodies bigger than post-buffering are read by an offload thread and pushed (in
+	post-buffering-bufsize chunks) to a socketpair whose buffer (post-buffering bytes)
+	is the read-ahead window: the app consumes the body while it is arriving, without
+	spooling it to disk and without a worker sitting on a slow client for every read()
+
+	only plain sockets are supported (no ssl, no framed protocols), the other requests
+	fall back to the disk buffering
+
+*/
+
+int uwsgi_postbuffer_do_stream(struct wsgi_request *wsgi_req) {
+
+	if (uwsgi.offload_threads < 1 || uwsgi.upload_progress) return -1;
+	if (wsgi_req->socket->proto_read_body != uwsgi_proto_base_read_body) return -1;
+	// already parsed ?
+	if (wsgi_req->proto_parser_remains >= wsgi_req->post_cl) return -1;
+
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+		uwsgi_req_error("uwsgi_postbuffer_do_stream()/socketpair()");
+		return -1;
+	}
+
+	int window = uwsgi.post_buffering;
+	if (setsockopt(fds[1], SOL_SOCKET, SO_SNDBUF, &window, sizeof(int))) {
+		uwsgi_req_error("uwsgi_postbuffer_do_stream()/setsockopt()");
+	}
+	uwsgi_socket_nb(fds[0]);
+	uwsgi_socket_nb(fds[1]);
+
+	if (uwsgi_offload_request_body_do(wsgi_req, fds[1])) {
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+
+	wsgi_req->post_stream = 1;
+	wsgi_req->post_stream_fd = fds[0];
+	return 0;
+}
+
+void uwsgi_postbuffer_stream_close(struct wsgi_request *wsgi_req) {
+	if (!wsgi_req->post_stream) return;
+	// the offload thread could still be waiting for the client, wake it up
+	if (wsgi_req->post_pos < wsgi_req->post_cl && !wsgi_req->fd_closed) {
+		shutdown(wsgi_req->fd, SHUT_RD);
+	}
+	close(wsgi_req->post_stream_fd);
+	wsgi_req->post_stream = 0;
+}
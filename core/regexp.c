@@ -13,6 +13,35 @@ void uwsgi_opt_pcre_jit(char *opt, char *value, void *foobar) {
 #endif
 }
 
+#if defined(PCRE_STUDY_JIT_COMPILE) && defined(PCRE_CONFIG_JIT)
+/*
+	jit stacks are allocated on first use, one for each thread (so one for each core
+	in threaded mode, while async cores share the one of their thread as a match never yields)
+*/
+static __thread pcre_jit_stack *uwsgi_pcre_jit_stack;
+
+static pcre_jit_stack *uwsgi_pcre_jit_stack_cb(void *data) {
+	if (!uwsgi_pcre_jit_stack) {
+		// on failure pcre uses the (32k) machine stack
+		uwsgi_pcre_jit_stack = pcre_jit_stack_alloc(32 * 1024, uwsgi.pcre_jit_stack_size);
+	}
+	return uwsgi_pcre_jit_stack;
+}
+#endif
+
+static int uwsgi_pcre_exec(pcre * pattern, pcre_extra * pattern_extra, char *subject, int length, int *ovec, int ovec_size) {
+	int ret = pcre_exec((const pcre *) pattern, (const pcre_extra *) pattern_extra, subject, length, 0, 0, ovec, ovec_size);
+#if defined(PCRE_ERROR_JIT_STACKLIMIT) && defined(PCRE_EXTRA_EXECUTABLE_JIT)
+	// the jit stack is not enough, fallback to the interpreter
+	if (ret == PCRE_ERROR_JIT_STACKLIMIT && pattern_extra) {
+		pcre_extra interpreter = *pattern_extra;
+		interpreter.flags &= ~PCRE_EXTRA_EXECUTABLE_JIT;
+		ret = pcre_exec((const pcre *) pattern, (const pcre_extra *) &interpreter, subject, length, 0, 0, ovec, ovec_size);
+	}
+#endif
+	return ret;
+}
+
 int uwsgi_regexp_build(char *re, pcre ** pattern, pcre_extra ** pattern_extra) {
 
 	const char *errstr;
@@ -33,21 +62,28 @@ int uwsgi_regexp_build(char *re, pcre ** pattern, pcre_extra ** pattern_extra) {
 		return -1;
 	}
 
+#if defined(PCRE_STUDY_JIT_COMPILE) && defined(PCRE_CONFIG_JIT)
+	// a noop if the pattern has not been jit-compiled
+	if (opt && *pattern_extra) {
+		pcre_assign_jit_stack(*pattern_extra, uwsgi_pcre_jit_stack_cb, NULL);
+	}
+#endif
+
 	return 0;
 
 }
 
 int uwsgi_regexp_match(pcre * pattern, pcre_extra * pattern_extra, char *subject, int length) {
 
-	return pcre_exec((const pcre *) pattern, (const pcre_extra *) pattern_extra, subject, length, 0, 0, NULL, 0);
+	return uwsgi_pcre_exec(pattern, pattern_extra, subject, length, NULL, 0);
 }
 
 int uwsgi_regexp_match_ovec(pcre * pattern, pcre_extra * pattern_extra, char *subject, int length, int *ovec, int n) {
 
 	if (n > 0) {
-		return pcre_exec((const pcre *) pattern, (const pcre_extra *) pattern_extra, subject, length, 0, 0, ovec, (n + 1) * 3);
+		return uwsgi_pcre_exec(pattern, pattern_extra, subject, length, ovec, (n + 1) * 3);
 	}
-	return pcre_exec((const pcre *) pattern, (const pcre_extra *) pattern_extra, subject, length, 0, 0, NULL, 0);
+	return uwsgi_pcre_exec(pattern, pattern_extra, subject, length, NULL, 0);
 }
 
 int uwsgi_regexp_ovector(pcre * pattern, pcre_extra * pattern_extra) {
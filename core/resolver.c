@@ -0,0 +1,249 @@
+#include <uwsgi.h>
+
+extern struct uwsgi_server uwsgi;
+
+/*
+
+	the resolver cache
+
+	uwsgi_resolve_ip() is used by the connect paths (backends, nodes, loggers, routers...).
+	With --dns-cache-ttl the resolutions are stored in a table in shared memory, so workers,
+	mules and gateways share them. Hits never touch the resolver. When an entry expires
+	its address is still returned while the resolver thread of the process refreshes it,
+	so a slow dns server can only block the first resolution of a name.
+
+	Entries used since their last refresh (and the pinned ones, like the static nodes
+	of the routers) are re-resolved by the thread as soon as they expire, even if idle,
+	so a change of address is followed without restarting the instance.
+
+	getaddrinfo() does not expose the ttl of the records, the configured one is used.
+
+*/
+
+struct uwsgi_dns_entry {
+	char name[256];
+	char ip[INET_ADDRSTRLEN];
+	uint64_t expires;
+	uint64_t last_used;
+	uint64_t refreshed;
+	// the pid of the process refreshing the entry
+	pid_t refreshing;
+	uint64_t refreshing_since;
+	uint8_t pinned;
+};
+
+static struct uwsgi_dns_entry *dns_entries;
+static struct uwsgi_lock_item *dns_lock;
+static struct uwsgi_thread *dns_thread;
+static pid_t dns_thread_pid;
+static __thread char dns_resolved[INET_ADDRSTRLEN];
+
+// a stuck refresh (its process died) is retried after this amount of seconds
+#define UWSGI_DNS_REFRESH_TIMEOUT 30
+
+void uwsgi_dns_cache_init() {
+	if (uwsgi.dns_cache_ttl <= 0) return;
+	if (uwsgi.dns_cache_size <= 0) uwsgi.dns_cache_size = 64;
+	dns_entries = uwsgi_calloc_shared(sizeof(struct uwsgi_dns_entry) * uwsgi.dns_cache_size);
+	dns_lock = uwsgi_lock_init("dns cache");
+	uwsgi_log_initial("dns cache: %d entries, ttl %d seconds\n", uwsgi.dns_cache_size, uwsgi.dns_cache_ttl);
+}
+
+static int dns_resolve(char *name, char *ip) {
+	struct addrinfo hints, *res = NULL;
+	memset(&hints, 0, sizeof(struct addrinfo));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(name, NULL, &hints, &res) || !res) return -1;
+	struct sockaddr_in *sin = (struct sockaddr_in *) res->ai_addr;
+	int ret = inet_ntop(AF_INET, &sin->sin_addr, ip, INET_ADDRSTRLEN) ? 0 : -1;
+	freeaddrinfo(res);
+	return ret;
+}
+
+// must be called with the lock held
+static struct uwsgi_dns_entry *dns_entry_get(char *name) {
+	int i;
+	for (i = 0; i < uwsgi.dns_cache_size; i++) {
+		if (dns_entries[i].name[0] && !strcmp(dns_entries[i].name, name)) return &dns_entries[i];
+	}
+	return NULL;
+}
+
+// must be called with the lock held, the least recently used (not pinned) entry is recycled
+static struct uwsgi_dns_entry *dns_entry_new(char *name) {
+	int i;
+	struct uwsgi_dns_entry *ude = NULL;
+	for (i = 0; i < uwsgi.dns_cache_size; i++) {
+		if (!dns_entries[i].name[0]) {
+			ude = &dns_entries[i];
+			break;
+		}
+		if (dns_entries[i].pinned) continue;
+		if (!ude || dns_entries[i].last_used < ude->last_used) ude = &dns_entries[i];
+	}
+	if (!ude) return NULL;
+	memset(ude, 0, sizeof(struct uwsgi_dns_entry));
+	strncpy(ude->name, name, sizeof(ude->name) - 1);
+	return ude;
+}
+
+static void dns_cache_refresh(uint64_t now) {
+	int i;
+	char name[256];
+	char ip[INET_ADDRSTRLEN];
+	pid_t mypid = getpid();
+	for (i = 0; i < uwsgi.dns_cache_size; i++) {
+		struct uwsgi_dns_entry *ude = &dns_entries[i];
+		uwsgi_lock(dns_lock);
+		if (!ude->name[0] || ude->expires > now || (!ude->pinned && ude->last_used <= ude->refreshed)
+			|| (ude->refreshing && ude->refreshing_since + UWSGI_DNS_REFRESH_TIMEOUT > now)) {
+			uwsgi_unlock(dns_lock);
+			continue;
+		}
+		ude->refreshing = mypid;
+		ude->refreshing_since = now;
+		memcpy(name, ude->name, sizeof(name));
+		uwsgi_unlock(dns_lock);
+
+		int ret = dns_resolve(name, ip);
+
+		uwsgi_lock(dns_lock);
+		// the entry could have been recycled meanwhile
+		if (ude->refreshing == mypid && !strcmp(ude->name, name)) {
+			if (!ret) {
+				if (strcmp(ude->ip, ip)) {
+					uwsgi_log_verbose("[dns-cache] %s changed address: %s -> %s\n", name, ude->ip, ip);
+				}
+				memcpy(ude->ip, ip, sizeof(ude->ip));
+				ude->expires = now + uwsgi.dns_cache_ttl;
+			}
+			else {
+				// keep the old address and retry soon
+				ude->expires = now + UMIN(uwsgi.dns_cache_ttl, 5);
+			}
+			ude->refreshed = now;
+			ude->refreshing = 0;
+		}
+		uwsgi_unlock(dns_lock);
+		if (ret) {
+			uwsgi_log_verbose("[dns-cache] unable to refresh %s\n", name);
+		}
+	}
+}
+
+static void dns_cache_loop(struct uwsgi_thread *ut) {
+	char buf[64];
+	for (;;) {
+		int interesting_fd = -1;
+		int ret = event_queue_wait(ut->queue, 1, &interesting_fd);
+		if (ret > 0 && interesting_fd == ut->pipe[1]) {
+			// drain the wakeups
+			while (read(ut->pipe[1], buf, sizeof(buf)) > 0);
+		}
+		dns_cache_refresh(uwsgi_now());
+	}
+}
+
+// the thread does not survive fork(), every process starts its own on the first use
+static void dns_thread_check() {
+	pid_t mypid = getpid();
+	pid_t old = dns_thread_pid;
+	if (old == mypid) return;
+	if (!__sync_bool_compare_and_swap(&dns_thread_pid, old, mypid)) return;
+	dns_thread = uwsgi_thread_new(dns_cache_loop);
+	if (!dns_thread) {
+		uwsgi_log("[dns-cache] unable to start the resolver thread\n");
+	}
+}
+
+static void dns_thread_wakeup() {
+	if (!dns_thread) return;
+	if (write(dns_thread->pipe[0], "r", 1) != 1) {
+		// the thread is already awake
+	}
+}
+
+static char *dns_cache_resolve(char *domain, int pin) {
+	struct in_addr addr;
+	size_t len = strlen(domain);
+	// numeric addresses and invalid names bypass the cache
+	if (!len || len >= 256) goto direct;
+	if (inet_pton(AF_INET, domain, &addr) == 1) {
+		memcpy(dns_resolved, domain, len + 1);
+		return dns_resolved;
+	}
+
+	dns_thread_check();
+
+	uint64_t now = uwsgi_now();
+	uwsgi_lock(dns_lock);
+	struct uwsgi_dns_entry *ude = dns_entry_get(domain);
+	// stale entries not pinned and not used for longer than a ttl are resolved again
+	if (ude && (ude->pinned || ude->expires + uwsgi.dns_cache_ttl > now)) {
+		int expired = ude->expires <= now;
+		memcpy(dns_resolved, ude->ip, sizeof(dns_resolved));
+		ude->last_used = now;
+		if (pin) ude->pinned = 1;
+		uwsgi_unlock(dns_lock);
+		if (expired) dns_thread_wakeup();
+		return dns_resolved;
+	}
+	uwsgi_unlock(dns_lock);
+
+	char ip[INET_ADDRSTRLEN];
+	if (dns_resolve(domain, ip)) return NULL;
+
+	uwsgi_lock(dns_lock);
+	ude = dns_entry_get(domain);
+	if (!ude) ude = dns_entry_new(domain);
+	if (ude) {
+		memcpy(ude->ip, ip, sizeof(ude->ip));
+		ude->expires = now + uwsgi.dns_cache_ttl;
+		ude->last_used = now;
+		ude->refreshed = now;
+		if (pin) ude->pinned = 1;
+	}
+	uwsgi_unlock(dns_lock);
+	memcpy(dns_resolved, ip, sizeof(dns_resolved));
+	return dns_resolved;
+
+direct:
+	if (dns_resolve(domain, dns_resolved)) return NULL;
+	return dns_resolved;
+}
+
+char *uwsgi_resolve_ip(char *domain) {
+
+	if (dns_entries) {
+		return dns_cache_resolve(domain, 0);
+	}
+
+	struct hostent *he;
+
+	he = gethostbyname(domain);
+	if (!he || !*he->h_addr_list || (he->h_addrtype != AF_INET
+#ifdef AF_INET6
+					 && he->h_addrtype != AF_INET6
+#endif
+	    )) {
+		return NULL;
+	}
+
+	return inet_ntoa(*(struct in_addr *) he->h_addr_list[0]);
+}
+
+/*
+	resolve a "host:port" address now and keep refreshing it in background,
+	UNIX sockets and numeric addresses are ignored
+*/
+void uwsgi_dns_cache_pin(char *address) {
+	if (!dns_entries) return;
+	char *colon = strrchr(address, ':');
+	if (!colon || colon == address || address[0] == '[' || address[0] == '/' || address[0] == '@') return;
+	char *host = uwsgi_concat2n(address, colon - address, "", 0);
+	if (!dns_cache_resolve(host, 1)) {
+		uwsgi_log("[dns-cache] unable to resolve %s\n", host);
+	}
+	free(host);
+}
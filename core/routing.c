@@ -40,114 +40,265 @@ struct uwsgi_route_var *uwsgi_get_route_var(char *name, uint16_t name_len) {
 	return NULL;
 }
 
-struct uwsgi_buffer *uwsgi_routing_translate(struct wsgi_request *wsgi_req, struct uwsgi_route *ur, char *subject, uint16_t subject_len, char *data, size_t data_len) {
+/*
+	route templates
+
+	the strings of the actions (and of the conditions) are parsed once (for each core, at
+	the first usage) in a list of tokens (literals, $N captures, ${var} and ${func[arg]} vars),
+	expanded in a per-core scratch buffer owned by the template: no allocations at all
+	for the common case and no work at all for pure literals.
+
+	the cache is keyed by the string pointer, so it works for every field of the route
+	(and for pointers in the middle of them, like the two sides of a condition)
+*/
+
+#define UWSGI_ROUTE_TOKEN_LITERAL 0
+#define UWSGI_ROUTE_TOKEN_CAPTURE 1
+#define UWSGI_ROUTE_TOKEN_VAR 2
+#define UWSGI_ROUTE_TOKEN_FUNC 3
+
+struct uwsgi_route_token {
+	uint8_t type;
+	char *ptr;
+	size_t len;
+	// route var function (ptr/len is the argument)
+	struct uwsgi_route_var *urv;
+};
+
+struct uwsgi_route_template {
+	char *data;
+	size_t data_len;
+	struct uwsgi_route_token *tokens;
+	size_t tokens_cnt;
+	int literal;
+	// the scratch buffer (with the whole string for literals)
+	struct uwsgi_buffer *ub;
+	struct uwsgi_route_template *next;
+};
+
+static void route_template_add(struct uwsgi_route_template *urt, uint8_t type, char *ptr, size_t len, struct uwsgi_route_var *urv) {
+	// merge contiguous literals
+	if (type == UWSGI_ROUTE_TOKEN_LITERAL && urt->tokens_cnt > 0) {
+		struct uwsgi_route_token *last = &urt->tokens[urt->tokens_cnt-1];
+		if (last->type == UWSGI_ROUTE_TOKEN_LITERAL && last->ptr + last->len == ptr) {
+			last->len += len;
+			return;
+		}
+	}
+	struct uwsgi_route_token *tokens = realloc(urt->tokens, sizeof(struct uwsgi_route_token) * (urt->tokens_cnt + 1));
+	if (!tokens) {
+		uwsgi_error("route_template_add()/realloc()");
+		exit(1);
+	}
+	urt->tokens = tokens;
+	struct uwsgi_route_token *urtk = &urt->tokens[urt->tokens_cnt];
+	urtk->type = type;
+	urtk->ptr = ptr;
+	urtk->len = len;
+	urtk->urv = urv;
+	urt->tokens_cnt++;
+}
+
+static struct uwsgi_route_template *route_template_compile(char *data, size_t data_len) {
+	struct uwsgi_route_template *urt = uwsgi_calloc(sizeof(struct uwsgi_route_template));
+	urt->data = data;
+	urt->data_len = data_len;
+	urt->literal = 1;
+
+	size_t i = 0;
+	while(i < data_len) {
+		char *dollar = memchr(data + i, '$', data_len - i);
+		if (!dollar) {
+			route_template_add(urt, UWSGI_ROUTE_TOKEN_LITERAL, data + i, data_len - i, NULL);
+			break;
+		}
+		if (dollar > data + i) {
+			route_template_add(urt, UWSGI_ROUTE_TOKEN_LITERAL, data + i, dollar - (data + i), NULL);
+		}
+		i = dollar - data;
+		// a trailing $
+		if (i + 1 >= data_len) {
+			route_template_add(urt, UWSGI_ROUTE_TOKEN_LITERAL, dollar, 1, NULL);
+			break;
+		}
+		char next = data[i+1];
+		if (isdigit((int) next)) {
+			route_template_add(urt, UWSGI_ROUTE_TOKEN_CAPTURE, dollar + 1, 1, NULL);
+			urt->literal = 0;
+			i += 2;
+			continue;
+		}
+		if (next == '{') {
+			char *key = dollar + 2;
+			char *bracket = memchr(key, '}', data_len - (key - data));
+			// an unterminated var is a literal
+			if (!bracket) {
+				route_template_add(urt, UWSGI_ROUTE_TOKEN_LITERAL, dollar, data_len - i, NULL);
+				break;
+			}
+			size_t keylen = bracket - key;
+			char *square = memchr(key, '[', keylen);
+			struct uwsgi_route_var *urv = NULL;
+			if (square && keylen > 0 && key[keylen-1] == ']') {
+				urv = uwsgi_get_route_var(key, square - key);
+			}
+			if (urv) {
+				route_template_add(urt, UWSGI_ROUTE_TOKEN_FUNC, square + 1, keylen - (urv->name_len+2), urv);
+			}
+			else {
+				route_template_add(urt, UWSGI_ROUTE_TOKEN_VAR, key, keylen, NULL);
+			}
+			urt->literal = 0;
+			i = (bracket - data) + 1;
+			continue;
+		}
+		// $ followed by something else
+		route_template_add(urt, UWSGI_ROUTE_TOKEN_LITERAL, dollar, 2, NULL);
+		i += 2;
+	}
 
-	char *pass1 = data;
-	size_t pass1_len = data_len;
+	urt->ub = uwsgi_buffer_new(data_len + 1);
+	if (urt->literal) {
+		if (data_len > 0) {
+			if (uwsgi_buffer_append(urt->ub, data, data_len)) goto error;
+		}
+		if (uwsgi_buffer_append(urt->ub, "\0", 1)) goto error;
+		urt->ub->pos--;
+	}
+	return urt;
+error:
+	uwsgi_buffer_destroy(urt->ub);
+	if (urt->tokens) free(urt->tokens);
+	free(urt);
+	return NULL;
+}
+
+static void route_template_free(struct uwsgi_route_template *urt) {
+	uwsgi_buffer_destroy(urt->ub);
+	if (urt->tokens) free(urt->tokens);
+	free(urt);
+}
+
+static int route_template_render(struct wsgi_request *wsgi_req, struct uwsgi_route *ur, char *subject, uint16_t subject_len, struct uwsgi_route_template *urt, struct uwsgi_buffer *ub) {
 
-	if (ur->condition_ub[wsgi_req->async_id] && ur->ovn[wsgi_req->async_id] > 0) {
-		pass1 = uwsgi_regexp_apply_ovec(ur->condition_ub[wsgi_req->async_id]->buf, ur->condition_ub[wsgi_req->async_id]->pos, data, data_len, ur->ovector[wsgi_req->async_id], ur->ovn[wsgi_req->async_id]);
-		pass1_len = strlen(pass1);
+	// captures come from the last regexp condition or from the subject of the route
+	char *src = NULL;
+	int *ovector = NULL;
+	int ovn = 0;
+	if (ur->condition_ub && ur->condition_ub[wsgi_req->async_id] && ur->ovn[wsgi_req->async_id] > 0) {
+		src = ur->condition_ub[wsgi_req->async_id]->buf;
 	}
-	// cannot fail
 	else if (subject) {
-		pass1 = uwsgi_regexp_apply_ovec(subject, subject_len, data, data_len, ur->ovector[wsgi_req->async_id], ur->ovn[wsgi_req->async_id]);
-		pass1_len = strlen(pass1);
+		src = subject;
+	}
+	if (src && ur->ovector) {
+		ovector = ur->ovector[wsgi_req->async_id];
+		ovn = ur->ovn[wsgi_req->async_id];
 	}
 
-	struct uwsgi_buffer *ub = uwsgi_buffer_new(pass1_len);
 	size_t i;
-	int status = 0;
-	char *key = NULL;
-	size_t keylen = 0;
-	for(i=0;i<pass1_len;i++) {
-		switch(status) {
-			case 0:
-				if (pass1[i] == '$') {
-					status = 1;
-					break;
-				}
-				if (uwsgi_buffer_append(ub, pass1 + i, 1)) goto error;
+	for(i=0;i<urt->tokens_cnt;i++) {
+		struct uwsgi_route_token *urtk = &urt->tokens[i];
+		switch(urtk->type) {
+			case UWSGI_ROUTE_TOKEN_LITERAL:
+				if (uwsgi_buffer_append(ub, urtk->ptr, urtk->len)) return -1;
 				break;
-			case 1:
-				if (pass1[i] == '{') {
-					status = 2;
-					key = pass1+i+1;
-					keylen = 0;
+			case UWSGI_ROUTE_TOKEN_CAPTURE:
+				// no regexp context, leave it as is
+				if (!src) {
+					if (uwsgi_buffer_append(ub, urtk->ptr - 1, 2)) return -1;
 					break;
 				}
-				status = 0;
-				key = NULL;
-				keylen = 0;
-				if (uwsgi_buffer_append(ub, "$", 1)) goto error;
-				if (uwsgi_buffer_append(ub, pass1 + i, 1)) goto error;
+				int pos = urtk->ptr[0] - '0';
+				if (ovector && pos <= ovn && ovector[pos*2] >= 0) {
+					if (uwsgi_buffer_append(ub, src + ovector[pos*2], ovector[pos*2+1] - ovector[pos*2])) return -1;
+				}
 				break;
-			case 2:
-				if (pass1[i] == '}') {
-					uint16_t vallen = 0;
-					int need_free = 0;
-					char *value = NULL;
-					char *bracket = memchr(key, '[', keylen);
-					if (bracket && keylen > 0 && key[keylen-1] == ']') {
-						struct uwsgi_route_var *urv = uwsgi_get_route_var(key, bracket - key);
-						if (urv) {
-							need_free = urv->need_free;
-							value = urv->func(wsgi_req, bracket + 1, keylen - (urv->name_len+2), &vallen); 
-						}
-						else {
-							value = uwsgi_get_var(wsgi_req, key, keylen, &vallen);
-						}
-					}
-					else {
-						value = uwsgi_get_var(wsgi_req, key, keylen, &vallen);
-					}
-					if (value) {
-						if (uwsgi_buffer_append(ub, value, vallen)) {
-							if (need_free) {
-								free(value);
-							}
-							goto error;
-						}
-						if (need_free) {
-							free(value);
-						}
-					}
-                                        status = 0;
-					key = NULL;
-					keylen = 0;
-                                        break;
-                                }
-				keylen++;
+			case UWSGI_ROUTE_TOKEN_VAR:
+			case UWSGI_ROUTE_TOKEN_FUNC: {
+				uint16_t vallen = 0;
+				char *value = NULL;
+				int need_free = 0;
+				if (urtk->urv) {
+					need_free = urtk->urv->need_free;
+					value = urtk->urv->func(wsgi_req, urtk->ptr, urtk->len, &vallen);
+				}
+				else {
+					value = uwsgi_get_var(wsgi_req, urtk->ptr, urtk->len, &vallen);
+				}
+				if (value) {
+					int ret = uwsgi_buffer_append(ub, value, vallen);
+					if (need_free) free(value);
+					if (ret) return -1;
+				}
 				break;
+			}
 			default:
 				break;
 		}
 	}
 
-	// fix the buffer
-	if (status == 1) {
-		if (uwsgi_buffer_append(ub, "$", 1)) goto error;
-	}
-	else if (status == 2) {
-		if (uwsgi_buffer_append(ub, "${", 2)) goto error;
-		if (keylen > 0) {
-			if (uwsgi_buffer_append(ub, key, keylen)) goto error;
-		}
-	}
-
 	// add the final NULL byte (to simplify plugin work)
-	if (uwsgi_buffer_append(ub, "\0", 1)) goto error;
+	if (uwsgi_buffer_append(ub, "\0", 1)) return -1;
 	// .. but came back of 1 position to avoid accounting it
 	ub->pos--;
+	return 0;
+}
+
+static struct uwsgi_route_template *route_template_get(struct uwsgi_route *ur, int core, char *data, size_t data_len) {
+	struct uwsgi_route_template *urt = ur->templates[core];
+	while(urt) {
+		if (urt->data == data && urt->data_len == data_len) return urt;
+		urt = urt->next;
+	}
+	urt = route_template_compile(data, data_len);
+	if (!urt) return NULL;
+	urt->next = ur->templates[core];
+	ur->templates[core] = urt;
+	return urt;
+}
+
+/*
+	expand a string in the per-core scratch buffer of its template:
+	the buffer is owned by the route (do not destroy it) and it is valid until
+	the next expansion of the same string on the same core
+*/
+struct uwsgi_buffer *uwsgi_routing_expand(struct wsgi_request *wsgi_req, struct uwsgi_route *ur, char *subject, uint16_t subject_len, char *data, size_t data_len) {
+	// virtual routes have no templates
+	if (!ur->templates) return NULL;
+	struct uwsgi_route_template *urt = route_template_get(ur, wsgi_req->async_id, data, data_len);
+	if (!urt) return NULL;
+	if (urt->literal) {
+		// the previous user could have appended something
+		urt->ub->pos = urt->data_len;
+		urt->ub->buf[urt->ub->pos] = 0;
+		return urt->ub;
+	}
+	uwsgi_buffer_reset(urt->ub);
+	if (route_template_render(wsgi_req, ur, subject, subject_len, urt, urt->ub)) return NULL;
+	return urt->ub;
+}
+
+// this returns a new buffer (to be destroyed by the caller)
+struct uwsgi_buffer *uwsgi_routing_translate(struct wsgi_request *wsgi_req, struct uwsgi_route *ur, char *subject, uint16_t subject_len, char *data, size_t data_len) {
 
-	if (pass1 != data) {
-		free(pass1);
+	struct uwsgi_route_template *urt = NULL;
+	if (ur->templates) {
+		urt = route_template_get(ur, wsgi_req->async_id, data, data_len);
+		if (!urt) return NULL;
+	}
+	else {
+		urt = route_template_compile(data, data_len);
+		if (!urt) return NULL;
 	}
-	return ub;
 
-error:
-	uwsgi_buffer_destroy(ub);
-	return NULL;
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(data_len + 1);
+	if (route_template_render(wsgi_req, ur, subject, subject_len, urt, ub)) {
+		uwsgi_buffer_destroy(ub);
+		ub = NULL;
+	}
+	if (!ur->templates) route_template_free(urt);
+	return ub;
 }
 
 static void uwsgi_routing_reset_memory(struct wsgi_request *wsgi_req, struct uwsgi_route *routes) {
@@ -166,6 +317,42 @@ static void uwsgi_routing_reset_memory(struct wsgi_request *wsgi_req, struct uws
 
 }
 
+/*
+	regexp results only depend on the pattern and on the subject, so (when --route-memo is set)
+	they are stored in a per-core direct-mapped table and replayed without calling pcre.
+	Subjects longer than UWSGI_ROUTE_MEMO_SUBJECT and patterns with too many groups are never memoized.
+*/
+static int uwsgi_route_memo_match(struct wsgi_request *wsgi_req, pcre *pattern, pcre_extra *pattern_extra, char *subject, uint16_t subject_len, int *ovector, int ovn) {
+	int ovec_size = ovn > 0 ? (ovn + 1) * 3 : 0;
+	if (!uwsgi.route_memo || subject_len > UWSGI_ROUTE_MEMO_SUBJECT || ovec_size > UWSGI_ROUTE_MEMO_OVEC) {
+		return uwsgi_regexp_match_ovec(pattern, pattern_extra, subject, subject_len, ovector, ovn);
+	}
+
+	if (!uwsgi.route_memo_tables[wsgi_req->async_id]) {
+		uwsgi.route_memo_tables[wsgi_req->async_id] = uwsgi_calloc(sizeof(struct uwsgi_route_memo) * uwsgi.route_memo);
+	}
+
+	uint32_t hash = djb33x_hash(subject, subject_len) ^ (uint32_t) (((uintptr_t) pattern >> 4) * 2654435761UL);
+	struct uwsgi_route_memo *urm = &uwsgi.route_memo_tables[wsgi_req->async_id][hash & (uwsgi.route_memo - 1)];
+
+	if (urm->pattern == pattern && urm->hash == hash && urm->subject_len == subject_len && !memcmp(urm->subject, subject, subject_len)) {
+		if (ovec_size) memcpy(ovector, urm->ovector, sizeof(int) * ovec_size);
+		return urm->n;
+	}
+
+	int n = uwsgi_regexp_match_ovec(pattern, pattern_extra, subject, subject_len, ovector, ovn);
+	// errors (other than a missing match) are not cached
+	if (n < PCRE_ERROR_NOMATCH) return n;
+
+	urm->pattern = pattern;
+	urm->hash = hash;
+	urm->subject_len = subject_len;
+	urm->n = n;
+	memcpy(urm->subject, subject, subject_len);
+	if (ovec_size) memcpy(urm->ovector, ovector, sizeof(int) * ovec_size);
+	return n;
+}
+
 int uwsgi_apply_routes_do(struct uwsgi_route *routes, struct wsgi_request *wsgi_req, char *subject, uint16_t subject_len) {
 
 	int n = -1;
@@ -199,6 +386,20 @@ int uwsgi_apply_routes_do(struct uwsgi_route *routes, struct wsgi_request *wsgi_
 
 		*r_goto = 0;
 
+		// first check if any route of the group could match (if not, skip all of them)
+		if (routes->group_len > 0) {
+			char **subject2 = (char **) (((char *) (wsgi_req)) + routes->subject);
+			uint16_t *subject_len2 = (uint16_t *) (((char *) (wsgi_req)) + routes->subject_len);
+			if (uwsgi_route_memo_match(wsgi_req, routes->group_pattern, routes->group_pattern_extra, subject ? subject : *subject2, subject ? subject_len : *subject_len2, NULL, 0) == PCRE_ERROR_NOMATCH) {
+				uint32_t i;
+				for(i=1;i<routes->group_len;i++) {
+					routes = routes->next;
+					*r_pc = *r_pc+1;
+				}
+				goto next;
+			}
+		}
+
 		if (!routes->if_func) {
 			// could be a "run"
 			if (!routes->subject) {
@@ -211,7 +412,7 @@ int uwsgi_apply_routes_do(struct uwsgi_route *routes, struct wsgi_request *wsgi_
 				subject = *subject2 ;
 				subject_len = *subject_len2;
 			}
-			n = uwsgi_regexp_match_ovec(routes->pattern, routes->pattern_extra, subject, subject_len, routes->ovector[wsgi_req->async_id], routes->ovn[wsgi_req->async_id]);
+			n = uwsgi_route_memo_match(wsgi_req, routes->pattern, routes->pattern_extra, subject, subject_len, routes->ovector[wsgi_req->async_id], routes->ovn[wsgi_req->async_id]);
 		}
 		else {
 			int ret = routes->if_func(wsgi_req, routes);
@@ -239,6 +440,7 @@ int uwsgi_apply_routes_do(struct uwsgi_route *routes, struct wsgi_request *wsgi_
 
 run:
 		if (n >= 0) {
+			uwsgi_probe4(route_match, uwsgi.mywid, wsgi_req->async_id, routes->orig_route, routes->subject_str);
 			wsgi_req->is_routing = 1;
 			int ret = routes->func(wsgi_req, routes);
 			uwsgi_routing_reset_memory(wsgi_req, routes);
@@ -482,7 +684,9 @@ done:
 
 	*colon = 0;
 
-	struct uwsgi_router *r = uwsgi.routers;
+	struct uwsgi_router *r;
+retry:
+	r = uwsgi.routers;
 	while (r) {
 		if (!strcmp(r->name, command)) {
 			if (r->func(ur, colon + 1) == 0) {
@@ -493,16 +697,98 @@ done:
 		r = r->next;
 	}
 
+	if (!r && uwsgi_lazy_plugin_load(command))
+		goto retry;
+
 	uwsgi_log("unable to register route \"%s\"\n", value);
 	exit(1);
 }
 
+/*
+	route groups
+
+	consecutive regexp routes on the same subject are compiled (at startup) in a single
+	alternation, a request not matching it skips the whole group in one pass.
+	When it matches the group is walked as usual, so the first-match order, the captures,
+	and goto/labels (a label always closes a group) are preserved.
+
+	patterns whose meaning could change when embedded in an alternation
+	(backreferences, recursions, options, verbs, quoting) are never grouped.
+*/
+
+#define UWSGI_ROUTE_GROUP_MIN 4
+
+static int uwsgi_route_condition_regexp(struct wsgi_request *, struct uwsgi_route *);
+
+static int uwsgi_route_groupable(struct uwsgi_route *ur) {
+	if (!ur->pattern || ur->if_func || ur->label) return 0;
+	char *p = ur->orig_route;
+	if (!strncmp(p, "(*", 2)) return 0;
+	while(*p) {
+		if (*p == '\\') {
+			p++;
+			if (isdigit((int) *p) || *p == 'g' || *p == 'k' || *p == 'Q' || *p == 'E') return 0;
+			if (!*p) return 0;
+		}
+		else if (*p == '(' && *(p+1) == '?') {
+			if (strncmp(p, "(?:", 3) && strncmp(p, "(?=", 3) && strncmp(p, "(?!", 3) &&
+				strncmp(p, "(?<=", 4) && strncmp(p, "(?<!", 4)) return 0;
+		}
+		p++;
+	}
+	return 1;
+}
+
+static void uwsgi_fixup_route_groups(struct uwsgi_route *ur) {
+	while(ur) {
+		if (!uwsgi_route_groupable(ur)) {
+			ur = ur->next;
+			continue;
+		}
+		uint32_t n = 1;
+		struct uwsgi_route *last = ur->next;
+		while(last && uwsgi_route_groupable(last) && last->subject == ur->subject && last->subject_len == ur->subject_len) {
+			n++;
+			last = last->next;
+		}
+		if (n >= UWSGI_ROUTE_GROUP_MIN) {
+			struct uwsgi_buffer *ub = uwsgi_buffer_new(uwsgi.page_size);
+			struct uwsgi_route *r = ur;
+			while(r != last) {
+				if (r != ur) {
+					if (uwsgi_buffer_append(ub, "|", 1)) goto end;
+				}
+				if (uwsgi_buffer_append(ub, "(?:", 3)) goto end;
+				if (uwsgi_buffer_append(ub, r->orig_route, strlen(r->orig_route))) goto end;
+				if (uwsgi_buffer_append(ub, ")", 1)) goto end;
+				r = r->next;
+			}
+			if (uwsgi_buffer_append(ub, "\0", 1)) goto end;
+			if (!uwsgi_regexp_build(ub->buf, &ur->group_pattern, &ur->group_pattern_extra)) {
+				ur->group_len = n;
+			}
+end:
+			uwsgi_buffer_destroy(ub);
+		}
+		ur = last;
+	}
+}
+
 void uwsgi_fixup_routes(struct uwsgi_route *ur) {
+	struct uwsgi_route *routes = ur;
+	if (uwsgi.route_memo && !uwsgi.route_memo_tables) {
+		// round to a power of two (the slot is computed with a mask)
+		uint64_t entries = 1;
+		while(entries < uwsgi.route_memo) entries <<= 1;
+		uwsgi.route_memo = entries;
+		uwsgi.route_memo_tables = uwsgi_calloc(sizeof(struct uwsgi_route_memo *) * uwsgi.cores);
+	}
 	while(ur) {
 		// prepare the main pointers
 		ur->ovn = uwsgi_calloc(sizeof(int) * uwsgi.cores);
 		ur->ovector = uwsgi_calloc(sizeof(int *) * uwsgi.cores);
 		ur->condition_ub = uwsgi_calloc( sizeof(struct uwsgi_buffer *) * uwsgi.cores);
+		ur->templates = uwsgi_calloc(sizeof(struct uwsgi_route_template *) * uwsgi.cores);
 
 		// fill them if needed... (this is an optimization for route with a static subject)
 		if (ur->subject && ur->subject_len) {
@@ -518,8 +804,20 @@ void uwsgi_fixup_routes(struct uwsgi_route *ur) {
                 		}
 			}
 		}
+		// the pattern of regexp conditions is static too (only the subject is translated)
+		else if (ur->if_func == uwsgi_route_condition_regexp) {
+			char *semicolon = memchr(ur->subject_str, ';', ur->subject_str_len);
+			if (semicolon) {
+				char *re = uwsgi_concat2n(semicolon+1, ur->subject_str_len - ((semicolon+1) - ur->subject_str), "", 0);
+				if (uwsgi_regexp_build(re, &ur->pattern, &ur->pattern_extra)) {
+					exit(1);
+				}
+				free(re);
+			}
+		}
 		ur = ur->next;
         }
+	uwsgi_fixup_route_groups(routes);
 }
 
 int uwsgi_route_api_func(struct wsgi_request *wsgi_req, char *router, char *args) {
@@ -616,6 +914,81 @@ static int uwsgi_router_return(struct uwsgi_route *ur, char *arg)
 	return 0;
 }
 
+// ratelimit router
+static int uwsgi_router_ratelimit_func(struct wsgi_request *wsgi_req, struct uwsgi_route *ur) {
+	char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
+	uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
+
+	// limiters are created after the routes
+	if (!ur->data3) {
+		ur->data3 = uwsgi_ratelimit_get(ur->data);
+		if (!ur->data3) {
+			uwsgi_log("[uwsgi-route] unknown rate limiter \"%s\"\n", (char *) ur->data);
+			return UWSGI_ROUTE_BREAK;
+		}
+	}
+
+	struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, *subject, *subject_len, ur->data2, ur->data2_len);
+	if (!ub) return UWSGI_ROUTE_BREAK;
+
+	uint64_t retry_after = 0;
+	if (!uwsgi_ratelimit_acquire((struct uwsgi_ratelimit *) ur->data3, ub->buf, ub->pos, &retry_after)) {
+		return UWSGI_ROUTE_NEXT;
+	}
+
+	char status[4];
+	uwsgi_num2str2n(ur->custom, status, 4);
+	uint16_t status_msg_len = 0;
+	const char *status_msg = uwsgi_http_status_msg(status, &status_msg_len);
+	if (!status_msg) {
+		status_msg = "Too Many Requests";
+		status_msg_len = 17;
+	}
+	char *buf = uwsgi_concat3n(status, 3, " ", 1, (char *) status_msg, status_msg_len);
+	if (uwsgi_response_prepare_headers(wsgi_req, buf, 4 + status_msg_len)) goto end;
+	char seconds[sizeof(UMAX64_STR)+1];
+	int seconds_len = uwsgi_long2str2n((retry_after / 1000000) + 1, seconds, sizeof(UMAX64_STR)+1);
+	if (uwsgi_response_add_header(wsgi_req, "Retry-After", 11, seconds, seconds_len)) goto end;
+	if (uwsgi_response_add_content_type(wsgi_req, "text/plain", 10)) goto end;
+	if (uwsgi_response_add_content_length(wsgi_req, status_msg_len)) goto end;
+	uwsgi_response_write_body_do(wsgi_req, (char *) status_msg, status_msg_len);
+end:
+	free(buf);
+	return UWSGI_ROUTE_BREAK;
+}
+
+static int uwsgi_router_ratelimit(struct uwsgi_route *ur, char *args) {
+	char *name = NULL;
+	char *key = NULL;
+	char *status = NULL;
+
+	ur->func = uwsgi_router_ratelimit_func;
+	if (uwsgi_kvlist_parse(args, strlen(args), ',', '=',
+		"name", &name,
+		"key", &key,
+		"status", &status,
+		NULL)) {
+		uwsgi_log("invalid ratelimit route syntax: %s\n", args);
+		return -1;
+	}
+
+	if (!name) {
+		uwsgi_log("invalid ratelimit route syntax, you need to specify the limiter name\n");
+		return -1;
+	}
+
+	ur->data = name;
+	ur->data_len = strlen(name);
+	ur->data2 = key ? key : "${REMOTE_ADDR}";
+	ur->data2_len = strlen(ur->data2);
+	ur->custom = status ? atoi(status) : 429;
+	if (ur->custom < 100 || ur->custom > 999) {
+		uwsgi_log("invalid ratelimit route status: %s\n", status);
+		return -1;
+	}
+	return 0;
+}
+
 // simple math router
 static int uwsgi_router_simple_math_func(struct wsgi_request *wsgi_req, struct uwsgi_route *ur) {
 	char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
@@ -629,10 +1002,9 @@ static int uwsgi_router_simple_math_func(struct wsgi_request *wsgi_req, struct u
 	int64_t value = 1;
 
 	if (ur->data2_len) {
-        	struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data2, ur->data2_len);
+        	struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, *subject, *subject_len, ur->data2, ur->data2_len);
         	if (!ub) return UWSGI_ROUTE_BREAK;
 		value = uwsgi_str_num(ub->buf, ub->pos);
-		uwsgi_buffer_destroy(ub);
 	}
 
 	char out[sizeof(UMAX64_STR)+1];
@@ -783,11 +1155,10 @@ static int uwsgi_router_log_func(struct wsgi_request *wsgi_req, struct uwsgi_rou
 	char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-	struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
+	struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
 	if (!ub) return UWSGI_ROUTE_BREAK;
 
 	uwsgi_log("%.*s\n", ub->pos, ub->buf);
-	uwsgi_buffer_destroy(ub);
 	return UWSGI_ROUTE_NEXT;	
 }
 
@@ -814,10 +1185,9 @@ static int uwsgi_router_logvar_func(struct wsgi_request *wsgi_req, struct uwsgi_
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-	struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data2, ur->data2_len);
+	struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, *subject, *subject_len, ur->data2, ur->data2_len);
 	if (!ub) return UWSGI_ROUTE_BREAK;
 	uwsgi_logvar_add(wsgi_req, ur->data, ur->data_len, ub->buf, ub->pos);
-	uwsgi_buffer_destroy(ub);
 
         return UWSGI_ROUTE_NEXT;
 }
@@ -844,7 +1214,7 @@ static int uwsgi_router_goto_func(struct wsgi_request *wsgi_req, struct uwsgi_ro
 	char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-	struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
+	struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
         if (!ub) return UWSGI_ROUTE_BREAK;
 	uint32_t *r_goto = &wsgi_req->route_goto;
 	uint32_t *r_pc = &wsgi_req->route_pc;
@@ -879,7 +1249,6 @@ next:
 	*r_goto = ur->custom;
 	
 found:
-	uwsgi_buffer_destroy(ub);
 	if (*r_goto <= *r_pc) {
 		*r_goto = 0;
 		uwsgi_log("[uwsgi-route] ERROR \"goto\" instruction can only jump forward (check your label !!!)\n");
@@ -902,14 +1271,12 @@ static int uwsgi_router_addvar_func(struct wsgi_request *wsgi_req, struct uwsgi_
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-	struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data2, ur->data2_len);
+	struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, *subject, *subject_len, ur->data2, ur->data2_len);
         if (!ub) return UWSGI_ROUTE_BREAK;
 
 	if (!uwsgi_req_append(wsgi_req, ur->data, ur->data_len, ub->buf, ub->pos)) {
-		uwsgi_buffer_destroy(ub);
         	return UWSGI_ROUTE_BREAK;
 	}
-	uwsgi_buffer_destroy(ub);
         return UWSGI_ROUTE_NEXT;
 }
 
@@ -935,10 +1302,9 @@ static int uwsgi_router_addheader_func(struct wsgi_request *wsgi_req, struct uws
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-	struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
+	struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
         if (!ub) return UWSGI_ROUTE_BREAK;
 	uwsgi_additional_header_add(wsgi_req, ub->buf, ub->pos);
-	uwsgi_buffer_destroy(ub);
         return UWSGI_ROUTE_NEXT;
 }
 
@@ -950,16 +1316,42 @@ static int uwsgi_router_addheader(struct uwsgi_route *ur, char *arg) {
         return 0;
 }
 
+// headertemplate route
+static int uwsgi_router_headertemplate_func(struct wsgi_request *wsgi_req, struct uwsgi_route *ur) {
+	if (wsgi_req->header_templates_cnt >= UWSGI_MAX_HEADER_TEMPLATES) {
+		uwsgi_log("[uwsgi-route] too many header templates for the request\n");
+		return UWSGI_ROUTE_NEXT;
+	}
+	// templates are built after the routes, resolve it on the first run
+	struct uwsgi_header_template *uht = (struct uwsgi_header_template *) ur->data2;
+	if (!uht) {
+		uht = uwsgi_header_template_get(ur->data, ur->data_len);
+		if (!uht) {
+			uwsgi_log("[uwsgi-route] unknown header template \"%.*s\"\n", (int) ur->data_len, ur->data);
+			return UWSGI_ROUTE_NEXT;
+		}
+		ur->data2 = uht;
+	}
+	wsgi_req->header_templates[wsgi_req->header_templates_cnt++] = uht;
+        return UWSGI_ROUTE_NEXT;
+}
+
+static int uwsgi_router_headertemplate(struct uwsgi_route *ur, char *arg) {
+        ur->func = uwsgi_router_headertemplate_func;
+        ur->data = arg;
+        ur->data_len = strlen(arg);
+        return 0;
+}
+
 // remheader route
 static int uwsgi_router_remheader_func(struct wsgi_request *wsgi_req, struct uwsgi_route *ur) {
 
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-	struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
+	struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
         if (!ub) return UWSGI_ROUTE_BREAK;
         uwsgi_remove_header(wsgi_req, ub->buf, ub->pos);
-	uwsgi_buffer_destroy(ub);
         return UWSGI_ROUTE_NEXT;
 }
 
@@ -977,15 +1369,13 @@ static int uwsgi_router_clearheaders_func(struct wsgi_request *wsgi_req, struct
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
         if (!ub) return UWSGI_ROUTE_BREAK;
 
 	if (uwsgi_response_prepare_headers(wsgi_req, ub->buf, ub->pos)) {
-        	uwsgi_buffer_destroy(ub);
         	return UWSGI_ROUTE_BREAK;
 	}
 	
-        uwsgi_buffer_destroy(ub);
         return UWSGI_ROUTE_NEXT;
 }
 
@@ -1028,14 +1418,12 @@ static int uwsgi_router_chdir_func(struct wsgi_request *wsgi_req, struct uwsgi_r
 	char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
 	if (!ub) return UWSGI_ROUTE_BREAK;
 	if (chdir(ub->buf)) {
 		uwsgi_req_error("uwsgi_router_chdir_func()/chdir()");
-		uwsgi_buffer_destroy(ub);
 		return UWSGI_ROUTE_BREAK;
 	}
-	uwsgi_buffer_destroy(ub);
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_chdir(struct uwsgi_route *ur, char *arg) {
@@ -1050,16 +1438,14 @@ static int uwsgi_router_setapp_func(struct wsgi_request *wsgi_req, struct uwsgi_
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
         if (!ub) return UWSGI_ROUTE_BREAK;
 	char *ptr = uwsgi_req_append(wsgi_req, "UWSGI_APPID", 11, ub->buf, ub->pos);
 	if (!ptr) {
-                uwsgi_buffer_destroy(ub);
                 return UWSGI_ROUTE_BREAK;
         }
 	wsgi_req->appid = ptr;
 	wsgi_req->appid_len = ub->pos;
-        uwsgi_buffer_destroy(ub);
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_setapp(struct uwsgi_route *ur, char *arg) {
@@ -1074,16 +1460,14 @@ static int uwsgi_router_setscriptname_func(struct wsgi_request *wsgi_req, struct
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
         if (!ub) return UWSGI_ROUTE_BREAK;
         char *ptr = uwsgi_req_append(wsgi_req, "SCRIPT_NAME", 11, ub->buf, ub->pos);
         if (!ptr) {
-                uwsgi_buffer_destroy(ub);
                 return UWSGI_ROUTE_BREAK;
         }
         wsgi_req->script_name = ptr;
         wsgi_req->script_name_len = ub->pos;
-        uwsgi_buffer_destroy(ub);
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_setscriptname(struct uwsgi_route *ur, char *arg) {
@@ -1098,16 +1482,14 @@ static int uwsgi_router_setmethod_func(struct wsgi_request *wsgi_req, struct uws
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
         if (!ub) return UWSGI_ROUTE_BREAK;
         char *ptr = uwsgi_req_append(wsgi_req, "REQUEST_METHOD", 14, ub->buf, ub->pos);
         if (!ptr) {
-                uwsgi_buffer_destroy(ub);
                 return UWSGI_ROUTE_BREAK;
         }
         wsgi_req->method = ptr;
         wsgi_req->method_len = ub->pos;
-        uwsgi_buffer_destroy(ub);
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_setmethod(struct uwsgi_route *ur, char *arg) {
@@ -1122,16 +1504,14 @@ static int uwsgi_router_seturi_func(struct wsgi_request *wsgi_req, struct uwsgi_
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
         if (!ub) return UWSGI_ROUTE_BREAK;
         char *ptr = uwsgi_req_append(wsgi_req, "REQUEST_URI", 11, ub->buf, ub->pos);
         if (!ptr) {
-                uwsgi_buffer_destroy(ub);
                 return UWSGI_ROUTE_BREAK;
         }
         wsgi_req->uri = ptr;
         wsgi_req->uri_len = ub->pos;
-        uwsgi_buffer_destroy(ub);
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_seturi(struct uwsgi_route *ur, char *arg) {
@@ -1146,16 +1526,14 @@ static int uwsgi_router_setremoteaddr_func(struct wsgi_request *wsgi_req, struct
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
         if (!ub) return UWSGI_ROUTE_BREAK;
         char *ptr = uwsgi_req_append(wsgi_req, "REMOTE_ADDR", 11, ub->buf, ub->pos);
         if (!ptr) {
-                uwsgi_buffer_destroy(ub);
                 return UWSGI_ROUTE_BREAK;
         }
         wsgi_req->remote_addr = ptr;
         wsgi_req->remote_addr_len = ub->pos;
-        uwsgi_buffer_destroy(ub);
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_setremoteaddr(struct uwsgi_route *ur, char *arg) {
@@ -1171,16 +1549,14 @@ static int uwsgi_router_setdocroot_func(struct wsgi_request *wsgi_req, struct uw
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
         if (!ub) return UWSGI_ROUTE_BREAK;
         char *ptr = uwsgi_req_append(wsgi_req, "DOCUMENT_ROOT", 13, ub->buf, ub->pos);
         if (!ptr) {
-                uwsgi_buffer_destroy(ub);
                 return UWSGI_ROUTE_BREAK;
         }
         wsgi_req->document_root = ptr;
         wsgi_req->document_root_len = ub->pos;
-        uwsgi_buffer_destroy(ub);
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_setdocroot(struct uwsgi_route *ur, char *arg) {
@@ -1196,16 +1572,14 @@ static int uwsgi_router_setpathinfo_func(struct wsgi_request *wsgi_req, struct u
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
         if (!ub) return UWSGI_ROUTE_BREAK;
         char *ptr = uwsgi_req_append(wsgi_req, "PATH_INFO", 9, ub->buf, ub->pos);
         if (!ptr) {
-                uwsgi_buffer_destroy(ub);
                 return UWSGI_ROUTE_BREAK;
         }
         wsgi_req->path_info = ptr;
         wsgi_req->path_info_len = ub->pos;
-        uwsgi_buffer_destroy(ub);
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_setpathinfo(struct uwsgi_route *ur, char *arg) {
@@ -1241,16 +1615,14 @@ static int uwsgi_router_setscheme_func(struct wsgi_request *wsgi_req, struct uws
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
         if (!ub) return UWSGI_ROUTE_BREAK;
         char *ptr = uwsgi_req_append(wsgi_req, "UWSGI_SCHEME", 12, ub->buf, ub->pos);
         if (!ptr) {
-                uwsgi_buffer_destroy(ub);
                 return UWSGI_ROUTE_BREAK;
         }
         wsgi_req->scheme = ptr;
         wsgi_req->scheme_len = ub->pos;
-        uwsgi_buffer_destroy(ub);
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_setscheme(struct uwsgi_route *ur, char *arg) {
@@ -1286,7 +1658,7 @@ static int uwsgi_router_setuser_func(struct wsgi_request *wsgi_req, struct uwsgi
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
         if (!ub) return UWSGI_ROUTE_BREAK;
 	uint16_t user_len = ub->pos;
 	// stop at the first colon (useful for various tricks)
@@ -1296,12 +1668,10 @@ static int uwsgi_router_setuser_func(struct wsgi_request *wsgi_req, struct uwsgi
 	}
         char *ptr = uwsgi_req_append(wsgi_req, "REMOTE_USER", 11, ub->buf, user_len);
         if (!ptr) {
-                uwsgi_buffer_destroy(ub);
                 return UWSGI_ROUTE_BREAK;
         }
         wsgi_req->remote_user = ptr;
         wsgi_req->remote_user_len = ub->pos;
-        uwsgi_buffer_destroy(ub);
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_setuser(struct uwsgi_route *ur, char *arg) {
@@ -1317,16 +1687,14 @@ static int uwsgi_router_sethome_func(struct wsgi_request *wsgi_req, struct uwsgi
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
         if (!ub) return UWSGI_ROUTE_BREAK;
         char *ptr = uwsgi_req_append(wsgi_req, "UWSGI_HOME", 10, ub->buf, ub->pos);
         if (!ptr) {
-                uwsgi_buffer_destroy(ub);
                 return UWSGI_ROUTE_BREAK;
         }
         wsgi_req->home = ptr;
         wsgi_req->home_len = ub->pos;
-        uwsgi_buffer_destroy(ub);
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_sethome(struct uwsgi_route *ur, char *arg) {
@@ -1341,17 +1709,15 @@ static int uwsgi_router_setfile_func(struct wsgi_request *wsgi_req, struct uwsgi
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
         if (!ub) return UWSGI_ROUTE_BREAK;
         char *ptr = uwsgi_req_append(wsgi_req, "UWSGI_HOME", 10, ub->buf, ub->pos);
         if (!ptr) {
-                uwsgi_buffer_destroy(ub);
                 return UWSGI_ROUTE_BREAK;
         }
         wsgi_req->file = ptr;
         wsgi_req->file_len = ub->pos;
 	wsgi_req->dynamic = 1;
-        uwsgi_buffer_destroy(ub);
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_setfile(struct uwsgi_route *ur, char *arg) {
@@ -1367,10 +1733,9 @@ static int uwsgi_router_setprocname_func(struct wsgi_request *wsgi_req, struct u
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
         if (!ub) return UWSGI_ROUTE_BREAK;
 	uwsgi_set_processname(ub->buf);
-        uwsgi_buffer_destroy(ub);
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_setprocname(struct uwsgi_route *ur, char *arg) {
@@ -1385,17 +1750,14 @@ static int uwsgi_router_alarm_func(struct wsgi_request *wsgi_req, struct uwsgi_r
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub_alarm = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
+        struct uwsgi_buffer *ub_alarm = uwsgi_routing_expand(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
         if (!ub_alarm) return UWSGI_ROUTE_BREAK;
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data2, ur->data2_len);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, *subject, *subject_len, ur->data2, ur->data2_len);
         if (!ub) {
-		uwsgi_buffer_destroy(ub_alarm);
 		return UWSGI_ROUTE_BREAK;
 	}
 	uwsgi_alarm_trigger(ub_alarm->buf, ub->buf, ub->pos);	
-        uwsgi_buffer_destroy(ub_alarm);
-        uwsgi_buffer_destroy(ub);
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_alarm(struct uwsgi_route *ur, char *arg) {
@@ -1419,18 +1781,16 @@ static int uwsgi_router_send_func(struct wsgi_request *wsgi_req, struct uwsgi_ro
 	char **subject = (char **) (((char *)(wsgi_req))+route->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+route->subject_len);
 
-	struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, route, *subject, *subject_len, route->data, route->data_len);
+	struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, route, *subject, *subject_len, route->data, route->data_len);
         if (!ub) {
                 return UWSGI_ROUTE_BREAK;
         }
 	if (route->custom) {
 		if (uwsgi_buffer_append(ub, "\r\n", 2)) {
-			uwsgi_buffer_destroy(ub);
 			return UWSGI_ROUTE_BREAK;
 		}
 	}
 	uwsgi_response_write_body_do(wsgi_req, ub->buf, ub->pos);
-	uwsgi_buffer_destroy(ub);
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_send(struct uwsgi_route *ur, char *arg) {
@@ -1446,24 +1806,20 @@ static int uwsgi_router_send_crnl(struct uwsgi_route *ur, char *arg) {
 }
 
 static int uwsgi_route_condition_exists(struct wsgi_request *wsgi_req, struct uwsgi_route *ur) {
-	struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len);
+	struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len);
 	if (!ub) return -1;
 	if (uwsgi_file_exists(ub->buf)) {
-		uwsgi_buffer_destroy(ub);
 		return 1;
 	}
-	uwsgi_buffer_destroy(ub);
 	return 0;
 }
 
 static int uwsgi_route_condition_isfile(struct wsgi_request *wsgi_req, struct uwsgi_route *ur) {
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len);
         if (!ub) return -1;
         if (uwsgi_is_file(ub->buf)) {
-                uwsgi_buffer_destroy(ub);
                 return 1;
         }
-        uwsgi_buffer_destroy(ub);
         return 0;
 }
 
@@ -1474,14 +1830,17 @@ static int uwsgi_route_condition_regexp(struct wsgi_request *wsgi_req, struct uw
         ur->condition_ub[wsgi_req->async_id] = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, ur->subject_str, semicolon - ur->subject_str);
         if (!ur->condition_ub[wsgi_req->async_id]) return -1;
 
-	pcre *pattern;
-	pcre_extra *pattern_extra;
-	char *re = uwsgi_concat2n(semicolon+1, ur->subject_str_len - ((semicolon+1) - ur->subject_str), "", 0);
-	if (uwsgi_regexp_build(re, &pattern, &pattern_extra)) {
+	// precompiled by uwsgi_fixup_routes() (virtual routes compile it on every call)
+	pcre *pattern = ur->pattern;
+	pcre_extra *pattern_extra = ur->pattern_extra;
+	if (!pattern) {
+		char *re = uwsgi_concat2n(semicolon+1, ur->subject_str_len - ((semicolon+1) - ur->subject_str), "", 0);
+		if (uwsgi_regexp_build(re, &pattern, &pattern_extra)) {
+			free(re);
+			return -1;
+		}
 		free(re);
-		return -1;
 	}
-	free(re);
 
 	// a condition has no initialized vectors, let's create them
 	ur->ovn[wsgi_req->async_id] = uwsgi_regexp_ovector(pattern, pattern_extra);
@@ -1489,36 +1848,31 @@ static int uwsgi_route_condition_regexp(struct wsgi_request *wsgi_req, struct uw
         	ur->ovector[wsgi_req->async_id] = uwsgi_calloc(sizeof(int) * (3 * (ur->ovn[wsgi_req->async_id] + 1)));
         }
 
+	int ret = 0;
 	if (uwsgi_regexp_match_ovec(pattern, pattern_extra, ur->condition_ub[wsgi_req->async_id]->buf, ur->condition_ub[wsgi_req->async_id]->pos, ur->ovector[wsgi_req->async_id], ur->ovn[wsgi_req->async_id] ) >= 0) {
+		ret = 1;
+	}
+
+	if (pattern != ur->pattern) {
 		pcre_free(pattern);
 #ifdef PCRE_STUDY_JIT_COMPILE
 		pcre_free_study(pattern_extra);
 #else
 		pcre_free(pattern_extra);
 #endif
-		return 1;
 	}
-
-	pcre_free(pattern);
-#ifdef PCRE_STUDY_JIT_COMPILE
-	pcre_free_study(pattern_extra);
-#else
-	pcre_free(pattern_extra);
-#endif
-        return 0;
+        return ret;
 }
 
 static int uwsgi_route_condition_empty(struct wsgi_request *wsgi_req, struct uwsgi_route *ur) {
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len);
         if (!ub) return -1;
 
 	if (ub->pos == 0) {
-        	uwsgi_buffer_destroy(ub);
         	return 1;
 	}
 
-        uwsgi_buffer_destroy(ub);
         return 0;
 }
 
@@ -1527,22 +1881,17 @@ static int uwsgi_route_condition_equal(struct wsgi_request *wsgi_req, struct uws
 	char *semicolon = memchr(ur->subject_str, ';', ur->subject_str_len);
 	if (!semicolon) return 0;
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, ur->subject_str, semicolon - ur->subject_str);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, NULL, 0, ur->subject_str, semicolon - ur->subject_str);
         if (!ub) return -1;
 
-	struct uwsgi_buffer *ub2 = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, semicolon+1, ur->subject_str_len - ((semicolon+1) - ur->subject_str));
+	struct uwsgi_buffer *ub2 = uwsgi_routing_expand(wsgi_req, ur, NULL, 0, semicolon+1, ur->subject_str_len - ((semicolon+1) - ur->subject_str));
         if (!ub2) {
-		uwsgi_buffer_destroy(ub);
 		return -1;
 	}
 
 	if(!uwsgi_strncmp(ub->buf, ub->pos, ub2->buf, ub2->pos)) {
-		uwsgi_buffer_destroy(ub);
-		uwsgi_buffer_destroy(ub2);
 		return 1;
 	}
-        uwsgi_buffer_destroy(ub);
-        uwsgi_buffer_destroy(ub2);
         return 0;
 }
 
@@ -1550,24 +1899,19 @@ static int uwsgi_route_condition_higher(struct wsgi_request *wsgi_req, struct uw
         char *semicolon = memchr(ur->subject_str, ';', ur->subject_str_len);
         if (!semicolon) return 0;
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, ur->subject_str, semicolon - ur->subject_str);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, NULL, 0, ur->subject_str, semicolon - ur->subject_str);
         if (!ub) return -1;
 
-        struct uwsgi_buffer *ub2 = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, semicolon+1, ur->subject_str_len - ((semicolon+1) - ur->subject_str));
+        struct uwsgi_buffer *ub2 = uwsgi_routing_expand(wsgi_req, ur, NULL, 0, semicolon+1, ur->subject_str_len - ((semicolon+1) - ur->subject_str));
         if (!ub2) {
-                uwsgi_buffer_destroy(ub);
                 return -1;
         }
 
 	long num1 = strtol(ub->buf, NULL, 10);
 	long num2 = strtol(ub2->buf, NULL, 10);
         if(num1 > num2) {
-                uwsgi_buffer_destroy(ub);
-                uwsgi_buffer_destroy(ub2);
                 return 1;
         }
-        uwsgi_buffer_destroy(ub);
-        uwsgi_buffer_destroy(ub2);
         return 0;
 }
 
@@ -1575,24 +1919,19 @@ static int uwsgi_route_condition_higherequal(struct wsgi_request *wsgi_req, stru
         char *semicolon = memchr(ur->subject_str, ';', ur->subject_str_len);
         if (!semicolon) return 0;
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, ur->subject_str, semicolon - ur->subject_str);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, NULL, 0, ur->subject_str, semicolon - ur->subject_str);
         if (!ub) return -1;
 
-        struct uwsgi_buffer *ub2 = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, semicolon+1, ur->subject_str_len - ((semicolon+1) - ur->subject_str));
+        struct uwsgi_buffer *ub2 = uwsgi_routing_expand(wsgi_req, ur, NULL, 0, semicolon+1, ur->subject_str_len - ((semicolon+1) - ur->subject_str));
         if (!ub2) {
-                uwsgi_buffer_destroy(ub);
                 return -1;
         }
 
         long num1 = strtol(ub->buf, NULL, 10);
         long num2 = strtol(ub2->buf, NULL, 10);
         if(num1 >= num2) {
-                uwsgi_buffer_destroy(ub);
-                uwsgi_buffer_destroy(ub2);
                 return 1;
         }
-        uwsgi_buffer_destroy(ub);
-        uwsgi_buffer_destroy(ub2);
         return 0;
 }
 
@@ -1601,24 +1940,19 @@ static int uwsgi_route_condition_lower(struct wsgi_request *wsgi_req, struct uws
         char *semicolon = memchr(ur->subject_str, ';', ur->subject_str_len);
         if (!semicolon) return 0;
         
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, ur->subject_str, semicolon - ur->subject_str);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, NULL, 0, ur->subject_str, semicolon - ur->subject_str);
         if (!ub) return -1;
 
-        struct uwsgi_buffer *ub2 = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, semicolon+1, ur->subject_str_len - ((semicolon+1) - ur->subject_str));
+        struct uwsgi_buffer *ub2 = uwsgi_routing_expand(wsgi_req, ur, NULL, 0, semicolon+1, ur->subject_str_len - ((semicolon+1) - ur->subject_str));
         if (!ub2) {
-                uwsgi_buffer_destroy(ub);
                 return -1;
         }
 
         long num1 = strtol(ub->buf, NULL, 10);
         long num2 = strtol(ub2->buf, NULL, 10);
         if(num1 < num2) {
-                uwsgi_buffer_destroy(ub);
-                uwsgi_buffer_destroy(ub2);
                 return 1;
         }
-        uwsgi_buffer_destroy(ub);
-        uwsgi_buffer_destroy(ub2);
         return 0;
 }
 
@@ -1626,33 +1960,27 @@ static int uwsgi_route_condition_lowerequal(struct wsgi_request *wsgi_req, struc
         char *semicolon = memchr(ur->subject_str, ';', ur->subject_str_len);
         if (!semicolon) return 0;
         
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, ur->subject_str, semicolon - ur->subject_str);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, NULL, 0, ur->subject_str, semicolon - ur->subject_str);
         if (!ub) return -1;
 
-        struct uwsgi_buffer *ub2 = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, semicolon+1, ur->subject_str_len - ((semicolon+1) - ur->subject_str));
+        struct uwsgi_buffer *ub2 = uwsgi_routing_expand(wsgi_req, ur, NULL, 0, semicolon+1, ur->subject_str_len - ((semicolon+1) - ur->subject_str));
         if (!ub2) {
-                uwsgi_buffer_destroy(ub);
                 return -1;
         }
 
         long num1 = strtol(ub->buf, NULL, 10);
         long num2 = strtol(ub2->buf, NULL, 10);
         if(num1 <= num2) {
-                uwsgi_buffer_destroy(ub);
-                uwsgi_buffer_destroy(ub2);
                 return 1;
         }
-        uwsgi_buffer_destroy(ub);
-        uwsgi_buffer_destroy(ub2);
         return 0;
 }
 
 #ifdef UWSGI_SSL
 static int uwsgi_route_condition_lord(struct wsgi_request *wsgi_req, struct uwsgi_route *ur) {
-	struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len);
+	struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len);
         if (!ub) return -1;
         int ret = uwsgi_legion_i_am_the_lord(ub->buf);
-        uwsgi_buffer_destroy(ub);
         return ret;
 }
 #endif
@@ -1663,22 +1991,17 @@ static int uwsgi_route_condition_startswith(struct wsgi_request *wsgi_req, struc
         char *semicolon = memchr(ur->subject_str, ';', ur->subject_str_len);
         if (!semicolon) return 0;
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, ur->subject_str, semicolon - ur->subject_str);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, NULL, 0, ur->subject_str, semicolon - ur->subject_str);
         if (!ub) return -1;
 
-        struct uwsgi_buffer *ub2 = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, semicolon+1, ur->subject_str_len - ((semicolon+1) - ur->subject_str));
+        struct uwsgi_buffer *ub2 = uwsgi_routing_expand(wsgi_req, ur, NULL, 0, semicolon+1, ur->subject_str_len - ((semicolon+1) - ur->subject_str));
         if (!ub2) {
-                uwsgi_buffer_destroy(ub);
                 return -1;
         }
 
         if(!uwsgi_starts_with(ub->buf, ub->pos, ub2->buf, ub2->pos)) {
-                uwsgi_buffer_destroy(ub);
-                uwsgi_buffer_destroy(ub2);
                 return 1;
         }
-        uwsgi_buffer_destroy(ub);
-        uwsgi_buffer_destroy(ub2);
         return 0;
 }
 
@@ -1686,22 +2009,17 @@ static int uwsgi_route_condition_contains(struct wsgi_request *wsgi_req, struct
         char *semicolon = memchr(ur->subject_str, ';', ur->subject_str_len);
         if (!semicolon) return 0;
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, ur->subject_str, semicolon - ur->subject_str);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, NULL, 0, ur->subject_str, semicolon - ur->subject_str);
         if (!ub) return -1;
 
-        struct uwsgi_buffer *ub2 = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, semicolon+1, ur->subject_str_len - ((semicolon+1) - ur->subject_str));
+        struct uwsgi_buffer *ub2 = uwsgi_routing_expand(wsgi_req, ur, NULL, 0, semicolon+1, ur->subject_str_len - ((semicolon+1) - ur->subject_str));
         if (!ub2) {
-                uwsgi_buffer_destroy(ub);
                 return -1;
         }
 
         if(uwsgi_contains_n(ub->buf, ub->pos, ub2->buf, ub2->pos)) {
-                uwsgi_buffer_destroy(ub);
-                uwsgi_buffer_destroy(ub2);
                 return 1;
         }
-        uwsgi_buffer_destroy(ub);
-        uwsgi_buffer_destroy(ub2);
         return 0;
 }
 
@@ -1709,61 +2027,50 @@ static int uwsgi_route_condition_endswith(struct wsgi_request *wsgi_req, struct
         char *semicolon = memchr(ur->subject_str, ';', ur->subject_str_len);
         if (!semicolon) return 0;
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, ur->subject_str, semicolon - ur->subject_str);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, NULL, 0, ur->subject_str, semicolon - ur->subject_str);
         if (!ub) return -1;
 
-        struct uwsgi_buffer *ub2 = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, semicolon+1, ur->subject_str_len - ((semicolon+1) - ur->subject_str));
+        struct uwsgi_buffer *ub2 = uwsgi_routing_expand(wsgi_req, ur, NULL, 0, semicolon+1, ur->subject_str_len - ((semicolon+1) - ur->subject_str));
         if (!ub2) {
-                uwsgi_buffer_destroy(ub);
                 return -1;
         }
 
 	if (ub2->pos > ub->pos) goto zero;
         if(!uwsgi_strncmp(ub->buf + (ub->pos - ub2->pos), ub2->pos, ub2->buf, ub2->pos)) {
-                uwsgi_buffer_destroy(ub);
-                uwsgi_buffer_destroy(ub2);
                 return 1;
         }
 
 zero:
-        uwsgi_buffer_destroy(ub);
-        uwsgi_buffer_destroy(ub2);
         return 0;
 }
 
 
 
 static int uwsgi_route_condition_isdir(struct wsgi_request *wsgi_req, struct uwsgi_route *ur) {
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len);
         if (!ub) return -1;
         if (uwsgi_is_dir(ub->buf)) {
-                uwsgi_buffer_destroy(ub);
                 return 1;
         }
-        uwsgi_buffer_destroy(ub);
         return 0;
 }
 
 static int uwsgi_route_condition_islink(struct wsgi_request *wsgi_req, struct uwsgi_route *ur) {
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len);
         if (!ub) return -1;
         if (uwsgi_is_link(ub->buf)) {
-                uwsgi_buffer_destroy(ub);
                 return 1;
         }
-        uwsgi_buffer_destroy(ub);
         return 0;
 }
 
 
 static int uwsgi_route_condition_isexec(struct wsgi_request *wsgi_req, struct uwsgi_route *ur) {
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len);
+        struct uwsgi_buffer *ub = uwsgi_routing_expand(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len);
         if (!ub) return -1;
         if (!access(ub->buf, X_OK)) {
-                uwsgi_buffer_destroy(ub);
                 return 1;
         }
-        uwsgi_buffer_destroy(ub);
         return 0;
 }
 
@@ -1902,12 +2209,14 @@ void uwsgi_register_embedded_routers() {
         uwsgi_register_router("break", uwsgi_router_break);
 	uwsgi_register_router("return", uwsgi_router_return);
 	uwsgi_register_router("break-with-status", uwsgi_router_return);
+	uwsgi_register_router("ratelimit", uwsgi_router_ratelimit);
         uwsgi_register_router("log", uwsgi_router_log);
         uwsgi_register_router("donotlog", uwsgi_router_donotlog);
         uwsgi_register_router("logvar", uwsgi_router_logvar);
         uwsgi_register_router("goto", uwsgi_router_goto);
         uwsgi_register_router("addvar", uwsgi_router_addvar);
         uwsgi_register_router("addheader", uwsgi_router_addheader);
+        uwsgi_register_router("headertemplate", uwsgi_router_headertemplate);
         uwsgi_register_router("delheader", uwsgi_router_remheader);
         uwsgi_register_router("remheader", uwsgi_router_remheader);
         uwsgi_register_router("clearheaders", uwsgi_router_clearheaders);
@@ -98,79 +98,164 @@ static void rpc_context_hook(char *key, uint16_t kl, char *value, uint16_t vl, v
 	}
 }
 
-char *uwsgi_do_rpc(char *node, char *func, uint8_t argc, char *argv[], uint16_t argvs[], uint64_t * len) {
-
-	uint8_t i;
-	uint16_t ulen;
-	struct uwsgi_header *uh = NULL;
-	char *buffer = NULL;
+/*
+	persistent rpc connections (--rpc-pool)
+
+	pooled connections speak the rpc session protocol (modifier2 6): every request
+	array starts with a 4 bytes (little endian) request id and every response is a
+	uwsgi header (173, 12, 6) followed by the id and the 64bit size of the body.
+	The server processes the calls of a session in order, so multiple calls to the same
+	node can be pipelined on a single connection.
+
+	The pool is process-local, connections inherited from the parent are never reused.
+*/
+
+struct uwsgi_rpc_conn {
+	char *node;
+	int fd;
+	time_t last;
+	struct uwsgi_rpc_conn *next;
+};
+
+static struct uwsgi_rpc_conn *rpc_pool;
+static pid_t rpc_pool_pid;
+static uint32_t rpc_pool_ids;
+static pthread_mutex_t rpc_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void rpc_pool_check_pid(void) {
+	// forked, forget (without closing) the parent connections
+	if (rpc_pool_pid != uwsgi.mypid) {
+		rpc_pool = NULL;
+		rpc_pool_pid = uwsgi.mypid;
+	}
+}
 
-	*len = 0;
+static int rpc_pool_get(char *node) {
+	int fd = -1;
+	time_t now = uwsgi_now();
+	pthread_mutex_lock(&rpc_pool_lock);
+	rpc_pool_check_pid();
+	struct uwsgi_rpc_conn *urc = rpc_pool, *prev = NULL;
+	while (urc) {
+		struct uwsgi_rpc_conn *next = urc->next;
+		int expired = (now - urc->last) >= uwsgi.rpc_pool_idle;
+		if (expired || (fd < 0 && !strcmp(urc->node, node))) {
+			if (prev) prev->next = next;
+			else rpc_pool = next;
+			if (expired) {
+				close(urc->fd);
+			}
+			else {
+				fd = urc->fd;
+			}
+			free(urc->node);
+			free(urc);
+		}
+		else {
+			prev = urc;
+		}
+		urc = next;
+	}
+	pthread_mutex_unlock(&rpc_pool_lock);
+
+	if (fd > -1) {
+		// an idle session must not be readable (the peer closed it)
+		struct pollfd upoll;
+		upoll.fd = fd;
+		upoll.events = POLLIN;
+		upoll.revents = 0;
+		if (poll(&upoll, 1, 0) != 0) {
+			close(fd);
+			fd = -1;
+		}
+	}
+	return fd;
+}
 
-	if (node == NULL || !strcmp(node, "")) {
-		// allocate the whole buffer
-		if (!uwsgi.rpc_table) {
-                	uwsgi_log("local rpc subsystem is still not initialized !!!\n");
-                	return NULL;
-        	}
-		*len = uwsgi_rpc(func, argc, argv, argvs, &buffer);
-		if (buffer)
-			return buffer;
-		return NULL;
+static void rpc_pool_put(char *node, int fd) {
+	int count = 0;
+	pthread_mutex_lock(&rpc_pool_lock);
+	rpc_pool_check_pid();
+	struct uwsgi_rpc_conn *urc = rpc_pool;
+	while (urc) {
+		if (!strcmp(urc->node, node)) count++;
+		urc = urc->next;
 	}
+	if (count >= uwsgi.rpc_pool) {
+		pthread_mutex_unlock(&rpc_pool_lock);
+		close(fd);
+		return;
+	}
+	urc = uwsgi_malloc(sizeof(struct uwsgi_rpc_conn));
+	urc->node = uwsgi_str(node);
+	urc->fd = fd;
+	urc->last = uwsgi_now();
+	urc->next = rpc_pool;
+	rpc_pool = urc;
+	pthread_mutex_unlock(&rpc_pool_lock);
+}
 
+static uint32_t rpc_pool_id(void) {
+	return __sync_add_and_fetch(&rpc_pool_ids, 1);
+}
 
-	// connect to node (async way)
-	int fd = uwsgi_connect(node, 0, 1);
-	if (fd < 0)
-		return NULL;
+// build a uwsgi rpc packet, session packets start with the request id
+static char *rpc_pack(struct uwsgi_rpc_call *urc, int session, size_t *len) {
+	uint8_t i;
+	uint16_t ulen;
+	size_t buffer_size = 2 + strlen(urc->func);
+	if (session) buffer_size += 2 + 4;
 
-	// wait for connection;
-	int ret = uwsgi.wait_write_hook(fd, uwsgi.socket_timeout);
-	if (ret <= 0) {
-		close(fd);
-		return NULL;
+	for (i = 0; i < urc->argc; i++) {
+		buffer_size += 2 + urc->argvs[i];
 	}
 
-	// prepare a uwsgi array
-	uint16_t buffer_size = 2 + strlen(func);
-
-	for (i = 0; i < argc; i++) {
-		buffer_size += 2 + argvs[i];
+	if (buffer_size > 0xffff) {
+		uwsgi_log("[uwsgi-rpc] call to \"%s\" is too big (%llu bytes)\n", urc->func, (unsigned long long) buffer_size);
+		return NULL;
 	}
 
-	// allocate the whole buffer
-	buffer = uwsgi_malloc(4+buffer_size);
+	char *buffer = uwsgi_malloc(4 + buffer_size);
 
 	// set the uwsgi header
-	uh = (struct uwsgi_header *) buffer;
+	struct uwsgi_header *uh = (struct uwsgi_header *) buffer;
 	uh->modifier1 = 173;
 	uh->_pktsize = buffer_size;
-	uh->modifier2 = 0;
+	uh->modifier2 = session ? 6 : 0;
 
-	// add func to the array
 	char *bufptr = buffer + 4;
-	ulen = strlen(func);
+	if (session) {
+		*bufptr++ = 4;
+		*bufptr++ = 0;
+		*bufptr++ = (uint8_t) (urc->id & 0xff);
+		*bufptr++ = (uint8_t) ((urc->id >> 8) & 0xff);
+		*bufptr++ = (uint8_t) ((urc->id >> 16) & 0xff);
+		*bufptr++ = (uint8_t) ((urc->id >> 24) & 0xff);
+	}
+
+	// add func to the array
+	ulen = strlen(urc->func);
 	*bufptr++ = (uint8_t) (ulen & 0xff);
 	*bufptr++ = (uint8_t) ((ulen >> 8) & 0xff);
-	memcpy(bufptr, func, ulen);
+	memcpy(bufptr, urc->func, ulen);
 	bufptr += ulen;
 
-	for (i = 0; i < argc; i++) {
-		ulen = argvs[i];
+	for (i = 0; i < urc->argc; i++) {
+		ulen = urc->argvs[i];
 		*bufptr++ = (uint8_t) (ulen & 0xff);
 		*bufptr++ = (uint8_t) ((ulen >> 8) & 0xff);
-		memcpy(bufptr, argv[i], ulen);
+		memcpy(bufptr, urc->argv[i], ulen);
 		bufptr += ulen;
 	}
 
-	// ok the request is ready, let's send it in non blocking way
-	if (uwsgi_write_true_nb(fd, buffer, buffer_size+4, uwsgi.socket_timeout)) {
-		goto error;
-	}
+	*len = 4 + buffer_size;
+	return buffer;
+}
 
-	// ok time to wait for the response in non blocking way
-	size_t rlen = buffer_size+4;
+// classic (one call per connection) response
+static char *rpc_read_response(int fd, uint64_t *len) {
+	size_t rlen = 4096;
+	char *buffer = uwsgi_malloc(rlen);
 	uint8_t modifier2 = 0;
 	if (uwsgi_read_with_realloc(fd, &buffer, &rlen, uwsgi.socket_timeout, NULL, &modifier2)) {
 		goto error;
@@ -195,19 +280,193 @@ char *uwsgi_do_rpc(char *node, char *func, uint8_t argc, char *argv[], uint16_t
                 }
 	}
 
-	close(fd);
 	*len = rlen;
 	if (*len == 0) {
-		goto error2;
+		goto error;
 	}
 	return buffer;
 
 error:
-	close(fd);
-error2:
 	free(buffer);
 	return NULL;
+}
 
+static char *rpc_read_session_response(int fd, uint32_t id, uint64_t *len) {
+	uint8_t hdr[16];
+	if (uwsgi_read_whole_true_nb(fd, (char *) hdr, 16, uwsgi.socket_timeout)) return NULL;
+	if (hdr[0] != 173 || hdr[1] != 12 || hdr[2] != 0 || hdr[3] != 6) {
+		uwsgi_log("[uwsgi-rpc] invalid session response\n");
+		return NULL;
+	}
+	uint32_t rid = hdr[4] | (hdr[5] << 8) | (hdr[6] << 16) | ((uint32_t) hdr[7] << 24);
+	if (rid != id) {
+		uwsgi_log("[uwsgi-rpc] session response id mismatch (%u != %u)\n", rid, id);
+		return NULL;
+	}
+	uint64_t rlen = 0;
+	int i;
+	for (i = 7; i >= 0; i--) {
+		rlen = (rlen << 8) | hdr[8 + i];
+	}
+	char *buffer = uwsgi_malloc(rlen + 1);
+	if (rlen > 0 && uwsgi_read_whole_true_nb(fd, buffer, rlen, uwsgi.socket_timeout)) {
+		free(buffer);
+		return NULL;
+	}
+	*len = rlen;
+	return buffer;
+}
+
+/*
+	run multiple (local or remote) rpc calls.
+
+	All of the connections are started and all of the requests are sent before
+	waiting for the first response, so calls to different nodes run in parallel
+	(the wait hooks suspend the current core when async modes are in use) and calls to the
+	same node are pipelined on a single persistent connection (if --rpc-pool is enabled).
+
+	Returns the number of successful calls, responses must be freed by the caller.
+*/
+static int rpc_do_multi(struct uwsgi_rpc_call *calls, int n, int reuse) {
+	int i, j, ok = 0;
+	int session = uwsgi.rpc_pool > 0;
+
+	for (i = 0; i < n; i++) {
+		struct uwsgi_rpc_call *urc = &calls[i];
+		urc->response = NULL;
+		urc->len = 0;
+		urc->fd = -1;
+		urc->owner = i;
+		urc->reused = 0;
+
+		if (urc->node == NULL || !strcmp(urc->node, "")) {
+			if (!uwsgi.rpc_table) {
+				uwsgi_log("local rpc subsystem is still not initialized !!!\n");
+				continue;
+			}
+			urc->len = uwsgi_rpc(urc->func, urc->argc, urc->argv, urc->argvs, &urc->response);
+			if (urc->response) ok++;
+			continue;
+		}
+
+		if (session) {
+			urc->id = rpc_pool_id();
+			// pipeline on the connection of a previous call to the same node
+			for (j = 0; j < i; j++) {
+				if (calls[j].owner == j && calls[j].fd > -1 && calls[j].node && !strcmp(calls[j].node, urc->node)) {
+					urc->fd = calls[j].fd;
+					urc->owner = j;
+					urc->reused = calls[j].reused;
+					break;
+				}
+			}
+			if (urc->fd > -1) continue;
+			if (reuse) {
+				urc->fd = rpc_pool_get(urc->node);
+				if (urc->fd > -1) {
+					urc->reused = 1;
+					continue;
+				}
+			}
+		}
+
+		// connect to node (async way)
+		urc->fd = uwsgi_connect(urc->node, 0, 1);
+	}
+
+	// send the requests
+	for (i = 0; i < n; i++) {
+		struct uwsgi_rpc_call *urc = &calls[i];
+		if (urc->fd < 0) continue;
+		if (urc->owner == i && !urc->reused) {
+			// wait for connection
+			if (uwsgi.wait_write_hook(urc->fd, uwsgi.socket_timeout) <= 0) goto broken;
+		}
+		size_t len = 0;
+		char *buffer = rpc_pack(urc, session, &len);
+		if (!buffer) goto broken;
+		int ret = uwsgi_write_true_nb(urc->fd, buffer, len, uwsgi.socket_timeout);
+		free(buffer);
+		if (ret) goto broken;
+		continue;
+broken:
+		// the connection is shared by the following calls too
+		close(urc->fd);
+		for (j = urc->owner; j < n; j++) {
+			if (calls[j].fd == urc->fd && calls[j].owner == urc->owner) calls[j].fd = -1;
+		}
+	}
+
+	// collect the responses (in order, as sessions are sequential)
+	for (i = 0; i < n; i++) {
+		struct uwsgi_rpc_call *urc = &calls[i];
+		if (urc->fd < 0) continue;
+		if (session) {
+			urc->response = rpc_read_session_response(urc->fd, urc->id, &urc->len);
+		}
+		else {
+			urc->response = rpc_read_response(urc->fd, &urc->len);
+		}
+		if (urc->response) {
+			// empty response (like an unknown function), the session is still valid
+			if (session && urc->len == 0) {
+				free(urc->response);
+				urc->response = NULL;
+				urc->reused = 0;
+				continue;
+			}
+			ok++;
+			continue;
+		}
+		close(urc->fd);
+		int fd = urc->fd;
+		for (j = urc->owner; j < n; j++) {
+			if (calls[j].fd == fd && calls[j].owner == urc->owner) calls[j].fd = -1;
+		}
+	}
+
+	// recycle (or close) the connections
+	for (i = 0; i < n; i++) {
+		struct uwsgi_rpc_call *urc = &calls[i];
+		if (urc->fd < 0 || urc->owner != i) continue;
+		if (session) {
+			rpc_pool_put(urc->node, urc->fd);
+		}
+		else {
+			close(urc->fd);
+		}
+	}
+
+	// a stale pooled connection could be the culprit, retry with brand new ones
+	if (reuse && session && ok < n) {
+		for (i = 0; i < n; i++) {
+			if (!calls[i].response && calls[i].reused) {
+				ok += rpc_do_multi(&calls[i], 1, 0);
+			}
+		}
+	}
+
+	return ok;
+}
+
+int uwsgi_do_rpc_multi(struct uwsgi_rpc_call *calls, int n) {
+	return rpc_do_multi(calls, n, 1);
+}
+
+char *uwsgi_do_rpc(char *node, char *func, uint8_t argc, char *argv[], uint16_t argvs[], uint64_t * len) {
+
+	struct uwsgi_rpc_call urc;
+	memset(&urc, 0, sizeof(struct uwsgi_rpc_call));
+	urc.node = node;
+	urc.func = func;
+	urc.argc = argc;
+	urc.argv = argv;
+	urc.argvs = argvs;
+
+	*len = 0;
+	uwsgi_do_rpc_multi(&urc, 1);
+	*len = urc.len;
+	return urc.response;
 }
 
 
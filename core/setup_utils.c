@@ -86,6 +86,22 @@ void uwsgi_setup_zerg() {
 	}
 }
 
+// get back the zergpool connections after a reload
+void uwsgi_setup_zerg_report() {
+	char *fds = getenv("UWSGI_ZERG_REPORT_FDS");
+	if (!fds) return;
+	char *list = uwsgi_str(fds);
+	unsetenv("UWSGI_ZERG_REPORT_FDS");
+	char *p, *ctx = NULL;
+	uwsgi_foreach_token(list, ",", p, ctx) {
+		int fd = atoi(p);
+		if (fd > 2 && fcntl(fd, F_GETFD) > -1) {
+			uwsgi_zerg_report_add(fd);
+		}
+	}
+	free(list);
+}
+
 void uwsgi_setup_inherited_sockets() {
 
 	int j;
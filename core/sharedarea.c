@@ -1,7 +1,15 @@
 #include <uwsgi.h>
 
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
 extern struct uwsgi_server uwsgi;
 
+static void uwsgi_sharedarea_notify(struct uwsgi_sharedarea *);
+
 /*
 
 This is an high-performance memory area shared by all workers/cores/threads
@@ -30,6 +38,7 @@ int uwsgi_sharedarea_update(int id) {
         struct uwsgi_sharedarea *sa = uwsgi_sharedarea_get_by_id(id, 0);
         if (!sa) return -1;
 	sa->updates++;
+	uwsgi_sharedarea_notify(sa);
         return 0;
 }
 
@@ -68,6 +77,28 @@ int64_t uwsgi_sharedarea_read(int id, uint64_t pos, char *blob, uint64_t len) {
         return len;
 } 
 
+// like uwsgi_sharedarea_read() but returns a new copy along with the updates counter it refers to
+char *uwsgi_sharedarea_snapshot(int id, uint64_t pos, uint64_t *len, uint64_t *generation) {
+	struct uwsgi_sharedarea *sa = uwsgi_sharedarea_get_by_id(id, pos);
+	if (!sa) return NULL;
+	if (pos + *len > sa->max_pos + 1) return NULL;
+	uwsgi_rlock(sa->lock);
+	if (*len == 0) *len = (sa->max_pos + 1) - pos;
+	if (sa->honour_used) {
+		if (sa->used <= pos) *len = 0;
+		else if (sa->used-pos < *len) *len = sa->used-pos;
+	}
+	char *buf = NULL;
+	if (*len > 0) {
+		buf = uwsgi_malloc(*len);
+		memcpy(buf, sa->area + pos, *len);
+		*generation = sa->updates;
+		sa->hits++;
+	}
+	uwsgi_rwunlock(sa->lock);
+	return buf;
+}
+
 int uwsgi_sharedarea_write(int id, uint64_t pos, char *blob, uint64_t len) {
 	struct uwsgi_sharedarea *sa = uwsgi_sharedarea_get_by_id(id, pos);
 	if (!sa) return -1;
@@ -75,6 +106,7 @@ int uwsgi_sharedarea_write(int id, uint64_t pos, char *blob, uint64_t len) {
 	uwsgi_wlock(sa->lock);
 	memcpy(sa->area + pos, blob, len);	
 	sa->updates++;
+	uwsgi_sharedarea_notify(sa);
 	uwsgi_rwunlock(sa->lock);
 	return 0;
 } 
@@ -124,6 +156,7 @@ int uwsgi_sharedarea_inc8(int id, uint64_t pos, int8_t amount) {
 	int8_t *n_ptr = (int8_t *) (sa->area + pos);
         *n_ptr+=amount;
         sa->updates++;
+        uwsgi_sharedarea_notify(sa);
         uwsgi_rwunlock(sa->lock);
         return 0;
 }
@@ -136,6 +169,7 @@ int uwsgi_sharedarea_inc16(int id, uint64_t pos, int16_t amount) {
         int16_t *n_ptr = (int16_t *) (sa->area + pos);
         *n_ptr+=amount;
         sa->updates++;
+        uwsgi_sharedarea_notify(sa);
         uwsgi_rwunlock(sa->lock);
         return 0;
 }
@@ -148,6 +182,7 @@ int uwsgi_sharedarea_inc32(int id, uint64_t pos, int32_t amount) {
         int32_t *n_ptr = (int32_t *) (sa->area + pos);
         *n_ptr+=amount;
         sa->updates++;
+        uwsgi_sharedarea_notify(sa);
         uwsgi_rwunlock(sa->lock);
         return 0;
 }
@@ -160,6 +195,7 @@ int uwsgi_sharedarea_inc64(int id, uint64_t pos, int64_t amount) {
         int64_t *n_ptr = (int64_t *) (sa->area + pos);
         *n_ptr+=amount;
         sa->updates++;
+        uwsgi_sharedarea_notify(sa);
         uwsgi_rwunlock(sa->lock);
         return 0;
 }
@@ -173,6 +209,7 @@ int uwsgi_sharedarea_dec8(int id, uint64_t pos, int8_t amount) {
         int8_t *n_ptr = (int8_t *) (sa->area + pos);
         *n_ptr-=amount;
         sa->updates++;
+        uwsgi_sharedarea_notify(sa);
         uwsgi_rwunlock(sa->lock);
         return 0;
 }
@@ -185,6 +222,7 @@ int uwsgi_sharedarea_dec16(int id, uint64_t pos, int16_t amount) {
         int16_t *n_ptr = (int16_t *) (sa->area + pos);
         *n_ptr-=amount;
         sa->updates++;
+        uwsgi_sharedarea_notify(sa);
         uwsgi_rwunlock(sa->lock);
         return 0;
 }
@@ -197,6 +235,7 @@ int uwsgi_sharedarea_dec32(int id, uint64_t pos, int32_t amount) {
         int32_t *n_ptr = (int32_t *) (sa->area + pos);
         *n_ptr-=amount;
         sa->updates++;
+        uwsgi_sharedarea_notify(sa);
         uwsgi_rwunlock(sa->lock);
         return 0;
 }
@@ -209,10 +248,140 @@ int uwsgi_sharedarea_dec64(int id, uint64_t pos, int64_t amount) {
         int64_t *n_ptr = (int64_t *) (sa->area + pos);
         *n_ptr-=amount;
         sa->updates++;
+        uwsgi_sharedarea_notify(sa);
         uwsgi_rwunlock(sa->lock);
         return 0;
 }
 
+/*
+
+	lock-free integer operations
+
+	aligned positions are managed with atomic instructions (the area lock is not touched),
+	misaligned ones fall back to the write lock.
+	Do not mix them with the locked inc/dec functions on the same position.
+
+	cas returns 1 (and stores the current value in *old) when the swap fails.
+
+*/
+
+enum {
+	UWSGI_SHAREDAREA_ATOMIC_ADD,
+	UWSGI_SHAREDAREA_ATOMIC_XCHG,
+	UWSGI_SHAREDAREA_ATOMIC_CAS,
+	UWSGI_SHAREDAREA_ATOMIC_MIN,
+	UWSGI_SHAREDAREA_ATOMIC_MAX,
+};
+
+#define sharedarea_atomic_op(type) {\
+	type *n_ptr = (type *) (sa->area + pos);\
+	type cur = *n_ptr;\
+	if (!locked) {\
+		switch(op) {\
+			case UWSGI_SHAREDAREA_ATOMIC_ADD: cur = __sync_fetch_and_add(n_ptr, (type) value); break;\
+			case UWSGI_SHAREDAREA_ATOMIC_XCHG: cur = uwsgi_atomic_xchg(n_ptr, (type) value); break;\
+			case UWSGI_SHAREDAREA_ATOMIC_CAS: cur = __sync_val_compare_and_swap(n_ptr, (type) expected, (type) value); break;\
+			default:\
+				for(;;) {\
+					if (op == UWSGI_SHAREDAREA_ATOMIC_MIN ? (type) value >= cur : (type) value <= cur) break;\
+					type prev = __sync_val_compare_and_swap(n_ptr, cur, (type) value);\
+					if (prev == cur) break;\
+					cur = prev;\
+				}\
+				break;\
+		}\
+	}\
+	else {\
+		switch(op) {\
+			case UWSGI_SHAREDAREA_ATOMIC_ADD: *n_ptr += (type) value; break;\
+			case UWSGI_SHAREDAREA_ATOMIC_XCHG: *n_ptr = (type) value; break;\
+			case UWSGI_SHAREDAREA_ATOMIC_CAS: if (cur == (type) expected) *n_ptr = (type) value; break;\
+			case UWSGI_SHAREDAREA_ATOMIC_MIN: if ((type) value < cur) *n_ptr = (type) value; break;\
+			case UWSGI_SHAREDAREA_ATOMIC_MAX: if ((type) value > cur) *n_ptr = (type) value; break;\
+		}\
+	}\
+	if (op == UWSGI_SHAREDAREA_ATOMIC_CAS && cur != (type) expected) ret = 1;\
+	if (old) *old = cur;\
+}
+
+static int uwsgi_sharedarea_atomic(int id, uint64_t pos, int size, int op, int64_t expected, int64_t value, int64_t *old) {
+	struct uwsgi_sharedarea *sa = uwsgi_sharedarea_get_by_id(id, pos);
+	if (!sa) return -1;
+	if (pos + size > sa->max_pos + 1) return -1;
+	int ret = 0;
+	int locked = (((uintptr_t) (sa->area + pos)) % size) != 0;
+	if (locked) uwsgi_wlock(sa->lock);
+	if (size == 8) sharedarea_atomic_op(int64_t)
+	else sharedarea_atomic_op(int32_t)
+	if (locked) {
+		if (!ret) {
+			sa->updates++;
+			uwsgi_sharedarea_notify(sa);
+		}
+		uwsgi_rwunlock(sa->lock);
+	}
+	else if (!ret) {
+		__sync_add_and_fetch(&sa->updates, 1);
+		uwsgi_sharedarea_notify(sa);
+	}
+	return ret;
+}
+
+int uwsgi_sharedarea_fetch_add64(int id, uint64_t pos, int64_t amount, int64_t *old) {
+	return uwsgi_sharedarea_atomic(id, pos, 8, UWSGI_SHAREDAREA_ATOMIC_ADD, 0, amount, old);
+}
+
+int uwsgi_sharedarea_xchg64(int id, uint64_t pos, int64_t value, int64_t *old) {
+	return uwsgi_sharedarea_atomic(id, pos, 8, UWSGI_SHAREDAREA_ATOMIC_XCHG, 0, value, old);
+}
+
+int uwsgi_sharedarea_cas64(int id, uint64_t pos, int64_t expected, int64_t value, int64_t *old) {
+	return uwsgi_sharedarea_atomic(id, pos, 8, UWSGI_SHAREDAREA_ATOMIC_CAS, expected, value, old);
+}
+
+int uwsgi_sharedarea_min64(int id, uint64_t pos, int64_t value, int64_t *old) {
+	return uwsgi_sharedarea_atomic(id, pos, 8, UWSGI_SHAREDAREA_ATOMIC_MIN, 0, value, old);
+}
+
+int uwsgi_sharedarea_max64(int id, uint64_t pos, int64_t value, int64_t *old) {
+	return uwsgi_sharedarea_atomic(id, pos, 8, UWSGI_SHAREDAREA_ATOMIC_MAX, 0, value, old);
+}
+
+int uwsgi_sharedarea_fetch_add32(int id, uint64_t pos, int32_t amount, int32_t *old) {
+	int64_t n = 0;
+	int ret = uwsgi_sharedarea_atomic(id, pos, 4, UWSGI_SHAREDAREA_ATOMIC_ADD, 0, amount, &n);
+	if (old) *old = n;
+	return ret;
+}
+
+int uwsgi_sharedarea_xchg32(int id, uint64_t pos, int32_t value, int32_t *old) {
+	int64_t n = 0;
+	int ret = uwsgi_sharedarea_atomic(id, pos, 4, UWSGI_SHAREDAREA_ATOMIC_XCHG, 0, value, &n);
+	if (old) *old = n;
+	return ret;
+}
+
+int uwsgi_sharedarea_cas32(int id, uint64_t pos, int32_t expected, int32_t value, int32_t *old) {
+	int64_t n = 0;
+	int ret = uwsgi_sharedarea_atomic(id, pos, 4, UWSGI_SHAREDAREA_ATOMIC_CAS, expected, value, &n);
+	if (old) *old = n;
+	return ret;
+}
+
+int uwsgi_sharedarea_min32(int id, uint64_t pos, int32_t value, int32_t *old) {
+	int64_t n = 0;
+	int ret = uwsgi_sharedarea_atomic(id, pos, 4, UWSGI_SHAREDAREA_ATOMIC_MIN, 0, value, &n);
+	if (old) *old = n;
+	return ret;
+}
+
+int uwsgi_sharedarea_max32(int id, uint64_t pos, int32_t value, int32_t *old) {
+	int64_t n = 0;
+	int ret = uwsgi_sharedarea_atomic(id, pos, 4, UWSGI_SHAREDAREA_ATOMIC_MAX, 0, value, &n);
+	if (old) *old = n;
+	return ret;
+}
+
 
 
 /*
@@ -221,30 +390,96 @@ int uwsgi_sharedarea_dec64(int id, uint64_t pos, int64_t amount) {
 		-1 -> on error
 		-2 -> on timeout
 */
+// wake up the cores waiting for changes (if any)
+static void uwsgi_sharedarea_notify(struct uwsgi_sharedarea *sa) {
+	__sync_add_and_fetch(&sa->notify_seq, 1);
+	if (!sa->waiters) return;
+#ifdef __linux__
+	syscall(SYS_futex, &sa->notify_seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+	if (sa->efd > -1) {
+		uint64_t one = 1;
+		if (write(sa->efd, &one, sizeof(uint64_t)) < 0 && errno != EAGAIN) {
+			uwsgi_error("uwsgi_sharedarea_notify()/write()");
+		}
+	}
+#endif
+}
+
+/*
+	wait for the updates counter to change (for up to timeout seconds, forever if 0).
+
+	Blocking cores sleep on a futex, when a suspend engine is installed the area eventfd
+	is waited with the wait_read_hook (rechecking the counter at least every freq milliseconds,
+	as another core could have reset the eventfd before we got to it).
+*/
 int uwsgi_sharedarea_wait(int id, int freq, int timeout) {
-	int waiting = 0;
 	struct uwsgi_sharedarea *sa = uwsgi_sharedarea_get_by_id(id, 0);
 	if (!sa) return -1;
 	if (!freq) freq = 100;
 	uwsgi_rlock(sa->lock);
 	uint64_t updates = sa->updates;
 	uwsgi_rwunlock(sa->lock);
-	while(timeout == 0 || waiting == 0 || (timeout > 0 && waiting > 0 && (waiting/1000) < timeout)) {
-		if (uwsgi.wait_milliseconds_hook(freq)) {
-			uwsgi_rwunlock(sa->lock);
-			return -1;
+	uint64_t deadline = timeout > 0 ? uwsgi_micros() + ((uint64_t) timeout * 1000000) : 0;
+
+	for (;;) {
+		uint32_t seq = sa->notify_seq;
+		uwsgi_barrier();
+		if (sa->updates != updates) return 0;
+
+		int remains = -1;
+		if (deadline) {
+			uint64_t now = uwsgi_micros();
+			if (now >= deadline) return -2;
+			remains = (deadline - now) / 1000;
+			if (!remains) remains = 1;
+		}
+
+		__sync_add_and_fetch(&sa->waiters, 1);
+		// an update could have happened before the writer could see us
+		if (sa->notify_seq != seq) {
+			__sync_sub_and_fetch(&sa->waiters, 1);
+			continue;
 		}
-		waiting += freq;
-		// lock sa
-		uwsgi_rlock(sa->lock);
-		if (sa->updates != updates) {
-			uwsgi_rwunlock(sa->lock);
-			return 0;
+#ifdef __linux__
+		if (sa->efd > -1 && uwsgi.wait_read_hook != uwsgi_simple_wait_read_hook) {
+			// every core needs its own descriptor to be registered in the event queue
+			int fd = dup(sa->efd);
+			if (fd < 0) {
+				uwsgi_error("uwsgi_sharedarea_wait()/dup()");
+				__sync_sub_and_fetch(&sa->waiters, 1);
+				return -1;
+			}
+			int interval = (remains > -1 && remains < freq) ? remains : freq;
+			int ret = uwsgi.wait_read_hook(fd, (interval + 999) / 1000);
+			close(fd);
+			if (ret < 0) {
+				__sync_sub_and_fetch(&sa->waiters, 1);
+				return -1;
+			}
+			// the eventfd is left readable for the other waiters, the last one (or one woken by a stale event) resets it
+			if (__sync_sub_and_fetch(&sa->waiters, 1) == 0 || (ret > 0 && sa->notify_seq == seq)) {
+				uint64_t counter;
+				if (read(sa->efd, &counter, sizeof(uint64_t)) < 0 && errno != EAGAIN) {
+					uwsgi_error("uwsgi_sharedarea_wait()/read()");
+				}
+			}
+			continue;
 		}
-		// unlock sa
-		uwsgi_rwunlock(sa->lock);
+		else {
+			struct timespec ts;
+			ts.tv_sec = remains / 1000;
+			ts.tv_nsec = (remains % 1000) * 1000000;
+			// returns immediately if an update happened after we read seq
+			syscall(SYS_futex, &sa->notify_seq, FUTEX_WAIT, seq, remains < 0 ? NULL : &ts, NULL, 0);
+		}
+#else
+		if (uwsgi.wait_milliseconds_hook(remains > -1 && remains < freq ? remains : freq)) {
+			__sync_sub_and_fetch(&sa->waiters, 1);
+			return -1;
+		}
+#endif
+		__sync_sub_and_fetch(&sa->waiters, 1);
 	}
-	return -2;
 }
 
 int uwsgi_sharedarea_new_id() {
@@ -265,7 +500,14 @@ int uwsgi_sharedarea_new_id() {
 }
 
 static struct uwsgi_sharedarea *announce_sa(struct uwsgi_sharedarea *sa) {
-	uwsgi_log("sharedarea %d created at %p (%d pages, area at %p)\n", sa->id, sa, sa->pages, sa->area);
+	sa->efd = -1;
+#ifdef __linux__
+	sa->efd = eventfd(0, EFD_NONBLOCK);
+	if (sa->efd < 0) {
+		uwsgi_error("announce_sa()/eventfd()");
+	}
+#endif
+	uwsgi_log("sharedarea %d created at %p (%d pages, area at %p, page size %llu)\n", sa->id, sa, sa->pages, sa->area, (unsigned long long) sa->page_size);
 	return sa;
 }
 
@@ -280,6 +522,7 @@ struct uwsgi_sharedarea *uwsgi_sharedarea_init_fd(int fd, uint64_t len, off_t of
 	}
         uwsgi.sharedareas[id]->id = id;
         uwsgi.sharedareas[id]->fd = fd;
+        uwsgi.sharedareas[id]->page_size = uwsgi_fd_page_size(fd);
         uwsgi.sharedareas[id]->pages = len / (size_t) uwsgi.page_size;
         if (len % (size_t) uwsgi.page_size != 0) uwsgi.sharedareas[id]->pages++;
         uwsgi.sharedareas[id]->max_pos = len-1;
@@ -292,7 +535,15 @@ struct uwsgi_sharedarea *uwsgi_sharedarea_init_fd(int fd, uint64_t len, off_t of
 
 struct uwsgi_sharedarea *uwsgi_sharedarea_init(int pages) {
 	int id = uwsgi_sharedarea_new_id();
-	uwsgi.sharedareas[id] = uwsgi_calloc_shared((size_t)uwsgi.page_size * (size_t)(pages + 1));
+	size_t len = (size_t)uwsgi.page_size * (size_t)(pages + 1);
+	uint64_t page_size = 0;
+	uwsgi.sharedareas[id] = uwsgi_mmap_shared(len, &page_size);
+	if ((void *) uwsgi.sharedareas[id] == MAP_FAILED) {
+		uwsgi_error("uwsgi_sharedarea_init()/mmap()");
+		exit(1);
+	}
+	memset(uwsgi.sharedareas[id], 0, len);
+	uwsgi.sharedareas[id]->page_size = page_size;
 	uwsgi.sharedareas[id]->area = ((char *) uwsgi.sharedareas[id]) + (size_t) uwsgi.page_size;
 	uwsgi.sharedareas[id]->id = id;
 	uwsgi.sharedareas[id]->fd = -1;
@@ -310,6 +561,7 @@ struct uwsgi_sharedarea *uwsgi_sharedarea_init_ptr(char *area, uint64_t len) {
         uwsgi.sharedareas[id]->area = area;
         uwsgi.sharedareas[id]->id = id;
         uwsgi.sharedareas[id]->fd = -1;
+        uwsgi.sharedareas[id]->page_size = uwsgi.page_size;
         uwsgi.sharedareas[id]->pages = len / (size_t) uwsgi.page_size;
 	if (len % (size_t) uwsgi.page_size != 0) uwsgi.sharedareas[id]->pages++;
         uwsgi.sharedareas[id]->max_pos = len-1;
@@ -319,6 +571,184 @@ struct uwsgi_sharedarea *uwsgi_sharedarea_init_ptr(char *area, uint64_t len) {
 	return announce_sa(uwsgi.sharedareas[id]);
 }
 
+/*
+
+	shared heap: an area formatted as a variable-size allocator.
+
+	Chunks are power of 2 sized (32 bytes to 16MB, header included), freed chunks go
+	in a list for each size class (every class has its own lock), new ones are taken from
+	the never used part of the area or by splitting a bigger free chunk.
+	Handles are offsets (of the payload) in the area, so they are valid in every process
+	and can be used with the plain sharedarea read/write functions too.
+
+	Reading/writing an allocated chunk does not take any lock: concurrent users of
+	the same object have to coordinate themselves.
+
+*/
+
+#define UWSGI_SHAREDHEAP_MAGIC 0x7573676873686561ULL
+#define UWSGI_SHAREDHEAP_USED 0x75736875
+#define UWSGI_SHAREDHEAP_FREE 0x75736866
+
+static void uwsgi_sharedheap_init(struct uwsgi_sharedarea *sa) {
+	struct uwsgi_sharedheap *sh = (struct uwsgi_sharedheap *) sa->area;
+	int i;
+	if (sa->max_pos + 1 < sizeof(struct uwsgi_sharedheap) + 32) {
+		uwsgi_log("sharedarea %d is too small for a heap\n", sa->id);
+		exit(1);
+	}
+	char *id_str = uwsgi_num2str(sa->id);
+	for (i = 0; i < UWSGI_SHAREDHEAP_CLASSES; i++) {
+		char *num = uwsgi_num2str(i);
+		sa->heap_locks[i] = uwsgi_lock_init(uwsgi_concat4("sharedheap", id_str, ".", num));
+		free(num);
+	}
+	sa->heap_brk_lock = uwsgi_lock_init(uwsgi_concat2("sharedheap_brk", id_str));
+	free(id_str);
+	sa->heap = 1;
+
+	// file backed areas keep their heap
+	if (sh->magic == UWSGI_SHAREDHEAP_MAGIC && sh->size == sa->max_pos + 1) return;
+
+	memset(sh, 0, sizeof(struct uwsgi_sharedheap));
+	sh->magic = UWSGI_SHAREDHEAP_MAGIC;
+	sh->size = sa->max_pos + 1;
+	sh->brk = (sizeof(struct uwsgi_sharedheap) + 31) & ~((uint64_t) 31);
+}
+
+static struct uwsgi_sharedheap *uwsgi_sharedheap_get(int id, struct uwsgi_sharedarea **sa) {
+	*sa = uwsgi_sharedarea_get_by_id(id, 0);
+	if (!*sa || !(*sa)->heap) return NULL;
+	return (struct uwsgi_sharedheap *) (*sa)->area;
+}
+
+static struct uwsgi_sharedheap_chunk *uwsgi_sharedheap_chunk(struct uwsgi_sharedarea *sa, struct uwsgi_sharedheap *sh, uint64_t handle) {
+	if (handle < sizeof(struct uwsgi_sharedheap) + sizeof(struct uwsgi_sharedheap_chunk) || handle >= sh->size) return NULL;
+	uint64_t off = handle - sizeof(struct uwsgi_sharedheap_chunk);
+	struct uwsgi_sharedheap_chunk *chunk = (struct uwsgi_sharedheap_chunk *) (sa->area + off);
+	if (chunk->magic != UWSGI_SHAREDHEAP_USED || chunk->size_class >= UWSGI_SHAREDHEAP_CLASSES) return NULL;
+	if (off + (32ULL << chunk->size_class) > sh->size) return NULL;
+	return chunk;
+}
+
+static uint64_t uwsgi_sharedheap_pop(struct uwsgi_sharedarea *sa, struct uwsgi_sharedheap *sh, int class) {
+	uwsgi_lock(sa->heap_locks[class]);
+	uint64_t off = sh->free_list[class];
+	if (off) {
+		memcpy(&sh->free_list[class], sa->area + off + sizeof(struct uwsgi_sharedheap_chunk), sizeof(uint64_t));
+	}
+	uwsgi_unlock(sa->heap_locks[class]);
+	return off;
+}
+
+static void uwsgi_sharedheap_push(struct uwsgi_sharedarea *sa, struct uwsgi_sharedheap *sh, uint64_t off, int class) {
+	struct uwsgi_sharedheap_chunk *chunk = (struct uwsgi_sharedheap_chunk *) (sa->area + off);
+	chunk->magic = UWSGI_SHAREDHEAP_FREE;
+	chunk->size_class = class;
+	chunk->len = 0;
+	uwsgi_lock(sa->heap_locks[class]);
+	memcpy(sa->area + off + sizeof(struct uwsgi_sharedheap_chunk), &sh->free_list[class], sizeof(uint64_t));
+	sh->free_list[class] = off;
+	uwsgi_unlock(sa->heap_locks[class]);
+}
+
+// returns the handle of a chunk able to store len bytes (0 on error)
+uint64_t uwsgi_sharedheap_alloc(int id, uint64_t len) {
+	struct uwsgi_sharedarea *sa = NULL;
+	struct uwsgi_sharedheap *sh = uwsgi_sharedheap_get(id, &sa);
+	if (!sh) return 0;
+
+	int class = 0;
+	while (class < UWSGI_SHAREDHEAP_CLASSES && (32ULL << class) - sizeof(struct uwsgi_sharedheap_chunk) < len) class++;
+	if (class >= UWSGI_SHAREDHEAP_CLASSES) return 0;
+
+	uint64_t off = uwsgi_sharedheap_pop(sa, sh, class);
+
+	// never used memory
+	if (!off) {
+		uwsgi_lock(sa->heap_brk_lock);
+		if (sh->brk + (32ULL << class) <= sh->size) {
+			off = sh->brk;
+			sh->brk += (32ULL << class);
+		}
+		uwsgi_unlock(sa->heap_brk_lock);
+	}
+
+	// split a bigger chunk, giving back the upper halves
+	if (!off) {
+		int i;
+		for (i = class + 1; i < UWSGI_SHAREDHEAP_CLASSES; i++) {
+			off = uwsgi_sharedheap_pop(sa, sh, i);
+			if (!off) continue;
+			while (--i >= class) {
+				uwsgi_sharedheap_push(sa, sh, off + (32ULL << i), i);
+			}
+			break;
+		}
+	}
+
+	if (!off) return 0;
+
+	struct uwsgi_sharedheap_chunk *chunk = (struct uwsgi_sharedheap_chunk *) (sa->area + off);
+	chunk->size_class = class;
+	chunk->len = 0;
+	uwsgi_barrier();
+	chunk->magic = UWSGI_SHAREDHEAP_USED;
+	__sync_add_and_fetch(&sh->allocated[class], 1);
+	return off + sizeof(struct uwsgi_sharedheap_chunk);
+}
+
+int uwsgi_sharedheap_free(int id, uint64_t handle) {
+	struct uwsgi_sharedarea *sa = NULL;
+	struct uwsgi_sharedheap *sh = uwsgi_sharedheap_get(id, &sa);
+	if (!sh) return -1;
+	struct uwsgi_sharedheap_chunk *chunk = uwsgi_sharedheap_chunk(sa, sh, handle);
+	if (!chunk) return -1;
+	// protect against double free
+	if (!uwsgi_atomic_cas(&chunk->magic, UWSGI_SHAREDHEAP_USED, UWSGI_SHAREDHEAP_FREE)) return -1;
+	int class = chunk->size_class;
+	__sync_sub_and_fetch(&sh->allocated[class], 1);
+	uwsgi_sharedheap_push(sa, sh, handle - sizeof(struct uwsgi_sharedheap_chunk), class);
+	return 0;
+}
+
+// store len bytes in the chunk (they become its current length)
+int uwsgi_sharedheap_write(int id, uint64_t handle, char *blob, uint64_t len) {
+	struct uwsgi_sharedarea *sa = NULL;
+	struct uwsgi_sharedheap *sh = uwsgi_sharedheap_get(id, &sa);
+	if (!sh) return -1;
+	struct uwsgi_sharedheap_chunk *chunk = uwsgi_sharedheap_chunk(sa, sh, handle);
+	if (!chunk) return -1;
+	if (len > (32ULL << chunk->size_class) - sizeof(struct uwsgi_sharedheap_chunk)) return -1;
+	memcpy(sa->area + handle, blob, len);
+	chunk->len = len;
+	sa->updates++;
+	uwsgi_sharedarea_notify(sa);
+	return 0;
+}
+
+int64_t uwsgi_sharedheap_len(int id, uint64_t handle) {
+	struct uwsgi_sharedarea *sa = NULL;
+	struct uwsgi_sharedheap *sh = uwsgi_sharedheap_get(id, &sa);
+	if (!sh) return -1;
+	struct uwsgi_sharedheap_chunk *chunk = uwsgi_sharedheap_chunk(sa, sh, handle);
+	if (!chunk) return -1;
+	return chunk->len;
+}
+
+// copy up to len bytes of the chunk, returns the amount copied
+int64_t uwsgi_sharedheap_read(int id, uint64_t handle, char *blob, uint64_t len) {
+	struct uwsgi_sharedarea *sa = NULL;
+	struct uwsgi_sharedheap *sh = uwsgi_sharedheap_get(id, &sa);
+	if (!sh) return -1;
+	struct uwsgi_sharedheap_chunk *chunk = uwsgi_sharedheap_chunk(sa, sh, handle);
+	if (!chunk) return -1;
+	if (len > chunk->len) len = chunk->len;
+	memcpy(blob, sa->area + handle, len);
+	sa->hits++;
+	return len;
+}
+
 struct uwsgi_sharedarea *uwsgi_sharedarea_init_keyval(char *arg) {
 	char *s_pages = NULL;
 	char *s_file = NULL;
@@ -326,6 +756,7 @@ struct uwsgi_sharedarea *uwsgi_sharedarea_init_keyval(char *arg) {
 	char *s_ptr = NULL;
 	char *s_size = NULL;
 	char *s_offset = NULL;
+	char *s_heap = NULL;
 	if (uwsgi_kvlist_parse(arg, strlen(arg), ',', '=',
 		"pages", &s_pages,
 		"file", &s_file,
@@ -333,6 +764,7 @@ struct uwsgi_sharedarea *uwsgi_sharedarea_init_keyval(char *arg) {
 		"ptr", &s_ptr,
 		"size", &s_size,
 		"offset", &s_offset,
+		"heap", &s_heap,
 		NULL)) {
 		uwsgi_log("invalid sharedarea keyval syntax\n");
 		exit(1);
@@ -398,6 +830,11 @@ struct uwsgi_sharedarea *uwsgi_sharedarea_init_keyval(char *arg) {
 		exit(1);
 	}
 
+	if (s_heap) {
+		uwsgi_sharedheap_init(sa);
+		free(s_heap);
+	}
+
 	if (s_pages) free(s_pages);
 	if (s_file) free(s_file);
 	if (s_fd) free(s_fd);
@@ -311,6 +311,101 @@ int uwsgi_signal_send(int fd, uint8_t sig) {
 
 }
 
+/*
+	signal coalescing (--signal-coalesce)
+
+	a signal already pending on a pipe is not written again, only its counter is increased:
+	the receiver runs the handler once and exposes the number of covered deliveries in uwsgi.signal_count
+*/
+static int uwsgi_signal_deliver(int fd, struct uwsgi_signal_queue *q, uint8_t sig) {
+	if (!uwsgi.signal_coalesce || !q)
+		return uwsgi_signal_send(fd, sig);
+
+	uint64_t bit = 1ULL << (sig % 64);
+	// the counter must be increased before checking the pending bit (see uwsgi_signal_ack())
+	__sync_add_and_fetch(&q->count[sig], 1);
+	uint64_t old = __sync_fetch_and_or(&q->pending[sig / 64], bit);
+	if (old & bit) {
+		__sync_add_and_fetch(&uwsgi.shared->coalesced_signals, 1);
+		return 0;
+	}
+	if (uwsgi_signal_send(fd, sig)) {
+		__sync_fetch_and_and(&q->pending[sig / 64], ~bit);
+		uwsgi_atomic_xchg(&q->count[sig], 0);
+		return -1;
+	}
+	return 0;
+}
+
+// returns the number of deliveries covered by the received signal (0 means already managed)
+static uint32_t uwsgi_signal_ack(struct uwsgi_signal_queue *q, uint8_t sig) {
+	if (!q) return 1;
+	__sync_fetch_and_and(&q->pending[sig / 64], ~(1ULL << (sig % 64)));
+	return uwsgi_atomic_xchg(&q->count[sig], 0);
+}
+
+// map a receiving descriptor to its coalescing queue
+static struct uwsgi_signal_queue *uwsgi_signal_queue_by_fd(int fd) {
+	int i;
+	if (!uwsgi.signal_coalesce) return NULL;
+
+	if (uwsgi.muleid > 0) {
+		if (fd == uwsgi.signal_socket) return &uwsgi.shared->mule_signal_queue;
+		if (fd == uwsgi.my_signal_socket) return &uwsgi.mules[uwsgi.muleid - 1].signal_queue;
+		for (i = 0; i < uwsgi.farms_cnt; i++) {
+			if (fd == uwsgi.farms[i].signal_pipe[1]) return &uwsgi.farms[i].signal_queue;
+		}
+		return NULL;
+	}
+
+	if (uwsgi.i_am_a_spooler && getpid() == uwsgi.i_am_a_spooler->pid) {
+		if (fd == uwsgi.shared->spooler_signal_pipe[1]) return &uwsgi.shared->spooler_signal_queue;
+		return NULL;
+	}
+
+	if (uwsgi.mywid > 0) {
+		if (fd == uwsgi.signal_socket) return &uwsgi.shared->worker_signal_queue;
+		if (fd == uwsgi.my_signal_socket) return &uwsgi.workers[uwsgi.mywid].signal_queue;
+		if (uwsgi.core_signals) {
+			for (i = 0; i < uwsgi.cores; i++) {
+				if (fd == uwsgi.workers[uwsgi.mywid].cores[i].signal_pipe[1]) return &uwsgi.workers[uwsgi.mywid].cores[i].signal_queue;
+			}
+		}
+	}
+	return NULL;
+}
+
+// run the handler of a signal read from fd, returns -2 if the signal has been coalesced in a previous run
+static int uwsgi_signal_dispatch(struct wsgi_request *wsgi_req, int fd, uint8_t sig) {
+	uint32_t count = uwsgi_signal_ack(uwsgi_signal_queue_by_fd(fd), sig);
+	if (count == 0) return -2;
+	uwsgi.signal_count = count;
+	int ret = uwsgi_signal_handler(wsgi_req, sig);
+	uwsgi.signal_count = 0;
+	return ret;
+}
+
+static void uwsgi_route_signal_to_core(char *receiver, uint8_t sig) {
+	char *colon = strchr(receiver, ':');
+	int wid = atoi(receiver + 6);
+	int core_id = atoi(colon + 5);
+	if (wid <= 0 || wid > uwsgi.numproc || core_id < 0 || core_id >= uwsgi.cores) {
+		uwsgi_log("invalid signal target: %s\n", receiver);
+		return;
+	}
+	struct uwsgi_core *uc = &uwsgi.workers[wid].cores[core_id];
+	// cores without a dedicated pipe (--core-signals not enabled or a single thread)
+	if (uc->signal_pipe[0] < 0) {
+		if (uwsgi_signal_deliver(uwsgi.workers[wid].signal_pipe[0], &uwsgi.workers[wid].signal_queue, sig)) {
+			uwsgi_log("could not deliver signal %d to worker %d\n", sig, wid);
+		}
+		return;
+	}
+	if (uwsgi_signal_deliver(uc->signal_pipe[0], &uc->signal_queue, sig)) {
+		uwsgi_log("could not deliver signal %d to worker %d core %d\n", sig, wid, core_id);
+	}
+}
+
 void uwsgi_route_signal(uint8_t sig) {
 
 	int pos = (uwsgi.mywid * 256) + sig;
@@ -319,14 +414,14 @@ void uwsgi_route_signal(uint8_t sig) {
 
 	// send to first available worker
 	if (use->receiver[0] == 0 || !strcmp(use->receiver, "worker") || !strcmp(use->receiver, "worker0")) {
-		if (uwsgi_signal_send(ushared->worker_signal_pipe[0], sig)) {
+		if (uwsgi_signal_deliver(ushared->worker_signal_pipe[0], &ushared->worker_signal_queue, sig)) {
 			uwsgi_log("could not deliver signal %d to workers pool\n", sig);
 		}
 	}
 	// send to all workers
 	else if (!strcmp(use->receiver, "workers")) {
 		for (i = 1; i <= uwsgi.numproc; i++) {
-			if (uwsgi_signal_send(uwsgi.workers[i].signal_pipe[0], sig)) {
+			if (uwsgi_signal_deliver(uwsgi.workers[i].signal_pipe[0], &uwsgi.workers[i].signal_queue, sig)) {
 				uwsgi_log("could not deliver signal %d to worker %d\n", sig, i);
 			}
 		}
@@ -335,19 +430,23 @@ void uwsgi_route_signal(uint8_t sig) {
 	else if (!strcmp(use->receiver, "active-workers")) {
                 for (i = 1; i <= uwsgi.numproc; i++) {
 			if (uwsgi.workers[i].pid > 0 && !uwsgi.workers[i].cheaped && !uwsgi.workers[i].suspended) {
-                        	if (uwsgi_signal_send(uwsgi.workers[i].signal_pipe[0], sig)) {
+                        	if (uwsgi_signal_deliver(uwsgi.workers[i].signal_pipe[0], &uwsgi.workers[i].signal_queue, sig)) {
                                 	uwsgi_log("could not deliver signal %d to worker %d\n", sig, i);
                         	}
 			}
                 }
         }
+	// route to a specific core of a worker (workerN:coreM)
+	else if (!strncmp(use->receiver, "worker", 6) && strstr(use->receiver, ":core")) {
+		uwsgi_route_signal_to_core(use->receiver, sig);
+	}
 	// route to specific worker
 	else if (!strncmp(use->receiver, "worker", 6)) {
 		i = atoi(use->receiver + 6);
 		if (i > uwsgi.numproc) {
 			uwsgi_log("invalid signal target: %s\n", use->receiver);
 		}
-		if (uwsgi_signal_send(uwsgi.workers[i].signal_pipe[0], sig)) {
+		if (uwsgi_signal_deliver(uwsgi.workers[i].signal_pipe[0], &uwsgi.workers[i].signal_queue, sig)) {
 			uwsgi_log("could not deliver signal %d to worker %d\n", sig, i);
 		}
 	}
@@ -357,14 +456,14 @@ void uwsgi_route_signal(uint8_t sig) {
 	// route to spooler
 	else if (!strcmp(use->receiver, "spooler")) {
 		if (ushared->worker_signal_pipe[0] != -1) {
-			if (uwsgi_signal_send(ushared->spooler_signal_pipe[0], sig)) {
+			if (uwsgi_signal_deliver(ushared->spooler_signal_pipe[0], &ushared->spooler_signal_queue, sig)) {
 				uwsgi_log("could not deliver signal %d to the spooler\n", sig);
 			}
 		}
 	}
 	else if (!strcmp(use->receiver, "mules")) {
 		for (i = 0; i < uwsgi.mules_cnt; i++) {
-			if (uwsgi_signal_send(uwsgi.mules[i].signal_pipe[0], sig)) {
+			if (uwsgi_signal_deliver(uwsgi.mules[i].signal_pipe[0], &uwsgi.mules[i].signal_queue, sig)) {
 				uwsgi_log("could not deliver signal %d to mule %d\n", sig, i + 1);
 			}
 		}
@@ -375,12 +474,12 @@ void uwsgi_route_signal(uint8_t sig) {
 			uwsgi_log("invalid signal target: %s\n", use->receiver);
 		}
 		else if (i == 0) {
-			if (uwsgi_signal_send(ushared->mule_signal_pipe[0], sig)) {
+			if (uwsgi_signal_deliver(ushared->mule_signal_pipe[0], &ushared->mule_signal_queue, sig)) {
 				uwsgi_log("could not deliver signal %d to a mule\n", sig);
 			}
 		}
 		else {
-			if (uwsgi_signal_send(uwsgi.mules[i - 1].signal_pipe[0], sig)) {
+			if (uwsgi_signal_deliver(uwsgi.mules[i - 1].signal_pipe[0], &uwsgi.mules[i - 1].signal_queue, sig)) {
 				uwsgi_log("could not deliver signal %d to mule %d\n", sig, i);
 			}
 		}
@@ -392,7 +491,7 @@ void uwsgi_route_signal(uint8_t sig) {
 			uwsgi_log("unknown farm: %s\n", name);
 			return;
 		}
-		if (uwsgi_signal_send(uf->signal_pipe[0], sig)) {
+		if (uwsgi_signal_deliver(uf->signal_pipe[0], &uf->signal_queue, sig)) {
 			uwsgi_log("could not deliver signal %d to farm %d (%s)\n", sig, uf->id, uf->name);
 		}
 	}
@@ -402,7 +501,7 @@ void uwsgi_route_signal(uint8_t sig) {
 			uwsgi_log("invalid signal target: %s\n", use->receiver);
 		}
 		else {
-			if (uwsgi_signal_send(uwsgi.farms[i - 1].signal_pipe[0], sig)) {
+			if (uwsgi_signal_deliver(uwsgi.farms[i - 1].signal_pipe[0], &uwsgi.farms[i - 1].signal_queue, sig)) {
 				uwsgi_log("could not deliver signal %d to farm %d (%s)\n", sig, i, uwsgi.farms[i - 1].name);
 			}
 		}
@@ -440,7 +539,7 @@ cycle:
 				uwsgi_error("read()");
 			}
 			else {
-				(void) uwsgi_signal_handler(wsgi_req, uwsgi_signal);
+				if (uwsgi_signal_dispatch(wsgi_req, uwsgi.signal_socket, uwsgi_signal) == -2) goto cycle;
 				if (wait_for_specific_signal) {
 					if (signum != uwsgi_signal)
 						goto cycle;
@@ -453,7 +552,7 @@ cycle:
 				uwsgi_error("read()");
 			}
 			else {
-				(void) uwsgi_signal_handler(wsgi_req, uwsgi_signal);
+				if (uwsgi_signal_dispatch(wsgi_req, uwsgi.my_signal_socket, uwsgi_signal) == -2) goto cycle;
 				if (wait_for_specific_signal) {
 					if (signum != uwsgi_signal)
 						goto cycle;
@@ -469,9 +568,14 @@ cycle:
 
 void uwsgi_receive_signal(struct wsgi_request *wsgi_req, int fd, char *name, int id) {
 
-	uint8_t uwsgi_signal;
+	uint8_t signals[64];
+	ssize_t i;
+
+	// drain a batch of signals, but only from private pipes (leave the shared ones to the other processes)
+	size_t batch = 1;
+	if (fd == uwsgi.my_signal_socket || (uwsgi.core_signals && uwsgi.mywid > 0 && fd != uwsgi.signal_socket)) batch = 64;
 
-	ssize_t ret = read(fd, &uwsgi_signal, 1);
+	ssize_t ret = read(fd, signals, batch);
 
 	if (ret == 0) {
 		goto destroy;
@@ -480,12 +584,14 @@ void uwsgi_receive_signal(struct wsgi_request *wsgi_req, int fd, char *name, int
 		uwsgi_error("[uwsgi-signal] read()");
 		goto destroy;
 	}
-	else if (ret > 0) {
+
+	for (i = 0; i < ret; i++) {
 #ifdef UWSGI_DEBUG
-		uwsgi_log_verbose("master sent signal %d to %s %d\n", uwsgi_signal, name, id);
+		uwsgi_log_verbose("master sent signal %d to %s %d\n", signals[i], name, id);
 #endif
-		if (uwsgi_signal_handler(wsgi_req, uwsgi_signal)) {
-			uwsgi_log_verbose("error managing signal %d on %s %d\n", uwsgi_signal, name, id);
+		int sret = uwsgi_signal_dispatch(wsgi_req, fd, signals[i]);
+		if (sret && sret != -2) {
+			uwsgi_log_verbose("error managing signal %d on %s %d\n", signals[i], name, id);
 		}
 	}
 
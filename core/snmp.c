@@ -449,15 +449,17 @@ int uwsgi_setup_snmp(void) {
 }
 
 void uwsgi_master_manage_snmp(int snmp_fd) {
-        struct sockaddr_in udp_client;
-        socklen_t udp_len = sizeof(udp_client);
-        ssize_t rlen = recvfrom(snmp_fd, uwsgi.wsgi_req->buffer, uwsgi.buffer_size, 0, (struct sockaddr *) &udp_client, &udp_len);
-
-        if (rlen < 0) {
-                uwsgi_error("recvfrom()");
-        }
-        else if (rlen > 0) {
-                manage_snmp(snmp_fd, (uint8_t *) uwsgi.wsgi_req->buffer, rlen, &udp_client);
-        }
-}
+	static struct uwsgi_dgram_batch *udb = NULL;
+	if (!udb) udb = uwsgi_dgram_batch_new(UWSGI_DGRAM_BATCH, uwsgi.buffer_size);
+
+	int i, n = uwsgi_dgram_batch_recv(snmp_fd, udb);
+	if (n < 0) {
+		uwsgi_error("recvmmsg()");
+		return;
+	}
 
+	for(i=0;i<n;i++) {
+		if (udb->len[i] <= 0) continue;
+		manage_snmp(snmp_fd, (uint8_t *) uwsgi_dgram_batch_buf(udb, i), udb->len[i], (struct sockaddr_in *) &udb->addr[i]);
+	}
+}
@@ -380,6 +380,114 @@ int uwsgi_connect(char *socket_name, int timeout, int async) {
 	return fd;
 }
 
+/*
+	batched datagrams
+
+	a batch is allocated once by every consumer, uwsgi_dgram_batch_recv() fills it with
+	a single recvmmsg() (or a recvfrom() loop) without blocking and returns the number of datagrams
+*/
+struct uwsgi_dgram_batch *uwsgi_dgram_batch_new(int max, size_t size) {
+	struct uwsgi_dgram_batch *udb = uwsgi_calloc(sizeof(struct uwsgi_dgram_batch));
+	udb->max = max;
+	udb->size = size;
+	udb->buf = uwsgi_malloc(max * size);
+	udb->addr = uwsgi_calloc(sizeof(struct sockaddr_storage) * max);
+	udb->addr_len = uwsgi_calloc(sizeof(socklen_t) * max);
+	udb->len = uwsgi_calloc(sizeof(ssize_t) * max);
+#ifdef __linux__
+	int i;
+	udb->iov = uwsgi_calloc(sizeof(struct iovec) * max);
+	udb->msgs = uwsgi_calloc(sizeof(struct mmsghdr) * max);
+	for(i=0;i<max;i++) {
+		udb->iov[i].iov_base = udb->buf + (i * size);
+		udb->iov[i].iov_len = size;
+		udb->msgs[i].msg_hdr.msg_iov = &udb->iov[i];
+		udb->msgs[i].msg_hdr.msg_iovlen = 1;
+		udb->msgs[i].msg_hdr.msg_name = &udb->addr[i];
+	}
+#endif
+	return udb;
+}
+
+int uwsgi_dgram_batch_recv(int fd, struct uwsgi_dgram_batch *udb) {
+	int i;
+#ifdef __linux__
+	for(i=0;i<udb->max;i++) {
+		udb->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+	}
+	int ret = recvmmsg(fd, udb->msgs, udb->max, MSG_DONTWAIT, NULL);
+	if (ret < 0) {
+		if (uwsgi_is_again()) return 0;
+		return -1;
+	}
+	for(i=0;i<ret;i++) {
+		udb->len[i] = udb->msgs[i].msg_len;
+		udb->addr_len[i] = udb->msgs[i].msg_hdr.msg_namelen;
+	}
+	return ret;
+#else
+	for(i=0;i<udb->max;i++) {
+		udb->addr_len[i] = sizeof(struct sockaddr_storage);
+		udb->len[i] = recvfrom(fd, udb->buf + (i * udb->size), udb->size, MSG_DONTWAIT, (struct sockaddr *) &udb->addr[i], &udb->addr_len[i]);
+		if (udb->len[i] < 0) {
+			if (i > 0 || uwsgi_is_again()) return i;
+			return -1;
+		}
+	}
+	return i;
+#endif
+}
+
+/*
+	send every packet to every node (the address is in custom_ptr, its size in custom),
+	the socket should be non blocking, returns the number of datagrams not sent
+*/
+int uwsgi_dgram_send_nodes(int fd, struct iovec *iov, int n, struct uwsgi_string_list *nodes) {
+	int i, j, k = 0, nodes_cnt = 0;
+	struct uwsgi_string_list *usl;
+	uwsgi_foreach(usl, nodes) nodes_cnt++;
+	if (!n || !nodes_cnt) return 0;
+#ifdef __linux__
+	struct mmsghdr *msgs = uwsgi_calloc(sizeof(struct mmsghdr) * n * nodes_cnt);
+	uwsgi_foreach(usl, nodes) {
+		for(i=0;i<n;i++) {
+			msgs[k].msg_hdr.msg_iov = &iov[i];
+			msgs[k].msg_hdr.msg_iovlen = 1;
+			msgs[k].msg_hdr.msg_name = usl->custom_ptr;
+			msgs[k].msg_hdr.msg_namelen = usl->custom;
+			k++;
+		}
+	}
+	for(j=0;j<k;) {
+		int ret = sendmmsg(fd, msgs + j, k - j, 0);
+		if (ret <= 0) {
+			uwsgi_error("uwsgi_dgram_send_nodes()/sendmmsg()");
+			break;
+		}
+		j += ret;
+	}
+	free(msgs);
+	return k - j;
+#else
+	struct msghdr mh;
+	int lost = 0;
+	memset(&mh, 0, sizeof(struct msghdr));
+	mh.msg_iovlen = 1;
+	uwsgi_foreach(usl, nodes) {
+		mh.msg_name = usl->custom_ptr;
+		mh.msg_namelen = usl->custom;
+		for(i=0;i<n;i++) {
+			mh.msg_iov = &iov[i];
+			if (sendmsg(fd, &mh, 0) <= 0) {
+				uwsgi_error("uwsgi_dgram_send_nodes()/sendmsg()");
+				lost++;
+			}
+		}
+	}
+	return lost;
+#endif
+}
+
 int uwsgi_connect_udp(char *socket_name) {
 	int fd = -1;
 	char *zeroed_socket_name = uwsgi_str(socket_name);
@@ -453,6 +561,13 @@ static int connect_to_tcp(char *socket_name, int port, int timeout, int async) {
 	}
 	else {
 		uws_addr.sin_addr.s_addr = inet_addr(socket_name);
+		// hostnames (cached with --dns-cache-ttl)
+		if (uws_addr.sin_addr.s_addr == INADDR_NONE) {
+			char *resolved = uwsgi_resolve_ip(socket_name);
+			if (resolved) {
+				uws_addr.sin_addr.s_addr = inet_addr(resolved);
+			}
+		}
 	}
 
 #if defined(__linux__) && defined(SOCK_NONBLOCK) && !defined(OBSOLETE_LINUX_KERNEL)
@@ -734,10 +849,13 @@ int bind_to_tcp(char *socket_name, int listen_queue, char *tcp_port) {
 		}
 	}
 
+	uwsgi_socket_busy_poll(serverfd);
+
 	if (!uwsgi.no_defer_accept) {
 
 #ifdef __linux__
-		if (setsockopt(serverfd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &uwsgi.socket_timeout, sizeof(int))) {
+		int defer_accept = uwsgi.defer_accept_timeout > 0 ? uwsgi.defer_accept_timeout : uwsgi.socket_timeout;
+		if (setsockopt(serverfd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &defer_accept, sizeof(int))) {
 			uwsgi_error("TCP_DEFER_ACCEPT setsockopt()");
 		}
 		// OSX has no SO_ACCEPTFILTER !!!
@@ -781,6 +899,22 @@ int bind_to_tcp(char *socket_name, int listen_queue, char *tcp_port) {
 	return serverfd;
 }
 
+// busy polling of the device queue (accepted sockets inherit it from the listener)
+void uwsgi_socket_busy_poll(int fd) {
+#ifdef __linux__
+	if (uwsgi.so_busy_poll > 0) {
+		if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &uwsgi.so_busy_poll, sizeof(int))) {
+			uwsgi_error("SO_BUSY_POLL setsockopt()");
+		}
+	}
+	if (uwsgi.so_prefer_busy_poll) {
+		if (setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &uwsgi.so_prefer_busy_poll, sizeof(int))) {
+			uwsgi_error("SO_PREFER_BUSY_POLL setsockopt()");
+		}
+	}
+#endif
+}
+
 // set non-blocking socket
 void uwsgi_socket_nb(int fd) {
 	int arg;
@@ -839,6 +973,18 @@ int timed_connect(struct pollfd *fdpoll, const struct sockaddr *addr, int addr_s
 	}
 #endif
 
+	if (addr->sa_family != AF_UNIX) uwsgi_socket_busy_poll(fdpoll->fd);
+
+#ifdef __linux__
+	// connect() returns immediately, the SYN will carry the first write() (when a cookie is available)
+	if (addr->sa_family != AF_UNIX && uwsgi.tcp_fast_open_client) {
+		int on = 1;
+		if (setsockopt(fdpoll->fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &on, sizeof(int))) {
+			uwsgi_error("TCP_FASTOPEN_CONNECT setsockopt()");
+		}
+	}
+	ret = connect(fdpoll->fd, addr, addr_size);
+#else
 #ifdef MSG_FASTOPEN
 	if (addr->sa_family == AF_INET && uwsgi.tcp_fast_open_client) {
 		ret = sendto(fdpoll->fd, "", 0, MSG_FASTOPEN, addr, addr_size);
@@ -848,6 +994,7 @@ int timed_connect(struct pollfd *fdpoll, const struct sockaddr *addr, int addr_s
 		ret = connect(fdpoll->fd, addr, addr_size);
 #ifdef MSG_FASTOPEN
 	}
+#endif
 #endif
 
 	if (async) {
@@ -1447,6 +1594,15 @@ void uwsgi_manage_zerg(int fd, int num_sockets, int *sockets) {
 		return;
 	}
 
+	uwsgi_send_zerg(zerg_client, num_sockets, sockets);
+	close(zerg_client);
+}
+
+// pass the fds to an already connected zerg
+int uwsgi_send_zerg(int zerg_client, int num_sockets, int *sockets) {
+
+	int ret = 0;
+
 	if (!num_sockets) {
 		num_sockets = uwsgi_count_sockets(uwsgi.sockets);
 	}
@@ -1501,12 +1657,12 @@ nextsock:
 
 	if (sendmsg(zerg_client, &zerg_msg, 0) < 0) {
 		uwsgi_error("sendmsg()");
+		ret = -1;
 	}
 
 	free(zerg_msg_control);
 
-	close(zerg_client);
-
+	return ret;
 }
 
 
@@ -1643,7 +1799,208 @@ void uwsgi_setup_shared_sockets() {
 
 }
 
+/*
+	socket qos (--socket-qos socket=<num|name>,priority=N,weight=N,reserved=N,shed=N)
+
+	priority: on wakeup a worker accepts from the ready socket with the highest priority
+	weight: ready sockets with the same priority are served by smooth weighted round robin
+	reserved: the last N workers only accept from the socket
+	shed: connections accepted while the listen queue is over N are rejected (503 for http)
+*/
+
+#define UWSGI_SOCKET_QOS_MAX 64
+
+void uwsgi_setup_socket_qos() {
+	int reserved = 0;
+	struct uwsgi_string_list *usl = NULL;
+	uwsgi_foreach(usl, uwsgi.socket_qos) {
+		char *s_socket = NULL;
+		char *s_priority = NULL;
+		char *s_weight = NULL;
+		char *s_reserved = NULL;
+		char *s_shed = NULL;
+		if (uwsgi_kvlist_parse(usl->value, usl->len, ',', '=',
+			"socket", &s_socket,
+			"priority", &s_priority,
+			"weight", &s_weight,
+			"reserved", &s_reserved,
+			"shed", &s_shed,
+			NULL)) {
+			uwsgi_log("invalid --socket-qos keyval syntax: %s\n", usl->value);
+			exit(1);
+		}
+
+		if (!s_socket) {
+			uwsgi_log("--socket-qos: you need to specify the socket\n");
+			exit(1);
+		}
+
+		struct uwsgi_socket *uwsgi_sock = uwsgi.sockets;
+		while (uwsgi_sock) {
+			if (is_a_number(s_socket)) {
+				if (atoi(s_socket) == uwsgi_get_socket_num(uwsgi_sock)) break;
+			}
+			else if (uwsgi_sock->name && !strcmp(uwsgi_sock->name, s_socket)) {
+				break;
+			}
+			uwsgi_sock = uwsgi_sock->next;
+		}
+
+		if (!uwsgi_sock) {
+			uwsgi_log("--socket-qos: unable to find socket \"%s\"\n", s_socket);
+			exit(1);
+		}
+
+		if (s_priority) {
+			uwsgi_sock->priority = atoi(s_priority);
+			uwsgi.sockets_qos = 1;
+		}
+
+		if (s_weight) {
+			uwsgi_sock->weight = atoi(s_weight);
+			if (uwsgi_sock->weight < 1) {
+				uwsgi_log("--socket-qos: invalid weight for socket \"%s\"\n", uwsgi_sock->name);
+				exit(1);
+			}
+			uwsgi.sockets_qos = 1;
+		}
+
+		if (s_reserved) {
+			uwsgi_sock->reserved = atoi(s_reserved);
+			reserved += uwsgi_sock->reserved;
+		}
+
+		if (s_shed) {
+			uwsgi_sock->shed_backlog = uwsgi_n64(s_shed);
+			uwsgi_sock->shed = uwsgi_calloc_shared(sizeof(uint64_t));
+		}
+
+		uwsgi_log_initial("socket %d (%s) qos: priority %d weight %d reserved workers %d shed backlog %llu\n", uwsgi_get_socket_num(uwsgi_sock), uwsgi_sock->name,
+			uwsgi_sock->priority, uwsgi_sock->weight ? uwsgi_sock->weight : 1, uwsgi_sock->reserved, (unsigned long long) uwsgi_sock->shed_backlog);
+	}
+
+	if (reserved > 0 && reserved >= uwsgi.numproc) {
+		uwsgi_log("--socket-qos: %d workers reserved, you need at least %d processes\n", reserved, reserved + 1);
+		exit(1);
+	}
+
+	if (!uwsgi.sockets_qos) return;
+
+	struct uwsgi_socket *uwsgi_sock = uwsgi.sockets;
+	while (uwsgi_sock) {
+		if (!uwsgi_sock->weight) uwsgi_sock->weight = 1;
+		uwsgi_sock->qos_current = uwsgi_calloc(sizeof(int) * uwsgi.cores);
+		uwsgi_sock = uwsgi_sock->next;
+	}
+}
+
+// the socket the worker is reserved to (if any)
+static struct uwsgi_socket *uwsgi_socket_qos_reserved(int wid) {
+	int base = uwsgi.numproc;
+	struct uwsgi_socket *uwsgi_sock = uwsgi.sockets;
+	while (uwsgi_sock) {
+		if (uwsgi_sock->reserved > 0) {
+			if (wid > base - uwsgi_sock->reserved && wid <= base) return uwsgi_sock;
+			base -= uwsgi_sock->reserved;
+		}
+		uwsgi_sock = uwsgi_sock->next;
+	}
+	return NULL;
+}
+
+static int uwsgi_socket_qos_queue_fd(struct uwsgi_socket *uwsgi_sock, int async_id) {
+	if (uwsgi_sock->fd_threads && uwsgi_sock->fd_threads[async_id] > -1) return uwsgi_sock->fd_threads[async_id];
+	return uwsgi_sock->fd;
+}
+
+/*
+	called after a wakeup, returns the fd to accept from: the woken socket is ready for sure,
+	the others with the same or a higher priority are checked with a non blocking poll()
+*/
+int uwsgi_socket_qos_fd(struct wsgi_request *wsgi_req, int interesting_fd) {
+	int async_id = wsgi_req->async_id;
+	struct pollfd pfd[UWSGI_SOCKET_QOS_MAX];
+	struct uwsgi_socket *candidates[UWSGI_SOCKET_QOS_MAX];
+	struct uwsgi_socket *woken = NULL;
+	int i, n = 0;
+
+	struct uwsgi_socket *uwsgi_sock = uwsgi.sockets;
+	while (uwsgi_sock) {
+		// kept-alive connections are always managed first
+		if (uwsgi_sock->retry && uwsgi_sock->retry[async_id]) return interesting_fd;
+		if (uwsgi_socket_qos_queue_fd(uwsgi_sock, async_id) == interesting_fd) woken = uwsgi_sock;
+		uwsgi_sock = uwsgi_sock->next;
+	}
+
+	if (!woken) return interesting_fd;
+
+	uwsgi_sock = uwsgi.sockets;
+	while (uwsgi_sock && n < UWSGI_SOCKET_QOS_MAX) {
+		int fd = uwsgi_socket_qos_queue_fd(uwsgi_sock, async_id);
+		if (uwsgi_sock != woken && fd > -1 && uwsgi_sock->priority >= woken->priority) {
+			pfd[n].fd = fd;
+			pfd[n].events = POLLIN;
+			pfd[n].revents = 0;
+			candidates[n] = uwsgi_sock;
+			n++;
+		}
+		uwsgi_sock = uwsgi_sock->next;
+	}
+
+	if (!n || poll(pfd, n, 0) <= 0) return interesting_fd;
+
+	int priority = woken->priority;
+	for (i = 0; i < n; i++) {
+		if ((pfd[i].revents & POLLIN) && candidates[i]->priority > priority) priority = candidates[i]->priority;
+	}
+
+	// smooth weighted round robin between the ready sockets with the highest priority
+	struct uwsgi_socket *best = NULL;
+	int total = 0;
+	if (woken->priority == priority) {
+		woken->qos_current[async_id] += woken->weight;
+		total += woken->weight;
+		best = woken;
+	}
+	for (i = 0; i < n; i++) {
+		uwsgi_sock = candidates[i];
+		if (!(pfd[i].revents & POLLIN) || uwsgi_sock->priority != priority) continue;
+		uwsgi_sock->qos_current[async_id] += uwsgi_sock->weight;
+		total += uwsgi_sock->weight;
+		if (!best || uwsgi_sock->qos_current[async_id] > best->qos_current[async_id]) best = uwsgi_sock;
+	}
+	best->qos_current[async_id] -= total;
+	return uwsgi_socket_qos_queue_fd(best, async_id);
+}
+
+// reject a just accepted connection if the listen queue of its socket is over the limit
+int uwsgi_socket_shed(struct wsgi_request *wsgi_req) {
+	struct uwsgi_socket *uwsgi_sock = wsgi_req->socket;
+	// kept-alive connections are not new load
+	if (uwsgi_sock->retry && uwsgi_sock->retry[wsgi_req->async_id]) return 0;
+	uwsgi_update_listen_queue(uwsgi_sock);
+	if (uwsgi_sock->queue <= uwsgi_sock->shed_backlog) return 0;
+
+	if (uwsgi_sock->proto_name && (!strcmp(uwsgi_sock->proto_name, "http") || !strcmp(uwsgi_sock->proto_name, "http11"))) {
+		static char busy[] = "HTTP/1.0 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+		char buf[4096];
+		// consume the already received request, otherwise close() resets the connection
+		ssize_t rlen = recv(wsgi_req->fd, buf, sizeof(buf), MSG_DONTWAIT);
+		// best effort (the socket buffer of a new connection is empty), errors are not logged under overload
+		rlen = write(wsgi_req->fd, busy, sizeof(busy) - 1);
+		(void) rlen;
+	}
+	close(wsgi_req->fd);
+	wsgi_req->fd = -1;
+	__sync_add_and_fetch(uwsgi_sock->shed, 1);
+	return 1;
+}
+
 void uwsgi_map_sockets() {
+	struct uwsgi_socket *reserved = uwsgi_socket_qos_reserved(uwsgi.mywid);
+	if (reserved) {
+		uwsgi_log("worker %d reserved to socket %d (%s)\n", uwsgi.mywid, uwsgi_get_socket_num(reserved), reserved->name);
+	}
 	struct uwsgi_socket *uwsgi_sock = uwsgi.sockets;
 	while (uwsgi_sock) {
 		struct uwsgi_string_list *usl = uwsgi.map_socket;
@@ -1675,6 +2032,10 @@ void uwsgi_map_sockets() {
 			usl = usl->next;
 		}
 
+		if (reserved && uwsgi_sock != reserved) {
+			enabled = 0;
+		}
+
 		if (!enabled) {
 			close(uwsgi_sock->fd);
 			uwsgi_remap_fd(uwsgi_sock->fd, "/dev/null");
@@ -1698,6 +2059,68 @@ void uwsgi_map_sockets() {
 
 }
 
+// bind a listener for each worker, the kernel will balance connections between them
+void uwsgi_setup_socket_shards() {
+	if (!uwsgi.reuse_port_workers || uwsgi.numproc < 2) return;
+#ifdef SO_REUSEPORT
+	struct uwsgi_socket *uwsgi_sock = uwsgi.sockets;
+	while (uwsgi_sock) {
+		char *tcp_port = strrchr(uwsgi_sock->name, ':');
+		if (uwsgi_sock->fd < 0 || uwsgi_sock->family == AF_UNIX || uwsgi_sock->per_core || !tcp_port) goto next;
+		int i;
+		// the first listener is the socket itself (could be inherited on reload)
+		uwsgi_sock->shards = uwsgi_malloc(sizeof(int) * uwsgi.numproc);
+		uwsgi_sock->shards[0] = uwsgi_sock->fd;
+		for(i=1;i<uwsgi.numproc;i++) {
+			uwsgi_sock->shards[i] = bind_to_tcp(uwsgi_sock->name, uwsgi.listen_queue, tcp_port);
+			if (uwsgi_sock->shards[i] < 0) {
+				uwsgi_log("unable to bind SO_REUSEPORT listener %d for %s\n", i, uwsgi_sock->name);
+				exit(1);
+			}
+			uwsgi_socket_nb(uwsgi_sock->shards[i]);
+		}
+		uwsgi_sock->shards_cnt = uwsgi.numproc;
+		uwsgi_log("uwsgi socket %d sharded in %d SO_REUSEPORT listeners\n", uwsgi_get_socket_num(uwsgi_sock), uwsgi_sock->shards_cnt);
+next:
+		uwsgi_sock = uwsgi_sock->next;
+	}
+#else
+	uwsgi_log("your system does not support SO_REUSEPORT, unable to bind a listener for each worker\n");
+	exit(1);
+#endif
+}
+
+// use the listener of the worker, closing the ones of the others
+void uwsgi_attach_socket_shards() {
+	struct uwsgi_socket *uwsgi_sock = uwsgi.sockets;
+	while (uwsgi_sock) {
+		if (uwsgi_sock->shards_cnt > 0) {
+			int i;
+			int shard = (uwsgi.mywid - 1) % uwsgi_sock->shards_cnt;
+			for(i=0;i<uwsgi_sock->shards_cnt;i++) {
+				if (i != shard) close(uwsgi_sock->shards[i]);
+			}
+			uwsgi_sock->fd = uwsgi_sock->shards[shard];
+			if (uwsgi.reuse_port_incoming_cpu && uwsgi.cpus > 0) {
+#ifdef SO_INCOMING_CPU
+				// the first cpu of the worker (see uwsgi_set_cpu_affinity() and uwsgi_numa_worker())
+				int cpu = ((uwsgi.mywid - 1) * (uwsgi.cpu_affinity > 0 ? uwsgi.cpu_affinity : 1)) % uwsgi.cpus;
+				if (!uwsgi.cpu_affinity && uwsgi.numa_workers) {
+					int numa_cpu = uwsgi_numa_worker_cpu(uwsgi.mywid);
+					if (numa_cpu >= 0) cpu = numa_cpu;
+				}
+				if (setsockopt(uwsgi_sock->fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(int))) {
+					uwsgi_error("uwsgi_attach_socket_shards()/setsockopt()");
+				}
+#else
+				uwsgi_log("your system does not support SO_INCOMING_CPU\n");
+#endif
+			}
+		}
+		uwsgi_sock = uwsgi_sock->next;
+	}
+}
+
 void uwsgi_bind_sockets() {
 	socklen_t socket_type_len;
 	union uwsgi_sockaddr usa;
@@ -1947,6 +2370,107 @@ int uwsgi_socket_passcred(int fd) {
 #endif
 }
 
+/*
+	persistent connections to external services (router_redis, router_memcached...)
+
+	each core has its own pool (no locking needed), a connection is taken out of the pool
+	while in use and given back only after the whole response has been consumed.
+	Idle connections closed by the server are detected (and dropped) before being reused.
+*/
+struct uwsgi_pooled_connection {
+	char *addr;
+	int fd;
+	struct uwsgi_pooled_connection *next;
+};
+
+static struct uwsgi_pooled_connection **uwsgi_connection_pools;
+
+static int pooled_connection_alive(int fd) {
+	char c;
+	ssize_t ret = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+	// nothing to read, the connection is still idle
+	if (ret < 0 && uwsgi_is_again()) return 1;
+	return 0;
+}
+
+int uwsgi_pool_connect(char *addr, int core) {
+	if (core >= 0 && core < uwsgi.cores) {
+		if (!uwsgi_connection_pools) {
+			uwsgi_connection_pools = uwsgi_calloc(sizeof(struct uwsgi_pooled_connection *) * uwsgi.cores);
+		}
+		struct uwsgi_pooled_connection *upc = uwsgi_connection_pools[core];
+		while (upc) {
+			if (upc->fd > -1 && !strcmp(upc->addr, addr)) {
+				int fd = upc->fd;
+				upc->fd = -1;
+				if (pooled_connection_alive(fd)) return fd;
+				close(fd);
+				break;
+			}
+			upc = upc->next;
+		}
+	}
+
+	int fd = uwsgi_connect(addr, 0, 1);
+	if (fd < 0) return -1;
+	// wait for connection
+	if (uwsgi.wait_write_hook(fd, uwsgi.socket_timeout) <= 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+void uwsgi_pool_release(char *addr, int core, int fd) {
+	if (!uwsgi_connection_pools || core < 0 || core >= uwsgi.cores) {
+		close(fd);
+		return;
+	}
+	struct uwsgi_pooled_connection *upc = uwsgi_connection_pools[core];
+	while (upc) {
+		if (!strcmp(upc->addr, addr)) {
+			if (upc->fd > -1) {
+				close(fd);
+				return;
+			}
+			upc->fd = fd;
+			return;
+		}
+		upc = upc->next;
+	}
+	upc = uwsgi_malloc(sizeof(struct uwsgi_pooled_connection));
+	upc->addr = uwsgi_str(addr);
+	upc->fd = fd;
+	upc->next = uwsgi_connection_pools[core];
+	uwsgi_connection_pools[core] = upc;
+}
+
+/*
+	sharding: choose one address from a '|' separated list (jump consistent hash of the key),
+	a new string is always returned
+*/
+char *uwsgi_shard_addr(char *addrs, size_t addrs_len, char *key, size_t keylen) {
+	uint32_t count = 1;
+	size_t i;
+	for (i = 0; i < addrs_len; i++) {
+		if (addrs[i] == '|') count++;
+	}
+	if (count == 1) return uwsgi_concat2n(addrs, addrs_len, "", 0);
+
+	uint32_t shard = uwsgi_jump_hash(djb33x_hash(key, keylen), count);
+	char *ptr = addrs;
+	size_t len = addrs_len;
+	while (shard > 0) {
+		char *next = memchr(ptr, '|', len);
+		len -= (next - ptr) + 1;
+		ptr = next + 1;
+		shard--;
+	}
+	char *end = memchr(ptr, '|', len);
+	if (end) len = end - ptr;
+	return uwsgi_concat2n(ptr, len, "", 0);
+}
+
 void uwsgi_protocols_register() {
 	uwsgi_register_protocol("uwsgi", uwsgi_proto_uwsgi_setup);
 	uwsgi_register_protocol("puwsgi", uwsgi_proto_puwsgi_setup);
@@ -1954,6 +2478,9 @@ void uwsgi_protocols_register() {
 	uwsgi_register_protocol("http", uwsgi_proto_http_setup);
 	uwsgi_register_protocol("http11", uwsgi_proto_http11_setup);
 
+	uwsgi_register_protocol("uwsgi-handoff", uwsgi_proto_uwsgi_handoff_setup);
+	uwsgi_register_protocol("http-handoff", uwsgi_proto_http_handoff_setup);
+
 #ifdef UWSGI_SSL
 	uwsgi_register_protocol("suwsgi", uwsgi_proto_suwsgi_setup);
 	uwsgi_register_protocol("https", uwsgi_proto_https_setup);
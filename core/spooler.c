@@ -9,6 +9,8 @@ extern struct uwsgi_server uwsgi;
 static void spooler_readdir(struct uwsgi_spooler *, char *dir);
 static void spooler_scandir(struct uwsgi_spooler *, char *dir);
 static void spooler_manage_task(struct uwsgi_spooler *, char *, char *);
+struct spooler_req;
+static char *spooler_write_file(struct uwsgi_spooler *, struct spooler_req *, char *, size_t, char *, size_t);
 
 // increment it whenever a signal is raised
 static uint64_t wakeup = 0;
@@ -207,9 +209,6 @@ CHANGED in 2.0.7: wsgi_req is useless !
 */
 char *uwsgi_spool_request(struct wsgi_request *wsgi_req, char *buf, size_t len, char *body, size_t body_len) {
 
-	struct timeval tv;
-	static uint64_t internal_counter = 0;
-	int fd = -1;
 	struct spooler_req sr;
 
 	if (len > 0xffff) {
@@ -236,6 +235,20 @@ char *uwsgi_spool_request(struct wsgi_request *wsgi_req, char *buf, size_t len,
 		}
 	}
 
+	if (uspool->engine && uspool->engine->push) {
+		char *task = uspool->engine->push(uspool, buf, len, body, body_len, sr.at, sr.priority, sr.priority_len);
+		if (task) return task;
+	}
+
+	return spooler_write_file(uspool, &sr, buf, len, body, body_len);
+}
+
+static char *spooler_write_file(struct uwsgi_spooler *uspool, struct spooler_req *sr, char *buf, size_t len, char *body, size_t body_len) {
+
+	struct timeval tv;
+	static uint64_t internal_counter = 0;
+	int fd = -1;
+
 	// this lock is for threads, the pid value in filename will avoid multiprocess races
 	uwsgi_lock(uspool->lock);
 
@@ -247,10 +260,10 @@ char *uwsgi_spool_request(struct wsgi_request *wsgi_req, char *buf, size_t len,
 	char *filename = NULL;
 	size_t filename_len = 0;
 
-	if (sr.priority && sr.priority_len) {
-		filename_len = strlen(uspool->dir) + sr.priority_len + strlen(uwsgi.hostname) + 256;	
+	if (sr->priority && sr->priority_len) {
+		filename_len = strlen(uspool->dir) + sr->priority_len + strlen(uwsgi.hostname) + 256;	
 		filename = uwsgi_malloc(filename_len);
-		int ret = snprintf(filename, filename_len, "%s/%.*s", uspool->dir, (int) sr.priority_len, sr.priority);
+		int ret = snprintf(filename, filename_len, "%s/%.*s", uspool->dir, (int) sr->priority_len, sr->priority);
 		if (ret <= 0 || ret >= (int) filename_len) {
 			uwsgi_log("[uwsgi-spooler] error generating spooler filename\n");
 			free(filename);
@@ -260,7 +273,7 @@ char *uwsgi_spool_request(struct wsgi_request *wsgi_req, char *buf, size_t len,
 		// no need to check for errors...
 		(void) mkdir(filename, 0777);
 
-		ret = snprintf(filename, filename_len, "%s/%.*s/uwsgi_spoolfile_on_%s_%d_%llu_%d_%llu_%llu", uspool->dir, (int)sr.priority_len, sr.priority, uwsgi.hostname, (int) getpid(), (unsigned long long) internal_counter, rand(),
+		ret = snprintf(filename, filename_len, "%s/%.*s/uwsgi_spoolfile_on_%s_%d_%llu_%d_%llu_%llu", uspool->dir, (int)sr->priority_len, sr->priority, uwsgi.hostname, (int) getpid(), (unsigned long long) internal_counter, rand(),
 				(unsigned long long) tv.tv_sec, (unsigned long long) tv.tv_usec);
 		if (ret <= 0 || ret >=(int)  filename_len) {
                         uwsgi_log("[uwsgi-spooler] error generating spooler filename\n");
@@ -325,21 +338,21 @@ char *uwsgi_spool_request(struct wsgi_request *wsgi_req, char *buf, size_t len,
 		}
 	}
 
-	if (sr.at > 0) {
+	if (sr->at > 0) {
 #ifdef __UCLIBC__
 		struct timespec ts[2]; 
-		ts[0].tv_sec = sr.at; 
+		ts[0].tv_sec = sr->at; 
 		ts[0].tv_nsec = 0;
-		ts[1].tv_sec = sr.at;
+		ts[1].tv_sec = sr->at;
 		ts[1].tv_nsec = 0; 
 		if (futimens(fd, ts)) {
 			uwsgi_error("uwsgi_spooler_request()/futimens()");	
 		}
 #else
 		struct timeval tv[2];
-		tv[0].tv_sec = sr.at;
+		tv[0].tv_sec = sr->at;
 		tv[0].tv_usec = 0;
-		tv[1].tv_sec = sr.at;
+		tv[1].tv_sec = sr->at;
 		tv[1].tv_usec = 0;
 #ifdef __sun__
 		if (futimesat(fd, NULL, tv)) {
@@ -367,7 +380,7 @@ char *uwsgi_spool_request(struct wsgi_request *wsgi_req, char *buf, size_t len,
 
 	struct uwsgi_spooler *spoolers = uwsgi.spoolers;
 	while (spoolers) {
-		if (!strcmp(spoolers->dir, uspool->dir)) {
+		if (!strcmp(spoolers->dir, uspool->dir) && !spoolers->engine->notified) {
 			if (spoolers->pid > 0 && spoolers->running == 0) {
 				(void) kill(spoolers->pid, SIGUSR1);
 			}
@@ -433,6 +446,15 @@ void spooler(struct uwsgi_spooler *uspool) {
 
 	time_t last_task_managed = 0;
 
+	int engine_fd = -1;
+	if (uspool->engine->fd) {
+		engine_fd = uspool->engine->fd(uspool);
+		if (engine_fd > -1) {
+			event_queue_add_fd_read(spooler_event_queue, engine_fd);
+		}
+	}
+	int full = 1;
+
 	for (;;) {
 
 		if (chdir(uspool->dir)) {
@@ -440,12 +462,7 @@ void spooler(struct uwsgi_spooler *uspool) {
 			exit(1);
 		}
 
-		if (uwsgi.spooler_ordered) {
-			spooler_scandir(uspool, NULL);
-		}
-		else {
-			spooler_readdir(uspool, NULL);
-		}
+		uspool->engine->run(uspool, full);
 
 		// here we check (if in cheap mode), if the spooler has done its job
 		if (uwsgi.spooler_cheap) {
@@ -462,12 +479,17 @@ void spooler(struct uwsgi_spooler *uspool) {
 			timeout = 0;
 		}
 
+		full = 1;
 		if (event_queue_wait(spooler_event_queue, timeout, &interesting_fd) > 0) {
 			if (uwsgi.master_process) {
 				if (interesting_fd == uwsgi.shared->spooler_signal_pipe[1]) {
 					uwsgi_receive_signal(NULL, interesting_fd, "spooler", (int) getpid());
 				}
 			}
+			// only the new tasks, the periodic scan will manage the others
+			if (interesting_fd == engine_fd) {
+				full = 0;
+			}
 		}
 
 		// avoid races
@@ -523,9 +545,76 @@ static void spooler_readdir(struct uwsgi_spooler *uspool, char *dir) {
 	}
 }
 
+/*
+	run a task with the plugins spooler hooks
+
+	returns -2 when the task is done, -1 if it has to be retried and 0 if
+	no spooler function has been found
+*/
+static int spooler_run_task(struct uwsgi_spooler *uspool, char *task, char *spool_buf, uint16_t args_len, char *body, size_t body_len) {
+	int i, ret = 0;
+
+	// now the task is running and should not be woken up
+	uspool->running = 1;
+	// this is used in cheap mode for making decision about who must die
+	uspool->last_task_managed = uwsgi_now();
+
+	if (!uwsgi.spooler_quiet)
+		uwsgi_log("[spooler %s pid: %d] managing request %s ...\n", uspool->dir, (int) uwsgi.mypid, task);
+
+	// chdir before running the task (if requested)
+	if (uwsgi.spooler_chdir) {
+		if (chdir(uwsgi.spooler_chdir)) {
+			uwsgi_error("spooler_run_task()/chdir()");
+		}
+	}
+
+	int callable_found = 0;
+	for (i = 0; i < 256; i++) {
+		if (uwsgi.p[i]->spooler) {
+			time_t now = uwsgi_now();
+			if (uwsgi.harakiri_options.spoolers > 0) {
+				set_spooler_harakiri(uwsgi.harakiri_options.spoolers);
+			}
+			ret = uwsgi.p[i]->spooler(task, spool_buf, args_len, body, body_len);
+			if (uwsgi.harakiri_options.spoolers > 0) {
+				set_spooler_harakiri(0);
+			}
+			if (ret == 0)
+				continue;
+			callable_found = 1;
+			// increase task counter
+			uspool->tasks++;
+			if (ret == -2) {
+				if (!uwsgi.spooler_quiet)
+					uwsgi_log("[spooler %s pid: %d] done with task %s after %lld seconds\n", uspool->dir, (int) uwsgi.mypid, task, (long long) uwsgi_now() - now);
+			}
+			// re-spool it
+			break;
+		}
+	}
+
+	uspool->running = 0;
+
+	if (!callable_found) {
+		uwsgi_log("unable to find the spooler function, have you loaded it into the spooler process ?\n");
+		return 0;
+	}
+
+	return ret;
+}
+
+// need to recycle ?
+static void spooler_check_recycle(struct uwsgi_spooler *uspool) {
+	if (uwsgi.spooler_max_tasks > 0 && uspool->tasks >= (uint64_t) uwsgi.spooler_max_tasks) {
+		uwsgi_log("[spooler %s pid: %d] maximum number of tasks reached (%d) recycling ...\n", uspool->dir, (int) uwsgi.mypid, uwsgi.spooler_max_tasks);
+		end_me(0);
+	}
+}
+
 void spooler_manage_task(struct uwsgi_spooler *uspool, char *dir, char *task) {
 
-	int i, ret;
+	int ret;
 
 	char spool_buf[0xffff];
 	struct uwsgi_header uh;
@@ -628,46 +717,9 @@ void spooler_manage_task(struct uwsgi_spooler *uspool, char *dir, char *task) {
 				}
 			}
 
-			// now the task is running and should not be woken up
-			uspool->running = 1;
-			// this is used in cheap mode for making decision about who must die
-			uspool->last_task_managed = uwsgi_now();
-
-			if (!uwsgi.spooler_quiet)
-				uwsgi_log("[spooler %s pid: %d] managing request %s ...\n", uspool->dir, (int) uwsgi.mypid, task);
-
-
-			// chdir before running the task (if requested)
-			if (uwsgi.spooler_chdir) {
-				if (chdir(uwsgi.spooler_chdir)) {
-					uwsgi_error("spooler_manage_task()/chdir()");
-				}
-			}
-
-			int callable_found = 0;
-			for (i = 0; i < 256; i++) {
-				if (uwsgi.p[i]->spooler) {
-					time_t now = uwsgi_now();
-					if (uwsgi.harakiri_options.spoolers > 0) {
-						set_spooler_harakiri(uwsgi.harakiri_options.spoolers);
-					}
-					ret = uwsgi.p[i]->spooler(task, spool_buf, uh._pktsize, body, body_len);
-					if (uwsgi.harakiri_options.spoolers > 0) {
-						set_spooler_harakiri(0);
-					}
-					if (ret == 0)
-						continue;
-					callable_found = 1;
-					// increase task counter
-					uspool->tasks++;
-					if (ret == -2) {
-						if (!uwsgi.spooler_quiet)
-							uwsgi_log("[spooler %s pid: %d] done with task %s after %lld seconds\n", uspool->dir, (int) uwsgi.mypid, task, (long long) uwsgi_now() - now);
-						destroy_spool(dir, task);
-					}
-					// re-spool it
-					break;
-				}
+			ret = spooler_run_task(uspool, task, spool_buf, uh._pktsize, body, body_len);
+			if (ret == -2) {
+				destroy_spool(dir, task);
 			}
 
 			if (body)
@@ -675,15 +727,8 @@ void spooler_manage_task(struct uwsgi_spooler *uspool, char *dir, char *task) {
 
 			// here we free and unlock the task
 			uwsgi_protected_close(spool_fd);
-			uspool->running = 0;
-
-
-			// need to recycle ?
-			if (uwsgi.spooler_max_tasks > 0 && uspool->tasks >= (uint64_t) uwsgi.spooler_max_tasks) {
-				uwsgi_log("[spooler %s pid: %d] maximum number of tasks reached (%d) recycling ...\n", uspool->dir, (int) uwsgi.mypid, uwsgi.spooler_max_tasks);
-				end_me(0);
-			}
 
+			spooler_check_recycle(uspool);
 
 			if (chdir(dir)) {
 				uwsgi_error("chdir()");
@@ -691,42 +736,982 @@ void spooler_manage_task(struct uwsgi_spooler *uspool, char *dir, char *task) {
 				exit(1);
 			}
 
-			if (!callable_found) {
-				uwsgi_log("unable to find the spooler function, have you loaded it into the spooler process ?\n");
-			}
-
 		}
 	}
 }
 
-// this function checks which spooler should be spawned
+/*
+	this function checks which spooler should be spawned
+
+	for every directory one more (idle) process is spawned for each pending task,
+	spoolers with nothing to do exit by themselves (see spooler())
+*/
 void uwsgi_spooler_cheap_check() {
 	struct uwsgi_spooler *uspool = uwsgi.spoolers;
-	char *last_managed = NULL;
 	while(uspool) {
-		// skip already active spoolers
-		if (uspool->pid > 0) goto next; 
-		// spooler dir names (in multiprocess mode, are ordered, so we can use
-		// this trick for avoiding spawning multiple processes for the same dir
-		// in the same cycle
-		if (!last_managed || strcmp(last_managed, uspool->dir)) {
-			// unfortunately, reusing readdir/scandir of the spooler is too dungeorus
-			// as the code is run in the master, let's do a simpler check
-        		struct dirent *dp;
-			DIR *sdir = opendir(uspool->dir);
-			if (!sdir) goto next;
-                	while ((dp = readdir(sdir)) != NULL) {
-				if (strncmp("uwsgi_spoolfile_on_", dp->d_name, 19)) continue;
-				// a uwsgi_spoolfile_on_* file has been found...
-				uspool->respawned++;
+		struct uwsgi_spooler *first = uwsgi.spoolers;
+		// spooler dir names (in multiprocess mode, are ordered, so we manage each directory only once
+		while (first != uspool && strcmp(first->dir, uspool->dir)) first = first->next;
+		if (first != uspool || uspool->mode == UWSGI_SPOOLER_EXTERNAL) goto next;
+		if (!uspool->engine->pending) goto next;
+		int pending = uspool->engine->pending(uspool);
+		struct uwsgi_spooler *us = uspool;
+		int active = 0;
+		while (us) {
+			if (!strcmp(us->dir, uspool->dir) && us->pid > 0) active++;
+			us = us->next;
+		}
+		us = uspool;
+		while (us && pending > active) {
+			if (!strcmp(us->dir, uspool->dir) && us->pid <= 0) {
+				us->respawned++;
 				// spawn a new spooler
-                                uspool->pid = spooler_start(uspool);
-				last_managed = uspool->dir;
-				break;
+				us->pid = spooler_start(us);
+				active++;
 			}
-			closedir(sdir);
+			us = us->next;
 		}
 next:
 		uspool = uspool->next;
 	}
 }
+
+struct uwsgi_spooler_engine *uwsgi_register_spooler_engine(char *name, void (*run) (struct uwsgi_spooler *, int)) {
+	struct uwsgi_spooler_engine *old_use = NULL, *use = uwsgi.spooler_engines;
+	while (use) {
+		if (!strcmp(use->name, name)) {
+			return use;
+		}
+		old_use = use;
+		use = use->next;
+	}
+
+	use = uwsgi_calloc(sizeof(struct uwsgi_spooler_engine));
+	use->name = name;
+	use->run = run;
+
+	if (old_use) {
+		old_use->next = use;
+	}
+	else {
+		uwsgi.spooler_engines = use;
+	}
+
+	return use;
+}
+
+void uwsgi_spooler_engine_init(struct uwsgi_spooler *uspool) {
+	char *name = uwsgi.spooler_engine ? uwsgi.spooler_engine : "dir";
+	// external spoolers are only directories
+	if (uspool->mode == UWSGI_SPOOLER_EXTERNAL) name = "dir";
+	struct uwsgi_spooler_engine *use = uwsgi.spooler_engines;
+	while (use) {
+		if (!strcmp(use->name, name)) break;
+		use = use->next;
+	}
+	if (!use) {
+		uwsgi_log("unable to find spooler engine \"%s\"\n", name);
+		exit(1);
+	}
+	uspool->engine = use;
+	if (use->init) use->init(uspool);
+}
+
+/*
+
+	"dir" engine: scan the spool directory
+
+*/
+
+static void spooler_dir_run(struct uwsgi_spooler *uspool, int full) {
+	if (uwsgi.spooler_ordered) {
+		spooler_scandir(uspool, NULL);
+	}
+	else {
+		spooler_readdir(uspool, NULL);
+	}
+}
+
+static int spooler_dir_pending(struct uwsgi_spooler *uspool) {
+	// unfortunately, reusing readdir/scandir of the spooler is too dungeorus
+	// as the code is run in the master, let's do a simpler check
+	struct dirent *dp;
+	int found = 0;
+	DIR *sdir = opendir(uspool->dir);
+	if (!sdir) return 0;
+	while ((dp = readdir(sdir)) != NULL) {
+		// a uwsgi_spoolfile_on_* file has been found...
+		if (!strncmp("uwsgi_spoolfile_on_", dp->d_name, 19)) {
+			found = 1;
+			break;
+		}
+	}
+	closedir(sdir);
+	return found;
+}
+
+// store a task in a spool file (retried and delayed tasks of the engines not based on files)
+static int spooler_respool_file(struct uwsgi_spooler *uspool, char *args, uint16_t args_len, char *body, size_t body_len, time_t at) {
+	struct spooler_req sr;
+	memset(&sr, 0, sizeof(struct spooler_req));
+	uwsgi_hooked_parse(args, args_len, spooler_req_parser_hook, &sr);
+	sr.at = at;
+	char *filename = spooler_write_file(uspool, &sr, args, args_len, body, body_len);
+	if (!filename) return -1;
+	free(filename);
+	return 0;
+}
+
+/*
+
+	"inotify" engine: spool files are managed as soon as they are closed,
+	the directory is still scanned at every spooler-frequency for delayed and retried tasks.
+
+	Immediate pickup does not honour --spooler-ordered (the periodic scans still do).
+
+*/
+
+#ifdef UWSGI_EVENT_FILEMONITOR_USE_INOTIFY
+#include <sys/inotify.h>
+
+struct spooler_inotify_watch {
+	int wd;
+	char *dir;
+	struct spooler_inotify_watch *next;
+};
+
+static int spooler_inotify_fd = -1;
+static struct spooler_inotify_watch *spooler_inotify_watches = NULL;
+
+static void spooler_inotify_watch(char *dir) {
+	int wd = inotify_add_watch(spooler_inotify_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR);
+	if (wd < 0) {
+		uwsgi_error("spooler_inotify_watch()/inotify_add_watch()");
+		return;
+	}
+	struct spooler_inotify_watch *siw = spooler_inotify_watches;
+	while (siw) {
+		if (siw->wd == wd) return;
+		siw = siw->next;
+	}
+	siw = uwsgi_calloc(sizeof(struct spooler_inotify_watch));
+	siw->wd = wd;
+	siw->dir = uwsgi_str(dir);
+	siw->next = spooler_inotify_watches;
+	spooler_inotify_watches = siw;
+}
+
+static int spooler_inotify_fd_init(struct uwsgi_spooler *uspool) {
+	spooler_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (spooler_inotify_fd < 0) {
+		uwsgi_error("spooler_inotify_fd_init()/inotify_init1()");
+		return -1;
+	}
+	spooler_inotify_watch(uspool->dir);
+	return spooler_inotify_fd;
+}
+
+static void spooler_inotify_run(struct uwsgi_spooler *uspool, int full) {
+	char buf[8192] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+	if (full || spooler_inotify_fd < 0) {
+		// watch the priority directories too
+		if (uwsgi.spooler_ordered && spooler_inotify_fd > -1) {
+			DIR *sdir = opendir(uspool->dir);
+			if (sdir) {
+				struct dirent *dp;
+				while ((dp = readdir(sdir)) != NULL) {
+					if (is_a_number(dp->d_name)) {
+						char *prio_path = uwsgi_concat3(uspool->dir, "/", dp->d_name);
+						spooler_inotify_watch(prio_path);
+						free(prio_path);
+					}
+				}
+				closedir(sdir);
+			}
+		}
+		spooler_dir_run(uspool, full);
+		return;
+	}
+
+	for (;;) {
+		ssize_t len = read(spooler_inotify_fd, buf, sizeof(buf));
+		if (len <= 0) {
+			if (len < 0 && errno != EAGAIN && errno != EINTR) {
+				uwsgi_error("spooler_inotify_run()/read()");
+			}
+			return;
+		}
+		char *ptr = buf;
+		while (ptr < buf + len) {
+			struct inotify_event *ie = (struct inotify_event *) ptr;
+			ptr += sizeof(struct inotify_event) + ie->len;
+			// events have been lost, rescan
+			if (ie->mask & IN_Q_OVERFLOW) {
+				spooler_dir_run(uspool, 1);
+				continue;
+			}
+			if (!ie->len) continue;
+			struct spooler_inotify_watch *siw = spooler_inotify_watches;
+			while (siw) {
+				if (siw->wd == ie->wd) break;
+				siw = siw->next;
+			}
+			if (!siw) continue;
+			if (ie->mask & IN_ISDIR) {
+				if (uwsgi.spooler_ordered && is_a_number(ie->name)) {
+					char *prio_path = uwsgi_concat3(siw->dir, "/", ie->name);
+					spooler_inotify_watch(prio_path);
+					free(prio_path);
+				}
+				continue;
+			}
+			// IN_CREATE is only interesting for directories
+			if (!(ie->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))) continue;
+			if (chdir(siw->dir)) {
+				uwsgi_error("spooler_inotify_run()/chdir()");
+				continue;
+			}
+			spooler_manage_task(uspool, siw->dir, ie->name);
+			if (chdir(uspool->dir)) {
+				uwsgi_error("chdir()");
+				exit(1);
+			}
+		}
+	}
+}
+#endif
+
+/*
+
+	"shm" engine: tasks are stored in shared memory, in a FIFO queue for each priority.
+
+	priority 0 is the most important one, tasks without a (numeric) priority go in the last queue.
+	Every spooler process on the same directory takes the first runnable task of the most important
+	queue that has not reached its concurrency limit (--spooler-priority-limit).
+
+	Tasks bigger than --spooler-shm-task-size (or enqueued when the slots are exhausted) are stored
+	in the spool directory, that is scanned at every spooler-frequency.
+	The queues do not survive a restart of the instance.
+
+*/
+
+#define UWSGI_SPOOLER_PRIORITIES 16
+
+struct spooler_shm_task {
+	uint64_t id;
+	time_t at;
+	// next slot in the queue (or in the free list) + 1
+	uint64_t next;
+	uint64_t body_len;
+	uint16_t args_len;
+	uint8_t priority;
+};
+
+struct spooler_shm_queue {
+	uint64_t head;
+	uint64_t tail;
+	uint64_t count;
+	uint64_t running;
+	uint64_t limit;
+};
+
+struct spooler_shm {
+	struct uwsgi_lock_item *lock;
+	// wake up pipe
+	int pipe[2];
+	uint64_t free;
+	uint64_t count;
+	uint64_t counter;
+	struct spooler_shm_queue queues[UWSGI_SPOOLER_PRIORITIES];
+	char *tasks;
+};
+
+#define spooler_shm_slot(ss, n) ((struct spooler_shm_task *) ((ss)->tasks + ((n) * uwsgi.spooler_shm_task_size)))
+
+static void spooler_shm_init(struct uwsgi_spooler *uspool) {
+	uint64_t i;
+	// spoolers on the same directory share the queues
+	struct uwsgi_spooler *other = uwsgi.spoolers;
+	while (other && other != uspool) {
+		if (!strcmp(other->dir, uspool->dir) && other->engine_data) {
+			uspool->engine_data = other->engine_data;
+			return;
+		}
+		other = other->next;
+	}
+
+	if (!uwsgi.spooler_shm_tasks) uwsgi.spooler_shm_tasks = 1024;
+	if (!uwsgi.spooler_shm_task_size) uwsgi.spooler_shm_task_size = 4096;
+	if (uwsgi.spooler_shm_task_size <= sizeof(struct spooler_shm_task)) {
+		uwsgi_log("invalid --spooler-shm-task-size\n");
+		exit(1);
+	}
+	// keep headers aligned
+	uwsgi.spooler_shm_task_size = (uwsgi.spooler_shm_task_size + 7) & ~((uint64_t) 7);
+
+	struct spooler_shm *ss = uwsgi_calloc_shared(sizeof(struct spooler_shm));
+	ss->tasks = uwsgi_calloc_shared(uwsgi.spooler_shm_tasks * uwsgi.spooler_shm_task_size);
+	for (i = 0; i < uwsgi.spooler_shm_tasks; i++) {
+		spooler_shm_slot(ss, i)->next = i + 1 < uwsgi.spooler_shm_tasks ? i + 2 : 0;
+	}
+	ss->free = 1;
+
+	struct uwsgi_string_list *usl = NULL;
+	uwsgi_foreach(usl, uwsgi.spooler_priority_limits) {
+		char *equal = strchr(usl->value, '=');
+		if (!equal) {
+			uwsgi_log("invalid --spooler-priority-limit syntax, must be <priority>=<n>\n");
+			exit(1);
+		}
+		int prio = UWSGI_SPOOLER_PRIORITIES - 1;
+		if (uwsgi_strncmp(usl->value, equal - usl->value, "default", 7)) {
+			prio = uwsgi_str_num(usl->value, equal - usl->value);
+			if (prio > UWSGI_SPOOLER_PRIORITIES - 2) prio = UWSGI_SPOOLER_PRIORITIES - 2;
+		}
+		ss->queues[prio].limit = strtoull(equal + 1, NULL, 10);
+	}
+
+	ss->lock = uwsgi_lock_init(uwsgi_concat2("spooler shm on ", uspool->dir));
+	if (pipe(ss->pipe)) {
+		uwsgi_error("spooler_shm_init()/pipe()");
+		exit(1);
+	}
+	uwsgi_socket_nb(ss->pipe[0]);
+	uwsgi_socket_nb(ss->pipe[1]);
+	uspool->engine_data = ss;
+	uwsgi_log("spooler %s: shm engine with %llu slots of %llu bytes\n", uspool->dir, (unsigned long long) uwsgi.spooler_shm_tasks, (unsigned long long) uwsgi.spooler_shm_task_size);
+}
+
+static void spooler_shm_wakeup(struct spooler_shm *ss) {
+	char byte = 1;
+	if (write(ss->pipe[1], &byte, 1) < 0 && errno != EAGAIN) {
+		uwsgi_error("spooler_shm_wakeup()/write()");
+	}
+}
+
+static int spooler_shm_store(struct spooler_shm *ss, uint64_t id, int prio, char *buf, uint16_t len, char *body, size_t body_len, time_t at) {
+	if (sizeof(struct spooler_shm_task) + len + body_len > uwsgi.spooler_shm_task_size) return -1;
+	uwsgi_lock(ss->lock);
+	if (!ss->free) {
+		uwsgi_unlock(ss->lock);
+		return -1;
+	}
+	uint64_t slot = ss->free;
+	struct spooler_shm_task *sst = spooler_shm_slot(ss, slot - 1);
+	ss->free = sst->next;
+	sst->id = id;
+	sst->at = at;
+	sst->next = 0;
+	sst->priority = prio;
+	sst->args_len = len;
+	sst->body_len = body_len;
+	char *ptr = (char *) (sst + 1);
+	memcpy(ptr, buf, len);
+	if (body_len > 0) memcpy(ptr + len, body, body_len);
+	struct spooler_shm_queue *ssq = &ss->queues[prio];
+	if (ssq->tail) {
+		spooler_shm_slot(ss, ssq->tail - 1)->next = slot;
+	}
+	else {
+		ssq->head = slot;
+	}
+	ssq->tail = slot;
+	ssq->count++;
+	ss->count++;
+	uwsgi_unlock(ss->lock);
+
+	spooler_shm_wakeup(ss);
+	return 0;
+}
+
+static int spooler_shm_priority(char *priority, size_t priority_len) {
+	if (!priority || !priority_len) return UWSGI_SPOOLER_PRIORITIES - 1;
+	size_t i;
+	for (i = 0; i < priority_len; i++) {
+		if (!isdigit((int) priority[i])) return UWSGI_SPOOLER_PRIORITIES - 1;
+	}
+	int prio = uwsgi_str_num(priority, priority_len);
+	if (prio > UWSGI_SPOOLER_PRIORITIES - 2) prio = UWSGI_SPOOLER_PRIORITIES - 2;
+	return prio;
+}
+
+static char *spooler_shm_push(struct uwsgi_spooler *uspool, char *buf, uint16_t len, char *body, size_t body_len, time_t at, char *priority, size_t priority_len) {
+	struct spooler_shm *ss = (struct spooler_shm *) uspool->engine_data;
+	uint64_t id = __sync_add_and_fetch(&ss->counter, 1);
+	if (spooler_shm_store(ss, id, spooler_shm_priority(priority, priority_len), buf, len, body, body_len, at)) return NULL;
+	char *task = uwsgi_malloc(strlen(uspool->dir) + 32);
+	sprintf(task, "%s/shm_%llu", uspool->dir, (unsigned long long) id);
+	return task;
+}
+
+/*
+	acknowledge the previous task (if any) and take the next runnable one in the same critical section,
+	returns its priority or -1
+*/
+static int spooler_shm_next(struct uwsgi_spooler *uspool, struct spooler_shm *ss, int done, char *task_buf) {
+	int i, prio = -1, wake = 0;
+	uint64_t j;
+	time_t now = uwsgi_now();
+	uwsgi_lock(ss->lock);
+	if (done > -1) {
+		struct spooler_shm_queue *ssq = &ss->queues[done];
+		// a limited queue has tasks for the other processes
+		if (ssq->limit && ssq->running >= ssq->limit && ssq->count > 0) wake = 1;
+		ssq->running--;
+		uspool->claimed = 0;
+	}
+	for (i = 0; i < UWSGI_SPOOLER_PRIORITIES && prio < 0; i++) {
+		struct spooler_shm_queue *ssq = &ss->queues[i];
+		if (!ssq->count) continue;
+		if (ssq->limit && ssq->running >= ssq->limit) continue;
+		// delayed tasks go back to the tail
+		for (j = 0; j < ssq->count; j++) {
+			uint64_t slot = ssq->head;
+			struct spooler_shm_task *sst = spooler_shm_slot(ss, slot - 1);
+			ssq->head = sst->next;
+			if (!ssq->head) ssq->tail = 0;
+			if (sst->at > now) {
+				sst->next = 0;
+				if (ssq->tail) {
+					spooler_shm_slot(ss, ssq->tail - 1)->next = slot;
+				}
+				else {
+					ssq->head = slot;
+				}
+				ssq->tail = slot;
+				continue;
+			}
+			memcpy(task_buf, sst, sizeof(struct spooler_shm_task) + sst->args_len + sst->body_len);
+			sst->next = ss->free;
+			ss->free = slot;
+			ssq->count--;
+			ss->count--;
+			ssq->running++;
+			uspool->claimed = i + 1;
+			prio = i;
+			break;
+		}
+	}
+	uwsgi_unlock(ss->lock);
+	if (wake) spooler_shm_wakeup(ss);
+	return prio;
+}
+
+static int spooler_shm_fd(struct uwsgi_spooler *uspool) {
+	struct spooler_shm *ss = (struct spooler_shm *) uspool->engine_data;
+	// the previous process died while running a task
+	if (uspool->claimed > 0) {
+		uwsgi_lock(ss->lock);
+		ss->queues[uspool->claimed - 1].running--;
+		uspool->claimed = 0;
+		uwsgi_unlock(ss->lock);
+	}
+	return ss->pipe[0];
+}
+
+static void spooler_shm_run(struct uwsgi_spooler *uspool, int full) {
+	struct spooler_shm *ss = (struct spooler_shm *) uspool->engine_data;
+	static char *task_buf = NULL;
+	if (!task_buf) task_buf = uwsgi_malloc(uwsgi.spooler_shm_task_size);
+	char byte[64];
+
+	if (!full) {
+		if (read(ss->pipe[0], byte, 1) < 0 && errno != EAGAIN) {
+			uwsgi_error("spooler_shm_run()/read()");
+		}
+	}
+	else {
+		// consume the pending wake ups (all of the queues will be checked)
+		while (read(ss->pipe[0], byte, 64) > 0);
+		// tasks that did not fit in shared memory
+		spooler_dir_run(uspool, full);
+	}
+
+	int prio = -1;
+	for (;;) {
+		prio = spooler_shm_next(uspool, ss, prio, task_buf);
+		if (prio < 0) break;
+
+		struct spooler_shm_task *sst = (struct spooler_shm_task *) task_buf;
+		char *args = (char *) (sst + 1);
+		char *body = sst->body_len > 0 ? args + sst->args_len : NULL;
+
+		char task[sizeof(uspool->dir) + 32];
+		snprintf(task, sizeof(task), "%s/shm_%llu", uspool->dir, (unsigned long long) sst->id);
+		int ret = spooler_run_task(uspool, task, args, sst->args_len, body, sst->body_len);
+		if (chdir(uspool->dir)) {
+			uwsgi_error("chdir()");
+			exit(1);
+		}
+
+		// retry at the next scan
+		if (ret == -1) {
+			int freq = uwsgi.shared->spooler_frequency ? uwsgi.shared->spooler_frequency : uwsgi.spooler_frequency;
+			time_t at = uwsgi_now() + freq;
+			// put it back, falling back to a spool file
+			if (spooler_shm_store(ss, sst->id, prio, args, sst->args_len, body, sst->body_len, at)) {
+				if (spooler_respool_file(uspool, args, sst->args_len, body, sst->body_len, at)) {
+					uwsgi_log("[spooler %s pid: %d] unable to respool task shm_%llu, it will be lost\n", uspool->dir, (int) uwsgi.mypid, (unsigned long long) sst->id);
+				}
+			}
+		}
+
+		if (uwsgi.spooler_max_tasks > 0 && uspool->tasks >= (uint64_t) uwsgi.spooler_max_tasks) {
+			// release the task before recycling
+			uwsgi_lock(ss->lock);
+			ss->queues[prio].running--;
+			uspool->claimed = 0;
+			uwsgi_unlock(ss->lock);
+			spooler_check_recycle(uspool);
+		}
+	}
+}
+
+static int spooler_shm_pending(struct uwsgi_spooler *uspool) {
+	struct spooler_shm *ss = (struct spooler_shm *) uspool->engine_data;
+	if (ss->count > 0) return ss->count;
+	return spooler_dir_pending(uspool);
+}
+
+/*
+
+	"journal" engine: group commit of the spool requests.
+
+	tasks are appended to a segment file shared by all of the workers (uwsgi_spoolseg_<n> in the spool
+	directory), the first writer waiting for its commit becomes the leader: it waits --spooler-commit-interval
+	usecs for the other writers, calls fdatasync() once for all of them and acknowledges the whole group.
+
+	spoolers read the committed records in order, a managed record is flagged as done in the segment
+	and a segment is removed when all of its records have been managed.
+	Segments left by a previous run are managed again at startup (records flagged as done are skipped).
+	Delayed or retried tasks and tasks bigger than --spooler-segment-size are stored in spool files.
+
+*/
+
+#define UWSGI_SPOOLER_JOURNAL_MAGIC 0x4a505375
+
+#if defined(__APPLE__)
+#define spooler_fdatasync fsync
+#else
+#define spooler_fdatasync fdatasync
+#endif
+
+struct spooler_journal_record {
+	uint32_t magic;
+	uint32_t done;
+	uint64_t at;
+	uint64_t body_len;
+	uint16_t args_len;
+	uint16_t reserved[3];
+};
+
+#define spooler_journal_record_len(sjr) ((sizeof(struct spooler_journal_record) + (sjr)->args_len + (sjr)->body_len + 7) & ~((uint64_t) 7))
+
+struct spooler_journal {
+	struct uwsgi_lock_item *lock;
+	int pipe[2];
+	// the segment being written
+	uint64_t segment;
+	uint64_t offset;
+	uint64_t committed_offset;
+	uint64_t appended;
+	uint64_t committed;
+	// pid of the commit leader
+	pid_t committing;
+	// the first segment still on disk and the next record to manage
+	uint64_t oldest;
+	uint64_t read_segment;
+	uint64_t read_offset;
+};
+
+// process local descriptors (engine_data, copied by fork())
+struct spooler_journal_local {
+	struct spooler_journal *sj;
+	int wfd;
+	uint64_t wsegment;
+	int rfd;
+	uint64_t rsegment;
+};
+
+static void spooler_journal_path(char *buf, size_t len, struct uwsgi_spooler *uspool, uint64_t segment) {
+	snprintf(buf, len, "%s/uwsgi_spoolseg_%llu", uspool->dir, (unsigned long long) segment);
+}
+
+static void spooler_journal_init(struct uwsgi_spooler *uspool) {
+	struct uwsgi_spooler *other = uwsgi.spoolers;
+	while (other && other != uspool) {
+		if (!strcmp(other->dir, uspool->dir) && other->engine_data) {
+			uspool->engine_data = other->engine_data;
+			return;
+		}
+		other = other->next;
+	}
+
+	if (!uwsgi.spooler_segment_size) uwsgi.spooler_segment_size = 4 * 1024 * 1024;
+	if (!uwsgi.spooler_commit_interval) uwsgi.spooler_commit_interval = 1000;
+
+	struct spooler_journal_local *sjl = uwsgi_calloc(sizeof(struct spooler_journal_local));
+	sjl->wfd = -1;
+	sjl->rfd = -1;
+	struct spooler_journal *sj = uwsgi_calloc_shared(sizeof(struct spooler_journal));
+	sjl->sj = sj;
+
+	// recover the segments of a previous run
+	DIR *sdir = opendir(uspool->dir);
+	if (sdir) {
+		int found = 0;
+		uint64_t min = 0, max = 0;
+		struct dirent *dp;
+		while ((dp = readdir(sdir)) != NULL) {
+			if (strncmp(dp->d_name, "uwsgi_spoolseg_", 15) || !is_a_number(dp->d_name + 15)) continue;
+			uint64_t n = strtoull(dp->d_name + 15, NULL, 10);
+			if (!found || n < min) min = n;
+			if (!found || n > max) max = n;
+			found = 1;
+		}
+		closedir(sdir);
+		if (found) {
+			sj->oldest = min;
+			sj->read_segment = min;
+			sj->segment = max + 1;
+			uwsgi_log("spooler %s: recovering journal segments %llu-%llu\n", uspool->dir, (unsigned long long) min, (unsigned long long) max);
+		}
+	}
+
+	sj->lock = uwsgi_lock_init(uwsgi_concat2("spooler journal on ", uspool->dir));
+	if (pipe(sj->pipe)) {
+		uwsgi_error("spooler_journal_init()/pipe()");
+		exit(1);
+	}
+	uwsgi_socket_nb(sj->pipe[0]);
+	uwsgi_socket_nb(sj->pipe[1]);
+	uspool->engine_data = sjl;
+	uwsgi_log("spooler %s: journal engine with segments of %llu bytes, commit interval %d usecs\n", uspool->dir, (unsigned long long) uwsgi.spooler_segment_size, uwsgi.spooler_commit_interval);
+}
+
+static void spooler_journal_wakeup(struct spooler_journal *sj) {
+	char byte = 1;
+	if (write(sj->pipe[1], &byte, 1) < 0 && errno != EAGAIN) {
+		uwsgi_error("spooler_journal_wakeup()/write()");
+	}
+}
+
+static int spooler_journal_sync(struct uwsgi_spooler *uspool, uint64_t segment) {
+	char path[PATH_MAX + 64];
+	spooler_journal_path(path, sizeof(path), uspool, segment);
+	int fd = open(path, O_WRONLY);
+	if (fd < 0) {
+		uwsgi_error_open(path);
+		return -1;
+	}
+	int ret = spooler_fdatasync(fd);
+	if (ret) {
+		uwsgi_error("spooler_journal_sync()/fdatasync()");
+	}
+	close(fd);
+	return ret;
+}
+
+// the writer descriptor of the current segment, called with the lock held
+static int spooler_journal_wfd(struct uwsgi_spooler *uspool, struct spooler_journal_local *sjl) {
+	struct spooler_journal *sj = sjl->sj;
+	if (sjl->wfd > -1 && sjl->wsegment == sj->segment) return sjl->wfd;
+	if (sjl->wfd > -1) close(sjl->wfd);
+	char path[PATH_MAX + 64];
+	spooler_journal_path(path, sizeof(path), uspool, sj->segment);
+	sjl->wfd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+	if (sjl->wfd < 0) {
+		uwsgi_error_open(path);
+		return -1;
+	}
+	sjl->wsegment = sj->segment;
+	// a new segment, make its directory entry durable
+	if (sj->offset == 0) {
+		int dfd = open(uspool->dir, O_RDONLY);
+		if (dfd > -1) {
+			if (fsync(dfd)) {
+				uwsgi_error("spooler_journal_wfd()/fsync()");
+			}
+			close(dfd);
+		}
+	}
+	return sjl->wfd;
+}
+
+// wait for the commit of the record, becoming the leader of the group if no commit is running
+static void spooler_journal_commit(struct uwsgi_spooler *uspool, struct spooler_journal *sj, uint64_t seq) {
+	int poll_interval = uwsgi.spooler_commit_interval / 4;
+	if (poll_interval < 100) poll_interval = 100;
+	for (;;) {
+		uwsgi_lock(sj->lock);
+		if (sj->committed >= seq) {
+			uwsgi_unlock(sj->lock);
+			return;
+		}
+		if (sj->committing) {
+			// the leader died
+			if (kill(sj->committing, 0) && errno == ESRCH) sj->committing = 0;
+			uwsgi_unlock(sj->lock);
+			usleep(poll_interval);
+			continue;
+		}
+		sj->committing = uwsgi.mypid;
+		uwsgi_unlock(sj->lock);
+
+		// let the other writers join the group
+		usleep(uwsgi.spooler_commit_interval);
+
+		uwsgi_lock(sj->lock);
+		uint64_t segment = sj->segment;
+		uint64_t offset = sj->offset;
+		uint64_t appended = sj->appended;
+		uwsgi_unlock(sj->lock);
+
+		spooler_journal_sync(uspool, segment);
+
+		uwsgi_lock(sj->lock);
+		if (sj->segment == segment && offset > sj->committed_offset) sj->committed_offset = offset;
+		if (appended > sj->committed) sj->committed = appended;
+		sj->committing = 0;
+		uwsgi_unlock(sj->lock);
+		spooler_journal_wakeup(sj);
+	}
+}
+
+static char *spooler_journal_push(struct uwsgi_spooler *uspool, char *buf, uint16_t len, char *body, size_t body_len, time_t at, char *priority, size_t priority_len) {
+	struct spooler_journal_local *sjl = (struct spooler_journal_local *) uspool->engine_data;
+	struct spooler_journal *sj = sjl->sj;
+
+	struct spooler_journal_record sjr;
+	memset(&sjr, 0, sizeof(struct spooler_journal_record));
+	sjr.magic = UWSGI_SPOOLER_JOURNAL_MAGIC;
+	sjr.at = at;
+	sjr.args_len = len;
+	sjr.body_len = body_len;
+	size_t rlen = spooler_journal_record_len(&sjr);
+	if (rlen > uwsgi.spooler_segment_size) return NULL;
+
+	char *record = uwsgi_calloc(rlen);
+	memcpy(record, &sjr, sizeof(struct spooler_journal_record));
+	memcpy(record + sizeof(struct spooler_journal_record), buf, len);
+	if (body_len > 0) memcpy(record + sizeof(struct spooler_journal_record) + len, body, body_len);
+
+	uwsgi_lock(sj->lock);
+	if (sj->offset + rlen > uwsgi.spooler_segment_size) {
+		// seal the segment, it is committed as a whole
+		spooler_journal_sync(uspool, sj->segment);
+		sj->committed = sj->appended;
+		sj->segment++;
+		sj->offset = 0;
+		sj->committed_offset = 0;
+	}
+	int fd = spooler_journal_wfd(uspool, sjl);
+	if (fd < 0 || pwrite(fd, record, rlen, sj->offset) != (ssize_t) rlen) {
+		if (fd > -1) uwsgi_error("spooler_journal_push()/pwrite()");
+		uwsgi_unlock(sj->lock);
+		free(record);
+		return NULL;
+	}
+	uint64_t segment = sj->segment;
+	uint64_t offset = sj->offset;
+	sj->offset += rlen;
+	uint64_t seq = ++sj->appended;
+	uwsgi_unlock(sj->lock);
+	free(record);
+
+	spooler_journal_commit(uspool, sj, seq);
+
+	char *task = uwsgi_malloc(strlen(uspool->dir) + 64);
+	sprintf(task, "%s/spoolseg_%llu_%llu", uspool->dir, (unsigned long long) segment, (unsigned long long) offset);
+	return task;
+}
+
+static int spooler_journal_rfd(struct uwsgi_spooler *uspool, struct spooler_journal_local *sjl, uint64_t segment) {
+	if (sjl->rfd > -1 && sjl->rsegment == segment) return sjl->rfd;
+	if (sjl->rfd > -1) close(sjl->rfd);
+	char path[PATH_MAX + 64];
+	spooler_journal_path(path, sizeof(path), uspool, segment);
+	sjl->rfd = open(path, O_RDWR | O_CLOEXEC);
+	if (sjl->rfd < 0) {
+		if (errno != ENOENT) uwsgi_error_open(path);
+		return -1;
+	}
+	sjl->rsegment = segment;
+	return sjl->rfd;
+}
+
+// remove the segments completely managed, called with the lock held
+static void spooler_journal_gc(struct uwsgi_spooler *uspool, struct spooler_journal *sj) {
+	char path[PATH_MAX + 64];
+	while (sj->oldest < sj->read_segment) {
+		struct uwsgi_spooler *us = uwsgi.spoolers;
+		while (us) {
+			if (!strcmp(us->dir, uspool->dir) && us->claimed_segment == sj->oldest + 1) return;
+			us = us->next;
+		}
+		spooler_journal_path(path, sizeof(path), uspool, sj->oldest);
+		if (unlink(path) && errno != ENOENT) {
+			uwsgi_error("spooler_journal_gc()/unlink()");
+		}
+		sj->oldest++;
+	}
+}
+
+// claim the next committed record, returns -1 if none is available
+static int spooler_journal_next(struct uwsgi_spooler *uspool, struct spooler_journal_local *sjl) {
+	struct spooler_journal *sj = sjl->sj;
+	struct spooler_journal_record sjr;
+	int ret = -1;
+	uwsgi_lock(sj->lock);
+	for (;;) {
+		int sealed = sj->read_segment < sj->segment;
+		if (!sealed && sj->read_offset >= sj->committed_offset) break;
+		int fd = spooler_journal_rfd(uspool, sjl, sj->read_segment);
+		if (fd < 0 || pread(fd, &sjr, sizeof(struct spooler_journal_record), sj->read_offset) != sizeof(struct spooler_journal_record) || sjr.magic != UWSGI_SPOOLER_JOURNAL_MAGIC) {
+			if (!sealed) {
+				uwsgi_log("[spooler %s pid: %d] corrupted journal segment %llu at offset %llu\n", uspool->dir, (int) uwsgi.mypid, (unsigned long long) sj->read_segment, (unsigned long long) sj->read_offset);
+				sj->read_offset = sj->committed_offset;
+				break;
+			}
+			// end of the segment (a torn record can only be the last one)
+			sj->read_segment++;
+			sj->read_offset = 0;
+			spooler_journal_gc(uspool, sj);
+			continue;
+		}
+		uint64_t offset = sj->read_offset;
+		sj->read_offset += spooler_journal_record_len(&sjr);
+		if (sjr.done) continue;
+		uspool->claimed_offset = offset;
+		uspool->claimed_segment = sj->read_segment + 1;
+		ret = 0;
+		break;
+	}
+	uwsgi_unlock(sj->lock);
+	return ret;
+}
+
+static void spooler_journal_release(struct uwsgi_spooler *uspool, struct spooler_journal *sj) {
+	uwsgi_lock(sj->lock);
+	uspool->claimed_segment = 0;
+	spooler_journal_gc(uspool, sj);
+	uwsgi_unlock(sj->lock);
+}
+
+// run the claimed record and flag it as done
+static void spooler_journal_manage(struct uwsgi_spooler *uspool, struct spooler_journal_local *sjl) {
+	uint64_t segment = uspool->claimed_segment - 1;
+	uint64_t offset = uspool->claimed_offset;
+	struct spooler_journal_record sjr;
+
+	int fd = spooler_journal_rfd(uspool, sjl, segment);
+	if (fd < 0) return;
+	if (pread(fd, &sjr, sizeof(struct spooler_journal_record), offset) != sizeof(struct spooler_journal_record) || sjr.magic != UWSGI_SPOOLER_JOURNAL_MAGIC || sjr.done) return;
+
+	size_t len = sjr.args_len + sjr.body_len;
+	char *args = uwsgi_malloc(len + 1);
+	if (pread(fd, args, len, offset + sizeof(struct spooler_journal_record)) != (ssize_t) len) {
+		uwsgi_error("spooler_journal_manage()/pread()");
+		free(args);
+		return;
+	}
+	char *body = sjr.body_len > 0 ? args + sjr.args_len : NULL;
+
+	char task[sizeof(uspool->dir) + 64];
+	snprintf(task, sizeof(task), "%s/spoolseg_%llu_%llu", uspool->dir, (unsigned long long) segment, (unsigned long long) offset);
+
+	time_t now = uwsgi_now();
+	if ((time_t) sjr.at > now) {
+		// delayed tasks are moved to spool files
+		if (spooler_respool_file(uspool, args, sjr.args_len, body, sjr.body_len, sjr.at)) goto end;
+	}
+	else {
+		int ret = spooler_run_task(uspool, task, args, sjr.args_len, body, sjr.body_len);
+		if (chdir(uspool->dir)) {
+			uwsgi_error("chdir()");
+			exit(1);
+		}
+		if (ret == -1) {
+			int freq = uwsgi.shared->spooler_frequency ? uwsgi.shared->spooler_frequency : uwsgi.spooler_frequency;
+			if (spooler_respool_file(uspool, args, sjr.args_len, body, sjr.body_len, now + freq)) {
+				uwsgi_log("[spooler %s pid: %d] unable to respool task %s, it will be lost\n", uspool->dir, (int) uwsgi.mypid, task);
+			}
+		}
+	}
+
+	// no need to fsync(), in the worst case the task is managed again after a crash
+	sjr.done = 1;
+	if (pwrite(fd, &sjr.done, sizeof(uint32_t), offset + offsetof(struct spooler_journal_record, done)) != sizeof(uint32_t)) {
+		uwsgi_error("spooler_journal_manage()/pwrite()");
+	}
+end:
+	free(args);
+}
+
+static int spooler_journal_fd(struct uwsgi_spooler *uspool) {
+	struct spooler_journal_local *sjl = (struct spooler_journal_local *) uspool->engine_data;
+	return sjl->sj->pipe[0];
+}
+
+static void spooler_journal_run(struct uwsgi_spooler *uspool, int full) {
+	struct spooler_journal_local *sjl = (struct spooler_journal_local *) uspool->engine_data;
+	struct spooler_journal *sj = sjl->sj;
+	char byte[64];
+
+	if (!full) {
+		if (read(sj->pipe[0], byte, 1) < 0 && errno != EAGAIN) {
+			uwsgi_error("spooler_journal_run()/read()");
+		}
+	}
+	else {
+		while (read(sj->pipe[0], byte, 64) > 0);
+		// delayed, retried and big tasks
+		spooler_dir_run(uspool, full);
+	}
+
+	// the previous process died while running a task
+	if (uspool->claimed_segment) {
+		spooler_journal_manage(uspool, sjl);
+		spooler_journal_release(uspool, sj);
+	}
+
+	while (!spooler_journal_next(uspool, sjl)) {
+		// let the other spoolers on the same directory take the next records
+		if (uwsgi.spooler_numproc > 1) spooler_journal_wakeup(sj);
+		spooler_journal_manage(uspool, sjl);
+		spooler_journal_release(uspool, sj);
+		spooler_check_recycle(uspool);
+	}
+}
+
+static int spooler_journal_pending(struct uwsgi_spooler *uspool) {
+	struct spooler_journal_local *sjl = (struct spooler_journal_local *) uspool->engine_data;
+	struct spooler_journal *sj = sjl->sj;
+	if (sj->read_segment < sj->segment || sj->read_offset < sj->committed_offset) return 1;
+	return spooler_dir_pending(uspool);
+}
+
+void uwsgi_spooler_engines_setup() {
+	struct uwsgi_spooler_engine *use = uwsgi_register_spooler_engine("dir", spooler_dir_run);
+	use->pending = spooler_dir_pending;
+
+#ifdef UWSGI_EVENT_FILEMONITOR_USE_INOTIFY
+	use = uwsgi_register_spooler_engine("inotify", spooler_inotify_run);
+	use->fd = spooler_inotify_fd_init;
+	use->pending = spooler_dir_pending;
+	use->notified = 1;
+#endif
+
+	use = uwsgi_register_spooler_engine("shm", spooler_shm_run);
+	use->init = spooler_shm_init;
+	use->push = spooler_shm_push;
+	use->fd = spooler_shm_fd;
+	use->pending = spooler_shm_pending;
+
+	use = uwsgi_register_spooler_engine("journal", spooler_journal_run);
+	use->init = spooler_journal_init;
+	use->push = spooler_journal_push;
+	use->fd = spooler_journal_fd;
+	use->pending = spooler_journal_pending;
+}
@@ -2,6 +2,7 @@
 #include <openssl/rand.h>
 #include <openssl/sha.h>
 #include <openssl/md5.h>
+#include <openssl/hmac.h>
 
 extern struct uwsgi_server uwsgi;
 /*
@@ -13,11 +14,43 @@ set data in it with SSL_CTX_set_ex_data
 
 */
 
+// protects the SNI list (handshakes could run in helper threads)
+static pthread_mutex_t uwsgi_sni_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+// openssl < 1.1 needs locking callbacks to be used by multiple threads
+static pthread_mutex_t *uwsgi_ssl_locks;
+
+static void uwsgi_ssl_locking_cb(int mode, int n, const char *file, int line) {
+	if (mode & CRYPTO_LOCK) {
+		pthread_mutex_lock(&uwsgi_ssl_locks[n]);
+	}
+	else {
+		pthread_mutex_unlock(&uwsgi_ssl_locks[n]);
+	}
+}
+
+static unsigned long uwsgi_ssl_id_cb(void) {
+	return (unsigned long) pthread_self();
+}
+#endif
+
 void uwsgi_ssl_init(void) {
         OPENSSL_config(NULL);
         SSL_library_init();
         SSL_load_error_strings();
         OpenSSL_add_all_algorithms();
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+	int i;
+	uwsgi_ssl_locks = uwsgi_malloc(sizeof(pthread_mutex_t) * CRYPTO_num_locks());
+	for (i = 0; i < CRYPTO_num_locks(); i++) {
+		pthread_mutex_init(&uwsgi_ssl_locks[i], NULL);
+	}
+	CRYPTO_set_id_callback(uwsgi_ssl_id_cb);
+	CRYPTO_set_locking_callback(uwsgi_ssl_locking_cb);
+#endif
+	// bumped by the master to trigger SNI certificates reload
+	uwsgi.sni_generation = uwsgi_calloc_shared(sizeof(uint64_t));
         uwsgi.ssl_initialized = 1;
 }
 
@@ -58,13 +91,14 @@ int uwsgi_ssl_session_new_cb(SSL *ssl, SSL_SESSION *sess) {
         i2d_SSL_SESSION(sess, &p);
 
         // ok let's write the value to the cache
-        uwsgi_wlock(uwsgi.ssl_sessions_cache->lock);
+        struct uwsgi_lock_item *cl = uwsgi_cache_key_lock(uwsgi.ssl_sessions_cache, (char *) sess->session_id, sess->session_id_length);
+        uwsgi_wlock(cl);
         if (uwsgi_cache_set2(uwsgi.ssl_sessions_cache, (char *) sess->session_id, sess->session_id_length, session_blob, len, uwsgi.ssl_sessions_timeout, 0)) {
                 if (uwsgi.ssl_verbose) {
                         uwsgi_log("[uwsgi-ssl] unable to store session of size %d in the cache\n", len);
                 }
         }
-        uwsgi_rwunlock(uwsgi.ssl_sessions_cache->lock);
+        uwsgi_rwunlock(cl);
         return 0;
 }
 
@@ -73,10 +107,11 @@ SSL_SESSION *uwsgi_ssl_session_get_cb(SSL *ssl, unsigned char *key, int keylen,
         uint64_t valsize = 0;
 
         *copy = 0;
-        uwsgi_rlock(uwsgi.ssl_sessions_cache->lock);
+        struct uwsgi_lock_item *cl = uwsgi_cache_key_lock(uwsgi.ssl_sessions_cache, (char *) key, keylen);
+        uwsgi_rlock(cl);
         char *value = uwsgi_cache_get2(uwsgi.ssl_sessions_cache, (char *)key, keylen, &valsize);
         if (!value) {
-                uwsgi_rwunlock(uwsgi.ssl_sessions_cache->lock);
+                uwsgi_rwunlock(cl);
                 if (uwsgi.ssl_verbose) {
                         uwsgi_log("[uwsgi-ssl] cache miss\n");
                 }
@@ -87,18 +122,259 @@ SSL_SESSION *uwsgi_ssl_session_get_cb(SSL *ssl, unsigned char *key, int keylen,
 #else
         SSL_SESSION *sess = d2i_SSL_SESSION(NULL, (unsigned char **)&value, valsize);
 #endif
-        uwsgi_rwunlock(uwsgi.ssl_sessions_cache->lock);
+        uwsgi_rwunlock(cl);
         return sess;
 }
 
 void uwsgi_ssl_session_remove_cb(SSL_CTX *ctx, SSL_SESSION *sess) {
-        uwsgi_wlock(uwsgi.ssl_sessions_cache->lock);
+        struct uwsgi_lock_item *cl = uwsgi_cache_key_lock(uwsgi.ssl_sessions_cache, (char *) sess->session_id, sess->session_id_length);
+        uwsgi_wlock(cl);
         if (uwsgi_cache_del2(uwsgi.ssl_sessions_cache, (char *) sess->session_id, sess->session_id_length, 0, 0)) {
                 if (uwsgi.ssl_verbose) {
                         uwsgi_log("[uwsgi-ssl] error removing cache item\n");
                 }
         }
-        uwsgi_rwunlock(uwsgi.ssl_sessions_cache->lock);
+        uwsgi_rwunlock(cl);
+}
+
+/*
+
+	SNI contexts table
+
+	items are indexed by servername in a chained hash table (grown when it becomes too crowded).
+	An item keeps the cert/key/ciphers/client_ca it has been configured with, so its SSL_CTX can be:
+
+	- created lazily at the first handshake (--sni-lazy)
+	- evicted when more than --sni-max-contexts are alive (least recently used first) and recreated on demand
+	- hot-swapped: 'K' on the master fifo bumps a shared generation counter, every process checks
+	  (at the next handshake for the item) if the cert/key files changed and atomically replaces the context.
+	  Connections already established keep a reference to the old one (SSL_set_SSL_CTX increases the refcount).
+
+	all of the table is protected by uwsgi_sni_lock
+
+*/
+struct uwsgi_sni_item {
+	char *name;
+	size_t name_len;
+	char *crt;
+	char *key;
+	char *ciphers;
+	char *client_ca;
+	SSL_CTX *ctx;
+	// added by sni-dir or subscriptions, can be removed
+	int dynamic;
+	uint64_t generation;
+	// mtime, size and inode of cert and key
+	uint64_t stamp[6];
+	struct uwsgi_sni_item *next;
+	struct uwsgi_sni_item *lru_prev;
+	struct uwsgi_sni_item *lru_next;
+};
+
+static struct uwsgi_sni_table {
+	struct uwsgi_sni_item **buckets;
+	uint64_t size;
+	uint64_t items;
+	uint64_t contexts;
+	// most recently used context first
+	struct uwsgi_sni_item *lru_head;
+	struct uwsgi_sni_item *lru_tail;
+} uwsgi_sni_table;
+
+static uint64_t uwsgi_sni_hash(char *name, size_t name_len) {
+	static struct uwsgi_hash_algo *uha = NULL;
+	if (!uha) uha = uwsgi_hash_algo_get("wyhash");
+	return uwsgi_hash_algo_64(uha, name, name_len);
+}
+
+static void uwsgi_sni_table_grow() {
+	uint64_t new_size = uwsgi_sni_table.size ? uwsgi_sni_table.size * 2 : 256;
+	struct uwsgi_sni_item **new_buckets = uwsgi_calloc(sizeof(struct uwsgi_sni_item *) * new_size);
+	uint64_t i;
+	for (i = 0; i < uwsgi_sni_table.size; i++) {
+		struct uwsgi_sni_item *item = uwsgi_sni_table.buckets[i];
+		while (item) {
+			struct uwsgi_sni_item *next = item->next;
+			uint64_t slot = uwsgi_sni_hash(item->name, item->name_len) % new_size;
+			item->next = new_buckets[slot];
+			new_buckets[slot] = item;
+			item = next;
+		}
+	}
+	free(uwsgi_sni_table.buckets);
+	uwsgi_sni_table.buckets = new_buckets;
+	uwsgi_sni_table.size = new_size;
+}
+
+static struct uwsgi_sni_item *uwsgi_sni_table_find(char *name, size_t name_len) {
+	if (!uwsgi_sni_table.size) return NULL;
+	struct uwsgi_sni_item *item = uwsgi_sni_table.buckets[uwsgi_sni_hash(name, name_len) % uwsgi_sni_table.size];
+	while (item) {
+		if (!uwsgi_strncmp(item->name, item->name_len, name, name_len)) return item;
+		item = item->next;
+	}
+	return NULL;
+}
+
+static void uwsgi_sni_lru_unlink(struct uwsgi_sni_item *item) {
+	if (item->lru_prev) item->lru_prev->lru_next = item->lru_next;
+	else uwsgi_sni_table.lru_head = item->lru_next;
+	if (item->lru_next) item->lru_next->lru_prev = item->lru_prev;
+	else uwsgi_sni_table.lru_tail = item->lru_prev;
+	item->lru_prev = NULL;
+	item->lru_next = NULL;
+}
+
+static void uwsgi_sni_lru_push(struct uwsgi_sni_item *item) {
+	item->lru_prev = NULL;
+	item->lru_next = uwsgi_sni_table.lru_head;
+	if (uwsgi_sni_table.lru_head) uwsgi_sni_table.lru_head->lru_prev = item;
+	uwsgi_sni_table.lru_head = item;
+	if (!uwsgi_sni_table.lru_tail) uwsgi_sni_table.lru_tail = item;
+}
+
+static void uwsgi_sni_item_stamp(struct uwsgi_sni_item *item, uint64_t *stamp) {
+	struct stat st;
+	memset(stamp, 0, sizeof(uint64_t) * 6);
+	// inline pem are never reloaded
+	if (uwsgi_starts_with(item->crt, strlen(item->crt), "-----BEGIN ", 11)) {
+		if (!stat(item->crt, &st)) {
+			stamp[0] = st.st_mtime; stamp[1] = st.st_size; stamp[2] = st.st_ino;
+		}
+	}
+	if (uwsgi_starts_with(item->key, strlen(item->key), "-----BEGIN ", 11)) {
+		if (!stat(item->key, &st)) {
+			stamp[3] = st.st_mtime; stamp[4] = st.st_size; stamp[5] = st.st_ino;
+		}
+	}
+}
+
+static void uwsgi_sni_ctx_release(struct uwsgi_sni_item *item) {
+	if (!item->ctx) return;
+	uwsgi_sni_lru_unlink(item);
+	SSL_CTX_free(item->ctx);
+	item->ctx = NULL;
+	uwsgi_sni_table.contexts--;
+}
+
+static uint64_t uwsgi_sni_current_generation() {
+	if (!uwsgi.sni_generation) return 0;
+	return __atomic_load_n(uwsgi.sni_generation, __ATOMIC_ACQUIRE);
+}
+
+// must be called with uwsgi_sni_lock held, returns the (ready to use) context of the item
+static SSL_CTX *uwsgi_sni_item_ctx(struct uwsgi_sni_item *item) {
+	uint64_t generation = uwsgi_sni_current_generation();
+	if (item->ctx) {
+		if (item->generation != generation) {
+			item->generation = generation;
+			uint64_t stamp[6];
+			uwsgi_sni_item_stamp(item, stamp);
+			if (memcmp(stamp, item->stamp, sizeof(stamp))) {
+				SSL_CTX *ctx = uwsgi_ssl_new_server_context(item->name, item->crt, item->key, item->ciphers, item->client_ca);
+				if (ctx) {
+					SSL_CTX_free(item->ctx);
+					item->ctx = ctx;
+					memcpy(item->stamp, stamp, sizeof(stamp));
+					uwsgi_log_verbose("[uwsgi-sni for pid %d] reloaded SSL context for %s\n", (int) getpid(), item->name);
+				}
+				else {
+					uwsgi_log("[uwsgi-ssl] unable to reload context for \"%s\", keeping the old one\n", item->name);
+				}
+			}
+		}
+		// move it to the head of the lru list
+		if (uwsgi_sni_table.lru_head != item) {
+			uwsgi_sni_lru_unlink(item);
+			uwsgi_sni_lru_push(item);
+		}
+		return item->ctx;
+	}
+
+	uwsgi_sni_item_stamp(item, item->stamp);
+	item->generation = generation;
+	item->ctx = uwsgi_ssl_new_server_context(item->name, item->crt, item->key, item->ciphers, item->client_ca);
+	if (!item->ctx) {
+		uwsgi_log("[uwsgi-ssl] DANGER unable to initialize context for \"%s\"\n", item->name);
+		return NULL;
+	}
+	uwsgi_sni_lru_push(item);
+	uwsgi_sni_table.contexts++;
+
+	// evict the least recently used contexts
+	while (uwsgi.sni_max_contexts > 0 && uwsgi_sni_table.contexts > (uint64_t) uwsgi.sni_max_contexts && uwsgi_sni_table.lru_tail != item) {
+		uwsgi_sni_ctx_release(uwsgi_sni_table.lru_tail);
+	}
+	return item->ctx;
+}
+
+// must be called with uwsgi_sni_lock held
+static struct uwsgi_sni_item *uwsgi_sni_table_add(char *name, char *crt, char *key, char *ciphers, char *client_ca, int dynamic) {
+	if (uwsgi_sni_table.items >= uwsgi_sni_table.size) {
+		uwsgi_sni_table_grow();
+	}
+	struct uwsgi_sni_item *item = uwsgi_calloc(sizeof(struct uwsgi_sni_item));
+	item->name = name;
+	item->name_len = strlen(name);
+	item->crt = uwsgi_str(crt);
+	item->key = uwsgi_str(key);
+	item->ciphers = ciphers ? uwsgi_str(ciphers) : NULL;
+	item->client_ca = client_ca ? uwsgi_str(client_ca) : NULL;
+	item->dynamic = dynamic;
+	uint64_t slot = uwsgi_sni_hash(name, item->name_len) % uwsgi_sni_table.size;
+	item->next = uwsgi_sni_table.buckets[slot];
+	uwsgi_sni_table.buckets[slot] = item;
+	uwsgi_sni_table.items++;
+	return item;
+}
+
+static void uwsgi_sni_item_free(struct uwsgi_sni_item *item) {
+	uwsgi_sni_ctx_release(item);
+	free(item->name);
+	free(item->crt);
+	free(item->key);
+	if (item->ciphers) free(item->ciphers);
+	if (item->client_ca) free(item->client_ca);
+	free(item);
+}
+
+// must be called with uwsgi_sni_lock held, established connections keep their reference to the context
+static int uwsgi_sni_table_del(char *name, size_t name_len, int only_dynamic) {
+	if (!uwsgi_sni_table.size) return -1;
+	struct uwsgi_sni_item **prev = &uwsgi_sni_table.buckets[uwsgi_sni_hash(name, name_len) % uwsgi_sni_table.size];
+	while (*prev) {
+		struct uwsgi_sni_item *item = *prev;
+		if (!uwsgi_strncmp(item->name, item->name_len, name, name_len)) {
+			if (only_dynamic && !item->dynamic) return -1;
+			*prev = item->next;
+			uwsgi_sni_table.items--;
+			uwsgi_sni_item_free(item);
+			return 0;
+		}
+		prev = &item->next;
+	}
+	return -1;
+}
+
+// called by the master fifo
+void uwsgi_ssl_sni_reload() {
+	if (!uwsgi.sni_generation) {
+		uwsgi_log("[uwsgi-ssl] SSL is not initialized, nothing to reload\n");
+		return;
+	}
+	uint64_t generation = __sync_add_and_fetch(uwsgi.sni_generation, 1);
+	uwsgi_log_verbose("[uwsgi-ssl] SNI certificates generation %llu, changed contexts will be reloaded at the next handshake\n", (unsigned long long) generation);
+}
+
+static void uwsgi_sni_apply(SSL *ssl, SSL_CTX *ctx) {
+	SSL_set_SSL_CTX(ssl, ctx);
+	// the following steps are taken from nginx
+	SSL_set_verify(ssl, SSL_CTX_get_verify_mode(ctx), SSL_CTX_get_verify_callback(ctx));
+	SSL_set_verify_depth(ssl, SSL_CTX_get_verify_depth(ctx));
+#ifdef SSL_CTRL_CLEAR_OPTIONS
+	SSL_clear_options(ssl, SSL_get_options(ssl) & ~SSL_CTX_get_options(ctx));
+#endif
+	SSL_set_options(ssl, SSL_CTX_get_options(ctx));
 }
 
 #ifdef SSL_CTRL_SET_TLSEXT_HOSTNAME
@@ -109,23 +385,17 @@ static int uwsgi_sni_cb(SSL *ssl, int *ad, void *arg) {
 	// reduce DOS attempts
 	int count = 5;
 
+	pthread_mutex_lock(&uwsgi_sni_lock);
 	while(count > 0) {
-        	struct uwsgi_string_list *usl = uwsgi.sni;
-        	while(usl) {
-                	if (!uwsgi_strncmp(usl->value, usl->len, (char *)servername, servername_len)) {
-                        	SSL_set_SSL_CTX(ssl, (SSL_CTX *) usl->custom_ptr);
-				// the following steps are taken from nginx
-				SSL_set_verify(ssl, SSL_CTX_get_verify_mode((SSL_CTX *)usl->custom_ptr),
-				SSL_CTX_get_verify_callback((SSL_CTX *)usl->custom_ptr));
-				SSL_set_verify_depth(ssl, SSL_CTX_get_verify_depth((SSL_CTX *)usl->custom_ptr));	
-#ifdef SSL_CTRL_CLEAR_OPTIONS
-				SSL_clear_options(ssl, SSL_get_options(ssl) & ~SSL_CTX_get_options((SSL_CTX *)usl->custom_ptr));
-#endif
-				SSL_set_options(ssl, SSL_CTX_get_options((SSL_CTX *)usl->custom_ptr));
-                        	return SSL_TLSEXT_ERR_OK;
-                	}
-                	usl = usl->next;
-        	}
+		struct uwsgi_sni_item *item = uwsgi_sni_table_find((char *) servername, servername_len);
+		if (item) {
+			SSL_CTX *ctx = uwsgi_sni_item_ctx(item);
+			if (ctx) {
+				uwsgi_sni_apply(ssl, ctx);
+			}
+			pthread_mutex_unlock(&uwsgi_sni_lock);
+			return ctx ? SSL_TLSEXT_ERR_OK : SSL_TLSEXT_ERR_NOACK;
+		}
 		if (!uwsgi.subscription_dotsplit) break;
 		char *next = memchr(servername+1, '.', servername_len-1);
 		if (next) {
@@ -136,6 +406,7 @@ static int uwsgi_sni_cb(SSL *ssl, int *ad, void *arg) {
 		}
 		break;
 	}
+	pthread_mutex_unlock(&uwsgi_sni_lock);
 
 	if (uwsgi.subscription_dotsplit) goto end;
 
@@ -160,15 +431,24 @@ static int uwsgi_sni_cb(SSL *ssl, int *ad, void *arg) {
 			if (uwsgi_file_exists(sni_dir_client_ca)) {
 				client_ca = sni_dir_client_ca;
 			}
-			struct uwsgi_string_list *usl = uwsgi_ssl_add_sni_item(uwsgi_str((char *)servername), sni_dir_cert, sni_dir_key, uwsgi.sni_dir_ciphers, client_ca);
-			if (!usl) goto done;
+			SSL_CTX *ctx = NULL;
+			pthread_mutex_lock(&uwsgi_sni_lock);
+			// another thread could have already added it
+			struct uwsgi_sni_item *item = uwsgi_sni_table_find((char *) servername, servername_len);
+			if (!item) {
+				item = uwsgi_sni_table_add(uwsgi_str((char *)servername), sni_dir_cert, sni_dir_key, uwsgi.sni_dir_ciphers, client_ca, 1);
+				uwsgi_log_verbose("[uwsgi-sni for pid %d] added SSL context for %s\n", (int) getpid(), item->name);
+			}
+			ctx = uwsgi_sni_item_ctx(item);
+			if (ctx) {
+				uwsgi_sni_apply(ssl, ctx);
+			}
+			pthread_mutex_unlock(&uwsgi_sni_lock);
 			free(sni_dir_cert);
 			free(sni_dir_key);
 			free(sni_dir_client_ca);
-			SSL_set_SSL_CTX(ssl, usl->custom_ptr);
-			return SSL_TLSEXT_ERR_OK;
+			return ctx ? SSL_TLSEXT_ERR_OK : SSL_TLSEXT_ERR_NOACK;
 		}
-done:
 		free(sni_dir_cert);
 		free(sni_dir_key);
 		free(sni_dir_client_ca);
@@ -200,6 +480,110 @@ char *uwsgi_write_pem_to_file(char *name, char *buf, size_t len, char *ext) {
 	return filename;
 }
 
+/*
+
+	session tickets
+
+	by default every process generates its own random tickets key, so a session can be resumed
+	only by the process that created it. With --ssl-tickets-rotate the keys are stored in shared memory
+	and rotated by the master: every period has its key, tickets created with the two previous ones are still
+	accepted (and renewed). With --ssl-tickets-secret the keys are derived from the secret and the period
+	number, so all of the nodes sharing the secret (and a synchronized clock) can resume each other's sessions.
+
+*/
+
+static void uwsgi_ssl_ticket_key_fill(struct uwsgi_ssl_ticket_key *key, uint64_t period) {
+	if (uwsgi.ssl_tickets_secret) {
+		static char *secret = NULL;
+		static size_t secret_len = 0;
+		if (!secret) {
+			secret = uwsgi_open_and_read(uwsgi.ssl_tickets_secret, &secret_len, 0, NULL);
+			if (secret_len < 32) {
+				uwsgi_log("[uwsgi-ssl] the session tickets secret must be at least 32 bytes long\n");
+				exit(1);
+			}
+		}
+		unsigned char buf[96];
+		unsigned char msg[25];
+		unsigned int i, hlen = 0;
+		memcpy(msg, "uwsgi-ssl-ticket", 16);
+		for (i = 0; i < 8; i++) {
+			msg[16 + i] = (period >> (56 - (i * 8))) & 0xff;
+		}
+		for (i = 0; i < 3; i++) {
+			msg[24] = i;
+			HMAC(EVP_sha256(), secret, secret_len, msg, sizeof(msg), buf + (i * 32), &hlen);
+		}
+		memcpy(key->name, buf, 16);
+		memcpy(key->aes_key, buf + 32, 32);
+		memcpy(key->hmac_key, buf + 64, 32);
+	}
+	else if (RAND_bytes(key->name, 16) <= 0 || RAND_bytes(key->aes_key, 32) <= 0 || RAND_bytes(key->hmac_key, 32) <= 0) {
+		uwsgi_log("[uwsgi-ssl] unable to generate session tickets key\n");
+		exit(1);
+	}
+	// the key must be complete before it can be used
+	__sync_synchronize();
+	key->period = period;
+}
+
+static void uwsgi_ssl_tickets_init() {
+	if (uwsgi.ssl_tickets) return;
+	uwsgi.ssl_tickets = uwsgi_calloc_shared(sizeof(struct uwsgi_ssl_tickets));
+	uint64_t period = uwsgi_now() / uwsgi.ssl_tickets_rotate;
+	// tickets of the previous periods can be accepted only if the keys are derived from a secret
+	if (uwsgi.ssl_tickets_secret) {
+		uwsgi_ssl_ticket_key_fill(&uwsgi.ssl_tickets->keys[(period - 2) % 4], period - 2);
+		uwsgi_ssl_ticket_key_fill(&uwsgi.ssl_tickets->keys[(period - 1) % 4], period - 1);
+	}
+	uwsgi_ssl_ticket_key_fill(&uwsgi.ssl_tickets->keys[period % 4], period);
+	uwsgi_ssl_ticket_key_fill(&uwsgi.ssl_tickets->keys[(period + 1) % 4], period + 1);
+	uwsgi.ssl_tickets->period = period;
+}
+
+// called by the master, the key of the next period is prepared in advance (so processes can switch to it without waiting for the master)
+void uwsgi_ssl_tickets_rotate() {
+	struct uwsgi_ssl_tickets *ust = uwsgi.ssl_tickets;
+	uint64_t period = uwsgi_now() / uwsgi.ssl_tickets_rotate;
+	if (period == ust->period) return;
+	if (ust->keys[period % 4].period != period) {
+		uwsgi_ssl_ticket_key_fill(&ust->keys[period % 4], period);
+	}
+	uwsgi_ssl_ticket_key_fill(&ust->keys[(period + 1) % 4], period + 1);
+	ust->period = period;
+}
+
+static int uwsgi_ssl_ticket_key_cb(SSL *ssl, unsigned char *key_name, unsigned char *iv, EVP_CIPHER_CTX *ectx, HMAC_CTX *hctx, int enc) {
+	struct uwsgi_ssl_tickets *ust = uwsgi.ssl_tickets;
+	uint64_t period = uwsgi_now() / uwsgi.ssl_tickets_rotate;
+	struct uwsgi_ssl_ticket_key *current = &ust->keys[period % 4];
+	// the master is late (or the clock went back)
+	if (current->period != period) {
+		current = &ust->keys[ust->period % 4];
+	}
+
+	if (enc) {
+		if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) <= 0) return -1;
+		memcpy(key_name, current->name, 16);
+		if (!EVP_EncryptInit_ex(ectx, EVP_aes_256_cbc(), NULL, current->aes_key, iv)) return -1;
+		if (!HMAC_Init_ex(hctx, current->hmac_key, 32, EVP_sha256(), NULL)) return -1;
+		return 1;
+	}
+
+	int i;
+	for (i = 0; i < 4; i++) {
+		struct uwsgi_ssl_ticket_key *key = &ust->keys[i];
+		if (memcmp(key_name, key->name, 16)) continue;
+		if (!HMAC_Init_ex(hctx, key->hmac_key, 32, EVP_sha256(), NULL)) return -1;
+		if (!EVP_DecryptInit_ex(ectx, EVP_aes_256_cbc(), NULL, key->aes_key, iv)) return -1;
+		// renew tickets not encrypted with the current key
+		return key == current ? 1 : 2;
+	}
+
+	// unknown key, full handshake
+	return 0;
+}
+
 SSL_CTX *uwsgi_ssl_new_server_context(char *name, char *crt, char *key, char *ciphers, char *client_ca) {
 
 	int crt_need_free = 0;
@@ -408,9 +792,21 @@ SSL_CTX *uwsgi_ssl_new_server_context(char *name, char *crt, char *key, char *ci
                 SSL_CTX_sess_set_get_cb(ctx, uwsgi_ssl_session_get_cb);
                 SSL_CTX_sess_set_remove_cb(ctx, uwsgi_ssl_session_remove_cb);
         }
+	else if (uwsgi.ssl_tickets_rotate > 0) {
+		uwsgi_ssl_tickets_init();
+		SSL_CTX_set_tlsext_ticket_key_cb(ctx, uwsgi_ssl_ticket_key_cb);
+	}
 
         SSL_CTX_set_timeout(ctx, uwsgi.ssl_sessions_timeout);
 
+	if (uwsgi.ssl_ktls) {
+#ifdef SSL_OP_ENABLE_KTLS
+		ssloptions |= SSL_OP_ENABLE_KTLS;
+#else
+		uwsgi_log("[uwsgi-ssl] kernel TLS is not supported by this OpenSSL build\n");
+#endif
+	}
+
 	struct uwsgi_string_list *usl = NULL;
 	uwsgi_foreach(usl, uwsgi.ssl_options) {
 		ssloptions |= atoi(usl->value);
@@ -608,70 +1004,64 @@ void uwsgi_opt_sni(char *opt, char *value, void *foobar) {
                 uwsgi_ssl_init();
         }
 
-        SSL_CTX *ctx = uwsgi_ssl_new_server_context(v, crt, key, ciphers, client_ca);
-        if (!ctx) {
-                uwsgi_log("[uwsgi-ssl] DANGER unable to initialize context for \"%s\"\n", v);
-                free(v);
-                return;
-        }
-
 #ifdef UWSGI_PCRE
         if (!strcmp(opt, "sni-regexp")) {
+		SSL_CTX *ctx = uwsgi_ssl_new_server_context(v, crt, key, ciphers, client_ca);
+		if (!ctx) {
+			uwsgi_log("[uwsgi-ssl] DANGER unable to initialize context for \"%s\"\n", v);
+			free(v);
+			return;
+		}
                 struct uwsgi_regexp_list *url = uwsgi_regexp_new_list(&uwsgi.sni_regexp, v);
                 url->custom_ptr = ctx;
-        }
-        else {
-#endif
-                struct uwsgi_string_list *usl = uwsgi_string_new_list(&uwsgi.sni, v);
-                usl->custom_ptr = ctx;
-#ifdef UWSGI_PCRE
+		return;
         }
 #endif
 
+	pthread_mutex_lock(&uwsgi_sni_lock);
+	if (uwsgi_sni_table_find(v, strlen(v))) {
+		pthread_mutex_unlock(&uwsgi_sni_lock);
+		uwsgi_log("[uwsgi-ssl] SNI context for \"%s\" already defined\n", v);
+		free(v);
+		return;
+	}
+	struct uwsgi_sni_item *item = uwsgi_sni_table_add(uwsgi_str(v), crt, key, ciphers, client_ca, 0);
+	// the context will be created at the first handshake
+	if (!uwsgi.sni_lazy && !uwsgi_sni_item_ctx(item)) {
+		uwsgi_sni_table_del(item->name, item->name_len, 0);
+	}
+	pthread_mutex_unlock(&uwsgi_sni_lock);
+	free(v);
 }
 
-struct uwsgi_string_list *uwsgi_ssl_add_sni_item(char *name, char *crt, char *key, char *ciphers, char *client_ca) {
+SSL_CTX *uwsgi_ssl_add_sni_item(char *name, char *crt, char *key, char *ciphers, char *client_ca) {
 	if (!uwsgi.ssl_initialized) {
                 uwsgi_ssl_init();
         }
-	SSL_CTX *ctx = uwsgi_ssl_new_server_context(name, crt, key, ciphers, client_ca);
-        if (!ctx) {
-                uwsgi_log("[uwsgi-ssl] DANGER unable to initialize context for \"%s\"\n", name);
+
+	pthread_mutex_lock(&uwsgi_sni_lock);
+	struct uwsgi_sni_item *item = uwsgi_sni_table_find(name, strlen(name));
+	if (item) {
 		free(name);
+	}
+	else {
+		item = uwsgi_sni_table_add(name, crt, key, ciphers, client_ca, 1);
+	}
+	SSL_CTX *ctx = uwsgi_sni_item_ctx(item);
+	if (!ctx) {
+		uwsgi_sni_table_del(item->name, item->name_len, 1);
+		pthread_mutex_unlock(&uwsgi_sni_lock);
 		return NULL;
 	}
-
-	struct uwsgi_string_list *usl = uwsgi_string_new_list(&uwsgi.sni, name);
-	usl->custom_ptr = ctx;
-	// mark it as dynamic
-	usl->custom = 1;
-	uwsgi_log_verbose("[uwsgi-sni for pid %d] added SSL context for %s\n", (int) getpid(), name);
-	return usl;
+	pthread_mutex_unlock(&uwsgi_sni_lock);
+	uwsgi_log_verbose("[uwsgi-sni for pid %d] added SSL context for %s\n", (int) getpid(), item->name);
+	return ctx;
 }
 
 void uwsgi_ssl_del_sni_item(char *name, uint16_t name_len) {
-	struct uwsgi_string_list *usl = NULL, *last_sni = NULL, *sni_item = NULL;
-	uwsgi_foreach(usl, uwsgi.sni) {
-		if (!uwsgi_strncmp(usl->value, usl->len, name, name_len) && usl->custom) {
-			sni_item = usl;
-			break;
-		}
-		last_sni = usl;
-	}
-
-	if (!sni_item) return;
-
-	if (last_sni) {
-		last_sni->next = sni_item->next;
-	}
-	else {
-		uwsgi.sni = sni_item->next;
-	}
-
-	// we are free to destroy it as no more clients are using it
-	SSL_CTX_free((SSL_CTX *) sni_item->custom_ptr);
-	free(sni_item->value);
-	free(sni_item);	
-
-	uwsgi_log_verbose("[uwsgi-sni for pid %d] destroyed SSL context for %s\n",(int) getpid(), name);
+	pthread_mutex_lock(&uwsgi_sni_lock);
+	int ret = uwsgi_sni_table_del(name, name_len, 1);
+	pthread_mutex_unlock(&uwsgi_sni_lock);
+	if (ret) return;
+	uwsgi_log_verbose("[uwsgi-sni for pid %d] destroyed SSL context for %.*s\n",(int) getpid(), name_len, name);
 }
@@ -2,20 +2,63 @@
 
 extern struct uwsgi_server uwsgi;
 
-int uwsgi_static_want_gzip(struct wsgi_request *wsgi_req, char *filename, size_t *filename_len, struct stat *st) {
-	// check for filename size
-	if (*filename_len + 4 > PATH_MAX) return 0;
-	// check for supported encodings
-	if (!uwsgi_contains_n(wsgi_req->encoding, wsgi_req->encoding_len, "gzip", 4) ) return 0;
+// the supported precompressed variants (--static-precompressed), gzip is the default
+static struct uwsgi_static_encoding {
+	char *name;
+	size_t name_len;
+	char *ext;
+	size_t ext_len;
+} static_encodings[] = {
+	{"gzip", 4, ".gz", 3},
+	{"br", 2, ".br", 3},
+	{"zstd", 4, ".zst", 4},
+	{NULL, 0, NULL, 0},
+};
+
+// returns the q-value (in thousandths) of an encoding in the Accept-Encoding header
+int uwsgi_accept_encoding_q(char *buf, uint16_t len, char *name, size_t name_len) {
+	int q_star = 0;
+	char *p = buf, *end = buf + len;
+	while (p < end) {
+		char *item_end = memchr(p, ',', end - p);
+		if (!item_end) item_end = end;
+		while (p < item_end && (*p == ' ' || *p == '\t')) p++;
+		char *token = p;
+		while (p < item_end && *p != ';' && *p != ' ' && *p != '\t') p++;
+		size_t token_len = p - token;
+		int q = 1000;
+		for (; p + 1 < item_end; p++) {
+			if (p[0] == 'q' && p[1] == '=' && (p[-1] == ';' || p[-1] == ' ')) {
+				p += 2;
+				q = 0;
+				if (p < item_end && *p == '1') q = 1000;
+				else if (p + 1 < item_end && p[0] == '0' && p[1] == '.') {
+					int i, mul = 100;
+					for (i = 2; i < 5 && p + i < item_end && isdigit((int) p[i]); i++) {
+						q += (p[i] - '0') * mul;
+						mul /= 10;
+					}
+				}
+				break;
+			}
+		}
+		if (!uwsgi_strnicmp(token, token_len, name, name_len)) return q;
+		if (token_len == 1 && *token == '*') q_star = q;
+		p = item_end + 1;
+	}
+	return q_star;
+}
 
+// check if the static-gzip-* rules allow a compressed variant for the file
+static int static_can_compress(char *filename, size_t filename_len) {
 	// check for 'all'
-	if (uwsgi.static_gzip_all) goto gzip;
+	if (uwsgi.static_gzip_all) return 1;
 
 	// check for dirs/prefix
 	struct uwsgi_string_list *usl = uwsgi.static_gzip_dir;
 	while(usl) {
-		if (!uwsgi_starts_with(filename, *filename_len, usl->value, usl->len)) {
-			goto gzip;
+		if (!uwsgi_starts_with(filename, filename_len, usl->value, usl->len)) {
+			return 1;
 		}
 		usl = usl->next;
 	} 
@@ -23,8 +66,8 @@ int uwsgi_static_want_gzip(struct wsgi_request *wsgi_req, char *filename, size_t
 	// check for ext/suffix
 	usl = uwsgi.static_gzip_ext;
         while(usl) {
-		if (!uwsgi_strncmp(filename + (*filename_len - usl->len), usl->len, usl->value, usl->len)) {
-			goto gzip;
+		if (filename_len >= usl->len && !uwsgi_strncmp(filename + (filename_len - usl->len), usl->len, usl->value, usl->len)) {
+			return 1;
 		}
                 usl = usl->next;
         }
@@ -33,15 +76,102 @@ int uwsgi_static_want_gzip(struct wsgi_request *wsgi_req, char *filename, size_t
 	// check for regexp
 	struct uwsgi_regexp_list *url = uwsgi.static_gzip;
 	while(url) {
-		if (uwsgi_regexp_match(url->pattern, url->pattern_extra, filename, *filename_len) >= 0) {
-			goto gzip;
+		if (uwsgi_regexp_match(url->pattern, url->pattern_extra, filename, filename_len) >= 0) {
+			return 1;
 		}
 		url = url->next;
 	}
 #endif
 	return 0;
+}
+
+static struct uwsgi_static_encoding *static_encoding_by_name(char *name) {
+	struct uwsgi_static_encoding *use = static_encodings;
+	while (use->name) {
+		if (!strcmp(use->name, name)) return use;
+		use++;
+	}
+	return NULL;
+}
+
+void uwsgi_static_compression_setup() {
+	struct uwsgi_string_list *usl = NULL;
+	uwsgi_foreach(usl, uwsgi.static_precompressed) {
+		if (!static_encoding_by_name(usl->value)) {
+			uwsgi_log("unsupported static precompressed encoding: %s (use gzip, br or zstd)\n", usl->value);
+			exit(1);
+		}
+	}
+#ifdef UWSGI_ZLIB
+	if (uwsgi.static_gzip_cache && !strchr(uwsgi.static_gzip_cache, '@') && !uwsgi_cache_by_name(uwsgi.static_gzip_cache)) {
+		uwsgi_log("unable to find cache \"%s\"\n", uwsgi.static_gzip_cache);
+		exit(1);
+	}
+#else
+	if (uwsgi.static_gzip_store || uwsgi.static_gzip_cache) {
+		uwsgi_log("--static-gzip-store and --static-gzip-cache require zlib support\n");
+		exit(1);
+	}
+#endif
+}
 
-gzip:
+/*
+	choose the best precompressed sibling (file.gz, file.br, file.zst) using the
+	Accept-Encoding q-values (ties are resolved with the --static-precompressed order).
+	On success filename and st point to the sibling and the encoding name is returned.
+*/
+char *uwsgi_static_want_encoding(struct wsgi_request *wsgi_req, char *filename, size_t *filename_len, struct stat *st, size_t *encoding_len) {
+	struct uwsgi_static_encoding *candidates[3];
+	int q[3];
+	int i, j, n = 0;
+	struct stat orig_st;
+
+	// check for filename size
+	if (*filename_len + 5 > PATH_MAX) return NULL;
+	if (!wsgi_req->encoding_len) return NULL;
+	if (!static_can_compress(filename, *filename_len)) return NULL;
+
+	struct uwsgi_string_list *usl = uwsgi.static_precompressed;
+	struct uwsgi_static_encoding *use = usl ? static_encoding_by_name(usl->value) : &static_encodings[0];
+	while (use && n < 3) {
+		int eq = uwsgi_accept_encoding_q(wsgi_req->encoding, wsgi_req->encoding_len, use->name, use->name_len);
+		if (eq > 0) {
+			// insertion sort, stable
+			for (i = n; i > 0 && q[i - 1] < eq; i--) {
+				candidates[i] = candidates[i - 1];
+				q[i] = q[i - 1];
+			}
+			candidates[i] = use;
+			q[i] = eq;
+			n++;
+		}
+		if (!usl) break;
+		usl = usl->next;
+		use = usl ? static_encoding_by_name(usl->value) : NULL;
+	}
+
+	if (n > 0) orig_st = *st;
+	for (j = 0; j < n; j++) {
+		use = candidates[j];
+		memcpy(filename + *filename_len, use->ext, use->ext_len + 1);
+		if (!stat(filename, st) && S_ISREG(st->st_mode)) {
+			*filename_len += use->ext_len;
+			*encoding_len = use->name_len;
+			return use->name;
+		}
+		filename[*filename_len] = 0;
+		*st = orig_st;
+	}
+
+	return NULL;
+}
+
+int uwsgi_static_want_gzip(struct wsgi_request *wsgi_req, char *filename, size_t *filename_len, struct stat *st) {
+	// check for filename size
+	if (*filename_len + 4 > PATH_MAX) return 0;
+	// check for supported encodings
+	if (uwsgi_accept_encoding_q(wsgi_req->encoding, wsgi_req->encoding_len, "gzip", 4) <= 0) return 0;
+	if (!static_can_compress(filename, *filename_len)) return 0;
 
 	memcpy(filename + *filename_len, ".gz\0", 4);
 	*filename_len += 3;
@@ -55,6 +185,131 @@ gzip:
 	return 1;
 }
 
+#ifdef UWSGI_ZLIB
+/*
+	compress-once (--static-gzip-store and --static-gzip-cache)
+
+	when no precompressed sibling is available, the file is gzipped on the first request
+	and the result is stored on disk (mirroring the real path under the store directory,
+	with the mtime of the original) or in a uWSGI cache (prefixed by the mtime and size of the original).
+*/
+
+static struct uwsgi_buffer *static_gzip_file(char *filename) {
+	size_t len = 0;
+	char *buf = uwsgi_open_and_read(filename, &len, 0, NULL);
+	if (!buf) return NULL;
+	struct uwsgi_buffer *ub = uwsgi_gzip(buf, len);
+	free(buf);
+	return ub;
+}
+
+// on success filename and st point to the compressed copy
+static int static_gzip_store(struct wsgi_request *wsgi_req, char *filename, size_t *filename_len, struct stat *st) {
+	char path[PATH_MAX + 1];
+	char tmp_path[PATH_MAX + 1];
+	struct stat gz_st;
+	size_t dir_len = strlen(uwsgi.static_gzip_store);
+	size_t path_len = dir_len + *filename_len + 3;
+	if (path_len > PATH_MAX) return -1;
+	memcpy(path, uwsgi.static_gzip_store, dir_len);
+	memcpy(path + dir_len, filename, *filename_len);
+	memcpy(path + dir_len + *filename_len, ".gz", 4);
+
+	if (!stat(path, &gz_st) && gz_st.st_mtime == st->st_mtime) goto found;
+
+	int ret = snprintf(tmp_path, PATH_MAX + 1, "%s.%d.%d", path, (int) uwsgi.mypid, wsgi_req->async_id);
+	if (ret <= 0 || ret > PATH_MAX) return -1;
+
+	struct uwsgi_buffer *ub = static_gzip_file(filename);
+	if (!ub) return -1;
+
+	// create the directories (the store too)
+	char *p = path + 1;
+	while ((p = strchr(p, '/'))) {
+		*p = 0;
+		if (mkdir(path, 0755) && errno != EEXIST) {
+			uwsgi_error("static_gzip_store()/mkdir()");
+			*p = '/';
+			goto error;
+		}
+		*p++ = '/';
+	}
+
+	int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		uwsgi_error_open(tmp_path);
+		goto error;
+	}
+	if (write(fd, ub->buf, ub->pos) != (ssize_t) ub->pos) {
+		uwsgi_error("static_gzip_store()/write()");
+		close(fd);
+		goto error2;
+	}
+	close(fd);
+
+	struct timeval tv[2];
+	tv[0].tv_sec = st->st_atime;
+	tv[0].tv_usec = 0;
+	tv[1].tv_sec = st->st_mtime;
+	tv[1].tv_usec = 0;
+	if (utimes(tmp_path, tv) || rename(tmp_path, path)) {
+		uwsgi_error("static_gzip_store()/rename()");
+		goto error2;
+	}
+	uwsgi_buffer_destroy(ub);
+
+	if (stat(path, &gz_st)) return -1;
+found:
+	memcpy(filename, path, path_len + 1);
+	*filename_len = path_len;
+	*st = gz_st;
+	return 0;
+
+error2:
+	unlink(tmp_path);
+error:
+	uwsgi_buffer_destroy(ub);
+	return -1;
+}
+
+// returns the compressed body (to free) from the cache, compressing the file if needed
+static char *static_gzip_cache(char *filename, size_t filename_len, struct stat *st, size_t *body_len) {
+	uint64_t header[2];
+	uint64_t vallen = 0;
+	if (filename_len > 0xffff) return NULL;
+
+	header[0] = st->st_mtime;
+	header[1] = st->st_size;
+
+	char *value = uwsgi_cache_magic_get(filename, filename_len, &vallen, NULL, uwsgi.static_gzip_cache);
+	if (value) {
+		if (vallen > sizeof(header) && !memcmp(value, header, sizeof(header))) goto found;
+		free(value);
+	}
+
+	struct uwsgi_buffer *gz = static_gzip_file(filename);
+	if (!gz) return NULL;
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(sizeof(header) + gz->pos);
+	if (uwsgi_buffer_append(ub, (char *) header, sizeof(header)) || uwsgi_buffer_append(ub, gz->buf, gz->pos)) {
+		uwsgi_buffer_destroy(gz);
+		uwsgi_buffer_destroy(ub);
+		return NULL;
+	}
+	uwsgi_buffer_destroy(gz);
+	if (uwsgi_cache_magic_set(filename, filename_len, ub->buf, ub->pos, 0, UWSGI_CACHE_FLAG_UPDATE, uwsgi.static_gzip_cache)) {
+		uwsgi_log("[uwsgi-fileserve] unable to store the gzip version of %s in the cache\n", filename);
+	}
+	value = ub->buf;
+	vallen = ub->pos;
+	ub->buf = NULL;
+	uwsgi_buffer_destroy(ub);
+found:
+	*body_len = vallen - sizeof(header);
+	memmove(value, value + sizeof(header), *body_len);
+	return value;
+}
+#endif
+
 int uwsgi_http_date(time_t t, char *dst) {
 
         static char *week[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
@@ -439,16 +694,166 @@ static int uwsgi_static_stat(struct wsgi_request *wsgi_req, char *filename, size
 	return -1;
 }
 
-int uwsgi_real_file_serve(struct wsgi_request *wsgi_req, char *real_filename, size_t real_filename_len, struct stat *st) {
+/*
 
-	size_t mime_type_size = 0;
+	the static fd cache (--static-fd-cache)
+
+	each worker keeps a direct-mapped table of open files indexed by the requested name.
+	An item stores the resolved (and already security-checked) path, the stat() result and
+	the values of Content-Type, Last-Modified and ETag, so a hit skips realpath(), stat(),
+	open(), the mime lookup and the date formatting.
+
+	items are revalidated with a stat() after --static-fd-cache-ttl seconds, and the whole table
+	is flushed when a --static-fd-cache-watch directory changes (the master monitors them via fsmon
+	and bumps a generation counter in the shared area).
+
+	an item can be replaced while another thread is sending it, so they are refcounted
+	(the table holds a reference too).
+
+*/
+
+struct uwsgi_static_fd {
+	char *key;
+	size_t key_len;
+	char *filename;
+	size_t filename_len;
+	struct stat st;
+	struct uwsgi_string_list *index;
+	int fd;
+	char *mime_type;
+	size_t mime_type_len;
+	char last_modified[49];
+	int last_modified_len;
+	char etag[64];
+	int etag_len;
+	time_t checked;
+	uint64_t generation;
+	int refcnt;
+};
+
+static struct uwsgi_static_fd **static_fd_cache;
+
+static void static_fd_cache_flush(struct uwsgi_fsmon *fs) {
+	uwsgi.shared->static_fd_cache_generation++;
+}
+
+void uwsgi_static_fd_cache_setup() {
+	static_fd_cache = uwsgi_calloc(sizeof(struct uwsgi_static_fd *) * uwsgi.static_fd_cache);
+	struct uwsgi_string_list *usl = NULL;
+	uwsgi_foreach(usl, uwsgi.static_fd_cache_watch) {
+		uwsgi_register_fsmon(usl->value, static_fd_cache_flush, NULL);
+	}
+	uwsgi_log("static fd cache: %d items per worker, ttl %d seconds\n", uwsgi.static_fd_cache, uwsgi.static_fd_cache_ttl);
+}
+
+static void static_fd_put(struct uwsgi_static_fd *usf) {
+	if (--usf->refcnt > 0) return;
+	close(usf->fd);
+	free(usf->key);
+	free(usf->filename);
+	free(usf);
+}
+
+static void static_fd_release(struct uwsgi_static_fd *usf) {
+	if (uwsgi.threads > 1) pthread_mutex_lock(&uwsgi.lock_static);
+	static_fd_put(usf);
+	if (uwsgi.threads > 1) pthread_mutex_unlock(&uwsgi.lock_static);
+}
+
+// returns a referenced item (or NULL)
+static struct uwsgi_static_fd *static_fd_get(struct wsgi_request *wsgi_req, char *key, size_t key_len) {
+	struct uwsgi_static_fd *usf = NULL;
+	uint32_t slot = djb33x_hash(key, key_len) % uwsgi.static_fd_cache;
+	time_t now = wsgi_req->start_of_request / 1000000;
+
+	if (uwsgi.threads > 1) pthread_mutex_lock(&uwsgi.lock_static);
+	usf = static_fd_cache[slot];
+	if (!usf || uwsgi_strncmp(usf->key, usf->key_len, key, key_len)) {
+		usf = NULL;
+		goto end;
+	}
+	if (usf->generation != uwsgi.shared->static_fd_cache_generation) goto drop;
+	if (now - usf->checked >= uwsgi.static_fd_cache_ttl) {
+		struct stat st;
+		if (stat(usf->filename, &st) || st.st_ino != usf->st.st_ino || st.st_dev != usf->st.st_dev
+			|| st.st_size != usf->st.st_size || st.st_mtime != usf->st.st_mtime) goto drop;
+		usf->checked = now;
+	}
+	usf->refcnt++;
+	goto end;
+drop:
+	static_fd_cache[slot] = NULL;
+	static_fd_put(usf);
+	usf = NULL;
+end:
+	if (uwsgi.threads > 1) pthread_mutex_unlock(&uwsgi.lock_static);
+	return usf;
+}
+
+// returns a referenced item (or NULL)
+static struct uwsgi_static_fd *static_fd_add(struct wsgi_request *wsgi_req, char *key, size_t key_len, char *filename, size_t filename_len, struct stat *st, struct uwsgi_string_list *index) {
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) return NULL;
+	// do not leak it to the processes spawned by the app
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+	struct uwsgi_static_fd *usf = uwsgi_calloc(sizeof(struct uwsgi_static_fd));
+	usf->key = uwsgi_concat2n(key, key_len, "", 0);
+	usf->key_len = key_len;
+	usf->filename = uwsgi_concat2n(filename, filename_len, "", 0);
+	usf->filename_len = filename_len;
+	usf->st = *st;
+	usf->index = index;
+	usf->fd = fd;
+	usf->mime_type = uwsgi_get_mime_type(filename, filename_len, &usf->mime_type_len);
+	usf->last_modified_len = uwsgi_http_date(st->st_mtime, usf->last_modified);
+	usf->etag_len = snprintf(usf->etag, sizeof(usf->etag), "\"%llx-%llx\"", (unsigned long long) st->st_mtime, (unsigned long long) st->st_size);
+	usf->checked = wsgi_req->start_of_request / 1000000;
+	usf->generation = uwsgi.shared->static_fd_cache_generation;
+	// one for the table and one for the caller
+	usf->refcnt = 2;
+
+	uint32_t slot = djb33x_hash(key, key_len) % uwsgi.static_fd_cache;
+	if (uwsgi.threads > 1) pthread_mutex_lock(&uwsgi.lock_static);
+	if (static_fd_cache[slot]) static_fd_put(static_fd_cache[slot]);
+	static_fd_cache[slot] = usf;
+	if (uwsgi.threads > 1) pthread_mutex_unlock(&uwsgi.lock_static);
+	return usf;
+}
+
+static int static_add_last_modified(struct wsgi_request *wsgi_req, struct stat *st, struct uwsgi_static_fd *usf) {
 	char http_last_modified[49];
-	int use_gzip = 0;
+	if (usf) {
+		return uwsgi_response_add_header(wsgi_req, "Last-Modified", 13, usf->last_modified, usf->last_modified_len);
+	}
+	int size = uwsgi_http_date(st->st_mtime, http_last_modified);
+	return uwsgi_response_add_header(wsgi_req, "Last-Modified", 13, http_last_modified, size);
+}
 
-	char *mime_type = uwsgi_get_mime_type(real_filename, real_filename_len, &mime_type_size);
+static int static_file_serve_do(struct wsgi_request *wsgi_req, char *real_filename, size_t real_filename_len, struct stat *st, struct uwsgi_static_fd *usf) {
 
-	// here we need to choose if we want the gzip variant;
-	if (uwsgi_static_want_gzip(wsgi_req, real_filename, &real_filename_len, st)) use_gzip = 1;
+	size_t mime_type_size = 0;
+	char *encoding = NULL;
+	size_t encoding_len = 0;
+	char *mime_type = NULL;
+	// compressed in memory (--static-gzip-cache)
+	char *body = NULL;
+	size_t body_len = 0;
+
+	if (usf) {
+		mime_type = usf->mime_type;
+		mime_type_size = usf->mime_type_len;
+	}
+	else {
+		mime_type = uwsgi_get_mime_type(real_filename, real_filename_len, &mime_type_size);
+	}
+
+	// here we need to choose if we want a compressed variant
+	encoding = uwsgi_static_want_encoding(wsgi_req, real_filename, &real_filename_len, st, &encoding_len);
+	if (encoding) {
+		// the cached fd and headers are for the uncompressed file
+		usf = NULL;
+	}
 
 	if (wsgi_req->if_modified_since_len) {
 		time_t ims = parse_http_date(wsgi_req->if_modified_since, wsgi_req->if_modified_since_len);
@@ -458,6 +863,40 @@ int uwsgi_real_file_serve(struct wsgi_request *wsgi_req, char *real_filename, si
 			return uwsgi_response_write_headers_do(wsgi_req);
 		}
 	}
+
+	if (usf) {
+		uint16_t inm_len = 0;
+		char *inm = uwsgi_get_var(wsgi_req, "HTTP_IF_NONE_MATCH", 18, &inm_len);
+		if (inm && !uwsgi_strncmp(inm, inm_len, usf->etag, usf->etag_len)) {
+			if (uwsgi_response_prepare_headers(wsgi_req, "304 Not Modified", 16))
+				return -1;
+			return uwsgi_response_write_headers_do(wsgi_req);
+		}
+	}
+#ifdef UWSGI_ZLIB
+	// compress it once
+	if (!encoding && (uwsgi.static_gzip_store || uwsgi.static_gzip_cache) && st->st_size > 0
+		&& uwsgi_accept_encoding_q(wsgi_req->encoding, wsgi_req->encoding_len, "gzip", 4) > 0
+		&& static_can_compress(real_filename, real_filename_len)) {
+		if (uwsgi.static_gzip_store) {
+			if (!static_gzip_store(wsgi_req, real_filename, &real_filename_len, st)) {
+				encoding = "gzip";
+				encoding_len = 4;
+				usf = NULL;
+			}
+		}
+		// ranges of the in-memory version are not supported
+		else if (uwsgi.file_serve_mode == 0 && !wsgi_req->range_from && !wsgi_req->range_to) {
+			body = static_gzip_cache(real_filename, real_filename_len, st, &body_len);
+			if (body) {
+				encoding = "gzip";
+				encoding_len = 4;
+				usf = NULL;
+			}
+		}
+	}
+#endif
+
 #ifdef UWSGI_DEBUG
 	uwsgi_log("[uwsgi-fileserve] file %s found\n", real_filename);
 #endif
@@ -465,7 +904,20 @@ int uwsgi_real_file_serve(struct wsgi_request *wsgi_req, char *real_filename, si
 	// static file - don't update avg_rt after request
 	wsgi_req->do_not_account_avg_rt = 1;
 
-	size_t fsize = st->st_size;
+	size_t fsize = body ? body_len : (size_t) st->st_size;
+	struct uwsgi_byteranges *ubr = NULL;
+	if (wsgi_req->range_len && !body) {
+		struct uwsgi_http_range ranges[UWSGI_MAX_RANGES];
+		int n = uwsgi_parse_http_ranges(wsgi_req->range, wsgi_req->range_len, fsize, ranges, UWSGI_MAX_RANGES);
+		if (n == 1) {
+			wsgi_req->range_from = ranges[0].from;
+			wsgi_req->range_to = ranges[0].to;
+		}
+		// multiple ranges are sent as multipart/byteranges (only by raw transfers)
+		else if (n > 1 && uwsgi.file_serve_mode == 0) {
+			ubr = uwsgi_byteranges_new(ranges, n, fsize, mime_type, mime_type_size);
+		}
+	}
 	// security check
         if (wsgi_req->range_from > fsize) {
                 wsgi_req->range_from = 0;
@@ -483,11 +935,11 @@ int uwsgi_real_file_serve(struct wsgi_request *wsgi_req, char *real_filename, si
         }
 
 	// HTTP status
-	if (fsize > 0 && (wsgi_req->range_from || wsgi_req->range_to)) {
-		if (uwsgi_response_prepare_headers(wsgi_req, "206 Partial Content", 19)) return -1;
+	if (ubr || (fsize > 0 && (wsgi_req->range_from || wsgi_req->range_to))) {
+		if (uwsgi_response_prepare_headers(wsgi_req, "206 Partial Content", 19)) goto error;
 	}
 	else {
-		if (uwsgi_response_prepare_headers(wsgi_req, "200 OK", 6)) return -1;
+		if (uwsgi_response_prepare_headers(wsgi_req, "200 OK", 6)) goto error;
 	}
 
 #ifdef UWSGI_PCRE
@@ -496,13 +948,15 @@ int uwsgi_real_file_serve(struct wsgi_request *wsgi_req, char *real_filename, si
 	uwsgi_add_expires_uri(wsgi_req, st);
 #endif
 
-	if (use_gzip) {
-		if (uwsgi_response_add_header(wsgi_req, "Content-Encoding", 16, "gzip", 4)) return -1;
+	if (encoding) {
+		if (uwsgi_response_add_header(wsgi_req, "Content-Encoding", 16, encoding, encoding_len)) goto error;
+		if (uwsgi_response_add_header(wsgi_req, "Vary", 4, "Accept-Encoding", 15)) goto error;
 	}
 
 	// Content-Type (if available)
 	if (mime_type_size > 0 && mime_type) {
-		if (uwsgi_response_add_content_type(wsgi_req, mime_type, mime_type_size)) return -1;
+		// the type of every part is in the part headers
+		if (!ubr && uwsgi_response_add_content_type(wsgi_req, mime_type, mime_type_size)) goto error;
 		// check for content-type related headers
 		uwsgi_add_expires_type(wsgi_req, mime_type, mime_type_size, st);
 	}
@@ -514,35 +968,69 @@ int uwsgi_real_file_serve(struct wsgi_request *wsgi_req, char *real_filename, si
 	if (uwsgi.file_serve_mode == 1) {
 		if (uwsgi_response_add_header(wsgi_req, "X-Accel-Redirect", 16, real_filename, real_filename_len)) return -1;
 		// this is the final header (\r\n added)
-		int size = uwsgi_http_date(st->st_mtime, http_last_modified);
-		if (uwsgi_response_add_header(wsgi_req, "Last-Modified", 13, http_last_modified, size)) return -1;
+		if (static_add_last_modified(wsgi_req, st, usf)) return -1;
 	}
 	// apache
 	else if (uwsgi.file_serve_mode == 2) {
 		if (uwsgi_response_add_header(wsgi_req, "X-Sendfile", 10, real_filename, real_filename_len)) return -1;
 		// this is the final header (\r\n added)
-		int size = uwsgi_http_date(st->st_mtime, http_last_modified);
-		if (uwsgi_response_add_header(wsgi_req, "Last-Modified", 13, http_last_modified, size)) return -1;
+		if (static_add_last_modified(wsgi_req, st, usf)) return -1;
 	}
 	// raw
 	else {
+		if (ubr) {
+			if (uwsgi_response_add_byteranges_headers(wsgi_req, ubr)) goto error;
+		}
 		// set Content-Length (to fsize NOT st->st_size)
-		if (uwsgi_response_add_content_length(wsgi_req, fsize)) return -1;
-		if (fsize > 0 && (wsgi_req->range_from || wsgi_req->range_to)) {
+		else if (uwsgi_response_add_content_length(wsgi_req, fsize)) goto error;
+		if (!ubr && fsize > 0 && (wsgi_req->range_from || wsgi_req->range_to)) {
 			// here use the original size !!!
-			if (uwsgi_response_add_content_range(wsgi_req, wsgi_req->range_from, wsgi_req->range_to, st->st_size)) return -1;
+			if (uwsgi_response_add_content_range(wsgi_req, wsgi_req->range_from, wsgi_req->range_to, st->st_size)) goto error;
+		}
+		if (static_add_last_modified(wsgi_req, st, usf)) goto error;
+		if (usf) {
+			if (uwsgi_response_add_header(wsgi_req, "ETag", 4, usf->etag, usf->etag_len)) goto error;
 		}
-		int size = uwsgi_http_date(st->st_mtime, http_last_modified);
-		if (uwsgi_response_add_header(wsgi_req, "Last-Modified", 13, http_last_modified, size)) return -1;
 
 		// if it is a HEAD request just skip transfer
 		if (!uwsgi_strncmp(wsgi_req->method, wsgi_req->method_len, "HEAD", 4)) {
+			if (body) free(body);
+			if (ubr) uwsgi_byteranges_destroy(ubr);
+			wsgi_req->status = 200;
+			return 0;
+		}
+
+		if (ubr) {
+			if (usf) {
+				uwsgi_response_byteranges_do(wsgi_req, usf->fd, ubr, 0);
+			}
+			else {
+				int fd = open(real_filename, O_RDONLY);
+				if (fd < 0) {
+					uwsgi_byteranges_destroy(ubr);
+					return -1;
+				}
+				uwsgi_response_byteranges_do(wsgi_req, fd, ubr, 1);
+			}
+			wsgi_req->status = 206;
+			return 0;
+		}
+
+		if (body) {
+			uwsgi_response_write_body_do(wsgi_req, body, body_len);
+			free(body);
 			wsgi_req->status = 200;
 			return 0;
 		}
 
 		// Ok, the file must be transferred from uWSGI
 		// offloading will be automatically managed
+		if (usf) {
+			// the cached fd is never closed here (offloading dups it)
+			uwsgi_response_sendfile_do_can_close(wsgi_req, usf->fd, wsgi_req->range_from, fsize, 0);
+			wsgi_req->status = 200;
+			return 0;
+		}
 		int fd = open(real_filename, O_RDONLY);
 		if (fd < 0) return -1;
 		// fd will be closed in the following function
@@ -551,8 +1039,41 @@ int uwsgi_real_file_serve(struct wsgi_request *wsgi_req, char *real_filename, si
 
 	wsgi_req->status = 200;
 	return 0;
+
+error:
+	if (body) free(body);
+	if (ubr) uwsgi_byteranges_destroy(ubr);
+	return -1;
 }
 
+int uwsgi_real_file_serve(struct wsgi_request *wsgi_req, char *real_filename, size_t real_filename_len, struct stat *st) {
+	return static_file_serve_do(wsgi_req, real_filename, real_filename_len, st, NULL);
+}
+
+// the per-request part of uwsgi_file_serve()
+static int static_file_serve(struct wsgi_request *wsgi_req, char *real_filename, size_t real_filename_len, struct stat *st, struct uwsgi_string_list *index, struct uwsgi_static_fd *usf) {
+	if (index) {
+		// if we are here the PATH_INFO need to be changed
+		if (uwsgi_req_append_path_info_with_index(wsgi_req, index->value, index->len)) {
+			return -1;
+		}
+	}
+
+	// skip methods other than GET and HEAD
+	if (uwsgi_strncmp(wsgi_req->method, wsgi_req->method_len, "GET", 3) && uwsgi_strncmp(wsgi_req->method, wsgi_req->method_len, "HEAD", 4)) {
+		return -1;
+	}
+
+#ifdef UWSGI_ROUTING
+	// before sending the file, we need to check if some rule applies
+	if (!wsgi_req->is_routing && uwsgi_apply_routes_do(uwsgi.routes, wsgi_req, NULL, 0) == UWSGI_ROUTE_BREAK) {
+		return 0;
+	}
+	wsgi_req->routes_applied = 1;
+#endif
+
+	return static_file_serve_do(wsgi_req, real_filename, real_filename_len, st, usf);
+}
 
 int uwsgi_file_serve(struct wsgi_request *wsgi_req, char *document_root, uint16_t document_root_len, char *path_info, uint16_t path_info_len, int is_a_file) {
 
@@ -563,6 +1084,7 @@ int uwsgi_file_serve(struct wsgi_request *wsgi_req, char *document_root, uint16_
 	size_t filename_len = 0;
 
 	struct uwsgi_string_list *index = NULL;
+	char *fd_cache_key = NULL;
 
 	if (!is_a_file) {
 		filename = uwsgi_concat3n(document_root, document_root_len, "/", 1, path_info, path_info_len);
@@ -577,18 +1099,32 @@ int uwsgi_file_serve(struct wsgi_request *wsgi_req, char *document_root, uint16_
 	uwsgi_log("[uwsgi-fileserve] checking for %s\n", filename);
 #endif
 
+	if (uwsgi.static_fd_cache > 0) {
+		struct uwsgi_static_fd *usf = static_fd_get(wsgi_req, filename, filename_len);
+		if (usf) {
+			free(filename);
+			// the gzip variant check could change them
+			memcpy(real_filename, usf->filename, usf->filename_len + 1);
+			st = usf->st;
+			int ret = static_file_serve(wsgi_req, real_filename, usf->filename_len, &st, usf->index, usf);
+			static_fd_release(usf);
+			return ret;
+		}
+	}
+
 	if (uwsgi.static_cache_paths) {
-		uwsgi_rlock(uwsgi.static_cache_paths->lock);
+		struct uwsgi_lock_item *cl = uwsgi_cache_key_lock(uwsgi.static_cache_paths, filename, filename_len);
+		uwsgi_rlock(cl);
 		uint64_t item_len;
 		char *item = uwsgi_cache_get2(uwsgi.static_cache_paths, filename, filename_len, &item_len);
 		if (item && item_len > 0 && item_len <= PATH_MAX) {
 			memcpy(real_filename, item, item_len);
 			real_filename_len = item_len;
 			real_filename[real_filename_len] = 0;
-			uwsgi_rwunlock(uwsgi.static_cache_paths->lock);
+			uwsgi_rwunlock(cl);
 			goto found;
 		}
-		uwsgi_rwunlock(uwsgi.static_cache_paths->lock);
+		uwsgi_rwunlock(cl);
 	}
 
 	if (!realpath(filename, real_filename)) {
@@ -601,13 +1137,20 @@ int uwsgi_file_serve(struct wsgi_request *wsgi_req, char *document_root, uint16_
 	real_filename_len = strlen(real_filename);
 
 	if (uwsgi.static_cache_paths) {
-		uwsgi_wlock(uwsgi.static_cache_paths->lock);
+		struct uwsgi_lock_item *cl = uwsgi_cache_key_lock(uwsgi.static_cache_paths, filename, filename_len);
+		uwsgi_wlock(cl);
 		uwsgi_cache_set2(uwsgi.static_cache_paths, filename, filename_len, real_filename, real_filename_len, uwsgi.use_static_cache_paths, UWSGI_CACHE_FLAG_UPDATE);
-		uwsgi_rwunlock(uwsgi.static_cache_paths->lock);
+		uwsgi_rwunlock(cl);
 	}
 
 found:
-	free(filename);
+	// the requested name is the key of the fd cache
+	if (uwsgi.static_fd_cache > 0) {
+		fd_cache_key = filename;
+	}
+	else {
+		free(filename);
+	}
 
 	if (uwsgi_starts_with(real_filename, real_filename_len, document_root, document_root_len)) {
 		struct uwsgi_string_list *safe = uwsgi.static_safe;
@@ -618,6 +1161,7 @@ found:
 			safe = safe->next;
 		}
 		uwsgi_log("[uwsgi-fileserve] security error: %s is not under %.*s or a safe path\n", real_filename, document_root_len, document_root);
+		free(fd_cache_key);
 		return -1;
 	}
 
@@ -625,40 +1169,34 @@ safe:
 
 	if (!uwsgi_static_stat(wsgi_req, real_filename, &real_filename_len, &st, &index)) {
 
-		if (index) {
-			// if we are here the PATH_INFO need to be changed
-			if (uwsgi_req_append_path_info_with_index(wsgi_req, index->value, index->len)) {
-                        	return -1;
-                        }
-		}
-
-		// skip methods other than GET and HEAD
-        	if (uwsgi_strncmp(wsgi_req->method, wsgi_req->method_len, "GET", 3) && uwsgi_strncmp(wsgi_req->method, wsgi_req->method_len, "HEAD", 4)) {
-			return -1;
-        	}
-
 		// check for skippable ext
 		struct uwsgi_string_list *sse = uwsgi.static_skip_ext;
 		while (sse) {
 			if (real_filename_len >= sse->len) {
 				if (!uwsgi_strncmp(real_filename + (real_filename_len - sse->len), sse->len, sse->value, sse->len)) {
+					free(fd_cache_key);
+					// the app gets the index in PATH_INFO
+					if (index) {
+						uwsgi_req_append_path_info_with_index(wsgi_req, index->value, index->len);
+					}
 					return -1;
 				}
 			}
 			sse = sse->next;
 		}
 
-#ifdef UWSGI_ROUTING
-		// before sending the file, we need to check if some rule applies
-		if (!wsgi_req->is_routing && uwsgi_apply_routes_do(uwsgi.routes, wsgi_req, NULL, 0) == UWSGI_ROUTE_BREAK) {
-			return 0;
+		struct uwsgi_static_fd *usf = NULL;
+		if (fd_cache_key) {
+			usf = static_fd_add(wsgi_req, fd_cache_key, filename_len, real_filename, real_filename_len, &st, index);
+			free(fd_cache_key);
 		}
-		wsgi_req->routes_applied = 1;
-#endif
 
-		return uwsgi_real_file_serve(wsgi_req, real_filename, real_filename_len, &st);
+		int ret = static_file_serve(wsgi_req, real_filename, real_filename_len, &st, index, usf);
+		if (usf) static_fd_release(usf);
+		return ret;
 	}
 
+	free(fd_cache_key);
 	return -1;
 
 }
@@ -354,6 +354,27 @@ int uwsgi_stats_keyslong_comma(struct uwsgi_stats *us, char *key, long long num)
 }
 
 
+int uwsgi_stats_send_buffer(int fd, struct uwsgi_buffer *ub) {
+	size_t remains = ub->pos;
+	off_t pos = 0;
+	while (remains > 0) {
+		int ret = uwsgi_waitfd_write(fd, uwsgi.socket_timeout);
+		if (ret <= 0) {
+			return -1;
+		}
+		ssize_t res = write(fd, ub->buf + pos, remains);
+		if (res <= 0) {
+			if (res < 0) {
+				uwsgi_error("uwsgi_stats_send_buffer()/write()");
+			}
+			return -1;
+		}
+		pos += res;
+		remains -= res;
+	}
+	return 0;
+}
+
 void uwsgi_send_stats(int fd, struct uwsgi_stats *(*func) (void)) {
 
 	struct sockaddr_un client_src;
@@ -365,13 +386,20 @@ void uwsgi_send_stats(int fd, struct uwsgi_stats *(*func) (void)) {
 		return;
 	}
 
+	int openmetrics = uwsgi.stats_openmetrics;
 	if (uwsgi.stats_http) {
-		if (uwsgi_send_http_stats(client_fd)) {
+		if (uwsgi_send_http_stats2(client_fd, &openmetrics)) {
 			close(client_fd);
 			return;
 		}
 	}
 
+	if (openmetrics) {
+		struct uwsgi_buffer *ub = uwsgi_openmetrics_master();
+		if (ub) uwsgi_stats_send_buffer(client_fd, ub);
+		goto end;
+	}
+
 	struct uwsgi_stats *us = func();
 	if (!us)
 		goto end;
@@ -402,6 +430,210 @@ end:
 	close(client_fd);
 }
 
+/*
+
+	binary/incremental stats protocol (--stats-binary)
+
+	request (16 bytes): epoch (u64be) generation (u64be), send zeroes for a full snapshot
+
+	response:
+		"uWSB" version (u8) flags (u8, 1 = full snapshot) reserved (u16)
+		epoch (u64be) generation (u64be) items (u32be)
+
+		full snapshot items: id (u32be) value (u64be) name_len (u16be) name
+		delta items: id (u32be) value (u64be)
+
+	values are sampled on every request, each changed one gets a new generation number, so a client
+	passing back the epoch and the generation of its last response only receives the counters changed since then.
+	A different epoch (the master has been restarted) or an unknown generation gives a full snapshot.
+
+*/
+
+static struct uwsgi_stats_binary {
+	uint64_t epoch;
+	uint64_t generation;
+	uint64_t count;
+	char **names;
+	uint64_t *values;
+	uint64_t *generations;
+	uint64_t *tmp;
+	struct uwsgi_buffer *ub;
+} usb;
+
+// in build mode the name is generated, otherwise only the value is stored
+static void stats_binary_item(uint64_t *pos, int build, uint64_t value, char *fmt, ...) {
+	if (build) {
+		char buf[0xff];
+		va_list ap;
+		va_start(ap, fmt);
+		int ret = vsnprintf(buf, sizeof(buf), fmt, ap);
+		va_end(ap);
+		if (ret <= 0 || ret >= (int) sizeof(buf)) buf[0] = 0;
+		char **names = realloc(usb.names, sizeof(char *) * (*pos + 1));
+		if (!names) {
+			uwsgi_error("stats_binary_item()/realloc()");
+			exit(1);
+		}
+		usb.names = names;
+		usb.names[*pos] = uwsgi_str(buf);
+	}
+	else {
+		usb.tmp[*pos] = value;
+	}
+	(*pos)++;
+}
+
+static uint64_t stats_binary_walk(int build) {
+	uint64_t pos = 0;
+	int i, j;
+
+	stats_binary_item(&pos, build, uwsgi.shared->backlog, "listen_queue");
+	stats_binary_item(&pos, build, uwsgi.shared->backlog_errors, "listen_queue_errors");
+	stats_binary_item(&pos, build, uwsgi.shared->load, "load");
+
+	struct uwsgi_socket *uwsgi_sock;
+	i = 0;
+	uwsgi_foreach(uwsgi_sock, uwsgi.sockets) {
+		stats_binary_item(&pos, build, uwsgi_sock->queue, "socket.%d.queue", i);
+		i++;
+	}
+
+	for(i=1;i<=uwsgi.numproc;i++) {
+		struct uwsgi_worker *w = &uwsgi.workers[i];
+		stats_binary_item(&pos, build, w->pid, "worker.%d.pid", i);
+		stats_binary_item(&pos, build, w->requests, "worker.%d.requests", i);
+		stats_binary_item(&pos, build, uwsgi_worker_exceptions(i), "worker.%d.exceptions", i);
+		stats_binary_item(&pos, build, w->harakiri_count, "worker.%d.harakiri_count", i);
+		stats_binary_item(&pos, build, w->signals, "worker.%d.signals", i);
+		stats_binary_item(&pos, build, w->respawn_count, "worker.%d.respawn_count", i);
+		stats_binary_item(&pos, build, w->tx, "worker.%d.tx", i);
+		stats_binary_item(&pos, build, w->rss_size, "worker.%d.rss", i);
+		stats_binary_item(&pos, build, w->vsz_size, "worker.%d.vsz", i);
+		stats_binary_item(&pos, build, w->running_time, "worker.%d.running_time", i);
+		stats_binary_item(&pos, build, w->avg_response_time, "worker.%d.avg_rt", i);
+		stats_binary_item(&pos, build, uwsgi_worker_is_busy(i), "worker.%d.busy", i);
+		stats_binary_item(&pos, build, w->accepting, "worker.%d.accepting", i);
+		stats_binary_item(&pos, build, w->cheaped, "worker.%d.cheaped", i);
+		if (uwsgi.stats_no_cores) continue;
+		for(j=0;j<uwsgi.cores;j++) {
+			struct uwsgi_core *uc = &w->cores[j];
+			stats_binary_item(&pos, build, uc->requests, "worker.%d.core.%d.requests", i, j);
+			stats_binary_item(&pos, build, uc->static_requests, "worker.%d.core.%d.static_requests", i, j);
+			stats_binary_item(&pos, build, uc->routed_requests, "worker.%d.core.%d.routed_requests", i, j);
+			stats_binary_item(&pos, build, uc->offloaded_requests, "worker.%d.core.%d.offloaded_requests", i, j);
+			stats_binary_item(&pos, build, uc->write_errors, "worker.%d.core.%d.write_errors", i, j);
+			stats_binary_item(&pos, build, uc->read_errors, "worker.%d.core.%d.read_errors", i, j);
+			stats_binary_item(&pos, build, uc->in_request, "worker.%d.core.%d.in_request", i, j);
+		}
+	}
+
+	struct uwsgi_cache *uc;
+	uwsgi_foreach(uc, uwsgi.caches) {
+		uint64_t c_items = 0, c_hits = 0, c_miss = 0, c_full = 0;
+		if (!build) uwsgi_cache_counters(uc, &c_items, &c_hits, &c_miss, &c_full);
+		char *name = uc->name ? uc->name : "default";
+		stats_binary_item(&pos, build, c_items, "cache.%s.items", name);
+		stats_binary_item(&pos, build, c_hits, "cache.%s.hits", name);
+		stats_binary_item(&pos, build, c_miss, "cache.%s.miss", name);
+		stats_binary_item(&pos, build, c_full, "cache.%s.full", name);
+	}
+
+	if (uwsgi.has_metrics && !uwsgi.stats_no_metrics) {
+		struct uwsgi_metric *um;
+		uwsgi_rlock(uwsgi.metrics_lock);
+		uwsgi_foreach(um, uwsgi.metrics) {
+			stats_binary_item(&pos, build, (uint64_t) *um->value, "metric.%s", um->name);
+		}
+		uwsgi_rwunlock(uwsgi.metrics_lock);
+	}
+
+	return pos;
+}
+
+static void stats_binary_sample() {
+	if (!usb.names) {
+		usb.count = stats_binary_walk(1);
+		usb.values = uwsgi_calloc(sizeof(uint64_t) * (usb.count + 1));
+		usb.generations = uwsgi_calloc(sizeof(uint64_t) * (usb.count + 1));
+		usb.tmp = uwsgi_calloc(sizeof(uint64_t) * (usb.count + 1));
+		usb.epoch = uwsgi_micros();
+		usb.ub = uwsgi_buffer_new(uwsgi.page_size);
+	}
+
+	stats_binary_walk(0);
+
+	int changed = 0;
+	uint64_t i;
+	for(i=0;i<usb.count;i++) {
+		if (usb.tmp[i] != usb.values[i] || !usb.generation) {
+			if (!changed) {
+				usb.generation++;
+				changed = 1;
+			}
+			usb.values[i] = usb.tmp[i];
+			usb.generations[i] = usb.generation;
+		}
+	}
+}
+
+void uwsgi_send_stats_binary(int fd) {
+	struct sockaddr_un client_src;
+	socklen_t client_src_len = 0;
+
+	int client_fd = accept(fd, (struct sockaddr *) &client_src, &client_src_len);
+	if (client_fd < 0) {
+		uwsgi_error("uwsgi_send_stats_binary()/accept()");
+		return;
+	}
+
+	char req[16];
+	size_t have = 0;
+	while(have < 16) {
+		int ret = uwsgi_waitfd(client_fd, uwsgi.socket_timeout);
+		if (ret <= 0) goto end;
+		ssize_t rlen = read(client_fd, req + have, 16 - have);
+		if (rlen <= 0) goto end;
+		have += rlen;
+	}
+
+	uint64_t epoch = uwsgi_be64(req);
+	uint64_t since = uwsgi_be64(req + 8);
+
+	stats_binary_sample();
+
+	int full = (epoch != usb.epoch || since == 0 || since > usb.generation);
+	uint32_t items = 0;
+	uint64_t i;
+	for(i=0;i<usb.count;i++) {
+		if (full || usb.generations[i] > since) items++;
+	}
+
+	struct uwsgi_buffer *ub = usb.ub;
+	uwsgi_buffer_reset(ub);
+	if (uwsgi_buffer_append(ub, "uWSB", 4)) goto end;
+	if (uwsgi_buffer_u8(ub, 1)) goto end;
+	if (uwsgi_buffer_u8(ub, full)) goto end;
+	if (uwsgi_buffer_u16be(ub, 0)) goto end;
+	if (uwsgi_buffer_u64be(ub, usb.epoch)) goto end;
+	if (uwsgi_buffer_u64be(ub, usb.generation)) goto end;
+	if (uwsgi_buffer_u32be(ub, items)) goto end;
+
+	for(i=0;i<usb.count;i++) {
+		if (!full && usb.generations[i] <= since) continue;
+		if (uwsgi_buffer_u32be(ub, i)) goto end;
+		if (uwsgi_buffer_u64be(ub, usb.values[i])) goto end;
+		if (full) {
+			uint16_t len = strlen(usb.names[i]);
+			if (uwsgi_buffer_u16be(ub, len)) goto end;
+			if (uwsgi_buffer_append(ub, usb.names[i], len)) goto end;
+		}
+	}
+
+	uwsgi_stats_send_buffer(client_fd, ub);
+end:
+	close(client_fd);
+}
+
 struct uwsgi_stats_pusher *uwsgi_stats_pusher_get(char *name) {
 	struct uwsgi_stats_pusher *usp = uwsgi.stats_pushers;
 	while (usp) {
@@ -436,6 +668,98 @@ struct uwsgi_stats_pusher_instance *uwsgi_stats_pusher_add(struct uwsgi_stats_pu
 	return uspi;
 }
 
+struct uwsgi_stats_pusher_dgram *uwsgi_stats_pusher_dgram_new(int fd, struct sockaddr *addr, socklen_t addr_len) {
+	struct uwsgi_stats_pusher_dgram *uspd = uwsgi_calloc(sizeof(struct uwsgi_stats_pusher_dgram));
+	uspd->fd = fd;
+	uspd->addr = addr;
+	uspd->addr_len = addr_len;
+	uspd->ub = uwsgi_buffer_new(uwsgi.page_size);
+	return uspd;
+}
+
+static void uwsgi_stats_pusher_dgram_close(struct uwsgi_stats_pusher_dgram *uspd) {
+	if (uspd->ub->pos == uspd->packet_start) return;
+	uspd->ends[uspd->packets++] = uspd->ub->pos;
+	uspd->packet_start = uspd->ub->pos;
+}
+
+void uwsgi_stats_pusher_dgram_flush(struct uwsgi_stats_pusher_dgram *uspd) {
+	int i;
+	uwsgi_stats_pusher_dgram_close(uspd);
+	if (!uspd->packets) return;
+
+	struct iovec iov[UWSGI_STATS_PUSHER_MMSG];
+	size_t start = 0;
+	for (i = 0; i < uspd->packets; i++) {
+		iov[i].iov_base = uspd->ub->buf + start;
+		iov[i].iov_len = uspd->ends[i] - start;
+		start = uspd->ends[i];
+	}
+#ifdef __linux__
+	struct mmsghdr msgs[UWSGI_STATS_PUSHER_MMSG];
+	memset(msgs, 0, sizeof(struct mmsghdr) * uspd->packets);
+	for (i = 0; i < uspd->packets; i++) {
+		msgs[i].msg_hdr.msg_name = uspd->addr;
+		msgs[i].msg_hdr.msg_namelen = uspd->addr_len;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	// the socket is non blocking, what is not sent now is lost (as a plain sendto() would do)
+	for (i = 0; i < uspd->packets;) {
+		int ret = sendmmsg(uspd->fd, msgs + i, uspd->packets - i, 0);
+		if (ret <= 0) {
+			uwsgi_error("uwsgi_stats_pusher_dgram_flush()/sendmmsg()");
+			break;
+		}
+		i += ret;
+	}
+#else
+	for (i = 0; i < uspd->packets; i++) {
+		if (sendto(uspd->fd, iov[i].iov_base, iov[i].iov_len, 0, uspd->addr, uspd->addr_len) < 0) {
+			uwsgi_error("uwsgi_stats_pusher_dgram_flush()/sendto()");
+		}
+	}
+#endif
+	uspd->packets = 0;
+	uspd->packet_start = 0;
+	uspd->ub->pos = 0;
+}
+
+// append a metric line (lines in the same packet are newline separated)
+int uwsgi_stats_pusher_dgram_add(struct uwsgi_stats_pusher_dgram *uspd, char *line, size_t len) {
+	size_t current = uspd->ub->pos - uspd->packet_start;
+	if (current > 0 && current + 1 + len > uwsgi.stats_pusher_mtu) {
+		uwsgi_stats_pusher_dgram_close(uspd);
+		if (uspd->packets >= UWSGI_STATS_PUSHER_MMSG) {
+			uwsgi_stats_pusher_dgram_flush(uspd);
+		}
+		current = 0;
+	}
+	if (current > 0 && uwsgi_buffer_byte(uspd->ub, '\n')) return -1;
+	return uwsgi_buffer_append(uspd->ub, line, len);
+}
+
+// returns 1 if the metric in the specified position has to be pushed
+int uwsgi_stats_pusher_changed(struct uwsgi_stats_pusher_instance *uspi, int pos, int64_t value) {
+	if (!uwsgi.stats_pusher_changed_only) return 1;
+	if (pos >= uspi->last_values_count) {
+		int count = pos + 64;
+		int64_t *last_values = realloc(uspi->last_values, sizeof(int64_t) * count);
+		if (!last_values) {
+			uwsgi_error("uwsgi_stats_pusher_changed()/realloc()");
+			return 1;
+		}
+		// never pushed
+		int i;
+		for (i = uspi->last_values_count; i < count; i++) last_values[i] = INT64_MIN;
+		uspi->last_values = last_values;
+		uspi->last_values_count = count;
+	}
+	if (uspi->last_values[pos] == value) return 0;
+	uspi->last_values[pos] = value;
+	return 1;
+}
+
 void uwsgi_stats_pusher_loop(struct uwsgi_thread *ut) {
 	void *events = event_queue_alloc(1);
 	for (;;) {
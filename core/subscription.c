@@ -20,6 +20,8 @@
 
 extern struct uwsgi_server uwsgi;
 
+static void uwsgi_subscription_chash_free(struct uwsgi_subscribe_slot *);
+
 char *uwsgi_subscription_algo_name(void *ptr) {
 	struct uwsgi_string_list *usl = uwsgi.subscription_algos;
 	while(usl) {
@@ -82,7 +84,36 @@ int uwsgi_subscription_credentials_check(struct uwsgi_subscribe_slot *slot, stru
 	return 0;
 }
 
-struct uwsgi_subscribe_slot *uwsgi_get_subscribe_slot(struct uwsgi_subscribe_slot **slot, char *key, uint16_t keylen) {
+// djb33x spreads entropy poorly in the low bits, fold the upper half before masking
+#define uwsgi_subscription_bucket(table, hash) (((hash) ^ ((hash) >> 16)) & ((table)->size - 1))
+
+static void uwsgi_subscription_table_grow(struct uwsgi_subscribe_table *table) {
+	uint64_t i;
+	uint64_t old_size = table->size;
+	struct uwsgi_subscribe_slot **old_buckets = table->buckets;
+
+	table->size *= 2;
+	table->buckets = uwsgi_calloc(sizeof(struct uwsgi_subscribe_slot *) * table->size);
+
+	for (i = 0; i < old_size; i++) {
+		struct uwsgi_subscribe_slot *current_slot = old_buckets[i];
+		while (current_slot) {
+			struct uwsgi_subscribe_slot *next_slot = current_slot->next;
+			uint64_t bucket = uwsgi_subscription_bucket(table, current_slot->hash);
+			current_slot->prev = NULL;
+			current_slot->next = table->buckets[bucket];
+			if (current_slot->next) {
+				current_slot->next->prev = current_slot;
+			}
+			table->buckets[bucket] = current_slot;
+			current_slot = next_slot;
+		}
+	}
+
+	free(old_buckets);
+}
+
+struct uwsgi_subscribe_slot *uwsgi_get_subscribe_slot(struct uwsgi_subscribe_table *table, char *key, uint16_t keylen) {
 	int retried = 0;
 retry:
 
@@ -90,9 +121,9 @@ retry:
 		return NULL;
 
 	uint32_t hash = djb33x_hash(key, keylen);
-	int hash_key = hash % 0xffff;
+	uint64_t bucket = uwsgi_subscription_bucket(table, hash);
 
-	struct uwsgi_subscribe_slot *current_slot = slot[hash_key];
+	struct uwsgi_subscribe_slot *current_slot = table->buckets[bucket];
 
 
 #ifdef UWSGI_DEBUG
@@ -102,11 +133,11 @@ retry:
 		current_slot = current_slot->next;
 	}
 	uwsgi_log("****************************\n");
-	current_slot = slot[hash_key];
+	current_slot = table->buckets[bucket];
 #endif
 
 	while (current_slot) {
-		if (!uwsgi_strncmp(key, keylen, current_slot->key, current_slot->keylen)) {
+		if (current_slot->hash == hash && !uwsgi_strncmp(key, keylen, current_slot->key, current_slot->keylen)) {
 			// auto optimization
 			if (current_slot->prev) {
 				if (current_slot->hits > current_slot->prev->hits) {
@@ -115,7 +146,7 @@ retry:
 						slot_parent->next = current_slot;
 					}
 					else {
-						slot[hash_key] = current_slot;
+						table->buckets[bucket] = current_slot;
 					}
 
 					if (current_slot->next) {
@@ -133,9 +164,6 @@ retry:
 			return current_slot;
 		}
 		current_slot = current_slot->next;
-		// check for loopy optimization
-		if (current_slot == slot[hash_key])
-			break;
 	}
 
 	// if we are here and in mountpoints mode, try the domain only variant
@@ -151,12 +179,12 @@ retry:
 	return NULL;
 }
 
-struct uwsgi_subscribe_node *uwsgi_get_subscribe_node(struct uwsgi_subscribe_slot **slot, char *key, uint16_t keylen, struct uwsgi_subscription_client *client) {
+struct uwsgi_subscribe_node *uwsgi_get_subscribe_node(struct uwsgi_subscribe_table *table, char *key, uint16_t keylen, struct uwsgi_subscription_client *client) {
 
 	if (keylen > 0xff)
 		return NULL;
 
-	struct uwsgi_subscribe_slot *current_slot = uwsgi_get_subscribe_slot(slot, key, keylen);
+	struct uwsgi_subscribe_slot *current_slot = uwsgi_get_subscribe_slot(table, key, keylen);
 	if (!current_slot)
 		return NULL;
 
@@ -178,7 +206,7 @@ struct uwsgi_subscribe_node *uwsgi_get_subscribe_node(struct uwsgi_subscribe_slo
 			struct uwsgi_subscribe_node *dead_node = node;
 			node = node->next;
 			// if the slot has been removed, return NULL;
-			if (uwsgi_remove_subscribe_node(slot, dead_node) == 1) {
+			if (uwsgi_remove_subscribe_node(table, dead_node) == 1) {
 				return NULL;
 			}
 			continue;
@@ -194,11 +222,11 @@ struct uwsgi_subscribe_node *uwsgi_get_subscribe_node(struct uwsgi_subscribe_slo
 	return current_slot->algo(current_slot, node, client);
 }
 
-struct uwsgi_subscribe_node *uwsgi_get_subscribe_node_by_name(struct uwsgi_subscribe_slot **slot, char *key, uint16_t keylen, char *val, uint16_t vallen) {
+struct uwsgi_subscribe_node *uwsgi_get_subscribe_node_by_name(struct uwsgi_subscribe_table *table, char *key, uint16_t keylen, char *val, uint16_t vallen) {
 
 	if (keylen > 0xff)
 		return NULL;
-	struct uwsgi_subscribe_slot *current_slot = uwsgi_get_subscribe_slot(slot, key, keylen);
+	struct uwsgi_subscribe_slot *current_slot = uwsgi_get_subscribe_slot(table, key, keylen);
 	if (current_slot) {
 		struct uwsgi_subscribe_node *node = current_slot->nodes;
 		while (node) {
@@ -212,7 +240,7 @@ struct uwsgi_subscribe_node *uwsgi_get_subscribe_node_by_name(struct uwsgi_subsc
 	return NULL;
 }
 
-int uwsgi_remove_subscribe_node(struct uwsgi_subscribe_slot **slot, struct uwsgi_subscribe_node *node) {
+int uwsgi_remove_subscribe_node(struct uwsgi_subscribe_table *table, struct uwsgi_subscribe_node *node) {
 
 	int ret = 0;
 
@@ -221,8 +249,6 @@ int uwsgi_remove_subscribe_node(struct uwsgi_subscribe_slot **slot, struct uwsgi
 	struct uwsgi_subscribe_slot *prev_slot = node_slot->prev;
 	struct uwsgi_subscribe_slot *next_slot = node_slot->next;
 
-	int hash_key = node_slot->hash;
-
 	// over-engineering to avoid race conditions
 	node->len = 0;
 
@@ -246,48 +272,33 @@ int uwsgi_remove_subscribe_node(struct uwsgi_subscribe_slot **slot, struct uwsgi
 
 		ret = 1;
 
-		// first check if i am the only node
-		if ((!prev_slot && !next_slot) || next_slot == node_slot) {
-#ifdef UWSGI_SSL
-			if (node_slot->sign_ctx) {
-				EVP_PKEY_free(node_slot->sign_public_key);
-				EVP_MD_CTX_destroy(node_slot->sign_ctx);
-			}
-#ifdef SSL_CTRL_SET_TLSEXT_HOSTNAME
-			// if there is a SNI context active, destroy it
-			if (node_slot->sni_enabled) {
-				uwsgi_ssl_del_sni_item(node_slot->key, node_slot->keylen);
-			}
-#endif
-#endif
-			free(node_slot);
-			slot[hash_key] = NULL;
-			goto end;
-		}
-
-		// if i am the main entry point, set the next value
-		if (node_slot == slot[hash_key]) {
-			slot[hash_key] = next_slot;
-		}
-
 		if (prev_slot) {
 			prev_slot->next = next_slot;
 		}
+		else {
+			table->buckets[uwsgi_subscription_bucket(table, node_slot->hash)] = next_slot;
+		}
 		if (next_slot) {
 			next_slot->prev = prev_slot;
 		}
+		table->count--;
 
 #ifdef UWSGI_SSL
 		if (node_slot->sign_ctx) {
 			EVP_PKEY_free(node_slot->sign_public_key);
 			EVP_MD_CTX_destroy(node_slot->sign_ctx);
 		}
+#ifdef SSL_CTRL_SET_TLSEXT_HOSTNAME
+		// if there is a SNI context active, destroy it
+		if (node_slot->sni_enabled) {
+			uwsgi_ssl_del_sni_item(node_slot->key, node_slot->keylen);
+		}
 #endif
+#endif
+		uwsgi_subscription_chash_free(node_slot);
 		free(node_slot);
 	}
 
-end:
-
 	return ret;
 }
 
@@ -296,9 +307,9 @@ static int subscription_new_sign_ctx(struct uwsgi_subscribe_slot *, struct uwsgi
 static int subscription_is_safe(struct uwsgi_subscribe_req *);
 #endif
 
-struct uwsgi_subscribe_node *uwsgi_add_subscribe_node(struct uwsgi_subscribe_slot **slot, struct uwsgi_subscribe_req *usr) {
+struct uwsgi_subscribe_node *uwsgi_add_subscribe_node(struct uwsgi_subscribe_table *table, struct uwsgi_subscribe_req *usr) {
 
-	struct uwsgi_subscribe_slot *current_slot = uwsgi_get_subscribe_slot(slot, usr->key, usr->keylen), *old_slot = NULL, *a_slot;
+	struct uwsgi_subscribe_slot *current_slot = uwsgi_get_subscribe_slot(table, usr->key, usr->keylen);
 	struct uwsgi_subscribe_node *node, *old_node = NULL;
 
 	if (usr->address_len > 0xff || usr->address_len == 0)
@@ -355,7 +366,7 @@ struct uwsgi_subscribe_node *uwsgi_add_subscribe_node(struct uwsgi_subscribe_slo
 		uwsgi_subscription_sni_check(current_slot, usr);
 #endif
 
-		node = uwsgi_malloc(sizeof(struct uwsgi_subscribe_node));
+		node = uwsgi_malloc(sizeof(struct uwsgi_subscribe_node) + usr->address_len + 1);
 		node->len = usr->address_len;
 		node->modifier1 = usr->modifier1;
 		node->modifier2 = usr->modifier2;
@@ -370,6 +381,7 @@ struct uwsgi_subscribe_node *uwsgi_add_subscribe_node(struct uwsgi_subscribe_slo
 		node->load = usr->load;
 		node->weight = usr->weight;
 		node->backup_level = usr->backup_level;
+		node->proto = 0;
 		if (usr->proto_len > 0) {
 			node->proto = usr->proto[0];
 		}
@@ -377,6 +389,11 @@ struct uwsgi_subscribe_node *uwsgi_add_subscribe_node(struct uwsgi_subscribe_slo
 		if (!node->weight)
 			node->weight = 1;
 		node->wrr = 0;
+		node->latency = 0;
+		node->errors = 0;
+		node->ejections = 0;
+		node->ejected_until = 0;
+		node->latency_stamp = 0;
 		node->pid = usr->pid;
 		node->uid = usr->uid;
 		node->gid = usr->gid;
@@ -388,6 +405,7 @@ struct uwsgi_subscribe_node *uwsgi_add_subscribe_node(struct uwsgi_subscribe_slo
 		node->last_check = uwsgi_now();
 		node->slot = current_slot;
 		memcpy(node->name, usr->address, usr->address_len);
+		node->name[usr->address_len] = 0;
 		if (old_node) {
 			old_node->next = node;
 		}
@@ -403,7 +421,10 @@ struct uwsgi_subscribe_node *uwsgi_add_subscribe_node(struct uwsgi_subscribe_slo
 		return node;
 	}
 	else {
-		current_slot = uwsgi_malloc(sizeof(struct uwsgi_subscribe_slot));
+		if (usr->keylen > 0xff)
+			return NULL;
+		current_slot = uwsgi_malloc(sizeof(struct uwsgi_subscribe_slot) + usr->keylen + 1);
+		current_slot->chash = NULL;
 #ifdef UWSGI_SSL
 		current_slot->sign_ctx = NULL;
 		if (uwsgi.subscriptions_sign_check_dir && !subscription_new_sign_ctx(current_slot, usr)) {
@@ -411,9 +432,7 @@ struct uwsgi_subscribe_node *uwsgi_add_subscribe_node(struct uwsgi_subscribe_slo
 			return NULL;
 		}
 #endif
-		uint32_t hash = djb33x_hash(usr->key, usr->keylen);
-		int hash_key = hash % 0xffff;
-		current_slot->hash = hash_key;
+		current_slot->hash = djb33x_hash(usr->key, usr->keylen);
 		current_slot->keylen = usr->keylen;
 		memcpy(current_slot->key, usr->key, usr->keylen);
 		if (uwsgi.subscriptions_credentials_check_dir) {
@@ -429,7 +448,7 @@ struct uwsgi_subscribe_node *uwsgi_add_subscribe_node(struct uwsgi_subscribe_slo
 		current_slot->sni_enabled = 0;
 		uwsgi_subscription_sni_check(current_slot, usr);
 #endif
-		current_slot->nodes = uwsgi_malloc(sizeof(struct uwsgi_subscribe_node));
+		current_slot->nodes = uwsgi_malloc(sizeof(struct uwsgi_subscribe_node) + usr->address_len + 1);
 		current_slot->nodes->slot = current_slot;
 		current_slot->nodes->len = usr->address_len;
 		current_slot->nodes->reference = 0;
@@ -445,6 +464,7 @@ struct uwsgi_subscribe_node *uwsgi_add_subscribe_node(struct uwsgi_subscribe_slo
 		current_slot->nodes->load = usr->load;
 		current_slot->nodes->weight = usr->weight;
 		current_slot->nodes->backup_level = usr->backup_level;
+		current_slot->nodes->proto = 0;
 		if (usr->proto_len > 0) {
 			current_slot->nodes->proto = usr->proto[0];
 		}
@@ -452,6 +472,11 @@ struct uwsgi_subscribe_node *uwsgi_add_subscribe_node(struct uwsgi_subscribe_slo
 		if (!current_slot->nodes->weight)
 			current_slot->nodes->weight = 1;
 		current_slot->nodes->wrr = 0;
+		current_slot->nodes->latency = 0;
+		current_slot->nodes->errors = 0;
+		current_slot->nodes->ejections = 0;
+		current_slot->nodes->ejected_until = 0;
+		current_slot->nodes->latency_stamp = 0;
 		current_slot->nodes->pid = usr->pid;
 		current_slot->nodes->uid = usr->uid;
 		current_slot->nodes->gid = usr->gid;
@@ -461,33 +486,28 @@ struct uwsgi_subscribe_node *uwsgi_add_subscribe_node(struct uwsgi_subscribe_slo
 			current_slot->nodes->notify[usr->notify_len] = 0;
 		}
 		memcpy(current_slot->nodes->name, usr->address, usr->address_len);
+		current_slot->nodes->name[usr->address_len] = 0;
 		current_slot->nodes->last_check = uwsgi_now();
 
 		current_slot->nodes->next = NULL;
 
-		a_slot = slot[hash_key];
-		while (a_slot) {
-			old_slot = a_slot;
-			a_slot = a_slot->next;
-		}
-
-
-		if (old_slot) {
-			old_slot->next = current_slot;
-		}
-
-		current_slot->prev = old_slot;
-		current_slot->next = NULL;
-
 		current_slot->algo = usr->algo;
 		if (!current_slot->algo) current_slot->algo = uwsgi.subscription_algo;
 
+		if (table->count >= table->size) {
+			uwsgi_subscription_table_grow(table);
+		}
 
-		if (!slot[hash_key] || current_slot->prev == NULL) {
-			slot[hash_key] = current_slot;
+		uint64_t bucket = uwsgi_subscription_bucket(table, current_slot->hash);
+		current_slot->prev = NULL;
+		current_slot->next = table->buckets[bucket];
+		if (current_slot->next) {
+			current_slot->next->prev = current_slot;
 		}
+		table->buckets[bucket] = current_slot;
+		table->count++;
 
-		uwsgi_log("[uwsgi-subscription for pid %d] new pool: %.*s (hash key: %d, algo: %s)\n", (int) uwsgi.mypid, usr->keylen, usr->key, current_slot->hash, uwsgi_subscription_algo_name(current_slot->algo));
+		uwsgi_log("[uwsgi-subscription for pid %d] new pool: %.*s (hash key: %llu, algo: %s)\n", (int) uwsgi.mypid, usr->keylen, usr->key, (unsigned long long) bucket, uwsgi_subscription_algo_name(current_slot->algo));
 		uwsgi_log("[uwsgi-subscription for pid %d] %.*s => new node: %.*s (weight: %d, backup: %d)\n", (int) uwsgi.mypid, usr->keylen, usr->key, usr->address_len, usr->address, usr->weight, usr->backup_level);
 
 		if (current_slot->nodes->notify[0]) {
@@ -501,6 +521,88 @@ struct uwsgi_subscribe_node *uwsgi_add_subscribe_node(struct uwsgi_subscribe_slo
 
 }
 
+// a refresh (cmd 2) only keeps alive an already known node, unknown ones have to wait for a full announce
+struct uwsgi_subscribe_node *uwsgi_refresh_subscribe_node(struct uwsgi_subscribe_table *table, struct uwsgi_subscribe_req *usr) {
+	struct uwsgi_subscribe_node *node = uwsgi_get_subscribe_node_by_name(table, usr->key, usr->keylen, usr->address, usr->address_len);
+	if (!node) return NULL;
+#ifdef UWSGI_SSL
+	// refresh packets are never signed
+	if (node->slot->sign_ctx) return NULL;
+#endif
+	if (uwsgi.subscriptions_credentials_check_dir && !uwsgi_subscription_credentials_check(node->slot, usr)) {
+		return NULL;
+	}
+	node->death_mark = 0;
+	node->last_check = uwsgi_now();
+	node->load = usr->load;
+	node->last_requests = 0;
+	return node;
+}
+
+static int subscription_snapshot_node(struct uwsgi_buffer *ub, struct uwsgi_subscribe_slot *slot, struct uwsgi_subscribe_node *node) {
+	size_t start = ub->pos;
+	// make space for the uwsgi header
+	if (uwsgi_buffer_append(ub, "\0\0\0\0", 4)) return -1;
+	if (uwsgi_buffer_append_keyval(ub, "key", 3, slot->key, slot->keylen)) return -1;
+	if (uwsgi_buffer_append_keyval(ub, "address", 7, node->name, node->len)) return -1;
+	if (uwsgi_buffer_append_keynum(ub, "modifier1", 9, node->modifier1)) return -1;
+	if (uwsgi_buffer_append_keynum(ub, "modifier2", 9, node->modifier2)) return -1;
+	if (uwsgi_buffer_append_keynum(ub, "cores", 5, node->cores)) return -1;
+	if (uwsgi_buffer_append_keynum(ub, "load", 4, node->load)) return -1;
+	if (uwsgi_buffer_append_keynum(ub, "weight", 6, node->weight)) return -1;
+	if (uwsgi_buffer_append_keynum(ub, "backup", 6, node->backup_level)) return -1;
+	if (node->proto) {
+		if (uwsgi_buffer_append_keyval(ub, "proto", 5, &node->proto, 1)) return -1;
+	}
+	char *algo = uwsgi_subscription_algo_name(slot->algo);
+	if (algo) {
+		if (uwsgi_buffer_append_keyval(ub, "algo", 4, algo, strlen(algo))) return -1;
+	}
+	if (node->notify[0]) {
+		if (uwsgi_buffer_append_keyval(ub, "notify", 6, node->notify, strlen(node->notify))) return -1;
+	}
+	size_t pktsize = ub->pos - start - 4;
+	if (pktsize > 0xffff) return -1;
+	ub->buf[start] = 224;
+	ub->buf[start + 1] = (uint8_t) (pktsize & 0xff);
+	ub->buf[start + 2] = (uint8_t) ((pktsize >> 8) & 0xff);
+	ub->buf[start + 3] = 0;
+	return 0;
+}
+
+/*
+	dump the whole table as a sequence of (unsigned) subscription packets,
+	used by routers for snapshot files and for bootstrapping peers.
+	Signed pools are skipped, their nodes must announce themselves.
+*/
+struct uwsgi_buffer *uwsgi_subscription_snapshot(struct uwsgi_subscribe_table *table) {
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(uwsgi.page_size);
+	uint64_t i;
+	for (i = 0; i < table->size; i++) {
+		struct uwsgi_subscribe_slot *slot = table->buckets[i];
+		while (slot) {
+#ifdef UWSGI_SSL
+			if (slot->sign_ctx) {
+				slot = slot->next;
+				continue;
+			}
+#endif
+			struct uwsgi_subscribe_node *node = slot->nodes;
+			while (node) {
+				if (!node->death_mark) {
+					if (subscription_snapshot_node(ub, slot, node)) {
+						uwsgi_buffer_destroy(ub);
+						return NULL;
+					}
+				}
+				node = node->next;
+			}
+			slot = slot->next;
+		}
+	}
+	return ub;
+}
+
 static void send_subscription(int sfd, char *host, char *message, uint16_t message_size) {
 
 	int fd = sfd;
@@ -581,6 +683,57 @@ static void send_subscription(int sfd, char *host, char *message, uint16_t messa
 		close(fd);
 }
 
+/*
+	--subscription-delta <n>
+
+	as long as an announce does not change (load excluded), the full packet is replaced
+	by a tiny refresh (cmd 2) carrying only key, address and load.
+	A full announce is forced every <n> rounds, so routers that lost their table
+	(and do not bootstrap from a snapshot) will learn it back.
+
+	signed subscriptions are always sent in full (the refresh would need its own signature)
+*/
+static struct uwsgi_string_list *subscription_delta_states;
+
+static int subscription_delta(int fd, char *server, struct uwsgi_buffer *ub, size_t delta_len, uint8_t cmd, char *sign, char *key, size_t keylen, char *addr, size_t addr_len) {
+	if (!uwsgi.subscription_delta || sign) return 0;
+	if (delta_len < 4 || delta_len > ub->pos) return 0;
+
+	char id[1024];
+	int ret = snprintf(id, 1024, "%s|%.*s|%.*s", server, (int) keylen, key, (int) addr_len, addr);
+	if (ret <= 0 || ret >= 1024) return 0;
+
+	struct uwsgi_string_list *state = uwsgi_string_list_has_item(subscription_delta_states, id, ret);
+	// unsubscriptions reset the state, refreshes forwarded by routers are sent as-is
+	if (cmd != 0) {
+		if (cmd != 2 && state) state->custom = 0;
+		return 0;
+	}
+
+	uint64_t hash = djb33x_hash(ub->buf + 4, delta_len - 4);
+	if (!state) {
+		state = uwsgi_string_new_list(&subscription_delta_states, uwsgi_str(id));
+	}
+	else if (state->custom == hash && state->custom2 < (uint64_t) uwsgi.subscription_delta) {
+		struct uwsgi_buffer *rub = uwsgi_buffer_new(64 + keylen + addr_len);
+		rub->pos = 4;
+		if (uwsgi_buffer_append_keyval(rub, "key", 3, key, keylen)) goto full;
+		if (uwsgi_buffer_append_keyval(rub, "address", 7, addr, addr_len)) goto full;
+		if (uwsgi_buffer_append_keynum(rub, "load", 4, uwsgi.shared->load)) goto full;
+		if (uwsgi_buffer_set_uh(rub, 224, 2)) goto full;
+		send_subscription(fd, server, rub->buf, rub->pos);
+		uwsgi_buffer_destroy(rub);
+		state->custom2++;
+		return 1;
+full:
+		uwsgi_buffer_destroy(rub);
+	}
+
+	state->custom = hash;
+	state->custom2 = 0;
+	return 0;
+}
+
 static int uwsgi_subscription_ub_fix(struct uwsgi_buffer *ub, uint8_t modifier1, uint8_t modifier2, uint8_t cmd, char *sign) {
 	#ifdef UWSGI_SSL
         if (sign) {
@@ -605,7 +758,7 @@ static int uwsgi_subscription_ub_fix(struct uwsgi_buffer *ub, uint8_t modifier1,
 	return 0;
 }
 
-static struct uwsgi_buffer *uwsgi_subscription_ub(char *key, size_t keysize, uint8_t modifier1, uint8_t modifier2, uint8_t cmd, char *socket_name, char *sign, char *sni_key, char *sni_crt, char *sni_ca) {
+static struct uwsgi_buffer *uwsgi_subscription_ub(char *key, size_t keysize, uint8_t modifier1, uint8_t modifier2, uint8_t cmd, char *socket_name, char *sign, char *sni_key, char *sni_crt, char *sni_ca, size_t *delta_len) {
 	struct uwsgi_buffer *ub = uwsgi_buffer_new(4096);
 
 	// make space for uwsgi header
@@ -625,8 +778,6 @@ static struct uwsgi_buffer *uwsgi_subscription_ub(char *key, size_t keysize, uin
 		goto end;
 	if (uwsgi_buffer_append_keynum(ub, "cores", 5, uwsgi.numproc * uwsgi.cores))
 		goto end;
-	if (uwsgi_buffer_append_keynum(ub, "load", 4, uwsgi.shared->load))
-		goto end;
 	if (uwsgi.auto_weight) {
 		if (uwsgi_buffer_append_keynum(ub, "weight", 6, uwsgi.numproc * uwsgi.cores))
 			goto end;
@@ -660,6 +811,11 @@ static struct uwsgi_buffer *uwsgi_subscription_ub(char *key, size_t keysize, uin
 			goto end;
 	}
 
+	// load is the only value changing between rounds, keep it as the last one (see subscription_delta)
+	*delta_len = ub->pos;
+	if (uwsgi_buffer_append_keynum(ub, "load", 4, uwsgi.shared->load))
+		goto end;
+
 	if (uwsgi_subscription_ub_fix(ub, modifier1, modifier2, cmd, sign)) goto end;
 
 	return ub;
@@ -678,12 +834,14 @@ void uwsgi_send_subscription_from_fd(int fd, char *udp_address, char *key, size_
 		socket_name = uwsgi.sockets->name;
 	}
 
-	struct uwsgi_buffer *ub = uwsgi_subscription_ub(key, keysize, modifier1, modifier2, cmd, socket_name, sign, sni_key, sni_crt, sni_ca);
+	size_t delta_len = 0;
+	struct uwsgi_buffer *ub = uwsgi_subscription_ub(key, keysize, modifier1, modifier2, cmd, socket_name, sign, sni_key, sni_crt, sni_ca, &delta_len);
 
 	if (!ub)
 		return;
 
-	send_subscription(fd, udp_address, ub->buf, ub->pos);
+	if (!subscription_delta(fd, udp_address, ub, delta_len, cmd, sign, key, keysize, socket_name, strlen(socket_name)))
+		send_subscription(fd, udp_address, ub->buf, ub->pos);
 	uwsgi_buffer_destroy(ub);
 }
 
@@ -773,13 +931,8 @@ int uwsgi_subscription_sign_check(struct uwsgi_subscribe_slot *slot, struct uwsg
 }
 #endif
 
-int uwsgi_no_subscriptions(struct uwsgi_subscribe_slot **slot) {
-	int i;
-	for (i = 0; i < UMAX16; i++) {
-		if (slot[i])
-			return 0;
-	}
-	return 1;
+int uwsgi_no_subscriptions(struct uwsgi_subscribe_table *table) {
+	return table->count == 0;
 }
 
 void uwsgi_subscribe(char *subscription, uint8_t cmd) {
@@ -1014,8 +1167,6 @@ void uwsgi_subscribe2(char *arg, uint8_t cmd) {
                 goto end;
         if (uwsgi_buffer_append_keynum(ub, "cores", 5, uwsgi.numproc * uwsgi.cores))
                 goto end;
-        if (uwsgi_buffer_append_keynum(ub, "load", 4, uwsgi.shared->load))
-                goto end;
         if (uwsgi_buffer_append_keynum(ub, "weight", 6, weight))
         	goto end;
         if (uwsgi_buffer_append_keynum(ub, "backup", 6, backup))
@@ -1055,9 +1206,14 @@ void uwsgi_subscribe2(char *arg, uint8_t cmd) {
                         goto end;
         }
 
+	size_t delta_len = ub->pos;
+        if (uwsgi_buffer_append_keynum(ub, "load", 4, uwsgi.shared->load))
+                goto end;
+
         if (uwsgi_subscription_ub_fix(ub, modifier1, modifier2, cmd, s2_sign)) goto end;
 
-        send_subscription(-1, s2_server, ub->buf, ub->pos);
+	if (!subscription_delta(-1, s2_server, ub, delta_len, cmd, s2_sign, s2_key, strlen(s2_key), s2_addr, strlen(s2_addr)))
+        	send_subscription(-1, s2_server, ub->buf, ub->pos);
 
 end:
 	if (ub)
@@ -1121,6 +1277,76 @@ void uwsgi_subscribe_all(uint8_t cmd, int verbose) {
 
 }
 
+/*
+	passive health checks (outlier detection)
+
+	routers report the outcome of every request (5xx responses and timeouts are errors),
+	after --subscription-outlier-errors consecutive errors the node is ejected from balancing
+	for --subscription-outlier-ejection seconds (multiplied by the number of consecutive ejections, up to 10x).
+	When the ejection expires the node is half-open: it gets a single request at a time,
+	a success fully restores it, an error ejects it again.
+
+	The last usable node of a pool is never ejected.
+*/
+static int subscription_node_usable(struct uwsgi_subscribe_node *node) {
+	if (node->death_mark) return 0;
+	if (!node->ejected_until) return 1;
+	if (uwsgi_now() < node->ejected_until) return 0;
+	// half-open
+	return node->reference == 0;
+}
+
+void uwsgi_subscription_node_outcome(struct uwsgi_subscribe_node *node, int failed) {
+	if (uwsgi.subscription_outlier_errors <= 0) return;
+
+	if (!failed) {
+		if (node->ejected_until) {
+			uwsgi_log("[uwsgi-subscription for pid %d] %.*s => node %.*s recovered\n", (int) uwsgi.mypid, (int) node->slot->keylen, node->slot->key, (int) node->len, node->name);
+			node->ejected_until = 0;
+			node->ejections = 0;
+		}
+		node->errors = 0;
+		return;
+	}
+
+	time_t now = uwsgi_now();
+	// already ejected, errors of the requests in flight do not count
+	if (node->ejected_until && now < node->ejected_until) return;
+
+	node->errors++;
+	// the half-open probe failed or too many errors
+	if (!node->ejected_until && node->errors < (uint64_t) uwsgi.subscription_outlier_errors) return;
+
+	struct uwsgi_subscribe_node *other = node->slot->nodes;
+	while (other) {
+		if (other != node && subscription_node_usable(other)) break;
+		other = other->next;
+	}
+	if (!other) return;
+
+	if (node->ejections < 10) node->ejections++;
+	time_t ejection = (uwsgi.subscription_outlier_ejection > 0 ? uwsgi.subscription_outlier_ejection : 30) * node->ejections;
+	node->ejected_until = now + ejection;
+	node->errors = 0;
+	uwsgi_log("[uwsgi-subscription for pid %d] %.*s => ejecting node %.*s for %d seconds\n", (int) uwsgi.mypid, (int) node->slot->keylen, node->slot->key, (int) node->len, node->name, (int) ejection);
+}
+
+// --subscription-iphash-algo is resolved on first use (hash algos are registered after the options parsing)
+static struct uwsgi_hash_algo *subscription_iphash_algo(void) {
+	static struct uwsgi_hash_algo *uha = NULL;
+	static int resolved = 0;
+	if (!resolved) {
+		resolved = 1;
+		if (uwsgi.subscription_iphash_algo) {
+			uha = uwsgi_hash_algo_get(uwsgi.subscription_iphash_algo);
+			if (!uha) {
+				uwsgi_log("[uwsgi-subscription] unable to find hash algo \"%s\", using the default iphash\n", uwsgi.subscription_iphash_algo);
+			}
+		}
+	}
+	return uha;
+}
+
 // iphash
 static struct uwsgi_subscribe_node *uwsgi_subscription_algo_iphash(struct uwsgi_subscribe_slot *current_slot, struct uwsgi_subscribe_node *node, struct uwsgi_subscription_client *client) {
         // if node is NULL we are in the second step (in lrc mode we do not use the first step)
@@ -1134,20 +1360,31 @@ static struct uwsgi_subscribe_node *uwsgi_subscription_algo_iphash(struct uwsgi_
 	// first step is counting the number of nodes
 	node = current_slot->nodes;
 	while(node) {
-		if (!node->death_mark) count++;
+		if (subscription_node_usable(node)) count++;
 		node = node->next;
 	}
 	if (count == 0) return NULL;
 
 	uint64_t hash = 0;
+	struct uwsgi_hash_algo *uha = subscription_iphash_algo();
 
 	//hash the ip
 	if (client->sockaddr->sa.sa_family == AF_INET) {
-		hash = client->sockaddr->sa_in.sin_addr.s_addr % count;
+		if (uha) {
+			hash = uwsgi_hash_algo_64(uha, (char *) &client->sockaddr->sa_in.sin_addr.s_addr, 4) % count;
+		}
+		else {
+			hash = client->sockaddr->sa_in.sin_addr.s_addr % count;
+		}
 	}
 #ifdef AF_INET6
 	else if (client->sockaddr->sa.sa_family == AF_INET6) {
-		hash = djb33x_hash((char *)client->sockaddr->sa_in6.sin6_addr.s6_addr, 16) % count;
+		if (uha) {
+			hash = uwsgi_hash_algo_64(uha, (char *) client->sockaddr->sa_in6.sin6_addr.s6_addr, 16) % count;
+		}
+		else {
+			hash = djb33x_hash((char *)client->sockaddr->sa_in6.sin6_addr.s6_addr, 16) % count;
+		}
 	}
 #endif
 		
@@ -1156,7 +1393,7 @@ static struct uwsgi_subscribe_node *uwsgi_subscription_algo_iphash(struct uwsgi_
         struct uwsgi_subscribe_node *choosen_node = NULL;
         node = current_slot->nodes;
         while (node) {
-                if (!node->death_mark) {
+                if (subscription_node_usable(node)) {
 			if (count == hash) {
 				choosen_node = node;
 				break;
@@ -1187,7 +1424,7 @@ retry:
         node = current_slot->nodes;
         uint64_t min_rc = 0;
         while (node) {
-                if (!node->death_mark) {
+                if (subscription_node_usable(node)) {
 			if (node->backup_level == backup_level) {
                         	if (min_rc == 0 || node->reference < min_rc) {
                                 	min_rc = node->reference;
@@ -1229,7 +1466,7 @@ retry:
 	has_backup = 0;
         double min_rc = 0;
         while (node) {
-                if (!node->death_mark) {
+                if (subscription_node_usable(node)) {
 			if (node->backup_level == backup_level) {
                         	// node->weight is always >= 1, we can safely use it as divider
                         	double ref = (double) node->reference / (double) node->weight;
@@ -1262,13 +1499,178 @@ retry:
         return choosen_node;
 }
 
+/*
+	latency aware algos (p2c and ewma)
+
+	routers feed the time to first byte of each backend response, nodes keep a peak-ewma of it:
+	slower responses are immediately taken, faster ones are averaged in with a weight
+	decaying with the time elapsed since the last sample (--subscription-ewma-decay).
+	The same decay is applied when reading the value, so an avoided node slowly becomes
+	attractive again.
+
+	The cost of a node is its latency multiplied by the in-flight requests (+1) and divided by its weight.
+	Nodes without samples take the latency of their competitors, so new nodes get traffic
+	without flooding them.
+*/
+static double subscription_ewma_decay(uint64_t elapsed) {
+	double decay = uwsgi.subscription_ewma_decay > 0 ? uwsgi.subscription_ewma_decay : 10000;
+	return exp(-((double) elapsed / 1000.0) / decay);
+}
+
+void uwsgi_subscription_node_latency(struct uwsgi_subscribe_node *node, uint64_t latency) {
+	uint64_t now = uwsgi_micros();
+	double value = (double) latency;
+	if (node->latency_stamp == 0 || value > node->latency) {
+		node->latency = value;
+	}
+	else {
+		double w = subscription_ewma_decay(now - node->latency_stamp);
+		node->latency = (node->latency * w) + (value * (1.0 - w));
+	}
+	node->latency_stamp = now;
+}
+
+static double subscription_node_latency(struct uwsgi_subscribe_node *node, uint64_t now) {
+	if (node->latency_stamp == 0) return 0;
+	if (now <= node->latency_stamp) return node->latency;
+	return node->latency * subscription_ewma_decay(now - node->latency_stamp);
+}
+
+static double subscription_node_cost(struct uwsgi_subscribe_node *node, double latency) {
+	// node->weight is always >= 1
+	return latency * (double) (node->reference + 1) / (double) node->weight;
+}
+
+// returns the lowest backup level with alive nodes and counts them
+static uint64_t subscription_alive_nodes(struct uwsgi_subscribe_slot *current_slot, uint64_t *backup_level) {
+	uint64_t count = 0;
+	uint64_t level = 0;
+	struct uwsgi_subscribe_node *node = current_slot->nodes;
+	while (node) {
+		if (subscription_node_usable(node)) {
+			if (count == 0 || node->backup_level < level) {
+				level = node->backup_level;
+				count = 1;
+			}
+			else if (node->backup_level == level) {
+				count++;
+			}
+		}
+		node = node->next;
+	}
+	*backup_level = level;
+	return count;
+}
+
+static struct uwsgi_subscribe_node *subscription_alive_node_at(struct uwsgi_subscribe_slot *current_slot, uint64_t backup_level, uint64_t pos) {
+	struct uwsgi_subscribe_node *node = current_slot->nodes;
+	while (node) {
+		if (subscription_node_usable(node) && node->backup_level == backup_level) {
+			if (pos == 0) return node;
+			pos--;
+		}
+		node = node->next;
+	}
+	return NULL;
+}
+
+// power of two choices: pick two random nodes and take the cheaper one
+static struct uwsgi_subscribe_node *uwsgi_subscription_algo_p2c(struct uwsgi_subscribe_slot *current_slot, struct uwsgi_subscribe_node *node, struct uwsgi_subscription_client *client) {
+	// if node is NULL we are in the second step (in p2c mode we do not use the first step)
+	if (node)
+		return NULL;
+
+	uint64_t backup_level = 0;
+	uint64_t count = subscription_alive_nodes(current_slot, &backup_level);
+	if (count == 0) return NULL;
+
+	uint64_t first = rand() % count;
+	struct uwsgi_subscribe_node *choosen_node = subscription_alive_node_at(current_slot, backup_level, first);
+	if (count > 1) {
+		// the second choice skips the first one
+		uint64_t second = rand() % (count - 1);
+		if (second >= first) second++;
+		struct uwsgi_subscribe_node *a = choosen_node;
+		struct uwsgi_subscribe_node *b = subscription_alive_node_at(current_slot, backup_level, second);
+		if (a && b) {
+			uint64_t now = uwsgi_micros();
+			double la = subscription_node_latency(a, now);
+			double lb = subscription_node_latency(b, now);
+			if (la == 0) la = lb;
+			if (lb == 0) lb = la;
+			// no samples at all, fallback to the in-flight requests
+			if (la == 0) {
+				la = 1;
+				lb = 1;
+			}
+			if (subscription_node_cost(b, lb) < subscription_node_cost(a, la)) {
+				choosen_node = b;
+			}
+		}
+	}
+
+	if (choosen_node) {
+		choosen_node->reference++;
+	}
+
+	return choosen_node;
+}
+
+// take the cheapest node (full scan)
+static struct uwsgi_subscribe_node *uwsgi_subscription_algo_ewma(struct uwsgi_subscribe_slot *current_slot, struct uwsgi_subscribe_node *node, struct uwsgi_subscription_client *client) {
+	// if node is NULL we are in the second step (in ewma mode we do not use the first step)
+	if (node)
+		return NULL;
+
+	uint64_t backup_level = 0;
+	if (subscription_alive_nodes(current_slot, &backup_level) == 0) return NULL;
+
+	uint64_t now = uwsgi_micros();
+	// average latency of the nodes with samples, used for the others
+	double sum = 0;
+	uint64_t probed = 0;
+	node = current_slot->nodes;
+	while (node) {
+		if (subscription_node_usable(node) && node->backup_level == backup_level) {
+			double latency = subscription_node_latency(node, now);
+			if (latency > 0) {
+				sum += latency;
+				probed++;
+			}
+		}
+		node = node->next;
+	}
+	double avg = probed ? sum / (double) probed : 1;
+
+	struct uwsgi_subscribe_node *choosen_node = NULL;
+	double min_cost = 0;
+	node = current_slot->nodes;
+	while (node) {
+		if (subscription_node_usable(node) && node->backup_level == backup_level) {
+			double latency = subscription_node_latency(node, now);
+			double cost = subscription_node_cost(node, latency > 0 ? latency : avg);
+			if (!choosen_node || cost < min_cost) {
+				min_cost = cost;
+				choosen_node = node;
+			}
+		}
+		node = node->next;
+	}
+
+	if (choosen_node) {
+		choosen_node->reference++;
+	}
+
+	return choosen_node;
+}
+
 // weighted round robin algo (with backup support)
 static struct uwsgi_subscribe_node *uwsgi_subscription_algo_wrr(struct uwsgi_subscribe_slot *current_slot, struct uwsgi_subscribe_node *node, struct uwsgi_subscription_client *client) {
 	uint64_t backup_level = 0;
 	uint64_t has_backup = 0;
         // if node is NULL we are in the second step
         if (node) {
-                if (node->death_mark == 0 && node->wrr > 0) {
+                if (subscription_node_usable(node) && node->wrr > 0) {
                         node->wrr--;
                         node->reference++;
                         return node;
@@ -1280,7 +1682,7 @@ static struct uwsgi_subscribe_node *uwsgi_subscription_algo_wrr(struct uwsgi_sub
         node = current_slot->nodes;
         uint64_t min_weight = 0;
         while (node) {
-                if (!node->death_mark) {
+                if (subscription_node_usable(node)) {
                         if (min_weight == 0 || node->weight < min_weight)
                                 min_weight = node->weight;
                 }
@@ -1293,7 +1695,7 @@ retry:
 	has_backup = 0;
         struct uwsgi_subscribe_node *choosen_node = NULL;
         while (node) {
-                if (!node->death_mark) {
+                if (subscription_node_usable(node)) {
 			if (node->backup_level == backup_level) {
                         	node->wrr = node->weight / min_weight;
                         	choosen_node = node;
@@ -1315,12 +1717,200 @@ retry:
         return choosen_node;
 }
 
+/*
+	consistent hashing (ketama style)
+
+	every alive node (of the lowest available backup level) gets vnodes * weight points in a ring,
+	the affinity key (the client cookie or the client address) is mapped to the first point
+	following its hash. Adding or removing a node only moves the keys of its points.
+
+	With --subscription-chash-load the walk skips the nodes with more than load% of the
+	average reference count (consistent hashing with bounded loads).
+
+	The ring is rebuilt whenever the signature of the nodes list changes.
+*/
+
+struct uwsgi_subscribe_chash_point {
+	uint32_t point;
+	struct uwsgi_subscribe_node *node;
+};
+
+struct uwsgi_subscribe_chash {
+	uint64_t signature;
+	uint64_t count;
+	struct uwsgi_subscribe_chash_point *points;
+};
+
+// fnv1a + murmur3 finalizer, points of the ring need a good distribution
+static uint32_t chash_hash(char *key, size_t len, uint32_t seed) {
+	uint32_t h = 2166136261U ^ seed;
+	size_t i;
+	for(i=0;i<len;i++) {
+		h ^= (uint8_t) key[i];
+		h *= 16777619U;
+	}
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+static int chash_point_cmp(const void *a, const void *b) {
+	uint32_t pa = ((struct uwsgi_subscribe_chash_point *) a)->point;
+	uint32_t pb = ((struct uwsgi_subscribe_chash_point *) b)->point;
+	if (pa < pb) return -1;
+	if (pa > pb) return 1;
+	return 0;
+}
+
+static void uwsgi_subscription_chash_free(struct uwsgi_subscribe_slot *current_slot) {
+	if (!current_slot->chash) return;
+	free(current_slot->chash->points);
+	free(current_slot->chash);
+	current_slot->chash = NULL;
+}
+
+static int uwsgi_subscription_chash_build(struct uwsgi_subscribe_slot *current_slot, uint64_t backup_level, uint64_t signature) {
+	uint64_t vnodes = uwsgi.subscription_chash_vnodes > 0 ? uwsgi.subscription_chash_vnodes : 160;
+	uint64_t count = 0;
+	struct uwsgi_subscribe_node *node = current_slot->nodes;
+	while(node) {
+		if (subscription_node_usable(node) && node->backup_level == backup_level) {
+			count += vnodes * UMIN(UMAX(node->weight, 1), 0xffff);
+		}
+		node = node->next;
+	}
+
+	struct uwsgi_subscribe_chash_point *points = malloc(sizeof(struct uwsgi_subscribe_chash_point) * count);
+	if (!points) {
+		uwsgi_error("uwsgi_subscription_chash_build()/malloc()");
+		return -1;
+	}
+
+	uint64_t pos = 0;
+	node = current_slot->nodes;
+	while(node) {
+		if (subscription_node_usable(node) && node->backup_level == backup_level) {
+			uint64_t i, n = vnodes * UMIN(UMAX(node->weight, 1), 0xffff);
+			for(i=0;i<n;i++) {
+				points[pos].point = chash_hash(node->name, node->len, (uint32_t) i);
+				points[pos].node = node;
+				pos++;
+			}
+		}
+		node = node->next;
+	}
+
+	qsort(points, count, sizeof(struct uwsgi_subscribe_chash_point), chash_point_cmp);
+
+	if (!current_slot->chash) {
+		current_slot->chash = uwsgi_calloc(sizeof(struct uwsgi_subscribe_chash));
+	}
+	free(current_slot->chash->points);
+	current_slot->chash->points = points;
+	current_slot->chash->count = count;
+	current_slot->chash->signature = signature;
+	return 0;
+}
+
+static struct uwsgi_subscribe_node *uwsgi_subscription_algo_chash(struct uwsgi_subscribe_slot *current_slot, struct uwsgi_subscribe_node *node, struct uwsgi_subscription_client *client) {
+	// if node is NULL we are in the second step (in chash mode we do not use the first step)
+	if (node)
+		return NULL;
+
+	// the lowest backup level with alive nodes
+	uint64_t backup_level = 0;
+	int found = 0;
+	node = current_slot->nodes;
+	while(node) {
+		if (subscription_node_usable(node) && (!found || node->backup_level < backup_level)) {
+			backup_level = node->backup_level;
+			found = 1;
+		}
+		node = node->next;
+	}
+	if (!found) return NULL;
+
+	// the signature covers the nodes (and their weights) in the ring
+	uint64_t signature = 0, nodes = 0, references = 0;
+	node = current_slot->nodes;
+	while(node) {
+		if (subscription_node_usable(node) && node->backup_level == backup_level) {
+			uint64_t h = (uint64_t) (uintptr_t) node ^ ((uint64_t) chash_hash(node->name, node->len, 0) << 32) ^ node->weight;
+			h ^= h >> 33;
+			h *= 0xff51afd7ed558ccdULL;
+			h ^= h >> 33;
+			signature += h;
+			nodes++;
+			references += node->reference;
+		}
+		node = node->next;
+	}
+
+	if (!current_slot->chash || current_slot->chash->signature != signature) {
+		if (uwsgi_subscription_chash_build(current_slot, backup_level, signature)) return NULL;
+	}
+
+	struct uwsgi_subscribe_chash *ring = current_slot->chash;
+	if (ring->count == 0) return NULL;
+
+	uint32_t hash = 0;
+	if (client && client->cookie_len > 0) {
+		hash = chash_hash(client->cookie, client->cookie_len, 0);
+	}
+	else if (client && client->sockaddr) {
+		if (client->sockaddr->sa.sa_family == AF_INET) {
+			hash = chash_hash((char *) &client->sockaddr->sa_in.sin_addr.s_addr, 4, 0);
+		}
+#ifdef AF_INET6
+		else if (client->sockaddr->sa.sa_family == AF_INET6) {
+			hash = chash_hash((char *) client->sockaddr->sa_in6.sin6_addr.s6_addr, 16, 0);
+		}
+#endif
+	}
+
+	// first point >= hash (wrapping around)
+	uint64_t low = 0, high = ring->count;
+	while(low < high) {
+		uint64_t mid = low + ((high - low) / 2);
+		if (ring->points[mid].point < hash) {
+			low = mid + 1;
+		}
+		else {
+			high = mid;
+		}
+	}
+	if (low == ring->count) low = 0;
+
+	struct uwsgi_subscribe_node *choosen_node = ring->points[low].node;
+	if (uwsgi.subscription_chash_load > 0) {
+		// ceil(load% * (references + 1) / nodes)
+		uint64_t bound = ((uwsgi.subscription_chash_load * (references + 1)) + (100 * nodes) - 1) / (100 * nodes);
+		uint64_t i;
+		for(i=0;i<ring->count;i++) {
+			struct uwsgi_subscribe_node *candidate = ring->points[(low + i) % ring->count].node;
+			if (candidate->reference < bound) {
+				choosen_node = candidate;
+				break;
+			}
+		}
+	}
+
+	choosen_node->reference++;
+	return choosen_node;
+}
+
 void uwsgi_subscription_init_algos() {
 
 	uwsgi_register_subscription_algo("wrr", uwsgi_subscription_algo_wrr);
 	uwsgi_register_subscription_algo("lrc", uwsgi_subscription_algo_lrc);
 	uwsgi_register_subscription_algo("wlrc", uwsgi_subscription_algo_wlrc);
 	uwsgi_register_subscription_algo("iphash", uwsgi_subscription_algo_iphash);
+	uwsgi_register_subscription_algo("chash", uwsgi_subscription_algo_chash);
+	uwsgi_register_subscription_algo("p2c", uwsgi_subscription_algo_p2c);
+	uwsgi_register_subscription_algo("ewma", uwsgi_subscription_algo_ewma);
 }
 
 void uwsgi_subscription_set_algo(char *algo) {
@@ -1337,11 +1927,14 @@ wrr:
 }
 
 // we are lazy for subscription algos, we initialize them only if needed
-struct uwsgi_subscribe_slot **uwsgi_subscription_init_ht() {
+struct uwsgi_subscribe_table *uwsgi_subscription_init_ht() {
         if (!uwsgi.subscription_algo) {
                 uwsgi_subscription_set_algo(NULL);
         }
-        return uwsgi_calloc(sizeof(struct uwsgi_subscription_slot *) * UMAX16);
+        struct uwsgi_subscribe_table *table = uwsgi_calloc(sizeof(struct uwsgi_subscribe_table));
+        table->size = 256;
+        table->buckets = uwsgi_calloc(sizeof(struct uwsgi_subscribe_slot *) * table->size);
+        return table;
 }
 
 struct uwsgi_subscribe_node *(*uwsgi_subscription_algo_get(char *name , size_t len))(struct uwsgi_subscribe_slot *, struct uwsgi_subscribe_node *, struct uwsgi_subscription_client *) {
@@ -0,0 +1,293 @@
+#include <uwsgi.h>
+
+extern struct uwsgi_server uwsgi;
+
+/*
+
+	kernel accounting of workers and mules
+
+	with --taskstats the master periodically asks the kernel (generic netlink, TASKSTATS family)
+	the accounting of the thread groups of workers and mules: cpu time, context switches,
+	storage io and the time spent waiting for a cpu (run queue) or for block io.
+
+	Requests are sent in batches on a single socket and the replies are matched by sequence number,
+	a slow reply never blocks the master for more than a second.
+
+	The kernel does not aggregate the io accounting of the live threads of a group, the bytes are read
+	from /proc/<pid>/io.
+
+	TASKSTATS_CMD_GET requires CAP_NET_ADMIN (keep it with --cap net_admin when dropping privileges),
+	the delays are recorded only with delay accounting enabled (sysctl kernel.task_delayacct=1 or the
+	delayacct boot option).
+
+*/
+
+#ifdef __linux__
+
+#include <linux/genetlink.h>
+#include <linux/taskstats.h>
+
+// requests in flight at the same time (the replies must fit the socket buffer)
+#define UWSGI_TASKSTATS_BATCH 64
+
+struct uwsgi_taskstats_req {
+	struct nlmsghdr n;
+	struct genlmsghdr g;
+	char buf[64];
+};
+
+static int taskstats_fd = -1;
+static uint16_t taskstats_family;
+static uint32_t taskstats_seq;
+static int taskstats_disabled;
+static time_t taskstats_last;
+
+static void taskstats_req_init(struct uwsgi_taskstats_req *req, uint16_t type, uint8_t cmd) {
+	memset(req, 0, sizeof(struct uwsgi_taskstats_req));
+	req->n.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+	req->n.nlmsg_type = type;
+	req->n.nlmsg_flags = NLM_F_REQUEST;
+	req->n.nlmsg_seq = ++taskstats_seq;
+	req->g.cmd = cmd;
+	req->g.version = 1;
+}
+
+static void taskstats_req_attr(struct uwsgi_taskstats_req *req, uint16_t type, void *data, uint16_t len) {
+	struct nlattr *na = (struct nlattr *) ((char *) &req->n + NLMSG_ALIGN(req->n.nlmsg_len));
+	na->nla_type = type;
+	na->nla_len = NLA_HDRLEN + len;
+	memcpy((char *) na + NLA_HDRLEN, data, len);
+	req->n.nlmsg_len = NLMSG_ALIGN(req->n.nlmsg_len) + NLA_ALIGN(na->nla_len);
+}
+
+static struct nlattr *taskstats_attr(char *buf, ssize_t len, uint16_t type) {
+	while (len >= NLA_HDRLEN) {
+		struct nlattr *na = (struct nlattr *) buf;
+		if (na->nla_len < NLA_HDRLEN || na->nla_len > len) break;
+		if ((na->nla_type & NLA_TYPE_MASK) == type) return na;
+		len -= NLA_ALIGN(na->nla_len);
+		buf += NLA_ALIGN(na->nla_len);
+	}
+	return NULL;
+}
+
+#define taskstats_attr_data(na) ((char *) (na) + NLA_HDRLEN)
+#define taskstats_attr_len(na) ((size_t) ((na)->nla_len - NLA_HDRLEN))
+
+// the payload (the attributes) of a genetlink reply, < 0 (-errno) on errors
+static ssize_t taskstats_payload(struct nlmsghdr *n, char **attrs) {
+	if (n->nlmsg_type == NLMSG_ERROR) {
+		if (n->nlmsg_len < NLMSG_LENGTH(sizeof(struct nlmsgerr))) return -EINVAL;
+		struct nlmsgerr *err = (struct nlmsgerr *) NLMSG_DATA(n);
+		return err->error ? err->error : -EINVAL;
+	}
+	if (n->nlmsg_len < NLMSG_LENGTH(GENL_HDRLEN)) return -EINVAL;
+	*attrs = (char *) NLMSG_DATA(n) + GENL_HDRLEN;
+	return n->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+}
+
+static int taskstats_init() {
+	struct sockaddr_nl snl;
+	struct uwsgi_taskstats_req req;
+	char buf[4096];
+
+	taskstats_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_GENERIC);
+	if (taskstats_fd < 0) {
+		uwsgi_error("uwsgi_master_taskstats()/socket()");
+		return -1;
+	}
+
+	memset(&snl, 0, sizeof(struct sockaddr_nl));
+	snl.nl_family = AF_NETLINK;
+	if (bind(taskstats_fd, (struct sockaddr *) &snl, sizeof(struct sockaddr_nl))) {
+		uwsgi_error("uwsgi_master_taskstats()/bind()");
+		goto error;
+	}
+
+	// resolve the id of the TASKSTATS family
+	taskstats_req_init(&req, GENL_ID_CTRL, CTRL_CMD_GETFAMILY);
+	taskstats_req_attr(&req, CTRL_ATTR_FAMILY_NAME, TASKSTATS_GENL_NAME, strlen(TASKSTATS_GENL_NAME) + 1);
+	if (send(taskstats_fd, &req, req.n.nlmsg_len, 0) < 0) {
+		uwsgi_error("uwsgi_master_taskstats()/send()");
+		goto error;
+	}
+	if (uwsgi_waitfd(taskstats_fd, 1) <= 0) {
+		uwsgi_log("[taskstats] no reply from the genetlink controller\n");
+		goto error;
+	}
+	ssize_t rlen = recv(taskstats_fd, buf, sizeof(buf), 0);
+	if (rlen < 0) {
+		uwsgi_error("uwsgi_master_taskstats()/recv()");
+		goto error;
+	}
+	struct nlmsghdr *n = (struct nlmsghdr *) buf;
+	char *attrs = NULL;
+	if (!NLMSG_OK(n, rlen)) goto invalid;
+	ssize_t len = taskstats_payload(n, &attrs);
+	if (len < 0) {
+		errno = -len;
+		uwsgi_error("uwsgi_master_taskstats()/CTRL_CMD_GETFAMILY");
+		goto error;
+	}
+	struct nlattr *na = taskstats_attr(attrs, len, CTRL_ATTR_FAMILY_ID);
+	if (!na || taskstats_attr_len(na) < sizeof(uint16_t)) goto invalid;
+	memcpy(&taskstats_family, taskstats_attr_data(na), sizeof(uint16_t));
+
+	struct uwsgi_buffer *delayacct = uwsgi_linux_proc_read("/proc/sys/kernel/task_delayacct");
+	if (delayacct && delayacct->buf[0] == '0') {
+		uwsgi_log("[taskstats] delay accounting is disabled (sysctl kernel.task_delayacct=1), cpu and block io delays will be 0\n");
+	}
+	if (delayacct) uwsgi_buffer_destroy(delayacct);
+	return 0;
+
+invalid:
+	uwsgi_log("[taskstats] invalid reply from the genetlink controller\n");
+error:
+	close(taskstats_fd);
+	taskstats_fd = -1;
+	return -1;
+}
+
+// slots are the workers (from 1) followed by the mules
+static struct uwsgi_taskstats *taskstats_slot(int slot, pid_t *pid) {
+	if (slot < uwsgi.numproc) {
+		*pid = uwsgi.workers[slot + 1].pid;
+		return &uwsgi.workers[slot + 1].taskstats;
+	}
+	*pid = uwsgi.mules[slot - uwsgi.numproc].pid;
+	return &uwsgi.mules[slot - uwsgi.numproc].taskstats;
+}
+
+static void taskstats_io(struct uwsgi_taskstats *uts, pid_t pid) {
+	char file[64];
+	snprintf(file, sizeof(file), "/proc/%d/io", (int) pid);
+	struct uwsgi_buffer *ub = uwsgi_linux_proc_read(file);
+	if (!ub) return;
+	char *ctx = NULL;
+	char *line = strtok_r(ub->buf, "\n", &ctx);
+	while (line) {
+		unsigned long long bytes = 0;
+		if (sscanf(line, "read_bytes: %llu", &bytes) == 1) {
+			uts->read_bytes = bytes;
+		}
+		else if (sscanf(line, "write_bytes: %llu", &bytes) == 1) {
+			uts->write_bytes = bytes;
+		}
+		line = strtok_r(NULL, "\n", &ctx);
+	}
+	uwsgi_buffer_destroy(ub);
+}
+
+static void taskstats_store(struct uwsgi_taskstats *uts, char *attrs, ssize_t len) {
+	struct taskstats ts;
+	struct nlattr *aggr = taskstats_attr(attrs, len, TASKSTATS_TYPE_AGGR_TGID);
+	if (!aggr) return;
+	struct nlattr *na = taskstats_attr(taskstats_attr_data(aggr), taskstats_attr_len(aggr), TASKSTATS_TYPE_STATS);
+	if (!na) return;
+	// older kernels send a shorter struct
+	memset(&ts, 0, sizeof(struct taskstats));
+	memcpy(&ts, taskstats_attr_data(na), UMIN(taskstats_attr_len(na), sizeof(struct taskstats)));
+
+	uts->cpu_time = ts.ac_utime + ts.ac_stime;
+	uts->voluntary_switches = ts.nvcsw;
+	uts->involuntary_switches = ts.nivcsw;
+	uts->cpu_delay = ts.cpu_delay_total / 1000;
+	uts->blkio_delay = ts.blkio_delay_total / 1000;
+}
+
+// send a batch of requests (from slot 'first') and wait for the replies
+static int taskstats_batch(int first, int last) {
+	struct uwsgi_taskstats_req req;
+	char buf[8192];
+	int slots[UWSGI_TASKSTATS_BATCH];
+	uint32_t base = taskstats_seq + 1;
+	int pending = 0;
+	int i;
+
+	for (i = first; i < last; i++) {
+		pid_t pid = 0;
+		taskstats_slot(i, &pid);
+		if (pid <= 0) continue;
+		uint32_t tgid = pid;
+		taskstats_req_init(&req, taskstats_family, TASKSTATS_CMD_GET);
+		taskstats_req_attr(&req, TASKSTATS_CMD_ATTR_TGID, &tgid, sizeof(uint32_t));
+		if (send(taskstats_fd, &req, req.n.nlmsg_len, 0) < 0) {
+			uwsgi_error("uwsgi_master_taskstats()/send()");
+			return -1;
+		}
+		slots[req.n.nlmsg_seq - base] = i;
+		pending++;
+	}
+	uint32_t seqs = taskstats_seq + 1 - base;
+
+	while (pending > 0) {
+		if (uwsgi_waitfd(taskstats_fd, 1) <= 0) {
+			uwsgi_log("[taskstats] %d replies not received\n", pending);
+			return 0;
+		}
+		ssize_t rlen = recv(taskstats_fd, buf, sizeof(buf), 0);
+		if (rlen < 0) {
+			if (uwsgi_is_again()) continue;
+			uwsgi_error("uwsgi_master_taskstats()/recv()");
+			return -1;
+		}
+		struct nlmsghdr *n;
+		for (n = (struct nlmsghdr *) buf; NLMSG_OK(n, rlen); n = NLMSG_NEXT(n, rlen)) {
+			// late replies of previous batches
+			if (n->nlmsg_seq - base >= seqs) continue;
+			pending--;
+			char *attrs = NULL;
+			ssize_t len = taskstats_payload(n, &attrs);
+			if (len == -EPERM) {
+				uwsgi_log("[taskstats] CAP_NET_ADMIN is required to get the kernel accounting of the processes (--cap net_admin)\n");
+				return -1;
+			}
+			// the process is gone (ESRCH) or not ready
+			if (len < 0) continue;
+			pid_t pid = 0;
+			struct uwsgi_taskstats *uts = taskstats_slot(slots[n->nlmsg_seq - base], &pid);
+			taskstats_store(uts, attrs, len);
+			taskstats_io(uts, pid);
+		}
+	}
+	return 0;
+}
+
+void uwsgi_master_taskstats() {
+	if (!uwsgi.taskstats || taskstats_disabled) return;
+	if (uwsgi.current_time - taskstats_last < uwsgi.taskstats) return;
+	taskstats_last = uwsgi.current_time;
+
+	if (taskstats_fd < 0 && taskstats_init()) goto disable;
+
+	int slots = uwsgi.numproc + uwsgi.mules_cnt;
+	int i;
+	for (i = 0; i < slots; i += UWSGI_TASKSTATS_BATCH) {
+		if (taskstats_batch(i, UMIN(i + UWSGI_TASKSTATS_BATCH, slots))) goto disable;
+	}
+	return;
+
+disable:
+	uwsgi_log("disabling --taskstats\n");
+	taskstats_disabled = 1;
+	if (taskstats_fd >= 0) {
+		close(taskstats_fd);
+		taskstats_fd = -1;
+	}
+}
+
+int uwsgi_stats_taskstats(struct uwsgi_stats *us, struct uwsgi_taskstats *uts) {
+	if (uwsgi_stats_key(us, "taskstats")) return -1;
+	if (uwsgi_stats_object_open(us)) return -1;
+	if (uwsgi_stats_keylong_comma(us, "cpu_time", (unsigned long long) uts->cpu_time)) return -1;
+	if (uwsgi_stats_keylong_comma(us, "voluntary_switches", (unsigned long long) uts->voluntary_switches)) return -1;
+	if (uwsgi_stats_keylong_comma(us, "involuntary_switches", (unsigned long long) uts->involuntary_switches)) return -1;
+	if (uwsgi_stats_keylong_comma(us, "read_bytes", (unsigned long long) uts->read_bytes)) return -1;
+	if (uwsgi_stats_keylong_comma(us, "write_bytes", (unsigned long long) uts->write_bytes)) return -1;
+	if (uwsgi_stats_keylong_comma(us, "cpu_delay", (unsigned long long) uts->cpu_delay)) return -1;
+	if (uwsgi_stats_keylong(us, "blkio_delay", (unsigned long long) uts->blkio_delay)) return -1;
+	if (uwsgi_stats_object_close(us)) return -1;
+	return 0;
+}
+
+#endif
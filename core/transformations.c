@@ -12,6 +12,16 @@
 
 	Transformations (if required) could completely swallow already set headers
 
+	the streaming contract (can_stream = 1):
+
+	- func is called for every chunk, ut->chunk contains the data and the transformation
+	  replaces it with its output (the buffer is reset after each round, so its size is
+	  bounded by the biggest chunk)
+	- state can be kept only in ut->data, a transformation flagged as is_final (sharing the same data)
+	  is called at the end to flush it
+	- ut->free is always called when the chain is destroyed, so resources are released even
+	  when the final round is not reached (empty bodies, errors)
+
 */
 
 extern struct uwsgi_server uwsgi;
@@ -131,6 +141,9 @@ void uwsgi_free_transformations(struct wsgi_request *wsgi_req) {
 	struct uwsgi_transformation *ut = wsgi_req->transformations;
 	while(ut) {
 		struct uwsgi_transformation *current_ut = ut;
+		if (current_ut->free) {
+			current_ut->free(current_ut);
+		}
 		if (current_ut->chunk) {
 			uwsgi_buffer_destroy(current_ut->chunk);
 		}
@@ -1,5 +1,13 @@
 #include <uwsgi.h>
 
+#ifdef __linux__
+#include <sys/syscall.h>
+#ifdef __linux__
+#include <sys/vfs.h>
+#define UWSGI_HUGETLBFS_MAGIC 0x958458f6
+#endif
+#endif
+
 
 extern struct uwsgi_server uwsgi;
 
@@ -41,10 +49,21 @@ int check_hex(char *str, int len) {
 
 }
 
+// the default timeout could have sub-second resolution
+static uint64_t harakiri_msecs(int sec) {
+	if (uwsgi.harakiri_options.workers_ms > 0 && sec == uwsgi.harakiri_options.workers) {
+		return uwsgi.harakiri_options.workers_ms;
+	}
+	return (uint64_t) sec * 1000;
+}
+
 // increase worker harakiri
 void inc_harakiri(struct wsgi_request *wsgi_req, int sec) {
 	if (uwsgi.master_process) {
-		uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].harakiri += sec;
+		struct uwsgi_core *uc = &uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id];
+		uc->harakiri += sec;
+		// a later deadline does not need to lower the bound
+		if (uc->harakiri_deadline) uc->harakiri_deadline += harakiri_msecs(sec);
 	}
 	else {
 		alarm(uwsgi.harakiri_options.workers + sec);
@@ -54,11 +73,15 @@ void inc_harakiri(struct wsgi_request *wsgi_req, int sec) {
 // set worker harakiri
 void set_harakiri(struct wsgi_request *wsgi_req, int sec) {
 	if (!wsgi_req) return;
+	struct uwsgi_core *uc = &uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id];
 	if (sec == 0) {
-		uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].harakiri = 0;
+		uc->harakiri = 0;
+		uc->harakiri_deadline = 0;
 	}
 	else {
-		uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].harakiri = uwsgi_now() + sec;
+		uc->harakiri = uwsgi_now() + sec;
+		uc->harakiri_deadline = (uwsgi_micros() / 1000) + harakiri_msecs(sec);
+		uwsgi_worker_harakiri_bound(uwsgi.mywid, uc->harakiri_deadline);
 	}
 	if (!uwsgi.master_process) {
 		alarm(sec);
@@ -94,6 +117,8 @@ void set_user_harakiri(struct wsgi_request *wsgi_req, int sec) {
 		}
 		else if (wsgi_req) {
 			uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].user_harakiri = uwsgi_now() + sec;
+			// user harakiri has seconds resolution
+			uwsgi_worker_harakiri_bound(uwsgi.mywid, (uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].user_harakiri + 1) * 1000);
 		}
 	}
 }
@@ -1002,6 +1027,9 @@ nonroot:
 
 static void close_and_free_request(struct wsgi_request *wsgi_req) {
 
+	// stop the body streaming (if any) before closing the socket
+	uwsgi_postbuffer_stream_close(wsgi_req);
+
 	// close the connection with the client
         if (!wsgi_req->fd_closed) {
                 // NOTE, if we close the socket before receiving eventually sent data, socket layer will send a RST
@@ -1024,12 +1052,17 @@ static void close_and_free_request(struct wsgi_request *wsgi_req) {
                 free(wsgi_req->proto_parser_buf);
         }
 
+        if (wsgi_req->proto_handoff_buf) {
+                free(wsgi_req->proto_handoff_buf);
+        }
+
 }
 
 // destroy a request
 void uwsgi_destroy_request(struct wsgi_request *wsgi_req) {
 
 	close_and_free_request(wsgi_req);
+	uwsgi_req_arena_reset(wsgi_req);
 
 	int foo;
         if (uwsgi.threads > 1) {
@@ -1048,12 +1081,100 @@ void uwsgi_destroy_request(struct wsgi_request *wsgi_req) {
 }
 
 // finalize/close/free a request
+void uwsgi_req_timing_start(struct wsgi_request *wsgi_req) {
+	memset(wsgi_req->timing, 0, sizeof(wsgi_req->timing));
+	wsgi_req->timing_mark = uwsgi_micros_monotonic();
+	wsgi_req->timing_write_mark = 0;
+}
+
+/*
+	account the time elapsed since the previous mark to the specified stage,
+	time spent waiting for the client to be writable is already in UWSGI_REQ_STAGE_WRITE
+*/
+void uwsgi_req_stage(struct wsgi_request *wsgi_req, int stage) {
+	if (!wsgi_req->timing_mark) return;
+	uint64_t now = uwsgi_micros_monotonic();
+	uint64_t elapsed = now - wsgi_req->timing_mark;
+	uint64_t waited = wsgi_req->timing[UWSGI_REQ_STAGE_WRITE] - wsgi_req->timing_write_mark;
+	if (elapsed > waited) {
+		wsgi_req->timing[stage] += elapsed - waited;
+	}
+	wsgi_req->timing_mark = now;
+	wsgi_req->timing_write_mark = wsgi_req->timing[UWSGI_REQ_STAGE_WRITE];
+}
+
+/*
+	X-Request-Start as set by the frontend: "t=<timestamp>" or "<timestamp>",
+	the timestamp can be in seconds (with optional fraction), milliseconds or microseconds
+*/
+static uint64_t uwsgi_request_start_micros(char *buf, uint16_t len) {
+	uint64_t num = 0, frac = 0;
+	int digits = 0, frac_digits = 0, dot = 0;
+	uint16_t i;
+
+	if (len > 2 && buf[0] == 't' && buf[1] == '=') {
+		buf += 2;
+		len -= 2;
+	}
+
+	for (i = 0; i < len; i++) {
+		if (isdigit((int) buf[i])) {
+			if (!dot) {
+				num = (num * 10) + (buf[i] - '0');
+				digits++;
+			}
+			else if (frac_digits < 6) {
+				frac = (frac * 10) + (buf[i] - '0');
+				frac_digits++;
+			}
+		}
+		else if (buf[i] == '.' && !dot) {
+			dot = 1;
+		}
+		else {
+			break;
+		}
+	}
+
+	if (!digits) return 0;
+	if (dot) {
+		while (frac_digits++ < 6) frac *= 10;
+		return (num * 1000000) + frac;
+	}
+	if (digits >= 16) return num;
+	if (digits >= 13) return num * 1000;
+	return num * 1000000;
+}
+
+void uwsgi_req_timing_end(struct wsgi_request *wsgi_req) {
+	int i;
+	if (!wsgi_req->timing_mark) return;
+	uwsgi_req_stage(wsgi_req, UWSGI_REQ_STAGE_CLOSE);
+	wsgi_req->timing_mark = 0;
+
+	// queue time is the distance between the frontend and the accept()
+	uint16_t rs_len = 0;
+	char *rs = uwsgi_get_var(wsgi_req, "HTTP_X_REQUEST_START", 20, &rs_len);
+	if (rs) {
+		uint64_t queued = uwsgi_request_start_micros(rs, rs_len);
+		if (queued && queued < wsgi_req->start_of_request) {
+			wsgi_req->timing[UWSGI_REQ_STAGE_QUEUE] = wsgi_req->start_of_request - queued;
+		}
+	}
+
+	for (i = 0; i < UWSGI_REQ_STAGE_MAX; i++) {
+		if (uwsgi.metric_req_stages[i]) uwsgi_metric_histogram_add(uwsgi.metric_req_stages[i], wsgi_req, wsgi_req->timing[i]);
+	}
+}
+
 void uwsgi_close_request(struct wsgi_request *wsgi_req) {
 
 	int waitpid_status;
 	int tmp_id;
 	uint64_t tmp_rt, rss = 0, vsz = 0;
 
+	uwsgi_req_timing(wsgi_req, UWSGI_REQ_STAGE_APP);
+
 	// apply transformations
 	if (wsgi_req->transformations) {
 		if (uwsgi_apply_final_transformations(wsgi_req) == 0) {
@@ -1069,16 +1190,28 @@ void uwsgi_close_request(struct wsgi_request *wsgi_req) {
 		if (!wsgi_req->headers_sent && !wsgi_req->headers_size && !wsgi_req->response_size) {
 			uwsgi_response_write_headers_do(wsgi_req);
 		}
-		uwsgi_buffer_destroy(wsgi_req->headers);
+		uwsgi_buffer_put(wsgi_req->headers);
 	}
 
 	uint64_t end_of_request = uwsgi_micros();
 	wsgi_req->end_of_request = end_of_request;
 
+	if (uwsgi.req_timing) uwsgi_req_timing_end(wsgi_req);
+
+	// worker, core, status, latency (usecs), response size, uri, uri length
+	uwsgi_probe7(request_end, uwsgi.mywid, wsgi_req->async_id, wsgi_req->status, end_of_request - wsgi_req->start_of_request, wsgi_req->response_size, wsgi_req->uri, wsgi_req->uri_len);
+
+	struct uwsgi_core *uc = &uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id];
+
 	if (!wsgi_req->do_not_account_avg_rt) {
 		tmp_rt = wsgi_req->end_of_request - wsgi_req->start_of_request;
-		uwsgi.workers[uwsgi.mywid].running_time += tmp_rt;
-		uwsgi.workers[uwsgi.mywid].avg_response_time = (uwsgi.workers[uwsgi.mywid].avg_response_time + tmp_rt) / 2;
+		uc->running_time += tmp_rt;
+		uc->avg_response_time = (uc->avg_response_time + tmp_rt) / 2;
+		if (uwsgi.metric_request_latency) uwsgi_metric_histogram_add(uwsgi.metric_request_latency, wsgi_req, tmp_rt);
+		if (!uwsgi.lazy_worker_stats) {
+			uwsgi.workers[uwsgi.mywid].running_time += tmp_rt;
+			uwsgi.workers[uwsgi.mywid].avg_response_time = (uwsgi.workers[uwsgi.mywid].avg_response_time + tmp_rt) / 2;
+		}
 	}
 
 	// get memory usage
@@ -1089,13 +1222,16 @@ void uwsgi_close_request(struct wsgi_request *wsgi_req) {
 	}
 
 	if (!wsgi_req->do_not_account) {
-		uwsgi.workers[0].requests++;
-		uwsgi.workers[uwsgi.mywid].requests++;
-		uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].requests++;
-		uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].write_errors += wsgi_req->write_errors;
-		uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].read_errors += wsgi_req->read_errors;
-		// this is used for MAX_REQUESTS
-		uwsgi.workers[uwsgi.mywid].delta_requests++;
+		uc->requests++;
+		uc->write_errors += wsgi_req->write_errors;
+		uc->read_errors += wsgi_req->read_errors;
+		uc->delta_requests++;
+		if (!uwsgi.lazy_worker_stats) {
+			uwsgi.workers[0].requests++;
+			uwsgi.workers[uwsgi.mywid].requests++;
+			// this is used for MAX_REQUESTS
+			uwsgi.workers[uwsgi.mywid].delta_requests++;
+		}
 	}
 
 #ifdef UWSGI_ROUTING
@@ -1133,12 +1269,16 @@ void uwsgi_close_request(struct wsgi_request *wsgi_req) {
 	}
 
 	if (!wsgi_req->do_not_account) {
-		// this is racy in multithread mode
+		uint64_t tx = 0;
 		if (wsgi_req->response_size > 0) {
-			uwsgi.workers[uwsgi.mywid].tx += wsgi_req->response_size;
+			tx += wsgi_req->response_size;
 		}
 		if (wsgi_req->headers_size > 0) {
-			uwsgi.workers[uwsgi.mywid].tx += wsgi_req->headers_size;
+			tx += wsgi_req->headers_size;
+		}
+		uc->tx += tx;
+		if (!uwsgi.lazy_worker_stats) {
+			uwsgi.workers[uwsgi.mywid].tx += tx;
 		}
 	}
 
@@ -1147,30 +1287,8 @@ void uwsgi_close_request(struct wsgi_request *wsgi_req) {
 		while (waitpid(WAIT_ANY, &waitpid_status, WNOHANG) > 0);
 	}
 
-	// free logvars
-	struct uwsgi_logvar *lv = wsgi_req->logvars;
-	while (lv) {
-		struct uwsgi_logvar *ptr = lv;
-		lv = lv->next;
-		free(ptr);
-	}
-
-	// free additional headers
-	struct uwsgi_string_list *ah = wsgi_req->additional_headers;
-	while (ah) {
-		struct uwsgi_string_list *ptr = ah;
-		ah = ah->next;
-		free(ptr->value);
-		free(ptr);
-	}
-	// free remove headers
-	ah = wsgi_req->remove_headers;
-	while (ah) {
-		struct uwsgi_string_list *ptr = ah;
-		ah = ah->next;
-		free(ptr->value);
-		free(ptr);
-	}
+	// logvars, additional and removed headers (and what plugins allocated with uwsgi_req_malloc())
+	uwsgi_req_arena_reset(wsgi_req);
 
 	// free chunked input
 	if (wsgi_req->chunked_input_buf) {
@@ -1184,6 +1302,9 @@ void uwsgi_close_request(struct wsgi_request *wsgi_req) {
 	if (wsgi_req->websocket_send_buf) {
 		uwsgi_buffer_destroy(wsgi_req->websocket_send_buf);
 	}
+#ifdef UWSGI_ZLIB
+	uwsgi_websocket_deflate_free(wsgi_req);
+#endif
 
 
 	// reset request
@@ -1195,10 +1316,10 @@ void uwsgi_close_request(struct wsgi_request *wsgi_req) {
 	// yes, this is pretty useless but we cannot ensure all of the plugin have the same behaviour
 	uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].in_request = 0;
 
-	if (uwsgi.max_requests > 0 && uwsgi.workers[uwsgi.mywid].delta_requests >= (uwsgi.max_requests + ((uwsgi.mywid-1) * uwsgi.max_requests_delta))
+	if (uwsgi.max_requests > 0 && uwsgi_worker_delta_requests(uwsgi.mywid) >= (uwsgi.max_requests + ((uwsgi.mywid-1) * uwsgi.max_requests_delta))
 	    && (end_of_request - (uwsgi.workers[uwsgi.mywid].last_spawn * 1000000) >= uwsgi.min_worker_lifetime * 1000000)) {
 		goodbye_cruel_world("max requests reached (%llu >= %llu)",
-			(unsigned long long) uwsgi.workers[uwsgi.mywid].delta_requests,
+			(unsigned long long) uwsgi_worker_delta_requests(uwsgi.mywid),
 			(unsigned long long) (uwsgi.max_requests + ((uwsgi.mywid-1) * uwsgi.max_requests_delta))
 		);
 	}
@@ -1217,6 +1338,8 @@ void uwsgi_close_request(struct wsgi_request *wsgi_req) {
 		);
 	}
 
+	uwsgi_worker_check_memory_pressure();
+
 
 	// after the first request, if i am a vassal, signal Emperor about my loyalty
 	if (uwsgi.has_emperor && !uwsgi.loyal) {
@@ -1231,7 +1354,7 @@ void uwsgi_close_request(struct wsgi_request *wsgi_req) {
 #ifdef __linux__
 #ifdef MADV_MERGEABLE
 	// run the ksm mapper
-	if (uwsgi.linux_ksm > 0 && (uwsgi.workers[uwsgi.mywid].requests % uwsgi.linux_ksm) == 0) {
+	if (uwsgi.linux_ksm > 0 && ((uwsgi.lazy_worker_stats ? uc->requests : uwsgi.workers[uwsgi.mywid].requests) % uwsgi.linux_ksm) == 0) {
 		uwsgi_linux_ksm_map();
 	}
 #endif
@@ -1240,6 +1363,144 @@ void uwsgi_close_request(struct wsgi_request *wsgi_req) {
 }
 
 #ifdef __linux__
+// [heap] and private writable anonymous mappings (interpreters arenas, mmap()ed malloc chunks...)
+static int uwsgi_linux_maps_line_is_heap(char *line) {
+	char perms[5];
+	unsigned long inode = 1;
+	int n = 0;
+	if (sscanf(line, "%*x-%*x %4s %*s %*s %lu %n", perms, &inode, &n) != 2) return 0;
+	if (perms[1] != 'w' || perms[3] != 'p' || inode != 0) return 0;
+	return !line[n] || !strcmp(line + n, "[heap]") || !uwsgi_startswith(line + n, "[anon:", 6);
+}
+
+// read a whole /proc file (their size is always 0)
+struct uwsgi_buffer *uwsgi_linux_proc_read(char *file) {
+	int fd = open(file, O_RDONLY);
+	if (fd < 0) return NULL;
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(uwsgi.page_size);
+	for (;;) {
+		if (uwsgi_buffer_ensure(ub, uwsgi.page_size)) goto error;
+		ssize_t rlen = read(fd, ub->buf + ub->pos, ub->len - ub->pos);
+		if (rlen < 0) goto error;
+		if (rlen == 0) break;
+		ub->pos += rlen;
+	}
+	close(fd);
+	if (uwsgi_buffer_byte(ub, 0)) {
+		uwsgi_buffer_destroy(ub);
+		return NULL;
+	}
+	ub->pos--;
+	return ub;
+error:
+	close(fd);
+	uwsgi_buffer_destroy(ub);
+	return NULL;
+}
+
+// the heaps grown by the workers will be backed by huge pages
+void uwsgi_linux_thp_heaps() {
+#ifdef MADV_HUGEPAGE
+	unsigned long long start = 0, end = 0;
+	uint64_t advised = 0;
+	struct uwsgi_buffer *ub = uwsgi_linux_proc_read("/proc/self/maps");
+	if (!ub) {
+		uwsgi_error_open("[uwsgi-THP] /proc/self/maps");
+		return;
+	}
+	char *ctx = NULL;
+	char *line = strtok_r(ub->buf, "\n", &ctx);
+	while (line) {
+		if (uwsgi_linux_maps_line_is_heap(line) && sscanf(line, "%llx-%llx", &start, &end) == 2) {
+			// smaller areas cannot be backed by an huge page
+			if (end - start >= 2 * 1024 * 1024 && !madvise((void *) (long) start, (size_t) (end - start), MADV_HUGEPAGE)) {
+				advised += end - start;
+			}
+		}
+		line = strtok_r(NULL, "\n", &ctx);
+	}
+	uwsgi_buffer_destroy(ub);
+	uwsgi_log("[uwsgi-THP] worker %d: %llu MB of heaps advised for transparent huge pages\n", uwsgi.mywid, (unsigned long long) (advised / (1024 * 1024)));
+#else
+	uwsgi_log("[uwsgi-THP] MADV_HUGEPAGE is not supported on this system\n");
+#endif
+}
+
+/*
+	apply an advice to the heaps of another process (requires Linux >= 5.10 and CAP_SYS_NICE),
+	returns the number of advised bytes or -1 on error
+*/
+int64_t uwsgi_linux_process_madvise_heaps(pid_t pid, int advice) {
+#if defined(SYS_pidfd_open) && defined(SYS_process_madvise)
+	char file[64];
+	unsigned long long start = 0, end = 0;
+	struct iovec iov[UIO_MAXIOV];
+	int iov_cnt = 0;
+	int64_t advised = 0;
+
+	snprintf(file, sizeof(file), "/proc/%d/maps", (int) pid);
+	struct uwsgi_buffer *ub = uwsgi_linux_proc_read(file);
+	if (!ub) return -1;
+
+	int pidfd = syscall(SYS_pidfd_open, pid, 0);
+	if (pidfd < 0) {
+		uwsgi_buffer_destroy(ub);
+		return -1;
+	}
+
+	char *ctx = NULL;
+	char *line = strtok_r(ub->buf, "\n", &ctx);
+	while (line) {
+		char *next = strtok_r(NULL, "\n", &ctx);
+		if (uwsgi_linux_maps_line_is_heap(line) && sscanf(line, "%llx-%llx", &start, &end) == 2) {
+			iov[iov_cnt].iov_base = (void *) (long) start;
+			iov[iov_cnt].iov_len = end - start;
+			iov_cnt++;
+		}
+		if (iov_cnt > 0 && (iov_cnt == UIO_MAXIOV || !next)) {
+			ssize_t rlen = syscall(SYS_process_madvise, pidfd, iov, iov_cnt, advice, 0);
+			if (rlen < 0) {
+				advised = -1;
+				break;
+			}
+			advised += rlen;
+			iov_cnt = 0;
+		}
+		line = next;
+	}
+	close(pidfd);
+	uwsgi_buffer_destroy(ub);
+	return advised;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+// Shared_* and Private_* of the whole process
+int uwsgi_linux_smaps_rollup(pid_t pid, uint64_t *shared, uint64_t *private) {
+	char file[64];
+	snprintf(file, sizeof(file), "/proc/%d/smaps_rollup", (int) pid);
+	struct uwsgi_buffer *ub = uwsgi_linux_proc_read(file);
+	if (!ub) return -1;
+	*shared = 0;
+	*private = 0;
+	char *ctx = NULL;
+	char *line = strtok_r(ub->buf, "\n", &ctx);
+	while (line) {
+		unsigned long long kb = 0;
+		if (sscanf(line, "Shared_Clean: %llu", &kb) == 1 || sscanf(line, "Shared_Dirty: %llu", &kb) == 1) {
+			*shared += kb * 1024;
+		}
+		else if (sscanf(line, "Private_Clean: %llu", &kb) == 1 || sscanf(line, "Private_Dirty: %llu", &kb) == 1) {
+			*private += kb * 1024;
+		}
+		line = strtok_r(NULL, "\n", &ctx);
+	}
+	uwsgi_buffer_destroy(ub);
+	return 0;
+}
+
 #ifdef MADV_MERGEABLE
 
 void uwsgi_linux_ksm_map(void) {
@@ -1250,6 +1511,9 @@ void uwsgi_linux_ksm_map(void) {
 	int errors = 0;
 	int lines = 0;
 
+	// the kernel already merges the whole process memory
+	if (uwsgi.ksm_mode == UWSGI_KSM_PROCESS) return;
+
 	int fd = open("/proc/self/maps", O_RDONLY);
 	if (fd < 0) {
 		uwsgi_error_open("[uwsgi-KSM] /proc/self/maps");
@@ -1303,7 +1567,7 @@ void uwsgi_linux_ksm_map(void) {
 			if (uwsgi.ksm_mappings_last[i] == '\n') {
 				lines++;
 				uwsgi.ksm_mappings_last[i] = 0;
-				if (sscanf(ptr, "%llx-%llx %*s", &start, &end) == 2) {
+				if ((uwsgi.ksm_mode != UWSGI_KSM_ANON || uwsgi_linux_maps_line_is_heap(ptr)) && sscanf(ptr, "%llx-%llx %*s", &start, &end) == 2) {
 					if (madvise((void *) (long) start, (size_t) (end - start), MADV_MERGEABLE)) {
 						errors++;
 					}
@@ -1384,9 +1648,18 @@ int wsgi_req_async_recv(struct wsgi_request *wsgi_req) {
 
 	wsgi_req->start_of_request = uwsgi_micros();
 	wsgi_req->start_of_request_in_sec = wsgi_req->start_of_request / 1000000;
+	if (uwsgi.req_timing) uwsgi_req_timing_start(wsgi_req);
+	uwsgi_probe3(request_start, uwsgi.mywid, wsgi_req->async_id, wsgi_req->fd);
+
+	// handed off connections could already carry the whole request (no read event would come)
+	if (wsgi_req->proto_handoff_buf) {
+		int ret = wsgi_req->socket->proto(wsgi_req);
+		if (ret < 0) return -1;
+		if (ret == UWSGI_OK) wsgi_req->do_not_add_to_async_queue = 1;
+	}
 
 	if (!wsgi_req->do_not_add_to_async_queue) {
-		if (event_queue_add_fd_read(uwsgi.async_queue, wsgi_req->fd) < 0)
+		if (event_queue_add_fd_read(uwsgi_async_loop_get()->queue, wsgi_req->fd) < 0)
 			return -1;
 
 		async_add_timeout(wsgi_req, uwsgi.socket_timeout);
@@ -1408,6 +1681,8 @@ int wsgi_req_recv(int queue, struct wsgi_request *wsgi_req) {
 
 	wsgi_req->start_of_request = uwsgi_micros();
 	wsgi_req->start_of_request_in_sec = wsgi_req->start_of_request / 1000000;
+	if (uwsgi.req_timing) uwsgi_req_timing_start(wsgi_req);
+	uwsgi_probe3(request_start, uwsgi.mywid, wsgi_req->async_id, wsgi_req->fd);
 
 	// edge triggered sockets get the whole request during accept() phase
 	if (!wsgi_req->socket->edge_trigger) {
@@ -1431,9 +1706,12 @@ int wsgi_req_recv(int queue, struct wsgi_request *wsgi_req) {
 	}
 
 #ifdef UWSGI_ROUTING
-	if (uwsgi_apply_routes(wsgi_req) == UWSGI_ROUTE_BREAK)
+	if (uwsgi_apply_routes(wsgi_req) == UWSGI_ROUTE_BREAK) {
+		uwsgi_req_timing(wsgi_req, UWSGI_REQ_STAGE_ROUTING);
 		return 0;
+	}
 #endif
+	uwsgi_req_timing(wsgi_req, UWSGI_REQ_STAGE_ROUTING);
 
 	wsgi_req->async_status = uwsgi.p[wsgi_req->uh->modifier1]->request(wsgi_req);
 
@@ -1442,8 +1720,8 @@ int wsgi_req_recv(int queue, struct wsgi_request *wsgi_req) {
 
 void uwsgi_post_accept(struct wsgi_request *wsgi_req) {
 
-	// set close on exec (if not a new socket)
-	if (!wsgi_req->socket->edge_trigger && uwsgi.close_on_exec) {
+	// set close on exec (if not a new socket or already set by accept4())
+	if (!wsgi_req->socket->edge_trigger && uwsgi.close_on_exec && !wsgi_req->fd_cloexec) {
 		if (fcntl(wsgi_req->fd, F_SETFD, FD_CLOEXEC) < 0) {
 			uwsgi_error("fcntl()");
 		}
@@ -1464,11 +1742,25 @@ int wsgi_req_simple_accept(struct wsgi_request *wsgi_req, int fd) {
 		return -1;
 	}
 
+	if (wsgi_req->socket->shed_backlog && uwsgi_socket_shed(wsgi_req)) {
+		return -1;
+	}
+
+	uwsgi_probe3(request_accept, uwsgi.mywid, wsgi_req->async_id, wsgi_req->fd);
+
 	uwsgi_post_accept(wsgi_req);
 
 	return 0;
 }
 
+// how many connections an async loop should accept on a single wakeup
+int uwsgi_accept_batch() {
+	if (uwsgi.accept_batch > 0) return uwsgi.accept_batch;
+	// the master noticed connections waiting in a listen queue
+	if (uwsgi.shared->backlog > 0) return UWSGI_ACCEPT_BATCH;
+	return 1;
+}
+
 // send heartbeat to the emperor
 void uwsgi_heartbeat() {
 
@@ -1544,7 +1836,7 @@ int wsgi_req_accept(int queue, struct wsgi_request *wsgi_req) {
 	if (uwsgi.threads > 1)
 		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &ret);
 
-	if (uwsgi.signal_socket > -1 && (interesting_fd == uwsgi.signal_socket || interesting_fd == uwsgi.my_signal_socket)) {
+	if (uwsgi.signal_socket > -1 && (interesting_fd == uwsgi.signal_socket || interesting_fd == uwsgi.my_signal_socket || (interesting_fd > -1 && interesting_fd == uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].signal_pipe[1]))) {
 
 		thunder_unlock;
 
@@ -1556,6 +1848,11 @@ int wsgi_req_accept(int queue, struct wsgi_request *wsgi_req) {
 	}
 
 
+	// socket priorities and weights
+	if (uwsgi.sockets_qos) {
+		interesting_fd = uwsgi_socket_qos_fd(wsgi_req, interesting_fd);
+	}
+
 	while (uwsgi_sock) {
 		if (interesting_fd == uwsgi_sock->fd || (uwsgi_sock->retry && uwsgi_sock->retry[wsgi_req->async_id]) || (uwsgi_sock->fd_threads && interesting_fd == uwsgi_sock->fd_threads[wsgi_req->async_id])) {
 			wsgi_req->socket = uwsgi_sock;
@@ -1567,6 +1864,14 @@ int wsgi_req_accept(int queue, struct wsgi_request *wsgi_req) {
 				return -1;
 			}
 
+			if (uwsgi_sock->shed_backlog && uwsgi_socket_shed(wsgi_req)) {
+				if (uwsgi.threads > 1)
+					pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &ret);
+				return -1;
+			}
+
+			uwsgi_probe3(request_accept, uwsgi.mywid, wsgi_req->async_id, wsgi_req->fd);
+
 			if (!uwsgi_sock->edge_trigger) {
 				uwsgi_post_accept(wsgi_req);
 			}
@@ -1812,22 +2117,6 @@ void *uwsgi_calloc(size_t size) {
 }
 
 
-char *uwsgi_resolve_ip(char *domain) {
-
-	struct hostent *he;
-
-	he = gethostbyname(domain);
-	if (!he || !*he->h_addr_list || (he->h_addrtype != AF_INET
-#ifdef AF_INET6
-					 && he->h_addrtype != AF_INET6
-#endif
-	    )) {
-		return NULL;
-	}
-
-	return inet_ntoa(*(struct in_addr *) he->h_addr_list[0]);
-}
-
 int uwsgi_file_exists(char *filename) {
 	// TODO check for http url or stdin
 	return !access(filename, R_OK);
@@ -2222,9 +2511,163 @@ void uwsgi_dyn_dict_free(struct uwsgi_dyn_dict **dd) {
 	*dd = NULL;
 }
 
+/*
+	--shm-hugepages: the big shared memory areas (caches, sharedareas, the workers table...) are backed by huge pages.
+
+	"hugetlb" maps them with MAP_HUGETLB (it requires reserved pages, vm.nr_hugepages) falling back to "thp",
+	"thp" madvise()s them for transparent huge pages (shmem_enabled has to allow it).
+	Areas smaller than an huge page always use normal pages.
+*/
+void uwsgi_opt_set_shm_hugepages(char *opt, char *value, void *none) {
+	if (!strcmp(value, "thp")) {
+		uwsgi.shm_hugepages = UWSGI_SHM_HUGEPAGES_THP;
+	}
+	else if (!strcmp(value, "hugetlb")) {
+		uwsgi.shm_hugepages = UWSGI_SHM_HUGEPAGES_HUGETLB;
+	}
+	else if (!strcmp(value, "none")) {
+		uwsgi.shm_hugepages = 0;
+	}
+	else {
+		uwsgi_log("invalid --%s value: %s (supported: thp, hugetlb, none)\n", opt, value);
+		exit(1);
+	}
+}
+
+uint64_t uwsgi_hugepage_size() {
+	static uint64_t size = 0;
+	if (size) return size;
+	size = 2 * 1024 * 1024;
+#ifdef __linux__
+	FILE *meminfo = fopen("/proc/meminfo", "r");
+	if (meminfo) {
+		char line[128];
+		unsigned long long kb = 0;
+		while (fgets(line, sizeof(line), meminfo)) {
+			if (sscanf(line, "Hugepagesize: %llu kB", &kb) == 1) {
+				if (kb) size = kb * 1024;
+				break;
+			}
+		}
+		fclose(meminfo);
+	}
+#endif
+	return size;
+}
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+// the size of transparent huge pages for shared memory (0 if shmem_enabled does not allow them)
+static uint64_t uwsgi_thp_shmem_size() {
+	static int64_t size = -1;
+	if (size > -1) return size;
+	size = 0;
+	char buf[128];
+	int fd = open("/sys/kernel/mm/transparent_hugepage/shmem_enabled", O_RDONLY);
+	if (fd < 0) goto end;
+	ssize_t rlen = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (rlen <= 0) goto end;
+	buf[rlen] = 0;
+	// the current value is in brackets
+	char *selected = strchr(buf, '[');
+	if (!selected || !strncmp(selected, "[never]", 7) || !strncmp(selected, "[deny]", 6)) goto end;
+	size = uwsgi_hugepage_size();
+	fd = open("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", O_RDONLY);
+	if (fd >= 0) {
+		rlen = read(fd, buf, sizeof(buf) - 1);
+		close(fd);
+		if (rlen > 0) {
+			buf[rlen] = 0;
+			uint64_t pmd_size = strtoull(buf, NULL, 10);
+			if (pmd_size) size = pmd_size;
+		}
+	}
+end:
+	if (!size) {
+		uwsgi_log("[uwsgi-hugepages] transparent huge pages are not enabled for shared memory (/sys/kernel/mm/transparent_hugepage/shmem_enabled)\n");
+	}
+	return size;
+}
+#endif
+
+/*
+	map an anonymous shared area (honouring --shm-hugepages), returns MAP_FAILED on error.
+	page_size (if not NULL) is filled with the page size actually used
+*/
+void *uwsgi_mmap_shared(size_t size, uint64_t *page_size) {
+	void *addr = MAP_FAILED;
+	if (page_size) *page_size = uwsgi.page_size;
+
+#ifdef __linux__
+	uint64_t hsize = uwsgi_hugepage_size();
+	if (uwsgi.shm_hugepages && size >= hsize) {
+#ifdef MAP_HUGETLB
+		if (uwsgi.shm_hugepages == UWSGI_SHM_HUGEPAGES_HUGETLB) {
+			size_t hlen = ((size + hsize - 1) / hsize) * hsize;
+			addr = mmap(NULL, hlen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON | MAP_HUGETLB, -1, 0);
+			if (addr != MAP_FAILED) {
+				if (page_size) *page_size = hsize;
+				goto done;
+			}
+			uwsgi_log("[uwsgi-hugepages] unable to map %llu bytes with MAP_HUGETLB (%s), falling back to transparent huge pages\n", (unsigned long long) hlen, strerror(errno));
+		}
+#endif
+		addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+		if (addr == MAP_FAILED) return addr;
+#ifdef MADV_HUGEPAGE
+		uint64_t thp_size = uwsgi_thp_shmem_size();
+		if (thp_size && !madvise(addr, size, MADV_HUGEPAGE)) {
+			if (page_size) *page_size = thp_size;
+		}
+#endif
+		goto done;
+	}
+#endif
+
+	addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+	if (addr == MAP_FAILED) return addr;
+#ifdef __linux__
+done:
+#endif
+	uwsgi_numa_mbind(addr, size);
+	return addr;
+}
+
+// files on hugetlbfs are always mapped with huge pages (the block size of the filesystem)
+uint64_t uwsgi_fd_page_size(int fd) {
+#ifdef __linux__
+	struct statfs sfs;
+	if (!fstatfs(fd, &sfs) && (uint32_t) sfs.f_type == UWSGI_HUGETLBFS_MAGIC) return sfs.f_bsize;
+#endif
+	return uwsgi.page_size;
+}
+
+// as above, for files that could not exist yet (their directory is checked)
+uint64_t uwsgi_path_page_size(char *path) {
+#ifdef __linux__
+	struct statfs sfs;
+	int ret = statfs(path, &sfs);
+	if (ret && errno == ENOENT) {
+		char *dir = uwsgi_str(path);
+		char *slash = strrchr(dir, '/');
+		if (slash) {
+			if (slash == dir) slash++;
+			*slash = 0;
+			ret = statfs(dir, &sfs);
+		}
+		else {
+			ret = statfs(".", &sfs);
+		}
+		free(dir);
+	}
+	if (!ret && (uint32_t) sfs.f_type == UWSGI_HUGETLBFS_MAGIC) return sfs.f_bsize;
+#endif
+	return uwsgi.page_size;
+}
+
 void *uwsgi_malloc_shared(size_t size) {
 
-	void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+	void *addr = uwsgi_mmap_shared(size, NULL);
 
 	if (addr == MAP_FAILED) {
 		uwsgi_log("unable to allocate %llu bytes (%lluMB)\n", (unsigned long long) size, (unsigned long long) (size / (1024 * 1024)));
@@ -3123,7 +3566,12 @@ pid_t uwsgi_fork(char *name) {
 
 
 	pid_t pid = fork();
-	if (pid == 0) {
+	if (pid > 0) {
+		uwsgi_master_watch_pid(pid);
+	}
+	else if (pid == 0) {
+
+		uwsgi_master_watch_pids_close();
 
 #ifndef __CYGWIN__
 		if (uwsgi.never_swap) {
@@ -3386,17 +3834,59 @@ void http_url_decode(char *buf, uint16_t * len, char *dst) {
 
 
 /*
-	we scan the table in reverse, as updated values are at the end
+	small requests are scanned in reverse, as updated values are at the end.
+
+	bigger ones use a per-core open addressing index, updated lazily
+	with the vars appended (by the parsers, routers...) since the last lookup.
+	Later vars replace the slot of the earlier ones, so the last value still wins.
 */
+#define UWSGI_VARS_INDEX_MIN 16
+
+static void uwsgi_vars_index_update(struct wsgi_request *wsgi_req, uint16_t *slots) {
+	uint16_t i;
+	if (wsgi_req->vars_indexed > wsgi_req->var_cnt) wsgi_req->vars_indexed = 0;
+	if (wsgi_req->vars_indexed == 0) {
+		memset(slots, 0, sizeof(uint16_t) * (uwsgi.vars_index_mask + 1));
+	}
+	for (i = wsgi_req->vars_indexed; i + 1 < wsgi_req->var_cnt; i += 2) {
+		uint32_t h = djb33x_hash(wsgi_req->hvec[i].iov_base, wsgi_req->hvec[i].iov_len) & uwsgi.vars_index_mask;
+		while (slots[h]) {
+			struct iovec *iov = &wsgi_req->hvec[slots[h] - 1];
+			if (!uwsgi_strncmp(wsgi_req->hvec[i].iov_base, wsgi_req->hvec[i].iov_len, iov->iov_base, iov->iov_len)) break;
+			h = (h + 1) & uwsgi.vars_index_mask;
+		}
+		slots[h] = i + 1;
+	}
+	wsgi_req->vars_indexed = i;
+}
+
 char *uwsgi_get_var(struct wsgi_request *wsgi_req, char *key, uint16_t keylen, uint16_t * len) {
 
 	int i;
 
-	for (i = wsgi_req->var_cnt - 1; i > 0; i -= 2) {
-		if (!uwsgi_strncmp(key, keylen, wsgi_req->hvec[i - 1].iov_base, wsgi_req->hvec[i - 1].iov_len)) {
-			*len = wsgi_req->hvec[i].iov_len;
-			return wsgi_req->hvec[i].iov_base;
+	if (wsgi_req->var_cnt < UWSGI_VARS_INDEX_MIN || !uwsgi.vars_index || wsgi_req->async_id >= uwsgi.cores) {
+		for (i = wsgi_req->var_cnt - 1; i > 0; i -= 2) {
+			if (!uwsgi_strncmp(key, keylen, wsgi_req->hvec[i - 1].iov_base, wsgi_req->hvec[i - 1].iov_len)) {
+				*len = wsgi_req->hvec[i].iov_len;
+				return wsgi_req->hvec[i].iov_base;
+			}
 		}
+		return NULL;
+	}
+
+	uint16_t *slots = uwsgi.vars_index + ((uwsgi.vars_index_mask + 1) * wsgi_req->async_id);
+	if (wsgi_req->vars_indexed + 1 < wsgi_req->var_cnt || wsgi_req->vars_indexed > wsgi_req->var_cnt) {
+		uwsgi_vars_index_update(wsgi_req, slots);
+	}
+
+	uint32_t h = djb33x_hash(key, keylen) & uwsgi.vars_index_mask;
+	while (slots[h]) {
+		struct iovec *iov = &wsgi_req->hvec[slots[h] - 1];
+		if (!uwsgi_strncmp(key, keylen, iov->iov_base, iov->iov_len)) {
+			*len = iov[1].iov_len;
+			return iov[1].iov_base;
+		}
+		h = (h + 1) & uwsgi.vars_index_mask;
 	}
 
 	return NULL;
@@ -3419,9 +3909,9 @@ struct uwsgi_app *uwsgi_add_app(int id, uint8_t modifier1, char *mountpoint, int
 	wi->callable = callable;
 
 	uwsgi_apps_cnt++;
-	// check if we need to emulate fork() COW
+	// check if we need to emulate fork() COW (the workers forked by the zygote copy the apps by themselves)
 	int i;
-	if (uwsgi.mywid == 0) {
+	if (uwsgi.mywid == 0 && !uwsgi.i_am_a_zygote) {
 		for (i = 1; i <= uwsgi.numproc; i++) {
 			memcpy(&uwsgi.workers[i].apps[id], &uwsgi.workers[0].apps[id], sizeof(struct uwsgi_app));
 			uwsgi.workers[i].apps_cnt = uwsgi_apps_cnt;
@@ -3447,6 +3937,11 @@ char *uwsgi_check_touches(struct uwsgi_string_list *touch_list) {
 	struct uwsgi_string_list *touch = touch_list;
 	while (touch) {
 		struct stat tr_st;
+		// monitored files are checked only after an event
+		if (uwsgi_fsmon_touch_skip(touch)) {
+			touch = touch->next;
+			continue;
+		}
 		if (stat(touch->value, &tr_st)) {
 			if (touch->custom && !touch->custom2) {
 #ifdef UWSGI_DEBUG
@@ -3522,8 +4017,15 @@ char *uwsgi_chomp2(char *str) {
 
 
 int uwsgi_tmpfd() {
+	return uwsgi_tmpfd_in(NULL);
+}
+
+// an unlinked file in the specified directory (TMPDIR by default)
+int uwsgi_tmpfd_in(char *tmpdir) {
 	int fd = -1;
-	char *tmpdir = getenv("TMPDIR");
+	if (!tmpdir) {
+		tmpdir = getenv("TMPDIR");
+	}
 	if (!tmpdir) {
 		tmpdir = "/tmp";
 	}
@@ -3579,7 +4081,7 @@ void uwsgi_setup_post_buffering() {
 void uwsgi_emulate_cow_for_apps(int id) {
 	int i;
 	// check if we need to emulate fork() COW
-	if (uwsgi.mywid == 0) {
+	if (uwsgi.mywid == 0 && !uwsgi.i_am_a_zygote) {
 		for (i = 1; i <= uwsgi.numproc; i++) {
 			memcpy(&uwsgi.workers[i].apps[id], &uwsgi.workers[0].apps[id], sizeof(struct uwsgi_app));
 			uwsgi.workers[i].apps_cnt = uwsgi_apps_cnt;
@@ -3927,6 +4429,14 @@ int uwsgi_kvlist_parse(char *src, size_t len, char list_separator, char kv_separ
 }
 
 int uwsgi_send_http_stats(int fd) {
+	return uwsgi_send_http_stats2(fd, NULL);
+}
+
+/*
+	if openmetrics is not NULL, it is set when the request targets /metrics
+	(or when --stats-openmetrics is enabled) and the matching content type is sent
+*/
+int uwsgi_send_http_stats2(int fd, int *openmetrics) {
 
 	char buf[4096];
 
@@ -3934,9 +4444,18 @@ int uwsgi_send_http_stats(int fd) {
 	if (ret <= 0)
 		return -1;
 
-	if (read(fd, buf, 4096) <= 0)
+	ssize_t rlen = read(fd, buf, 4096);
+	if (rlen <= 0)
 		return -1;
 
+	if (openmetrics) {
+		*openmetrics = uwsgi.stats_openmetrics;
+		char *path = memchr(buf, ' ', rlen);
+		if (path && !uwsgi_starts_with(path + 1, rlen - ((path + 1) - buf), "/metrics", 8)) {
+			*openmetrics = 1;
+		}
+	}
+
 	struct uwsgi_buffer *ub = uwsgi_buffer_new(uwsgi.page_size);
 	if (!ub)
 		return -1;
@@ -3947,7 +4466,11 @@ int uwsgi_send_http_stats(int fd) {
 		goto error;
 	if (uwsgi_buffer_append(ub, "Access-Control-Allow-Origin: *\r\n", 32))
 		goto error;
-	if (uwsgi_buffer_append(ub, "Content-Type: application/json\r\n", 32))
+	if (openmetrics && *openmetrics) {
+		if (uwsgi_buffer_append(ub, "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n", 74))
+			goto error;
+	}
+	else if (uwsgi_buffer_append(ub, "Content-Type: application/json\r\n", 32))
 		goto error;
 	if (uwsgi_buffer_append(ub, "\r\n", 2))
 		goto error;
@@ -4049,15 +4572,66 @@ int uwsgi_uuid_cmp(char *x, char *y) {
 	return 0;
 }
 
+/*
+	request arena: a bump allocator (one for each core) whose memory is released
+	in one shot at the end of the request (there is no free)
+*/
+void *uwsgi_req_malloc(struct wsgi_request *wsgi_req, size_t size) {
+	struct uwsgi_req_arena *ura = &uwsgi.req_arenas[wsgi_req->async_id];
+	size = (size + 15) & ~((size_t) 15);
+
+	if (!ura->buf) {
+		ura->size = uwsgi.req_arena_size;
+		ura->buf = uwsgi_malloc(ura->size);
+	}
+
+	if (ura->size - ura->pos >= size) {
+		void *ptr = ura->buf + ura->pos;
+		ura->pos += size;
+		return ptr;
+	}
+
+	// does not fit, use a dedicated area (the header keeps the 16 bytes alignment)
+	void **large = uwsgi_malloc((sizeof(void *) * 2) + size);
+	large[0] = ura->large;
+	ura->large = large;
+	return large + 2;
+}
+
+char *uwsgi_req_strndup(struct wsgi_request *wsgi_req, char *str, size_t len) {
+	char *ptr = uwsgi_req_malloc(wsgi_req, len + 1);
+	memcpy(ptr, str, len);
+	ptr[len] = 0;
+	return ptr;
+}
+
+void uwsgi_req_arena_reset(struct wsgi_request *wsgi_req) {
+	if (!uwsgi.req_arenas) return;
+	struct uwsgi_req_arena *ura = &uwsgi.req_arenas[wsgi_req->async_id];
+	ura->pos = 0;
+	while(ura->large) {
+		void **large = ura->large;
+		ura->large = large[0];
+		free(large);
+	}
+}
+
+static void uwsgi_req_string_list_add(struct wsgi_request *wsgi_req, struct uwsgi_string_list **list, char *value, size_t len) {
+	struct uwsgi_string_list *usl = uwsgi_req_malloc(wsgi_req, sizeof(struct uwsgi_string_list));
+	memset(usl, 0, sizeof(struct uwsgi_string_list));
+	usl->value = uwsgi_req_strndup(wsgi_req, value, len);
+	usl->len = len;
+	while(*list) list = &(*list)->next;
+	*list = usl;
+}
+
+// the headers live in the request arena
 void uwsgi_additional_header_add(struct wsgi_request *wsgi_req, char *hh, uint16_t hh_len) {
-	// will be freed on request's end
-	char *header = uwsgi_concat2n(hh, hh_len, "", 0);
-	uwsgi_string_new_list(&wsgi_req->additional_headers, header);
+	uwsgi_req_string_list_add(wsgi_req, &wsgi_req->additional_headers, hh, hh_len);
 }
 
 void uwsgi_remove_header(struct wsgi_request *wsgi_req, char *hh, uint16_t hh_len) {
-	char *header = uwsgi_concat2n(hh, hh_len, "", 0);
-	uwsgi_string_new_list(&wsgi_req->remove_headers, header);
+	uwsgi_req_string_list_add(wsgi_req, &wsgi_req->remove_headers, hh, hh_len);
 }
 
 // based on nginx implementation
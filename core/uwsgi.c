@@ -49,6 +49,9 @@ static struct uwsgi_option uwsgi_base_options[] = {
 
 	{"http11-socket", required_argument, 0, "bind to the specified UNIX/TCP socket using HTTP 1.1 (Keep-Alive) protocol", uwsgi_opt_add_socket, "http11", 0},
 
+	{"uwsgi-handoff-socket", required_argument, 0, "bind to the specified UNIX socket receiving uwsgi connections passed by the fastrouter (--fastrouter-handoff)", uwsgi_opt_add_socket, "uwsgi-handoff", 0},
+	{"http-handoff-socket", required_argument, 0, "bind to the specified UNIX socket receiving HTTP connections passed by the http router (--http-handoff)", uwsgi_opt_add_socket, "http-handoff", 0},
+
 #ifdef UWSGI_SSL
 	{"https-socket", required_argument, 0, "bind to the specified UNIX/TCP socket using HTTPS protocol", uwsgi_opt_add_ssl_socket, "https", 0},
 	{"https-socket-modifier1", required_argument, 0, "force the specified modifier1 when using HTTPS protocol", uwsgi_opt_set_64bit, &uwsgi.https_modifier1, 0},
@@ -79,6 +82,7 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"workers", required_argument, 'p', "spawn the specified number of workers/processes", uwsgi_opt_set_int, &uwsgi.numproc, 0},
 	{"thunder-lock", no_argument, 0, "serialize accept() usage (if possible)", uwsgi_opt_true, &uwsgi.use_thunder_lock, 0},
 	{"harakiri", required_argument, 't', "set harakiri timeout", uwsgi_opt_set_int, &uwsgi.harakiri_options.workers, 0},
+	{"harakiri-ms", required_argument, 0, "set harakiri timeout in milliseconds", uwsgi_opt_set_int, &uwsgi.harakiri_options.workers_ms, 0},
 	{"harakiri-verbose", no_argument, 0, "enable verbose mode for harakiri", uwsgi_opt_true, &uwsgi.harakiri_verbose, 0},
 	{"harakiri-no-arh", no_argument, 0, "do not enable harakiri during after-request-hook", uwsgi_opt_true, &uwsgi.harakiri_no_arh, 0},
 	{"no-harakiri-arh", no_argument, 0, "do not enable harakiri during after-request-hook", uwsgi_opt_true, &uwsgi.harakiri_no_arh, 0},
@@ -175,6 +179,7 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"max-vars", required_argument, 'v', "set the amount of internal iovec/vars structures", uwsgi_opt_max_vars, NULL, 0},
 	{"max-apps", required_argument, 0, "set the maximum number of per-worker applications", uwsgi_opt_set_int, &uwsgi.max_apps, 0},
 	{"buffer-size", required_argument, 'b', "set internal buffer size", uwsgi_opt_set_64bit, &uwsgi.buffer_size, 0},
+	{"req-arena-size", required_argument, 0, "set the size of the per-core request arena (default 16k)", uwsgi_opt_set_64bit, &uwsgi.req_arena_size, 0},
 	{"memory-report", no_argument, 'm', "enable memory report", uwsgi_opt_true, &uwsgi.logging_options.memory_report, 0},
 	{"profiler", required_argument, 0, "enable the specified profiler", uwsgi_opt_set_str, &uwsgi.profiler, 0},
 	{"cgi-mode", no_argument, 'c', "force CGI-mode for plugins supporting it", uwsgi_opt_true, &uwsgi.cgi_mode, 0},
@@ -187,6 +192,7 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"freebind", no_argument, 0, "put socket in freebind mode", uwsgi_opt_true, &uwsgi.freebind, 0},
 #endif
 	{"map-socket", required_argument, 0, "map sockets to specific workers", uwsgi_opt_add_string_list, &uwsgi.map_socket, 0},
+	{"socket-qos", required_argument, 0, "set priority, weight, reserved workers and load shedding of a socket (keyval: socket=<num|name>,priority=,weight=,reserved=,shed=)", uwsgi_opt_add_string_list, &uwsgi.socket_qos, 0},
 	{"enable-threads", no_argument, 'T', "enable threads", uwsgi_opt_true, &uwsgi.has_threads, 0},
 	{"no-threads-wait", no_argument, 0, "do not wait for threads cancellation on quit/reload", uwsgi_opt_true, &uwsgi.no_threads_wait, 0},
 
@@ -209,7 +215,11 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"emperor-nofollow", no_argument, 0, "do not follow symlinks when checking for mtime", uwsgi_opt_true, &uwsgi.emperor_nofollow, 0},
 	{"emperor-procname", required_argument, 0, "set the Emperor process name", uwsgi_opt_set_str, &uwsgi.emperor_procname, 0},
 	{"emperor-freq", required_argument, 0, "set the Emperor scan frequency (default 3 seconds)", uwsgi_opt_set_int, &uwsgi.emperor_freq, 0},
+	{"emperor-fsmon", no_argument, 0, "monitor dir:// and glob:// vassals with filesystem events (inotify/kqueue) instead of rescanning them every cycle", uwsgi_opt_true, &uwsgi.emperor_fsmon, 0},
+	{"emperor-fsmon-rescan", required_argument, 0, "set the frequency of the full rescans done as a safety net by --emperor-fsmon (default 60 seconds)", uwsgi_opt_set_int, &uwsgi.emperor_fsmon_rescan, 0},
 	{"emperor-required-heartbeat", required_argument, 0, "set the Emperor tolerance about heartbeats", uwsgi_opt_set_int, &uwsgi.emperor_heartbeat, 0},
+	{"emperor-on-demand-idle", required_argument, 0, "bring back on-demand vassals to on-demand mode after the specified seconds of inactivity (vassals report activity via their master)", uwsgi_opt_set_int, &uwsgi.emperor_on_demand_idle, 0},
+	{"emperor-on-demand-prewarm", required_argument, 0, "pre-spawn on-demand vassals whose history shows at least the specified active minutes (halved every day) for the upcoming hour", uwsgi_opt_set_int, &uwsgi.emperor_on_demand_prewarm, 0},
 	{"emperor-curse-tolerance", required_argument, 0, "set the Emperor tolerance about cursed vassals", uwsgi_opt_set_int, &uwsgi.emperor_curse_tolerance, 0},
 	{"emperor-pidfile", required_argument, 0, "write the Emperor pid in the specified file", uwsgi_opt_set_str, &uwsgi.emperor_pidfile, 0},
 	{"emperor-tyrant", no_argument, 0, "put the Emperor in Tyrant mode", uwsgi_opt_true, &uwsgi.emperor_tyrant, 0},
@@ -244,6 +254,12 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"emperor-collect-attribute", required_argument, 0, "collect the specified vassal attribute from imperial monitors", uwsgi_opt_add_string_list, &uwsgi.emperor_collect_attributes, 0},
 	{"emperor-collect-attr", required_argument, 0, "collect the specified vassal attribute from imperial monitors", uwsgi_opt_add_string_list, &uwsgi.emperor_collect_attributes, 0},
 	{"emperor-fork-server-attr", required_argument, 0, "set teh vassal's attribute to get when checking for fork-server", uwsgi_opt_set_str, &uwsgi.emperor_fork_server_attr, 0},
+	{"emperor-fork-template", required_argument, 0, "spawn a pre-initialized fork-server template (syntax: <name>=<config>) managed by the Emperor", uwsgi_opt_add_string_list, &uwsgi.emperor_fork_templates, 0},
+	{"emperor-use-fork-template", required_argument, 0, "fork new vassals from the specified template", uwsgi_opt_set_str, &uwsgi.emperor_use_fork_template, 0},
+	{"emperor-fork-template-attr", required_argument, 0, "set the vassal's attribute to get when choosing the fork-server template", uwsgi_opt_set_str, &uwsgi.emperor_fork_template_attr, 0},
+	{"emperor-spawn-concurrency", required_argument, 0, "limit the number of vassals being spawned at the same time (default unlimited)", uwsgi_opt_set_int, &uwsgi.emperor_spawn_concurrency, 0},
+	{"emperor-spawn-timeout", required_argument, 0, "release the spawn slot of a vassal not ready after the specified seconds (default 30)", uwsgi_opt_set_int, &uwsgi.emperor_spawn_timeout, 0},
+	{"emperor-spawn-priority-attr", required_argument, 0, "set the vassal's attribute to get for the spawn priority (higher first)", uwsgi_opt_set_str, &uwsgi.emperor_spawn_priority_attr, 0},
 	{"emperor-wrapper-attr", required_argument, 0, "set the vassal's attribute to get when checking for fork-wrapper", uwsgi_opt_set_str, &uwsgi.emperor_wrapper_attr, 0},
 	{"emperor-chdir-attr", required_argument, 0, "set the vassal's attribute to get when checking for chdir", uwsgi_opt_set_str, &uwsgi.emperor_chdir_attr, 0},
 	{"imperial-monitor-list", no_argument, 0, "list enabled imperial monitors", uwsgi_opt_true, &uwsgi.imperial_monitor_list, 0},
@@ -260,6 +276,7 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"vassal-set", required_argument, 0, "automatically set the specified option (via --set) for every vassal", uwsgi_opt_add_string_list, &uwsgi.vassals_set, 0},
 
 	{"heartbeat", required_argument, 0, "announce healthiness to the emperor", uwsgi_opt_set_int, &uwsgi.heartbeat, 0},
+	{"emperor-activity-report", required_argument, 0, "notify the emperor about request activity every N seconds (set automatically for on-demand vassals)", uwsgi_opt_set_int, &uwsgi.emperor_activity_report, UWSGI_OPT_MASTER},
 
 	{"zeus", required_argument, 0, "enable Zeus mode", uwsgi_opt_set_str, &uwsgi.zeus, 0},
 
@@ -284,9 +301,12 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"socket-timeout", required_argument, 'z', "set internal sockets timeout", uwsgi_opt_set_int, &uwsgi.socket_timeout, 0},
 	{"no-fd-passing", no_argument, 0, "disable file descriptor passing", uwsgi_opt_true, &uwsgi.no_fd_passing, 0},
 	{"locks", required_argument, 0, "create the specified number of shared locks", uwsgi_opt_set_int, &uwsgi.locks, 0},
-	{"lock-engine", required_argument, 0, "set the lock engine", uwsgi_opt_set_str, &uwsgi.lock_engine, 0},
+	{"lock-engine", required_argument, 0, "set the lock engine (ipcsem, futex on Linux)", uwsgi_opt_set_str, &uwsgi.lock_engine, 0},
 	{"ftok", required_argument, 0, "set the ipcsem key via ftok() for avoiding duplicates", uwsgi_opt_set_str, &uwsgi.ftok, 0},
 	{"persistent-ipcsem", no_argument, 0, "do not remove ipcsem's on shutdown", uwsgi_opt_true, &uwsgi.persistent_ipcsem, 0},
+	{"dns-cache-ttl", required_argument, 0, "cache the resolved hostnames in shared memory for the specified seconds (refreshed in background)", uwsgi_opt_set_int, &uwsgi.dns_cache_ttl, 0},
+	{"dns-cache-size", required_argument, 0, "set the max number of hostnames in the dns cache (default 64)", uwsgi_opt_set_int, &uwsgi.dns_cache_size, 0},
+	{"ratelimit", required_argument, 0, "create a shared rate limiter (keyval: name, rate, period, burst, items)", uwsgi_opt_add_string_list, &uwsgi.ratelimits_list, 0},
 	{"sharedarea", required_argument, 'A', "create a raw shared memory area of specified pages (note: it supports keyval too)", uwsgi_opt_add_string_list, &uwsgi.sharedareas_list, 0},
 
 	{"safe-fd", required_argument, 0, "do not close the specified file descriptor", uwsgi_opt_safe_fd, NULL, 0},
@@ -298,6 +318,8 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"cache-store-sync", required_argument, 0, "set frequency of sync for persistent cache", uwsgi_opt_set_int, &uwsgi.cache_store_sync, 0},
 	{"cache-no-expire", no_argument, 0, "disable auto sweep of expired items", uwsgi_opt_true, &uwsgi.cache_no_expire, 0},
 	{"cache-expire-freq", required_argument, 0, "set the frequency of cache sweeper scans (default 3 seconds)", uwsgi_opt_set_int, &uwsgi.cache_expire_freq, 0},
+	{"cache-remote-l1", required_argument, 0, "keep up to the specified number of items got from remote caches in a per-thread near cache", uwsgi_opt_set_64bit, &uwsgi.cache_remote_l1, 0},
+	{"cache-remote-l1-ttl", required_argument, 0, "set the lifetime of the items in the remote near cache (default 1 second)", uwsgi_opt_set_int, &uwsgi.cache_remote_l1_ttl, 0},
 	{"cache-report-freed-items", no_argument, 0, "constantly report the cache item freed by the sweeper (use only for debug)", uwsgi_opt_true, &uwsgi.cache_report_freed_items, 0},
 	{"cache-udp-server", required_argument, 0, "bind the cache udp server (used only for set/update/delete) to the specified socket", uwsgi_opt_add_string_list, &uwsgi.cache_udp_server, UWSGI_OPT_MASTER},
 	{"cache-udp-node", required_argument, 0, "send cache update/deletion to the specified cache udp server", uwsgi_opt_add_string_list, &uwsgi.cache_udp_node, UWSGI_OPT_MASTER},
@@ -314,7 +336,9 @@ static struct uwsgi_option uwsgi_base_options[] = {
 
 
 	{"queue", required_argument, 0, "enable shared queue", uwsgi_opt_set_int, &uwsgi.queue_size, 0},
-	{"queue-blocksize", required_argument, 0, "set queue blocksize", uwsgi_opt_set_int, &uwsgi.queue_store_sync, 0},
+	{"queue-blocksize", required_argument, 0, "set queue blocksize", uwsgi_opt_set_64bit, &uwsgi.queue_blocksize, 0},
+	{"queue-ring", required_argument, 0, "enable the lock-free shared message ring with the specified number of cells (power of 2), queue_push/queue_pull will use it", uwsgi_opt_set_64bit, &uwsgi.queue_ring, 0},
+	{"queue-ring-cellsize", required_argument, 0, "set the size of the message ring cells, bigger messages span multiple cells (default 256)", uwsgi_opt_set_64bit, &uwsgi.queue_ring_cellsize, 0},
 	{"queue-store", required_argument, 0, "enable persistent queue to disk", uwsgi_opt_set_str, &uwsgi.queue_store, UWSGI_OPT_MASTER},
 	{"queue-store-sync", required_argument, 0, "set frequency of sync for persistent queue", uwsgi_opt_set_int, &uwsgi.queue_store_sync, 0},
 
@@ -329,14 +353,25 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"spooler-frequency", required_argument, 0, "set spooler frequency", uwsgi_opt_set_int, &uwsgi.spooler_frequency, 0},
 	{"spooler-freq", required_argument, 0, "set spooler frequency", uwsgi_opt_set_int, &uwsgi.spooler_frequency, 0},
 	{"spooler-cheap", no_argument, 0, "set spooler cheap mode", uwsgi_opt_true, &uwsgi.spooler_cheap, 0},
+	{"spooler-engine", required_argument, 0, "set the spooler engine (dir, inotify, shm, journal)", uwsgi_opt_set_str, &uwsgi.spooler_engine, 0},
+	{"spooler-shm-tasks", required_argument, 0, "set the number of tasks the shm spooler engine can hold (default 1024)", uwsgi_opt_set_64bit, &uwsgi.spooler_shm_tasks, 0},
+	{"spooler-priority-limit", required_argument, 0, "limit the number of spooler processes running tasks of the specified priority (<priority>=<n>, shm engine)", uwsgi_opt_add_string_list, &uwsgi.spooler_priority_limits, 0},
+	{"spooler-shm-task-size", required_argument, 0, "set the max size of a shm spooler task, bigger ones are stored in spool files (default 4096)", uwsgi_opt_set_64bit, &uwsgi.spooler_shm_task_size, 0},
+	{"spooler-segment-size", required_argument, 0, "set the size of the journal spooler engine segments (default 4M)", uwsgi_opt_set_64bit, &uwsgi.spooler_segment_size, 0},
+	{"spooler-commit-interval", required_argument, 0, "group the journal spooler engine writes for the specified number of microseconds before fsync() (default 1000)", uwsgi_opt_set_int, &uwsgi.spooler_commit_interval, 0},
 
 	{"mule", optional_argument, 0, "add a mule", uwsgi_opt_add_mule, NULL, UWSGI_OPT_MASTER},
 	{"mules", required_argument, 0, "add the specified number of mules", uwsgi_opt_add_mules, NULL, UWSGI_OPT_MASTER},
 	{"farm", required_argument, 0, "add a mule farm", uwsgi_opt_add_farm, NULL, UWSGI_OPT_MASTER},
 	{"mule-msg-size", optional_argument, 0, "set mule message buffer size", uwsgi_opt_set_int, &uwsgi.mule_msg_size, UWSGI_OPT_MASTER},
+	{"mule-ring", required_argument, 0, "use shared memory rings of the specified size for mule/farm messages", uwsgi_opt_set_64bit, &uwsgi.mule_ring, UWSGI_OPT_MASTER},
+	{"mule-ring-heap", required_argument, 0, "pass big mule messages by reference in the specified sharedarea (must be a heap)", uwsgi_opt_set_int, &uwsgi.mule_ring_heap, UWSGI_OPT_MASTER},
+	{"mule-ring-ref-size", required_argument, 0, "mule messages bigger than this are passed by reference (default 4096, requires --mule-ring-heap)", uwsgi_opt_set_64bit, &uwsgi.mule_ring_ref_size, UWSGI_OPT_MASTER},
 
 	{"signal", required_argument, 0, "send a uwsgi signal to a server", uwsgi_opt_signal, NULL, UWSGI_OPT_IMMEDIATE},
 	{"signal-bufsize", required_argument, 0, "set buffer size for signal queue", uwsgi_opt_set_int, &uwsgi.signal_bufsize, 0},
+	{"signal-coalesce", no_argument, 0, "deliver an already pending signal only once (with a counter of the coalesced deliveries)", uwsgi_opt_true, &uwsgi.signal_coalesce, UWSGI_OPT_MASTER},
+	{"core-signals", no_argument, 0, "create a signal pipe for each thread, allowing workerN:coreM signal targets", uwsgi_opt_true, &uwsgi.core_signals, UWSGI_OPT_MASTER},
 	{"signals-bufsize", required_argument, 0, "set buffer size for signal queue", uwsgi_opt_set_int, &uwsgi.signal_bufsize, 0},
 
 	{"signal-timer", required_argument, 0, "add a timer (syntax: <signal> <seconds>)", uwsgi_opt_add_string_list, &uwsgi.signal_timers, UWSGI_OPT_MASTER},
@@ -346,6 +381,9 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"rbtimer", required_argument, 0, "add a redblack timer (syntax: <signal> <seconds>)", uwsgi_opt_add_string_list, &uwsgi.rb_signal_timers, UWSGI_OPT_MASTER},
 
 	{"rpc-max", required_argument, 0, "maximum number of rpc slots (default: 64)", uwsgi_opt_set_64bit, &uwsgi.rpc_max, 0},
+	{"rpc-pool", required_argument, 0, "keep up to the specified number of persistent (pipelined) connections per rpc node", uwsgi_opt_set_int, &uwsgi.rpc_pool, 0},
+	{"rpc-pool-idle", required_argument, 0, "close pooled rpc connections idle for more than the specified seconds (default: 30)", uwsgi_opt_set_int, &uwsgi.rpc_pool_idle, 0},
+	{"rpc-session-timeout", required_argument, 0, "close persistent rpc sessions idle for more than the specified seconds (default: 60)", uwsgi_opt_set_int, &uwsgi.rpc_session_timeout, 0},
 
 	{"disable-logging", no_argument, 'L', "disable request logging", uwsgi_opt_false, &uwsgi.logging_options.enabled, 0},
 
@@ -520,6 +558,7 @@ static struct uwsgi_option uwsgi_base_options[] = {
 
 
 
+	{"config-cache", required_argument, 0, "store pre-parsed config files in the specified directory and reuse them while unchanged", uwsgi_opt_set_str, &uwsgi.config_cache, UWSGI_OPT_IMMEDIATE},
 	{"ini", required_argument, 0, "load config from ini file", uwsgi_opt_load_ini, NULL, UWSGI_OPT_IMMEDIATE},
 #ifdef UWSGI_YAML
 	{"yaml", required_argument, 'y', "load config from yaml file", uwsgi_opt_load_yml, NULL, UWSGI_OPT_IMMEDIATE},
@@ -534,6 +573,7 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"no-server", no_argument, 0, "force no-server mode", uwsgi_opt_true, &uwsgi.no_server, 0},
 	{"command-mode", no_argument, 0, "force command mode", uwsgi_opt_true, &uwsgi.command_mode, UWSGI_OPT_IMMEDIATE},
 	{"no-defer-accept", no_argument, 0, "disable deferred-accept on sockets", uwsgi_opt_true, &uwsgi.no_defer_accept, 0},
+	{"defer-accept-timeout", required_argument, 0, "set the seconds to wait for data before accepting a connection anyway (default --socket-timeout)", uwsgi_opt_set_int, &uwsgi.defer_accept_timeout, 0},
 	{"tcp-nodelay", no_argument, 0, "enable TCP NODELAY on each request", uwsgi_opt_true, &uwsgi.tcp_nodelay, 0},
 	{"so-keepalive", no_argument, 0, "enable TCP KEEPALIVEs", uwsgi_opt_true, &uwsgi.so_keepalive, 0},
 	{"so-send-timeout", no_argument, 0, "set SO_SNDTIMEO", uwsgi_opt_set_int, &uwsgi.so_send_timeout, 0},
@@ -549,6 +589,13 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"evil-reload-on-as", required_argument, 0, "force the master to reload a worker if its address space is higher than specified megabytes", uwsgi_opt_set_megabytes, &uwsgi.evil_reload_on_as, UWSGI_OPT_MASTER | UWSGI_OPT_MEMORY},
 	{"evil-reload-on-rss", required_argument, 0, "force the master to reload a worker if its rss memory is higher than specified megabytes", uwsgi_opt_set_megabytes, &uwsgi.evil_reload_on_rss, UWSGI_OPT_MASTER | UWSGI_OPT_MEMORY},
 	{"mem-collector-freq", required_argument, 0, "set the memory collector frequency when evil reloads are in place", uwsgi_opt_set_int, &uwsgi.mem_collector_freq, 0},
+#ifdef __linux__
+	{"memory-pressure", no_argument, 0, "monitor the memory usage and the PSI of the instance cgroup (v2), recycling the fattest workers before the OOM killer acts", uwsgi_opt_true, &uwsgi.memory_pressure, UWSGI_OPT_MASTER},
+	{"memory-pressure-cgroup", required_argument, 0, "monitor the specified cgroup (v2) directory instead of the instance one (implies --memory-pressure)", uwsgi_opt_set_str, &uwsgi.memory_pressure_cgroup, UWSGI_OPT_MASTER},
+	{"memory-pressure-high", required_argument, 0, "percentage of memory.max over which the cgroup is under pressure (default 90)", uwsgi_opt_set_int, &uwsgi.memory_pressure_high, UWSGI_OPT_MASTER},
+	{"memory-pressure-psi", required_argument, 0, "'some' avg10 percentage of memory.pressure over which the cgroup is under pressure (default 10, 0 disables)", uwsgi_opt_set_int, &uwsgi.memory_pressure_psi, UWSGI_OPT_MASTER},
+	{"memory-pressure-cooldown", required_argument, 0, "seconds to wait between two memory pressure actions (default 5)", uwsgi_opt_set_int, &uwsgi.memory_pressure_cooldown, UWSGI_OPT_MASTER},
+#endif
 
 	{"reload-on-fd", required_argument, 0, "reload if the specified file descriptor is ready", uwsgi_opt_add_string_list, &uwsgi.reload_on_fd, UWSGI_OPT_MASTER},
 	{"brutal-reload-on-fd", required_argument, 0, "brutal reload if the specified file descriptor is ready", uwsgi_opt_add_string_list, &uwsgi.brutal_reload_on_fd, UWSGI_OPT_MASTER},
@@ -556,19 +603,30 @@ static struct uwsgi_option uwsgi_base_options[] = {
 #ifdef __linux__
 #ifdef MADV_MERGEABLE
 	{"ksm", optional_argument, 0, "enable Linux KSM", uwsgi_opt_set_int, &uwsgi.linux_ksm, 0},
+	{"ksm-mode", required_argument, 0, "set which memory is merged by Linux KSM: all (default), anon (only heaps and private anonymous memory) or process (PR_SET_MEMORY_MERGE, no mappings scan, Linux >= 6.4)", uwsgi_opt_set_str, &uwsgi.ksm_mode_str, 0},
 #endif
+	{"shm-hugepages", required_argument, 0, "back the big shared memory areas (caches, sharedareas, workers table) with huge pages: thp (madvise) or hugetlb (MAP_HUGETLB, falls back to thp)", uwsgi_opt_set_shm_hugepages, NULL, UWSGI_OPT_IMMEDIATE},
+	{"thp-heaps", no_argument, 0, "enable transparent huge pages on the heaps of the workers (it increases the CoW copies of the preforked memory)", uwsgi_opt_true, &uwsgi.thp_heaps, 0},
+	{"idle-workers-cold", required_argument, 0, "from the master, mark as cold (process_madvise) the private memory of workers idle for the specified seconds", uwsgi_opt_set_int, &uwsgi.idle_workers_cold, UWSGI_OPT_MASTER},
+	{"stats-cow", no_argument, 0, "report shared and private memory of each worker in the stats (from /proc/<pid>/smaps_rollup)", uwsgi_opt_true, &uwsgi.stats_cow, UWSGI_OPT_MASTER},
+	{"taskstats", optional_argument, 0, "collect the kernel accounting (cpu time, context switches, io bytes, run queue and block io delays) of workers and mules via netlink taskstats every N seconds (default 1), reported in the stats and in the metrics", uwsgi_opt_set_int, &uwsgi.taskstats, UWSGI_OPT_MASTER},
 #endif
 #ifdef UWSGI_PCRE
 	{"pcre-jit", no_argument, 0, "enable pcre jit (if available)", uwsgi_opt_pcre_jit, NULL, UWSGI_OPT_IMMEDIATE},
+	{"pcre-no-jit", no_argument, 0, "disable pcre jit", uwsgi_opt_false, &uwsgi.pcre_jit, UWSGI_OPT_IMMEDIATE},
+	{"pcre-jit-stack", required_argument, 0, "set the max size of the per-core pcre jit stack (default 512k)", uwsgi_opt_set_64bit, &uwsgi.pcre_jit_stack_size, 0},
 #endif
 	{"never-swap", no_argument, 0, "lock all memory pages avoiding swapping", uwsgi_opt_true, &uwsgi.never_swap, 0},
 	{"touch-reload", required_argument, 0, "reload uWSGI if the specified file is modified/touched", uwsgi_opt_add_string_list, &uwsgi.touch_reload, UWSGI_OPT_MASTER},
 	{"touch-workers-reload", required_argument, 0, "trigger reload of (only) workers if the specified file is modified/touched", uwsgi_opt_add_string_list, &uwsgi.touch_workers_reload, UWSGI_OPT_MASTER},
 	{"touch-chain-reload", required_argument, 0, "trigger chain reload if the specified file is modified/touched", uwsgi_opt_add_string_list, &uwsgi.touch_chain_reload, UWSGI_OPT_MASTER},
+	{"chain-reload-workers", required_argument, 0, "set how many workers the chain reload can recycle at the same time (default 1)", uwsgi_opt_set_int, &uwsgi.chain_reload_workers, UWSGI_OPT_MASTER},
+	{"worker-warmup", required_argument, 0, "send the specified request path to each new worker before it starts accepting requests", uwsgi_opt_add_string_list, &uwsgi.worker_warmup, 0},
 	{"touch-logrotate", required_argument, 0, "trigger logrotation if the specified file is modified/touched", uwsgi_opt_add_string_list, &uwsgi.touch_logrotate, UWSGI_OPT_MASTER | UWSGI_OPT_LOG_MASTER},
 	{"touch-logreopen", required_argument, 0, "trigger log reopen if the specified file is modified/touched", uwsgi_opt_add_string_list, &uwsgi.touch_logreopen, UWSGI_OPT_MASTER | UWSGI_OPT_LOG_MASTER},
 	{"touch-exec", required_argument, 0, "run command when the specified file is modified/touched (syntax: file command)", uwsgi_opt_add_string_list, &uwsgi.touch_exec, UWSGI_OPT_MASTER},
 	{"touch-signal", required_argument, 0, "signal when the specified file is modified/touched (syntax: file signal)", uwsgi_opt_add_string_list, &uwsgi.touch_signal, UWSGI_OPT_MASTER},
+	{"touch-polling", no_argument, 0, "check touch-* files with stat() every master cycle instead of filesystem monitoring", uwsgi_opt_true, &uwsgi.touch_polling, UWSGI_OPT_MASTER},
 
 	{"fs-reload", required_argument, 0, "graceful reload when the specified filesystem object is modified", uwsgi_opt_add_string_list, &uwsgi.fs_reload, UWSGI_OPT_MASTER},
 	{"fs-brutal-reload", required_argument, 0, "brutal reload when the specified filesystem object is modified", uwsgi_opt_add_string_list, &uwsgi.fs_brutal_reload, UWSGI_OPT_MASTER},
@@ -584,8 +642,13 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"no-orphans", no_argument, 0, "automatically kill workers if master dies (can be dangerous for availability)", uwsgi_opt_true, &uwsgi.no_orphans, 0},
 	{"prio", required_argument, 0, "set processes/threads priority", uwsgi_opt_set_rawint, &uwsgi.prio, 0},
 	{"cpu-affinity", required_argument, 0, "set cpu affinity", uwsgi_opt_set_int, &uwsgi.cpu_affinity, 0},
+	{"numa-interleave", no_argument, 0, "interleave the shared memory areas over all of the NUMA nodes", uwsgi_opt_true, &uwsgi.numa_interleave, 0},
+	{"numa-workers", no_argument, 0, "group workers by NUMA node (cpus, memory policy and per-worker shared memory)", uwsgi_opt_true, &uwsgi.numa_workers, 0},
 	{"post-buffering", required_argument, 0, "enable post buffering", uwsgi_opt_set_64bit, &uwsgi.post_buffering, 0},
 	{"post-buffering-bufsize", required_argument, 0, "set buffer size for read() in post buffering mode", uwsgi_opt_set_64bit, &uwsgi.post_buffering_bufsize, 0},
+	{"post-buffering-stream", no_argument, 0, "stream bodies bigger than post-buffering via the offload threads instead of storing them on disk", uwsgi_opt_true, &uwsgi.post_buffering_stream, 0},
+	{"post-buffering-splice", no_argument, 0, "store bodies bigger than post-buffering on disk with splice(), without copying them in user space (Linux only, plain sockets)", uwsgi_opt_true, &uwsgi.post_buffering_splice, 0},
+	{"post-buffering-dir", required_argument, 0, "create the files of the bodies bigger than post-buffering in the specified directory (unnamed O_TMPFILE ones when supported, the app can link them in the same filesystem)", uwsgi_opt_set_str, &uwsgi.post_buffering_dir, 0},
 	{"body-read-warning", required_argument, 0, "set the amount of allowed memory allocation (in megabytes) for request body before starting printing a warning", uwsgi_opt_set_64bit, &uwsgi.body_read_warning, 0},
 	{"upload-progress", required_argument, 0, "enable creation of .json files in the specified directory during a file upload", uwsgi_opt_set_str, &uwsgi.upload_progress, 0},
 	{"no-default-app", no_argument, 0, "do not fallback to default app", uwsgi_opt_true, &uwsgi.no_default_app, 0},
@@ -609,16 +672,23 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"metric-dir", required_argument, 0, "export metrics as text files to the specified directory", uwsgi_opt_set_str, &uwsgi.metrics_dir, UWSGI_OPT_METRICS|UWSGI_OPT_MASTER},
 	{"metric-dir-restore", no_argument, 0, "restore last value taken from the metrics dir", uwsgi_opt_true, &uwsgi.metrics_dir_restore, UWSGI_OPT_METRICS|UWSGI_OPT_MASTER},
 	{"metrics-no-cores", no_argument, 0, "disable generation of cores-related metrics", uwsgi_opt_true, &uwsgi.metrics_no_cores, UWSGI_OPT_METRICS|UWSGI_OPT_MASTER},
+	{"metrics-no-shards", no_argument, 0, "do not use per-core shards for metrics updated by the application", uwsgi_opt_true, &uwsgi.metrics_no_shards, UWSGI_OPT_METRICS|UWSGI_OPT_MASTER},
+	{"req-timing", no_argument, 0, "trace the time spent in each stage of the requests (queue, parse, body, routing, app, write, close)", uwsgi_opt_true, &uwsgi.req_timing, 0},
+	{"metrics-no-histograms", no_argument, 0, "disable the default latency histograms (requests, cache gets, routers)", uwsgi_opt_true, &uwsgi.metrics_no_histograms, UWSGI_OPT_METRICS|UWSGI_OPT_MASTER},
 
 	{"udp", required_argument, 0, "run the udp server on the specified address", uwsgi_opt_set_str, &uwsgi.udp_socket, UWSGI_OPT_MASTER},
 	{"stats", required_argument, 0, "enable the stats server on the specified address", uwsgi_opt_set_str, &uwsgi.stats, UWSGI_OPT_MASTER},
 	{"stats-server", required_argument, 0, "enable the stats server on the specified address", uwsgi_opt_set_str, &uwsgi.stats, UWSGI_OPT_MASTER},
 	{"stats-http", no_argument, 0, "prefix stats server json output with http headers", uwsgi_opt_true, &uwsgi.stats_http, UWSGI_OPT_MASTER},
+	{"stats-binary", required_argument, 0, "enable the binary/incremental stats server on the specified address", uwsgi_opt_set_str, &uwsgi.stats_binary, UWSGI_OPT_MASTER},
+	{"stats-openmetrics", no_argument, 0, "output OpenMetrics text instead of json from the stats servers (with --stats-http it is available under /metrics)", uwsgi_opt_true, &uwsgi.stats_openmetrics, UWSGI_OPT_MASTER},
 	{"stats-minified", no_argument, 0, "minify statistics json output", uwsgi_opt_true, &uwsgi.stats_minified, UWSGI_OPT_MASTER},
 	{"stats-min", no_argument, 0, "minify statistics json output", uwsgi_opt_true, &uwsgi.stats_minified, UWSGI_OPT_MASTER},
 	{"stats-push", required_argument, 0, "push the stats json to the specified destination", uwsgi_opt_add_string_list, &uwsgi.requested_stats_pushers, UWSGI_OPT_MASTER|UWSGI_OPT_METRICS},
 	{"stats-pusher-default-freq", required_argument, 0, "set the default frequency of stats pushers", uwsgi_opt_set_int, &uwsgi.stats_pusher_default_freq, UWSGI_OPT_MASTER},
 	{"stats-pushers-default-freq", required_argument, 0, "set the default frequency of stats pushers", uwsgi_opt_set_int, &uwsgi.stats_pusher_default_freq, UWSGI_OPT_MASTER},
+	{"stats-pusher-mtu", required_argument, 0, "coalesce the metrics of datagram stats pushers in packets of the specified size (default 1400, 0 for a packet per metric)", uwsgi_opt_set_64bit, &uwsgi.stats_pusher_mtu, UWSGI_OPT_MASTER},
+	{"stats-pusher-changed-only", no_argument, 0, "push only the metrics changed since the previous push", uwsgi_opt_true, &uwsgi.stats_pusher_changed_only, UWSGI_OPT_MASTER},
 	{"stats-no-cores", no_argument, 0, "disable generation of cores-related stats", uwsgi_opt_true, &uwsgi.stats_no_cores, UWSGI_OPT_MASTER},
 	{"stats-no-metrics", no_argument, 0, "do not include metrics in stats output", uwsgi_opt_true, &uwsgi.stats_no_metrics, UWSGI_OPT_MASTER},
 	{"multicast", required_argument, 0, "subscribe to specified multicast group", uwsgi_opt_set_str, &uwsgi.multicast_group, UWSGI_OPT_MASTER},
@@ -637,7 +707,9 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"legion-mcast", required_argument, 0, "became a member of a legion (shortcut for multicast)", uwsgi_opt_legion_mcast, NULL, UWSGI_OPT_MASTER},
 	{"legion-node", required_argument, 0, "add a node to a legion", uwsgi_opt_legion_node, NULL, UWSGI_OPT_MASTER},
 	{"legion-freq", required_argument, 0, "set the frequency of legion packets", uwsgi_opt_set_int, &uwsgi.legion_freq, UWSGI_OPT_MASTER},
+	{"legion-freq-ms", required_argument, 0, "set the frequency of legion packets in milliseconds (overrides legion-freq)", uwsgi_opt_set_int, &uwsgi.legion_freq_ms, UWSGI_OPT_MASTER},
 	{"legion-tolerance", required_argument, 0, "set the tolerance of legion subsystem", uwsgi_opt_set_int, &uwsgi.legion_tolerance, UWSGI_OPT_MASTER},
+	{"legion-phi-threshold", required_argument, 0, "consider a legion node dead when its phi accrual suspicion level exceeds the specified value (legion-tolerance is still the upper bound)", uwsgi_opt_set_int, &uwsgi.legion_phi_threshold, UWSGI_OPT_MASTER},
 	{"legion-death-on-lord-error", required_argument, 0, "declare itself as a dead node for the specified amount of seconds if one of the lord hooks fails", uwsgi_opt_set_int, &uwsgi.legion_death_on_lord_error, UWSGI_OPT_MASTER},
 	{"legion-skew-tolerance", required_argument, 0, "set the clock skew tolerance of legion subsystem (default 30 seconds)", uwsgi_opt_set_int, &uwsgi.legion_skew_tolerance, UWSGI_OPT_MASTER},
 	{"legion-lord", required_argument, 0, "action to call on Lord election", uwsgi_opt_legion_hook, NULL, UWSGI_OPT_MASTER},
@@ -659,12 +731,19 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"subscriptions-use-credentials", no_argument, 0, "enable management of SCM_CREDENTIALS in subscriptions UNIX sockets", uwsgi_opt_true, &uwsgi.subscriptions_use_credentials, 0},
 	{"subscription-algo", required_argument, 0, "set load balancing algorithm for the subscription system", uwsgi_opt_ssa, NULL, 0},
 	{"subscription-dotsplit", no_argument, 0, "try to fallback to the next part (dot based) in subscription key", uwsgi_opt_true, &uwsgi.subscription_dotsplit, 0},
+	{"subscription-chash-vnodes", required_argument, 0, "set the number of virtual nodes (per weight unit) of the chash subscription algo (default 160)", uwsgi_opt_set_int, &uwsgi.subscription_chash_vnodes, 0},
+	{"subscription-chash-load", required_argument, 0, "bound the load of chash subscription nodes to the specified percentage of the average (e.g. 125)", uwsgi_opt_set_int, &uwsgi.subscription_chash_load, 0},
+	{"subscription-iphash-algo", required_argument, 0, "hash the client address with the specified hash algo in the iphash subscription algo (e.g. wyhash, xxh64)", uwsgi_opt_set_str, &uwsgi.subscription_iphash_algo, 0},
+	{"subscription-ewma-decay", required_argument, 0, "set the decay time (in milliseconds) of the peak-ewma latency of subscription nodes used by the p2c and ewma algos (default 10000)", uwsgi_opt_set_int, &uwsgi.subscription_ewma_decay, 0},
+	{"subscription-outlier-errors", required_argument, 0, "eject subscription nodes from balancing after the specified number of consecutive errors (5xx, timeouts)", uwsgi_opt_set_int, &uwsgi.subscription_outlier_errors, 0},
+	{"subscription-outlier-ejection", required_argument, 0, "set the base ejection time (in seconds) of outlier subscription nodes, multiplied by the number of consecutive ejections (default 30)", uwsgi_opt_set_int, &uwsgi.subscription_outlier_ejection, 0},
 	{"subscribe-to", required_argument, 0, "subscribe to the specified subscription server", uwsgi_opt_add_string_list, &uwsgi.subscriptions, UWSGI_OPT_MASTER},
 	{"st", required_argument, 0, "subscribe to the specified subscription server", uwsgi_opt_add_string_list, &uwsgi.subscriptions, UWSGI_OPT_MASTER},
 	{"subscribe", required_argument, 0, "subscribe to the specified subscription server", uwsgi_opt_add_string_list, &uwsgi.subscriptions, UWSGI_OPT_MASTER},
 	{"subscribe2", required_argument, 0, "subscribe to the specified subscription server using advanced keyval syntax", uwsgi_opt_add_string_list, &uwsgi.subscriptions2, UWSGI_OPT_MASTER},
 	{"subscribe-freq", required_argument, 0, "send subscription announce at the specified interval", uwsgi_opt_set_int, &uwsgi.subscribe_freq, 0},
 	{"subscription-tolerance", required_argument, 0, "set tolerance for subscription servers", uwsgi_opt_set_int, &uwsgi.subscription_tolerance, 0},
+	{"subscription-delta", required_argument, 0, "send only tiny refresh packets for unchanged subscriptions, forcing a full announce every <n> rounds (requires delta aware routers)", uwsgi_opt_set_int, &uwsgi.subscription_delta, 0},
 	{"unsubscribe-on-graceful-reload", no_argument, 0, "force unsubscribe request even during graceful reload", uwsgi_opt_true, &uwsgi.unsubscribe_on_graceful_reload, 0},
 	{"start-unsubscribed", no_argument, 0, "configure subscriptions but do not send them (useful with master fifo)", uwsgi_opt_true, &uwsgi.subscriptions_blocked, 0},
 
@@ -682,12 +761,17 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"sni", required_argument, 0, "add an SNI-governed SSL context", uwsgi_opt_sni, NULL, 0},
 	{"sni-dir", required_argument, 0, "check for cert/key/client_ca file in the specified directory and create a sni/ssl context on demand", uwsgi_opt_set_str, &uwsgi.sni_dir, 0},
 	{"sni-dir-ciphers", required_argument, 0, "set ssl ciphers for sni-dir option", uwsgi_opt_set_str, &uwsgi.sni_dir_ciphers, 0},
+	{"sni-lazy", no_argument, 0, "create SNI contexts at the first handshake instead of at startup (set it before the sni options)", uwsgi_opt_true, &uwsgi.sni_lazy, 0},
+	{"sni-max-contexts", required_argument, 0, "keep at most the specified number of SNI contexts alive in each process, evicting the least recently used", uwsgi_opt_set_int, &uwsgi.sni_max_contexts, 0},
 	{"ssl-enable3", no_argument, 0, "enable SSLv3 (insecure)", uwsgi_opt_true, &uwsgi.sslv3, 0},
 	{"ssl-option", no_argument, 0, "set a raw ssl option (numeric value)", uwsgi_opt_add_string_list, &uwsgi.ssl_options, 0},
 #ifdef UWSGI_PCRE
 	{"sni-regexp", required_argument, 0, "add an SNI-governed SSL context (the key is a regexp)", uwsgi_opt_sni, NULL, 0},
 #endif
 	{"ssl-tmp-dir", required_argument, 0, "store ssl-related temp files in the specified directory", uwsgi_opt_set_str, &uwsgi.ssl_tmp_dir, 0},
+	{"ssl-tickets-rotate", required_argument, 0, "share session tickets keys between processes and rotate them every <n> seconds (set it before the ssl sockets)", uwsgi_opt_set_int, &uwsgi.ssl_tickets_rotate, UWSGI_OPT_MASTER},
+	{"ssl-tickets-secret", required_argument, 0, "derive the rotated session tickets keys from the specified secret file (allows resumption between nodes)", uwsgi_opt_set_str, &uwsgi.ssl_tickets_secret, UWSGI_OPT_MASTER},
+	{"ssl-ktls", no_argument, 0, "enable kernel TLS offload (when supported) after the handshake", uwsgi_opt_true, &uwsgi.ssl_ktls, 0},
 #endif
 	{"check-interval", required_argument, 0, "set the interval (in seconds) of master checks", uwsgi_opt_set_int, &uwsgi.master_interval, UWSGI_OPT_MASTER},
 	{"forkbomb-delay", required_argument, 0, "sleep for the specified number of seconds when a forkbomb is detected", uwsgi_opt_set_int, &uwsgi.forkbomb_delay, UWSGI_OPT_MASTER},
@@ -697,6 +781,9 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"privileged-binary-patch-arg", required_argument, 0, "patch the uwsgi binary with a new command and arguments (before privileges drop)", uwsgi_opt_set_str, &uwsgi.privileged_binary_patch_arg, 0},
 	{"unprivileged-binary-patch-arg", required_argument, 0, "patch the uwsgi binary with a new command and arguments (after privileges drop)", uwsgi_opt_set_str, &uwsgi.unprivileged_binary_patch_arg, 0},
 	{"async", required_argument, 0, "enable async mode with specified cores", uwsgi_opt_set_int, &uwsgi.async, 0},
+	{"accept-batch", required_argument, 0, "accept up to the specified number of pending connections on every wakeup of an async loop (default 1, 8 when the master reports a listen queue)", uwsgi_opt_set_int, &uwsgi.accept_batch, 0},
+	{"async-threads", required_argument, 0, "run the async loop engine in the specified number of threads sharing the async cores (for plugins without a global lock)", uwsgi_opt_set_int, &uwsgi.async_threads, 0},
+	{"timer-wheel", no_argument, 0, "use a hashed timing wheel (instead of a rbtree) for async cores and routers timeouts", uwsgi_opt_true, &uwsgi.timer_wheel, 0},
 	{"disable-async-warn-on-queue-full", no_argument, 0, "Disable printing 'async queue is full' warning messages.", uwsgi_opt_false, &uwsgi.async_warn_if_queue_full, 0},
 	{"max-fd", required_argument, 0, "set maximum number of file descriptors (requires root privileges)", uwsgi_opt_set_int, &uwsgi.requested_max_fd, 0},
 	{"logto", required_argument, 0, "set logfile/udp address", uwsgi_opt_set_str, &uwsgi.logfile, 0},
@@ -705,6 +792,8 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"logformat", required_argument, 0, "set advanced format for request logging", uwsgi_opt_set_str, &uwsgi.logformat, 0},
 	{"logformat-strftime", no_argument, 0, "apply strftime to logformat output", uwsgi_opt_true, &uwsgi.logformat_strftime, 0},
 	{"log-format-strftime", no_argument, 0, "apply strftime to logformat output", uwsgi_opt_true, &uwsgi.logformat_strftime, 0},
+	{"logformat-json", no_argument, 0, "emit the logformat variables as a json object (raw text is ignored)", uwsgi_opt_true, &uwsgi.logformat_json, 0},
+	{"log-format-json", no_argument, 0, "emit the logformat variables as a json object (raw text is ignored)", uwsgi_opt_true, &uwsgi.logformat_json, 0},
 	{"logfile-chown", no_argument, 0, "chown logfiles", uwsgi_opt_true, &uwsgi.logfile_chown, 0},
 	{"logfile-chmod", required_argument, 0, "chmod logfiles", uwsgi_opt_logfile_chmod, NULL, 0},
 	{"log-syslog", optional_argument, 0, "log to syslog", uwsgi_opt_set_logger, "syslog", UWSGI_OPT_MASTER | UWSGI_OPT_LOG_MASTER},
@@ -714,6 +803,10 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"logger", required_argument, 0, "set/append a logger", uwsgi_opt_set_logger, NULL, UWSGI_OPT_MASTER | UWSGI_OPT_LOG_MASTER},
 	{"logger-list", no_argument, 0, "list enabled loggers", uwsgi_opt_true, &uwsgi.loggers_list, 0},
 	{"loggers-list", no_argument, 0, "list enabled loggers", uwsgi_opt_true, &uwsgi.loggers_list, 0},
+	{"log-batch", required_argument, 0, "accumulate the lines for the specified logger (name, id or \"all\") and send them in batches from a thread", uwsgi_opt_add_string_list, &uwsgi.log_batch, UWSGI_OPT_MASTER | UWSGI_OPT_LOG_MASTER},
+	{"log-batch-size", required_argument, 0, "flush a log batch when it reaches the specified size (default 64k)", uwsgi_opt_set_64bit, &uwsgi.log_batch_size, 0},
+	{"log-batch-freq", required_argument, 0, "flush log batches every <n> milliseconds (default 100)", uwsgi_opt_set_int, &uwsgi.log_batch_freq, 0},
+	{"log-batch-max", required_argument, 0, "max memory for a log batch, lines are dropped (and counted) when full (default 1M)", uwsgi_opt_set_64bit, &uwsgi.log_batch_max, 0},
 	{"threaded-logger", no_argument, 0, "offload log writing to a thread", uwsgi_opt_true, &uwsgi.threaded_logger, UWSGI_OPT_MASTER | UWSGI_OPT_LOG_MASTER},
 
 
@@ -733,6 +826,7 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"alarm", required_argument, 0, "create a new alarm, syntax: <alarm> <plugin:args>", uwsgi_opt_add_string_list, &uwsgi.alarm_list, UWSGI_OPT_MASTER},
 	{"alarm-cheap", required_argument, 0, "use main alarm thread rather than create dedicated threads for curl-based alarms", uwsgi_opt_true, &uwsgi.alarm_cheap, 0},
 	{"alarm-freq", required_argument, 0, "tune the anti-loop alarm system (default 3 seconds)", uwsgi_opt_set_int, &uwsgi.alarm_freq, 0},
+	{"alarm-burst", required_argument, 0, "allow at most the specified number of alarms for each instance every alarm-freq seconds, the others are suppressed and counted", uwsgi_opt_set_64bit, &uwsgi.alarm_burst, 0},
 	{"alarm-fd", required_argument, 0, "raise the specified alarm when an fd is read for read (by default it reads 1 byte, set 8 for eventfd)", uwsgi_opt_add_string_list, &uwsgi.alarm_fd_list, UWSGI_OPT_MASTER},
 	{"alarm-segfault", required_argument, 0, "raise the specified alarm when the segmentation fault handler is executed", uwsgi_opt_add_string_list, &uwsgi.alarm_segfault, UWSGI_OPT_MASTER},
 	{"segfault-alarm", required_argument, 0, "raise the specified alarm when the segmentation fault handler is executed", uwsgi_opt_add_string_list, &uwsgi.alarm_segfault, UWSGI_OPT_MASTER},
@@ -753,6 +847,7 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"alarm-msg-size", required_argument, 0, "set the max size of an alarm message (default 8192)", uwsgi_opt_set_64bit, &uwsgi.alarm_msg_size, 0},
 	{"log-master", no_argument, 0, "delegate logging to master process", uwsgi_opt_true, &uwsgi.log_master, UWSGI_OPT_MASTER|UWSGI_OPT_LOG_MASTER},
 	{"log-master-bufsize", required_argument, 0, "set the buffer size for the master logger. bigger log messages will be truncated", uwsgi_opt_set_64bit, &uwsgi.log_master_bufsize, 0},
+	{"req-log-ring", required_argument, 0, "pass request logs to the threaded logger via per-core shared memory rings of the specified size, records are dropped (and counted) when a ring is full", uwsgi_opt_set_64bit, &uwsgi.req_log_ring, UWSGI_OPT_REQ_LOG_MASTER},
 	{"log-master-stream", no_argument, 0, "create the master logpipe as SOCK_STREAM", uwsgi_opt_true, &uwsgi.log_master_stream, 0},
 	{"log-master-req-stream", no_argument, 0, "create the master requests logpipe as SOCK_STREAM", uwsgi_opt_true, &uwsgi.log_master_req_stream, 0},
 	{"log-reopen", no_argument, 0, "reopen log after reload", uwsgi_opt_true, &uwsgi.log_reopen, 0},
@@ -784,13 +879,16 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"chdir2", required_argument, 0, "chdir to specified directory after apps loading", uwsgi_opt_set_str, &uwsgi.chdir2, 0},
 	{"lazy", no_argument, 0, "set lazy mode (load apps in workers instead of master)", uwsgi_opt_true, &uwsgi.lazy, 0},
 	{"lazy-apps", no_argument, 0, "load apps in each worker instead of the master", uwsgi_opt_true, &uwsgi.lazy_apps, 0},
+	{"zygote", no_argument, 0, "load apps in a zygote process forking the workers (implies lazy-apps)", uwsgi_opt_true, &uwsgi.zygote, UWSGI_OPT_MASTER},
 	{"cheap", no_argument, 0, "set cheap mode (spawn workers only after the first request)", uwsgi_opt_true, &uwsgi.status.is_cheap, UWSGI_OPT_MASTER},
 	{"cheaper", required_argument, 0, "set cheaper mode (adaptive process spawning)", uwsgi_opt_set_int, &uwsgi.cheaper_count, UWSGI_OPT_MASTER | UWSGI_OPT_CHEAPER},
 	{"cheaper-initial", required_argument, 0, "set the initial number of processes to spawn in cheaper mode", uwsgi_opt_set_int, &uwsgi.cheaper_initial, UWSGI_OPT_MASTER | UWSGI_OPT_CHEAPER},
 	{"cheaper-algo", required_argument, 0, "choose to algorithm used for adaptive process spawning", uwsgi_opt_set_str, &uwsgi.requested_cheaper_algo, UWSGI_OPT_MASTER},
 	{"cheaper-step", required_argument, 0, "number of additional processes to spawn at each overload", uwsgi_opt_set_int, &uwsgi.cheaper_step, UWSGI_OPT_MASTER | UWSGI_OPT_CHEAPER},
 	{"cheaper-overload", required_argument, 0, "increase workers after specified overload", uwsgi_opt_set_64bit, &uwsgi.cheaper_overload, UWSGI_OPT_MASTER | UWSGI_OPT_CHEAPER},
-	{"cheaper-idle", required_argument, 0, "decrease workers after specified idle (algo: spare2) (default: 10)", uwsgi_opt_set_int, &uwsgi.cheaper_idle, UWSGI_OPT_MASTER | UWSGI_OPT_CHEAPER},
+	{"cheaper-idle", required_argument, 0, "decrease workers after specified idle (algo: spare2, predict) (default: 10)", uwsgi_opt_set_int, &uwsgi.cheaper_idle, UWSGI_OPT_MASTER | UWSGI_OPT_CHEAPER},
+	{"cheaper-sample-ms", required_argument, 0, "sample listen queue and latency every N milliseconds (algo: predict) (default: 100)", uwsgi_opt_set_int, &uwsgi.cheaper_sample_ms, UWSGI_OPT_MASTER | UWSGI_OPT_CHEAPER},
+	{"cheaper-predict-horizon", required_argument, 0, "forecast the request rate N milliseconds ahead (algo: predict) (default: 500)", uwsgi_opt_set_int, &uwsgi.cheaper_predict_horizon, UWSGI_OPT_MASTER | UWSGI_OPT_CHEAPER},
 	{"cheaper-algo-list", no_argument, 0, "list enabled cheapers algorithms", uwsgi_opt_true, &uwsgi.cheaper_algo_list, 0},
 	{"cheaper-algos-list", no_argument, 0, "list enabled cheapers algorithms", uwsgi_opt_true, &uwsgi.cheaper_algo_list, 0},
 	{"cheaper-list", no_argument, 0, "list enabled cheapers algorithms", uwsgi_opt_true, &uwsgi.cheaper_algo_list, 0},
@@ -823,6 +921,7 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"route-if", required_argument, 0, "add a route based on condition", uwsgi_opt_add_route, "if", 0},
 	{"route-if-not", required_argument, 0, "add a route based on condition (negate version)", uwsgi_opt_add_route, "if-not", 0},
 	{"route-run", required_argument, 0, "always run the specified route action", uwsgi_opt_add_route, "run", 0},
+	{"route-memo", required_argument, 0, "memoize routes regexp results in a per-core table of the specified number of entries", uwsgi_opt_set_64bit, &uwsgi.route_memo, 0},
 
 
 
@@ -885,6 +984,19 @@ static struct uwsgi_option uwsgi_base_options[] = {
 
 	{"websockets-max-size", required_argument, 0, "set the max allowed size of websocket messages (in Kbytes, default 1024)", uwsgi_opt_set_64bit, &uwsgi.websockets_max_size, 0},
 	{"websocket-max-size", required_argument, 0, "set the max allowed size of websocket messages (in Kbytes, default 1024)", uwsgi_opt_set_64bit, &uwsgi.websockets_max_size, 0},
+#ifdef UWSGI_ZLIB
+	{"websockets-deflate", no_argument, 0, "enable the permessage-deflate websocket extension", uwsgi_opt_true, &uwsgi.websockets_deflate, 0},
+	{"websockets-deflate-window-bits", required_argument, 0, "set the max LZ77 window bits (9-15) of websockets permessage-deflate (default 15)", uwsgi_opt_set_int, &uwsgi.websockets_deflate_window_bits, 0},
+	{"websockets-deflate-mem-level", required_argument, 0, "set the zlib memory level (1-9) of websockets permessage-deflate compressors (default 8)", uwsgi_opt_set_int, &uwsgi.websockets_deflate_mem_level, 0},
+	{"websockets-deflate-level", required_argument, 0, "set the compression level (0-9) of websockets permessage-deflate (default is the zlib one)", uwsgi_opt_set_int, &uwsgi.websockets_deflate_level, 0},
+	{"websockets-deflate-no-context-takeover", no_argument, 0, "do not keep the websockets permessage-deflate context between messages", uwsgi_opt_true, &uwsgi.websockets_deflate_no_context_takeover, 0},
+	{"websockets-deflate-idle", required_argument, 0, "release resettable websockets permessage-deflate state after the specified seconds of inactivity", uwsgi_opt_set_int, &uwsgi.websockets_deflate_idle, 0},
+	{"websockets-deflate-min-size", required_argument, 0, "do not compress websocket messages smaller than the specified size (default 64)", uwsgi_opt_set_64bit, &uwsgi.websockets_deflate_min_size, 0},
+#endif
+	{"websockets-offload", no_argument, 0, "allow handing websockets over to the offload threads (ping/pong, channels and forwarding are managed there)", uwsgi_opt_true, &uwsgi.websockets_offload, 0},
+	{"websockets-offload-ring", required_argument, 0, "set the size of the shared ring used for publishing messages to offloaded websockets (default 1M)", uwsgi_opt_set_64bit, &uwsgi.websockets_offload_ring, 0},
+	{"websockets-offload-forward", required_argument, 0, "forward messages received by offloaded websockets as requests to the specified uwsgi socket", uwsgi_opt_set_str, &uwsgi.websockets_offload_forward, 0},
+	{"websockets-offload-max-pending", required_argument, 0, "close offloaded websockets with more than the specified amount of unsent bytes (default 256k)", uwsgi_opt_set_64bit, &uwsgi.websockets_offload_max_pending, 0},
 
 	{"chunked-input-limit", required_argument, 0, "set the max size of a chunked input part (default 1MB, in bytes)", uwsgi_opt_set_64bit, &uwsgi.chunked_input_limit, 0},
 	{"chunked-input-timeout", required_argument, 0, "set default timeout for chunked input", uwsgi_opt_set_int, &uwsgi.chunked_input_timeout, 0},
@@ -895,6 +1007,8 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"clocks-list", no_argument, 0, "list enabled clocks", uwsgi_opt_true, &uwsgi.clock_list, 0},
 
 	{"add-header", required_argument, 0, "automatically add HTTP headers to response", uwsgi_opt_add_string_list, &uwsgi.additional_headers, 0},
+	{"header-template", required_argument, 0, "define a named set of response headers serialized once at startup (syntax: name=Key: value)", uwsgi_opt_add_string_list, &uwsgi.header_templates_list, 0},
+	{"add-header-template", required_argument, 0, "automatically add the specified header template to response", uwsgi_opt_add_string_list, &uwsgi.add_header_templates, 0},
 	{"rem-header", required_argument, 0, "automatically remove specified HTTP header from the response", uwsgi_opt_add_string_list, &uwsgi.remove_headers, 0},
 	{"del-header", required_argument, 0, "automatically remove specified HTTP header from the response", uwsgi_opt_add_string_list, &uwsgi.remove_headers, 0},
 	{"collect-header", required_argument, 0, "store the specified response header in a request var (syntax: header var)", uwsgi_opt_add_string_list, &uwsgi.collect_headers, 0},
@@ -912,6 +1026,9 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"static-safe", required_argument, 0, "skip security checks if the file is under the specified path", uwsgi_opt_add_string_list, &uwsgi.static_safe, UWSGI_OPT_MIME},
 	{"static-cache-paths", required_argument, 0, "put resolved paths in the uWSGI cache for the specified amount of seconds", uwsgi_opt_set_int, &uwsgi.use_static_cache_paths, UWSGI_OPT_MIME|UWSGI_OPT_MASTER},
 	{"static-cache-paths-name", required_argument, 0, "use the specified cache for static paths", uwsgi_opt_set_str, &uwsgi.static_cache_paths_name, UWSGI_OPT_MIME|UWSGI_OPT_MASTER},
+	{"static-fd-cache", required_argument, 0, "keep up to the specified number of static files open (with their headers) in each worker", uwsgi_opt_set_int, &uwsgi.static_fd_cache, UWSGI_OPT_MIME},
+	{"static-fd-cache-ttl", required_argument, 0, "revalidate the items of the static fd cache after the specified number of seconds (default 5)", uwsgi_opt_set_int, &uwsgi.static_fd_cache_ttl, UWSGI_OPT_MIME},
+	{"static-fd-cache-watch", required_argument, 0, "flush the static fd cache whenever the specified directory changes", uwsgi_opt_add_string_list, &uwsgi.static_fd_cache_watch, UWSGI_OPT_MIME|UWSGI_OPT_MASTER},
 #ifdef __APPLE__
 	{"mimefile", required_argument, 0, "set mime types file path (default /etc/apache2/mime.types)", uwsgi_opt_add_string_list, &uwsgi.mime_file, UWSGI_OPT_MIME},
 	{"mime-file", required_argument, 0, "set mime types file path (default /etc/apache2/mime.types)", uwsgi_opt_add_string_list, &uwsgi.mime_file, UWSGI_OPT_MIME},
@@ -938,12 +1055,17 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"static-gzip-dir", required_argument, 0, "check for a gzip version of all requested static files in the specified dir/prefix", uwsgi_opt_add_string_list, &uwsgi.static_gzip_dir, UWSGI_OPT_MIME},
 	{"static-gzip-prefix", required_argument, 0, "check for a gzip version of all requested static files in the specified dir/prefix", uwsgi_opt_add_string_list, &uwsgi.static_gzip_dir, UWSGI_OPT_MIME},
 	{"static-gzip-ext", required_argument, 0, "check for a gzip version of all requested static files with the specified ext/suffix", uwsgi_opt_add_string_list, &uwsgi.static_gzip_ext, UWSGI_OPT_MIME},
+	{"static-precompressed", required_argument, 0, "search for the specified precompressed variant (gzip, br, zstd) of the files allowed by the static-gzip-* options, in order of preference (default gzip)", uwsgi_opt_add_string_list, &uwsgi.static_precompressed, UWSGI_OPT_MIME},
+	{"static-gzip-store", required_argument, 0, "gzip once the files allowed by the static-gzip-* options without a precompressed variant, storing them in the specified directory", uwsgi_opt_set_str, &uwsgi.static_gzip_store, UWSGI_OPT_MIME},
+	{"static-gzip-cache", required_argument, 0, "gzip once the files allowed by the static-gzip-* options without a precompressed variant, storing them in the specified cache", uwsgi_opt_set_str, &uwsgi.static_gzip_cache, UWSGI_OPT_MIME},
 	{"static-gzip-suffix", required_argument, 0, "check for a gzip version of all requested static files with the specified ext/suffix", uwsgi_opt_add_string_list, &uwsgi.static_gzip_ext, UWSGI_OPT_MIME},
 
 	{"honour-range", no_argument, 0, "enable support for the HTTP Range header", uwsgi_opt_true, &uwsgi.honour_range, 0},
 
 	{"offload-threads", required_argument, 0, "set the number of offload threads to spawn (per-worker, default 0)", uwsgi_opt_set_int, &uwsgi.offload_threads, 0},
 	{"offload-thread", required_argument, 0, "set the number of offload threads to spawn (per-worker, default 0)", uwsgi_opt_set_int, &uwsgi.offload_threads, 0},
+	{"offload-threads-rr", no_argument, 0, "dispatch tasks to offload threads in round robin instead of choosing the one with less active tasks", uwsgi_opt_true, &uwsgi.offload_threads_rr, 0},
+	{"offload-http-keepalive", required_argument, 0, "keep up to <n> idle keepalive connections per http upstream in each offload thread (used by the http router)", uwsgi_opt_set_int, &uwsgi.offload_http_keepalive, 0},
 
 	{"file-serve-mode", required_argument, 0, "set static file serving mode", uwsgi_opt_fileserve_mode, NULL, UWSGI_OPT_MIME},
 	{"fileserve-mode", required_argument, 0, "set static file serving mode", uwsgi_opt_fileserve_mode, NULL, UWSGI_OPT_MIME},
@@ -973,10 +1095,14 @@ static struct uwsgi_option uwsgi_base_options[] = {
 #endif
 	{"enable-proxy-protocol", no_argument, 0, "enable PROXY1 protocol support (only for http parsers)", uwsgi_opt_true, &uwsgi.enable_proxy_protocol, 0},
 	{"reuse-port", no_argument, 0, "enable REUSE_PORT flag on socket (BSD and Linux >3.9 only)", uwsgi_opt_true, &uwsgi.reuse_port, 0},
+	{"reuse-port-workers", no_argument, 0, "bind a REUSE_PORT listener for each worker instead of sharing the socket (Linux >3.9 only)", uwsgi_opt_true, &uwsgi.reuse_port_workers, 0},
+	{"reuse-port-incoming-cpu", no_argument, 0, "pair each worker listener with the cpu of the worker (SO_INCOMING_CPU, use it with --cpu-affinity)", uwsgi_opt_true, &uwsgi.reuse_port_incoming_cpu, 0},
 	{"tcp-fast-open", required_argument, 0, "enable TCP_FASTOPEN flag on TCP sockets with the specified qlen value", uwsgi_opt_set_int, &uwsgi.tcp_fast_open, 0},
 	{"tcp-fastopen", required_argument, 0, "enable TCP_FASTOPEN flag on TCP sockets with the specified qlen value", uwsgi_opt_set_int, &uwsgi.tcp_fast_open, 0},
-	{"tcp-fast-open-client", no_argument, 0, "use sendto(..., MSG_FASTOPEN, ...) instead of connect() if supported", uwsgi_opt_true, &uwsgi.tcp_fast_open_client, 0},
-	{"tcp-fastopen-client", no_argument, 0, "use sendto(..., MSG_FASTOPEN, ...) instead of connect() if supported", uwsgi_opt_true, &uwsgi.tcp_fast_open_client, 0},
+	{"tcp-fast-open-client", no_argument, 0, "use TCP fast open for outgoing connections (the first write is sent with the SYN when supported)", uwsgi_opt_true, &uwsgi.tcp_fast_open_client, 0},
+	{"tcp-fastopen-client", no_argument, 0, "use TCP fast open for outgoing connections (the first write is sent with the SYN when supported)", uwsgi_opt_true, &uwsgi.tcp_fast_open_client, 0},
+	{"so-busy-poll", required_argument, 0, "busy poll the device queue for the specified usecs on blocking reads of TCP sockets (SO_BUSY_POLL, Linux only)", uwsgi_opt_set_int, &uwsgi.so_busy_poll, 0},
+	{"so-prefer-busy-poll", no_argument, 0, "prefer busy polling to interrupts on TCP sockets (SO_PREFER_BUSY_POLL, Linux >5.11 only)", uwsgi_opt_true, &uwsgi.so_prefer_busy_poll, 0},
 	{"zerg", required_argument, 0, "attach to a zerg server", uwsgi_opt_add_string_list, &uwsgi.zerg_node, 0},
 	{"zerg-fallback", no_argument, 0, "fallback to normal sockets if the zerg server is not available", uwsgi_opt_true, &uwsgi.zerg_fallback, 0},
 	{"zerg-server", required_argument, 0, "enable the zerg server on the specified UNIX socket", uwsgi_opt_set_str, &uwsgi.zerg_server, UWSGI_OPT_MASTER},
@@ -1016,6 +1142,7 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"plugins-list", no_argument, 0, "list enabled plugins", uwsgi_opt_true, &uwsgi.plugins_list, 0},
 	{"plugin-list", no_argument, 0, "list enabled plugins", uwsgi_opt_true, &uwsgi.plugins_list, 0},
 	{"autoload", no_argument, 0, "try to automatically load plugins when unknown options are found", uwsgi_opt_true, &uwsgi.autoload, UWSGI_OPT_IMMEDIATE},
+	{"lazy-plugins", no_argument, 0, "defer loading of the plugins listed after it until one of their options, loggers or routers is needed", uwsgi_opt_true, &uwsgi.lazy_plugins, UWSGI_OPT_IMMEDIATE},
 	{"dlopen", required_argument, 0, "blindly load a shared library", uwsgi_opt_load_dl, NULL, UWSGI_OPT_IMMEDIATE},
 	{"allowed-modifiers", required_argument, 0, "comma separated list of allowed modifiers", uwsgi_opt_set_str, &uwsgi.allowed_modifiers, 0},
 	{"remap-modifier", required_argument, 0, "remap request modifier from one id to another", uwsgi_opt_set_str, &uwsgi.remap_modifier, 0},
@@ -2365,6 +2492,7 @@ configure:
 	uwsgi_register_cheaper_algo("spare2", uwsgi_cheaper_algo_spare2);
 	uwsgi_register_cheaper_algo("backlog", uwsgi_cheaper_algo_backlog);
 	uwsgi_register_cheaper_algo("manual", uwsgi_cheaper_algo_manual);
+	uwsgi_register_cheaper_algo("predict", uwsgi_cheaper_algo_predict);
 
 	// setup imperial monitors
 	uwsgi_register_imperial_monitor("dir", uwsgi_imperial_monitor_directory_init, uwsgi_imperial_monitor_directory);
@@ -2373,6 +2501,9 @@ configure:
 	// setup stats pushers
 	uwsgi_stats_pusher_setup();
 
+	// setup spooler engines
+	uwsgi_spooler_engines_setup();
+
 	// register embedded alarms
 	uwsgi_register_embedded_alarms();
 
@@ -2582,7 +2713,7 @@ configure:
 
 int uwsgi_start(void *v_argv) {
 
-	int i, j;
+	int i;
 
 #ifdef __linux__
 	uwsgi_set_cgroup();
@@ -2784,6 +2915,9 @@ int uwsgi_start(void *v_argv) {
 		uwsgi_log_initial("VirtualHosting mode enabled.\n");
 	}
 
+	// detect NUMA nodes before allocating the shared areas
+	uwsgi_numa_setup();
+
 	// setup locking
 	uwsgi_setup_locking();
 	if (uwsgi.use_thunder_lock) {
@@ -2802,12 +2936,18 @@ int uwsgi_start(void *v_argv) {
 	uwsgi.snmp_lock = uwsgi_lock_init("snmp");
 
 	// setup queue
-	if (uwsgi.queue_size > 0) {
+	if (uwsgi.queue_size > 0 || uwsgi.queue_ring > 0) {
 		uwsgi_init_queue();
 	}
 
 	uwsgi_cache_create_all();
 
+	// rate limiters (they need the hash algos registered by the caching subsystem)
+	uwsgi_ratelimits_init();
+
+	// shared dns cache
+	uwsgi_dns_cache_init();
+
 	if (uwsgi.use_check_cache) {
 		uwsgi.check_cache = uwsgi_cache_by_name(uwsgi.use_check_cache);
 		if (!uwsgi.check_cache) {
@@ -2833,6 +2973,13 @@ int uwsgi_start(void *v_argv) {
 		}
         }
 
+	if (uwsgi.static_fd_cache > 0) {
+		uwsgi_static_fd_cache_setup();
+	}
+
+	uwsgi_static_compression_setup();
+	uwsgi_header_templates_setup();
+
         // initialize the alarm subsystem
         uwsgi_alarms_init();
 
@@ -2842,6 +2989,12 @@ int uwsgi_start(void *v_argv) {
 	// initialize socket protocols (do it after caching !!!)
 	uwsgi_protocols_register();
 
+	// deferred plugins no one asked for are never dlopen()ed nor initialized
+	struct uwsgi_string_list *lazy_usl;
+	uwsgi_foreach(lazy_usl, uwsgi.lazy_plugins_list) {
+		uwsgi_log_initial("lazy plugin %s not needed, skipped\n", lazy_usl->value);
+	}
+
 	/* plugin initialization */
 	for (i = 0; i < uwsgi.gp_cnt; i++) {
 		if (uwsgi.gp[i]->init) {
@@ -2863,15 +3016,22 @@ int uwsgi_start(void *v_argv) {
 		//check for inherited sockets
 		if (uwsgi.is_a_reload) {
 			uwsgi_setup_inherited_sockets();
+			uwsgi_setup_zerg_report();
 		}
 
 
 		//now bind all the unbound sockets
 		uwsgi_bind_sockets();
 
+		// eventually bind a listener for each worker
+		uwsgi_setup_socket_shards();
+
 		// put listening socket in non-blocking state and set the protocol
 		uwsgi_set_sockets_protocols();
 
+		// priorities, reserved workers and load shedding
+		uwsgi_setup_socket_qos();
+
 	}
 
 
@@ -2922,6 +3082,7 @@ int uwsgi_start(void *v_argv) {
 		}
 
 		pthread_mutex_init(&uwsgi.lock_static, NULL);
+		pthread_mutex_init(&uwsgi.lock_offload_snapshots, NULL);
 
 		// again check for workers/sockets...
 		if (uwsgi.sockets || uwsgi.master_process || uwsgi.no_server || uwsgi.command_mode || uwsgi.loop) {
@@ -3057,6 +3218,13 @@ unsafe:
 	if (uwsgi.master_process) {
 		for (i = 1; i <= uwsgi.numproc; i++) {
 			create_signal_pipe(uwsgi.workers[i].signal_pipe);
+			// a pipe per thread, to target a single core without waking up the others
+			if (uwsgi.core_signals && uwsgi.threads > 1) {
+				int j;
+				for (j = 0; j < uwsgi.cores; j++) {
+					create_signal_pipe(uwsgi.workers[i].cores[j].signal_pipe);
+				}
+			}
 		}
 	}
 
@@ -3068,6 +3236,9 @@ unsafe:
 	// initialize mules and farms
 	uwsgi_setup_mules_and_farms();
 
+	// publishing ring and wakeup pipes of offloaded websockets
+	uwsgi_websockets_hub_setup();
+
 	if (uwsgi.command_mode) {
 		uwsgi_log("*** Operational MODE: command ***\n");
 	}
@@ -3111,12 +3282,7 @@ unsafe:
 		//if (uwsgi.logformat_strftime) {
 			//uwsgi.logit = uwsgi_logit_lf_strftime;
 		//}
-		uwsgi.logvectors = uwsgi_malloc(sizeof(struct iovec *) * uwsgi.cores);
-		for (j = 0; j < uwsgi.cores; j++) {
-			uwsgi.logvectors[j] = uwsgi_malloc(sizeof(struct iovec) * uwsgi.logformat_vectors);
-			uwsgi.logvectors[j][uwsgi.logformat_vectors - 1].iov_base = "\n";
-			uwsgi.logvectors[j][uwsgi.logformat_vectors - 1].iov_len = 1;
-		}
+		uwsgi_setup_log_format();
 	}
 
 	// initialize locks and socket as soon as possible, as the master could enqueue tasks
@@ -3126,6 +3292,7 @@ unsafe:
 		while (uspool) {
 			// lock is required even in EXTERNAL mode
 			uspool->lock = uwsgi_lock_init(uwsgi_concat2("spooler on ", uspool->dir));
+			uwsgi_spooler_engine_init(uspool);
 			if (uspool->mode == UWSGI_SPOOLER_EXTERNAL)
 				goto next;
 			create_signal_pipe(uspool->signal_pipe);
@@ -3215,7 +3382,19 @@ next:
 #ifdef __linux__
 #ifdef MADV_MERGEABLE
 	if (uwsgi.linux_ksm > 0) {
-		uwsgi_log("[uwsgi-KSM] enabled with frequency: %d\n", uwsgi.linux_ksm);
+		if (uwsgi.ksm_mode == UWSGI_KSM_PROCESS) {
+#ifndef PR_SET_MEMORY_MERGE
+#define PR_SET_MEMORY_MERGE 67
+#endif
+			// the flag is inherited by the workers, no mappings scan is needed
+			if (prctl(PR_SET_MEMORY_MERGE, 1, 0, 0, 0)) {
+				uwsgi_error("[uwsgi-KSM] prctl(PR_SET_MEMORY_MERGE)");
+				uwsgi_log("[uwsgi-KSM] falling back to anon mode\n");
+				uwsgi.ksm_mode = UWSGI_KSM_ANON;
+			}
+		}
+		uwsgi_log("[uwsgi-KSM] enabled with frequency: %d (mode: %s)\n", uwsgi.linux_ksm,
+			uwsgi.ksm_mode == UWSGI_KSM_PROCESS ? "process" : (uwsgi.ksm_mode == UWSGI_KSM_ANON ? "anon" : "all"));
 	}
 #endif
 #endif
@@ -3287,12 +3466,19 @@ next2:
 		// setup internal signalling system
 		create_signal_pipe(uwsgi.shared->worker_signal_pipe);
 		uwsgi.signal_socket = uwsgi.shared->worker_signal_pipe[1];
+		if (uwsgi.harakiri_options.workers_ms > 0) {
+			create_signal_pipe(uwsgi.shared->harakiri_pipe);
+		}
 	}
 
 	// uWSGI is ready
 	uwsgi_notify_ready();
 	uwsgi.current_time = uwsgi_now();
 
+	if (uwsgi.zygote) {
+		uwsgi_zygote_start();
+	}
+
 	// here we spawn the workers...
 	if (!uwsgi.status.is_cheap) {
 		if (uwsgi.cheaper && uwsgi.cheaper_count) {
@@ -3377,12 +3563,22 @@ int uwsgi_run() {
 		pthread_create(&t, NULL, mem_collector, NULL);
 	}
 
+#ifdef __linux__
+	if (uwsgi.thp_heaps) {
+		uwsgi_linux_thp_heaps();
+	}
+#endif
+
+
+	// eventually use the worker listeners
+	uwsgi_attach_socket_shards();
 
 	// eventually maps (or disable) sockets for the  worker
 	uwsgi_map_sockets();
 
 	// eventually set cpu affinity poilicies (OS-dependent)
 	uwsgi_set_cpu_affinity();
+	uwsgi_numa_worker();
 
 	if (uwsgi.worker_exec) {
 		char *w_argv[2];
@@ -3416,7 +3612,7 @@ int uwsgi_run() {
 	if (uwsgi.offload_threads > 0) {
 		uwsgi.offload_thread = uwsgi_malloc(sizeof(struct uwsgi_thread *) * uwsgi.offload_threads);
 		for(i=0;i<uwsgi.offload_threads;i++) {
-			uwsgi.offload_thread[i] = uwsgi_offload_thread_start();
+			uwsgi.offload_thread[i] = uwsgi_offload_thread_start(&uwsgi.workers[uwsgi.mywid].offload_stats[i]);
 			if (!uwsgi.offload_thread[i]) {
 				uwsgi_log("unable to start offload thread %d for worker %d !!!\n", i, uwsgi.mywid);
 				uwsgi.offload_threads = i;
@@ -3473,7 +3669,7 @@ void uwsgi_worker_run() {
 
 	int i;
 
-	if (uwsgi.lazy || uwsgi.lazy_apps) {
+	if ((uwsgi.lazy || uwsgi.lazy_apps) && !uwsgi.zygote_apps_loaded) {
 		uwsgi_init_all_apps();
 	}
 
@@ -3585,6 +3781,11 @@ void uwsgi_ignition() {
 		}
 	}
 
+	// the worker is not ready until the apps are warm
+	if (uwsgi.worker_warmup) {
+		uwsgi_worker_warmup();
+	}
+
 	// mark the worker as "accepting" (this is a mark used by chain reloading)
 	uwsgi.workers[uwsgi.mywid].accepting = 1;
 	// ready to accept request, if i am a vassal signal Emperor about it
@@ -3809,6 +4010,16 @@ void uwsgi_help(char *opt, char *val, void *none) {
 initialize all apps
 
 */
+/*
+	log the time spent in a startup stage, plugins without apps (taking less than a millisecond)
+	are skipped to keep the logs readable
+*/
+void uwsgi_log_startup_stage(const char *who, char *stage, uint64_t start) {
+	uint64_t elapsed = (uwsgi_micros() - start) / 1000;
+	if (!elapsed) return;
+	uwsgi_log("[startup] %s %s loaded in %llu ms\n", who, stage, (unsigned long long) elapsed);
+}
+
 void uwsgi_init_all_apps() {
 
 	int i, j;
@@ -3835,15 +4046,23 @@ void uwsgi_init_all_apps() {
         }
 
 
+	// the loading time of every stage is logged, so slow apps can be spotted
+	uint64_t apps_start = uwsgi_micros();
+	uint64_t stage_start;
+
 	for (i = 0; i < 256; i++) {
 		if (uwsgi.p[i]->init_apps) {
+			stage_start = uwsgi_micros();
 			uwsgi.p[i]->init_apps();
+			uwsgi_log_startup_stage(uwsgi.p[i]->name, "apps", stage_start);
 		}
 	}
 
 	for (i = 0; i < uwsgi.gp_cnt; i++) {
 		if (uwsgi.gp[i]->init_apps) {
+			stage_start = uwsgi_micros();
 			uwsgi.gp[i]->init_apps();
+			uwsgi_log_startup_stage(uwsgi.gp[i]->name, "apps", stage_start);
 		}
 	}
 
@@ -3856,8 +4075,11 @@ void uwsgi_init_all_apps() {
 			for (j = 0; j < 256; j++) {
 				if (uwsgi.p[j]->mount_app) {
 					uwsgi_log("mounting %s on %s\n", what, app_mps->value);
-					if (uwsgi.p[j]->mount_app(app_mps->value, what) != -1)
+					stage_start = uwsgi_micros();
+					if (uwsgi.p[j]->mount_app(app_mps->value, what) != -1) {
+						uwsgi_log("[startup] mount %s (%s) loaded in %llu ms\n", app_mps->value, what, (unsigned long long) ((uwsgi_micros() - stage_start) / 1000));
 						break;
+					}
 				}
 			}
 			what--;
@@ -3889,6 +4111,10 @@ void uwsgi_init_all_apps() {
 		}
 	}
 
+	uint64_t now = uwsgi_micros();
+	uint64_t since_start = now - ((uint64_t) uwsgi.start_tv.tv_sec * 1000000 + uwsgi.start_tv.tv_usec);
+	uwsgi_log("[startup] %d app(s) loaded in %llu ms (%llu ms after the instance start)\n", uwsgi_apps_cnt, (unsigned long long) ((now - apps_start) / 1000), (unsigned long long) (since_start / 1000));
+
 	uwsgi_hooks_run(uwsgi.hook_post_app, "post app", 1);
 
 	usl = uwsgi.exec_post_app;
@@ -4436,6 +4662,11 @@ void uwsgi_opt_load_plugin(char *opt, char *value, void *none) {
 #ifdef UWSGI_DEBUG
 		uwsgi_debug("loading plugin %s\n", p);
 #endif
+		if (uwsgi.lazy_plugins && !plugin_already_loaded(p)) {
+			if (!uwsgi_string_list_has_item(uwsgi.lazy_plugins_list, p, strlen(p)))
+				uwsgi_string_new_list(&uwsgi.lazy_plugins_list, uwsgi_str(p));
+			continue;
+		}
 		if (uwsgi_load_plugin(-1, p, NULL)) {
 			build_options();
 		}
@@ -4583,10 +4814,52 @@ int uwsgi_zerg_attach(char *value) {
 		free(zerg);
 	}
 
-	close(zerg_fd);
+	// keep the connection, load-aware zergpools use it for busyness reports
+	uwsgi_zerg_report_add(zerg_fd);
 	return 0;
 }
 
+void uwsgi_zerg_report_add(int fd) {
+	uwsgi.zerg_report_fds = realloc(uwsgi.zerg_report_fds, sizeof(int) * (uwsgi.zerg_report_fds_cnt + 1));
+	if (!uwsgi.zerg_report_fds) {
+		uwsgi_error("uwsgi_zerg_report_add()/realloc()");
+		exit(1);
+	}
+	uwsgi.zerg_report_fds[uwsgi.zerg_report_fds_cnt] = fd;
+	uwsgi.zerg_report_fds_cnt++;
+	// survive reloads
+	uwsgi_add_safe_fd(fd);
+	uwsgi_zerg_report_sync();
+}
+
+// drop closed connections and export the list for the next reload
+void uwsgi_zerg_report_sync() {
+	int i, j = 0;
+	for (i = 0; i < uwsgi.zerg_report_fds_cnt; i++) {
+		if (uwsgi.zerg_report_fds[i] > -1) {
+			uwsgi.zerg_report_fds[j++] = uwsgi.zerg_report_fds[i];
+		}
+	}
+	uwsgi.zerg_report_fds_cnt = j;
+
+	if (!j) {
+		unsetenv("UWSGI_ZERG_REPORT_FDS");
+		return;
+	}
+
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(uwsgi.page_size);
+	for (i = 0; i < uwsgi.zerg_report_fds_cnt; i++) {
+		if (i > 0 && uwsgi_buffer_append(ub, ",", 1)) goto end;
+		if (uwsgi_buffer_num64(ub, uwsgi.zerg_report_fds[i])) goto end;
+	}
+	if (uwsgi_buffer_append(ub, "\0", 1)) goto end;
+	if (setenv("UWSGI_ZERG_REPORT_FDS", ub->buf, 1)) {
+		uwsgi_error("uwsgi_zerg_report_sync()/setenv()");
+	}
+end:
+	uwsgi_buffer_destroy(ub);
+}
+
 void uwsgi_opt_signal(char *opt, char *value, void *foobar) {
 	uwsgi_command_signal(value);
 }
@@ -4722,8 +4995,14 @@ void uwsgi_opt_noop(char *opt, char *foo, void *bar) {
 }
 
 void uwsgi_opt_load_ini(char *opt, char *filename, void *none) {
+	struct uwsgi_config_cache *ucc = NULL;
 	config_magic_table_fill(filename, uwsgi.magic_table);
+	// ":section" references resolve to the last read file, even when it comes from the cache
+	if (uwsgi.config_cache && filename[0] != ':')
+		uwsgi_ini_set_last_file(filename);
+	if (uwsgi_config_cache_replay(filename, "INI", &ucc)) return;
 	uwsgi_ini_config(filename, uwsgi.magic_table);
+	uwsgi_config_cache_store(ucc);
 }
 
 void uwsgi_opt_load_config(char *opt, char *filename, void *none) {
@@ -4743,22 +5022,31 @@ void uwsgi_opt_load_config(char *opt, char *filename, void *none) {
 
 #ifdef UWSGI_XML
 void uwsgi_opt_load_xml(char *opt, char *filename, void *none) {
+	struct uwsgi_config_cache *ucc = NULL;
 	config_magic_table_fill(filename, uwsgi.magic_table);
+	if (uwsgi_config_cache_replay(filename, "XML", &ucc)) return;
 	uwsgi_xml_config(filename, uwsgi.wsgi_req, uwsgi.magic_table);
+	uwsgi_config_cache_store(ucc);
 }
 #endif
 
 #ifdef UWSGI_YAML
 void uwsgi_opt_load_yml(char *opt, char *filename, void *none) {
+	struct uwsgi_config_cache *ucc = NULL;
 	config_magic_table_fill(filename, uwsgi.magic_table);
+	if (uwsgi_config_cache_replay(filename, "YAML", &ucc)) return;
 	uwsgi_yaml_config(filename, uwsgi.magic_table);
+	uwsgi_config_cache_store(ucc);
 }
 #endif
 
 #ifdef UWSGI_JSON
 void uwsgi_opt_load_json(char *opt, char *filename, void *none) {
+	struct uwsgi_config_cache *ucc = NULL;
 	config_magic_table_fill(filename, uwsgi.magic_table);
+	if (uwsgi_config_cache_replay(filename, "JSON", &ucc)) return;
 	uwsgi_json_config(filename, uwsgi.magic_table);
+	uwsgi_config_cache_store(ucc);
 }
 #endif
 
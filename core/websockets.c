@@ -1,5 +1,11 @@
 #include <uwsgi.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 /*
 
         uWSGI websockets functions
@@ -42,6 +48,329 @@ error:
 	return NULL;
 }
 
+// fill the websocket header of a message (max 10 bytes), returns its size
+static size_t uwsgi_websocket_header(uint8_t *hdr, uint8_t opcode, uint64_t len) {
+	int i;
+	hdr[0] = opcode;
+	if (len < 126) {
+		hdr[1] = len;
+		return 2;
+	}
+	if (len <= 0xffff) {
+		hdr[1] = 126;
+		hdr[2] = (uint8_t) ((len >> 8) & 0xff);
+		hdr[3] = (uint8_t) (len & 0xff);
+		return 4;
+	}
+	hdr[1] = 127;
+	for (i = 0; i < 8; i++) {
+		hdr[2 + i] = (uint8_t) ((len >> (56 - (i * 8))) & 0xff);
+	}
+	return 10;
+}
+
+#ifdef UWSGI_ZLIB
+/*
+	permessage-deflate (RFC 7692)
+
+	compressor and decompressor are allocated on first use and kept for the whole
+	connection (context takeover) unless "no_context_takeover" has been negotiated:
+	in such a case they are reset after each message and, being stateless between
+	messages, they can be released after --websockets-deflate-idle seconds.
+*/
+static z_stream *uwsgi_websocket_zdeflate(struct wsgi_request *wsgi_req) {
+	if (wsgi_req->websocket_zdeflate) return wsgi_req->websocket_zdeflate;
+	z_stream *z = uwsgi_calloc(sizeof(z_stream));
+	// raw deflate (negative window bits)
+	if (deflateInit2(z, uwsgi.websockets_deflate_level, Z_DEFLATED, -wsgi_req->websocket_server_wbits, uwsgi.websockets_deflate_mem_level, Z_DEFAULT_STRATEGY) != Z_OK) {
+		free(z);
+		return NULL;
+	}
+	wsgi_req->websocket_zdeflate = z;
+	return z;
+}
+
+static z_stream *uwsgi_websocket_zinflate(struct wsgi_request *wsgi_req) {
+	if (wsgi_req->websocket_zinflate) return wsgi_req->websocket_zinflate;
+	z_stream *z = uwsgi_calloc(sizeof(z_stream));
+	if (inflateInit2(z, -wsgi_req->websocket_client_wbits) != Z_OK) {
+		free(z);
+		return NULL;
+	}
+	wsgi_req->websocket_zinflate = z;
+	return z;
+}
+
+static void uwsgi_websocket_zdeflate_free(struct wsgi_request *wsgi_req) {
+	if (!wsgi_req->websocket_zdeflate) return;
+	deflateEnd((z_stream *) wsgi_req->websocket_zdeflate);
+	free(wsgi_req->websocket_zdeflate);
+	wsgi_req->websocket_zdeflate = NULL;
+}
+
+static void uwsgi_websocket_zinflate_free(struct wsgi_request *wsgi_req) {
+	if (!wsgi_req->websocket_zinflate) return;
+	inflateEnd((z_stream *) wsgi_req->websocket_zinflate);
+	free(wsgi_req->websocket_zinflate);
+	wsgi_req->websocket_zinflate = NULL;
+}
+
+void uwsgi_websocket_deflate_free(struct wsgi_request *wsgi_req) {
+	uwsgi_websocket_zdeflate_free(wsgi_req);
+	uwsgi_websocket_zinflate_free(wsgi_req);
+}
+
+// release the compression state that the peer does not expect us to keep
+static void uwsgi_websocket_deflate_idle(struct wsgi_request *wsgi_req) {
+	if (!uwsgi.websockets_deflate_idle || !wsgi_req->websocket_zlast) return;
+	if (uwsgi_now() - wsgi_req->websocket_zlast < uwsgi.websockets_deflate_idle) return;
+	if (wsgi_req->websocket_server_no_takeover) {
+		uwsgi_websocket_zdeflate_free(wsgi_req);
+	}
+	// do not drop the decompressor in the middle of a fragmented message
+	if (wsgi_req->websocket_client_no_takeover && !wsgi_req->websocket_compressed) {
+		uwsgi_websocket_zinflate_free(wsgi_req);
+	}
+}
+
+// compress a message payload at the end of the buffer (without the 00 00 ff ff trailer)
+static int uwsgi_websocket_deflate_do(struct wsgi_request *wsgi_req, char *msg, size_t len, struct uwsgi_buffer *ub) {
+	size_t base = ub->pos;
+	z_stream *z = uwsgi_websocket_zdeflate(wsgi_req);
+	if (!z) return -1;
+	z->next_in = (Bytef *) msg;
+	z->avail_in = len;
+	size_t need = (len >> 1) + 64;
+	for(;;) {
+		if (uwsgi_buffer_ensure(ub, need)) return -1;
+		z->next_out = (Bytef *) ub->buf + ub->pos;
+		z->avail_out = ub->len - ub->pos;
+		int ret = deflate(z, Z_SYNC_FLUSH);
+		if (ret != Z_OK && ret != Z_BUF_ERROR) return -1;
+		ub->pos = ub->len - z->avail_out;
+		// the flush is complete only when some output space is left
+		if (z->avail_out > 0 && z->avail_in == 0) break;
+		need = ub->len;
+	}
+	if (ub->pos - base >= 4 && !memcmp(ub->buf + ub->pos - 4, "\0\0\xff\xff", 4)) {
+		ub->pos -= 4;
+	}
+	// an empty payload is encoded as a single 0x00 byte
+	if (ub->pos == base) {
+		if (uwsgi_buffer_u8(ub, 0)) return -1;
+	}
+	if (wsgi_req->websocket_server_no_takeover) {
+		deflateReset(z);
+	}
+	wsgi_req->websocket_zlast = uwsgi_now();
+	return 0;
+}
+
+/*
+	append a compressed frame to the buffer, returns its offset
+
+	the payload is compressed leaving room for the biggest header,
+	the real header is then written just before it
+*/
+static ssize_t uwsgi_websocket_deflate_frame(struct wsgi_request *wsgi_req, struct uwsgi_buffer *ub, char *msg, size_t len, uint8_t opcode) {
+	uint8_t hdr[10];
+	size_t base = ub->pos;
+	if (uwsgi_buffer_ensure(ub, 10)) return -1;
+	ub->pos += 10;
+	if (uwsgi_websocket_deflate_do(wsgi_req, msg, len, ub)) return -1;
+	size_t hlen = uwsgi_websocket_header(hdr, opcode | 0x40, ub->pos - (base + 10));
+	memcpy(ub->buf + base + 10 - hlen, hdr, hlen);
+	return base + 10 - hlen;
+}
+
+static int uwsgi_websocket_inflate_feed(z_stream *z, struct uwsgi_buffer *ub, char *buf, size_t len) {
+	z->next_in = (Bytef *) buf;
+	z->avail_in = len;
+	for(;;) {
+		// grow by doubling, the buffer limit protects against decompression bombs
+		if (ub->pos == ub->len && uwsgi_buffer_ensure(ub, ub->len)) return -1;
+		z->next_out = (Bytef *) ub->buf + ub->pos;
+		z->avail_out = ub->len - ub->pos;
+		int ret = inflate(z, Z_SYNC_FLUSH);
+		ub->pos = ub->len - z->avail_out;
+		// a final block has been sent, the peer will start a new stream
+		if (ret == Z_STREAM_END) {
+			inflateReset(z);
+			return 0;
+		}
+		if (ret == Z_BUF_ERROR && z->avail_in == 0) return 0;
+		if (ret != Z_OK) return -1;
+		if (z->avail_in == 0 && z->avail_out > 0) return 0;
+	}
+}
+
+static struct uwsgi_buffer *uwsgi_websocket_inflate_do(struct wsgi_request *wsgi_req, char *buf, size_t len) {
+	z_stream *z = uwsgi_websocket_zinflate(wsgi_req);
+	if (!z) return NULL;
+	uint64_t max_size = uwsgi.websockets_max_size * 1024;
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(UMIN(UMAX(len * 4, 64), max_size));
+	ub->limit = max_size;
+	if (uwsgi_websocket_inflate_feed(z, ub, buf, len)) goto error;
+	if (wsgi_req->websocket_fin) {
+		if (uwsgi_websocket_inflate_feed(z, ub, "\0\0\xff\xff", 4)) goto error;
+		if (wsgi_req->websocket_client_no_takeover) {
+			inflateReset(z);
+		}
+	}
+	wsgi_req->websocket_zlast = uwsgi_now();
+	return ub;
+error:
+	uwsgi_log("[uwsgi-websocket] \"%.*s %.*s\" (%.*s) unable to inflate message\n", REQ_DATA);
+	uwsgi_buffer_destroy(ub);
+	return NULL;
+}
+
+// negotiation happens in the handshake, that requires sha1
+#ifdef UWSGI_SSL
+static int uwsgi_websocket_deflate_param(char *param, size_t len, char *name, char **value, size_t *value_len) {
+	size_t name_len = strlen(name);
+	if (len < name_len || strncasecmp(param, name, name_len)) return 0;
+	char *ptr = param + name_len;
+	size_t remains = len - name_len;
+	while (remains > 0 && isspace((int) *ptr)) { ptr++; remains--; }
+	if (remains == 0) {
+		*value = NULL;
+		*value_len = 0;
+		return 1;
+	}
+	if (*ptr != '=') return 0;
+	ptr++; remains--;
+	while (remains > 0 && isspace((int) *ptr)) { ptr++; remains--; }
+	// quoted-string form
+	if (remains >= 2 && ptr[0] == '"' && ptr[remains-1] == '"') {
+		ptr++;
+		remains -= 2;
+	}
+	*value = ptr;
+	*value_len = remains;
+	return 1;
+}
+
+static int uwsgi_websocket_deflate_bits(char *value, size_t len) {
+	if (!value || len == 0 || len > 2) return -1;
+	size_t i;
+	for (i = 0; i < len; i++) {
+		if (!isdigit((int) value[i])) return -1;
+	}
+	int bits = uwsgi_str_num(value, len);
+	if (bits < 8 || bits > 15) return -1;
+	return bits;
+}
+
+/*
+	check a single permessage-deflate offer, on success the
+	negotiated parameters are appended to the response buffer
+*/
+static int uwsgi_websocket_deflate_offer(struct wsgi_request *wsgi_req, char *offer, size_t len, struct uwsgi_buffer *ub) {
+	int server_no_takeover = uwsgi.websockets_deflate_no_context_takeover;
+	int client_no_takeover = uwsgi.websockets_deflate_no_context_takeover;
+	int server_wbits = uwsgi.websockets_deflate_window_bits;
+	int server_wbits_requested = 0;
+	int client_wbits = 15;
+	int client_wbits_allowed = 0;
+	int first = 1;
+
+	char *ctx = NULL;
+	char *p = uwsgi_concat2n(offer, len, "", 0);
+	char *param = strtok_r(p, ";", &ctx);
+	while (param) {
+		char *value = NULL;
+		size_t value_len = 0;
+		size_t param_len = strlen(param);
+		while (param_len > 0 && isspace((int) *param)) { param++; param_len--; }
+		while (param_len > 0 && isspace((int) param[param_len-1])) param_len--;
+		if (first) {
+			if (param_len != 18 || strncasecmp(param, "permessage-deflate", 18)) goto decline;
+			first = 0;
+		}
+		else if (uwsgi_websocket_deflate_param(param, param_len, "server_no_context_takeover", &value, &value_len)) {
+			if (value) goto decline;
+			server_no_takeover = 1;
+		}
+		else if (uwsgi_websocket_deflate_param(param, param_len, "client_no_context_takeover", &value, &value_len)) {
+			if (value) goto decline;
+			client_no_takeover = 1;
+		}
+		else if (uwsgi_websocket_deflate_param(param, param_len, "server_max_window_bits", &value, &value_len)) {
+			int bits = uwsgi_websocket_deflate_bits(value, value_len);
+			if (bits < 0) goto decline;
+			server_wbits = UMIN(server_wbits, bits);
+			server_wbits_requested = 1;
+		}
+		else if (uwsgi_websocket_deflate_param(param, param_len, "client_max_window_bits", &value, &value_len)) {
+			if (value) {
+				int bits = uwsgi_websocket_deflate_bits(value, value_len);
+				if (bits < 0) goto decline;
+				client_wbits = bits;
+			}
+			client_wbits_allowed = 1;
+		}
+		else {
+			goto decline;
+		}
+		param = strtok_r(NULL, ";", &ctx);
+	}
+	free(p);
+
+	// zlib raw deflate cannot use a 256 bytes window
+	if (server_wbits < 9) return -1;
+	// the client can be asked to use a smaller window (and smaller decompressor) only if it announced support
+	if (client_wbits_allowed) {
+		client_wbits = UMIN(client_wbits, uwsgi.websockets_deflate_window_bits);
+	}
+
+	if (uwsgi_buffer_append(ub, "permessage-deflate", 18)) return -1;
+	if (server_no_takeover && uwsgi_buffer_append(ub, "; server_no_context_takeover", 28)) return -1;
+	if (client_no_takeover && uwsgi_buffer_append(ub, "; client_no_context_takeover", 28)) return -1;
+	if (server_wbits_requested || server_wbits < 15) {
+		if (uwsgi_buffer_append(ub, "; server_max_window_bits=", 25)) return -1;
+		if (uwsgi_buffer_num64(ub, server_wbits)) return -1;
+	}
+	if (client_wbits_allowed && client_wbits < 15) {
+		if (uwsgi_buffer_append(ub, "; client_max_window_bits=", 25)) return -1;
+		if (uwsgi_buffer_num64(ub, client_wbits)) return -1;
+	}
+
+	wsgi_req->websocket_deflate = 1;
+	wsgi_req->websocket_server_no_takeover = server_no_takeover;
+	wsgi_req->websocket_client_no_takeover = client_no_takeover;
+	wsgi_req->websocket_server_wbits = server_wbits;
+	// without an explicit limit the client can use the whole 32k window
+	wsgi_req->websocket_client_wbits = client_wbits_allowed ? client_wbits : 15;
+	return 0;
+
+decline:
+	free(p);
+	return -1;
+}
+
+// parse Sec-WebSocket-Extensions, returns the value of the response header (or NULL)
+static struct uwsgi_buffer *uwsgi_websocket_deflate_negotiate(struct wsgi_request *wsgi_req) {
+	if (!uwsgi.websockets_deflate || !wsgi_req->http_sec_websocket_extensions_len) return NULL;
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(128);
+	char *ptr = wsgi_req->http_sec_websocket_extensions;
+	size_t remains = wsgi_req->http_sec_websocket_extensions_len;
+	// offers are in order of preference, take the first acceptable one
+	while (remains > 0) {
+		char *comma = memchr(ptr, ',', remains);
+		size_t len = comma ? (size_t) (comma - ptr) : remains;
+		ub->pos = 0;
+		if (!uwsgi_websocket_deflate_offer(wsgi_req, ptr, len, ub)) return ub;
+		if (!comma) break;
+		ptr += len + 1;
+		remains -= len + 1;
+	}
+	uwsgi_buffer_destroy(ub);
+	return NULL;
+}
+#endif
+#endif
+
 static int uwsgi_websockets_ping(struct wsgi_request *wsgi_req) {
         if (uwsgi_response_write_body_do(wsgi_req, uwsgi.websockets_ping->buf, uwsgi.websockets_ping->pos)) {
 		return -1;
@@ -56,6 +385,12 @@ static int uwsgi_websockets_pong(struct wsgi_request *wsgi_req) {
 
 static int uwsgi_websockets_check_pingpong(struct wsgi_request *wsgi_req) {
 	time_t now = uwsgi_now();
+#ifdef UWSGI_ZLIB
+	// this is the periodic hook of the connection, use it for releasing idle compression state too
+	if (wsgi_req->websocket_deflate) {
+		uwsgi_websocket_deflate_idle(wsgi_req);
+	}
+#endif
 	// first round
 	if (wsgi_req->websocket_last_ping == 0) {
 		return uwsgi_websockets_ping(wsgi_req);
@@ -75,7 +410,28 @@ static int uwsgi_websockets_check_pingpong(struct wsgi_request *wsgi_req) {
 	return 0;
 }
 
+#ifdef UWSGI_ZLIB
+static int uwsgi_websocket_send_deflated(struct wsgi_request *wsgi_req, char *msg, size_t len, uint8_t opcode, struct uwsgi_sharedarea *sa) {
+	struct uwsgi_buffer *ub = wsgi_req->websocket_send_buf;
+	if (!ub) {
+		wsgi_req->websocket_send_buf = uwsgi_buffer_new(10 + len);
+		ub = wsgi_req->websocket_send_buf;
+	}
+	ub->pos = 0;
+	if (sa) uwsgi_rlock(sa->lock);
+	ssize_t offset = uwsgi_websocket_deflate_frame(wsgi_req, ub, msg, len, opcode);
+	if (sa) uwsgi_rwunlock(sa->lock);
+	if (offset < 0) return -1;
+	return uwsgi_response_write_body_do(wsgi_req, ub->buf + offset, ub->pos - offset);
+}
+#endif
+
 static int uwsgi_websocket_send_do(struct wsgi_request *wsgi_req, char *msg, size_t len, uint8_t opcode) {
+#ifdef UWSGI_ZLIB
+	if (wsgi_req->websocket_deflate && len >= uwsgi.websockets_deflate_min_size) {
+		return uwsgi_websocket_send_deflated(wsgi_req, msg, len, opcode, NULL);
+	}
+#endif
 	struct uwsgi_buffer *ub = uwsgi_websocket_message(wsgi_req, msg, len, opcode);
 	if (!ub) return -1;
 
@@ -88,6 +444,12 @@ static int uwsgi_websocket_send_from_sharedarea_do(struct wsgi_request *wsgi_req
 	if (!len) {
 		len = sa->honour_used ? sa->used-pos : ((sa->max_pos+1)-pos);
 	}
+#ifdef UWSGI_ZLIB
+	if (wsgi_req->websocket_deflate && len >= uwsgi.websockets_deflate_min_size) {
+		sa->hits++;
+		return uwsgi_websocket_send_deflated(wsgi_req, sa->area, len, opcode, sa);
+	}
+#endif
 	uwsgi_rlock(sa->lock);
 	sa->hits++;
         struct uwsgi_buffer *ub = uwsgi_websocket_message(wsgi_req, sa->area, len, opcode);
@@ -97,6 +459,108 @@ static int uwsgi_websocket_send_from_sharedarea_do(struct wsgi_request *wsgi_req
         return uwsgi_response_write_body_do(wsgi_req, ub->buf, ub->pos);
 }
 
+/*
+	send multiple messages with a single writev() per batch (payloads are only referenced, not copied)
+*/
+#ifdef UWSGI_ZLIB
+/*
+	compressed variant: all of the frames of a batch are built in a single buffer
+	and then sent with one writev() (frames are not contiguous as every compressed one
+	leaves some unused space before its header)
+*/
+static int uwsgi_websocket_send_many_deflated(struct wsgi_request *wsgi_req, struct iovec *msgs, size_t n, uint8_t opcode, size_t batch) {
+	size_t i, base;
+	int ret = 0;
+	uint8_t hdr[10];
+
+	struct iovec *iov = uwsgi_malloc(sizeof(struct iovec) * UMIN(n, batch));
+	size_t *offsets = uwsgi_malloc(sizeof(size_t) * 2 * UMIN(n, batch));
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(uwsgi.page_size);
+
+	for (base = 0; base < n; base += batch) {
+		size_t cnt = UMIN(batch, n - base);
+		ub->pos = 0;
+		for (i = 0; i < cnt; i++) {
+			struct iovec *msg = &msgs[base + i];
+			if (msg->iov_len >= uwsgi.websockets_deflate_min_size) {
+				ssize_t offset = uwsgi_websocket_deflate_frame(wsgi_req, ub, msg->iov_base, msg->iov_len, opcode);
+				if (offset < 0) {
+					ret = -1;
+					goto end;
+				}
+				offsets[i * 2] = offset;
+			}
+			else {
+				offsets[i * 2] = ub->pos;
+				size_t hlen = uwsgi_websocket_header(hdr, opcode, msg->iov_len);
+				if (uwsgi_buffer_append(ub, (char *) hdr, hlen) || uwsgi_buffer_append(ub, msg->iov_base, msg->iov_len)) {
+					ret = -1;
+					goto end;
+				}
+			}
+			offsets[(i * 2) + 1] = ub->pos;
+		}
+		// the buffer could have been reallocated, build the vector only now
+		for (i = 0; i < cnt; i++) {
+			iov[i].iov_base = ub->buf + offsets[i * 2];
+			iov[i].iov_len = offsets[(i * 2) + 1] - offsets[i * 2];
+		}
+		ret = uwsgi_response_writev_body_do(wsgi_req, iov, cnt);
+		if (ret < 0) break;
+	}
+
+end:
+	uwsgi_buffer_destroy(ub);
+	free(offsets);
+	free(iov);
+	return ret;
+}
+#endif
+
+static int uwsgi_websocket_send_many_do(struct wsgi_request *wsgi_req, struct iovec *msgs, size_t n, uint8_t opcode) {
+	// stay below the common IOV_MAX (1024)
+	size_t batch = 512;
+	size_t i, base;
+	int ret = 0;
+
+#ifdef UWSGI_ZLIB
+	if (wsgi_req->websocket_deflate) {
+		return uwsgi_websocket_send_many_deflated(wsgi_req, msgs, n, opcode, batch);
+	}
+#endif
+
+	struct iovec *iov = uwsgi_malloc(sizeof(struct iovec) * 2 * UMIN(n, batch));
+	uint8_t *hdrs = uwsgi_malloc(10 * UMIN(n, batch));
+
+	for (base = 0; base < n; base += batch) {
+		size_t cnt = UMIN(batch, n - base);
+		for (i = 0; i < cnt; i++) {
+			uint8_t *hdr = hdrs + (10 * i);
+			iov[i * 2].iov_base = hdr;
+			iov[i * 2].iov_len = uwsgi_websocket_header(hdr, opcode, msgs[base + i].iov_len);
+			iov[(i * 2) + 1] = msgs[base + i];
+		}
+		ret = uwsgi_response_writev_body_do(wsgi_req, iov, cnt * 2);
+		if (ret < 0) break;
+	}
+
+	free(iov);
+	free(hdrs);
+	return ret;
+}
+
+int uwsgi_websocket_send_many(struct wsgi_request *wsgi_req, struct iovec *msgs, size_t n, int binary) {
+	if (wsgi_req->websocket_closed) {
+		return -1;
+	}
+	if (n == 0) return 0;
+	int ret = uwsgi_websocket_send_many_do(wsgi_req, msgs, n, binary ? 0x82 : 0x81);
+	if (ret < 0) {
+		wsgi_req->websocket_closed = 1;
+	}
+	return ret;
+}
+
 int uwsgi_websocket_send(struct wsgi_request *wsgi_req, char *msg, size_t len) {
 	if (wsgi_req->websocket_closed) {
                 return -1;
@@ -145,24 +609,81 @@ static void uwsgi_websocket_parse_header(struct wsgi_request *wsgi_req) {
 	uint8_t byte1 = wsgi_req->websocket_buf->buf[0];
 	uint8_t byte2 = wsgi_req->websocket_buf->buf[1];
 	wsgi_req->websocket_opcode = byte1 & 0xf;
+	wsgi_req->websocket_fin = byte1 >> 7;
+	wsgi_req->websocket_rsv1 = (byte1 >> 6) & 1;
 	wsgi_req->websocket_has_mask = byte2 >> 7;
 	wsgi_req->websocket_size = byte2 & 0x7f;
 }
 
+/*
+	xor the payload with the 4 bytes mask, 16 bytes (SSE2/NEON) or 8 bytes at a time
+	(the mask is replicated, so every block starts at mask phase 0)
+*/
+static void uwsgi_websocket_unmask(uint8_t *ptr, size_t len, uint8_t *mask) {
+	size_t i = 0;
+	uint8_t m[16];
+	for (i = 0; i < 16; i++) m[i] = mask[i % 4];
+	i = 0;
+#if defined(__SSE2__)
+	__m128i m128 = _mm_loadu_si128((__m128i *) m);
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((__m128i *) (ptr + i));
+		_mm_storeu_si128((__m128i *) (ptr + i), _mm_xor_si128(v, m128));
+	}
+#elif defined(__ARM_NEON)
+	uint8x16_t m128 = vld1q_u8(m);
+	for (; i + 16 <= len; i += 16) {
+		vst1q_u8(ptr + i, veorq_u8(vld1q_u8(ptr + i), m128));
+	}
+#endif
+	uint64_t m64;
+	memcpy(&m64, m, 8);
+	for (; i + 8 <= len; i += 8) {
+		uint64_t v;
+		memcpy(&v, ptr + i, 8);
+		v ^= m64;
+		memcpy(ptr + i, &v, 8);
+	}
+	for (; i < len; i++) {
+		ptr[i] ^= m[i % 4];
+	}
+}
+
 static struct uwsgi_buffer *uwsgi_websockets_parse(struct wsgi_request *wsgi_req) {
 	// de-mask buffer
 	uint8_t *ptr = (uint8_t *) (wsgi_req->websocket_buf->buf + (wsgi_req->websocket_pktsize - wsgi_req->websocket_size));
-	size_t i;
 
 	if (wsgi_req->websocket_has_mask) {
-		uint8_t *mask = ptr-4;
-		for(i=0;i<wsgi_req->websocket_size;i++) {
-			ptr[i] = ptr[i] ^ mask[i%4];	
+		uwsgi_websocket_unmask(ptr, wsgi_req->websocket_size, ptr - 4);
+	}
+
+	struct uwsgi_buffer *ub = NULL;
+	// RSV1 marks the first frame of a compressed message
+	if (wsgi_req->websocket_rsv1) {
+		if (!wsgi_req->websocket_deflate || wsgi_req->websocket_opcode == 0) {
+			uwsgi_log("[uwsgi-websocket] \"%.*s %.*s\" (%.*s) unexpected RSV1 bit in frame\n", REQ_DATA);
+			return NULL;
 		}
+		wsgi_req->websocket_compressed = 1;
+	}
+	else if (wsgi_req->websocket_opcode != 0) {
+		wsgi_req->websocket_compressed = 0;
 	}
 
-	struct uwsgi_buffer *ub = uwsgi_buffer_new(wsgi_req->websocket_size);
-	if (uwsgi_buffer_append(ub, (char *) ptr, wsgi_req->websocket_size)) goto error;	
+#ifdef UWSGI_ZLIB
+	if (wsgi_req->websocket_compressed) {
+		ub = uwsgi_websocket_inflate_do(wsgi_req, (char *) ptr, wsgi_req->websocket_size);
+		if (wsgi_req->websocket_fin) {
+			wsgi_req->websocket_compressed = 0;
+		}
+		if (!ub) return NULL;
+	}
+	else
+#endif
+	{
+		ub = uwsgi_buffer_new(wsgi_req->websocket_size);
+		if (uwsgi_buffer_append(ub, (char *) ptr, wsgi_req->websocket_size)) goto error;
+	}
 	if (uwsgi_buffer_decapitate(wsgi_req->websocket_buf, wsgi_req->websocket_pktsize)) goto error;
 	wsgi_req->websocket_phase = 0;
 	wsgi_req->websocket_need = 2;
@@ -415,6 +936,15 @@ int uwsgi_websocket_handshake(struct wsgi_request *wsgi_req, char *key, uint16_t
 	}
 	free(b64);
 
+#ifdef UWSGI_ZLIB
+	struct uwsgi_buffer *extensions = uwsgi_websocket_deflate_negotiate(wsgi_req);
+	if (extensions) {
+		int ret = uwsgi_response_add_header(wsgi_req, "Sec-WebSocket-Extensions", 24, extensions->buf, extensions->pos);
+		uwsgi_buffer_destroy(extensions);
+		if (ret) return -1;
+	}
+#endif
+
 	wsgi_req->websocket_last_pong = uwsgi_now();
 
 	return uwsgi_response_write_headers_do(wsgi_req);
@@ -432,4 +962,706 @@ void uwsgi_websockets_init() {
 	uwsgi.websockets_ping_freq = 30;
 	uwsgi.websockets_pong_tolerance = 3;
 	uwsgi.websockets_max_size = 1024;
+#ifdef UWSGI_ZLIB
+	uwsgi.websockets_deflate_window_bits = 15;
+	uwsgi.websockets_deflate_mem_level = 8;
+	uwsgi.websockets_deflate_level = Z_DEFAULT_COMPRESSION;
+	uwsgi.websockets_deflate_min_size = 64;
+#endif
+}
+
+
+/*
+
+	offloaded websockets (--websockets-offload)
+
+	after the handshake a worker can hand a websocket over to one of its offload threads,
+	freeing the core. The thread (the "hub") answers pings, checks pongs, keeps the channel
+	subscriptions and forwards the received messages as plain requests to
+	--websockets-offload-forward. Idle connections only cost the offload request and the session
+	structure (parser and output buffers are allocated only when data is pending).
+
+	any process can publish a message to a channel: records are appended to a shared ring
+	and every hub is woken up with a byte on its socketpair (created in the master,
+	so they are inherited by workers, mules and spoolers).
+
+*/
+
+#define UWSGI_WEBSOCKETS_HUB_BUCKETS 4096
+#define uwsgi_websockets_hub_retry if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS) return 0;
+
+struct uwsgi_websocket_session;
+
+struct uwsgi_websocket_channel {
+	char *name;
+	uint16_t name_len;
+	struct uwsgi_websocket_subscription *subscriptions;
+	struct uwsgi_websocket_channel *next;
+};
+
+struct uwsgi_websocket_subscription {
+	struct uwsgi_websocket_channel *channel;
+	struct uwsgi_offload_request *uor;
+	struct uwsgi_websocket_subscription *prev;
+	struct uwsgi_websocket_subscription *next;
+};
+
+struct uwsgi_websockets_hub {
+	struct uwsgi_thread *ut;
+	int wake_fd;
+	uint64_t cursor;
+	time_t last_tick;
+	struct uwsgi_websocket_channel *channels[UWSGI_WEBSOCKETS_HUB_BUCKETS];
+	struct uwsgi_websocket_session *sessions;
+	// published records are copied here (leaving room for the frame header)
+	struct uwsgi_buffer *record;
+	char *rbuf;
+	size_t rbuf_len;
+};
+
+struct uwsgi_websocket_session {
+	uint64_t id;
+	struct uwsgi_offload_request *uor;
+	struct uwsgi_websockets_hub *hub;
+	// partial frames and unsent data
+	struct uwsgi_buffer *in;
+	struct uwsgi_buffer *out;
+	time_t last_ping;
+	time_t last_pong;
+	// the opcode of the message being received (for continuation frames)
+	uint8_t opcode;
+	// the data for forwarded requests
+	char *uri;
+	uint16_t uri_len;
+	char *remote_addr;
+	uint16_t remote_addr_len;
+	char *channels;
+	uint16_t channels_len;
+	uint16_t subscriptions_cnt;
+	struct uwsgi_websocket_subscription *subscriptions;
+	struct uwsgi_websocket_session *prev;
+	struct uwsgi_websocket_session *next;
+};
+
+static void ws_ring_copy_in(struct uwsgi_websockets_ring *ring, uint64_t pos, void *buf, uint64_t len) {
+	uint64_t off = pos % ring->size;
+	uint64_t chunk = ring->size - off;
+	if (chunk > len) chunk = len;
+	memcpy(ring->data + off, buf, chunk);
+	if (len > chunk) memcpy(ring->data, (char *) buf + chunk, len - chunk);
+}
+
+static void ws_ring_copy_out(struct uwsgi_websockets_ring *ring, uint64_t pos, void *buf, uint64_t len) {
+	uint64_t off = pos % ring->size;
+	uint64_t chunk = ring->size - off;
+	if (chunk > len) chunk = len;
+	memcpy(buf, ring->data + off, chunk);
+	if (len > chunk) memcpy((char *) buf + chunk, ring->data, len - chunk);
+}
+
+void uwsgi_websockets_hub_setup() {
+	if (!uwsgi.websockets_offload) return;
+	if (uwsgi.offload_threads < 1) {
+		uwsgi_log("--websockets-offload requires offload threads (--offload-threads)\n");
+		exit(1);
+	}
+	if (!uwsgi.websockets_offload_ring) uwsgi.websockets_offload_ring = 1024 * 1024;
+	if (!uwsgi.websockets_offload_max_pending) uwsgi.websockets_offload_max_pending = 256 * 1024;
+
+	struct uwsgi_websockets_ring *ring = uwsgi_calloc_shared(sizeof(struct uwsgi_websockets_ring));
+	ring->size = uwsgi.websockets_offload_ring;
+	ring->data = uwsgi_calloc_shared(ring->size);
+	ring->lock = uwsgi_rwlock_init("websockets ring");
+	uwsgi.websockets_ring = ring;
+
+	int i, j;
+	for (i = 1; i <= uwsgi.numproc; i++) {
+		uwsgi.workers[i].websockets_hub_pipes = uwsgi_malloc(sizeof(int) * 2 * uwsgi.offload_threads);
+		for (j = 0; j < uwsgi.offload_threads; j++) {
+			create_signal_pipe(&uwsgi.workers[i].websockets_hub_pipes[j * 2]);
+		}
+	}
+	uwsgi_log("websockets offloading enabled (publishing ring: %llu bytes)\n", (unsigned long long) ring->size);
+}
+
+/*
+	record: [u32 payload size][u16 channel size][u8 opcode][u8 reserved][channel][payload]
+*/
+int uwsgi_websocket_publish(char *channel, uint16_t channel_len, char *msg, size_t len, int binary) {
+	struct uwsgi_websockets_ring *ring = uwsgi.websockets_ring;
+	if (!ring) return -1;
+	uint64_t total = 8 + channel_len + len;
+	if (total > ring->size / 2) {
+		uwsgi_log("[uwsgi-websocket] message too big for the publishing ring (%llu bytes)\n", (unsigned long long) len);
+		return -1;
+	}
+	uint8_t hdr[8];
+	uint32_t len32 = len;
+	memcpy(hdr, &len32, 4);
+	memcpy(hdr + 4, &channel_len, 2);
+	hdr[6] = binary ? 0x82 : 0x81;
+	hdr[7] = 0;
+
+	uwsgi_wlock(ring->lock);
+	ws_ring_copy_in(ring, ring->head, hdr, 8);
+	ws_ring_copy_in(ring, ring->head + 8, channel, channel_len);
+	ws_ring_copy_in(ring, ring->head + 8 + channel_len, msg, len);
+	ring->head += total;
+	uwsgi_rwunlock(ring->lock);
+
+	// wake up the hubs (a full socketpair means a wakeup is already pending)
+	int i, j;
+	for (i = 1; i <= uwsgi.numproc; i++) {
+		if (!uwsgi.workers[i].websockets_hub_pipes) continue;
+		for (j = 0; j < uwsgi.offload_threads; j++) {
+			if (write(uwsgi.workers[i].websockets_hub_pipes[j * 2], "", 1) < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+				uwsgi_error("uwsgi_websocket_publish()/write()");
+			}
+		}
+	}
+	return 0;
+}
+
+static struct uwsgi_websocket_channel *uwsgi_websockets_hub_channel(struct uwsgi_websockets_hub *hub, char *name, uint16_t name_len, int create) {
+	uint32_t bucket = djb33x_hash(name, name_len) % UWSGI_WEBSOCKETS_HUB_BUCKETS;
+	struct uwsgi_websocket_channel *channel = hub->channels[bucket];
+	while (channel) {
+		if (!uwsgi_strncmp(channel->name, channel->name_len, name, name_len)) return channel;
+		channel = channel->next;
+	}
+	if (!create) return NULL;
+	channel = uwsgi_calloc(sizeof(struct uwsgi_websocket_channel));
+	channel->name = uwsgi_concat2n(name, name_len, "", 0);
+	channel->name_len = name_len;
+	channel->next = hub->channels[bucket];
+	hub->channels[bucket] = channel;
+	return channel;
+}
+
+static void uwsgi_websockets_hub_channel_release(struct uwsgi_websockets_hub *hub, struct uwsgi_websocket_channel *channel) {
+	if (channel->subscriptions) return;
+	uint32_t bucket = djb33x_hash(channel->name, channel->name_len) % UWSGI_WEBSOCKETS_HUB_BUCKETS;
+	struct uwsgi_websocket_channel **ptr = &hub->channels[bucket];
+	while (*ptr) {
+		if (*ptr == channel) {
+			*ptr = channel->next;
+			break;
+		}
+		ptr = &(*ptr)->next;
+	}
+	free(channel->name);
+	free(channel);
+}
+
+static struct uwsgi_websockets_hub *uwsgi_websockets_hub_get(struct uwsgi_thread *ut) {
+	if (ut->offload_hub) return ut->offload_hub;
+	struct uwsgi_websockets_hub *hub = uwsgi_calloc(sizeof(struct uwsgi_websockets_hub));
+	int t = (struct uwsgi_offload_thread_stats *) ut->data - uwsgi.workers[uwsgi.mywid].offload_stats;
+	hub->ut = ut;
+	hub->wake_fd = uwsgi.workers[uwsgi.mywid].websockets_hub_pipes[(t * 2) + 1];
+	if (event_queue_add_fd_read(ut->queue, hub->wake_fd)) {
+		free(hub);
+		return NULL;
+	}
+	uwsgi_rlock(uwsgi.websockets_ring->lock);
+	hub->cursor = uwsgi.websockets_ring->head;
+	uwsgi_rwunlock(uwsgi.websockets_ring->lock);
+	hub->record = uwsgi_buffer_new(uwsgi.page_size);
+	hub->rbuf_len = 32768;
+	hub->rbuf = uwsgi_malloc(hub->rbuf_len);
+	hub->last_tick = uwsgi_now();
+	ut->offload_hub = hub;
+	return hub;
+}
+
+// write (or queue) data for a session
+static int uwsgi_websocket_session_write(struct uwsgi_thread *ut, struct uwsgi_offload_request *uor, char *buf, size_t len) {
+	struct uwsgi_websocket_session *session = (struct uwsgi_websocket_session *) uor->data;
+	ssize_t wlen = 0;
+	if (!session->out || session->out->pos == 0) {
+		wlen = write(uor->s, buf, len);
+		if (wlen == (ssize_t) len) {
+			uor->written += wlen;
+			return 0;
+		}
+		if (wlen < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINPROGRESS) return -1;
+			wlen = 0;
+		}
+		uor->written += wlen;
+		if (!session->out) session->out = uwsgi_buffer_new(len - wlen);
+		if (event_queue_fd_read_to_readwrite(ut->queue, uor->s)) return -1;
+	}
+	if (session->out->pos + (len - wlen) > uwsgi.websockets_offload_max_pending) {
+		uwsgi_log("[uwsgi-websocket] offloaded websocket %llu is too slow, closing it\n", (unsigned long long) session->id);
+		return -1;
+	}
+	return uwsgi_buffer_append(session->out, buf + wlen, len - wlen);
+}
+
+static int uwsgi_websocket_session_flush(struct uwsgi_thread *ut, struct uwsgi_offload_request *uor) {
+	struct uwsgi_websocket_session *session = (struct uwsgi_websocket_session *) uor->data;
+	if (!session->out || session->out->pos == 0) return 0;
+	ssize_t wlen = write(uor->s, session->out->buf, session->out->pos);
+	if (wlen < 0) {
+		uwsgi_websockets_hub_retry
+		return -1;
+	}
+	uor->written += wlen;
+	if (uwsgi_buffer_decapitate(session->out, wlen)) return -1;
+	if (session->out->pos == 0) {
+		// release the memory of (now) idle connections
+		uwsgi_buffer_destroy(session->out);
+		session->out = NULL;
+		if (event_queue_fd_readwrite_to_read(ut->queue, uor->s)) return -1;
+	}
+	return 0;
+}
+
+static int uwsgi_websocket_session_ping(struct uwsgi_thread *ut, struct uwsgi_offload_request *uor) {
+	struct uwsgi_websocket_session *session = (struct uwsgi_websocket_session *) uor->data;
+	session->last_ping = uwsgi_now();
+	return uwsgi_websocket_session_write(ut, uor, uwsgi.websockets_ping->buf, uwsgi.websockets_ping->pos);
+}
+
+/*
+	forward a received message to --websockets-offload-forward (the response is discarded)
+
+	status:
+		0 -> sending the request (write event)
+		1 -> waiting for the end of the response
+*/
+static int uwsgi_websocket_forward_do(struct uwsgi_thread *ut, struct uwsgi_offload_request *uor, int fd) {
+	if (fd == -1) {
+		return event_queue_add_fd_write(ut->queue, uor->fd);
+	}
+	if (uor->status == 0) {
+		ssize_t wlen = write(uor->fd, uor->ubuf->buf + uor->pos, uor->ubuf->pos - uor->pos);
+		if (wlen <= 0) {
+			if (wlen < 0) {
+				uwsgi_websockets_hub_retry
+				uwsgi_error("uwsgi_websocket_forward_do()/write()");
+			}
+			return -1;
+		}
+		uor->pos += wlen;
+		if ((size_t) uor->pos >= uor->ubuf->pos) {
+			uor->status = 1;
+			return event_queue_fd_write_to_read(ut->queue, uor->fd);
+		}
+		return 0;
+	}
+	char buf[4096];
+	ssize_t rlen = read(uor->fd, buf, 4096);
+	if (rlen > 0) return 0;
+	if (rlen < 0) {
+		uwsgi_websockets_hub_retry
+	}
+	return -1;
+}
+
+static struct uwsgi_offload_engine uwsgi_websocket_forward_engine = {
+	.name = "websocket-forward",
+	.event_func = uwsgi_websocket_forward_do,
+};
+
+static void uwsgi_websocket_session_forward(struct uwsgi_thread *ut, struct uwsgi_websocket_session *session, uint8_t opcode, uint8_t fin, char *payload, size_t len) {
+	if (!uwsgi.websockets_offload_forward) return;
+
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(uwsgi.page_size + len);
+	// leave space for the uwsgi header
+	ub->pos = 4;
+	if (uwsgi_buffer_append_keyval(ub, "REQUEST_METHOD", 14, "POST", 4)) goto error;
+	if (uwsgi_buffer_append_keyval(ub, "REQUEST_URI", 11, session->uri, session->uri_len)) goto error;
+	char *qs = memchr(session->uri, '?', session->uri_len);
+	uint16_t path_len = qs ? qs - session->uri : session->uri_len;
+	if (uwsgi_buffer_append_keyval(ub, "PATH_INFO", 9, session->uri, path_len)) goto error;
+	if (uwsgi_buffer_append_keyval(ub, "QUERY_STRING", 12, qs ? qs + 1 : "", qs ? session->uri_len - (path_len + 1) : 0)) goto error;
+	if (uwsgi_buffer_append_keyval(ub, "SERVER_PROTOCOL", 15, "HTTP/1.0", 8)) goto error;
+	if (uwsgi_buffer_append_keyval(ub, "SERVER_NAME", 11, uwsgi.hostname, uwsgi.hostname_len)) goto error;
+	if (uwsgi_buffer_append_keyval(ub, "SERVER_PORT", 11, "0", 1)) goto error;
+	if (uwsgi_buffer_append_keyval(ub, "REMOTE_ADDR", 11, session->remote_addr, session->remote_addr_len)) goto error;
+	if (uwsgi_buffer_append_keynum(ub, "CONTENT_LENGTH", 14, len)) goto error;
+	if (uwsgi_buffer_append_keyval(ub, "CONTENT_TYPE", 12, "application/octet-stream", 24)) goto error;
+	if (uwsgi_buffer_append_keynum(ub, "UWSGI_WEBSOCKET_ID", 18, session->id)) goto error;
+	if (uwsgi_buffer_append_keyval(ub, "UWSGI_WEBSOCKET_CHANNELS", 24, session->channels, session->channels_len)) goto error;
+	if (uwsgi_buffer_append_keynum(ub, "UWSGI_WEBSOCKET_OPCODE", 22, opcode)) goto error;
+	if (uwsgi_buffer_append_keynum(ub, "UWSGI_WEBSOCKET_FIN", 19, fin)) goto error;
+	if (ub->pos - 4 > 0xffff) goto error;
+	if (uwsgi_buffer_set_uh(ub, 0, 0)) goto error;
+	if (uwsgi_buffer_append(ub, payload, len)) goto error;
+
+	struct uwsgi_offload_request *uor = uwsgi_calloc(sizeof(struct uwsgi_offload_request));
+	uor->engine = &uwsgi_websocket_forward_engine;
+	uor->s = -1;
+	uor->fd2 = -1;
+	uor->pipe[0] = -1;
+	uor->pipe[1] = -1;
+	uor->ubuf = ub;
+	uor->fd = uwsgi_connect(uwsgi.websockets_offload_forward, 0, 1);
+	if (uor->fd < 0) {
+		uwsgi_error("uwsgi_websocket_session_forward()/connect()");
+		free(uor);
+		goto error;
+	}
+	// the task is accounted as every other one (uwsgi_offload_close() will do the opposite)
+	struct uwsgi_offload_thread_stats *uots = (struct uwsgi_offload_thread_stats *) ut->data;
+	__sync_add_and_fetch(&uots->active, 1);
+	if (uor->engine->event_func(ut, uor, -1)) {
+		uwsgi_offload_close(ut, uor);
+		return;
+	}
+	uwsgi_offload_append(ut, uor);
+	return;
+error:
+	uwsgi_buffer_destroy(ub);
+}
+
+// parse the frames in the buffer, returns the number of consumed bytes
+static ssize_t uwsgi_websocket_session_parse(struct uwsgi_thread *ut, struct uwsgi_offload_request *uor, char *buf, size_t len) {
+	struct uwsgi_websocket_session *session = (struct uwsgi_websocket_session *) uor->data;
+	size_t pos = 0;
+	while (len - pos >= 2) {
+		uint8_t byte1 = buf[pos];
+		uint8_t byte2 = buf[pos + 1];
+		uint8_t opcode = byte1 & 0xf;
+		uint8_t fin = byte1 >> 7;
+		uint64_t size = byte2 & 0x7f;
+		size_t hlen = 2;
+		// no extensions are negotiated for offloaded websockets
+		if (byte1 & 0x70) {
+			uwsgi_log("[uwsgi-websocket] offloaded websocket %llu: unexpected RSV bits\n", (unsigned long long) session->id);
+			return -1;
+		}
+		if (size == 126) {
+			if (len - pos < 4) break;
+			size = uwsgi_be16(buf + pos + 2);
+			hlen = 4;
+		}
+		else if (size == 127) {
+			if (len - pos < 10) break;
+			size = uwsgi_be64(buf + pos + 2);
+			hlen = 10;
+		}
+		if (size > (uwsgi.websockets_max_size * 1024)) {
+			uwsgi_log("[uwsgi-websocket] offloaded websocket %llu: invalid packet size received: %llu, max allowed: %llu\n", (unsigned long long) session->id, (unsigned long long) size, (unsigned long long) uwsgi.websockets_max_size * 1024);
+			return -1;
+		}
+		if (byte2 >> 7) hlen += 4;
+		if (len - pos < hlen + size) break;
+
+		uint8_t *payload = (uint8_t *) buf + pos + hlen;
+		if (byte2 >> 7) {
+			uwsgi_websocket_unmask(payload, size, payload - 4);
+		}
+		uint8_t hdr[10];
+		size_t plen;
+		switch (opcode) {
+			case 0:
+			case 1:
+			case 2:
+				if (opcode) session->opcode = opcode;
+				uwsgi_websocket_session_forward(ut, session, opcode, fin, (char *) payload, size);
+				break;
+			// close, send it back
+			case 0x8:
+				uwsgi_websocket_session_write(ut, uor, "\x88\0", 2);
+				return -1;
+			case 0x9:
+				plen = uwsgi_websocket_header(hdr, 0x8A, size);
+				if (uwsgi_websocket_session_write(ut, uor, (char *) hdr, plen)) return -1;
+				if (size > 0 && uwsgi_websocket_session_write(ut, uor, (char *) payload, size)) return -1;
+				break;
+			case 0xA:
+				session->last_pong = uwsgi_now();
+				break;
+			default:
+				break;
+		}
+		pos += hlen + size;
+	}
+	return pos;
+}
+
+static void uwsgi_websocket_session_free(struct uwsgi_offload_request *uor) {
+	struct uwsgi_websocket_session *session = (struct uwsgi_websocket_session *) uor->data;
+	if (!session) return;
+	struct uwsgi_websockets_hub *hub = session->hub;
+	uint16_t i;
+	for (i = 0; i < session->subscriptions_cnt; i++) {
+		struct uwsgi_websocket_subscription *sub = &session->subscriptions[i];
+		if (!sub->channel) continue;
+		if (sub->prev) sub->prev->next = sub->next;
+		else sub->channel->subscriptions = sub->next;
+		if (sub->next) sub->next->prev = sub->prev;
+		uwsgi_websockets_hub_channel_release(hub, sub->channel);
+	}
+	if (hub) {
+		if (session->prev) session->prev->next = session->next;
+		else if (hub->sessions == session) hub->sessions = session->next;
+		if (session->next) session->next->prev = session->prev;
+	}
+	if (session->in) uwsgi_buffer_destroy(session->in);
+	if (session->out) uwsgi_buffer_destroy(session->out);
+	free(session->subscriptions);
+	free(session->uri);
+	free(session->remote_addr);
+	free(session->channels);
+	free(session);
+	uor->data = NULL;
+}
+
+/*
+
+	websocket offload engine:
+		s -> the websocket
+		data -> the session (allocated by uwsgi_websocket_offload())
+		ubuf -> already received (but still unparsed) data
+
+*/
+int uwsgi_websocket_offload_prepare(struct wsgi_request *wsgi_req, struct uwsgi_offload_request *uor) {
+	if (!uor->data || !uwsgi.websockets_ring) return -1;
+	uor->free = uwsgi_websocket_session_free;
+	return 0;
+}
+
+static int uwsgi_websocket_session_start(struct uwsgi_thread *ut, struct uwsgi_offload_request *uor) {
+	struct uwsgi_websocket_session *session = (struct uwsgi_websocket_session *) uor->data;
+	struct uwsgi_websockets_hub *hub = uwsgi_websockets_hub_get(ut);
+	if (!hub) return -1;
+	session->uor = uor;
+	session->hub = hub;
+	session->next = hub->sessions;
+	if (hub->sessions) hub->sessions->prev = session;
+	hub->sessions = session;
+
+	// subscribe to channels
+	char *ctx = NULL;
+	char *channels = uwsgi_concat2n(session->channels, session->channels_len, "", 0);
+	char *p = strtok_r(channels, ",", &ctx);
+	uint16_t i = 0;
+	while (p && i < session->subscriptions_cnt) {
+		size_t len = strlen(p);
+		struct uwsgi_websocket_channel *channel = NULL;
+		if (len > 0 && len <= 0xffff) {
+			channel = uwsgi_websockets_hub_channel(hub, p, len, 1);
+		}
+		// skip duplicates
+		uint16_t j;
+		for (j = 0; channel && j < i; j++) {
+			if (session->subscriptions[j].channel == channel) channel = NULL;
+		}
+		if (channel) {
+			struct uwsgi_websocket_subscription *sub = &session->subscriptions[i++];
+			sub->channel = channel;
+			sub->uor = uor;
+			sub->next = sub->channel->subscriptions;
+			if (sub->next) sub->next->prev = sub;
+			sub->channel->subscriptions = sub;
+		}
+		p = strtok_r(NULL, ",", &ctx);
+	}
+	free(channels);
+
+	if (event_queue_add_fd_read(ut->queue, uor->s)) return -1;
+	// the worker could have already read some frame
+	if (uor->ubuf && uor->ubuf->pos > 0) {
+		ssize_t consumed = uwsgi_websocket_session_parse(ut, uor, uor->ubuf->buf, uor->ubuf->pos);
+		if (consumed < 0) return -1;
+		if (uwsgi_buffer_decapitate(uor->ubuf, consumed)) return -1;
+		if (uor->ubuf->pos > 0) {
+			session->in = uor->ubuf;
+			uor->ubuf = NULL;
+		}
+	}
+	if (uor->ubuf) {
+		uwsgi_buffer_destroy(uor->ubuf);
+		uor->ubuf = NULL;
+	}
+	return 0;
+}
+
+int uwsgi_websocket_offload_do(struct uwsgi_thread *ut, struct uwsgi_offload_request *uor, int fd) {
+	if (fd == -1) {
+		return uwsgi_websocket_session_start(ut, uor);
+	}
+
+	struct uwsgi_websocket_session *session = (struct uwsgi_websocket_session *) uor->data;
+	struct uwsgi_websockets_hub *hub = session->hub;
+
+	// we do not know if it is a read or a write event, try both
+	if (uwsgi_websocket_session_flush(ut, uor)) return -1;
+
+	ssize_t rlen = read(uor->s, hub->rbuf, hub->rbuf_len);
+	if (rlen == 0) return -1;
+	if (rlen < 0) {
+		uwsgi_websockets_hub_retry
+		return -1;
+	}
+
+	char *buf = hub->rbuf;
+	size_t len = rlen;
+	if (session->in) {
+		if (uwsgi_buffer_append(session->in, hub->rbuf, rlen)) return -1;
+		buf = session->in->buf;
+		len = session->in->pos;
+	}
+	ssize_t consumed = uwsgi_websocket_session_parse(ut, uor, buf, len);
+	if (consumed < 0) return -1;
+	if (session->in) {
+		if (uwsgi_buffer_decapitate(session->in, consumed)) return -1;
+		if (session->in->pos == 0) {
+			uwsgi_buffer_destroy(session->in);
+			session->in = NULL;
+		}
+	}
+	else if ((size_t) consumed < len) {
+		session->in = uwsgi_buffer_new(len - consumed);
+		if (uwsgi_buffer_append(session->in, buf + consumed, len - consumed)) return -1;
+	}
+	return 0;
+}
+
+// deliver the published records
+static void uwsgi_websockets_hub_consume(struct uwsgi_websockets_hub *hub) {
+	struct uwsgi_websockets_ring *ring = uwsgi.websockets_ring;
+	struct uwsgi_thread *ut = hub->ut;
+	uint8_t hdr[10];
+	for (;;) {
+		uwsgi_rlock(ring->lock);
+		if (hub->cursor == ring->head) {
+			uwsgi_rwunlock(ring->lock);
+			break;
+		}
+		if (ring->head - hub->cursor > ring->size) {
+			uwsgi_log("[uwsgi-websocket] hub of worker %d is too slow, %llu bytes of published messages lost\n", uwsgi.mywid, (unsigned long long) (ring->head - hub->cursor));
+			hub->cursor = ring->head;
+			uwsgi_rwunlock(ring->lock);
+			break;
+		}
+		uint32_t len;
+		uint16_t channel_len;
+		ws_ring_copy_out(ring, hub->cursor, hdr, 8);
+		memcpy(&len, hdr, 4);
+		memcpy(&channel_len, hdr + 4, 2);
+		uint8_t opcode = hdr[6];
+		// [frame header room][payload][channel]
+		hub->record->pos = 0;
+		if (uwsgi_buffer_ensure(hub->record, 10 + len + channel_len)) {
+			hub->cursor += 8 + channel_len + len;
+			uwsgi_rwunlock(ring->lock);
+			continue;
+		}
+		ws_ring_copy_out(ring, hub->cursor + 8, hub->record->buf + 10 + len, channel_len);
+		ws_ring_copy_out(ring, hub->cursor + 8 + channel_len, hub->record->buf + 10, len);
+		hub->cursor += 8 + channel_len + len;
+		uwsgi_rwunlock(ring->lock);
+
+		struct uwsgi_websocket_channel *channel = uwsgi_websockets_hub_channel(hub, hub->record->buf + 10 + len, channel_len, 0);
+		if (!channel) continue;
+		size_t hlen = uwsgi_websocket_header(hdr, opcode, len);
+		char *frame = hub->record->buf + 10 - hlen;
+		memcpy(frame, hdr, hlen);
+		struct uwsgi_websocket_subscription *sub = channel->subscriptions;
+		while (sub) {
+			// the session (and the channel too) could be destroyed
+			struct uwsgi_websocket_subscription *next = sub->next;
+			int last = (next == NULL);
+			if (uwsgi_websocket_session_write(ut, sub->uor, frame, hlen + len)) {
+				uwsgi_offload_close(ut, sub->uor);
+			}
+			if (last) break;
+			sub = next;
+		}
+	}
+}
+
+int uwsgi_websockets_hub_event(struct uwsgi_thread *ut, int fd) {
+	struct uwsgi_websockets_hub *hub = (struct uwsgi_websockets_hub *) ut->offload_hub;
+	if (fd != hub->wake_fd) return 0;
+	char buf[256];
+	while (read(hub->wake_fd, buf, 256) > 0);
+	uwsgi_websockets_hub_consume(hub);
+	return 1;
+}
+
+// ping/pong management (once per second)
+void uwsgi_websockets_hub_tick(struct uwsgi_thread *ut) {
+	struct uwsgi_websockets_hub *hub = (struct uwsgi_websockets_hub *) ut->offload_hub;
+	time_t now = uwsgi_now();
+	if (now == hub->last_tick) return;
+	hub->last_tick = now;
+	struct uwsgi_websocket_session *session = hub->sessions;
+	while (session) {
+		struct uwsgi_websocket_session *next = session->next;
+		int ret = 0;
+		// pong not received ?
+		if (session->last_pong < session->last_ping) {
+			if (now - session->last_ping > uwsgi.websockets_pong_tolerance) {
+				uwsgi_log("[uwsgi-websocket] offloaded websocket %llu: no PONG received in %d seconds !!!\n", (unsigned long long) session->id, uwsgi.websockets_pong_tolerance);
+				ret = -1;
+			}
+		}
+		else if (now - session->last_ping >= uwsgi.websockets_ping_freq) {
+			ret = uwsgi_websocket_session_ping(ut, session->uor);
+		}
+		if (ret) {
+			uwsgi_offload_close(ut, session->uor);
+		}
+		session = next;
+	}
+}
+
+/*
+	hand the websocket over to an offload thread, subscribing it to the
+	specified (comma separated) channels. Returns the id of the session
+*/
+int64_t uwsgi_websocket_offload(struct wsgi_request *wsgi_req, char *channels, uint16_t channels_len) {
+	static uint64_t counter = 0;
+	if (!uwsgi.websockets_ring) {
+		uwsgi_log("[uwsgi-websocket] websockets offloading is not enabled (--websockets-offload)\n");
+		return -1;
+	}
+	if (wsgi_req->websocket_closed || !wsgi_req->socket->can_offload) return -1;
+	if (wsgi_req->websocket_deflate) {
+		uwsgi_log("[uwsgi-websocket] \"%.*s %.*s\" (%.*s) compressed websockets cannot be offloaded\n", REQ_DATA);
+		return -1;
+	}
+
+	struct uwsgi_websocket_session *session = uwsgi_calloc(sizeof(struct uwsgi_websocket_session));
+	session->id = ((uint64_t) uwsgi.mywid << 48) | (__sync_add_and_fetch(&counter, 1) & 0xffffffffffffULL);
+	session->uri = uwsgi_concat2n(wsgi_req->uri, wsgi_req->uri_len, "", 0);
+	session->uri_len = wsgi_req->uri_len;
+	session->remote_addr = uwsgi_concat2n(wsgi_req->remote_addr, wsgi_req->remote_addr_len, "", 0);
+	session->remote_addr_len = wsgi_req->remote_addr_len;
+	session->channels = uwsgi_concat2n(channels, channels_len, "", 0);
+	session->channels_len = channels_len;
+	if (channels_len > 0) {
+		uint16_t i;
+		session->subscriptions_cnt = 1;
+		for (i = 0; i < channels_len; i++) {
+			if (channels[i] == ',') session->subscriptions_cnt++;
+		}
+		session->subscriptions = uwsgi_calloc(sizeof(struct uwsgi_websocket_subscription) * session->subscriptions_cnt);
+	}
+	session->last_ping = uwsgi_now();
+	session->last_pong = session->last_ping;
+	int64_t id = session->id;
+
+	struct uwsgi_offload_request uor;
+	uwsgi_offload_setup(uwsgi.offload_engine_websocket, &uor, wsgi_req, 1);
+	uor.data = session;
+	// frames already read by the worker
+	if (wsgi_req->websocket_buf && wsgi_req->websocket_buf->pos > 0) {
+		uor.ubuf = uwsgi_buffer_new(wsgi_req->websocket_buf->pos);
+		uwsgi_buffer_append(uor.ubuf, wsgi_req->websocket_buf->buf, wsgi_req->websocket_buf->pos);
+	}
+	if (uwsgi_offload_run(wsgi_req, &uor, NULL)) {
+		uwsgi_websocket_session_free(&uor);
+		if (uor.ubuf) uwsgi_buffer_destroy(uor.ubuf);
+		return -1;
+	}
+	// from now on the websocket is managed by the offload thread
+	wsgi_req->websocket_closed = 1;
+	return id;
 }
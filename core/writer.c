@@ -70,12 +70,12 @@ int uwsgi_response_prepare_headers(struct wsgi_request *wsgi_req, char *status,
 	if (wsgi_req->headers_sent || wsgi_req->headers_size || wsgi_req->response_size || status_len < 3 || wsgi_req->write_errors) return -1;
 
 	if (!wsgi_req->headers) {
-		wsgi_req->headers = uwsgi_buffer_new(uwsgi.page_size);
+		wsgi_req->headers = uwsgi_buffer_get(uwsgi.page_size);
 		wsgi_req->headers->limit = UMAX16;
 	}
 
 	// reset the buffer (could be useful for rollbacks...)
-	wsgi_req->headers->pos = 0;
+	uwsgi_buffer_reset(wsgi_req->headers);
 	// reset headers count
 	wsgi_req->header_cnt = 0;
 	struct uwsgi_buffer *hh = NULL;
@@ -112,10 +112,10 @@ int uwsgi_response_prepare_headers(struct wsgi_request *wsgi_req, char *status,
 	}
 	if (!hh) {wsgi_req->write_errors++; return -1;}
         if (uwsgi_buffer_append(wsgi_req->headers, hh->buf, hh->pos)) goto error;
-        uwsgi_buffer_destroy(hh);
+        uwsgi_buffer_put(hh);
         return 0;
 error:
-        uwsgi_buffer_destroy(hh);
+        uwsgi_buffer_put(hh);
 	wsgi_req->write_errors++;
 	return -1;
 }
@@ -145,7 +145,7 @@ static int uwsgi_response_add_header_do(struct wsgi_request *wsgi_req, char *key
 	}
 
         if (!wsgi_req->headers) {
-                wsgi_req->headers = uwsgi_buffer_new(uwsgi.page_size);
+                wsgi_req->headers = uwsgi_buffer_get(uwsgi.page_size);
                 wsgi_req->headers->limit = UMAX16;
         }
 
@@ -153,10 +153,10 @@ static int uwsgi_response_add_header_do(struct wsgi_request *wsgi_req, char *key
         if (!hh) { wsgi_req->write_errors++ ; return -1;}
         if (uwsgi_buffer_append(wsgi_req->headers, hh->buf, hh->pos)) goto error;
         wsgi_req->header_cnt++;
-        uwsgi_buffer_destroy(hh);
+        uwsgi_buffer_put(hh);
         return 0;
 error:
-        uwsgi_buffer_destroy(hh);
+        uwsgi_buffer_put(hh);
         wsgi_req->write_errors++;
         return -1;
 }
@@ -190,6 +190,110 @@ int uwsgi_response_add_header_force(struct wsgi_request *wsgi_req, char *key, ui
         return uwsgi_response_add_header_do(wsgi_req, key, key_len, value, value_len);
 }
 
+/*
+	header templates
+
+	static headers (--add-header, --header-template) are serialized once at startup
+	and appended to the header block with a single copy. Protocols with a custom
+	header hook still get them one by one.
+*/
+static int response_add_header_template_do(struct wsgi_request *wsgi_req, struct uwsgi_header_template *uht) {
+	if (wsgi_req->socket->proto_add_header != uwsgi_proto_base_add_header) {
+		char *ptr = uht->ub->buf;
+		char *end = uht->ub->buf + uht->ub->pos;
+		while(ptr < end) {
+			char *crlf = memchr(ptr, '\r', end - ptr);
+			if (!crlf) break;
+			if (uwsgi_response_add_header(wsgi_req, NULL, 0, ptr, crlf - ptr)) return -1;
+			ptr = crlf + 2;
+		}
+		return 0;
+	}
+
+	if (!wsgi_req->headers) {
+		wsgi_req->headers = uwsgi_buffer_get(uwsgi.page_size);
+		wsgi_req->headers->limit = UMAX16;
+	}
+	if (uwsgi_buffer_append(wsgi_req->headers, uht->ub->buf, uht->ub->pos)) {
+		wsgi_req->write_errors++;
+		return -1;
+	}
+	wsgi_req->header_cnt += uht->count;
+	return 0;
+}
+
+int uwsgi_response_add_header_template(struct wsgi_request *wsgi_req, struct uwsgi_header_template *uht) {
+	if (wsgi_req->headers_sent || wsgi_req->headers_size || wsgi_req->response_size || wsgi_req->write_errors) return -1;
+	return response_add_header_template_do(wsgi_req, uht);
+}
+
+struct uwsgi_header_template *uwsgi_header_template_get(char *name, size_t name_len) {
+	struct uwsgi_header_template *uht = uwsgi.header_templates;
+	while(uht) {
+		if (!uwsgi_strncmp(uht->name, strlen(uht->name), name, name_len)) return uht;
+		uht = uht->next;
+	}
+	return NULL;
+}
+
+static struct uwsgi_header_template *header_template_new(char *name, size_t name_len) {
+	struct uwsgi_header_template *uht = uwsgi_calloc(sizeof(struct uwsgi_header_template));
+	uht->name = uwsgi_concat2n(name, name_len, "", 0);
+	uht->ub = uwsgi_buffer_new(uwsgi.page_size);
+	return uht;
+}
+
+static void header_template_append(struct uwsgi_header_template *uht, char *header, size_t len) {
+	if (memchr(header, '\r', len) || memchr(header, '\n', len) || !memchr(header, ':', len)) {
+		uwsgi_log("invalid header for template \"%s\": %.*s\n", uht->name, (int) len, header);
+		exit(1);
+	}
+	if (uwsgi_buffer_append(uht->ub, header, len) || uwsgi_buffer_append(uht->ub, "\r\n", 2)) {
+		uwsgi_log("unable to build header template \"%s\"\n", uht->name);
+		exit(1);
+	}
+	uht->count++;
+}
+
+void uwsgi_header_templates_setup() {
+	struct uwsgi_string_list *usl = NULL;
+	uwsgi_foreach(usl, uwsgi.header_templates_list) {
+		char *equal = strchr(usl->value, '=');
+		if (!equal) {
+			uwsgi_log("invalid header template syntax, must be name=Key: value\n");
+			exit(1);
+		}
+		struct uwsgi_header_template *uht = uwsgi_header_template_get(usl->value, equal - usl->value);
+		if (!uht) {
+			uht = header_template_new(usl->value, equal - usl->value);
+			struct uwsgi_header_template **last = &uwsgi.header_templates;
+			while(*last) last = &(*last)->next;
+			*last = uht;
+		}
+		header_template_append(uht, equal + 1, strlen(equal + 1));
+	}
+
+	if (!uwsgi.additional_headers && !uwsgi.add_header_templates) return;
+
+	struct uwsgi_header_template *global = header_template_new("", 0);
+	uwsgi_foreach(usl, uwsgi.additional_headers) {
+		header_template_append(global, usl->value, usl->len);
+	}
+	uwsgi_foreach(usl, uwsgi.add_header_templates) {
+		struct uwsgi_header_template *uht = uwsgi_header_template_get(usl->value, usl->len);
+		if (!uht) {
+			uwsgi_log("unknown header template \"%s\"\n", usl->value);
+			exit(1);
+		}
+		if (uwsgi_buffer_append(global->ub, uht->ub->buf, uht->ub->pos)) {
+			uwsgi_log("unable to build the additional headers\n");
+			exit(1);
+		}
+		global->count += uht->count;
+	}
+	uwsgi.additional_headers_template = global;
+}
+
 static int uwsgi_response_write_headers_do0(struct wsgi_request *wsgi_req) {
 	if (wsgi_req->headers_sent || !wsgi_req->headers || wsgi_req->response_size || wsgi_req->write_errors) {
 		return UWSGI_OK;
@@ -207,13 +311,16 @@ static int uwsgi_response_write_headers_do0(struct wsgi_request *wsgi_req) {
 	}
 #endif
 
-	struct uwsgi_string_list *ah = uwsgi.additional_headers;
-	while(ah) {
-		if (uwsgi_response_add_header(wsgi_req, NULL, 0, ah->value, ah->len)) return -1;
-                ah = ah->next;
-        }
+	if (uwsgi.additional_headers_template) {
+		if (response_add_header_template_do(wsgi_req, uwsgi.additional_headers_template)) return -1;
+	}
+
+	int i;
+	for(i=0;i<wsgi_req->header_templates_cnt;i++) {
+		if (response_add_header_template_do(wsgi_req, wsgi_req->header_templates[i])) return -1;
+	}
 
-        ah = wsgi_req->additional_headers;
+        struct uwsgi_string_list *ah = wsgi_req->additional_headers;
         while(ah) {
 		if (uwsgi_response_add_header(wsgi_req, NULL, 0, ah->value, ah->len)) return -1;
                 ah = ah->next;
@@ -355,6 +462,62 @@ fallback:
 
 }
 
+/*
+	like the previous one but for a vector of app-owned memory areas (they are only referenced),
+	headers are prepended to the vector
+*/
+static int uwsgi_response_writev_headers_and_iov_do(struct wsgi_request *wsgi_req, struct iovec *body, size_t len) {
+
+	struct iovec stack_iov[UWSGI_RESPONSE_IOV];
+	struct iovec *iov = stack_iov;
+
+	int ret = uwsgi_response_write_headers_do0(wsgi_req);
+	if (ret != UWSGI_AGAIN) return ret;
+
+	if (len + 1 > UWSGI_RESPONSE_IOV) {
+		iov = uwsgi_malloc(sizeof(struct iovec) * (len + 1));
+	}
+
+	iov[0].iov_base = wsgi_req->headers->buf;
+	iov[0].iov_len = wsgi_req->headers->pos;
+	memcpy(iov + 1, body, sizeof(struct iovec) * len);
+
+	size_t iov_len = len + 1;
+	for(;;) {
+		errno = 0;
+		ret = wsgi_req->socket->proto_writev(wsgi_req, iov, &iov_len);
+		if (ret < 0) {
+			if (!uwsgi.ignore_write_errors) {
+				uwsgi_req_error("uwsgi_response_writev_body_do()");
+			}
+			wsgi_req->write_errors++;
+			goto end;
+		}
+		if (ret == UWSGI_OK) {
+			break;
+		}
+		if (!uwsgi_is_again()) continue;
+		ret = uwsgi_wait_write_req(wsgi_req);
+		if (ret < 0) { wsgi_req->write_errors++; ret = -1; goto end;}
+		if (ret == 0) {
+			uwsgi_log("uwsgi_response_writev_body_do() TIMEOUT !!!\n");
+			wsgi_req->write_errors++;
+			ret = -1;
+			goto end;
+		}
+	}
+
+	wsgi_req->headers_size += wsgi_req->headers->pos;
+	wsgi_req->response_size += wsgi_req->write_pos - wsgi_req->headers->pos;
+	wsgi_req->headers_sent = 1;
+	// reset for the next write
+	wsgi_req->write_pos = 0;
+	ret = UWSGI_OK;
+end:
+	if (iov != stack_iov) free(iov);
+	return ret;
+}
+
 // this is the function called by all request plugins to send chunks to the client
 int uwsgi_response_write_body_do(struct wsgi_request *wsgi_req, char *buf, size_t len) {
 
@@ -490,6 +653,10 @@ int uwsgi_response_writev_body_do(struct wsgi_request *wsgi_req, struct iovec *i
 write:
         // send headers if not already sent
         if (!wsgi_req->headers_sent) {
+		// a single syscall for headers and body
+		if (wsgi_req->socket->proto_writev && len > 0 && wsgi_req->headers) {
+			return uwsgi_response_writev_headers_and_iov_do(wsgi_req, iov, len);
+		}
                 int ret = uwsgi_response_write_headers_do(wsgi_req);
                 if (ret == UWSGI_OK) goto sendbody;
                 if (ret == UWSGI_AGAIN) return UWSGI_AGAIN;
@@ -567,6 +734,40 @@ done:
 }
 
 
+// blocking (or async-aware) transfer of a file slice
+static int response_sendfile_loop(struct wsgi_request *wsgi_req, int fd, size_t pos, size_t len) {
+        for(;;) {
+		errno = 0;
+                int ret = wsgi_req->socket->proto_sendfile(wsgi_req, fd, pos, len);
+                if (ret < 0) {
+                        if (!uwsgi.ignore_write_errors) {
+                                uwsgi_req_error("uwsgi_response_sendfile_do()");
+                        }
+			wsgi_req->write_errors++;
+                        return -1;
+                }
+                if (ret == UWSGI_OK) {
+                        break;
+                }
+		if (!uwsgi_is_again()) continue;
+                ret = uwsgi_wait_write_req(wsgi_req);
+                if (ret < 0) {
+			wsgi_req->write_errors++;
+			return -1;
+		}
+		if (ret == 0) {
+                        uwsgi_log("uwsgi_response_sendfile_do() TIMEOUT !!!\n");
+                        wsgi_req->write_errors++;
+                        return -1;
+                }	
+        }
+
+        wsgi_req->response_size += wsgi_req->write_pos;
+	// reset for the next write
+        wsgi_req->write_pos = 0;
+        return UWSGI_OK;
+}
+
 int uwsgi_response_sendfile_do(struct wsgi_request *wsgi_req, int fd, size_t pos, size_t len) {
 	return uwsgi_response_sendfile_do_can_close(wsgi_req, fd, pos, len, 1);	
 }
@@ -624,7 +825,7 @@ sendfile:
 			fd = tmp_fd;
 			can_close = 1;
 		}
-       		if (!uwsgi_offload_request_sendfile_do(wsgi_req, fd, len)) {
+       		if (!uwsgi_offload_request_sendfile_range_do(wsgi_req, fd, pos, len)) {
                 	wsgi_req->via = UWSGI_VIA_OFFLOAD;
 			wsgi_req->response_size += len;
                         return 0;
@@ -637,44 +838,141 @@ sendfile:
 
         wsgi_req->via = UWSGI_VIA_SENDFILE;
 
-        for(;;) {
-		errno = 0;
-                int ret = wsgi_req->socket->proto_sendfile(wsgi_req, fd, pos, len);
-                if (ret < 0) {
-                        if (!uwsgi.ignore_write_errors) {
-                                uwsgi_req_error("uwsgi_response_sendfile_do()");
-                        }
-			wsgi_req->write_errors++;
-			if (can_close) close(fd);
-                        return -1;
-                }
-                if (ret == UWSGI_OK) {
-                        break;
-                }
-		if (!uwsgi_is_again()) continue;
-                ret = uwsgi_wait_write_req(wsgi_req);
-                if (ret < 0) {
-			wsgi_req->write_errors++;
-			if (can_close) close(fd);
-			return -1;
-		}
-		if (ret == 0) {
-                        uwsgi_log("uwsgi_response_sendfile_do() TIMEOUT !!!\n");
-                        wsgi_req->write_errors++;
-			if (can_close) close(fd);
-                        return -1;
-                }	
-        }
-
-        wsgi_req->response_size += wsgi_req->write_pos;
-	// reset for the next write
-        wsgi_req->write_pos = 0;
+	int ret = response_sendfile_loop(wsgi_req, fd, pos, len);
 	// close the file descriptor
 	if (can_close) close(fd);
-        return UWSGI_OK;
+	return ret;
 }
 
 
+/*
+	multipart/byteranges
+
+	every part is prefixed by its boundary and headers, the whole body size
+	is known in advance so Content-Length can be set
+*/
+struct uwsgi_byteranges *uwsgi_byteranges_new(struct uwsgi_http_range *ranges, int n, uint64_t size, char *mime, uint16_t mime_len) {
+	struct uwsgi_byteranges *ubr = uwsgi_calloc(sizeof(struct uwsgi_byteranges));
+	snprintf(ubr->boundary, sizeof(ubr->boundary), "%08x%08x", (uint32_t) uwsgi_micros(), (uint32_t) (getpid() ^ rand()));
+	ubr->ub = uwsgi_buffer_new(uwsgi.page_size);
+	ubr->n = n + 1;
+	ubr->parts = uwsgi_calloc(sizeof(struct uwsgi_byterange_part) * ubr->n);
+	int i;
+	for(i=0;i<n;i++) {
+		struct uwsgi_byterange_part *part = &ubr->parts[i];
+		part->hdr_pos = ubr->ub->pos;
+		if (uwsgi_buffer_append(ubr->ub, i ? "\r\n--" : "--", i ? 4 : 2)) goto error;
+		if (uwsgi_buffer_append(ubr->ub, ubr->boundary, 16)) goto error;
+		if (mime && mime_len) {
+			if (uwsgi_buffer_append(ubr->ub, "\r\nContent-Type: ", 16)) goto error;
+			if (uwsgi_buffer_append(ubr->ub, mime, mime_len)) goto error;
+		}
+		if (uwsgi_buffer_append(ubr->ub, "\r\nContent-Range: bytes ", 23)) goto error;
+		if (uwsgi_buffer_num64(ubr->ub, ranges[i].from)) goto error;
+		if (uwsgi_buffer_append(ubr->ub, "-", 1)) goto error;
+		if (uwsgi_buffer_num64(ubr->ub, ranges[i].to)) goto error;
+		if (uwsgi_buffer_append(ubr->ub, "/", 1)) goto error;
+		if (uwsgi_buffer_num64(ubr->ub, size)) goto error;
+		if (uwsgi_buffer_append(ubr->ub, "\r\n\r\n", 4)) goto error;
+		part->hdr_len = ubr->ub->pos - part->hdr_pos;
+		part->pos = ranges[i].from;
+		part->len = (ranges[i].to - ranges[i].from) + 1;
+		ubr->len += part->hdr_len + part->len;
+	}
+	struct uwsgi_byterange_part *last = &ubr->parts[n];
+	last->hdr_pos = ubr->ub->pos;
+	if (uwsgi_buffer_append(ubr->ub, "\r\n--", 4)) goto error;
+	if (uwsgi_buffer_append(ubr->ub, ubr->boundary, 16)) goto error;
+	if (uwsgi_buffer_append(ubr->ub, "--\r\n", 4)) goto error;
+	last->hdr_len = ubr->ub->pos - last->hdr_pos;
+	ubr->len += last->hdr_len;
+	return ubr;
+error:
+	uwsgi_byteranges_destroy(ubr);
+	return NULL;
+}
+
+void uwsgi_byteranges_destroy(struct uwsgi_byteranges *ubr) {
+	if (ubr->ub) uwsgi_buffer_destroy(ubr->ub);
+	free(ubr->parts);
+	free(ubr);
+}
+
+int uwsgi_response_add_byteranges_headers(struct wsgi_request *wsgi_req, struct uwsgi_byteranges *ubr) {
+	char ct[31 + 16];
+	memcpy(ct, "multipart/byteranges; boundary=", 31);
+	memcpy(ct + 31, ubr->boundary, 16);
+	if (uwsgi_response_add_content_type(wsgi_req, ct, 31 + 16)) return -1;
+	return uwsgi_response_add_content_length(wsgi_req, ubr->len);
+}
+
+// ubr is always consumed, fd is closed (when can_close is set) like in uwsgi_response_sendfile_do_can_close()
+int uwsgi_response_byteranges_do(struct wsgi_request *wsgi_req, int fd, struct uwsgi_byteranges *ubr, int can_close) {
+
+	int ret = -1;
+
+	if (fd == wsgi_req->sendfile_fd) can_close = 0;
+
+	if (wsgi_req->write_errors) goto end;
+
+	if (wsgi_req->ignore_body) {
+		ret = UWSGI_OK;
+		goto end;
+	}
+
+	if (!wsgi_req->headers_sent) {
+		ret = uwsgi_response_write_headers_do(wsgi_req);
+		if (ret != UWSGI_OK) {
+			if (ret != UWSGI_AGAIN) wsgi_req->write_errors++;
+			goto end;
+		}
+	}
+
+	if (wsgi_req->socket->can_offload) {
+		if (!can_close) {
+			int tmp_fd = dup(fd);
+			if (tmp_fd < 0) {
+				uwsgi_req_error("uwsgi_response_byteranges_do()/dup()");
+				wsgi_req->write_errors++;
+				ret = -1;
+				goto end;
+			}
+			fd = tmp_fd;
+			can_close = 1;
+		}
+		uint64_t len = ubr->len;
+		// on success the offload engine owns both the fd and the parts
+		if (!uwsgi_offload_request_byteranges_do(wsgi_req, fd, ubr)) {
+			wsgi_req->via = UWSGI_VIA_OFFLOAD;
+			wsgi_req->response_size += len;
+			ubr->ub = NULL;
+			ubr->parts = NULL;
+			uwsgi_byteranges_destroy(ubr);
+			return 0;
+		}
+		wsgi_req->write_errors++;
+		ret = -1;
+		goto end;
+	}
+
+	wsgi_req->via = UWSGI_VIA_SENDFILE;
+
+	int i;
+	for(i=0;i<ubr->n;i++) {
+		struct uwsgi_byterange_part *part = &ubr->parts[i];
+		ret = uwsgi_response_write_body_do(wsgi_req, ubr->ub->buf + part->hdr_pos, part->hdr_len);
+		if (ret) goto end;
+		if (!part->len) continue;
+		ret = response_sendfile_loop(wsgi_req, fd, part->pos, part->len);
+		if (ret) goto end;
+	}
+
+end:
+	if (can_close) close(fd);
+	uwsgi_byteranges_destroy(ubr);
+	return ret;
+}
+
 int uwsgi_simple_wait_write_hook(int fd, int timeout) {
 	struct pollfd upoll;
         timeout = timeout * 1000;
@@ -697,6 +995,19 @@ int uwsgi_simple_wait_write_hook(int fd, int timeout) {
         return ret;
 }
 
+// wait for the client socket to be writable (accounted in the WRITE stage when --req-timing is on)
+int uwsgi_wait_write_req_do(struct wsgi_request *wsgi_req) {
+	if (!uwsgi.req_timing || !wsgi_req->timing_mark) {
+		wsgi_req->switches++;
+		return uwsgi.wait_write_hook(wsgi_req->fd, uwsgi.socket_timeout);
+	}
+	uint64_t start = uwsgi_micros_monotonic();
+	int ret = uwsgi.wait_write_hook(wsgi_req->fd, uwsgi.socket_timeout);
+	wsgi_req->switches++;
+	wsgi_req->timing[UWSGI_REQ_STAGE_WRITE] += uwsgi_micros_monotonic() - start;
+	return ret;
+}
+
 /*
 	simplified write to client
 	(generally used as fallback)
@@ -0,0 +1,202 @@
+#include <uwsgi.h>
+
+extern struct uwsgi_server uwsgi;
+extern pid_t masterpid;
+
+/*
+
+	the zygote (--zygote)
+
+	instead of loading the apps in each worker (lazy-apps) a dedicated process, forked by the master
+	before the workers, loads them once. Then it waits for the master to ask for a worker id,
+	double forks (the master is a child subreaper, so it becomes the parent of the new worker)
+	and sends back the pid of the worker.
+
+	respawning a worker after harakiri, max-requests or reload-on-* becomes a fork() of a warm process,
+	and the memory of the apps is shared (copy-on-write) among all of the workers.
+
+	the zygote is restarted (reloading the apps) on workers reload and chain reload.
+
+*/
+
+static void zygote_loop(int fd) {
+	for (;;) {
+		int wid = 0;
+		ssize_t rlen = read(fd, &wid, sizeof(int));
+		if (rlen < 0 && errno == EINTR) continue;
+		// the master is gone (or it wants a new zygote)
+		if (rlen != sizeof(int)) _exit(0);
+		if (wid < 1 || wid > uwsgi.numproc) continue;
+
+		uwsgi.current_time = uwsgi_now();
+
+		pid_t pid = fork();
+		if (pid < 0) {
+			uwsgi_error("zygote_loop()/fork()");
+			pid_t err = -1;
+			if (write(fd, &err, sizeof(pid_t)) != sizeof(pid_t)) {
+				uwsgi_error("zygote_loop()/write()");
+			}
+			continue;
+		}
+		if (pid > 0) {
+			waitpid(pid, NULL, 0);
+			continue;
+		}
+
+		// this is the intermediate process
+		uwsgi.workers[wid].pid = 0;
+		if (uwsgi_respawn_worker(wid)) {
+			// and this is the new worker
+			close(fd);
+			uwsgi.i_am_a_zygote = 0;
+			// wait to be adopted by the master
+			int tries = 1000;
+			while (getppid() != masterpid && tries--) {
+				usleep(1000);
+			}
+			uwsgi_run();
+			// never here
+			_exit(0);
+		}
+
+		pid_t wpid = uwsgi.workers[wid].pid;
+		if (wpid <= 0) wpid = -1;
+		if (write(fd, &wpid, sizeof(pid_t)) != sizeof(pid_t)) {
+			uwsgi_error("zygote_loop()/write()");
+		}
+		_exit(0);
+	}
+}
+
+void uwsgi_zygote_start() {
+	int i;
+	int fds[2];
+
+#if defined(__linux__) && defined(PR_SET_CHILD_SUBREAPER)
+	if (prctl(PR_SET_CHILD_SUBREAPER, 1, 0, 0, 0)) {
+		uwsgi_error("uwsgi_zygote_start()/prctl()");
+		return;
+	}
+#endif
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+		uwsgi_error("uwsgi_zygote_start()/socketpair()");
+		return;
+	}
+
+	pid_t pid = uwsgi_fork("uWSGI zygote");
+	if (pid < 0) {
+		uwsgi_error("uwsgi_zygote_start()/fork()");
+		close(fds[0]);
+		close(fds[1]);
+		return;
+	}
+
+	if (pid > 0) {
+		close(fds[1]);
+		// do not leak it on reload
+		if (fcntl(fds[0], F_SETFD, FD_CLOEXEC)) {
+			uwsgi_error("uwsgi_zygote_start()/fcntl()");
+		}
+		uwsgi.zygote_fd = fds[0];
+		uwsgi.zygote_pid = pid;
+		uwsgi_log("spawned uWSGI zygote (pid: %d)\n", (int) pid);
+		return;
+	}
+
+	close(fds[0]);
+	uwsgi.mypid = getpid();
+	uwsgi.i_am_a_zygote = 1;
+
+#if defined(__linux__) && defined(PR_SET_PDEATHSIG)
+	if (prctl(PR_SET_PDEATHSIG, SIGKILL)) {
+		uwsgi_error("uwsgi_zygote_start()/prctl()");
+	}
+#endif
+
+	// the master handlers make no sense here
+	signal(SIGHUP, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGINT, SIG_DFL);
+	signal(SIGQUIT, SIG_DFL);
+	signal(SIGUSR1, SIG_DFL);
+	signal(SIGUSR2, SIG_DFL);
+	signal(SIGTSTP, SIG_DFL);
+	signal(SIGWINCH, SIG_DFL);
+	signal(SIGCHLD, SIG_DFL);
+
+	// load the apps in the master slot, each new worker will copy them
+	uwsgi.workers[0].apps_cnt = 0;
+	memset(uwsgi.workers[0].apps, 0, sizeof(struct uwsgi_app) * uwsgi.max_apps);
+	uwsgi.wsgi_req = &uwsgi.workers[0].cores[0].req;
+	uwsgi_init_all_apps();
+	uwsgi.zygote_apps_loaded = 1;
+
+	for (i = 0; i < 256; i++) {
+		if (uwsgi.p[i]->zygote_ready) {
+			uwsgi.p[i]->zygote_ready();
+		}
+	}
+
+	for (i = 0; i < uwsgi.gp_cnt; i++) {
+		if (uwsgi.gp[i]->zygote_ready) {
+			uwsgi.gp[i]->zygote_ready();
+		}
+	}
+
+	uwsgi_log("uWSGI zygote ready (pid: %d)\n", (int) uwsgi.mypid);
+
+	zygote_loop(fds[1]);
+}
+
+// ask the zygote for a new worker, returns -1 on error
+int uwsgi_zygote_spawn(int wid) {
+	if (write(uwsgi.zygote_fd, &wid, sizeof(int)) != sizeof(int)) {
+		uwsgi_error("uwsgi_zygote_spawn()/write()");
+		return -1;
+	}
+
+	pid_t pid = 0;
+	for (;;) {
+		ssize_t rlen = read(uwsgi.zygote_fd, &pid, sizeof(pid_t));
+		if (rlen < 0 && errno == EINTR) continue;
+		if (rlen != sizeof(pid_t)) {
+			if (rlen < 0) uwsgi_error("uwsgi_zygote_spawn()/read()");
+			return -1;
+		}
+		break;
+	}
+
+	if (pid <= 0) return -1;
+	// pid and counters are set by the zygote in the shared area
+	return 0;
+}
+
+static void zygote_stop() {
+	close(uwsgi.zygote_fd);
+	uwsgi.zygote_fd = -1;
+	if (kill(uwsgi.zygote_pid, SIGKILL)) {
+		uwsgi_error("zygote_stop()/kill()");
+	}
+	waitpid(uwsgi.zygote_pid, NULL, 0);
+	uwsgi.zygote_pid = 0;
+}
+
+// start a new zygote (reloading the apps)
+void uwsgi_zygote_reload() {
+	if (uwsgi.zygote_pid <= 0) return;
+	uwsgi_log_verbose("reloading the uWSGI zygote (pid: %d)...\n", (int) uwsgi.zygote_pid);
+	zygote_stop();
+	uwsgi_zygote_start();
+}
+
+int uwsgi_master_check_zygote_death(int diedpid) {
+	if (uwsgi.zygote_pid <= 0 || diedpid != uwsgi.zygote_pid) return 0;
+	uwsgi_log("OOOPS the uWSGI zygote (pid: %d) died...trying respawn...\n", (int) diedpid);
+	close(uwsgi.zygote_fd);
+	uwsgi.zygote_fd = -1;
+	uwsgi.zygote_pid = 0;
+	uwsgi_zygote_start();
+	return -1;
+}
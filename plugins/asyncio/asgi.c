@@ -0,0 +1,703 @@
+#include "../python/uwsgi_python.h"
+
+/*
+
+	ASGI 3.0 handler running directly on the asyncio loop (--asgi)
+
+	the request is parsed by the asyncio engine, then the application
+	coroutine is scheduled as a task: receive() and send() are C callables
+	mapped to the request core, the task done callback closes the request.
+
+	http and websocket scopes are supported (lifespan is not)
+
+*/
+
+#ifdef PYTHREE
+
+extern struct uwsgi_server uwsgi;
+extern struct uwsgi_python up;
+
+#define free_req_queue uwsgi.async_queue_unused_ptr++; uwsgi.async_queue_unused[uwsgi.async_queue_unused_ptr] = wsgi_req
+
+// max size of a http.request body message
+#define UWSGI_ASGI_BODY_CHUNK 65536
+
+struct uwsgi_asgi_request {
+	struct wsgi_request *wsgi_req;
+	// changes for every request mapped to the core, callables of old requests are ignored
+	uint64_t generation;
+	PyObject *task;
+	// future returned by a pending receive()
+	PyObject *waiter;
+	int waiter_fd;
+	uint8_t websocket;
+	uint8_t body_done;
+	uint8_t response_started;
+	uint8_t response_done;
+	uint8_t ws_connected;
+	uint8_t ws_accepted;
+	uint8_t ws_closed;
+};
+
+static struct uwsgi_asgi {
+	PyObject *loop;
+	struct uwsgi_asgi_request *requests;
+	uint64_t generation;
+	PyObject *asgi_version;
+} uasgi;
+
+static PyObject *py_uwsgi_asgi_receive(PyObject *, PyObject *);
+static PyObject *py_uwsgi_asgi_send(PyObject *, PyObject *);
+static PyObject *py_uwsgi_asgi_readable(PyObject *, PyObject *);
+static PyObject *py_uwsgi_asgi_done(PyObject *, PyObject *);
+
+static PyMethodDef uwsgi_asgi_receive_def[] = { {"receive", py_uwsgi_asgi_receive, METH_NOARGS, ""} };
+static PyMethodDef uwsgi_asgi_send_def[] = { {"send", py_uwsgi_asgi_send, METH_O, ""} };
+static PyMethodDef uwsgi_asgi_readable_def[] = { {"uwsgi_asgi_readable", py_uwsgi_asgi_readable, METH_NOARGS, ""} };
+static PyMethodDef uwsgi_asgi_done_def[] = { {"uwsgi_asgi_done", py_uwsgi_asgi_done, METH_O, ""} };
+
+// the self object of the callables is (async_id, generation)
+static struct uwsgi_asgi_request *uwsgi_asgi_get(PyObject *self) {
+	int async_id = 0;
+	unsigned long long generation = 0;
+	if (!PyArg_ParseTuple(self, "iK", &async_id, &generation)) return NULL;
+	if (async_id < 0 || async_id >= uwsgi.async) return NULL;
+	struct uwsgi_asgi_request *uar = &uasgi.requests[async_id];
+	if (!uar->wsgi_req || uar->generation != generation) return NULL;
+	uwsgi.wsgi_req = uar->wsgi_req;
+	return uar;
+}
+
+static PyObject *uwsgi_asgi_callable(PyMethodDef *def, struct uwsgi_asgi_request *uar) {
+	PyObject *self = Py_BuildValue("(iK)", uar->wsgi_req->async_id, (unsigned long long) uar->generation);
+	if (!self) return NULL;
+	PyObject *f = PyCFunction_New(def, self);
+	Py_DECREF(self);
+	return f;
+}
+
+// steals the reference to value
+static int uwsgi_asgi_set(PyObject *d, char *key, PyObject *value) {
+	if (!value) return -1;
+	int ret = PyDict_SetItemString(d, key, value);
+	Py_DECREF(value);
+	return ret;
+}
+
+static PyObject *uwsgi_asgi_message(char *type) {
+	PyObject *msg = PyDict_New();
+	if (!msg) return NULL;
+	if (uwsgi_asgi_set(msg, "type", PyUnicode_FromString(type))) {
+		Py_DECREF(msg);
+		return NULL;
+	}
+	return msg;
+}
+
+static PyObject *uwsgi_asgi_headers(struct wsgi_request *wsgi_req) {
+	PyObject *headers = PyList_New(0);
+	if (!headers) return NULL;
+	char name[UWSGI_PYTHON_ENV_KEY_MAX];
+	int i;
+	for(i=0;i<wsgi_req->var_cnt;i+=2) {
+		char *key = wsgi_req->hvec[i].iov_base;
+		size_t key_len = wsgi_req->hvec[i].iov_len;
+		if (key_len > 5 && !memcmp(key, "HTTP_", 5)) {
+			key += 5; key_len -= 5;
+		}
+		else if (!uwsgi_strncmp(key, key_len, "CONTENT_TYPE", 12) || !uwsgi_strncmp(key, key_len, "CONTENT_LENGTH", 14)) {
+		}
+		else {
+			continue;
+		}
+		if (key_len >= UWSGI_PYTHON_ENV_KEY_MAX) continue;
+		size_t j;
+		for(j=0;j<key_len;j++) {
+			name[j] = key[j] == '_' ? '-' : tolower((int) key[j]);
+		}
+		PyObject *hname = PyBytes_FromStringAndSize(name, key_len);
+		PyObject *hvalue = PyBytes_FromStringAndSize(wsgi_req->hvec[i+1].iov_base, wsgi_req->hvec[i+1].iov_len);
+		PyObject *header = hname && hvalue ? PyTuple_Pack(2, hname, hvalue) : NULL;
+		Py_XDECREF(hname);
+		Py_XDECREF(hvalue);
+		if (!header || PyList_Append(headers, header)) {
+			Py_XDECREF(header);
+			Py_DECREF(headers);
+			return NULL;
+		}
+		Py_DECREF(header);
+	}
+	return headers;
+}
+
+static PyObject *uwsgi_asgi_address(char *host, uint16_t host_len, char *port, uint16_t port_len) {
+	if (!host_len) {
+		Py_INCREF(Py_None);
+		return Py_None;
+	}
+	PyObject *address = PyList_New(2);
+	if (!address) return NULL;
+	PyObject *h = PyUnicode_FromStringAndSize(host, host_len);
+	if (!h) {
+		Py_DECREF(address);
+		return NULL;
+	}
+	PyList_SET_ITEM(address, 0, h);
+	PyList_SET_ITEM(address, 1, PyLong_FromLong(port_len ? uwsgi_str_num(port, port_len) : 0));
+	return address;
+}
+
+static PyObject *uwsgi_asgi_scope(struct uwsgi_asgi_request *uar) {
+	struct wsgi_request *wsgi_req = uar->wsgi_req;
+	PyObject *scope = PyDict_New();
+	if (!scope) return NULL;
+
+	int secure = (wsgi_req->scheme_len == 5 && !memcmp(wsgi_req->scheme, "https", 5)) || (wsgi_req->https_len > 0 && (wsgi_req->https[0] == 'o' || wsgi_req->https[0] == 'O'));
+	char http_version[8] = "1.1";
+	if (wsgi_req->protocol_len > 5 && wsgi_req->protocol_len < 13 && !memcmp(wsgi_req->protocol, "HTTP/", 5)) {
+		memcpy(http_version, wsgi_req->protocol + 5, wsgi_req->protocol_len - 5);
+		http_version[wsgi_req->protocol_len - 5] = 0;
+	}
+
+	char *path = wsgi_req->uri;
+	size_t path_len = wsgi_req->uri_len;
+	char *qs = memchr(path, '?', path_len);
+	if (qs) path_len = qs - path;
+
+	uint16_t server_name_len = 0, server_port_len = 0, remote_port_len = 0;
+	char *server_name = uwsgi_get_var(wsgi_req, "SERVER_NAME", 11, &server_name_len);
+	char *server_port = uwsgi_get_var(wsgi_req, "SERVER_PORT", 11, &server_port_len);
+	char *remote_port = uwsgi_get_var(wsgi_req, "REMOTE_PORT", 11, &remote_port_len);
+
+	if (uwsgi_asgi_set(scope, "type", PyUnicode_FromString(uar->websocket ? "websocket" : "http"))) goto error;
+	if (PyDict_SetItemString(scope, "asgi", uasgi.asgi_version)) goto error;
+	if (uwsgi_asgi_set(scope, "http_version", PyUnicode_FromString(http_version))) goto error;
+	if (!uar->websocket) {
+		if (uwsgi_asgi_set(scope, "method", PyUnicode_FromStringAndSize(wsgi_req->method, wsgi_req->method_len))) goto error;
+		if (uwsgi_asgi_set(scope, "scheme", PyUnicode_FromString(secure ? "https" : "http"))) goto error;
+	}
+	else {
+		if (uwsgi_asgi_set(scope, "scheme", PyUnicode_FromString(secure ? "wss" : "ws"))) goto error;
+	}
+	if (uwsgi_asgi_set(scope, "path", PyUnicode_DecodeUTF8(wsgi_req->path_info, wsgi_req->path_info_len, "surrogateescape"))) goto error;
+	if (uwsgi_asgi_set(scope, "raw_path", PyBytes_FromStringAndSize(path, path_len))) goto error;
+	if (uwsgi_asgi_set(scope, "query_string", PyBytes_FromStringAndSize(wsgi_req->query_string, wsgi_req->query_string_len))) goto error;
+	if (uwsgi_asgi_set(scope, "root_path", PyUnicode_DecodeUTF8(wsgi_req->script_name, wsgi_req->script_name_len, "surrogateescape"))) goto error;
+	if (uwsgi_asgi_set(scope, "headers", uwsgi_asgi_headers(wsgi_req))) goto error;
+	if (uwsgi_asgi_set(scope, "client", uwsgi_asgi_address(wsgi_req->remote_addr, wsgi_req->remote_addr_len, remote_port, remote_port_len))) goto error;
+	if (uwsgi_asgi_set(scope, "server", uwsgi_asgi_address(server_name, server_name_len, server_port, server_port_len))) goto error;
+
+	if (uar->websocket) {
+		PyObject *subprotocols = PyList_New(0);
+		if (uwsgi_asgi_set(scope, "subprotocols", subprotocols)) goto error;
+		char *ctx = NULL;
+		char *protocols = uwsgi_concat2n(wsgi_req->http_sec_websocket_protocol, wsgi_req->http_sec_websocket_protocol_len, "", 0);
+		char *p = strtok_r(protocols, ", ", &ctx);
+		while(p) {
+			PyObject *proto = PyUnicode_FromString(p);
+			if (!proto || PyList_Append(subprotocols, proto)) {
+				Py_XDECREF(proto);
+				free(protocols);
+				goto error;
+			}
+			Py_DECREF(proto);
+			p = strtok_r(NULL, ", ", &ctx);
+		}
+		free(protocols);
+	}
+
+	return scope;
+error:
+	Py_DECREF(scope);
+	return NULL;
+}
+
+static void uwsgi_asgi_unwait(struct uwsgi_asgi_request *uar) {
+	if (uar->waiter_fd > -1) {
+		PyObject *ret = PyObject_CallMethod(uasgi.loop, "remove_reader", "i", uar->waiter_fd);
+		if (!ret) PyErr_Print();
+		Py_XDECREF(ret);
+		uar->waiter_fd = -1;
+	}
+	Py_CLEAR(uar->waiter);
+}
+
+/*
+	build the next message for receive(), NULL with *wait set means no data is available
+	and the caller has to wait for *wait_fd (-1 means "until the end of the request")
+*/
+static PyObject *uwsgi_asgi_next_message(struct uwsgi_asgi_request *uar, int *wait, int *wait_fd) {
+	struct wsgi_request *wsgi_req = uar->wsgi_req;
+	*wait = 0;
+	*wait_fd = -1;
+
+	if (uar->websocket) {
+		if (!uar->ws_connected) {
+			uar->ws_connected = 1;
+			return uwsgi_asgi_message("websocket.connect");
+		}
+		if (!uar->ws_accepted || uar->ws_closed) goto ws_disconnect;
+		struct uwsgi_buffer *ub = uwsgi_websocket_recv_nb(wsgi_req);
+		if (!ub) goto ws_disconnect;
+		if (ub->pos == 0) {
+			uwsgi_buffer_destroy(ub);
+			*wait = 1;
+			*wait_fd = wsgi_req->fd;
+			return NULL;
+		}
+		PyObject *msg = uwsgi_asgi_message("websocket.receive");
+		if (msg) {
+			// opcode 1 is a text frame
+			if (wsgi_req->websocket_opcode == 1) {
+				if (uwsgi_asgi_set(msg, "text", PyUnicode_DecodeUTF8(ub->buf, ub->pos, "replace"))) Py_CLEAR(msg);
+			}
+			else {
+				if (uwsgi_asgi_set(msg, "bytes", PyBytes_FromStringAndSize(ub->buf, ub->pos))) Py_CLEAR(msg);
+			}
+		}
+		uwsgi_buffer_destroy(ub);
+		return msg;
+ws_disconnect:
+		uar->ws_closed = 1;
+		PyObject *dmsg = uwsgi_asgi_message("websocket.disconnect");
+		if (dmsg && uwsgi_asgi_set(dmsg, "code", PyLong_FromLong(1000))) Py_CLEAR(dmsg);
+		return dmsg;
+	}
+
+	// the body has been consumed, the next event is the disconnection
+	if (uar->body_done) {
+		if (uar->response_done || wsgi_req->write_errors) return uwsgi_asgi_message("http.disconnect");
+		*wait = 1;
+		return NULL;
+	}
+
+	size_t chunk = UMIN(UWSGI_ASGI_BODY_CHUNK, wsgi_req->post_cl - wsgi_req->post_pos);
+	PyObject *body = PyBytes_FromStringAndSize(NULL, chunk);
+	if (!body) return NULL;
+	ssize_t rlen = 0;
+	if (chunk > 0) {
+		rlen = uwsgi_request_body_read_nb(wsgi_req, PyBytes_AS_STRING(body), chunk);
+		if (rlen < 0) {
+			Py_DECREF(body);
+			if (errno == EAGAIN) {
+				*wait = 1;
+				*wait_fd = wsgi_req->post_stream ? wsgi_req->post_stream_fd : wsgi_req->fd;
+				return NULL;
+			}
+			uar->body_done = 1;
+			return uwsgi_asgi_message("http.disconnect");
+		}
+		if ((size_t) rlen < chunk && _PyBytes_Resize(&body, rlen)) return NULL;
+	}
+
+	if (wsgi_req->post_pos >= wsgi_req->post_cl) uar->body_done = 1;
+
+	PyObject *msg = uwsgi_asgi_message("http.request");
+	if (!msg) goto end;
+	if (PyDict_SetItemString(msg, "body", body)) Py_CLEAR(msg);
+	else if (PyDict_SetItemString(msg, "more_body", uar->body_done ? Py_False : Py_True)) Py_CLEAR(msg);
+end:
+	Py_DECREF(body);
+	return msg;
+}
+
+static PyObject *py_uwsgi_asgi_receive(PyObject *self, PyObject *args) {
+	struct uwsgi_asgi_request *uar = uwsgi_asgi_get(self);
+	if (!uar) {
+		PyErr_Clear();
+		return PyErr_Format(PyExc_OSError, "the ASGI request is closed");
+	}
+
+	if (uar->waiter) {
+		return PyErr_Format(PyExc_RuntimeError, "receive() is already waiting for a message");
+	}
+
+	PyObject *future = PyObject_CallMethod(uasgi.loop, "create_future", NULL);
+	if (!future) return NULL;
+
+	int wait = 0, wait_fd = -1;
+	PyObject *msg = uwsgi_asgi_next_message(uar, &wait, &wait_fd);
+	if (msg) {
+		PyObject *ret = PyObject_CallMethod(future, "set_result", "O", msg);
+		Py_DECREF(msg);
+		if (!ret) goto error;
+		Py_DECREF(ret);
+		return future;
+	}
+	if (!wait) goto error;
+
+	if (wait_fd > -1) {
+		PyObject *readable = uwsgi_asgi_callable(uwsgi_asgi_readable_def, uar);
+		if (!readable) goto error;
+		PyObject *ret = PyObject_CallMethod(uasgi.loop, "add_reader", "iO", wait_fd, readable);
+		Py_DECREF(readable);
+		if (!ret) goto error;
+		Py_DECREF(ret);
+		uar->waiter_fd = wait_fd;
+	}
+	Py_INCREF(future);
+	uar->waiter = future;
+	return future;
+error:
+	Py_DECREF(future);
+	return NULL;
+}
+
+// called by the loop when the fd of a pending receive() is readable
+static PyObject *py_uwsgi_asgi_readable(PyObject *self, PyObject *args) {
+	struct uwsgi_asgi_request *uar = uwsgi_asgi_get(self);
+	if (!uar || !uar->waiter) {
+		PyErr_Clear();
+		goto end;
+	}
+
+	PyObject *done = PyObject_CallMethod(uar->waiter, "done", NULL);
+	if (!done) goto error;
+	int is_done = PyObject_IsTrue(done);
+	Py_DECREF(done);
+	// cancelled
+	if (is_done) {
+		uwsgi_asgi_unwait(uar);
+		goto end;
+	}
+
+	int wait = 0, wait_fd = -1;
+	PyObject *msg = uwsgi_asgi_next_message(uar, &wait, &wait_fd);
+	if (!msg && wait && wait_fd == uar->waiter_fd) goto end;
+
+	PyObject *waiter = uar->waiter;
+	uar->waiter = NULL;
+	Py_INCREF(waiter);
+	uwsgi_asgi_unwait(uar);
+	PyObject *ret = msg ? PyObject_CallMethod(waiter, "set_result", "O", msg) : NULL;
+	if (!ret) {
+		// propagate the error to the application
+		PyObject *type, *value, *tb;
+		PyErr_Fetch(&type, &value, &tb);
+		PyErr_NormalizeException(&type, &value, &tb);
+		ret = PyObject_CallMethod(waiter, "set_exception", "O", value ? value : PyExc_OSError);
+		Py_XDECREF(type); Py_XDECREF(value); Py_XDECREF(tb);
+	}
+	Py_XDECREF(msg);
+	Py_DECREF(waiter);
+	if (!ret) goto error;
+	Py_DECREF(ret);
+end:
+	Py_INCREF(Py_None);
+	return Py_None;
+error:
+	PyErr_Print();
+	goto end;
+}
+
+static int uwsgi_asgi_send_start(struct wsgi_request *wsgi_req, PyObject *msg) {
+	PyObject *status = PyDict_GetItemString(msg, "status");
+	if (!status || !PyLong_Check(status)) {
+		PyErr_SetString(PyExc_ValueError, "http.response.start requires an integer status");
+		return -1;
+	}
+	if (uwsgi_response_prepare_headers_int(wsgi_req, PyLong_AsLong(status))) goto error;
+	PyObject *headers = PyDict_GetItemString(msg, "headers");
+	if (!headers) return 0;
+	PyObject *iter = PyObject_GetIter(headers);
+	if (!iter) return -1;
+	PyObject *header;
+	while((header = PyIter_Next(iter))) {
+		char *name = NULL, *value = NULL;
+		Py_ssize_t name_len = 0, value_len = 0;
+		PyObject *hname = PySequence_Check(header) && PySequence_Size(header) == 2 ? PySequence_GetItem(header, 0) : NULL;
+		PyObject *hvalue = hname ? PySequence_GetItem(header, 1) : NULL;
+		Py_DECREF(header);
+		if (!hvalue || PyBytes_AsStringAndSize(hname, &name, &name_len) || PyBytes_AsStringAndSize(hvalue, &value, &value_len)) {
+			Py_XDECREF(hname);
+			Py_XDECREF(hvalue);
+			Py_DECREF(iter);
+			PyErr_Clear();
+			PyErr_SetString(PyExc_TypeError, "ASGI headers must be [bytes, bytes] pairs");
+			return -1;
+		}
+		int ret = uwsgi_response_add_header(wsgi_req, name, name_len, value, value_len);
+		Py_DECREF(hname);
+		Py_DECREF(hvalue);
+		if (ret) {
+			Py_DECREF(iter);
+			goto error;
+		}
+	}
+	Py_DECREF(iter);
+	if (PyErr_Occurred()) return -1;
+	return 0;
+error:
+	PyErr_SetString(PyExc_OSError, "unable to prepare the response headers");
+	return -1;
+}
+
+static int uwsgi_asgi_send_bytes(PyObject *msg, char *key, char **buf, Py_ssize_t *len) {
+	*buf = "";
+	*len = 0;
+	PyObject *body = PyDict_GetItemString(msg, key);
+	if (!body || body == Py_None) return 0;
+	return PyBytes_AsStringAndSize(body, buf, len);
+}
+
+static PyObject *py_uwsgi_asgi_send(PyObject *self, PyObject *msg) {
+	struct uwsgi_asgi_request *uar = uwsgi_asgi_get(self);
+	if (!uar) {
+		PyErr_Clear();
+		return PyErr_Format(PyExc_OSError, "the ASGI request is closed");
+	}
+	struct wsgi_request *wsgi_req = uar->wsgi_req;
+
+	if (!PyDict_Check(msg)) {
+		return PyErr_Format(PyExc_TypeError, "ASGI messages must be dictionaries");
+	}
+	PyObject *type = PyDict_GetItemString(msg, "type");
+	if (!type || !PyUnicode_Check(type)) {
+		return PyErr_Format(PyExc_ValueError, "ASGI messages require a type");
+	}
+	const char *t = PyUnicode_AsUTF8(type);
+	if (!t) return NULL;
+
+	char *buf = NULL;
+	Py_ssize_t len = 0;
+
+	if (!uar->websocket && !strcmp(t, "http.response.start")) {
+		if (uar->response_started) return PyErr_Format(PyExc_RuntimeError, "http.response.start already sent");
+		if (uwsgi_asgi_send_start(wsgi_req, msg)) return NULL;
+		uar->response_started = 1;
+	}
+	else if (!uar->websocket && !strcmp(t, "http.response.body")) {
+		if (!uar->response_started) return PyErr_Format(PyExc_RuntimeError, "http.response.body sent before http.response.start");
+		if (uar->response_done) return PyErr_Format(PyExc_RuntimeError, "the response is already complete");
+		if (uwsgi_asgi_send_bytes(msg, "body", &buf, &len)) return NULL;
+		PyObject *more_body = PyDict_GetItemString(msg, "more_body");
+		int ret = 0;
+		if (len > 0) {
+			ret = uwsgi_response_write_body_do(wsgi_req, buf, len);
+		}
+		else if (!more_body || !PyObject_IsTrue(more_body)) {
+			ret = uwsgi_response_write_headers_do(wsgi_req);
+		}
+		if (ret < 0 || wsgi_req->write_errors) return PyErr_Format(PyExc_OSError, "write error");
+		if (!more_body || !PyObject_IsTrue(more_body)) {
+			uar->response_done = 1;
+			// wake up receive() waiting for http.disconnect
+			if (uar->waiter && uar->waiter_fd == -1) {
+				PyObject *dmsg = uwsgi_asgi_message("http.disconnect");
+				if (!dmsg) return NULL;
+				PyObject *r = PyObject_CallMethod(uar->waiter, "set_result", "O", dmsg);
+				Py_DECREF(dmsg);
+				Py_CLEAR(uar->waiter);
+				if (!r) return NULL;
+				Py_DECREF(r);
+			}
+		}
+	}
+	else if (uar->websocket && !strcmp(t, "websocket.accept")) {
+		if (uar->ws_accepted || uar->ws_closed) return PyErr_Format(PyExc_RuntimeError, "the websocket has already been accepted or closed");
+		PyObject *subprotocol = PyDict_GetItemString(msg, "subprotocol");
+		if (subprotocol && subprotocol != Py_None) {
+			buf = (char *) PyUnicode_AsUTF8AndSize(subprotocol, &len);
+			if (!buf) return NULL;
+		}
+		if (uwsgi_websocket_handshake(wsgi_req, NULL, 0, NULL, 0, buf, len)) {
+			uar->ws_closed = 1;
+			return PyErr_Format(PyExc_OSError, "websocket handshake failed");
+		}
+		uar->ws_accepted = 1;
+		uar->response_started = 1;
+	}
+	else if (uar->websocket && !strcmp(t, "websocket.send")) {
+		if (!uar->ws_accepted || uar->ws_closed) return PyErr_Format(PyExc_OSError, "the websocket is not connected");
+		PyObject *text = PyDict_GetItemString(msg, "text");
+		int ret;
+		if (text && text != Py_None) {
+			buf = (char *) PyUnicode_AsUTF8AndSize(text, &len);
+			if (!buf) return NULL;
+			ret = uwsgi_websocket_send(wsgi_req, buf, len);
+		}
+		else {
+			if (uwsgi_asgi_send_bytes(msg, "bytes", &buf, &len)) return NULL;
+			ret = uwsgi_websocket_send_binary(wsgi_req, buf, len);
+		}
+		if (ret < 0) {
+			uar->ws_closed = 1;
+			return PyErr_Format(PyExc_OSError, "websocket send error");
+		}
+	}
+	else if (uar->websocket && !strcmp(t, "websocket.close")) {
+		if (!uar->ws_accepted) {
+			// rejected handshake
+			if (!uar->response_started) {
+				uar->response_started = 1;
+				if (!uwsgi_response_prepare_headers_int(wsgi_req, 403)) {
+					uwsgi_response_write_headers_do(wsgi_req);
+				}
+			}
+		}
+		else if (!uar->ws_closed) {
+			PyObject *code = PyDict_GetItemString(msg, "code");
+			long close_code = code && PyLong_Check(code) ? PyLong_AsLong(code) : 1000;
+			char frame[4];
+			frame[0] = (char) 0x88;
+			frame[1] = 2;
+			frame[2] = (char) ((close_code >> 8) & 0xff);
+			frame[3] = (char) (close_code & 0xff);
+			uwsgi_response_write_body_do(wsgi_req, frame, 4);
+		}
+		uar->ws_closed = 1;
+	}
+	else {
+		return PyErr_Format(PyExc_ValueError, "unsupported ASGI message type: %s", t);
+	}
+
+	// send() is awaited by the application, return a completed future
+	PyObject *future = PyObject_CallMethod(uasgi.loop, "create_future", NULL);
+	if (!future) return NULL;
+	PyObject *ret = PyObject_CallMethod(future, "set_result", "O", Py_None);
+	if (!ret) {
+		Py_DECREF(future);
+		return NULL;
+	}
+	Py_DECREF(ret);
+	return future;
+}
+
+static void uwsgi_asgi_finish(struct uwsgi_asgi_request *uar) {
+	struct wsgi_request *wsgi_req = uar->wsgi_req;
+	if (uar->waiter) {
+		PyObject *ret = PyObject_CallMethod(uar->waiter, "cancel", NULL);
+		if (!ret) PyErr_Print();
+		Py_XDECREF(ret);
+	}
+	uwsgi_asgi_unwait(uar);
+	Py_CLEAR(uar->task);
+	uar->wsgi_req = NULL;
+
+	uwsgi.wsgi_req = wsgi_req;
+	uwsgi_close_request(wsgi_req);
+	free_req_queue;
+}
+
+// task done callback
+static PyObject *py_uwsgi_asgi_done(PyObject *self, PyObject *task) {
+	struct uwsgi_asgi_request *uar = uwsgi_asgi_get(self);
+	if (!uar) {
+		PyErr_Clear();
+		goto end;
+	}
+	struct wsgi_request *wsgi_req = uar->wsgi_req;
+
+	PyObject *exc = PyObject_CallMethod(task, "exception", NULL);
+	// the task has been cancelled
+	if (!exc) {
+		PyErr_Clear();
+	}
+	else if (exc != Py_None) {
+		Py_INCREF(exc);
+		PyErr_SetObject((PyObject *) Py_TYPE(exc), exc);
+		Py_DECREF(exc);
+		uwsgi_manage_exception(wsgi_req, 0);
+		PyErr_Clear();
+	}
+
+	if (!uar->response_started) {
+		if (uar->websocket) {
+			if (!uwsgi_response_prepare_headers_int(wsgi_req, 403)) {
+				uwsgi_response_write_headers_do(wsgi_req);
+			}
+		}
+		else {
+			uwsgi_500(wsgi_req);
+		}
+	}
+	else if (!uar->websocket && !wsgi_req->headers_sent) {
+		uwsgi_response_write_headers_do(wsgi_req);
+	}
+	Py_XDECREF(exc);
+
+	uwsgi_asgi_finish(uar);
+end:
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+/*
+	called by the asyncio engine after the request has been parsed,
+	the request is closed by the task done callback (or here on error)
+*/
+void uwsgi_asgi_request(struct wsgi_request *wsgi_req) {
+
+	if (!wsgi_req->len || uwsgi_parse_vars(wsgi_req)) goto close;
+
+	wsgi_req->app_id = uwsgi_get_app_id(wsgi_req, wsgi_req->appid, wsgi_req->appid_len, wsgi_req->uh->modifier1);
+	if (wsgi_req->app_id == -1 && !uwsgi.no_default_app && uwsgi.default_app > -1) {
+		if (uwsgi_apps[uwsgi.default_app].modifier1 == wsgi_req->uh->modifier1) {
+			wsgi_req->app_id = uwsgi.default_app;
+		}
+	}
+	if (wsgi_req->app_id == -1) {
+		uwsgi_500(wsgi_req);
+		uwsgi_log("--- no ASGI application found, check your startup logs for errors ---\n");
+		goto close;
+	}
+
+	struct uwsgi_app *wi = &uwsgi_apps[wsgi_req->app_id];
+	wi->requests++;
+
+	struct uwsgi_asgi_request *uar = &uasgi.requests[wsgi_req->async_id];
+	memset(uar, 0, sizeof(struct uwsgi_asgi_request));
+	uar->wsgi_req = wsgi_req;
+	uar->generation = ++uasgi.generation;
+	uar->waiter_fd = -1;
+	uar->websocket = wsgi_req->http_sec_websocket_key_len > 0;
+
+	PyObject *scope = uwsgi_asgi_scope(uar);
+	if (!scope) goto error;
+	PyObject *receive = uwsgi_asgi_callable(uwsgi_asgi_receive_def, uar);
+	PyObject *send = uwsgi_asgi_callable(uwsgi_asgi_send_def, uar);
+	PyObject *coro = NULL;
+	if (receive && send) {
+		coro = PyObject_CallFunctionObjArgs((PyObject *) wi->callable, scope, receive, send, NULL);
+	}
+	Py_DECREF(scope);
+	Py_XDECREF(receive);
+	Py_XDECREF(send);
+	if (!coro) goto error;
+
+	uar->task = PyObject_CallMethod(uasgi.loop, "create_task", "O", coro);
+	Py_DECREF(coro);
+	if (!uar->task) goto error;
+
+	PyObject *done = uwsgi_asgi_callable(uwsgi_asgi_done_def, uar);
+	if (!done) goto error;
+	PyObject *ret = PyObject_CallMethod(uar->task, "add_done_callback", "O", done);
+	Py_DECREF(done);
+	if (!ret) goto error;
+	Py_DECREF(ret);
+	return;
+
+error:
+	uwsgi_manage_exception(wsgi_req, 0);
+	PyErr_Clear();
+	if (uar->task) {
+		PyObject *cancel = PyObject_CallMethod(uar->task, "cancel", NULL);
+		Py_XDECREF(cancel);
+		PyErr_Clear();
+	}
+	uwsgi_500(wsgi_req);
+	Py_CLEAR(uar->task);
+	uar->wsgi_req = NULL;
+close:
+	uwsgi_close_request(wsgi_req);
+	free_req_queue;
+}
+
+void uwsgi_asgi_init(PyObject *loop) {
+	uasgi.loop = loop;
+	uasgi.requests = uwsgi_calloc(sizeof(struct uwsgi_asgi_request) * uwsgi.async);
+	uasgi.asgi_version = Py_BuildValue("{s:s,s:s}", "version", "3.0", "spec_version", "2.3");
+	if (!uasgi.asgi_version) uwsgi_pyexit;
+}
+
+#endif
@@ -20,8 +20,15 @@ static struct uwsgi_asyncio {
 	PyObject *hook_fd;
 	PyObject *hook_timeout;
 	PyObject *hook_fix;
+	int asgi;
+	int uvloop;
 } uasyncio;
 
+#ifdef PYTHREE
+void uwsgi_asgi_init(PyObject *);
+void uwsgi_asgi_request(struct wsgi_request *);
+#endif
+
 #define free_req_queue uwsgi.async_queue_unused_ptr++; uwsgi.async_queue_unused[uwsgi.async_queue_unused_ptr] = wsgi_req
 
 static void uwsgi_opt_setup_asyncio(char *opt, char *value, void *null) {
@@ -38,6 +45,8 @@ static void uwsgi_opt_setup_asyncio(char *opt, char *value, void *null) {
 
 static struct uwsgi_option asyncio_options[] = {
         {"asyncio", required_argument, 0, "a shortcut enabling asyncio loop engine with the specified number of async cores and optimal parameters", uwsgi_opt_setup_asyncio, NULL, UWSGI_OPT_THREADS},
+        {"asgi", no_argument, 0, "run the python apps as ASGI 3.0 applications directly on the asyncio loop", uwsgi_opt_true, &uasyncio.asgi, 0},
+        {"asyncio-uvloop", no_argument, 0, "use the uvloop event loop for the asyncio loop engine", uwsgi_opt_true, &uasyncio.uvloop, 0},
         {0, 0, 0, 0, 0, 0, 0},
 
 };
@@ -156,6 +165,15 @@ static PyObject *py_uwsgi_asyncio_request(PyObject *self, PyObject *args) {
 	if (status == 0) {
 		// we call this two time... overengineering :(
 		uwsgi.async_proto_fd_table[wsgi_req->fd] = NULL;
+#ifdef PYTHREE
+		if (uasyncio.asgi) {
+#ifdef UWSGI_ROUTING
+			if (uwsgi_apply_routes(wsgi_req) == UWSGI_ROUTE_BREAK) goto end;
+#endif
+			uwsgi_asgi_request(wsgi_req);
+			goto again;
+		}
+#endif
 		uwsgi.schedule_to_req();
 		goto again;
 	}
@@ -309,23 +327,32 @@ static void asyncio_loop() {
 	up.gil_get = gil_asyncio_get;
 	up.gil_release = gil_asyncio_release;
 
-	uwsgi.wait_write_hook = uwsgi_asyncio_wait_write_hook;
-	uwsgi.wait_read_hook = uwsgi_asyncio_wait_read_hook;
-
 	if (uwsgi.async < 1) {
 		uwsgi_log("the asyncio loop engine requires async mode (--async <n>)\n");
 		exit(1);
 	}
 
-	if (!uwsgi.schedule_to_main) {
-                uwsgi_log("*** DANGER *** asyncio mode without coroutine/greenthread engine loaded !!!\n");
-        }
-
-	if (!uwsgi.schedule_to_req) {
-		uwsgi.schedule_to_req = async_schedule_to_req_green;
+	if (uasyncio.asgi) {
+#ifndef PYTHREE
+		uwsgi_log("ASGI mode requires python 3\n");
+		exit(1);
+#endif
+		// ASGI apps never suspend in C, the rare blocking writes just poll() the socket
 	}
 	else {
-		uwsgi.schedule_fix = uwsgi_asyncio_schedule_fix;
+		uwsgi.wait_write_hook = uwsgi_asyncio_wait_write_hook;
+		uwsgi.wait_read_hook = uwsgi_asyncio_wait_read_hook;
+
+		if (!uwsgi.schedule_to_main) {
+                	uwsgi_log("*** DANGER *** asyncio mode without coroutine/greenthread engine loaded !!!\n");
+        	}
+
+		if (!uwsgi.schedule_to_req) {
+			uwsgi.schedule_to_req = async_schedule_to_req_green;
+		}
+		else {
+			uwsgi.schedule_fix = uwsgi_asyncio_schedule_fix;
+		}
 	}
 
 #ifndef PYTHREE
@@ -337,8 +364,23 @@ static void asyncio_loop() {
 
 	uasyncio.mod = asyncio;
 
-	uasyncio.loop = PyObject_CallMethod(asyncio, "get_event_loop", NULL);
-	if (!uasyncio.loop) uwsgi_pyexit;
+	if (uasyncio.uvloop) {
+		PyObject *uvloop = PyImport_ImportModule("uvloop");
+		if (!uvloop) uwsgi_pyexit;
+		uasyncio.loop = PyObject_CallMethod(uvloop, "new_event_loop", NULL);
+		if (!uasyncio.loop) uwsgi_pyexit;
+		if (PyObject_CallMethod(asyncio, "set_event_loop", "O", uasyncio.loop) == NULL) uwsgi_pyexit;
+	}
+	else {
+		uasyncio.loop = PyObject_CallMethod(asyncio, "get_event_loop", NULL);
+		if (!uasyncio.loop) uwsgi_pyexit;
+	}
+
+#ifdef PYTHREE
+	if (uasyncio.asgi) {
+		uwsgi_asgi_init(uasyncio.loop);
+	}
+#endif
 
 	 // main greenlet waiting for connection (one greenlet per-socket)
         PyObject *asyncio_accept = PyCFunction_New(uwsgi_asyncio_accept_def, NULL);
@@ -8,4 +8,4 @@ CFLAGS = [
 ]
 LDFLAGS = []
 LIBS = []
-GCC_LIST = ['asyncio']
+GCC_LIST = ['asyncio', 'asgi']
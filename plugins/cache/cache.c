@@ -29,10 +29,18 @@
 		17 -> magic interface for plugins remote access { "cmd": "get|set|update|del|exists", "key": "cache key", "expires": "seconds", "cache": "the cache name"}
 			returns: {"status":"ok|notfound|error", "size": "size of the following body, if present"} + stream
 
+			batched commands ("mget", "mset", "mupdate") repeat the "key" (and for mset the "size") entries,
+			mget returns a body of (64bit big endian size + value) for each key (size is 0xffffffffffffffff for missing keys),
+			mset/mupdate read the concatenated values after the dictionary and return the number of "failed" items
+
 */
 
 extern struct uwsgi_server uwsgi;
 
+// the memcached protocol server (memcached.c)
+extern struct uwsgi_option cache_memcached_options[];
+int cache_memcached_init(void);
+
 static void cache_simple_command(char *key, uint16_t keylen, char *val, uint16_t vallen, void *data) {
 
         struct wsgi_request *wsgi_req = (struct wsgi_request *) data;
@@ -62,10 +70,118 @@ static void cache_simple_command(char *key, uint16_t keylen, char *val, uint16_t
 }
 
 // this function does not use the magic api internally to avoid too much copy
+struct cache_magic_batch {
+	uint64_t n;
+	uint64_t max;
+	char **keys;
+	uint16_t *keys_len;
+	uint64_t *sizes;
+};
+
+static void cache_magic_batch_hook(char *key, uint16_t keylen, char *val, uint16_t vallen, void *data) {
+	struct cache_magic_batch *cmb = (struct cache_magic_batch *) data;
+	if (!uwsgi_strncmp(key, keylen, "key", 3)) {
+		if (cmb->n >= cmb->max) return;
+		cmb->keys[cmb->n] = val;
+		cmb->keys_len[cmb->n] = vallen;
+		cmb->sizes[cmb->n] = 0;
+		cmb->n++;
+		return;
+	}
+	// a size always follows its key
+	if (!uwsgi_strncmp(key, keylen, "size", 4)) {
+		if (cmb->n == 0) return;
+		cmb->sizes[cmb->n-1] = uwsgi_str_num(val, vallen);
+	}
+}
+
+static void manage_magic_batch(struct wsgi_request *wsgi_req, struct uwsgi_cache *uc, struct uwsgi_cache_magic_context *ucmc) {
+	struct uwsgi_buffer *ub = NULL;
+	struct uwsgi_buffer *body = NULL;
+	struct cache_magic_batch cmb;
+	uint64_t i;
+	int locked = 0;
+
+	// every dictionary item takes at least 4 bytes
+	cmb.n = 0;
+	cmb.max = (wsgi_req->uh->_pktsize / 4) + 1;
+	cmb.keys = uwsgi_malloc(sizeof(char *) * cmb.max);
+	cmb.keys_len = uwsgi_malloc(sizeof(uint16_t) * cmb.max);
+	cmb.sizes = uwsgi_malloc(sizeof(uint64_t) * cmb.max);
+
+	if (uwsgi_hooked_parse(wsgi_req->buffer, wsgi_req->uh->_pktsize, cache_magic_batch_hook, &cmb)) goto end;
+
+	ub = uwsgi_buffer_new(uwsgi.page_size);
+	ub->pos = 4;
+
+	if (!uwsgi_strncmp(ucmc->cmd, ucmc->cmd_len, "mget", 4)) {
+		body = uwsgi_buffer_new(uwsgi.page_size);
+		if (uc->purge_lru)
+			uwsgi_cache_wlock(uc);
+		else
+			uwsgi_cache_rlock(uc);
+		locked = 1;
+		for(i=0;i<cmb.n;i++) {
+			uint64_t vallen = 0;
+			char *value = uwsgi_cache_get3(uc, cmb.keys[i], cmb.keys_len[i], &vallen, NULL);
+			if (!value) {
+				if (uwsgi_buffer_u64be(body, 0xffffffffffffffffLLU)) goto end;
+				continue;
+			}
+			if (uwsgi_buffer_u64be(body, vallen)) goto end;
+			if (uwsgi_buffer_append(body, value, vallen)) goto end;
+		}
+		uwsgi_cache_rwunlock(uc);
+		locked = 0;
+		if (uwsgi_buffer_append_keyval(ub, "status", 6, "ok", 2)) goto end;
+		if (uwsgi_buffer_append_keynum(ub, "size", 4, body->pos)) goto end;
+		if (uwsgi_buffer_set_uh(ub, 111, 17)) goto end;
+		if (uwsgi_buffer_append(ub, body->buf, body->pos)) goto end;
+		uwsgi_response_write_body_do(wsgi_req, ub->buf, ub->pos);
+		goto end;
+	}
+
+	if (!uwsgi_strncmp(ucmc->cmd, ucmc->cmd_len, "mset", 4) || !uwsgi_strncmp(ucmc->cmd, ucmc->cmd_len, "mupdate", 7)) {
+		uint64_t total = 0;
+		uint64_t failed = 0;
+		for(i=0;i<cmb.n;i++) {
+			if (cmb.sizes[i] > uc->max_item_size) goto end;
+			total += cmb.sizes[i];
+		}
+		char *values = NULL;
+		if (total > 0) {
+			wsgi_req->post_cl = total;
+			ssize_t rlen = 0;
+			values = uwsgi_request_body_read(wsgi_req, total, &rlen);
+			if (rlen != (ssize_t) total) goto end;
+		}
+		uwsgi_cache_wlock(uc);
+		for(i=0;i<cmb.n;i++) {
+			if (uwsgi_cache_set2(uc, cmb.keys[i], cmb.keys_len[i], values, cmb.sizes[i], ucmc->expires, ucmc->cmd_len > 4 ? UWSGI_CACHE_FLAG_UPDATE : 0)) failed++;
+			values += cmb.sizes[i];
+		}
+		uwsgi_cache_rwunlock(uc);
+		if (uwsgi_buffer_append_keyval(ub, "status", 6, "ok", 2)) goto end;
+		if (uwsgi_buffer_append_keynum(ub, "failed", 6, failed)) goto end;
+		if (uwsgi_buffer_set_uh(ub, 111, 17)) goto end;
+		uwsgi_response_write_body_do(wsgi_req, ub->buf, ub->pos);
+	}
+
+end:
+	if (locked) uwsgi_cache_rwunlock(uc);
+	if (ub) uwsgi_buffer_destroy(ub);
+	if (body) uwsgi_buffer_destroy(body);
+	free(cmb.keys);
+	free(cmb.keys_len);
+	free(cmb.sizes);
+}
+
 static void manage_magic_context(struct wsgi_request *wsgi_req, struct uwsgi_cache_magic_context *ucmc) {
 
 	struct uwsgi_buffer *ub = NULL;
 	struct uwsgi_cache *uc = uwsgi.caches;
+	// the lock of the key's segment (NULL for whole-cache operations)
+	struct uwsgi_lock_item *cl = NULL;
 
 	if (ucmc->cache_len > 0) {
 		uc = uwsgi_cache_by_namelen(ucmc->cache, ucmc->cache_len);
@@ -74,14 +190,38 @@ static void manage_magic_context(struct wsgi_request *wsgi_req, struct uwsgi_cac
 
 	if (!uc) return;
 
+	// batched commands
+	if (ucmc->cmd_len > 0 && ucmc->cmd[0] == 'm') {
+		manage_magic_batch(wsgi_req, uc, ucmc);
+		return;
+	}
+
 	// cache get
 	if (!uwsgi_strncmp(ucmc->cmd, ucmc->cmd_len, "get", 3)) {
 		uint64_t vallen = 0;
 		uint64_t expires = 0;
-		uwsgi_rlock(uc->lock);
+		int fd = -1;
+		uint64_t pos = 0;
+		// big values of file backed caches are directly sent from the store
+		if (!uwsgi_cache_magic_get_fd(ucmc->key, ucmc->key_len, &fd, &pos, &vallen, &expires, uc->name)) {
+			ub = uwsgi_buffer_new(uwsgi.page_size);
+			ub->pos = 4;
+			if (uwsgi_buffer_append_keyval(ub, "status", 6, "ok", 2)) goto unlocked_error;
+			if (uwsgi_buffer_append_keynum(ub, "size", 4, vallen)) goto unlocked_error;
+			if (expires) {
+				if (uwsgi_buffer_append_keynum(ub, "expires", 7, expires)) goto unlocked_error;
+			}
+			if (uwsgi_buffer_set_uh(ub, 111, 17)) goto unlocked_error;
+			uwsgi_response_write_body_do(wsgi_req, ub->buf, ub->pos);
+			uwsgi_buffer_destroy(ub);
+			uwsgi_response_sendfile_do_can_close(wsgi_req, fd, pos, vallen, 0);
+			return;
+		}
+		cl = uwsgi_cache_key_lock(uc, ucmc->key, ucmc->key_len);
+		uwsgi_rlock(cl);
 		char *value = uwsgi_cache_get3(uc, ucmc->key, ucmc->key_len, &vallen, &expires);
 		if (!value) {
-			uwsgi_rwunlock(uc->lock);
+			uwsgi_rwunlock(cl);
 			return;
 		}
 		// we are still locked !!!
@@ -95,7 +235,7 @@ static void manage_magic_context(struct wsgi_request *wsgi_req, struct uwsgi_cac
 		if (uwsgi_buffer_set_uh(ub, 111, 17)) goto error;
 		if (uwsgi_buffer_append(ub, value, vallen)) goto error;
 		// unlock !!!
-		uwsgi_rwunlock(uc->lock);
+		uwsgi_rwunlock(cl);
 		uwsgi_response_write_body_do(wsgi_req, ub->buf, ub->pos);
 		uwsgi_buffer_destroy(ub);
 		return;	
@@ -103,9 +243,10 @@ static void manage_magic_context(struct wsgi_request *wsgi_req, struct uwsgi_cac
 
 	// cache exists
 	if (!uwsgi_strncmp(ucmc->cmd, ucmc->cmd_len, "exists", 6)) {
-                uwsgi_rlock(uc->lock);
+                cl = uwsgi_cache_key_lock(uc, ucmc->key, ucmc->key_len);
+                uwsgi_rlock(cl);
                 if (!uwsgi_cache_exists2(uc, ucmc->key, ucmc->key_len)) {
-                        uwsgi_rwunlock(uc->lock);
+                        uwsgi_rwunlock(cl);
                         return;
                 }
                 // we are still locked !!!
@@ -114,7 +255,7 @@ static void manage_magic_context(struct wsgi_request *wsgi_req, struct uwsgi_cac
                 if (uwsgi_buffer_append_keyval(ub, "status", 6, "ok", 2)) goto error;
                 if (uwsgi_buffer_set_uh(ub, 111, 17)) goto error;
                 // unlock !!!
-                uwsgi_rwunlock(uc->lock);
+                uwsgi_rwunlock(cl);
                 uwsgi_response_write_body_do(wsgi_req, ub->buf, ub->pos);
                 uwsgi_buffer_destroy(ub);
                 return;
@@ -122,9 +263,10 @@ static void manage_magic_context(struct wsgi_request *wsgi_req, struct uwsgi_cac
 
 	// cache del
         if (!uwsgi_strncmp(ucmc->cmd, ucmc->cmd_len, "del", 3)) {
-                uwsgi_wlock(uc->lock);
+                cl = uwsgi_cache_key_lock(uc, ucmc->key, ucmc->key_len);
+                uwsgi_wlock(cl);
                 if (uwsgi_cache_del2(uc, ucmc->key, ucmc->key_len, 0, 0)) {
-                        uwsgi_rwunlock(uc->lock);
+                        uwsgi_rwunlock(cl);
                         return;
                 }
                 // we are still locked !!!
@@ -133,7 +275,7 @@ static void manage_magic_context(struct wsgi_request *wsgi_req, struct uwsgi_cac
                 if (uwsgi_buffer_append_keyval(ub, "status", 6, "ok", 2)) goto error;
                 if (uwsgi_buffer_set_uh(ub, 111, 17)) goto error;
                 // unlock !!!
-                uwsgi_rwunlock(uc->lock);
+                uwsgi_rwunlock(cl);
                 uwsgi_response_write_body_do(wsgi_req, ub->buf, ub->pos);
                 uwsgi_buffer_destroy(ub);
                 return;
@@ -142,10 +284,10 @@ static void manage_magic_context(struct wsgi_request *wsgi_req, struct uwsgi_cac
 	// cache clear
         if (!uwsgi_strncmp(ucmc->cmd, ucmc->cmd_len, "clear", 5)) {
 		uint64_t i;
-		uwsgi_wlock(uc->lock);
-		for (i = 1; i < uwsgi.caches->max_items; i++) {
+		uwsgi_cache_wlock(uc);
+		for (i = 1; i < uc->max_items; i++) {
 			if (uwsgi_cache_del2(uc, NULL, 0, i, 0)) {
-                                uwsgi_rwunlock(uc->lock);
+                                uwsgi_cache_rwunlock(uc);
                                 return;
                         }	
 		}
@@ -155,7 +297,7 @@ static void manage_magic_context(struct wsgi_request *wsgi_req, struct uwsgi_cac
                 if (uwsgi_buffer_append_keyval(ub, "status", 6, "ok", 2)) goto error;
                 if (uwsgi_buffer_set_uh(ub, 111, 17)) goto error;
                 // unlock !!!
-                uwsgi_rwunlock(uc->lock);
+                uwsgi_cache_rwunlock(uc);
                 uwsgi_response_write_body_do(wsgi_req, ub->buf, ub->pos);
                 uwsgi_buffer_destroy(ub);
                 return;
@@ -170,9 +312,10 @@ static void manage_magic_context(struct wsgi_request *wsgi_req, struct uwsgi_cac
 		char *value = uwsgi_request_body_read(wsgi_req, ucmc->size, &rlen);
 		if (rlen != (ssize_t) ucmc->size) return;
 		// ok let's lock
-		uwsgi_wlock(uc->lock);
+		cl = uwsgi_cache_key_lock(uc, ucmc->key, ucmc->key_len);
+		uwsgi_wlock(cl);
 		if (uwsgi_cache_set2(uc, ucmc->key, ucmc->key_len, value, ucmc->size, ucmc->expires, ucmc->cmd_len > 3 ? UWSGI_CACHE_FLAG_UPDATE : 0)) {
-			uwsgi_rwunlock(uc->lock);
+			uwsgi_rwunlock(cl);
 			return;
 		}
 		// we are still locked !!!
@@ -181,7 +324,7 @@ static void manage_magic_context(struct wsgi_request *wsgi_req, struct uwsgi_cac
                 if (uwsgi_buffer_append_keyval(ub, "status", 6, "ok", 2)) goto error;
 		if (uwsgi_buffer_set_uh(ub, 111, 17)) goto error;
 		// unlock !!!
-		uwsgi_rwunlock(uc->lock);
+		uwsgi_rwunlock(cl);
 		uwsgi_response_write_body_do(wsgi_req, ub->buf, ub->pos);
                 uwsgi_buffer_destroy(ub);
                 return;
@@ -189,7 +332,13 @@ static void manage_magic_context(struct wsgi_request *wsgi_req, struct uwsgi_cac
 
 	return;
 error:
-	uwsgi_rwunlock(uc->lock);
+	if (cl) {
+		uwsgi_rwunlock(cl);
+	}
+	else {
+		uwsgi_cache_rwunlock(uc);
+	}
+unlocked_error:
 	uwsgi_buffer_destroy(ub);
 }
 
@@ -271,6 +420,12 @@ static int uwsgi_cache_request(struct wsgi_request *wsgi_req) {
 
 			if (!uc) break;
 
+			// segmented caches have no contiguous memory area to dump
+			if (uc->segments) {
+				uwsgi_log("[cache] unable to dump segmented cache \"%s\"\n", uc->name);
+				break;
+			}
+
 			uwsgi_wlock(uc->lock);
 			struct uwsgi_buffer *cache_dump = uwsgi_buffer_new(uwsgi.page_size + uc->filesize);
 			cache_dump->pos = 4;
@@ -318,6 +473,8 @@ struct uwsgi_plugin cache_plugin = {
         .name = "cache",
         .modifier1 = 111,
         .request = uwsgi_cache_request,
+        .options = cache_memcached_options,
+        .init = cache_memcached_init,
 
 };
 
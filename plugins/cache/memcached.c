@@ -0,0 +1,960 @@
+#include <uwsgi.h>
+
+/*
+
+	memcached protocol server for the local caches
+
+	--cache-memcached-server spawns a gateway running --cache-memcached-threads event loops
+	(sharing the listening sockets). Both the text and the binary memcached protocols are
+	supported (the first byte of each request chooses it) and they work directly on the
+	cache memory, so a uWSGI node can replace a memcached sidecar.
+
+	Requests are pipelined: all of the commands available in a read are parsed and their
+	responses are sent with a single write. Values bigger than a memory page are written
+	straight from the cache memory (holding the read lock of the key) when the socket can
+	take them, only the unsent part is copied.
+
+	- client flags are not stored, 0 is always returned
+	- exptime follows the memcached rules (relative up to 30 days, unix time after, negative
+	  values mean already expired)
+	- incr/decr use the cache math api (UWSGI_CACHE_FLAG_MATH): counters are stored as 64bit
+	  native integers (like the other math users of the cache), other values are non-numeric
+	- the cas unique is the sequence counter of the hashtable slot of the key: it changes on
+	  every write to the slot, so a "cas" could fail because of a colliding key, but it never
+	  overwrites a newer value
+	- empty values cannot be stored in uWSGI caches, they are reported as not stored
+
+*/
+
+extern struct uwsgi_server uwsgi;
+
+#define MEMCACHED_EVENTS 64
+#define MEMCACHED_MAX_LINE 2048
+#define MEMCACHED_KEY_MAX 250
+#define MEMCACHED_RELATIVE_MAX (60*60*24*30)
+// stop parsing requests when this amount of responses is waiting for the socket
+#define MEMCACHED_OUT_HIGH (1024*1024)
+
+struct uwsgi_cache_memcached {
+	struct uwsgi_string_list *servers;
+	char *cache;
+	int threads;
+	struct uwsgi_cache *uc;
+	int *fds;
+	int fds_cnt;
+	struct memcached_peer **peers;
+} ucm;
+
+struct memcached_peer {
+	int fd;
+	struct uwsgi_buffer *in;
+	struct uwsgi_buffer *out;
+	size_t out_pos;
+	// bytes of a rejected value to discard
+	uint64_t swallow;
+	int writing;
+	int closing;
+};
+
+struct uwsgi_option cache_memcached_options[] = {
+	{"cache-memcached-server", required_argument, 0, "run a memcached protocol (text and binary) server for a local cache", uwsgi_opt_add_string_list, &ucm.servers, 0},
+	{"cache-memcached-cache", required_argument, 0, "the cache exposed by the memcached server (default: the first one)", uwsgi_opt_set_str, &ucm.cache, 0},
+	{"cache-memcached-threads", required_argument, 0, "number of event loop threads of the memcached server (default: cpu cores)", uwsgi_opt_set_int, &ucm.threads, 0},
+	{0, 0, 0, 0, 0, 0, 0},
+};
+
+enum {
+	MC_OK = 0,
+	MC_NOT_STORED,
+	MC_EXISTS,
+	MC_NOT_FOUND,
+	MC_TOO_LARGE,
+	MC_NON_NUMERIC,
+	MC_ERROR,
+	MC_INVALID,
+	MC_UNKNOWN,
+};
+
+static char *memcached_text_status[] = {
+	"STORED\r\n",
+	"NOT_STORED\r\n",
+	"EXISTS\r\n",
+	"NOT_FOUND\r\n",
+	"SERVER_ERROR object too large for cache\r\n",
+	"CLIENT_ERROR cannot increment or decrement non-numeric value\r\n",
+	"SERVER_ERROR out of memory storing object\r\n",
+	"CLIENT_ERROR bad command line format\r\n",
+	"ERROR\r\n",
+};
+
+static uint16_t memcached_binary_status[] = { 0x00, 0x05, 0x02, 0x01, 0x03, 0x06, 0x82, 0x04, 0x81 };
+
+static char *memcached_binary_message[] = {
+	"",
+	"Not stored.",
+	"Data exists for key.",
+	"Not found",
+	"Too large.",
+	"Non-numeric server-side value for incr or decr",
+	"Out of memory",
+	"Invalid arguments",
+	"Unknown command",
+};
+
+enum {
+	MC_SET = 0,
+	MC_ADD,
+	MC_REPLACE,
+	MC_APPEND,
+	MC_PREPEND,
+	MC_CAS,
+};
+
+// returns -1 if the item is already expired
+static int memcached_expires(int64_t exptime, uint64_t *expires, uint64_t *flags) {
+	*expires = 0;
+	if (exptime == 0) return 0;
+	if (exptime < 0) return -1;
+	if (exptime > MEMCACHED_RELATIVE_MAX) {
+		if ((uint64_t) exptime <= (uint64_t) uwsgi_now()) return -1;
+		*flags |= UWSGI_CACHE_FLAG_ABSEXPIRE;
+	}
+	*expires = exptime;
+	return 0;
+}
+
+static int memcached_store(int mode, char *key, uint16_t keylen, char *val, uint64_t vallen, int64_t exptime, uint64_t cas, uint64_t *new_cas) {
+	struct uwsgi_cache *uc = ucm.uc;
+	uint64_t expires = 0, flags = 0;
+	int ret = MC_OK;
+	char *buf = NULL;
+
+	if (vallen > uc->max_item_size) return MC_TOO_LARGE;
+	if (!vallen && mode != MC_APPEND && mode != MC_PREPEND) return MC_NOT_STORED;
+	int expired = memcached_expires(exptime, &expires, &flags);
+
+	struct uwsgi_lock_item *cl = uwsgi_cache_key_lock(uc, key, keylen);
+	uwsgi_wlock(cl);
+	int exists = uwsgi_cache_exists2(uc, key, keylen) != 0;
+
+	if (mode == MC_CAS && !cas) {
+		ret = MC_INVALID;
+		goto end;
+	}
+	if (cas && mode != MC_ADD) {
+		if (!exists) {
+			ret = MC_NOT_FOUND;
+			goto end;
+		}
+		if (cas != uwsgi_cache_generation(uc, key, keylen)) {
+			ret = MC_EXISTS;
+			goto end;
+		}
+	}
+
+	switch(mode) {
+		case MC_ADD:
+			if (exists) {
+				ret = MC_NOT_STORED;
+				goto end;
+			}
+			break;
+		case MC_APPEND:
+		case MC_PREPEND:
+			if (!exists) {
+				ret = MC_NOT_STORED;
+				goto end;
+			}
+			uint64_t old_len = 0;
+			char *old = uwsgi_cache_get2(uc, key, keylen, &old_len);
+			if (!old) {
+				ret = MC_NOT_STORED;
+				goto end;
+			}
+			if (old_len + vallen > uc->max_item_size) {
+				ret = MC_TOO_LARGE;
+				goto end;
+			}
+			buf = uwsgi_malloc(old_len + vallen);
+			if (mode == MC_APPEND) {
+				memcpy(buf, old, old_len);
+				memcpy(buf + old_len, val, vallen);
+			}
+			else {
+				memcpy(buf, val, vallen);
+				memcpy(buf + vallen, old, old_len);
+			}
+			val = buf;
+			vallen += old_len;
+			// the expiration is not changed
+			flags = UWSGI_CACHE_FLAG_UPDATE | UWSGI_CACHE_FLAG_FIXEXPIRE;
+			expired = 0;
+			break;
+		case MC_REPLACE:
+			if (!exists) {
+				ret = MC_NOT_STORED;
+				goto end;
+			}
+			// fallthrough
+		default:
+			flags |= UWSGI_CACHE_FLAG_UPDATE;
+			break;
+	}
+
+	if (expired) {
+		if (exists) uwsgi_cache_del2(uc, key, keylen, 0, 0);
+		goto end;
+	}
+
+	if (uwsgi_cache_set2(uc, key, keylen, val, vallen, expires, flags)) {
+		ret = MC_ERROR;
+		goto end;
+	}
+	if (new_cas) *new_cas = uwsgi_cache_generation(uc, key, keylen);
+end:
+	uwsgi_rwunlock(cl);
+	free(buf);
+	return ret;
+}
+
+static int memcached_delete(char *key, uint16_t keylen) {
+	struct uwsgi_cache *uc = ucm.uc;
+	struct uwsgi_lock_item *cl = uwsgi_cache_key_lock(uc, key, keylen);
+	uwsgi_wlock(cl);
+	int ret = uwsgi_cache_del2(uc, key, keylen, 0, 0) ? MC_NOT_FOUND : MC_OK;
+	uwsgi_rwunlock(cl);
+	return ret;
+}
+
+/*
+	incr/decr, missing keys are created with the initial value when create is set,
+	decrementing below 0 sets the counter to 0 (like memcached does)
+*/
+static int memcached_math(char *key, uint16_t keylen, int decr, uint64_t delta, int create, uint64_t initial, int64_t exptime, uint64_t *result, uint64_t *new_cas) {
+	struct uwsgi_cache *uc = ucm.uc;
+	int ret = MC_OK;
+	struct uwsgi_lock_item *cl = uwsgi_cache_key_lock(uc, key, keylen);
+	uwsgi_wlock(cl);
+
+	if (!uwsgi_cache_exists2(uc, key, keylen)) {
+		if (!create) {
+			ret = MC_NOT_FOUND;
+			goto end;
+		}
+		uint64_t expires = 0, flags = 0;
+		memcached_expires(exptime, &expires, &flags);
+		int64_t num = initial;
+		if (uwsgi_cache_set2(uc, key, keylen, (char *) &num, 8, expires, flags)) {
+			ret = MC_ERROR;
+			goto end;
+		}
+		*result = initial;
+		goto done;
+	}
+
+	uint64_t vallen = 0;
+	if (!uwsgi_cache_get2(uc, key, keylen, &vallen) || vallen != 8) {
+		ret = MC_NON_NUMERIC;
+		goto end;
+	}
+
+	int64_t num = delta;
+	uint64_t flags = UWSGI_CACHE_FLAG_UPDATE | UWSGI_CACHE_FLAG_FIXEXPIRE | UWSGI_CACHE_FLAG_MATH;
+	flags |= decr ? UWSGI_CACHE_FLAG_DEC : UWSGI_CACHE_FLAG_INC;
+	if (uwsgi_cache_set2(uc, key, keylen, (char *) &num, 8, 0, flags)) {
+		ret = MC_ERROR;
+		goto end;
+	}
+	num = uwsgi_cache_num2(uc, key, keylen);
+	if (decr && num < 0) {
+		num = 0;
+		uwsgi_cache_set2(uc, key, keylen, (char *) &num, 8, 0, UWSGI_CACHE_FLAG_UPDATE | UWSGI_CACHE_FLAG_FIXEXPIRE);
+	}
+	*result = num;
+done:
+	if (new_cas) *new_cas = uwsgi_cache_generation(uc, key, keylen);
+end:
+	uwsgi_rwunlock(cl);
+	return ret;
+}
+
+// returns 0 even if the socket cannot take the whole output
+static int memcached_flush(struct memcached_peer *mp) {
+	while (mp->out_pos < mp->out->pos) {
+		ssize_t wlen = write(mp->fd, mp->out->buf + mp->out_pos, mp->out->pos - mp->out_pos);
+		if (wlen < 0) {
+			if (uwsgi_is_again()) return 0;
+			return -1;
+		}
+		if (wlen == 0) return -1;
+		mp->out_pos += wlen;
+	}
+	mp->out->pos = 0;
+	mp->out_pos = 0;
+	return 0;
+}
+
+static int memcached_append(struct memcached_peer *mp, char *buf, size_t len) {
+	return uwsgi_buffer_append(mp->out, buf, len);
+}
+
+/*
+	queue a response containing a value, big values are written directly from
+	the cache memory when all of the previous responses have been sent.
+	The caller holds the lock of the key.
+*/
+static int memcached_send_value(struct memcached_peer *mp, char *head, size_t head_len, char *value, uint64_t vallen, char *tail, size_t tail_len) {
+	if (vallen >= (uint64_t) uwsgi.page_size) {
+		if (memcached_flush(mp)) return -1;
+		if (mp->out->pos == 0) {
+			struct iovec iov[3];
+			iov[0].iov_base = head;
+			iov[0].iov_len = head_len;
+			iov[1].iov_base = value;
+			iov[1].iov_len = vallen;
+			iov[2].iov_base = tail;
+			iov[2].iov_len = tail_len;
+			ssize_t wlen = writev(mp->fd, iov, 3);
+			if (wlen < 0) {
+				if (!uwsgi_is_again()) return -1;
+				wlen = 0;
+			}
+			// copy what the socket did not take
+			size_t skip = wlen;
+			int i;
+			for (i = 0; i < 3; i++) {
+				if (skip >= iov[i].iov_len) {
+					skip -= iov[i].iov_len;
+					continue;
+				}
+				if (memcached_append(mp, (char *) iov[i].iov_base + skip, iov[i].iov_len - skip)) return -1;
+				skip = 0;
+			}
+			return 0;
+		}
+	}
+	if (memcached_append(mp, head, head_len)) return -1;
+	if (vallen && memcached_append(mp, value, vallen)) return -1;
+	if (tail_len && memcached_append(mp, tail, tail_len)) return -1;
+	return 0;
+}
+
+static char *memcached_token(char **p, char *end, size_t *len) {
+	char *s = *p;
+	while (s < end && *s == ' ') s++;
+	if (s >= end) return NULL;
+	char *e = s;
+	while (e < end && *e != ' ') e++;
+	*len = e - s;
+	*p = e;
+	return s;
+}
+
+static int memcached_num(char *s, size_t len, uint64_t *n) {
+	uint64_t num = 0;
+	size_t i;
+	if (!s || !len || len > 20) return -1;
+	for (i = 0; i < len; i++) {
+		if (s[i] < '0' || s[i] > '9') return -1;
+		num = (num * 10) + (s[i] - '0');
+	}
+	*n = num;
+	return 0;
+}
+
+static int memcached_signed_num(char *s, size_t len, int64_t *n) {
+	uint64_t num = 0;
+	if (s && len > 1 && s[0] == '-') {
+		if (memcached_num(s + 1, len - 1, &num)) return -1;
+		*n = -((int64_t) num);
+		return 0;
+	}
+	if (memcached_num(s, len, &num)) return -1;
+	*n = num;
+	return 0;
+}
+
+static int memcached_valid_key(size_t keylen) {
+	return keylen > 0 && keylen <= MEMCACHED_KEY_MAX && keylen <= ucm.uc->keysize;
+}
+
+static int memcached_text_get(struct memcached_peer *mp, char *p, char *end, int with_cas) {
+	struct uwsgi_cache *uc = ucm.uc;
+	char head[MEMCACHED_KEY_MAX + 64];
+	size_t keylen = 0;
+	char *key;
+	while ((key = memcached_token(&p, end, &keylen))) {
+		if (!memcached_valid_key(keylen)) {
+			return memcached_append(mp, memcached_text_status[MC_INVALID], strlen(memcached_text_status[MC_INVALID]));
+		}
+		struct uwsgi_lock_item *cl = uwsgi_cache_key_lock(uc, key, keylen);
+		if (uc->purge_lru)
+			uwsgi_wlock(cl);
+		else
+			uwsgi_rlock(cl);
+		int ret = 0;
+		uint64_t vallen = 0;
+		char *value = uwsgi_cache_get2(uc, key, keylen, &vallen);
+		if (value) {
+			int hlen;
+			if (with_cas) {
+				hlen = snprintf(head, sizeof(head), "VALUE %.*s 0 %llu %llu\r\n", (int) keylen, key, (unsigned long long) vallen, (unsigned long long) uwsgi_cache_generation(uc, key, keylen));
+			}
+			else {
+				hlen = snprintf(head, sizeof(head), "VALUE %.*s 0 %llu\r\n", (int) keylen, key, (unsigned long long) vallen);
+			}
+			ret = memcached_send_value(mp, head, hlen, value, vallen, "\r\n", 2);
+		}
+		uwsgi_rwunlock(cl);
+		if (ret) return -1;
+	}
+	return memcached_append(mp, "END\r\n", 5);
+}
+
+static int memcached_is_noreply(char *p, char *end) {
+	size_t len = 0;
+	char *token = memcached_token(&p, end, &len);
+	return token && !uwsgi_strncmp(token, len, "noreply", 7);
+}
+
+static ssize_t memcached_text_store(struct memcached_peer *mp, int mode, char *p, char *end, char *buf, size_t len, size_t consumed) {
+	size_t keylen = 0, flags_len = 0, exptime_len = 0, bytes_len = 0, cas_len = 0;
+	uint64_t bytes = 0, cas = 0, client_flags = 0;
+	int64_t exptime = 0;
+	char *key = memcached_token(&p, end, &keylen);
+	char *c_flags = memcached_token(&p, end, &flags_len);
+	char *c_exptime = memcached_token(&p, end, &exptime_len);
+	char *c_bytes = memcached_token(&p, end, &bytes_len);
+	char *c_cas = mode == MC_CAS ? memcached_token(&p, end, &cas_len) : NULL;
+	int noreply = memcached_is_noreply(p, end);
+
+	if (memcached_num(c_bytes, bytes_len, &bytes)) {
+		mp->closing = 1;
+		return memcached_append(mp, memcached_text_status[MC_INVALID], strlen(memcached_text_status[MC_INVALID])) ? -1 : (ssize_t) consumed;
+	}
+
+	int ret = MC_OK;
+	if (!key || !memcached_valid_key(keylen) || memcached_num(c_flags, flags_len, &client_flags)
+		|| memcached_signed_num(c_exptime, exptime_len, &exptime) || (mode == MC_CAS && memcached_num(c_cas, cas_len, &cas))) {
+		ret = MC_INVALID;
+	}
+	else if (bytes > ucm.uc->max_item_size) {
+		ret = MC_TOO_LARGE;
+	}
+
+	if (ret != MC_OK) {
+		mp->swallow = bytes + 2;
+		return memcached_append(mp, memcached_text_status[ret], strlen(memcached_text_status[ret])) ? -1 : (ssize_t) consumed;
+	}
+
+	// wait for the whole value
+	if (len < consumed + bytes + 2) return 0;
+
+	char *value = buf + consumed;
+	if (value[bytes] != '\r' || value[bytes + 1] != '\n') {
+		char *msg = "CLIENT_ERROR bad data chunk\r\n";
+		return memcached_append(mp, msg, strlen(msg)) ? -1 : (ssize_t) (consumed + bytes + 2);
+	}
+
+	ret = memcached_store(mode, key, keylen, value, bytes, exptime, cas, NULL);
+	if (!noreply && memcached_append(mp, memcached_text_status[ret], strlen(memcached_text_status[ret]))) return -1;
+	return consumed + bytes + 2;
+}
+
+static int memcached_text_stats(struct memcached_peer *mp) {
+	struct uwsgi_cache *uc = ucm.uc;
+	uint64_t n_items = 0, hits = 0, miss = 0, full = 0;
+	char stats[1024];
+	uwsgi_cache_counters(uc, &n_items, &hits, &miss, &full);
+	int ret = snprintf(stats, sizeof(stats), "STAT pid %d\r\nSTAT uptime %llu\r\nSTAT version %s\r\nSTAT threads %d\r\n"
+		"STAT curr_items %llu\r\nSTAT get_hits %llu\r\nSTAT get_misses %llu\r\nSTAT limit_maxbytes %llu\r\nSTAT evictions %llu\r\nEND\r\n",
+		(int) getpid(), (unsigned long long) (uwsgi_now() - uwsgi.start_tv.tv_sec), UWSGI_VERSION, ucm.threads,
+		(unsigned long long) n_items, (unsigned long long) hits, (unsigned long long) miss,
+		(unsigned long long) (uc->max_items * uc->blocksize), (unsigned long long) full);
+	if (ret <= 0 || ret >= (int) sizeof(stats)) return -1;
+	return memcached_append(mp, stats, ret);
+}
+
+// returns the number of consumed bytes, 0 if more data is needed or -1 on error
+static ssize_t memcached_text(struct memcached_peer *mp, char *buf, size_t len) {
+	char *nl = memchr(buf, '\n', len);
+	if (!nl) {
+		if (len > MEMCACHED_MAX_LINE) {
+			char *msg = "CLIENT_ERROR line too long\r\n";
+			mp->closing = 1;
+			return memcached_append(mp, msg, strlen(msg)) ? -1 : (ssize_t) len;
+		}
+		return 0;
+	}
+
+	size_t consumed = (nl - buf) + 1;
+	char *end = nl;
+	if (end > buf && *(end - 1) == '\r') end--;
+
+	char *p = buf;
+	size_t cmd_len = 0;
+	char *cmd = memcached_token(&p, end, &cmd_len);
+	int ret = 0;
+
+	if (!cmd) {
+		ret = memcached_append(mp, memcached_text_status[MC_UNKNOWN], strlen(memcached_text_status[MC_UNKNOWN]));
+	}
+	else if (!uwsgi_strncmp(cmd, cmd_len, "get", 3)) {
+		ret = memcached_text_get(mp, p, end, 0);
+	}
+	else if (!uwsgi_strncmp(cmd, cmd_len, "gets", 4)) {
+		ret = memcached_text_get(mp, p, end, 1);
+	}
+	else if (!uwsgi_strncmp(cmd, cmd_len, "set", 3)) {
+		return memcached_text_store(mp, MC_SET, p, end, buf, len, consumed);
+	}
+	else if (!uwsgi_strncmp(cmd, cmd_len, "add", 3)) {
+		return memcached_text_store(mp, MC_ADD, p, end, buf, len, consumed);
+	}
+	else if (!uwsgi_strncmp(cmd, cmd_len, "replace", 7)) {
+		return memcached_text_store(mp, MC_REPLACE, p, end, buf, len, consumed);
+	}
+	else if (!uwsgi_strncmp(cmd, cmd_len, "append", 6)) {
+		return memcached_text_store(mp, MC_APPEND, p, end, buf, len, consumed);
+	}
+	else if (!uwsgi_strncmp(cmd, cmd_len, "prepend", 7)) {
+		return memcached_text_store(mp, MC_PREPEND, p, end, buf, len, consumed);
+	}
+	else if (!uwsgi_strncmp(cmd, cmd_len, "cas", 3)) {
+		return memcached_text_store(mp, MC_CAS, p, end, buf, len, consumed);
+	}
+	else if (!uwsgi_strncmp(cmd, cmd_len, "delete", 6)) {
+		size_t keylen = 0;
+		char *key = memcached_token(&p, end, &keylen);
+		int noreply = memcached_is_noreply(p, end);
+		if (!key || !memcached_valid_key(keylen)) {
+			ret = memcached_append(mp, memcached_text_status[MC_INVALID], strlen(memcached_text_status[MC_INVALID]));
+		}
+		else if (memcached_delete(key, keylen) == MC_OK) {
+			if (!noreply) ret = memcached_append(mp, "DELETED\r\n", 9);
+		}
+		else if (!noreply) {
+			ret = memcached_append(mp, memcached_text_status[MC_NOT_FOUND], strlen(memcached_text_status[MC_NOT_FOUND]));
+		}
+	}
+	else if (!uwsgi_strncmp(cmd, cmd_len, "incr", 4) || !uwsgi_strncmp(cmd, cmd_len, "decr", 4)) {
+		size_t keylen = 0, delta_len = 0;
+		uint64_t delta = 0, result = 0;
+		char *key = memcached_token(&p, end, &keylen);
+		char *c_delta = memcached_token(&p, end, &delta_len);
+		int noreply = memcached_is_noreply(p, end);
+		if (!key || !memcached_valid_key(keylen) || memcached_num(c_delta, delta_len, &delta)) {
+			char *msg = "CLIENT_ERROR invalid numeric delta argument\r\n";
+			ret = memcached_append(mp, msg, strlen(msg));
+		}
+		else {
+			int status = memcached_math(key, keylen, cmd[0] == 'd', delta, 0, 0, 0, &result, NULL);
+			if (!noreply) {
+				if (status == MC_OK) {
+					char num[sizeof(UMAX64_STR) + 3];
+					int nlen = snprintf(num, sizeof(num), "%llu\r\n", (unsigned long long) result);
+					ret = memcached_append(mp, num, nlen);
+				}
+				else {
+					ret = memcached_append(mp, memcached_text_status[status], strlen(memcached_text_status[status]));
+				}
+			}
+		}
+	}
+	else if (!uwsgi_strncmp(cmd, cmd_len, "flush_all", 9)) {
+		int status = uwsgi_cache_magic_clear(ucm.uc->name);
+		if (!memcached_is_noreply(p, end)) {
+			ret = status ? memcached_append(mp, "SERVER_ERROR unable to clear the cache\r\n", 40) : memcached_append(mp, "OK\r\n", 4);
+		}
+	}
+	else if (!uwsgi_strncmp(cmd, cmd_len, "stats", 5)) {
+		ret = memcached_text_stats(mp);
+	}
+	else if (!uwsgi_strncmp(cmd, cmd_len, "version", 7)) {
+		ret = memcached_append(mp, "VERSION " UWSGI_VERSION "\r\n", 10 + strlen(UWSGI_VERSION));
+	}
+	else if (!uwsgi_strncmp(cmd, cmd_len, "verbosity", 9)) {
+		size_t level_len = 0;
+		memcached_token(&p, end, &level_len);
+		if (!memcached_is_noreply(p, end)) ret = memcached_append(mp, "OK\r\n", 4);
+	}
+	else if (!uwsgi_strncmp(cmd, cmd_len, "quit", 4)) {
+		mp->closing = 1;
+	}
+	else {
+		ret = memcached_append(mp, memcached_text_status[MC_UNKNOWN], strlen(memcached_text_status[MC_UNKNOWN]));
+	}
+
+	if (ret) return -1;
+	return consumed;
+}
+
+struct memcached_binary_header {
+	uint8_t magic;
+	uint8_t opcode;
+	uint16_t keylen;
+	uint8_t extlen;
+	uint8_t datatype;
+	uint16_t status;
+	uint32_t bodylen;
+	uint32_t opaque;
+	uint64_t cas;
+} __attribute__ ((__packed__));
+
+static int memcached_binary_response(struct memcached_peer *mp, struct memcached_binary_header *req, int status, uint64_t cas,
+	char *extras, uint8_t extlen, char *key, uint16_t keylen, char *value, uint64_t vallen) {
+
+	char head[sizeof(struct memcached_binary_header) + 8 + MEMCACHED_KEY_MAX];
+	struct memcached_binary_header *res = (struct memcached_binary_header *) head;
+
+	if (status != MC_OK && !value) {
+		value = memcached_binary_message[status];
+		vallen = strlen(value);
+	}
+
+	res->magic = 0x81;
+	res->opcode = req->opcode;
+	res->keylen = htons(keylen);
+	res->extlen = extlen;
+	res->datatype = 0;
+	res->status = htons(memcached_binary_status[status]);
+	res->bodylen = htonl(extlen + keylen + vallen);
+	res->opaque = req->opaque;
+	// uwsgi_be64() swaps the host order too
+	res->cas = uwsgi_be64((char *) &cas);
+	size_t hlen = sizeof(struct memcached_binary_header);
+	memcpy(head + hlen, extras, extlen);
+	hlen += extlen;
+	memcpy(head + hlen, key, keylen);
+	hlen += keylen;
+	return memcached_send_value(mp, head, hlen, value, vallen, NULL, 0);
+}
+
+static ssize_t memcached_binary(struct memcached_peer *mp, char *buf, size_t len) {
+	struct uwsgi_cache *uc = ucm.uc;
+	struct memcached_binary_header req;
+	size_t hlen = sizeof(struct memcached_binary_header);
+
+	if (len < hlen) return 0;
+	memcpy(&req, buf, hlen);
+
+	uint16_t keylen = ntohs(req.keylen);
+	uint32_t bodylen = ntohl(req.bodylen);
+	uint64_t cas = uwsgi_be64(buf + 16);
+
+	if ((uint32_t) req.extlen + keylen > bodylen) return -1;
+	if (bodylen > uc->max_item_size + MEMCACHED_MAX_LINE) {
+		mp->swallow = bodylen;
+		return memcached_binary_response(mp, &req, MC_TOO_LARGE, 0, NULL, 0, NULL, 0, NULL, 0) ? -1 : (ssize_t) hlen;
+	}
+	if (len < hlen + bodylen) return 0;
+
+	char *extras = buf + hlen;
+	char *key = extras + req.extlen;
+	char *value = key + keylen;
+	uint64_t vallen = bodylen - req.extlen - keylen;
+	ssize_t consumed = hlen + bodylen;
+	int ret = 0, status = MC_OK, quiet = 0;
+	uint64_t new_cas = 0;
+
+	switch (req.opcode) {
+		// get, getq, getk, getkq
+		case 0x00:
+		case 0x09:
+		case 0x0c:
+		case 0x0d: {
+			int with_key = req.opcode >= 0x0c;
+			quiet = req.opcode == 0x09 || req.opcode == 0x0d;
+			if (req.extlen || vallen || !memcached_valid_key(keylen)) {
+				status = MC_INVALID;
+				break;
+			}
+			struct uwsgi_lock_item *cl = uwsgi_cache_key_lock(uc, key, keylen);
+			if (uc->purge_lru)
+				uwsgi_wlock(cl);
+			else
+				uwsgi_rlock(cl);
+			uint64_t item_len = 0;
+			char *item = uwsgi_cache_get2(uc, key, keylen, &item_len);
+			if (item) {
+				uint32_t client_flags = 0;
+				ret = memcached_binary_response(mp, &req, MC_OK, uwsgi_cache_generation(uc, key, keylen), (char *) &client_flags, 4,
+					with_key ? key : NULL, with_key ? keylen : 0, item, item_len);
+			}
+			uwsgi_rwunlock(cl);
+			if (item) return ret ? -1 : consumed;
+			if (quiet) return consumed;
+			return memcached_binary_response(mp, &req, MC_NOT_FOUND, 0, NULL, 0, with_key ? key : NULL, with_key ? keylen : 0, NULL, 0) ? -1 : consumed;
+		}
+		// set, add, replace (and the quiet versions)
+		case 0x01:
+		case 0x02:
+		case 0x03:
+		case 0x11:
+		case 0x12:
+		case 0x13: {
+			quiet = req.opcode >= 0x11;
+			if (req.extlen != 8 || !memcached_valid_key(keylen)) {
+				status = MC_INVALID;
+				break;
+			}
+			int mode = (req.opcode & 0x0f) == 0x02 ? MC_ADD : ((req.opcode & 0x0f) == 0x03 ? MC_REPLACE : MC_SET);
+			status = memcached_store(mode, key, keylen, value, vallen, uwsgi_be32(extras + 4), cas, &new_cas);
+			break;
+		}
+		// append, prepend (and the quiet versions)
+		case 0x0e:
+		case 0x0f:
+		case 0x19:
+		case 0x1a:
+			quiet = req.opcode >= 0x19;
+			if (req.extlen || !memcached_valid_key(keylen)) {
+				status = MC_INVALID;
+				break;
+			}
+			status = memcached_store((req.opcode == 0x0e || req.opcode == 0x19) ? MC_APPEND : MC_PREPEND, key, keylen, value, vallen, 0, cas, &new_cas);
+			break;
+		// delete, deleteq
+		case 0x04:
+		case 0x14:
+			quiet = req.opcode == 0x14;
+			if (req.extlen || vallen || !memcached_valid_key(keylen)) {
+				status = MC_INVALID;
+				break;
+			}
+			status = memcached_delete(key, keylen);
+			break;
+		// incr, decr (and the quiet versions)
+		case 0x05:
+		case 0x06:
+		case 0x15:
+		case 0x16: {
+			quiet = req.opcode >= 0x15;
+			if (req.extlen != 20 || vallen || !memcached_valid_key(keylen)) {
+				status = MC_INVALID;
+				break;
+			}
+			uint32_t exptime = uwsgi_be32(extras + 16);
+			uint64_t result = 0;
+			status = memcached_math(key, keylen, (req.opcode & 0x0f) == 0x06, uwsgi_be64(extras), exptime != 0xffffffff, uwsgi_be64(extras + 8), exptime, &result, &new_cas);
+			if (status == MC_OK && !quiet) {
+				uint64_t be_result = uwsgi_be64((char *) &result);
+				return memcached_binary_response(mp, &req, MC_OK, new_cas, NULL, 0, NULL, 0, (char *) &be_result, 8) ? -1 : consumed;
+			}
+			break;
+		}
+		// quit, quitq
+		case 0x07:
+		case 0x17:
+			quiet = req.opcode == 0x17;
+			mp->closing = 1;
+			break;
+		// flush, flushq
+		case 0x08:
+		case 0x18:
+			quiet = req.opcode == 0x18;
+			if (uwsgi_cache_magic_clear(uc->name)) status = MC_ERROR;
+			break;
+		// noop
+		case 0x0a:
+			break;
+		// version
+		case 0x0b:
+			return memcached_binary_response(mp, &req, MC_OK, 0, NULL, 0, NULL, 0, UWSGI_VERSION, strlen(UWSGI_VERSION)) ? -1 : consumed;
+		default:
+			status = MC_UNKNOWN;
+			break;
+	}
+
+	if (quiet && status == MC_OK) return consumed;
+	return memcached_binary_response(mp, &req, status, new_cas, NULL, 0, NULL, 0, NULL, 0) ? -1 : consumed;
+}
+
+// returns 1 when stopped by the output high watermark, 0 when all of the complete requests have been parsed
+static int memcached_process(struct memcached_peer *mp) {
+	size_t pos = 0;
+	int ret = 0;
+	while (pos < mp->in->pos && !mp->closing) {
+		if (mp->out->pos >= MEMCACHED_OUT_HIGH) {
+			ret = 1;
+			break;
+		}
+		char *buf = mp->in->buf + pos;
+		size_t len = mp->in->pos - pos;
+		if (mp->swallow) {
+			size_t discard = UMIN(mp->swallow, len);
+			mp->swallow -= discard;
+			pos += discard;
+			continue;
+		}
+		ssize_t rlen = (uint8_t) buf[0] == 0x80 ? memcached_binary(mp, buf, len) : memcached_text(mp, buf, len);
+		if (rlen < 0) return -1;
+		if (rlen == 0) break;
+		pos += rlen;
+	}
+	if (pos) uwsgi_buffer_decapitate(mp->in, pos);
+	return ret;
+}
+
+static void memcached_peer_close(struct memcached_peer *mp) {
+	ucm.peers[mp->fd] = NULL;
+	close(mp->fd);
+	uwsgi_buffer_destroy(mp->in);
+	uwsgi_buffer_destroy(mp->out);
+	free(mp);
+}
+
+static void memcached_peer_run(int queue, struct memcached_peer *mp) {
+	for (;;) {
+		int ret = memcached_process(mp);
+		if (ret < 0) goto close;
+		if (memcached_flush(mp)) goto close;
+		// stop reading until the socket has taken the responses
+		if (mp->out->pos) {
+			if (!mp->writing) {
+				if (event_queue_fd_read_to_write(queue, mp->fd)) goto close;
+				mp->writing = 1;
+			}
+			return;
+		}
+		if (mp->closing) goto close;
+		if (mp->writing) {
+			if (event_queue_fd_write_to_read(queue, mp->fd)) goto close;
+			mp->writing = 0;
+		}
+		if (ret == 0) return;
+	}
+close:
+	memcached_peer_close(mp);
+}
+
+static void memcached_peer_read(int queue, struct memcached_peer *mp) {
+	if (uwsgi_buffer_ensure(mp->in, uwsgi.page_size) && mp->in->pos >= mp->in->len) {
+		uwsgi_log("[cache-memcached] request too big, closing connection\n");
+		memcached_peer_close(mp);
+		return;
+	}
+	ssize_t rlen = read(mp->fd, mp->in->buf + mp->in->pos, mp->in->len - mp->in->pos);
+	if (rlen < 0 && uwsgi_is_again()) return;
+	if (rlen <= 0) {
+		memcached_peer_close(mp);
+		return;
+	}
+	mp->in->pos += rlen;
+	memcached_peer_run(queue, mp);
+}
+
+static void memcached_accept(int queue, int fd) {
+	struct sockaddr_storage addr;
+	socklen_t addr_len = sizeof(addr);
+	int client = accept(fd, (struct sockaddr *) &addr, &addr_len);
+	if (client < 0) {
+		if (!uwsgi_is_again()) uwsgi_error("[cache-memcached] accept()");
+		return;
+	}
+	if (client >= (int) uwsgi.max_fd) {
+		uwsgi_log("[cache-memcached] too many connections\n");
+		close(client);
+		return;
+	}
+	uwsgi_socket_nb(client);
+	if (addr.ss_family != AF_UNIX) uwsgi_tcp_nodelay(client);
+
+	struct memcached_peer *mp = uwsgi_calloc(sizeof(struct memcached_peer));
+	mp->fd = client;
+	mp->in = uwsgi_buffer_new(uwsgi.page_size);
+	// a whole value, its command line and a bit of the next pipelined request
+	mp->in->limit = ucm.uc->max_item_size + (MEMCACHED_MAX_LINE * 2);
+	mp->out = uwsgi_buffer_new(uwsgi.page_size);
+	ucm.peers[client] = mp;
+	if (event_queue_add_fd_read(queue, client)) {
+		memcached_peer_close(mp);
+	}
+}
+
+static void *memcached_loop(void *arg) {
+	int i;
+	int queue = event_queue_init();
+	void *events = event_queue_alloc(MEMCACHED_EVENTS);
+
+	for (i = 0; i < ucm.fds_cnt; i++) {
+		event_queue_add_fd_read(queue, ucm.fds[i]);
+	}
+
+	for (;;) {
+		int nevents = event_queue_wait_multi(queue, -1, events, MEMCACHED_EVENTS);
+		for (i = 0; i < nevents; i++) {
+			int interesting_fd = event_queue_interesting_fd(events, i);
+			int j, is_server = 0;
+			for (j = 0; j < ucm.fds_cnt; j++) {
+				if (ucm.fds[j] == interesting_fd) {
+					memcached_accept(queue, interesting_fd);
+					is_server = 1;
+					break;
+				}
+			}
+			if (is_server) continue;
+			struct memcached_peer *mp = ucm.peers[interesting_fd];
+			if (!mp) continue;
+			if (mp->writing) {
+				memcached_peer_run(queue, mp);
+			}
+			else {
+				memcached_peer_read(queue, mp);
+			}
+		}
+	}
+	return NULL;
+}
+
+static void memcached_gateway(int id, void *data) {
+	int i;
+	ucm.peers = uwsgi_calloc(sizeof(struct memcached_peer *) * uwsgi.max_fd);
+	// every thread has its event queue, the connections stay in the thread accepting them
+	for (i = 1; i < ucm.threads; i++) {
+		pthread_t t;
+		if (pthread_create(&t, NULL, memcached_loop, NULL)) {
+			uwsgi_error("[cache-memcached] pthread_create()");
+			exit(1);
+		}
+	}
+	memcached_loop(NULL);
+}
+
+int cache_memcached_init() {
+	if (!ucm.servers) return 0;
+
+	ucm.uc = ucm.cache ? uwsgi_cache_by_name(ucm.cache) : uwsgi.caches;
+	if (!ucm.uc) {
+		uwsgi_log("[cache-memcached] unable to find cache \"%s\"\n", ucm.cache ? ucm.cache : "default");
+		exit(1);
+	}
+	if (ucm.threads <= 0) ucm.threads = uwsgi.cpus > 0 ? uwsgi.cpus : 1;
+
+	struct uwsgi_string_list *usl;
+	uwsgi_foreach(usl, ucm.servers) {
+		char *name = uwsgi_str(usl->value);
+		char *tcp_port = strrchr(name, ':');
+		int fd = tcp_port ? bind_to_tcp(name, uwsgi.listen_queue, tcp_port) : bind_to_unix(name, uwsgi.listen_queue, uwsgi.chmod_socket, uwsgi.abstract_socket);
+		if (fd < 0) {
+			uwsgi_log("[cache-memcached] unable to bind to %s\n", usl->value);
+			exit(1);
+		}
+		free(name);
+		uwsgi_socket_nb(fd);
+		ucm.fds = realloc(ucm.fds, sizeof(int) * (ucm.fds_cnt + 1));
+		if (!ucm.fds) {
+			uwsgi_error("[cache-memcached] realloc()");
+			exit(1);
+		}
+		ucm.fds[ucm.fds_cnt++] = fd;
+		uwsgi_log("memcached server for cache \"%s\" bound on %s fd %d (%d threads)\n", ucm.uc->name, usl->value, fd, ucm.threads);
+	}
+
+	if (register_gateway("uWSGI memcached", memcached_gateway, NULL) == NULL) {
+		uwsgi_log("unable to register the memcached gateway\n");
+		exit(1);
+	}
+
+	return 0;
+}
@@ -4,4 +4,4 @@ CFLAGS = []
 LDFLAGS = []
 LIBS = []
 
-GCC_LIST = ['cache']
+GCC_LIST = ['cache', 'memcached']
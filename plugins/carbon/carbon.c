@@ -38,8 +38,12 @@ struct uwsgi_carbon {
 	uint64_t last_requests;
 	struct uwsgi_stats_pusher *pusher;
 	int use_metrics;
+	// lines are accumulated here and written in big chunks
+	struct uwsgi_buffer *buffer;
 } u_carbon;
 
+#define CARBON_BUFFER_SIZE 32768
+
 static struct uwsgi_option carbon_options[] = {
 	{"carbon", required_argument, 0, "push statistics to the specified carbon server", uwsgi_opt_add_string_list, &u_carbon.servers, UWSGI_OPT_MASTER},
 	{"carbon-timeout", required_argument, 0, "set carbon connection timeout in seconds (default 3)", uwsgi_opt_set_int, &u_carbon.timeout, 0},
@@ -166,6 +170,17 @@ static void carbon_post_init() {
 	uspi->raw=1;
 }
 
+static int carbon_flush(int fd) {
+	if (!u_carbon.buffer->pos) return 1;
+	int ret = uwsgi_write_nb(fd, u_carbon.buffer->buf, u_carbon.buffer->pos, u_carbon.timeout);
+	u_carbon.buffer->pos = 0;
+	if (ret) {
+		uwsgi_error("carbon_flush()");
+		return 0;
+	}
+	return 1;
+}
+
 static int carbon_write(int fd, char *fmt,...) {
 	va_list ap;
 	va_start(ap, fmt);
@@ -177,11 +192,10 @@ static int carbon_write(int fd, char *fmt,...) {
 	va_end(ap);
 
 	if (rlen < 1) return 0;
+	if (rlen >= 4096) rlen = 4095;
 
-	if (uwsgi_write_nb(fd, ptr, rlen, u_carbon.timeout)) {
-		uwsgi_error("carbon_write()");
-		return 0;
-	}
+	if (u_carbon.buffer->pos + rlen > CARBON_BUFFER_SIZE && !carbon_flush(fd)) return 0;
+	if (uwsgi_buffer_append(u_carbon.buffer, ptr, rlen)) return 0;
 
 	return 1;
 }
@@ -202,6 +216,10 @@ static int carbon_push_stats(int retry_cycle, time_t now) {
 		u_carbon.was_busy[i] += uwsgi_worker_is_busy(i+1);
 	}
 
+	if (!u_carbon.buffer) {
+		u_carbon.buffer = uwsgi_buffer_new(CARBON_BUFFER_SIZE);
+	}
+
 	needs_retry = 0;
 	while(usl) {
 		if (retry_cycle && usl->healthy)
@@ -393,12 +411,15 @@ metrics_loop:
 			}
 		}
 
+		if (!carbon_flush(fd)) goto clear;
+
 		usl->healthy = 1;
 		usl->errors = 0;
 
 		u_carbon.last_requests = uwsgi.workers[0].requests;
 
 clear:
+		u_carbon.buffer->pos = 0;
 		close(fd);
 nxt:
 		usl = usl->next;
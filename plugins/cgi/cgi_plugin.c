@@ -4,6 +4,43 @@ extern struct uwsgi_server uwsgi;
 
 #define kill_on_error if (!uc.do_not_kill_on_error) { if (kill(cgi_pid, SIGKILL)) uwsgi_error("kill()");}
 
+#define FCGI_BEGIN_REQUEST 1
+#define FCGI_END_REQUEST 3
+#define FCGI_PARAMS 4
+#define FCGI_STDIN 5
+#define FCGI_STDOUT 6
+#define FCGI_STDERR 7
+
+/*
+	persistent helpers (php-cgi, perl FCGI...) are spawned in each worker with a listening
+	unix socket as fd 0 (the FastCGI convention) and serve one request at a time
+*/
+struct uwsgi_cgi_proc {
+	pid_t pid;
+	int busy;
+	uint64_t requests;
+	struct sockaddr_un addr;
+	socklen_t addr_len;
+};
+
+struct uwsgi_cgi_pool {
+	char *ext;
+	size_t ext_len;
+	char *command;
+	struct uwsgi_cgi_proc *procs;
+	pid_t owner;
+	struct uwsgi_cgi_pool *next;
+};
+
+// stdout of the cgi, a plain pipe or the STDOUT records of a FastCGI connection
+struct uwsgi_cgi_reader {
+	int fd;
+	int fastcgi;
+	size_t remains;
+	uint8_t pad;
+	int ended;
+};
+
 struct uwsgi_cgi {
 	struct uwsgi_dyn_dict *mountpoint;
 	struct uwsgi_dyn_dict *helpers;
@@ -20,6 +57,9 @@ struct uwsgi_cgi {
 	int path_info;
 	int do_not_kill_on_error;
 	int async_max_attempts;
+	struct uwsgi_cgi_pool *pools;
+	int pool_processes;
+	uint64_t pool_max_requests;
 } uc ;
 
 static void uwsgi_opt_add_cgi(char *opt, char *value, void *foobar) {
@@ -43,6 +83,21 @@ static void uwsgi_opt_add_cgi_maphelper(char *opt, char *value, void *foobar) {
         uwsgi_dyn_dict_new(&uc.helpers, value, val-value, val+1, strlen(val+1));
 }
 
+static void uwsgi_opt_add_cgi_persistent(char *opt, char *value, void *foobar) {
+	char *val = strchr(value, '=');
+	if (!val) {
+		uwsgi_log("invalid CGI persistent helper syntax, must be ext=command\n");
+		exit(1);
+	}
+	struct uwsgi_cgi_pool *ucp = uwsgi_calloc(sizeof(struct uwsgi_cgi_pool));
+	ucp->ext = value;
+	ucp->ext_len = val-value;
+	ucp->command = val+1;
+	struct uwsgi_cgi_pool **last = &uc.pools;
+	while(*last) last = &(*last)->next;
+	*last = ucp;
+}
+
 struct uwsgi_option uwsgi_cgi_options[] = {
 
         {"cgi", required_argument, 0, "add a cgi mountpoint/directory/script", uwsgi_opt_add_cgi, NULL, 0},
@@ -50,6 +105,10 @@ struct uwsgi_option uwsgi_cgi_options[] = {
         {"cgi-map-helper", required_argument, 0, "add a cgi map-helper", uwsgi_opt_add_cgi_maphelper, NULL, 0},
         {"cgi-helper", required_argument, 0, "add a cgi map-helper", uwsgi_opt_add_cgi_maphelper, NULL, 0},
 
+        {"cgi-persistent-helper", required_argument, 0, "add a persistent FastCGI helper (ext=command), a pool of them is spawned in each worker", uwsgi_opt_add_cgi_persistent, NULL, 0},
+        {"cgi-persistent-processes", required_argument, 0, "set the number of persistent helpers per worker (default: the number of cores)", uwsgi_opt_set_int, &uc.pool_processes, 0},
+        {"cgi-persistent-max-requests", required_argument, 0, "recycle persistent helpers after the specified number of requests", uwsgi_opt_set_64bit, &uc.pool_max_requests, 0},
+
         {"cgi-from-docroot", no_argument, 0, "blindly enable cgi in DOCUMENT_ROOT", uwsgi_opt_true, &uc.from_docroot, 0},
 
         {"cgi-buffer-size", required_argument, 0, "set cgi buffer size", uwsgi_opt_set_64bit, &uc.buffer_size, 0},
@@ -257,7 +316,52 @@ static int uwsgi_cgi_check_status(struct wsgi_request *wsgi_req, char *buf, size
 
 }
 
-static int uwsgi_cgi_parse(struct wsgi_request *wsgi_req, int fd, char *buf, size_t blen) {
+/*
+	same semantics of uwsgi_read_true_nb(): -1 with errno = 0 at the end of the stream, 0 on timeout
+*/
+static ssize_t uwsgi_cgi_read(struct uwsgi_cgi_reader *ucr, char *buf, size_t len) {
+	if (!ucr->fastcgi) return uwsgi_read_true_nb(ucr->fd, buf, len, uc.timeout);
+
+	char tmp[4096];
+	for(;;) {
+		if (ucr->ended) {
+			errno = 0;
+			return -1;
+		}
+		if (ucr->remains > 0) {
+			ssize_t rlen = uwsgi_read_true_nb(ucr->fd, buf, UMIN(len, ucr->remains), uc.timeout);
+			if (rlen < 0 && !errno) errno = ECONNRESET;
+			if (rlen <= 0) return rlen;
+			ucr->remains -= rlen;
+			return rlen;
+		}
+		if (ucr->pad > 0) {
+			if (uwsgi_read_whole_true_nb(ucr->fd, tmp, ucr->pad, uc.timeout)) goto broken;
+			ucr->pad = 0;
+		}
+		uint8_t fr[8];
+		if (uwsgi_read_whole_true_nb(ucr->fd, (char *) fr, 8, uc.timeout)) goto broken;
+		size_t cl = (fr[4] << 8) | fr[5];
+		ucr->pad = fr[6];
+		if (fr[1] == FCGI_STDOUT) {
+			ucr->remains = cl;
+			continue;
+		}
+		// stderr is logged, everything else is skipped
+		while(cl > 0) {
+			size_t chunk = UMIN(cl, sizeof(tmp));
+			if (uwsgi_read_whole_true_nb(ucr->fd, tmp, chunk, uc.timeout)) goto broken;
+			if (fr[1] == FCGI_STDERR) uwsgi_log("%.*s", (int) chunk, tmp);
+			cl -= chunk;
+		}
+		if (fr[1] == FCGI_END_REQUEST) ucr->ended = 1;
+	}
+broken:
+	if (!errno) errno = ECONNRESET;
+	return -1;
+}
+
+static int uwsgi_cgi_parse(struct wsgi_request *wsgi_req, struct uwsgi_cgi_reader *ucr, char *buf, size_t blen) {
 
 	size_t i;
 	size_t header_size = 0;
@@ -267,7 +371,7 @@ static int uwsgi_cgi_parse(struct wsgi_request *wsgi_req, int fd, char *buf, siz
 	size_t len = 0;
 
 	while(remains > 0) {
-		ssize_t rlen = uwsgi_read_true_nb(fd, ptr, remains, uc.timeout);
+		ssize_t rlen = uwsgi_cgi_read(ucr, ptr, remains);
 		if (rlen < 0) {
 			if (!errno) return 1;
 			return -1;
@@ -464,6 +568,59 @@ static int uwsgi_cgi_walk(struct wsgi_request *wsgi_req, char *full_path, char *
 }
 
 static int uwsgi_cgi_run(struct wsgi_request *, char *, size_t, char *, char *, char *, char *, int, int);
+static int uwsgi_cgi_run_persistent(struct wsgi_request *, struct uwsgi_cgi_pool *, char *, size_t, char *, char *, char *, int, int);
+
+static struct uwsgi_cgi_pool *uwsgi_cgi_get_pool(char *filename) {
+	struct uwsgi_cgi_pool *ucp = uc.pools;
+	size_t len = strlen(filename);
+	while(ucp) {
+		if (ucp->procs && len >= ucp->ext_len) {
+			if (!uwsgi_strncmp((filename+len)-ucp->ext_len, ucp->ext_len, ucp->ext, ucp->ext_len)) {
+				return ucp;
+			}
+		}
+		ucp = ucp->next;
+	}
+	return NULL;
+}
+
+/*
+	forward the cgi output to the client, returns -1 on error
+*/
+static int uwsgi_cgi_response(struct wsgi_request *wsgi_req, struct uwsgi_cgi_reader *ucr) {
+	int ret = -1;
+	char *buf = uwsgi_malloc(uc.buffer_size);
+
+	int completed = uwsgi_cgi_parse(wsgi_req, ucr, buf, uc.buffer_size);
+	if (completed < 0) {
+		uwsgi_log("invalid CGI response !!!\n");
+		goto end;
+	}
+
+	while (!completed) {
+		ssize_t rlen = uwsgi_cgi_read(ucr, buf, uc.buffer_size);
+		if (rlen > 0) {
+			if (uwsgi_response_write_body_do(wsgi_req, buf, rlen)) {
+				goto end;
+			}
+		}
+		else if (rlen == 0) {
+			uwsgi_log("CGI timeout !!!\n");
+			goto end;
+		}
+		else {
+			if (errno) {
+				uwsgi_req_error("error reading CGI response\n");
+				goto end;
+			}
+			break;
+		}
+	}
+	ret = 0;
+end:
+	free(buf);
+	return ret;
+}
 
 static int uwsgi_cgi_request(struct wsgi_request *wsgi_req) {
 
@@ -609,6 +766,14 @@ static int uwsgi_cgi_request(struct wsgi_request *wsgi_req) {
 		return UWSGI_OK;
 	}
 
+	// persistent helpers do not need the script to be executable
+	struct uwsgi_cgi_pool *ucp = uwsgi_cgi_get_pool(is_a_file ? docroot : full_path);
+	if (ucp) {
+		int ret = uwsgi_cgi_run_persistent(wsgi_req, ucp, docroot, docroot_len, full_path, path_info, script_name, is_a_file, discard_base);
+		if (need_free) free(docroot);
+		return ret;
+	}
+
 	// get the helper
 	if (!is_a_file) {
 		helper = uwsgi_cgi_get_helper(full_path);
@@ -681,51 +846,23 @@ static int uwsgi_cgi_run(struct wsgi_request *wsgi_req, char *docroot, size_t do
                 	ssize_t rlen = 0;
                 	char *buf = uwsgi_request_body_read(wsgi_req, 8192, &rlen);
                 	if (!buf) {
-				goto clear2;
+				goto clear;
                 	}
                 	if (buf == uwsgi.empty) break;
                 	// write data to the node
                 	if (uwsgi_write_true_nb(post_pipe[1], buf, rlen, uc.timeout)) {
-				goto clear2;
+				goto clear;
                 	}
                 	remains -= rlen;
         	}
 
 		// wait for data
-		char *buf = uwsgi_malloc(uc.buffer_size);
-
-		int completed = uwsgi_cgi_parse(wsgi_req, cgi_pipe[0], buf, uc.buffer_size);
-		if (completed < 0) {
-			uwsgi_log("invalid CGI response !!!\n");
+		struct uwsgi_cgi_reader ucr = { .fd = cgi_pipe[0] };
+		if (uwsgi_cgi_response(wsgi_req, &ucr)) {
 			kill_on_error
-			goto clear;
-		}
-
-		while (!completed) {
-			ssize_t rlen = uwsgi_read_true_nb(cgi_pipe[0], buf, uc.buffer_size, uc.timeout);
-			if (rlen > 0) {
-				if (uwsgi_response_write_body_do(wsgi_req, buf, rlen)) {
-					kill_on_error
-					goto clear;
-				}
-			}
-			else if (rlen == 0) {
-				uwsgi_log("CGI timeout !!!\n");
-				kill_on_error
-				goto clear;
-			}
-			else {
-				if (errno) {
-					uwsgi_req_error("error reading CGI response\n");
-					kill_on_error
-				}
-				goto clear;
-			}
 		}
 
 clear:
-		free(buf);
-clear2:
 		close(cgi_pipe[0]);
 		close(post_pipe[1]);
 
@@ -923,6 +1060,328 @@ clear2:
 	exit(1);
 }
 
+static void uwsgi_cgi_post_fork() {
+	struct uwsgi_cgi_pool *ucp = uc.pools;
+	if (!ucp || uwsgi.mywid == 0) return;
+	if (!uc.pool_processes) uc.pool_processes = uwsgi.cores;
+	while(ucp) {
+		ucp->procs = uwsgi_calloc(sizeof(struct uwsgi_cgi_proc) * uc.pool_processes);
+		ucp->owner = getpid();
+		ucp = ucp->next;
+	}
+}
+
+static void uwsgi_cgi_pool_kill(struct uwsgi_cgi_proc *ucproc) {
+	if (kill(ucproc->pid, SIGKILL)) {
+		uwsgi_error("uwsgi_cgi_pool_kill()/kill()");
+	}
+	// --reaper could have already collected it
+	if (waitpid(ucproc->pid, NULL, 0) < 0 && errno != ECHILD) {
+		uwsgi_error("uwsgi_cgi_pool_kill()/waitpid()");
+	}
+#ifndef __linux__
+	unlink(ucproc->addr.sun_path);
+#endif
+	ucproc->pid = 0;
+}
+
+static void uwsgi_cgi_atexit() {
+	struct uwsgi_cgi_pool *ucp = uc.pools;
+	while(ucp) {
+		// the classic cgi processes inherit the pool too
+		if (ucp->procs && ucp->owner == getpid()) {
+			int i;
+			for(i=0;i<uc.pool_processes;i++) {
+				if (ucp->procs[i].pid > 0) uwsgi_cgi_pool_kill(&ucp->procs[i]);
+			}
+		}
+		ucp = ucp->next;
+	}
+}
+
+static int uwsgi_cgi_pool_spawn(struct uwsgi_cgi_pool *ucp, struct uwsgi_cgi_proc *ucproc) {
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		uwsgi_error("uwsgi_cgi_pool_spawn()/socket()");
+		return -1;
+	}
+
+	memset(&ucproc->addr, 0, sizeof(struct sockaddr_un));
+	ucproc->addr.sun_family = AF_UNIX;
+#ifdef __linux__
+	// autobind to a unique abstract address
+	if (bind(fd, (struct sockaddr *) &ucproc->addr, sizeof(sa_family_t))) {
+		uwsgi_error("uwsgi_cgi_pool_spawn()/bind()");
+		goto error;
+	}
+	ucproc->addr_len = sizeof(struct sockaddr_un);
+	if (getsockname(fd, (struct sockaddr *) &ucproc->addr, &ucproc->addr_len)) {
+		uwsgi_error("uwsgi_cgi_pool_spawn()/getsockname()");
+		goto error;
+	}
+#else
+	snprintf(ucproc->addr.sun_path, sizeof(ucproc->addr.sun_path), "/tmp/uwsgi-cgi-%d-%d.sock", (int) getpid(), (int) (ucproc - ucp->procs));
+	unlink(ucproc->addr.sun_path);
+	ucproc->addr_len = sizeof(struct sockaddr_un);
+	if (bind(fd, (struct sockaddr *) &ucproc->addr, ucproc->addr_len)) {
+		uwsgi_error("uwsgi_cgi_pool_spawn()/bind()");
+		goto error;
+	}
+#endif
+	if (listen(fd, uwsgi.listen_queue)) {
+		uwsgi_error("uwsgi_cgi_pool_spawn()/listen()");
+		goto error;
+	}
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		uwsgi_error("uwsgi_cgi_pool_spawn()/fork()");
+		goto error;
+	}
+
+	if (pid == 0) {
+#if defined(__linux__) && defined(PR_SET_PDEATHSIG)
+		if (prctl(PR_SET_PDEATHSIG, SIGKILL, 0, 0, 0)) {
+			uwsgi_error("prctl()");
+		}
+#endif
+		if (fd != 0) {
+			dup2(fd, 0);
+			close(fd);
+		}
+		int i;
+		for(i=3;i<(int)uwsgi.max_fd;i++) {
+			close(i);
+		}
+		char *argv[4];
+		argv[0] = "/bin/sh";
+		argv[1] = "-c";
+		argv[2] = uwsgi_concat2("exec ", ucp->command);
+		argv[3] = NULL;
+		execv(argv[0], argv);
+		uwsgi_error("uwsgi_cgi_pool_spawn()/execv()");
+		// never run the atexit hooks of the worker
+		_exit(1);
+	}
+
+	// the helper must be the only listener (connect() fails as soon as it dies)
+	close(fd);
+	ucproc->pid = pid;
+	ucproc->requests = 0;
+	uwsgi_log("spawned persistent CGI helper \"%s\" (pid: %d)\n", ucp->command, (int) pid);
+	return 0;
+error:
+	close(fd);
+	return -1;
+}
+
+/*
+	get a free helper (spawning it if needed), waits up to cgi-timeout when all of them are busy
+*/
+static struct uwsgi_cgi_proc *uwsgi_cgi_pool_acquire(struct uwsgi_cgi_pool *ucp) {
+	int waited = 0;
+	for(;;) {
+		int i;
+		for(i=0;i<uc.pool_processes;i++) {
+			struct uwsgi_cgi_proc *ucproc = &ucp->procs[i];
+			if (!__sync_bool_compare_and_swap(&ucproc->busy, 0, 1)) continue;
+			if (ucproc->pid > 0) {
+				pid_t diedpid = waitpid(ucproc->pid, NULL, WNOHANG);
+				if (diedpid == ucproc->pid || (diedpid < 0 && errno == ECHILD)) {
+					uwsgi_log("persistent CGI helper \"%s\" (pid: %d) died\n", ucp->command, (int) ucproc->pid);
+					ucproc->pid = 0;
+				}
+			}
+			if (ucproc->pid <= 0 && uwsgi_cgi_pool_spawn(ucp, ucproc)) {
+				__sync_lock_release(&ucproc->busy);
+				return NULL;
+			}
+			return ucproc;
+		}
+		if (waited >= uc.timeout * 1000) {
+			uwsgi_log("no persistent CGI helper \"%s\" available after %d seconds\n", ucp->command, uc.timeout);
+			return NULL;
+		}
+		if (uwsgi.wait_milliseconds_hook(10) < 0) return NULL;
+		waited += 10;
+	}
+}
+
+static void uwsgi_cgi_pool_release(struct uwsgi_cgi_proc *ucproc, int broken) {
+	ucproc->requests++;
+	if (broken || (uc.pool_max_requests && ucproc->requests >= uc.pool_max_requests)) {
+		uwsgi_cgi_pool_kill(ucproc);
+	}
+	__sync_lock_release(&ucproc->busy);
+}
+
+static int fcgi_record_header(struct uwsgi_buffer *ub, uint8_t type, uint16_t len) {
+	char fr[8];
+	fr[0] = 1;
+	fr[1] = type;
+	// request id 1
+	fr[2] = 0;
+	fr[3] = 1;
+	fr[4] = (uint8_t) (len >> 8);
+	fr[5] = (uint8_t) (len & 0xff);
+	fr[6] = 0;
+	fr[7] = 0;
+	return uwsgi_buffer_append(ub, fr, 8);
+}
+
+// split data in records of max 64k (an empty record closes the stream)
+static int fcgi_records(struct uwsgi_buffer *ub, uint8_t type, char *buf, size_t len) {
+	while(len > 0) {
+		uint16_t chunk = UMIN(len, 65535);
+		if (fcgi_record_header(ub, type, chunk)) return -1;
+		if (uwsgi_buffer_append(ub, buf, chunk)) return -1;
+		buf += chunk;
+		len -= chunk;
+	}
+	return 0;
+}
+
+static int fcgi_param_len(struct uwsgi_buffer *ub, size_t len) {
+	if (len < 128) return uwsgi_buffer_u8(ub, len);
+	return uwsgi_buffer_u32be(ub, len | 0x80000000);
+}
+
+static int fcgi_param(struct uwsgi_buffer *ub, char *key, size_t keylen, char *val, size_t vallen) {
+	if (fcgi_param_len(ub, keylen)) return -1;
+	if (fcgi_param_len(ub, vallen)) return -1;
+	if (uwsgi_buffer_append(ub, key, keylen)) return -1;
+	return uwsgi_buffer_append(ub, val, vallen);
+}
+
+// the same environment of uwsgi_cgi_run(), the vars set by the plugin win over the request ones
+static int fcgi_params(struct wsgi_request *wsgi_req, struct uwsgi_buffer *ub, char *docroot, size_t docroot_len, char *full_path, char *path_info, char *script_name, int is_a_file, int discard_base) {
+	char *script_filename = is_a_file ? docroot : full_path;
+	char *document_root = is_a_file ? uwsgi.cwd : docroot;
+	size_t document_root_len = is_a_file ? strlen(uwsgi.cwd) : docroot_len;
+	char *sn = NULL;
+	size_t sn_len = 0;
+	if (!is_a_file) {
+		sn = uwsgi_concat2n(wsgi_req->path_info, discard_base, full_path+docroot_len, strlen(full_path+docroot_len));
+		sn_len = strlen(sn);
+	}
+	else if (script_name && discard_base > 1) {
+		sn = script_name;
+		sn_len = discard_base;
+	}
+
+	int ret = -1;
+	int i;
+	for(i=0;i<wsgi_req->var_cnt;i+=2) {
+		char *key = wsgi_req->hvec[i].iov_base;
+		size_t keylen = wsgi_req->hvec[i].iov_len;
+		if (!uwsgi_strncmp(key, keylen, "PATH_INFO", 9) || !uwsgi_strncmp(key, keylen, "PATH_TRANSLATED", 15)) continue;
+		if (sn && !uwsgi_strncmp(key, keylen, "SCRIPT_NAME", 11)) continue;
+		if (uwsgi_string_list_has_item(uc.unset, key, keylen)) continue;
+		if (fcgi_param(ub, key, keylen, wsgi_req->hvec[i+1].iov_base, wsgi_req->hvec[i+1].iov_len)) goto end;
+	}
+
+#define fcgi_param_default(k, v, vl) if (!uwsgi_string_list_has_item(uc.unset, k, sizeof(k)-1)) {\
+		uint16_t l = 0;\
+		if (!uwsgi_get_var(wsgi_req, k, sizeof(k)-1, &l) && fcgi_param(ub, k, sizeof(k)-1, v, vl)) goto end;\
+	}
+
+	fcgi_param_default("GATEWAY_INTERFACE", "CGI/1.1", 7)
+	fcgi_param_default("SERVER_SOFTWARE", "uWSGI/" UWSGI_VERSION, strlen("uWSGI/" UWSGI_VERSION))
+	fcgi_param_default("REDIRECT_STATUS", "200", 3)
+	fcgi_param_default("DOCUMENT_ROOT", document_root, document_root_len)
+	fcgi_param_default("SCRIPT_FILENAME", script_filename, strlen(script_filename))
+
+	if (path_info) {
+		size_t pi_len = wsgi_req->path_info_len - (path_info - wsgi_req->path_info);
+		if (fcgi_param(ub, "PATH_INFO", 9, path_info, pi_len)) goto end;
+		char *base = wsgi_req->document_root_len > 0 ? wsgi_req->document_root : docroot;
+		size_t base_len = wsgi_req->document_root_len > 0 ? wsgi_req->document_root_len : docroot_len;
+		char *pt = uwsgi_concat2n(base, base_len, path_info, pi_len);
+		int r = fcgi_param(ub, "PATH_TRANSLATED", 15, pt, base_len + pi_len);
+		free(pt);
+		if (r) goto end;
+	}
+
+	if (sn && fcgi_param(ub, "SCRIPT_NAME", 11, sn, sn_len)) goto end;
+	ret = 0;
+end:
+	if (!is_a_file) free(sn);
+	return ret;
+}
+
+static int uwsgi_cgi_run_persistent(struct wsgi_request *wsgi_req, struct uwsgi_cgi_pool *ucp, char *docroot, size_t docroot_len, char *full_path, char *path_info, char *script_name, int is_a_file, int discard_base) {
+
+	int attempts = 2;
+	struct uwsgi_cgi_proc *ucproc = NULL;
+	int fd = -1;
+
+	// a helper could have exited by itself (php-cgi after PHP_FCGI_MAX_REQUESTS), retry on a fresh one
+	while(attempts--) {
+		ucproc = uwsgi_cgi_pool_acquire(ucp);
+		if (!ucproc) {
+			uwsgi_500(wsgi_req);
+			return UWSGI_OK;
+		}
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0) {
+			uwsgi_error("uwsgi_cgi_run_persistent()/socket()");
+			uwsgi_cgi_pool_release(ucproc, 0);
+			uwsgi_500(wsgi_req);
+			return UWSGI_OK;
+		}
+		if (!connect(fd, (struct sockaddr *) &ucproc->addr, ucproc->addr_len)) break;
+		uwsgi_error("uwsgi_cgi_run_persistent()/connect()");
+		close(fd);
+		fd = -1;
+		uwsgi_cgi_pool_release(ucproc, 1);
+	}
+
+	if (fd < 0) {
+		uwsgi_500(wsgi_req);
+		return UWSGI_OK;
+	}
+
+	uwsgi_socket_nb(fd);
+
+	int broken = 1;
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(uwsgi.page_size);
+	struct uwsgi_buffer *params = uwsgi_buffer_new(uwsgi.page_size);
+
+	// role RESPONDER, close the connection at the end of the request
+	if (fcgi_record_header(ub, FCGI_BEGIN_REQUEST, 8)) goto end;
+	if (uwsgi_buffer_append(ub, "\0\1\0\0\0\0\0\0", 8)) goto end;
+	if (fcgi_params(wsgi_req, params, docroot, docroot_len, full_path, path_info, script_name, is_a_file, discard_base)) goto end;
+	if (fcgi_records(ub, FCGI_PARAMS, params->buf, params->pos)) goto end;
+	if (fcgi_record_header(ub, FCGI_PARAMS, 0)) goto end;
+	if (uwsgi_write_true_nb(fd, ub->buf, ub->pos, uc.timeout)) goto end;
+
+	size_t remains = wsgi_req->post_cl;
+	while(remains > 0) {
+		ssize_t rlen = 0;
+		char *buf = uwsgi_request_body_read(wsgi_req, 8192, &rlen);
+		if (!buf) goto end;
+		if (buf == uwsgi.empty) break;
+		uwsgi_buffer_reset(ub);
+		if (fcgi_records(ub, FCGI_STDIN, buf, rlen)) goto end;
+		if (uwsgi_write_true_nb(fd, ub->buf, ub->pos, uc.timeout)) goto end;
+		remains -= rlen;
+	}
+
+	uwsgi_buffer_reset(ub);
+	if (fcgi_record_header(ub, FCGI_STDIN, 0)) goto end;
+	if (uwsgi_write_true_nb(fd, ub->buf, ub->pos, uc.timeout)) goto end;
+
+	struct uwsgi_cgi_reader ucr = { .fd = fd, .fastcgi = 1 };
+	if (uwsgi_cgi_response(wsgi_req, &ucr)) goto end;
+	broken = 0;
+
+end:
+	uwsgi_buffer_destroy(ub);
+	uwsgi_buffer_destroy(params);
+	close(fd);
+	uwsgi_cgi_pool_release(ucproc, broken && !uc.do_not_kill_on_error);
+	return UWSGI_OK;
+}
 
 static void uwsgi_cgi_after_request(struct wsgi_request *wsgi_req) {
 	if (wsgi_req->async_plagued > 0) {
@@ -1034,6 +1493,8 @@ struct uwsgi_plugin cgi_plugin = {
 	.options = uwsgi_cgi_options,
 	.request = uwsgi_cgi_request,
 	.after_request = uwsgi_cgi_after_request,
+	.post_fork = uwsgi_cgi_post_fork,
+	.atexit = uwsgi_cgi_atexit,
 #ifdef UWSGI_ROUTING
         .on_load = uwsgi_cgi_register_router,
 #endif
@@ -28,6 +28,89 @@ struct corerouter_peer *uwsgi_cr_peer_find_by_sid(struct corerouter_session *cs,
 	return NULL;
 }
 
+/*
+	sessions, peers and buffers are recycled using per-process stacks of free items,
+	this avoids malloc()/free() churn (and memory fragmentation) under connection storms
+*/
+
+#define CR_CACHE_MIN 64
+
+static void *cr_cache_get(struct corerouter_cache *cc) {
+	if (cc->count == 0) return NULL;
+	return cc->items[--cc->count];
+}
+
+static int cr_cache_put(struct corerouter_cache *cc, void *item) {
+	if (cc->count >= cc->max) return -1;
+	cc->items[cc->count++] = item;
+	return 0;
+}
+
+static size_t cr_buffer_size(struct uwsgi_corerouter *ucr) {
+	if (ucr->buffer_size) return ucr->buffer_size;
+	return uwsgi.page_size;
+}
+
+struct uwsgi_buffer *uwsgi_cr_buffer_new(struct uwsgi_corerouter *ucr, size_t len) {
+	struct uwsgi_buffer *ub = cr_cache_get(&ucr->buffers_cache);
+	if (!ub) return uwsgi_buffer_new(len);
+	// cached buffers are at least cr_buffer_size() bytes
+	if (ub->len < len) {
+		char *buf = realloc(ub->buf, len);
+		if (!buf) {
+			uwsgi_error("uwsgi_cr_buffer_new()/realloc()");
+			exit(1);
+		}
+		ub->buf = buf;
+		ub->len = len;
+	}
+	return ub;
+}
+
+void uwsgi_cr_buffer_destroy(struct uwsgi_corerouter *ucr, struct uwsgi_buffer *ub) {
+	size_t bufsize = cr_buffer_size(ucr);
+	// do not keep too small or too big (grown) buffers
+	if (ub->len >= bufsize && ub->len <= bufsize * 4) {
+		ub->pos = 0;
+		ub->limit = 0;
+		if (!cr_cache_put(&ucr->buffers_cache, ub)) return;
+	}
+	uwsgi_buffer_destroy(ub);
+}
+
+static struct corerouter_peer *cr_peer_new(struct uwsgi_corerouter *ucr) {
+	struct corerouter_peer *peer = cr_cache_get(&ucr->peers_cache);
+	if (!peer) return uwsgi_calloc(sizeof(struct corerouter_peer));
+	memset(peer, 0, sizeof(struct corerouter_peer));
+	return peer;
+}
+
+static void cr_peer_free(struct uwsgi_corerouter *ucr, struct corerouter_peer *peer) {
+	if (cr_cache_put(&ucr->peers_cache, peer)) free(peer);
+}
+
+// called by each router process
+static void corerouter_setup_caches(struct uwsgi_corerouter *ucr) {
+	uint64_t max = UMAX(CR_CACHE_MIN, ucr->prealloc);
+	uint64_t i;
+
+	ucr->sessions_cache.items = uwsgi_malloc(sizeof(void *) * max);
+	ucr->sessions_cache.max = max;
+	// each session has (at least) a client and a backend peer
+	ucr->peers_cache.items = uwsgi_malloc(sizeof(void *) * max * 2);
+	ucr->peers_cache.max = max * 2;
+	ucr->buffers_cache.items = uwsgi_malloc(sizeof(void *) * max * 2);
+	ucr->buffers_cache.max = max * 2;
+
+	for(i=0;i<ucr->prealloc;i++) {
+		cr_cache_put(&ucr->sessions_cache, uwsgi_calloc(ucr->session_size));
+		cr_cache_put(&ucr->peers_cache, uwsgi_calloc(sizeof(struct corerouter_peer)));
+		cr_cache_put(&ucr->peers_cache, uwsgi_calloc(sizeof(struct corerouter_peer)));
+		cr_cache_put(&ucr->buffers_cache, uwsgi_buffer_new(cr_buffer_size(ucr)));
+		cr_cache_put(&ucr->buffers_cache, uwsgi_buffer_new(cr_buffer_size(ucr)));
+	}
+}
+
 // add a new peer to the session
 struct corerouter_peer *uwsgi_cr_peer_add(struct corerouter_session *cs) {
 	struct corerouter_peer *old_peers = NULL, *peers = cs->peers; 
@@ -37,13 +120,11 @@ struct corerouter_peer *uwsgi_cr_peer_add(struct corerouter_session *cs) {
 		peers = peers->next;
 	}
 
-	peers = uwsgi_calloc(sizeof(struct corerouter_peer));
+	peers = cr_peer_new(cs->corerouter);
 	peers->session = cs;
 	peers->fd = -1;
 	// create input buffer
-	size_t bufsize = cs->corerouter->buffer_size;
-	if (!bufsize) bufsize = uwsgi.page_size;
-	peers->in = uwsgi_buffer_new(bufsize);
+	peers->in = uwsgi_cr_buffer_new(cs->corerouter, cr_buffer_size(cs->corerouter));
 	// add timeout
 	peers->current_timeout = cs->corerouter->socket_timeout;
         peers->timeout = cr_add_timeout(cs->corerouter, peers);
@@ -59,8 +140,630 @@ struct corerouter_peer *uwsgi_cr_peer_add(struct corerouter_session *cs) {
 	return peers;
 }
 
+/*
+	backend connection pool
+
+	connections to backends speaking the persistent uwsgi protocol (--puwsgi-socket)
+	can be reused when the response is framed (HTTP Content-Length).
+	The router tracks the response of each backend peer, when the declared body has been
+	received the peer is managed as if the backend closed the connection, and its socket is
+	given back to the pool of its instance_address.
+*/
+
+// batched events need to know the fd is going away
+static void cr_forget_fd(struct uwsgi_corerouter *ucr, int fd) {
+	if (ucr->defer_events) {
+		event_queue_fd_interest(ucr->queue, fd, UWSGI_EVENT_QUEUE_CLOSE);
+	}
+}
+
+static struct corerouter_pool *cr_pool_get(struct uwsgi_corerouter *ucr, char *address, uint64_t address_len, int create) {
+	struct corerouter_pool *pool = ucr->pools;
+	while(pool) {
+		if (!uwsgi_strncmp(pool->address, pool->address_len, address, address_len)) return pool;
+		pool = pool->next;
+	}
+	if (!create) return NULL;
+	pool = uwsgi_calloc(sizeof(struct corerouter_pool));
+	pool->address = uwsgi_concat2n(address, address_len, "", 0);
+	pool->address_len = address_len;
+	pool->fds = uwsgi_malloc(sizeof(int) * ucr->backend_pool);
+	pool->next = ucr->pools;
+	ucr->pools = pool;
+	return pool;
+}
+
+// get a connection to the peer instance_address (from the pool if possible)
+int uwsgi_cr_pool_connect(struct corerouter_peer *peer) {
+	struct uwsgi_corerouter *ucr = peer->session->corerouter;
+
+	if (peer->pool_tracking || peer->mux) {
+		// the peer could be retrying, reset the response parser
+		peer->mux_hdr_pos = 0;
+		peer->mux_remains = 0;
+		peer->pool_done = 0;
+		peer->pool_status = 0;
+		peer->pool_has_cl = 0;
+		peer->pool_remains = 0;
+		peer->pool_line_len = 0;
+
+		struct corerouter_pool *pool = cr_pool_get(ucr, peer->instance_address, peer->instance_address_len, 0);
+		while(pool && pool->count > 0) {
+			// the most recently used connection is at the top
+			int fd = pool->fds[--pool->count];
+			char byte;
+			ssize_t rlen = recv(fd, &byte, 1, MSG_PEEK|MSG_DONTWAIT);
+			if (rlen < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+				ucr->pool_hits++;
+				return fd;
+			}
+			// closed by the backend (or unexpected data)
+			cr_forget_fd(ucr, fd);
+			close(fd);
+		}
+		ucr->pool_misses++;
+	}
+
+	return uwsgi_connectn(peer->instance_address, peer->instance_address_len, 0, 1);
+}
+
+static int cr_pool_put(struct corerouter_peer *peer) {
+	struct uwsgi_corerouter *ucr = peer->session->corerouter;
+
+	if (peer->instance_address_len == 0) return -1;
+
+	// stop monitoring the socket
+	if (uwsgi_cr_set_hooks(peer, NULL, NULL)) return -1;
+
+	struct corerouter_pool *pool = cr_pool_get(ucr, peer->instance_address, peer->instance_address_len, 1);
+	// full pool, drop the oldest connection
+	if (pool->count >= ucr->backend_pool) {
+		cr_forget_fd(ucr, pool->fds[0]);
+		close(pool->fds[0]);
+		memmove(pool->fds, pool->fds + 1, sizeof(int) * (pool->count - 1));
+		pool->count--;
+	}
+	pool->fds[pool->count++] = peer->fd;
+
+	ucr->cr_table[peer->fd] = NULL;
+	peer->fd = -1;
+	return 0;
+}
+
+// parse the backend response to find its end
+void uwsgi_cr_pool_track(struct corerouter_peer *peer, char *buf, size_t len) {
+	size_t i;
+	for(i=0;i<len;i++) {
+		// body
+		if (peer->pool_status == 2) {
+			uint64_t remains = len - i;
+			if (remains > peer->pool_remains) goto unframed;
+			peer->pool_remains -= remains;
+			if (peer->pool_remains == 0) peer->pool_done = 1;
+			return;
+		}
+
+		char c = buf[i];
+		if (c == '\r') continue;
+		if (c != '\n') {
+			// only the first part of the line is needed
+			if (peer->pool_line_len < sizeof(peer->pool_line)) {
+				peer->pool_line[peer->pool_line_len++] = c;
+			}
+			continue;
+		}
+
+		char *line = peer->pool_line;
+		size_t line_len = peer->pool_line_len;
+		peer->pool_line_len = 0;
+
+		// status line (1xx responses, like websockets handshakes, are not framed)
+		if (peer->pool_status == 0) {
+			if (line_len < 12 || memcmp(line, "HTTP/1.", 7) || line[9] == '1') goto unframed;
+			peer->pool_status = 1;
+			continue;
+		}
+
+		// end of headers
+		if (line_len == 0) {
+			if (!peer->pool_no_body) {
+				if (!peer->pool_has_cl) goto unframed;
+				peer->pool_status = 2;
+				if (peer->pool_remains > 0) continue;
+			}
+			// pipelined data ?
+			if (i + 1 < len) goto unframed;
+			peer->pool_done = 1;
+			return;
+		}
+
+		if (line_len > 15 && !strncasecmp(line, "Content-Length:", 15)) {
+			size_t j;
+			uint64_t cl = 0;
+			int digits = 0;
+			for(j=15;j<line_len;j++) {
+				if (line[j] == ' ' && !digits) continue;
+				if (line[j] < '0' || line[j] > '9' || digits >= 19) goto unframed;
+				cl = (cl * 10) + (line[j] - '0');
+				digits++;
+			}
+			if (!digits) goto unframed;
+			peer->pool_remains = cl;
+			peer->pool_has_cl = 1;
+		}
+		else if (line_len >= 18 && !strncasecmp(line, "Transfer-Encoding:", 18)) {
+			goto unframed;
+		}
+	}
+	return;
+
+unframed:
+	// wait for the backend to close the connection
+	peer->pool_tracking = 0;
+	peer->pool_no_reuse = 1;
+}
+
+/*
+	multiplexed puwsgi framing
+
+	requests are sent as REQUEST and BODY frames tagged with an id, the backend answers with
+	RESPONSE frames and an END frame, so every connection can go back to the pool (HEAD requests
+	and unread bodies included) without parsing the response. See proto/puwsgi.c for the format.
+*/
+
+static int cr_mux_frame(struct uwsgi_buffer *ub, uint8_t type, uint32_t id, char *buf, size_t len) {
+	if (uwsgi_buffer_byte(ub, (char) UWSGI_MODIFIER_PUWSGI_FRAME)) return -1;
+	if (uwsgi_buffer_u16le(ub, len + 4)) return -1;
+	if (uwsgi_buffer_byte(ub, type)) return -1;
+	if (uwsgi_buffer_u32le(ub, id)) return -1;
+	return uwsgi_buffer_append(ub, buf, len);
+}
+
+static int cr_mux_frames(struct uwsgi_buffer *ub, uint32_t id, char *buf, size_t len) {
+	while (len > 0) {
+		size_t chunk = UMIN(len, UWSGI_PUWSGI_FRAME_MAX);
+		if (cr_mux_frame(ub, UWSGI_PUWSGI_BODY, id, buf, chunk)) return -1;
+		buf += chunk;
+		len -= chunk;
+	}
+	return 0;
+}
+
+// frame (in place) a uwsgi packet optionally followed by the first part of the body
+int uwsgi_cr_mux_request(struct corerouter_peer *peer, struct uwsgi_buffer *ub) {
+	struct uwsgi_corerouter *ucr = peer->session->corerouter;
+	if (ub->pos < 4) return -1;
+	size_t pktsize = 4 + ((uint8_t) ub->buf[1] | (((uint8_t) ub->buf[2]) << 8));
+	if (pktsize > ub->pos || pktsize > UWSGI_PUWSGI_FRAME_MAX) return -1;
+
+	peer->mux = 1;
+	peer->mux_id = ++ucr->mux_ids;
+
+	struct uwsgi_buffer *framed = uwsgi_buffer_new(ub->pos + 8 + ((ub->pos / UWSGI_PUWSGI_FRAME_MAX) + 1) * 8);
+	if (cr_mux_frame(framed, UWSGI_PUWSGI_REQUEST, peer->mux_id, ub->buf, pktsize)) goto error;
+	if (cr_mux_frames(framed, peer->mux_id, ub->buf + pktsize, ub->pos - pktsize)) goto error;
+
+	// the framed request could be bigger than a uwsgi packet
+	ub->limit = 0;
+	ub->pos = 0;
+	if (uwsgi_buffer_append(ub, framed->buf, framed->pos)) goto error;
+	uwsgi_buffer_destroy(framed);
+	return 0;
+error:
+	uwsgi_buffer_destroy(framed);
+	return -1;
+}
+
+/*
+	handoff mode
+
+	the client connection is passed (SCM_RIGHTS) to backends bound to UNIX sockets (--uwsgi-handoff-socket,
+	--http-handoff-socket) with the bytes already read, so the router steps out of the data path.
+	Returns 1 when the connection cannot be handed off (the request is proxied as usual).
+*/
+int uwsgi_cr_handoff(struct corerouter_peer *peer, struct uwsgi_buffer *ub) {
+	struct corerouter_session *cs = peer->session;
+	struct uwsgi_corerouter *ucr = cs->corerouter;
+
+	// only UNIX sockets can pass file descriptors
+	if (peer->instance_address_len == 0 || memchr(peer->instance_address, ':', peer->instance_address_len)) return 1;
+	if (ub->pos > UWSGI_HANDOFF_MAX) return 1;
+
+	// connecting to a UNIX socket does not wait for the peer, a blocking one is fine
+	int fd = uwsgi_connectn(peer->instance_address, peer->instance_address_len, ucr->socket_timeout, 0);
+	if (fd < 0) return 1;
+
+	int ret = -1;
+	struct uwsgi_buffer *handoff = uwsgi_buffer_new(4 + ub->pos);
+	if (uwsgi_buffer_u32le(handoff, ub->pos)) goto end;
+	if (uwsgi_buffer_append(handoff, ub->buf, ub->pos)) goto end;
+	if (uwsgi_send_fds_and_body(fd, &cs->main_peer->fd, 1, handoff->buf, handoff->pos)) goto end;
+	ucr->handoffs++;
+	ret = 0;
+end:
+	uwsgi_buffer_destroy(handoff);
+	close(fd);
+	return ret;
+}
+
+// a chunk of the request body as BODY frames (the buffer is owned by the peer)
+struct uwsgi_buffer *uwsgi_cr_mux_body(struct corerouter_peer *peer, struct uwsgi_buffer *ub) {
+	if (!peer->mux_buf) {
+		peer->mux_buf = uwsgi_cr_buffer_new(peer->session->corerouter, cr_buffer_size(peer->session->corerouter));
+	}
+	peer->mux_buf->pos = 0;
+	if (cr_mux_frames(peer->mux_buf, peer->mux_id, ub->buf, ub->pos)) return NULL;
+	return peer->mux_buf;
+}
+
+// strip the frame headers from the last len bytes read, returns the payload size
+ssize_t uwsgi_cr_mux_decode(struct corerouter_peer *peer, ssize_t len) {
+	char *base = peer->in->buf + peer->in->pos - len;
+	char *src = base;
+	char *dst = base;
+	char *end = base + len;
+
+	while (src < end) {
+		if (peer->mux_remains > 0) {
+			size_t chunk = UMIN(peer->mux_remains, (size_t) (end - src));
+			if (dst != src) memmove(dst, src, chunk);
+			dst += chunk;
+			src += chunk;
+			peer->mux_remains -= chunk;
+			continue;
+		}
+		// data after the end of the response
+		if (peer->pool_done) goto invalid;
+
+		size_t chunk = UMIN((size_t) (8 - peer->mux_hdr_pos), (size_t) (end - src));
+		memcpy(peer->mux_hdr + peer->mux_hdr_pos, src, chunk);
+		peer->mux_hdr_pos += chunk;
+		src += chunk;
+		if (peer->mux_hdr_pos < 8) break;
+		peer->mux_hdr_pos = 0;
+
+		char *hdr = peer->mux_hdr;
+		uint16_t fsize = (uint8_t) hdr[1] | (((uint8_t) hdr[2]) << 8);
+		uint32_t id = (uint8_t) hdr[4] | (((uint8_t) hdr[5]) << 8) | (((uint8_t) hdr[6]) << 16) | (((uint32_t) (uint8_t) hdr[7]) << 24);
+		if ((uint8_t) hdr[0] != UWSGI_MODIFIER_PUWSGI_FRAME || fsize < 4 || id != peer->mux_id) goto invalid;
+		peer->mux_type = hdr[3];
+		if (peer->mux_type == UWSGI_PUWSGI_END) {
+			if (fsize != 4) goto invalid;
+			peer->pool_done = 1;
+			continue;
+		}
+		if (peer->mux_type != UWSGI_PUWSGI_RESPONSE) goto invalid;
+		peer->mux_remains = fsize - 4;
+	}
+
+	peer->in->pos -= len - (dst - base);
+	return dst - base;
+
+invalid:
+	uwsgi_cr_log(peer, " invalid multiplexed puwsgi frame from %.*s\n", (int) peer->instance_address_len, peer->instance_address);
+	return -1;
+}
+
+// a backend response is complete, manage it as a closed connection when the client has got it
+static void corerouter_pool_check(struct uwsgi_corerouter *ucr, struct corerouter_session *cs) {
+	if (!cs->main_peer || cs->main_peer->hook_write) return;
+	struct corerouter_peer *peers = cs->peers;
+	while(peers) {
+		struct corerouter_peer *next = peers->next;
+		if (peers->pool_done && peers->hook_read) {
+			errno = 0;
+			// cr_read() returns 0 on completed responses
+			ssize_t ret = peers->hook_read(peers);
+			if (ret == 0 || (ret < 0 && errno != EINPROGRESS)) {
+				if (ret < 0) cs->can_keepalive = 0;
+				// this could destroy the session
+				corerouter_close_peer(ucr, peers);
+				return;
+			}
+		}
+		peers = next;
+	}
+}
+
+/*
+	splice() forwarding
+
+	when both peers are plain sockets, the data read from a peer is moved to a pipe
+	and from the pipe to the other peer (the client for backends, the first backend for the client)
+	without crossing user space. The hooks follow the same read -> write -> reset cycle
+	of the buffer based ones, so a single pipe per direction is enough.
+*/
+
+// the default pipe size, a read never exceeds what the pipe can hold
+#define CR_SPLICE_CHUNK 65536
+
+int uwsgi_cr_splice_init(struct corerouter_peer *peer) {
+#ifdef __linux__
+	if (peer->splicing) return 0;
+	if (pipe(peer->splice_pipe)) {
+		uwsgi_cr_error(peer, "uwsgi_cr_splice_init()/pipe()");
+		return -1;
+	}
+	uwsgi_socket_nb(peer->splice_pipe[0]);
+	uwsgi_socket_nb(peer->splice_pipe[1]);
+	peer->splicing = 1;
+	peer->splice_pending = 0;
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+static struct corerouter_peer *cr_splice_peer(struct corerouter_peer *peer) {
+	if (peer == peer->session->main_peer) return peer->session->peers;
+	return peer->session->main_peer;
+}
+
+ssize_t uwsgi_cr_splice_read(struct corerouter_peer *peer) {
+#ifdef __linux__
+	size_t chunk = CR_SPLICE_CHUNK;
+	if (peer->splice_limited) {
+		if (peer->splice_remains == 0) {
+			// stop reading
+			peer->disabled = 1;
+			if (uwsgi_cr_set_hooks(peer, NULL, NULL)) return -1;
+			return 1;
+		}
+		chunk = UMIN(chunk, peer->splice_remains);
+	}
+
+	ssize_t len = splice(peer->fd, NULL, peer->splice_pipe[1], NULL, chunk, SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+	if (len < 0) {
+		cr_try_again;
+		uwsgi_cr_error(peer, "uwsgi_cr_splice_read()/splice()");
+		return -1;
+	}
+	if (!len) return 0;
+
+	if (peer != peer->session->main_peer && peer->un) peer->un->tx+=len;
+	peer->splice_pending = len;
+	if (peer->splice_limited) {
+		peer->splice_remains -= len;
+		if (peer->splice_remains == 0) peer->disabled = 1;
+	}
+
+	struct corerouter_peer *dst = cr_splice_peer(peer);
+	if (!dst) return -1;
+	if (dst == peer->session->main_peer) {
+		cr_write_to_main(peer, uwsgi_cr_splice_write);
+	}
+	else {
+		cr_write_to_backend(dst, uwsgi_cr_splice_write);
+	}
+	return len;
+#else
+	return -1;
+#endif
+}
+
+ssize_t uwsgi_cr_splice_write(struct corerouter_peer *peer) {
+#ifdef __linux__
+	struct corerouter_peer *src = cr_splice_peer(peer);
+	if (!src) return -1;
+
+	ssize_t len = splice(src->splice_pipe[0], NULL, peer->fd, NULL, src->splice_pending, SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+	if (len < 0) {
+		cr_try_again;
+		uwsgi_cr_error(peer, "uwsgi_cr_splice_write()/splice()");
+		return -1;
+	}
+	if (!len) return 0;
+
+	if (peer != peer->session->main_peer && peer->un) peer->un->rx+=len;
+	src->splice_pending -= len;
+
+	// the chunk has been sent, start (again) reading from client and instances
+	if (src->splice_pending == 0) {
+		cr_reset_hooks(peer);
+	}
+	return len;
+#else
+	return -1;
+#endif
+}
+
+/*
+	adaptive concurrency limit
+
+	each router process tracks the requests in flight to every backend and their time to
+	first byte. The limit starts at UWSGI_CR_LIMIT_INITIAL and is moved by the gradient
+	between the latency without load (the lowest one, slowly forgotten) and the recent
+	average (Vegas/Gradient style): similar latencies let the limit grow by about its square
+	root, a recent latency growing over the tolerance shrinks it down to a half.
+	Failed connections and timeouts halve the headroom (multiplicative decrease).
+
+	Requests over the limit wait (up to --*-adaptive-limit-queue of them, FIFO) until a slot
+	is released or their connect timeout expires, then are shed (503 for the http routers).
+*/
+
+#define UWSGI_CR_LIMIT_INITIAL 10
+#define UWSGI_CR_LIMIT_TOLERANCE 1.5
+#define UWSGI_CR_LIMIT_SMOOTHING 0.2
+
+static struct corerouter_limit *cr_limit_get(struct uwsgi_corerouter *ucr, char *address, uint64_t address_len) {
+	struct corerouter_limit *limit = ucr->limits;
+	while(limit) {
+		if (!uwsgi_strncmp(limit->address, limit->address_len, address, address_len)) return limit;
+		limit = limit->next;
+	}
+	limit = uwsgi_calloc(sizeof(struct corerouter_limit));
+	limit->address = uwsgi_concat2n(address, address_len, "", 0);
+	limit->address_len = address_len;
+	limit->limit = UMIN(UWSGI_CR_LIMIT_INITIAL, ucr->adaptive_limit);
+	limit->next = ucr->limits;
+	ucr->limits = limit;
+	return limit;
+}
+
+static int cr_limit_full(struct corerouter_limit *limit) {
+	return limit->inflight >= (uint64_t) limit->limit;
+}
+
+// returns 0 if the peer can connect, 1 if the request is waiting (or has been shed)
+int uwsgi_cr_limit_acquire(struct corerouter_peer *peer, ssize_t (*hook)(struct corerouter_peer *)) {
+	struct uwsgi_corerouter *ucr = peer->session->corerouter;
+	if (peer->limit || peer->instance_address_len == 0) return 0;
+
+	struct corerouter_limit *limit = cr_limit_get(ucr, peer->instance_address, peer->instance_address_len);
+	if (!cr_limit_full(limit)) {
+		limit->inflight++;
+		peer->limit = limit;
+		return 0;
+	}
+
+	if (limit->queued < (uint64_t) ucr->adaptive_limit_queue) {
+		// stop reading from the client until the backend is connected
+		if (uwsgi_cr_set_hooks(peer->session->main_peer, NULL, NULL)) return -1;
+		peer->limit = limit;
+		peer->limit_waiting = 1;
+		peer->limit_hook = hook;
+		peer->limit_next = NULL;
+		if (limit->waiting_tail) {
+			limit->waiting_tail->limit_next = peer;
+		}
+		else {
+			limit->waiting = peer;
+		}
+		limit->waiting_tail = peer;
+		limit->queued++;
+		ucr->limit_queued++;
+		return 1;
+	}
+
+	ucr->limit_shed++;
+	// the request never reached the backend
+	peer->outcome_reported = 1;
+	peer->can_retry = 0;
+	peer->session->can_keepalive = 0;
+	if (!ucr->quiet)
+		uwsgi_log("[uwsgi-%s] %.*s => node \"%.*s\" is over its concurrency limit (%llu requests in flight)\n", ucr->short_name, (int) peer->key_len, peer->key, (int) peer->instance_address_len, peer->instance_address, (unsigned long long) limit->inflight);
+	if (peer->session->shed && !peer->session->shed(peer)) return 1;
+	return -1;
+}
+
+void uwsgi_cr_limit_sample(struct corerouter_peer *peer, uint64_t latency) {
+	struct corerouter_limit *limit = peer->limit;
+	int max = peer->session->corerouter->adaptive_limit;
+	double rtt = latency ? latency : 1;
+
+	if (limit->rtt_noload == 0) {
+		limit->rtt_noload = rtt;
+		limit->rtt_short = rtt;
+		return;
+	}
+
+	limit->rtt_short = (limit->rtt_short * 0.9) + (rtt * 0.1);
+	// the backend could have become slower (a deploy, another machine), the minimum is forgotten slowly
+	if (rtt < limit->rtt_noload) limit->rtt_noload = rtt;
+	else limit->rtt_noload = (limit->rtt_noload * 0.999) + (rtt * 0.001);
+
+	// the backend is not using its slots, the latency says nothing about the limit
+	if (limit->inflight < limit->limit / 2) return;
+
+	double gradient = UWSGI_CR_LIMIT_TOLERANCE * limit->rtt_noload / limit->rtt_short;
+	if (gradient > 1.0) gradient = 1.0;
+	if (gradient < 0.5) gradient = 0.5;
+
+	double new_limit = (limit->limit * gradient) + sqrt(limit->limit);
+	limit->limit = (limit->limit * (1 - UWSGI_CR_LIMIT_SMOOTHING)) + (new_limit * UWSGI_CR_LIMIT_SMOOTHING);
+	if (limit->limit > max) limit->limit = max;
+	if (limit->limit < 1) limit->limit = 1;
+}
+
+// give back the slot of the peer (or remove it from the waiting queue)
+static void cr_limit_release(struct corerouter_peer *peer) {
+	struct corerouter_limit *limit = peer->limit;
+	peer->limit = NULL;
+
+	if (peer->limit_waiting) {
+		struct corerouter_peer *prev = NULL, *waiting = limit->waiting;
+		while(waiting) {
+			if (waiting == peer) {
+				if (prev) prev->limit_next = peer->limit_next;
+				else limit->waiting = peer->limit_next;
+				if (limit->waiting_tail == peer) limit->waiting_tail = prev;
+				limit->queued--;
+				break;
+			}
+			prev = waiting;
+			waiting = waiting->limit_next;
+		}
+		peer->limit_waiting = 0;
+		peer->limit_next = NULL;
+		return;
+	}
+
+	// the backend refused the connection or did not answer in time
+	if (peer->failed || (peer->timed_out && peer->backend_start)) {
+		limit->limit *= 0.9;
+		if (limit->limit < 1) limit->limit = 1;
+	}
+
+	if (limit->inflight > 0) limit->inflight--;
+	// the waiting requests are connected by the event loop (the peer could be in the middle of its session teardown)
+	if (limit->waiting && !cr_limit_full(limit)) peer->session->corerouter->limit_wakeup = 1;
+}
+
+static ssize_t cr_limit_connect(struct corerouter_peer *peer) {
+	ssize_t (*f)(struct corerouter_peer *) = peer->limit_hook;
+	cr_connect_now(peer, f);
+	return 0;
+}
+
+// connect the waiting requests to the backends with free slots
+static void corerouter_limit_wakeup(struct uwsgi_corerouter *ucr) {
+	ucr->limit_wakeup = 0;
+	struct corerouter_limit *limit = ucr->limits;
+	while(limit) {
+		while(limit->waiting && !cr_limit_full(limit)) {
+			struct corerouter_peer *peer = limit->waiting;
+			limit->waiting = peer->limit_next;
+			if (!limit->waiting) limit->waiting_tail = NULL;
+			limit->queued--;
+			limit->inflight++;
+			peer->limit_waiting = 0;
+			peer->limit_next = NULL;
+			// the connect timeout starts now
+			peer->timeout = corerouter_reset_timeout(ucr, peer);
+			if (cr_limit_connect(peer) < 0) {
+				peer->session->can_keepalive = 0;
+				corerouter_close_peer(ucr, peer);
+			}
+		}
+		limit = limit->next;
+	}
+}
+
+// a request waited too much for a slot
+static void corerouter_limit_expire(struct uwsgi_corerouter *ucr, struct corerouter_peer *peer) {
+	struct corerouter_session *cs = peer->session;
+	cr_limit_release(peer);
+	ucr->limit_shed++;
+	peer->outcome_reported = 1;
+	peer->can_retry = 0;
+	cs->can_keepalive = 0;
+	if (!ucr->quiet)
+		uwsgi_log("[uwsgi-%s] %.*s => timeout waiting for a free slot of node \"%.*s\"\n", ucr->short_name, (int) peer->key_len, peer->key, (int) peer->instance_address_len, peer->instance_address);
+	if (cs->shed && !cs->shed(peer)) {
+		peer->timeout = corerouter_reset_timeout(ucr, peer);
+		return;
+	}
+	corerouter_close_peer(ucr, peer);
+}
+
 // reset a peer (allows it to connect to another backend)
 void uwsgi_cr_peer_reset(struct corerouter_peer *peer) {
+	// give back the connection to the pool (instance_address could be mapped to tmp_socket_name)
+	if (peer->fd != -1 && peer->pool_done && (peer->mux || !peer->pool_no_reuse) && !peer->failed && !peer->timed_out) {
+		cr_pool_put(peer);
+	}
+	peer->pool_done = 0;
+
 	if (peer->tmp_socket_name) {
 		free(peer->tmp_socket_name);
 		peer->tmp_socket_name = NULL;
@@ -69,6 +772,7 @@ void uwsgi_cr_peer_reset(struct corerouter_peer *peer) {
 	cr_del_timeout(peer->session->corerouter, peer);
 	
 	if (peer->fd != -1) {
+		cr_forget_fd(peer->session->corerouter, peer->fd);
 		close(peer->fd);
 		peer->session->corerouter->cr_table[peer->fd] = NULL;
 		peer->fd = -1;
@@ -82,12 +786,15 @@ void uwsgi_cr_peer_reset(struct corerouter_peer *peer) {
 		}
 	}
 
+	if (peer->limit) cr_limit_release(peer);
+
 	peer->failed = 0;
 	peer->soopt = 0;
 	peer->timed_out = 0;
 
 	peer->un = NULL;
 	peer->static_node = NULL;
+	peer->outcome_reported = 0;
 }
 
 // destroy a peer
@@ -116,16 +823,28 @@ int uwsgi_cr_peer_del(struct corerouter_peer *peer) {
 
 	uwsgi_cr_peer_reset(peer);
 
+	struct uwsgi_corerouter *ucr = peer->session->corerouter;
+
+	if (peer->splicing) {
+		close(peer->splice_pipe[0]);
+		close(peer->splice_pipe[1]);
+		peer->splicing = 0;
+	}
+
 	if (peer->in) {
-		uwsgi_buffer_destroy(peer->in);
+		uwsgi_cr_buffer_destroy(ucr, peer->in);
 	}
 
 	// main_peer bring the output buffer from backend peers
 	if (peer->out && peer->out_need_free) {
-		uwsgi_buffer_destroy(peer->out);
+		uwsgi_cr_buffer_destroy(ucr, peer->out);
+	}
+
+	if (peer->mux_buf) {
+		uwsgi_cr_buffer_destroy(ucr, peer->mux_buf);
 	}
 
-	free(peer);
+	cr_peer_free(ucr, peer);
 	return 0;
 }
 
@@ -325,6 +1044,13 @@ void corerouter_close_peer(struct uwsgi_corerouter *ucr, struct corerouter_peer
 	
 	// manage subscription reference count
 	if (ucr->subscriptions && peer->un && peer->un->len > 0) {
+		// passive health check (connect failures are managed below with the death mark)
+		if (peer->timed_out && !peer->connecting) {
+			uwsgi_subscription_node_outcome(peer->un, 1);
+		}
+		else if (!peer->failed && !peer->outcome_reported && !peer->connecting && !peer->backend_start) {
+			uwsgi_subscription_node_outcome(peer->un, 0);
+		}
                 // decrease reference count
 #ifdef UWSGI_DEBUG
                uwsgi_log("[1] node %.*s refcnt: %llu\n", peer->un->len, peer->un->name, peer->un->reference);
@@ -446,7 +1172,7 @@ void corerouter_close_session(struct uwsgi_corerouter *ucr, struct corerouter_se
 	if (cr_session->close)
 		cr_session->close(cr_session);
 
-	free(cr_session);
+	if (cr_cache_put(&ucr->sessions_cache, cr_session)) free(cr_session);
 
 	if (ucr->active_sessions == 0) {
 		uwsgi_log("[BUG] number of active sessions already 0 !!!\n");
@@ -456,13 +1182,12 @@ void corerouter_close_session(struct uwsgi_corerouter *ucr, struct corerouter_se
 }
 
 struct uwsgi_rb_timer *corerouter_reset_timeout(struct uwsgi_corerouter *ucr, struct corerouter_peer *peer) {
-	cr_del_timeout(ucr, peer);
-	return cr_add_timeout(ucr, peer);
+	return uwsgi_reset_rb_timer(ucr->timeouts, peer->timeout, uwsgi_now() + peer->current_timeout);
 }
 
+// called on every read/write: nothing happens until the second changes
 struct uwsgi_rb_timer *corerouter_reset_timeout_fast(struct uwsgi_corerouter *ucr, struct corerouter_peer *peer, time_t now) {
-        cr_del_timeout(ucr, peer);
-        return cr_add_timeout_fast(ucr, peer, now);
+	return uwsgi_reset_rb_timer(ucr->timeouts, peer->timeout, now + peer->current_timeout);
 }
 
 
@@ -479,6 +1204,14 @@ static void corerouter_expire_timeouts(struct uwsgi_corerouter *ucr, time_t now)
 
 		if (urbt->value <= current) {
 			peer = (struct corerouter_peer *) urbt->data;
+			if (peer->session->offloaded) {
+				peer->timeout = corerouter_reset_timeout(ucr, peer);
+				continue;
+			}
+			if (peer->limit_waiting) {
+				corerouter_limit_expire(ucr, peer);
+				continue;
+			}
 			peer->timed_out = 1;
 			if (peer->connecting) {
 				peer->failed = 1;
@@ -491,6 +1224,50 @@ static void corerouter_expire_timeouts(struct uwsgi_corerouter *ucr, time_t now)
 	}
 }
 
+// returns 1 if the hook can be called again
+static int corerouter_run_hook(struct uwsgi_corerouter *ucr, struct corerouter_peer *peer, ssize_t (*hook)(struct corerouter_peer *)) {
+	// reset errno (as we use it for internal signalling)
+	errno = 0;
+	ssize_t ret = hook(peer);
+	// connection closed
+	if (ret == 0) {
+		corerouter_close_peer(ucr, peer);
+		return 0;
+	}
+	else if (ret < 0) {
+		if (errno == EINPROGRESS) return 0;
+		// remove keepalive on error
+		peer->session->can_keepalive = 0;
+		corerouter_close_peer(ucr, peer);
+		return 0;
+	}
+
+	// the peer could have been destroyed by the hook
+	if (ucr->backend_pool && ucr->cr_table[ucr->interesting_fd] == peer) {
+		corerouter_pool_check(ucr, peer->session);
+	}
+	return 1;
+}
+
+// in edge-triggered mode hooks are called until EAGAIN (or until they are disabled)
+#define UWSGI_CR_DRAIN_MAX 64
+
+static void corerouter_drain(struct uwsgi_corerouter *ucr, struct corerouter_peer *peer, int write) {
+	int fd = ucr->interesting_fd;
+	int i;
+	for(i=0;i<UWSGI_CR_DRAIN_MAX;i++) {
+		// the peer could have been destroyed
+		if (ucr->cr_table[fd] != peer) return;
+		ssize_t (*hook)(struct corerouter_peer *) = write ? peer->hook_write : peer->hook_read;
+		if (!hook) return;
+		if (!corerouter_run_hook(ucr, peer, hook)) return;
+	}
+	// still ready, let the kernel report it again
+	if (ucr->cr_table[fd] == peer && (peer->hook_read || peer->hook_write)) {
+		event_queue_fd_interest(ucr->queue, fd, (peer->hook_read ? UWSGI_EVENT_QUEUE_READ : 0) | (peer->hook_write ? UWSGI_EVENT_QUEUE_WRITE : 0) | UWSGI_EVENT_QUEUE_REARM);
+	}
+}
+
 int uwsgi_cr_set_hooks(struct corerouter_peer *peer, ssize_t (*read_hook)(struct corerouter_peer *), ssize_t (*write_hook)(struct corerouter_peer *)) {
 	struct corerouter_session *cs = peer->session;
 	struct uwsgi_corerouter *ucr = cs->corerouter;
@@ -526,6 +1303,11 @@ int uwsgi_cr_set_hooks(struct corerouter_peer *peer, ssize_t (*read_hook)(struct
 		goto unchanged;
 	}
 
+	if (ucr->defer_events) {
+		if (event_queue_fd_interest(ucr->queue, peer->fd, (read_hook ? UWSGI_EVENT_QUEUE_READ : 0) | (write_hook ? UWSGI_EVENT_QUEUE_WRITE : 0))) return -1;
+		goto unchanged;
+	}
+
 	int has_read = 0;
 	int has_write = 0;
 
@@ -590,13 +1372,17 @@ unchanged:
 
 struct corerouter_session *corerouter_alloc_session(struct uwsgi_corerouter *ucr, struct uwsgi_gateway_socket *ugs, int new_connection, struct sockaddr *cr_addr, socklen_t cr_addr_len) {
 
-	struct corerouter_session *cs = uwsgi_calloc(ucr->session_size);
+	struct corerouter_session *cs = cr_cache_get(&ucr->sessions_cache);
+	if (cs) {
+		memset(cs, 0, ucr->session_size);
+	}
+	else {
+		cs = uwsgi_calloc(ucr->session_size);
+	}
 
-	struct corerouter_peer *peer = uwsgi_calloc(sizeof(struct corerouter_peer));
+	struct corerouter_peer *peer = cr_peer_new(ucr);
 	// main_peer has only input buffer as output buffer is taken from backend peers
-	size_t bufsize = ucr->buffer_size;
-	if (!bufsize) bufsize = uwsgi.page_size;
-	peer->in = uwsgi_buffer_new(bufsize);
+	peer->in = uwsgi_cr_buffer_new(ucr, cr_buffer_size(ucr));
 
 	ucr->cr_table[new_connection] = peer;
 	cs->main_peer = peer;
@@ -656,6 +1442,32 @@ struct corerouter_session *corerouter_alloc_session(struct uwsgi_corerouter *ucr
 	return cs;
 }
 
+// the client address is the key, rejected connections are closed soon after accept()
+static int corerouter_ratelimited(struct uwsgi_corerouter *ucr, int fd, struct sockaddr *addr) {
+	char key[INET6_ADDRSTRLEN];
+	const char *ok = NULL;
+	switch(addr->sa_family) {
+		case AF_INET:
+			ok = inet_ntop(AF_INET, &((struct sockaddr_in *) addr)->sin_addr, key, sizeof(key));
+			break;
+#ifdef AF_INET6
+		case AF_INET6:
+			ok = inet_ntop(AF_INET6, &((struct sockaddr_in6 *) addr)->sin6_addr, key, sizeof(key));
+			break;
+#endif
+		default:
+			return 0;
+	}
+	if (!ok) return 0;
+	if (!uwsgi_ratelimit_acquire(ucr->ratelimit, key, strlen(key), NULL)) return 0;
+	if (ucr->ratelimit_reply) {
+		// best effort, the socket is non-blocking
+		if (write(fd, ucr->ratelimit_reply, strlen(ucr->ratelimit_reply)) < 0) {}
+	}
+	close(fd);
+	return 1;
+}
+
 void uwsgi_corerouter_loop(int id, void *data) {
 
 	int i;
@@ -672,6 +1484,8 @@ void uwsgi_corerouter_loop(int id, void *data) {
 
 	ucr->i_am_cheap = ucr->cheap;
 
+	corerouter_setup_caches(ucr);
+
 	void *events = uwsgi_corerouter_setup_event_queue(ucr, id);
 
 	if (ucr->has_subscription_sockets)
@@ -776,8 +1590,23 @@ void uwsgi_corerouter_loop(int id, void *data) {
 
 	ucr->timeouts = uwsgi_init_rb_timer();
 
+	time_t snapshot_last = 0;
+	if (ucr->has_subscription_sockets) {
+		if (ucr->subscriptions_snapshot) {
+			if (!ucr->subscriptions_snapshot_freq)
+				ucr->subscriptions_snapshot_freq = 10;
+			uwsgi_corerouter_subscriptions_snapshot_load(ucr);
+			snapshot_last = uwsgi_now();
+		}
+		// the answers will be propagated to the other processes
+		if (i_am_the_first)
+			uwsgi_corerouter_subscriptions_bootstrap(ucr);
+	}
+
 	for (;;) {
 
+		if (ucr->limit_wakeup) corerouter_limit_wakeup(ucr);
+
 		time_t now = uwsgi_now();
 
 		// set timeouts and harakiri
@@ -793,6 +1622,18 @@ void uwsgi_corerouter_loop(int id, void *data) {
 			}
 		}
 
+		// only the first process dumps the snapshot (it receives all of the subscriptions)
+		if (snapshot_last && i_am_the_first) {
+			time_t snapshot_delta = (snapshot_last + ucr->subscriptions_snapshot_freq) - now;
+			if (snapshot_delta <= 0) {
+				uwsgi_corerouter_subscriptions_snapshot_store(ucr);
+				snapshot_last = now;
+				snapshot_delta = ucr->subscriptions_snapshot_freq;
+			}
+			if (delta < 0 || delta > snapshot_delta)
+				delta = snapshot_delta;
+		}
+
 		if (uwsgi.master_process && ucr->harakiri > 0) {
 			ushared->gateways_harakiri[id] = 0;
 		}
@@ -840,6 +1681,10 @@ void uwsgi_corerouter_loop(int id, void *data) {
                                                 uwsgi_socket_nb(new_connection);
 #endif
 #endif
+						if (ucr->ratelimit && corerouter_ratelimited(ucr, new_connection, (struct sockaddr *) &cr_addr)) {
+							taken = 1;
+							break;
+						}
 						struct corerouter_session *cr = corerouter_alloc_session(ucr, ugs, new_connection, (struct sockaddr *) &cr_addr, cr_addr_len);
 						//something wrong in the allocation
 						if (!cr) break;
@@ -868,6 +1713,9 @@ void uwsgi_corerouter_loop(int id, void *data) {
 			else if (ucr->interesting_fd == ucr->cr_stats_server) {
 				corerouter_send_stats(ucr);
 			}
+			else if (ucr->event_hook && ucr->interesting_fd == ucr->event_fd) {
+				ucr->event_hook(ucr, ucr->interesting_fd);
+			}
 			else {
 				struct corerouter_peer *peer = ucr->cr_table[ucr->interesting_fd];
 
@@ -886,6 +1734,16 @@ void uwsgi_corerouter_loop(int id, void *data) {
 				peer->timeout = corerouter_reset_timeout_fast(ucr, peer, now);
 				peer->session->main_peer->timeout = corerouter_reset_timeout_fast(ucr, peer->session->main_peer, now);
 
+				if (ucr->edge_triggered) {
+					if (event_queue_interesting_fd_is_read(events, i)) {
+						corerouter_drain(ucr, peer, 0);
+					}
+					if (event_queue_interesting_fd_is_write(events, i) && ucr->cr_table[ucr->interesting_fd] == peer) {
+						corerouter_drain(ucr, peer, 1);
+					}
+					continue;
+				}
+
 				ssize_t (*hook)(struct corerouter_peer *) = NULL;
 
 				// call event hook
@@ -897,22 +1755,7 @@ void uwsgi_corerouter_loop(int id, void *data) {
 				}
 
 				if (!hook) continue;
-				// reset errno (as we use it for internal signalling)
-				errno = 0;
-				ssize_t ret = hook(peer);
-				// connection closed
-				if (ret == 0) {
-					corerouter_close_peer(ucr, peer);
-					continue;
-				}
-				else if (ret < 0) {
-					if (errno == EINPROGRESS) continue;
-					// remove keepalive on error
-					peer->session->can_keepalive = 0;
-					corerouter_close_peer(ucr, peer);
-					continue;
-				}
-				
+				corerouter_run_hook(ucr, peer, hook);
 			}
 		}
 	}
@@ -956,10 +1799,31 @@ int uwsgi_corerouter_init(struct uwsgi_corerouter *ucr) {
 
 		if (!ucr->max_retries)
 			ucr->max_retries = 3;
+
+		if (ucr->ratelimit_name) {
+			ucr->ratelimit = uwsgi_ratelimit_get(ucr->ratelimit_name);
+			if (!ucr->ratelimit) {
+				uwsgi_log("%s: unknown rate limiter \"%s\"\n", ucr->name, ucr->ratelimit_name);
+				exit(1);
+			}
+		}
+
+		// multiplexed connections are always pooled
+		if (ucr->backend_mux && !ucr->backend_pool)
+			ucr->backend_pool = 8;
 	
 
 		ucr->has_backends = uwsgi_corerouter_has_backends(ucr);
 
+		// static nodes are re-resolved in background (with --dns-cache-ttl)
+		struct uwsgi_string_list *usl;
+		uwsgi_foreach(usl, ucr->static_nodes) {
+			uwsgi_dns_cache_pin(usl->value);
+		}
+		uwsgi_foreach(usl, ucr->fallback) {
+			uwsgi_dns_cache_pin(usl->value);
+		}
+
 
 		uwsgi_corerouter_setup_sockets(ucr);
 
@@ -988,6 +1852,88 @@ struct uwsgi_plugin corerouter_plugin = {
 	.name = "corerouter",
 };
 
+static int corerouter_openmetrics_collect(struct uwsgi_buffer *raw, void *data) {
+	struct uwsgi_corerouter *ucr = (struct uwsgi_corerouter *) data;
+	size_t name_len = strlen(ucr->short_name);
+
+	if (uwsgi_openmetrics_family(raw, "uwsgi_router_active_sessions", "gauge", "active sessions of the router")) return -1;
+	if (uwsgi_openmetrics_sample(raw, NULL, ucr->active_sessions, 1, "router", ucr->short_name, name_len)) return -1;
+
+	if (ucr->handoff) {
+		if (uwsgi_openmetrics_family(raw, "uwsgi_router_handoffs", "counter", "client connections passed to the backends")) return -1;
+		if (uwsgi_openmetrics_sample(raw, "_total", ucr->handoffs, 1, "router", ucr->short_name, name_len)) return -1;
+	}
+
+	if (ucr->backend_pool) {
+		if (uwsgi_openmetrics_family(raw, "uwsgi_router_backend_pool_hits", "counter", "backend connections taken from the pool")) return -1;
+		if (uwsgi_openmetrics_sample(raw, "_total", ucr->pool_hits, 1, "router", ucr->short_name, name_len)) return -1;
+		if (uwsgi_openmetrics_family(raw, "uwsgi_router_backend_pool_misses", "counter", "backend connections not found in the pool")) return -1;
+		if (uwsgi_openmetrics_sample(raw, "_total", ucr->pool_misses, 1, "router", ucr->short_name, name_len)) return -1;
+	}
+
+	if (ucr->adaptive_limit) {
+		if (uwsgi_openmetrics_family(raw, "uwsgi_router_limit_queued", "counter", "requests delayed by the adaptive concurrency limit")) return -1;
+		if (uwsgi_openmetrics_sample(raw, "_total", ucr->limit_queued, 1, "router", ucr->short_name, name_len)) return -1;
+		if (uwsgi_openmetrics_family(raw, "uwsgi_router_limit_shed", "counter", "requests rejected by the adaptive concurrency limit")) return -1;
+		if (uwsgi_openmetrics_sample(raw, "_total", ucr->limit_shed, 1, "router", ucr->short_name, name_len)) return -1;
+		struct corerouter_limit *limit;
+		if (uwsgi_openmetrics_family(raw, "uwsgi_router_node_limit", "gauge", "adaptive concurrency limit of the node")) return -1;
+		for(limit=ucr->limits;limit;limit=limit->next) {
+			if (uwsgi_openmetrics_sample(raw, NULL, (int64_t) limit->limit, 2, "router", ucr->short_name, name_len, "node", limit->address, (size_t) limit->address_len)) return -1;
+		}
+		if (uwsgi_openmetrics_family(raw, "uwsgi_router_node_inflight", "gauge", "requests in flight to the node")) return -1;
+		for(limit=ucr->limits;limit;limit=limit->next) {
+			if (uwsgi_openmetrics_sample(raw, NULL, (int64_t) limit->inflight, 2, "router", ucr->short_name, name_len, "node", limit->address, (size_t) limit->address_len)) return -1;
+		}
+	}
+
+	if (ucr->static_nodes) {
+		if (uwsgi_openmetrics_family(raw, "uwsgi_router_static_node_hits", "counter", "requests routed to the static node")) return -1;
+		struct uwsgi_string_list *usl;
+		uwsgi_foreach(usl, ucr->static_nodes) {
+			if (uwsgi_openmetrics_sample(raw, "_total", usl->custom2, 2, "router", ucr->short_name, name_len, "node", usl->value, usl->len)) return -1;
+		}
+	}
+
+	if (!ucr->has_subscription_sockets) return 0;
+
+#define cr_om_node_family(family, type, suffix, help, field) \
+	if (uwsgi_openmetrics_family(raw, family, type, help)) return -1;\
+	for(i=0;i<ucr->subscriptions->size;i++) {\
+		struct uwsgi_subscribe_slot *s_slot = ucr->subscriptions->buckets[i];\
+		while(s_slot) {\
+			struct uwsgi_subscribe_node *s_node = s_slot->nodes;\
+			while(s_node) {\
+				if (uwsgi_openmetrics_sample(raw, suffix, (int64_t) s_node->field, 3, "router", ucr->short_name, name_len, "key", s_slot->key, (size_t) s_slot->keylen, "node", s_node->name, (size_t) s_node->len)) return -1;\
+				s_node = s_node->next;\
+			}\
+			s_slot = s_slot->next;\
+		}\
+	}
+
+	uint64_t i;
+	cr_om_node_family("uwsgi_router_node_requests", "counter", "_total", "requests routed to the subscribed node", requests);
+	cr_om_node_family("uwsgi_router_node_tx_bytes", "counter", "_total", "bytes sent to the subscribed node", tx);
+	cr_om_node_family("uwsgi_router_node_rx_bytes", "counter", "_total", "bytes received from the subscribed node", rx);
+	cr_om_node_family("uwsgi_router_node_failures", "counter", "_total", "connection failures of the subscribed node", failcnt);
+	cr_om_node_family("uwsgi_router_node_load", "gauge", NULL, "load announced by the subscribed node", load);
+	cr_om_node_family("uwsgi_router_node_weight", "gauge", NULL, "weight of the subscribed node", weight);
+	cr_om_node_family("uwsgi_router_node_latency_usec", "gauge", NULL, "peak-ewma of the time to first byte of the subscribed node", latency);
+
+	return 0;
+}
+
+static void corerouter_send_openmetrics(struct uwsgi_corerouter *ucr, int fd) {
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(uwsgi.page_size);
+	ucr->openmetrics.collect = corerouter_openmetrics_collect;
+	ucr->openmetrics.data = ucr;
+	if (uwsgi_openmetrics_section_render(&ucr->openmetrics, ub)) goto end;
+	if (uwsgi_buffer_append(ub, "# EOF\n", 6)) goto end;
+	uwsgi_stats_send_buffer(fd, ub);
+end:
+	uwsgi_buffer_destroy(ub);
+}
+
 void corerouter_send_stats(struct uwsgi_corerouter *ucr) {
 
 	struct sockaddr_un client_src;
@@ -999,13 +1945,20 @@ void corerouter_send_stats(struct uwsgi_corerouter *ucr) {
 		return;
 	}
 
+	int openmetrics = uwsgi.stats_openmetrics;
 	if (uwsgi.stats_http) {
-                if (uwsgi_send_http_stats(client_fd)) {
+                if (uwsgi_send_http_stats2(client_fd, &openmetrics)) {
                         close(client_fd);
                         return;
                 }
         }
 
+	if (openmetrics) {
+		corerouter_send_openmetrics(ucr, client_fd);
+		close(client_fd);
+		return;
+	}
+
 	struct uwsgi_stats *us = uwsgi_stats_new(8192);
 
         if (uwsgi_stats_keyval_comma(us, "version", UWSGI_VERSION)) goto end;
@@ -1018,6 +1971,39 @@ void corerouter_send_stats(struct uwsgi_corerouter *ucr) {
 
         if (uwsgi_stats_keylong_comma(us, "active_sessions", (unsigned long long) ucr->active_sessions)) goto end0;
 
+	if (ucr->handoff) {
+		if (uwsgi_stats_keylong_comma(us, "handoffs", (unsigned long long) ucr->handoffs)) goto end0;
+	}
+
+	if (ucr->backend_pool) {
+		if (uwsgi_stats_keylong_comma(us, "backend_pool_hits", (unsigned long long) ucr->pool_hits)) goto end0;
+		if (uwsgi_stats_keylong_comma(us, "backend_pool_misses", (unsigned long long) ucr->pool_misses)) goto end0;
+	}
+
+	if (ucr->adaptive_limit) {
+		if (uwsgi_stats_keylong_comma(us, "limit_queued", (unsigned long long) ucr->limit_queued)) goto end0;
+		if (uwsgi_stats_keylong_comma(us, "limit_shed", (unsigned long long) ucr->limit_shed)) goto end0;
+		if (uwsgi_stats_key(us , "limits")) goto end0;
+		if (uwsgi_stats_list_open(us)) goto end0;
+		struct corerouter_limit *limit = ucr->limits;
+		while(limit) {
+			if (uwsgi_stats_object_open(us)) goto end0;
+			if (uwsgi_stats_keyvaln_comma(us, "name", limit->address, limit->address_len)) goto end0;
+			if (uwsgi_stats_keylong_comma(us, "limit", (unsigned long long) limit->limit)) goto end0;
+			if (uwsgi_stats_keylong_comma(us, "inflight", (unsigned long long) limit->inflight)) goto end0;
+			if (uwsgi_stats_keylong_comma(us, "queued", (unsigned long long) limit->queued)) goto end0;
+			if (uwsgi_stats_keylong_comma(us, "rtt_noload", (unsigned long long) limit->rtt_noload)) goto end0;
+			if (uwsgi_stats_keylong(us, "rtt_short", (unsigned long long) limit->rtt_short)) goto end0;
+			if (uwsgi_stats_object_close(us)) goto end0;
+			limit = limit->next;
+			if (limit) {
+				if (uwsgi_stats_comma(us)) goto end0;
+			}
+		}
+		if (uwsgi_stats_list_close(us)) goto end0;
+		if (uwsgi_stats_comma(us)) goto end0;
+	}
+
 	if (uwsgi_stats_key(us , ucr->short_name)) goto end0;
         if (uwsgi_stats_list_open(us)) goto end0;
 
@@ -1061,10 +2047,10 @@ void corerouter_send_stats(struct uwsgi_corerouter *ucr) {
 		if (uwsgi_stats_key(us , "subscriptions")) goto end0;
 		if (uwsgi_stats_list_open(us)) goto end0;
 
-		int i;
+		uint64_t i;
 		int first_processed = 0;
-		for(i=0;i<UMAX16;i++) {
-			struct uwsgi_subscribe_slot *s_slot = ucr->subscriptions[i];
+		for(i=0;i<ucr->subscriptions->size;i++) {
+			struct uwsgi_subscribe_slot *s_slot = ucr->subscriptions->buckets[i];
 			if (s_slot && first_processed) {
 				if (uwsgi_stats_comma(us)) goto end0;
 			}
@@ -1105,6 +2091,7 @@ void corerouter_send_stats(struct uwsgi_corerouter *ucr) {
 					if (uwsgi_stats_keyvaln_comma(us, "proto", &s_node->proto, 1)) goto end0;
 					if (uwsgi_stats_keylong_comma(us, "wrr", (unsigned long long) s_node->wrr)) goto end0;
 					if (uwsgi_stats_keylong_comma(us, "ref", (unsigned long long) s_node->reference)) goto end0;
+					if (uwsgi_stats_keylong_comma(us, "latency", (unsigned long long) s_node->latency)) goto end0;
 					if (uwsgi_stats_keylong_comma(us, "failcnt", (unsigned long long) s_node->failcnt)) goto end0;
 					if (uwsgi_stats_keylong(us, "death_mark", (unsigned long long) s_node->death_mark)) goto end0;
 
@@ -1122,9 +2109,6 @@ void corerouter_send_stats(struct uwsgi_corerouter *ucr) {
 				}
 
 				s_slot = s_slot->next;
-				// check for loopy optimization
-				if (s_slot == ucr->subscriptions[i])
-					break;
 			}
 		}
 
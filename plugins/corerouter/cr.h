@@ -37,7 +37,24 @@
 
 #define cr_write_complete_buf(peer, buf) buf##_pos == buf->pos
 
-#define cr_connect(peer, f) peer->fd = uwsgi_connectn(peer->instance_address, peer->instance_address_len, 0, 1);\
+// time to first byte of the backends is tracked for the router_latency metric, the USDT probes
+// and the latency aware subscription algos
+#ifdef UWSGI_USDT
+#define cr_backend_timing(peer) 1
+#else
+#define cr_backend_timing(peer) (uwsgi.metric_router_latency || peer->un || peer->limit)
+#endif
+
+// with the adaptive concurrency limit the connection could be delayed (or refused)
+#define cr_connect(peer, f) {\
+		int cr_limit = peer->session->corerouter->adaptive_limit ? uwsgi_cr_limit_acquire(peer, f) : 0;\
+		if (cr_limit < 0) return -1;\
+		if (!cr_limit) {\
+			cr_connect_now(peer, f);\
+		}\
+	}
+
+#define cr_connect_now(peer, f) peer->fd = uwsgi_cr_pool_connect(peer);\
         if (peer->fd < 0) {\
                 peer->failed = 1;\
                 peer->soopt = errno;\
@@ -45,16 +62,36 @@
         }\
         peer->session->corerouter->cr_table[peer->fd] = peer;\
         peer->connecting = 1;\
+	uwsgi_probe4(cr_backend_connect, peer->session->corerouter->name, peer->instance_address, peer->instance_address_len, peer->fd);\
+	if (cr_backend_timing(peer)) peer->backend_start = uwsgi_micros();\
 	cr_write_to_backend(peer, f);
 
-#define cr_read(peer, f) read(peer->fd, peer->in->buf + peer->in->pos, peer->in->len - peer->in->pos);\
+// a completed response from a pooled backend is seen as an EOF
+#define cr_read(peer, f) (peer->pool_done ? 0 : read(peer->fd, peer->in->buf + peer->in->pos, peer->in->len - peer->in->pos));\
 	if (len < 0) {\
                 cr_try_again;\
                 uwsgi_cr_error(peer, f);\
                 return -1;\
         }\
 	if (peer != peer->session->main_peer && peer->un) peer->un->tx+=len;\
+	if (peer->backend_start && len > 0) {\
+		uint64_t backend_latency = uwsgi_micros() - peer->backend_start;\
+		uwsgi_probe5(cr_backend_response, peer->session->corerouter->name, peer->instance_address, peer->instance_address_len, peer->fd, backend_latency);\
+		if (uwsgi.metric_router_latency) uwsgi_metric_histogram_add(uwsgi.metric_router_latency, NULL, backend_latency);\
+		if (peer->un && peer->un->len) uwsgi_subscription_node_latency(peer->un, backend_latency);\
+		if (peer->limit) uwsgi_cr_limit_sample(peer, backend_latency);\
+		peer->backend_start = 0;\
+	}\
         peer->in->pos += len;\
+	if (peer->pool_tracking && len > 0) uwsgi_cr_pool_track(peer, peer->in->buf + peer->in->pos - len, len);\
+	if (peer->mux && len > 0) {\
+		len = uwsgi_cr_mux_decode(peer, len);\
+		if (len < 0) return -1;\
+		if (len == 0 && !peer->pool_done) {\
+			errno = EINPROGRESS;\
+			return -1;\
+		}\
+	}\
 
 #define cr_read_exact(peer, l, f) read(peer->fd, peer->in->buf + peer->in->pos, (l - peer->in->pos));\
         if (len < 0) {\
@@ -170,9 +207,13 @@ struct corerouter_peer {
 
 	// stream id (could have various use)
 	uint32_t sid;
+	// send window of the stream (HTTP/2 flow control)
+	int64_t sid_window;
 
 	// internal parser status
 	int r_parser_status;
+	// how much of the input buffer the parser has already seen
+	size_t r_parser_pos;
 
 	// can retry ?
 	int can_retry;
@@ -183,6 +224,10 @@ struct corerouter_peer {
         char key[0xff];
         uint8_t key_len;
 
+	// affinity key for the chash subscription algo (points to the request)
+	char *chash_key;
+	uint16_t chash_key_len;
+
 	uint8_t modifier1;
 	uint8_t modifier2;
 
@@ -199,6 +244,85 @@ struct corerouter_peer {
 
 	int is_buffering;
 	int buffering_fd;
+
+	// backend pool: parse the response framing (Content-Length)
+	int pool_tracking;
+	// the response is complete
+	int pool_done;
+	// the response has no body (HEAD)
+	int pool_no_body;
+	// never give back the connection to the pool
+	int pool_no_reuse;
+	int pool_status;
+	int pool_has_cl;
+	uint64_t pool_remains;
+	char pool_line[64];
+	uint8_t pool_line_len;
+	// splice() forwarding: data read from this peer waits in a pipe
+	int splicing;
+	int splice_pipe[2];
+	size_t splice_pending;
+	// stop reading after splice_remains bytes (request bodies)
+	int splice_limited;
+	uint64_t splice_remains;
+	// time of the backend connection (for the router latency histogram)
+	uint64_t backend_start;
+	// the outcome of the request has been reported to the subscription node (outlier detection)
+	int outcome_reported;
+	// multiplexed puwsgi framing (the end of the response is marked by the backend)
+	int mux;
+	// the request needs a dedicated (unframed) connection
+	int mux_disabled;
+	uint32_t mux_id;
+	char mux_hdr[8];
+	uint8_t mux_hdr_pos;
+	uint8_t mux_type;
+	size_t mux_remains;
+	// frames of the request body
+	struct uwsgi_buffer *mux_buf;
+	// adaptive concurrency limit of the backend (the peer holds a slot or is waiting for one)
+	struct corerouter_limit *limit;
+	int limit_waiting;
+	struct corerouter_peer *limit_next;
+	ssize_t (*limit_hook)(struct corerouter_peer *);
+};
+
+/*
+	adaptive concurrency limit of a backend (instance_address)
+
+	the limit follows the gradient between the time to first byte without load and the
+	recent one: while they are similar the limit grows, when the backend starts queuing
+	the requests it shrinks.
+*/
+struct corerouter_limit {
+	char *address;
+	uint64_t address_len;
+	double limit;
+	uint64_t inflight;
+	// time to first byte (usecs) without load and its recent average
+	double rtt_noload;
+	double rtt_short;
+	// requests waiting for a free slot
+	struct corerouter_peer *waiting;
+	struct corerouter_peer *waiting_tail;
+	uint64_t queued;
+	struct corerouter_limit *next;
+};
+
+// a stack of free items (sessions, peers or buffers) of a router process
+struct corerouter_cache {
+	void **items;
+	uint64_t count;
+	uint64_t max;
+};
+
+// idle persistent connections to a backend
+struct corerouter_pool {
+	char *address;
+	uint64_t address_len;
+	int *fds;
+	int count;
+	struct corerouter_pool *next;
 };
 
 struct uwsgi_corerouter {
@@ -249,7 +373,7 @@ struct uwsgi_corerouter {
         int socket_num;
         struct uwsgi_socket *to_socket;
 
-        struct uwsgi_subscribe_slot **subscriptions;
+        struct uwsgi_subscribe_table *subscriptions;
 
         struct uwsgi_string_list *fallback;
 
@@ -279,8 +403,64 @@ struct uwsgi_corerouter {
         struct uwsgi_string_list *resubscribe;
         char *resubscribe_bind;
 
+	char *subscriptions_snapshot;
+	int subscriptions_snapshot_freq;
+	struct uwsgi_string_list *subscription_peers;
+
 	size_t buffer_size;
 	int fallback_on_no_key;
+
+	// give each process its own SO_REUSEPORT listener
+	int reuse_port;
+
+	// sessions (with their peers and buffers) to preallocate
+	uint64_t prealloc;
+	struct corerouter_cache sessions_cache;
+	struct corerouter_cache peers_cache;
+	struct corerouter_cache buffers_cache;
+
+	// max idle connections per backend
+	int backend_pool;
+	struct corerouter_pool *pools;
+	uint64_t pool_hits;
+	uint64_t pool_misses;
+	// speak the multiplexed puwsgi framing to the backends
+	int backend_mux;
+	uint32_t mux_ids;
+	// pass the client connections to backends bound to UNIX sockets
+	int handoff;
+	uint64_t handoffs;
+
+	// cached OpenMetrics rendering of the stats
+	struct uwsgi_openmetrics_section openmetrics;
+	// forward the streams with splice() when both peers are plain sockets
+	int splice;
+
+	// batched (and optionally edge-triggered) interest changes
+	int defer_events;
+	int edge_triggered;
+
+	// source of the affinity key for the chash subscription algo
+	char *chash_key;
+
+	// reject clients over the rate limit before reading their requests
+	char *ratelimit_name;
+	struct uwsgi_ratelimit *ratelimit;
+	// sent to rejected clients (if set by the router)
+	char *ratelimit_reply;
+
+	// an additional fd managed by the router plugin (e.g. notifications from helper threads)
+	int event_fd;
+	void (*event_hook)(struct uwsgi_corerouter *, int);
+
+	// adaptive per-backend concurrency limit (its max value) and max requests waiting for a slot
+	int adaptive_limit;
+	int adaptive_limit_queue;
+	struct corerouter_limit *limits;
+	// slots have been released while requests are waiting
+	int limit_wakeup;
+	uint64_t limit_queued;
+	uint64_t limit_shed;
 };
 
 // a session is started when a client connect to the router
@@ -300,11 +480,15 @@ struct corerouter_session {
 
 	void (*close)(struct corerouter_session *);
 	int (*retry)(struct corerouter_peer *);
+	// reply to the client of a request over the concurrency limit (0 on success)
+	int (*shed)(struct corerouter_peer *);
 
 	// leave the main peer alive
 	int can_keepalive;
 	// destroy the main peer after the last full write
 	int wait_full_write;
+	// the session is owned by a helper thread, its timeouts are only rescheduled
+	int offloaded;
 
 	// this is the peer of the client
 	struct corerouter_peer *main_peer;
@@ -339,6 +523,9 @@ void corerouter_manage_subscription(char *, uint16_t, char *, uint16_t, void *);
 void *uwsgi_corerouter_setup_event_queue(struct uwsgi_corerouter *, int);
 void uwsgi_corerouter_manage_subscription(struct uwsgi_corerouter *, int id, struct uwsgi_gateway_socket *);
 void uwsgi_corerouter_manage_internal_subscription(struct uwsgi_corerouter *, int);
+void uwsgi_corerouter_subscriptions_snapshot_load(struct uwsgi_corerouter *);
+void uwsgi_corerouter_subscriptions_snapshot_store(struct uwsgi_corerouter *);
+void uwsgi_corerouter_subscriptions_bootstrap(struct uwsgi_corerouter *);
 void uwsgi_corerouter_setup_sockets(struct uwsgi_corerouter *);
 
 int uwsgi_corerouter_init(struct uwsgi_corerouter *);
@@ -363,4 +550,19 @@ int uwsgi_cr_set_hooks(struct corerouter_peer *, ssize_t (*)(struct corerouter_p
 struct corerouter_peer *uwsgi_cr_peer_add(struct corerouter_session *);
 struct corerouter_peer *uwsgi_cr_peer_find_by_sid(struct corerouter_session *, uint32_t);
 void corerouter_close_peer(struct uwsgi_corerouter *, struct corerouter_peer *);
+
+struct uwsgi_buffer *uwsgi_cr_buffer_new(struct uwsgi_corerouter *, size_t);
+void uwsgi_cr_buffer_destroy(struct uwsgi_corerouter *, struct uwsgi_buffer *);
+
+int uwsgi_cr_pool_connect(struct corerouter_peer *);
+int uwsgi_cr_limit_acquire(struct corerouter_peer *, ssize_t (*)(struct corerouter_peer *));
+void uwsgi_cr_limit_sample(struct corerouter_peer *, uint64_t);
+void uwsgi_cr_pool_track(struct corerouter_peer *, char *, size_t);
+int uwsgi_cr_mux_request(struct corerouter_peer *, struct uwsgi_buffer *);
+int uwsgi_cr_handoff(struct corerouter_peer *, struct uwsgi_buffer *);
+struct uwsgi_buffer *uwsgi_cr_mux_body(struct corerouter_peer *, struct uwsgi_buffer *);
+ssize_t uwsgi_cr_mux_decode(struct corerouter_peer *, ssize_t);
+int uwsgi_cr_splice_init(struct corerouter_peer *);
+ssize_t uwsgi_cr_splice_read(struct corerouter_peer *);
+ssize_t uwsgi_cr_splice_write(struct corerouter_peer *);
 struct uwsgi_rb_timer *corerouter_reset_timeout(struct uwsgi_corerouter *, struct corerouter_peer *);
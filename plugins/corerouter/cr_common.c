@@ -10,6 +10,30 @@ extern struct uwsgi_server uwsgi;
 
 #include "cr.h"
 
+// bind a listener for each process, the kernel will balance connections between them
+static void corerouter_setup_shards(struct uwsgi_corerouter *ucr, struct uwsgi_gateway_socket *ugs) {
+#ifdef SO_REUSEPORT
+	int i;
+	int current_reuse_port = uwsgi.reuse_port;
+	uwsgi.reuse_port = 1;
+	ugs->shards = uwsgi_malloc(sizeof(int) * ucr->processes);
+	for(i=0;i<ucr->processes;i++) {
+		ugs->shards[i] = bind_to_tcp(ugs->name, uwsgi.listen_queue, ugs->port);
+		if (ugs->shards[i] < 0) {
+			uwsgi_log("unable to bind SO_REUSEPORT listener %d for %s\n", i, ugs->name);
+			exit(1);
+		}
+		uwsgi_socket_nb(ugs->shards[i]);
+	}
+	ugs->shards_cnt = ucr->processes;
+	ugs->fd = ugs->shards[0];
+	uwsgi.reuse_port = current_reuse_port;
+#else
+	uwsgi_log("your system does not support SO_REUSEPORT, unable to shard %s\n", ugs->name);
+	exit(1);
+#endif
+}
+
 void uwsgi_corerouter_setup_sockets(struct uwsgi_corerouter *ucr) {
 
 	struct uwsgi_gateway_socket *ugs = uwsgi.gateway_sockets;
@@ -47,7 +71,12 @@ void uwsgi_corerouter_setup_sockets(struct uwsgi_corerouter *ucr) {
 					}
 					if (ugs->fd == -1) {
 						if (ugs->port) {
-							ugs->fd = bind_to_tcp(ugs->name, uwsgi.listen_queue, ugs->port);
+							if (ucr->reuse_port && ucr->processes > 1) {
+								corerouter_setup_shards(ucr, ugs);
+							}
+							else {
+								ugs->fd = bind_to_tcp(ugs->name, uwsgi.listen_queue, ugs->port);
+							}
 							ugs->port++;
 							ugs->port_len = strlen(ugs->port);
 						}
@@ -95,11 +124,36 @@ void uwsgi_corerouter_setup_sockets(struct uwsgi_corerouter *ucr) {
 
 void *uwsgi_corerouter_setup_event_queue(struct uwsgi_corerouter *ucr, int id) {
 
+	int i;
+	// the index of this process between the ones of the router
+	int shard = 0;
+	for(i=0;i<id;i++) {
+		if (!strcmp(ushared->gateways[i].name, ucr->name)) shard++;
+	}
+
 	ucr->queue = event_queue_init();
 
+	if (ucr->defer_events || ucr->edge_triggered) {
+		if (event_queue_defer(ucr->queue, ucr->edge_triggered)) {
+			uwsgi_log("[uwsgi-%s] batched events are not supported by this event backend\n", ucr->short_name);
+			ucr->defer_events = 0;
+			ucr->edge_triggered = 0;
+		}
+		else {
+			ucr->defer_events = 1;
+		}
+	}
+
 	struct uwsgi_gateway_socket *ugs = uwsgi.gateway_sockets;
 	while (ugs) {
 		if (!strcmp(ucr->name, ugs->owner)) {
+			// use our listener, closing the ones of the other processes
+			if (ugs->shards_cnt > 0) {
+				for(i=0;i<ugs->shards_cnt;i++) {
+					if (i != shard % ugs->shards_cnt) close(ugs->shards[i]);
+				}
+				ugs->fd = ugs->shards[shard % ugs->shards_cnt];
+			}
 			if (!ucr->cheap || ugs->subscription) {
 				event_queue_add_fd_read(ucr->queue, ugs->fd);
 			}
@@ -111,123 +165,186 @@ void *uwsgi_corerouter_setup_event_queue(struct uwsgi_corerouter *ucr, int id) {
 	return event_queue_alloc(ucr->nevents);
 }
 
-void uwsgi_corerouter_manage_subscription(struct uwsgi_corerouter *ucr, int id, struct uwsgi_gateway_socket *ugs) {
+static void corerouter_subscription_add(struct uwsgi_corerouter *ucr, struct uwsgi_subscribe_req *usr) {
+	if (uwsgi_add_subscribe_node(ucr->subscriptions, usr) && ucr->i_am_cheap) {
+		struct uwsgi_gateway_socket *ugs = uwsgi.gateway_sockets;
+		while (ugs) {
+			if (!strcmp(ugs->owner, ucr->name) && !ugs->subscription) {
+				event_queue_add_fd_read(ucr->queue, ugs->fd);
+			}
+			ugs = ugs->next;
+		}
+		ucr->i_am_cheap = 0;
+		uwsgi_log("[%s pid %d] leaving cheap mode...\n", ucr->name, (int) uwsgi.mypid);
+	}
+}
+
+// walk a sequence of subscription packets (as generated by uwsgi_subscription_snapshot())
+static char *corerouter_snapshot_next(char *buf, size_t len, size_t *pos, uint16_t *pktlen) {
+	if (*pos + 4 > len) return NULL;
+	char *pkt = buf + *pos;
+	uint16_t pktsize = (uint8_t) pkt[1] | (((uint8_t) pkt[2]) << 8);
+	if ((uint8_t) pkt[0] != 224 || *pos + 4 + pktsize > len) return NULL;
+	*pktlen = 4 + pktsize;
+	*pos += *pktlen;
+	return pkt;
+}
+
+// reply to a snapshot request (cmd 3) sending back the whole table, one packet per node
+static void corerouter_subscription_send_snapshot(struct uwsgi_corerouter *ucr, int fd, struct sockaddr *addr, socklen_t addr_len) {
+	struct uwsgi_buffer *ub = uwsgi_subscription_snapshot(ucr->subscriptions);
+	if (!ub) return;
+	size_t pos = 0;
+	uint16_t pktlen = 0;
+	uint64_t count = 0;
+	char *pkt;
+	while ((pkt = corerouter_snapshot_next(ub->buf, ub->pos, &pos, &pktlen))) {
+		if (sendto(fd, pkt, pktlen, 0, addr, addr_len) < 0) {
+			uwsgi_error("corerouter_subscription_send_snapshot()/sendto()");
+			break;
+		}
+		count++;
+	}
+	uwsgi_log("[%s pid %d] sent subscriptions snapshot to peer (%llu nodes)\n", ucr->name, (int) uwsgi.mypid, (unsigned long long) count);
+	uwsgi_buffer_destroy(ub);
+}
+
+static void corerouter_subscription_packet(struct uwsgi_corerouter *ucr, int id, int fd, char *bbuf, ssize_t len, struct uwsgi_subscribe_req *usr, struct sockaddr *addr, socklen_t addr_len) {
 
 	int i;
-	struct uwsgi_subscribe_req usr;
-	char bbuf[4096];
-	ssize_t len = -1;
 
-	memset(&usr, 0, sizeof(struct uwsgi_subscribe_req));
+	if (len < 4) return;
 
-	if (uwsgi.subscriptions_use_credentials) {
-		len = uwsgi_recv_cred2(ugs->fd, bbuf, 4096, &usr.pid, &usr.uid, &usr.gid);
+	// snapshot request, it is not propagated
+	if (bbuf[3] == 3) {
+		if (addr) {
+			corerouter_subscription_send_snapshot(ucr, fd, addr, addr_len);
+		}
+		return;
 	}
-	else {
-		len = recv(ugs->fd, bbuf, 4096, 0);
+
+	uwsgi_hooked_parse(bbuf + 4, len - 4, corerouter_manage_subscription, usr);
+	if (usr->sign_len > 0) {
+		// calc the base size
+		usr->base = bbuf + 4;
+		usr->base_len = len - 4 - (2 + 4 + 2 + usr->sign_len);
 	}
-	if (len > 0) {
-		uwsgi_hooked_parse(bbuf + 4, len - 4, corerouter_manage_subscription, &usr);
-		if (usr.sign_len > 0) {
-			// calc the base size
-			usr.base = bbuf + 4;
-			usr.base_len = len - 4 - (2 + 4 + 2 + usr.sign_len);
-		}
 
-		// subscribe request ?
-		if (bbuf[3] == 0) {
-			if (uwsgi_add_subscribe_node(ucr->subscriptions, &usr) && ucr->i_am_cheap) {
-				struct uwsgi_gateway_socket *ugs = uwsgi.gateway_sockets;
-				while (ugs) {
-					if (!strcmp(ugs->owner, ucr->name) && !ugs->subscription) {
-						event_queue_add_fd_read(ucr->queue, ugs->fd);
-					}
-					ugs = ugs->next;
-				}
-				ucr->i_am_cheap = 0;
-				uwsgi_log("[%s pid %d] leaving cheap mode...\n", ucr->name, (int) uwsgi.mypid);
-			}
-		}
-		//unsubscribe 
-		else {
-			struct uwsgi_subscribe_node *node = uwsgi_get_subscribe_node_by_name(ucr->subscriptions, usr.key, usr.keylen, usr.address, usr.address_len);
-			if (node && node->len) {
+	// subscribe request ?
+	if (bbuf[3] == 0) {
+		corerouter_subscription_add(ucr, usr);
+	}
+	// refresh (delta) of an already known node
+	else if (bbuf[3] == 2) {
+		uwsgi_refresh_subscribe_node(ucr->subscriptions, usr);
+	}
+	//unsubscribe 
+	else {
+		struct uwsgi_subscribe_node *node = uwsgi_get_subscribe_node_by_name(ucr->subscriptions, usr->key, usr->keylen, usr->address, usr->address_len);
+		if (node && node->len) {
 #ifdef UWSGI_SSL
-				if (uwsgi.subscriptions_sign_check_dir) {
-					if (!uwsgi_subscription_sign_check(node->slot, &usr)) {
-						return;
-					}
+			if (uwsgi.subscriptions_sign_check_dir) {
+				if (!uwsgi_subscription_sign_check(node->slot, usr)) {
+					return;
 				}
+			}
 #endif
-				if (node->death_mark == 0)
-					uwsgi_log("[%s pid %d] %.*s => marking %.*s as failed\n", ucr->name, (int) uwsgi.mypid, (int) usr.keylen, usr.key, (int) usr.address_len, usr.address);
-				node->failcnt++;
-				node->death_mark = 1;
-				// check if i can remove the node
-				if (node->reference == 0) {
-					uwsgi_remove_subscribe_node(ucr->subscriptions, node);
-				}
-				if (ucr->cheap && !ucr->i_am_cheap && uwsgi_no_subscriptions(ucr->subscriptions)) {
-					uwsgi_gateway_go_cheap(ucr->name, ucr->queue, &ucr->i_am_cheap);
-				}
+			if (node->death_mark == 0)
+				uwsgi_log("[%s pid %d] %.*s => marking %.*s as failed\n", ucr->name, (int) uwsgi.mypid, (int) usr->keylen, usr->key, (int) usr->address_len, usr->address);
+			node->failcnt++;
+			node->death_mark = 1;
+			// check if i can remove the node
+			if (node->reference == 0) {
+				uwsgi_remove_subscribe_node(ucr->subscriptions, node);
+			}
+			if (ucr->cheap && !ucr->i_am_cheap && uwsgi_no_subscriptions(ucr->subscriptions)) {
+				uwsgi_gateway_go_cheap(ucr->name, ucr->queue, &ucr->i_am_cheap);
 			}
 		}
+	}
 
-		// propagate the subscription to other nodes
-		for (i = 0; i < ushared->gateways_cnt; i++) {
-			if (i == id)
-				continue;
-			if (!strcmp(ushared->gateways[i].name, ucr->name)) {
-				if (send(ushared->gateways[i].internal_subscription_pipe[0], bbuf, len, 0) != len) {
-					uwsgi_error("uwsgi_corerouter_manage_subscription()/send()");
-				}
+	// propagate the subscription to other nodes
+	for (i = 0; i < ushared->gateways_cnt; i++) {
+		if (i == id)
+			continue;
+		if (!strcmp(ushared->gateways[i].name, ucr->name)) {
+			if (send(ushared->gateways[i].internal_subscription_pipe[0], bbuf, len, 0) != len) {
+				uwsgi_error("uwsgi_corerouter_manage_subscription()/send()");
 			}
 		}
+	}
 
-		// resubscribe if needed ?
-		if (ucr->resubscribe) {
-			static char *address = NULL;
-			if (!address) {
-				struct uwsgi_gateway_socket *augs = uwsgi.gateway_sockets;
+	// resubscribe if needed ?
+	if (ucr->resubscribe) {
+		static char *address = NULL;
+		if (!address) {
+			struct uwsgi_gateway_socket *augs = uwsgi.gateway_sockets;
         			while (augs) {
                 			if (!strcmp(ucr->name, augs->owner)) {
                         			if (!augs->subscription) {
-							address = augs->name;
-							break;
-						}
+						address = augs->name;
+						break;
 					}
-					augs = augs->next;
 				}
+				augs = augs->next;
 			}
-			struct uwsgi_string_list *usl = NULL;
-			char *sni_key = NULL;
-			char *sni_cert = NULL;
-			char *sni_ca = NULL;
-			if (usr.sni_key_len) {
-				sni_key = uwsgi_concat2n(usr.sni_key, usr.sni_key_len, "", 0);
-			}
-			if (usr.sni_crt_len) {
-				sni_cert = uwsgi_concat2n(usr.sni_crt, usr.sni_crt_len, "", 0);
-			}
-			if (usr.sni_ca_len) {
-				sni_ca = uwsgi_concat2n(usr.sni_ca, usr.sni_ca_len, "", 0);
-			}
-			uwsgi_foreach(usl, ucr->resubscribe) {	
-				if (ucr->resubscribe_bind) {
-					static int rfd = -1;
-					if (rfd == -1) {
-						rfd = bind_to_udp(ucr->resubscribe_bind, 0, 0);
-					}
-					uwsgi_send_subscription_from_fd(rfd, usl->value, usr.key, usr.keylen, usr.modifier1, usr.modifier2, bbuf[3], address, NULL, sni_key, sni_cert, sni_ca);
-				}
-				else {
-					uwsgi_send_subscription_from_fd(-2, usl->value, usr.key, usr.keylen, usr.modifier1, usr.modifier2, bbuf[3], address, NULL, sni_key, sni_cert, sni_ca);
+		}
+		struct uwsgi_string_list *usl = NULL;
+		char *sni_key = NULL;
+		char *sni_cert = NULL;
+		char *sni_ca = NULL;
+		if (usr->sni_key_len) {
+			sni_key = uwsgi_concat2n(usr->sni_key, usr->sni_key_len, "", 0);
+		}
+		if (usr->sni_crt_len) {
+			sni_cert = uwsgi_concat2n(usr->sni_crt, usr->sni_crt_len, "", 0);
+		}
+		if (usr->sni_ca_len) {
+			sni_ca = uwsgi_concat2n(usr->sni_ca, usr->sni_ca_len, "", 0);
+		}
+		uwsgi_foreach(usl, ucr->resubscribe) {	
+			if (ucr->resubscribe_bind) {
+				static int rfd = -1;
+				if (rfd == -1) {
+					rfd = bind_to_udp(ucr->resubscribe_bind, 0, 0);
 				}
+				uwsgi_send_subscription_from_fd(rfd, usl->value, usr->key, usr->keylen, usr->modifier1, usr->modifier2, bbuf[3], address, NULL, sni_key, sni_cert, sni_ca);
 			}
-			if (sni_key) free(sni_key);
-			if (sni_cert) free(sni_cert);
-			if (sni_ca) free(sni_ca);
+			else {
+				uwsgi_send_subscription_from_fd(-2, usl->value, usr->key, usr->keylen, usr->modifier1, usr->modifier2, bbuf[3], address, NULL, sni_key, sni_cert, sni_ca);
+			}
+		}
+		if (sni_key) free(sni_key);
+		if (sni_cert) free(sni_cert);
+		if (sni_ca) free(sni_ca);
+	}
+}
+
+void uwsgi_corerouter_manage_subscription(struct uwsgi_corerouter *ucr, int id, struct uwsgi_gateway_socket *ugs) {
+
+	struct uwsgi_subscribe_req usr;
+	char bbuf[4096];
+	ssize_t len = -1;
+
+	memset(&usr, 0, sizeof(struct uwsgi_subscribe_req));
+
+	if (uwsgi.subscriptions_use_credentials) {
+		len = uwsgi_recv_cred2(ugs->fd, bbuf, 4096, &usr.pid, &usr.uid, &usr.gid);
+		if (len > 0) {
+			corerouter_subscription_packet(ucr, id, ugs->fd, bbuf, len, &usr, NULL, 0);
 		}
+		return;
+	}
+
+	// with thousands of nodes announcing themselves, get all of the queued packets with a single syscall
+	static struct uwsgi_dgram_batch *udb = NULL;
+	if (!udb) udb = uwsgi_dgram_batch_new(UWSGI_DGRAM_BATCH, 4096);
+
+	int i, n = uwsgi_dgram_batch_recv(ugs->fd, udb);
+	for(i=0;i<n;i++) {
+		if (udb->len[i] <= 0) continue;
+		memset(&usr, 0, sizeof(struct uwsgi_subscribe_req));
+		corerouter_subscription_packet(ucr, id, ugs->fd, uwsgi_dgram_batch_buf(udb, i), udb->len[i], &usr, (struct sockaddr *) &udb->addr[i], udb->addr_len[i]);
 	}
 
 }
@@ -245,17 +362,10 @@ void uwsgi_corerouter_manage_internal_subscription(struct uwsgi_corerouter *ucr,
 
 		// subscribe request ?
 		if (bbuf[3] == 0) {
-			if (uwsgi_add_subscribe_node(ucr->subscriptions, &usr) && ucr->i_am_cheap) {
-				struct uwsgi_gateway_socket *ugs = uwsgi.gateway_sockets;
-				while (ugs) {
-					if (!strcmp(ugs->owner, ucr->name) && !ugs->subscription) {
-						event_queue_add_fd_read(ucr->queue, ugs->fd);
-					}
-					ugs = ugs->next;
-				}
-				ucr->i_am_cheap = 0;
-				uwsgi_log("[%s pid %d] leaving cheap mode...\n", ucr->name, (int) uwsgi.mypid);
-			}
+			corerouter_subscription_add(ucr, &usr);
+		}
+		else if (bbuf[3] == 2) {
+			uwsgi_refresh_subscribe_node(ucr->subscriptions, &usr);
 		}
 		//unsubscribe 
 		else {
@@ -277,3 +387,85 @@ void uwsgi_corerouter_manage_internal_subscription(struct uwsgi_corerouter *ucr,
 	}
 
 }
+
+/*
+	subscriptions snapshot file: the table is periodically dumped (by the first process of the router)
+	as a sequence of subscription packets, and reloaded on startup, so a restarted router
+	does not have to wait for every node to re-announce itself.
+*/
+void uwsgi_corerouter_subscriptions_snapshot_load(struct uwsgi_corerouter *ucr) {
+	if (!ucr->subscriptions_snapshot || !uwsgi_file_exists(ucr->subscriptions_snapshot)) return;
+	size_t len = 0;
+	char *buf = uwsgi_open_and_read(ucr->subscriptions_snapshot, &len, 0, NULL);
+	size_t pos = 0;
+	uint16_t pktlen = 0;
+	uint64_t count = 0;
+	char *pkt;
+	while ((pkt = corerouter_snapshot_next(buf, len, &pos, &pktlen))) {
+		struct uwsgi_subscribe_req usr;
+		memset(&usr, 0, sizeof(struct uwsgi_subscribe_req));
+		uwsgi_hooked_parse(pkt + 4, pktlen - 4, corerouter_manage_subscription, &usr);
+		corerouter_subscription_add(ucr, &usr);
+		count++;
+	}
+	free(buf);
+	uwsgi_log("[%s pid %d] loaded %llu subscriptions from snapshot %s\n", ucr->name, (int) uwsgi.mypid, (unsigned long long) count, ucr->subscriptions_snapshot);
+}
+
+void uwsgi_corerouter_subscriptions_snapshot_store(struct uwsgi_corerouter *ucr) {
+	struct uwsgi_buffer *ub = uwsgi_subscription_snapshot(ucr->subscriptions);
+	if (!ub) return;
+	char *tmp = uwsgi_concat2(ucr->subscriptions_snapshot, ".tmp");
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		uwsgi_error_open(tmp);
+		goto end;
+	}
+	if (write(fd, ub->buf, ub->pos) != (ssize_t) ub->pos) {
+		uwsgi_error("uwsgi_corerouter_subscriptions_snapshot_store()/write()");
+		close(fd);
+		unlink(tmp);
+		goto end;
+	}
+	close(fd);
+	if (rename(tmp, ucr->subscriptions_snapshot)) {
+		uwsgi_error("uwsgi_corerouter_subscriptions_snapshot_store()/rename()");
+		unlink(tmp);
+	}
+end:
+	free(tmp);
+	uwsgi_buffer_destroy(ub);
+}
+
+// ask the peers for their table, the answers are managed as standard subscriptions
+void uwsgi_corerouter_subscriptions_bootstrap(struct uwsgi_corerouter *ucr) {
+	if (!ucr->subscription_peers) return;
+	struct uwsgi_gateway_socket *ugs = uwsgi.gateway_sockets;
+	while (ugs) {
+		if (!strcmp(ugs->owner, ucr->name) && ugs->subscription) break;
+		ugs = ugs->next;
+	}
+	if (!ugs) {
+		uwsgi_log("[%s pid %d] unable to bootstrap subscriptions from peers without a subscription server\n", ucr->name, (int) uwsgi.mypid);
+		return;
+	}
+	// empty packet, modifier2 3 is the snapshot request
+	char req[4] = { (char) 224, 0, 0, 3 };
+	struct uwsgi_string_list *usl;
+	uwsgi_foreach(usl, ucr->subscription_peers) {
+		union uwsgi_sockaddr peer;
+		socklen_t peer_len = 0;
+		char *colon = strchr(usl->value, ':');
+		if (colon) {
+			peer_len = socket_to_in_addr(usl->value, colon, 0, &peer.sa_in);
+		}
+		else {
+			peer_len = socket_to_un_addr(usl->value, &peer.sa_un);
+		}
+		if (peer_len == 0 || sendto(ugs->fd, req, 4, 0, (struct sockaddr *) &peer, peer_len) < 0) {
+			uwsgi_log("[%s pid %d] unable to request subscriptions snapshot from %s\n", ucr->name, (int) uwsgi.mypid, usl->value);
+			continue;
+		}
+		uwsgi_log("[%s pid %d] requested subscriptions snapshot from %s\n", ucr->name, (int) uwsgi.mypid, usl->value);
+	}
+}
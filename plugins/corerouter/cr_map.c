@@ -10,7 +10,8 @@ int uwsgi_cr_map_use_void(struct uwsgi_corerouter *ucr, struct corerouter_peer *
 
 int uwsgi_cr_map_use_cache(struct uwsgi_corerouter *ucr, struct corerouter_peer *peer) {
 	uint64_t hits = 0;
-	uwsgi_rlock(ucr->cache->lock);
+	struct uwsgi_lock_item *cl = uwsgi_cache_key_lock(ucr->cache, peer->key, peer->key_len);
+	uwsgi_rlock(cl);
 	char *value = uwsgi_cache_get4(ucr->cache, peer->key, peer->key_len, &peer->instance_address_len, &hits);
 	if (!value) goto end;
 	peer->tmp_socket_name = uwsgi_concat2n(value, peer->instance_address_len, "", 0);
@@ -31,7 +32,7 @@ int uwsgi_cr_map_use_cache(struct uwsgi_corerouter *ucr, struct corerouter_peer
 		peer->instance_address_len = (cs_mod - peer->instance_address);
 	}
 end:
-	uwsgi_rwunlock(ucr->cache->lock);
+	uwsgi_rwunlock(cl);
 	return 0;
 }
 
@@ -51,7 +52,8 @@ int uwsgi_cr_map_use_subscription(struct uwsgi_corerouter *ucr, struct coreroute
 	struct uwsgi_subscription_client usc;
 	usc.fd = peer->session->main_peer->fd;
 	usc.sockaddr = &peer->session->client_sockaddr;
-	usc.cookie = NULL;
+	usc.cookie = peer->chash_key;
+	usc.cookie_len = peer->chash_key_len;
 
 	peer->un = uwsgi_get_subscribe_node(ucr->subscriptions, peer->key, peer->key_len, &usc);
 	if (peer->un && peer->un->len) {
@@ -78,7 +80,8 @@ int uwsgi_cr_map_use_subscription_dotsplit(struct uwsgi_corerouter *ucr, struct
 	struct uwsgi_subscription_client usc;
 	usc.fd = peer->session->main_peer->fd;
 	usc.sockaddr = &peer->session->client_sockaddr;
-	usc.cookie = NULL;
+	usc.cookie = peer->chash_key;
+	usc.cookie_len = peer->chash_key_len;
 
 split:
 	if (!count) return 0;
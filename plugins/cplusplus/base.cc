@@ -1,6 +1,20 @@
-#include <uwsgi.h>
+#include "uwsgi.hh"
 
-extern struct uwsgi_server uwsgi;
+/*
+
+	example c++ plugin (modifier1 250)
+
+	/raw/... is served with the plain C api, everything else via the uwsgicc helpers,
+	so the two versions can be benchmarked against each other:
+
+	uwsgi --plugin cplusplus --http-socket :9090 --http-socket-modifier1 250
+	ab -n 100000 -c 8 http://127.0.0.1:9090/raw/hello
+	ab -n 100000 -c 8 http://127.0.0.1:9090/hello
+
+*/
+
+using uwsgicc::request;
+using uwsgicc::response;
 
 class FakeClass {
 
@@ -18,48 +32,73 @@ void FakeClass::hello_world(struct wsgi_request *wsgi_req) {
 	uwsgi_response_write_body_do(wsgi_req, foobar, foobar_len);
 }
 
-extern "C" int uwsgi_cplusplus_init(){
-        uwsgi_log("Initializing example c++ plugin\n");
-        return 0;
+static int raw_hello(request &r) {
+	FakeClass fc;
+	// get PATH_INFO
+	fc.foobar = uwsgi_get_var(r.get(), (char *) "PATH_INFO", 9, &fc.foobar_len);
+	if (fc.foobar) {
+		fc.hello_world(r.get());
+	}
+	return UWSGI_OK;
 }
 
-extern "C" int uwsgi_cplusplus_request(struct wsgi_request *wsgi_req) {
-
-	FakeClass *fc;
-
-	// empty request ?
-	if (!wsgi_req->len) {
-                uwsgi_log( "Invalid request. skip.\n");
-		goto clear;
-        }
+static int hello(request &r) {
+	response(r).content_type("text/html").write(r.path());
+	return UWSGI_OK;
+}
 
-	// get uwsgi variables
-        if (uwsgi_parse_vars(wsgi_req)) {
-                uwsgi_log("Invalid request. skip.\n");
-                goto clear;
-        }
+static int echo(request &r) {
+	uwsgicc::buffer b;
+	b << r.method() << " " << r.uri() << "\n";
+	r.for_each_var([&b](std::string_view key, std::string_view value) {
+		b << key << "=" << value << "\n";
+	});
+	b << "\n" << r.body();
+	response resp(r);
+	resp.content_type("text/plain").content_length(b.size());
+	resp.write(std::move(b));
+	return UWSGI_OK;
+}
 
-	fc = new FakeClass();
-	// get PATH_INFO
-        fc->foobar = uwsgi_get_var(wsgi_req, (char *) "PATH_INFO", 9, &fc->foobar_len);
+// ?ms=N
+static uwsgicc::task slow(request &r) {
+	std::string_view qs = r.query_string();
+	int ms = 100;
+	if (qs.substr(0, 3) == "ms=") ms = uwsgi_str_num((char *) qs.data() + 3, qs.size() - 3);
+	co_await uwsgicc::sleep_ms{ms};
+	response(r).content_type("text/plain").write("slept\n");
+	co_return UWSGI_OK;
+}
 
-	if (fc->foobar) {
-		// send output
-		fc->hello_world(wsgi_req);
-	}
+static constexpr auto routes = uwsgicc::make_router(
+	uwsgicc::route("", "/raw/*", raw_hello),
+	uwsgicc::route("", "/echo", echo),
+	uwsgicc::route("GET", "/slow", slow),
+	uwsgicc::route("GET", "/*", hello)
+);
 
-	delete fc;
+static_assert(routes.find("GET", "/raw/foo")->fn == raw_hello);
+static_assert(routes.find("POST", "/slow") == nullptr);
 
-clear:
-        return UWSGI_OK;
+static int uwsgi_cplusplus_init() {
+	uwsgi_log("Initializing example c++ plugin\n");
+	return 0;
 }
 
-
-extern "C" void uwsgi_cplusplus_after_request(struct wsgi_request *wsgi_req) {
-	// call log_request(wsgi_req) if you want a standard logline
-        uwsgi_log("logging c++ request\n");
+static int uwsgi_cplusplus_request(struct wsgi_request *wsgi_req) {
+	return uwsgicc::dispatch(wsgi_req, routes);
 }
 
+static void uwsgi_cplusplus_after_request(struct wsgi_request *wsgi_req) {
+	log_request(wsgi_req);
+}
 
-
-
+extern "C" {
+struct uwsgi_plugin cplusplus_plugin = {
+	.name = "cplusplus",
+	.modifier1 = 250,
+	.init = uwsgi_cplusplus_init,
+	.request = uwsgi_cplusplus_request,
+	.after_request = uwsgi_cplusplus_after_request,
+};
+}
@@ -0,0 +1,300 @@
+#ifndef UWSGI_CPLUSPLUS_HH
+#define UWSGI_CPLUSPLUS_HH
+
+/*
+
+	header-only C++ api for writing request handlers
+
+	- uwsgicc::request exposes the request vars as std::string_view (no copies, the memory is the request buffer)
+	- uwsgicc::response is an RAII builder over the core writer (headers are flushed on destruction if not already sent)
+	- uwsgicc::buffer is a move-only wrapper of struct uwsgi_buffer
+	- uwsgicc::route/uwsgicc::make_router build a constexpr routing table
+	- uwsgicc::task (C++20) allows writing handlers as coroutines awaiting the uwsgi wait hooks,
+	  so they cooperate with the loaded async engine (ugreen, gevent...) or simply block in sync mode
+
+	the namespace is not called 'uwsgi' as it would clash with the global server structure
+
+*/
+
+#include <uwsgi.h>
+
+#include <string_view>
+#include <array>
+#include <utility>
+#include <exception>
+
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#endif
+
+extern struct uwsgi_server uwsgi;
+
+namespace uwsgicc {
+
+using std::string_view;
+
+class buffer {
+	struct uwsgi_buffer *ub;
+public:
+	explicit buffer(size_t len = 4096) : ub(uwsgi_buffer_new(len)) {}
+	buffer(const buffer &) = delete;
+	buffer &operator=(const buffer &) = delete;
+	buffer(buffer &&o) noexcept : ub(std::exchange(o.ub, nullptr)) {}
+	buffer &operator=(buffer &&o) noexcept {
+		if (this != &o) {
+			reset();
+			ub = std::exchange(o.ub, nullptr);
+		}
+		return *this;
+	}
+	~buffer() { reset(); }
+
+	void reset() {
+		if (ub) uwsgi_buffer_destroy(ub);
+		ub = nullptr;
+	}
+
+	bool append(string_view s) { return ub && !uwsgi_buffer_append(ub, (char *) s.data(), s.size()); }
+	bool append(int64_t n) { return ub && !uwsgi_buffer_num64(ub, n); }
+	buffer &operator<<(string_view s) { append(s); return *this; }
+	buffer &operator<<(int64_t n) { append(n); return *this; }
+
+	string_view view() const { return ub ? string_view(ub->buf, ub->pos) : string_view(); }
+	size_t size() const { return ub ? ub->pos : 0; }
+	struct uwsgi_buffer *get() const { return ub; }
+	// give up ownership (the caller has to uwsgi_buffer_destroy() it)
+	struct uwsgi_buffer *release() { return std::exchange(ub, nullptr); }
+};
+
+class request {
+	struct wsgi_request *wsgi_req;
+	static string_view sv(char *p, uint16_t len) { return p ? string_view(p, len) : string_view(); }
+public:
+	explicit request(struct wsgi_request *r) : wsgi_req(r) {}
+	struct wsgi_request *get() const { return wsgi_req; }
+
+	string_view var(string_view key) const {
+		uint16_t len = 0;
+		char *value = uwsgi_get_var(wsgi_req, (char *) key.data(), key.size(), &len);
+		return sv(value, len);
+	}
+
+	// "Content-Type" -> HTTP_CONTENT_TYPE
+	string_view header(string_view name) const {
+		char key[5 + 128];
+		if (name.size() > 128) return string_view();
+		memcpy(key, "HTTP_", 5);
+		for (size_t i = 0; i < name.size(); i++) {
+			char c = name[i];
+			key[5 + i] = c == '-' ? '_' : toupper((unsigned char) c);
+		}
+		return var(string_view(key, 5 + name.size()));
+	}
+
+	string_view method() const { return sv(wsgi_req->method, wsgi_req->method_len); }
+	string_view path() const { return sv(wsgi_req->path_info, wsgi_req->path_info_len); }
+	string_view uri() const { return sv(wsgi_req->uri, wsgi_req->uri_len); }
+	string_view query_string() const { return sv(wsgi_req->query_string, wsgi_req->query_string_len); }
+	string_view host() const { return sv(wsgi_req->host, wsgi_req->host_len); }
+	string_view remote_addr() const { return sv(wsgi_req->remote_addr, wsgi_req->remote_addr_len); }
+	string_view protocol() const { return sv(wsgi_req->protocol, wsgi_req->protocol_len); }
+	size_t content_length() const { return wsgi_req->post_cl; }
+
+	// read (up to hint bytes of) the body, the memory is owned by the request
+	string_view body(ssize_t hint = 0) {
+		ssize_t rlen = 0;
+		char *buf = uwsgi_request_body_read(wsgi_req, hint, &rlen);
+		if (!buf || buf == uwsgi.empty || rlen <= 0) return string_view();
+		return string_view(buf, rlen);
+	}
+
+	template <class F> void for_each_var(F f) const {
+		for (int i = 0; i + 1 < wsgi_req->var_cnt; i += 2) {
+			f(string_view((char *) wsgi_req->hvec[i].iov_base, wsgi_req->hvec[i].iov_len),
+			  string_view((char *) wsgi_req->hvec[i + 1].iov_base, wsgi_req->hvec[i + 1].iov_len));
+		}
+	}
+};
+
+class response {
+	struct wsgi_request *wsgi_req;
+	bool failed = false;
+	bool check(int ret) {
+		if (ret) failed = true;
+		return !failed;
+	}
+public:
+	explicit response(request &r, string_view status = "200 OK") : wsgi_req(r.get()) {
+		check(uwsgi_response_prepare_headers(wsgi_req, (char *) status.data(), status.size()));
+	}
+	response(request &r, int status) : wsgi_req(r.get()) {
+		check(uwsgi_response_prepare_headers_int(wsgi_req, status));
+	}
+	response(const response &) = delete;
+	response &operator=(const response &) = delete;
+	// a response with no body still has to send its headers
+	~response() {
+		if (!failed && !wsgi_req->headers_sent) uwsgi_response_write_headers_do(wsgi_req);
+	}
+
+	response &header(string_view key, string_view value) {
+		if (!failed) check(uwsgi_response_add_header(wsgi_req, (char *) key.data(), key.size(), (char *) value.data(), value.size()));
+		return *this;
+	}
+	response &content_type(string_view value) { return header("Content-Type", value); }
+	response &content_length(uint64_t len) {
+		if (!failed) check(uwsgi_response_add_content_length(wsgi_req, len));
+		return *this;
+	}
+
+	bool write(string_view body) {
+		if (failed) return false;
+		return check(uwsgi_response_write_body_do(wsgi_req, (char *) body.data(), body.size()));
+	}
+	// the buffer is consumed
+	bool write(buffer b) { return write(b.view()); }
+	response &operator<<(string_view body) { write(body); return *this; }
+
+	explicit operator bool() const { return !failed; }
+};
+
+#if defined(__cpp_impl_coroutine)
+/*
+	the awaiters never really suspend the coroutine: they call the uwsgi wait hooks,
+	that in async mode switch to another core (and back when the event is ready)
+*/
+class task {
+public:
+	struct promise_type {
+		int status = UWSGI_OK;
+		task get_return_object() { return task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		std::exception_ptr exception;
+		void return_value(int s) { status = s; }
+		void unhandled_exception() { exception = std::current_exception(); }
+	};
+	task(const task &) = delete;
+	task(task &&o) noexcept : h(std::exchange(o.h, nullptr)) {}
+	~task() { if (h) h.destroy(); }
+
+	int wait() {
+		while (!h.done()) h.resume();
+		if (h.promise().exception) std::rethrow_exception(h.promise().exception);
+		return h.promise().status;
+	}
+private:
+	explicit task(std::coroutine_handle<promise_type> ch) : h(ch) {}
+	std::coroutine_handle<promise_type> h;
+};
+
+struct wait_read {
+	int fd;
+	int timeout;
+	int ret = -1;
+	bool await_ready() const noexcept { return false; }
+	bool await_suspend(std::coroutine_handle<>) { ret = uwsgi.wait_read_hook(fd, timeout); return false; }
+	int await_resume() const noexcept { return ret; }
+};
+
+struct wait_write {
+	int fd;
+	int timeout;
+	int ret = -1;
+	bool await_ready() const noexcept { return false; }
+	bool await_suspend(std::coroutine_handle<>) { ret = uwsgi.wait_write_hook(fd, timeout); return false; }
+	int await_resume() const noexcept { return ret; }
+};
+
+struct sleep_ms {
+	int ms;
+	int ret = 0;
+	bool await_ready() const noexcept { return ms <= 0; }
+	bool await_suspend(std::coroutine_handle<>) { ret = uwsgi.wait_milliseconds_hook(ms); return false; }
+	int await_resume() const noexcept { return ret; }
+};
+#endif
+
+// patterns are exact matches, a trailing star makes them a prefix match, an empty method matches any of them
+struct route {
+	string_view method;
+	string_view pattern;
+	int (*fn)(request &) = nullptr;
+#if defined(__cpp_impl_coroutine)
+	task (*co)(request &) = nullptr;
+	constexpr route(string_view m, string_view p, task (*c)(request &)) : method(m), pattern(p), co(c) {}
+#endif
+	constexpr route(string_view m, string_view p, int (*f)(request &)) : method(m), pattern(p), fn(f) {}
+
+	constexpr bool matches(string_view m, string_view path) const {
+		if (!method.empty() && method != m) return false;
+		if (!pattern.empty() && pattern.back() == '*') {
+			return path.substr(0, pattern.size() - 1) == pattern.substr(0, pattern.size() - 1);
+		}
+		return path == pattern;
+	}
+
+	int run(request &r) const {
+#if defined(__cpp_impl_coroutine)
+		if (co) return co(r).wait();
+#endif
+		return fn(r);
+	}
+};
+
+template <size_t N> struct router {
+	std::array<route, N> routes;
+
+	constexpr const route *find(string_view method, string_view path) const {
+		for (const route &r : routes) {
+			if (r.matches(method, path)) return &r;
+		}
+		return nullptr;
+	}
+
+	int operator()(request &r) const {
+		const route *rt = find(r.method(), r.path());
+		if (!rt) {
+			response(r, 404).content_type("text/plain").write("Not Found");
+			return UWSGI_OK;
+		}
+		return rt->run(r);
+	}
+};
+
+template <class... R> constexpr auto make_router(R... r) {
+	return router<sizeof...(R)>{{{r...}}};
+}
+
+/*
+	the plugin request hook: parse the vars and run the handler,
+	exceptions are logged and turned in a 500 (if the headers are not sent)
+*/
+template <class H> int dispatch(struct wsgi_request *wsgi_req, const H &handler) {
+	// empty request ?
+	if (!wsgi_req->len) {
+		uwsgi_log("Empty request. skip.\n");
+		return -1;
+	}
+	if (uwsgi_parse_vars(wsgi_req)) {
+		return -1;
+	}
+	request r(wsgi_req);
+	try {
+		return handler(r);
+	}
+	catch (const std::exception &e) {
+		uwsgi_log("[uwsgi-c++] unhandled exception: %s\n", e.what());
+	}
+	catch (...) {
+		uwsgi_log("[uwsgi-c++] unhandled exception\n");
+	}
+	if (!wsgi_req->headers_sent) {
+		response(r, 500).content_type("text/plain").write("Internal Server Error");
+	}
+	return UWSGI_OK;
+}
+
+}
+
+#endif
@@ -1,6 +1,6 @@
 NAME = 'cplusplus'
 
-CFLAGS = []
+CFLAGS = ['-std=gnu++20']
 LDFLAGS = []
 LIBS = ['-lstdc++']
-GCC_LIST = ['base.cc', 'plugin']
+GCC_LIST = ['base.cc']
@@ -10,6 +10,9 @@
 static struct uwsgi_fastrouter {
 	struct uwsgi_corerouter cr;
 	char *force_key;
+	struct uwsgi_string_list *vars;
+	// the serialized extra vars, appended to each request
+	struct uwsgi_buffer *vars_buf;
 } ufr;
 
 extern struct uwsgi_server uwsgi;
@@ -19,12 +22,16 @@ struct fastrouter_session {
 	int has_key;
 	uint64_t content_length;
 	uint64_t buffered;
+	// where the extra vars go in the forwarded packet (0: no extra vars)
+	size_t vars_at;
 };
 
 static struct uwsgi_option fastrouter_options[] = {
 	{"fastrouter", required_argument, 0, "run the fastrouter on the specified port", uwsgi_opt_corerouter, &ufr, 0},
 	{"fastrouter-processes", required_argument, 0, "prefork the specified number of fastrouter processes", uwsgi_opt_set_int, &ufr.cr.processes, 0},
 	{"fastrouter-workers", required_argument, 0, "prefork the specified number of fastrouter processes", uwsgi_opt_set_int, &ufr.cr.processes, 0},
+	{"fastrouter-reuse-port", no_argument, 0, "give each fastrouter process its own SO_REUSEPORT listener", uwsgi_opt_true, &ufr.cr.reuse_port, 0},
+	{"fastrouter-prealloc", required_argument, 0, "preallocate the specified number of sessions (with their peers and buffers) in each fastrouter process", uwsgi_opt_set_64bit, &ufr.cr.prealloc, 0},
 	{"fastrouter-zerg", required_argument, 0, "attach the fastrouter to a zerg server", uwsgi_opt_corerouter_zerg, &ufr, 0},
 	{"fastrouter-use-cache", optional_argument, 0, "use uWSGI cache as hostname->server mapper for the fastrouter", uwsgi_opt_set_str, &ufr.cr.use_cache, 0},
 
@@ -44,6 +51,11 @@ static struct uwsgi_option fastrouter_options[] = {
 	{"fastrouter-subscription-slot", required_argument, 0, "*** deprecated ***", uwsgi_opt_deprecated, (void *) "useless thanks to the new implementation", 0},
 
 	{"fastrouter-timeout", required_argument, 0, "set fastrouter timeout", uwsgi_opt_set_int, &ufr.cr.socket_timeout, 0},
+	{"fastrouter-backend-pool", required_argument, 0, "reuse connections to persistent uwsgi (--puwsgi-socket) backends, keeping up to the specified number of idle ones per backend", uwsgi_opt_set_int, &ufr.cr.backend_pool, 0},
+	{"fastrouter-backend-mux", no_argument, 0, "send requests to persistent uwsgi (--puwsgi-socket) backends using the multiplexed framing (implies --fastrouter-backend-pool 8)", uwsgi_opt_true, &ufr.cr.backend_mux, 0},
+	{"fastrouter-adaptive-limit", required_argument, 0, "limit the requests in flight to each backend with a concurrency limit adapted to its latency (up to the specified value)", uwsgi_opt_set_int, &ufr.cr.adaptive_limit, 0},
+	{"fastrouter-adaptive-limit-queue", required_argument, 0, "let the specified number of requests per backend wait for a free slot of the adaptive concurrency limit (up to --fastrouter-timeout), the others get a 503", uwsgi_opt_set_int, &ufr.cr.adaptive_limit_queue, 0},
+	{"fastrouter-handoff", no_argument, 0, "pass the client connections to backends bound to UNIX sockets (--uwsgi-handoff-socket) instead of proxying them", uwsgi_opt_true, &ufr.cr.handoff, 0},
 	{"fastrouter-post-buffering", required_argument, 0, "enable fastrouter post buffering", uwsgi_opt_set_64bit, &ufr.cr.post_buffering, 0},
 	{"fastrouter-post-buffering-dir", required_argument, 0, "put fastrouter buffered files to the specified directory (noop, use TMPDIR env)", uwsgi_opt_set_str, &ufr.cr.pb_base_dir, 0},
 
@@ -56,11 +68,20 @@ static struct uwsgi_option fastrouter_options[] = {
         {"fastrouter-gid", required_argument, 0, "drop fastrouter privileges to the specified gid", uwsgi_opt_gid, &ufr.cr.gid, 0 },
 	{"fastrouter-resubscribe", required_argument, 0, "forward subscriptions to the specified subscription server", uwsgi_opt_add_string_list, &ufr.cr.resubscribe, 0},
 	{"fastrouter-resubscribe-bind", required_argument, 0, "bind to the specified address when re-subscribing", uwsgi_opt_set_str, &ufr.cr.resubscribe_bind, 0},
+	{"fastrouter-subscriptions-snapshot", required_argument, 0, "periodically dump the subscriptions table to the specified file and reload it on startup", uwsgi_opt_set_str, &ufr.cr.subscriptions_snapshot, 0},
+	{"fastrouter-subscriptions-snapshot-freq", required_argument, 0, "set the interval (in seconds) of subscriptions snapshot dumps (default 10)", uwsgi_opt_set_int, &ufr.cr.subscriptions_snapshot_freq, 0},
+	{"fastrouter-subscription-peer", required_argument, 0, "on startup bootstrap the subscriptions table from the specified peer subscription server", uwsgi_opt_add_string_list, &ufr.cr.subscription_peers, 0},
 
 	{"fastrouter-buffer-size", required_argument, 0, "set internal buffer size (default: page size)", uwsgi_opt_set_64bit, &ufr.cr.buffer_size, 0},
+	{"fastrouter-splice", no_argument, 0, "forward request bodies and responses with splice() without copying them in user space (Linux only)", uwsgi_opt_true, &ufr.cr.splice, 0},
+	{"fastrouter-batch-events", no_argument, 0, "apply the changes of the fastrouter event interests in a batch before waiting (epoll only)", uwsgi_opt_true, &ufr.cr.defer_events, 0},
+	{"fastrouter-edge-triggered", no_argument, 0, "use edge-triggered events for the fastrouter peers (epoll only, implies batched events)", uwsgi_opt_true, &ufr.cr.edge_triggered, 0},
+	{"fastrouter-ratelimit", required_argument, 0, "close the connections of the clients over the specified rate limiter (--ratelimit), keyed by their address", uwsgi_opt_set_str, &ufr.cr.ratelimit_name, 0},
+	{"fastrouter-chash-key", required_argument, 0, "use the specified request var (e.g. REQUEST_URI or HTTP_X_USER) as the key of the chash subscription algo", uwsgi_opt_set_str, &ufr.cr.chash_key, 0},
 	{"fastrouter-fallback-on-no-key", no_argument, 0, "move to fallback node even if a subscription key is not found", uwsgi_opt_true, &ufr.cr.fallback_on_no_key, 0},
 
 	{"fastrouter-force-key", required_argument, 0, "skip uwsgi parsing and directly set a key", uwsgi_opt_set_str, &ufr.force_key, 0},
+	{"fastrouter-var", required_argument, 0, "add a key=value item to the forwarded uwsgi packet", uwsgi_opt_add_string_list, &ufr.vars, 0},
 	UWSGI_END_OF_OPTIONS
 };
 
@@ -70,6 +91,12 @@ static void fr_get_hostname(char *key, uint16_t keylen, char *val, uint16_t vall
 	struct fastrouter_session *fr = (struct fastrouter_session *) peer->session;
 
 	//uwsgi_log("%.*s = %.*s\n", keylen, key, vallen, val);
+	// affinity key for the chash subscription algo
+	if (ufr.cr.chash_key && !uwsgi_strncmp(ufr.cr.chash_key, strlen(ufr.cr.chash_key), key, keylen)) {
+		peer->chash_key = val;
+		peer->chash_key_len = vallen;
+	}
+
 	if (!uwsgi_strncmp("SERVER_NAME", 11, key, keylen) && !peer->key_len) {
 		if (vallen <= 0xff) {
 			memcpy(peer->key, val, vallen);
@@ -109,6 +136,23 @@ static void fr_get_hostname(char *key, uint16_t keylen, char *val, uint16_t vall
                 return;
         }
 
+	if (ufr.cr.backend_pool) {
+		// HEAD responses have no body
+		if (!uwsgi_strncmp("REQUEST_METHOD", 14, key, keylen) && !uwsgi_strncmp("HEAD", 4, val, vallen)) {
+			peer->pool_no_body = 1;
+			peer->pool_no_reuse = 1;
+		}
+		// the body is streamed from the client, the backend could still be waiting for it
+		else if (!uwsgi_strncmp("CONTENT_LENGTH", 14, key, keylen) && uwsgi_str_num(val, vallen) > 0) {
+			peer->pool_no_reuse = 1;
+		}
+	}
+
+	// upgraded connections are not framed
+	if (ufr.cr.backend_mux && !uwsgi_strncmp("HTTP_UPGRADE", 12, key, keylen)) {
+		peer->mux_disabled = 1;
+	}
+
 	if (ufr.cr.post_buffering > 0) {
 		if (!uwsgi_strncmp("CONTENT_LENGTH", 14, key, keylen)) {
 			fr->content_length = uwsgi_str_num(val, vallen);
@@ -126,6 +170,7 @@ static ssize_t fr_instance_write_body(struct corerouter_peer *peer) {
         if (cr_write_complete(peer)) {
                 // reset the original read buffer
                 peer->out->pos = 0;
+		if (peer->mux) peer->session->main_peer->in->pos = 0;
                 cr_reset_hooks(peer);
         }
 
@@ -138,10 +183,17 @@ static ssize_t fr_read_body(struct corerouter_peer *main_peer) {
 	ssize_t len = cr_read(main_peer, "fr_read_body()");
         if (!len) return 0;
 
-        main_peer->session->peers->out = main_peer->in;
-        main_peer->session->peers->out_pos = 0;
+	struct corerouter_peer *peer = main_peer->session->peers;
+	if (peer->mux) {
+		peer->out = uwsgi_cr_mux_body(peer, main_peer->in);
+		if (!peer->out) return -1;
+	}
+	else {
+		peer->out = main_peer->in;
+	}
+        peer->out_pos = 0;
 
-        cr_write_to_backend(main_peer->session->peers, fr_instance_write_body);
+        cr_write_to_backend(peer, fr_instance_write_body);
         return len;	
 }
 
@@ -155,6 +207,7 @@ static ssize_t fr_write(struct corerouter_peer *main_peer) {
         if (cr_write_complete(main_peer)) {
                 // reset the original read buffer
                 main_peer->out->pos = 0;
+		if (main_peer->session->wait_full_write) return 0;
                 cr_reset_hooks(main_peer);
         }
 
@@ -191,26 +244,73 @@ static ssize_t fr_instance_sendfile(struct corerouter_peer *peer) {
 	return len;
 }
 
+static int fr_instance_request_sent(struct corerouter_peer *peer) {
+	// reset the original read buffer
+	peer->out->pos = 0;
+	if (!peer->session->main_peer->is_buffering) {
+		// start waiting for body
+		peer->session->main_peer->last_hook_read = fr_read_body;
+		if (ufr.cr.splice && !peer->mux && !uwsgi_cr_splice_init(peer->session->main_peer)) {
+			peer->session->main_peer->last_hook_read = uwsgi_cr_splice_read;
+		}
+		cr_reset_hooks(peer);
+	}
+	else {
+		peer->hook_write = fr_instance_sendfile;
+		// stop reading from the client
+		peer->session->main_peer->last_hook_read = NULL;
+	}
+	return 0;
+}
+
+// send the client packet with the extra vars between the vars and the (buffered) body, without copying it
+static ssize_t fr_instance_send_request_vars(struct corerouter_peer *peer) {
+	struct fastrouter_session *fr = (struct fastrouter_session *) peer->session;
+	struct iovec iov[3];
+	char *base[3] = { peer->out->buf, ufr.vars_buf->buf, peer->out->buf + fr->vars_at };
+	size_t chunk[3] = { fr->vars_at, ufr.vars_buf->pos, peer->out->pos - fr->vars_at };
+	size_t skip = peer->out_pos;
+	int i, cnt = 0;
+	for (i = 0; i < 3; i++) {
+		if (skip >= chunk[i]) {
+			skip -= chunk[i];
+			continue;
+		}
+		iov[cnt].iov_base = base[i] + skip;
+		iov[cnt].iov_len = chunk[i] - skip;
+		skip = 0;
+		cnt++;
+	}
+
+	ssize_t len = writev(peer->fd, iov, cnt);
+	if (len < 0) {
+		cr_try_again;
+		uwsgi_cr_error(peer, "fr_instance_send_request_vars()");
+		return -1;
+	}
+	if (peer->un) peer->un->rx += len;
+	peer->out_pos += len;
+	if (!len) return 0;
+
+	if (peer->out_pos == peer->out->pos + ufr.vars_buf->pos) {
+		if (fr_instance_request_sent(peer)) return -1;
+	}
+
+	return len;
+}
+
 // send the uwsgi request header and vars
 static ssize_t fr_instance_send_request(struct corerouter_peer *peer) {
+	struct fastrouter_session *fr = (struct fastrouter_session *) peer->session;
+	if (fr->vars_at) return fr_instance_send_request_vars(peer);
+
 	ssize_t len = cr_write(peer, "fr_instance_send_request()");
         // end on empty write
         if (!len) return 0;
 
         // the chunk has been sent, start (again) reading from client and instances
         if (cr_write_complete(peer)) {
-                // reset the original read buffer
-                peer->out->pos = 0;
-		if (!peer->session->main_peer->is_buffering) {
-			// start waiting for body
-			peer->session->main_peer->last_hook_read = fr_read_body;
-                	cr_reset_hooks(peer);
-		}
-		else {
-			peer->hook_write = fr_instance_sendfile;
-			// stop reading from the client
-			peer->session->main_peer->last_hook_read = NULL;
-		}
+		if (fr_instance_request_sent(peer)) return -1;
         }
 
 	return len;
@@ -224,6 +324,11 @@ static ssize_t fr_instance_connected(struct corerouter_peer *peer) {
 	// we are connected, we cannot retry anymore
 	peer->can_retry = 0;
 
+	// pooled responses need to be parsed
+	if (ufr.cr.splice && !peer->pool_tracking && !peer->mux && !uwsgi_cr_splice_init(peer)) {
+		peer->last_hook_read = uwsgi_cr_splice_read;
+	}
+
 	// fix modifiers
 	peer->in->buf[0] = peer->modifier1;
 	peer->in->buf[3] = peer->modifier2;
@@ -349,7 +454,33 @@ done:
 			new_peer = main_peer->session->peers;
 		}
 
+		// the client packet is forwarded as is, only its size is fixed for the extra vars
+		if (ufr.vars_buf) {
+			if (pktsize + ufr.vars_buf->pos > 0xffff) return -1;
+			uh = (struct uwsgi_header *) main_peer->in->buf;
+			uh->_pktsize = pktsize + ufr.vars_buf->pos;
+			// handoff and multiplexing need the whole packet in a single buffer
+			if ((ufr.cr.handoff && !main_peer->is_buffering) || (ufr.cr.backend_mux && !new_peer->mux_disabled && !main_peer->is_buffering)) {
+				if (uwsgi_buffer_insert(main_peer->in, pktsize + 4, ufr.vars_buf->buf, ufr.vars_buf->pos)) return -1;
+			}
+			else {
+				fr->vars_at = pktsize + 4;
+			}
+		}
+
+		// pass the client connection to the backend (bodies buffered on disk are proxied)
+		if (ufr.cr.handoff && !main_peer->is_buffering) {
+			int ret = uwsgi_cr_handoff(new_peer, main_peer->in);
+			if (ret <= 0) return ret;
+		}
+
 		new_peer->can_retry = 1;
+		// multiplexed backends frame the response (bodies buffered on disk are sent with sendfile())
+		if (ufr.cr.backend_mux && !new_peer->mux_disabled && !main_peer->is_buffering) {
+			if (uwsgi_cr_mux_request(new_peer, main_peer->in)) return -1;
+		}
+		// track the response framing of persistent backends
+		else if (ufr.cr.backend_pool) new_peer->pool_tracking = 1;
 
 		cr_connect(new_peer, fr_instance_connected);
 	}
@@ -374,6 +505,17 @@ static ssize_t fr_recv_uwsgi_header(struct corerouter_peer *main_peer) {
 	return len;
 }
 
+// the backend is over its concurrency limit (the webserver parses the response as the one of a backend)
+static int fr_shed(struct corerouter_peer *peer) {
+	peer->in->pos = 0;
+	if (uwsgi_buffer_append(peer->in, "HTTP/1.1 503 Service Unavailable\r\nConnection: close\r\nContent-Length: 0\r\n\r\n", 74)) return -1;
+	peer->session->wait_full_write = 1;
+	peer->session->main_peer->out = peer->in;
+	peer->session->main_peer->out_pos = 0;
+	cr_write_to_main(peer, fr_write);
+	return 0;
+}
+
 // retry connection to the backend
 static int fr_retry(struct corerouter_peer *peer) {
 
@@ -400,6 +542,7 @@ retry:
 static int fastrouter_alloc_session(struct uwsgi_corerouter *ucr, struct uwsgi_gateway_socket *ugs, struct corerouter_session *cs, struct sockaddr *sa, socklen_t s_len) {
 	// set the retry hook
 	cs->retry = fr_retry;
+	cs->shed = fr_shed;
 	// wait for requests...
 	if (uwsgi_cr_set_hooks(cs->main_peer, fr_recv_uwsgi_header, NULL)) return -1;
 	return 0;
@@ -408,6 +551,19 @@ static int fastrouter_alloc_session(struct uwsgi_corerouter *ucr, struct uwsgi_g
 static int fastrouter_init() {
 
 	ufr.cr.session_size = sizeof(struct fastrouter_session);
+
+	struct uwsgi_string_list *usl = ufr.vars;
+	while (usl) {
+		char *equal = strchr(usl->value, '=');
+		if (!equal) {
+			uwsgi_log("invalid fastrouter var: %s (syntax: key=value)\n", usl->value);
+			exit(1);
+		}
+		if (!ufr.vars_buf) ufr.vars_buf = uwsgi_buffer_new(uwsgi.page_size);
+		if (uwsgi_buffer_append_keyval(ufr.vars_buf, usl->value, equal - usl->value, equal + 1, strlen(equal + 1))) exit(1);
+		usl = usl->next;
+	}
+
 	ufr.cr.alloc_session = fastrouter_alloc_session;
 	uwsgi_corerouter_init((struct uwsgi_corerouter *) &ufr);
 
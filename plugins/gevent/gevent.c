@@ -21,6 +21,8 @@ static struct uwsgi_option gevent_options[] = {
         {"gevent-monkey-patch", no_argument, 0, "call gevent.monkey.patch_all() automatically on startup", uwsgi_opt_true, &ugevent.monkey, 0},
         {"gevent-early-monkey-patch", no_argument, 0, "call gevent.monkey.patch_all() automatically before app loading", uwsgi_opt_true, &ugevent.early_monkey, 0},
         {"gevent-wait-for-hub", no_argument, 0, "wait for gevent hub's death instead of the control greenlet", uwsgi_opt_true, &ugevent.wait_for_hub, 0},
+        {"gevent-reuse-greenlets", no_argument, 0, "run the requests of each async core in a persistent greenlet instead of spawning a new one every time (greenlet-local storage survives requests)", uwsgi_opt_true, &ugevent.reuse_greenlets, 0},
+        {"gevent-no-watchers-cache", no_argument, 0, "create new gevent watchers at every wait instead of reusing the ones of the core", uwsgi_opt_true, &ugevent.no_watchers_cache, 0},
         {0, 0, 0, 0, 0, 0, 0},
 
 };
@@ -242,6 +244,29 @@ edge:
                 set_harakiri(wsgi_req, uwsgi.harakiri_options.workers);
         }
 
+	if (ugevent.reuse_greenlets) {
+		struct uwsgi_gevent_core *ugc = &ugevent.cores[wsgi_req->async_id];
+		if (ugc->pooled) {
+			// wake up the greenlet waiting on the core (from the next loop iteration)
+			PyObject *cb = PyObject_CallFunctionObjArgs(ugevent.run_callback, ugc->greenlet_switch, NULL);
+			if (cb) {
+				Py_DECREF(cb);
+			}
+			else {
+				PyErr_Print();
+			}
+			goto next;
+		}
+		PyObject *core_args = PyTuple_New(2);
+		Py_INCREF(ugevent.core_greenlet);
+		PyTuple_SetItem(core_args, 0, ugevent.core_greenlet);
+		PyTuple_SetItem(core_args, 1, PyLong_FromLong((long)wsgi_req));
+		PyObject *new_gl = python_call(ugevent.spawn, core_args, 0, NULL);
+		Py_XDECREF(new_gl);
+		Py_DECREF(core_args);
+		goto next;
+	}
+
 	// hack to easily pass wsgi_req pointer to the greenlet
 	PyTuple_SetItem(ugevent.greenlet_args, 1, PyLong_FromLong((long)wsgi_req));
 
@@ -249,6 +274,8 @@ edge:
 	PyObject *new_gl = python_call(ugevent.spawn, ugevent.greenlet_args, 0, NULL);
 	Py_DECREF(new_gl);
 
+next:
+
 	if (uwsgi_sock->edge_trigger) {
 #ifdef UWSGI_DEBUG
 		uwsgi_log("i am an edge triggered socket !!!\n");
@@ -266,16 +293,7 @@ void start_watcher(int i, struct uwsgi_socket* uwsgi_sock) {
         PyObject_CallMethod(ugevent.watchers[i], "start", "Oli", uwsgi_gevent_main,(long)uwsgi_sock, i);
 }
 
-PyObject *py_uwsgi_gevent_request(PyObject * self, PyObject * args) {
-
-	PyObject *py_wsgi_req = PyTuple_GetItem(args, 0);
-	struct wsgi_request *wsgi_req = (struct wsgi_request *) PyLong_AsLong(py_wsgi_req);
-
-	PyObject *greenlet_switch = NULL;
-
-	PyObject *current_greenlet = GET_CURRENT_GREENLET;
-	// another hack to retrieve the current wsgi_req;
-	PyObject_SetAttrString(current_greenlet, "uwsgi_wsgi_req", py_wsgi_req);
+static void gevent_run_request(struct wsgi_request *wsgi_req) {
 
 	// if in edge-triggered mode read from socket now !!!
 	if (wsgi_req->socket->edge_trigger) {
@@ -286,8 +304,6 @@ PyObject *py_uwsgi_gevent_request(PyObject * self, PyObject * args) {
 		goto request;
 	}
 
-	greenlet_switch = PyObject_GetAttrString(current_greenlet, "switch");
-
 	for(;;) {
 		int ret = uwsgi.wait_read_hook(wsgi_req->fd, uwsgi.socket_timeout);
                 wsgi_req->switches++;
@@ -323,12 +339,6 @@ request:
 	}
 
 end:
-	if (greenlet_switch) {
-		Py_DECREF(greenlet_switch);
-	}
-
-	Py_DECREF(current_greenlet);
-
 	uwsgi_close_request(wsgi_req);
 	free_req_queue;
 
@@ -365,14 +375,73 @@ end:
                         Py_DECREF(py_watcher_active);
                 }
         }
+}
+
+PyObject *py_uwsgi_gevent_request(PyObject * self, PyObject * args) {
+
+	PyObject *py_wsgi_req = PyTuple_GetItem(args, 0);
+	struct wsgi_request *wsgi_req = (struct wsgi_request *) PyLong_AsLong(py_wsgi_req);
+
+	PyObject *current_greenlet = GET_CURRENT_GREENLET;
+	// another hack to retrieve the current wsgi_req;
+	PyObject_SetAttrString(current_greenlet, "uwsgi_wsgi_req", py_wsgi_req);
+	Py_DECREF(current_greenlet);
+
+	gevent_run_request(wsgi_req);
 
 	Py_INCREF(Py_None);
 	return Py_None;
+}
+
+/*
+	pooled greenlet (--gevent-reuse-greenlets): it is spawned for the first request of a core,
+	then it waits in the hub for the main greenlet to assign it the next one
+*/
+PyObject *py_uwsgi_gevent_core(PyObject * self, PyObject * args) {
+
+	PyObject *py_wsgi_req = PyTuple_GetItem(args, 0);
+	struct wsgi_request *wsgi_req = (struct wsgi_request *) PyLong_AsLong(py_wsgi_req);
+	struct uwsgi_gevent_core *ugc = &ugevent.cores[wsgi_req->async_id];
+
+	PyObject *current_greenlet = GET_CURRENT_GREENLET;
+	// the wsgi_req of a core never changes
+	PyObject_SetAttrString(current_greenlet, "uwsgi_wsgi_req", py_wsgi_req);
 
+	Py_XDECREF(ugc->greenlet);
+	Py_XDECREF(ugc->greenlet_switch);
+	ugc->greenlet = current_greenlet;
+	ugc->greenlet_switch = PyObject_GetAttrString(current_greenlet, "switch");
+	if (!ugc->greenlet_switch) {
+		Py_CLEAR(ugc->greenlet);
+		gevent_run_request(wsgi_req);
+		goto end;
+	}
+	ugc->pooled = 1;
+
+	for(;;) {
+		gevent_run_request(wsgi_req);
+		if (uwsgi.workers[uwsgi.mywid].manage_next_request == 0) break;
+		PyObject *ret = PyObject_CallMethod(ugevent.hub, "switch", NULL);
+		if (!ret) {
+			// killed while waiting, give up the core unless a request has already been assigned to it
+			PyErr_Clear();
+			if (!uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].in_request) break;
+			continue;
+		}
+		Py_DECREF(ret);
+	}
+
+	ugc->pooled = 0;
+	Py_CLEAR(ugc->greenlet_switch);
+	Py_CLEAR(ugc->greenlet);
+end:
+	Py_INCREF(Py_None);
+	return Py_None;
 }
 
 PyMethodDef uwsgi_gevent_main_def[] = { {"uwsgi_gevent_main", py_uwsgi_gevent_main, METH_VARARGS, ""} };
 PyMethodDef uwsgi_gevent_request_def[] = { {"uwsgi_gevent_request", py_uwsgi_gevent_request, METH_VARARGS, ""} };
+PyMethodDef uwsgi_gevent_core_def[] = { {"uwsgi_gevent_core", py_uwsgi_gevent_core, METH_VARARGS, ""} };
 PyMethodDef uwsgi_gevent_signal_def[] = { {"uwsgi_gevent_signal", py_uwsgi_gevent_signal, METH_VARARGS, ""} };
 PyMethodDef uwsgi_gevent_my_signal_def[] = { {"uwsgi_gevent_my_signal", py_uwsgi_gevent_my_signal, METH_VARARGS, ""} };
 PyMethodDef uwsgi_gevent_signal_handler_def[] = { {"uwsgi_gevent_signal_handler", py_uwsgi_gevent_signal_handler, METH_VARARGS, ""} };
@@ -482,6 +551,16 @@ static void gevent_loop() {
 	// pre-fill the greenlet args
 	ugevent.greenlet_args = PyTuple_New(2);
 	PyTuple_SetItem(ugevent.greenlet_args, 0, uwsgi_request_greenlet);
+
+	// watchers (and pooled greenlets) cache
+	ugevent.cores = uwsgi_calloc(sizeof(struct uwsgi_gevent_core) * uwsgi.async);
+
+	if (ugevent.reuse_greenlets) {
+		ugevent.core_greenlet = PyCFunction_New(uwsgi_gevent_core_def, NULL);
+		Py_INCREF(ugevent.core_greenlet);
+		ugevent.run_callback = PyObject_GetAttrString(ugevent.hub_loop, "run_callback");
+		if (!ugevent.run_callback) uwsgi_pyexit;
+	}
 		
 	if (uwsgi.signal_socket > -1) {
 		// and these are the watcher for signal sockets
@@ -38,6 +38,20 @@ int uwsgi_gevent_wait_milliseconds_hook(int);
 
 
 
+// per-core cache of the greenlet and of the watchers used by the wait hooks
+struct uwsgi_gevent_core {
+	PyObject *greenlet;
+	PyObject *greenlet_switch;
+	PyObject *watcher_read;
+	PyObject *watcher_write;
+	PyObject *timer;
+	int timer_timeout;
+	PyObject *ms_timer;
+	int ms_timer_timeout;
+	// the greenlet is a pooled one, waiting for requests
+	int pooled;
+};
+
 struct uwsgi_gevent {
         PyObject *greenlet_switch;
         PyObject *greenlet_switch_args;
@@ -57,5 +71,10 @@ struct uwsgi_gevent {
 	int monkey;
 	int wait_for_hub;
 	int early_monkey;
+	int reuse_greenlets;
+	int no_watchers_cache;
+	PyObject *core_greenlet;
+	PyObject *run_callback;
+	struct uwsgi_gevent_core *cores;
 };
 
@@ -3,71 +3,128 @@
 extern struct uwsgi_server uwsgi;
 extern struct uwsgi_gevent ugevent;
 
+/*
+	the wait hooks reuse the watchers (and the switch method) of the core
+	bound to the current greenlet, greenlets not bound to a core (signal handlers,
+	greenlets spawned by the app) get new ones at every call.
+
+	all of the returned objects are new references
+*/
+static struct uwsgi_gevent_core *gevent_current_core(PyObject **current_greenlet, PyObject **current) {
+	*current_greenlet = GET_CURRENT_GREENLET;
+	if (!*current_greenlet) return NULL;
+
+	if (ugevent.cores) {
+		PyObject *py_wsgi_req = PyObject_GetAttrString(*current_greenlet, "uwsgi_wsgi_req");
+		if (py_wsgi_req) {
+			struct wsgi_request *wsgi_req = (struct wsgi_request *) PyLong_AsLong(py_wsgi_req);
+			Py_DECREF(py_wsgi_req);
+			struct uwsgi_gevent_core *ugc = &ugevent.cores[wsgi_req->async_id];
+			if (ugc->greenlet != *current_greenlet) {
+				PyObject *gl_switch = PyObject_GetAttrString(*current_greenlet, "switch");
+				if (!gl_switch) goto fallback;
+				Py_XDECREF(ugc->greenlet);
+				Py_XDECREF(ugc->greenlet_switch);
+				Py_INCREF(*current_greenlet);
+				ugc->greenlet = *current_greenlet;
+				ugc->greenlet_switch = gl_switch;
+			}
+			Py_INCREF(ugc->greenlet_switch);
+			*current = ugc->greenlet_switch;
+			return ugc;
+		}
+fallback:
+		PyErr_Clear();
+	}
+
+	*current = PyObject_GetAttrString(*current_greenlet, "switch");
+	if (!*current) {
+		Py_DECREF(*current_greenlet);
+		*current_greenlet = NULL;
+	}
+	return NULL;
+}
 
-int uwsgi_gevent_wait_write_hook(int fd, int timeout) {
-
-        PyObject *ret = NULL;
-
-        /// create a watcher for writes
-        PyObject *watcher = PyObject_CallMethod(ugevent.hub_loop, "io", "ii", fd, 2);
-        if (!watcher) return -1;
-
-        PyObject *timer = PyObject_CallMethod(ugevent.hub_loop, "timer", "i", timeout);
-        if (!timer) {
-                Py_DECREF(watcher);
-		return -1;
-        }
-
-        PyObject *current_greenlet = GET_CURRENT_GREENLET;
-        PyObject *current = PyObject_GetAttrString(current_greenlet, "switch");
-
-        ret = PyObject_CallMethod(watcher, "start", "OO", current, watcher);
-        if (!ret) {
-                stop_the_watchers_and_clear
-		return -1;
-        }
-        Py_DECREF(ret);
-
-        ret = PyObject_CallMethod(timer, "start", "OO", current, timer);
-        if (!ret) {
-                stop_the_watchers_and_clear
-		return -1;
-        }
-        Py_DECREF(ret);
-
-        ret = PyObject_CallMethod(ugevent.hub, "switch", NULL);
-        if (!ret) {
-                stop_the_watchers_and_clear
-		return -1;
-        }
-        Py_DECREF(ret);
+static PyObject *gevent_core_io(struct uwsgi_gevent_core *ugc, int fd, int events) {
+	if (!ugc || ugevent.no_watchers_cache) {
+		return PyObject_CallMethod(ugevent.hub_loop, "io", "ii", fd, events);
+	}
+
+	PyObject **watcher = events == 1 ? &ugc->watcher_read : &ugc->watcher_write;
+	if (*watcher) {
+		// always re-set the fd (even if it is the same number it could be a different file)
+		PyObject *py_fd = PyInt_FromLong(fd);
+		int ret = PyObject_SetAttrString(*watcher, "fd", py_fd);
+		Py_DECREF(py_fd);
+		if (ret) {
+			// this gevent loop does not allow changing the fd of a watcher
+			PyErr_Clear();
+			Py_CLEAR(*watcher);
+			ugevent.no_watchers_cache = 1;
+			uwsgi_log_verbose("gevent io watchers cannot be reused, disabling the cache\n");
+			return PyObject_CallMethod(ugevent.hub_loop, "io", "ii", fd, events);
+		}
+	}
+	else {
+		*watcher = PyObject_CallMethod(ugevent.hub_loop, "io", "ii", fd, events);
+		if (!*watcher) return NULL;
+	}
+	Py_INCREF(*watcher);
+	return *watcher;
+}
 
-        if (ret == timer) {
-		stop_the_watchers_and_clear;
-                return 0;
-        }
+static PyObject *gevent_core_timer(struct uwsgi_gevent_core *ugc, int timeout) {
+	if (!ugc) {
+		return PyObject_CallMethod(ugevent.hub_loop, "timer", "i", timeout);
+	}
+
+	if (!ugc->timer || ugc->timer_timeout != timeout) {
+		Py_CLEAR(ugc->timer);
+		ugc->timer = PyObject_CallMethod(ugevent.hub_loop, "timer", "i", timeout);
+		if (!ugc->timer) return NULL;
+		ugc->timer_timeout = timeout;
+	}
+	Py_INCREF(ugc->timer);
+	return ugc->timer;
+}
 
-        stop_the_watchers_and_clear;
-	return 1;
+static PyObject *gevent_core_ms_timer(struct uwsgi_gevent_core *ugc, int timeout) {
+	if (!ugc) {
+		return PyObject_CallMethod(ugevent.hub_loop, "timer", "f", ((double) timeout)/1000.0);
+	}
+
+	if (!ugc->ms_timer || ugc->ms_timer_timeout != timeout) {
+		Py_CLEAR(ugc->ms_timer);
+		ugc->ms_timer = PyObject_CallMethod(ugevent.hub_loop, "timer", "f", ((double) timeout)/1000.0);
+		if (!ugc->ms_timer) return NULL;
+		ugc->ms_timer_timeout = timeout;
+	}
+	Py_INCREF(ugc->ms_timer);
+	return ugc->ms_timer;
 }
 
-int uwsgi_gevent_wait_read_hook(int fd, int timeout) {
+static int gevent_wait_fd(int fd, int events, int timeout) {
 
         PyObject *ret = NULL;
+        PyObject *current = NULL;
+        PyObject *current_greenlet = NULL;
+
+        struct uwsgi_gevent_core *ugc = gevent_current_core(&current_greenlet, &current);
+        if (!current_greenlet) return -1;
 
-        /// create a watcher for writes
-        PyObject *watcher = PyObject_CallMethod(ugevent.hub_loop, "io", "ii", fd, 1);
-        if (!watcher) return -1;
+        PyObject *watcher = gevent_core_io(ugc, fd, events);
+        if (!watcher) {
+                Py_DECREF(current); Py_DECREF(current_greenlet);
+                return -1;
+        }
 
-        PyObject *timer = PyObject_CallMethod(ugevent.hub_loop, "timer", "i", timeout);
+        PyObject *timer = gevent_core_timer(ugc, timeout);
         if (!timer) {
+                Py_DECREF(current); Py_DECREF(current_greenlet);
                 Py_DECREF(watcher);
                 return -1;
         }
 
-        PyObject *current_greenlet = GET_CURRENT_GREENLET;
-        PyObject *current = PyObject_GetAttrString(current_greenlet, "switch");
-
         ret = PyObject_CallMethod(watcher, "start", "OO", current, watcher);
         if (!ret) {
                 stop_the_watchers_and_clear
@@ -98,15 +155,28 @@ int uwsgi_gevent_wait_read_hook(int fd, int timeout) {
         return 1;
 }
 
+int uwsgi_gevent_wait_write_hook(int fd, int timeout) {
+	return gevent_wait_fd(fd, 2, timeout);
+}
+
+int uwsgi_gevent_wait_read_hook(int fd, int timeout) {
+	return gevent_wait_fd(fd, 1, timeout);
+}
+
 int uwsgi_gevent_wait_milliseconds_hook(int timeout) {
 
         PyObject *ret = NULL;
+        PyObject *current = NULL;
+        PyObject *current_greenlet = NULL;
 
-        PyObject *timer = PyObject_CallMethod(ugevent.hub_loop, "timer", "f", ((double) timeout)/1000.0);
-        if (!timer) return -1;
+        struct uwsgi_gevent_core *ugc = gevent_current_core(&current_greenlet, &current);
+        if (!current_greenlet) return -1;
 
-        PyObject *current_greenlet = GET_CURRENT_GREENLET;
-        PyObject *current = PyObject_GetAttrString(current_greenlet, "switch");
+        PyObject *timer = gevent_core_ms_timer(ugc, timeout);
+        if (!timer) {
+                Py_DECREF(current); Py_DECREF(current_greenlet);
+                return -1;
+        }
 
         ret = PyObject_CallMethod(timer, "start", "OO", current, timer);
         if (!ret) {
@@ -134,6 +204,10 @@ int uwsgi_gevent_wait_milliseconds_hook(int timeout) {
                 return 0;
         }
 
+        // woken up by something else, stop the timer (it could be a cached one)
+        ret = PyObject_CallMethod(timer, "stop", NULL);
+        if (ret) { Py_DECREF(ret); }
+        Py_DECREF(current); Py_DECREF(current_greenlet);
+        Py_DECREF(timer);
         return -1;
 }
-
@@ -9,78 +9,271 @@ extern struct uwsgi_server uwsgi;
 
 	--glusterfs-mount mountpoint=/foo,server=192.168.173.13:24007;192.168.173.17:0,volfile=foo.vol;volume=unbit001
 
+	--glusterfs-cache <secs> keeps (per-worker) the opened fds and their stat for the specified number of seconds
+
+	files are read with up to --glusterfs-read-parallel outstanding async reads, the read size starts
+	small and doubles (up to --glusterfs-read-ahead) as the download proceeds, the same happens for
+	the number of outstanding reads, so small files do not pay for the big buffers
+
 */
 
 struct uwsgi_plugin glusterfs_plugin;
 
+/*
+	an opened file, shared by the cores of the worker
+	it is closed when it is no more in the cache and nobody is using it
+*/
+struct uwsgi_glusterfs_file {
+	glfs_t *volume;
+	char *path;
+	size_t path_len;
+	glfs_fd_t *fd;
+	struct stat st;
+	uint64_t expires;
+	int refs;
+	int cached;
+};
+
+/*
+	an async read, the uwsgi_glusterfs_aio structure is passed between threads
+	the callback simply signal the core about the availability of data
+*/
+struct uwsgi_glusterfs_aio {
+	char *buf;
+	size_t len;
+	ssize_t rlen;
+	// 0 while the read is in flight
+	int done;
+	// the core gave up (error or timeout), the callback frees the structure
+	int abandoned;
+	int pipe;
+};
+
+struct uwsgi_glusterfs_core {
+	int fd[2];
+	struct uwsgi_glusterfs_aio **ring;
+};
+
 struct uwsgi_glusterfs {
 	int timeout;
 	struct uwsgi_string_list *mountpoints;
+	int cache;
+	uint64_t cache_items;
+	int read_parallel;
+	uint64_t read_ahead;
+	struct uwsgi_glusterfs_file **files;
+	struct uwsgi_glusterfs_core *cores;
+	pthread_mutex_t lock;
 } uglusterfs;
 
 static struct uwsgi_option uwsgi_glusterfs_options[] = {
 	{"glusterfs-mount", required_argument, 0, "virtual mount the specified glusterfs volume in a uri", uwsgi_opt_add_string_list, &uglusterfs.mountpoints, UWSGI_OPT_MIME},
 	{"glusterfs-timeout", required_argument, 0, "timeout for glusterfs async mode", uwsgi_opt_set_int, &uglusterfs.timeout, 0},
+	{"glusterfs-cache", required_argument, 0, "cache opened fds and stat results for the specified number of seconds", uwsgi_opt_set_int, &uglusterfs.cache, 0},
+	{"glusterfs-cache-items", required_argument, 0, "set the max number of items of the glusterfs cache (default 1024)", uwsgi_opt_set_64bit, &uglusterfs.cache_items, 0},
+	{"glusterfs-read-parallel", required_argument, 0, "set the max number of outstanding reads for each request (default 4)", uwsgi_opt_set_int, &uglusterfs.read_parallel, 0},
+	{"glusterfs-read-ahead", required_argument, 0, "set the max size of each read (default 256k)", uwsgi_opt_set_64bit, &uglusterfs.read_ahead, 0},
         {0, 0, 0, 0, 0, 0, 0},
 };
 
+// the first read of a file, it is doubled at every chunk
+#define UWSGI_GLUSTERFS_MIN_READ 16384
+
+
+static void uwsgi_glusterfs_file_free(struct uwsgi_glusterfs_file *ugf) {
+	if (!ugf) return;
+	glfs_close(ugf->fd);
+	free(ugf->path);
+	free(ugf);
+}
+
+static struct uwsgi_glusterfs_file **uwsgi_glusterfs_file_slot(glfs_t *volume, char *path, size_t path_len) {
+	uint32_t hash = djb33x_hash(path, path_len) ^ (uint32_t) (uintptr_t) volume;
+	return &uglusterfs.files[hash % uglusterfs.cache_items];
+}
 
-static int uwsgi_glusterfs_read_sync(struct wsgi_request *wsgi_req, glfs_fd_t *fd, size_t remains) {
-	while(remains > 0) {
-        	char buf[8192];
-                ssize_t rlen = glfs_read (fd, buf, UMIN(remains, 8192), 0);
-                if (rlen <= 0) return -1;
-                if (uwsgi_response_write_body_do(wsgi_req, buf, rlen)) return -1;
-                remains -= rlen;
+// get an opened file (from the cache if possible), errno is set on failure
+static struct uwsgi_glusterfs_file *uwsgi_glusterfs_file_get(glfs_t *volume, char *path, size_t path_len) {
+	struct uwsgi_glusterfs_file *ugf = NULL;
+	if (uglusterfs.files) {
+		pthread_mutex_lock(&uglusterfs.lock);
+		ugf = *uwsgi_glusterfs_file_slot(volume, path, path_len);
+		if (ugf && ugf->volume == volume && !uwsgi_strncmp(ugf->path, ugf->path_len, path, path_len) && ugf->expires > (uint64_t) uwsgi_now()) {
+			ugf->refs++;
+			pthread_mutex_unlock(&uglusterfs.lock);
+			return ugf;
+		}
+		pthread_mutex_unlock(&uglusterfs.lock);
 	}
-	return 0;
+
+	glfs_fd_t *fd = glfs_open(volume, path, O_RDONLY);
+	if (!fd) return NULL;
+
+	ugf = uwsgi_calloc(sizeof(struct uwsgi_glusterfs_file));
+	ugf->volume = volume;
+	ugf->fd = fd;
+	ugf->refs = 1;
+	if (glfs_fstat(fd, &ugf->st)) {
+		glfs_close(fd);
+		free(ugf);
+		errno = EACCES;
+		return NULL;
+	}
+
+	if (!uglusterfs.files) return ugf;
+
+	ugf->path = uwsgi_strncopy(path, path_len);
+	ugf->path_len = path_len;
+	ugf->expires = uwsgi_now() + uglusterfs.cache;
+
+	// the old item could still be in use by other cores
+	struct uwsgi_glusterfs_file *old = NULL;
+	pthread_mutex_lock(&uglusterfs.lock);
+	struct uwsgi_glusterfs_file **slot = uwsgi_glusterfs_file_slot(volume, path, path_len);
+	if (*slot) {
+		(*slot)->cached = 0;
+		if (!(*slot)->refs) old = *slot;
+	}
+	*slot = ugf;
+	ugf->cached = 1;
+	pthread_mutex_unlock(&uglusterfs.lock);
+
+	uwsgi_glusterfs_file_free(old);
+	return ugf;
 }
 
-/*
-	async read of a resource
-	the uwsgi_glusterfs_async_io structure is passed between threads
-	the callback simply signal the main core about the availability of data
-*/
-struct uwsgi_glusterfs_async_io {
-	int fd[2];
-	ssize_t rlen;
-};
+// release a file, on errors the item is removed from the cache
+static void uwsgi_glusterfs_file_put(struct uwsgi_glusterfs_file *ugf, int invalidate) {
+	if (!uglusterfs.files) {
+		uwsgi_glusterfs_file_free(ugf);
+		return;
+	}
+	pthread_mutex_lock(&uglusterfs.lock);
+	ugf->refs--;
+	if (invalidate && ugf->cached) {
+		struct uwsgi_glusterfs_file **slot = uwsgi_glusterfs_file_slot(ugf->volume, ugf->path, ugf->path_len);
+		if (*slot == ugf) *slot = NULL;
+		ugf->cached = 0;
+	}
+	int destroy = !ugf->refs && !ugf->cached;
+	pthread_mutex_unlock(&uglusterfs.lock);
+	if (destroy) uwsgi_glusterfs_file_free(ugf);
+}
 
 static void uwsgi_glusterfs_read_async_cb(glfs_fd_t *fd, ssize_t rlen, void *data) {
-	struct uwsgi_glusterfs_async_io *aio = (struct uwsgi_glusterfs_async_io *) data;
+	struct uwsgi_glusterfs_aio *aio = (struct uwsgi_glusterfs_aio *) data;
 #ifdef UWSGI_DEBUG
 	uwsgi_log("[glusterfs-cb] rlen = %d\n", rlen);
 #endif
+	pthread_mutex_lock(&uglusterfs.lock);
+	if (aio->abandoned) {
+		pthread_mutex_unlock(&uglusterfs.lock);
+		free(aio->buf);
+		free(aio);
+		return;
+	}
 	aio->rlen = rlen;
+	aio->done = 1;
 	// signal the core
-	if (write(aio->fd[1], "\1", 1) <= 0) {
+	if (write(aio->pipe, "\1", 1) <= 0) {
 		uwsgi_error("uwsgi_glusterfs_read_async_cb()/write()");
 	}
+	pthread_mutex_unlock(&uglusterfs.lock);
 }
 
-static int uwsgi_glusterfs_read_async(struct wsgi_request *wsgi_req, glfs_fd_t *fd, size_t remains) {
-	char buf[8192];
-	struct uwsgi_glusterfs_async_io aio;
-	int ret = -1;
-	if (pipe(aio.fd)) {
-		uwsgi_error("uwsgi_glusterfs_read_async()/pipe()");
-		return -1;
+static int uwsgi_glusterfs_aio_done(struct uwsgi_glusterfs_aio *aio) {
+	pthread_mutex_lock(&uglusterfs.lock);
+	int done = aio->done;
+	pthread_mutex_unlock(&uglusterfs.lock);
+	return done;
+}
+
+/*
+	read a resource with a ring of async reads, the chunks are sent in order.
+	The same code is used in sync and async modes (wait_read_hook blocks or suspends the core)
+*/
+static int uwsgi_glusterfs_read(struct wsgi_request *wsgi_req, glfs_fd_t *fd, size_t total) {
+	struct uwsgi_glusterfs_core *ugc = &uglusterfs.cores[wsgi_req->async_id];
+	int n = uglusterfs.read_parallel;
+	int i;
+
+	if (ugc->fd[0] == -1) {
+		if (pipe(ugc->fd)) {
+			uwsgi_error("uwsgi_glusterfs_read()/pipe()");
+			return -1;
+		}
+		uwsgi_socket_nb(ugc->fd[0]);
+		ugc->ring = uwsgi_calloc(sizeof(struct uwsgi_glusterfs_aio *) * n);
+	}
+
+	// consume the signals of the previous (aborted) request
+	char acks[64];
+	while (read(ugc->fd[0], acks, 64) > 0);
+
+	uint64_t off = 0;
+	uint64_t sent = 0;
+	int head = 0;
+	int inflight = 0;
+	int window = 1;
+	size_t chunk = UMIN(UWSGI_GLUSTERFS_MIN_READ, uglusterfs.read_ahead);
+
+	while (sent < total) {
+		// keep the window full
+		while (inflight < window && off < total) {
+			int slot = (head + inflight) % n;
+			struct uwsgi_glusterfs_aio *aio = ugc->ring[slot];
+			if (!aio) {
+				aio = uwsgi_calloc(sizeof(struct uwsgi_glusterfs_aio));
+				aio->buf = uwsgi_malloc(uglusterfs.read_ahead);
+				aio->pipe = ugc->fd[1];
+				aio->done = 1;
+				ugc->ring[slot] = aio;
+			}
+			aio->len = UMIN(chunk, total - off);
+			aio->rlen = -1;
+			aio->done = 0;
+			if (glfs_pread_async(fd, aio->buf, aio->len, off, 0, uwsgi_glusterfs_read_async_cb, aio)) {
+				uwsgi_error("uwsgi_glusterfs_read()/glfs_pread_async()");
+				aio->done = 1;
+				goto abandon;
+			}
+			off += aio->len;
+			inflight++;
+		}
+
+		struct uwsgi_glusterfs_aio *aio = ugc->ring[head];
+		while (!uwsgi_glusterfs_aio_done(aio)) {
+			if (uwsgi.wait_read_hook(ugc->fd[0], uglusterfs.timeout) <= 0) goto abandon;
+			if (read(ugc->fd[0], acks, 64) < 0 && !uwsgi_is_again()) {
+				uwsgi_error("uwsgi_glusterfs_read()/read()");
+				goto abandon;
+			}
+		}
+		inflight--;
+		// short reads (the file has been truncated) are errors too
+		if (aio->rlen <= 0 || (size_t) aio->rlen != aio->len) goto abandon;
+		if (uwsgi_response_write_body_do(wsgi_req, aio->buf, aio->rlen)) goto abandon;
+		sent += aio->rlen;
+		head = (head + 1) % n;
+
+		// the download is going on, read more
+		if (chunk < uglusterfs.read_ahead) chunk = UMIN(chunk * 2, uglusterfs.read_ahead);
+		if (window < n) window++;
 	}
-	aio.rlen = -1;
-	while(remains > 0) {
-		// trigger an async read
-		if (glfs_read_async(fd, buf, 8192, 0, uwsgi_glusterfs_read_async_cb, &aio)) goto end;
-		// wait for the callback to be executed
-		if (uwsgi.wait_read_hook(aio.fd[0], uglusterfs.timeout) <= 0) goto end;
-		if (aio.rlen <= 0) goto end;	
-		if (uwsgi_response_write_body_do(wsgi_req, buf, aio.rlen)) goto end;
-		remains -= aio.rlen;
+	return 0;
+
+abandon:
+	// the outstanding reads cannot be cancelled, their callbacks will free the memory
+	pthread_mutex_lock(&uglusterfs.lock);
+	for (i = 0; i < n; i++) {
+		struct uwsgi_glusterfs_aio *aio = ugc->ring[i];
+		if (aio && !aio->done) {
+			aio->abandoned = 1;
+			ugc->ring[i] = NULL;
+		}
 	}
-	ret = 0;
-end:
-	close(aio.fd[0]);
-	close(aio.fd[1]);
-	return ret;	
+	pthread_mutex_unlock(&uglusterfs.lock);
+	return -1;
 }
 
 
@@ -202,6 +395,24 @@ static void uwsgi_glusterfs_setup() {
 	if (!uglusterfs.timeout) {
 		uglusterfs.timeout = uwsgi.socket_timeout;
 	}
+	if (!uglusterfs.cache_items) uglusterfs.cache_items = 1024;
+	if (!uglusterfs.read_parallel) uglusterfs.read_parallel = 4;
+	if (!uglusterfs.read_ahead) uglusterfs.read_ahead = 256 * 1024;
+
+	if (pthread_mutex_init(&uglusterfs.lock, NULL)) {
+		uwsgi_error("uwsgi_glusterfs_setup()/pthread_mutex_init()");
+		exit(1);
+	}
+	if (uglusterfs.cache > 0) {
+		uglusterfs.files = uwsgi_calloc(sizeof(struct uwsgi_glusterfs_file *) * uglusterfs.cache_items);
+	}
+	// pipes and buffers are allocated on first usage
+	int i;
+	uglusterfs.cores = uwsgi_calloc(sizeof(struct uwsgi_glusterfs_core) * uwsgi.cores);
+	for (i = 0; i < uwsgi.cores; i++) {
+		uglusterfs.cores[i].fd[0] = -1;
+		uglusterfs.cores[i].fd[1] = -1;
+	}
 
 	struct uwsgi_string_list *usl = uglusterfs.mountpoints;
 	while(usl) {
@@ -244,18 +455,27 @@ static int uwsgi_glusterfs_request(struct wsgi_request *wsgi_req) {
 	memcpy(filename, wsgi_req->path_info, wsgi_req->path_info_len);
 	filename[wsgi_req->path_info_len] = 0;
 
-	glfs_fd_t *fd = glfs_open((glfs_t *) ua->interpreter, filename, O_RDONLY);
-	if (!fd) {
-                uwsgi_404(wsgi_req);
+	struct uwsgi_glusterfs_file *ugf = uwsgi_glusterfs_file_get((glfs_t *) ua->interpreter, filename, wsgi_req->path_info_len);
+	if (!ugf) {
+		if (errno == EACCES) {
+			uwsgi_403(wsgi_req);
+		}
+		else {
+			uwsgi_404(wsgi_req);
+		}
                 return UWSGI_OK;
 	}
-	
-
-	struct stat st;
-	if (glfs_fstat(fd, &st)) {
-		uwsgi_403(wsgi_req);
-                return UWSGI_OK;
-	}	
+	int invalidate = 0;
+	struct stat st = ugf->st;
+
+	if (wsgi_req->if_modified_since_len) {
+		time_t ims = uwsgi_parse_http_date(wsgi_req->if_modified_since, wsgi_req->if_modified_since_len);
+		if (st.st_mtime <= ims) {
+			if (uwsgi_response_prepare_headers(wsgi_req, "304 Not Modified", 16)) goto end;
+			uwsgi_response_write_headers_do(wsgi_req);
+			goto end;
+		}
+	}
 
 	if (uwsgi_response_prepare_headers(wsgi_req, "200 OK", 6)) goto end;
 	size_t mime_type_len = 0;
@@ -270,16 +490,12 @@ static int uwsgi_glusterfs_request(struct wsgi_request *wsgi_req) {
 	// skip body on HEAD
 	if (uwsgi_strncmp(wsgi_req->method, wsgi_req->method_len, "HEAD", 4)) {
 		size_t remains = st.st_size;
-		if (uwsgi.async > 0) {
-			if (uwsgi_glusterfs_read_async(wsgi_req, fd, remains)) goto end;
-		}
-		else {
-			if (uwsgi_glusterfs_read_sync(wsgi_req, fd, remains)) goto end;
-		}
+		// the cached fd could be stale, do not reuse it
+		if (uwsgi_glusterfs_read(wsgi_req, ugf->fd, remains)) invalidate = 1;
 	}
 
 end:
-	glfs_close(fd);
+	uwsgi_glusterfs_file_put(ugf, invalidate);
 	return UWSGI_OK;
 }
 
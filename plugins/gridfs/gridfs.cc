@@ -5,12 +5,32 @@
 #include <uwsgi.h>
 
 #include <client/dbclient.h>
-#include <client/gridfs.h>
 
 /*
 	Thanks to WeirdCarrotMonster (https://github.com/WeirdCarrotMonster)
+
+	every core keeps its own (authenticated) connection, it is dropped on errors.
+
+	chunks are fetched with a single cursor returning prefetch=K (--gridfs-prefetch) chunks
+	for each round trip, Range requests are mapped to the chunk indexes.
+
+	cache=N (--gridfs-cache) keeps (per-worker) the metadata of the files for N seconds,
+	so If-None-Match (with etag=1) and If-Modified-Since can be answered without touching mongo.
 */
 
+// the cached metadata of a file
+struct uwsgi_gridfs_file {
+	std::string key;
+	// {_id: ...}
+	mongo::BSONObj id;
+	long long length;
+	int chunk_size;
+	time_t mtime;
+	std::string md5;
+	std::string filename;
+	uint64_t expires;
+};
+
 struct uwsgi_gridfs_mountpoint {
 	char *mountpoint;
 	uint16_t mountpoint_len;
@@ -32,125 +52,262 @@ struct uwsgi_gridfs_mountpoint {
 	char *password;
 	char *bucket;
 	uint16_t bucket_len;
+	char *prefetch_str;
+	int prefetch;
+	char *cache_str;
+	int cache;
+	char *files_ns;
+	char *chunks_ns;
 	std::vector<mongo::HostAndPort> servers;
+	// one for each core, allocated on first usage
+	mongo::DBClientBase **conns;
+	std::vector<struct uwsgi_gridfs_file> *files;
+	pthread_mutex_t lock;
 };
 
 struct uwsgi_gridfs {
 	int debug;
 	struct uwsgi_string_list *mountpoints;
+	int prefetch;
+	int cache;
+	uint64_t cache_items;
 } ugridfs;
 
 struct uwsgi_option uwsgi_gridfs_options[] = {
 	{(char *)"gridfs-mount", required_argument, 0, (char *)"mount a gridfs db on the specified mountpoint", uwsgi_opt_add_string_list, &ugridfs.mountpoints, UWSGI_OPT_MIME},
 	{(char *)"gridfs-debug", no_argument, 0, (char *)"report gridfs mountpoint and itemname for each request (debug)", uwsgi_opt_true, &ugridfs.debug, UWSGI_OPT_MIME},
+	{(char *)"gridfs-prefetch", required_argument, 0, (char *)"set the number of chunks fetched for each round trip (default 4)", uwsgi_opt_set_int, &ugridfs.prefetch, 0},
+	{(char *)"gridfs-cache", required_argument, 0, (char *)"cache the metadata of the files for the specified number of seconds", uwsgi_opt_set_int, &ugridfs.cache, 0},
+	{(char *)"gridfs-cache-items", required_argument, 0, (char *)"set the max number of items of the gridfs metadata cache (default 1024)", uwsgi_opt_set_64bit, &ugridfs.cache_items, 0},
 	{0, 0, 0, 0, 0, 0, 0},
 };
 
 extern struct uwsgi_server uwsgi;
 extern struct uwsgi_plugin gridfs_plugin;
 
-static void uwsgi_gridfs_do(struct wsgi_request *wsgi_req, struct uwsgi_gridfs_mountpoint *ugm, char *itemname, int need_free) {
-	try {
-		std::unique_ptr<mongo::DBClientBase> conn;
+static struct uwsgi_gridfs_file *uwsgi_gridfs_cache_slot(struct uwsgi_gridfs_mountpoint *ugm, const std::string &key) {
+	uint32_t hash = djb33x_hash((char *) key.c_str(), key.length());
+	return &(*ugm->files)[hash % ugm->files->size()];
+}
+
+static bool uwsgi_gridfs_cache_get(struct uwsgi_gridfs_mountpoint *ugm, const std::string &key, struct uwsgi_gridfs_file &gf) {
+	if (!ugm->files) return false;
+	bool found = false;
+	pthread_mutex_lock(&ugm->lock);
+	struct uwsgi_gridfs_file *item = uwsgi_gridfs_cache_slot(ugm, key);
+	if (item->key == key && item->expires > (uint64_t) uwsgi_now()) {
+		gf = *item;
+		found = true;
+	}
+	pthread_mutex_unlock(&ugm->lock);
+	return found;
+}
+
+static void uwsgi_gridfs_cache_set(struct uwsgi_gridfs_mountpoint *ugm, struct uwsgi_gridfs_file &gf) {
+	if (!ugm->files) return;
+	gf.expires = uwsgi_now() + ugm->cache;
+	pthread_mutex_lock(&ugm->lock);
+	*uwsgi_gridfs_cache_slot(ugm, gf.key) = gf;
+	pthread_mutex_unlock(&ugm->lock);
+}
+
+// get the persistent connection of the core, NULL on auth failure
+static mongo::DBClientBase *uwsgi_gridfs_connection(struct wsgi_request *wsgi_req, struct uwsgi_gridfs_mountpoint *ugm) {
+	if (!ugm->conns) {
+		mongo::DBClientBase **conns = new mongo::DBClientBase*[uwsgi.cores]();
+		if (!__sync_bool_compare_and_swap(&ugm->conns, NULL, conns)) delete[] conns;
+	}
+	mongo::DBClientBase *conn = ugm->conns[wsgi_req->async_id];
+	if (conn) return conn;
 
-		if (ugm->replica) {
-			conn = std::unique_ptr<mongo::DBClientBase> (new mongo::DBClientReplicaSet(ugm->replica, ugm->servers, ugm->timeout));
-			dynamic_cast<mongo::DBClientReplicaSet *>(conn.get())->connect();
+	std::unique_ptr<mongo::DBClientBase> new_conn;
+	if (ugm->replica) {
+		new_conn = std::unique_ptr<mongo::DBClientBase> (new mongo::DBClientReplicaSet(ugm->replica, ugm->servers, ugm->timeout));
+		dynamic_cast<mongo::DBClientReplicaSet *>(new_conn.get())->connect();
+	}
+	else {
+		new_conn = std::unique_ptr<mongo::DBClientBase> (new mongo::DBClientConnection(true, 0, ugm->timeout));
+		dynamic_cast<mongo::DBClientConnection *>(new_conn.get())->connect(ugm->server);
+	}
+
+	if (ugm->username && ugm->password) {
+		std::string errmsg;
+		if (!new_conn->auth(ugm->db, ugm->username, ugm->password, errmsg)) {
+			uwsgi_log("[uwsgi-gridfs]: %s\n", errmsg.c_str());
+			return NULL;
 		}
-		else {
-			conn = std::unique_ptr<mongo::DBClientBase> (new mongo::DBClientConnection(true, 0, ugm->timeout));
-			dynamic_cast<mongo::DBClientConnection *>(conn.get())->connect(ugm->server);
+	}
+	conn = new_conn.release();
+	ugm->conns[wsgi_req->async_id] = conn;
+	return conn;
+}
+
+static void uwsgi_gridfs_drop_connection(struct wsgi_request *wsgi_req, struct uwsgi_gridfs_mountpoint *ugm) {
+	if (!ugm->conns) return;
+	delete ugm->conns[wsgi_req->async_id];
+	ugm->conns[wsgi_req->async_id] = NULL;
+}
+
+// send the bytes from-to (inclusive) fetching only the needed chunks
+static int uwsgi_gridfs_send(struct wsgi_request *wsgi_req, struct uwsgi_gridfs_mountpoint *ugm, mongo::DBClientBase *conn, struct uwsgi_gridfs_file &gf, uint64_t from, uint64_t to) {
+	int first = from / gf.chunk_size;
+	int last = to / gf.chunk_size;
+
+	mongo::BSONObjBuilder qb;
+	qb.appendAs(gf.id.firstElement(), "files_id");
+	qb.append("n", BSON("$gte" << first << "$lte" << last));
+	mongo::Query q(qb.obj());
+	q.sort("n");
+
+	// the return type changed between driver versions
+	std::unique_ptr<mongo::DBClientCursor> cursor(conn->query(ugm->chunks_ns, q, 0, 0, 0, 0, ugm->prefetch).release());
+	if (!cursor.get()) return -1;
+
+	int expected = first;
+	while (expected <= last && cursor->more()) {
+		mongo::BSONObj chunk = cursor->next();
+		if (chunk.getIntField("n") != expected) {
+			uwsgi_log("[uwsgi-gridfs]: missing chunk %d of %s\n", expected, gf.key.c_str());
+			return -1;
 		}
+		int chunk_len = 0;
+		const char *data = chunk.getField("data").binData(chunk_len);
+		// only the last chunk of the file can be shorter
+		if (chunk_len != gf.chunk_size && (uint64_t) expected * gf.chunk_size + chunk_len < (uint64_t) gf.length) return -1;
+		uint64_t chunk_start = (uint64_t) expected * gf.chunk_size;
+		uint64_t skip = from > chunk_start ? from - chunk_start : 0;
+		uint64_t len = UMIN((uint64_t) chunk_len, to - chunk_start + 1);
+		if (skip >= len) return -1;
+		if (uwsgi_response_write_body_do(wsgi_req, (char *) data + skip, len - skip)) return -1;
+		expected++;
+	}
+	return expected > last ? 0 : -1;
+}
 
-		try {
-			if (ugm->username && ugm->password) {
-				std::string errmsg;
-				if (!conn->auth(ugm->db, ugm->username, ugm->password, errmsg)) {
-					uwsgi_log("[uwsgi-gridfs]: %s\n", errmsg.c_str());
-					uwsgi_403(wsgi_req);
-					return;
-				}
-			}
-			mongo::GridFS gridfs((*conn.get()), ugm->db);
-			mongo::GridFile gfile = gridfs.findFileByName(itemname);
+static void uwsgi_gridfs_do(struct wsgi_request *wsgi_req, struct uwsgi_gridfs_mountpoint *ugm, char *itemname, int need_free) {
+	struct uwsgi_gridfs_file gf;
+	gf.key = itemname;
+	if (need_free) {
+		free(itemname);
+		itemname = NULL;
+	}
 
-			if (need_free) {
-				free(itemname);
-				itemname = NULL;
+	try {
+		mongo::DBClientBase *conn = NULL;
+		if (!uwsgi_gridfs_cache_get(ugm, gf.key, gf)) {
+			conn = uwsgi_gridfs_connection(wsgi_req, ugm);
+			if (!conn) {
+				uwsgi_403(wsgi_req);
+				return;
 			}
-
-			if (!gfile.exists()) {
+			// the last uploaded version wins
+			mongo::BSONObj obj = conn->findOne(ugm->files_ns, mongo::Query(BSON("filename" << gf.key)).sort("uploadDate", -1));
+			if (obj.isEmpty()) {
 				uwsgi_404(wsgi_req);
 				return;
 			}
+			gf.id = obj.getField("_id").wrap();
+			gf.length = obj.getField("length").numberLong();
+			gf.chunk_size = obj.getField("chunkSize").numberInt();
+			gf.mtime = obj.getField("uploadDate").date().toTimeT();
+			gf.md5 = obj.getStringField("md5");
+			gf.filename = obj.getStringField("filename");
+			if (gf.chunk_size <= 0) {
+				uwsgi_log("[uwsgi-gridfs]: invalid chunkSize for %s\n", gf.key.c_str());
+				uwsgi_500(wsgi_req);
+				return;
+			}
+			uwsgi_gridfs_cache_set(ugm, gf);
+		}
 
-			uwsgi_response_prepare_headers(wsgi_req, (char *)"200 OK", 6);
-			// first get the content_type (if possibile)
-			std::string filename = gfile.getFilename();
+		char *etag = NULL;
+		if (ugm->etag && !gf.md5.empty()) {
+			etag = uwsgi_concat3((char *)"\"", (char *)gf.md5.c_str(), (char *)"\"");
+		}
 
-			if (!ugm->no_mime) {
-				size_t mime_type_len = 0;
-				char *mime_type = uwsgi_get_mime_type((char *)filename.c_str(), filename.length(), &mime_type_len);
-				if (mime_type) {
-					uwsgi_response_add_content_type(wsgi_req, mime_type, mime_type_len);
-				}
+		// conditional requests
+		uint16_t inm_len = 0;
+		char *inm = uwsgi_get_var(wsgi_req, (char *) "HTTP_IF_NONE_MATCH", 18, &inm_len);
+		int not_modified = 0;
+		if (inm) {
+			not_modified = etag && !uwsgi_strncmp(inm, inm_len, etag, strlen(etag));
+		}
+		else if (wsgi_req->if_modified_since_len) {
+			not_modified = gf.mtime <= uwsgi_parse_http_date(wsgi_req->if_modified_since, wsgi_req->if_modified_since_len);
+		}
+		if (not_modified) {
+			free(etag);
+			if (!uwsgi_response_prepare_headers(wsgi_req, (char *)"304 Not Modified", 16)) {
+				uwsgi_response_write_headers_do(wsgi_req);
 			}
+			return;
+		}
 
-			if (ugm->orig_filename) {
-				char *filename_header = uwsgi_concat3((char *)"inline; filename=\"", (char *)filename.c_str(), (char *)"\"");
-				uwsgi_response_add_header(wsgi_req, (char *)"Content-Disposition", 19, filename_header, 19 + filename.length());
-				free(filename_header);
+		// only a single range is supported
+		uint64_t length = gf.length;
+		uint64_t from = 0;
+		uint64_t to = length ? length - 1 : 0;
+		int partial = 0;
+		if (wsgi_req->range_len && length > 0) {
+			struct uwsgi_http_range ranges[1];
+			if (uwsgi_parse_http_ranges(wsgi_req->range, wsgi_req->range_len, length, ranges, 1) == 1) {
+				from = ranges[0].from;
+				to = ranges[0].to;
+				partial = 1;
 			}
+		}
+
+		uwsgi_response_prepare_headers(wsgi_req, partial ? (char *)"206 Partial Content" : (char *)"200 OK", partial ? 19 : 6);
+		// first get the content_type (if possibile)
+		if (!ugm->no_mime) {
+			size_t mime_type_len = 0;
+			char *mime_type = uwsgi_get_mime_type((char *)gf.filename.c_str(), gf.filename.length(), &mime_type_len);
+			if (mime_type) {
+				uwsgi_response_add_content_type(wsgi_req, mime_type, mime_type_len);
+			}
+		}
 
-			uwsgi_response_add_content_length(wsgi_req, gfile.getContentLength());
+		if (ugm->orig_filename) {
+			char *filename_header = uwsgi_concat3((char *)"inline; filename=\"", (char *)gf.filename.c_str(), (char *)"\"");
+			uwsgi_response_add_header(wsgi_req, (char *)"Content-Disposition", 19, filename_header, 19 + gf.filename.length());
+			free(filename_header);
+		}
 
-			char http_last_modified[49];
-			time_t t = gfile.getUploadDate().toTimeT();
-			int size = uwsgi_http_date(t, http_last_modified);
-                	uwsgi_response_add_header(wsgi_req, (char *)"Last-Modified", 13, http_last_modified, size);
+		uwsgi_response_add_content_length(wsgi_req, length ? to - from + 1 : 0);
+		if (partial) {
+			uwsgi_response_add_content_range(wsgi_req, from, to, length);
+		}
 
-			if (ugm->etag) {
-				std::string g_md5 = gfile.getMD5();
-				if (!g_md5.empty()) {
-					char *etag = uwsgi_concat3((char *)"\"", (char *)g_md5.c_str(), (char *)"\"");
-					uwsgi_response_add_header(wsgi_req, (char *)"ETag", 4, etag, 2+g_md5.length());
-					free(etag);
-				}
-			}
+		char http_last_modified[49];
+		int size = uwsgi_http_date(gf.mtime, http_last_modified);
+                uwsgi_response_add_header(wsgi_req, (char *)"Last-Modified", 13, http_last_modified, size);
 
-			if (ugm->md5) {
-				std::string g_md5 = gfile.getMD5();
-				size_t base64_len = 0;
-				char *base64 = uwsgi_base64_encode((char *)g_md5.c_str(), g_md5.length(), &base64_len);
-				uwsgi_response_add_header(wsgi_req, (char *) "Content-MD5", 11, base64, base64_len);
-				free(base64);
-			}
+		if (etag) {
+			uwsgi_response_add_header(wsgi_req, (char *)"ETag", 4, etag, strlen(etag));
+			free(etag);
+		}
 
-			if (uwsgi_strncmp(wsgi_req->method, wsgi_req->method_len, (char *)"HEAD", 4)) {
-				int nc = gfile.getNumChunks();
-				int i;
-				for(i=0;i<nc;i++) {
-					mongo::GridFSChunk gchunk = gfile.getChunk(i);
-					int chunk_len = 0;
-					const char *chunk = gchunk.data(chunk_len);
-					uwsgi_response_write_body_do(wsgi_req, (char *) chunk, chunk_len);
-				}
-			}
+		if (ugm->md5) {
+			size_t base64_len = 0;
+			char *base64 = uwsgi_base64_encode((char *)gf.md5.c_str(), gf.md5.length(), &base64_len);
+			uwsgi_response_add_header(wsgi_req, (char *) "Content-MD5", 11, base64, base64_len);
+			free(base64);
 		}
-		catch ( mongo::DBException &e ) {
-			uwsgi_log("[uwsgi-gridfs]: %s\n", e.what());
-			if (need_free && itemname) {
-				free(itemname);
-				itemname = NULL;
+
+		if (length > 0 && uwsgi_strncmp(wsgi_req->method, wsgi_req->method_len, (char *)"HEAD", 4)) {
+			if (!conn) {
+				conn = uwsgi_gridfs_connection(wsgi_req, ugm);
+				if (!conn) return;
+			}
+			if (uwsgi_gridfs_send(wsgi_req, ugm, conn, gf, from, to)) {
+				// the cursor could be still open, start from a clean connection
+				uwsgi_gridfs_drop_connection(wsgi_req, ugm);
 			}
 		}
 	}
 	catch ( mongo::DBException &e ) {
 		uwsgi_log("[uwsgi-gridfs]: %s\n", e.what());
-		if (need_free && itemname) {
-			free(itemname);
-			itemname = NULL;
-		}
+		uwsgi_gridfs_drop_connection(wsgi_req, ugm);
 	}
 }
 
@@ -174,6 +331,8 @@ static struct uwsgi_gridfs_mountpoint *uwsgi_gridfs_add_mountpoint(char *arg, si
                         "item", &ugm->itemname,
                         "username", &ugm->username,
                         "password", &ugm->password,
+                        "prefetch", &ugm->prefetch_str,
+                        "cache", &ugm->cache_str,
                         NULL)) {
                         uwsgi_log("invalid gridfs mountpoint syntax\n");
 			free(ugm);
@@ -214,6 +373,21 @@ static struct uwsgi_gridfs_mountpoint *uwsgi_gridfs_add_mountpoint(char *arg, si
 		ugm->bucket_len = strlen(ugm->bucket);
 	}
 
+	ugm->files_ns = uwsgi_concat4(ugm->db, (char *)".", ugm->bucket, (char *)".files");
+	ugm->chunks_ns = uwsgi_concat4(ugm->db, (char *)".", ugm->bucket, (char *)".chunks");
+
+	ugm->prefetch = ugm->prefetch_str ? atoi(ugm->prefetch_str) : ugridfs.prefetch;
+	if (ugm->prefetch <= 0) ugm->prefetch = 4;
+
+	ugm->cache = ugm->cache_str ? atoi(ugm->cache_str) : ugridfs.cache;
+	if (ugm->cache > 0) {
+		ugm->files = new std::vector<struct uwsgi_gridfs_file>(ugridfs.cache_items ? ugridfs.cache_items : 1024);
+		if (pthread_mutex_init(&ugm->lock, NULL)) {
+			uwsgi_error("uwsgi_gridfs_add_mountpoint()/pthread_mutex_init()");
+			exit(1);
+		}
+	}
+
 	if (ugm->itemname) {
 		ugm->itemname_len = strlen(ugm->itemname);
 	}
@@ -0,0 +1,360 @@
+/*
+
+   uWSGI HTTP router response micro-cache
+
+   GET responses are stored in a (local) uWSGI cache and served directly
+   by the router, without contacting the backends.
+
+   Every item is prefixed by the 64bit timestamp until it is fresh, and it is kept
+   in the cache for --http-cache-stale more seconds: a stale item is served
+   while a single request (the one getting the revalidation lock) refreshes it.
+
+   Requests missing the cache wait for the one (of the same process) already
+   fetching the same key.
+
+*/
+
+#include "common.h"
+
+extern struct uwsgi_http uhttp;
+
+static struct http_cache_fill *hr_cache_fills;
+
+void hr_cache_init() {
+	if (!uhttp.cache) return;
+	struct uwsgi_cache *uc = uwsgi_cache_by_name(uhttp.cache);
+	if (!uc) {
+		uwsgi_log("[uwsgi-http] unable to find cache \"%s\"\n", uhttp.cache);
+		exit(1);
+	}
+	if (!uhttp.cache_max_size || uhttp.cache_max_size > uc->max_item_size - 8) {
+		uhttp.cache_max_size = uc->max_item_size - 8;
+	}
+	if (!uhttp.cache_expires) uhttp.cache_expires = 60;
+
+	if (!uhttp.cache_key) {
+		uwsgi_string_new_list(&uhttp.cache_key, "host");
+		uwsgi_string_new_list(&uhttp.cache_key, "uri");
+	}
+
+	struct uwsgi_string_list *usl = uhttp.cache_key;
+	while(usl) {
+		if (strcmp(usl->value, "method") && strcmp(usl->value, "scheme") && strcmp(usl->value, "host") &&
+			strcmp(usl->value, "uri") && strcmp(usl->value, "path") && strcmp(usl->value, "query") &&
+			uwsgi_starts_with(usl->value, usl->len, "header:", 7)) {
+			uwsgi_log("[uwsgi-http] invalid cache key part: %s\n", usl->value);
+			exit(1);
+		}
+		usl = usl->next;
+	}
+}
+
+// get the value of a request header
+static char *hr_cache_header(char *ptr, char *watermark, char *name, size_t name_len, size_t *vlen) {
+	// skip the request line
+	ptr = memchr(ptr, '\n', watermark - ptr);
+	while(ptr && ++ptr < watermark) {
+		char *eol = memchr(ptr, '\n', watermark - ptr);
+		if (!eol) eol = watermark;
+		char *end = eol;
+		if (end > ptr && *(end-1) == '\r') end--;
+		if ((size_t) (end - ptr) > name_len && ptr[name_len] == ':' && !uwsgi_strnicmp(name, name_len, ptr, name_len)) {
+			char *value = ptr + name_len + 1;
+			while(value < end && (*value == ' ' || *value == '\t')) value++;
+			*vlen = end - value;
+			return value;
+		}
+		ptr = eol;
+	}
+	return NULL;
+}
+
+static int hr_cache_build_key(struct http_session *hr, struct corerouter_peer *peer, char *ptr, char *watermark) {
+	struct uwsgi_buffer *ub = hr->cache_key;
+	char *qs = memchr(hr->request_uri, '?', hr->request_uri_len);
+	struct uwsgi_string_list *usl = uhttp.cache_key;
+	while(usl) {
+		if (!strcmp(usl->value, "method")) {
+			if (uwsgi_buffer_append(ub, "GET", 3)) return -1;
+		}
+		else if (!strcmp(usl->value, "scheme")) {
+#ifdef UWSGI_SSL
+			if (hr->ssl) {
+				if (uwsgi_buffer_append(ub, "https", 5)) return -1;
+			}
+			else
+#endif
+			if (uwsgi_buffer_append(ub, "http", 4)) return -1;
+		}
+		else if (!strcmp(usl->value, "host")) {
+			if (uwsgi_buffer_append(ub, peer->key, peer->key_len)) return -1;
+		}
+		else if (!strcmp(usl->value, "uri")) {
+			if (uwsgi_buffer_append(ub, hr->request_uri, hr->request_uri_len)) return -1;
+		}
+		else if (!strcmp(usl->value, "path")) {
+			if (uwsgi_buffer_append(ub, hr->request_uri, qs ? qs - hr->request_uri : hr->request_uri_len)) return -1;
+		}
+		else if (!strcmp(usl->value, "query")) {
+			if (qs) {
+				if (uwsgi_buffer_append(ub, qs + 1, (hr->request_uri + hr->request_uri_len) - (qs + 1))) return -1;
+			}
+		}
+		else {
+			size_t vlen = 0;
+			char *value = hr_cache_header(ptr, watermark, usl->value + 7, usl->len - 7, &vlen);
+			if (value) {
+				if (uwsgi_buffer_append(ub, value, vlen)) return -1;
+			}
+		}
+		// parts are separated by a newline (it cannot be part of the values)
+		if (uwsgi_buffer_append(ub, "\n", 1)) return -1;
+		usl = usl->next;
+	}
+	return 0;
+}
+
+static void hr_cache_reset(struct http_session *hr) {
+	if (hr->cache_key) {
+		uwsgi_buffer_destroy(hr->cache_key);
+		hr->cache_key = NULL;
+	}
+	if (hr->cache_response) {
+		uwsgi_buffer_destroy(hr->cache_response);
+		hr->cache_response = NULL;
+	}
+}
+
+// the lock key is the item key followed by a zero byte
+static int hr_cache_lock(struct http_session *hr) {
+	struct uwsgi_buffer *ub = hr->cache_key;
+	if (ub->pos >= 0xffff) return -1;
+	if (uwsgi_buffer_byte(ub, 0)) return -1;
+	int ret = uwsgi_cache_magic_set(ub->buf, ub->pos, "1", 1, uhttp.cr.socket_timeout, 0, uhttp.cache);
+	ub->pos--;
+	return ret;
+}
+
+static void hr_cache_unlock(struct http_session *hr) {
+	struct uwsgi_buffer *ub = hr->cache_key;
+	if (!hr->cache_revalidate) return;
+	hr->cache_revalidate = 0;
+	if (uwsgi_buffer_byte(ub, 0)) return;
+	uwsgi_cache_magic_del(ub->buf, ub->pos, uhttp.cache);
+	ub->pos--;
+}
+
+// send a stored response to the client and close the connection
+static int hr_cache_reply(struct corerouter_peer *peer, char *buf, size_t len) {
+	struct http_session *hr = (struct http_session *) peer->session;
+	peer->in->pos = 0;
+	peer->in->limit = 0;
+	if (uwsgi_buffer_append(peer->in, buf, len)) return -1;
+	hr->session.wait_full_write = 1;
+	peer->session->main_peer->out = peer->in;
+	peer->session->main_peer->out_pos = 0;
+	cr_write_to_main(peer, hr->func_write);
+	return 0;
+}
+
+/*
+	returns 1 if the request has been served from the cache, 0 if it must be forwarded
+	to a backend (hr->cache_key is set when the response can be stored)
+*/
+int hr_cache_lookup(struct corerouter_peer *peer, int skip) {
+	struct http_session *hr = (struct http_session *) peer->session;
+	char *ptr = peer->session->main_peer->in->buf + skip;
+	char *watermark = peer->session->main_peer->in->buf + hr->headers_size;
+	size_t vlen = 0;
+
+	// the previous request of this connection did not complete
+	hr_cache_done(hr, 0);
+	hr_cache_reset(hr);
+
+	if (hr->raw_body || hr->h2) return 0;
+	if (watermark - ptr < 4 || memcmp(ptr, "GET ", 4)) return 0;
+	// no bodies, upgrades or authenticated requests
+	if (hr_cache_header(ptr, watermark, "Authorization", 13, &vlen)) return 0;
+	if (hr_cache_header(ptr, watermark, "Upgrade", 7, &vlen)) return 0;
+	if (hr_cache_header(ptr, watermark, "Transfer-Encoding", 17, &vlen)) return 0;
+	char *cl = hr_cache_header(ptr, watermark, "Content-Length", 14, &vlen);
+	if (cl && uwsgi_str_num(cl, vlen) > 0) return 0;
+
+	hr->cache_key = uwsgi_buffer_new(uwsgi.page_size);
+	if (hr_cache_build_key(hr, peer, ptr, watermark) || hr->cache_key->pos >= 0xffff) {
+		hr_cache_reset(hr);
+		return 0;
+	}
+
+	uint64_t valsize = 0;
+	uint64_t expires = 0;
+	char *value = uwsgi_cache_magic_get(hr->cache_key->buf, hr->cache_key->pos, &valsize, &expires, uhttp.cache);
+	if (!value) return 0;
+	if (valsize <= 8) {
+		free(value);
+		return 0;
+	}
+
+	// still fresh, or stale and somebody else is revalidating it
+	if (uwsgi_be64(value) > (uint64_t) uwsgi_now() || hr_cache_lock(hr)) {
+		int ret = hr_cache_reply(peer, value + 8, valsize - 8);
+		free(value);
+		hr_cache_reset(hr);
+		if (ret) return -1;
+		return 1;
+	}
+
+	free(value);
+	hr->cache_revalidate = 1;
+	return 0;
+}
+
+/*
+	called before connecting to the backend: returns 1 if the request has been parked
+	waiting for another one fetching the same key
+*/
+int hr_cache_wait(struct corerouter_peer *peer) {
+	struct http_session *hr = (struct http_session *) peer->session;
+
+	if (hr->raw_body) {
+		hr_cache_unlock(hr);
+		hr_cache_reset(hr);
+		return 0;
+	}
+
+	struct http_cache_fill *fill = hr_cache_fills;
+	while(fill) {
+		if (!uwsgi_strncmp(fill->key, fill->key_len, hr->cache_key->buf, hr->cache_key->pos)) {
+			if (uwsgi_cr_set_hooks(peer->session->main_peer, NULL, NULL)) return -1;
+			hr->cache_fill = fill;
+			hr->cache_peer = peer;
+			hr->cache_next = fill->waiters;
+			fill->waiters = hr;
+			hr_cache_reset(hr);
+			return 1;
+		}
+		fill = fill->next;
+	}
+
+	// we are the first one asking for this key
+	fill = uwsgi_calloc(sizeof(struct http_cache_fill));
+	fill->key = hr->cache_key->buf;
+	fill->key_len = hr->cache_key->pos;
+	fill->leader = hr;
+	fill->next = hr_cache_fills;
+	if (hr_cache_fills) hr_cache_fills->prev = fill;
+	hr_cache_fills = fill;
+	hr->cache_fill = fill;
+	hr->cache_response = uwsgi_buffer_new(uwsgi.page_size);
+	return 0;
+}
+
+// collect the response chunks sent to the client
+void hr_cache_store(struct http_session *hr, struct uwsgi_buffer *ub) {
+#ifdef UWSGI_ZLIB
+	if (hr->force_chunked || hr->force_gzip) goto drop;
+#else
+	if (hr->force_chunked) goto drop;
+#endif
+	if (hr->cache_response->pos + ub->pos > uhttp.cache_max_size) goto drop;
+	if (uwsgi_buffer_append(hr->cache_response, ub->buf, ub->pos)) goto drop;
+	return;
+drop:
+	uwsgi_buffer_destroy(hr->cache_response);
+	hr->cache_response = NULL;
+}
+
+// only successful and public responses are stored
+static int hr_cache_cacheable(char *buf, size_t len) {
+	if (len < 12 || memcmp(buf, "HTTP/1.", 7) || memcmp(buf + 8, " 200", 4)) return 0;
+	char *ptr = memchr(buf, '\n', len);
+	char *watermark = buf + len;
+	while(ptr && ++ptr < watermark) {
+		char *eol = memchr(ptr, '\n', watermark - ptr);
+		if (!eol) return 0;
+		char *end = eol;
+		if (end > ptr && *(end-1) == '\r') end--;
+		// end of headers
+		if (end == ptr) return 1;
+		if (end - ptr > 11 && !uwsgi_strnicmp("Set-Cookie:", 11, ptr, 11)) return 0;
+		if (end - ptr > 14 && !uwsgi_strnicmp("Cache-Control:", 14, ptr, 14)) {
+			if (uwsgi_contains_n(ptr, end - ptr, "no-store", 8) ||
+				uwsgi_contains_n(ptr, end - ptr, "no-cache", 8) ||
+				uwsgi_contains_n(ptr, end - ptr, "private", 7)) return 0;
+		}
+		ptr = eol;
+	}
+	return 0;
+}
+
+static int hr_cache_resume(struct http_session *hr, char *buf, size_t len) {
+	struct corerouter_peer *peer = hr->session.peers;
+	// the parked peer could have been timed out
+	while(peer) {
+		if (peer == hr->cache_peer) break;
+		peer = peer->next;
+	}
+	hr->cache_peer = NULL;
+	if (!peer) return -1;
+	if (buf) return hr_cache_reply(peer, buf, len);
+	// the leader failed, go to the backend
+	http_set_timeout(peer->session->main_peer, uhttp.cr.socket_timeout);
+	http_set_timeout(peer, uhttp.connect_timeout);
+	cr_connect(peer, hr_instance_connected);
+	return 0;
+}
+
+/*
+	called at the end of the backend response (complete = 1) and on session close:
+	stores the response and wakes up the waiting requests
+*/
+void hr_cache_done(struct http_session *hr, int complete) {
+	struct http_cache_fill *fill = hr->cache_fill;
+	if (!fill) {
+		hr_cache_unlock(hr);
+		return;
+	}
+	hr->cache_fill = NULL;
+
+	// a waiting request is going away
+	if (fill->leader != hr) {
+		struct http_session **waiter = &fill->waiters;
+		while(*waiter) {
+			if (*waiter == hr) {
+				*waiter = hr->cache_next;
+				break;
+			}
+			waiter = &(*waiter)->cache_next;
+		}
+		return;
+	}
+
+	if (fill->prev) fill->prev->next = fill->next;
+	else hr_cache_fills = fill->next;
+	if (fill->next) fill->next->prev = fill->prev;
+
+	struct uwsgi_buffer *response = NULL;
+	if (complete && hr->cache_response && hr_cache_cacheable(hr->cache_response->buf, hr->cache_response->pos)) {
+		response = hr->cache_response;
+		struct uwsgi_buffer *ub = uwsgi_buffer_new(8 + response->pos);
+		if (!uwsgi_buffer_u64be(ub, uwsgi_now() + uhttp.cache_expires) && !uwsgi_buffer_append(ub, response->buf, response->pos)) {
+			uwsgi_cache_magic_set(hr->cache_key->buf, hr->cache_key->pos, ub->buf, ub->pos, uhttp.cache_expires + uhttp.cache_stale, UWSGI_CACHE_FLAG_UPDATE, uhttp.cache);
+		}
+		uwsgi_buffer_destroy(ub);
+	}
+
+	hr_cache_unlock(hr);
+
+	struct http_session *waiter = fill->waiters;
+	while(waiter) {
+		struct http_session *next = waiter->cache_next;
+		waiter->cache_fill = NULL;
+		if (hr_cache_resume(waiter, response ? response->buf : NULL, response ? response->pos : 0)) {
+			corerouter_close_session(waiter->session.corerouter, &waiter->session);
+		}
+		waiter = next;
+	}
+
+	free(fill);
+	hr_cache_reset(hr);
+}
@@ -4,6 +4,12 @@ extern struct uwsgi_server uwsgi;
 
 #include "../corerouter/cr.h"
 
+#ifdef UWSGI_SSL
+#ifdef TLSEXT_TYPE_application_layer_protocol_negotiation
+#define UWSGI_HTTP2_ALPN
+#endif
+#endif
+
 #ifdef UWSGI_SSL
 #ifdef OPENSSL_NPN_UNSUPPORTED
 #ifdef UWSGI_ZLIB
@@ -30,6 +36,7 @@ struct uwsgi_http {
 #ifdef UWSGI_SSL
         char *https_session_context;
         int https_export_cert;
+        int https_handshake_threads;
 #endif
 
         struct uwsgi_string_list *stud_prefix;
@@ -51,8 +58,52 @@ struct uwsgi_http {
 
 	int proto_http;
 
+	int http2;
+
+	int response_hint;
+
+	int trace;
+	char *alt_svc;
+	size_t alt_svc_len;
+	uint64_t trace_seed;
+
+	char *cache;
+	struct uwsgi_string_list *cache_key;
+	int cache_expires;
+	int cache_stale;
+	uint64_t cache_max_size;
+
 }; 
 
+// a response being fetched for the micro-cache (other requests for the same key wait for it)
+struct http_cache_fill {
+	char *key;
+	uint16_t key_len;
+	struct http_session *leader;
+	struct http_session *waiters;
+	struct http_cache_fill *prev;
+	struct http_cache_fill *next;
+};
+
+struct uwsgi_hpack_header {
+	char *name;
+	uint16_t name_len;
+	char *value;
+	uint16_t value_len;
+};
+
+// HPACK decoder state (the dynamic table is a ring of entries)
+struct uwsgi_hpack {
+	struct uwsgi_hpack_header *entries;
+	uint32_t slots;
+	uint32_t head;
+	uint32_t count;
+	size_t size;
+	size_t max_size;
+	// SETTINGS_HEADER_TABLE_SIZE
+	size_t limit;
+};
+
 struct http_session {
 
         struct corerouter_session session;
@@ -88,8 +139,14 @@ struct http_session {
         char *ssl_client_dn;
         BIO *ssl_bio;
         char *ssl_cc;
+        size_t ssl_cc_len;
         int force_https;
         struct uwsgi_buffer *force_ssl_buf;
+	// handshake running in a helper thread
+	int ssl_handshake_events;
+	int ssl_handshake_failed;
+	time_t ssl_handshake_deadline;
+	struct http_session *ssl_handshake_next;
 #endif
 
 #ifdef UWSGI_SPDY
@@ -119,6 +176,28 @@ struct http_session {
         ssize_t (*spdy_hook)(struct corerouter_peer *);
 #endif
 
+	int h2;
+	int h2_preface;
+	// frames for the client
+	struct uwsgi_buffer *h2_out;
+	// header block being received (HEADERS + CONTINUATION)
+	struct uwsgi_buffer *h2_headers;
+	uint32_t h2_headers_sid;
+	uint8_t h2_headers_flags;
+	uint32_t h2_last_sid;
+	// connection send window
+	int64_t h2_window;
+	// SETTINGS_INITIAL_WINDOW_SIZE and SETTINGS_MAX_FRAME_SIZE of the client
+	int64_t h2_initial_window;
+	uint32_t h2_max_frame;
+	int h2_goaway;
+	struct uwsgi_hpack h2_hpack;
+
+	// 1: the backend could send a response hint, 2: got it
+	int response_hint;
+	uint16_t response_hint_size;
+	uint8_t response_hint_flags;
+
 #ifdef UWSGI_ZLIB
 	int can_gzip;
 	int has_gzip;
@@ -145,6 +224,14 @@ struct http_session {
         uint16_t proxy_src_len;
         uint16_t proxy_src_port_len;
 
+	// response micro-cache
+	struct uwsgi_buffer *cache_key;
+	struct uwsgi_buffer *cache_response;
+	int cache_revalidate;
+	struct http_cache_fill *cache_fill;
+	struct http_session *cache_next;
+	struct corerouter_peer *cache_peer;
+
 };
 
 
@@ -171,6 +258,7 @@ ssize_t hr_ssl_write(struct corerouter_peer *);
 
 int hr_https_add_vars(struct http_session *, struct corerouter_peer *, struct uwsgi_buffer *);
 void hr_setup_ssl(struct http_session *, struct uwsgi_gateway_socket *);
+int hr_ssl_ktls(struct http_session *, int);
 
 #endif
 
@@ -182,16 +270,38 @@ ssize_t spdy_parse(struct corerouter_peer *);
 void spdy_window_update(char *, uint32_t, uint32_t);
 #endif
 
+#ifdef UWSGI_HTTP2_ALPN
+int hr_https_alpn(SSL *, const unsigned char **, unsigned char *, const unsigned char *, unsigned int, void *);
+#endif
+
+ssize_t http2_parse(struct corerouter_peer *);
+ssize_t http2_flush(struct corerouter_peer *);
+void http2_session_close(struct http_session *);
+
+void uwsgi_hpack_init(struct uwsgi_hpack *, size_t);
+void uwsgi_hpack_free(struct uwsgi_hpack *);
+int uwsgi_hpack_decode(struct uwsgi_hpack *, char *, size_t, struct uwsgi_buffer *);
+int uwsgi_hpack_encode(struct uwsgi_buffer *, char *, uint16_t, char *, uint16_t);
+
 ssize_t hs_http_manage(struct corerouter_peer *, ssize_t);
 
 ssize_t hr_instance_connected(struct corerouter_peer *);
 ssize_t hr_instance_write(struct corerouter_peer *);
+ssize_t hr_write(struct corerouter_peer *);
 
 ssize_t hr_instance_read_response(struct corerouter_peer *);
 ssize_t hr_read_body(struct corerouter_peer *);
 ssize_t hr_write_body(struct corerouter_peer *);
 
 void hr_session_close(struct corerouter_session *);
+void http_set_timeout(struct corerouter_peer *, int);
 ssize_t http_parse(struct corerouter_peer *);
 
 int http_response_parse(struct http_session *, struct uwsgi_buffer *, size_t);
+int http_response_apply(struct http_session *, struct uwsgi_buffer *, size_t, uint8_t);
+
+void hr_cache_init(void);
+int hr_cache_lookup(struct corerouter_peer *, int);
+int hr_cache_wait(struct corerouter_peer *);
+void hr_cache_store(struct http_session *, struct uwsgi_buffer *);
+void hr_cache_done(struct http_session *, int);
@@ -0,0 +1,367 @@
+/*
+
+   uWSGI HPACK (RFC 7541) header compression for the HTTP/2 router
+
+*/
+
+#include "common.h"
+
+// the static table (index 1 to 61)
+static struct uwsgi_hpack_header hpack_static_table[] = {
+	{":authority", 10, "", 0},
+	{":method", 7, "GET", 3},
+	{":method", 7, "POST", 4},
+	{":path", 5, "/", 1},
+	{":path", 5, "/index.html", 11},
+	{":scheme", 7, "http", 4},
+	{":scheme", 7, "https", 5},
+	{":status", 7, "200", 3},
+	{":status", 7, "204", 3},
+	{":status", 7, "206", 3},
+	{":status", 7, "304", 3},
+	{":status", 7, "400", 3},
+	{":status", 7, "404", 3},
+	{":status", 7, "500", 3},
+	{"accept-charset", 14, "", 0},
+	{"accept-encoding", 15, "gzip, deflate", 13},
+	{"accept-language", 15, "", 0},
+	{"accept-ranges", 13, "", 0},
+	{"accept", 6, "", 0},
+	{"access-control-allow-origin", 27, "", 0},
+	{"age", 3, "", 0},
+	{"allow", 5, "", 0},
+	{"authorization", 13, "", 0},
+	{"cache-control", 13, "", 0},
+	{"content-disposition", 19, "", 0},
+	{"content-encoding", 16, "", 0},
+	{"content-language", 16, "", 0},
+	{"content-length", 14, "", 0},
+	{"content-location", 16, "", 0},
+	{"content-range", 13, "", 0},
+	{"content-type", 12, "", 0},
+	{"cookie", 6, "", 0},
+	{"date", 4, "", 0},
+	{"etag", 4, "", 0},
+	{"expect", 6, "", 0},
+	{"expires", 7, "", 0},
+	{"from", 4, "", 0},
+	{"host", 4, "", 0},
+	{"if-match", 8, "", 0},
+	{"if-modified-since", 17, "", 0},
+	{"if-none-match", 13, "", 0},
+	{"if-range", 8, "", 0},
+	{"if-unmodified-since", 19, "", 0},
+	{"last-modified", 13, "", 0},
+	{"link", 4, "", 0},
+	{"location", 8, "", 0},
+	{"max-forwards", 12, "", 0},
+	{"proxy-authenticate", 18, "", 0},
+	{"proxy-authorization", 19, "", 0},
+	{"range", 5, "", 0},
+	{"referer", 7, "", 0},
+	{"refresh", 7, "", 0},
+	{"retry-after", 11, "", 0},
+	{"server", 6, "", 0},
+	{"set-cookie", 10, "", 0},
+	{"strict-transport-security", 25, "", 0},
+	{"transfer-encoding", 17, "", 0},
+	{"user-agent", 10, "", 0},
+	{"vary", 4, "", 0},
+	{"via", 3, "", 0},
+	{"www-authenticate", 16, "", 0},
+};
+
+#define HPACK_STATIC_ENTRIES 61
+
+// canonical huffman codes (256 is EOS)
+static const uint32_t hpack_huffman_codes[257] = {
+	0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+	0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+	0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+	0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+	0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+	0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+	0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+	0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+	0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+	0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+	0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+	0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+	0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+	0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+	0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+	0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+	0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+	0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+	0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+	0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+	0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+	0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+	0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+	0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+	0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+	0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+	0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+	0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+	0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+	0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+	0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+	0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+	0x3fffffff,
+};
+
+static const uint8_t hpack_huffman_lens[257] = {
+	13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+	28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+	6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+	5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+	13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+	15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+	6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+	20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+	24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+	22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+	21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+	26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+	19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+	20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+	26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+	30,
+};
+
+// decoding tree, children >= 0 are nodes, < 0 are symbols (-(sym+1))
+static int16_t hpack_huffman_tree[512][2];
+static int hpack_huffman_tree_ready;
+
+static void hpack_huffman_build() {
+	int i, nodes = 1;
+	for(i=0;i<257;i++) {
+		int node = 0;
+		int bit;
+		for(bit=hpack_huffman_lens[i]-1;bit>=0;bit--) {
+			int b = (hpack_huffman_codes[i] >> bit) & 1;
+			if (bit == 0) {
+				hpack_huffman_tree[node][b] = -(i+1);
+				break;
+			}
+			if (!hpack_huffman_tree[node][b]) {
+				hpack_huffman_tree[node][b] = nodes++;
+			}
+			node = hpack_huffman_tree[node][b];
+		}
+	}
+	hpack_huffman_tree_ready = 1;
+}
+
+static int hpack_huffman_decode(struct uwsgi_buffer *ub, uint8_t *buf, size_t len) {
+	if (!hpack_huffman_tree_ready) hpack_huffman_build();
+	size_t i;
+	int node = 0;
+	int pad_bits = 0, pad_ones = 1;
+	for(i=0;i<len;i++) {
+		int bit;
+		for(bit=7;bit>=0;bit--) {
+			int b = (buf[i] >> bit) & 1;
+			int next = hpack_huffman_tree[node][b];
+			if (next < 0) {
+				// EOS in a string is an error
+				if (next == -257) return -1;
+				if (uwsgi_buffer_u8(ub, (uint8_t) (-next-1))) return -1;
+				node = 0;
+				pad_bits = 0;
+				pad_ones = 1;
+				continue;
+			}
+			if (next == 0) return -1;
+			node = next;
+			pad_bits++;
+			if (!b) pad_ones = 0;
+		}
+	}
+	// padding must be a (max 7 bits) prefix of EOS
+	if (pad_bits > 7 || !pad_ones) return -1;
+	return 0;
+}
+
+static int hpack_read_int(uint8_t **ptr, uint8_t *watermark, int prefix, uint64_t *value) {
+	uint8_t mask = (1 << prefix) - 1;
+	if (*ptr >= watermark) return -1;
+	*value = **ptr & mask;
+	(*ptr)++;
+	if (*value < mask) return 0;
+	int shift = 0;
+	while(*ptr < watermark) {
+		uint8_t b = **ptr;
+		(*ptr)++;
+		*value += (uint64_t) (b & 0x7f) << shift;
+		if (!(b & 0x80)) return 0;
+		shift += 7;
+		if (shift > 28) return -1;
+	}
+	return -1;
+}
+
+static int hpack_write_int(struct uwsgi_buffer *ub, uint8_t first, int prefix, uint64_t value) {
+	uint8_t mask = (1 << prefix) - 1;
+	if (value < mask) return uwsgi_buffer_u8(ub, first | (uint8_t) value);
+	if (uwsgi_buffer_u8(ub, first | mask)) return -1;
+	value -= mask;
+	while(value >= 128) {
+		if (uwsgi_buffer_u8(ub, (uint8_t) ((value & 0x7f) | 0x80))) return -1;
+		value >>= 7;
+	}
+	return uwsgi_buffer_u8(ub, (uint8_t) value);
+}
+
+// append a 16bit le size followed by the (decoded) string
+static int hpack_read_string(uint8_t **ptr, uint8_t *watermark, struct uwsgi_buffer *ub) {
+	if (*ptr >= watermark) return -1;
+	int huffman = **ptr & 0x80;
+	uint64_t len = 0;
+	if (hpack_read_int(ptr, watermark, 7, &len)) return -1;
+	if (len > (uint64_t) (watermark - *ptr)) return -1;
+	size_t base = ub->pos;
+	if (uwsgi_buffer_u16le(ub, 0)) return -1;
+	if (huffman) {
+		if (hpack_huffman_decode(ub, *ptr, len)) return -1;
+	}
+	else {
+		if (uwsgi_buffer_append(ub, (char *) *ptr, len)) return -1;
+	}
+	*ptr += len;
+	size_t slen = ub->pos - (base + 2);
+	if (slen > UMAX16) return -1;
+	ub->buf[base] = (uint8_t) (slen & 0xff);
+	ub->buf[base+1] = (uint8_t) ((slen >> 8) & 0xff);
+	return 0;
+}
+
+static struct uwsgi_hpack_header *hpack_get(struct uwsgi_hpack *hpack, uint64_t index) {
+	if (index == 0) return NULL;
+	if (index <= HPACK_STATIC_ENTRIES) return &hpack_static_table[index-1];
+	index -= HPACK_STATIC_ENTRIES + 1;
+	if (index >= hpack->count) return NULL;
+	return &hpack->entries[(hpack->head + hpack->slots - index) % hpack->slots];
+}
+
+static void hpack_evict(struct uwsgi_hpack *hpack, size_t max_size) {
+	while(hpack->count > 0 && hpack->size > max_size) {
+		struct uwsgi_hpack_header *uhh = &hpack->entries[(hpack->head + hpack->slots - (hpack->count-1)) % hpack->slots];
+		hpack->size -= uhh->name_len + uhh->value_len + 32;
+		free(uhh->name);
+		hpack->count--;
+	}
+}
+
+static void hpack_insert(struct uwsgi_hpack *hpack, char *name, uint16_t name_len, char *value, uint16_t value_len) {
+	size_t size = name_len + value_len + 32;
+	// an entry bigger than the table empties it
+	if (size > hpack->max_size) {
+		hpack_evict(hpack, 0);
+		return;
+	}
+	hpack_evict(hpack, hpack->max_size - size);
+	if (!hpack->entries) {
+		// every entry takes at least 32 bytes
+		hpack->slots = (hpack->limit / 32) + 1;
+		hpack->entries = uwsgi_calloc(sizeof(struct uwsgi_hpack_header) * hpack->slots);
+	}
+	hpack->head = (hpack->head + 1) % hpack->slots;
+	struct uwsgi_hpack_header *uhh = &hpack->entries[hpack->head];
+	uhh->name = uwsgi_malloc(name_len + value_len);
+	memcpy(uhh->name, name, name_len);
+	uhh->name_len = name_len;
+	uhh->value = uhh->name + name_len;
+	memcpy(uhh->value, value, value_len);
+	uhh->value_len = value_len;
+	hpack->size += size;
+	hpack->count++;
+}
+
+void uwsgi_hpack_init(struct uwsgi_hpack *hpack, size_t limit) {
+	memset(hpack, 0, sizeof(struct uwsgi_hpack));
+	hpack->limit = limit;
+	hpack->max_size = limit;
+}
+
+void uwsgi_hpack_free(struct uwsgi_hpack *hpack) {
+	hpack_evict(hpack, 0);
+	if (hpack->entries) free(hpack->entries);
+	hpack->entries = NULL;
+}
+
+/*
+	decode a header block, the headers are appended to ub as uwsgi keyvals
+	(16bit le size + name + 16bit le size + value)
+*/
+int uwsgi_hpack_decode(struct uwsgi_hpack *hpack, char *buf, size_t len, struct uwsgi_buffer *ub) {
+	uint8_t *ptr = (uint8_t *) buf;
+	uint8_t *watermark = ptr + len;
+	uint64_t index = 0;
+	while(ptr < watermark) {
+		uint8_t c = *ptr;
+		struct uwsgi_hpack_header *uhh = NULL;
+		// indexed header field
+		if (c & 0x80) {
+			if (hpack_read_int(&ptr, watermark, 7, &index)) return -1;
+			uhh = hpack_get(hpack, index);
+			if (!uhh) return -1;
+			if (uwsgi_buffer_append_keyval(ub, uhh->name, uhh->name_len, uhh->value, uhh->value_len)) return -1;
+			continue;
+		}
+		// dynamic table size update
+		if ((c & 0xe0) == 0x20) {
+			if (hpack_read_int(&ptr, watermark, 5, &index)) return -1;
+			if (index > hpack->limit) return -1;
+			hpack->max_size = index;
+			hpack_evict(hpack, hpack->max_size);
+			continue;
+		}
+		// literal header field (with incremental indexing, without indexing, never indexed)
+		int indexing = (c & 0xc0) == 0x40;
+		if (hpack_read_int(&ptr, watermark, indexing ? 6 : 4, &index)) return -1;
+		size_t base = ub->pos;
+		if (index) {
+			uhh = hpack_get(hpack, index);
+			if (!uhh) return -1;
+			if (uwsgi_buffer_u16le(ub, uhh->name_len)) return -1;
+			if (uwsgi_buffer_append(ub, uhh->name, uhh->name_len)) return -1;
+		}
+		else {
+			if (hpack_read_string(&ptr, watermark, ub)) return -1;
+		}
+		if (hpack_read_string(&ptr, watermark, ub)) return -1;
+		if (indexing) {
+			uint16_t name_len = (uint8_t) ub->buf[base] | ((uint8_t) ub->buf[base+1] << 8);
+			char *name = ub->buf + base + 2;
+			uint16_t value_len = (uint8_t) name[name_len] | ((uint8_t) name[name_len+1] << 8);
+			hpack_insert(hpack, name, name_len, name + name_len + 2, value_len);
+		}
+	}
+	return 0;
+}
+
+/*
+	encode a response header (name must be lowercase), the dynamic table is never used,
+	so the encoder does not need state
+*/
+int uwsgi_hpack_encode(struct uwsgi_buffer *ub, char *name, uint16_t name_len, char *value, uint16_t value_len) {
+	uint64_t i, index = 0;
+	for(i=0;i<HPACK_STATIC_ENTRIES;i++) {
+		struct uwsgi_hpack_header *uhh = &hpack_static_table[i];
+		if (uwsgi_strncmp(uhh->name, uhh->name_len, name, name_len)) continue;
+		if (!uwsgi_strncmp(uhh->value, uhh->value_len, value, value_len)) {
+			return hpack_write_int(ub, 0x80, 7, i+1);
+		}
+		if (!index) index = i+1;
+	}
+	// literal header field without indexing
+	if (hpack_write_int(ub, 0, 4, index)) return -1;
+	if (!index) {
+		if (hpack_write_int(ub, 0, 7, name_len)) return -1;
+		if (uwsgi_buffer_append(ub, name, name_len)) return -1;
+	}
+	if (hpack_write_int(ub, 0, 7, value_len)) return -1;
+	return uwsgi_buffer_append(ub, value, value_len);
+}
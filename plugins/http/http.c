@@ -16,9 +16,12 @@ struct uwsgi_option http_options[] = {
 	{"https2", required_argument, 0, "add an https/spdy router/server using keyval options", uwsgi_opt_https2, &uhttp, 0},
 	{"https-export-cert", no_argument, 0, "export uwsgi variable HTTPS_CC containing the raw client certificate", uwsgi_opt_true, &uhttp.https_export_cert, 0},
 	{"https-session-context", required_argument, 0, "set the session id context to the specified value", uwsgi_opt_set_str, &uhttp.https_session_context, 0},
+	{"https-handshake-threads", required_argument, 0, "run the TLS handshakes in the specified number of helper threads", uwsgi_opt_set_int, &uhttp.https_handshake_threads, 0},
 	{"http-to-https", required_argument, 0, "add an http router/server on the specified address and redirect all of the requests to https", uwsgi_opt_http_to_https, &uhttp, 0},
 #endif
 	{"http-processes", required_argument, 0, "set the number of http processes to spawn", uwsgi_opt_set_int, &uhttp.cr.processes, 0},
+	{"http-reuse-port", no_argument, 0, "give each http process its own SO_REUSEPORT listener", uwsgi_opt_true, &uhttp.cr.reuse_port, 0},
+	{"http-prealloc", required_argument, 0, "preallocate the specified number of sessions (with their peers and buffers) in each http router process", uwsgi_opt_set_64bit, &uhttp.cr.prealloc, 0},
 	{"http-workers", required_argument, 0, "set the number of http processes to spawn", uwsgi_opt_set_int, &uhttp.cr.processes, 0},
 	{"http-var", required_argument, 0, "add a key=value item to the generated uwsgi packet", uwsgi_opt_add_string_list, &uhttp.http_vars, 0},
 	{"http-to", required_argument, 0, "forward requests to the specified node (you can specify it multiple time for lb)", uwsgi_opt_add_string_list, &uhttp.cr.static_nodes, 0 },
@@ -32,8 +35,14 @@ struct uwsgi_option http_options[] = {
 	{"http-events", required_argument, 0, "set the number of concurrent http async events", uwsgi_opt_set_int, &uhttp.cr.nevents, 0},
 	{"http-subscription-server", required_argument, 0, "enable the subscription server", uwsgi_opt_corerouter_ss, &uhttp, 0},
 	{"http-timeout", required_argument, 0, "set internal http socket timeout", uwsgi_opt_set_int, &uhttp.cr.socket_timeout, 0},
+	{"http-backend-pool", required_argument, 0, "reuse connections to persistent uwsgi (--puwsgi-socket) backends, keeping up to the specified number of idle ones per backend", uwsgi_opt_set_int, &uhttp.cr.backend_pool, 0},
+	{"http-backend-mux", no_argument, 0, "send requests to persistent uwsgi (--puwsgi-socket) backends using the multiplexed framing (implies --http-backend-pool 8)", uwsgi_opt_true, &uhttp.cr.backend_mux, 0},
+	{"http-adaptive-limit", required_argument, 0, "limit the requests in flight to each backend with a concurrency limit adapted to its latency (up to the specified value)", uwsgi_opt_set_int, &uhttp.cr.adaptive_limit, 0},
+	{"http-adaptive-limit-queue", required_argument, 0, "let the specified number of requests per backend wait for a free slot of the adaptive concurrency limit (up to --http-connect-timeout), the others get a 503", uwsgi_opt_set_int, &uhttp.cr.adaptive_limit_queue, 0},
+	{"http-handoff", no_argument, 0, "pass the plain HTTP client connections to backends bound to UNIX sockets (--http-handoff-socket) instead of proxying them", uwsgi_opt_true, &uhttp.cr.handoff, 0},
 	{"http-manage-expect", optional_argument, 0, "manage the Expect HTTP request header (optionally checking for Content-Length)", uwsgi_opt_set_64bit, &uhttp.manage_expect, 0},
 	{"http-keepalive", optional_argument, 0, "HTTP 1.1 keepalive support (non-pipelined) requests", uwsgi_opt_set_int, &uhttp.keepalive, 0},
+	{"http-response-hint", no_argument, 0, "ask uwsgi backends for a compact response metadata packet, avoiding the parsing of their response headers", uwsgi_opt_true, &uhttp.response_hint, 0},
 	{"http-auto-chunked", no_argument, 0, "automatically transform output to chunked encoding during HTTP 1.1 keepalive (if needed)", uwsgi_opt_true, &uhttp.auto_chunked, 0},
 #ifdef UWSGI_ZLIB
 	{"http-auto-gzip", no_argument, 0, "automatically gzip content if uWSGI-Encoding header is set to gzip, but content size (Content-Length/Transfer-Encoding) and Content-Encoding are not specified", uwsgi_opt_true, &uhttp.auto_gzip, 0},
@@ -58,7 +67,15 @@ struct uwsgi_option http_options[] = {
 	{"http-uid", required_argument, 0, "drop http router privileges to the specified uid", uwsgi_opt_uid, &uhttp.cr.uid, 0 },
 	{"http-gid", required_argument, 0, "drop http router privileges to the specified gid", uwsgi_opt_gid, &uhttp.cr.gid, 0 },
 	{"http-resubscribe", required_argument, 0, "forward subscriptions to the specified subscription server", uwsgi_opt_add_string_list, &uhttp.cr.resubscribe, 0},
+	{"http-subscriptions-snapshot", required_argument, 0, "periodically dump the subscriptions table to the specified file and reload it on startup", uwsgi_opt_set_str, &uhttp.cr.subscriptions_snapshot, 0},
+	{"http-subscriptions-snapshot-freq", required_argument, 0, "set the interval (in seconds) of subscriptions snapshot dumps (default 10)", uwsgi_opt_set_int, &uhttp.cr.subscriptions_snapshot_freq, 0},
+	{"http-subscription-peer", required_argument, 0, "on startup bootstrap the subscriptions table from the specified peer subscription server", uwsgi_opt_add_string_list, &uhttp.cr.subscription_peers, 0},
 	{"http-buffer-size", required_argument, 0, "set internal buffer size (default: page size)", uwsgi_opt_set_64bit, &uhttp.cr.buffer_size, 0},
+	{"http-ratelimit", required_argument, 0, "reject (429) the clients over the specified rate limiter (--ratelimit), keyed by their address", uwsgi_opt_set_str, &uhttp.cr.ratelimit_name, 0},
+	{"http-chash-key", required_argument, 0, "set the key of the chash subscription algo: uri, path or header:<name> (default: the client address)", uwsgi_opt_set_str, &uhttp.cr.chash_key, 0},
+	{"http-splice", no_argument, 0, "forward request bodies and responses of plain (non keepalive) connections with splice() (Linux only)", uwsgi_opt_true, &uhttp.cr.splice, 0},
+	{"http-batch-events", no_argument, 0, "apply the changes of the http event interests in a batch before waiting (epoll only)", uwsgi_opt_true, &uhttp.cr.defer_events, 0},
+	{"http-edge-triggered", no_argument, 0, "use edge-triggered events for the http peers (epoll only, implies batched events)", uwsgi_opt_true, &uhttp.cr.edge_triggered, 0},
 
 	{"http-server-name-as-http-host", required_argument, 0, "force SERVER_NAME to HTTP_HOST", uwsgi_opt_true, &uhttp.server_name_as_http_host, 0},
 	{"http-headers-timeout", required_argument, 0, "set internal http socket timeout for headers", uwsgi_opt_set_int, &uhttp.headers_timeout, 0},
@@ -66,10 +83,19 @@ struct uwsgi_option http_options[] = {
 
 	{"http-manage-source", no_argument, 0, "manage the SOURCE HTTP method placing the session in raw mode", uwsgi_opt_true, &uhttp.manage_source, 0},
 	{"http-enable-proxy-protocol", optional_argument, 0, "manage PROXY protocol requests", uwsgi_opt_true, &uhttp.enable_proxy_protocol, 0},
+	{"http-alt-svc", required_argument, 0, "add an Alt-Svc header to the responses, advertising another endpoint of the service (like an HTTP/3 terminator: h3=\":443\"; ma=86400)", uwsgi_opt_set_str, &uhttp.alt_svc, 0},
+	{"http-trace", no_argument, 0, "generate W3C traceparent and X-Request-Start headers for requests missing them", uwsgi_opt_true, &uhttp.trace, 0},
+	{"http-enable-http2", no_argument, 0, "enable HTTP/2 (h2c with prior knowledge on plain sockets, ALPN on https ones)", uwsgi_opt_true, &uhttp.http2, 0},
 
 	{"http-backend-http", no_argument, 0, "use plain http protocol instead of uwsgi for backend nodes", uwsgi_opt_true, &uhttp.proto_http, 0},
 
 	{"http-manage-rtsp", no_argument, 0, "manage RTSP sessions", uwsgi_opt_true, &uhttp.manage_rtsp, 0},
+
+	{"http-cache", required_argument, 0, "serve GET responses from the specified (local) uWSGI cache directly in the http router", uwsgi_opt_set_str, &uhttp.cache, 0},
+	{"http-cache-key", required_argument, 0, "add a request part to the http cache key: method, scheme, host, uri, path, query or header:<name> (default: host and uri)", uwsgi_opt_add_string_list, &uhttp.cache_key, 0},
+	{"http-cache-expires", required_argument, 0, "set the number of seconds http cache items are fresh (default 60)", uwsgi_opt_set_int, &uhttp.cache_expires, 0},
+	{"http-cache-stale", required_argument, 0, "serve expired http cache items for the specified number of seconds while a single request revalidates them", uwsgi_opt_set_int, &uhttp.cache_stale, 0},
+	{"http-cache-max-size", required_argument, 0, "do not store responses bigger than the specified size in the http cache", uwsgi_opt_set_64bit, &uhttp.cache_max_size, 0},
 	{0, 0, 0, 0, 0, 0, 0},
 };
 
@@ -105,7 +131,7 @@ static int rebuild_key_for_mountpoint(struct http_session *hr, struct corerouter
 	return 0;
 }
 
-static void http_set_timeout(struct corerouter_peer *peer, int timeout) {
+void http_set_timeout(struct corerouter_peer *peer, int timeout) {
 	if (peer->current_timeout == timeout) return;
 	peer->current_timeout = timeout;
 	peer->timeout = corerouter_reset_timeout(peer->session->corerouter, peer);
@@ -198,33 +224,39 @@ static int http_header_dumb_check(struct http_session *hr, struct corerouter_pee
 	return 0;
 }
 
+// jump to the next CR (memchr() is vectorized by the libc)
+static inline char *http_next_cr(char *ptr, char *watermark) {
+	char *cr = memchr(ptr, '\r', watermark - ptr);
+	return cr ? cr : watermark;
+}
+
 static char * http_header_to_cgi(char *hh, size_t hhlen, size_t *keylen, size_t *vallen, int *has_prefix) {
 	size_t i;
 	char *val = hh;
-	int status = 0;
+	// only the name is converted, values (think about big cookies) are never scanned
 	for (i = 0; i < hhlen; i++) {
-                if (!status) {
-                        hh[i] = toupper((int) hh[i]);
-                        if (hh[i] == '-')
-                                hh[i] = '_';
-                        if (hh[i] == ':') {
-                                status = 1;
-                                *keylen = i;
-                        }
-                }
-                else if (status == 1 && hh[i] != ' ') {
-                        status = 2;
-                        val += i;
-                        *vallen+=1;
-                }
-                else if (status == 2) {
-                        *vallen+=1;
-                }
-        }
+		char c = hh[i];
+		if (c == ':') break;
+		if (c >= 'a' && c <= 'z') {
+			hh[i] = c - ('a' - 'A');
+		}
+		else if (c == '-') {
+			hh[i] = '_';
+		}
+	}
 
-	if (!(*keylen))
+	if (i == 0 || i >= hhlen)
                 return NULL;
 
+	*keylen = i;
+	for (i++; i < hhlen; i++) {
+		if (hh[i] != ' ') {
+			val += i;
+			*vallen = hhlen - i;
+			break;
+		}
+	}
+
 	if (uwsgi_strncmp("CONTENT_LENGTH", 14, hh, *keylen) && uwsgi_strncmp("CONTENT_TYPE", 12, hh, *keylen)) {
 		*has_prefix = 0x02;
         }
@@ -232,6 +264,36 @@ static char * http_header_to_cgi(char *hh, size_t hhlen, size_t *keylen, size_t
 	return val;
 }
 
+// xorshift64*, the ids only need to be unique, not unpredictable
+static uint64_t http_trace_rand(void) {
+	if (!uhttp.trace_seed) {
+		uhttp.trace_seed = ((uint64_t) getpid() << 32) ^ uwsgi_micros();
+		if (!uhttp.trace_seed) uhttp.trace_seed = 1;
+	}
+	uhttp.trace_seed ^= uhttp.trace_seed >> 12;
+	uhttp.trace_seed ^= uhttp.trace_seed << 25;
+	uhttp.trace_seed ^= uhttp.trace_seed >> 27;
+	return uhttp.trace_seed * 0x2545F4914F6CDD1DULL;
+}
+
+// 00-<trace-id>-<parent-id>-01 (55 chars, not zero terminated)
+static void http_trace_traceparent(char *buf) {
+	uint64_t ids[3];
+	int i, j;
+	ids[0] = http_trace_rand();
+	ids[1] = http_trace_rand();
+	ids[2] = http_trace_rand();
+	char *ptr = buf;
+	*ptr++ = '0'; *ptr++ = '0'; *ptr++ = '-';
+	for (i = 0; i < 3; i++) {
+		for (j = 60; j >= 0; j -= 4) {
+			*ptr++ = "0123456789abcdef"[(ids[i] >> j) & 0xf];
+		}
+		if (i > 0) *ptr++ = '-';
+	}
+	*ptr++ = '0'; *ptr++ = '1';
+}
+
 static int http_add_uwsgi_header(struct corerouter_peer *peer, char *hh, size_t keylen, char *val, size_t vallen, int prefix) {
 
 	struct uwsgi_buffer *out = peer->out;
@@ -369,6 +431,18 @@ static int http_headers_parse_first_round(struct corerouter_peer *peer) {
 			// if we want to allow sub-keys, we need to parse the first part of the REQUEST_URI
                         hr->request_uri = base;
                         hr->request_uri_len = ptr - base;
+			// affinity key for the chash subscription algo
+			if (uhttp.cr.chash_key) {
+				if (!strcmp(uhttp.cr.chash_key, "uri")) {
+					peer->chash_key = base;
+					peer->chash_key_len = UMIN(ptr - base, 0xffff);
+				}
+				else if (!strcmp(uhttp.cr.chash_key, "path")) {
+					char *qs = memchr(base, '?', ptr - base);
+					peer->chash_key = base;
+					peer->chash_key_len = UMIN((qs ? qs : ptr) - base, 0xffff);
+				}
+			}
                         ptr++;
                         found = 1;
                         break;
@@ -383,6 +457,8 @@ static int http_headers_parse_first_round(struct corerouter_peer *peer) {
         base = ptr;
         found = 0;
         while (ptr < watermark) {
+                ptr = http_next_cr(ptr, watermark);
+                if (ptr >= watermark) break;
                 if (*ptr == '\r') {
                         if (ptr + 1 >= watermark)
                                 return 0;
@@ -404,6 +480,8 @@ static int http_headers_parse_first_round(struct corerouter_peer *peer) {
         //HEADERS
         base = ptr;
         while (ptr < watermark) {
+                ptr = http_next_cr(ptr, watermark);
+                if (ptr >= watermark) break;
                 if (*ptr == '\r') {
                         if (ptr + 1 >= watermark)
                                 break;
@@ -424,6 +502,17 @@ static int http_headers_parse_first_round(struct corerouter_peer *peer) {
 				}
                         }
 
+			if (uhttp.cr.chash_key && !uwsgi_starts_with(uhttp.cr.chash_key, strlen(uhttp.cr.chash_key), "header:", 7)) {
+				char *name = uhttp.cr.chash_key + 7;
+				size_t name_len = strlen(name);
+				if ((size_t) (ptr - base) > name_len && base[name_len] == ':' && !uwsgi_strnicmp(name, name_len, base, name_len)) {
+					char *value = base + name_len + 1;
+					while(value < ptr && *value == ' ') value++;
+					peer->chash_key = value;
+					peer->chash_key_len = UMIN(ptr - value, 0xffff);
+				}
+			}
+
                         // last line, do not waste time
                         if (ptr - base == 0) break;
                         ptr++;
@@ -442,7 +531,7 @@ static int http_headers_parse_dumb(struct corerouter_peer *peer, int skip) {
         char *base = ptr + skip;
 
 	// leave space for X-Forwarded-For and X-Forwarded-Proto: https
-	peer->out = uwsgi_buffer_new(hr->headers_size + 256);
+	peer->out = uwsgi_cr_buffer_new(&uhttp.cr, hr->headers_size + 256);
         // force this buffer to be destroyed as soon as possibile
         peer->out_need_free = 1;
         peer->out->limit = UMAX16;
@@ -490,6 +579,8 @@ static int http_headers_parse_dumb(struct corerouter_peer *peer, int skip) {
         base = ptr;
         found = 0;
         while (ptr < watermark) {
+                ptr = http_next_cr(ptr, watermark);
+                if (ptr >= watermark) break;
                 if (*ptr == '\r') {
                         if (ptr + 1 >= watermark)
                                 return 0;
@@ -515,6 +606,8 @@ static int http_headers_parse_dumb(struct corerouter_peer *peer, int skip) {
 	//HEADERS
         base = ptr;
         while (ptr < watermark) {
+                ptr = http_next_cr(ptr, watermark);
+                if (ptr >= watermark) break;
                 if (*ptr == '\r') {
                         if (ptr + 1 >= watermark)
                                 break;
@@ -582,7 +675,7 @@ int http_headers_parse(struct corerouter_peer *peer, int skip) {
 	char *base = ptr + skip;
 	char *query_string = NULL;
 
-	peer->out = uwsgi_buffer_new(uwsgi.page_size);
+	peer->out = uwsgi_cr_buffer_new(&uhttp.cr, uwsgi.page_size);
 	// force this buffer to be destroyed as soon as possibile
 	peer->out_need_free = 1;
 	peer->out->limit = UMAX16;
@@ -601,6 +694,11 @@ int http_headers_parse(struct corerouter_peer *peer, int skip) {
 			if (uhttp.manage_source && !uwsgi_strncmp(base, ptr - base, "SOURCE", 6)) {
 				hr->raw_body = 1;
 			}
+			// HEAD responses have no body (and cannot be reused)
+			if (!uwsgi_strncmp(base, ptr - base, "HEAD", 4)) {
+				peer->pool_no_body = 1;
+				peer->pool_no_reuse = 1;
+			}
 			ptr++;
 			found = 1;
 			break;
@@ -677,6 +775,8 @@ int http_headers_parse(struct corerouter_peer *peer, int skip) {
 	base = ptr;
 	found = 0;
 	while (ptr < watermark) {
+		ptr = http_next_cr(ptr, watermark);
+		if (ptr >= watermark) break;
 		if (*ptr == '\r') {
 			if (ptr + 1 >= watermark)
 				return 0;
@@ -716,6 +816,13 @@ int http_headers_parse(struct corerouter_peer *peer, int skip) {
 	// UWSGI_ROUTER
 	if (uwsgi_buffer_append_keyval(out, "UWSGI_ROUTER", 12, "http", 4)) return -1;
 
+	// ask for the response metadata (pooled and multiplexed backends have their own framing)
+	hr->response_hint = 0;
+	if (uhttp.response_hint && !uhttp.cr.backend_pool && !uhttp.cr.backend_mux) {
+		if (uwsgi_buffer_append_keyval(out, "UWSGI_RESPONSE_HINT", 19, "1", 1)) return -1;
+		hr->response_hint = 1;
+	}
+
 	// stud HTTPS
 	if (hr->stud_prefix_pos > 0) {
 		if (uwsgi_buffer_append_keyval(out, "HTTPS", 5, "on", 2)) return -1;
@@ -744,6 +851,8 @@ int http_headers_parse(struct corerouter_peer *peer, int skip) {
 	struct uwsgi_string_list *headers = NULL, *usl = NULL;
 
 	while (ptr < watermark) {
+		ptr = http_next_cr(ptr, watermark);
+		if (ptr >= watermark) break;
 		if (*ptr == '\r') {
 			if (ptr + 1 >= watermark)
 				break;
@@ -796,7 +905,12 @@ int http_headers_parse(struct corerouter_peer *peer, int skip) {
 
 	usl = headers;
 	int broken = 0;
+	int has_traceparent = 0, has_request_start = 0;
 	while(usl) {
+		if (uhttp.trace) {
+			if (!uwsgi_strncmp("TRACEPARENT", 11, usl->value, usl->len)) has_traceparent = 1;
+			else if (!uwsgi_strncmp("X_REQUEST_START", 15, usl->value, usl->len)) has_request_start = 1;
+		}
 		if (!broken) {
 			if (http_add_uwsgi_header(peer, usl->value, usl->len, usl->custom_ptr, (size_t) usl->custom, usl->custom2 & 0x02)) broken = 1;
 		}
@@ -810,6 +924,20 @@ int http_headers_parse(struct corerouter_peer *peer, int skip) {
 
 	if (broken) return -1;
 
+	if (uhttp.trace) {
+		if (!has_traceparent) {
+			char tp[55];
+			http_trace_traceparent(tp);
+			if (uwsgi_buffer_append_keyval(out, "HTTP_TRACEPARENT", 16, tp, 55)) return -1;
+		}
+		if (!has_request_start) {
+			char rs[2 + sizeof(UMAX64_STR)];
+			int rs_len = snprintf(rs, sizeof(rs), "t=%llu", (unsigned long long) uwsgi_micros());
+			if (rs_len <= 0 || rs_len >= (int) sizeof(rs)) return -1;
+			if (uwsgi_buffer_append_keyval(out, "HTTP_X_REQUEST_START", 20, rs, rs_len)) return -1;
+		}
+	}
+
 	struct uwsgi_string_list *hv = uhttp.http_vars;
 	while (hv) {
 		char *equal = strchr(hv->value, '=');
@@ -872,6 +1000,43 @@ ready:
 }
 
 
+// splice() needs the raw socket, with TLS only if the kernel does the encryption (kTLS)
+static int hr_can_splice(struct http_session *hr, int receive) {
+	if (hr->func_write == hr_write) return 1;
+#ifdef UWSGI_SSL
+	if (hr->func_write == hr_ssl_write) return hr_ssl_ktls(hr, receive);
+#endif
+	return 0;
+}
+
+// move the request body and the response to splice() hooks (the uwsgi packet has been sent)
+static void hr_splice_init(struct corerouter_peer *peer) {
+	struct http_session *hr = (struct http_session *) peer->session;
+	struct corerouter_peer *main_peer = peer->session->main_peer;
+
+	// the response must not be parsed nor transformed
+	if (!hr_can_splice(hr, 0) || hr->h2 || hr->session.can_keepalive || peer->pool_tracking || peer->mux) return;
+#ifdef UWSGI_SPDY
+	if (hr->spdy) return;
+#endif
+#ifdef UWSGI_ZLIB
+	if (hr->can_gzip) return;
+#endif
+
+	if (uwsgi_cr_splice_init(peer)) return;
+	peer->last_hook_read = uwsgi_cr_splice_read;
+
+	if (hr->content_length == 0 && !hr->raw_body) return;
+	if (!hr_can_splice(hr, 1)) return;
+	if (uwsgi_cr_splice_init(main_peer)) return;
+	if (hr->content_length) {
+		main_peer->splice_limited = 1;
+		main_peer->splice_remains = hr->content_length;
+		hr->content_length = 0;
+	}
+	main_peer->last_hook_read = uwsgi_cr_splice_read;
+}
+
 ssize_t hr_instance_write(struct corerouter_peer *peer) {
 	ssize_t len = cr_write(peer, "hr_instance_write()");
         // end on empty write
@@ -881,19 +1046,24 @@ ssize_t hr_instance_write(struct corerouter_peer *peer) {
         if (cr_write_complete(peer)) {
 		// destroy the buffer used for the uwsgi packet
 		if (peer->out_need_free == 1) {
-			uwsgi_buffer_destroy(peer->out);
+			uwsgi_cr_buffer_destroy(&uhttp.cr, peer->out);
 			peer->out_need_free = 0;
 			peer->out = NULL;
 			// reset the main_peer input stream
 			peer->session->main_peer->in->pos = 0;
+			if (uhttp.cr.splice) hr_splice_init(peer);
 		}
 		// reset the stream (main_peer->in = peer->out)
 		else {
 			peer->out->pos = 0;
+			if (peer->mux) peer->session->main_peer->in->pos = 0;
 		}
                 cr_reset_hooks(peer);
-#ifdef UWSGI_SPDY
 		struct http_session *hr = (struct http_session *) peer->session;
+		if (hr->h2) {
+			return http2_parse(peer->session->main_peer);
+		}
+#ifdef UWSGI_SPDY
 		if (hr->spdy) {
 			if (hr->spdy_update_window) {
 				if (uwsgi_buffer_fix(peer->in, 16)) return -1;
@@ -935,6 +1105,10 @@ ssize_t hr_write(struct corerouter_peer *main_peer) {
 			return len;
 		}
                 cr_reset_hooks(main_peer);
+		struct http_session *hr = (struct http_session *) main_peer->session;
+		if (hr->h2) {
+			return http2_flush(main_peer);
+		}
         }
 
         return len;
@@ -960,11 +1134,37 @@ ssize_t hr_instance_connected(struct corerouter_peer* peer) {
 }
 
 // check if the response allows for keepalive
+// append the Alt-Svc header to a response header block of *len bytes
+static int hr_add_alt_svc(struct uwsgi_buffer *ub, size_t *len) {
+	if (!uhttp.alt_svc) return 0;
+	size_t hlen = *len;
+	if (hlen < 4 || ub->buf[hlen-2] != '\r' || ub->buf[hlen-1] != '\n') return 0;
+	if (uwsgi_buffer_insert(ub, hlen-2, "Alt-Svc: ", 9)) return -1;
+	if (uwsgi_buffer_insert(ub, hlen-2+9, uhttp.alt_svc, uhttp.alt_svc_len)) return -1;
+	if (uwsgi_buffer_insert(ub, hlen-2+9+uhttp.alt_svc_len, "\r\n", 2)) return -1;
+	*len += 9 + uhttp.alt_svc_len + 2;
+	return 0;
+}
+
 int hr_check_response_keepalive(struct corerouter_peer *peer) {
 	struct http_session *hr = (struct http_session *) peer->session;
 	struct uwsgi_buffer *ub = peer->in;
+
+	// the backend already told us where the headers end and what they contain
+	if (hr->response_hint == 2) {
+		if (ub->pos < hr->response_hint_size) return 1;
+		peer->r_parser_status = 4;
+		size_t hlen = hr->response_hint_size;
+		if (hr_add_alt_svc(ub, &hlen)) return -1;
+		if (http_response_apply(hr, ub, hlen, hr->response_hint_flags)) {
+			return -1;
+		}
+		return 0;
+	}
+
 	size_t i;
-	for(i=0;i<ub->pos;i++) {
+	// continue from the bytes of the previous round
+	for(i=peer->r_parser_pos;i<ub->pos;i++) {
                 char c = ub->buf[i];
                 if (c == '\r' && (peer->r_parser_status == 0 || peer->r_parser_status == 2)) {
                         peer->r_parser_status++;
@@ -979,7 +1179,9 @@ int hr_check_response_keepalive(struct corerouter_peer *peer) {
                 else if (c == '\n' && peer->r_parser_status == 3) {
 			// end of headers
 			peer->r_parser_status = 4;
-			if (http_response_parse(hr, ub, i+1)) {
+			size_t hlen = i+1;
+			if (hr_add_alt_svc(ub, &hlen)) return -1;
+			if (http_response_parse(hr, ub, hlen)) {
 				return -1;
 			}
 			return 0;
@@ -989,6 +1191,7 @@ int hr_check_response_keepalive(struct corerouter_peer *peer) {
                 }
         }
 
+	peer->r_parser_pos = ub->pos;
 	return 1;
 
 }
@@ -999,9 +1202,32 @@ ssize_t hr_instance_read(struct corerouter_peer *peer) {
 	if (uwsgi_buffer_ensure(peer->in, uwsgi.page_size)) return -1;
 	struct http_session *hr = (struct http_session *) peer->session;
         ssize_t len = cr_read(peer, "hr_instance_read()");
+	// strip the response metadata hint
+	if (len && hr->response_hint == 1) {
+		if ((uint8_t) peer->in->buf[0] != UWSGI_MODIFIER_RESPONSE_HINT) {
+			hr->response_hint = 0;
+		}
+		else {
+			if (peer->in->pos < 4) return 1;
+			hr->response_hint = 2;
+			hr->response_hint_size = (uint8_t) peer->in->buf[1] | ((uint8_t) peer->in->buf[2] << 8);
+			hr->response_hint_flags = peer->in->buf[3];
+			if (uwsgi_buffer_decapitate(peer->in, 4)) return -1;
+			if (!peer->in->pos) return 1;
+		}
+	}
+	// passive health check of the subscription node ("HTTP/1.x 5xx")
+	if (peer->un && !peer->outcome_reported && peer->in->pos >= 12) {
+		peer->outcome_reported = 1;
+		uwsgi_subscription_node_outcome(peer->un, peer->in->buf[9] == '5');
+	}
         if (!len) {
+		// the response is complete, store it
+		if (hr->cache_fill) hr_cache_done(hr, 1);
 		// disable keepalive on unread body
 		if (hr->content_length) hr->session.can_keepalive = 0;
+		// the backend could still be waiting for the body
+		if (hr->content_length || hr->raw_body) peer->pool_no_reuse = 1;
 		if (hr->session.can_keepalive) {
 			peer->session->main_peer->disabled = 0;
 			hr->rnrn = 0;
@@ -1054,9 +1280,9 @@ ssize_t hr_instance_read(struct corerouter_peer *peer) {
 
 	// need to parse response headers
 #ifdef UWSGI_ZLIB
-	if (hr->session.can_keepalive || hr->can_gzip) {
+	if (hr->session.can_keepalive || hr->can_gzip || uhttp.alt_svc) {
 #else
-	if (hr->session.can_keepalive) {
+	if (hr->session.can_keepalive || uhttp.alt_svc) {
 #endif
 		if (peer->r_parser_status != 4) {
 			int ret = hr_check_response_keepalive(peer);
@@ -1090,6 +1316,8 @@ ssize_t hr_instance_read(struct corerouter_peer *peer) {
 		}
 	}
 
+	if (hr->cache_response) hr_cache_store(hr, peer->in);
+
         // set the input buffer as the main output one
         peer->session->main_peer->out = peer->in;
         peer->session->main_peer->out_pos = 0;
@@ -1133,12 +1361,25 @@ ssize_t http_parse(struct corerouter_peer *main_peer) {
 				}
 			}
 		}
-		main_peer->session->peers->out = main_peer->in;
-		main_peer->session->peers->out_pos = 0;
-		cr_write_to_backend(main_peer->session->peers, hr_instance_write);
+		struct corerouter_peer *peer = main_peer->session->peers;
+		if (peer->mux) {
+			peer->out = uwsgi_cr_mux_body(peer, main_peer->in);
+			if (!peer->out) return -1;
+		}
+		else {
+			peer->out = main_peer->in;
+		}
+		peer->out_pos = 0;
+		cr_write_to_backend(peer, hr_instance_write);
 		return 1;
 	}
 
+	// HTTP/2 connection preface ?
+	if (hr->h2 || (uhttp.http2 && main_peer->in->pos >= 4 && !memcmp(main_peer->in->buf, "PRI ", 4))) {
+		hr->h2 = 1;
+		return http2_parse(main_peer);
+	}
+
 	// ensure the headers timeout is honoured
 	http_set_timeout(main_peer, uhttp.headers_timeout);
 
@@ -1150,6 +1391,13 @@ ssize_t http_parse(struct corerouter_peer *main_peer) {
 	hr->rnrn = 0;
 	
 	for (j = 0; j < len; j++) {
+		// outside of a line boundary only a CR can change the state
+		if (hr->rnrn == 0 && *ptr != '\r') {
+			char *cr = http_next_cr(ptr, main_peer->in->buf + len);
+			j += cr - ptr;
+			ptr = cr;
+			if (j >= len) break;
+		}
 		if (*ptr == '\r' && (hr->rnrn == 0 || hr->rnrn == 2)) {
 			hr->rnrn++;
 		}
@@ -1187,6 +1435,13 @@ ssize_t http_parse(struct corerouter_peer *main_peer) {
 				break;
 			}
 #endif
+			// hits are served without contacting the backends
+			if (uhttp.cache) {
+				int ret = hr_cache_lookup(new_peer, skip);
+				if (ret < 0) return -1;
+				if (ret > 0) break;
+			}
+
 			if (uwsgi.subscription_mountpoints) {
 				if (rebuild_key_for_mountpoint(hr, new_peer)) return -1;
 			}
@@ -1198,6 +1453,16 @@ ssize_t http_parse(struct corerouter_peer *main_peer) {
                 	if (new_peer->instance_address_len == 0)
                         	return -1;
 
+			// pass the client connection to the backend (the backend speaks HTTP directly to the client)
+			int handoff = uhttp.cr.handoff && !hr->stud_prefix_remains;
+#ifdef UWSGI_SSL
+			if (hr->ssl) handoff = 0;
+#endif
+			if (handoff) {
+				int ret = uwsgi_cr_handoff(new_peer, main_peer->in);
+				if (ret <= 0) return ret;
+			}
+
 			// parse HTTP request
 			if (new_peer->proto != 'h' && !uhttp.proto_http) {
 				if (http_headers_parse(new_peer, skip)) return -1;
@@ -1256,6 +1521,22 @@ ssize_t http_parse(struct corerouter_peer *main_peer) {
         		}
 
 
+			// multiplexed backends frame the response (upgraded and raw streams are not framed)
+			if (uhttp.cr.backend_mux && new_peer->proto != 'h' && !uhttp.proto_http && !hr->raw_body) {
+				if (uwsgi_cr_mux_request(new_peer, new_peer->out)) return -1;
+			}
+			// track the response framing of persistent backends
+			else if (uhttp.cr.backend_pool && new_peer->proto != 'h' && !uhttp.proto_http) {
+				new_peer->pool_tracking = 1;
+			}
+
+			// another request is already fetching this response
+			if (hr->cache_key) {
+				int ret = hr_cache_wait(new_peer);
+				if (ret < 0) return -1;
+				if (ret > 0) break;
+			}
+
 			new_peer->can_retry = 1;
 			// reset main timeout
 			http_set_timeout(main_peer, uhttp.cr.socket_timeout);
@@ -1287,6 +1568,10 @@ ssize_t hr_read(struct corerouter_peer *main_peer) {
 
 void hr_session_close(struct corerouter_session *cs) {
 	struct http_session *hr = (struct http_session *) cs;
+	hr_cache_done(hr, 0);
+	if (hr->cache_key) uwsgi_buffer_destroy(hr->cache_key);
+	if (hr->cache_response) uwsgi_buffer_destroy(hr->cache_response);
+
 	if (hr->path_info) {
 		free(hr->path_info);
 	}
@@ -1295,6 +1580,8 @@ void hr_session_close(struct corerouter_session *cs) {
 		uwsgi_buffer_destroy(hr->last_chunked);
 	}
 
+	http2_session_close(hr);
+
 #ifdef UWSGI_ZLIB
 	if (hr->z.next_in) {
 		deflateEnd(&hr->z);
@@ -1330,6 +1617,23 @@ ssize_t hr_recv_stud4(struct corerouter_peer * main_peer) {
 
 }
 
+// the backend is over its concurrency limit
+static int hr_shed(struct corerouter_peer *peer) {
+	struct http_session *hr = (struct http_session *) peer->session;
+	// multiplexed clients lose the whole connection
+	if (hr->h2) return -1;
+#ifdef UWSGI_SPDY
+	if (hr->spdy) return -1;
+#endif
+	peer->in->pos = 0;
+	if (uwsgi_buffer_append(peer->in, "HTTP/1.1 503 Service Unavailable\r\nConnection: close\r\nContent-Length: 0\r\n\r\n", 74)) return -1;
+	hr->session.wait_full_write = 1;
+	peer->session->main_peer->out = peer->in;
+	peer->session->main_peer->out_pos = 0;
+	cr_write_to_main(peer, hr->func_write);
+	return 0;
+}
+
 // retry connection to the backend
 static int hr_retry(struct corerouter_peer *peer) {
 
@@ -1360,6 +1664,7 @@ int http_alloc_session(struct uwsgi_corerouter *ucr, struct uwsgi_gateway_socket
 
 	// set the retry hook
         cs->retry = hr_retry;
+	cs->shed = hr_shed;
 	struct http_session *hr = (struct http_session *) cs;
 	// default hook
 	cs->main_peer->last_hook_read = hr_read;
@@ -1420,6 +1725,7 @@ void http_setup() {
 int http_init() {
 
 	uhttp.cr.session_size = sizeof(struct http_session);
+	if (uhttp.alt_svc) uhttp.alt_svc_len = strlen(uhttp.alt_svc);
 	uhttp.cr.alloc_session = http_alloc_session;
 	if (uhttp.cr.has_sockets && !uwsgi_corerouter_has_backends(&uhttp.cr)) {
 		if (!uwsgi.sockets) {
@@ -1428,6 +1734,8 @@ int http_init() {
 		uhttp.cr.use_socket = 1;
 		uhttp.cr.socket_num = 0;
 	}
+	hr_cache_init();
+	uhttp.cr.ratelimit_reply = "HTTP/1.1 429 Too Many Requests\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
 	uwsgi_corerouter_init((struct uwsgi_corerouter *) &uhttp);
 	return 0;
 }
@@ -0,0 +1,856 @@
+/*
+
+   uWSGI HTTP/2 router
+
+   every stream is mapped to a backend peer (peer->sid is the stream id),
+   requests are translated to uwsgi packets (or HTTP/1.0 for http backends)
+   and the HTTP/1.x responses of the backends are sent back as HEADERS + DATA frames.
+
+   HTTP/2 is enabled with --http-enable-http2, on plain sockets the client has to
+   start with the connection preface (h2c with prior knowledge), on https sockets
+   "h2" is negotiated via ALPN.
+
+*/
+
+#include "common.h"
+
+extern struct uwsgi_http uhttp;
+
+#define HTTP2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define HTTP2_PREFACE_LEN 24
+
+#define HTTP2_DATA		0x0
+#define HTTP2_HEADERS		0x1
+#define HTTP2_PRIORITY		0x2
+#define HTTP2_RST_STREAM	0x3
+#define HTTP2_SETTINGS		0x4
+#define HTTP2_PUSH_PROMISE	0x5
+#define HTTP2_PING		0x6
+#define HTTP2_GOAWAY		0x7
+#define HTTP2_WINDOW_UPDATE	0x8
+#define HTTP2_CONTINUATION	0x9
+
+#define HTTP2_FLAG_END_STREAM	0x1
+#define HTTP2_FLAG_ACK		0x1
+#define HTTP2_FLAG_END_HEADERS	0x4
+#define HTTP2_FLAG_PADDED	0x8
+#define HTTP2_FLAG_PRIORITY	0x20
+
+#define HTTP2_PROTOCOL_ERROR		0x1
+#define HTTP2_INTERNAL_ERROR		0x2
+#define HTTP2_FLOW_CONTROL_ERROR	0x3
+#define HTTP2_STREAM_CLOSED		0x5
+#define HTTP2_FRAME_SIZE_ERROR		0x6
+#define HTTP2_REFUSED_STREAM		0x7
+#define HTTP2_COMPRESSION_ERROR		0x9
+
+// protocol defaults (they are also our settings)
+#define HTTP2_MAX_FRAME		16384
+#define HTTP2_WINDOW		65535
+#define HTTP2_MAX_WINDOW	0x7fffffff
+#define HTTP2_MAX_STREAMS	128
+#define HTTP2_HEADER_TABLE	4096
+
+ssize_t hr_instance_read_to_h2(struct corerouter_peer *);
+
+static int http2_frame(struct uwsgi_buffer *ub, uint32_t len, uint8_t type, uint8_t flags, uint32_t sid) {
+	if (uwsgi_buffer_u24be(ub, len)) return -1;
+	if (uwsgi_buffer_u8(ub, type)) return -1;
+	if (uwsgi_buffer_u8(ub, flags)) return -1;
+	return uwsgi_buffer_u32be(ub, sid & 0x7fffffff);
+}
+
+static int http2_rst_stream(struct http_session *hr, uint32_t sid, uint32_t error) {
+	if (http2_frame(hr->h2_out, 4, HTTP2_RST_STREAM, 0, sid)) return -1;
+	return uwsgi_buffer_u32be(hr->h2_out, error);
+}
+
+static int http2_window_update(struct http_session *hr, uint32_t sid, uint32_t increment) {
+	if (http2_frame(hr->h2_out, 4, HTTP2_WINDOW_UPDATE, 0, sid)) return -1;
+	return uwsgi_buffer_u32be(hr->h2_out, increment);
+}
+
+// connection error, send GOAWAY and close the connection
+static ssize_t http2_goaway(struct corerouter_peer *main_peer, uint32_t error) {
+	struct http_session *hr = (struct http_session *) main_peer->session;
+	if (http2_frame(hr->h2_out, 8, HTTP2_GOAWAY, 0, 0)) return -1;
+	if (uwsgi_buffer_u32be(hr->h2_out, hr->h2_last_sid)) return -1;
+	if (uwsgi_buffer_u32be(hr->h2_out, error)) return -1;
+	hr->session.wait_full_write = 1;
+	main_peer->out = hr->h2_out;
+	main_peer->out_pos = 0;
+	cr_write_to_main(main_peer, hr->func_write);
+	return 1;
+}
+
+/*
+	send the queued frames to the client, the body of the responses
+	is framed in DATA frames honouring the flow control windows
+*/
+ssize_t http2_flush(struct corerouter_peer *main_peer) {
+	struct corerouter_session *cs = main_peer->session;
+	struct http_session *hr = (struct http_session *) cs;
+
+	struct corerouter_peer *peer = cs->peers;
+	while(peer) {
+		size_t pos = 0;
+		while (peer->r_parser_status == 4 && pos < peer->in->pos && hr->h2_window > 0 && peer->sid_window > 0) {
+			int64_t len = UMIN((int64_t) (peer->in->pos - pos), (int64_t) hr->h2_max_frame);
+			len = UMIN(len, hr->h2_window);
+			len = UMIN(len, peer->sid_window);
+			if (http2_frame(hr->h2_out, len, HTTP2_DATA, 0, peer->sid)) return -1;
+			if (uwsgi_buffer_append(hr->h2_out, peer->in->buf + pos, len)) return -1;
+			pos += len;
+			hr->h2_window -= len;
+			peer->sid_window -= len;
+		}
+		if (pos > 0) {
+			if (uwsgi_buffer_decapitate(peer->in, pos)) return -1;
+		}
+		peer = peer->next;
+	}
+
+	if (!hr->h2_out->pos) return 1;
+
+	main_peer->out = hr->h2_out;
+	main_peer->out_pos = 0;
+	cr_write_to_main(main_peer, hr->func_write);
+	return 1;
+}
+
+static int http2_add_header(struct uwsgi_buffer *hb, char *name, size_t name_len, char *value, size_t value_len) {
+	size_t i;
+	// connection specific headers are not allowed in HTTP/2
+	if (!uwsgi_strnicmp(name, name_len, "Connection", 10) ||
+		!uwsgi_strnicmp(name, name_len, "Keep-Alive", 10) ||
+		!uwsgi_strnicmp(name, name_len, "Proxy-Connection", 16) ||
+		!uwsgi_strnicmp(name, name_len, "Transfer-Encoding", 17) ||
+		!uwsgi_strnicmp(name, name_len, "Upgrade", 7)) {
+		return 0;
+	}
+	if (name_len > 0xffff || value_len > 0xffff) return -1;
+	for(i=0;i<name_len;i++) {
+		name[i] = tolower((int) name[i]);
+	}
+	return uwsgi_hpack_encode(hb, name, name_len, value, value_len);
+}
+
+/*
+	translate the HTTP/1.x response headers of a backend to a HEADERS frame,
+	returns 1 if more data is needed
+*/
+static int http2_response_headers(struct corerouter_peer *peer) {
+	struct http_session *hr = (struct http_session *) peer->session;
+	struct uwsgi_buffer *ub = peer->in;
+	size_t i, headers_size;
+
+again:
+	headers_size = 0;
+	for(i=3;i<ub->pos;i++) {
+		if (!memcmp(ub->buf + i - 3, "\r\n\r\n", 4)) {
+			headers_size = i + 1;
+			break;
+		}
+	}
+	if (!headers_size) return 1;
+
+	// status line
+	char *ptr = memchr(ub->buf, ' ', headers_size);
+	if (!ptr || (size_t) ((ptr + 4) - ub->buf) > headers_size) return -1;
+	char *status = ptr + 1;
+	// interim responses are discarded
+	if (status[0] == '1') {
+		if (uwsgi_buffer_decapitate(ub, headers_size)) return -1;
+		goto again;
+	}
+
+	struct uwsgi_buffer *hb = uwsgi_buffer_new(uwsgi.page_size);
+	if (uwsgi_hpack_encode(hb, ":status", 7, status, 3)) goto error;
+
+	char *watermark = ub->buf + headers_size - 2;
+	ptr = memchr(status, '\n', watermark - status);
+	if (!ptr) goto error;
+	ptr++;
+	while(ptr < watermark) {
+		char *eol = memchr(ptr, '\n', watermark - ptr);
+		if (!eol) break;
+		size_t line_len = eol - ptr;
+		if (line_len > 0 && ptr[line_len-1] == '\r') line_len--;
+		char *colon = memchr(ptr, ':', line_len);
+		if (colon) {
+			char *value = colon + 1;
+			size_t value_len = line_len - (value - ptr);
+			while(value_len > 0 && (*value == ' ' || *value == '\t')) {
+				value++;
+				value_len--;
+			}
+			if (http2_add_header(hb, ptr, colon - ptr, value, value_len)) goto error;
+		}
+		ptr = eol + 1;
+	}
+
+	// the header block could be bigger than a frame
+	size_t pos = 0;
+	uint8_t type = HTTP2_HEADERS;
+	for(;;) {
+		size_t len = UMIN(hb->pos - pos, hr->h2_max_frame);
+		uint8_t flags = (pos + len == hb->pos) ? HTTP2_FLAG_END_HEADERS : 0;
+		if (http2_frame(hr->h2_out, len, type, flags, peer->sid)) goto error;
+		if (uwsgi_buffer_append(hr->h2_out, hb->buf + pos, len)) goto error;
+		pos += len;
+		if (flags) break;
+		type = HTTP2_CONTINUATION;
+	}
+	uwsgi_buffer_destroy(hb);
+
+	peer->r_parser_status = 4;
+	// what remains is response body
+	return uwsgi_buffer_decapitate(ub, headers_size);
+
+error:
+	uwsgi_buffer_destroy(hb);
+	return -1;
+}
+
+// data from instance
+ssize_t hr_instance_read_to_h2(struct corerouter_peer *peer) {
+	struct corerouter_peer *main_peer = peer->session->main_peer;
+	struct http_session *hr = (struct http_session *) peer->session;
+
+	// waiting for window updates, stop reading from the instance
+	if (peer->r_parser_status == 4 && peer->in->pos > 0) {
+		if (uwsgi_cr_set_hooks(peer, NULL, NULL)) return -1;
+		return 1;
+	}
+
+	peer->in->limit = UMAX16;
+	if (uwsgi_buffer_ensure(peer->in, uwsgi.page_size)) return -1;
+	ssize_t len = cr_read(peer, "hr_instance_read_to_h2()");
+	if (!len) {
+		if (peer->r_parser_status != 4) {
+			if (http2_rst_stream(hr, peer->sid, HTTP2_INTERNAL_ERROR)) return -1;
+		}
+		else {
+			if (http2_frame(hr->h2_out, 0, HTTP2_DATA, HTTP2_FLAG_END_STREAM, peer->sid)) return -1;
+		}
+		if (http2_flush(main_peer) < 0) return -1;
+		return 0;
+	}
+
+	if (peer->r_parser_status != 4) {
+		int ret = http2_response_headers(peer);
+		if (ret < 0) return -1;
+		if (ret > 0) return 1;
+	}
+
+	return http2_flush(main_peer);
+}
+
+static int http2_next_header(struct uwsgi_buffer *hb, size_t *pos, char **name, uint16_t *name_len, char **value, uint16_t *value_len) {
+	if (*pos + 4 > hb->pos) return 0;
+	uint8_t *ptr = (uint8_t *) hb->buf + *pos;
+	*name_len = ptr[0] | (ptr[1] << 8);
+	*name = (char *) ptr + 2;
+	ptr += 2 + *name_len;
+	*value_len = ptr[0] | (ptr[1] << 8);
+	*value = (char *) ptr + 2;
+	*pos += 4 + *name_len + *value_len;
+	return 1;
+}
+
+static char *http2_header_to_cgi(char *name, uint16_t name_len, uint16_t *cgi_len) {
+	uint16_t i;
+	if (!uwsgi_strncmp(name, name_len, "content-length", 14)) {
+		*cgi_len = 14;
+		return uwsgi_str("CONTENT_LENGTH");
+	}
+	if (!uwsgi_strncmp(name, name_len, "content-type", 12)) {
+		*cgi_len = 12;
+		return uwsgi_str("CONTENT_TYPE");
+	}
+	char *cgi = uwsgi_malloc(name_len + 6);
+	memcpy(cgi, "HTTP_", 5);
+	for(i=0;i<name_len;i++) {
+		cgi[i+5] = name[i] == '-' ? '_' : toupper((int) name[i]);
+	}
+	cgi[name_len + 5] = 0;
+	*cgi_len = name_len + 5;
+	return cgi;
+}
+
+// build the uwsgi packet of the request
+static int http2_build_uwsgi(struct corerouter_peer *peer, struct uwsgi_buffer *hb, char *method, uint16_t method_len, char *path, uint16_t path_len) {
+	struct http_session *hr = (struct http_session *) peer->session;
+	struct uwsgi_buffer *out = peer->out;
+
+	// leave space for the uwsgi header
+	out->pos = 4;
+
+	if (uwsgi_buffer_append_keyval(out, "REQUEST_METHOD", 14, method, method_len)) return -1;
+	if (uwsgi_buffer_append_keyval(out, "REQUEST_URI", 11, path, path_len)) return -1;
+
+	uint16_t path_info_len = path_len;
+	char *query_string = memchr(path, '?', path_len);
+	if (query_string) {
+		path_info_len = query_string - path;
+		query_string++;
+		if (uwsgi_buffer_append_keyval(out, "QUERY_STRING", 12, query_string, path_len - (path_info_len + 1))) return -1;
+	}
+	else {
+		if (uwsgi_buffer_append_keyval(out, "QUERY_STRING", 12, "", 0)) return -1;
+	}
+
+	// PATH_INFO must be url-decoded !!!
+	char *path_info = uwsgi_malloc(path_info_len + 1);
+	http_url_decode(path, &path_info_len, path_info);
+	if (uwsgi_buffer_append_keyval(out, "PATH_INFO", 9, path_info, path_info_len)) {
+		free(path_info);
+		return -1;
+	}
+	free(path_info);
+
+	if (uwsgi_buffer_append_keyval(out, "SERVER_PROTOCOL", 15, "HTTP/2.0", 8)) return -1;
+	if (uwsgi_buffer_append_keyval(out, "SCRIPT_NAME", 11, "", 0)) return -1;
+	if (uhttp.server_name_as_http_host) {
+		if (uwsgi_buffer_append_keyval(out, "SERVER_NAME", 11, peer->key, peer->key_len)) return -1;
+	}
+	else {
+		if (uwsgi_buffer_append_keyval(out, "SERVER_NAME", 11, uwsgi.hostname, uwsgi.hostname_len)) return -1;
+	}
+	if (uwsgi_buffer_append_keyval(out, "SERVER_PORT", 11, hr->port, hr->port_len)) return -1;
+	if (uwsgi_buffer_append_keyval(out, "UWSGI_ROUTER", 12, "http", 4)) return -1;
+
+	if (hr->stud_prefix_pos > 0) {
+		if (uwsgi_buffer_append_keyval(out, "HTTPS", 5, "on", 2)) return -1;
+	}
+
+#ifdef UWSGI_SSL
+	// the key could be overwritten by the SNI name
+	uint8_t key_len = peer->key_len;
+	char key[0xff];
+	memcpy(key, peer->key, key_len);
+	if (hr_https_add_vars(hr, peer, out)) return -1;
+	memcpy(peer->key, key, key_len);
+	peer->key_len = key_len;
+#endif
+
+	if (hr->proxy_src) {
+		if (uwsgi_buffer_append_keyval(out, "REMOTE_ADDR", 11, hr->proxy_src, hr->proxy_src_len)) return -1;
+		if (hr->proxy_src_port) {
+			if (uwsgi_buffer_append_keyval(out, "REMOTE_PORT", 11, hr->proxy_src_port, hr->proxy_src_port_len)) return -1;
+		}
+	}
+	else {
+		if (uwsgi_buffer_append_keyval(out, "REMOTE_ADDR", 11, peer->session->client_address, strlen(peer->session->client_address))) return -1;
+		if (uwsgi_buffer_append_keyval(out, "REMOTE_PORT", 11, peer->session->client_port, strlen(peer->session->client_port))) return -1;
+	}
+
+	// merge the headers with the same name (cookies are split by the clients)
+	struct uwsgi_string_list *headers = NULL, *usl = NULL;
+	size_t pos = 0;
+	char *name, *value;
+	uint16_t name_len, value_len;
+	int has_authority = 0;
+	while(http2_next_header(hb, &pos, &name, &name_len, &value, &value_len)) {
+		if (!uwsgi_strncmp(name, name_len, ":authority", 10)) has_authority = 1;
+	}
+	pos = 0;
+	while(http2_next_header(hb, &pos, &name, &name_len, &value, &value_len)) {
+		if (name_len == 0) continue;
+		uint16_t cgi_len = 0;
+		char *cgi = NULL;
+		if (name[0] == ':') {
+			// :authority is the HTTP/2 Host header
+			if (!uwsgi_strncmp(name, name_len, ":authority", 10)) {
+				cgi = uwsgi_str("HTTP_HOST");
+				cgi_len = 9;
+			}
+			else if (!uwsgi_strncmp(name, name_len, ":scheme", 7)) {
+				cgi = uwsgi_str("UWSGI_SCHEME");
+				cgi_len = 12;
+			}
+			else {
+				continue;
+			}
+		}
+		else {
+			if (has_authority && !uwsgi_strncmp(name, name_len, "host", 4)) continue;
+			cgi = http2_header_to_cgi(name, name_len, &cgi_len);
+		}
+		usl = uwsgi_string_list_has_item(headers, cgi, cgi_len);
+		if (usl) {
+			free(cgi);
+			char *old_value = usl->custom_ptr;
+			if (!uwsgi_strncmp(name, name_len, "cookie", 6)) {
+				usl->custom_ptr = uwsgi_concat3n(old_value, usl->custom, "; ", 2, value, value_len);
+			}
+			else {
+				usl->custom_ptr = uwsgi_concat3n(old_value, usl->custom, ", ", 2, value, value_len);
+			}
+			usl->custom += 2 + value_len;
+			if (usl->custom2) free(old_value);
+			usl->custom2 = 1;
+		}
+		else {
+			usl = uwsgi_string_new_list(&headers, cgi);
+			usl->len = cgi_len;
+			usl->custom_ptr = value;
+			usl->custom = value_len;
+		}
+	}
+
+	int broken = 0;
+	usl = headers;
+	while(usl) {
+		if (!broken) {
+			if (usl->custom > 0xffff || uwsgi_buffer_append_keyval(out, usl->value, usl->len, usl->custom_ptr, usl->custom)) broken = 1;
+		}
+		if (usl->custom2) free(usl->custom_ptr);
+		free(usl->value);
+		struct uwsgi_string_list *tmp_usl = usl;
+		usl = usl->next;
+		free(tmp_usl);
+	}
+	if (broken) return -1;
+
+	struct uwsgi_string_list *hv = uhttp.http_vars;
+	while (hv) {
+		char *equal = strchr(hv->value, '=');
+		if (equal) {
+			if (uwsgi_buffer_append_keyval(out, hv->value, equal - hv->value, equal + 1, strlen(equal + 1))) return -1;
+		}
+		hv = hv->next;
+	}
+
+	if (uhttp.modifier1) peer->modifier1 = uhttp.modifier1;
+	if (uhttp.modifier2) peer->modifier2 = uhttp.modifier2;
+
+	uint16_t pktsize = out->pos - 4;
+	out->buf[0] = peer->modifier1;
+	out->buf[1] = (uint8_t) (pktsize & 0xff);
+	out->buf[2] = (uint8_t) ((pktsize >> 8) & 0xff);
+	out->buf[3] = peer->modifier2;
+	return 0;
+}
+
+// build an HTTP/1.0 request for http backends
+static int http2_build_http(struct corerouter_peer *peer, struct uwsgi_buffer *hb, char *method, uint16_t method_len, char *path, uint16_t path_len) {
+	struct uwsgi_buffer *out = peer->out;
+	out->pos = 0;
+
+	if (uwsgi_buffer_append(out, method, method_len)) return -1;
+	if (uwsgi_buffer_append(out, " ", 1)) return -1;
+	if (uwsgi_buffer_append(out, path, path_len)) return -1;
+	if (uwsgi_buffer_append(out, " HTTP/1.0\r\nHost: ", 17)) return -1;
+	if (uwsgi_buffer_append(out, peer->key, peer->key_len)) return -1;
+	if (uwsgi_buffer_append(out, "\r\nX-Forwarded-For: ", 19)) return -1;
+	if (uwsgi_buffer_append(out, peer->session->client_address, strlen(peer->session->client_address))) return -1;
+
+	size_t pos = 0;
+	char *name, *value;
+	uint16_t name_len, value_len;
+	while(http2_next_header(hb, &pos, &name, &name_len, &value, &value_len)) {
+		if (name_len == 0 || name[0] == ':') continue;
+		if (!uwsgi_strncmp(name, name_len, "host", 4)) continue;
+		if (uwsgi_buffer_append(out, "\r\n", 2)) return -1;
+		if (uwsgi_buffer_append(out, name, name_len)) return -1;
+		if (uwsgi_buffer_append(out, ": ", 2)) return -1;
+		if (uwsgi_buffer_append(out, value, value_len)) return -1;
+	}
+
+	return uwsgi_buffer_append(out, "\r\nConnection: close\r\n\r\n", 23);
+}
+
+/*
+	a complete header block has been received, create a new stream (peer)
+	and connect it to the backend, returns 1 if the parser has to wait for the connection
+*/
+static ssize_t http2_stream_new(struct corerouter_peer *main_peer, uint32_t sid, uint8_t flags) {
+	struct corerouter_session *cs = main_peer->session;
+	struct http_session *hr = (struct http_session *) cs;
+	struct uwsgi_corerouter *ucr = cs->corerouter;
+
+	struct uwsgi_buffer *hb = uwsgi_buffer_new(uwsgi.page_size);
+	// the dynamic table must be updated even for refused streams
+	if (uwsgi_hpack_decode(&hr->h2_hpack, hr->h2_headers->buf, hr->h2_headers->pos, hb)) {
+		uwsgi_buffer_destroy(hb);
+		return http2_goaway(main_peer, HTTP2_COMPRESSION_ERROR);
+	}
+	hr->h2_headers->pos = 0;
+
+	// trailers (or headers for closed streams) are ignored
+	if (sid <= hr->h2_last_sid) {
+		uwsgi_buffer_destroy(hb);
+		return 0;
+	}
+	hr->h2_last_sid = sid;
+
+	int streams = 0;
+	struct corerouter_peer *stream = cs->peers;
+	while(stream) {
+		streams++;
+		stream = stream->next;
+	}
+
+	if (hr->h2_goaway || streams >= HTTP2_MAX_STREAMS) {
+		uwsgi_buffer_destroy(hb);
+		if (http2_rst_stream(hr, sid, HTTP2_REFUSED_STREAM)) return -1;
+		return 0;
+	}
+
+	char *method = NULL, *path = NULL, *authority = NULL;
+	uint16_t method_len = 0, path_len = 0, authority_len = 0;
+	size_t pos = 0;
+	char *name, *value;
+	uint16_t name_len, value_len;
+	while(http2_next_header(hb, &pos, &name, &name_len, &value, &value_len)) {
+		if (!uwsgi_strncmp(name, name_len, ":method", 7)) {
+			method = value; method_len = value_len;
+		}
+		else if (!uwsgi_strncmp(name, name_len, ":path", 5)) {
+			path = value; path_len = value_len;
+		}
+		else if (!uwsgi_strncmp(name, name_len, ":authority", 10)) {
+			authority = value; authority_len = value_len;
+		}
+		else if (!authority && !uwsgi_strncmp(name, name_len, "host", 4)) {
+			authority = value; authority_len = value_len;
+		}
+	}
+
+	if (!method || !path || !authority || authority_len > 0xff) {
+		uwsgi_buffer_destroy(hb);
+		if (http2_rst_stream(hr, sid, HTTP2_PROTOCOL_ERROR)) return -1;
+		return 0;
+	}
+
+	struct corerouter_peer *new_peer = uwsgi_cr_peer_add(cs);
+	new_peer->last_hook_read = hr_instance_read_to_h2;
+	new_peer->sid = sid;
+	new_peer->sid_window = hr->h2_initial_window;
+	new_peer->out = uwsgi_cr_buffer_new(ucr, uwsgi.page_size);
+	new_peer->out->limit = UMAX16;
+	// the buffer is reused for the request body
+	new_peer->out_need_free = 2;
+	new_peer->out_pos = 0;
+
+	memcpy(new_peer->key, authority, authority_len);
+	new_peer->key_len = authority_len;
+
+	if (ucr->mapper(ucr, new_peer) || new_peer->instance_address_len == 0) {
+		uwsgi_buffer_destroy(hb);
+		if (http2_rst_stream(hr, sid, HTTP2_REFUSED_STREAM)) return -1;
+		corerouter_close_peer(ucr, new_peer);
+		return 0;
+	}
+
+	int ret;
+	if (new_peer->proto != 'h' && !uhttp.proto_http) {
+		ret = http2_build_uwsgi(new_peer, hb, method, method_len, path, path_len);
+		// track the response framing of persistent backends
+		if (uhttp.cr.backend_pool) new_peer->pool_tracking = 1;
+	}
+	else {
+		ret = http2_build_http(new_peer, hb, method, method_len, path, path_len);
+	}
+	uwsgi_buffer_destroy(hb);
+
+	if (ret) {
+		if (http2_rst_stream(hr, sid, HTTP2_INTERNAL_ERROR)) return -1;
+		corerouter_close_peer(ucr, new_peer);
+		return 0;
+	}
+
+	// HEAD responses have no body (and cannot be reused), the same for requests with a body
+	if (!uwsgi_strncmp(method, method_len, "HEAD", 4)) {
+		new_peer->pool_no_body = 1;
+		new_peer->pool_no_reuse = 1;
+	}
+	if (!(flags & HTTP2_FLAG_END_STREAM)) {
+		new_peer->pool_no_reuse = 1;
+	}
+
+	new_peer->can_retry = 1;
+	http_set_timeout(new_peer, uhttp.connect_timeout);
+	cr_connect(new_peer, hr_instance_connected);
+	return 1;
+}
+
+static ssize_t http2_manage_data(struct corerouter_peer *main_peer, uint8_t *buf, uint32_t len, uint8_t flags, uint32_t sid) {
+	struct http_session *hr = (struct http_session *) main_peer->session;
+
+	if (sid == 0) return http2_goaway(main_peer, HTTP2_PROTOCOL_ERROR);
+
+	struct corerouter_peer *peer = uwsgi_cr_peer_find_by_sid(&hr->session, sid);
+
+	// the whole frame (padding included) is flow controlled
+	if (len > 0) {
+		if (http2_window_update(hr, 0, len)) return -1;
+		if (peer && !(flags & HTTP2_FLAG_END_STREAM)) {
+			if (http2_window_update(hr, sid, len)) return -1;
+		}
+	}
+
+	if (!peer) {
+		if (http2_rst_stream(hr, sid, HTTP2_STREAM_CLOSED)) return -1;
+		return 0;
+	}
+
+	if (flags & HTTP2_FLAG_PADDED) {
+		if (len < 1 || buf[0] >= len) return http2_goaway(main_peer, HTTP2_PROTOCOL_ERROR);
+		len -= buf[0] + 1;
+		buf++;
+	}
+
+	if (len == 0) return 0;
+
+	peer->out->pos = 0;
+	if (uwsgi_buffer_append(peer->out, (char *) buf, len)) return -1;
+	peer->out_pos = 0;
+	cr_write_to_backend(peer, hr_instance_write);
+	return 1;
+}
+
+static ssize_t http2_manage_headers(struct corerouter_peer *main_peer, uint8_t *buf, uint32_t len, uint8_t flags, uint32_t sid) {
+	struct http_session *hr = (struct http_session *) main_peer->session;
+
+	if (sid == 0 || !(sid & 1)) return http2_goaway(main_peer, HTTP2_PROTOCOL_ERROR);
+
+	uint32_t pad = 0;
+	if (flags & HTTP2_FLAG_PADDED) {
+		if (len < 1) return http2_goaway(main_peer, HTTP2_PROTOCOL_ERROR);
+		pad = buf[0];
+		buf++;
+		len--;
+	}
+	// stream dependency and weight
+	if (flags & HTTP2_FLAG_PRIORITY) {
+		if (len < 5) return http2_goaway(main_peer, HTTP2_PROTOCOL_ERROR);
+		buf += 5;
+		len -= 5;
+	}
+	if (pad > len) return http2_goaway(main_peer, HTTP2_PROTOCOL_ERROR);
+	len -= pad;
+
+	hr->h2_headers->pos = 0;
+	if (uwsgi_buffer_append(hr->h2_headers, (char *) buf, len)) return http2_goaway(main_peer, HTTP2_PROTOCOL_ERROR);
+
+	if (!(flags & HTTP2_FLAG_END_HEADERS)) {
+		hr->h2_headers_sid = sid;
+		hr->h2_headers_flags = flags;
+		return 0;
+	}
+
+	return http2_stream_new(main_peer, sid, flags);
+}
+
+static ssize_t http2_manage_continuation(struct corerouter_peer *main_peer, uint8_t *buf, uint32_t len, uint8_t flags, uint32_t sid) {
+	struct http_session *hr = (struct http_session *) main_peer->session;
+
+	if (sid != hr->h2_headers_sid) return http2_goaway(main_peer, HTTP2_PROTOCOL_ERROR);
+	if (uwsgi_buffer_append(hr->h2_headers, (char *) buf, len)) return http2_goaway(main_peer, HTTP2_PROTOCOL_ERROR);
+
+	if (!(flags & HTTP2_FLAG_END_HEADERS)) return 0;
+
+	hr->h2_headers_sid = 0;
+	return http2_stream_new(main_peer, sid, hr->h2_headers_flags);
+}
+
+static ssize_t http2_manage_settings(struct corerouter_peer *main_peer, uint8_t *buf, uint32_t len, uint8_t flags, uint32_t sid) {
+	struct corerouter_session *cs = main_peer->session;
+	struct http_session *hr = (struct http_session *) cs;
+
+	if (sid != 0) return http2_goaway(main_peer, HTTP2_PROTOCOL_ERROR);
+
+	if (flags & HTTP2_FLAG_ACK) {
+		if (len != 0) return http2_goaway(main_peer, HTTP2_FRAME_SIZE_ERROR);
+		return 0;
+	}
+
+	if (len % 6) return http2_goaway(main_peer, HTTP2_FRAME_SIZE_ERROR);
+
+	uint32_t i;
+	for(i=0;i<len;i+=6) {
+		uint16_t id = uwsgi_be16((char *) buf + i);
+		uint32_t value = uwsgi_be32((char *) buf + i + 2);
+		// SETTINGS_INITIAL_WINDOW_SIZE
+		if (id == 0x4) {
+			if (value > HTTP2_MAX_WINDOW) return http2_goaway(main_peer, HTTP2_FLOW_CONTROL_ERROR);
+			int64_t delta = (int64_t) value - hr->h2_initial_window;
+			struct corerouter_peer *peers = cs->peers;
+			while(peers) {
+				peers->sid_window += delta;
+				peers = peers->next;
+			}
+			hr->h2_initial_window = value;
+		}
+		// SETTINGS_MAX_FRAME_SIZE
+		else if (id == 0x5) {
+			if (value < HTTP2_MAX_FRAME || value > 0xffffff) return http2_goaway(main_peer, HTTP2_PROTOCOL_ERROR);
+			// peer buffers are limited to 64k
+			hr->h2_max_frame = UMIN(value, 0xffff);
+		}
+	}
+
+	if (http2_frame(hr->h2_out, 0, HTTP2_SETTINGS, HTTP2_FLAG_ACK, 0)) return -1;
+	return 0;
+}
+
+static ssize_t http2_manage_window_update(struct corerouter_peer *main_peer, uint8_t *buf, uint32_t len, uint32_t sid) {
+	struct http_session *hr = (struct http_session *) main_peer->session;
+
+	if (len != 4) return http2_goaway(main_peer, HTTP2_FRAME_SIZE_ERROR);
+	uint32_t increment = uwsgi_be32((char *) buf) & 0x7fffffff;
+
+	if (sid == 0) {
+		if (increment == 0) return http2_goaway(main_peer, HTTP2_PROTOCOL_ERROR);
+		hr->h2_window += increment;
+		if (hr->h2_window > HTTP2_MAX_WINDOW) return http2_goaway(main_peer, HTTP2_FLOW_CONTROL_ERROR);
+		return 0;
+	}
+
+	struct corerouter_peer *peer = uwsgi_cr_peer_find_by_sid(&hr->session, sid);
+	if (!peer) return 0;
+	peer->sid_window += increment;
+	if (increment == 0 || peer->sid_window > HTTP2_MAX_WINDOW) {
+		if (http2_rst_stream(hr, sid, increment ? HTTP2_FLOW_CONTROL_ERROR : HTTP2_PROTOCOL_ERROR)) return -1;
+		corerouter_close_peer(hr->session.corerouter, peer);
+	}
+	return 0;
+}
+
+static ssize_t http2_init(struct corerouter_peer *main_peer) {
+	struct corerouter_session *cs = main_peer->session;
+	struct http_session *hr = (struct http_session *) cs;
+
+	hr->h2_out = uwsgi_buffer_new(uwsgi.page_size);
+	hr->h2_headers = uwsgi_buffer_new(uwsgi.page_size);
+	hr->h2_headers->limit = UMAX16;
+	uwsgi_hpack_init(&hr->h2_hpack, HTTP2_HEADER_TABLE);
+
+	hr->h2_window = HTTP2_WINDOW;
+	hr->h2_initial_window = HTTP2_WINDOW;
+	hr->h2_max_frame = HTTP2_MAX_FRAME;
+
+	// streams are closed without closing the connection
+	cs->can_keepalive = 1;
+	http_set_timeout(main_peer, uhttp.cr.socket_timeout);
+
+	// DATA frames are flow controlled, do not let Nagle delay window rounds
+	if (cs->client_sockaddr.sa.sa_family == AF_INET
+#ifdef AF_INET6
+		|| cs->client_sockaddr.sa.sa_family == AF_INET6
+#endif
+		) {
+		uwsgi_tcp_nodelay(main_peer->fd);
+	}
+
+	// server preface (SETTINGS_MAX_CONCURRENT_STREAMS)
+	if (http2_frame(hr->h2_out, 6, HTTP2_SETTINGS, 0, 0)) return -1;
+	if (uwsgi_buffer_u16be(hr->h2_out, 0x3)) return -1;
+	if (uwsgi_buffer_u32be(hr->h2_out, HTTP2_MAX_STREAMS)) return -1;
+	return 0;
+}
+
+/*
+	parse the frames sent by the client.
+
+	The parser stops (returning 1) whenever a frame needs to be written to
+	a backend (new streams and DATA frames), it is resumed by hr_instance_write()
+	as soon as the write is complete. All of the other frames only enqueue
+	responses that are sent to the client when no more frames are available.
+*/
+ssize_t http2_parse(struct corerouter_peer *main_peer) {
+	struct corerouter_session *cs = main_peer->session;
+	struct http_session *hr = (struct http_session *) cs;
+
+	if (!hr->h2_out) {
+		if (http2_init(main_peer)) return -1;
+	}
+
+	struct uwsgi_buffer *ub = main_peer->in;
+
+	if (!hr->h2_preface) {
+		size_t len = UMIN(ub->pos, HTTP2_PREFACE_LEN);
+		if (memcmp(ub->buf, HTTP2_PREFACE, len)) return -1;
+		if (len < HTTP2_PREFACE_LEN) return 1;
+		if (uwsgi_buffer_decapitate(ub, HTTP2_PREFACE_LEN)) return -1;
+		hr->h2_preface = 1;
+	}
+
+	while(ub->pos >= 9) {
+		uint8_t *buf = (uint8_t *) ub->buf;
+		uint32_t len = (buf[0] << 16) | (buf[1] << 8) | buf[2];
+		uint8_t type = buf[3];
+		uint8_t flags = buf[4];
+		uint32_t sid = uwsgi_be32((char *) buf + 5) & 0x7fffffff;
+
+		if (len > HTTP2_MAX_FRAME) return http2_goaway(main_peer, HTTP2_FRAME_SIZE_ERROR);
+		if (ub->pos < 9 + len) break;
+
+		// a header block cannot be interleaved with other frames
+		if (hr->h2_headers_sid && type != HTTP2_CONTINUATION) return http2_goaway(main_peer, HTTP2_PROTOCOL_ERROR);
+
+		ssize_t ret = 0;
+		buf += 9;
+		switch(type) {
+			case HTTP2_DATA:
+				ret = http2_manage_data(main_peer, buf, len, flags, sid);
+				break;
+			case HTTP2_HEADERS:
+				ret = http2_manage_headers(main_peer, buf, len, flags, sid);
+				break;
+			case HTTP2_CONTINUATION:
+				ret = http2_manage_continuation(main_peer, buf, len, flags, sid);
+				break;
+			case HTTP2_RST_STREAM:
+				if (len != 4) return http2_goaway(main_peer, HTTP2_FRAME_SIZE_ERROR);
+				{
+					struct corerouter_peer *peer = uwsgi_cr_peer_find_by_sid(cs, sid);
+					if (peer) {
+						corerouter_close_peer(cs->corerouter, peer);
+					}
+				}
+				break;
+			case HTTP2_SETTINGS:
+				ret = http2_manage_settings(main_peer, buf, len, flags, sid);
+				break;
+			case HTTP2_PING:
+				if (len != 8) return http2_goaway(main_peer, HTTP2_FRAME_SIZE_ERROR);
+				if (!(flags & HTTP2_FLAG_ACK)) {
+					if (http2_frame(hr->h2_out, 8, HTTP2_PING, HTTP2_FLAG_ACK, 0)) return -1;
+					if (uwsgi_buffer_append(hr->h2_out, (char *) buf, 8)) return -1;
+				}
+				break;
+			case HTTP2_WINDOW_UPDATE:
+				ret = http2_manage_window_update(main_peer, buf, len, sid);
+				break;
+			case HTTP2_GOAWAY:
+				hr->h2_goaway = 1;
+				if (!cs->peers) return 0;
+				break;
+			case HTTP2_PUSH_PROMISE:
+				return http2_goaway(main_peer, HTTP2_PROTOCOL_ERROR);
+			// PRIORITY and unknown frames are ignored
+			default:
+				break;
+		}
+
+		if (ret < 0) return -1;
+		// GOAWAY has been sent
+		if (cs->wait_full_write) return 1;
+		if (uwsgi_buffer_decapitate(ub, 9 + len)) return -1;
+		// wait for the backend write
+		if (ret > 0) return 1;
+	}
+
+	return http2_flush(main_peer);
+}
+
+void http2_session_close(struct http_session *hr) {
+	if (hr->h2_out) {
+		uwsgi_buffer_destroy(hr->h2_out);
+		uwsgi_buffer_destroy(hr->h2_headers);
+		uwsgi_hpack_free(&hr->h2_hpack);
+	}
+}
@@ -10,6 +10,17 @@
 
 extern struct uwsgi_http uhttp;
 
+#ifdef UWSGI_HTTP2_ALPN
+int hr_https_alpn(SSL *ssl, const unsigned char **out, unsigned char *outlen, const unsigned char *in, unsigned int inlen, void *arg) {
+	// the option could be parsed after the https sockets
+	if (!uhttp.http2) return SSL_TLSEXT_ERR_NOACK;
+	if (SSL_select_next_proto((unsigned char **) out, outlen, (const unsigned char *) "\x02h2\x08http/1.1", 12, in, inlen) != OPENSSL_NPN_NEGOTIATED) {
+		return SSL_TLSEXT_ERR_NOACK;
+	}
+	return SSL_TLSEXT_ERR_OK;
+}
+#endif
+
 void uwsgi_opt_https(char *opt, char *value, void *cr) {
         struct uwsgi_corerouter *ucr = (struct uwsgi_corerouter *) cr;
         char *client_ca = NULL;
@@ -54,6 +65,9 @@ void uwsgi_opt_https(char *opt, char *value, void *cr) {
 	if (!ugs->ctx) {
 		exit(1);
 	}
+#ifdef UWSGI_HTTP2_ALPN
+	SSL_CTX_set_alpn_select_cb(ugs->ctx, hr_https_alpn, NULL);
+#endif
         // set the ssl mode
         ugs->mode = UWSGI_HTTP_SSL;
 
@@ -124,6 +138,9 @@ void uwsgi_opt_https2(char *opt, char *value, void *cr) {
         if (!ugs->ctx) {
                 exit(1);
         }
+#ifdef UWSGI_HTTP2_ALPN
+	SSL_CTX_set_alpn_select_cb(ugs->ctx, hr_https_alpn, NULL);
+#endif
 #ifdef UWSGI_SPDY
 	if (s2_spdy) {
         	SSL_CTX_set_info_callback(ugs->ctx, uwsgi_spdy_info_cb);
@@ -177,19 +194,28 @@ int hr_https_add_vars(struct http_session *hr, struct corerouter_peer *peer, str
                         	memcpy(peer->key, servername, peer->key_len) ;
                         }
 #endif
-                hr->ssl_client_cert = SSL_get_peer_certificate(hr->ssl);
+		// the session could run multiple requests (keepalive, HTTP/2 streams)
+		if (!hr->ssl_client_cert) {
+                	hr->ssl_client_cert = SSL_get_peer_certificate(hr->ssl);
+		}
                 if (hr->ssl_client_cert) {
                         X509_NAME *name = X509_get_subject_name(hr->ssl_client_cert);
                         if (name) {
-                                hr->ssl_client_dn = X509_NAME_oneline(name, NULL, 0);
+				if (!hr->ssl_client_dn) {
+                                	hr->ssl_client_dn = X509_NAME_oneline(name, NULL, 0);
+				}
                                 if (uwsgi_buffer_append_keyval(out, "HTTPS_DN", 8, hr->ssl_client_dn, strlen(hr->ssl_client_dn))) return -1;
                         }
-                        if (uhttp.https_export_cert) {
+                        if (uhttp.https_export_cert && hr->ssl_cc) {
+                                if (uwsgi_buffer_append_keyval(out, "HTTPS_CC", 8, hr->ssl_cc, hr->ssl_cc_len)) return -1;
+                        }
+                        else if (uhttp.https_export_cert) {
                         hr->ssl_bio = BIO_new(BIO_s_mem());
                         if (hr->ssl_bio) {
                                 if (PEM_write_bio_X509(hr->ssl_bio, hr->ssl_client_cert) > 0) {
                                         size_t cc_len = BIO_pending(hr->ssl_bio);
                                         hr->ssl_cc = uwsgi_malloc(cc_len);
+                                        hr->ssl_cc_len = cc_len;
                                         BIO_read(hr->ssl_bio, hr->ssl_cc, cc_len);
                                         if (uwsgi_buffer_append_keyval(out, "HTTPS_CC", 8, hr->ssl_cc, cc_len)) return -1;
                                 }
@@ -286,6 +312,9 @@ ssize_t hr_ssl_write(struct corerouter_peer *main_peer) {
                         	return ret;
                 	}
                         cr_reset_hooks(main_peer);
+			if (hr->h2) {
+				return http2_flush(main_peer);
+			}
 #ifdef UWSGI_SPDY
 			if (hr->spdy) {
 				return spdy_parse(main_peer);
@@ -416,6 +445,210 @@ ssize_t hr_ssl_shutdown(struct corerouter_peer *peer) {
         return -1;
 }
 
+// is the kernel managing the encryption (send) or the decryption (receive) of the records ?
+int hr_ssl_ktls(struct http_session *hr, int receive) {
+#ifdef SSL_OP_ENABLE_KTLS
+	if (receive) {
+		// openssl could still have buffered plaintext
+		return SSL_pending(hr->ssl) == 0 && BIO_get_ktls_recv(SSL_get_rbio(hr->ssl));
+	}
+	return BIO_get_ktls_send(SSL_get_wbio(hr->ssl));
+#else
+	return 0;
+#endif
+}
+
+/*
+
+	TLS handshakes in helper threads
+
+	the session is passed (as a pointer) to one of the threads, which runs the handshake in its
+	own event loop and then writes the pointer to a pipe monitored by the router. In the meantime
+	the session is flagged as offloaded, so the router does not touch it.
+
+*/
+
+static struct uwsgi_thread **hr_ssl_handshake_threads;
+static int hr_ssl_handshake_pipe[2];
+static uint64_t hr_ssl_handshake_next;
+
+static void hr_ssl_handshake_return(struct uwsgi_thread *ut, struct http_session *hr) {
+	int fd = hr->session.main_peer->fd;
+	if (hr->ssl_handshake_events == 1) {
+		event_queue_del_fd(ut->queue, fd, event_queue_read());
+	}
+	else if (hr->ssl_handshake_events == 2) {
+		event_queue_del_fd(ut->queue, fd, event_queue_write());
+	}
+	hr->ssl_handshake_events = 0;
+	if (write(hr_ssl_handshake_pipe[1], &hr, sizeof(struct http_session *)) != sizeof(struct http_session *)) {
+		uwsgi_error("hr_ssl_handshake_return()/write()");
+	}
+}
+
+// 1 -> in progress, 0 -> done, -1 -> error
+static int hr_ssl_handshake_step(struct uwsgi_thread *ut, struct http_session *hr) {
+	int fd = hr->session.main_peer->fd;
+	int ret = SSL_do_handshake(hr->ssl);
+	if (ret == 1) return 0;
+
+	int err = SSL_get_error(hr->ssl, ret);
+	if (err == SSL_ERROR_WANT_READ) {
+		if (hr->ssl_handshake_events == 0) {
+			if (event_queue_add_fd_read(ut->queue, fd)) return -1;
+		}
+		else if (hr->ssl_handshake_events == 2) {
+			if (event_queue_fd_write_to_read(ut->queue, fd)) return -1;
+		}
+		hr->ssl_handshake_events = 1;
+		return 1;
+	}
+	else if (err == SSL_ERROR_WANT_WRITE) {
+		if (hr->ssl_handshake_events == 0) {
+			if (event_queue_add_fd_write(ut->queue, fd)) return -1;
+		}
+		else if (hr->ssl_handshake_events == 1) {
+			if (event_queue_fd_read_to_write(ut->queue, fd)) return -1;
+		}
+		hr->ssl_handshake_events = 2;
+		return 1;
+	}
+	else if (err == SSL_ERROR_SSL && uwsgi.ssl_verbose) {
+		ERR_print_errors_fp(stderr);
+	}
+	// the error queue is per-thread
+	ERR_clear_error();
+	return -1;
+}
+
+static void hr_ssl_handshake_loop(struct uwsgi_thread *ut) {
+	int i;
+	struct http_session *sessions = NULL;
+	void *events = event_queue_alloc(64);
+
+	for (;;) {
+		int nevents = event_queue_wait_multi(ut->queue, 1, events, 64);
+		time_t now = uwsgi_now();
+		for (i = 0; i < nevents; i++) {
+			struct http_session *hr = NULL, *prev = NULL;
+			int interesting_fd = event_queue_interesting_fd(events, i);
+			if (interesting_fd == ut->pipe[1]) {
+				if (read(ut->pipe[1], &hr, sizeof(struct http_session *)) != sizeof(struct http_session *)) continue;
+				hr->ssl_handshake_events = 0;
+				hr->ssl_handshake_deadline = now + uhttp.cr.socket_timeout;
+				hr->ssl_handshake_next = sessions;
+				sessions = hr;
+			}
+			else {
+				hr = sessions;
+				while (hr) {
+					if (hr->session.main_peer->fd == interesting_fd) break;
+					prev = hr;
+					hr = hr->ssl_handshake_next;
+				}
+				if (!hr) continue;
+			}
+
+			int ret = hr_ssl_handshake_step(ut, hr);
+			if (ret > 0) continue;
+			if (prev) {
+				prev->ssl_handshake_next = hr->ssl_handshake_next;
+			}
+			else {
+				sessions = hr->ssl_handshake_next;
+			}
+			hr->ssl_handshake_failed = ret < 0;
+			hr_ssl_handshake_return(ut, hr);
+		}
+
+		// expire stuck handshakes
+		struct http_session *hr = sessions, *prev = NULL;
+		while (hr) {
+			struct http_session *next = hr->ssl_handshake_next;
+			if (hr->ssl_handshake_deadline <= now) {
+				if (prev) {
+					prev->ssl_handshake_next = next;
+				}
+				else {
+					sessions = next;
+				}
+				hr->ssl_handshake_failed = 1;
+				hr_ssl_handshake_return(ut, hr);
+			}
+			else {
+				prev = hr;
+			}
+			hr = next;
+		}
+	}
+}
+
+// called by the router when handshakes are completed
+static void hr_ssl_handshake_done(struct uwsgi_corerouter *ucr, int fd) {
+	struct http_session *sessions[64];
+	ssize_t len = read(fd, sessions, sizeof(sessions));
+	if (len <= 0) return;
+
+	int i;
+	for (i = 0; i < (int) (len / sizeof(struct http_session *)); i++) {
+		struct http_session *hr = sessions[i];
+		struct corerouter_peer *main_peer = hr->session.main_peer;
+		hr->session.offloaded = 0;
+		if (hr->ssl_handshake_failed) {
+			corerouter_close_peer(ucr, main_peer);
+			continue;
+		}
+		main_peer->timeout = corerouter_reset_timeout(ucr, main_peer);
+		if (uwsgi_cr_set_hooks(main_peer, hr_ssl_read, NULL)) {
+			corerouter_close_peer(ucr, main_peer);
+			continue;
+		}
+		// the request could be already buffered by openssl
+		errno = 0;
+		ssize_t ret = hr_ssl_read(main_peer);
+		if (ret == 0 || (ret < 0 && errno != EINPROGRESS)) {
+			main_peer->session->can_keepalive = 0;
+			corerouter_close_peer(ucr, main_peer);
+		}
+	}
+}
+
+static int hr_ssl_handshake_offload(struct http_session *hr) {
+	struct uwsgi_corerouter *ucr = hr->session.corerouter;
+	int i;
+
+	// threads are started on the first handshake of the router process
+	if (!hr_ssl_handshake_threads) {
+		if (pipe(hr_ssl_handshake_pipe)) {
+			uwsgi_error("hr_ssl_handshake_offload()/pipe()");
+			uhttp.https_handshake_threads = 0;
+			return -1;
+		}
+		uwsgi_socket_nb(hr_ssl_handshake_pipe[0]);
+		hr_ssl_handshake_threads = uwsgi_calloc(sizeof(struct uwsgi_thread *) * uhttp.https_handshake_threads);
+		for (i = 0; i < uhttp.https_handshake_threads; i++) {
+			hr_ssl_handshake_threads[i] = uwsgi_thread_new(hr_ssl_handshake_loop);
+			if (!hr_ssl_handshake_threads[i]) {
+				uwsgi_log("[uwsgi-http] unable to start TLS handshake thread %d\n", i);
+				exit(1);
+			}
+		}
+		ucr->event_fd = hr_ssl_handshake_pipe[0];
+		ucr->event_hook = hr_ssl_handshake_done;
+		if (event_queue_add_fd_read(ucr->queue, ucr->event_fd)) {
+			exit(1);
+		}
+	}
+
+	struct uwsgi_thread *ut = hr_ssl_handshake_threads[hr_ssl_handshake_next++ % uhttp.https_handshake_threads];
+	hr->session.offloaded = 1;
+	if (write(ut->pipe[0], &hr, sizeof(struct http_session *)) != sizeof(struct http_session *)) {
+		hr->session.offloaded = 0;
+		return -1;
+	}
+	return 0;
+}
+
 void hr_setup_ssl(struct http_session *hr, struct uwsgi_gateway_socket *ugs) {
  	hr->ssl = SSL_new(ugs->ctx);
         SSL_set_fd(hr->ssl, hr->session.main_peer->fd);
@@ -423,10 +656,12 @@ void hr_setup_ssl(struct http_session *hr, struct uwsgi_gateway_socket *ugs) {
 #ifdef UWSGI_SPDY
         SSL_set_ex_data(hr->ssl, uhttp.spdy_index, hr);
 #endif
-        uwsgi_cr_set_hooks(hr->session.main_peer, hr_ssl_read, NULL);
 	hr->session.main_peer->flush = hr_ssl_shutdown;
         hr->session.close = hr_session_ssl_close;
 	hr->func_write = hr_ssl_write;
+	// on failure the handshake runs in the router
+	if (uhttp.https_handshake_threads > 0 && !hr_ssl_handshake_offload(hr)) return;
+        uwsgi_cr_set_hooks(hr->session.main_peer, hr_ssl_read, NULL);
 }
 
 #endif
@@ -6,19 +6,21 @@ extern struct uwsgi_http uhttp;
 static char gzheader[10] = { 0x1f, 0x8b, Z_DEFLATED, 0, 0, 0, 0, 0, 0, 3 };
 #endif
 
+// scan the response header block (len bytes) for the flags http_response_apply() needs
 int http_response_parse(struct http_session *hr, struct uwsgi_buffer *ub, size_t len) {
 
         size_t i;
         size_t next = 0;
 
 	char *buf = ub->buf;
+	uint8_t flags = 0;
 
         int found = 0;
         // protocol
         for(i=0;i<len;i++) {
                 if (buf[i] == ' ') {
-			if (hr->session.can_keepalive && uwsgi_strncmp("HTTP/1.1", 8, buf, i)) {
-				goto end;
+			if (uwsgi_strncmp("HTTP/1.1", 8, buf, i)) {
+				flags |= UWSGI_RESPONSE_HINT_NOT_HTTP11;
 			}
                         if (i+1 >= len) return -1;;
                         next = i+1;
@@ -58,9 +60,6 @@ int http_response_parse(struct http_session *hr, struct uwsgi_buffer *ub, size_t
 
         uint32_t h_len = 0;
 
-	int has_size = 0;
-	int has_connection = 0;
-
         for(i=next;i<len;i++) {
                 if (key) {
                         if (buf[i] == '\r' || buf[i] == '\n') {
@@ -68,39 +67,29 @@ int http_response_parse(struct http_session *hr, struct uwsgi_buffer *ub, size_t
                                 if (!colon) return -1;
                                 // security check
                                 if (colon+2 >= buf+len) return -1;
-#ifdef UWSGI_ZLIB
-				if (hr->session.can_keepalive || (uhttp.auto_gzip && hr->can_gzip)) {
-#else
-				if (hr->session.can_keepalive) {
-#endif
-					if (!uwsgi_strnicmp(key, colon-key, "Connection", 10)) {
-						has_connection = 1;
-						if (!uwsgi_strnicmp(colon+2, h_len-((colon-key)+2), "close", 5)) {
-							goto end;
-						}
-					}
-					else if (!uwsgi_strnicmp(key, colon-key, "Trailers", 8)) {
-						goto end;
-					}
-					else if (!uwsgi_strnicmp(key, colon-key, "Content-Length", 14)) {
-						has_size = 1;
-					}
-					else if (!uwsgi_strnicmp(key, colon-key, "Transfer-Encoding", 17)) {
-						has_size = 1;
+				if (!uwsgi_strnicmp(key, colon-key, "Connection", 10)) {
+					flags |= UWSGI_RESPONSE_HINT_HAS_CONNECTION;
+					if (!uwsgi_strnicmp(colon+2, h_len-((colon-key)+2), "close", 5)) {
+						flags |= UWSGI_RESPONSE_HINT_CLOSE;
 					}
 				}
-#ifdef UWSGI_ZLIB
-				if (uhttp.auto_gzip && hr->can_gzip) {
-					if (!uwsgi_strnicmp(key, colon-key, "Content-Encoding", 16)) {
-						hr->can_gzip = 0;
-					}
-					else if (!uwsgi_strnicmp(key, colon-key, "uWSGI-Encoding", 14)) {
-						if (!uwsgi_strnicmp(colon+2, h_len-((colon-key)+2), "gzip", 4)) {
-							hr->has_gzip = 1;
-                                                }
+				else if (!uwsgi_strnicmp(key, colon-key, "Trailers", 8)) {
+					flags |= UWSGI_RESPONSE_HINT_CLOSE;
+				}
+				else if (!uwsgi_strnicmp(key, colon-key, "Content-Length", 14)) {
+					flags |= UWSGI_RESPONSE_HINT_HAS_SIZE;
+				}
+				else if (!uwsgi_strnicmp(key, colon-key, "Transfer-Encoding", 17)) {
+					flags |= UWSGI_RESPONSE_HINT_HAS_SIZE;
+				}
+				else if (!uwsgi_strnicmp(key, colon-key, "Content-Encoding", 16)) {
+					flags |= UWSGI_RESPONSE_HINT_HAS_ENCODING;
+				}
+				else if (!uwsgi_strnicmp(key, colon-key, "uWSGI-Encoding", 14)) {
+					if (!uwsgi_strnicmp(colon+2, h_len-((colon-key)+2), "gzip", 4)) {
+						flags |= UWSGI_RESPONSE_HINT_UWSGI_GZIP;
 					}
 				}
-#endif
                                 key = NULL;
                                 h_len = 0;
                         }
@@ -116,6 +105,35 @@ int http_response_parse(struct http_session *hr, struct uwsgi_buffer *ub, size_t
                 }
         }
 
+	return http_response_apply(hr, ub, len, flags);
+
+end:
+	hr->session.can_keepalive = 0;
+        return 0;
+}
+
+// decide keepalive, chunking and gzip of a response from the flags of its header block (len bytes)
+int http_response_apply(struct http_session *hr, struct uwsgi_buffer *ub, size_t len, uint8_t flags) {
+
+	char *buf = ub->buf;
+
+	if (hr->session.can_keepalive && (flags & UWSGI_RESPONSE_HINT_NOT_HTTP11)) goto end;
+	if (flags & UWSGI_RESPONSE_HINT_CLOSE) goto end;
+
+	int has_size = flags & UWSGI_RESPONSE_HINT_HAS_SIZE;
+	int has_connection = flags & UWSGI_RESPONSE_HINT_HAS_CONNECTION;
+
+#ifdef UWSGI_ZLIB
+	if (uhttp.auto_gzip && hr->can_gzip) {
+		if (flags & UWSGI_RESPONSE_HINT_HAS_ENCODING) {
+			hr->can_gzip = 0;
+		}
+		else if (flags & UWSGI_RESPONSE_HINT_UWSGI_GZIP) {
+			hr->has_gzip = 1;
+		}
+	}
+#endif
+
 	if (!has_size) {
 #ifdef UWSGI_ZLIB
 		if (hr->has_gzip) {
@@ -2,6 +2,16 @@
 #include <jni.h>
 #include <jvmti.h>
 
+#define UWSGI_JVM_DIRECT_CHUNK 65536
+
+// per-core direct ByteBuffers, created once and reused by every request
+struct uwsgi_jvm_direct {
+	char *vars_ptr;
+	jobject vars;
+	char *body_chunk;
+	jobject body;
+};
+
 struct uwsgi_jvm {
 
 	JavaVM *vm;
@@ -29,6 +39,9 @@ struct uwsgi_jvm {
 	jclass set_class;
 	jclass iterator_class;
 	jclass bool_class;
+	jclass map_entry_class;
+	jclass iterable_class;
+	jclass buffer_class;
 
 	jclass runtime_exception;
 	jclass io_exception;
@@ -36,6 +49,16 @@ struct uwsgi_jvm {
 	jmethodID api_signal_handler_mid;
 	jmethodID api_rpc_function_mid;
 
+	jmethodID input_stream_read_mid;
+	jmethodID input_stream_close_mid;
+	jmethodID map_entry_key_mid;
+	jmethodID map_entry_value_mid;
+	jmethodID iterable_iterator_mid;
+	jmethodID buffer_clear_mid;
+	jmethodID buffer_limit_mid;
+
+	struct uwsgi_jvm_direct *direct;
+
 	int (*request_handlers[UMAX8])(struct wsgi_request *);
 	int (*request_handlers_setup[UMAX8])(void);
 };
@@ -117,3 +140,5 @@ char *uwsgi_jvm_bytearray2c(jobject);
 void uwsgi_jvm_release_bytearray(jobject, char *);
 
 jobject uwsgi_jvm_to_string(jobject);
+
+jobject uwsgi_jvm_request_vars_buffer(struct wsgi_request *);
@@ -26,10 +26,45 @@ int uwsgi_jvm_register_request_handler(uint8_t modifier2,int (*setup)(void), int
 	return 0;
 }
 
+// rewind a pooled direct buffer and limit it to the valid data
+static int uwsgi_jvm_buffer_reset(jobject bb, size_t len) {
+	jobject ret = (*ujvm_env)->CallObjectMethod(ujvm_env, bb, ujvm.buffer_clear_mid);
+	if (uwsgi_jvm_exception()) return -1;
+	uwsgi_jvm_local_unref(ret);
+	ret = (*ujvm_env)->CallObjectMethod(ujvm_env, bb, ujvm.buffer_limit_mid, (jint) len);
+	if (uwsgi_jvm_exception()) return -1;
+	uwsgi_jvm_local_unref(ret);
+	return 0;
+}
+
+/*
+	a view of the request vars (the uwsgi packet without the 4 bytes header),
+	the core buffer never changes, so the ByteBuffer is created only once per core
+*/
+jobject uwsgi_jvm_request_vars_buffer(struct wsgi_request *wsgi_req) {
+	struct uwsgi_jvm_direct *ujd = &ujvm.direct[wsgi_req->async_id];
+	if (!ujd->vars || ujd->vars_ptr != wsgi_req->buffer) {
+		if (ujd->vars) uwsgi_jvm_unref(ujd->vars);
+		ujd->vars = NULL;
+		jobject bb = (*ujvm_env)->NewDirectByteBuffer(ujvm_env, wsgi_req->buffer, uwsgi.buffer_size);
+		if (!bb) return NULL;
+		ujd->vars = uwsgi_jvm_ref(bb);
+		uwsgi_jvm_local_unref(bb);
+		ujd->vars_ptr = wsgi_req->buffer;
+	}
+	if (uwsgi_jvm_buffer_reset(ujd->vars, wsgi_req->len)) return NULL;
+	return (*ujvm_env)->NewLocalRef(ujvm_env, ujd->vars);
+}
+
 JNIEXPORT jint JNICALL uwsgi_jvm_api_worker_id(JNIEnv *env, jclass c) {
 	return uwsgi.mywid;
 }
 
+JNIEXPORT jobject JNICALL uwsgi_jvm_api_request_vars(JNIEnv *env, jclass c) {
+	struct wsgi_request *wsgi_req = current_wsgi_req();
+	return uwsgi_jvm_request_vars_buffer(wsgi_req);
+}
+
 JNIEXPORT void JNICALL uwsgi_jvm_api_register_signal(JNIEnv *env, jclass c, jint signum, jstring target, jobject handler) {
 	// no need to release it
 	char *t = uwsgi_jvm_str2c(target);
@@ -171,6 +206,7 @@ static JNINativeMethod uwsgi_jvm_api_methods[] = {
 	{"register_signal", "(ILjava/lang/String;Luwsgi$SignalHandler;)V", (void *) &uwsgi_jvm_api_register_signal},
 	{"register_rpc", "(Ljava/lang/String;Luwsgi$RpcFunction;)V", (void *) &uwsgi_jvm_api_register_rpc},
 	{"worker_id", "()I", (void *) &uwsgi_jvm_api_worker_id},
+	{"request_vars", "()Ljava/nio/ByteBuffer;", (void *) &uwsgi_jvm_api_request_vars},
 	{"lock", "()V", (void *) &uwsgi_jvm_api_lock_zero},
 	{"unlock", "()V", (void *) &uwsgi_jvm_api_unlock_zero},
 	{"lock", "(I)V", (void *) &uwsgi_jvm_api_lock},
@@ -235,6 +271,34 @@ JNIEXPORT jint JNICALL uwsgi_jvm_request_body_readline_bytearray(JNIEnv *env, jo
 }
 
 
+JNIEXPORT jobject JNICALL uwsgi_jvm_request_body_read_direct(JNIEnv *env, jobject o) {
+	struct wsgi_request *wsgi_req = current_wsgi_req();
+	struct uwsgi_jvm_direct *ujd = &ujvm.direct[wsgi_req->async_id];
+	if (!ujd->body) {
+		ujd->body_chunk = uwsgi_malloc(UWSGI_JVM_DIRECT_CHUNK);
+		jobject bb = (*ujvm_env)->NewDirectByteBuffer(ujvm_env, ujd->body_chunk, UWSGI_JVM_DIRECT_CHUNK);
+		if (!bb) {
+			free(ujd->body_chunk);
+			ujd->body_chunk = NULL;
+			return NULL;
+		}
+		ujd->body = uwsgi_jvm_ref(bb);
+		uwsgi_jvm_local_unref(bb);
+	}
+	ssize_t rlen = 0;
+	char *chunk = uwsgi_request_body_read(wsgi_req, UWSGI_JVM_DIRECT_CHUNK, &rlen);
+	if (!chunk) {
+		uwsgi_jvm_throw_io("error reading request body");
+		return NULL;
+	}
+	if (chunk == uwsgi.empty) {
+		return NULL;
+	}
+	memcpy(ujd->body_chunk, chunk, rlen);
+	if (uwsgi_jvm_buffer_reset(ujd->body, rlen)) return NULL;
+	return (*ujvm_env)->NewLocalRef(ujvm_env, ujd->body);
+}
+
 JNIEXPORT jint JNICALL uwsgi_jvm_request_body_available(JNIEnv *env, jobject o) {
 	struct wsgi_request *wsgi_req = current_wsgi_req();
 	return (jint) (wsgi_req->post_cl - wsgi_req->post_pos);
@@ -251,6 +315,7 @@ static JNINativeMethod uwsgi_jvm_request_body_methods[] = {
 	{"readLine", "([B)I", (void *) &uwsgi_jvm_request_body_readline_bytearray},
 	{"available", "()I", (void *) &uwsgi_jvm_request_body_available},
 	{"seek", "(I)V", (void *) &uwsgi_jvm_request_body_seek},
+	{"readDirect", "()Ljava/nio/ByteBuffer;", (void *) &uwsgi_jvm_request_body_read_direct},
 };
 
 static struct uwsgi_option uwsgi_jvm_options[] = {
@@ -615,18 +680,9 @@ jobject uwsgi_jvm_bytearray(char *buf, size_t len) {
 
 int uwsgi_jvm_consume_input_stream(struct wsgi_request *wsgi_req, size_t chunk, jobject o) {
 	int ret = 0;
-	jclass c = uwsgi_jvm_class_from_object(o);
-	jmethodID mid_read = uwsgi_jvm_get_method_id(c, "read", "([B)I");
-	if (!mid_read) {
-		uwsgi_jvm_local_unref(c);
-		return -1;
-	}
-	jmethodID mid_close = uwsgi_jvm_get_method_id(c, "close", "()V");
-        if (!mid_close) {
-                uwsgi_jvm_local_unref(c);
-                return -1;
-        }
-	uwsgi_jvm_local_unref(c);
+	// virtual calls, the ids of java/io/InputStream work for every subclass
+	jmethodID mid_read = ujvm.input_stream_read_mid;
+	jmethodID mid_close = ujvm.input_stream_close_mid;
 
 	// allocate the byte buffer
 	jobject byte_buffer = (*ujvm_env)->NewByteArray(ujvm_env, chunk);
@@ -806,6 +862,9 @@ jobject uwsgi_jvm_iterator(jobject set) {
 }
 
 jobject uwsgi_jvm_auto_iterator(jobject o) {
+	if (uwsgi_jvm_object_is_instance(o, ujvm.iterable_class)) {
+		return uwsgi_jvm_call_object(o, ujvm.iterable_iterator_mid);
+	}
 	jclass c = uwsgi_jvm_class_from_object(o);
 	if (!c) return NULL;
         jmethodID mid = uwsgi_jvm_get_method_id_quiet(c, "iterator", "()Ljava/util/Iterator;");
@@ -826,6 +885,9 @@ jobject uwsgi_jvm_filename(jobject o) {
 }
 
 jobject uwsgi_jvm_getKey(jobject item) {
+	if (uwsgi_jvm_object_is_instance(item, ujvm.map_entry_class)) {
+		return uwsgi_jvm_call_object(item, ujvm.map_entry_key_mid);
+	}
 	jclass c = uwsgi_jvm_class_from_object(item);
 	if (!c) return NULL;
 	jmethodID mid = uwsgi_jvm_get_method_id(c, "getKey", "()Ljava/lang/Object;");
@@ -835,6 +897,9 @@ jobject uwsgi_jvm_getKey(jobject item) {
 }
 
 jobject uwsgi_jvm_getValue(jobject item) {
+	if (uwsgi_jvm_object_is_instance(item, ujvm.map_entry_class)) {
+		return uwsgi_jvm_call_object(item, ujvm.map_entry_value_mid);
+	}
         jclass c = uwsgi_jvm_class_from_object(item);
         if (!c) return NULL;
         jmethodID mid = uwsgi_jvm_get_method_id(c, "getValue", "()Ljava/lang/Object;");
@@ -911,7 +976,14 @@ jobject uwsgi_jvm_bool(long b) {
 
 jobject uwsgi_jvm_str(char *str, size_t len) {
 	jobject new_str;
-	if (len > 0) {
+	// most of the request vars fit in the stack
+	if (len > 0 && len < 4096) {
+		char tmp[4096];
+		memcpy(tmp, str, len);
+		tmp[len] = 0;
+		new_str = (*ujvm_env)->NewStringUTF(ujvm_env, tmp);
+	}
+	else if (len > 0) {
 		char *tmp = uwsgi_concat2n(str, len, "", 0);
 		new_str = (*ujvm_env)->NewStringUTF(ujvm_env, tmp);	
 		free(tmp);
@@ -995,6 +1067,15 @@ static int uwsgi_jvm_init(void) {
 	return 0;
 }
 
+// the classes cached in ujvm are used by all of the threads, so they need a global reference
+static jclass uwsgi_jvm_class_ref(char *name) {
+	jclass c = uwsgi_jvm_class(name);
+	if (!c) return NULL;
+	jclass ref = uwsgi_jvm_ref(c);
+	uwsgi_jvm_local_unref(c);
+	return ref;
+}
+
 static void uwsgi_jvm_create(void) {
 
 
@@ -1067,49 +1148,76 @@ static void uwsgi_jvm_create(void) {
 		}
 	}
 
-	ujvm.str_class = uwsgi_jvm_class("java/lang/String");
+	ujvm.str_class = uwsgi_jvm_class_ref("java/lang/String");
 	if (!ujvm.str_class) exit(1);
 
-	ujvm.str_array_class = uwsgi_jvm_class("[Ljava/lang/String;");
+	ujvm.str_array_class = uwsgi_jvm_class_ref("[Ljava/lang/String;");
 	if (!ujvm.str_array_class) exit(1);
 
-	ujvm.int_class = uwsgi_jvm_class("java/lang/Integer");
+	ujvm.int_class = uwsgi_jvm_class_ref("java/lang/Integer");
 	if (!ujvm.int_class) exit(1);
 
-	ujvm.bool_class = uwsgi_jvm_class("java/lang/Boolean");
+	ujvm.bool_class = uwsgi_jvm_class_ref("java/lang/Boolean");
 	if (!ujvm.bool_class) exit(1);
 
-	ujvm.long_class = uwsgi_jvm_class("java/lang/Long");
+	ujvm.long_class = uwsgi_jvm_class_ref("java/lang/Long");
 	if (!ujvm.long_class) exit(1);
 
-	ujvm.byte_class = uwsgi_jvm_class("java/lang/Byte");
+	ujvm.byte_class = uwsgi_jvm_class_ref("java/lang/Byte");
 	if (!ujvm.byte_class) exit(1);
 
-	ujvm.bytearray_class = uwsgi_jvm_class("[B");
+	ujvm.bytearray_class = uwsgi_jvm_class_ref("[B");
 	if (!ujvm.bytearray_class) exit(1);
 
-	ujvm.file_class = uwsgi_jvm_class("java/io/File");
+	ujvm.file_class = uwsgi_jvm_class_ref("java/io/File");
 	if (!ujvm.file_class) exit(1);
 
-	ujvm.input_stream_class = uwsgi_jvm_class("java/io/InputStream");
+	ujvm.input_stream_class = uwsgi_jvm_class_ref("java/io/InputStream");
 	if (!ujvm.input_stream_class) exit(1);
 
-	ujvm.hashmap_class = uwsgi_jvm_class("java/util/HashMap");
+	ujvm.hashmap_class = uwsgi_jvm_class_ref("java/util/HashMap");
 	if (!ujvm.hashmap_class) exit(1);
 
-	ujvm.list_class = uwsgi_jvm_class("java/util/ArrayList");
+	ujvm.list_class = uwsgi_jvm_class_ref("java/util/ArrayList");
 	if (!ujvm.list_class) exit(1);
 
-	ujvm.set_class = uwsgi_jvm_class("java/util/Set");
+	ujvm.set_class = uwsgi_jvm_class_ref("java/util/Set");
 	if (!ujvm.set_class) exit(1);
 
-	ujvm.iterator_class = uwsgi_jvm_class("java/util/Iterator");
+	ujvm.iterator_class = uwsgi_jvm_class_ref("java/util/Iterator");
 	if (!ujvm.iterator_class) exit(1);
 
-	ujvm.runtime_exception = uwsgi_jvm_class("java/lang/RuntimeException");
+	ujvm.map_entry_class = uwsgi_jvm_class_ref("java/util/Map$Entry");
+	if (!ujvm.map_entry_class) exit(1);
+
+	ujvm.iterable_class = uwsgi_jvm_class_ref("java/lang/Iterable");
+	if (!ujvm.iterable_class) exit(1);
+
+	ujvm.buffer_class = uwsgi_jvm_class_ref("java/nio/Buffer");
+	if (!ujvm.buffer_class) exit(1);
+
+	// method ids used at every request
+	ujvm.input_stream_read_mid = uwsgi_jvm_get_method_id(ujvm.input_stream_class, "read", "([B)I");
+	if (!ujvm.input_stream_read_mid) exit(1);
+	ujvm.input_stream_close_mid = uwsgi_jvm_get_method_id(ujvm.input_stream_class, "close", "()V");
+	if (!ujvm.input_stream_close_mid) exit(1);
+	ujvm.map_entry_key_mid = uwsgi_jvm_get_method_id(ujvm.map_entry_class, "getKey", "()Ljava/lang/Object;");
+	if (!ujvm.map_entry_key_mid) exit(1);
+	ujvm.map_entry_value_mid = uwsgi_jvm_get_method_id(ujvm.map_entry_class, "getValue", "()Ljava/lang/Object;");
+	if (!ujvm.map_entry_value_mid) exit(1);
+	ujvm.iterable_iterator_mid = uwsgi_jvm_get_method_id(ujvm.iterable_class, "iterator", "()Ljava/util/Iterator;");
+	if (!ujvm.iterable_iterator_mid) exit(1);
+	ujvm.buffer_clear_mid = uwsgi_jvm_get_method_id(ujvm.buffer_class, "clear", "()Ljava/nio/Buffer;");
+	if (!ujvm.buffer_clear_mid) exit(1);
+	ujvm.buffer_limit_mid = uwsgi_jvm_get_method_id(ujvm.buffer_class, "limit", "(I)Ljava/nio/Buffer;");
+	if (!ujvm.buffer_limit_mid) exit(1);
+
+	ujvm.direct = uwsgi_calloc(sizeof(struct uwsgi_jvm_direct) * uwsgi.cores);
+
+	ujvm.runtime_exception = uwsgi_jvm_class_ref("java/lang/RuntimeException");
 	if (!ujvm.runtime_exception) exit(1);
 
-	ujvm.io_exception = uwsgi_jvm_class("java/io/IOException");
+	ujvm.io_exception = uwsgi_jvm_class_ref("java/io/IOException");
 	if (!ujvm.io_exception) exit(1);
 
 	jclass uwsgi_class = uwsgi_jvm_class("uwsgi");
@@ -1177,7 +1285,7 @@ static void uwsgi_jvm_create(void) {
 	ujvm.api_rpc_function_mid = uwsgi_jvm_get_method_id(uwsgi_rpc_function_class, "function", "([Ljava/lang/String;)Ljava/lang/String;");
 	if (!ujvm.api_rpc_function_mid) exit(1);
 
-	ujvm.request_body_class = uwsgi_jvm_class("uwsgi$RequestBody");
+	ujvm.request_body_class = uwsgi_jvm_class_ref("uwsgi$RequestBody");
 	if (!ujvm.request_body_class) exit(1);
 
 	(*ujvm_env)->RegisterNatives(ujvm_env, ujvm.request_body_class, uwsgi_jvm_request_body_methods, sizeof(uwsgi_jvm_request_body_methods)/sizeof(uwsgi_jvm_request_body_methods[0]));
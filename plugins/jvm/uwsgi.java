@@ -1,5 +1,6 @@
 import java.io.*;
 import java.util.*;
+import java.nio.ByteBuffer;
 
 public class uwsgi {
 
@@ -11,6 +12,8 @@ public class uwsgi {
 		public native int readLine(byte[] b);
 		public native int available();
 		public native void seek(int pos);
+		// the next chunk of the body in a direct buffer reused by the core (null at the end of the body)
+		public native ByteBuffer readDirect();
 	}
 
 	public interface SignalHandler {
@@ -23,6 +26,9 @@ public class uwsgi {
 
 	public static native int worker_id();
 
+	// the uwsgi vars block of the current request (valid until the end of the request, do not write to it)
+	public static native ByteBuffer request_vars();
+
 	public static native void register_signal(int signum, String target, SignalHandler sh);
 
 	public static native void register_rpc(String name, RpcFunction rf);
@@ -10,10 +10,12 @@ struct uwsgi_jwsgi {
 	jmethodID app_mid;
 	jclass app_class;
 	jobject app_instance;
+	int direct;
 } ujwsgi;
 
 static struct uwsgi_option uwsgi_jwsgi_options[] = {
         {"jwsgi", required_argument, 0, "load the specified JWSGI application (syntax class:method)", uwsgi_opt_set_str, &ujwsgi.app, 0},
+        {"jwsgi-direct", no_argument, 0, "do not convert request vars to java/lang/String, the app parses the jwsgi.vars ByteBuffer", uwsgi_opt_true, &ujwsgi.direct, 0},
         {0, 0, 0, 0},
 };
 
@@ -58,6 +60,23 @@ static int uwsgi_jwsgi_add_request_input(jobject hm, char *key, uint16_t key_len
         return ret;
 }
 
+// the raw vars as a direct ByteBuffer (no copy, reused by every request of the core)
+static int uwsgi_jwsgi_add_request_vars(struct wsgi_request *wsgi_req, jobject hm, char *key, uint16_t key_len) {
+	jobject j_key = uwsgi_jvm_str(key, key_len);
+	if (!j_key) return -1;
+
+	jobject j_value = uwsgi_jvm_request_vars_buffer(wsgi_req);
+	if (!j_value) {
+		uwsgi_jvm_local_unref(j_key);
+		return -1;
+	}
+
+	int ret = uwsgi_jvm_hashmap_put(hm, j_key, j_value);
+	uwsgi_jvm_local_unref(j_key);
+	uwsgi_jvm_local_unref(j_value);
+	return ret;
+}
+
 static int uwsgi_jwsgi_request(struct wsgi_request *wsgi_req) {
 	char status_str[11];
 	jobject hm = NULL;
@@ -71,7 +90,7 @@ static int uwsgi_jwsgi_request(struct wsgi_request *wsgi_req) {
 	if (!hm) return -1;
 
 	int i;
-	for(i=0;i<wsgi_req->var_cnt;i++) {
+	for(i=0;!ujwsgi.direct && i<wsgi_req->var_cnt;i++) {
                 char *hk = wsgi_req->hvec[i].iov_base;
                 uint16_t hk_l = wsgi_req->hvec[i].iov_len;
                 char *hv = wsgi_req->hvec[i+1].iov_base;
@@ -80,6 +99,7 @@ static int uwsgi_jwsgi_request(struct wsgi_request *wsgi_req) {
 		i++;
 	}
 
+	if (uwsgi_jwsgi_add_request_vars(wsgi_req, hm, "jwsgi.vars", 10)) goto end;
 	if (uwsgi_jwsgi_add_request_input(hm, "jwsgi.input", 11)) goto end;
 
 	if (!ujwsgi.app_instance) {
@@ -158,19 +178,24 @@ static int uwsgi_jwsgi_setup() {
 		method = colon + 1;
 	}
 
-	ujwsgi.app_class = uwsgi_jvm_class(app);
-	if (!ujwsgi.app_class) {
+	jclass app_class = uwsgi_jvm_class(app);
+	if (!app_class) {
 		exit(1);
 	}
+	// used by all of the threads
+	ujwsgi.app_class = uwsgi_jvm_ref(app_class);
+	uwsgi_jvm_local_unref(app_class);
 
 	ujwsgi.app_mid = uwsgi_jvm_get_static_method_id_quiet(ujwsgi.app_class, method, "(Ljava/util/HashMap;)[Ljava/lang/Object;");
 	if (uwsgi_jvm_exception() || !ujwsgi.app_mid) {
                 jmethodID mid = uwsgi_jvm_get_method_id(ujwsgi.app_class, "<init>", "()V");
                 if (uwsgi_jvm_exception() || !mid) exit(1);
-        	ujwsgi.app_instance = (*ujvm_env)->NewObject(ujvm_env, ujwsgi.app_class, mid);
-        	if (uwsgi_jvm_exception() || !ujwsgi.app_instance) {
+        	jobject app_instance = (*ujvm_env)->NewObject(ujvm_env, ujwsgi.app_class, mid);
+        	if (uwsgi_jvm_exception() || !app_instance) {
 			exit(1);
         	}
+		ujwsgi.app_instance = uwsgi_jvm_ref(app_instance);
+		uwsgi_jvm_local_unref(app_instance);
 		ujwsgi.app_mid = uwsgi_jvm_get_method_id(ujwsgi.app_class, method, "(Ljava/util/HashMap;)[Ljava/lang/Object;");
         	if (uwsgi_jvm_exception() || !ujwsgi.app_mid) {
 			exit(1);
@@ -61,7 +61,7 @@ ssize_t uwsgi_socket_logger(struct uwsgi_logger *ul, char *message, size_t len)
 }
 
 void uwsgi_logsocket_register() {
-	uwsgi_register_logger("socket", uwsgi_socket_logger);
+	uwsgi_register_dgram_logger("socket", uwsgi_socket_logger);
 }
 
 struct uwsgi_plugin logsocket_plugin = {
@@ -4,6 +4,10 @@
 #include <lualib.h>
 #include <lauxlib.h>
 
+#ifdef UWSGI_LUAJIT
+#include <luajit.h>
+#endif
+
 #if LUA_VERSION_NUM < 502
 # define luaL_newuwsgilib(L,l) luaL_register(L, "uwsgi",l)
 # define lua_rawlen lua_objlen
@@ -657,6 +661,160 @@ static int uwsgi_lua_input(lua_State *L) {
 	return 0;
 }
 
+#ifdef UWSGI_LUAJIT
+/*
+	LuaJIT FFI bindings (require "uwsgi.ffi")
+
+	cache and sharedarea functions are called directly, the following helpers
+	wrap what cannot be called without locking or without the current request.
+	They are not static, LuaJIT resolves them in the global namespace.
+*/
+
+char *uwsgi_lua_ffi_var(char *key, uint16_t keylen, uint16_t *vallen) {
+	struct wsgi_request *wsgi_req = current_wsgi_req();
+	return uwsgi_get_var(wsgi_req, key, keylen, vallen);
+}
+
+// queue items live in shared memory, they are copied (while locked) in a malloc'ed buffer
+static char *uwsgi_lua_ffi_queue_copy(char *message, uint64_t *size) {
+	if (!message || *size == 0) return NULL;
+	char *storage = uwsgi_malloc(*size);
+	memcpy(storage, message, *size);
+	return storage;
+}
+
+char *uwsgi_lua_ffi_queue_get(uint64_t index, uint64_t *size) {
+	if (!uwsgi.queue_size) return NULL;
+	uwsgi_rlock(uwsgi.queue_lock);
+	char *storage = uwsgi_lua_ffi_queue_copy(uwsgi_queue_get(index, size), size);
+	uwsgi_rwunlock(uwsgi.queue_lock);
+	return storage;
+}
+
+char *uwsgi_lua_ffi_queue_pull(uint64_t *size) {
+	if (!uwsgi.queue_size) return NULL;
+	uwsgi_wlock(uwsgi.queue_lock);
+	char *storage = uwsgi_lua_ffi_queue_copy(uwsgi_queue_pull(size), size);
+	uwsgi_rwunlock(uwsgi.queue_lock);
+	return storage;
+}
+
+char *uwsgi_lua_ffi_queue_pop(uint64_t *size) {
+	if (!uwsgi.queue_size) return NULL;
+	uwsgi_wlock(uwsgi.queue_lock);
+	char *storage = uwsgi_lua_ffi_queue_copy(uwsgi_queue_pop(size), size);
+	uwsgi_rwunlock(uwsgi.queue_lock);
+	return storage;
+}
+
+int uwsgi_lua_ffi_queue_push(char *message, uint64_t size) {
+	if (!uwsgi.queue_size) return 0;
+	uwsgi_wlock(uwsgi.queue_lock);
+	int ret = uwsgi_queue_push(message, size);
+	uwsgi_rwunlock(uwsgi.queue_lock);
+	return ret;
+}
+
+int uwsgi_lua_ffi_queue_set(uint64_t index, char *message, uint64_t size) {
+	if (!uwsgi.queue_size) return 0;
+	uwsgi_wlock(uwsgi.queue_lock);
+	int ret = uwsgi_queue_set(index, message, size);
+	uwsgi_rwunlock(uwsgi.queue_lock);
+	return ret;
+}
+
+static const char *uwsgi_lua_ffi_module =
+"local ffi = require 'ffi'\n"
+"local C = ffi.C\n"
+"ffi.cdef[[\n"
+"void free(void *);\n"
+"char *uwsgi_cache_magic_get(const char *, uint16_t, uint64_t *, uint64_t *, const char *);\n"
+"int uwsgi_cache_magic_set(const char *, uint16_t, const char *, uint64_t, uint64_t, uint64_t, const char *);\n"
+"int uwsgi_cache_magic_del(const char *, uint16_t, const char *);\n"
+"int uwsgi_cache_magic_exists(const char *, uint16_t, const char *);\n"
+"int uwsgi_sharedarea_read64(int, uint64_t, int64_t *);\n"
+"int uwsgi_sharedarea_write64(int, uint64_t, int64_t *);\n"
+"int uwsgi_sharedarea_inc64(int, uint64_t, int64_t);\n"
+"int uwsgi_sharedarea_dec64(int, uint64_t, int64_t);\n"
+"int uwsgi_sharedarea_fetch_add64(int, uint64_t, int64_t, int64_t *);\n"
+"int uwsgi_sharedarea_xchg64(int, uint64_t, int64_t, int64_t *);\n"
+"int uwsgi_sharedarea_cas64(int, uint64_t, int64_t, int64_t, int64_t *);\n"
+"int uwsgi_sharedarea_min64(int, uint64_t, int64_t, int64_t *);\n"
+"int uwsgi_sharedarea_max64(int, uint64_t, int64_t, int64_t *);\n"
+"char *uwsgi_lua_ffi_var(const char *, uint16_t, uint16_t *);\n"
+"char *uwsgi_lua_ffi_queue_get(uint64_t, uint64_t *);\n"
+"char *uwsgi_lua_ffi_queue_pull(uint64_t *);\n"
+"char *uwsgi_lua_ffi_queue_pop(uint64_t *);\n"
+"int uwsgi_lua_ffi_queue_push(const char *, uint64_t);\n"
+"int uwsgi_lua_ffi_queue_set(uint64_t, const char *, uint64_t);\n"
+"]]\n"
+"local len64 = ffi.new('uint64_t[1]')\n"
+"local len16 = ffi.new('uint16_t[1]')\n"
+"local i64 = ffi.new('int64_t[1]')\n"
+"local function take(ptr)\n"
+"  if ptr == nil then return nil end\n"
+"  local s = ffi.string(ptr, len64[0])\n"
+"  C.free(ptr)\n"
+"  return s\n"
+"end\n"
+"local M = {}\n"
+"function M.cache_get(key, cache) return take(C.uwsgi_cache_magic_get(key, #key, len64, nil, cache)) end\n"
+"function M.cache_set(key, value, expires, cache) return C.uwsgi_cache_magic_set(key, #key, value, #value, expires or 0, 0, cache) == 0 end\n"
+"function M.cache_update(key, value, expires, cache) return C.uwsgi_cache_magic_set(key, #key, value, #value, expires or 0, 2, cache) == 0 end\n"
+"function M.cache_del(key, cache) return C.uwsgi_cache_magic_del(key, #key, cache) == 0 end\n"
+"function M.cache_exists(key, cache) return C.uwsgi_cache_magic_exists(key, #key, cache) ~= 0 end\n"
+"function M.sharedarea_read64(id, pos)\n"
+"  if C.uwsgi_sharedarea_read64(id, pos, i64) ~= 0 then return nil end\n"
+"  return i64[0]\n"
+"end\n"
+"function M.sharedarea_write64(id, pos, value)\n"
+"  i64[0] = value\n"
+"  return C.uwsgi_sharedarea_write64(id, pos, i64) == 0\n"
+"end\n"
+"function M.sharedarea_inc64(id, pos, amount) return C.uwsgi_sharedarea_inc64(id, pos, amount or 1) == 0 end\n"
+"function M.sharedarea_dec64(id, pos, amount) return C.uwsgi_sharedarea_dec64(id, pos, amount or 1) == 0 end\n"
+// lock-free variants, they return the previous value (cas returns the swap result too)
+"local function atomic(ret) if ret < 0 then return nil end return i64[0] end\n"
+"function M.sharedarea_fetch_add64(id, pos, amount) return atomic(C.uwsgi_sharedarea_fetch_add64(id, pos, amount or 1, i64)) end\n"
+"function M.sharedarea_xchg64(id, pos, value) return atomic(C.uwsgi_sharedarea_xchg64(id, pos, value, i64)) end\n"
+"function M.sharedarea_min64(id, pos, value) return atomic(C.uwsgi_sharedarea_min64(id, pos, value, i64)) end\n"
+"function M.sharedarea_max64(id, pos, value) return atomic(C.uwsgi_sharedarea_max64(id, pos, value, i64)) end\n"
+"function M.sharedarea_cas64(id, pos, expected, value)\n"
+"  local ret = C.uwsgi_sharedarea_cas64(id, pos, expected, value, i64)\n"
+"  if ret < 0 then return nil end\n"
+"  return ret == 0, i64[0]\n"
+"end\n"
+// pointer and size in the request buffer, valid until the end of the request
+"function M.var_ptr(key)\n"
+"  local ptr = C.uwsgi_lua_ffi_var(key, #key, len16)\n"
+"  if ptr == nil then return nil end\n"
+"  return ptr, len16[0]\n"
+"end\n"
+"function M.var(key)\n"
+"  local ptr, len = M.var_ptr(key)\n"
+"  if ptr == nil then return nil end\n"
+"  return ffi.string(ptr, len)\n"
+"end\n"
+"function M.queue_get(index) return take(C.uwsgi_lua_ffi_queue_get(index, len64)) end\n"
+"function M.queue_pull() return take(C.uwsgi_lua_ffi_queue_pull(len64)) end\n"
+"function M.queue_pop() return take(C.uwsgi_lua_ffi_queue_pop(len64)) end\n"
+"function M.queue_push(value) return C.uwsgi_lua_ffi_queue_push(value, #value) ~= 0 end\n"
+"function M.queue_set(index, value) return C.uwsgi_lua_ffi_queue_set(index, value, #value) ~= 0 end\n"
+"return M\n";
+
+// register the bindings in package.preload
+static void uwsgi_lua_ffi_preload(lua_State *L) {
+	lua_getglobal(L, "package");
+	lua_getfield(L, -1, "preload");
+	if (luaL_loadbuffer(L, uwsgi_lua_ffi_module, strlen(uwsgi_lua_ffi_module), "uwsgi.ffi")) {
+		uwsgi_log("unable to load the uwsgi.ffi module: %s\n", lua_tostring(L, -1));
+		exit(1);
+	}
+	lua_setfield(L, -2, "uwsgi.ffi");
+	lua_pop(L, 2);
+}
+#endif
+
 static const luaL_Reg uwsgi_api[] = {
   {"log", uwsgi_api_log},
   {"connection_fd", uwsgi_api_req_fd},
@@ -721,6 +879,10 @@ static void uwsgi_lua_app() {
 			lua_pushstring(ulua.L[i], UWSGI_VERSION);
         		lua_setfield(ulua.L[i], -2, "version");
 
+#ifdef UWSGI_LUAJIT
+			uwsgi_lua_ffi_preload(ulua.L[i]);
+#endif
+
 			struct uwsgi_string_list *usl = ulua.load;
 			while(usl) {
 				if (luaL_dofile(ulua.L[i], usl->value)) {
@@ -30,3 +30,7 @@ else:
     LDFLAGS = []
 
 GCC_LIST = ['lua_plugin']
+
+# LuaJIT builds ship the FFI bindings (require "uwsgi.ffi")
+if 'luajit' in LUAPC or 'luajit' in (LUALIB or '') or os.environ.get('UWSGICONFIG_LUAJIT'):
+    CFLAGS.append('-DUWSGI_LUAJIT')
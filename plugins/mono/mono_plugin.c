@@ -29,6 +29,10 @@
 
 		the app is created on demand using the specified key as the physicalDirectory
 
+	with --mono-async the requests are run by managed Tasks: the core reads the whole body,
+	starts the Task and waits (with the loop engine wait hooks) for the response chunks
+	queued by the managed side, so a core is free to serve other requests in the mean time
+
 
 	TODO:
 		allows mounting apps under subpaths (currently all is mapped to "/")
@@ -65,9 +69,20 @@ struct uwsgi_mono {
 	MonoClass *byte_class;
 
 	MonoClassField *filepath;
+	MonoClassField *wsgi_req;
+
+	// thunks
+	void (*process_request)(MonoObject *, void *, MonoException **);
+	void (*process_request_async)(MonoObject *, void *, int, MonoException **);
+	int (*drain)(MonoObject *, void *, MonoException **);
 
-	// thunk
-	void (*process_request)(MonoObject *, MonoException **);
+	int async;
+	// per-core notification pipes and preloaded bodies (async mode)
+	int *notify_pipes;
+	struct uwsgi_mono_body {
+		char *buf;
+		size_t len;
+	} *bodies;
 
 	struct uwsgi_string_list *app;
 	struct uwsgi_string_list *exec;
@@ -84,9 +99,102 @@ struct uwsgi_option uwsgi_mono_options[] = {
         {"mono-assembly", required_argument, 0, "load the specified main assembly (default: uwsgi.dll)", uwsgi_opt_set_str, &umono.assembly_name, 0},
         {"mono-exec", required_argument, 0, "exec the specified assembly just before app loading", uwsgi_opt_add_string_list, &umono.exec, 0},
         {"mono-index", required_argument, 0, "add an asp.net index file", uwsgi_opt_add_string_list, &umono.index, 0},
+        {"mono-async", no_argument, 0, "run asp.net requests in managed Tasks, the uWSGI core sends the response (allows async cores)", uwsgi_opt_true, &umono.async, 0},
 	{0, 0, 0, 0, 0, 0, 0},
 };
 
+/*
+	request values are mostly short and repeated (methods, protocols, most of the headers),
+	so a small per-thread cache of MonoStrings avoids allocating (and collecting) them at every request.
+	strings are immutable, sharing them is safe
+*/
+#define UWSGI_MONO_STRINGS 64
+#define UWSGI_MONO_STRING_MAX 48
+
+struct uwsgi_mono_string {
+	MonoDomain *domain;
+	uint32_t handle;
+	uint16_t len;
+	char buf[UWSGI_MONO_STRING_MAX];
+};
+
+static __thread struct uwsgi_mono_string *umono_strings;
+
+static MonoString *uwsgi_mono_string(char *buf, uint16_t len) {
+	MonoDomain *domain = mono_domain_get();
+	if (len > UWSGI_MONO_STRING_MAX) {
+		return mono_string_new_len(domain, buf, len);
+	}
+
+	if (!umono_strings) {
+		umono_strings = uwsgi_calloc(sizeof(struct uwsgi_mono_string) * UWSGI_MONO_STRINGS);
+	}
+
+	struct uwsgi_mono_string *ums = &umono_strings[djb33x_hash(buf, len) % UWSGI_MONO_STRINGS];
+	if (ums->handle && ums->domain == domain && ums->len == len && !memcmp(ums->buf, buf, len)) {
+		MonoString *ret = (MonoString *) mono_gchandle_get_target(ums->handle);
+		if (ret) return ret;
+	}
+
+	MonoString *ret = mono_string_new_len(domain, buf, len);
+	if (ums->handle) {
+		mono_gchandle_free(ums->handle);
+	}
+	ums->handle = mono_gchandle_new((MonoObject *) ret, 0);
+	ums->domain = domain;
+	ums->len = len;
+	memcpy(ums->buf, buf, len);
+	return ret;
+}
+
+// header and var names are ascii, convert them on the stack instead of allocating utf8 copies
+static int uwsgi_mono_ascii(MonoString *s, char *buf, int len) {
+	int i, slen = mono_string_length(s);
+	if (slen > len) return -1;
+	mono_unichar2 *chars = mono_string_chars(s);
+	for (i = 0; i < slen; i++) {
+		if (chars[i] > 127) return -1;
+		buf[i] = chars[i];
+	}
+	return slen;
+}
+
+// the request object carries the wsgi_req of its core (in async mode it is used by managed threads)
+static struct wsgi_request *uwsgi_mono_wsgi_req(MonoObject *this) {
+	struct wsgi_request *wsgi_req = NULL;
+	mono_field_get_value(this, umono.wsgi_req, &wsgi_req);
+	return wsgi_req;
+}
+
+// HttpWorkerRequest known request headers (by index) mapped to uWSGI vars
+static struct uwsgi_mono_known_header {
+	char *key;
+	uint16_t len;
+} uwsgi_mono_known_request_headers[] = {
+	{"HTTP_CACHE_CONTROL", 18}, {"HTTP_CONNECTION", 15}, {"HTTP_DATE", 9}, {"HTTP_KEEP_ALIVE", 15},
+	{"HTTP_PRAGMA", 11}, {"HTTP_TRAILER", 12}, {"HTTP_TRANSFER_ENCODING", 22}, {"HTTP_UPGRADE", 12},
+	{"HTTP_VIA", 8}, {"HTTP_WARNING", 12}, {"HTTP_ALLOW", 10}, {"CONTENT_LENGTH", 14},
+	{"CONTENT_TYPE", 12}, {"HTTP_CONTENT_ENCODING", 21}, {"HTTP_CONTENT_LANGUAGE", 21}, {"HTTP_CONTENT_LOCATION", 21},
+	{"HTTP_CONTENT_MD5", 16}, {"HTTP_CONTENT_RANGE", 18}, {"HTTP_EXPIRES", 12}, {"HTTP_LAST_MODIFIED", 18},
+	{"HTTP_ACCEPT", 11}, {"HTTP_ACCEPT_CHARSET", 19}, {"HTTP_ACCEPT_ENCODING", 20}, {"HTTP_ACCEPT_LANGUAGE", 20},
+	{"HTTP_AUTHORIZATION", 18}, {"HTTP_COOKIE", 11}, {"HTTP_EXPECT", 11}, {"HTTP_FROM", 9},
+	{"HTTP_HOST", 9}, {"HTTP_IF_MATCH", 13}, {"HTTP_IF_MODIFIED_SINCE", 22}, {"HTTP_IF_NONE_MATCH", 18},
+	{"HTTP_IF_RANGE", 13}, {"HTTP_IF_UNMODIFIED_SINCE", 24}, {"HTTP_MAX_FORWARDS", 17}, {"HTTP_PROXY_AUTHORIZATION", 24},
+	{"HTTP_REFERER", 12}, {"HTTP_RANGE", 10}, {"HTTP_TE", 7}, {"HTTP_USER_AGENT", 15},
+};
+
+// HttpWorkerRequest known response headers (by index)
+static struct uwsgi_mono_known_header uwsgi_mono_known_response_headers[] = {
+	{"Cache-Control", 13}, {"Connection", 10}, {"Date", 4}, {"Keep-Alive", 10},
+	{"Pragma", 6}, {"Trailer", 7}, {"Transfer-Encoding", 17}, {"Upgrade", 7},
+	{"Via", 3}, {"Warning", 7}, {"Allow", 5}, {"Content-Length", 14},
+	{"Content-Type", 12}, {"Content-Encoding", 16}, {"Content-Language", 16}, {"Content-Location", 16},
+	{"Content-MD5", 11}, {"Content-Range", 13}, {"Expires", 7}, {"Last-Modified", 13},
+	{"Accept-Ranges", 13}, {"Age", 3}, {"ETag", 4}, {"Location", 8},
+	{"Proxy-Authenticate", 18}, {"Retry-After", 11}, {"Server", 6}, {"Set-Cookie", 10},
+	{"Vary", 4}, {"WWW-Authenticate", 16},
+};
+
 static MonoString *uwsgi_mono_method_GetFilePath(MonoObject *this) {
 	MonoString *ret = NULL;
 	// cache it !!!
@@ -94,7 +202,7 @@ static MonoString *uwsgi_mono_method_GetFilePath(MonoObject *this) {
 	if (filepath) {
 		return (MonoString *) filepath;
 	}
-	struct wsgi_request *wsgi_req = current_wsgi_req();
+	struct wsgi_request *wsgi_req = uwsgi_mono_wsgi_req(this);
 	struct uwsgi_app *app = &uwsgi_apps[wsgi_req->app_id];
 	char *path = uwsgi_concat3n(app->interpreter, strlen(app->interpreter), "/", 1, wsgi_req->path_info, wsgi_req->path_info_len);
 	size_t path_len = strlen(app->interpreter) + 1 + wsgi_req->path_info_len;
@@ -131,65 +239,91 @@ static MonoString *uwsgi_mono_method_GetUriPath(MonoObject *this) {
 }
 
 static MonoString *uwsgi_mono_method_MapPath(MonoObject *this, MonoString *virtualPath) {
-	struct wsgi_request *wsgi_req = current_wsgi_req();
+	struct wsgi_request *wsgi_req = uwsgi_mono_wsgi_req(this);
 	struct uwsgi_app *app = &uwsgi_apps[wsgi_req->app_id];
-	char *path = uwsgi_concat3n(app->interpreter, strlen(app->interpreter), "/", 1, mono_string_to_utf8(virtualPath), mono_string_length(virtualPath));
+	char *vpath = mono_string_to_utf8(virtualPath);
+	char *path = uwsgi_concat3n(app->interpreter, strlen(app->interpreter), "/", 1, vpath, strlen(vpath));
+	mono_free(vpath);
 	MonoString *ret = mono_string_new_len(mono_domain_get(), path, strlen(path));
 	free(path);
 	return ret;
 }
 
 static MonoString *uwsgi_mono_method_GetQueryString(MonoObject *this) {
-	struct wsgi_request *wsgi_req = current_wsgi_req();
-	return mono_string_new_len(mono_domain_get(), wsgi_req->query_string, wsgi_req->query_string_len);
+	struct wsgi_request *wsgi_req = uwsgi_mono_wsgi_req(this);
+	return uwsgi_mono_string(wsgi_req->query_string, wsgi_req->query_string_len);
 }
 
 static MonoString *uwsgi_mono_method_GetHttpVerbName(MonoObject *this) {
-	struct wsgi_request *wsgi_req = current_wsgi_req();
-	return mono_string_new_len(mono_domain_get(), wsgi_req->method, wsgi_req->method_len);
+	struct wsgi_request *wsgi_req = uwsgi_mono_wsgi_req(this);
+	return uwsgi_mono_string(wsgi_req->method, wsgi_req->method_len);
 }
 
 static MonoString *uwsgi_mono_method_GetRawUrl(MonoObject *this) {
-	struct wsgi_request *wsgi_req = current_wsgi_req();
-	return mono_string_new_len(mono_domain_get(), wsgi_req->uri, wsgi_req->uri_len);
+	struct wsgi_request *wsgi_req = uwsgi_mono_wsgi_req(this);
+	return uwsgi_mono_string(wsgi_req->uri, wsgi_req->uri_len);
 }
 
 static MonoString *uwsgi_mono_method_GetHttpVersion(MonoObject *this) {
-	struct wsgi_request *wsgi_req = current_wsgi_req();
-	return mono_string_new_len(mono_domain_get(), wsgi_req->protocol, wsgi_req->protocol_len);
+	struct wsgi_request *wsgi_req = uwsgi_mono_wsgi_req(this);
+	return uwsgi_mono_string(wsgi_req->protocol, wsgi_req->protocol_len);
 }
 
 static MonoString *uwsgi_mono_method_GetRemoteAddress(MonoObject *this) {
-	struct wsgi_request *wsgi_req = current_wsgi_req();
-	return mono_string_new_len(mono_domain_get(), wsgi_req->remote_addr, wsgi_req->remote_addr_len);
+	struct wsgi_request *wsgi_req = uwsgi_mono_wsgi_req(this);
+	return uwsgi_mono_string(wsgi_req->remote_addr, wsgi_req->remote_addr_len);
 }
 
 static void uwsgi_mono_method_SendStatus(MonoObject *this, int code, MonoString *msg) {
-	struct wsgi_request *wsgi_req = current_wsgi_req();
+	struct wsgi_request *wsgi_req = uwsgi_mono_wsgi_req(this);
 	char status_code[4];
 	uwsgi_num2str2n(code, status_code, 4);
-	char *status_line = uwsgi_concat3n(status_code, 3, " ", 1, mono_string_to_utf8(msg), mono_string_length(msg));
-	uwsgi_response_prepare_headers(wsgi_req, status_line, 4 + mono_string_length(msg));
+	char *c_msg = mono_string_to_utf8(msg);
+	size_t msg_len = strlen(c_msg);
+	char *status_line = uwsgi_concat3n(status_code, 3, " ", 1, c_msg, msg_len);
+	mono_free(c_msg);
+	uwsgi_response_prepare_headers(wsgi_req, status_line, 4 + msg_len);
 	free(status_line);
 }
 
+static void uwsgi_mono_add_header(struct wsgi_request *wsgi_req, char *key, uint16_t key_len, MonoString *value) {
+	char *c_value = mono_string_to_utf8(value);
+	uwsgi_response_add_header(wsgi_req, key, key_len, c_value, strlen(c_value));
+	mono_free(c_value);
+}
+
 static void uwsgi_mono_method_SendUnknownResponseHeader(MonoObject *this, MonoString *key, MonoString *value) {
-	struct wsgi_request *wsgi_req = current_wsgi_req();
-	uwsgi_response_add_header(wsgi_req, mono_string_to_utf8(key), mono_string_length(key), mono_string_to_utf8(value), mono_string_length(value));
+	struct wsgi_request *wsgi_req = uwsgi_mono_wsgi_req(this);
+	char buf[256];
+	int key_len = uwsgi_mono_ascii(key, buf, 256);
+	if (key_len >= 0) {
+		uwsgi_mono_add_header(wsgi_req, buf, key_len, value);
+		return;
+	}
+	char *c_key = mono_string_to_utf8(key);
+	uwsgi_mono_add_header(wsgi_req, c_key, strlen(c_key), value);
+	mono_free(c_key);
+}
+
+static void uwsgi_mono_method_SendKnownHeader(MonoObject *this, int index, MonoString *value) {
+	struct wsgi_request *wsgi_req = uwsgi_mono_wsgi_req(this);
+	if (index < 0 || index >= (int) (sizeof(uwsgi_mono_known_response_headers)/sizeof(struct uwsgi_mono_known_header))) return;
+	struct uwsgi_mono_known_header *umkh = &uwsgi_mono_known_response_headers[index];
+	uwsgi_mono_add_header(wsgi_req, umkh->key, umkh->len, value);
 }
 
 static void uwsgi_mono_method_SendResponseFromMemory(MonoObject *this, MonoArray *byteArray, int len) {
-	struct wsgi_request *wsgi_req = current_wsgi_req();
+	struct wsgi_request *wsgi_req = uwsgi_mono_wsgi_req(this);
 	uwsgi_response_write_body_do(wsgi_req, mono_array_addr(byteArray, char, 0), len);
 }
 
 static void uwsgi_mono_method_FlushResponse(MonoObject *this, int is_final) {
-	struct wsgi_request *wsgi_req = current_wsgi_req();
+	struct wsgi_request *wsgi_req = uwsgi_mono_wsgi_req(this);
 	uwsgi_response_write_body_do(wsgi_req, "", 0);
 }
 
 static void uwsgi_mono_method_SendResponseFromFd(MonoObject *this, int fd, long offset, long len) {
-	struct wsgi_request *wsgi_req = current_wsgi_req();
+	struct wsgi_request *wsgi_req = uwsgi_mono_wsgi_req(this);
 	wsgi_req->sendfile_fd = fd;
 	if (fd >= 0) {
         	uwsgi_response_sendfile_do(wsgi_req, fd, offset, len);
@@ -198,50 +332,118 @@ static void uwsgi_mono_method_SendResponseFromFd(MonoObject *this, int fd, long
 }
 
 static void uwsgi_mono_method_SendResponseFromFile(MonoObject *this, MonoString *filename, long offset, long len) {
-	struct wsgi_request *wsgi_req = current_wsgi_req();
-	int fd = open(mono_string_to_utf8(filename), O_RDONLY);
+	struct wsgi_request *wsgi_req = uwsgi_mono_wsgi_req(this);
+	char *c_filename = mono_string_to_utf8(filename);
+	int fd = open(c_filename, O_RDONLY);
+	mono_free(c_filename);
 	if (fd >= 0) {
         	uwsgi_response_sendfile_do(wsgi_req, fd, offset, len);
 	}
 }
 
 static MonoString *uwsgi_mono_method_GetHeaderByName(MonoObject *this, MonoString *key) {
-	struct wsgi_request *wsgi_req = current_wsgi_req();
+	struct wsgi_request *wsgi_req = uwsgi_mono_wsgi_req(this);
+	uint16_t rlen = 0;
+	char *value = NULL;
+	char buf[256];
+	int key_len = uwsgi_mono_ascii(key, buf, 256);
+	if (key_len >= 0) {
+		value = uwsgi_get_header(wsgi_req, buf, key_len, &rlen);
+	}
+	if (value) {
+		return uwsgi_mono_string(value, rlen);
+	}
+	return uwsgi_mono_string("", 0);
+}
+
+static MonoString *uwsgi_mono_method_GetKnownHeader(MonoObject *this, int index) {
+	struct wsgi_request *wsgi_req = uwsgi_mono_wsgi_req(this);
 	uint16_t rlen = 0;
-	char *value = uwsgi_get_header(wsgi_req, mono_string_to_utf8(key), mono_string_length(key), &rlen);
+	char *value = NULL;
+	if (index >= 0 && index < (int) (sizeof(uwsgi_mono_known_request_headers)/sizeof(struct uwsgi_mono_known_header))) {
+		struct uwsgi_mono_known_header *umkh = &uwsgi_mono_known_request_headers[index];
+		value = uwsgi_get_var(wsgi_req, umkh->key, umkh->len, &rlen);
+	}
 	if (value) {
-		return mono_string_new_len(mono_domain_get(), value, rlen);
+		return uwsgi_mono_string(value, rlen);
 	}
-	return mono_string_new(mono_domain_get(), "");
+	return uwsgi_mono_string("", 0);
 }
 
 static MonoString *uwsgi_mono_method_GetServerVariable(MonoObject *this, MonoString *key) {
-	struct wsgi_request *wsgi_req = current_wsgi_req();
+	struct wsgi_request *wsgi_req = uwsgi_mono_wsgi_req(this);
 	uint16_t rlen = 0;
-	char *value = uwsgi_get_var(wsgi_req, mono_string_to_utf8(key), mono_string_length(key), &rlen);
+	char *value = NULL;
+	char buf[256];
+	int key_len = uwsgi_mono_ascii(key, buf, 256);
+	if (key_len >= 0) {
+		value = uwsgi_get_var(wsgi_req, buf, key_len, &rlen);
+	}
 	if (value) {
-		return mono_string_new_len(mono_domain_get(), value, rlen);
+		return uwsgi_mono_string(value, rlen);
 	}
-	return mono_string_new(mono_domain_get(), "");
+	return uwsgi_mono_string("", 0);
 }
 
 static int uwsgi_mono_method_ReadEntityBody(MonoObject *this, MonoArray *byteArray, int len) {
-	struct wsgi_request *wsgi_req = current_wsgi_req();
-	char *buf = mono_array_addr(byteArray, char, 0);	
-	ssize_t rlen = 0;
-	char *chunk = uwsgi_request_body_read(wsgi_req, len, &rlen);
-	if (chunk == uwsgi.empty) {
-		return 0;
+	struct wsgi_request *wsgi_req = uwsgi_mono_wsgi_req(this);
+	// the body is read directly in the managed array, pin it as the wait hooks could switch to another core
+	uint32_t handle = mono_gchandle_new((MonoObject *) byteArray, 1);
+	char *buf = mono_array_addr(byteArray, char, 0);
+	int ret = 0;
+	while (ret < len) {
+		ssize_t rlen = uwsgi_request_body_read_nb(wsgi_req, buf + ret, len - ret);
+		if (rlen > 0) {
+			ret += rlen;
+			continue;
+		}
+		// end of the body
+		if (rlen == 0) break;
+		if (errno != EAGAIN) {
+			ret = -1;
+			break;
+		}
+		int wret = -1;
+		if (wsgi_req->post_stream) {
+			wret = uwsgi.wait_read_hook(wsgi_req->post_stream_fd, uwsgi.socket_timeout);
+			wsgi_req->switches++;
+		}
+		else {
+			wret = uwsgi_wait_read_req(wsgi_req);
+		}
+		if (wret <= 0) {
+			if (wret == 0) {
+				uwsgi_log("[uwsgi-mono] timeout reading the request body\n");
+			}
+			ret = -1;
+			break;
+		}
+	}
+	mono_gchandle_free(handle);
+	return ret;
+}
+
+// async mode: the body has been read by the core
+static MonoArray *uwsgi_mono_method_GetBody(MonoObject *this) {
+	struct wsgi_request *wsgi_req = uwsgi_mono_wsgi_req(this);
+	struct uwsgi_mono_body *umb = &umono.bodies[wsgi_req->async_id];
+	MonoArray *ret = mono_array_new(mono_domain_get(), umono.byte_class, umb->len);
+	if (umb->len > 0) {
+		memcpy(mono_array_addr(ret, char, 0), umb->buf, umb->len);
 	}
-	if (chunk) {
-		memcpy(buf, chunk, rlen);
-		return rlen;
+	return ret;
+}
+
+// async mode: wake up the core waiting for the response (called by managed threads)
+static void uwsgi_mono_method_Notify(int fd) {
+	if (write(fd, "", 1) < 0) {
+		// a full pipe means the core has already something to read
+		if (errno != EAGAIN) uwsgi_error("uwsgi_mono_method_Notify()/write()");
 	}
-	return -1;
 }
 
 static int uwsgi_mono_method_GetTotalEntityBodyLength(MonoObject *this) {
-	struct wsgi_request *wsgi_req = current_wsgi_req();
+	struct wsgi_request *wsgi_req = uwsgi_mono_wsgi_req(this);
 	return wsgi_req->post_cl;
 }
 
@@ -300,6 +502,10 @@ static void uwsgi_mono_add_internal_calls() {
 	mono_add_internal_call("uwsgi.uWSGIRequest::GetHttpVersion", uwsgi_mono_method_GetHttpVersion);
 	mono_add_internal_call("uwsgi.uWSGIRequest::GetServerVariable", uwsgi_mono_method_GetServerVariable);
 	mono_add_internal_call("uwsgi.uWSGIRequest::GetRemoteAddress", uwsgi_mono_method_GetRemoteAddress);
+	mono_add_internal_call("uwsgi.uWSGIRequest::GetKnownHeader", uwsgi_mono_method_GetKnownHeader);
+	mono_add_internal_call("uwsgi.uWSGIRequest::SendKnownHeader", uwsgi_mono_method_SendKnownHeader);
+	mono_add_internal_call("uwsgi.uWSGIAsyncRequest::GetBody", uwsgi_mono_method_GetBody);
+	mono_add_internal_call("uwsgi.uWSGIAsyncRequest::Notify", uwsgi_mono_method_Notify);
 
 	// api
 	mono_add_internal_call("uwsgi.api::Signal", uwsgi_mono_method_api_Signal);
@@ -326,6 +532,21 @@ static int uwsgi_mono_init() {
 }
 
 
+static void *uwsgi_mono_thunk(char *name) {
+	MonoMethodDesc *desc = mono_method_desc_new(name, 1);
+	if (!desc) {
+		uwsgi_log("unable to create description for %s\n", name);
+		exit(1);
+	}
+	MonoMethod *method = mono_method_desc_search_in_class(desc, umono.application_class);
+	mono_method_desc_free(desc);
+	if (!method) {
+		uwsgi_log("unable to find %s method in uWSGIApplication class\n", name);
+		exit(1);
+	}
+	return mono_method_get_unmanaged_thunk(method);
+}
+
 static void uwsgi_mono_create_jit() {
 
 
@@ -385,6 +606,12 @@ static void uwsgi_mono_create_jit() {
 		uwsgi_log("unable to get reference to field uwsgi.uWSGIRequest.filepath\n");
 	}
 
+	umono.wsgi_req = mono_class_get_field_from_name(urequest, "wsgi_req");
+	if (!umono.wsgi_req) {
+		uwsgi_log("unable to get reference to field uwsgi.uWSGIRequest.wsgi_req\n");
+		exit(1);
+	}
+
 	umono.api_class = mono_class_from_name(image, "uwsgi", "api");
         if (!umono.api_class) {
                 uwsgi_log("unable to get reference to class uwsgi.api\n");
@@ -403,19 +630,11 @@ static void uwsgi_mono_create_jit() {
 	}
 	mono_method_desc_free(desc);
 
-	desc = mono_method_desc_new("uwsgi.uWSGIApplication:Request()", 1);
-	if (!desc) {
-		uwsgi_log("unable to create description for uwsgi.uWSGIApplication:Request()\n");
-		exit(1);
+	umono.process_request = uwsgi_mono_thunk("uwsgi.uWSGIApplication:Request(intptr)");
+	if (umono.async) {
+		umono.process_request_async = uwsgi_mono_thunk("uwsgi.uWSGIApplication:RequestAsync(intptr,int)");
+		umono.drain = uwsgi_mono_thunk("uwsgi.uWSGIApplication:Drain(intptr)");
 	}
-	MonoMethod *process_request = mono_method_desc_search_in_class(desc, umono.application_class);
-	if (!process_request) {
-		uwsgi_log("unable to find ProcessRequest method in uwsgi_host class\n");
-		exit(1);
-	}
-	mono_method_desc_free(desc);
-
-	umono.process_request = mono_method_get_unmanaged_thunk(process_request);
 
 	struct uwsgi_string_list *usl = umono.exec;
 	while(usl) {
@@ -513,6 +732,63 @@ static void uwsgi_mono_init_apps() {
 	}
 }
 
+/*
+	async mode: the managed Task never touches the connection, it queues the response
+	and notifies the core, that sends the queued chunks calling Drain()
+*/
+static void uwsgi_mono_request_async(struct wsgi_request *wsgi_req, struct uwsgi_app *app) {
+	int *fds = &umono.notify_pipes[wsgi_req->async_id * 2];
+	if (fds[0] < 0) {
+		if (pipe(fds)) {
+			uwsgi_error("uwsgi_mono_request_async()/pipe()");
+			fds[0] = -1;
+			uwsgi_500(wsgi_req);
+			return;
+		}
+		uwsgi_socket_nb(fds[0]);
+		uwsgi_socket_nb(fds[1]);
+	}
+
+	struct uwsgi_mono_body *umb = &umono.bodies[wsgi_req->async_id];
+	umb->buf = NULL;
+	umb->len = 0;
+	if (wsgi_req->post_cl > 0) {
+		ssize_t rlen = 0;
+		char *buf = uwsgi_request_body_read(wsgi_req, 0, &rlen);
+		if (!buf) return;
+		if (buf != uwsgi.empty) {
+			umb->buf = buf;
+			umb->len = rlen;
+		}
+	}
+
+	MonoException *exc = NULL;
+	umono.process_request_async(app->callable, wsgi_req, fds[1], &exc);
+	if (exc) {
+		mono_print_unhandled_exception((MonoObject *)exc);
+		return;
+	}
+
+	for(;;) {
+		// the managed side is still using the request, timeouts are left to harakiri
+		int ret = uwsgi.wait_read_hook(fds[0], uwsgi.socket_timeout);
+		wsgi_req->switches++;
+		if (ret < 0) {
+			uwsgi_log("[uwsgi-mono] error waiting for the managed request\n");
+			break;
+		}
+		if (ret == 0) continue;
+		char tmp[64];
+		while (read(fds[0], tmp, 64) > 0);
+		int done = umono.drain(app->callable, wsgi_req, &exc);
+		if (exc) {
+			mono_print_unhandled_exception((MonoObject *)exc);
+			break;
+		}
+		if (done) break;
+	}
+}
+
 static int uwsgi_mono_request(struct wsgi_request *wsgi_req) {
 
 	/* Standard ASP.NET request */
@@ -587,12 +863,17 @@ static int uwsgi_mono_request(struct wsgi_request *wsgi_req) {
 	}
 	free(path);
 
-	MonoException *exc = NULL;
+	if (umono.async) {
+		uwsgi_mono_request_async(wsgi_req, app);
+	}
+	else {
+		MonoException *exc = NULL;
 
-	umono.process_request(app->callable, &exc);
+		umono.process_request(app->callable, wsgi_req, &exc);
 
-	if (exc) {
-		mono_print_unhandled_exception((MonoObject *)exc);
+		if (exc) {
+			mono_print_unhandled_exception((MonoObject *)exc);
+		}
 	}
 
 	if ( uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].requests % umono.gc_freq == 0) {
@@ -644,6 +925,15 @@ static void uwsgi_mono_post_fork() {
 	// yes, Mono is not fork-friendly, so we initialize it in the post_fork hook
 	uwsgi_mono_init_apps();
 
+	if (umono.async) {
+		int i;
+		umono.notify_pipes = uwsgi_malloc(sizeof(int) * 2 * uwsgi.cores);
+		for (i = 0; i < uwsgi.cores * 2; i++) {
+			umono.notify_pipes[i] = -1;
+		}
+		umono.bodies = uwsgi_calloc(sizeof(struct uwsgi_mono_body) * uwsgi.cores);
+	}
+
 	MonoMethodDesc *desc = mono_method_desc_new("uwsgi.api:RunPostForkHook()", 1);
         if (!desc) {
 		return;
@@ -4,6 +4,8 @@ using System.Net;
 using System.Web;
 using System.Web.Hosting;
 using System.Text;
+using System.Threading.Tasks;
+using System.Collections.Generic;
 using System.Runtime.CompilerServices;
 
 [assembly: System.Reflection.AssemblyVersion ("0.0.0.1")]
@@ -42,6 +44,12 @@ namespace uwsgi {
 	class uWSGIRequest: HttpWorkerRequest {
 
 		private String filepath = null;
+		// the struct wsgi_request of the core managing the request
+		private IntPtr wsgi_req;
+
+		public uWSGIRequest(IntPtr req) {
+			wsgi_req = req;
+		}
 
 		public override string GetAppPath() {
 			return "/";
@@ -67,9 +75,12 @@ namespace uwsgi {
 	
 
 		public override string GetKnownRequestHeader(int index) {
-			return GetHeaderByName(GetKnownRequestHeaderName(index));
+			return GetKnownHeader(index);
 		}
 
+		[MethodImplAttribute(MethodImplOptions.InternalCall)]
+		extern public string GetKnownHeader(int index);
+
 		[MethodImplAttribute(MethodImplOptions.InternalCall)]
 		extern public override int GetTotalEntityBodyLength();
 
@@ -119,10 +130,12 @@ namespace uwsgi {
 		extern public override string GetUriPath();
 
 		public override void SendKnownResponseHeader (int index, string value) {
-			string headerName = HttpWorkerRequest.GetKnownResponseHeaderName (index);
-                	SendUnknownResponseHeader (headerName, value);
+			SendKnownHeader(index, value);
 		}
 
+		[MethodImplAttribute(MethodImplOptions.InternalCall)]
+		extern public void SendKnownHeader(int index, string value);
+
 		[MethodImplAttribute(MethodImplOptions.InternalCall)]
 		extern public override void SendResponseFromMemory(byte[] chunk, int length);
 
@@ -147,11 +160,145 @@ namespace uwsgi {
 		}
 	}
 
+	/*
+		async mode: the request runs in a Task, the response is queued and sent
+		by the uWSGI core (calling Drain()) whenever it is notified
+	*/
+	class uWSGIAsyncRequest: uWSGIRequest {
+
+		private int notify_fd;
+		private bool ended = false;
+		private Queue<Action> actions = new Queue<Action>();
+
+		public uWSGIAsyncRequest(IntPtr req, int fd): base(req) {
+			notify_fd = fd;
+		}
+
+		[MethodImplAttribute(MethodImplOptions.InternalCall)]
+		extern private byte[] GetBody();
+
+		[MethodImplAttribute(MethodImplOptions.InternalCall)]
+		extern private static void Notify(int fd);
+
+		private void Enqueue(Action action) {
+			lock(actions) {
+				actions.Enqueue(action);
+			}
+		}
+
+		// the whole body is read by the core before starting the Task
+		public override bool IsEntireEntityBodyIsPreloaded() {
+			return true;
+		}
+
+		public override byte[] GetPreloadedEntityBody() {
+			return GetBody();
+		}
+
+		public override int ReadEntityBody(byte[] buffer, int size) {
+			return 0;
+		}
+
+		public override void SendStatus(int status, string msg) {
+			Enqueue(() => base.SendStatus(status, msg));
+		}
+
+		public override void SendKnownResponseHeader(int index, string value) {
+			Enqueue(() => base.SendKnownResponseHeader(index, value));
+		}
+
+		public override void SendUnknownResponseHeader(string name, string value) {
+			Enqueue(() => base.SendUnknownResponseHeader(name, value));
+		}
+
+		public override void SendResponseFromMemory(byte[] chunk, int length) {
+			// the caller could reuse the chunk
+			byte[] copy = new byte[length];
+			Buffer.BlockCopy(chunk, 0, copy, 0, length);
+			Enqueue(() => base.SendResponseFromMemory(copy, length));
+		}
+
+		public override void SendResponseFromFile(string filename, long offset, long length) {
+			Enqueue(() => base.SendResponseFromFile(filename, offset, length));
+		}
+
+		// the handle could be closed before the core sends it, read it now
+		public override void SendResponseFromFile(IntPtr handle, long offset, long length) {
+			using (FileStream fs = new FileStream(new Microsoft.Win32.SafeHandles.SafeFileHandle(handle, false), FileAccess.Read)) {
+				byte[] chunk = new byte[length];
+				fs.Seek(offset, SeekOrigin.Begin);
+				int len = fs.Read(chunk, 0, (int) length);
+				Enqueue(() => base.SendResponseFromMemory(chunk, len));
+			}
+		}
+
+		public override void FlushResponse(bool finalFlush) {
+			Enqueue(() => base.FlushResponse(finalFlush));
+			Notify(notify_fd);
+		}
+
+		public override void EndOfRequest() {
+			lock(actions) {
+				ended = true;
+			}
+			Notify(notify_fd);
+		}
+
+		// called by the core, returns 1 when the request is over
+		public int Drain() {
+			Action[] pending;
+			bool done;
+			lock(actions) {
+				pending = actions.ToArray();
+				actions.Clear();
+				done = ended;
+			}
+			try {
+				foreach(Action action in pending) {
+					action();
+				}
+			}
+			catch (Exception e) {
+				Console.Error.WriteLine(e);
+				done = true;
+			}
+			return done ? 1 : 0;
+		}
+	}
+
 	public class uWSGIApplicationHost: MarshalByRefObject {
-		public void ProcessRequest() {
-			uWSGIRequest ur = new uWSGIRequest();
+
+		private Dictionary<IntPtr, uWSGIAsyncRequest> running = new Dictionary<IntPtr, uWSGIAsyncRequest>();
+
+		public void ProcessRequest(IntPtr req) {
+			uWSGIRequest ur = new uWSGIRequest(req);
 			HttpRuntime.ProcessRequest(ur);
 		}
+
+		public void ProcessRequestAsync(IntPtr req, int fd) {
+			uWSGIAsyncRequest ur = new uWSGIAsyncRequest(req, fd);
+			lock(running) {
+				running[req] = ur;
+			}
+			Task.Factory.StartNew(() => HttpRuntime.ProcessRequest(ur)).ContinueWith(t => {
+				Console.Error.WriteLine(t.Exception);
+				ur.EndOfRequest();
+			}, TaskContinuationOptions.OnlyOnFaulted);
+		}
+
+		public int Drain(IntPtr req) {
+			uWSGIAsyncRequest ur;
+			lock(running) {
+				if (!running.TryGetValue(req, out ur)) return 1;
+			}
+			int ret = ur.Drain();
+			if (ret == 1) {
+				lock(running) {
+					running.Remove(req);
+				}
+			}
+			return ret;
+		}
 	}
 
 	public class uWSGIApplication {
@@ -162,8 +309,16 @@ namespace uwsgi {
 			appHost = (uWSGIApplicationHost)ApplicationHost.CreateApplicationHost(typeof(uWSGIApplicationHost), virtualPath, physicalPath);
 		}
 
-		public void Request() {
-			appHost.ProcessRequest();
+		public void Request(IntPtr req) {
+			appHost.ProcessRequest(req);
+		}
+
+		public void RequestAsync(IntPtr req, int fd) {
+			appHost.ProcessRequestAsync(req, fd);
+		}
+
+		public int Drain(IntPtr req) {
+			return appHost.Drain(req);
 		}
 	}
 
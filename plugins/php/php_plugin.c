@@ -32,7 +32,14 @@ struct uwsgi_php {
 	char *sapi_name;
 
 	int sapi_initialized;
-} uphp;
+
+	struct uwsgi_string_list *preload;
+	// per-core buffers coalescing the small writes of the scripts
+	size_t write_buffer_size;
+	struct uwsgi_buffer **write_buffers;
+} uphp = {
+	.write_buffer_size = 8192,
+};
 
 void uwsgi_opt_php_ini(char *opt, char *value, void *foobar) {
 	uwsgi_sapi_module.php_ini_path_override = uwsgi_str(value);
@@ -69,6 +76,8 @@ struct uwsgi_option uwsgi_php_options[] = {
         {"php-exec-after", required_argument, 0, "run specified php code after the requested script", uwsgi_opt_add_string_list, &uphp.exec_after, 0},
         {"php-exec-end", required_argument, 0, "run specified php code after the requested script", uwsgi_opt_add_string_list, &uphp.exec_after, 0},
         {"php-sapi-name", required_argument, 0, "hack the sapi name (required for enabling zend opcode cache)", uwsgi_opt_set_str, &uphp.sapi_name, 0},
+        {"php-preload", required_argument, 0, "run the specified php script in the master before forking (the files it compiles are shared via the opcode cache)", uwsgi_opt_add_string_list, &uphp.preload, 0},
+        {"php-write-buffer", required_argument, 0, "coalesce script output up to the specified size before sending it (default 8k, 0 disables)", uwsgi_opt_set_64bit, &uphp.write_buffer_size, 0},
 
         {"early-php", no_argument, 0, "initialize an early perl interpreter shared by all loaders", uwsgi_opt_early_php, NULL, UWSGI_OPT_IMMEDIATE},
         {"early-php-sapi-name", required_argument, 0, "hack the sapi name (required for enabling zend opcode cache)", uwsgi_opt_set_str, &uphp.sapi_name, UWSGI_OPT_IMMEDIATE},
@@ -76,18 +85,57 @@ struct uwsgi_option uwsgi_php_options[] = {
 };
 
 
+static int uwsgi_php_write(struct wsgi_request *wsgi_req, char *buf, size_t len TSRMLS_DC) {
+	uwsgi_response_write_body_do(wsgi_req, buf, len);
+	if (wsgi_req->write_errors > uwsgi.write_errors_tolerance) {
+		php_handle_aborted_connection();
+		return -1;
+	}
+	return 0;
+}
+
+static int uwsgi_php_flush_buffer(struct wsgi_request *wsgi_req TSRMLS_DC) {
+	if (!uphp.write_buffers) return 0;
+	struct uwsgi_buffer *ub = uphp.write_buffers[wsgi_req->async_id];
+	if (!ub->pos) return 0;
+	size_t len = ub->pos;
+	uwsgi_buffer_reset(ub);
+	return uwsgi_php_write(wsgi_req, ub->buf, len TSRMLS_CC);
+}
+
 static int sapi_uwsgi_ub_write(const char *str, uint str_length TSRMLS_DC)
 {
 	struct wsgi_request *wsgi_req = (struct wsgi_request *) SG(server_context);
 
-	uwsgi_response_write_body_do(wsgi_req, (char *) str, str_length);
-	if (wsgi_req->write_errors > uwsgi.write_errors_tolerance) {
-		php_handle_aborted_connection();
-		return -1;
+	// preloading in the master, there is no client
+	if (!wsgi_req) return str_length;
+
+	if (uphp.write_buffers) {
+		struct uwsgi_buffer *ub = uphp.write_buffers[wsgi_req->async_id];
+		if (ub->pos + str_length > ub->len) {
+			if (uwsgi_php_flush_buffer(wsgi_req TSRMLS_CC)) return -1;
+		}
+		if (str_length < ub->len) {
+			if (uwsgi_buffer_append(ub, (char *) str, str_length)) return -1;
+			return str_length;
+		}
 	}
+
+	if (uwsgi_php_write(wsgi_req, (char *) str, str_length TSRMLS_CC)) return -1;
 	return str_length;
 }
 
+// flush() from the scripts
+static void sapi_uwsgi_flush(void *server_context)
+{
+	struct wsgi_request *wsgi_req = (struct wsgi_request *) server_context;
+#ifdef ZTS
+	TSRMLS_FETCH();
+#endif
+	if (!wsgi_req) return;
+	uwsgi_php_flush_buffer(wsgi_req TSRMLS_CC);
+}
+
 static int sapi_uwsgi_send_headers(sapi_headers_struct *sapi_headers TSRMLS_DC)
 {
 	sapi_header_struct *h;
@@ -127,6 +175,7 @@ static int sapi_uwsgi_read_post(char *buffer, uint count_bytes TSRMLS_DC)
 	uint read_bytes = 0;
 	
 	struct wsgi_request *wsgi_req = (struct wsgi_request *) SG(server_context);
+	if (!wsgi_req) return 0;
 
         count_bytes = MIN(count_bytes, wsgi_req->post_cl - SG(read_post_bytes));
 
@@ -150,6 +199,7 @@ static char *sapi_uwsgi_read_cookies(TSRMLS_D)
 {
 	uint16_t len = 0;
 	struct wsgi_request *wsgi_req = (struct wsgi_request *) SG(server_context);
+	if (!wsgi_req) return NULL;
 
 	char *cookie = uwsgi_get_var(wsgi_req, (char *)"HTTP_COOKIE", 11, &len);
 	if (cookie) {
@@ -162,8 +212,10 @@ static char *sapi_uwsgi_read_cookies(TSRMLS_D)
 static void sapi_uwsgi_register_variables(zval *track_vars_array TSRMLS_DC)
 {
 	int i;
+	char key[256];
 	struct wsgi_request *wsgi_req = (struct wsgi_request *) SG(server_context);
 	php_import_environment_variables(track_vars_array TSRMLS_CC);
+	if (!wsgi_req) return;
 
 	if (uphp.server_software) {
 		if (!uphp.server_software_len) uphp.server_software_len = strlen(uphp.server_software);
@@ -173,10 +225,21 @@ static void sapi_uwsgi_register_variables(zval *track_vars_array TSRMLS_DC)
 		php_register_variable_safe("SERVER_SOFTWARE", "uWSGI", 5, track_vars_array TSRMLS_CC);
 	}
 
+	// php copies the names, so they can live on the stack
 	for (i = 0; i < wsgi_req->var_cnt; i += 2) {
-		php_register_variable_safe( estrndup(wsgi_req->hvec[i].iov_base, wsgi_req->hvec[i].iov_len),
+		size_t keylen = wsgi_req->hvec[i].iov_len;
+		char *name = key;
+		if (keylen >= sizeof(key)) {
+			name = estrndup(wsgi_req->hvec[i].iov_base, keylen);
+		}
+		else {
+			memcpy(key, wsgi_req->hvec[i].iov_base, keylen);
+			key[keylen] = 0;
+		}
+		php_register_variable_safe(name,
 			wsgi_req->hvec[i + 1].iov_base, wsgi_req->hvec[i + 1].iov_len,
 			track_vars_array TSRMLS_CC);
+		if (name != key) efree(name);
         }
 
 	php_register_variable_safe("PATH_INFO", wsgi_req->path_info, wsgi_req->path_info_len, track_vars_array TSRMLS_CC);
@@ -202,12 +265,11 @@ static void sapi_uwsgi_register_variables(zval *track_vars_array TSRMLS_DC)
 
 	php_register_variable_safe("PHP_SELF", wsgi_req->script_name, wsgi_req->script_name_len, track_vars_array TSRMLS_CC);
 
+	// already split by uwsgi_php_init()
 	struct uwsgi_string_list *usl = uphp.vars;
 	while(usl) {
-		char *equal = strchr(usl->value, '=');
-		if (equal) {
-			php_register_variable_safe( estrndup(usl->value, equal-usl->value),
-				equal+1, strlen(equal+1), track_vars_array TSRMLS_CC);
+		if (usl->custom_ptr) {
+			php_register_variable_safe(usl->value, usl->custom_ptr, usl->custom, track_vars_array TSRMLS_CC);
 		}
 		usl = usl->next;
 	}
@@ -545,7 +607,7 @@ static sapi_module_struct uwsgi_sapi_module = {
 	NULL,									/* deactivate */
 
 	sapi_uwsgi_ub_write,
-	NULL,
+	sapi_uwsgi_flush,
 	NULL,									/* get uid */
 	NULL,									/* getenv */
 
@@ -565,6 +627,40 @@ static sapi_module_struct uwsgi_sapi_module = {
 	STANDARD_SAPI_MODULE_PROPERTIES
 };
 
+/*
+	run the --php-preload scripts in a request-less context before forking,
+	with OPcache enabled the compiled files (and what they include) end in its shared memory
+*/
+static void uwsgi_php_preload() {
+	struct uwsgi_string_list *usl;
+#ifdef ZTS
+	TSRMLS_FETCH();
+#endif
+	uwsgi_foreach(usl, uphp.preload) {
+		zend_file_handle file_handle;
+
+		SG(server_context) = NULL;
+		SG(request_info).path_translated = usl->value;
+		SG(request_info).content_length = 0;
+
+		file_handle.type = ZEND_HANDLE_FILENAME;
+		file_handle.filename = usl->value;
+		file_handle.free_filename = 0;
+		file_handle.opened_path = NULL;
+
+		if (php_request_startup(TSRMLS_C) == FAILURE) {
+			uwsgi_log("unable to preload %s\n", usl->value);
+			exit(1);
+		}
+		SG(headers_sent) = 1;
+		SG(request_info).no_headers = 1;
+		php_execute_script(&file_handle TSRMLS_CC);
+		php_request_shutdown(NULL);
+		SG(request_info).path_translated = NULL;
+		uwsgi_log("PHP preloaded %s\n", usl->value);
+	}
+}
+
 static int uwsgi_php_init(void) {
 
 	struct uwsgi_string_list *pset = uphp.set;
@@ -608,12 +704,35 @@ static int uwsgi_php_init(void) {
 		uwsgi_sapi_module.name = uphp.sapi_name;
 	}
 
+	// --php-var are split once
+	struct uwsgi_string_list *usl = uphp.vars;
+	while(usl) {
+		char *equal = strchr(usl->value, '=');
+		if (equal && !usl->custom_ptr) {
+			*equal = 0;
+			usl->custom_ptr = equal+1;
+			usl->custom = strlen(equal+1);
+		}
+		usl = usl->next;
+	}
+
 	uwsgi_sapi_module.startup(&uwsgi_sapi_module);
 	uwsgi_log("PHP %s initialized\n", PHP_VERSION);
 
+	uwsgi_php_preload();
+
 	return 0;
 }
 
+static void uwsgi_php_post_fork() {
+	if (!uphp.write_buffer_size || uphp.write_buffers) return;
+	int i;
+	uphp.write_buffers = uwsgi_calloc(sizeof(struct uwsgi_buffer *) * uwsgi.cores);
+	for(i=0;i<uwsgi.cores;i++) {
+		uphp.write_buffers[i] = uwsgi_buffer_new(uphp.write_buffer_size);
+	}
+}
+
 int uwsgi_php_walk(struct wsgi_request *wsgi_req, char *full_path, char *docroot, size_t docroot_len, char **path_info) {
 
         // and now start walking...
@@ -686,6 +805,8 @@ int uwsgi_php_request(struct wsgi_request *wsgi_req) {
 #endif
 
 	SG(server_context) = (void *) wsgi_req;
+	// a previous request could have been interrupted
+	if (uphp.write_buffers) uwsgi_buffer_reset(uphp.write_buffers[wsgi_req->async_id]);
 
 	if (uwsgi_parse_vars(wsgi_req)) {
 		return -1;
@@ -938,6 +1059,8 @@ secure3:
 
 end:
         php_request_shutdown(NULL);
+	// the output layer is flushed by php_request_shutdown()
+	uwsgi_php_flush_buffer(wsgi_req TSRMLS_CC);
 
 	return 0;
 }
@@ -954,6 +1077,7 @@ SAPI_API struct uwsgi_plugin php_plugin = {
 	.init = uwsgi_php_init,
 	.request = uwsgi_php_request,
 	.after_request = uwsgi_php_after_request,
+	.post_fork = uwsgi_php_post_fork,
 	.options = uwsgi_php_options,
 };
 
@@ -72,11 +72,16 @@ struct uwsgi_perl {
 	char *early_psgi_app_name;
 
 	PerlInterpreter *early_interpreter;
+
+	uint64_t coalesce;
+	struct uwsgi_buffer **coalesce_buffers;
 };
 
 void init_perl_embedded_module(void);
 void uwsgi_psgi_app(void);
 int psgi_response(struct wsgi_request *, AV*);
+int psgi_write_body(struct wsgi_request *, char *, size_t);
+void psgi_coalesce_flush(struct wsgi_request *);
 
 #define psgi_xs(func) newXS("uwsgi::" #func, XS_##func, "uwsgi")
 #define psgi_check_args(x) if (items < x) Perl_croak(aTHX_ "Usage: uwsgi::%s takes %d arguments", __FUNCTION__ + 3, x)
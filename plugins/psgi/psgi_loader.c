@@ -190,8 +190,11 @@ ret:
 XS(XS_streaming_close) {
 
         dXSARGS;
+        struct wsgi_request *wsgi_req = current_wsgi_req();
         psgi_check_args(0);
 
+        psgi_coalesce_flush(wsgi_req);
+
         XSRETURN(0);
 }
 
@@ -206,7 +209,7 @@ XS(XS_streaming_write) {
 
         body = SvPV(ST(1), blen);
 
-	uwsgi_response_write_body_do(wsgi_req, body, blen);
+	psgi_write_body(wsgi_req, body, blen);
 	uwsgi_pl_check_write_errors {
 		croak("error while streaming PSGI response");
 	}
@@ -584,6 +587,14 @@ void uwsgi_psgi_preinit_apps() {
 
 void uwsgi_psgi_app() {
 
+	if (uperl.coalesce && !uperl.coalesce_buffers) {
+		int i;
+		uperl.coalesce_buffers = uwsgi_calloc(sizeof(struct uwsgi_buffer *) * uwsgi.cores);
+		for(i=0;i<uwsgi.cores;i++) {
+			uperl.coalesce_buffers[i] = uwsgi_buffer_new(uperl.coalesce);
+		}
+	}
+
 	if (uperl.early_psgi_callable) {
 		uwsgi_perl_add_app(NULL, uperl.early_psgi_app_name, uperl.main, uperl.early_psgi_callable, uwsgi_now());	
 	}
@@ -69,6 +69,7 @@ struct uwsgi_option uwsgi_perl_options[] = {
 
         {"psgi", required_argument, 0, "load a psgi app", uwsgi_opt_set_str, &uperl.psgi, 0},
         {"psgi-enable-psgix-io", no_argument, 0, "enable psgix.io support", uwsgi_opt_true, &uperl.enable_psgix_io, 0},
+        {"psgi-coalesce", required_argument, 0, "coalesce the streamed (writer and getline) body chunks until they reach the specified size", uwsgi_opt_set_64bit, &uperl.coalesce, 0},
         {"perl-no-die-catch", no_argument, 0, "do not catch $SIG{__DIE__}", uwsgi_opt_true, &uperl.no_die_catch, 0},
         {"perl-local-lib", required_argument, 0, "set perl locallib path", uwsgi_opt_set_str, &uperl.locallib, 0},
 #ifdef PERL_VERSION_STRING
@@ -579,6 +580,7 @@ int uwsgi_perl_request(struct wsgi_request *wsgi_req) {
 		else {
 			SvREFCNT_dec(stream_result);
 		}
+		psgi_coalesce_flush(wsgi_req);
 		goto clear2;
 	}
 
@@ -630,6 +632,9 @@ static void psgi_call_cleanup_hook(SV *hook, SV *env) {
 
 void uwsgi_perl_after_request(struct wsgi_request *wsgi_req) {
 
+	// delayed responses whose writer has not been closed
+	psgi_coalesce_flush(wsgi_req);
+
 	log_request(wsgi_req);
 
 	// We may be called after an early exit in XS_coroae_accept_request, 
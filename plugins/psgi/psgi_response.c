@@ -1,6 +1,110 @@
 #include "psgi.h"
 
 extern struct uwsgi_server uwsgi;
+extern struct uwsgi_perl uperl;
+
+// $/ used when calling getline() on body objects (as suggested by the PSGI spec)
+#define PSGI_GETLINE_CHUNK 65536
+
+/*
+	small body chunks are accumulated (--psgi-coalesce) in a per-core buffer
+	and sent when it reaches the configured size or when the response ends
+*/
+int psgi_write_body(struct wsgi_request *wsgi_req, char *buf, size_t len) {
+	if (!uperl.coalesce || !uperl.coalesce_buffers) {
+		return uwsgi_response_write_body_do(wsgi_req, buf, len);
+	}
+	struct uwsgi_buffer *ub = uperl.coalesce_buffers[wsgi_req->async_id];
+	if (len >= uperl.coalesce) {
+		psgi_coalesce_flush(wsgi_req);
+		return uwsgi_response_write_body_do(wsgi_req, buf, len);
+	}
+	if (uwsgi_buffer_append(ub, buf, len)) return -1;
+	if (ub->pos >= uperl.coalesce) {
+		psgi_coalesce_flush(wsgi_req);
+	}
+	return 0;
+}
+
+void psgi_coalesce_flush(struct wsgi_request *wsgi_req) {
+	if (!uperl.coalesce_buffers) return;
+	struct uwsgi_buffer *ub = uperl.coalesce_buffers[wsgi_req->async_id];
+	if (!ub->pos) return;
+	uwsgi_response_write_body_do(wsgi_req, ub->buf, ub->pos);
+	ub->pos = 0;
+}
+
+// call getline() on a body object reading chunks instead of lines
+static SV *psgi_getline(SV *obj) {
+	dTHX;
+	SV *rs = PL_rs;
+	PL_rs = newRV_noinc(newSViv(PSGI_GETLINE_CHUNK));
+	SV *chunk = uwsgi_perl_obj_call(obj, "getline");
+	SvREFCNT_dec(PL_rs);
+	PL_rs = rs;
+	return chunk;
+}
+
+// PerlIO layers passing data untouched, a filehandle using only them can be sent with sendfile()
+static int psgi_raw_layers(pTHX_ PerlIO *fp) {
+	int ret = 1;
+	AV *layers = PerlIO_get_layers(aTHX_ fp);
+	if (!layers) return 0;
+	I32 i, last = av_len(layers);
+	// name, arguments, flags triplets
+	for(i=0;i<=last;i+=3) {
+		SV **name = av_fetch(layers, i, 0);
+		if (!name || !SvOK(*name)) continue;
+		char *n = SvPV_nolen(*name);
+		if (strcmp(n, "unix") && strcmp(n, "perlio") && strcmp(n, "stdio") && strcmp(n, "mmap")) {
+			ret = 0;
+			break;
+		}
+	}
+	SvREFCNT_dec((SV *) layers);
+	return ret;
+}
+
+/*
+	a real filehandle: regular files without transforming layers go to sendfile()/offload
+	(starting from the current position), everything else is read via PerlIO in big chunks
+*/
+static void psgi_response_filehandle(struct wsgi_request *wsgi_req, PerlIO *fp) {
+	dTHX;
+	int fd = PerlIO_fileno(fp);
+	struct stat st;
+	if (fd >= 0 && psgi_raw_layers(aTHX_ fp) && !fstat(fd, &st) && S_ISREG(st.st_mode)) {
+		// data already buffered by perl is accounted by tell()
+		Off_t pos = PerlIO_tell(fp);
+		if (pos < 0) pos = 0;
+		if (pos >= st.st_size) {
+			uwsgi_response_write_headers_do(wsgi_req);
+			return;
+		}
+		// no need to close here as perl GC will do the close()
+		wsgi_req->sendfile_fd = fd;
+		uwsgi_response_sendfile_do(wsgi_req, fd, pos, st.st_size - pos);
+		return;
+	}
+
+	char buf[PSGI_GETLINE_CHUNK];
+	for(;;) {
+		SSize_t rlen = PerlIO_read(fp, buf, PSGI_GETLINE_CHUNK);
+		if (rlen <= 0) {
+			if (PerlIO_error(fp)) {
+				uwsgi_log("[uwsgi-perl] error reading the PSGI response filehandle\n");
+			}
+			break;
+		}
+		wsgi_req->switches++;
+		uwsgi_response_write_body_do(wsgi_req, buf, rlen);
+		uwsgi_pl_check_write_errors {
+			break;
+		}
+	}
+	// ensure headers are sent for empty bodies
+	uwsgi_response_write_headers_do(wsgi_req);
+}
 
 int psgi_response(struct wsgi_request *wsgi_req, AV *response) {
 
@@ -16,7 +120,7 @@ int psgi_response(struct wsgi_request *wsgi_req, AV *response) {
 		wsgi_req->async_force_again = 0;
 
 		wsgi_req->switches++;
-                SV *chunk = uwsgi_perl_obj_call(wsgi_req->async_placeholder, "getline");
+                SV *chunk = psgi_getline(wsgi_req->async_placeholder);
 		if (!chunk) {
 			uwsgi_500(wsgi_req);
 			return UWSGI_OK;
@@ -29,6 +133,7 @@ int psgi_response(struct wsgi_request *wsgi_req, AV *response) {
 			if (wsgi_req->async_force_again) {
 				return UWSGI_AGAIN;
 			}
+			psgi_coalesce_flush(wsgi_req);
 			SV *closed = uwsgi_perl_obj_call(wsgi_req->async_placeholder, "close");
                 	if (closed) {
                         	SvREFCNT_dec(closed);
@@ -45,7 +150,7 @@ int psgi_response(struct wsgi_request *wsgi_req, AV *response) {
 			return UWSGI_OK;
                 }
 
-		uwsgi_response_write_body_do(wsgi_req, chitem, hlen);
+		psgi_write_body(wsgi_req, chitem, hlen);
 		uwsgi_pl_check_write_errors {
 			SvREFCNT_dec(chunk);
 			return UWSGI_OK;
@@ -104,20 +209,15 @@ int psgi_response(struct wsgi_request *wsgi_req, AV *response) {
         if (!rv)
                 goto invalid_body;
 
-        IO *io = GvIO(rv);
-
-        if (io) {
-                const int fd = PerlIO_fileno(IoIFP(io));
+        IO *io = SvTYPE(rv) == SVt_PVGV ? GvIO(rv) : NULL;
 
-                if (fd >= 0) {
-                        wsgi_req->sendfile_fd = fd;
-                        uwsgi_response_sendfile_do(wsgi_req, wsgi_req->sendfile_fd, 0, 0);
-                        // no need to close here as perl GC will do the close()
-                        uwsgi_pl_check_write_errors {
-                                // noop
-                        }
-                        return UWSGI_OK;
+        // real filehandles (not tied ones) are managed in C
+        if (io && IoIFP(io) && !SvTIED_mg((SV *) io, PERL_MAGIC_tiedscalar)) {
+                psgi_response_filehandle(wsgi_req, IoIFP(io));
+                uwsgi_pl_check_write_errors {
+                        // noop
                 }
+                return UWSGI_OK;
         }
 
         if (SvOBJECT(rv)) {
@@ -137,7 +237,7 @@ int psgi_response(struct wsgi_request *wsgi_req, AV *response) {
                 for(;;) {
 
 			wsgi_req->switches++;
-                        SV *chunk = uwsgi_perl_obj_call(*hitem, "getline");
+                        SV *chunk = psgi_getline(*hitem);
 			if (!chunk) {
 				uwsgi_500(wsgi_req);
 				break;
@@ -153,7 +253,7 @@ int psgi_response(struct wsgi_request *wsgi_req, AV *response) {
                                 break;
                         }
 
-			uwsgi_response_write_body_do(wsgi_req, chitem, hlen);
+			psgi_write_body(wsgi_req, chitem, hlen);
 			uwsgi_pl_check_write_errors {
 				SvREFCNT_dec(chunk);
                                 break;
@@ -165,7 +265,7 @@ int psgi_response(struct wsgi_request *wsgi_req, AV *response) {
 				return UWSGI_AGAIN;
 			}
                 }
-
+		psgi_coalesce_flush(wsgi_req);
 
 		SV *closed = uwsgi_perl_obj_call(*hitem, "close");
 		if (closed) {
@@ -177,14 +277,27 @@ int psgi_response(struct wsgi_request *wsgi_req, AV *response) {
 
                 body = (AV *) rv;
 
-                for(i=0; i<=av_len(body); i++) {
+		// items are sent (along with the headers) with a single writev() without copying them
+		struct iovec iov[UWSGI_RESPONSE_IOV];
+		size_t iov_n = 0;
+		I32 last = av_len(body);
+                for(i=0; i<=last; i++) {
                         hitem = av_fetch(body,i,0);
+			if (!hitem) continue;
                         chitem = SvPV(*hitem, hlen);
-			uwsgi_response_write_body_do(wsgi_req, chitem, hlen);
+			iov[iov_n].iov_base = chitem;
+			iov[iov_n].iov_len = hlen;
+			iov_n++;
+			if (iov_n < UWSGI_RESPONSE_IOV && i < last) continue;
+			uwsgi_response_writev_body_do(wsgi_req, iov, iov_n);
+			iov_n = 0;
 			uwsgi_pl_check_write_errors {
 				break;
 			}
                 }
+		if (iov_n > 0) {
+			uwsgi_response_writev_body_do(wsgi_req, iov, iov_n);
+		}
         }
         else {
 invalid_body:
@@ -848,6 +848,62 @@ XS(XS_sharedarea_readfast) {
 }
 
 
+XS(XS_sharedarea_fetch_add) {
+	dXSARGS;
+	int64_t amount = 1;
+	int64_t old = 0;
+	psgi_check_args(2);
+
+	int id = SvIV(ST(0));
+	uint64_t pos = SvIV(ST(1));
+	if (items > 2) {
+		amount = SvIV(ST(2));
+	}
+
+	if (uwsgi_sharedarea_fetch_add64(id, pos, amount, &old)) {
+		croak("unable to update sharedarea %d", id);
+		XSRETURN_UNDEF;
+	}
+
+	ST(0) = newSViv(old);
+	sv_2mortal(ST(0));
+	XSRETURN(1);
+}
+
+#define psgi_sharedarea_atomic(x) XS(XS_sharedarea_##x) {\
+	dXSARGS;\
+	int64_t old = 0;\
+	psgi_check_args(3);\
+	int id = SvIV(ST(0));\
+	if (uwsgi_sharedarea_##x##64(id, SvIV(ST(1)), SvIV(ST(2)), &old)) {\
+		croak("unable to update sharedarea %d", id);\
+		XSRETURN_UNDEF;\
+	}\
+	ST(0) = newSViv(old);\
+	sv_2mortal(ST(0));\
+	XSRETURN(1);\
+}
+
+psgi_sharedarea_atomic(xchg)
+psgi_sharedarea_atomic(min)
+psgi_sharedarea_atomic(max)
+
+// returns true when the value has been swapped
+XS(XS_sharedarea_cas) {
+	dXSARGS;
+	int64_t old = 0;
+	psgi_check_args(4);
+
+	int id = SvIV(ST(0));
+	int ret = uwsgi_sharedarea_cas64(id, SvIV(ST(1)), SvIV(ST(2)), SvIV(ST(3)), &old);
+	if (ret < 0) {
+		croak("unable to update sharedarea %d", id);
+		XSRETURN_UNDEF;
+	}
+	if (ret) XSRETURN_NO;
+	XSRETURN_YES;
+}
+
 XS(XS_sharedarea_write) {
         dXSARGS;
         int id;
@@ -1046,6 +1102,11 @@ void init_perl_embedded_module() {
 	psgi_xs(sharedarea_readfast);
 	psgi_xs(sharedarea_write);
 	psgi_xs(sharedarea_wait);
+	psgi_xs(sharedarea_fetch_add);
+	psgi_xs(sharedarea_xchg);
+	psgi_xs(sharedarea_cas);
+	psgi_xs(sharedarea_min);
+	psgi_xs(sharedarea_max);
 
 	psgi_xs(spooler);
 	psgi_xs(spool);
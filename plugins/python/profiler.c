@@ -1,6 +1,8 @@
 #include "uwsgi_python.h"
+#include <pythread.h>
 
 extern struct uwsgi_server uwsgi;
+extern struct uwsgi_python up;
 
 #ifdef HAS_NOT_PyFrame_GetLineNumber
 int PyFrame_GetLineNumber(PyFrameObject *frame) {
@@ -74,3 +76,170 @@ int uwsgi_python_tracer(PyObject *obj, PyFrameObject *frame, int what, PyObject
         return 0;
 }
 
+
+/*
+	sampling profiler (--py-sampler <hz>)
+
+	a thread of each worker periodically walks the stacks of the python threads
+	and accounts them (as folded stacks) in a per-worker shared table,
+	the master exports the table in the "python_samples" list of the stats server
+*/
+
+#if PY_VERSION_HEX >= 0x03090000
+#define uwsgi_py_frame_code(f) PyFrame_GetCode(f)
+#define uwsgi_py_frame_back(f) PyFrame_GetBack(f)
+#define uwsgi_py_frame_unref(o) Py_XDECREF(o)
+#else
+#define uwsgi_py_frame_code(f) (f)->f_code
+#define uwsgi_py_frame_back(f) (f)->f_back
+#define uwsgi_py_frame_unref(o)
+#endif
+
+static struct uwsgi_python_sample *uwsgi_python_samples(int wid) {
+	return &up.samples[(wid - 1) * up.sampler_slots];
+}
+
+// copy a code object string to the folded stack, json and folding separators are masked
+static size_t uwsgi_python_sample_str(char *dst, size_t len, PyObject *o) {
+#ifdef PYTHREE
+	const char *s = PyUnicode_Check(o) ? PyUnicode_AsUTF8(o) : NULL;
+#else
+	const char *s = PyString_Check(o) ? PyString_AsString(o) : NULL;
+#endif
+	if (!s) {
+		PyErr_Clear();
+		s = "?";
+	}
+	size_t i;
+	for(i=0;i<len && s[i];i++) {
+		char c = s[i];
+		if (c == ';' || c == '"' || c == '\\' || (unsigned char) c < 32) c = '_';
+		dst[i] = c;
+	}
+	return i;
+}
+
+// build the folded stack (root first) of a frame, deep stacks lose their root frames
+static uint16_t uwsgi_python_sample_fold(PyFrameObject *frame, char *buf) {
+	char item[UWSGI_PYTHON_SAMPLE_STACK];
+	size_t pos = UWSGI_PYTHON_SAMPLE_STACK;
+	PyFrameObject *f = frame;
+	Py_XINCREF(f);
+	while(f) {
+		PyCodeObject *code = uwsgi_py_frame_code(f);
+		size_t ilen = uwsgi_python_sample_str(item, 128, code->co_name);
+		item[ilen++] = ' ';
+		item[ilen++] = '(';
+		ilen += uwsgi_python_sample_str(item + ilen, 256, code->co_filename);
+		ilen += snprintf(item + ilen, 16, ":%d)", code->co_firstlineno);
+		uwsgi_py_frame_unref((PyObject *) code);
+		// separator
+		if (pos < UWSGI_PYTHON_SAMPLE_STACK) ilen++;
+		if (ilen > pos) {
+			Py_DECREF(f);
+			break;
+		}
+		pos -= ilen;
+		memcpy(buf + pos, item, ilen);
+		if (pos + ilen < UWSGI_PYTHON_SAMPLE_STACK) buf[pos + ilen - 1] = ';';
+		PyFrameObject *back = uwsgi_py_frame_back(f);
+#if PY_VERSION_HEX < 0x03090000
+		Py_XINCREF(back);
+#endif
+		Py_DECREF(f);
+		f = back;
+	}
+	size_t len = UWSGI_PYTHON_SAMPLE_STACK - pos;
+	memmove(buf, buf + pos, len);
+	return len;
+}
+
+static void uwsgi_python_sample_account(struct uwsgi_python_sample *samples, char *stack, uint16_t len) {
+	uint32_t hash = djb33x_hash(stack, len);
+	// 0 marks empty slots
+	if (!hash) hash = 1;
+	uint64_t i;
+	for(i=0;i<up.sampler_slots;i++) {
+		struct uwsgi_python_sample *ups = &samples[(hash + i) % up.sampler_slots];
+		if (!ups->hash) {
+			memcpy(ups->stack, stack, len);
+			ups->len = len;
+			ups->count = 1;
+			// the master can read the slot only when it is complete
+			__sync_synchronize();
+			ups->hash = hash;
+			return;
+		}
+		if (ups->hash == hash && ups->len == len && !memcmp(ups->stack, stack, len)) {
+			ups->count++;
+			return;
+		}
+	}
+	// the table is full
+	up.samples_dropped[uwsgi.mywid]++;
+}
+
+void *uwsgi_python_sampler_thread(void *foobar) {
+
+	PyObject *new_thread = uwsgi_python_setup_thread("uWSGISampler");
+	if (!new_thread) return NULL;
+
+	PyObject *sys_module = PyImport_ImportModule("sys");
+	PyObject *_current_frames = sys_module ? PyObject_GetAttrString(sys_module, "_current_frames") : NULL;
+	if (!_current_frames) {
+		PyErr_Print();
+		UWSGI_RELEASE_GIL;
+		return NULL;
+	}
+
+	struct uwsgi_python_sample *samples = uwsgi_python_samples(uwsgi.mywid);
+	long my_ident = PyThread_get_thread_ident();
+	char stack[UWSGI_PYTHON_SAMPLE_STACK];
+	useconds_t interval = 1000000 / up.sampler_hz;
+
+	for(;;) {
+		UWSGI_RELEASE_GIL;
+		usleep(interval);
+		UWSGI_GET_GIL;
+
+		PyObject *current_frames = PyObject_CallObject(_current_frames, NULL);
+		if (!current_frames) {
+			PyErr_Clear();
+			continue;
+		}
+
+		PyObject *thread_id, *frame;
+		Py_ssize_t pos = 0;
+		while (PyDict_Next(current_frames, &pos, &thread_id, &frame)) {
+			if (PyInt_AsLong(thread_id) == my_ident) continue;
+			uint16_t len = uwsgi_python_sample_fold((PyFrameObject *) frame, stack);
+			if (len > 0) uwsgi_python_sample_account(samples, stack, len);
+		}
+		Py_DECREF(current_frames);
+	}
+
+	return NULL;
+}
+
+// runs in the master, exports the folded stacks of a worker as "stack count" strings
+int uwsgi_python_sampler_stats(struct uwsgi_stats *us, int wid) {
+	if (!up.samples) return 0;
+	struct uwsgi_python_sample *samples = uwsgi_python_samples(wid);
+	char item[UWSGI_PYTHON_SAMPLE_STACK + 32];
+
+	if (uwsgi_stats_keylong_comma(us, "python_samples_dropped", (unsigned long long) up.samples_dropped[wid])) return -1;
+	if (uwsgi_stats_key(us, "python_samples")) return -1;
+	if (uwsgi_stats_list_open(us)) return -1;
+	int first = 1;
+	uint64_t i;
+	for(i=0;i<up.sampler_slots;i++) {
+		struct uwsgi_python_sample *ups = &samples[i];
+		if (!ups->hash) continue;
+		if (!first && uwsgi_stats_comma(us)) return -1;
+		snprintf(item, sizeof(item), "%.*s %llu", (int) ups->len, ups->stack, (unsigned long long) ups->count);
+		if (uwsgi_stats_str(us, item)) return -1;
+		first = 0;
+	}
+	if (uwsgi_stats_list_close(us)) return -1;
+	return uwsgi_stats_comma(us);
+}
@@ -86,6 +86,9 @@ int init_uwsgi_app(int loader, void *arg1, struct wsgi_request *wsgi_req, PyThre
 	struct uwsgi_app *wi;
 
 	time_t now = uwsgi_now();
+	// sub-stages timing (interpreter setup and import of the callable)
+	uint64_t load_start = uwsgi_micros();
+	uint64_t import_start = 0, import_end = 0;
 
 	if (uwsgi_get_app_id(NULL, wsgi_req->appid, wsgi_req->appid_len, -1) != -1) {
 		uwsgi_log( "mountpoint %.*s already configured. skip.\n", wsgi_req->appid_len, wsgi_req->appid);
@@ -191,7 +194,9 @@ int init_uwsgi_app(int loader, void *arg1, struct wsgi_request *wsgi_req, PyThre
 		}
 	}
 
+	import_start = uwsgi_micros();
 	wi->callable = up.loaders[loader](arg1);
+	import_end = uwsgi_micros();
 
 	if (!wi->callable) {
 		uwsgi_log("unable to load app %d (mountpoint='%s') (callable not found or import error)\n", id, wi->mountpoint);
@@ -322,6 +327,28 @@ int init_uwsgi_app(int loader, void *arg1, struct wsgi_request *wsgi_req, PyThre
 	wi->uwsgi_node = PyString_FromString(uwsgi.hostname);
 	Py_INCREF((PyObject *)wi->uwsgi_node);
 
+	if (app_type == PYTHON_APP_TYPE_WSGI) {
+		// the keys not depending on the request are set only once
+		wi->environ_template = PyDict_New();
+		PyDict_SetItemString(wi->environ_template, "wsgi.file_wrapper", wi->sendfile);
+		if (uwsgi.async > 0) {
+			PyDict_SetItemString(wi->environ_template, "x-wsgiorg.fdevent.readable", wi->eventfd_read);
+			PyDict_SetItemString(wi->environ_template, "x-wsgiorg.fdevent.writable", wi->eventfd_write);
+			PyDict_SetItemString(wi->environ_template, "x-wsgiorg.fdevent.timeout", Py_None);
+		}
+		PyDict_SetItemString(wi->environ_template, "wsgi.version", wi->gateway_version);
+		PyDict_SetItemString(wi->environ_template, "wsgi.errors", wi->error);
+		PyDict_SetItemString(wi->environ_template, "wsgi.run_once", Py_False);
+		PyDict_SetItemString(wi->environ_template, "wsgi.multithread", uwsgi.threads > 1 ? Py_True : Py_False);
+		PyDict_SetItemString(wi->environ_template, "wsgi.multiprocess", uwsgi.numproc == 1 ? Py_False : Py_True);
+		PyDict_SetItemString(wi->environ_template, "uwsgi.version", wi->uwsgi_version);
+		PyDict_SetItemString(wi->environ_template, "uwsgi.node", wi->uwsgi_node);
+#ifndef Py_GIL_DISABLED
+		// the interned keys table is protected by the GIL
+		wi->environ_keys = uwsgi_calloc(sizeof(struct uwsgi_python_env_key) * UWSGI_PYTHON_ENV_KEYS);
+#endif
+	}
+
 	if (uwsgi.threads > 1 && id) {
 		// if we have multiple threads we need to initialize a PyThreadState for each one
 		for(i=0;i<uwsgi.threads;i++) {
@@ -357,6 +384,10 @@ int init_uwsgi_app(int loader, void *arg1, struct wsgi_request *wsgi_req, PyThre
 	wi->started_at = now;
 	wi->startup_time = uwsgi_now() - now;
 
+	uwsgi_log("[startup] python app %d (mountpoint='%.*s'): interpreter setup %llu ms, import %llu ms, total %llu ms\n", id, wi->mountpoint_len, wi->mountpoint,
+		(unsigned long long) ((import_start - load_start) / 1000), (unsigned long long) ((import_end - import_start) / 1000),
+		(unsigned long long) ((uwsgi_micros() - load_start) / 1000));
+
 	if (app_type == PYTHON_APP_TYPE_WSGI) {
 		uwsgi_log( "WSGI app %d (mountpoint='%.*s') ready in %d seconds on interpreter %p pid: %d%s\n", id, wi->mountpoint_len, wi->mountpoint, (int) wi->startup_time, wi->interpreter, (int) getpid(), default_app);
 	}
@@ -168,6 +168,9 @@ struct uwsgi_option uwsgi_python_options[] = {
 	{"pyrun", required_argument, 0, "run a python script in the uWSGI environment", uwsgi_opt_pyrun, NULL, 0},
 
 	{"py-tracebacker", required_argument, 0, "enable the uWSGI python tracebacker", uwsgi_opt_set_str, &up.tracebacker, UWSGI_OPT_THREADS|UWSGI_OPT_MASTER},
+	{"py-sampler", required_argument, 0, "sample the python stacks of each worker at the specified frequency (hz) and export them in the stats server", uwsgi_opt_set_int, &up.sampler_hz, UWSGI_OPT_THREADS|UWSGI_OPT_MASTER},
+	{"py-sampler-slots", required_argument, 0, "set the number of distinct stacks accounted for each worker by the python sampler (default 512)", uwsgi_opt_set_64bit, &up.sampler_slots, 0},
+	{"py-code-cache", required_argument, 0, "store the compiled code of the imported python modules in the specified uWSGI cache (python 3)", uwsgi_opt_set_str, &up.code_cache, 0},
 
 	{"py-auto-reload", required_argument, 0, "monitor python modules mtime to trigger reload (use only in development)", uwsgi_opt_set_int, &up.auto_reload, UWSGI_OPT_THREADS|UWSGI_OPT_MASTER},
 	{"py-autoreload", required_argument, 0, "monitor python modules mtime to trigger reload (use only in development)", uwsgi_opt_set_int, &up.auto_reload, UWSGI_OPT_THREADS|UWSGI_OPT_MASTER},
@@ -182,6 +185,7 @@ struct uwsgi_option uwsgi_python_options[] = {
 	{"wsgi-strict", no_argument, 0, "try to be fully PEP compliant disabling optimizations", uwsgi_opt_true, &up.wsgi_strict, 0},
 	{"wsgi-accept-buffer", no_argument, 0, "accept CPython buffer-compliant objects as WSGI response in addition to string/bytes", uwsgi_opt_true, &up.wsgi_accept_buffer, 0},
 	{"wsgi-accept-buffers", no_argument, 0, "accept CPython buffer-compliant objects as WSGI response in addition to string/bytes", uwsgi_opt_true, &up.wsgi_accept_buffer, 0},
+	{"wsgi-coalesce", required_argument, 0, "coalesce strings yielded by the WSGI response iterable until they reach the specified size (do not use with streaming apps)", uwsgi_opt_set_64bit, &up.wsgi_coalesce, 0},
 
 	{"python-version", no_argument, 0, "report python version", uwsgi_opt_pyver, NULL, UWSGI_OPT_IMMEDIATE},
 
@@ -192,6 +196,7 @@ struct uwsgi_option uwsgi_python_options[] = {
 #endif
 
 	{"py-call-osafterfork", no_argument, 0, "enable child processes running cpython to trap OS signals", uwsgi_opt_true, &up.call_osafterfork, 0},
+	{"py-zygote-freeze", no_argument, 0, "run gc.collect() and gc.freeze() in the zygote before forking workers", uwsgi_opt_true, &up.zygote_freeze, 0},
 
 	{"early-python", no_argument, 0, "load the python VM as soon as possible (useful for the fork server)", uwsgi_early_python, NULL, UWSGI_OPT_IMMEDIATE},
 	{"early-pyimport", required_argument, 0, "import a python module in the early phase", uwsgi_early_python_import, NULL, UWSGI_OPT_IMMEDIATE},
@@ -437,6 +442,13 @@ void uwsgi_python_post_fork() {
 			pthread_t ptb_tid;
 			pthread_create(&ptb_tid, NULL, uwsgi_python_tracebacker_thread, NULL);
 		}
+		if (up.samples) {
+			// a respawned worker starts with a clean profile
+			memset(&up.samples[(uwsgi.mywid - 1) * up.sampler_slots], 0, sizeof(struct uwsgi_python_sample) * up.sampler_slots);
+			up.samples_dropped[uwsgi.mywid] = 0;
+			pthread_t psa_tid;
+			pthread_create(&psa_tid, NULL, uwsgi_python_sampler_thread, NULL);
+		}
 	}
 
 UWSGI_RELEASE_GIL
@@ -899,7 +911,7 @@ void init_uwsgi_embedded_module() {
 
 	init_uwsgi_module_cache(new_uwsgi_module);
 
-	if (uwsgi.queue_size > 0) {
+	if (uwsgi.queue_size > 0 || uwsgi.queue_ring > 0) {
 		init_uwsgi_module_queue(new_uwsgi_module);
 	}
 
@@ -951,7 +963,7 @@ int uwsgi_python_mount_app(char *mountpoint, char *app) {
 		uwsgi.wsgi_req->appid = mountpoint;
 		uwsgi.wsgi_req->appid_len = strlen(mountpoint);
 		// lazy ?
-        	if (uwsgi.mywid > 0) UWSGI_GET_GIL
+        	if (uwsgi.mywid > 0 || uwsgi.i_am_a_zygote) UWSGI_GET_GIL
 		if (uwsgi.single_interpreter) {
 			id = init_uwsgi_app(LOADER_MOUNT, app, uwsgi.wsgi_req, up.main_thread, PYTHON_APP_TYPE_WSGI);
 		}
@@ -959,7 +971,7 @@ int uwsgi_python_mount_app(char *mountpoint, char *app) {
 			id = init_uwsgi_app(LOADER_MOUNT, app, uwsgi.wsgi_req, NULL, PYTHON_APP_TYPE_WSGI);
 		}
 		// lazy ?
-        	if (uwsgi.mywid > 0) UWSGI_RELEASE_GIL
+        	if (uwsgi.mywid > 0 || uwsgi.i_am_a_zygote) UWSGI_RELEASE_GIL
 		return id;
 	}
 	return -1;
@@ -1083,6 +1095,7 @@ void uwsgi_python_preinit_apps() {
 #ifdef __linux__
 	uwsgi_init_symbol_import();
 #endif
+	uwsgi_init_code_cache();
 
         if (up.test_module != NULL) {
                 if (PyImport_ImportModule(up.test_module)) {
@@ -1126,10 +1139,15 @@ ready:
 void uwsgi_python_init_apps() {
 
 	// lazy ?
-	if (uwsgi.mywid > 0) {
+	if (uwsgi.mywid > 0 || uwsgi.i_am_a_zygote) {
 		UWSGI_GET_GIL;
 	}
 
+	// the per-core buffers are allocated lazily, the array must be ready before threads start
+	if (up.wsgi_coalesce) {
+		up.wsgi_coalesce_buffers = uwsgi_calloc(sizeof(struct uwsgi_buffer *) * uwsgi.cores);
+	}
+
 	// prepare for stack suspend/resume
 	if (uwsgi.async > 0) {
 		up.current_recursion_depth = uwsgi_malloc(sizeof(int)*uwsgi.async);
@@ -1249,12 +1267,72 @@ next:
 		}
 	}
 	// lazy ?
-	if (uwsgi.mywid > 0) {
+	if (uwsgi.mywid > 0 || uwsgi.i_am_a_zygote) {
 		UWSGI_RELEASE_GIL;
 	}
 
 }
 
+// freeze the objects of the apps, so the gc never touches (and copies) their pages in the workers
+void uwsgi_python_zygote_ready() {
+
+	if (!up.zygote_freeze) return;
+
+	UWSGI_GET_GIL;
+
+	PyObject *gc_module = PyImport_ImportModule("gc");
+	if (!gc_module) {
+		PyErr_Print();
+		goto end;
+	}
+
+	PyObject *ret = PyObject_CallMethod(gc_module, "collect", NULL);
+	Py_XDECREF(ret);
+
+	if (PyObject_HasAttrString(gc_module, "freeze")) {
+		ret = PyObject_CallMethod(gc_module, "freeze", NULL);
+		if (!ret) {
+			PyErr_Print();
+		}
+		else {
+			Py_DECREF(ret);
+			uwsgi_log("python objects frozen in the zygote\n");
+		}
+	}
+	else {
+		uwsgi_log("!!! gc.freeze() is not available in this python version !!!\n");
+	}
+	Py_DECREF(gc_module);
+end:
+	PyErr_Clear();
+	UWSGI_RELEASE_GIL;
+}
+
+// the master detected memory pressure in the cgroup, run a full collection
+void uwsgi_python_memory_pressure() {
+
+	UWSGI_GET_GIL;
+
+	PyObject *gc_module = PyImport_ImportModule("gc");
+	if (!gc_module) {
+		PyErr_Print();
+		goto end;
+	}
+
+	PyObject *ret = PyObject_CallMethod(gc_module, "collect", NULL);
+	if (!ret) {
+		PyErr_Print();
+	}
+	else {
+		uwsgi_log("[uwsgi-python] memory pressure: gc collected %ld objects in worker %d\n", PyLong_AsLong(ret), uwsgi.mywid);
+		Py_DECREF(ret);
+	}
+	Py_DECREF(gc_module);
+end:
+	PyErr_Clear();
+	UWSGI_RELEASE_GIL;
+}
+
 void uwsgi_python_master_fixup(int step) {
 
 	static int master_fixed = 0;
@@ -1307,7 +1385,13 @@ void uwsgi_python_enable_threads() {
 
 	
 
+#ifdef Py_GIL_DISABLED
+	// gil_real_* now only attach/detach the thread states: blocking calls must
+	// still detach them, or the stop-the-world phases of the interpreter would wait for us
+	uwsgi_log("python threads support enabled (free-threaded interpreter, no GIL)\n");
+#else
 	uwsgi_log("python threads support enabled\n");
+#endif
 	
 
 }
@@ -1853,6 +1937,19 @@ int uwsgi_python_mule_msg(char *message, size_t len) {
 	return 1;
 }
 
+static void uwsgi_python_post_init() {
+	if (up.sampler_hz <= 0) return;
+	if (up.sampler_hz > 1000) {
+		uwsgi_log("the python sampler frequency must be between 1 and 1000 hz\n");
+		exit(1);
+	}
+	if (!up.sampler_slots) up.sampler_slots = 512;
+	// shared with the master (stats server)
+	up.samples = uwsgi_calloc_shared(sizeof(struct uwsgi_python_sample) * up.sampler_slots * uwsgi.numproc);
+	up.samples_dropped = uwsgi_calloc_shared(sizeof(uint64_t) * (uwsgi.numproc + 1));
+	uwsgi_log("python sampler enabled (%d hz, %llu stacks per worker)\n", up.sampler_hz, (unsigned long long) up.sampler_slots);
+}
+
 static void uwsgi_python_harakiri(int wid) {
 
 	if (up.tracebacker) {
@@ -1934,6 +2031,7 @@ struct uwsgi_plugin python_plugin = {
 	.alias = "python",
 	.modifier1 = 0,
 	.init = uwsgi_python_init,
+	.post_init = uwsgi_python_post_init,
 	.post_fork = uwsgi_python_post_fork,
 	.options = uwsgi_python_options,
 	.request = uwsgi_request_wsgi,
@@ -1944,6 +2042,7 @@ struct uwsgi_plugin python_plugin = {
 
 	.fixup = uwsgi_python_fixup,
 	.master_fixup = uwsgi_python_master_fixup,
+	.zygote_ready = uwsgi_python_zygote_ready,
 
 	.mount_app = uwsgi_python_mount_app,
 
@@ -1980,5 +2079,9 @@ struct uwsgi_plugin python_plugin = {
 	.exception_log = uwsgi_python_exception_log,
 	.backtrace = uwsgi_python_backtrace,
 
+	.worker_stats = uwsgi_python_sampler_stats,
+
+	.memory_pressure = uwsgi_python_memory_pressure,
+
 
 };
@@ -804,3 +804,111 @@ int uwsgi_init_symbol_import() {
         return 0;
 	
 }
+
+/*
+	shared code cache (--py-code-cache <cache>)
+
+	SourceFileLoader.get_code() is wrapped to store the marshalled code objects
+	of the imported modules in a uWSGI cache (keyed by interpreter version, path, mtime and size),
+	so lazy-apps workers (and restarted instances, when the cache has a store)
+	load them from shared memory instead of reading and validating each pyc
+*/
+
+#ifdef PYTHREE
+// marshal.h is not included by Python.h
+#ifndef Py_MARSHAL_VERSION
+#define Py_MARSHAL_VERSION 4
+#endif
+
+static PyObject *uwsgi_code_cache_get_code_orig;
+
+static PyObject *uwsgi_code_cache_get_code(PyObject *self, PyObject *args) {
+	PyObject *loader, *fullname;
+	if (!PyArg_ParseTuple(args, "OO:get_code", &loader, &fullname)) return NULL;
+
+	char *key = NULL;
+	int key_len = 0;
+	PyObject *filename = PyObject_CallMethod(loader, "get_filename", "O", fullname);
+	const char *path = filename ? PyUnicode_AsUTF8(filename) : NULL;
+	struct stat st;
+	if (!path || stat(path, &st)) {
+		PyErr_Clear();
+		goto orig;
+	}
+
+	key = uwsgi_malloc(strlen(path) + 64);
+	key_len = sprintf(key, "%x:%llu.%lu:%llu:%s", PY_VERSION_HEX, (unsigned long long) st.st_mtim.tv_sec, (unsigned long) st.st_mtim.tv_nsec, (unsigned long long) st.st_size, path);
+	if (key_len > 0xffff) goto orig;
+
+	uint64_t value_len = 0;
+	char *value;
+	UWSGI_RELEASE_GIL
+	value = uwsgi_cache_magic_get(key, key_len, &value_len, NULL, up.code_cache);
+	UWSGI_GET_GIL
+	if (value) {
+		PyObject *code = PyMarshal_ReadObjectFromString(value, value_len);
+		free(value);
+		if (code && PyCode_Check(code)) {
+			free(key);
+			Py_DECREF(filename);
+			return code;
+		}
+		Py_XDECREF(code);
+		PyErr_Clear();
+	}
+
+orig:
+	;
+	PyObject *code = PyObject_CallFunctionObjArgs(uwsgi_code_cache_get_code_orig, loader, fullname, NULL);
+	if (key && code && PyCode_Check(code)) {
+		PyObject *blob = PyMarshal_WriteObjectToString(code, Py_MARSHAL_VERSION);
+		if (blob) {
+			char *buf = PyBytes_AS_STRING(blob);
+			uint64_t len = PyBytes_GET_SIZE(blob);
+			// a full cache (or a too big module) simply means no caching
+			UWSGI_RELEASE_GIL
+			uwsgi_cache_magic_set(key, key_len, buf, len, 0, 0, up.code_cache);
+			UWSGI_GET_GIL
+			Py_DECREF(blob);
+		}
+		else {
+			PyErr_Clear();
+		}
+	}
+	free(key);
+	Py_XDECREF(filename);
+	return code;
+}
+
+static PyMethodDef uwsgi_code_cache_get_code_def[] = { {"get_code", uwsgi_code_cache_get_code, METH_VARARGS, ""} };
+#endif
+
+void uwsgi_init_code_cache() {
+	if (!up.code_cache) return;
+#ifdef PYTHREE
+	PyObject *bootstrap = PyImport_ImportModule("_frozen_importlib_external");
+	if (!bootstrap) {
+		PyErr_Clear();
+		bootstrap = PyImport_ImportModule("importlib._bootstrap");
+	}
+	if (!bootstrap) goto error;
+	PyObject *loader = PyObject_GetAttrString(bootstrap, "SourceFileLoader");
+	if (!loader) goto error;
+	uwsgi_code_cache_get_code_orig = PyObject_GetAttrString(loader, "get_code");
+	if (!uwsgi_code_cache_get_code_orig) goto error;
+	PyObject *func = PyCFunction_New(uwsgi_code_cache_get_code_def, NULL);
+	if (!func) goto error;
+	// bind it as a method of the loader
+	PyObject *method = PyInstanceMethod_New(func);
+	Py_DECREF(func);
+	if (!method || PyObject_SetAttrString(loader, "get_code", method)) goto error;
+	uwsgi_log("python code cache enabled on cache \"%s\"\n", up.code_cache);
+	return;
+error:
+	PyErr_Print();
+	uwsgi_log("unable to initialize the python code cache\n");
+	exit(1);
+#else
+	uwsgi_log("the python code cache requires python 3\n");
+#endif
+}
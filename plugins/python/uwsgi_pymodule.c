@@ -64,6 +64,11 @@ static PyObject *py_uwsgi_signal_wait(PyObject * self, PyObject * args) {
         return PyString_FromString("");
 }
 
+// number of deliveries coalesced in the signal being handled (--signal-coalesce)
+static PyObject *py_uwsgi_signal_count(PyObject * self, PyObject * args) {
+	return PyLong_FromUnsignedLong(uwsgi.signal_count);
+}
+
 static PyObject *py_uwsgi_signal_received(PyObject * self, PyObject * args) {
 
         struct wsgi_request *wsgi_req = py_current_wsgi_req();
@@ -235,7 +240,8 @@ static PyObject *py_uwsgi_add_cron(PyObject * self, PyObject * args) {
                 return NULL;
         }
 
-	if (uwsgi_signal_add_cron(uwsgi_signal, minute, hour, day, month, week)) {
+	UWSGI_WITHOUT_GIL(int ret = uwsgi_signal_add_cron(uwsgi_signal, minute, hour, day, month, week))
+	if (ret) {
 		return PyErr_Format(PyExc_ValueError, "unable to add cron");
 	}
 
@@ -253,7 +259,8 @@ static PyObject *py_uwsgi_add_timer(PyObject * self, PyObject * args) {
 		return NULL;
 	}
 
-	if (uwsgi_add_timer(uwsgi_signal, secs))
+	UWSGI_WITHOUT_GIL(int ret = uwsgi_add_timer(uwsgi_signal, secs))
+	if (ret)
 		return PyErr_Format(PyExc_ValueError, "unable to add timer");
 
 	Py_INCREF(Py_None);
@@ -270,7 +277,8 @@ PyObject *py_uwsgi_add_rb_timer(PyObject * self, PyObject * args) {
                 return NULL;
         }
 
-        if (uwsgi_signal_add_rb_timer(uwsgi_signal, secs, iterations))
+        UWSGI_WITHOUT_GIL(int ret = uwsgi_signal_add_rb_timer(uwsgi_signal, secs, iterations))
+        if (ret)
                 return PyErr_Format(PyExc_ValueError, "unable to add rb_timer");
 
         Py_INCREF(Py_None);
@@ -288,7 +296,8 @@ PyObject *py_uwsgi_add_file_monitor(PyObject * self, PyObject * args) {
 		return NULL;
 	}
 
-	if (uwsgi_add_file_monitor(uwsgi_signal, filename))
+	UWSGI_WITHOUT_GIL(int ret = uwsgi_add_file_monitor(uwsgi_signal, filename))
+	if (ret)
 		return PyErr_Format(PyExc_ValueError, "unable to add file monitor");
 
 	Py_INCREF(Py_None);
@@ -422,6 +431,80 @@ PyObject *py_uwsgi_rpc(PyObject * self, PyObject * args) {
 
 }
 
+/*
+	uwsgi.rpc_multi([(node, func, args...), ...])
+
+	returns the list of responses (None for failed calls)
+*/
+PyObject *py_uwsgi_rpc_multi(PyObject * self, PyObject * args) {
+
+	PyObject *py_calls;
+	int i, j;
+
+	if (!PyArg_ParseTuple(args, "O:rpc_multi", &py_calls)) {
+		return NULL;
+	}
+
+	PyObject *py_seq = PySequence_Fast(py_calls, "rpc_multi requires a list of tuples");
+	if (!py_seq) return NULL;
+
+	int n = PySequence_Fast_GET_SIZE(py_seq);
+	struct uwsgi_rpc_call *calls = uwsgi_calloc(sizeof(struct uwsgi_rpc_call) * (n + 1));
+
+	for (i = 0; i < n; i++) {
+		PyObject *py_call = PySequence_Fast_GET_ITEM(py_seq, i);
+		if (!PyTuple_Check(py_call) || PyTuple_Size(py_call) < 2 || PyTuple_Size(py_call) > 257)
+			goto clear;
+		PyObject *py_node = PyTuple_GetItem(py_call, 0);
+		PyObject *py_func = PyTuple_GetItem(py_call, 1);
+		if (py_node != Py_None) {
+			if (!PyString_Check(py_node)) goto clear;
+			calls[i].node = PyString_AsString(py_node);
+		}
+		if (!PyString_Check(py_func)) goto clear;
+		calls[i].func = PyString_AsString(py_func);
+		calls[i].argc = PyTuple_Size(py_call) - 2;
+		calls[i].argv = uwsgi_calloc(sizeof(char *) * (calls[i].argc + 1));
+		calls[i].argvs = uwsgi_calloc(sizeof(uint16_t) * (calls[i].argc + 1));
+		for (j = 0; j < calls[i].argc; j++) {
+			PyObject *py_str = PyTuple_GetItem(py_call, j + 2);
+			if (!PyString_Check(py_str)) goto clear;
+			calls[i].argv[j] = PyString_AsString(py_str);
+			calls[i].argvs[j] = PyString_Size(py_str);
+		}
+	}
+
+	UWSGI_RELEASE_GIL;
+	uwsgi_do_rpc_multi(calls, n);
+	UWSGI_GET_GIL;
+
+	PyObject *py_list = PyList_New(n);
+	for (i = 0; i < n; i++) {
+		if (calls[i].response) {
+			PyList_SetItem(py_list, i, PyString_FromStringAndSize(calls[i].response, calls[i].len));
+			free(calls[i].response);
+		}
+		else {
+			Py_INCREF(Py_None);
+			PyList_SetItem(py_list, i, Py_None);
+		}
+		free(calls[i].argv);
+		free(calls[i].argvs);
+	}
+	free(calls);
+	Py_DECREF(py_seq);
+	return py_list;
+
+clear:
+	for (i = 0; i < n; i++) {
+		free(calls[i].argv);
+		free(calls[i].argvs);
+	}
+	free(calls);
+	Py_DECREF(py_seq);
+	return PyErr_Format(PyExc_ValueError, "unable to call rpc functions");
+}
+
 PyObject *py_uwsgi_register_rpc(PyObject * self, PyObject * args) {
 
 	uint8_t argc = 0;
@@ -560,7 +643,7 @@ PyObject *py_uwsgi_signal(PyObject * self, PyObject * args) {
 #ifdef UWSGI_DEBUG
 		uwsgi_log("sending signal %d to node %s\n", uwsgi_signal, remote);
 #endif
-		int ret = uwsgi_remote_signal_send(remote, uwsgi_signal);
+		UWSGI_WITHOUT_GIL(int ret = uwsgi_remote_signal_send(remote, uwsgi_signal))
 		if (ret == 1) goto clear;
 		if (ret == -1)
 			return PyErr_Format(PyExc_IOError, "unable to deliver signal %d to node %s", uwsgi_signal, remote);
@@ -571,7 +654,7 @@ PyObject *py_uwsgi_signal(PyObject * self, PyObject * args) {
 #ifdef UWSGI_DEBUG
 		uwsgi_log("sending signal %d to master\n", uwsgi_signal);
 #endif
-		uwsgi_signal_send(uwsgi.signal_socket, uwsgi_signal);
+		UWSGI_WITHOUT_GIL(uwsgi_signal_send(uwsgi.signal_socket, uwsgi_signal))
 	}
 
 clear:
@@ -598,7 +681,7 @@ PyObject *py_uwsgi_alarm(PyObject * self, PyObject * args) {
                 return NULL;
         }	
 
-	uwsgi_alarm_trigger(alarm, msg, msg_len);
+	UWSGI_WITHOUT_GIL(uwsgi_alarm_trigger(alarm, msg, msg_len))
 
 	Py_INCREF(Py_None);
 	return Py_None;
@@ -886,7 +969,7 @@ PyObject *py_uwsgi_log(PyObject * self, PyObject * args) {
 		return NULL;
 	}
 
-	uwsgi_log("%s\n", logline);
+	UWSGI_WITHOUT_GIL(uwsgi_log("%s\n", logline))
 
 	Py_INCREF(Py_True);
 	return Py_True;
@@ -1067,6 +1150,96 @@ PyObject *py_uwsgi_websocket_send_binary(PyObject * self, PyObject * args) {
 }
 
 
+PyObject *py_uwsgi_websocket_send_many(PyObject * self, PyObject * args, PyObject *kwargs) {
+	PyObject *py_messages = NULL;
+	PyObject *py_binary = NULL;
+	Py_ssize_t i;
+
+	static char *kwlist[] = {"messages", "binary", NULL};
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O:websocket_send_many", kwlist, &py_messages, &py_binary)) {
+		return NULL;
+	}
+
+	PyObject *py_seq = PySequence_Fast(py_messages, "websocket_send_many requires a sequence of strings");
+	if (!py_seq) return NULL;
+
+	Py_ssize_t n = PySequence_Fast_GET_SIZE(py_seq);
+	struct iovec *msgs = uwsgi_malloc(sizeof(struct iovec) * (n + 1));
+	for (i = 0; i < n; i++) {
+		PyObject *py_msg = PySequence_Fast_GET_ITEM(py_seq, i);
+		if (!PyString_Check(py_msg)) {
+			free(msgs);
+			Py_DECREF(py_seq);
+			return PyErr_Format(PyExc_ValueError, "websocket_send_many requires a sequence of strings");
+		}
+		msgs[i].iov_base = PyString_AsString(py_msg);
+		msgs[i].iov_len = PyString_Size(py_msg);
+	}
+
+	int binary = py_binary && PyObject_IsTrue(py_binary);
+	struct wsgi_request *wsgi_req = py_current_wsgi_req();
+
+	UWSGI_RELEASE_GIL
+	int ret = uwsgi_websocket_send_many(wsgi_req, msgs, n, binary);
+	UWSGI_GET_GIL
+
+	free(msgs);
+	Py_DECREF(py_seq);
+	if (ret < 0) {
+		return PyErr_Format(PyExc_IOError, "unable to send websocket messages");
+	}
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+PyObject *py_uwsgi_websocket_offload(PyObject * self, PyObject * args) {
+	char *channels = "";
+	Py_ssize_t channels_len = 0;
+	if (!PyArg_ParseTuple(args, "|s#:websocket_offload", &channels, &channels_len)) {
+		return NULL;
+	}
+	if (channels_len > 0xffff) {
+		return PyErr_Format(PyExc_ValueError, "channels list too long");
+	}
+	struct wsgi_request *wsgi_req = py_current_wsgi_req();
+	UWSGI_RELEASE_GIL
+	int64_t id = uwsgi_websocket_offload(wsgi_req, channels, channels_len);
+	UWSGI_GET_GIL
+	if (id < 0) {
+		return PyErr_Format(PyExc_IOError, "unable to offload websocket");
+	}
+	return PyLong_FromLongLong(id);
+}
+
+PyObject *py_uwsgi_websocket_publish(PyObject * self, PyObject * args, PyObject *kwargs) {
+	char *channel;
+	Py_ssize_t channel_len = 0;
+	char *message;
+	Py_ssize_t message_len = 0;
+	PyObject *py_binary = NULL;
+
+	static char *kwlist[] = {"channel", "message", "binary", NULL};
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s#s#|O:websocket_publish", kwlist, &channel, &channel_len, &message, &message_len, &py_binary)) {
+		return NULL;
+	}
+	if (channel_len > 0xffff) {
+		return PyErr_Format(PyExc_ValueError, "channel name too long");
+	}
+	int binary = py_binary && PyObject_IsTrue(py_binary);
+
+	UWSGI_RELEASE_GIL
+	int ret = uwsgi_websocket_publish(channel, channel_len, message, message_len, binary);
+	UWSGI_GET_GIL
+
+	if (ret) {
+		return PyErr_Format(PyExc_IOError, "unable to publish websocket message");
+	}
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
 PyObject *py_uwsgi_chunked_read(PyObject * self, PyObject * args) {
 	int timeout = 0; 
 	if (!PyArg_ParseTuple(args, "|i:chunked_read", &timeout)) {
@@ -1084,6 +1257,27 @@ PyObject *py_uwsgi_chunked_read(PyObject * self, PyObject * args) {
         return PyString_FromStringAndSize(chunk, len);
 }
 
+PyObject *py_uwsgi_chunked_readinto(PyObject * self, PyObject * args) {
+	PyObject *ba = NULL;
+	int timeout = 0;
+	if (!PyArg_ParseTuple(args, "O|i:chunked_readinto", &ba, &timeout)) {
+		return NULL;
+	}
+	if (!PyByteArray_Check(ba)) {
+		return PyErr_Format(PyExc_TypeError, "chunked_readinto() requires a bytearray");
+	}
+	char *buf = PyByteArray_AsString(ba);
+	size_t len = PyByteArray_Size(ba);
+	struct wsgi_request *wsgi_req = py_current_wsgi_req();
+	UWSGI_RELEASE_GIL
+	ssize_t rlen = uwsgi_chunked_read_into(wsgi_req, buf, len, timeout, 0);
+	UWSGI_GET_GIL
+	if (rlen < 0) {
+		return PyErr_Format(PyExc_IOError, "unable to receive chunked input");
+	}
+	return PyLong_FromSsize_t(rlen);
+}
+
 PyObject *py_uwsgi_chunked_read_nb(PyObject * self, PyObject * args) {
         size_t len = 0;
         struct wsgi_request *wsgi_req = py_current_wsgi_req();
@@ -1258,6 +1452,7 @@ PyObject *py_uwsgi_mule_msg(PyObject * self, PyObject * args) {
 	PyObject *mule_obj = NULL;
 	int fd = -1;
 	int mule_id = -1;
+	int ret = -1;
 
 	if (!PyArg_ParseTuple(args, "s#|O:mule_msg", &message, &message_len, &mule_obj)) {
                 return NULL;
@@ -1268,12 +1463,18 @@ PyObject *py_uwsgi_mule_msg(PyObject * self, PyObject * args) {
 
 	if (mule_obj == NULL) {
 		UWSGI_RELEASE_GIL
-		mule_send_msg(uwsgi.shared->mule_queue_pipe[0], message, message_len);
+		if (uwsgi.mule_ring) {
+			ret = uwsgi_mule_ring_push(0, NULL, message, message_len);
+		}
+		else {
+			ret = mule_send_msg(uwsgi.shared->mule_queue_pipe[0], message, message_len);
+		}
 		UWSGI_GET_GIL
 	}
 	else {
+		struct uwsgi_farm *uf = NULL;
 		if (PyString_Check(mule_obj)) {
-			struct uwsgi_farm *uf = get_farm_by_name(PyString_AsString(mule_obj));
+			uf = get_farm_by_name(PyString_AsString(mule_obj));
 			if (uf == NULL) {
 				return PyErr_Format(PyExc_ValueError, "unknown farm");
 			}
@@ -1281,7 +1482,7 @@ PyObject *py_uwsgi_mule_msg(PyObject * self, PyObject * args) {
 		}
 		else if (PyInt_Check(mule_obj)) {
 			mule_id = PyInt_AsLong(mule_obj);
-			if (mule_id < 0 && mule_id > uwsgi.mules_cnt) {
+			if (mule_id < 0 || mule_id > uwsgi.mules_cnt) {
 				return PyErr_Format(PyExc_ValueError, "invalid mule number");
 			}
 			if (mule_id == 0) {
@@ -1295,15 +1496,25 @@ PyObject *py_uwsgi_mule_msg(PyObject * self, PyObject * args) {
 			return PyErr_Format(PyExc_ValueError, "invalid mule");
 		}
 
-		if (fd > -1) {
+		if (uwsgi.mule_ring) {
 			UWSGI_RELEASE_GIL
-			mule_send_msg(fd, message, message_len);
+			ret = uwsgi_mule_ring_push(mule_id, uf, message, message_len);
+			UWSGI_GET_GIL
+		}
+		else if (fd > -1) {
+			UWSGI_RELEASE_GIL
+			ret = mule_send_msg(fd, message, message_len);
 			UWSGI_GET_GIL
 		}
 	}
 
-	Py_INCREF(Py_None);
-	return Py_None;
+	if (ret) {
+		Py_INCREF(Py_False);
+		return Py_False;
+	}
+
+	Py_INCREF(Py_True);
+	return Py_True;
 	
 }
 
@@ -1354,6 +1565,72 @@ PyObject *py_uwsgi_mule_get_msg(PyObject * self, PyObject * args, PyObject *kwar
 	return msg;
 }
 
+PyObject *py_uwsgi_mule_get_msgs(PyObject * self, PyObject * args, PyObject *kwargs) {
+
+	PyObject *py_manage_signals = NULL;
+	PyObject *py_manage_farms = NULL;
+	int max = 64;
+	int timeout = -1;
+	int manage_signals = 1, manage_farms = 1;
+	int i, n;
+
+	static char *kwlist[] = {"max", "timeout", "signals", "farms", NULL};
+
+	if (uwsgi.muleid == 0) {
+		return PyErr_Format(PyExc_ValueError, "you can receive mule messages only in a mule !!!");
+	}
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|iiOO:mule_get_msgs", kwlist, &max, &timeout, &py_manage_signals, &py_manage_farms)) {
+		return NULL;
+	}
+
+	if (py_manage_signals == Py_None || py_manage_signals == Py_False) {
+		manage_signals = 0;
+	}
+
+	if (py_manage_farms == Py_None || py_manage_farms == Py_False) {
+		manage_farms = 0;
+	}
+
+	if (max < 1) max = 1;
+
+	PyObject *list = PyList_New(0);
+
+	// without rings only a single message at a time can be received
+	if (!uwsgi.mule_ring) {
+		char *message = uwsgi_malloc(65536);
+		ssize_t len;
+		UWSGI_RELEASE_GIL;
+		len = uwsgi_mule_get_msg(manage_signals, manage_farms, message, 65536, timeout);
+		UWSGI_GET_GIL;
+		if (len >= 0) {
+			PyObject *msg = PyString_FromStringAndSize(message, len);
+			PyList_Append(list, msg);
+			Py_DECREF(msg);
+		}
+		free(message);
+		return list;
+	}
+
+	char **messages = uwsgi_malloc(sizeof(char *) * max);
+	size_t *lens = uwsgi_malloc(sizeof(size_t) * max);
+
+	UWSGI_RELEASE_GIL;
+	n = uwsgi_mule_get_msgs(manage_signals, manage_farms, messages, lens, max, timeout);
+	UWSGI_GET_GIL;
+
+	for (i = 0; i < n; i++) {
+		PyObject *msg = PyString_FromStringAndSize(messages[i], lens[i]);
+		PyList_Append(list, msg);
+		Py_DECREF(msg);
+		free(messages[i]);
+	}
+
+	free(messages);
+	free(lens);
+	return list;
+}
+
 PyObject *py_uwsgi_farm_get_msg(PyObject * self, PyObject * args) {
 
         ssize_t len = 0;
@@ -1365,6 +1642,22 @@ PyObject *py_uwsgi_farm_get_msg(PyObject * self, PyObject * args) {
         if (uwsgi.muleid == 0) {
                 return PyErr_Format(PyExc_ValueError, "you can receive farm messages only in a mule !!!");
         }
+
+	if (uwsgi.mule_ring) {
+		char *ring_msg = NULL;
+		size_t ring_len = 0;
+		UWSGI_RELEASE_GIL;
+		ret = uwsgi_mule_get_msgs(0, 1, &ring_msg, &ring_len, 1, -1);
+		UWSGI_GET_GIL;
+		if (ret <= 0) {
+			Py_INCREF(Py_None);
+			return Py_None;
+		}
+		PyObject *msg = PyString_FromStringAndSize(ring_msg, ring_len);
+		free(ring_msg);
+		return msg;
+	}
+
         UWSGI_RELEASE_GIL;
 	for(i=0;i<uwsgi.farms_cnt;i++) {	
 		if (uwsgi_farm_has_mule(&uwsgi.farms[i], uwsgi.muleid)) count++;
@@ -1515,6 +1808,99 @@ PyObject *py_uwsgi_sharedarea_dec32(PyObject * self, PyObject * args) {
 
 }
 
+// lock-free operations, they return the previous value
+PyObject *py_uwsgi_sharedarea_fetch_add(PyObject * self, PyObject * args) {
+	int id;
+	uint64_t pos = 0;
+	int64_t value = 1;
+	int64_t old = 0;
+
+	if (!PyArg_ParseTuple(args, "iL|L:sharedarea_fetch_add", &id, &pos, &value)) {
+		return NULL;
+	}
+
+	if (uwsgi_sharedarea_fetch_add64(id, pos, value, &old)) {
+		return PyErr_Format(PyExc_ValueError, "error calling uwsgi_sharedarea_fetch_add64()");
+	}
+
+	return PyLong_FromLongLong(old);
+}
+
+PyObject *py_uwsgi_sharedarea_xchg(PyObject * self, PyObject * args) {
+	int id;
+	uint64_t pos = 0;
+	int64_t value = 0;
+	int64_t old = 0;
+
+	if (!PyArg_ParseTuple(args, "iLL:sharedarea_xchg", &id, &pos, &value)) {
+		return NULL;
+	}
+
+	if (uwsgi_sharedarea_xchg64(id, pos, value, &old)) {
+		return PyErr_Format(PyExc_ValueError, "error calling uwsgi_sharedarea_xchg64()");
+	}
+
+	return PyLong_FromLongLong(old);
+}
+
+PyObject *py_uwsgi_sharedarea_min(PyObject * self, PyObject * args) {
+	int id;
+	uint64_t pos = 0;
+	int64_t value = 0;
+	int64_t old = 0;
+
+	if (!PyArg_ParseTuple(args, "iLL:sharedarea_min", &id, &pos, &value)) {
+		return NULL;
+	}
+
+	if (uwsgi_sharedarea_min64(id, pos, value, &old)) {
+		return PyErr_Format(PyExc_ValueError, "error calling uwsgi_sharedarea_min64()");
+	}
+
+	return PyLong_FromLongLong(old);
+}
+
+PyObject *py_uwsgi_sharedarea_max(PyObject * self, PyObject * args) {
+	int id;
+	uint64_t pos = 0;
+	int64_t value = 0;
+	int64_t old = 0;
+
+	if (!PyArg_ParseTuple(args, "iLL:sharedarea_max", &id, &pos, &value)) {
+		return NULL;
+	}
+
+	if (uwsgi_sharedarea_max64(id, pos, value, &old)) {
+		return PyErr_Format(PyExc_ValueError, "error calling uwsgi_sharedarea_max64()");
+	}
+
+	return PyLong_FromLongLong(old);
+}
+
+// returns True when the value has been swapped
+PyObject *py_uwsgi_sharedarea_cas(PyObject * self, PyObject * args) {
+	int id;
+	uint64_t pos = 0;
+	int64_t expected = 0;
+	int64_t value = 0;
+
+	if (!PyArg_ParseTuple(args, "iLLL:sharedarea_cas", &id, &pos, &expected, &value)) {
+		return NULL;
+	}
+
+	int ret = uwsgi_sharedarea_cas64(id, pos, expected, value, NULL);
+	if (ret < 0) {
+		return PyErr_Format(PyExc_ValueError, "error calling uwsgi_sharedarea_cas64()");
+	}
+
+	if (ret) {
+		Py_INCREF(Py_False);
+		return Py_False;
+	}
+	Py_INCREF(Py_True);
+	return Py_True;
+}
+
 PyObject *py_uwsgi_sharedarea_write32(PyObject * self, PyObject * args) {
         int id;
         uint64_t pos = 0;
@@ -1609,7 +1995,8 @@ PyObject *py_uwsgi_sharedarea_update(PyObject * self, PyObject * args) {
                 return NULL;
         }
 
-        if (uwsgi_sharedarea_update(id)) {
+        UWSGI_WITHOUT_GIL(int ret = uwsgi_sharedarea_update(id))
+        if (ret) {
                 return PyErr_Format(PyExc_ValueError, "error calling uwsgi_sharedarea_update()");
         }
 
@@ -1618,6 +2005,40 @@ PyObject *py_uwsgi_sharedarea_update(PyObject * self, PyObject * args) {
 
 }
 
+// returns True when the area changed, False on timeout
+PyObject *py_uwsgi_sharedarea_wait(PyObject * self, PyObject * args) {
+	int id;
+	int freq = 0;
+	int timeout = 0;
+	int ret;
+
+	if (!PyArg_ParseTuple(args, "i|ii:sharedarea_wait", &id, &freq, &timeout)) {
+		return NULL;
+	}
+
+	// suspend engines need the GIL to switch
+	if (uwsgi.wait_read_hook != uwsgi_simple_wait_read_hook) {
+		ret = uwsgi_sharedarea_wait(id, freq, timeout);
+	}
+	else {
+		UWSGI_RELEASE_GIL
+		ret = uwsgi_sharedarea_wait(id, freq, timeout);
+		UWSGI_GET_GIL
+	}
+
+	if (ret == -2) {
+		Py_INCREF(Py_False);
+		return Py_False;
+	}
+
+	if (ret) {
+		return PyErr_Format(PyExc_ValueError, "error calling uwsgi_sharedarea_wait()");
+	}
+
+	Py_INCREF(Py_True);
+	return Py_True;
+}
+
 PyObject *py_uwsgi_sharedarea_rlock(PyObject * self, PyObject * args) {
         int id;
 
@@ -1825,6 +2246,104 @@ PyObject *py_uwsgi_sharedarea_read(PyObject * self, PyObject * args) {
 	return ret;
 }
 
+PyObject *py_uwsgi_sharedarea_alloc(PyObject * self, PyObject * args) {
+	int id;
+	uint64_t len = 0;
+
+	if (!PyArg_ParseTuple(args, "iL:sharedarea_alloc", &id, &len)) {
+		return NULL;
+	}
+
+	UWSGI_RELEASE_GIL
+	uint64_t handle = uwsgi_sharedheap_alloc(id, len);
+	UWSGI_GET_GIL
+
+	// heap full
+	if (!handle) {
+		Py_INCREF(Py_None);
+		return Py_None;
+	}
+
+	return PyLong_FromUnsignedLongLong(handle);
+}
+
+PyObject *py_uwsgi_sharedarea_free(PyObject * self, PyObject * args) {
+	int id;
+	uint64_t handle = 0;
+
+	if (!PyArg_ParseTuple(args, "iL:sharedarea_free", &id, &handle)) {
+		return NULL;
+	}
+
+	UWSGI_RELEASE_GIL
+	int ret = uwsgi_sharedheap_free(id, handle);
+	UWSGI_GET_GIL
+
+	if (ret) {
+		return PyErr_Format(PyExc_ValueError, "error calling uwsgi_sharedheap_free()");
+	}
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+PyObject *py_uwsgi_sharedarea_heap_write(PyObject * self, PyObject * args) {
+	int id;
+	uint64_t handle = 0;
+	char *value;
+	Py_ssize_t value_len = 0;
+
+	if (!PyArg_ParseTuple(args, "iLs#:sharedarea_heap_write", &id, &handle, &value, &value_len)) {
+		return NULL;
+	}
+
+	UWSGI_RELEASE_GIL
+	int ret = uwsgi_sharedheap_write(id, handle, value, value_len);
+	UWSGI_GET_GIL
+
+	if (ret) {
+		return PyErr_Format(PyExc_ValueError, "error calling uwsgi_sharedheap_write()");
+	}
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+PyObject *py_uwsgi_sharedarea_heap_read(PyObject * self, PyObject * args) {
+	int id;
+	uint64_t handle = 0;
+
+	if (!PyArg_ParseTuple(args, "iL:sharedarea_heap_read", &id, &handle)) {
+		return NULL;
+	}
+
+	int64_t len = uwsgi_sharedheap_len(id, handle);
+	if (len < 0) {
+		return PyErr_Format(PyExc_ValueError, "error calling uwsgi_sharedheap_read()");
+	}
+
+	PyObject *ret = PyString_FromStringAndSize(NULL, len);
+#ifdef PYTHREE
+	char *storage = PyBytes_AsString(ret);
+#else
+	char *storage = PyString_AS_STRING(ret);
+#endif
+
+	UWSGI_RELEASE_GIL
+	int64_t rlen = uwsgi_sharedheap_read(id, handle, storage, len);
+	UWSGI_GET_GIL
+
+	if (rlen < 0) {
+		Py_DECREF(ret);
+		return PyErr_Format(PyExc_ValueError, "error calling uwsgi_sharedheap_read()");
+	}
+
+	// the chunk could have been shrunk in the meantime
+	Py_SIZE(ret) = rlen;
+
+	return ret;
+}
+
 #if defined(PYTHREE) || defined(Py_TPFLAGS_HAVE_NEWBUFFER)
 #ifndef HAS_NOT_PyMemoryView_FromBuffer
 PyObject *py_uwsgi_sharedarea_memoryview(PyObject * self, PyObject * args) {
@@ -2078,7 +2597,8 @@ PyObject *py_uwsgi_connect(PyObject * self, PyObject * args) {
 		return NULL;
 	}
 
-	return PyInt_FromLong(uwsgi_connect(socket_name, timeout, 0));
+	UWSGI_WITHOUT_GIL(int fd = uwsgi_connect(socket_name, timeout, 0))
+	return PyInt_FromLong(fd);
 }
 
 PyObject *py_uwsgi_async_connect(PyObject * self, PyObject * args) {
@@ -2088,7 +2608,8 @@ PyObject *py_uwsgi_async_connect(PyObject * self, PyObject * args) {
 		return NULL;
 	}
 
-	return PyInt_FromLong(uwsgi_connect(socket_name, 0, 1));
+	UWSGI_WITHOUT_GIL(int fd = uwsgi_connect(socket_name, 0, 1))
+	return PyInt_FromLong(fd);
 }
 
 /* uWSGI masterpid */
@@ -2546,6 +3067,7 @@ static PyMethodDef uwsgi_advanced_methods[] = {
 	{"signal_wait", py_uwsgi_signal_wait, METH_VARARGS, ""},
 	{"signal_registered", py_uwsgi_signal_registered, METH_VARARGS, ""},
 	{"signal_received", py_uwsgi_signal_received, METH_VARARGS, ""},
+	{"signal_count", py_uwsgi_signal_count, METH_VARARGS, ""},
 	{"add_file_monitor", py_uwsgi_add_file_monitor, METH_VARARGS, ""},
 	{"add_timer", py_uwsgi_add_timer, METH_VARARGS, ""},
 	{"add_rb_timer", py_uwsgi_add_rb_timer, METH_VARARGS, ""},
@@ -2557,6 +3079,7 @@ static PyMethodDef uwsgi_advanced_methods[] = {
 
 	{"register_rpc", py_uwsgi_register_rpc, METH_VARARGS, ""},
 	{"rpc", py_uwsgi_rpc, METH_VARARGS, ""},
+	{"rpc_multi", py_uwsgi_rpc_multi, METH_VARARGS, ""},
 	{"rpc_list", py_uwsgi_rpc_list, METH_VARARGS, ""},
 	{"call", py_uwsgi_call, METH_VARARGS, ""},
 	{"sendfile", py_uwsgi_advanced_sendfile, METH_VARARGS, ""},
@@ -2592,6 +3115,7 @@ static PyMethodDef uwsgi_advanced_methods[] = {
 	{"mule_msg", py_uwsgi_mule_msg, METH_VARARGS, ""},
 	{"farm_msg", py_uwsgi_farm_msg, METH_VARARGS, ""},
 	{"mule_get_msg", (PyCFunction) py_uwsgi_mule_get_msg, METH_VARARGS|METH_KEYWORDS, ""},
+	{"mule_get_msgs", (PyCFunction) py_uwsgi_mule_get_msgs, METH_VARARGS|METH_KEYWORDS, ""},
 	{"farm_get_msg", py_uwsgi_farm_get_msg, METH_VARARGS, ""},
 	{"in_farm", py_uwsgi_in_farm, METH_VARARGS, ""},
 
@@ -2603,10 +3127,14 @@ static PyMethodDef uwsgi_advanced_methods[] = {
 	{"websocket_recv_nb", py_uwsgi_websocket_recv_nb, METH_VARARGS, ""},
 	{"websocket_send", py_uwsgi_websocket_send, METH_VARARGS, ""},
 	{"websocket_send_binary", py_uwsgi_websocket_send_binary, METH_VARARGS, ""},
+	{"websocket_send_many", (PyCFunction) py_uwsgi_websocket_send_many, METH_VARARGS|METH_KEYWORDS, ""},
 	{"websocket_handshake", py_uwsgi_websocket_handshake, METH_VARARGS, ""},
+	{"websocket_offload", py_uwsgi_websocket_offload, METH_VARARGS, ""},
+	{"websocket_publish", (PyCFunction) py_uwsgi_websocket_publish, METH_VARARGS|METH_KEYWORDS, ""},
 
 	{"chunked_read", py_uwsgi_chunked_read, METH_VARARGS, ""},
 	{"chunked_read_nb", py_uwsgi_chunked_read_nb, METH_VARARGS, ""},
+	{"chunked_readinto", py_uwsgi_chunked_readinto, METH_VARARGS, ""},
 
 	{"ready_fd", py_uwsgi_ready_fd, METH_VARARGS, ""},
 
@@ -2638,9 +3166,19 @@ static PyMethodDef uwsgi_sa_methods[] = {
 	{"sharedarea_inc32", py_uwsgi_sharedarea_inc32, METH_VARARGS, ""},
 	{"sharedarea_dec64", py_uwsgi_sharedarea_dec64, METH_VARARGS, ""},
 	{"sharedarea_dec32", py_uwsgi_sharedarea_dec32, METH_VARARGS, ""},
+	{"sharedarea_fetch_add", py_uwsgi_sharedarea_fetch_add, METH_VARARGS, ""},
+	{"sharedarea_xchg", py_uwsgi_sharedarea_xchg, METH_VARARGS, ""},
+	{"sharedarea_cas", py_uwsgi_sharedarea_cas, METH_VARARGS, ""},
+	{"sharedarea_min", py_uwsgi_sharedarea_min, METH_VARARGS, ""},
+	{"sharedarea_max", py_uwsgi_sharedarea_max, METH_VARARGS, ""},
 	{"sharedarea_rlock", py_uwsgi_sharedarea_rlock, METH_VARARGS, ""},
 	{"sharedarea_wlock", py_uwsgi_sharedarea_wlock, METH_VARARGS, ""},
 	{"sharedarea_unlock", py_uwsgi_sharedarea_unlock, METH_VARARGS, ""},
+	{"sharedarea_wait", py_uwsgi_sharedarea_wait, METH_VARARGS, ""},
+	{"sharedarea_alloc", py_uwsgi_sharedarea_alloc, METH_VARARGS, ""},
+	{"sharedarea_free", py_uwsgi_sharedarea_free, METH_VARARGS, ""},
+	{"sharedarea_heap_write", py_uwsgi_sharedarea_heap_write, METH_VARARGS, ""},
+	{"sharedarea_heap_read", py_uwsgi_sharedarea_heap_read, METH_VARARGS, ""},
 #if defined(PYTHREE) || defined(Py_TPFLAGS_HAVE_NEWBUFFER)
 #ifndef HAS_NOT_PyMemoryView_FromBuffer
 	{"sharedarea_memoryview", py_uwsgi_sharedarea_memoryview, METH_VARARGS, ""},
@@ -2883,6 +3421,20 @@ PyObject *py_uwsgi_queue_push(PyObject * self, PyObject * args) {
 	if (!PyArg_ParseTuple(args, "s#:queue_push", &message, &msglen)) {
                 return NULL;
         }
+
+	// the lock-free ring does not need the queue lock
+	if (uwsgi.queue_ring) {
+		int ret;
+		UWSGI_RELEASE_GIL
+		ret = uwsgi_queue_ring_push(message, msglen);
+		UWSGI_GET_GIL
+		if (ret) {
+			Py_INCREF(Py_True);
+			return Py_True;
+		}
+		Py_INCREF(Py_None);
+		return Py_None;
+	}
 	
 	if (uwsgi.queue_size) {
 		UWSGI_RELEASE_GIL
@@ -2953,12 +3505,62 @@ PyObject *py_uwsgi_queue_pull_slot(PyObject * self, PyObject * args) {
 }
 
 
+// blocking pull/pop, timeout is in seconds (< 0 waits forever)
+static PyObject *py_uwsgi_queue_wait(double timeout, int pop) {
+	uint64_t size = 0;
+	char *storage;
+	int ms = timeout < 0 ? -1 : (int) (timeout * 1000);
+	if (timeout > 0 && !ms) ms = 1;
+
+	// suspend engines need the GIL to switch
+	if (uwsgi.wait_read_hook != uwsgi_simple_wait_read_hook) {
+		storage = uwsgi_queue_pull_wait(&size, ms, pop);
+	}
+	else {
+		UWSGI_RELEASE_GIL
+		storage = uwsgi_queue_pull_wait(&size, ms, pop);
+		UWSGI_GET_GIL
+	}
+
+	if (!storage) {
+		Py_INCREF(Py_None);
+		return Py_None;
+	}
+	PyObject *res = PyString_FromStringAndSize(storage, size);
+	free(storage);
+	return res;
+}
+
 PyObject *py_uwsgi_queue_pull(PyObject * self, PyObject * args) {
 
 	char *message;
 	uint64_t size;
 	PyObject *res;
 	char *storage;
+	PyObject *py_timeout = NULL;
+
+	if (!PyArg_ParseTuple(args, "|O:queue_pull", &py_timeout)) {
+		return NULL;
+	}
+
+	if (py_timeout && py_timeout != Py_None && (uwsgi.queue_size || uwsgi.queue_ring)) {
+		double timeout = PyFloat_AsDouble(py_timeout);
+		if (PyErr_Occurred()) return NULL;
+		return py_uwsgi_queue_wait(timeout, 0);
+	}
+
+	if (uwsgi.queue_ring) {
+		UWSGI_RELEASE_GIL
+		storage = uwsgi_queue_ring_pull(&size);
+		UWSGI_GET_GIL
+		if (!storage) {
+			Py_INCREF(Py_None);
+			return Py_None;
+		}
+		res = PyString_FromStringAndSize(storage, size);
+		free(storage);
+		return res;
+	}
 
 	if (uwsgi.queue_size) {
 		UWSGI_RELEASE_GIL
@@ -2995,6 +3597,17 @@ PyObject *py_uwsgi_queue_pop(PyObject * self, PyObject * args) {
         uint64_t size;
         PyObject *res;
 	char *storage;
+	PyObject *py_timeout = NULL;
+
+	if (!PyArg_ParseTuple(args, "|O:queue_pop", &py_timeout)) {
+		return NULL;
+	}
+
+	if (py_timeout && py_timeout != Py_None && uwsgi.queue_size) {
+		double timeout = PyFloat_AsDouble(py_timeout);
+		if (PyErr_Occurred()) return NULL;
+		return py_uwsgi_queue_wait(timeout, 1);
+	}
 
         if (uwsgi.queue_size) {
 
@@ -3216,12 +3829,146 @@ PyObject *py_uwsgi_cache_num(PyObject * self, PyObject * args) {
 
 }
 
+PyObject *py_uwsgi_cache_mget(PyObject * self, PyObject * args) {
+
+	PyObject *py_keys;
+	char *cache = NULL;
+	Py_ssize_t i;
+
+	if (!PyArg_ParseTuple(args, "O|s:cache_mget", &py_keys, &cache)) {
+		return NULL;
+	}
+
+	PyObject *py_seq = PySequence_Fast(py_keys, "cache_mget() requires a sequence of keys");
+	if (!py_seq) return NULL;
+
+	Py_ssize_t n = PySequence_Fast_GET_SIZE(py_seq);
+	if (n == 0) {
+		Py_DECREF(py_seq);
+		return PyList_New(0);
+	}
+
+	char **keys = uwsgi_malloc(sizeof(char *) * n);
+	uint16_t *keys_len = uwsgi_malloc(sizeof(uint16_t) * n);
+	char **values = uwsgi_malloc(sizeof(char *) * n);
+	uint64_t *values_len = uwsgi_malloc(sizeof(uint64_t) * n);
+
+	for(i=0;i<n;i++) {
+		PyObject *py_key = PySequence_Fast_GET_ITEM(py_seq, i);
+		if (!PyString_Check(py_key) || PyString_Size(py_key) > 0xffff) {
+			free(keys); free(keys_len); free(values); free(values_len);
+			Py_DECREF(py_seq);
+			return PyErr_Format(PyExc_ValueError, "cache_mget() keys must be strings");
+		}
+		keys[i] = PyString_AsString(py_key);
+		keys_len[i] = PyString_Size(py_key);
+	}
+
+	UWSGI_RELEASE_GIL
+	int ret = uwsgi_cache_magic_mget(n, keys, keys_len, values, values_len, cache);
+	UWSGI_GET_GIL
+
+	PyObject *l = NULL;
+	if (ret >= 0) {
+		l = PyList_New(n);
+		for(i=0;i<n;i++) {
+			if (values[i]) {
+				PyList_SET_ITEM(l, i, PyString_FromStringAndSize(values[i], values_len[i]));
+				free(values[i]);
+			}
+			else {
+				Py_INCREF(Py_None);
+				PyList_SET_ITEM(l, i, Py_None);
+			}
+		}
+	}
+
+	free(keys); free(keys_len); free(values); free(values_len);
+	Py_DECREF(py_seq);
+
+	if (!l) {
+		Py_INCREF(Py_None);
+		return Py_None;
+	}
+	return l;
+}
+
+PyObject *py_uwsgi_cache_mset(PyObject * self, PyObject * args) {
+
+	PyObject *py_dict;
+	uint64_t expires = 0;
+	char *cache = NULL;
+	PyObject *py_key, *py_value;
+	Py_ssize_t pos = 0;
+	uint64_t i = 0;
+
+	if (!PyArg_ParseTuple(args, "O|ls:cache_mset", &py_dict, &expires, &cache)) {
+		return NULL;
+	}
+
+	if (!PyDict_Check(py_dict)) {
+		return PyErr_Format(PyExc_ValueError, "cache_mset() requires a dictionary");
+	}
+
+	Py_ssize_t n = PyDict_Size(py_dict);
+	if (n == 0) {
+		Py_INCREF(Py_True);
+		return Py_True;
+	}
+
+	char **keys = uwsgi_malloc(sizeof(char *) * n);
+	uint16_t *keys_len = uwsgi_malloc(sizeof(uint16_t) * n);
+	char **values = uwsgi_malloc(sizeof(char *) * n);
+	uint64_t *values_len = uwsgi_malloc(sizeof(uint64_t) * n);
+
+	while (PyDict_Next(py_dict, &pos, &py_key, &py_value)) {
+		if (!PyString_Check(py_key) || !PyString_Check(py_value) || PyString_Size(py_key) > 0xffff) {
+			free(keys); free(keys_len); free(values); free(values_len);
+			return PyErr_Format(PyExc_ValueError, "cache_mset() keys and values must be strings");
+		}
+		keys[i] = PyString_AsString(py_key);
+		keys_len[i] = PyString_Size(py_key);
+		values[i] = PyString_AsString(py_value);
+		values_len[i] = PyString_Size(py_value);
+		i++;
+	}
+
+	UWSGI_RELEASE_GIL
+	int ret = uwsgi_cache_magic_mset(n, keys, keys_len, values, values_len, expires, 0, cache);
+	UWSGI_GET_GIL
+
+	free(keys); free(keys_len); free(values); free(values_len);
+
+	if (ret) {
+		Py_INCREF(Py_None);
+		return Py_None;
+	}
+
+	Py_INCREF(Py_True);
+	return Py_True;
+}
+
+// decode the 16bit size + key records generated by uwsgi_cache_scan()
+static PyObject *py_uwsgi_cache_keys_list(struct uwsgi_buffer *ub) {
+	PyObject *l = PyList_New(0);
+	size_t ub_pos = 0;
+	while(ub_pos + 2 <= ub->pos) {
+		uint16_t keysize = (uint8_t) ub->buf[ub_pos] | (((uint8_t) ub->buf[ub_pos+1]) << 8);
+		ub_pos += 2;
+		PyObject *ci = PyString_FromStringAndSize(ub->buf + ub_pos, keysize);
+		PyList_Append(l, ci);
+		Py_DECREF(ci);
+		ub_pos += keysize;
+	}
+	return l;
+}
+
 PyObject *py_uwsgi_cache_keys(PyObject * self, PyObject * args) {
 	char *cache = NULL;
-        struct uwsgi_cache_item *uci = NULL;
-        uint64_t pos = 0;
+	char *pattern = NULL;
+        uint64_t cursor = 0;
 
-        if (!PyArg_ParseTuple(args, "|s:cache_keys", &cache)) {
+        if (!PyArg_ParseTuple(args, "|zz:cache_keys", &cache, &pattern)) {
                 return NULL;
         }
 
@@ -3230,20 +3977,48 @@ PyObject *py_uwsgi_cache_keys(PyObject * self, PyObject * args) {
 		return PyErr_Format(PyExc_ValueError, "no local uWSGI cache available");
 	}
 
-	PyObject *l = PyList_New(0);
+	// keys are collected with the GIL released, the cache is locked only for a bunch of slots at time
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(uwsgi.page_size);
+	UWSGI_RELEASE_GIL
+	for(;;) {
+		uint64_t next = uwsgi_cache_scan(uc, cursor, 1024, pattern, ub);
+		// a cursor not moving forward means the buffer cannot grow
+		if (!next || next <= cursor) break;
+		cursor = next;
+	}
+	UWSGI_GET_GIL
 
-	uwsgi_rlock(uc->lock);
-        for(;;) {
-                uci = uwsgi_cache_keys(uc, &pos, &uci);
-                if (!uci) break;
-		PyObject *ci = PyString_FromStringAndSize(uci->key, uci->keysize);
-		PyList_Append(l, ci);
-		Py_DECREF(ci);
-        }
-	uwsgi_rwunlock(uc->lock);
+	PyObject *l = py_uwsgi_cache_keys_list(ub);
+	uwsgi_buffer_destroy(ub);
 	return l;
 }
 
+// uwsgi.cache_scan(cursor[, count, pattern, cache]) -> (next_cursor, [keys]), next_cursor is 0 at the end
+PyObject *py_uwsgi_cache_scan(PyObject * self, PyObject * args) {
+	char *cache = NULL;
+	char *pattern = NULL;
+	unsigned long long cursor = 0;
+	unsigned long long count = 100;
+
+	if (!PyArg_ParseTuple(args, "K|Kzz:cache_scan", &cursor, &count, &pattern, &cache)) {
+		return NULL;
+	}
+
+	struct uwsgi_cache *uc = uwsgi_cache_by_name(cache);
+	if (!uc) {
+		return PyErr_Format(PyExc_ValueError, "no local uWSGI cache available");
+	}
+
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(uwsgi.page_size);
+	UWSGI_RELEASE_GIL
+	cursor = uwsgi_cache_scan(uc, cursor, count, pattern, ub);
+	UWSGI_GET_GIL
+
+	PyObject *l = py_uwsgi_cache_keys_list(ub);
+	uwsgi_buffer_destroy(ub);
+	return Py_BuildValue("(KN)", cursor, l);
+}
+
 
 static PyMethodDef uwsgi_cache_methods[] = {
 	{"cache_get", py_uwsgi_cache_get, METH_VARARGS, ""},
@@ -3258,6 +4033,9 @@ static PyMethodDef uwsgi_cache_methods[] = {
 	{"cache_div", py_uwsgi_cache_div, METH_VARARGS, ""},
 	{"cache_num", py_uwsgi_cache_num, METH_VARARGS, ""},
 	{"cache_keys", py_uwsgi_cache_keys, METH_VARARGS, ""},
+	{"cache_scan", py_uwsgi_cache_scan, METH_VARARGS, ""},
+	{"cache_mget", py_uwsgi_cache_mget, METH_VARARGS, ""},
+	{"cache_mset", py_uwsgi_cache_mset, METH_VARARGS, ""},
 	{NULL, NULL},
 };
 
@@ -42,6 +42,9 @@
 
 #define UWSGI_GET_GIL up.gil_get();
 #define UWSGI_RELEASE_GIL up.gil_release();
+// run a (potentially) locking or blocking core call without holding the GIL
+// (the statement can declare a variable, so no braces here)
+#define UWSGI_WITHOUT_GIL(x) UWSGI_RELEASE_GIL x; UWSGI_GET_GIL
 
 #ifndef PyVarObject_HEAD_INIT
 #define PyVarObject_HEAD_INIT(x, y) PyObject_HEAD_INIT(x) y,
@@ -95,6 +98,25 @@ PyAPI_FUNC(PyObject *) PyMarshal_ReadObjectFromString(char *, Py_ssize_t);
 
 #define LOADER_MAX              9
 
+#define UWSGI_PYTHON_ENV_KEYS		256
+#define UWSGI_PYTHON_ENV_KEY_MAX	64
+
+struct uwsgi_python_env_key {
+	uint16_t len;
+	char name[UWSGI_PYTHON_ENV_KEY_MAX];
+	PyObject *key;
+};
+
+// max size of a folded stack of the sampling profiler
+#define UWSGI_PYTHON_SAMPLE_STACK	1024
+
+struct uwsgi_python_sample {
+	uint32_t hash;
+	uint16_t len;
+	uint64_t count;
+	char stack[UWSGI_PYTHON_SAMPLE_STACK];
+};
+
 typedef struct uwsgi_Input {
         PyObject_HEAD
         struct wsgi_request *wsgi_req;
@@ -165,6 +187,11 @@ struct uwsgi_python {
 	void (*gil_release) (void);
 	int auto_reload;
 	char *tracebacker;
+	int sampler_hz;
+	uint64_t sampler_slots;
+	struct uwsgi_python_sample *samples;
+	uint64_t *samples_dropped;
+	char *code_cache;
 	struct uwsgi_string_list *auto_reload_ignore;
 
 	PyObject *workers_tuple;
@@ -192,6 +219,8 @@ struct uwsgi_python {
 	char *programname;
 	int wsgi_strict;
 	int wsgi_accept_buffer;
+	uint64_t wsgi_coalesce;
+	struct uwsgi_buffer **wsgi_coalesce_buffers;
 
 	char *raw;
 	PyObject *raw_callable;
@@ -199,6 +228,7 @@ struct uwsgi_python {
 	struct uwsgi_string_list *sharedarea;
 
 	int call_osafterfork;
+	int zygote_freeze;
 	int pre_initialized;
 };
 
@@ -285,6 +315,8 @@ void uwsgi_python_reset_random_seed(void);
 char *uwsgi_pythonize(char *);
 void *uwsgi_python_autoreloader_thread(void *);
 void *uwsgi_python_tracebacker_thread(void *);
+void *uwsgi_python_sampler_thread(void *);
+int uwsgi_python_sampler_stats(struct uwsgi_stats *, int);
 
 int uwsgi_python_do_send_headers(struct wsgi_request *);
 void *uwsgi_python_tracebacker_thread(void *);
@@ -297,6 +329,8 @@ struct uwsgi_buffer *uwsgi_python_backtrace(struct wsgi_request *);
 void uwsgi_python_exception_log(struct wsgi_request *);
 
 int uwsgi_python_send_body(struct wsgi_request *, PyObject *);
+int uwsgi_python_send_body_list(struct wsgi_request *, PyObject *);
+void uwsgi_python_coalesce_flush(struct wsgi_request *);
 
 int uwsgi_request_python_raw(struct wsgi_request *);
 
@@ -311,4 +345,5 @@ void uwsgi_python_set_thread_name(int);
 
 #ifdef __linux__
 int uwsgi_init_symbol_import(void);
+void uwsgi_init_code_cache(void);
 #endif
@@ -240,6 +240,8 @@ PyObject *py_uwsgi_write(PyObject * self, PyObject * args) {
 
 	data = PyTuple_GetItem(args, 0);
 	if (PyString_Check(data)) {
+		// keep ordering with the strings already coalesced
+		if (up.wsgi_coalesce) uwsgi_python_coalesce_flush(wsgi_req);
 		content = PyString_AsString(data);
 		content_len = PyString_Size(data);
 		UWSGI_RELEASE_GIL
@@ -391,8 +393,12 @@ int uwsgi_request_wsgi(struct wsgi_request *wsgi_req) {
 
 	UWSGI_GET_GIL
 
+#ifdef Py_GIL_DISABLED
+	__sync_add_and_fetch(&wi->requests, 1);
+#else
 	// no fear of race conditions for this counter as it is already protected by the GIL
 	wi->requests++;
+#endif
 
 	// create WSGI environ
 	wsgi_req->async_environ = up.wsgi_env_create(wsgi_req, wi);
@@ -468,17 +474,22 @@ PyObject *py_uwsgi_sendfile(PyObject * self, PyObject * args) {
 		return NULL;
 	}
 
-#ifdef PYTHREE
-	wsgi_req->sendfile_fd = PyObject_AsFileDescriptor(wsgi_req->async_sendfile);
-	if (wsgi_req->sendfile_fd >= 0) {
-		Py_INCREF((PyObject *)wsgi_req->async_sendfile);
+	// anything with a fileno() (io wrappers, tempfiles...), but fileno() would roll over a SpooledTemporaryFile to disk
+	PyObject *rolled = PyObject_GetAttrString((PyObject *)wsgi_req->async_sendfile, "_rolled");
+	if (!rolled) {
+		PyErr_Clear();
 	}
-#else
-	if (PyFile_Check((PyObject *)wsgi_req->async_sendfile)) {
-		Py_INCREF((PyObject *)wsgi_req->async_sendfile);
+	if (!rolled || PyObject_IsTrue(rolled)) {
 		wsgi_req->sendfile_fd = PyObject_AsFileDescriptor(wsgi_req->async_sendfile);
+		if (wsgi_req->sendfile_fd >= 0) {
+			Py_INCREF((PyObject *)wsgi_req->async_sendfile);
+		}
+		else {
+			wsgi_req->sendfile_fd = -1;
+			PyErr_Clear();
+		}
 	}
-#endif
+	Py_XDECREF(rolled);
 
 	// PEP 333 hack
 	wsgi_req->sendfile_obj = wsgi_req->async_sendfile;
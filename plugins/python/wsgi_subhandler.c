@@ -116,6 +116,147 @@ static void uwsgi_python_consume_file_wrapper_read(struct wsgi_request *wsgi_req
         Py_DECREF(read_method);
 }
 
+// the current position of a file-like object (-1 if unknown)
+static int64_t uwsgi_python_file_wrapper_tell(PyObject *obj) {
+	PyObject *ret = PyObject_CallMethod(obj, "tell", NULL);
+	if (!ret) {
+		PyErr_Clear();
+		return -1;
+	}
+	int64_t pos = PyLong_AsLongLong(ret);
+	Py_DECREF(ret);
+	if (PyErr_Occurred()) {
+		PyErr_Clear();
+		return -1;
+	}
+	return pos;
+}
+
+/*
+	file-like objects backed by a regular file (files, io wrappers, tempfiles) are sent with
+	sendfile() (or offloaded) from their current position, tell() is used instead of the fd
+	offset as buffered readers could be ahead of it
+*/
+static int uwsgi_python_file_wrapper_sendfile(struct wsgi_request *wsgi_req, PyObject *obj) {
+	struct stat st;
+	int fd = wsgi_req->sendfile_fd;
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode)) return -1;
+
+	// buffered writers could still hold part of the content
+	if (PyObject_HasAttrString(obj, "flush")) {
+		PyObject *ret = PyObject_CallMethod(obj, "flush", NULL);
+		Py_XDECREF(ret);
+		PyErr_Clear();
+		if (fstat(fd, &st)) return -1;
+	}
+
+	int64_t pos = uwsgi_python_file_wrapper_tell(obj);
+	if (pos < 0) pos = lseek(fd, 0, SEEK_CUR);
+	if (pos < 0) pos = 0;
+	if (pos >= st.st_size) return 0;
+
+	UWSGI_RELEASE_GIL
+	uwsgi_response_sendfile_do(wsgi_req, fd, pos, st.st_size - pos);
+	UWSGI_GET_GIL
+	return 0;
+}
+
+// in-memory objects exposing their buffer (BytesIO, not rolled over SpooledTemporaryFile)
+static int uwsgi_python_file_wrapper_buffer(struct wsgi_request *wsgi_req, PyObject *obj) {
+	if (!PyObject_HasAttrString(obj, "getbuffer")) {
+		// the BytesIO of a SpooledTemporaryFile
+		PyObject *rolled = PyObject_GetAttrString(obj, "_rolled");
+		if (!rolled) {
+			PyErr_Clear();
+			return -1;
+		}
+		int is_rolled = PyObject_IsTrue(rolled);
+		Py_DECREF(rolled);
+		if (is_rolled) return -1;
+		PyObject *file = PyObject_GetAttrString(obj, "_file");
+		if (!file) {
+			PyErr_Clear();
+			return -1;
+		}
+		int ret = -1;
+		if (PyObject_HasAttrString(file, "getbuffer")) {
+			ret = uwsgi_python_file_wrapper_buffer(wsgi_req, file);
+		}
+		Py_DECREF(file);
+		return ret;
+	}
+
+	PyObject *view = PyObject_CallMethod(obj, "getbuffer", NULL);
+	if (!view) {
+		PyErr_Clear();
+		return -1;
+	}
+
+	Py_buffer pbuf;
+	if (PyObject_GetBuffer(view, &pbuf, PyBUF_SIMPLE)) {
+		PyErr_Clear();
+		Py_DECREF(view);
+		return -1;
+	}
+
+	int64_t pos = uwsgi_python_file_wrapper_tell(obj);
+	if (pos < 0) pos = 0;
+	// the exported buffer cannot be resized until it is released
+	if (pos < pbuf.len) {
+		UWSGI_RELEASE_GIL
+		uwsgi_response_write_body_do(wsgi_req, (char *) pbuf.buf + pos, pbuf.len - pos);
+		UWSGI_GET_GIL
+	}
+
+	PyBuffer_Release(&pbuf);
+	Py_DECREF(view);
+	return 0;
+}
+
+// send the object passed to wsgi.file_wrapper
+static void uwsgi_python_send_file_wrapper(struct wsgi_request *wsgi_req, PyObject *obj) {
+	if (wsgi_req->sendfile_fd >= 0 && !uwsgi_python_file_wrapper_sendfile(wsgi_req, obj)) return;
+	if (!uwsgi_python_file_wrapper_buffer(wsgi_req, obj)) return;
+	// we do not have an iterable, check for read() method
+	if (PyObject_HasAttrString(obj, "read")) {
+		uwsgi_python_consume_file_wrapper_read(wsgi_req, obj);
+	}
+}
+
+/*
+	environ keys are interned in a per-app (so per-interpreter) table,
+	a colliding name simply replaces the slot
+*/
+static PyObject *uwsgi_python_env_key(struct uwsgi_app *wi, char *name, uint16_t len) {
+	struct uwsgi_python_env_key *upek = NULL;
+	if (wi->environ_keys && len <= UWSGI_PYTHON_ENV_KEY_MAX) {
+		upek = &((struct uwsgi_python_env_key *) wi->environ_keys)[djb33x_hash(name, len) % UWSGI_PYTHON_ENV_KEYS];
+		if (upek->key && upek->len == len && !memcmp(upek->name, name, len)) {
+			Py_INCREF(upek->key);
+			return upek->key;
+		}
+	}
+#ifdef PYTHREE
+	PyObject *key = PyUnicode_DecodeLatin1(name, len, NULL);
+#else
+	PyObject *key = PyString_FromStringAndSize(name, len);
+#endif
+	if (upek && key) {
+		Py_XDECREF(upek->key);
+		upek->len = len;
+		memcpy(upek->name, name, len);
+		upek->key = key;
+		Py_INCREF(key);
+	}
+	return key;
+}
+
+static void uwsgi_python_env_set(struct wsgi_request *wsgi_req, struct uwsgi_app *wi, char *name, uint16_t len, PyObject *value) {
+	PyObject *key = uwsgi_python_env_key(wi, name, len);
+	PyDict_SetItem(wsgi_req->async_environ, key, value);
+	Py_DECREF(key);
+}
+
 void *uwsgi_request_subhandler_wsgi(struct wsgi_request *wsgi_req, struct uwsgi_app *wi) {
 
 
@@ -128,11 +269,10 @@ void *uwsgi_request_subhandler_wsgi(struct wsgi_request *wsgi_req, struct uwsgi_
 #ifdef UWSGI_DEBUG
                 uwsgi_debug("%.*s: %.*s\n", wsgi_req->hvec[i].iov_len, wsgi_req->hvec[i].iov_base, wsgi_req->hvec[i+1].iov_len, wsgi_req->hvec[i+1].iov_base);
 #endif
+                pydictkey = uwsgi_python_env_key(wi, wsgi_req->hvec[i].iov_base, wsgi_req->hvec[i].iov_len);
 #ifdef PYTHREE
-                pydictkey = PyUnicode_DecodeLatin1(wsgi_req->hvec[i].iov_base, wsgi_req->hvec[i].iov_len, NULL);
                 pydictvalue = PyUnicode_DecodeLatin1(wsgi_req->hvec[i + 1].iov_base, wsgi_req->hvec[i + 1].iov_len, NULL);
 #else
-                pydictkey = PyString_FromStringAndSize(wsgi_req->hvec[i].iov_base, wsgi_req->hvec[i].iov_len);
                 pydictvalue = PyString_FromStringAndSize(wsgi_req->hvec[i + 1].iov_base, wsgi_req->hvec[i + 1].iov_len);
 #endif
 
@@ -166,38 +306,13 @@ void *uwsgi_request_subhandler_wsgi(struct wsgi_request *wsgi_req, struct uwsgi_
         ((uwsgi_Input*)wsgi_req->async_input)->wsgi_req = wsgi_req;
 
 
-        PyDict_SetItemString(wsgi_req->async_environ, "wsgi.input", wsgi_req->async_input);
+        uwsgi_python_env_set(wsgi_req, wi, "wsgi.input", 10, wsgi_req->async_input);
 
-	PyDict_SetItemString(wsgi_req->async_environ, "wsgi.file_wrapper", wi->sendfile);
-
-	if (uwsgi.async > 0) {
-		PyDict_SetItemString(wsgi_req->async_environ, "x-wsgiorg.fdevent.readable", wi->eventfd_read);
-		PyDict_SetItemString(wsgi_req->async_environ, "x-wsgiorg.fdevent.writable", wi->eventfd_write);
-		PyDict_SetItemString(wsgi_req->async_environ, "x-wsgiorg.fdevent.timeout", Py_None);
+	// wsgi.version, wsgi.errors, wsgi.file_wrapper...
+	if (wi->environ_template) {
+		PyDict_Merge(wsgi_req->async_environ, wi->environ_template, 1);
 	}
 
-	PyDict_SetItemString(wsgi_req->async_environ, "wsgi.version", wi->gateway_version);
-
-	PyDict_SetItemString(wsgi_req->async_environ, "wsgi.errors", wi->error);
-
-	PyDict_SetItemString(wsgi_req->async_environ, "wsgi.run_once", Py_False);
-
-
-
-	if (uwsgi.threads > 1) {
-		PyDict_SetItemString(wsgi_req->async_environ, "wsgi.multithread", Py_True);
-	}
-	else {
-		PyDict_SetItemString(wsgi_req->async_environ, "wsgi.multithread", Py_False);
-	}
-	if (uwsgi.numproc == 1) {
-		PyDict_SetItemString(wsgi_req->async_environ, "wsgi.multiprocess", Py_False);
-	}
-	else {
-		PyDict_SetItemString(wsgi_req->async_environ, "wsgi.multiprocess", Py_True);
-	}
-
-
 	if (wsgi_req->scheme_len > 0) {
 		zero = UWSGI_PYFROMSTRINGSIZE(wsgi_req->scheme, wsgi_req->scheme_len);
 	}
@@ -212,7 +327,7 @@ void *uwsgi_request_subhandler_wsgi(struct wsgi_request *wsgi_req, struct uwsgi_
 	else {
 		zero = UWSGI_PYFROMSTRING("http");
 	}
-	PyDict_SetItemString(wsgi_req->async_environ, "wsgi.url_scheme", zero);
+	uwsgi_python_env_set(wsgi_req, wi, "wsgi.url_scheme", 15, zero);
 	Py_DECREF(zero);
 
 	wsgi_req->async_app = wi->callable;
@@ -222,21 +337,128 @@ void *uwsgi_request_subhandler_wsgi(struct wsgi_request *wsgi_req, struct uwsgi_
 		PyDict_SetItemString(up.embedded_dict, "env", wsgi_req->async_environ);
 	}
 
-	PyDict_SetItemString(wsgi_req->async_environ, "uwsgi.version", wi->uwsgi_version);
-
 	if (uwsgi.cores > 1) {
 		zero = PyInt_FromLong(wsgi_req->async_id);
-		PyDict_SetItemString(wsgi_req->async_environ, "uwsgi.core", zero);
+		uwsgi_python_env_set(wsgi_req, wi, "uwsgi.core", 10, zero);
 		Py_DECREF(zero);
 	}
 
-	PyDict_SetItemString(wsgi_req->async_environ, "uwsgi.node", wi->uwsgi_node);
-
 	// call
 	PyTuple_SetItem(wsgi_req->async_args, 0, wsgi_req->async_environ);
 	return python_call(wsgi_req->async_app, wsgi_req->async_args, uwsgi.catch_exceptions, wsgi_req);
 }
 
+/*
+	lists and tuples of strings (bytes) are sent along with the headers with a single writev(),
+	the memory of the items is only referenced (no copies).
+
+	With --wsgi-accept-buffer any buffer-compliant item (bytearray, memoryview, numpy arrays...)
+	is referenced too
+*/
+#if defined(PYTHREE) || defined(Py_TPFLAGS_HAVE_NEWBUFFER)
+#define uwsgi_python_body_item_check(x) (PyString_Check(x) || (up.wsgi_accept_buffer && PyObject_CheckBuffer(x)))
+#else
+#define uwsgi_python_body_item_check(x) PyString_Check(x)
+#endif
+
+int uwsgi_python_send_body_list(struct wsgi_request *wsgi_req, PyObject *seq) {
+	// the tuple keeps the items alive even if the list is changed while the GIL is released
+	PyObject *items = PySequence_Tuple(seq);
+	if (!items) {
+		PyErr_Clear();
+		return 0;
+	}
+	Py_ssize_t i, n = PyTuple_GET_SIZE(items);
+	// single items are already managed by the generic path
+	if (n < 2) goto fallback;
+	for(i=0;i<n;i++) {
+		if (!uwsgi_python_body_item_check(PyTuple_GET_ITEM(items, i))) goto fallback;
+	}
+
+	struct iovec iov[UWSGI_RESPONSE_IOV];
+	size_t iov_n = 0;
+#if defined(PYTHREE) || defined(Py_TPFLAGS_HAVE_NEWBUFFER)
+	Py_buffer views[UWSGI_RESPONSE_IOV];
+	size_t views_n = 0;
+#endif
+	for(i=0;i<n;i++) {
+		PyObject *item = PyTuple_GET_ITEM(items, i);
+		if (PyString_Check(item)) {
+			iov[iov_n].iov_base = PyString_AsString(item);
+			iov[iov_n].iov_len = PyString_Size(item);
+			iov_n++;
+		}
+#if defined(PYTHREE) || defined(Py_TPFLAGS_HAVE_NEWBUFFER)
+		else if (!PyObject_GetBuffer(item, &views[views_n], PyBUF_SIMPLE)) {
+			iov[iov_n].iov_base = views[views_n].buf;
+			iov[iov_n].iov_len = views[views_n].len;
+			iov_n++;
+			views_n++;
+		}
+		else {
+			PyErr_Clear();
+		}
+#endif
+		if (iov_n < UWSGI_RESPONSE_IOV && i < n-1) continue;
+		UWSGI_RELEASE_GIL
+		uwsgi_response_writev_body_do(wsgi_req, iov, iov_n);
+		UWSGI_GET_GIL
+		iov_n = 0;
+#if defined(PYTHREE) || defined(Py_TPFLAGS_HAVE_NEWBUFFER)
+		while(views_n > 0) {
+			PyBuffer_Release(&views[--views_n]);
+		}
+#endif
+		uwsgi_py_check_write_errors {
+			uwsgi_py_write_exception(wsgi_req);
+			break;
+		}
+	}
+	Py_DECREF(items);
+	return 1;
+
+fallback:
+	Py_DECREF(items);
+	return 0;
+}
+
+/*
+	--wsgi-coalesce: small strings yielded by the response iterable are accumulated
+	in a per-core buffer, flushed when it reaches the threshold, before any other write
+	and at the end of the response
+*/
+void uwsgi_python_coalesce_flush(struct wsgi_request *wsgi_req) {
+	if (!up.wsgi_coalesce_buffers) return;
+	struct uwsgi_buffer *ub = up.wsgi_coalesce_buffers[wsgi_req->async_id];
+	if (!ub || ub->pos == 0) return;
+	size_t len = ub->pos;
+	ub->pos = 0;
+	UWSGI_RELEASE_GIL
+	uwsgi_response_write_body_do(wsgi_req, ub->buf, len);
+	UWSGI_GET_GIL
+}
+
+static int uwsgi_python_coalesce(struct wsgi_request *wsgi_req, PyObject *chunk) {
+	if (!PyString_Check(chunk)) return 0;
+	size_t len = PyString_Size(chunk);
+	if (len >= up.wsgi_coalesce) return 0;
+	if (!up.wsgi_coalesce_buffers) return 0;
+	struct uwsgi_buffer *ub = up.wsgi_coalesce_buffers[wsgi_req->async_id];
+	if (!ub) {
+		ub = uwsgi_buffer_new(up.wsgi_coalesce * 2);
+		up.wsgi_coalesce_buffers[wsgi_req->async_id] = ub;
+	}
+	if (uwsgi_buffer_append(ub, PyString_AsString(chunk), len)) return 0;
+	if (ub->pos >= up.wsgi_coalesce) {
+		uwsgi_python_coalesce_flush(wsgi_req);
+		uwsgi_py_check_write_errors {
+			uwsgi_py_write_exception(wsgi_req);
+			return -1;
+		}
+	}
+	return 1;
+}
+
 int uwsgi_response_subhandler_wsgi(struct wsgi_request *wsgi_req) {
 
 	PyObject *pychunk;
@@ -247,16 +469,12 @@ int uwsgi_response_subhandler_wsgi(struct wsgi_request *wsgi_req) {
 		if (uwsgi_python_send_body(wsgi_req, (PyObject *)wsgi_req->async_result)) goto clear;
 	}
 
+	if (PyList_CheckExact((PyObject *)wsgi_req->async_result) || PyTuple_CheckExact((PyObject *)wsgi_req->async_result)) {
+		if (uwsgi_python_send_body_list(wsgi_req, (PyObject *)wsgi_req->async_result)) goto clear;
+	}
+
 	if (wsgi_req->sendfile_obj == wsgi_req->async_result) {
-		if (wsgi_req->sendfile_fd >= 0) {
-			UWSGI_RELEASE_GIL
-			uwsgi_response_sendfile_do(wsgi_req, wsgi_req->sendfile_fd, 0, 0);
-			UWSGI_GET_GIL
-		}
-                // we do not have an iterable, check for read() method
-		else if (PyObject_HasAttrString((PyObject *)wsgi_req->async_result, "read")) {
-			uwsgi_python_consume_file_wrapper_read(wsgi_req, (PyObject *)wsgi_req->async_result);
-		}
+		uwsgi_python_send_file_wrapper(wsgi_req, (PyObject *)wsgi_req->async_result);
 		uwsgi_py_check_write_errors {
 			uwsgi_py_write_exception(wsgi_req);
 		}
@@ -287,6 +505,21 @@ exception:
 
 
 
+	if (up.wsgi_coalesce) {
+		int ret = uwsgi_python_coalesce(wsgi_req, pychunk);
+		if (ret != 0) {
+			Py_DECREF(pychunk);
+			if (ret < 0) goto clear;
+			return UWSGI_AGAIN;
+		}
+		uwsgi_python_coalesce_flush(wsgi_req);
+		uwsgi_py_check_write_errors {
+			uwsgi_py_write_exception(wsgi_req);
+			Py_DECREF(pychunk);
+			goto clear;
+		}
+	}
+
 	int ret = uwsgi_python_send_body(wsgi_req, pychunk);
 	if (ret != 0) {
 		if (ret < 0) {
@@ -295,15 +528,7 @@ exception:
 		}
 	}
 	else if (wsgi_req->sendfile_obj == pychunk) {
-		if (wsgi_req->sendfile_fd >= 0) {
-			UWSGI_RELEASE_GIL
-			uwsgi_response_sendfile_do(wsgi_req, wsgi_req->sendfile_fd, 0, 0);
-			UWSGI_GET_GIL
-		}
-		// we do not have an iterable, check for read() method
-		else if (PyObject_HasAttrString(pychunk, "read")) {
-			uwsgi_python_consume_file_wrapper_read(wsgi_req, pychunk);
-		}
+		uwsgi_python_send_file_wrapper(wsgi_req, pychunk);
 
 		uwsgi_py_check_write_errors {
 			uwsgi_py_write_exception(wsgi_req);
@@ -318,6 +543,13 @@ exception:
 
 clear:
 
+	if (up.wsgi_coalesce) {
+		uwsgi_python_coalesce_flush(wsgi_req);
+		uwsgi_py_check_write_errors {
+			uwsgi_py_write_exception(wsgi_req);
+		}
+	}
+
 	if (wsgi_req->sendfile_fd != -1) {
 		Py_DECREF((PyObject *)wsgi_req->async_sendfile);
 	}
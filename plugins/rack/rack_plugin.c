@@ -50,6 +50,9 @@ struct uwsgi_option uwsgi_rack_options[] = {
 
         {"rvm-path", required_argument, 0, "search for rvm in the specified directory", uwsgi_opt_add_string_list, &ur.rvm_path, 0},
 
+        {"rack-frozen-keys", no_argument, 0, "use frozen (interned when available) strings as keys of the rack env hash", uwsgi_opt_true, &ur.frozen_keys, 0},
+        {"rack-coalesce", required_argument, 0, "coalesce the body chunks yielded by each() until they reach the specified size", uwsgi_opt_set_64bit, &ur.coalesce, 0},
+
         {"rbshell", optional_argument, 0, "run  a ruby/irb shell", uwsgi_opt_rbshell, NULL, 0},
         {"rbshell-oneshot", no_argument, 0, "set ruby/irb shell (one shot)", uwsgi_opt_rbshell, NULL, 0},
 
@@ -559,6 +562,15 @@ void uwsgi_rack_init_apps(void) {
 
 
 	ur.app_id = uwsgi_apps_cnt;
+
+	if (ur.coalesce && !ur.coalesce_buffers) {
+		int i;
+		ur.coalesce_buffers = uwsgi_calloc(sizeof(struct uwsgi_buffer *) * uwsgi.cores);
+		for(i=0;i<uwsgi.cores;i++) {
+			ur.coalesce_buffers[i] = uwsgi_buffer_new(ur.coalesce);
+		}
+	}
+
 	struct uwsgi_string_list *usl = ur.rbrequire;
 
 	time_t now = uwsgi_now();
@@ -698,13 +710,53 @@ VALUE call_dispatch(VALUE env) {
 
 }
 
+// env keys are always the same few dozen strings, frozen keys are not duplicated by rb_hash_aset()
+static VALUE rack_env_key(char *key, size_t len) {
+	if (!ur.frozen_keys) return rb_str_new(key, len);
+#if defined(RUBY_API_VERSION_MAJOR) && RUBY_API_VERSION_MAJOR >= 3
+	return rb_interned_str(key, len);
+#else
+	return rb_obj_freeze(rb_str_new(key, len));
+#endif
+}
+
+#define rack_env_key2(x) rack_env_key(x, strlen(x))
+
+static void rack_coalesce_flush(struct wsgi_request *wsgi_req) {
+	if (!ur.coalesce_buffers) return;
+	struct uwsgi_buffer *ub = ur.coalesce_buffers[wsgi_req->async_id];
+	if (!ub->pos) return;
+	uwsgi_response_write_body_do(wsgi_req, ub->buf, ub->pos);
+	ub->pos = 0;
+}
+
+/*
+	chunks smaller than --rack-coalesce are copied in a per-core buffer
+	and sent when it is full (or at the end of the body)
+*/
+static int rack_write_body(struct wsgi_request *wsgi_req, char *buf, size_t len) {
+	if (!ur.coalesce_buffers) {
+		return uwsgi_response_write_body_do(wsgi_req, buf, len);
+	}
+	struct uwsgi_buffer *ub = ur.coalesce_buffers[wsgi_req->async_id];
+	if (len >= ur.coalesce) {
+		rack_coalesce_flush(wsgi_req);
+		return uwsgi_response_write_body_do(wsgi_req, buf, len);
+	}
+	if (uwsgi_buffer_append(ub, buf, len)) return -1;
+	if (ub->pos >= ur.coalesce) {
+		rack_coalesce_flush(wsgi_req);
+	}
+	return 0;
+}
+
 static VALUE send_body(VALUE obj) {
 
 	struct wsgi_request *wsgi_req = current_wsgi_req();
 
 	//uwsgi_log("sending body\n");
 	if (TYPE(obj) == T_STRING) {
-		uwsgi_response_write_body_do(wsgi_req, RSTRING_PTR(obj), RSTRING_LEN(obj));
+		rack_write_body(wsgi_req, RSTRING_PTR(obj), RSTRING_LEN(obj));
 	}
 	else {
 		uwsgi_log("UNMANAGED BODY TYPE %d\n", TYPE(obj));
@@ -713,10 +765,58 @@ static VALUE send_body(VALUE obj) {
 	return Qnil;
 }
 
+// arrays of strings are sent (along with the headers) with a single writev() without copying them
+static int send_body_array(struct wsgi_request *wsgi_req, VALUE body) {
+	long i, n = RARRAY_LEN(body);
+	if (n < 2) return 0;
+	for(i=0;i<n;i++) {
+		if (TYPE(RARRAY_PTR(body)[i]) != T_STRING) return 0;
+	}
+	struct iovec iov[UWSGI_RESPONSE_IOV];
+	size_t iov_n = 0;
+	for(i=0;i<n;i++) {
+		VALUE item = RARRAY_PTR(body)[i];
+		iov[iov_n].iov_base = RSTRING_PTR(item);
+		iov[iov_n].iov_len = RSTRING_LEN(item);
+		iov_n++;
+		if (iov_n < UWSGI_RESPONSE_IOV && i < n-1) continue;
+		if (uwsgi_response_writev_body_do(wsgi_req, iov, iov_n)) break;
+		iov_n = 0;
+	}
+	return 1;
+}
+
 VALUE body_to_path(VALUE body) {
         return rb_funcall( body, rb_intern("to_path"), 0);
 }
 
+VALUE body_to_ary(VALUE body) {
+	return rb_funcall( body, rb_intern("to_ary"), 0);
+}
+
+// send the file pointed by body.to_path (sendfile or offload), returns 0 if the body has to be iterated instead
+static int send_body_path(struct wsgi_request *wsgi_req, VALUE body) {
+	int error = 0;
+	VALUE sendfile_path = rb_protect( body_to_path, body, &error);
+	if (error) {
+		uwsgi_manage_exception(wsgi_req, uwsgi.catch_exceptions);
+		return 1;
+	}
+	if (TYPE(sendfile_path) != T_STRING) return 0;
+	char *path = uwsgi_concat2n(RSTRING_PTR(sendfile_path), RSTRING_LEN(sendfile_path), "", 0);
+	int fd = open(path, O_RDONLY);
+	free(path);
+	if (fd < 0) return 0;
+	struct stat st;
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+		close(fd);
+		return 0;
+	}
+	// the following function will close the descriptor
+	uwsgi_response_sendfile_do(wsgi_req, fd, 0, st.st_size);
+	return 1;
+}
+
 
 VALUE close_body(VALUE body) {
 	return rb_funcall( body, rb_intern("close"), 0);
@@ -828,16 +928,16 @@ int uwsgi_rack_request(struct wsgi_request *wsgi_req) {
 
         env = rb_hash_new();
 	// the following vars have to always been defined (we skip REQUEST_METHOD and PATH_INFO as they should always be available)
-	rb_hash_aset(env, rb_str_new2("SCRIPT_NAME"), rb_str_new2(""));
-	rb_hash_aset(env, rb_str_new2("QUERY_STRING"), rb_str_new2(""));
-	rb_hash_aset(env, rb_str_new2("SERVER_NAME"), rb_str_new2(uwsgi.hostname));
+	rb_hash_aset(env, rack_env_key2("SCRIPT_NAME"), rb_str_new2(""));
+	rb_hash_aset(env, rack_env_key2("QUERY_STRING"), rb_str_new2(""));
+	rb_hash_aset(env, rack_env_key2("SERVER_NAME"), rb_str_new2(uwsgi.hostname));
 	// SERVER_PORT
         char *server_port = strchr(wsgi_req->socket->name, ':');
         if (server_port) {
-		rb_hash_aset(env, rb_str_new2("SERVER_PORT"), rb_str_new(server_port+1, strlen(server_port+1)));
+		rb_hash_aset(env, rack_env_key2("SERVER_PORT"), rb_str_new(server_port+1, strlen(server_port+1)));
         }
         else {
-		rb_hash_aset(env, rb_str_new2("SERVER_PORT"), rb_str_new2("80"));
+		rb_hash_aset(env, rack_env_key2("SERVER_PORT"), rb_str_new2("80"));
         }
 
         // fill ruby hash
@@ -852,7 +952,7 @@ int uwsgi_rack_request(struct wsgi_request *wsgi_req) {
 					!uwsgi_strncmp((char *)"SERVER_NAME", 11, wsgi_req->hvec[i].iov_base, (int) wsgi_req->hvec[i].iov_len) ||
 					!uwsgi_strncmp((char *)"SERVER_PORT", 11, wsgi_req->hvec[i].iov_base, (int) wsgi_req->hvec[i].iov_len)
 							) {
-			rb_hash_aset(env, rb_str_new(wsgi_req->hvec[i].iov_base, wsgi_req->hvec[i].iov_len),
+			rb_hash_aset(env, rack_env_key(wsgi_req->hvec[i].iov_base, wsgi_req->hvec[i].iov_len),
 					rb_str_new(wsgi_req->hvec[i+1].iov_base, wsgi_req->hvec[i+1].iov_len));
 
 			//uwsgi_log("%.*s = %.*s\n", wsgi_req->hvec[i].iov_len, wsgi_req->hvec[i].iov_base, wsgi_req->hvec[i+1].iov_len, wsgi_req->hvec[i+1].iov_base);
@@ -864,53 +964,53 @@ int uwsgi_rack_request(struct wsgi_request *wsgi_req) {
 	VALUE rbv = rb_ary_new();
 	rb_ary_store(rbv, 0, INT2NUM(1));
 	rb_ary_store(rbv, 1, INT2NUM(1));
-	rb_hash_aset(env, rb_str_new2("rack.version"), rbv);
+	rb_hash_aset(env, rack_env_key2("rack.version"), rbv);
 
 	if (wsgi_req->scheme_len > 0) {
-		rb_hash_aset(env, rb_str_new2("rack.url_scheme"), rb_str_new(wsgi_req->scheme, wsgi_req->scheme_len));
+		rb_hash_aset(env, rack_env_key2("rack.url_scheme"), rb_str_new(wsgi_req->scheme, wsgi_req->scheme_len));
         }
         else if (wsgi_req->https_len > 0) {
                 if (!strncasecmp(wsgi_req->https, "on", 2) || wsgi_req->https[0] == '1') {
-			rb_hash_aset(env, rb_str_new2("rack.url_scheme"), rb_str_new2("https"));
+			rb_hash_aset(env, rack_env_key2("rack.url_scheme"), rb_str_new2("https"));
                 }
                 else {
-			rb_hash_aset(env, rb_str_new2("rack.url_scheme"), rb_str_new2("http"));
+			rb_hash_aset(env, rack_env_key2("rack.url_scheme"), rb_str_new2("http"));
                 }
         }
         else {
-		rb_hash_aset(env, rb_str_new2("rack.url_scheme"), rb_str_new2("http"));
+		rb_hash_aset(env, rack_env_key2("rack.url_scheme"), rb_str_new2("http"));
         }
 
 
 	if (uwsgi.threads > 1) {
-		rb_hash_aset(env, rb_str_new2("rack.multithread"), Qtrue);
+		rb_hash_aset(env, rack_env_key2("rack.multithread"), Qtrue);
 	}
 	else {
-		rb_hash_aset(env, rb_str_new2("rack.multithread"), Qfalse);
+		rb_hash_aset(env, rack_env_key2("rack.multithread"), Qfalse);
 	}
 
 	if (uwsgi.numproc > 1) {
-		rb_hash_aset(env, rb_str_new2("rack.multiprocess"), Qtrue);
+		rb_hash_aset(env, rack_env_key2("rack.multiprocess"), Qtrue);
 	}
 	else {
-		rb_hash_aset(env, rb_str_new2("rack.multiprocess"), Qfalse);
+		rb_hash_aset(env, rack_env_key2("rack.multiprocess"), Qfalse);
 	}
 
-	rb_hash_aset(env, rb_str_new2("rack.run_once"), Qfalse);
+	rb_hash_aset(env, rack_env_key2("rack.run_once"), Qfalse);
 
 	VALUE dws_wr = Data_Wrap_Struct(ur.rb_uwsgi_io_class, 0, 0, wsgi_req);
 
-	rb_hash_aset(env, rb_str_new2("rack.input"), rb_funcall(ur.rb_uwsgi_io_class, rb_intern("new"), 1, dws_wr ));
+	rb_hash_aset(env, rack_env_key2("rack.input"), rb_funcall(ur.rb_uwsgi_io_class, rb_intern("new"), 1, dws_wr ));
 
-	rb_hash_aset(env, rb_str_new2("rack.errors"), rb_funcall( rb_const_get(rb_cObject, rb_intern("IO")), rb_intern("new"), 2, INT2NUM(2), rb_str_new("w",1) ));
+	rb_hash_aset(env, rack_env_key2("rack.errors"), rb_funcall( rb_const_get(rb_cObject, rb_intern("IO")), rb_intern("new"), 2, INT2NUM(2), rb_str_new("w",1) ));
 
-	rb_hash_aset(env, rb_str_new2("uwsgi.core"), INT2NUM(wsgi_req->async_id));
-	rb_hash_aset(env, rb_str_new2("uwsgi.version"), rb_str_new2(UWSGI_VERSION));
-	rb_hash_aset(env, rb_str_new2("uwsgi.node"), rb_str_new2(uwsgi.hostname));
+	rb_hash_aset(env, rack_env_key2("uwsgi.core"), INT2NUM(wsgi_req->async_id));
+	rb_hash_aset(env, rack_env_key2("uwsgi.version"), rb_str_new2(UWSGI_VERSION));
+	rb_hash_aset(env, rack_env_key2("uwsgi.node"), rb_str_new2(uwsgi.hostname));
 
 	// remove HTTP_CONTENT_LENGTH and HTTP_CONTENT_TYPE
-	rb_hash_delete(env, rb_str_new2("HTTP_CONTENT_LENGTH"));
-	rb_hash_delete(env, rb_str_new2("HTTP_CONTENT_TYPE"));
+	rb_hash_delete(env, rack_env_key2("HTTP_CONTENT_LENGTH"));
+	rb_hash_delete(env, rack_env_key2("HTTP_CONTENT_TYPE"));
 
 	if (ur.unprotected) {
 		ret = call_dispatch(env);
@@ -950,30 +1050,40 @@ int uwsgi_rack_request(struct wsgi_request *wsgi_req) {
 
 		body = RARRAY_PTR(ret)[2] ;
 
-		if (rb_respond_to( body, rb_intern("to_path") )) {
-			VALUE sendfile_path = rb_protect( body_to_path, body, &error);
-			if (error) {
-				uwsgi_manage_exception(wsgi_req, uwsgi.catch_exceptions);
-			}
-			else {
-				int fd = open(RSTRING_PTR(sendfile_path), O_RDONLY);
-				if (fd < 0) goto clear;
-				// the following function will close the descriptor
-				uwsgi_response_sendfile_do(wsgi_req, fd, 0, 0);
-			}
+		if (rb_respond_to( body, rb_intern("to_path") ) && send_body_path(wsgi_req, body)) {
+			// already sent
 		}
-		else if (rb_respond_to( body, rb_intern("each") )) {
-			if (ur.unprotected) {
-				iterate_body(body);
-			}
-			else {
-				rb_protect( iterate_body, body, &error);
+		else {
+			// the object to iterate, can be the array returned by to_ary
+			VALUE chunks = body;
+			if (TYPE(body) != T_ARRAY && rb_respond_to( body, rb_intern("to_ary") )) {
+				VALUE ary = rb_protect( body_to_ary, body, &error);
 				if (error) {
 					uwsgi_manage_exception(wsgi_req, uwsgi.catch_exceptions);
+					goto body_close;
 				}
+				if (TYPE(ary) == T_ARRAY) chunks = ary;
+			}
+
+			if (TYPE(chunks) == T_ARRAY && send_body_array(wsgi_req, chunks)) {
+				// already sent
+			}
+			else if (rb_respond_to( chunks, rb_intern("each") )) {
+				if (ur.unprotected) {
+					iterate_body(chunks);
+				}
+				else {
+					rb_protect( iterate_body, chunks, &error);
+					if (error) {
+						uwsgi_manage_exception(wsgi_req, uwsgi.catch_exceptions);
+					}
+				}
+				rack_coalesce_flush(wsgi_req);
 			}
 		}
 
+body_close:
+
 		if (rb_respond_to( body, rb_intern("close") )) {
 			//uwsgi_log("calling close\n");
 			rb_protect( close_body, body, &error);
@@ -2,6 +2,10 @@
 
 #include <ruby.h>
 
+#ifdef RUBY19
+#include <ruby/version.h>
+#endif
+
 #ifndef RUBY19
 #include <st.h>
 #define rb_errinfo() ruby_errinfo
@@ -48,6 +52,10 @@ struct uwsgi_rack {
 
 	int unprotected;
 
+	int frozen_keys;
+	uint64_t coalesce;
+	struct uwsgi_buffer **coalesce_buffers;
+
 	struct uwsgi_string_list *rbrequire;
 	struct uwsgi_string_list *shared_rbrequire;
 	struct uwsgi_string_list *rvm_path;
@@ -11,10 +11,26 @@ extern struct uwsgi_server uwsgi;
  *
  *	--rados-mount mountpoint=/foo,pool=unbit001,config=/etc/ceph.conf,timeout=30,allow_put=1,allow_delete=1
  *
+ *	objects are read with up to read_parallel (--rados-read-parallel) outstanding aio reads of
+ *	read_chunk (--rados-read-chunk) bytes, the chunks are sent to the client in order as soon as
+ *	the head of the ring is completed (and the slot is reused for the next chunk).
+ *
+ *	ioctx=N opens N io contexts for the mountpoint (default: one for each thread), cores use them in round robin.
+ *
+ *	--rados-stat-cache <secs> caches (per-worker) the result of the stat of the objects (stat_cache=N for a single mountpoint),
+ *	PUT and DELETE invalidate the item.
+ *
  */
 
 struct uwsgi_plugin rados_plugin;
 
+// a slot of the read ring
+struct uwsgi_rados_chunk {
+	char *buf;
+	size_t len;
+	rados_completion_t comp;
+};
+
 // this structure is preallocated (only the pipe part is per-request)
 struct uwsgi_rados_io {
 	int fds[2];
@@ -22,6 +38,17 @@ struct uwsgi_rados_io {
 	uint64_t rid;
 	pthread_mutex_t mutex;
 	rados_completion_t comp;
+	// the buffers are allocated on first usage and reused
+	struct uwsgi_rados_chunk *chunks;
+};
+
+struct uwsgi_rados_stat_item {
+	char *key;
+	size_t key_len;
+	int app_id;
+	uint64_t size;
+	time_t mtime;
+	uint64_t expires;
 };
 
 // this structure is allocated for each async transaction
@@ -35,6 +62,15 @@ static struct uwsgi_rados {
 	int timeout;
 	struct uwsgi_string_list *mountpoints;
 	struct uwsgi_rados_io *urio;
+	int read_parallel;
+	uint64_t read_chunk;
+	// the biggest values of the mountpoints (used for the allocation of the ring)
+	int max_read_parallel;
+	uint64_t max_read_chunk;
+	int stat_cache;
+	uint64_t stat_cache_items;
+	struct uwsgi_rados_stat_item *stat_cache_table;
+	pthread_mutex_t stat_cache_lock;
 } urados;
 
 struct uwsgi_rados_mountpoint {
@@ -48,11 +84,24 @@ struct uwsgi_rados_mountpoint {
 	char *allow_delete;
 	char *allow_mkcol;
 	char *allow_propfind;
+	char *str_ioctx;
+	char *str_read_parallel;
+	char *str_read_chunk;
+	char *str_stat_cache;
+	rados_ioctx_t *ctxes;
+	int ioctx;
+	int read_parallel;
+	uint64_t read_chunk;
+	int stat_cache;
 };
 
 static struct uwsgi_option uwsgi_rados_options[] = {
 	{"rados-mount", required_argument, 0, "virtual mount the specified rados volume in a uri", uwsgi_opt_add_string_list, &urados.mountpoints, UWSGI_OPT_MIME},
 	{"rados-timeout", required_argument, 0, "timeout for async operations", uwsgi_opt_set_int, &urados.timeout, 0},
+	{"rados-read-parallel", required_argument, 0, "set the number of outstanding reads for each request (default 4)", uwsgi_opt_set_int, &urados.read_parallel, 0},
+	{"rados-read-chunk", required_argument, 0, "set the size of each read (default 256k, every core allocates read-parallel buffers of this size)", uwsgi_opt_set_64bit, &urados.read_chunk, 0},
+	{"rados-stat-cache", required_argument, 0, "cache the stat of the objects for the specified number of seconds", uwsgi_opt_set_int, &urados.stat_cache, 0},
+	{"rados-stat-cache-items", required_argument, 0, "set the max number of items of the stat cache (default 1024)", uwsgi_opt_set_64bit, &urados.stat_cache_items, 0},
 	{0, 0, 0, 0, 0, 0, 0},
 };
 
@@ -184,36 +233,184 @@ static int uwsgi_rados_async_stat(int async_id, rados_ioctx_t ctx, const char *k
 		urcb, timeout);
 }
 
-static int uwsgi_rados_read(struct wsgi_request *wsgi_req, rados_ioctx_t ctx, const char *key, size_t remains, int timeout) {
-	uint64_t off = 0;
-	char buf[8192];
+// direct mapped, a new item simply replaces the old one
+static struct uwsgi_rados_stat_item *uwsgi_rados_stat_cache_slot(int app_id, const char *key, size_t key_len) {
+	uint32_t hash = djb33x_hash((char *) key, key_len) ^ app_id;
+	return &urados.stat_cache_table[hash % urados.stat_cache_items];
+}
+
+static int uwsgi_rados_stat_cache_get(int app_id, const char *key, uint64_t *stat_size, time_t *stat_mtime) {
+	size_t key_len = strlen(key);
+	int ret = -1;
+	pthread_mutex_lock(&urados.stat_cache_lock);
+	struct uwsgi_rados_stat_item *item = uwsgi_rados_stat_cache_slot(app_id, key, key_len);
+	if (item->key && item->app_id == app_id && !uwsgi_strncmp(item->key, item->key_len, (char *) key, key_len) && item->expires > (uint64_t) uwsgi_now()) {
+		*stat_size = item->size;
+		*stat_mtime = item->mtime;
+		ret = 0;
+	}
+	pthread_mutex_unlock(&urados.stat_cache_lock);
+	return ret;
+}
+
+static void uwsgi_rados_stat_cache_set(struct uwsgi_rados_mountpoint *urmp, int app_id, const char *key, uint64_t stat_size, time_t stat_mtime) {
+	size_t key_len = strlen(key);
+	pthread_mutex_lock(&urados.stat_cache_lock);
+	struct uwsgi_rados_stat_item *item = uwsgi_rados_stat_cache_slot(app_id, key, key_len);
+	if (!item->key || item->app_id != app_id || uwsgi_strncmp(item->key, item->key_len, (char *) key, key_len)) {
+		free(item->key);
+		item->key = uwsgi_strncopy((char *) key, key_len);
+		item->key_len = key_len;
+		item->app_id = app_id;
+	}
+	item->size = stat_size;
+	item->mtime = stat_mtime;
+	item->expires = uwsgi_now() + urmp->stat_cache;
+	pthread_mutex_unlock(&urados.stat_cache_lock);
+}
+
+static void uwsgi_rados_stat_cache_del(int app_id, const char *key) {
+	if (!urados.stat_cache_table) return;
+	size_t key_len = strlen(key);
+	pthread_mutex_lock(&urados.stat_cache_lock);
+	struct uwsgi_rados_stat_item *item = uwsgi_rados_stat_cache_slot(app_id, key, key_len);
+	if (item->key && item->app_id == app_id && !uwsgi_strncmp(item->key, item->key_len, (char *) key, key_len)) {
+		item->expires = 0;
+	}
+	pthread_mutex_unlock(&urados.stat_cache_lock);
+}
+
+static int uwsgi_rados_stat(struct wsgi_request *wsgi_req, struct uwsgi_rados_mountpoint *urmp, rados_ioctx_t ctx, const char *key, uint64_t *stat_size, time_t *stat_mtime, int timeout, int use_cache) {
+	use_cache = use_cache && urmp->stat_cache > 0 && urados.stat_cache_table;
+	if (use_cache && !uwsgi_rados_stat_cache_get(wsgi_req->app_id, key, stat_size, stat_mtime)) {
+		return 0;
+	}
+
+	int ret;
+	if (uwsgi.async > 0) {
+		ret = uwsgi_rados_async_stat(wsgi_req->async_id, ctx, key, stat_size, stat_mtime, timeout);
+	}
+	else {
+		ret = rados_stat(ctx, key, stat_size, stat_mtime);
+	}
+
+	if (ret == 0 && use_cache) {
+		uwsgi_rados_stat_cache_set(urmp, wsgi_req->app_id, key, *stat_size, *stat_mtime);
+	}
+	return ret;
+}
+
+static int uwsgi_rados_read_chunk(struct uwsgi_rados_io *urio, struct uwsgi_rados_chunk *c, uint64_t rid, rados_ioctx_t ctx, const char *key, size_t len, uint64_t off) {
+	struct uwsgi_rados_cb *urcb = NULL;
+	c->len = len;
+	if (uwsgi.async > 0) {
+		urcb = uwsgi_malloc(sizeof(struct uwsgi_rados_cb));
+		urcb->rid = rid;
+		urcb->urio = urio;
+		if (rados_aio_create_completion(urcb, NULL, uwsgi_rados_async_cb, &c->comp) < 0) {
+			free(urcb);
+			c->comp = NULL;
+			return -1;
+		}
+	}
+	else if (rados_aio_create_completion(NULL, NULL, NULL, &c->comp) < 0) {
+		c->comp = NULL;
+		return -1;
+	}
+
+	if (rados_aio_read(ctx, key, c->comp, c->buf, len, off) < 0) {
+		// the callback will never run
+		rados_aio_release(c->comp);
+		c->comp = NULL;
+		free(urcb);
+		return -1;
+	}
+	return 0;
+}
 
+static int uwsgi_rados_wait_chunk(struct uwsgi_rados_io *urio, struct uwsgi_rados_chunk *c, int timeout) {
 	if (uwsgi.async < 1) {
-		while(remains > 0) {
-			int rlen = rados_read(ctx, key, buf, UMIN(remains, 8192), off);
-			if (rlen <= 0) return -1;
-			if (uwsgi_response_write_body_do(wsgi_req, buf, rlen)) return -1;
-			remains -= rlen;
-			off += rlen;
+		rados_aio_wait_for_complete(c->comp);
+	}
+	else {
+		// every callback writes a byte in the pipe, but completions have to be consumed in order
+		while (!rados_aio_is_safe_and_cb(c->comp)) {
+			char acks[64];
+			if (uwsgi.wait_read_hook(urio->fds[0], timeout) <= 0) return -1;
+			if (read(urio->fds[0], acks, UMIN(urados.max_read_parallel, 64)) <= 0) {
+				uwsgi_error("uwsgi_rados_wait_chunk()/read()");
+				return -1;
+			}
 		}
-		return 0;
 	}
+	int ret = rados_aio_get_return_value(c->comp);
+	rados_aio_release(c->comp);
+	c->comp = NULL;
+	return ret;
+}
 
-	while(remains > 0) {
-		struct uwsgi_rados_cb *urcb = uwsgi_rados_set_completion(wsgi_req->async_id);
-		int rlen = uwsgi_rados_wait_completion(
-				rados_aio_read(ctx, key, urcb->urio->comp, buf, UMIN(remains, 8192), off),
-				urcb, timeout);
+static int uwsgi_rados_read(struct wsgi_request *wsgi_req, struct uwsgi_rados_mountpoint *urmp, rados_ioctx_t ctx, const char *key, size_t total, int timeout) {
+	struct uwsgi_rados_io *urio = &urados.urio[wsgi_req->async_id];
+	int n = urmp->read_parallel;
+	size_t chunk = urmp->read_chunk;
+	int i;
 
-		if (rlen <= 0) break;
-		if (uwsgi_response_write_body_do(wsgi_req, buf, rlen)) break;
-		remains -= rlen;
-		off += rlen;
+	if (!urio->chunks) {
+		urio->chunks = uwsgi_calloc(sizeof(struct uwsgi_rados_chunk) * urados.max_read_parallel);
+	}
+	// do not allocate the whole ring for small objects
+	for (i = 0; i < n && (uint64_t) i * chunk < total; i++) {
+		if (!urio->chunks[i].buf) urio->chunks[i].buf = uwsgi_malloc(urados.max_read_chunk);
+	}
+
+	uint64_t rid = 0;
+	if (uwsgi.async > 0) {
+		pthread_mutex_lock(&urio->mutex);
+		rid = ++urio->rid;
+		pthread_mutex_unlock(&urio->mutex);
 	}
-	return (remains == 0) ? 0 : -1;
+
+	// the next offset to request
+	uint64_t off = 0;
+	uint64_t sent = 0;
+	int head = 0;
+	// fill the ring
+	for (i = 0; i < n && off < total; i++) {
+		size_t len = UMIN(chunk, total - off);
+		if (uwsgi_rados_read_chunk(urio, &urio->chunks[i], rid, ctx, key, len, off)) goto drain;
+		off += len;
+	}
+
+	while (sent < total) {
+		struct uwsgi_rados_chunk *c = &urio->chunks[head];
+		int rlen = uwsgi_rados_wait_chunk(urio, c, timeout);
+		// short reads (the object has been truncated) are errors too
+		if (rlen <= 0 || (size_t) rlen != c->len) goto drain;
+		if (uwsgi_response_write_body_do(wsgi_req, c->buf, rlen)) goto drain;
+		sent += rlen;
+		// reuse the slot for the next chunk
+		if (off < total) {
+			size_t len = UMIN(chunk, total - off);
+			if (uwsgi_rados_read_chunk(urio, c, rid, ctx, key, len, off)) goto drain;
+			off += len;
+		}
+		head = (head + 1) % n;
+	}
+	return 0;
+
+drain:
+	// the buffers of the outstanding reads cannot be reused until they are completed
+	for (i = 0; i < n; i++) {
+		if (urio->chunks[i].comp) {
+			rados_aio_wait_for_complete(urio->chunks[i].comp);
+			rados_aio_release(urio->chunks[i].comp);
+			urio->chunks[i].comp = NULL;
+		}
+	}
+	return -1;
 }
 
-static void uwsgi_rados_propfind(struct wsgi_request *wsgi_req, rados_ioctx_t ctx, char *key, uint64_t size, time_t mtime, int timeout) {
+static void uwsgi_rados_propfind(struct wsgi_request *wsgi_req, struct uwsgi_rados_mountpoint *urmp, rados_ioctx_t ctx, char *key, uint64_t size, time_t mtime, int timeout) {
 	// consume the body
 	size_t remains = wsgi_req->post_cl;
 	while(remains > 0) {
@@ -266,12 +463,7 @@ static void uwsgi_rados_propfind(struct wsgi_request *wsgi_req, rados_ioctx_t ct
 	while(rados_objects_list_next(ctx_list, (const char **)&entry, NULL) == 0) {
 		uint64_t stat_size = 0;
 		time_t stat_mtime = 0;
-		if (uwsgi.async > 0) {
-			if (uwsgi_rados_async_stat(wsgi_req->async_id, ctx, entry, &stat_size, &stat_mtime, timeout) < 0) goto end;
-		}
-		else {
-			if (rados_stat(ctx, entry, &stat_size, &stat_mtime) < 0) goto end;
-		}
+		if (uwsgi_rados_stat(wsgi_req, urmp, ctx, entry, &stat_size, &stat_mtime, timeout, 1) < 0) goto end;
 
 		size_t mime_type_len = 0;
 		char *mime_type = uwsgi_get_mime_type(entry, strlen(entry), &mime_type_len);
@@ -304,6 +496,10 @@ static void uwsgi_rados_add_mountpoint(char *arg, size_t arg_len) {
 		"allow_delete", &urmp->allow_delete,
 		"allow_mkcol", &urmp->allow_mkcol,
 		"allow_propfind", &urmp->allow_propfind,
+		"ioctx", &urmp->str_ioctx,
+		"read_parallel", &urmp->str_read_parallel,
+		"read_chunk", &urmp->str_read_chunk,
+		"stat_cache", &urmp->str_stat_cache,
 		NULL)
 	) {
 		uwsgi_log("unable to parse rados mountpoint definition\n");
@@ -319,6 +515,17 @@ static void uwsgi_rados_add_mountpoint(char *arg, size_t arg_len) {
 		urmp->timeout = atoi(urmp->str_timeout);
 	}
 
+	urmp->ioctx = urmp->str_ioctx ? atoi(urmp->str_ioctx) : uwsgi.threads;
+	urmp->read_parallel = urmp->str_read_parallel ? atoi(urmp->str_read_parallel) : urados.read_parallel;
+	urmp->read_chunk = urmp->str_read_chunk ? uwsgi_n64(urmp->str_read_chunk) : urados.read_chunk;
+	urmp->stat_cache = urmp->str_stat_cache ? atoi(urmp->str_stat_cache) : urados.stat_cache;
+	if (urmp->ioctx < 1 || urmp->read_parallel < 1 || urmp->read_chunk < 1) {
+		uwsgi_log("[rados] invalid ioctx/read_parallel/read_chunk values for %s\n", urmp->mountpoint);
+		exit(1);
+	}
+	if (urmp->read_parallel > urados.max_read_parallel) urados.max_read_parallel = urmp->read_parallel;
+	if (urmp->read_chunk > urados.max_read_chunk) urados.max_read_chunk = urmp->read_chunk;
+
 	time_t now = uwsgi_now();
 	uwsgi_log("[rados] mounting %s ...\n", urmp->mountpoint);
 
@@ -353,28 +560,17 @@ static void uwsgi_rados_add_mountpoint(char *arg, size_t arg_len) {
 		exit(1);
 	}
 
-	void *ctx_ptr;
-
-	if (uwsgi.threads > 1) {
-		int i;
-		rados_ioctx_t *ctxes = uwsgi_calloc(sizeof(rados_ioctx_t) * uwsgi.threads);
-		for(i=0;i<uwsgi.threads;i++) {
-			if (rados_ioctx_create(cluster, urmp->pool, &ctxes[i]) < 0) {
-				uwsgi_error("can't open rados pool")
-				rados_shutdown(cluster);
-				exit(1);
-			}
-		}
-		ctx_ptr = ctxes;
-	} else {
-		rados_ioctx_t ctx;
-		if (rados_ioctx_create(cluster, urmp->pool, &ctx) < 0) {
+	// the pool of io contexts, cores map to them in round robin
+	int i;
+	urmp->ctxes = uwsgi_calloc(sizeof(rados_ioctx_t) * urmp->ioctx);
+	for(i=0;i<urmp->ioctx;i++) {
+		if (rados_ioctx_create(cluster, urmp->pool, &urmp->ctxes[i]) < 0) {
 			uwsgi_error("can't open rados pool")
 			rados_shutdown(cluster);
 			exit(1);
 		}
-		ctx_ptr = ctx;
 	}
+	void *ctx_ptr = urmp->ctxes;
 
 	char fsid[37];
 	rados_cluster_fsid(cluster, fsid, 37);
@@ -392,7 +588,8 @@ static void uwsgi_rados_add_mountpoint(char *arg, size_t arg_len) {
 	ua->responder1 = urmp;
 	ua->started_at = now;
 	ua->startup_time = uwsgi_now() - now;
-	uwsgi_log("Rados app/mountpoint %d (%s) loaded in %d seconds at %p\n", id, urmp->mountpoint, (int) ua->startup_time, ctx_ptr);
+	uwsgi_log("Rados app/mountpoint %d (%s) loaded in %d seconds at %p (%d io contexts, %d x %llu bytes reads)\n", id, urmp->mountpoint, (int) ua->startup_time, ctx_ptr,
+		urmp->ioctx, urmp->read_parallel, (unsigned long long) urmp->read_chunk);
 }
 
 // we translate the string list to an app representation
@@ -401,6 +598,9 @@ static void uwsgi_rados_setup() {
 	if (!urados.timeout) {
 		urados.timeout = uwsgi.socket_timeout;
 	}
+	if (!urados.read_parallel) urados.read_parallel = 4;
+	if (!urados.read_chunk) urados.read_chunk = 256 * 1024;
+	if (!urados.stat_cache_items) urados.stat_cache_items = 1024;
 
 	struct uwsgi_string_list *usl = urados.mountpoints;
 	while(usl) {
@@ -408,17 +608,30 @@ static void uwsgi_rados_setup() {
 		usl = usl->next;
 	}
 
-	// now initialize a pthread_mutex for each async core
-	if (uwsgi.async > 0) {
-		int i;
-		urados.urio = uwsgi_calloc(sizeof(struct uwsgi_rados_io) * uwsgi.async);
-		for(i=0;i<uwsgi.async;i++) {
-			urados.urio[i].fds[0] = -1;
-			urados.urio[i].fds[1] = -1;
-			if (pthread_mutex_init(&urados.urio[i].mutex, NULL)) {
-				uwsgi_error("uwsgi_rados_setup()/pthread_mutex_init()");
-				exit(1);
-			}
+	// now initialize a pthread_mutex for each core (the read ring is per-core in every mode)
+	int i;
+	urados.urio = uwsgi_calloc(sizeof(struct uwsgi_rados_io) * uwsgi.cores);
+	for(i=0;i<uwsgi.cores;i++) {
+		urados.urio[i].fds[0] = -1;
+		urados.urio[i].fds[1] = -1;
+		if (pthread_mutex_init(&urados.urio[i].mutex, NULL)) {
+			uwsgi_error("uwsgi_rados_setup()/pthread_mutex_init()");
+			exit(1);
+		}
+	}
+
+	// the stat cache is allocated only if a mountpoint uses it
+	int need_stat_cache = 0;
+	for(i=0;i<uwsgi_apps_cnt;i++) {
+		if (uwsgi_apps[i].modifier1 != rados_plugin.modifier1) continue;
+		struct uwsgi_rados_mountpoint *urmp = (struct uwsgi_rados_mountpoint *) uwsgi_apps[i].responder1;
+		if (urmp->stat_cache > 0) need_stat_cache = 1;
+	}
+	if (need_stat_cache) {
+		urados.stat_cache_table = uwsgi_calloc(sizeof(struct uwsgi_rados_stat_item) * urados.stat_cache_items);
+		if (pthread_mutex_init(&urados.stat_cache_lock, NULL)) {
+			uwsgi_error("uwsgi_rados_setup()/pthread_mutex_init()");
+			exit(1);
 		}
 	}
 
@@ -465,15 +678,8 @@ static int uwsgi_rados_request(struct wsgi_request *wsgi_req) {
 		filename[wsgi_req->path_info_len] = 0;
 	}
 
-	// in multithread mode the memory is different (as we need a ctx for each thread) !!!
-	rados_ioctx_t ctx;
-	if (uwsgi.threads > 1) {
-		rados_ioctx_t *ctxes = (rados_ioctx_t *) ua->responder0;
-		ctx = ctxes[wsgi_req->async_id];
-	} else {
-		ctx = (rados_ioctx_t) ua->responder0;
-	}
 	struct uwsgi_rados_mountpoint *urmp = (struct uwsgi_rados_mountpoint *) ua->responder1;
+	rados_ioctx_t ctx = urmp->ctxes[wsgi_req->async_id % urmp->ioctx];
 	uint64_t stat_size = 0;
 	time_t stat_mtime = 0;
 
@@ -532,7 +738,7 @@ static int uwsgi_rados_request(struct wsgi_request *wsgi_req) {
 	// empty paths are mapped to propfind
 	if (wsgi_req->path_info_len == 1 && wsgi_req->path_info[0] == '/') {
 		if (urmp->allow_propfind && !uwsgi_strncmp(wsgi_req->method, wsgi_req->method_len, "PROPFIND", 8)) {
-			uwsgi_rados_propfind(wsgi_req, ctx, NULL, 0, 0, timeout);
+			uwsgi_rados_propfind(wsgi_req, urmp, ctx, NULL, 0, 0, timeout);
 			goto end;
 		}
 		uwsgi_405(wsgi_req);
@@ -558,10 +764,11 @@ static int uwsgi_rados_request(struct wsgi_request *wsgi_req) {
 		goto end;
 	}
 
-	if (uwsgi.async > 0) {
-		ret = uwsgi_rados_async_stat(wsgi_req->async_id, ctx, filename, &stat_size, &stat_mtime, timeout);
-	} else {
-		ret = rados_stat(ctx, filename, &stat_size, &stat_mtime);
+	// PUT and DELETE always need a fresh stat
+	int writing = !uwsgi_strncmp(wsgi_req->method, wsgi_req->method_len, "PUT", 3) || !uwsgi_strncmp(wsgi_req->method, wsgi_req->method_len, "DELETE", 6);
+	ret = uwsgi_rados_stat(wsgi_req, urmp, ctx, filename, &stat_size, &stat_mtime, timeout, !writing);
+	if (writing) {
+		uwsgi_rados_stat_cache_del(wsgi_req->app_id, filename);
 	}
 
 	// PUT AND MKCOL can be used for non-existent objects
@@ -620,7 +827,7 @@ static int uwsgi_rados_request(struct wsgi_request *wsgi_req) {
 			uwsgi_405(wsgi_req);
 			goto end;
 		}
-		uwsgi_rados_propfind(wsgi_req, ctx, filename, stat_size, stat_mtime, timeout);
+		uwsgi_rados_propfind(wsgi_req, urmp, ctx, filename, stat_size, stat_mtime, timeout);
 		goto end;
 	}
 
@@ -642,13 +849,19 @@ static int uwsgi_rados_request(struct wsgi_request *wsgi_req) {
 	// skip body on HEAD
 	if (uwsgi_strncmp(wsgi_req->method, wsgi_req->method_len, "HEAD", 4)) {
 		size_t remains = stat_size;
-		if (uwsgi_rados_read(wsgi_req, ctx, filename, remains, timeout)) goto end;
+		if (uwsgi_rados_read(wsgi_req, urmp, ctx, filename, remains, timeout)) goto end;
 	}
 
 end:
 	if (uwsgi.async > 0) {
+		// late callbacks must not write to the closed pipe
+		pthread_mutex_lock(&urio->mutex);
+		urio->rid++;
 		close(urio->fds[0]);
 		close(urio->fds[1]);
+		urio->fds[0] = -1;
+		urio->fds[1] = -1;
+		pthread_mutex_unlock(&urio->mutex);
 	}
 	return UWSGI_OK;
 }
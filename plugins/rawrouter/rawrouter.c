@@ -27,6 +27,8 @@ struct rawrouter_session {
 static struct uwsgi_option rawrouter_options[] = {
 	{"rawrouter", required_argument, 0, "run the rawrouter on the specified port", uwsgi_opt_undeferred_corerouter, &urr, 0},
 	{"rawrouter-processes", required_argument, 0, "prefork the specified number of rawrouter processes", uwsgi_opt_set_int, &urr.cr.processes, 0},
+	{"rawrouter-reuse-port", no_argument, 0, "give each rawrouter process its own SO_REUSEPORT listener", uwsgi_opt_true, &urr.cr.reuse_port, 0},
+	{"rawrouter-prealloc", required_argument, 0, "preallocate the specified number of sessions (with their peers and buffers) in each rawrouter process", uwsgi_opt_set_64bit, &urr.cr.prealloc, 0},
 	{"rawrouter-workers", required_argument, 0, "prefork the specified number of rawrouter processes", uwsgi_opt_set_int, &urr.cr.processes, 0},
 	{"rawrouter-zerg", required_argument, 0, "attach the rawrouter to a zerg server", uwsgi_opt_corerouter_zerg, &urr, 0},
 	{"rawrouter-use-cache", optional_argument, 0, "use uWSGI cache as hostname->server mapper for the rawrouter", uwsgi_opt_set_str, &urr.cr.use_cache, 0},
@@ -57,6 +59,9 @@ static struct uwsgi_option rawrouter_options[] = {
 	{"rawrouter-xclient", no_argument, 0, "use the xclient protocol to pass the client addres", uwsgi_opt_true, &urr.xclient, 0},
 
 	{"rawrouter-buffer-size", required_argument, 0, "set internal buffer size (default: page size)", uwsgi_opt_set_64bit, &urr.cr.buffer_size, 0},
+	{"rawrouter-splice", no_argument, 0, "forward the streams with splice() without copying them in user space (Linux only)", uwsgi_opt_true, &urr.cr.splice, 0},
+	{"rawrouter-batch-events", no_argument, 0, "apply the changes of the rawrouter event interests in a batch before waiting (epoll only)", uwsgi_opt_true, &urr.cr.defer_events, 0},
+	{"rawrouter-edge-triggered", no_argument, 0, "use edge-triggered events for the rawrouter peers (epoll only, implies batched events)", uwsgi_opt_true, &urr.cr.edge_triggered, 0},
 
 	{0, 0, 0, 0, 0, 0, 0},
 };
@@ -173,6 +178,11 @@ static ssize_t rr_instance_connected(struct corerouter_peer *peer) {
 		cr_reset_hooks_and_read(peer, rr_xclient_read);
 		return 1;
 	}
+	if (urr.cr.splice && !uwsgi_cr_splice_init(cs->main_peer) && !uwsgi_cr_splice_init(peer)) {
+		cs->main_peer->last_hook_read = uwsgi_cr_splice_read;
+		cr_reset_hooks_and_read(peer, uwsgi_cr_splice_read);
+		return 1;
+	}
 	cr_reset_hooks_and_read(peer, rr_instance_read);
 	return 1;
 }
@@ -12,6 +12,34 @@ extern struct uwsgi_server uwsgi;
 
 	route = /^foobar1(.*)/ cache:key=foo$1poo,content_type=text/html,name=foobar
 
+	single-flight (only one request regenerates a missing key, the others wait for it):
+
+	route = /^foobar1(.*)/ cache:key=foo$1poo,singleflight=500
+	route = /^foobar1(.*)/ cachestore:key=foo$1poo,expires=60,stale=30
+
+	the first miss takes the "<key>@inflight" marker (released at the end of the request),
+	the other ones are served the "<key>@stale" copy (if available) or poll the cache
+	for up to singleflight milliseconds before falling back to the app
+
+	stale-while-revalidate and stale-if-error:
+
+	route = /^foobar1(.*)/ cache:key=foo$1poo,stale=30
+	error-route-status = 502 cache:key=foo$1poo,stale=30
+
+	after the item expires a single request (holding the marker for up to stale seconds)
+	refreshes it while all of the others get the stale copy; when used as an error route
+	the stale copy replaces the failed response of the refresher
+
+	variants (one canonical body, ETag and lazily compressed copies):
+
+	route = /^foobar1(.*)/ cache:key=foo$1poo,variants=1
+	route = /^foobar1(.*)/ cachestore:key=foo$1poo,variants=1
+
+	cachestore refuses responses varying on anything but Accept-Encoding and stores the etag
+	(the one of the app or a hash of the body) in "<key>@etag". cache answers If-None-Match with
+	a 304 straight from it, and builds the gzip copy on the first request accepting it
+	("<key>@gzip@<etag>", so an updated body never gets an old compressed copy)
+
 */
 
 struct uwsgi_router_cache_conf {
@@ -59,6 +87,20 @@ struct uwsgi_router_cache_conf {
 	char *no_offload;
 
 	char *no_cl;
+
+	char *singleflight_str;
+	uint64_t singleflight;
+
+	char *stale_str;
+	uint64_t stale;
+
+	char *variants;
+};
+
+// the in-flight marker owned by the single-flight leader
+struct uwsgi_router_cache_inflight {
+	struct uwsgi_buffer *marker;
+	char *name;
 };
 
 // this is allocated for each transformation
@@ -73,8 +115,66 @@ struct uwsgi_transformation_cache_conf {
 
         struct uwsgi_buffer *cache_it_to;
         uint64_t cache_it_expires;
+	uint64_t stale;
+	int variants;
 };
 
+// find a response header (the header block is made of "Key: value\r\n" lines)
+static char *router_cache_response_header(struct wsgi_request *wsgi_req, char *key, size_t keylen, size_t *vallen) {
+	if (!wsgi_req->headers) return NULL;
+	char *p = wsgi_req->headers->buf;
+	char *end = p + wsgi_req->headers->pos;
+	while (p < end) {
+		char *eol = memchr(p, '\n', end - p);
+		if (!eol) eol = end;
+		if ((size_t) (eol - p) > keylen && p[keylen] == ':' && !uwsgi_strnicmp(p, keylen, key, keylen)) {
+			char *value = p + keylen + 1;
+			while (value < eol && *value == ' ') value++;
+			char *value_end = eol;
+			if (value_end > value && value_end[-1] == '\r') value_end--;
+			*vallen = value_end - value;
+			return value;
+		}
+		p = eol + 1;
+	}
+	return NULL;
+}
+
+// a body varying on something else than the encoding cannot be shared by a single key
+static int router_cache_vary_ok(struct wsgi_request *wsgi_req) {
+	size_t len = 0;
+	char *vary = router_cache_response_header(wsgi_req, "Vary", 4, &len);
+	if (!vary) return 1;
+	char *p = vary, *end = vary + len;
+	while (p < end) {
+		char *item_end = memchr(p, ',', end - p);
+		if (!item_end) item_end = end;
+		while (p < item_end && (*p == ' ' || *p == '\t')) p++;
+		char *token_end = item_end;
+		while (token_end > p && (token_end[-1] == ' ' || token_end[-1] == '\t')) token_end--;
+		if (token_end > p && uwsgi_strnicmp(p, token_end - p, "Accept-Encoding", 15)) return 0;
+		p = item_end + 1;
+	}
+	return 1;
+}
+
+// If-None-Match could be "*" or a list of (weak) etags
+static int router_cache_etag_match(char *inm, uint16_t inm_len, char *etag, uint64_t etag_len) {
+	char *p = inm, *end = inm + inm_len;
+	while (p < end) {
+		char *item_end = memchr(p, ',', end - p);
+		if (!item_end) item_end = end;
+		while (p < item_end && (*p == ' ' || *p == '\t')) p++;
+		if (item_end - p >= 2 && p[0] == 'W' && p[1] == '/') p += 2;
+		char *token_end = item_end;
+		while (token_end > p && (token_end[-1] == ' ' || token_end[-1] == '\t')) token_end--;
+		if (token_end - p == 1 && *p == '*') return 1;
+		if (!uwsgi_strncmp(p, token_end - p, etag, etag_len)) return 1;
+		p = item_end + 1;
+	}
+	return 0;
+}
+
 static int transform_cache(struct wsgi_request *wsgi_req, struct uwsgi_transformation *ut) {
 	struct uwsgi_transformation_cache_conf *utcc = (struct uwsgi_transformation_cache_conf *) ut->data;
 	struct uwsgi_buffer *ub = ut->chunk;
@@ -84,9 +184,35 @@ static int transform_cache(struct wsgi_request *wsgi_req, struct uwsgi_transform
 	}
 	// store only successfull response
 	if (wsgi_req->write_errors == 0 && (wsgi_req->status == 200 || (utcc->status && wsgi_req->status == utcc->status))  && ub->pos > 0) {
+		if (utcc->variants && !router_cache_vary_ok(wsgi_req)) goto end;
 		if (utcc->cache_it) {
 			uwsgi_cache_magic_set(utcc->cache_it->buf, utcc->cache_it->pos, ub->buf, ub->pos, utcc->cache_it_expires,
 				UWSGI_CACHE_FLAG_UPDATE, utcc->cache_it_to ? utcc->cache_it_to->buf : NULL);
+			if (utcc->variants) {
+				char etag[64];
+				size_t etag_len = 0;
+				char *app_etag = router_cache_response_header(wsgi_req, "ETag", 4, &etag_len);
+				if (!app_etag || etag_len > sizeof(etag)) {
+					int ret = snprintf(etag, sizeof(etag), "\"%x-%llx\"", djb33x_hash(ub->buf, ub->pos), (unsigned long long) ub->pos);
+					etag_len = ret > 0 ? ret : 0;
+				}
+				else {
+					memcpy(etag, app_etag, etag_len);
+				}
+				size_t key_len = utcc->cache_it->pos;
+				if (etag_len && !uwsgi_buffer_append(utcc->cache_it, "@etag", 5)) {
+					uwsgi_cache_magic_set(utcc->cache_it->buf, utcc->cache_it->pos, etag, etag_len, utcc->cache_it_expires,
+						UWSGI_CACHE_FLAG_UPDATE, utcc->cache_it_to ? utcc->cache_it_to->buf : NULL);
+				}
+				utcc->cache_it->pos = key_len;
+			}
+			// the stale copy outlives the item, so single-flight waiters always have something to serve
+			if (utcc->stale && utcc->cache_it_expires) {
+				if (!uwsgi_buffer_append(utcc->cache_it, "@stale", 6)) {
+					uwsgi_cache_magic_set(utcc->cache_it->buf, utcc->cache_it->pos, ub->buf, ub->pos, utcc->cache_it_expires + utcc->stale,
+						UWSGI_CACHE_FLAG_UPDATE, utcc->cache_it_to ? utcc->cache_it_to->buf : NULL);
+				}
+			}
 #ifdef UWSGI_ZLIB
 			if (utcc->cache_it_gzip) {
 				struct uwsgi_buffer *gzipped = uwsgi_gzip(ub->buf, ub->pos);
@@ -100,6 +226,7 @@ static int transform_cache(struct wsgi_request *wsgi_req, struct uwsgi_transform
 		}
 	}
 
+end:
 	// free resources
 	if (utcc->cache_it) uwsgi_buffer_destroy(utcc->cache_it);
 #ifdef UWSGI_ZLIB
@@ -144,6 +271,8 @@ static int uwsgi_routing_func_cache_store(struct wsgi_request *wsgi_req, struct
 	}
 #endif
 	utcc->cache_it_expires = urcc->expires;
+	utcc->stale = urcc->stale;
+	utcc->variants = urcc->variants ? 1 : 0;
 
 	uwsgi_add_transformation(wsgi_req, transform_cache, utcc);
 
@@ -159,6 +288,119 @@ error:
 	return UWSGI_ROUTE_NEXT;
 }
 
+static int transform_cache_inflight(struct wsgi_request *wsgi_req, struct uwsgi_transformation *ut) {
+	return 0;
+}
+
+static void transform_cache_inflight_free(struct uwsgi_transformation *ut) {
+	struct uwsgi_router_cache_inflight *urci = (struct uwsgi_router_cache_inflight *) ut->data;
+	uwsgi_cache_magic_del(urci->marker->buf, urci->marker->pos, urci->name);
+	uwsgi_buffer_destroy(urci->marker);
+	free(urci);
+}
+
+// try to become the single-flight leader of a missing key (1 on success)
+static int router_cache_singleflight_lead(struct wsgi_request *wsgi_req, struct uwsgi_router_cache_conf *urcc, struct uwsgi_buffer *ub) {
+	struct uwsgi_buffer *marker = uwsgi_buffer_new(ub->pos + 9);
+	if (uwsgi_buffer_append(marker, ub->buf, ub->pos)) goto end;
+	if (uwsgi_buffer_append(marker, "@inflight", 9)) goto end;
+	// the marker expires by itself, a crashed leader cannot block the key forever
+	uint64_t marker_expires = urcc->stale ? urcc->stale : (urcc->singleflight / 1000) + 1;
+	if (!uwsgi_cache_magic_set(marker->buf, marker->pos, "1", 1, marker_expires, 0, urcc->name)) {
+		struct uwsgi_router_cache_inflight *urci = uwsgi_calloc(sizeof(struct uwsgi_router_cache_inflight));
+		urci->marker = marker;
+		urci->name = urcc->name;
+		// is_final: the marker is not a body filter, it is only released when the chain is destroyed
+		struct uwsgi_transformation *ut = uwsgi_add_transformation(wsgi_req, transform_cache_inflight, urci);
+		ut->is_final = 1;
+		ut->free = transform_cache_inflight_free;
+		return 1;
+	}
+end:
+	uwsgi_buffer_destroy(marker);
+	return 0;
+}
+
+/*
+	variants: 304 from the stored etag and lazily generated gzip copies
+
+	1 -> response sent, 0 -> go on with the canonical body (etag is set if available), -1 -> error
+*/
+static int router_cache_variant(struct wsgi_request *wsgi_req, struct uwsgi_router_cache_conf *urcc, struct uwsgi_buffer *ub, char **etag, uint64_t *etag_len) {
+	int ret = 0;
+	struct uwsgi_buffer *vkey = uwsgi_buffer_new(ub->pos + 64);
+	if (uwsgi_buffer_append(vkey, ub->buf, ub->pos)) goto end;
+	if (uwsgi_buffer_append(vkey, "@etag", 5)) goto end;
+	*etag = uwsgi_cache_magic_get(vkey->buf, vkey->pos, etag_len, NULL, urcc->name);
+	if (!*etag) goto end;
+
+	uint16_t inm_len = 0;
+	char *inm = uwsgi_get_var(wsgi_req, "HTTP_IF_NONE_MATCH", 18, &inm_len);
+	if (inm && router_cache_etag_match(inm, inm_len, *etag, *etag_len)) {
+		ret = -1;
+		if (uwsgi_response_prepare_headers(wsgi_req, "304 Not Modified", 16)) goto end;
+		if (uwsgi_response_add_header(wsgi_req, "ETag", 4, *etag, *etag_len)) goto end;
+		if (uwsgi_response_add_header(wsgi_req, "Vary", 4, "Accept-Encoding", 15)) goto end;
+		uwsgi_response_write_headers_do(wsgi_req);
+		ret = 1;
+		goto end;
+	}
+
+#ifdef UWSGI_ZLIB
+	if (!wsgi_req->encoding_len || uwsgi_accept_encoding_q(wsgi_req->encoding, wsgi_req->encoding_len, "gzip", 4) <= 0) goto end;
+	vkey->pos = ub->pos;
+	if (uwsgi_buffer_append(vkey, "@gzip@", 6)) goto end;
+	if (uwsgi_buffer_append(vkey, *etag, *etag_len)) goto end;
+
+	uint64_t valsize = 0;
+	uint64_t expires = 0;
+	struct uwsgi_buffer *gzipped = NULL;
+	char *value = uwsgi_cache_magic_get(vkey->buf, vkey->pos, &valsize, &expires, urcc->name);
+	if (!value) {
+		char *body = uwsgi_cache_magic_get(ub->buf, ub->pos, &valsize, &expires, urcc->name);
+		if (!body) goto end;
+		gzipped = uwsgi_gzip(body, valsize);
+		free(body);
+		if (!gzipped) goto end;
+		// the copy lives as long as the canonical body
+		uint64_t now = uwsgi_now();
+		if (!expires || expires > now) {
+			uwsgi_cache_magic_set(vkey->buf, vkey->pos, gzipped->buf, gzipped->pos, expires ? expires - now : 0, 0, urcc->name);
+		}
+		value = gzipped->buf;
+		valsize = gzipped->pos;
+	}
+
+	ret = -1;
+	if (uwsgi_response_prepare_headers(wsgi_req, "200 OK", 6)) goto end2;
+	size_t mime_type_len = 0;
+	char *mime_type = urcc->mime ? uwsgi_get_mime_type(ub->buf, ub->pos, &mime_type_len) : NULL;
+	if (mime_type) {
+		if (uwsgi_response_add_content_type(wsgi_req, mime_type, mime_type_len)) goto end2;
+	}
+	else {
+		if (uwsgi_response_add_content_type(wsgi_req, urcc->content_type, urcc->content_type_len)) goto end2;
+	}
+	if (uwsgi_response_add_header(wsgi_req, "Content-Encoding", 16, "gzip", 4)) goto end2;
+	if (uwsgi_response_add_header(wsgi_req, "ETag", 4, *etag, *etag_len)) goto end2;
+	if (uwsgi_response_add_header(wsgi_req, "Vary", 4, "Accept-Encoding", 15)) goto end2;
+	if (expires) {
+		if (uwsgi_response_add_expires(wsgi_req, expires)) goto end2;
+	}
+	if (!urcc->no_cl) {
+		if (uwsgi_response_add_content_length(wsgi_req, valsize)) goto end2;
+	}
+	uwsgi_response_write_body_do(wsgi_req, value, valsize);
+	ret = 1;
+end2:
+	if (gzipped) uwsgi_buffer_destroy(gzipped);
+	else free(value);
+#endif
+end:
+	uwsgi_buffer_destroy(vkey);
+	return ret;
+}
+
 static int uwsgi_routing_func_cache(struct wsgi_request *wsgi_req, struct uwsgi_route *ur){
 
 	char *mime_type = NULL;
@@ -170,14 +412,82 @@ static int uwsgi_routing_func_cache(struct wsgi_request *wsgi_req, struct uwsgi_
 	struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, urcc->key, urcc->key_len);
         if (!ub) return UWSGI_ROUTE_BREAK;
 
+	char *etag = NULL;
+	uint64_t etag_len = 0;
+	if (urcc->variants) {
+		int ret = router_cache_variant(wsgi_req, urcc, ub, &etag, &etag_len);
+		if (ret) {
+			uwsgi_buffer_destroy(ub);
+			if (etag) free(etag);
+			if (ret < 0 || !ur->custom) return UWSGI_ROUTE_BREAK;
+			return UWSGI_ROUTE_NEXT;
+		}
+	}
+
 	uint64_t valsize = 0;
 	uint64_t expires = 0;
-	char *value = uwsgi_cache_magic_get(ub->buf, ub->pos, &valsize, &expires, urcc->name);
-	if (urcc->mime && value) {
+	int fd = -1;
+	uint64_t pos = 0;
+	char *value = NULL;
+	struct uwsgi_offload_snapshot *uos = NULL;
+	// single-flight state
+	struct uwsgi_buffer *lookup = ub;
+	uint64_t waited = 0;
+	int stale_tried = 0;
+	int is_stale = 0;
+retry:
+	// big values of file backed caches are directly sent from the store
+	if (uwsgi_cache_magic_get_fd(lookup->buf, lookup->pos, &fd, &pos, &valsize, &expires, urcc->name)) {
+		fd = -1;
+		struct uwsgi_cache *uc = NULL;
+		// local items are streamed by the offload threads from a snapshot shared by the worker
+		if (wsgi_req->socket->can_offload && !ur->custom && !urcc->no_offload && !wsgi_req->ignore_body) {
+			uc = urcc->name ? uwsgi_cache_by_name(urcc->name) : uwsgi.caches;
+		}
+		if (uc) {
+			uos = uwsgi_offload_snapshot_cache(uc, lookup->buf, lookup->pos);
+			if (uos) {
+				value = uos->buf;
+				valsize = uos->len;
+				expires = uos->expires;
+			}
+		}
+		else {
+			value = uwsgi_cache_magic_get(lookup->buf, lookup->pos, &valsize, &expires, urcc->name);
+		}
+	}
+	if (lookup != ub) {
+		uwsgi_buffer_destroy(lookup);
+		lookup = ub;
+		is_stale = (value || fd > -1);
+	}
+	// on a miss only the leader goes on, the others get the stale copy or wait for the leader
+	// (while handling an error only the stale copy can be used)
+	if (!value && fd == -1 && (urcc->singleflight || urcc->stale) &&
+		(wsgi_req->is_error_routing || !router_cache_singleflight_lead(wsgi_req, urcc, ub))) {
+		if (!stale_tried) {
+			stale_tried = 1;
+			lookup = uwsgi_buffer_new(ub->pos + 6);
+			if (!uwsgi_buffer_append(lookup, ub->buf, ub->pos) && !uwsgi_buffer_append(lookup, "@stale", 6)) goto retry;
+			uwsgi_buffer_destroy(lookup);
+			lookup = ub;
+		}
+		if (!wsgi_req->is_error_routing && waited < urcc->singleflight) {
+			uwsgi.wait_milliseconds_hook(10);
+			waited += 10;
+			goto retry;
+		}
+	}
+	if (urcc->mime && (value || fd > -1)) {
 		mime_type = uwsgi_get_mime_type(ub->buf, ub->pos, &mime_type_len);	
 	}
 	uwsgi_buffer_destroy(ub);
-	if (value) {
+	if (value || fd > -1) {
+		// stale-if-error: the failed response must not reach the cache, release the chain (and the marker)
+		if (is_stale && wsgi_req->is_error_routing) {
+			uwsgi_free_transformations(wsgi_req);
+			wsgi_req->transformations = NULL;
+		}
 		if (uwsgi_response_prepare_headers(wsgi_req, "200 OK", 6)) goto error;
 		if (mime_type) {
                         uwsgi_response_add_content_type(wsgi_req, mime_type, mime_type_len);
@@ -188,12 +498,36 @@ static int uwsgi_routing_func_cache(struct wsgi_request *wsgi_req, struct uwsgi_
 		if (urcc->content_encoding_len) {
 			if (uwsgi_response_add_header(wsgi_req, "Content-Encoding", 16, urcc->content_encoding, urcc->content_encoding_len)) goto error;	
 		}
+		if (etag) {
+			if (uwsgi_response_add_header(wsgi_req, "ETag", 4, etag, etag_len)) goto error;
+			if (uwsgi_response_add_header(wsgi_req, "Vary", 4, "Accept-Encoding", 15)) goto error;
+			free(etag);
+			etag = NULL;
+		}
 		if (expires) {
 			if (uwsgi_response_add_expires(wsgi_req, expires)) goto error;	
 		}
 		if (!urcc->no_cl) {
 			if (uwsgi_response_add_content_length(wsgi_req, valsize)) goto error;
 		}
+		if (fd > -1) {
+			// the store fd is shared, it will be dup()ed for offloading
+			uwsgi_response_sendfile_do_can_close(wsgi_req, fd, pos, valsize, 0);
+			if (ur->custom)
+				return UWSGI_ROUTE_NEXT;
+			return UWSGI_ROUTE_BREAK;
+		}
+		if (uos) {
+			if (uwsgi_response_write_headers_do(wsgi_req) < 0) goto error;
+			if (!uwsgi_offload_request_snapshot_do(wsgi_req, uos)) {
+				wsgi_req->via = UWSGI_VIA_OFFLOAD;
+				wsgi_req->response_size += uos->len;
+				return UWSGI_ROUTE_BREAK;
+			}
+			uwsgi_response_write_body_do(wsgi_req, uos->buf, uos->len);
+			uwsgi_offload_snapshot_release(uos);
+			return UWSGI_ROUTE_BREAK;
+		}
 		if (wsgi_req->socket->can_offload && !ur->custom && !urcc->no_offload) {
                 	if (!uwsgi_offload_request_memory_do(wsgi_req, value, valsize)) {
                         	wsgi_req->via = UWSGI_VIA_OFFLOAD;
@@ -208,9 +542,12 @@ static int uwsgi_routing_func_cache(struct wsgi_request *wsgi_req, struct uwsgi_
 		return UWSGI_ROUTE_BREAK;
 	}
 	
+	if (etag) free(etag);
 	return UWSGI_ROUTE_NEXT;
 error:
-	free(value);
+	if (etag) free(etag);
+	if (uos) uwsgi_offload_snapshot_release(uos);
+	else if (value) free(value);
 	return UWSGI_ROUTE_BREAK;
 }
 
@@ -324,7 +661,9 @@ static int uwsgi_router_cache_store(struct uwsgi_route *ur, char *args) {
                         "value", &urcc->value,
 			"status", &urcc->status_str,
 			"code", &urcc->status_str,
-                        "expires", &urcc->expires_str, NULL)) {
+                        "expires", &urcc->expires_str,
+                        "stale", &urcc->stale_str,
+                        "variants", &urcc->variants, NULL)) {
                         uwsgi_log("invalid cachestore route syntax: %s\n", args);
 			goto error;
                 }
@@ -360,6 +699,10 @@ static int uwsgi_router_cache_store(struct uwsgi_route *ur, char *args) {
                         urcc->status = atoi(urcc->status_str);
                 }
 
+		if (urcc->stale_str) {
+			urcc->stale = strtoul(urcc->stale_str, NULL, 10);
+		}
+
 	ur->data2 = urcc;
         return 0;
 error:
@@ -385,6 +728,9 @@ static int uwsgi_router_cache(struct uwsgi_route *ur, char *args) {
                         "no_content_length", &urcc->no_cl,
                         "no_cl", &urcc->no_cl,
                         "nocl", &urcc->no_cl,
+                        "singleflight", &urcc->singleflight_str,
+                        "stale", &urcc->stale_str,
+                        "variants", &urcc->variants,
                         NULL)) {
 			uwsgi_log("invalid route syntax: %s\n", args);
 			exit(1);
@@ -407,6 +753,14 @@ static int uwsgi_router_cache(struct uwsgi_route *ur, char *args) {
 			urcc->content_encoding_len = strlen(urcc->content_encoding);
 		}
 
+		if (urcc->singleflight_str) {
+			urcc->singleflight = strtoul(urcc->singleflight_str, NULL, 10);
+		}
+
+		if (urcc->stale_str) {
+			urcc->stale = strtoul(urcc->stale_str, NULL, 10);
+		}
+
                 ur->data2 = urcc;
 	return 0;
 }
@@ -12,6 +12,9 @@ extern struct uwsgi_server uwsgi;
 
 	route = /^foobar1(.*)/ hash:key=foo$1poo,algo=murmur2,var=MYHASH,items=node1;node2;node3
 
+	algo can be any registered hash (djb33x, murmur2, wyhash, xxh64...), the 64bit ones
+	are used at full width
+
 */
 
 struct uwsgi_router_hash_conf {
@@ -43,7 +46,7 @@ static int uwsgi_routing_func_hash(struct wsgi_request *wsgi_req, struct uwsgi_r
         struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, urhc->key, urhc->key_len);
         if (!ub) return UWSGI_ROUTE_BREAK;
 
-	uint32_t h = uha->func(ub->buf, ub->pos);
+	uint64_t h = uwsgi_hash_algo_64(uha, ub->buf, ub->pos);
         uwsgi_buffer_destroy(ub);
 
 	// now count the number of items
@@ -26,6 +26,10 @@ static int uwsgi_routing_func_http(struct wsgi_request *wsgi_req, struct uwsgi_r
 		}
 	}
 
+	// upstream keepalive requires the whole request (body included) in the offloaded buffer
+	int keepalive = uwsgi.offload_http_keepalive > 0 && !(ur->custom & 0x07) && wsgi_req->socket->can_offload
+		&& !wsgi_req->post_file && (wsgi_req->post_cl == 0 || uwsgi.post_buffering > 0);
+
 	// convert the wsgi_request to an http proxy request
 	if (ur->custom & 0x02) {
 		ub = uwsgi_buffer_new(uwsgi.page_size);
@@ -34,7 +38,7 @@ static int uwsgi_routing_func_http(struct wsgi_request *wsgi_req, struct uwsgi_r
 		ub = uwsgi_to_http_dumb(wsgi_req, ur->data2, ur->data2_len, ub_url ? ub_url->buf : NULL, ub_url ? ub_url->pos : 0);
 	}
 	else {
-		ub = uwsgi_to_http(wsgi_req, ur->data2, ur->data2_len, ub_url ? ub_url->buf : NULL, ub_url ? ub_url->pos : 0);	
+		ub = uwsgi_to_http2(wsgi_req, ur->data2, ur->data2_len, ub_url ? ub_url->buf : NULL, ub_url ? ub_url->pos : 0, keepalive);
 	}
 
 	if (!ub) {
@@ -79,7 +83,9 @@ static int uwsgi_routing_func_http(struct wsgi_request *wsgi_req, struct uwsgi_r
                         uwsgi_response_write_headers_do(wsgi_req);	
 		}
 
-        	if (!uwsgi_offload_request_net_do(wsgi_req, ub_addr->buf, ub)) {
+		// (if the offloading fails, the in-worker proxy still works, it only waits for the upstream to close)
+		int ret = keepalive ? uwsgi_offload_request_http_do(wsgi_req, ub_addr->buf, ub) : uwsgi_offload_request_net_do(wsgi_req, ub_addr->buf, ub);
+        	if (!ret) {
                 	wsgi_req->via = UWSGI_VIA_OFFLOAD;
 			wsgi_req->status = 202;
 			uwsgi_buffer_destroy(ub_addr);
@@ -13,6 +13,11 @@ extern struct uwsgi_server uwsgi;
 	route = /^foobar1(.*)/ memcached:addr=127.0.0.1:11211,key=foo$1poo
 	route = /^foobar1(.*)/ memcachedstore:addr=127.0.0.1:11211,key=foo$1poo
 
+	connections are kept in a per-core pool (disable it with no_pool=1),
+	multiple servers separated by '|' are sharded by key (jump consistent hash)
+
+	route = /^foobar1(.*)/ memcached:addr=127.0.0.1:11211|127.0.0.1:11212,key=foo$1poo
+
 */
 
 struct uwsgi_router_memcached_conf {
@@ -27,6 +32,7 @@ struct uwsgi_router_memcached_conf {
 	size_t content_type_len;
 
 	char *no_offload;
+	char *no_pool;
 	char *expires;
 	
 };
@@ -36,6 +42,8 @@ struct uwsgi_transformation_memcached_conf {
 	struct uwsgi_buffer *addr;
         struct uwsgi_buffer *key;
         char *expires;
+	// -1 for a non pooled connection
+	int core;
 };
 
 
@@ -60,17 +68,14 @@ static size_t memcached_firstline_parse(char *buf, size_t len) {
 }
 
 // store an item in memcached
-static void memcached_store(char *addr, struct uwsgi_buffer *key, struct uwsgi_buffer *value, char *expires) {
+static void memcached_store(char *addr, struct uwsgi_buffer *key, struct uwsgi_buffer *value, char *expires, int core) {
 	
 	int timeout = uwsgi.socket_timeout;
+	int replies = 1;
 
-        int fd = uwsgi_connect(addr, 0, 1);
+        int fd = uwsgi_pool_connect(addr, core);
         if (fd < 0) return;
 
-	// wait for connection
-        int ret = uwsgi.wait_write_hook(fd, timeout);
-        if (ret <= 0) goto end;
-
 	// build the request
 	struct uwsgi_buffer *ub = uwsgi_buffer_new(uwsgi.page_size);
 	if (uwsgi_buffer_append(ub, "set ", 4)) goto end2;
@@ -85,10 +90,14 @@ static void memcached_store(char *addr, struct uwsgi_buffer *key, struct uwsgi_b
         if (uwsgi_write_true_nb(fd, value->buf, value->pos, timeout)) goto end2;
         if (uwsgi_write_true_nb(fd, "\r\n", 2, timeout)) goto end2;
 
-	// we are not interested in command result... (ugly but it works)
+	// without a pool we are not interested in command result... (ugly but it works)
+	if (core > -1 && !uwsgi_read_lines_true_nb(fd, replies, timeout)) {
+		uwsgi_buffer_destroy(ub);
+		uwsgi_pool_release(addr, core, fd);
+		return;
+	}
 end2:
 	uwsgi_buffer_destroy(ub);
-end:
 	close(fd);
 }
 
@@ -98,7 +107,9 @@ static int transform_memcached(struct wsgi_request *wsgi_req, struct uwsgi_trans
 
         // store only successfull response
         if (wsgi_req->write_errors == 0 && wsgi_req->status == 200 && ub->pos > 0) {
-		memcached_store(utmc->addr->buf, utmc->key, ub, utmc->expires);
+		char *addr = uwsgi_shard_addr(utmc->addr->buf, utmc->addr->pos, utmc->key->buf, utmc->key->pos);
+		memcached_store(addr, utmc->key, ub, utmc->expires, utmc->core);
+		free(addr);
         }
 
         // free resources
@@ -126,6 +137,7 @@ static int uwsgi_routing_func_memcached_store(struct wsgi_request *wsgi_req, str
         if (!utmc->addr) goto error;
 
         utmc->expires = urmc->expires;
+        utmc->core = urmc->no_pool ? -1 : wsgi_req->async_id;
 
         uwsgi_add_transformation(wsgi_req, transform_memcached, utmc);
 
@@ -159,33 +171,30 @@ static int uwsgi_routing_func_memcached(struct wsgi_request *wsgi_req, struct uw
 		return UWSGI_ROUTE_BREAK;
 	}
 
-	int fd = uwsgi_connect(ub_addr->buf, 0, 1);
+	// persistent connection (per core) to the (sharded) server
+	int core = urmc->no_pool ? -1 : wsgi_req->async_id;
+	char *addr = uwsgi_shard_addr(ub_addr->buf, ub_addr->pos, ub_key->buf, ub_key->pos);
+	uwsgi_buffer_destroy(ub_addr);
+
+	int fd = uwsgi_pool_connect(addr, core);
 	if (fd < 0) {
 		uwsgi_buffer_destroy(ub_key);
-		uwsgi_buffer_destroy(ub_addr);
 		goto end;
 	}
 
-        // wait for connection;
-        int ret = uwsgi.wait_write_hook(fd, uwsgi.socket_timeout);
-        if (ret <= 0) {
-		uwsgi_buffer_destroy(ub_key) ;
-		uwsgi_buffer_destroy(ub_addr);
-		close(fd);
-		goto end;
-        }
+	int ret;
+	// bytes of the end of the reply ("\r\nEND\r\n") already received
+	size_t trailer = 0;
 
 	// build the request and send it
 	char *cmd = uwsgi_concat3n("get ", 4, ub_key->buf, ub_key->pos, "\r\n", 2);
 	if (uwsgi_write_true_nb(fd, cmd, 6+ub_key->pos, uwsgi.socket_timeout)) {
 		uwsgi_buffer_destroy(ub_key);
-		uwsgi_buffer_destroy(ub_addr);
 		free(cmd);
 		close(fd);
 		goto end;
 	}
 	uwsgi_buffer_destroy(ub_key);
-	uwsgi_buffer_destroy(ub_addr);
 	free(cmd);
 
 	// ok, start reading the response...
@@ -230,7 +239,13 @@ read:
 	size_t response_size = memcached_firstline_parse(buf, found);
 
 	if (response_size == 0) {
-		close(fd);
+		// a clean miss (a single line) leaves the connection reusable
+		if (core > -1 && found + 2 == pos) {
+			uwsgi_pool_release(addr, core, fd);
+		}
+		else {
+			close(fd);
+		}
 		goto end;
 	}
 
@@ -245,6 +260,7 @@ read:
 	size_t remains = pos-(found+2);
 	if (remains >= response_size) {
 		uwsgi_response_write_body_do(wsgi_req, buf+found+2, response_size);
+		trailer = remains - response_size;
 		goto done;	
 	}
 
@@ -258,6 +274,7 @@ read:
 	if (wsgi_req->socket->can_offload && !ur->custom && !urmc->no_offload) {
         	if (!uwsgi_offload_request_pipe_do(wsgi_req, fd, response_size)) {
                 	wsgi_req->via = UWSGI_VIA_OFFLOAD;
+			free(addr);
                         return UWSGI_ROUTE_BREAK;
                 }
         }
@@ -282,16 +299,25 @@ write:
 	}
 
 done:
-	close(fd);
+	// the connection can be given back only after consuming the end of the reply
+	if (core > -1 && trailer <= 7 && !uwsgi_read_whole_true_nb(fd, buf, 7 - trailer, uwsgi.socket_timeout)) {
+		uwsgi_pool_release(addr, core, fd);
+	}
+	else {
+		close(fd);
+	}
+	free(addr);
 	if (ur->custom)
                 return UWSGI_ROUTE_NEXT;
 	return UWSGI_ROUTE_BREAK;
 
 error:
 	close(fd);
+	free(addr);
 	return UWSGI_ROUTE_BREAK;
 	
 end:
+	free(addr);
 	return UWSGI_ROUTE_NEXT;
 }
 
@@ -305,6 +331,7 @@ static int uwsgi_router_memcached(struct uwsgi_route *ur, char *args) {
                         "key", &urmc->key,
                         "content_type", &urmc->content_type,
                         "no_offload", &urmc->no_offload,
+                        "no_pool", &urmc->no_pool,
                         NULL)) {
 			uwsgi_log("invalid route syntax: %s\n", args);
 		exit(1);
@@ -340,7 +367,8 @@ static int uwsgi_router_memcached_store(struct uwsgi_route *ur, char *args) {
         if (uwsgi_kvlist_parse(ur->data, ur->data_len, ',', '=',
 			"addr", &urmc->addr,
                         "key", &urmc->key,
-                        "expires", &urmc->expires, NULL)) {
+                        "expires", &urmc->expires,
+                        "no_pool", &urmc->no_pool, NULL)) {
                         uwsgi_log("invalid memcachedstore route syntax: %s\n", args);
 			return -1;
                 }
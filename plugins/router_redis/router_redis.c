@@ -13,6 +13,11 @@ extern struct uwsgi_server uwsgi;
 	route = /^foobar1(.*)/ redis:addr=127.0.0.1:11211,key=foo$1poo
 	route = /^foobar1(.*)/ redisstore:addr=127.0.0.1:11211,key=foo$1poo
 
+	connections are kept in a per-core pool (disable it with no_pool=1),
+	multiple servers separated by '|' are sharded by key (jump consistent hash)
+
+	route = /^foobar1(.*)/ redis:addr=127.0.0.1:6379|127.0.0.1:6380,key=foo$1poo
+
 */
 
 struct uwsgi_router_redis_conf {
@@ -30,6 +35,7 @@ struct uwsgi_router_redis_conf {
 	size_t content_encoding_len;
 
 	char *no_offload;
+	char *no_pool;
 	char *expires;
 	
 };
@@ -39,6 +45,8 @@ struct uwsgi_transformation_redis_conf {
 	struct uwsgi_buffer *addr;
         struct uwsgi_buffer *key;
         char *expires;
+	// -1 for a non pooled connection
+	int core;
 };
 
 
@@ -51,17 +59,14 @@ static size_t redis_firstline_parse(char *buf, size_t len) {
 }
 
 // store an item in redis
-static void redis_store(char *addr, struct uwsgi_buffer *key, struct uwsgi_buffer *value, char *expires) {
+static void redis_store(char *addr, struct uwsgi_buffer *key, struct uwsgi_buffer *value, char *expires, int core) {
 	
 	int timeout = uwsgi.socket_timeout;
+	int replies = 1;
 
-        int fd = uwsgi_connect(addr, 0, 1);
+        int fd = uwsgi_pool_connect(addr, core);
         if (fd < 0) return;
 
-	// wait for connection
-        int ret = uwsgi.wait_write_hook(fd, timeout);
-        if (ret <= 0) goto end;
-
 	// build the request
 	struct uwsgi_buffer *ub = uwsgi_buffer_new(uwsgi.page_size);
 	if (uwsgi_buffer_append(ub, "*3\r\n$3\r\nSET\r\n$", 14)) goto end2;
@@ -75,6 +80,7 @@ static void redis_store(char *addr, struct uwsgi_buffer *key, struct uwsgi_buffe
         if (uwsgi_write_true_nb(fd, value->buf, value->pos, timeout)) goto end2;
 	ub->pos = 0;
 	if (strcmp(expires, "0")) {
+		replies = 2;
 		if (uwsgi_buffer_append(ub, "\r\n*3\r\n$6\r\nEXPIRE\r\n$" , 19)) goto end2;
 		if (uwsgi_buffer_num64(ub, key->pos)) goto end2;
         	if (uwsgi_buffer_append(ub, "\r\n" , 2)) goto end2;
@@ -87,10 +93,14 @@ static void redis_store(char *addr, struct uwsgi_buffer *key, struct uwsgi_buffe
 	if (uwsgi_buffer_append(ub, "\r\n" , 2)) goto end2;
         if (uwsgi_write_true_nb(fd, ub->buf, ub->pos, timeout)) goto end2;
 	
-	// we are not interested in command result... (ugly but it works)
+	// without a pool we are not interested in command result... (ugly but it works)
+	if (core > -1 && !uwsgi_read_lines_true_nb(fd, replies, timeout)) {
+		uwsgi_buffer_destroy(ub);
+		uwsgi_pool_release(addr, core, fd);
+		return;
+	}
 end2:
 	uwsgi_buffer_destroy(ub);
-end:
 	close(fd);
 }
 
@@ -100,7 +110,9 @@ static int transform_redis(struct wsgi_request *wsgi_req, struct uwsgi_transform
 
         // store only successfull response
         if (wsgi_req->write_errors == 0 && wsgi_req->status == 200 && ub->pos > 0) {
-		redis_store(utrc->addr->buf, utrc->key, ub, utrc->expires);
+		char *addr = uwsgi_shard_addr(utrc->addr->buf, utrc->addr->pos, utrc->key->buf, utrc->key->pos);
+		redis_store(addr, utrc->key, ub, utrc->expires, utrc->core);
+		free(addr);
         }
 
         // free resources
@@ -128,6 +140,7 @@ static int uwsgi_routing_func_redis_store(struct wsgi_request *wsgi_req, struct
         if (!utrc->addr) goto error;
 
         utrc->expires = urrc->expires;
+        utrc->core = urrc->no_pool ? -1 : wsgi_req->async_id;
 
         uwsgi_add_transformation(wsgi_req, transform_redis, utrc);
 
@@ -161,33 +174,30 @@ static int uwsgi_routing_func_redis(struct wsgi_request *wsgi_req, struct uwsgi_
 		return UWSGI_ROUTE_BREAK;
 	}
 
-	int fd = uwsgi_connect(ub_addr->buf, 0, 1);
+	// persistent connection (per core) to the (sharded) server
+	int core = urrc->no_pool ? -1 : wsgi_req->async_id;
+	char *addr = uwsgi_shard_addr(ub_addr->buf, ub_addr->pos, ub_key->buf, ub_key->pos);
+	uwsgi_buffer_destroy(ub_addr);
+
+	int fd = uwsgi_pool_connect(addr, core);
 	if (fd < 0) {
 		uwsgi_buffer_destroy(ub_key);
-		uwsgi_buffer_destroy(ub_addr);
 		goto end;
 	}
 
-        // wait for connection;
-        int ret = uwsgi.wait_write_hook(fd, uwsgi.socket_timeout);
-        if (ret <= 0) {
-		uwsgi_buffer_destroy(ub_key) ;
-		uwsgi_buffer_destroy(ub_addr);
-		close(fd);
-		goto end;
-        }
+	int ret;
+	// bytes of the end of the reply ("\r\n") already received
+	size_t trailer = 0;
 
 	// build the request and send it
 	char *cmd = uwsgi_concat3n("get ", 4, ub_key->buf, ub_key->pos, "\r\n", 2);
 	if (uwsgi_write_true_nb(fd, cmd, 6+ub_key->pos, uwsgi.socket_timeout)) {
 		uwsgi_buffer_destroy(ub_key);
-		uwsgi_buffer_destroy(ub_addr);
 		free(cmd);
 		close(fd);
 		goto end;
 	}
 	uwsgi_buffer_destroy(ub_key);
-	uwsgi_buffer_destroy(ub_addr);
 	free(cmd);
 
 	// ok, start reading the response...
@@ -231,7 +241,13 @@ read:
 	// ok parse the first line
 	size_t response_size = redis_firstline_parse(buf, found);
 	if (response_size == 0) {
-		close(fd);
+		// a clean miss (a single line) leaves the connection reusable
+		if (core > -1 && found + 2 == pos) {
+			uwsgi_pool_release(addr, core, fd);
+		}
+		else {
+			close(fd);
+		}
 		goto end;
 	}
 
@@ -247,6 +263,7 @@ read:
 	size_t remains = pos-(found+2);
 	if (remains >= response_size) {
 		uwsgi_response_write_body_do(wsgi_req, buf+found+2, response_size);
+		trailer = remains - response_size;
 		goto done;	
 	}
 
@@ -260,6 +277,7 @@ read:
 	if (wsgi_req->socket->can_offload && !ur->custom && !urrc->no_offload) {
         	if (!uwsgi_offload_request_pipe_do(wsgi_req, fd, response_size)) {
                 	wsgi_req->via = UWSGI_VIA_OFFLOAD;
+			free(addr);
                         return UWSGI_ROUTE_BREAK;
                 }
         }
@@ -284,16 +302,25 @@ write:
 	}
 
 done:
-	close(fd);
+	// the connection can be given back only after consuming the end of the reply
+	if (core > -1 && trailer <= 2 && !uwsgi_read_whole_true_nb(fd, buf, 2 - trailer, uwsgi.socket_timeout)) {
+		uwsgi_pool_release(addr, core, fd);
+	}
+	else {
+		close(fd);
+	}
+	free(addr);
 	if (ur->custom)
                 return UWSGI_ROUTE_NEXT;
 	return UWSGI_ROUTE_BREAK;
 
 error:
 	close(fd);
+	free(addr);
 	return UWSGI_ROUTE_BREAK;
 	
 end:
+	free(addr);
 	return UWSGI_ROUTE_NEXT;
 }
 
@@ -308,6 +335,7 @@ static int uwsgi_router_redis(struct uwsgi_route *ur, char *args) {
                         "content_type", &urrc->content_type,
                         "content_encoding", &urrc->content_encoding,
                         "no_offload", &urrc->no_offload,
+                        "no_pool", &urrc->no_pool,
                         NULL)) {
 			uwsgi_log("invalid route syntax: %s\n", args);
 		exit(1);
@@ -347,7 +375,8 @@ static int uwsgi_router_redis_store(struct uwsgi_route *ur, char *args) {
         if (uwsgi_kvlist_parse(ur->data, ur->data_len, ',', '=',
 			"addr", &urrc->addr,
                         "key", &urrc->key,
-                        "expires", &urrc->expires, NULL)) {
+                        "expires", &urrc->expires,
+                        "no_pool", &urrc->no_pool, NULL)) {
                         uwsgi_log("invalid redisstore route syntax: %s\n", args);
 			return -1;
                 }
@@ -19,6 +19,8 @@ extern struct uwsgi_server uwsgi;
 	3 -> set xmlrpc wrapper (requires libxml2)
 	4 -> set jsonrpc wrapper (requires libjansson)
 	5 -> used in uwsgi response to signal the response is a uwsgi dictionary followed by the body (the dictionary must contains a CONTENT_LENGTH key)
+	6 -> persistent session: the first item of the array is a 4 bytes request id, the response is a uwsgi header (173, 12, 6)
+	     followed by the id and the 64bit (little endian) size of the body. The connection stays open for other requests.
 
 */
 
@@ -128,6 +130,89 @@ static int uwsgi_rpc_xmlrpc(struct wsgi_request *wsgi_req, xmlDoc *doc, char **a
 }
 #endif
 
+static int uwsgi_rpc_session_call(struct wsgi_request *wsgi_req, char *buf, uint16_t len) {
+	char *argv[UMAX8];
+	uint16_t argvs[UMAX8];
+	uint8_t argc = 0xff;
+	char *response_buf = NULL;
+	int i;
+
+	if (uwsgi_parse_array(buf, len, argv, argvs, &argc) || argc < 2 || argvs[0] != 4) {
+		uwsgi_log("Invalid RPC session request. skip.\n");
+		return -1;
+	}
+
+	uint64_t content_len = uwsgi_rpc(argv[1], argc-2, argv+2, argvs+2, &response_buf);
+	if (!response_buf) content_len = 0;
+
+	// header and body in a single write (avoid nagle delays on pipelined sessions)
+	uint8_t *hdr = uwsgi_malloc(16 + content_len);
+	hdr[0] = 173;
+	hdr[1] = 12;
+	hdr[2] = 0;
+	hdr[3] = 6;
+	memcpy(hdr + 4, argv[0], 4);
+	for (i = 0; i < 8; i++) {
+		hdr[8 + i] = (uint8_t) ((content_len >> (i * 8)) & 0xff);
+	}
+	if (content_len > 0) memcpy(hdr + 16, response_buf, content_len);
+	free(response_buf);
+
+	int ret = uwsgi_response_write_body_do(wsgi_req, (char *) hdr, 16 + content_len);
+	free(hdr);
+	return ret;
+}
+
+// serve calls on the connection until the peer closes it or stays idle for --rpc-session-timeout
+static int uwsgi_rpc_session(struct wsgi_request *wsgi_req) {
+	if (uwsgi_rpc_session_call(wsgi_req, wsgi_req->buffer, wsgi_req->uh->_pktsize))
+		return -1;
+
+	char *buf = uwsgi_malloc(4 + 0xffff);
+	// data already read (pipelined) with the first request
+	size_t pos = 0;
+	if (wsgi_req->proto_parser_remains > 4 + 0xffff) {
+		uwsgi_log("Invalid RPC session packet. skip.\n");
+		free(buf);
+		return -1;
+	}
+	if (wsgi_req->proto_parser_remains > 0) {
+		memcpy(buf, wsgi_req->proto_parser_remains_buf, wsgi_req->proto_parser_remains);
+		pos = wsgi_req->proto_parser_remains;
+		wsgi_req->proto_parser_remains = 0;
+	}
+
+	for (;;) {
+		// wait for the header
+		while (pos < 4) {
+			ssize_t rlen = uwsgi_read_true_nb(wsgi_req->fd, buf + pos, (4 + 0xffff) - pos, uwsgi.rpc_session_timeout);
+			if (rlen <= 0) goto end;
+			pos += rlen;
+		}
+		struct uwsgi_header *uh = (struct uwsgi_header *) buf;
+		uint16_t pktsize = uh->_pktsize;
+#ifdef __BIG_ENDIAN__
+		pktsize = uwsgi_swap16(pktsize);
+#endif
+		if (uh->modifier1 != 173 || uh->modifier2 != 6) {
+			uwsgi_log("Invalid RPC session packet. skip.\n");
+			goto end;
+		}
+		while (pos < (size_t) (4 + pktsize)) {
+			ssize_t rlen = uwsgi_read_true_nb(wsgi_req->fd, buf + pos, (4 + 0xffff) - pos, uwsgi.socket_timeout);
+			if (rlen <= 0) goto end;
+			pos += rlen;
+		}
+		if (uwsgi_rpc_session_call(wsgi_req, buf + 4, pktsize)) goto end;
+		// move pipelined data to the start of the buffer
+		pos -= 4 + pktsize;
+		memmove(buf, buf + 4 + pktsize, pos);
+	}
+end:
+	free(buf);
+	return UWSGI_OK;
+}
+
 static int uwsgi_rpc_request(struct wsgi_request *wsgi_req) {
 
 	// this is the list of args
@@ -147,6 +232,10 @@ static int uwsgi_rpc_request(struct wsgi_request *wsgi_req) {
                 return -1;
         }
 
+	if (wsgi_req->uh->modifier2 == 6) {
+		return uwsgi_rpc_session(wsgi_req);
+	}
+
 	if (wsgi_req->uh->modifier2 == 2) {
 		if (uwsgi_parse_vars(wsgi_req)) {
                 	uwsgi_log("Invalid RPC request. skip.\n");
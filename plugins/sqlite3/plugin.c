@@ -2,6 +2,58 @@
 #include <sqlite3.h>
 
 extern struct uwsgi_server uwsgi;
+/*
+
+	request-time lookups
+
+	--sqlite3-db name=<name>,path=<file>[,mmap=<bytes>][,cache_size=<pages>][,shared=1]
+
+	opens a read-only db (shared cache when shared=1, memory mapped i/o when mmap is set)
+
+	--sqlite3-query <name>=<db>:<sql>
+
+	defines a named statement, it is prepared once per core (connections are per-core too,
+	so no locking is needed) and reset after every use. The statement is exposed as the
+	"sqlite" route var, returning the first column of the first row:
+
+	${sqlite[<query>]}
+	${sqlite[<query>:VAR1,VAR2...]} binds the values of the request vars to the statement parameters
+
+	example:
+
+	--sqlite3-db name=hosts,path=/etc/uwsgi/hosts.db,mmap=67108864
+	--sqlite3-query backend=hosts:SELECT addr FROM backends WHERE host = ?
+	--route-run uwsgi:${sqlite[backend:HTTP_HOST]},0,0
+
+*/
+
+struct uwsgi_sqlite3_db {
+	char *name;
+	char *path;
+	uint64_t mmap_size;
+	int64_t cache_size;
+	int shared;
+	// one connection per core
+	sqlite3 **conns;
+	struct uwsgi_sqlite3_db *next;
+};
+
+struct uwsgi_sqlite3_query {
+	char *name;
+	size_t name_len;
+	char *sql;
+	struct uwsgi_sqlite3_db *db;
+	// one prepared statement per core
+	sqlite3_stmt **stmts;
+	struct uwsgi_sqlite3_query *next;
+};
+
+static struct uwsgi_sqlite3 {
+	struct uwsgi_string_list *dbs_list;
+	struct uwsgi_string_list *queries_list;
+	struct uwsgi_sqlite3_db *dbs;
+	struct uwsgi_sqlite3_query *queries;
+} usqlite3;
 
 static void uwsgi_sqlite3_config(char *, char *[]);
 static void uwsgi_opt_load_sqlite3(char *opt, char *filename, void *none) {
@@ -12,9 +64,251 @@ static void uwsgi_opt_load_sqlite3(char *opt, char *filename, void *none) {
 static struct uwsgi_option uwsgi_sqlite3_options[] = {
         {"sqlite3", required_argument, 0, "load config from sqlite3 db", uwsgi_opt_load_sqlite3, NULL, UWSGI_OPT_IMMEDIATE},
         {"sqlite", required_argument, 0, "load config from sqlite3 db", uwsgi_opt_load_sqlite3, NULL, UWSGI_OPT_IMMEDIATE},
+        {"sqlite3-db", required_argument, 0, "open a read-only sqlite3 db for request-time lookups (name=...,path=...[,mmap=...,cache_size=...,shared=1])", uwsgi_opt_add_string_list, &usqlite3.dbs_list, 0},
+        {"sqlite3-query", required_argument, 0, "define a named statement for the sqlite route var (<name>=<db>:<sql>)", uwsgi_opt_add_string_list, &usqlite3.queries_list, 0},
 	{0, 0, 0, 0, 0, 0, 0},
 };
 
+static struct uwsgi_sqlite3_db *uwsgi_sqlite3_db_get(char *name) {
+	struct uwsgi_sqlite3_db *db = usqlite3.dbs;
+	while(db) {
+		if (!strcmp(db->name, name)) return db;
+		db = db->next;
+	}
+	return NULL;
+}
+
+static struct uwsgi_sqlite3_query *uwsgi_sqlite3_query_get(char *name, size_t name_len) {
+	struct uwsgi_sqlite3_query *q = usqlite3.queries;
+	while(q) {
+		if (!uwsgi_strncmp(q->name, q->name_len, name, name_len)) return q;
+		q = q->next;
+	}
+	return NULL;
+}
+
+static sqlite3 *uwsgi_sqlite3_open(struct uwsgi_sqlite3_db *db) {
+	sqlite3 *conn = NULL;
+	int flags = SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX;
+	if (db->shared) flags |= SQLITE_OPEN_SHAREDCACHE;
+	if (sqlite3_open_v2(db->path, &conn, flags, NULL)) {
+		uwsgi_log("[sqlite3] unable to open db \"%s\" (%s): %s\n", db->name, db->path, conn ? sqlite3_errmsg(conn) : "out of memory");
+		sqlite3_close(conn);
+		return NULL;
+	}
+	char pragma[128];
+	char *err = NULL;
+	if (db->mmap_size) {
+		snprintf(pragma, 128, "PRAGMA mmap_size=%llu", (unsigned long long) db->mmap_size);
+		if (sqlite3_exec(conn, pragma, NULL, NULL, &err)) goto error;
+	}
+	if (db->cache_size) {
+		snprintf(pragma, 128, "PRAGMA cache_size=%lld", (long long) db->cache_size);
+		if (sqlite3_exec(conn, pragma, NULL, NULL, &err)) goto error;
+	}
+	if (sqlite3_exec(conn, "PRAGMA query_only=1", NULL, NULL, &err)) goto error;
+	return conn;
+error:
+	uwsgi_log("[sqlite3] unable to configure db \"%s\": %s\n", db->name, err);
+	sqlite3_free(err);
+	sqlite3_close(conn);
+	return NULL;
+}
+
+static void uwsgi_sqlite3_db_create(char *arg) {
+	char *s_name = NULL;
+	char *s_path = NULL;
+	char *s_mmap = NULL;
+	char *s_cache_size = NULL;
+	char *s_shared = NULL;
+
+	if (uwsgi_kvlist_parse(arg, strlen(arg), ',', '=',
+		"name", &s_name,
+		"path", &s_path,
+		"mmap", &s_mmap,
+		"mmap_size", &s_mmap,
+		"cache_size", &s_cache_size,
+		"shared", &s_shared,
+		NULL)) {
+		uwsgi_log("invalid --sqlite3-db keyval syntax: %s\n", arg);
+		exit(1);
+	}
+
+	if (!s_name || !s_path) {
+		uwsgi_log("--sqlite3-db: you need to specify at least 'name' and 'path'\n");
+		exit(1);
+	}
+
+	if (uwsgi_sqlite3_db_get(s_name)) {
+		uwsgi_log("--sqlite3-db: db \"%s\" already defined\n", s_name);
+		exit(1);
+	}
+
+	struct uwsgi_sqlite3_db *db = uwsgi_calloc(sizeof(struct uwsgi_sqlite3_db));
+	db->name = s_name;
+	db->path = s_path;
+	if (s_mmap) db->mmap_size = uwsgi_n64(s_mmap);
+	if (s_cache_size) db->cache_size = strtoll(s_cache_size, NULL, 10);
+	if (s_shared) db->shared = 1;
+
+	struct uwsgi_sqlite3_db **last = &usqlite3.dbs;
+	while (*last) last = &(*last)->next;
+	*last = db;
+}
+
+static void uwsgi_sqlite3_query_create(char *arg) {
+	char *equal = strchr(arg, '=');
+	char *colon = equal ? strchr(equal + 1, ':') : NULL;
+	if (!equal || !colon || equal == arg || !colon[1]) {
+		uwsgi_log("invalid --sqlite3-query syntax: %s (must be <name>=<db>:<sql>)\n", arg);
+		exit(1);
+	}
+	*equal = 0;
+	*colon = 0;
+
+	struct uwsgi_sqlite3_db *db = uwsgi_sqlite3_db_get(equal + 1);
+	if (!db) {
+		uwsgi_log("--sqlite3-query: unknown db \"%s\"\n", equal + 1);
+		exit(1);
+	}
+
+	if (uwsgi_sqlite3_query_get(arg, strlen(arg))) {
+		uwsgi_log("--sqlite3-query: query \"%s\" already defined\n", arg);
+		exit(1);
+	}
+
+	struct uwsgi_sqlite3_query *q = uwsgi_calloc(sizeof(struct uwsgi_sqlite3_query));
+	q->name = arg;
+	q->name_len = strlen(arg);
+	q->sql = colon + 1;
+	q->db = db;
+
+	struct uwsgi_sqlite3_query **last = &usqlite3.queries;
+	while (*last) last = &(*last)->next;
+	*last = q;
+}
+
+static int uwsgi_sqlite3_init() {
+	struct uwsgi_string_list *usl = NULL;
+	uwsgi_foreach(usl, usqlite3.dbs_list) {
+		uwsgi_sqlite3_db_create(uwsgi_str(usl->value));
+	}
+	uwsgi_foreach(usl, usqlite3.queries_list) {
+		uwsgi_sqlite3_query_create(uwsgi_str(usl->value));
+	}
+
+	// check dbs and statements before forking (connections cannot be inherited)
+	struct uwsgi_sqlite3_db *db = usqlite3.dbs;
+	while(db) {
+		sqlite3 *conn = uwsgi_sqlite3_open(db);
+		if (!conn) exit(1);
+		struct uwsgi_sqlite3_query *q = usqlite3.queries;
+		while(q) {
+			if (q->db == db) {
+				sqlite3_stmt *stmt = NULL;
+				if (sqlite3_prepare_v2(conn, q->sql, -1, &stmt, NULL)) {
+					uwsgi_log("[sqlite3] unable to prepare query \"%s\": %s\n", q->name, sqlite3_errmsg(conn));
+					exit(1);
+				}
+				sqlite3_finalize(stmt);
+			}
+			q = q->next;
+		}
+		sqlite3_close(conn);
+		uwsgi_log_initial("sqlite3 db \"%s\" (%s) ready for lookups (mmap: %llu shared cache: %s)\n", db->name, db->path,
+			(unsigned long long) db->mmap_size, db->shared ? "yes" : "no");
+		db = db->next;
+	}
+	return 0;
+}
+
+// connections and statements are opened lazily by each core of each worker
+static void uwsgi_sqlite3_post_fork() {
+	struct uwsgi_sqlite3_db *db = usqlite3.dbs;
+	while(db) {
+		db->conns = uwsgi_calloc(sizeof(sqlite3 *) * uwsgi.cores);
+		db = db->next;
+	}
+	struct uwsgi_sqlite3_query *q = usqlite3.queries;
+	while(q) {
+		q->stmts = uwsgi_calloc(sizeof(sqlite3_stmt *) * uwsgi.cores);
+		q = q->next;
+	}
+}
+
+#ifdef UWSGI_ROUTING
+static sqlite3_stmt *uwsgi_sqlite3_stmt_get(struct uwsgi_sqlite3_query *q, int core_id) {
+	if (q->stmts[core_id]) return q->stmts[core_id];
+	struct uwsgi_sqlite3_db *db = q->db;
+	if (!db->conns[core_id]) {
+		db->conns[core_id] = uwsgi_sqlite3_open(db);
+		if (!db->conns[core_id]) return NULL;
+	}
+	if (sqlite3_prepare_v2(db->conns[core_id], q->sql, -1, &q->stmts[core_id], NULL)) {
+		uwsgi_log("[sqlite3] unable to prepare query \"%s\": %s\n", q->name, sqlite3_errmsg(db->conns[core_id]));
+		q->stmts[core_id] = NULL;
+		return NULL;
+	}
+	return q->stmts[core_id];
+}
+
+static char *uwsgi_route_var_sqlite(struct wsgi_request *wsgi_req, char *key, uint16_t keylen, uint16_t *vallen) {
+	if (!usqlite3.queries || !usqlite3.queries->stmts) return NULL;
+	char *colon = memchr(key, ':', keylen);
+	struct uwsgi_sqlite3_query *q = uwsgi_sqlite3_query_get(key, colon ? colon - key : keylen);
+	if (!q) return NULL;
+	sqlite3_stmt *stmt = uwsgi_sqlite3_stmt_get(q, wsgi_req->async_id);
+	if (!stmt) return NULL;
+
+	char *value = NULL;
+	if (colon) {
+		// bind the request vars to the parameters
+		char *vars = colon + 1;
+		size_t vars_len = keylen - ((colon - key) + 1);
+		int pos = 1;
+		while(vars_len > 0) {
+			char *comma = memchr(vars, ',', vars_len);
+			size_t var_len = comma ? (size_t) (comma - vars) : vars_len;
+			uint16_t var_vallen = 0;
+			char *var_value = uwsgi_get_var(wsgi_req, vars, var_len, &var_vallen);
+			if (var_value) {
+				if (sqlite3_bind_text(stmt, pos, var_value, var_vallen, SQLITE_STATIC)) goto end;
+			}
+			else {
+				if (sqlite3_bind_null(stmt, pos)) goto end;
+			}
+			pos++;
+			if (!comma) break;
+			vars_len -= var_len + 1;
+			vars = comma + 1;
+		}
+	}
+
+	if (sqlite3_step(stmt) == SQLITE_ROW) {
+		const unsigned char *column = sqlite3_column_text(stmt, 0);
+		if (column) {
+			int column_len = sqlite3_column_bytes(stmt, 0);
+			if (column_len > 0xffff) column_len = 0xffff;
+			value = uwsgi_concat2n((char *) column, column_len, "", 0);
+			*vallen = column_len;
+		}
+	}
+
+end:
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+	return value;
+}
+
+static void uwsgi_sqlite3_register() {
+	struct uwsgi_route_var *urv = uwsgi_register_route_var("sqlite", uwsgi_route_var_sqlite);
+	urv->need_free = 1;
+	urv = uwsgi_register_route_var("sqlite3", uwsgi_route_var_sqlite);
+	urv->need_free = 1;
+}
+#endif
+
+
 static int uwsgi_sqlite3_config_callback(void *magic_table, int field_count, char **fields, char **col) {
         // make a copy of the string
         if (field_count >= 2) {
@@ -43,11 +337,7 @@ static void uwsgi_sqlite3_config(char *file, char *magic_table[]) {
 
         uwsgi_log("[uWSGI] getting sqlite3 configuration from %s\n", file);
 
-#ifdef sqlite3_open_v2
         if (sqlite3_open_v2(file, &db, SQLITE_OPEN_READONLY, NULL)) {
-#else
-        if (sqlite3_open(file, &db)) {
-#endif
                 uwsgi_log("unable to open sqlite3 db: %s\n", sqlite3_errmsg(db));
                 sqlite3_close(db);
                 exit(1);
@@ -67,4 +357,9 @@ static void uwsgi_sqlite3_config(char *file, char *magic_table[]) {
 struct uwsgi_plugin sqlite3_plugin = {
 	.name = "sqlite3",
 	.options = uwsgi_sqlite3_options,
+#ifdef UWSGI_ROUTING
+	.on_load = uwsgi_sqlite3_register,
+#endif
+	.init = uwsgi_sqlite3_init,
+	.post_fork = uwsgi_sqlite3_post_fork,
 };
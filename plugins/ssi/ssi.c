@@ -8,6 +8,11 @@ extern struct uwsgi_server uwsgi;
 
 	uWSGI server side includes implementation
 
+	documents are compiled to a list of literal and command nodes, compiled documents (and the
+	files included by them) are cached per-worker and invalidated when the stat of the file changes
+	(--ssi-cache-items, --ssi-no-cache). The literal parts are sent directly from the cached
+	document, only the output of the commands is generated for each request.
+
 */
 
 
@@ -27,6 +32,43 @@ struct uwsgi_ssi_cmd {
 
 struct uwsgi_ssi_cmd *uwsgi_ssi_commands = NULL;
 
+// a literal (cmd == NULL) or a command, the strings point to the document source
+struct uwsgi_ssi_node {
+	char *buf;
+	size_t len;
+	struct uwsgi_ssi_cmd *cmd;
+	struct uwsgi_ssi_arg argv[UWSGI_SSI_MAX_ARGS];
+	int argc;
+};
+
+struct uwsgi_ssi_template {
+	char *filename;
+	// raw templates (included files) are not parsed
+	int raw;
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+	off_t size;
+	struct uwsgi_buffer *source;
+	struct uwsgi_ssi_node *nodes;
+	int nodes_cnt;
+	int refs;
+	int cached;
+};
+
+static struct uwsgi_ssi {
+	int no_cache;
+	uint64_t cache_items;
+	struct uwsgi_ssi_template **templates;
+	pthread_mutex_t lock;
+} ussi;
+
+static struct uwsgi_option uwsgi_ssi_options[] = {
+	{"ssi-cache-items", required_argument, 0, "set the max number of compiled ssi documents and included files cached by each worker (default 128)", uwsgi_opt_set_64bit, &ussi.cache_items, 0},
+	{"ssi-no-cache", no_argument, 0, "parse the ssi documents at every request", uwsgi_opt_true, &ussi.no_cache, 0},
+	UWSGI_END_OF_OPTIONS
+};
+
 static struct uwsgi_ssi_cmd* uwsgi_ssi_get_cmd(char *name, size_t name_len) {
 	struct uwsgi_ssi_cmd *usc = uwsgi_ssi_commands;
 	while(usc) {
@@ -63,7 +105,7 @@ static struct uwsgi_ssi_cmd *uwsgi_register_ssi_command(char *name, struct uwsgi
         return usc;
 }
 
-static int uwsgi_ssi_parse_args(struct wsgi_request *wsgi_req, char *buf, size_t len, struct uwsgi_ssi_arg *argv, int *argc) {
+static int uwsgi_ssi_parse_args(char *buf, size_t len, struct uwsgi_ssi_arg *argv, int *argc) {
 	// status [0]null/= [1]" [2]" [3]\s
 	size_t i;
 	uint8_t status = 0;
@@ -124,11 +166,12 @@ static int uwsgi_ssi_parse_args(struct wsgi_request *wsgi_req, char *buf, size_t
 	return 0;
 }
 
-static struct uwsgi_buffer *uwsgi_ssi_parse_command(struct wsgi_request *wsgi_req, char *buf, size_t len) {
+// resolve the command and its arguments, unknown or invalid commands are skipped (-1)
+static int uwsgi_ssi_compile_command(char *buf, size_t len, struct uwsgi_ssi_node *node) {
 
 	// storage for arguments
-	struct uwsgi_ssi_arg argv[UWSGI_SSI_MAX_ARGS];
-	int argc = 0;
+	struct uwsgi_ssi_arg *argv = node->argv;
+	node->argc = 0;
 
 	// first remove white spaces from the begin and the end
 	char *cmd = buf;
@@ -168,7 +211,7 @@ static struct uwsgi_buffer *uwsgi_ssi_parse_command(struct wsgi_request *wsgi_re
 	}
 
 	struct uwsgi_ssi_cmd *usc = uwsgi_ssi_get_cmd(ssi_cmd, ssi_cmd_len);
-	if (!usc) return NULL ;
+	if (!usc) return -1;
 
 	if (!found) goto run;
 
@@ -186,20 +229,48 @@ static struct uwsgi_buffer *uwsgi_ssi_parse_command(struct wsgi_request *wsgi_re
 		}
 	}
 
-	if (uwsgi_ssi_parse_args(wsgi_req, cmd_args, cmd_args_len, argv, &argc)) {
-		return NULL;
+	if (uwsgi_ssi_parse_args(cmd_args, cmd_args_len, argv, &node->argc)) {
+		return -1;
 	}
 
 run:
-	return usc->func(wsgi_req, argv, argc);
+	node->cmd = usc;
+	return 0;
+}
+
+static struct uwsgi_ssi_node *uwsgi_ssi_add_node(struct uwsgi_ssi_template *ust) {
+	ust->nodes = realloc(ust->nodes, sizeof(struct uwsgi_ssi_node) * (ust->nodes_cnt + 1));
+	if (!ust->nodes) {
+		uwsgi_error("uwsgi_ssi_add_node()/realloc()");
+		exit(1);
+	}
+	struct uwsgi_ssi_node *node = &ust->nodes[ust->nodes_cnt];
+	memset(node, 0, sizeof(struct uwsgi_ssi_node));
+	return node;
 }
 
-static struct uwsgi_buffer *uwsgi_ssi_parse(struct wsgi_request *wsgi_req, char *buf, size_t len) {
+static void uwsgi_ssi_add_literal(struct uwsgi_ssi_template *ust, char *buf, size_t len) {
+	if (!len) return;
+	struct uwsgi_ssi_node *node = uwsgi_ssi_add_node(ust);
+	node->buf = buf;
+	node->len = len;
+	ust->nodes_cnt++;
+}
+
+/*
+	compile the document in a list of nodes, the text between the commands is a literal
+	(unterminated tags and commands are dropped)
+*/
+static void uwsgi_ssi_compile(struct uwsgi_ssi_template *ust) {
+	char *buf = ust->source->buf;
+	size_t len = ust->source->pos;
 	size_t i;
 	uint8_t status = 0;
 	char *cmd = NULL;
 	size_t cmd_len = 0;
-	struct uwsgi_buffer *ub = uwsgi_buffer_new(len);
+	// the begin of the current literal and of the current tag
+	size_t literal = 0;
+	size_t tag = 0;
 	// parsing status 0[null] 1[<] 2[!] 3[-] 4[-] 5[#/-] 6[-] 7[>]
         // on status 6-7-8 the reset action come back to 5 instead of 0 
 	for(i=0;i<len;i++) {
@@ -207,50 +278,20 @@ static struct uwsgi_buffer *uwsgi_ssi_parse(struct wsgi_request *wsgi_req, char
 			case 0:
 				if (buf[i] == '<') {
 					status = 1;
-				}
-				else {
-					if (uwsgi_buffer_append(ub, &buf[i], 1)) goto error;
+					tag = i;
 				}
 				break;
 			case 1:
-				status = 0;
-				if (buf[i] == '!') {
-					status = 2;
-				}
-				else {
-					if (uwsgi_buffer_append(ub, "<", 1)) goto error;
-					if (uwsgi_buffer_append(ub, &buf[i], 1)) goto error;
-				}
+				status = buf[i] == '!' ? 2 : 0;
 				break;
 			case 2:
-				status = 0;
-				if (buf[i] == '-') {
-					status = 3;
-				}
-				else {
-					if (uwsgi_buffer_append(ub, "<!", 2)) goto error;
-					if (uwsgi_buffer_append(ub, &buf[i], 1)) goto error;
-				}
+				status = buf[i] == '-' ? 3 : 0;
 				break;
 			case 3:
-				status = 0;
-				if (buf[i] == '-') {
-					status = 4;
-				}
-				else {
-					if (uwsgi_buffer_append(ub, "<!-", 3)) goto error;
-					if (uwsgi_buffer_append(ub, &buf[i], 1)) goto error;
-				}
+				status = buf[i] == '-' ? 4 : 0;
 				break;
 			case 4:
-				status = 0;
-				if (buf[i] == '#') {
-					status = 5;
-				}
-				else {
-					if (uwsgi_buffer_append(ub, "<!--", 4)) goto error;
-					if (uwsgi_buffer_append(ub, &buf[i], 1)) goto error;
-				}
+				status = buf[i] == '#' ? 5 : 0;
 				break;
 			case 5:
 				if (buf[i] == '-') {
@@ -275,14 +316,12 @@ static struct uwsgi_buffer *uwsgi_ssi_parse(struct wsgi_request *wsgi_req, char
 				status = 5;
 				if (buf[i] == '>') {
 					status = 0;
-					struct uwsgi_buffer *ub_cmd = uwsgi_ssi_parse_command(wsgi_req, cmd, cmd_len);
-					if (ub_cmd) {
-						if (uwsgi_buffer_append(ub, ub_cmd->buf, ub_cmd->pos)) {
-							uwsgi_buffer_destroy(ub_cmd);
-							goto error;
-						}
-						uwsgi_buffer_destroy(ub_cmd);
+					uwsgi_ssi_add_literal(ust, buf + literal, tag - literal);
+					struct uwsgi_ssi_node *node = uwsgi_ssi_add_node(ust);
+					if (cmd && !uwsgi_ssi_compile_command(cmd, cmd_len, node)) {
+						ust->nodes_cnt++;
 					}
+					literal = i + 1;
 					cmd = NULL;
 					cmd_len = 0;	
                                 }
@@ -290,21 +329,172 @@ static struct uwsgi_buffer *uwsgi_ssi_parse(struct wsgi_request *wsgi_req, char
                                         cmd_len+=3;
                                 }
 				break;
-			default:
-				goto error;
 		}
 	}
 
-	return ub;
+	uwsgi_ssi_add_literal(ust, buf + literal, (status == 0 ? len : tag) - literal);
+}
 
-error:
-	uwsgi_buffer_destroy(ub);
-	return NULL;
+static void uwsgi_ssi_template_free(struct uwsgi_ssi_template *ust) {
+	if (!ust) return;
+	free(ust->filename);
+	if (ust->source) uwsgi_buffer_destroy(ust->source);
+	free(ust->nodes);
+	free(ust);
 }
 
-static int uwsgi_ssi_request(struct wsgi_request *wsgi_req) {
-	struct uwsgi_buffer *ub = NULL;
+static struct uwsgi_ssi_template *uwsgi_ssi_template_load(char *filename, int raw) {
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) return NULL;
+
+	struct stat st;
+	if (fstat(fd, &st)) {
+		close(fd);
+		return NULL;
+	}
+
+	struct uwsgi_ssi_template *ust = uwsgi_calloc(sizeof(struct uwsgi_ssi_template));
+	ust->filename = uwsgi_str(filename);
+	ust->raw = raw;
+	ust->dev = st.st_dev;
+	ust->ino = st.st_ino;
+	ust->mtime = st.st_mtime;
+	ust->size = st.st_size;
+	ust->refs = 1;
+	ust->source = uwsgi_buffer_new(st.st_size);
+	ssize_t rlen = read(fd, ust->source->buf, st.st_size);
+	close(fd);
+	if (rlen != st.st_size) {
+		uwsgi_ssi_template_free(ust);
+		return NULL;
+	}
+	ust->source->pos = rlen;
+
+	if (raw) {
+		uwsgi_ssi_add_literal(ust, ust->source->buf, ust->source->pos);
+	}
+	else {
+		uwsgi_ssi_compile(ust);
+	}
+	return ust;
+}
+
+static struct uwsgi_ssi_template **uwsgi_ssi_template_slot(char *filename, int raw) {
+	uint32_t hash = djb33x_hash(filename, strlen(filename)) ^ raw;
+	return &ussi.templates[hash % ussi.cache_items];
+}
+
+// get a compiled document, the cached one is reused if the file did not change
+static struct uwsgi_ssi_template *uwsgi_ssi_template_get(char *filename, int raw) {
+	if (!ussi.templates) return uwsgi_ssi_template_load(filename, raw);
+
+	struct stat st;
+	if (stat(filename, &st)) return NULL;
+
+	pthread_mutex_lock(&ussi.lock);
+	struct uwsgi_ssi_template *ust = *uwsgi_ssi_template_slot(filename, raw);
+	if (ust && ust->raw == raw && !strcmp(ust->filename, filename) && ust->dev == st.st_dev && ust->ino == st.st_ino
+		&& ust->mtime == st.st_mtime && ust->size == st.st_size) {
+		ust->refs++;
+		pthread_mutex_unlock(&ussi.lock);
+		return ust;
+	}
+	pthread_mutex_unlock(&ussi.lock);
+
+	ust = uwsgi_ssi_template_load(filename, raw);
+	if (!ust) return NULL;
+
+	// the old item could still be in use by other cores
+	struct uwsgi_ssi_template *old = NULL;
+	pthread_mutex_lock(&ussi.lock);
+	struct uwsgi_ssi_template **slot = uwsgi_ssi_template_slot(filename, raw);
+	if (*slot) {
+		(*slot)->cached = 0;
+		if (!(*slot)->refs) old = *slot;
+	}
+	*slot = ust;
+	ust->cached = 1;
+	pthread_mutex_unlock(&ussi.lock);
+
+	uwsgi_ssi_template_free(old);
+	return ust;
+}
+
+static void uwsgi_ssi_template_put(struct uwsgi_ssi_template *ust) {
+	if (!ussi.templates) {
+		uwsgi_ssi_template_free(ust);
+		return;
+	}
+	pthread_mutex_lock(&ussi.lock);
+	ust->refs--;
+	int destroy = !ust->refs && !ust->cached;
+	pthread_mutex_unlock(&ussi.lock);
+	if (destroy) uwsgi_ssi_template_free(ust);
+}
+
+/*
+	run the commands of the document and send the response,
+	literals are sent directly from the compiled document.
+	Returns -1 if the document cannot be loaded (no response is generated)
+*/
+static int uwsgi_ssi_serve(struct wsgi_request *wsgi_req, char *filename) {
+	struct uwsgi_ssi_template *ust = uwsgi_ssi_template_get(filename, 0);
+	if (!ust) return -1;
+
+	int i;
+	size_t total = 0;
+	struct uwsgi_buffer **outs = uwsgi_calloc(sizeof(struct uwsgi_buffer *) * (ust->nodes_cnt + 1));
+	for(i=0;i<ust->nodes_cnt;i++) {
+		struct uwsgi_ssi_node *node = &ust->nodes[i];
+		if (!node->cmd) {
+			total += node->len;
+			continue;
+		}
+		outs[i] = node->cmd->func(wsgi_req, node->argv, node->argc);
+		if (outs[i]) total += outs[i]->pos;
+	}
+
+	if (uwsgi_response_prepare_headers(wsgi_req, "200 OK", 6)) goto end;
+	if (uwsgi_response_add_content_length(wsgi_req, total)) goto end;
+	if (uwsgi_response_add_content_type(wsgi_req, "text/html", 9)) goto end;
+
+	struct iovec iov[UWSGI_RESPONSE_IOV];
+	size_t iov_cnt = 0;
+	for(i=0;i<ust->nodes_cnt;i++) {
+		struct uwsgi_ssi_node *node = &ust->nodes[i];
+		if (node->cmd) {
+			if (!outs[i] || !outs[i]->pos) continue;
+			iov[iov_cnt].iov_base = outs[i]->buf;
+			iov[iov_cnt].iov_len = outs[i]->pos;
+		}
+		else {
+			iov[iov_cnt].iov_base = node->buf;
+			iov[iov_cnt].iov_len = node->len;
+		}
+		iov_cnt++;
+		if (iov_cnt == UWSGI_RESPONSE_IOV) {
+			if (uwsgi_response_writev_body_do(wsgi_req, iov, iov_cnt)) goto end;
+			iov_cnt = 0;
+		}
+	}
+	if (iov_cnt > 0) {
+		uwsgi_response_writev_body_do(wsgi_req, iov, iov_cnt);
+	}
+	// an empty document
+	else if (!total) {
+		uwsgi_response_write_headers_do(wsgi_req);
+	}
+
+end:
+	for(i=0;i<ust->nodes_cnt;i++) {
+		if (outs[i]) uwsgi_buffer_destroy(outs[i]);
+	}
+	free(outs);
+	uwsgi_ssi_template_put(ust);
+	return 0;
+}
 
+static int uwsgi_ssi_request(struct wsgi_request *wsgi_req) {
 	if (uwsgi_parse_vars(wsgi_req)) {
                 return -1;
         }
@@ -326,40 +516,10 @@ static int uwsgi_ssi_request(struct wsgi_request *wsgi_req) {
 		return UWSGI_OK;
 	}
 
-	struct uwsgi_buffer *ub_ssi = uwsgi_buffer_from_file(real_filename);
-	free(real_filename);
-	if (!ub_ssi) {
+	if (uwsgi_ssi_serve(wsgi_req, real_filename)) {
 		uwsgi_500(wsgi_req);
-		return UWSGI_OK;
-	}
-
-	ub = uwsgi_ssi_parse(wsgi_req, ub_ssi->buf, ub_ssi->pos);
-	uwsgi_buffer_destroy(ub_ssi);
-	if (!ub) {
-               	uwsgi_500(wsgi_req);
-		return UWSGI_OK;
-	}
-	// prepare headers
-       	if (uwsgi_response_prepare_headers(wsgi_req, "200 OK", 6)) {
-               	uwsgi_500(wsgi_req);
-               	goto end;
-       	}
-       	// content_length
-       	if (uwsgi_response_add_content_length(wsgi_req, ub->pos)) {
-               	uwsgi_500(wsgi_req);
-               	goto end;
-       	}
-       	// content_type
-       	if (uwsgi_response_add_content_type(wsgi_req, "text/html", 9)) {
-               	uwsgi_500(wsgi_req);
-               	goto end;
-       	}
-
-	uwsgi_response_write_body_do(wsgi_req, ub->buf, ub->pos);
-end:
-	if (ub) {
-		uwsgi_buffer_destroy(ub);
 	}
+	free(real_filename);
 	return UWSGI_OK;
 }
 
@@ -422,10 +582,16 @@ static struct uwsgi_buffer *ssi_cmd_include(struct wsgi_request *wsgi_req, struc
 
 	char *filename = uwsgi_concat2n(var, var_len, "", 0);
 
-	struct uwsgi_buffer *ub = uwsgi_buffer_from_file(filename);
-
+	struct uwsgi_ssi_template *ust = uwsgi_ssi_template_get(filename, 1);
 	free(filename);
+	if (!ust) return NULL;
 
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(ust->source->pos);
+	if (uwsgi_buffer_append(ub, ust->source->buf, ust->source->pos)) {
+		uwsgi_buffer_destroy(ub);
+		ub = NULL;
+	}
+	uwsgi_ssi_template_put(ust);
 	return ub;
 }
 
@@ -463,30 +629,14 @@ static struct uwsgi_buffer *ssi_cmd_cache(struct wsgi_request *wsgi_req, struct
 
 static int uwsgi_routing_func_ssi(struct wsgi_request *wsgi_req, struct uwsgi_route *ur){
 
-	struct uwsgi_buffer *ub = NULL;
-
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *) (((char *)(wsgi_req))+ur->subject_len);
 
         struct uwsgi_buffer *ub_filename = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
-        if (!ub_filename) goto end;
+        if (!ub_filename) return UWSGI_ROUTE_BREAK;
 
-	struct uwsgi_buffer *ub_ssi = uwsgi_buffer_from_file(ub_filename->buf);
+	uwsgi_ssi_serve(wsgi_req, ub_filename->buf);
 	uwsgi_buffer_destroy(ub_filename);
-	if (!ub_ssi) goto end;
-
-	ub = uwsgi_ssi_parse(wsgi_req, ub_ssi->buf, ub_ssi->pos);
-	uwsgi_buffer_destroy(ub_ssi);
-	if (!ub) goto end;
-
-        if (uwsgi_response_prepare_headers(wsgi_req, "200 OK", 6)) goto end;
-        if (uwsgi_response_add_content_length(wsgi_req, ub->pos)) goto end;
-        if (uwsgi_response_add_content_type(wsgi_req, "text/html", 9)) goto end;
-
-        uwsgi_response_write_body_do(wsgi_req, ub->buf, ub->pos);
-	
-end:
-	if (ub) uwsgi_buffer_destroy(ub);
         return UWSGI_ROUTE_BREAK;
 }
 
@@ -507,6 +657,16 @@ static int uwsgi_ssi_init() {
 	return 0;
 }
 
+static void uwsgi_ssi_post_fork() {
+	if (ussi.no_cache) return;
+	if (!ussi.cache_items) ussi.cache_items = 128;
+	if (pthread_mutex_init(&ussi.lock, NULL)) {
+		uwsgi_error("uwsgi_ssi_post_fork()/pthread_mutex_init()");
+		exit(1);
+	}
+	ussi.templates = uwsgi_calloc(sizeof(struct uwsgi_ssi_template *) * ussi.cache_items);
+}
+
 
 static void uwsgi_ssi_register_router() {
 	uwsgi_register_router("ssi", uwsgi_router_ssi);
@@ -520,6 +680,8 @@ struct uwsgi_plugin ssi_plugin = {
 	.name = "ssi",
 	.modifier1 = 19,
 	.init = uwsgi_ssi_init,
+	.options = uwsgi_ssi_options,
+	.post_fork = uwsgi_ssi_post_fork,
 	.request = uwsgi_ssi_request,
 	.after_request = uwsgi_ssi_log,
 	.on_load = uwsgi_ssi_register_router,
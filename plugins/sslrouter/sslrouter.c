@@ -126,6 +126,10 @@ static struct uwsgi_option sslrouter_options[] = {
 	{"sslrouter2", required_argument, 0, "run the sslrouter on the specified port (key-value based)", uwsgi_opt_sslrouter2, &usr, 0},
 	{"sslrouter-session-context", required_argument, 0, "set the session id context to the specified value", uwsgi_opt_set_str, &usr.ssl_session_context, 0},
 	{"sslrouter-processes", required_argument, 0, "prefork the specified number of sslrouter processes", uwsgi_opt_set_int, &usr.cr.processes, 0},
+	{"sslrouter-reuse-port", no_argument, 0, "give each sslrouter process its own SO_REUSEPORT listener", uwsgi_opt_true, &usr.cr.reuse_port, 0},
+	{"sslrouter-batch-events", no_argument, 0, "apply the changes of the sslrouter event interests in a batch before waiting (epoll only)", uwsgi_opt_true, &usr.cr.defer_events, 0},
+	{"sslrouter-edge-triggered", no_argument, 0, "use edge-triggered events for the sslrouter peers (epoll only, implies batched events)", uwsgi_opt_true, &usr.cr.edge_triggered, 0},
+	{"sslrouter-prealloc", required_argument, 0, "preallocate the specified number of sessions (with their peers and buffers) in each sslrouter process", uwsgi_opt_set_64bit, &usr.cr.prealloc, 0},
 	{"sslrouter-workers", required_argument, 0, "prefork the specified number of sslrouter processes", uwsgi_opt_set_int, &usr.cr.processes, 0},
 	{"sslrouter-zerg", required_argument, 0, "attach the sslrouter to a zerg server", uwsgi_opt_corerouter_zerg, &usr, 0},
 	{"sslrouter-use-cache", optional_argument, 0, "use uWSGI cache as hostname->server mapper for the sslrouter", uwsgi_opt_set_str, &usr.cr.use_cache, 0},
@@ -12,6 +12,8 @@ example:
 
 it exports values exposed by the metric subsystem
 
+lines are coalesced (newline separated) in datagrams of up to --stats-pusher-mtu bytes
+
 (it is based on the statsd plugin)
 
 */
@@ -25,9 +27,10 @@ struct socket_node {
 	socklen_t addr_len;
 	char *prefix;
 	uint16_t prefix_len;
+	struct uwsgi_stats_pusher_dgram *dgram;
 };
 
-static int socket_send_metric(struct uwsgi_buffer *ub, struct uwsgi_stats_pusher_instance *uspi, struct uwsgi_metric *um) {
+static int socket_send_metric(struct uwsgi_buffer *ub, struct uwsgi_stats_pusher_instance *uspi, struct uwsgi_metric *um, int64_t value) {
 	struct socket_node *sn = (struct socket_node *) uspi->data;
 	// reset the buffer
         ub->pos = 0;
@@ -37,13 +40,9 @@ static int socket_send_metric(struct uwsgi_buffer *ub, struct uwsgi_stats_pusher
 	if (uwsgi_buffer_append(ub, " ", 1)) return -1;
         if (uwsgi_buffer_num64(ub, (int64_t) um->type)) return -1;
 	if (uwsgi_buffer_append(ub, " ", 1)) return -1;
-        if (uwsgi_buffer_num64(ub, *um->value)) return -1;
-
-        if (sendto(sn->fd, ub->buf, ub->pos, 0, (struct sockaddr *) &sn->addr.sa_in, sn->addr_len) < 0) {
-                uwsgi_error("socket_send_metric()/sendto()");
-        }
+        if (uwsgi_buffer_num64(ub, value)) return -1;
 
-        return 0;
+	return uwsgi_stats_pusher_dgram_add(sn->dgram, ub->buf, ub->pos);
 
 }
 
@@ -80,25 +79,33 @@ static void stats_pusher_socket(struct uwsgi_stats_pusher_instance *uspi, time_t
                         return;
 		}
 		uwsgi_socket_nb(sn->fd);
+		sn->dgram = uwsgi_stats_pusher_dgram_new(sn->fd, (struct sockaddr *) &sn->addr.sa_in, sn->addr_len);
 		if (comma) *comma = ',';
 		uspi->data = sn;
 		uspi->configured = 1;
 	}
 
-	// we use the same buffer for all of the packets
+	struct socket_node *sn = (struct socket_node *) uspi->data;
+	// we use the same buffer for all of the lines, they are coalesced in datagrams
 	struct uwsgi_buffer *ub = uwsgi_buffer_new(uwsgi.page_size);
 	struct uwsgi_metric *um = uwsgi.metrics;
+	int pos = 0;
 	while(um) {
 		uwsgi_rlock(uwsgi.metrics_lock);
-		socket_send_metric(ub, uspi, um);
+		int64_t value = *um->value;
 		uwsgi_rwunlock(uwsgi.metrics_lock);
+		if (uwsgi_stats_pusher_changed(uspi, pos, value)) {
+			socket_send_metric(ub, uspi, um, value);
+		}
 		if (um->reset_after_push){
 			uwsgi_wlock(uwsgi.metrics_lock);
 			*um->value = um->initial_value;
 			uwsgi_rwunlock(uwsgi.metrics_lock);
 		}
 		um = um->next;
+		pos++;
 	}
+	uwsgi_stats_pusher_dgram_flush(sn->dgram);
 	uwsgi_buffer_destroy(ub);
 }
 
@@ -12,6 +12,8 @@ example:
 
 it exports values exposed by the metric subsystem
 
+lines are coalesced (newline separated) in datagrams of up to --stats-pusher-mtu bytes
+
 */
 
 extern struct uwsgi_server uwsgi;
@@ -23,6 +25,7 @@ struct statsd_node {
 	socklen_t addr_len;
 	char *prefix;
 	uint16_t prefix_len;
+	struct uwsgi_stats_pusher_dgram *dgram;
 };
 
 static int statsd_send_metric(struct uwsgi_buffer *ub, struct uwsgi_stats_pusher_instance *uspi, char *metric, size_t metric_len, int64_t value, char type[2]) {
@@ -36,11 +39,7 @@ static int statsd_send_metric(struct uwsgi_buffer *ub, struct uwsgi_stats_pusher
         if (uwsgi_buffer_num64(ub, value)) return -1;
 	if (uwsgi_buffer_append(ub, type, 2)) return -1;
 
-        if (sendto(sn->fd, ub->buf, ub->pos, 0, (struct sockaddr *) &sn->addr.sa_in, sn->addr_len) < 0) {
-                uwsgi_error("statsd_send_metric()/sendto()");
-        }
-
-        return 0;
+	return uwsgi_stats_pusher_dgram_add(sn->dgram, ub->buf, ub->pos);
 
 }
 
@@ -77,31 +76,39 @@ static void stats_pusher_statsd(struct uwsgi_stats_pusher_instance *uspi, time_t
                         return;
 		}
 		uwsgi_socket_nb(sn->fd);
+		sn->dgram = uwsgi_stats_pusher_dgram_new(sn->fd, (struct sockaddr *) &sn->addr.sa_in, sn->addr_len);
 		if (comma) *comma = ',';
 		uspi->data = sn;
 		uspi->configured = 1;
 	}
 
-	// we use the same buffer for all of the packets
+	struct statsd_node *sn = (struct statsd_node *) uspi->data;
+	// we use the same buffer for all of the lines, they are coalesced in datagrams
 	struct uwsgi_buffer *ub = uwsgi_buffer_new(uwsgi.page_size);
 	struct uwsgi_metric *um = uwsgi.metrics;
+	int pos = 0;
 	while(um) {
 		uwsgi_rlock(uwsgi.metrics_lock);
-		// ignore return value
-		if (um->type == UWSGI_METRIC_GAUGE) {
-			statsd_send_metric(ub, uspi, um->name, um->name_len, *um->value, "|g");
-		}
-		else {
-			statsd_send_metric(ub, uspi, um->name, um->name_len, *um->value, "|c");
-		}
+		int64_t value = *um->value;
 		uwsgi_rwunlock(uwsgi.metrics_lock);
+		if (uwsgi_stats_pusher_changed(uspi, pos, value)) {
+			// ignore return value
+			if (um->type == UWSGI_METRIC_GAUGE) {
+				statsd_send_metric(ub, uspi, um->name, um->name_len, value, "|g");
+			}
+			else {
+				statsd_send_metric(ub, uspi, um->name, um->name_len, value, "|c");
+			}
+		}
 		if (um->reset_after_push){
 			uwsgi_wlock(uwsgi.metrics_lock);
 			*um->value = um->initial_value;
 			uwsgi_rwunlock(uwsgi.metrics_lock);
 		}
 		um = um->next;
+		pos++;
 	}
+	uwsgi_stats_pusher_dgram_flush(sn->dgram);
 	uwsgi_buffer_destroy(ub);
 }
 
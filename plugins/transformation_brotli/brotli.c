@@ -0,0 +1,152 @@
+#include <uwsgi.h>
+
+#ifdef UWSGI_ROUTING
+
+#include <brotli/encode.h>
+
+extern struct uwsgi_server uwsgi;
+
+/*
+
+	brotli transformation, works like the gzip one (streaming, Content-Encoding: br)
+
+	remember to fix the content_length (or use chunked encoding) !!!
+
+*/
+
+struct uwsgi_transformation_brotli {
+	BrotliEncoderState *state;
+	size_t len;
+	uint8_t header;
+	// reused between chunks (swapped with ut->chunk)
+	struct uwsgi_buffer *scratch;
+};
+
+static int transform_brotli_compress(struct uwsgi_transformation_brotli *utbr, char *buf, size_t len, BrotliEncoderOperation op) {
+	struct uwsgi_buffer *out = utbr->scratch;
+	out->pos = 0;
+	size_t avail_in = len;
+	const uint8_t *next_in = (const uint8_t *) buf;
+	for(;;) {
+		if (uwsgi_buffer_ensure(out, len + 4096)) return -1;
+		size_t avail_out = out->len - out->pos;
+		uint8_t *next_out = (uint8_t *) out->buf + out->pos;
+		if (!BrotliEncoderCompressStream(utbr->state, op, &avail_in, &next_in, &avail_out, &next_out, NULL)) return -1;
+		out->pos = out->len - avail_out;
+		if (avail_in == 0 && !BrotliEncoderHasMoreOutput(utbr->state)) {
+			if (op != BROTLI_OPERATION_FINISH || BrotliEncoderIsFinished(utbr->state)) break;
+		}
+	}
+	return 0;
+}
+
+static int transform_brotli(struct wsgi_request *wsgi_req, struct uwsgi_transformation *ut) {
+	struct uwsgi_transformation_brotli *utbr = (struct uwsgi_transformation_brotli *) ut->data;
+	struct uwsgi_buffer *ub = ut->chunk;
+
+	if (ut->is_final) {
+		if (utbr->len > 0) {
+			if (transform_brotli_compress(utbr, NULL, 0, BROTLI_OPERATION_FINISH)) return -1;
+			if (uwsgi_buffer_append(ub, utbr->scratch->buf, utbr->scratch->pos)) return -1;
+		}
+		return 0;
+	}
+
+	if (ub->pos == 0) {
+		// Don't try to compress empty responses.
+		return 0;
+	}
+
+	if (transform_brotli_compress(utbr, ub->buf, ub->pos, BROTLI_OPERATION_FLUSH)) return -1;
+	utbr->len += ub->pos;
+	if (!utbr->header) {
+		// do not check for errors !!!
+		uwsgi_response_add_header(wsgi_req, "Content-Encoding", 16, "br", 2);
+		utbr->header = 1;
+	}
+
+	// swap the buffers, the old chunk memory will be reused for the next one
+	struct uwsgi_buffer tmp = *ub;
+	ub->buf = utbr->scratch->buf;
+	ub->pos = utbr->scratch->pos;
+	ub->len = utbr->scratch->len;
+	utbr->scratch->buf = tmp.buf;
+	utbr->scratch->len = tmp.len;
+	utbr->scratch->pos = 0;
+
+	return 0;
+}
+
+static void transform_brotli_free(struct uwsgi_transformation *ut) {
+	struct uwsgi_transformation_brotli *utbr = (struct uwsgi_transformation_brotli *) ut->data;
+	BrotliEncoderDestroyInstance(utbr->state);
+	uwsgi_buffer_destroy(utbr->scratch);
+	free(utbr);
+}
+
+static int uwsgi_routing_func_brotli(struct wsgi_request *wsgi_req, struct uwsgi_route *ur) {
+	struct uwsgi_transformation_brotli *utbr = uwsgi_calloc(sizeof(struct uwsgi_transformation_brotli));
+	utbr->state = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+	if (!utbr->state) {
+		free(utbr);
+		return UWSGI_ROUTE_BREAK;
+	}
+	BrotliEncoderSetParameter(utbr->state, BROTLI_PARAM_QUALITY, (uint32_t) ur->custom);
+	utbr->scratch = uwsgi_buffer_new(uwsgi.page_size);
+	struct uwsgi_transformation *ut = uwsgi_add_transformation(wsgi_req, transform_brotli, utbr);
+	ut->can_stream = 1;
+	// this is the trasformation flushing the stream, the free hook releases the memory
+	ut = uwsgi_add_transformation(wsgi_req, transform_brotli, utbr);
+	ut->is_final = 1;
+	ut->free = transform_brotli_free;
+	return UWSGI_ROUTE_NEXT;
+}
+
+/*
+	brotli
+	brotli:5
+	brotli:quality=11
+*/
+static int uwsgi_router_brotli(struct uwsgi_route *ur, char *args) {
+	ur->func = uwsgi_routing_func_brotli;
+	// the brotli default (11) is too slow for dynamic content
+	int quality = 5;
+	if (args && *args) {
+		char *s_quality = NULL;
+		if (strchr(args, '=')) {
+			if (uwsgi_kvlist_parse(args, strlen(args), ',', '=',
+				"quality", &s_quality,
+				"level", &s_quality, NULL)) {
+				uwsgi_log("invalid brotli route syntax: %s\n", args);
+				return -1;
+			}
+		}
+		else {
+			s_quality = uwsgi_str(args);
+		}
+		if (s_quality) {
+			quality = atoi(s_quality);
+			free(s_quality);
+			if (quality < BROTLI_MIN_QUALITY || quality > BROTLI_MAX_QUALITY) {
+				uwsgi_log("invalid brotli quality: %s\n", args);
+				return -1;
+			}
+		}
+	}
+	ur->custom = (uint64_t) quality;
+	return 0;
+}
+
+static void router_brotli_register(void) {
+	uwsgi_register_router("brotli", uwsgi_router_brotli);
+}
+
+struct uwsgi_plugin transformation_brotli_plugin = {
+	.name = "transformation_brotli",
+	.on_load = router_brotli_register,
+};
+#else
+struct uwsgi_plugin transformation_brotli_plugin = {
+	.name = "transformation_brotli",
+};
+#endif
@@ -2,6 +2,8 @@
 
 #if defined(UWSGI_ROUTING) && defined(UWSGI_ZLIB)
 
+extern struct uwsgi_server uwsgi;
+
 /*
 
 	gzip transformations add content-encoding to your headers and changes the final size !!!
@@ -11,24 +13,114 @@
 */
 
 struct uwsgi_transformation_gzip {
-	z_stream z;
+	z_stream *z;
 	uint32_t crc32;
 	size_t len;
 	uint8_t header;
+	uint8_t pooled;
+	// reused between chunks (swapped with ut->chunk)
+	struct uwsgi_buffer *scratch;
 };
 
+/*
+	each core keeps its z_stream (and its scratch buffer) alive between requests,
+	they are recycled with deflateReset()/deflateParams() instead of paying
+	deflateInit2()/deflateEnd() (and ~256k of allocations) for every response
+*/
+struct uwsgi_transformation_gzip_core {
+	z_stream z;
+	int level;
+	uint8_t initialized;
+	uint8_t busy;
+	struct uwsgi_buffer *scratch;
+};
+
+static struct uwsgi_transformation_gzip_core *gzip_cores;
+
 extern char gzheader[];
 
+static int transform_gzip_init(z_stream *z, int level) {
+	z->zalloc = Z_NULL;
+	z->zfree = Z_NULL;
+	z->opaque = Z_NULL;
+	if (deflateInit2(z, level, Z_DEFLATED, -15, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+		return -1;
+	}
+	return 0;
+}
+
+static int transform_gzip_acquire(struct wsgi_request *wsgi_req, struct uwsgi_transformation_gzip *utgz, int level) {
+	if (gzip_cores && wsgi_req->async_id < uwsgi.cores) {
+		struct uwsgi_transformation_gzip_core *ugc = &gzip_cores[wsgi_req->async_id];
+		// the same request could have multiple gzip transformations
+		if (!ugc->busy) {
+			if (!ugc->initialized) {
+				if (transform_gzip_init(&ugc->z, level)) return -1;
+				ugc->level = level;
+				ugc->initialized = 1;
+				ugc->scratch = uwsgi_buffer_new(uwsgi.page_size);
+			}
+			else {
+				if (deflateReset(&ugc->z) != Z_OK) return -1;
+				if (ugc->level != level) {
+					if (deflateParams(&ugc->z, level, Z_DEFAULT_STRATEGY) != Z_OK) return -1;
+					ugc->level = level;
+				}
+				ugc->scratch->pos = 0;
+			}
+			ugc->busy = 1;
+			utgz->z = &ugc->z;
+			utgz->scratch = ugc->scratch;
+			utgz->pooled = 1;
+			return 0;
+		}
+	}
+
+	utgz->z = uwsgi_malloc(sizeof(z_stream));
+	if (transform_gzip_init(utgz->z, level)) {
+		free(utgz->z);
+		utgz->z = NULL;
+		return -1;
+	}
+	utgz->scratch = uwsgi_buffer_new(uwsgi.page_size);
+	return 0;
+}
+
+// deflate a chunk in the scratch buffer (no per-chunk allocations)
+static int transform_gzip_deflate(struct uwsgi_transformation_gzip *utgz, char *buf, size_t len, int flush) {
+	struct uwsgi_buffer *out = utgz->scratch;
+	out->pos = 0;
+	// the gzip header + the worst case for a flushed chunk
+	if (uwsgi_buffer_ensure(out, 10 + len + (len >> 12) + 30)) return -1;
+	if (!utgz->header) {
+		memcpy(out->buf, gzheader, 10);
+		out->pos = 10;
+	}
+	utgz->z->avail_in = len;
+	utgz->z->next_in = (Bytef *) buf;
+	for(;;) {
+		utgz->z->avail_out = out->len - out->pos;
+		utgz->z->next_out = (Bytef *) out->buf + out->pos;
+		int ret = deflate(utgz->z, flush);
+		if (ret != Z_OK && ret != Z_STREAM_END) return -1;
+		out->pos = out->len - utgz->z->avail_out;
+		if (flush == Z_FINISH ? ret == Z_STREAM_END : utgz->z->avail_out > 0) break;
+		if (uwsgi_buffer_ensure(out, 4096)) return -1;
+	}
+	return 0;
+}
+
 static int transform_gzip(struct wsgi_request *wsgi_req, struct uwsgi_transformation *ut) {
 	struct uwsgi_transformation_gzip *utgz = (struct uwsgi_transformation_gzip *) ut->data;
 	struct uwsgi_buffer *ub = ut->chunk;
 
 	if (ut->is_final) {
-		if (utgz->len > 0 && uwsgi_gzip_fix(&utgz->z, utgz->crc32, ub, utgz->len)) {
-			free(utgz);
-			return -1;
+		if (utgz->len > 0) {
+			if (transform_gzip_deflate(utgz, NULL, 0, Z_FINISH)) return -1;
+			if (uwsgi_buffer_append(ub, utgz->scratch->buf, utgz->scratch->pos)) return -1;
+			if (uwsgi_buffer_u32le(ub, utgz->crc32)) return -1;
+			if (uwsgi_buffer_u32le(ub, utgz->len)) return -1;
 		}
-		free(utgz);
 		return 0;
 	}
 
@@ -37,42 +129,96 @@ static int transform_gzip(struct wsgi_request *wsgi_req, struct uwsgi_transforma
 		return 0;
 	}
 
-	size_t dlen = 0;
-	char *gzipped = uwsgi_gzip_chunk(&utgz->z, &utgz->crc32, ub->buf, ub->pos, &dlen);
-	if (!gzipped) return -1;
+	uwsgi_crc32(&utgz->crc32, ub->buf, ub->pos);
+	if (transform_gzip_deflate(utgz, ub->buf, ub->pos, Z_SYNC_FLUSH)) return -1;
 	utgz->len += ub->pos;
-	uwsgi_buffer_map(ub, gzipped, dlen);
 	if (!utgz->header) {
 		// do not check for errors !!!
 		uwsgi_response_add_header(wsgi_req, "Content-Encoding", 16, "gzip", 4);
 		utgz->header = 1;
-		if (uwsgi_buffer_insert(ub, 0, gzheader, 10)) {
-			return -1;
-		}
 	}
 
+	// swap the buffers, the old chunk memory will be reused for the next one
+	struct uwsgi_buffer tmp = *ub;
+	ub->buf = utgz->scratch->buf;
+	ub->pos = utgz->scratch->pos;
+	ub->len = utgz->scratch->len;
+	utgz->scratch->buf = tmp.buf;
+	utgz->scratch->len = tmp.len;
+	utgz->scratch->pos = 0;
+
 	return 0;
 }
 
+static void transform_gzip_free(struct uwsgi_transformation *ut) {
+	struct uwsgi_transformation_gzip *utgz = (struct uwsgi_transformation_gzip *) ut->data;
+	if (utgz->pooled) {
+		// the core keeps the stream (and the scratch buffer) for the next request
+		struct uwsgi_transformation_gzip_core *ugc = (struct uwsgi_transformation_gzip_core *) utgz->z;
+		ugc->scratch = utgz->scratch;
+		ugc->busy = 0;
+	}
+	else {
+		deflateEnd(utgz->z);
+		free(utgz->z);
+		uwsgi_buffer_destroy(utgz->scratch);
+	}
+	free(utgz);
+}
+
 static int uwsgi_routing_func_gzip(struct wsgi_request *wsgi_req, struct uwsgi_route *ur) {
 	struct uwsgi_transformation_gzip *utgz = uwsgi_calloc(sizeof(struct uwsgi_transformation_gzip));
-	if (uwsgi_gzip_prepare(&utgz->z, NULL, 0, &utgz->crc32)) {
+	uwsgi_crc32(&utgz->crc32, NULL, 0);
+	if (transform_gzip_acquire(wsgi_req, utgz, (int) ur->custom)) {
 		free(utgz);
 		return UWSGI_ROUTE_BREAK;
 	}
 	struct uwsgi_transformation *ut = uwsgi_add_transformation(wsgi_req, transform_gzip, utgz);
 	ut->can_stream = 1;
-	// this is the trasformation clearing the memory
+	// this is the trasformation flushing the stream, the free hook releases the memory
 	ut = uwsgi_add_transformation(wsgi_req, transform_gzip, utgz);
 	ut->is_final = 1;
+	ut->free = transform_gzip_free;
 	return UWSGI_ROUTE_NEXT;
 }
 
+/*
+	gzip
+	gzip:6
+	gzip:level=9
+*/
 static int uwsgi_router_gzip(struct uwsgi_route *ur, char *args) {
 	ur->func = uwsgi_routing_func_gzip;
+	int level = Z_DEFAULT_COMPRESSION;
+	if (args && *args) {
+		char *s_level = NULL;
+		if (strchr(args, '=')) {
+			if (uwsgi_kvlist_parse(args, strlen(args), ',', '=',
+				"level", &s_level, NULL)) {
+				uwsgi_log("invalid gzip route syntax: %s\n", args);
+				return -1;
+			}
+		}
+		else {
+			s_level = uwsgi_str(args);
+		}
+		if (s_level) {
+			level = atoi(s_level);
+			free(s_level);
+			if (level < 0 || level > 9) {
+				uwsgi_log("invalid gzip compression level: %s\n", args);
+				return -1;
+			}
+		}
+	}
+	ur->custom = (uint64_t) level;
 	return 0;
 }
 
+static void transformation_gzip_post_fork() {
+	gzip_cores = uwsgi_calloc(sizeof(struct uwsgi_transformation_gzip_core) * uwsgi.cores);
+}
+
 static void router_gzip_register(void) {
 	uwsgi_register_router("gzip", uwsgi_router_gzip);
 }
@@ -80,6 +226,7 @@ static void router_gzip_register(void) {
 struct uwsgi_plugin transformation_gzip_plugin = {
 	.name = "transformation_gzip",
 	.on_load = router_gzip_register,
+	.post_fork = transformation_gzip_post_fork,
 };
 #else
 struct uwsgi_plugin transformation_gzip_plugin = {
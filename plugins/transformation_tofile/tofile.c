@@ -13,53 +13,238 @@ struct uwsgi_router_tofile_conf {
 	// the mode of the file
 	char *mode;
 	size_t mode_len;
+
+	// write-behind in the offload threads
+	char *offload;
+	char *offload_max;
+	size_t max;
 };
 
 // this is allocated for each transformation
 struct uwsgi_transformation_tofile_conf {
 	struct uwsgi_buffer *filename;
+	// chunks are streamed to a temp file, renamed at the end
+	char *tmp_filename;
+	int fd;
+	int failed;
+	// write-behind: the response is kept in memory and written by an offload thread
+	struct uwsgi_buffer *ub;
+	size_t max;
+	uint64_t started_at;
 };
 
+static struct uwsgi_offload_engine *tofile_offload_engine;
+
+/*
+	tofile offload engine (write-behind):
+		ubuf -> the response body
+		ubuf1 -> the filename (zero terminated)
+		custom1 -> the time the caching request started
+
+	regular files cannot be monitored by the event queue, so the whole
+	job is done on the first round. If a file newer than the request
+	appeared meanwhile, the write is skipped.
+*/
+static int tofile_offload_prepare(struct wsgi_request *wsgi_req, struct uwsgi_offload_request *uor) {
+	if (!uor->ubuf || !uor->ubuf1) return -1;
+	return 0;
+}
+
+static int tofile_offload_do(struct uwsgi_thread *ut, struct uwsgi_offload_request *uor, int fd) {
+	char *filename = uor->ubuf1->buf;
+	struct stat st;
+	if (!stat(filename, &st) && (uint64_t) st.st_mtime >= (uint64_t) uor->custom1) {
+		return -1;
+	}
+
+	char *tmp_filename = uwsgi_concat2(filename, ".XXXXXX");
+	int tmp_fd = mkstemp(tmp_filename);
+	if (tmp_fd < 0) {
+		uwsgi_error_open(tmp_filename);
+		free(tmp_filename);
+		return -1;
+	}
+	if (fchmod(tmp_fd, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH)) {
+		uwsgi_error("tofile_offload_do()/fchmod()");
+	}
+
+	while(uor->written < uor->ubuf->pos) {
+		ssize_t rlen = write(tmp_fd, uor->ubuf->buf + uor->written, uor->ubuf->pos - uor->written);
+		if (rlen <= 0) {
+			uwsgi_error("tofile_offload_do()/write()");
+			goto error;
+		}
+		uor->written += rlen;
+	}
+
+	close(tmp_fd);
+	tmp_fd = -1;
+	if (rename(tmp_filename, filename)) {
+		uwsgi_error("tofile_offload_do()/rename()");
+		goto error;
+	}
+	free(tmp_filename);
+	return -1;
+
+error:
+	if (tmp_fd > -1) close(tmp_fd);
+	unlink(tmp_filename);
+	free(tmp_filename);
+	return -1;
+}
+
+// hand the buffered response to an offload thread, on error the file is simply not cached
+static void transform_tofile_offload(struct wsgi_request *wsgi_req, struct uwsgi_transformation_tofile_conf *uttc) {
+	struct uwsgi_offload_request uor;
+	uwsgi_offload_setup(tofile_offload_engine, &uor, wsgi_req, 0);
+	// the client socket is not involved
+	uor.s = -1;
+	uor.ubuf = uttc->ub;
+	uor.ubuf1 = uwsgi_buffer_new(uttc->filename->pos + 1);
+	if (uwsgi_buffer_append(uor.ubuf1, uttc->filename->buf, uttc->filename->pos)) goto error;
+	if (uwsgi_buffer_append(uor.ubuf1, "\0", 1)) goto error;
+	uor.custom1 = uttc->started_at;
+	if (uwsgi_offload_run(wsgi_req, &uor, NULL)) goto error;
+	// now owned by the offload thread
+	uttc->ub = NULL;
+	return;
+error:
+	uwsgi_buffer_destroy(uor.ubuf1);
+}
+
+// the in-memory response is too big, go on as a synchronous stream
+static int transform_tofile_spill(struct uwsgi_transformation_tofile_conf *uttc) {
+	struct uwsgi_buffer *ub = uttc->ub;
+	uttc->ub = NULL;
+	uttc->tmp_filename = uwsgi_concat2(uttc->filename->buf, ".XXXXXX");
+	uttc->fd = mkstemp(uttc->tmp_filename);
+	if (uttc->fd < 0) {
+		uwsgi_error_open(uttc->tmp_filename);
+		goto error;
+	}
+	if (fchmod(uttc->fd, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH)) {
+		uwsgi_error("transform_tofile_spill()/fchmod()");
+	}
+	size_t remains = ub->pos;
+	while(remains) {
+		ssize_t rlen = write(uttc->fd, ub->buf + (ub->pos - remains), remains);
+		if (rlen <= 0) {
+			uwsgi_error("transform_tofile_spill()/write()");
+			goto error;
+		}
+		remains -= rlen;
+	}
+	uwsgi_buffer_destroy(ub);
+	return 0;
+error:
+	uwsgi_buffer_destroy(ub);
+	return -1;
+}
+
+static void transform_tofile_abort(struct uwsgi_transformation_tofile_conf *uttc) {
+	uttc->failed = 1;
+	if (uttc->ub) {
+		uwsgi_buffer_destroy(uttc->ub);
+		uttc->ub = NULL;
+	}
+	if (uttc->fd > -1) {
+		close(uttc->fd);
+		uttc->fd = -1;
+		unlink(uttc->tmp_filename);
+	}
+}
+
 static int transform_tofile(struct wsgi_request *wsgi_req, struct uwsgi_transformation *ut) {
 	
 	struct uwsgi_transformation_tofile_conf *uttc = (struct uwsgi_transformation_tofile_conf *) ut->data;
 	struct uwsgi_buffer *ub = ut->chunk;
 
+	if (uttc->failed) return 0;
+
 	// store only successfull response
-	if (wsgi_req->write_errors == 0 && wsgi_req->status == 200 && ub->pos > 0) {
-		if (uttc->filename) {
-			int fd = open(uttc->filename->buf, O_WRONLY|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
-			if (fd < 0) {
-				uwsgi_error_open(uttc->filename->buf);
-				goto end;
+	if (wsgi_req->write_errors > 0 || wsgi_req->status != 200) {
+		transform_tofile_abort(uttc);
+		return 0;
+	}
+
+	// write-behind mode, the response is accumulated in memory
+	if (uttc->ub) {
+		if (ub->pos > 0) {
+			if (uttc->ub->pos + ub->pos > uttc->max) {
+				if (transform_tofile_spill(uttc)) {
+					transform_tofile_abort(uttc);
+					return 0;
+				}
 			}
-			// lock the file
-			if (uwsgi_fcntl_lock(fd)) {
-				close(fd);
+			else {
+				if (uwsgi_buffer_append(uttc->ub, ub->buf, ub->pos)) {
+					transform_tofile_abort(uttc);
+				}
 				goto end;
 			}
-			// write to it
-			size_t remains = ub->pos;
-			while(remains) {
-				ssize_t rlen = write(fd, ub->buf + (ub->pos - remains), remains);
-				if (rlen <= 0) {
-					uwsgi_req_error("transform_tofile()/write()");
-					unlink(uttc->filename->buf);
-					break;
-				}
-				remains -= rlen;
+		}
+		else {
+			goto end;
+		}
+	}
+
+	// the final round could receive the trailer of a previous transformation (like gzip)
+	if (ub->pos > 0) {
+		if (uttc->fd < 0) {
+			uttc->tmp_filename = uwsgi_concat2(uttc->filename->buf, ".XXXXXX");
+			uttc->fd = mkstemp(uttc->tmp_filename);
+			if (uttc->fd < 0) {
+				uwsgi_error_open(uttc->tmp_filename);
+				uttc->failed = 1;
+				return 0;
+			}
+			if (fchmod(uttc->fd, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH)) {
+				uwsgi_req_error("transform_tofile()/fchmod()");
 			}
-                        // unlock/close
-			close(fd);
+		}
+
+		// write the chunk (the data passes through untouched)
+		size_t remains = ub->pos;
+		while(remains) {
+			ssize_t rlen = write(uttc->fd, ub->buf + (ub->pos - remains), remains);
+			if (rlen <= 0) {
+				uwsgi_req_error("transform_tofile()/write()");
+				transform_tofile_abort(uttc);
+				return 0;
+			}
+			remains -= rlen;
 		}
 	}
 
 end:
-	// free resources
+	if (ut->is_final && uttc->ub) {
+		if (uttc->ub->pos > 0) {
+			transform_tofile_offload(wsgi_req, uttc);
+		}
+		transform_tofile_abort(uttc);
+		return 0;
+	}
+
+	if (ut->is_final && uttc->fd > -1) {
+		close(uttc->fd);
+		uttc->fd = -1;
+		if (rename(uttc->tmp_filename, uttc->filename->buf)) {
+			uwsgi_req_error("transform_tofile()/rename()");
+			unlink(uttc->tmp_filename);
+		}
+		uttc->failed = 1;
+	}
+
+        return 0;
+}
+
+static void transform_tofile_free(struct uwsgi_transformation *ut) {
+	struct uwsgi_transformation_tofile_conf *uttc = (struct uwsgi_transformation_tofile_conf *) ut->data;
+	// the final round has not been reached
+	transform_tofile_abort(uttc);
+	if (uttc->tmp_filename) free(uttc->tmp_filename);
 	if (uttc->filename) uwsgi_buffer_destroy(uttc->filename);
 	free(uttc);
-	// reset the buffer
-        return 0;
 }
 
 
@@ -68,6 +253,7 @@ static int uwsgi_routing_func_tofile(struct wsgi_request *wsgi_req, struct uwsgi
 	struct uwsgi_router_tofile_conf *urtc = (struct uwsgi_router_tofile_conf *) ur->data2;
 
 	struct uwsgi_transformation_tofile_conf *uttc = uwsgi_calloc(sizeof(struct uwsgi_transformation_tofile_conf));
+	uttc->fd = -1;
 
 	// build key and name
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
@@ -75,8 +261,20 @@ static int uwsgi_routing_func_tofile(struct wsgi_request *wsgi_req, struct uwsgi
 
         uttc->filename = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, urtc->filename, urtc->filename_len);
         if (!uttc->filename) goto error;
+
+	// without offload threads the file is streamed synchronously
+	if (urtc->offload && uwsgi.offload_threads > 0) {
+		uttc->ub = uwsgi_buffer_new(uwsgi.page_size);
+		uttc->max = urtc->max;
+		uttc->started_at = uwsgi_now();
+	}
 	
-	uwsgi_add_transformation(wsgi_req, transform_tofile, uttc);
+	struct uwsgi_transformation *ut = uwsgi_add_transformation(wsgi_req, transform_tofile, uttc);
+	ut->can_stream = 1;
+	// commits the file
+	ut = uwsgi_add_transformation(wsgi_req, transform_tofile, uttc);
+	ut->is_final = 1;
+	ut->free = transform_tofile_free;
 	return UWSGI_ROUTE_NEXT;
 
 error:
@@ -93,7 +291,9 @@ static int uwsgi_router_tofile(struct uwsgi_route *ur, char *args) {
 	if (uwsgi_kvlist_parse(ur->data, ur->data_len, ',', '=',
                         "filename", &urtc->filename,
                         "name", &urtc->filename,
-                        "mode", &urtc->mode, NULL)) {
+                        "mode", &urtc->mode,
+                        "offload", &urtc->offload,
+                        "offload_max", &urtc->offload_max, NULL)) {
                 uwsgi_log("invalid tofile route syntax: %s\n", args);
 		goto error;
 	}
@@ -103,6 +303,11 @@ static int uwsgi_router_tofile(struct uwsgi_route *ur, char *args) {
 		goto error;
 	}
         urtc->filename_len = strlen(urtc->filename);
+	// responses bigger than this are streamed synchronously
+	urtc->max = 8 * 1024 * 1024;
+	if (urtc->offload_max) {
+		urtc->max = uwsgi_n64(urtc->offload_max);
+	}
 	ur->data2 = urtc;
         return 0;
 error:
@@ -114,6 +319,7 @@ error:
 static void router_tofile_register() {
 	uwsgi_register_router("tofile", uwsgi_router_tofile);
 	uwsgi_register_router("to-file", uwsgi_router_tofile);
+	tofile_offload_engine = uwsgi_offload_register_engine("tofile", tofile_offload_prepare, tofile_offload_do);
 }
 
 struct uwsgi_plugin transformation_tofile_plugin = {
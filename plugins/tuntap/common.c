@@ -19,7 +19,11 @@ struct uwsgi_tuntap_peer *uwsgi_tuntap_peer_create(struct uwsgi_tuntap_router *u
 	uttp->fd = fd;
 	// leave space fot he uwsgi header
 	uttp->buf = uwsgi_malloc(utt.buffer_size + 4);
-	uttp->write_buf = uwsgi_malloc(utt.buffer_size);
+	uttp->write_buf = uwsgi_malloc(utt.write_buffer_size);
+
+	uint32_t slot = uwsgi_tuntap_hash(fd);
+	uttp->fd_next = uttr->peers_by_fd[slot];
+	uttr->peers_by_fd[slot] = uttp;
 
 	if (uttr->peers_tail) {
 		uttr->peers_tail->next = uttp;
@@ -72,6 +76,36 @@ void uwsgi_tuntap_peer_destroy(struct uwsgi_tuntap_router *uttr, struct uwsgi_tu
 		uttr->peers_tail = prev;
 	}
 
+	struct uwsgi_tuntap_peer **slot = &uttr->peers_by_fd[uwsgi_tuntap_hash(uttp->fd)];
+	while (*slot) {
+		if (*slot == uttp) {
+			*slot = uttp->fd_next;
+			break;
+		}
+		slot = &(*slot)->fd_next;
+	}
+
+	if (uttp->hashed) {
+		slot = &uttr->peers_by_addr[uwsgi_tuntap_hash(uttp->addr)];
+		while (*slot) {
+			if (*slot == uttp) {
+				*slot = uttp->addr_next;
+				break;
+			}
+			slot = &(*slot)->addr_next;
+		}
+	}
+
+	if (uttp->pending) {
+		int i;
+		for(i=0;i<uttr->pending_cnt;i++) {
+			if (uttr->pending[i] == uttp) {
+				uttr->pending[i] = uttr->pending[--uttr->pending_cnt];
+				break;
+			}
+		}
+	}
+
 	free(uttp->buf);
 	free(uttp->write_buf);
 	if (uttp->rules) free(uttp->rules);
@@ -82,11 +116,23 @@ void uwsgi_tuntap_peer_destroy(struct uwsgi_tuntap_router *uttr, struct uwsgi_tu
 
 // get a peer by addr
 struct uwsgi_tuntap_peer *uwsgi_tuntap_peer_get_by_addr(struct uwsgi_tuntap_router *uttr, uint32_t addr) {
-	struct uwsgi_tuntap_peer *uttp = uttr->peers_head;
+	struct uwsgi_tuntap_peer *uttp = uttr->peers_by_addr[uwsgi_tuntap_hash(addr)];
 	while (uttp) {
 		if (uttp->addr == addr)
 			return uttp;
-		uttp = uttp->next;
+		uttp = uttp->addr_next;
+	}
+
+	return NULL;
+}
+
+// get a peer by fd
+struct uwsgi_tuntap_peer *uwsgi_tuntap_peer_get_by_fd(struct uwsgi_tuntap_router *uttr, int fd) {
+	struct uwsgi_tuntap_peer *uttp = uttr->peers_by_fd[uwsgi_tuntap_hash(fd)];
+	while (uttp) {
+		if (uttp->fd == fd)
+			return uttp;
+		uttp = uttp->fd_next;
 	}
 
 	return NULL;
@@ -196,10 +242,16 @@ int uwsgi_tuntap_register_addr(struct uwsgi_tuntap_router *uttr, struct uwsgi_tu
         	uwsgi_tuntap_error(uttp, "uwsgi_tuntap_register_addr()/inet_ntop()");
                 return -1;
         }
-        if (uttp != tmp_uttp) {
+        if (tmp_uttp && uttp != tmp_uttp) {
         	uwsgi_log("[tuntap-router] detected ip collision for %s\n", ip);
                 uwsgi_tuntap_peer_destroy(uttr, tmp_uttp);
         }
+	if (!uttp->hashed) {
+		uint32_t slot = uwsgi_tuntap_hash(uttp->addr);
+		uttp->addr_next = uttr->peers_by_addr[slot];
+		uttr->peers_by_addr[slot] = uttp;
+		uttp->hashed = 1;
+	}
         uwsgi_log("[tuntap-router] registered new peer %s (fd: %d)\n", ip, uttp->fd);
         memcpy(uttp->ip, ip, INET_ADDRSTRLEN + 1);
 	return 0;
@@ -290,6 +342,10 @@ enqueue:
 // enqueue a packet to the client
 int uwsgi_tuntap_peer_enqueue(struct uwsgi_tuntap_router *uttr, struct uwsgi_tuntap_peer *uttp) {
 
+	// a stale write event (the queue has been flushed in the same cycle)
+	if (uttp->written >= uttp->write_buf_pktsize)
+		return 0;
+
 	ssize_t rlen = write(uttp->fd, uttp->write_buf + uttp->written, uttp->write_buf_pktsize - uttp->written);
 	if (rlen == 0) {
 		uwsgi_tuntap_error(uttp, "uwsgi_tuntap_peer_enqueue()/write()");
@@ -328,9 +384,6 @@ int uwsgi_tuntap_peer_enqueue(struct uwsgi_tuntap_router *uttr, struct uwsgi_tun
 		return 0;
 	}
 
-	memmove(uttp->write_buf, uttp->write_buf + rlen, uttp->write_buf_pktsize - rlen);
-	uttp->write_buf_pktsize -= rlen;
-
 retry:
 	if (!uttp->wait_for_write) {
 		if (event_queue_fd_read_to_readwrite(uttr->queue, uttp->fd)) {
@@ -343,6 +396,49 @@ retry:
 	return 0;
 }
 
+// append a packet (prefixed by the uwsgi header) to the write queue of a peer
+int uwsgi_tuntap_peer_append(struct uwsgi_tuntap_peer *uttp, char *pkt, uint16_t pktsize) {
+	// first try to reclaim the already written part
+	if (uttp->write_buf_pktsize + 4 + pktsize > (uint32_t) utt.write_buffer_size && uttp->written > 0) {
+		memmove(uttp->write_buf, uttp->write_buf + uttp->written, uttp->write_buf_pktsize - uttp->written);
+		uttp->write_buf_pktsize -= uttp->written;
+		uttp->written = 0;
+	}
+
+	// the write queue is full
+	if (uttp->write_buf_pktsize + 4 + pktsize > (uint32_t) utt.write_buffer_size) {
+		uttp->dropped++;
+		return -1;
+	}
+
+	char *ptr = uttp->write_buf + uttp->write_buf_pktsize;
+	memcpy(ptr + 4, pkt, pktsize);
+	ptr[0] = 0;
+	ptr[1] = (uint8_t) (pktsize & 0xff);
+	ptr[2] = (uint8_t) ((pktsize >> 8) & 0xff);
+	ptr[3] = 0;
+	uttp->write_buf_pktsize += pktsize + 4;
+	return 0;
+}
+
+// mark a peer as having packets in the current batch
+void uwsgi_tuntap_peer_pending(struct uwsgi_tuntap_router *uttr, struct uwsgi_tuntap_peer *uttp) {
+	if (uttp->pending) return;
+	uttp->pending = 1;
+	uttr->pending[uttr->pending_cnt++] = uttp;
+}
+
+// a single write() for each peer with packets in the current batch
+void uwsgi_tuntap_flush(struct uwsgi_tuntap_router *uttr) {
+	while (uttr->pending_cnt > 0) {
+		struct uwsgi_tuntap_peer *uttp = uttr->pending[--uttr->pending_cnt];
+		uttp->pending = 0;
+		if (uwsgi_tuntap_peer_enqueue(uttr, uttp)) {
+			uwsgi_tuntap_peer_destroy(uttr, uttp);
+		}
+	}
+}
+
 int uwsgi_tuntap_device(char *name) {
 	struct ifreq ifr;
         int fd = open(UWSGI_TUNTAP_DEVICE, O_RDWR);
@@ -5,6 +5,11 @@
 #define UWSGI_TUNTAP_DEVICE "/dev/net/tun"
 #endif
 
+// peers are indexed by address and by fd (2^bits buckets each)
+#define UWSGI_TUNTAP_HASH_BITS 10
+#define UWSGI_TUNTAP_HASH_SIZE (1 << UWSGI_TUNTAP_HASH_BITS)
+#define uwsgi_tuntap_hash(x) ((((uint32_t) (x)) * 2654435761U) >> (32 - UWSGI_TUNTAP_HASH_BITS))
+
 /*
 
         a peer is a client connected to the router. It has 2 queue, one for read
@@ -36,10 +41,16 @@ struct uwsgi_tuntap_peer {
         uint16_t buf_pktsize;
         uint16_t buf_pos;
         char *write_buf;
-        uint16_t write_buf_pktsize;
+        uint32_t write_buf_pktsize;
         uint16_t write_buf_pos;
         struct uwsgi_tuntap_peer *prev;
         struct uwsgi_tuntap_peer *next;
+	// hash chains
+	struct uwsgi_tuntap_peer *addr_next;
+	struct uwsgi_tuntap_peer *fd_next;
+	int hashed;
+	// queued in the current batch
+	int pending;
 	// counters
 	uint64_t tx;
 	uint64_t rx;
@@ -72,6 +83,11 @@ struct uwsgi_tuntap_router {
         char *write_buf;
         struct uwsgi_tuntap_peer *peers_head;
         struct uwsgi_tuntap_peer *peers_tail;
+	struct uwsgi_tuntap_peer *peers_by_addr[UWSGI_TUNTAP_HASH_SIZE];
+	struct uwsgi_tuntap_peer *peers_by_fd[UWSGI_TUNTAP_HASH_SIZE];
+	// peers with packets appended in the current batch
+	struct uwsgi_tuntap_peer **pending;
+	int pending_cnt;
         uint16_t write_pktsize;
         uint16_t write_pos;
         int wait_for_write;
@@ -79,7 +95,7 @@ struct uwsgi_tuntap_router {
 	int stats_server_fd;
 	char *gateway;
 	int gateway_fd;
-	char *gateway_buf;
+	struct uwsgi_dgram_batch *gateway_batch;
 	char *subscription_server;
 	int subscription_server_fd;
 };
@@ -88,6 +104,8 @@ struct uwsgi_tuntap {
         struct uwsgi_string_list *routers;
         struct uwsgi_string_list *devices;
         uint16_t buffer_size;
+	int write_buffer_size;
+	int batch;
         struct uwsgi_tuntap_firewall_rule *fw_in;
         struct uwsgi_tuntap_firewall_rule *fw_out;
         struct uwsgi_tuntap_firewall_rule *routes;
@@ -106,6 +124,10 @@ int uwsgi_tuntap_route_check(int , char *, uint16_t);
 
 struct uwsgi_tuntap_peer *uwsgi_tuntap_peer_create(struct uwsgi_tuntap_router *, int, int);
 struct uwsgi_tuntap_peer *uwsgi_tuntap_peer_get_by_addr(struct uwsgi_tuntap_router *,uint32_t);
+struct uwsgi_tuntap_peer *uwsgi_tuntap_peer_get_by_fd(struct uwsgi_tuntap_router *, int);
+int uwsgi_tuntap_peer_append(struct uwsgi_tuntap_peer *, char *, uint16_t);
+void uwsgi_tuntap_peer_pending(struct uwsgi_tuntap_router *, struct uwsgi_tuntap_peer *);
+void uwsgi_tuntap_flush(struct uwsgi_tuntap_router *);
 void uwsgi_tuntap_peer_destroy(struct uwsgi_tuntap_router *, struct uwsgi_tuntap_peer *);
 
 int uwsgi_tuntap_device(char *);
@@ -65,6 +65,8 @@ static struct uwsgi_option uwsgi_tuntap_options[] = {
 	{"tuntap-router-route", required_argument, 0, "add a routing rule to the tuntap router (syntax: <src/mask> <dst/mask> <gateway>)", uwsgi_tuntap_opt_route, &utt.routes, 0},
 	{"tuntap-router-stats", required_argument, 0, "run the tuntap router stats server", uwsgi_opt_set_str, &utt.stats_server, 0},
 	{"tuntap-device-rule", required_argument, 0, "add a tuntap device rule (syntax: <direction> <src/mask> <dst/mask> <action> [target])", uwsgi_opt_add_string_list, &utt.device_rules, 0},
+	{"tuntap-batch", required_argument, 0, "set the max number of packets read from a tuntap device (or the router gateway) for each wakeup (default 32)", uwsgi_opt_set_int, &utt.batch, 0},
+	{"tuntap-write-buffer-size", required_argument, 0, "set the size of the write queue of each peer (default 65536)", uwsgi_opt_set_int, &utt.write_buffer_size, 0},
 	{NULL, 0, 0, NULL, NULL, NULL, 0},
 };
 
@@ -84,6 +86,10 @@ static void *uwsgi_tuntap_loop(void *arg) {
 
 	if (!utt.buffer_size)
 		utt.buffer_size = 8192;
+	if (utt.write_buffer_size < utt.buffer_size + 4)
+		utt.write_buffer_size = 65536;
+	if (utt.batch <= 0)
+		utt.batch = 32;
 	uttr->buf = uwsgi_malloc(utt.buffer_size);
 	uttr->write_buf = uwsgi_malloc(utt.buffer_size);
 
@@ -112,26 +118,23 @@ static void *uwsgi_tuntap_loop(void *arg) {
 				uwsgi_tuntap_enqueue(uttr);
 				continue;
 			}
-			ssize_t rlen = read(uttr->fd, uttr->buf, utt.buffer_size);
-			if (rlen <= 0) {
-				uwsgi_error("uwsgi_tuntap_loop()/read()");
-				exit(1);
+			// queue up to utt.batch packets for a single write
+			int i, queued = 0;
+			for(i=0;i<utt.batch;i++) {
+				ssize_t rlen = read(uttr->fd, uttr->buf, utt.buffer_size);
+				if (rlen < 0 && uwsgi_is_again()) break;
+				if (rlen <= 0) {
+					uwsgi_error("uwsgi_tuntap_loop()/read()");
+					exit(1);
+				}
+
+				// check for full write buffer
+				if (uwsgi_tuntap_peer_append(uttp, uttr->buf, rlen)) continue;
+				queued++;
 			}
 
-			// check for full write buffer
-                        if (uttp->write_buf_pktsize + 4 + rlen > utt.buffer_size) {
-                        	uttp->dropped++;
-                                continue;
-                        }
+			if (!queued) continue;
 
-			uint16_t pktsize = rlen;
-			char *ptr = uttp->write_buf + uttp->write_buf_pktsize;
-			memcpy(ptr + 4, uttr->buf, rlen);
-			ptr[0] = 0;
-			ptr[1] = (uint8_t) (pktsize & 0xff);
-			ptr[2] = (uint8_t) ((pktsize >> 8) & 0xff);
-			ptr[3] = 0;
-			uttp->write_buf_pktsize+= pktsize+4;
 			if (uwsgi_tuntap_peer_enqueue(uttr, uttp)) {
 				uwsgi_log_verbose("tuntap server disconnected...\n");
 				exit(1);
@@ -198,14 +201,71 @@ static void uwsgi_tuntap_client() {
 
 void tuntaprouter_send_stats(struct uwsgi_tuntap_router *);
 
+// drain up to utt.batch packets from the tuntap device, peers are written once per batch
+static void uwsgi_tuntap_router_read_device(struct uwsgi_tuntap_router *uttr) {
+	int i;
+	for(i=0;i<utt.batch;i++) {
+		ssize_t rlen = read(uttr->fd, uttr->buf, utt.buffer_size);
+		if (rlen < 0 && uwsgi_is_again()) break;
+		if (rlen <= 0) {
+			uwsgi_error("uwsgi_tuntap_router_loop()/read()");
+			exit(1);
+		}
+		if (rlen < 20) continue;
+
+		if (uwsgi_tuntap_firewall_check(utt.fw_in, uttr->buf, rlen)) continue;
+
+		uint32_t *dst_ip = (uint32_t *) & uttr->buf[16];
+		struct uwsgi_tuntap_peer *uttp = uwsgi_tuntap_peer_get_by_addr(uttr, *dst_ip);
+		if (!uttp)
+			continue;
+
+		if (uwsgi_tuntap_peer_rules_check(uttr, uttp, uttr->buf, rlen, 0)) continue;
+
+		// check for full write buffer
+		if (uwsgi_tuntap_peer_append(uttp, uttr->buf, rlen)) continue;
+		uwsgi_tuntap_peer_pending(uttr, uttp);
+	}
+	uwsgi_tuntap_flush(uttr);
+}
+
+// the same for the gateway, with a single recvmmsg()
+static void uwsgi_tuntap_router_read_gateway(struct uwsgi_tuntap_router *uttr) {
+	int i;
+	int n = uwsgi_dgram_batch_recv(uttr->gateway_fd, uttr->gateway_batch);
+	if (n < 0) {
+		uwsgi_error("uwsgi_tuntap_router_loop()/recvmmsg()");
+		return;
+	}
+	for(i=0;i<n;i++) {
+		ssize_t rlen = uttr->gateway_batch->len[i];
+		char *pkt = uwsgi_dgram_batch_buf(uttr->gateway_batch, i);
+		if (rlen < 20) continue;
+		if (uwsgi_tuntap_firewall_check(utt.fw_in, pkt, rlen)) continue;
+		uint32_t *dst_ip = (uint32_t *) & pkt[16];
+		struct uwsgi_tuntap_peer *uttp = uwsgi_tuntap_peer_get_by_addr(uttr, *dst_ip);
+		if (!uttp)
+			continue;
+
+		// check for full write buffer
+		if (uwsgi_tuntap_peer_append(uttp, pkt, rlen)) continue;
+		uwsgi_tuntap_peer_pending(uttr, uttp);
+	}
+	uwsgi_tuntap_flush(uttr);
+}
+
 void uwsgi_tuntap_router_loop(int id, void *arg) {
 	int i;
 
 	struct uwsgi_tuntap_router *uttr = (struct uwsgi_tuntap_router *) arg;
 	uttr->buf = uwsgi_malloc(utt.buffer_size);
 	uttr->write_buf = uwsgi_malloc(utt.buffer_size);
+	uttr->pending = uwsgi_calloc(sizeof(struct uwsgi_tuntap_peer *) * utt.batch);
 	uttr->queue = event_queue_init();
 
+	// required for draining the device
+	uwsgi_socket_nb(uttr->fd);
+
 	uttr->stats_server_fd = -1;
 	uttr->gateway_fd = -1;
 
@@ -240,7 +300,7 @@ void uwsgi_tuntap_router_loop(int id, void *arg) {
 		if (uttr->gateway_fd < 0) exit(1);
                 if (event_queue_add_fd_read(uttr->queue, uttr->gateway_fd)) exit(1);
 		uwsgi_log("*** tuntap gateway address enabled on %s\n", uttr->gateway);
-		uttr->gateway_buf = uwsgi_malloc(utt.buffer_size);
+		uttr->gateway_batch = uwsgi_dgram_batch_new(utt.batch, utt.buffer_size);
 		uwsgi_socket_nb(uttr->gateway_fd);
 	}
 
@@ -254,40 +314,7 @@ void uwsgi_tuntap_router_loop(int id, void *arg) {
 					uwsgi_tuntap_enqueue(uttr);
 					continue;
 				}
-				ssize_t rlen = read(uttr->fd, uttr->buf, utt.buffer_size);
-				if (rlen <= 0) {
-					uwsgi_error("uwsgi_tuntap_router_loop()/read()");
-					exit(1);
-				}
-				if (rlen < 20) continue;
-
-				if (uwsgi_tuntap_firewall_check(utt.fw_in, uttr->buf, rlen)) continue;
-
-
-				uint32_t *dst_ip = (uint32_t *) & uttr->buf[16];
-				struct uwsgi_tuntap_peer *uttp = uwsgi_tuntap_peer_get_by_addr(uttr, *dst_ip);
-				if (!uttp)
-					continue;
-
-				if (uwsgi_tuntap_peer_rules_check(uttr, uttp, uttr->buf, rlen, 0)) continue;
-
-				// check for full write buffer
-				if (uttp->write_buf_pktsize + 4 + rlen > utt.buffer_size) {
-					uttp->dropped++;
-					continue;
-				}
-
-				uint16_t pktsize = rlen;
-                        	char *ptr = uttp->write_buf + uttp->write_buf_pktsize;
-                        	memcpy(ptr + 4, uttr->buf, rlen);
-                        	ptr[0] = 0;
-                        	ptr[1] = (uint8_t) (pktsize & 0xff);
-                        	ptr[2] = (uint8_t) ((pktsize >> 8) & 0xff);
-                        	ptr[3] = 0;
-                        	uttp->write_buf_pktsize+= pktsize+4;
-				if (uwsgi_tuntap_peer_enqueue(uttr, uttp)) {
-					uwsgi_tuntap_peer_destroy(uttr, uttp);
-				}
+				uwsgi_tuntap_router_read_device(uttr);
 				continue;
 			}
 
@@ -316,39 +343,12 @@ void uwsgi_tuntap_router_loop(int id, void *arg) {
 			}
 
 			if (uttr->gateway_fd > -1 && interesting_fd == uttr->gateway_fd) {
-				ssize_t rlen = read(uttr->gateway_fd, uttr->gateway_buf, utt.buffer_size);	
-				if (rlen <= 0) {
-                                        uwsgi_error("uwsgi_tuntap_router_loop()/read()");
-					continue;
-                                }
-				if (rlen < 20) continue;
-				if (uwsgi_tuntap_firewall_check(utt.fw_in, uttr->gateway_buf, rlen)) continue;
-				uint32_t *dst_ip = (uint32_t *) & uttr->gateway_buf[16];
-                                struct uwsgi_tuntap_peer *uttp = uwsgi_tuntap_peer_get_by_addr(uttr, *dst_ip);
-                                if (!uttp)
-                                        continue;
-
-                                // check for full write buffer
-                                if (uttp->write_buf_pktsize + 4 + rlen > utt.buffer_size) {
-                                        uttp->dropped++;
-                                        continue;
-                                }
-
-                                uint16_t pktsize = rlen;
-                                char *ptr = uttp->write_buf + uttp->write_buf_pktsize;
-                                memcpy(ptr + 4, uttr->gateway_buf, rlen);
-                                ptr[0] = 0;
-                                ptr[1] = (uint8_t) (pktsize & 0xff);
-                                ptr[2] = (uint8_t) ((pktsize >> 8) & 0xff);
-                                ptr[3] = 0;
-                                uttp->write_buf_pktsize+= pktsize+4;
-                                if (uwsgi_tuntap_peer_enqueue(uttr, uttp)) {
-                                        uwsgi_tuntap_peer_destroy(uttr, uttp);
-                                }
-                                continue;
+				uwsgi_tuntap_router_read_gateway(uttr);
+				continue;
 			}
 
-			struct uwsgi_tuntap_peer *uttp = uttr->peers_head;
+			// walk the fd hash chain
+			struct uwsgi_tuntap_peer *uttp = uwsgi_tuntap_peer_get_by_fd(uttr, interesting_fd);
 			while (uttp) {
 				if (interesting_fd == uttp->fd) {
 					// read from the client
@@ -403,7 +403,7 @@ void uwsgi_tuntap_router_loop(int id, void *arg) {
 					}
 					break;
 				}
-				uttp = uttp->next;
+				uttp = uttp->fd_next;
 			}
 		}
 	}
@@ -415,6 +415,10 @@ static void uwsgi_tuntap_router() {
 
 	if (!utt.buffer_size)
 		utt.buffer_size = 8192;
+	if (utt.write_buffer_size < utt.buffer_size + 4)
+		utt.write_buffer_size = 65536;
+	if (utt.batch <= 0)
+		utt.batch = 32;
 
 	if (utt.use_credentials) {
 		if (utt.use_credentials[0] != 0 && strcmp(utt.use_credentials, "true")) {
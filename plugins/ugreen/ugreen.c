@@ -17,32 +17,118 @@ struct uwsgi_plugin ugreen_plugin = {
 struct uwsgi_ugreen {
 	int             ugreen;
         int             stackpages;
-        ucontext_t      main;
         ucontext_t    *contexts;
         size_t          u_stack_size;
+	int		fast;
+	// saved stack pointers of the cores (fast switch)
+	void		**sps;
 } ug;
 
 #define UGREEN_DEFAULT_STACKSIZE 256*1024
 
+// the main context of the loop (one for each --async-threads)
+static __thread ucontext_t ugreen_main;
+
+#if defined(__x86_64__) && defined(__ELF__)
+#define UGREEN_FAST_SWITCH
+/*
+	swapcontext() saves and restores the signal mask (a syscall for each switch),
+	this switches stack saving only the callee-saved registers and the fpu control words.
+
+	void uwsgi_ugreen_switch(void **save_sp, void *new_sp)
+*/
+__asm__ (
+	".text\n"
+	".globl uwsgi_ugreen_switch\n"
+	".hidden uwsgi_ugreen_switch\n"
+	".type uwsgi_ugreen_switch,@function\n"
+	"uwsgi_ugreen_switch:\n"
+	"	pushq %rbp\n"
+	"	pushq %rbx\n"
+	"	pushq %r12\n"
+	"	pushq %r13\n"
+	"	pushq %r14\n"
+	"	pushq %r15\n"
+	"	subq $8, %rsp\n"
+	"	stmxcsr (%rsp)\n"
+	"	fnstcw 4(%rsp)\n"
+	"	movq %rsp, (%rdi)\n"
+	"	movq %rsi, %rsp\n"
+	"	ldmxcsr (%rsp)\n"
+	"	fldcw 4(%rsp)\n"
+	"	addq $8, %rsp\n"
+	"	popq %r15\n"
+	"	popq %r14\n"
+	"	popq %r13\n"
+	"	popq %r12\n"
+	"	popq %rbx\n"
+	"	popq %rbp\n"
+	"	ret\n"
+	".size uwsgi_ugreen_switch,.-uwsgi_ugreen_switch\n"
+);
+void uwsgi_ugreen_switch(void **, void *);
+
+static __thread void *ugreen_main_sp;
+static __thread void *ugreen_dead_sp;
+
+static void u_green_fast_run(void) {
+	async_schedule_to_req_green();
+	// the request is over, the next one will start with a new frame
+	uwsgi_ugreen_switch(&ugreen_dead_sp, ugreen_main_sp);
+}
+
+// build the initial frame of a core (uwsgi_ugreen_switch will "return" to u_green_fast_run)
+static void *u_green_fast_frame(int id) {
+	uintptr_t top = ((uintptr_t) ug.contexts[id].uc_stack.ss_sp + ug.contexts[id].uc_stack.ss_size) & ~((uintptr_t) 15);
+	uint64_t *frame = (uint64_t *) (top - 16);
+	frame[0] = (uint64_t) (uintptr_t) u_green_fast_run;
+	frame[1] = 0;
+	// rbp, rbx, r12-r15
+	memset(frame - 6, 0, sizeof(uint64_t) * 6);
+	// default mxcsr and x87 control word
+	frame[-7] = 0x1F80 | ((uint64_t) 0x037F << 32);
+	return frame - 7;
+}
+#endif
+
 
 extern struct uwsgi_server uwsgi;
 
 static struct uwsgi_option ugreen_options[] = {
 	{"ugreen", no_argument, 0, "enable ugreen coroutine subsystem", uwsgi_opt_true, &ug.ugreen, 0},
 	{"ugreen-stacksize", required_argument, 0, "set ugreen stack size in pages", uwsgi_opt_set_int, &ug.stackpages, 0},
+	{"ugreen-fast-switch", no_argument, 0, "switch ugreen contexts without syscalls (x86_64 only)", uwsgi_opt_true, &ug.fast, 0},
 	{ 0, 0, 0, 0, 0, 0, 0 }
 };
 
 static void u_green_schedule_to_req() {
 
-	int id = uwsgi.wsgi_req->async_id;
-	uint8_t modifier1 = uwsgi.wsgi_req->uh->modifier1;
+	struct wsgi_request *wsgi_req = current_wsgi_req();
+	int id = wsgi_req->async_id;
+	uint8_t modifier1 = wsgi_req->uh->modifier1;
+
+#ifdef UGREEN_FAST_SWITCH
+	if (ug.fast) {
+		if (!wsgi_req->suspended) {
+			ug.sps[id] = u_green_fast_frame(id);
+			wsgi_req->suspended = 1;
+		}
+		if (uwsgi.p[modifier1]->suspend) {
+			uwsgi.p[modifier1]->suspend(NULL);
+		}
+		uwsgi_ugreen_switch(&ugreen_main_sp, ug.sps[id]);
+		if (uwsgi.p[modifier1]->resume) {
+			uwsgi.p[modifier1]->resume(NULL);
+		}
+		return;
+	}
+#endif
 
 	// first round ?
-	if (!uwsgi.wsgi_req->suspended) {
-		ug.contexts[id].uc_link = &ug.main;
+	if (!wsgi_req->suspended) {
+		ug.contexts[id].uc_link = &ugreen_main;
         	makecontext(&ug.contexts[id], async_schedule_to_req_green, 0);
-		uwsgi.wsgi_req->suspended = 1;
+		wsgi_req->suspended = 1;
 	}
 
 	// call it in the main core
@@ -51,7 +137,7 @@ static void u_green_schedule_to_req() {
 	}
 
 	// save the main stack and switch to the core
-	swapcontext(&ug.main, &ug.contexts[id] );		
+	swapcontext(&ugreen_main, &ug.contexts[id] );		
 
 	// call it in the main core
 	if (uwsgi.p[modifier1]->resume) {
@@ -67,7 +153,13 @@ static void u_green_schedule_to_main(struct wsgi_request *wsgi_req) {
 	}
 
 	// back to main
-	swapcontext(&ug.contexts[wsgi_req->async_id], &ug.main);
+#ifdef UGREEN_FAST_SWITCH
+	if (ug.fast) {
+		uwsgi_ugreen_switch(&ug.sps[wsgi_req->async_id], ugreen_main_sp);
+	}
+	else
+#endif
+	swapcontext(&ug.contexts[wsgi_req->async_id], &ugreen_main);
 	// back to core
 
 	if (uwsgi.p[wsgi_req->uh->modifier1]->resume) {
@@ -122,6 +214,18 @@ static int u_green_init() {
 	}
 
 
+#ifdef UGREEN_FAST_SWITCH
+	if (ug.fast) {
+		ug.sps = uwsgi_calloc(sizeof(void *) * uwsgi.async);
+		uwsgi_log("uGreen fast context switch enabled\n");
+	}
+#else
+	if (ug.fast) {
+		uwsgi_log("uGreen fast context switch is not available on this platform, falling back to ucontext\n");
+		ug.fast = 0;
+	}
+#endif
+
 	uwsgi.schedule_to_main = u_green_schedule_to_main;
 	uwsgi.schedule_to_req = u_green_schedule_to_req;
 
@@ -44,8 +44,18 @@
 
 	- Resource properties are stored as filesystem xattr (warning, not all operating system support them) -
 
+	PROPFIND responses are streamed: every <response> is serialized as soon as it is built, small
+	multistatus are sent with a Content-Length, bigger ones switch to chunked encoding (or to a close-delimited
+	body for HTTP/1.0 clients).
+
+	--webdav-metadata-cache <cache> stores the stat() fields and the user.uwsgi.webdav.* xattrs of every
+	resource for --webdav-metadata-cache-expires seconds, write methods invalidate the items they touch.
+
 */
 
+// flush the PROPFIND output every 64k
+#define UWSGI_WEBDAV_STREAM_BUFSIZE 65536
+
 extern struct uwsgi_server uwsgi;
 struct uwsgi_plugin webdav_plugin;
 
@@ -79,6 +89,9 @@ struct uwsgi_webdav {
 
 	struct uwsgi_string_list *skip_prop;
 
+	char *metadata_cache;
+	uint64_t metadata_cache_expires;
+
 } udav;
 
 struct uwsgi_option uwsgi_webdav_options[] = {
@@ -110,6 +123,9 @@ struct uwsgi_option uwsgi_webdav_options[] = {
 
 	{ "webdav-skip-prop", required_argument, 0, "do not add the specified prop if available in resource xattr", uwsgi_opt_add_string_list, &udav.skip_prop, UWSGI_OPT_MIME},
 
+	{ "webdav-metadata-cache", required_argument, 0, "cache resources metadata (stat and xattrs) in the specified cache", uwsgi_opt_set_str, &udav.metadata_cache, UWSGI_OPT_MIME},
+	{ "webdav-metadata-cache-expires", required_argument, 0, "set the expiration of webdav metadata cache items (default 2 seconds)", uwsgi_opt_set_64bit, &udav.metadata_cache_expires, UWSGI_OPT_MIME},
+
 	{ 0, 0, 0, 0, 0, 0, 0 },
 };
 
@@ -230,11 +246,159 @@ static char *uwsgi_webdav_new_date(uint64_t t) {
 	return uwsgi_concat2n(d, len, "", 0);
 }
 
-static int uwsgi_webdav_add_props(struct wsgi_request *wsgi_req, xmlNode *req_prop, xmlNode * multistatus, xmlNsPtr dav_ns, char *uri, char *filename, int with_values) {
+/*
+	resource metadata
+
+	the stat() fields and the user.uwsgi.webdav.* xattrs of a resource. xattrs are packed
+	(without the prefix) as [u16 name_len][name][i32 value_len][value], a negative value_len
+	means the value cannot be read. The same layout (header + xattrs) is stored in the metadata cache.
+*/
+struct uwsgi_webdav_meta {
+	uint64_t mode;
+	uint64_t size;
+	uint64_t mtime;
+	uint64_t ctime;
+	uint64_t xattrs_len;
+	char *xattrs;
+	// the memory area holding xattrs
+	char *buf;
+};
+
+#define UWSGI_WEBDAV_META_HDR (sizeof(uint64_t) * 5)
+
+static void uwsgi_webdav_meta_load_xattrs(char *filename, struct uwsgi_buffer *ub) {
+#if defined(__linux__) || defined(__APPLE__)
+#if defined(__linux__)
+	ssize_t rlen = listxattr(filename, NULL, 0);
+#elif defined(__APPLE__)
+	ssize_t rlen = listxattr(filename, NULL, 0, 0);
+#endif
+	if (rlen <= 0) return;
+	// use calloc to avoid races
+	char *xattrs = uwsgi_calloc(rlen);
+#if defined(__linux__)
+	rlen = listxattr(filename, xattrs, rlen);
+#elif defined(__APPLE__)
+	rlen = listxattr(filename, xattrs, rlen, 0);
+#endif
+	ssize_t i;
+	char *key = xattrs;
+	for(i=0;i<rlen;i++) {
+		if (xattrs[i] != 0) continue;
+		size_t key_len = (xattrs + i) - key;
+		if (key_len > 18 && key_len - 18 <= 0xffff && !uwsgi_starts_with(key, key_len, "user.uwsgi.webdav.", 18)) {
+#if defined(__linux__)
+			ssize_t rlen2 = getxattr(filename, key, NULL, 0);
+#elif defined(__APPLE__)
+			ssize_t rlen2 = getxattr(filename, key, NULL, 0, 0, 0);
+#endif
+			char *xvalue = NULL;
+			if (rlen2 > 0) {
+				xvalue = uwsgi_malloc(rlen2);
+#if defined(__linux__)
+				rlen2 = getxattr(filename, key, xvalue, rlen2);
+#elif defined(__APPLE__)
+				rlen2 = getxattr(filename, key, xvalue, rlen2, 0, 0);
+#endif
+			}
+			int32_t vlen = rlen2 < 0 || rlen2 > 0x7fffffff ? -1 : rlen2;
+			uint16_t nlen = key_len - 18;
+			if (!uwsgi_buffer_append(ub, (char *) &nlen, 2) && !uwsgi_buffer_append(ub, key + 18, nlen)
+				&& !uwsgi_buffer_append(ub, (char *) &vlen, 4) && vlen > 0) {
+				uwsgi_buffer_append(ub, xvalue, vlen);
+			}
+			if (xvalue) free(xvalue);
+		}
+		key = xattrs + i + 1;
+	}
+	free(xattrs);
+#endif
+}
+
+/*
+	fill the metadata of a resource, dfd/name (if dfd >= 0) allow fstatat() on directory listing
+*/
+static int uwsgi_webdav_meta_get(char *filename, int dfd, char *name, struct uwsgi_webdav_meta *meta) {
+	char *key = NULL;
+	uint16_t key_len = 0;
+	memset(meta, 0, sizeof(struct uwsgi_webdav_meta));
+	if (udav.metadata_cache) {
+		size_t filename_len = strlen(filename);
+		if (filename_len + 7 <= 0xffff) {
+			key = uwsgi_concat2n("webdav|", 7, filename, filename_len);
+			key_len = filename_len + 7;
+			uint64_t vallen = 0;
+			char *value = uwsgi_cache_magic_get(key, key_len, &vallen, NULL, udav.metadata_cache);
+			if (value) {
+				if (vallen >= UWSGI_WEBDAV_META_HDR) {
+					memcpy(meta, value, UWSGI_WEBDAV_META_HDR);
+					if (UWSGI_WEBDAV_META_HDR + meta->xattrs_len == vallen) {
+						meta->buf = value;
+						meta->xattrs = value + UWSGI_WEBDAV_META_HDR;
+						free(key);
+						return 0;
+					}
+				}
+				free(value);
+				memset(meta, 0, sizeof(struct uwsgi_webdav_meta));
+			}
+		}
+	}
+
 	struct stat st;
-	if (stat(filename, &st)) {
+	if (dfd >= 0) {
+		if (fstatat(dfd, name, &st, 0)) goto error;
+	}
+	else if (stat(filename, &st)) goto error;
+
+	meta->mode = st.st_mode;
+	meta->size = st.st_size;
+	meta->mtime = st.st_mtime;
+	meta->ctime = st.st_ctime;
+
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(UWSGI_WEBDAV_META_HDR + 256);
+	if (uwsgi_buffer_append(ub, (char *) meta, UWSGI_WEBDAV_META_HDR)) {
+		uwsgi_buffer_destroy(ub);
+		goto error;
+	}
+	uwsgi_webdav_meta_load_xattrs(filename, ub);
+	meta->xattrs_len = ub->pos - UWSGI_WEBDAV_META_HDR;
+	memcpy(ub->buf + (sizeof(uint64_t) * 4), &meta->xattrs_len, sizeof(uint64_t));
+
+	if (key) {
+		uwsgi_cache_magic_set(key, key_len, ub->buf, ub->pos, udav.metadata_cache_expires, UWSGI_CACHE_FLAG_UPDATE, udav.metadata_cache);
+		free(key);
+	}
+
+	meta->buf = ub->buf;
+	meta->xattrs = ub->buf + UWSGI_WEBDAV_META_HDR;
+	ub->buf = NULL;
+	uwsgi_buffer_destroy(ub);
+	return 0;
+error:
+	if (key) free(key);
+	return -1;
+}
+
+// drop the item and its parent collection (its mtime changed too)
+static void uwsgi_webdav_meta_invalidate(char *filename) {
+	if (!udav.metadata_cache) return;
+	size_t filename_len = strlen(filename);
+	if (filename_len + 7 > 0xffff) return;
+	char *key = uwsgi_concat2n("webdav|", 7, filename, filename_len);
+	uwsgi_cache_magic_del(key, filename_len + 7, udav.metadata_cache);
+	char *last_slash = uwsgi_get_last_charn(key + 7, filename_len, '/');
+	if (last_slash && last_slash > key + 7) {
+		uwsgi_cache_magic_del(key, last_slash - key, udav.metadata_cache);
+	}
+	free(key);
+}
+
+static xmlNode *uwsgi_webdav_add_props(struct wsgi_request *wsgi_req, xmlNode *req_prop, xmlNode * multistatus, xmlNsPtr dav_ns, char *uri, char *filename, int dfd, char *name, int with_values) {
+	struct uwsgi_webdav_meta meta;
+	if (uwsgi_webdav_meta_get(filename, dfd, name, &meta)) {
 		uwsgi_error("uwsgi_webdav_add_props()/stat()");
-		return -1;
+		return NULL;
 	}
 
 	int is_collection = 0;
@@ -265,7 +429,7 @@ static int uwsgi_webdav_add_props(struct wsgi_request *wsgi_req, xmlNode *req_pr
 
 		}
 
-		if (S_ISDIR(st.st_mode)) is_collection = 1;
+		if (S_ISDIR(meta.mode)) is_collection = 1;
 
 		xmlNode *r_type = NULL;
 
@@ -280,7 +444,7 @@ static int uwsgi_webdav_add_props(struct wsgi_request *wsgi_req, xmlNode *req_pr
 
 		if (!is_collection) {
 			if (uwsgi_webdav_prop_requested(req_prop, "DAV:", "getcontentlength")) {
-				char *r_contentlength = uwsgi_num2str(st.st_size);
+				char *r_contentlength = uwsgi_num2str(meta.size);
 				xmlNewChild(r_prop, dav_ns, BAD_CAST "getcontentlength", BAD_CAST r_contentlength);
 				free(r_contentlength);
 			}
@@ -297,7 +461,7 @@ static int uwsgi_webdav_add_props(struct wsgi_request *wsgi_req, xmlNode *req_pr
 
 		if (uwsgi_webdav_prop_requested(req_prop, "DAV:", "creationdate")) {
 			// there is no creation date on UNIX/POSIX, ctime is the nearest thing...
-			char *cdate = uwsgi_webdav_new_date(st.st_ctime);
+			char *cdate = uwsgi_webdav_new_date(meta.ctime);
 			if (cdate) {
 				xmlNewTextChild(r_prop, dav_ns, BAD_CAST "creationdate", BAD_CAST cdate);
 				free(cdate);
@@ -305,7 +469,7 @@ static int uwsgi_webdav_add_props(struct wsgi_request *wsgi_req, xmlNode *req_pr
 		}
 
 		if (uwsgi_webdav_prop_requested(req_prop, "DAV:", "getlastmodified")) {
-			char *mdate = uwsgi_webdav_new_date(st.st_mtime);
+			char *mdate = uwsgi_webdav_new_date(meta.mtime);
 			if (mdate) {
 				xmlNewTextChild(r_prop, dav_ns, BAD_CAST "getlastmodified", BAD_CAST mdate);
 				free(mdate);
@@ -313,7 +477,7 @@ static int uwsgi_webdav_add_props(struct wsgi_request *wsgi_req, xmlNode *req_pr
 		}
 
 		if (uwsgi_webdav_prop_requested(req_prop, "DAV:", "getetag")) {
-			char *etag = uwsgi_num2str(st.st_mtime);
+			char *etag = uwsgi_num2str(meta.mtime);
 			xmlNewTextChild(r_prop, dav_ns, BAD_CAST "getetag", BAD_CAST etag);
 			free(etag);
 		}
@@ -387,7 +551,7 @@ static int uwsgi_webdav_add_props(struct wsgi_request *wsgi_req, xmlNode *req_pr
 	else {
 		xmlNewChild(r_prop, dav_ns, BAD_CAST "displayname", NULL);
 		xmlNewChild(r_prop, dav_ns, BAD_CAST "resourcetype", NULL);
-		if (!S_ISDIR(st.st_mode)) {
+		if (!S_ISDIR(meta.mode)) {
 			xmlNewChild(r_prop, dav_ns, BAD_CAST "getcontentlength", NULL);
 			xmlNewChild(r_prop, dav_ns, BAD_CAST "getcontenttype", NULL);
 		}
@@ -402,88 +566,60 @@ static int uwsgi_webdav_add_props(struct wsgi_request *wsgi_req, xmlNode *req_pr
 		}
 	}
 
-#if defined(__linux__) || defined(__APPLE__)
-	// get xattr for user.uwsgi.webdav.
-#if defined(__linux__)
-	ssize_t rlen = listxattr(filename, NULL, 0);
-#elif defined(__APPLE__)
-	ssize_t rlen = listxattr(filename, NULL, 0, 0);
-#endif
-	// do not return -1 as the previous xml is valid !!!
-	if (rlen <= 0) return 0;
-	// use calloc to avoid races
-	char *xattrs = uwsgi_calloc(rlen);
-#if defined(__linux__)
-	if (listxattr(filename, xattrs, rlen) <= 0) {
-#elif defined(__APPLE__)
-	if (listxattr(filename, xattrs, rlen, 0) <= 0) {
-#endif
-		free(xattrs);
-		return 0;
-	}
-	// parse the name list
-	ssize_t i;
-	char *key = NULL;
-	for(i=0;i<rlen;i++) {
-		// check for wrong condition
-		if (xattrs[i] == 0 && key == NULL) break;
-		if (key && xattrs[i] == 0) {
-			if (!uwsgi_starts_with(key, strlen(key), "user.uwsgi.webdav.", 18)) {
-				if (uwsgi_string_list_has_item(udav.skip_prop, key + 18, strlen(key + 18))) continue;
-				xmlNsPtr xattr_ns = NULL;
-				// does it has a namespace ?
-				char *separator = strchr(key + 18, '|');
-				char *xattr_key = key + 18;
-				if (separator) {
-					xattr_key = separator + 1;
-					*separator = 0;
-					if (!uwsgi_webdav_prop_requested(req_prop, key + 18, xattr_key)) continue;
-				}
-				else {
-					if (!uwsgi_webdav_prop_requested(req_prop, NULL, xattr_key)) continue;
-				}
-				xmlNode *xattr_item = NULL;
-				if (with_values) {
-#if defined(__linux__)
-					ssize_t rlen2 = getxattr(filename, key, NULL, 0);
-#elif defined(__APPLE__)
-					ssize_t rlen2 = getxattr(filename, key, NULL, 0, 0, 0);
-#endif
-					if (rlen > 0) {
-						// leave space for final 0
-						char *xvalue = uwsgi_calloc(rlen2 + 1);
-#if defined(__linux__)
-						if (getxattr(filename, key, xvalue, rlen2) > 0) {
-#elif defined(__APPLE__)
-						if (getxattr(filename, key, xvalue, rlen2, 0 ,0) > 0) {
-#endif
-							xattr_item = xmlNewTextChild(r_prop, NULL, BAD_CAST xattr_key, BAD_CAST xvalue);
-						}
-						free(xvalue);	
-					}
-					else if (rlen == 0) {
-						xattr_item = xmlNewTextChild(r_prop, NULL, BAD_CAST xattr_key, NULL);
-					}
-				}
-				else {
-					xattr_item = xmlNewTextChild(r_prop, NULL, BAD_CAST xattr_key, NULL);
-				}	
-				if (separator && xattr_item) {
-					xattr_ns = xmlNewNs(xattr_item, BAD_CAST (key + 18), NULL);
-					*separator = '|';
-					xmlSetNs(xattr_item, xattr_ns);	
-				}
+	// user.uwsgi.webdav. xattrs
+	char *ptr = meta.xattrs;
+	char *watermark = meta.xattrs + meta.xattrs_len;
+	while(ptr + 2 <= watermark) {
+		uint16_t nlen;
+		int32_t vlen;
+		memcpy(&nlen, ptr, 2); ptr += 2;
+		if (ptr + nlen + 4 > watermark) break;
+		char *xattr_name = uwsgi_concat2n(ptr, nlen, "", 0); ptr += nlen;
+		memcpy(&vlen, ptr, 4); ptr += 4;
+		char *xvalue = NULL;
+		if (vlen > 0) {
+			if (ptr + vlen > watermark) {
+				free(xattr_name);
+				break;
 			}
-			key = NULL;
+			xvalue = uwsgi_concat2n(ptr, vlen, "", 0);
+			ptr += vlen;
+		}
+		if (uwsgi_string_list_has_item(udav.skip_prop, xattr_name, nlen)) goto next;
+		// does it has a namespace ?
+		char *separator = strchr(xattr_name, '|');
+		char *xattr_key = xattr_name;
+		if (separator) {
+			xattr_key = separator + 1;
+			*separator = 0;
+			if (!uwsgi_webdav_prop_requested(req_prop, xattr_name, xattr_key)) goto next;
+		}
+		else {
+			if (!uwsgi_webdav_prop_requested(req_prop, NULL, xattr_key)) goto next;
+		}
+		xmlNode *xattr_item = NULL;
+		if (with_values) {
+			if (vlen > 0) {
+				xattr_item = xmlNewTextChild(r_prop, NULL, BAD_CAST xattr_key, BAD_CAST xvalue);
+			}
+			else if (vlen == 0) {
+				xattr_item = xmlNewTextChild(r_prop, NULL, BAD_CAST xattr_key, NULL);
+			}
+		}
+		else {
+			xattr_item = xmlNewTextChild(r_prop, NULL, BAD_CAST xattr_key, NULL);
 		}
-		else if (key == NULL) {
-			key = &xattrs[i];
+		if (separator && xattr_item) {
+			xmlNsPtr xattr_ns = xmlNewNs(xattr_item, BAD_CAST xattr_name, NULL);
+			xmlSetNs(xattr_item, xattr_ns);
 		}
+next:
+		free(xattr_name);
+		if (xvalue) free(xvalue);
 	}
-	free(xattrs);
-	
-#endif
-	return 0;
+
+	free(meta.buf);
+	return response;
 }
 
 static size_t uwsgi_webdav_expand_path(struct wsgi_request *wsgi_req, char *item, uint16_t item_len, char *filename) {
@@ -515,7 +651,73 @@ static size_t uwsgi_webdav_expand_fake_path(struct wsgi_request *wsgi_req, char
 	return filename_len;
 }
 
-static xmlDoc *uwsgi_webdav_manage_prop(struct wsgi_request *wsgi_req, xmlNode *req_prop, char *filename, size_t filename_len, int with_values) {
+/*
+	PROPFIND output
+
+	the multistatus document is never built as a whole: each <response> is dumped
+	into the stream buffer and freed. Until the buffer is flushed the first time we can still
+	send a Content-Length, after that the body is chunked (or close-delimited for HTTP/1.0)
+*/
+struct uwsgi_webdav_stream {
+	struct uwsgi_buffer *ub;
+	xmlBufferPtr xbuf;
+	int started;
+	int chunked;
+};
+
+static int uwsgi_webdav_stream_flush(struct wsgi_request *wsgi_req, struct uwsgi_webdav_stream *uws, int is_final) {
+	struct uwsgi_buffer *ub = uws->ub;
+	if (is_final) {
+		if (uwsgi_buffer_append(ub, "</D:multistatus>\n", 17)) return -1;
+		if (!uws->started) {
+			if (uwsgi_response_add_content_length(wsgi_req, ub->pos)) return -1;
+			return uwsgi_response_write_body_do(wsgi_req, ub->buf, ub->pos);
+		}
+	}
+	else if (!uws->started) {
+		if (!uwsgi_strncmp(wsgi_req->protocol, wsgi_req->protocol_len, "HTTP/1.1", 8)) {
+			if (uwsgi_response_add_header(wsgi_req, "Transfer-Encoding", 17, "chunked", 7)) return -1;
+			uws->chunked = 1;
+		}
+		else {
+			if (uwsgi_response_add_connection_close(wsgi_req)) return -1;
+		}
+		uws->started = 1;
+	}
+
+	if (uws->chunked) {
+		if (uwsgi_buffer_insert_chunked(ub, 0, ub->pos)) return -1;
+		if (uwsgi_buffer_append(ub, "\r\n", 2)) return -1;
+		if (is_final) {
+			if (uwsgi_buffer_append(ub, "0\r\n\r\n", 5)) return -1;
+		}
+	}
+
+	int ret = uwsgi_response_write_body_do(wsgi_req, ub->buf, ub->pos);
+	ub->pos = 0;
+	return ret;
+}
+
+static int uwsgi_webdav_stream_add(struct wsgi_request *wsgi_req, struct uwsgi_webdav_stream *uws, xmlDoc *rdoc, xmlNode *response) {
+	// the resource vanished (or cannot be stat'ed), skip it
+	if (!response) return 0;
+	int ret = -1;
+	xmlBufferEmpty(uws->xbuf);
+	if (xmlNodeDump(uws->xbuf, rdoc, response, 1, 1) < 0) goto end;
+	if (uwsgi_buffer_append(uws->ub, "  ", 2)) goto end;
+	if (uwsgi_buffer_append(uws->ub, (char *) xmlBufferContent(uws->xbuf), xmlBufferLength(uws->xbuf))) goto end;
+	if (uwsgi_buffer_append(uws->ub, "\n", 1)) goto end;
+	ret = 0;
+	if (uws->ub->pos >= UWSGI_WEBDAV_STREAM_BUFSIZE) {
+		ret = uwsgi_webdav_stream_flush(wsgi_req, uws, 0);
+	}
+end:
+	xmlUnlinkNode(response);
+	xmlFreeNode(response);
+	return ret;
+}
+
+static int uwsgi_webdav_manage_prop(struct wsgi_request *wsgi_req, xmlNode *req_prop, char *filename, size_t filename_len, int with_values) {
 	// default 1 depth
 	int depth = 1;
         uint16_t http_depth_len = 0;
@@ -524,19 +726,36 @@ static xmlDoc *uwsgi_webdav_manage_prop(struct wsgi_request *wsgi_req, xmlNode *
                 depth = uwsgi_str_num(http_depth, http_depth_len);
         }
 
+	// the document is only the namespace context of the responses
 	xmlDoc *rdoc = xmlNewDoc(BAD_CAST "1.0");
         xmlNode *multistatus = xmlNewNode(NULL, BAD_CAST "multistatus");
         xmlDocSetRootElement(rdoc, multistatus);
         xmlNsPtr dav_ns = xmlNewNs(multistatus, BAD_CAST "DAV:", BAD_CAST "D");
         xmlSetNs(multistatus, dav_ns);
 
-	if (depth == 0) {
+	int ret = -1;
+	struct uwsgi_webdav_stream uws;
+	memset(&uws, 0, sizeof(struct uwsgi_webdav_stream));
+	uws.ub = uwsgi_buffer_new(UWSGI_WEBDAV_STREAM_BUFSIZE);
+	uws.xbuf = xmlBufferCreate();
+	if (!uws.xbuf) goto end;
+
+	if (uwsgi_buffer_append(uws.ub, "<?xml version=\"1.0\"?>\n<D:multistatus xmlns:D=\"DAV:\">\n", 53)) goto end;
+
+	DIR *collection = NULL;
+	if (depth != 0) {
+		collection = opendir(filename);
+	}
+
+	if (!collection) {
                 char *uri = uwsgi_concat2n(wsgi_req->path_info, wsgi_req->path_info_len, "", 0);
-                uwsgi_webdav_add_props(wsgi_req, req_prop, multistatus, dav_ns, uri, filename, with_values);
+                xmlNode *response = uwsgi_webdav_add_props(wsgi_req, req_prop, multistatus, dav_ns, uri, filename, -1, NULL, with_values);
                 free(uri);
+		if (uwsgi_webdav_stream_add(wsgi_req, &uws, rdoc, response)) goto end;
         }
         else {
-                DIR *collection = opendir(filename);
+		// entries are stat'ed relative to the collection fd, readdir() already fetches them in getdents() batches
+		int dfd = dirfd(collection);
                 struct dirent de;
                 for (;;) {
                         struct dirent *de_r = NULL;
@@ -549,6 +768,7 @@ static xmlDoc *uwsgi_webdav_manage_prop(struct wsgi_request *wsgi_req, xmlNode *
                         }
                         char *uri = NULL;
                         char *direntry = NULL;
+			int entry_dfd = dfd;
                         if (!strcmp(de.d_name, "..")) {
                                 // skip ..
                                 continue;
@@ -556,6 +776,7 @@ static xmlDoc *uwsgi_webdav_manage_prop(struct wsgi_request *wsgi_req, xmlNode *
                         else if (!strcmp(de.d_name, ".")) {
                                 uri = uwsgi_concat2n(wsgi_req->path_info, wsgi_req->path_info_len, "", 0);
                                 direntry = uwsgi_concat2n(filename, filename_len, "", 0);
+				entry_dfd = -1;
                         }
                         else if (wsgi_req->path_info[wsgi_req->path_info_len - 1] == '/') {
                                 uri = uwsgi_concat2n(wsgi_req->path_info, wsgi_req->path_info_len, de.d_name, strlen(de.d_name));
@@ -565,15 +786,23 @@ static xmlDoc *uwsgi_webdav_manage_prop(struct wsgi_request *wsgi_req, xmlNode *
                                 uri = uwsgi_concat3n(wsgi_req->path_info, wsgi_req->path_info_len, "/", 1, de.d_name, strlen(de.d_name));
                                 direntry = uwsgi_concat3n(filename, filename_len, "/", 1, de.d_name, strlen(de.d_name));
                         }
-                        uwsgi_webdav_add_props(wsgi_req, req_prop, multistatus, dav_ns, uri, direntry, with_values);
+                        xmlNode *response = uwsgi_webdav_add_props(wsgi_req, req_prop, multistatus, dav_ns, uri, direntry, entry_dfd, de.d_name, with_values);
                         free(uri);
                         free(direntry);
+			if (uwsgi_webdav_stream_add(wsgi_req, &uws, rdoc, response)) {
+				closedir(collection);
+				goto end;
+			}
                 }
                 closedir(collection);
         }
 
-	return rdoc;
-	
+	ret = uwsgi_webdav_stream_flush(wsgi_req, &uws, 1);
+end:
+	if (uws.xbuf) xmlBufferFree(uws.xbuf);
+	uwsgi_buffer_destroy(uws.ub);
+	xmlFreeDoc(rdoc);
+	return ret;
 }
 
 static int uwsgi_wevdav_manage_propfind(struct wsgi_request *wsgi_req, xmlDoc * doc) {
@@ -583,7 +812,6 @@ static int uwsgi_wevdav_manage_propfind(struct wsgi_request *wsgi_req, xmlDoc *
 		uwsgi_404(wsgi_req);
 		return UWSGI_OK;
 	}
-	xmlDoc *rdoc = NULL;
 	xmlNode *element = NULL;
 
 	if (doc) {
@@ -605,15 +833,15 @@ static int uwsgi_wevdav_manage_propfind(struct wsgi_request *wsgi_req, xmlDoc *
 		if (node->type == XML_ELEMENT_NODE) {
 			if (node->ns && !strcmp((char *) node->ns->href, "DAV:")) {
                 		if (!strcmp((char *) node->name, "prop")) {
-					rdoc = uwsgi_webdav_manage_prop(wsgi_req, node, filename, filename_len, 1);
+					uwsgi_webdav_manage_prop(wsgi_req, node, filename, filename_len, 1);
 					break;
 				}
 				if (!strcmp((char *) node->name, "allprop")) {
-					rdoc = uwsgi_webdav_manage_prop(wsgi_req, NULL, filename, filename_len, 1);
+					uwsgi_webdav_manage_prop(wsgi_req, NULL, filename, filename_len, 1);
 					break;
 				}
 				if (!strcmp((char *) node->name, "propname")) {
-					rdoc = uwsgi_webdav_manage_prop(wsgi_req, node, filename, filename_len, 0);
+					uwsgi_webdav_manage_prop(wsgi_req, node, filename, filename_len, 0);
 					break;
 				}
 			}
@@ -621,21 +849,9 @@ static int uwsgi_wevdav_manage_propfind(struct wsgi_request *wsgi_req, xmlDoc *
 	}
 	}
 	else {
-		rdoc = uwsgi_webdav_manage_prop(wsgi_req, NULL, filename, filename_len, 1);
+		uwsgi_webdav_manage_prop(wsgi_req, NULL, filename, filename_len, 1);
 	}
 
-	if (!rdoc) return UWSGI_OK;
-
-	xmlChar *xmlbuf;
-	int xlen = 0;
-	xmlDocDumpFormatMemory(rdoc, &xmlbuf, &xlen, 1);
-	uwsgi_response_add_content_length(wsgi_req, xlen);
-	uwsgi_response_write_body_do(wsgi_req, (char *) xmlbuf, xlen);
-#ifdef UWSGI_DEBUG
-	uwsgi_log("\n%.*s\n", xlen, xmlbuf);
-#endif
-	xmlFreeDoc(rdoc);
-	xmlFree(xmlbuf);
 	return UWSGI_OK;
 }
 
@@ -655,6 +871,7 @@ static int uwsgi_webdav_prop_set(char *filename, char *attr, char *ns, char *bod
 	ret = setxattr(filename, xattr_name, body, strlen(body), 0, 0);
 #endif
 	free(xattr_name);
+	uwsgi_webdav_meta_invalidate(filename);
 #endif
 	return ret; 
 }
@@ -675,6 +892,7 @@ static int uwsgi_webdav_prop_del(char *filename, char *attr, char *ns) {
         ret = removexattr(filename, xattr_name, 0);
 #endif
         free(xattr_name);
+	uwsgi_webdav_meta_invalidate(filename);
 #endif
         return ret;
 }
@@ -828,6 +1046,7 @@ static int uwsgi_wevdav_manage_put(struct wsgi_request *wsgi_req) {
 
 end:
 	close(fd);
+	uwsgi_webdav_meta_invalidate(filename);
 	return UWSGI_OK;
 }
 
@@ -845,6 +1064,7 @@ static int uwsgi_webdav_massive_delete(char *dir) {
 		// skip myself and parent
 		if (!strcmp(de.d_name, ".") || !strcmp(de.d_name, "..")) continue;
 		char *item = uwsgi_concat3(dir, "/", de.d_name);
+		uwsgi_webdav_meta_invalidate(item);
 		if (de.d_type == DT_DIR) {
 			if (uwsgi_webdav_massive_delete(item)) {
 				free(item);
@@ -898,6 +1118,7 @@ static int uwsgi_wevdav_manage_delete(struct wsgi_request *wsgi_req) {
 		}
 	}
 
+	uwsgi_webdav_meta_invalidate(filename);
 	uwsgi_response_prepare_headers(wsgi_req, "200 OK", 6);
 	return UWSGI_OK;
 }
@@ -1141,6 +1362,9 @@ static int uwsgi_wevdav_manage_move(struct wsgi_request *wsgi_req) {
 		return UWSGI_OK;
 	}
 
+	uwsgi_webdav_meta_invalidate(filename);
+	uwsgi_webdav_meta_invalidate(d_filename);
+
 	if (already_exists) {
 		uwsgi_response_prepare_headers(wsgi_req, "204 No Content", 14);
 	}
@@ -1178,6 +1402,7 @@ static int uwsgi_wevdav_manage_mkcol(struct wsgi_request *wsgi_req) {
 	if (mkdir(filename, S_IRUSR | S_IWUSR | S_IXUSR | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH)) {
 		uwsgi_response_prepare_headers(wsgi_req, "409 Conflict", 12);
 	}
+	uwsgi_webdav_meta_invalidate(filename);
 	uwsgi_response_prepare_headers(wsgi_req, "201 Created", 11);
 	return UWSGI_OK;
 }
@@ -1206,6 +1431,7 @@ static int uwsgi_wevdav_manage_mkcalendar(struct wsgi_request *wsgi_req, xmlDoc
                 uwsgi_response_prepare_headers(wsgi_req, "409 Conflict", 12);
 		return UWSGI_OK;
         }
+	uwsgi_webdav_meta_invalidate(filename);
 
 	xmlNode *element = xmlDocGetRootElement(doc);
         if (!element) return -1;
@@ -1376,6 +1602,9 @@ end:
 }
 
 static void uwsgi_webdav_mount() {
+	if (udav.metadata_cache && !udav.metadata_cache_expires) {
+		udav.metadata_cache_expires = 2;
+	}
 	struct uwsgi_string_list *usl = udav.mountpoints;
 	while(usl) {
 		if (uwsgi_apps_cnt >= uwsgi.max_apps) {
@@ -3,6 +3,8 @@
 #include <libxslt/xsltutils.h>
 #include <libxslt/transform.h>
 
+extern struct uwsgi_server uwsgi;
+
 /*
 
 	XSLT request plugin
@@ -19,6 +21,13 @@
 
 	toxslt:stylesheet=<path2>,params=<params>
 
+	compiled stylesheets are cached per-worker (--xslt-stylesheet-cache-items) and reloaded when
+	the stat of the file changes.
+
+	--xslt-result-cache <name> stores the results in the specified uWSGI cache, the key is built
+	from the stylesheet and the document (path and stat, or a hash of the body for transformations)
+	and the params
+
 */
 
 struct uwsgi_xslt_config {
@@ -28,8 +37,27 @@ struct uwsgi_xslt_config {
 	struct uwsgi_string_list *stylesheet;
 	char *content_type;
 	uint16_t content_type_len;
+	uint64_t ss_cache_items;
+	int no_ss_cache;
+	struct uwsgi_xslt_stylesheet **ss_cache;
+	pthread_mutex_t lock;
+	char *result_cache;
+	uint64_t result_cache_expires;
+	struct uwsgi_hash_algo *hash;
 } uxslt;
 
+// a compiled stylesheet, freed when it is no more in the cache and nobody is using it
+struct uwsgi_xslt_stylesheet {
+	char *filename;
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+	off_t size;
+	xsltStylesheetPtr ss;
+	int refs;
+	int cached;
+};
+
 struct uwsgi_router_xslt_conf {
 	char *doc;
 	uint16_t doc_len;
@@ -53,9 +81,144 @@ struct uwsgi_option uwsgi_xslt_options[] = {
 	{"xslt-var", required_argument, 0, "get the xslt stylesheet path from the specified request var", uwsgi_opt_add_string_list, &uxslt.var, 0},
 	{"xslt-stylesheet", required_argument, 0, "if no xslt stylesheet file can be found, use the specified one", uwsgi_opt_add_string_list, &uxslt.stylesheet, 0},
 	{"xslt-content-type", required_argument, 0, "set the content-type for the xslt rsult (default: text/html)", uwsgi_opt_set_str, &uxslt.content_type, 0},
+	{"xslt-stylesheet-cache-items", required_argument, 0, "set the max number of compiled stylesheets cached by each worker (default 64)", uwsgi_opt_set_64bit, &uxslt.ss_cache_items, 0},
+	{"xslt-no-stylesheet-cache", no_argument, 0, "compile the xslt stylesheets at every request", uwsgi_opt_true, &uxslt.no_ss_cache, 0},
+	{"xslt-result-cache", required_argument, 0, "store the xslt results in the specified uWSGI cache", uwsgi_opt_set_str, &uxslt.result_cache, 0},
+	{"xslt-result-cache-expires", required_argument, 0, "set the expiration of the cached xslt results (default: never)", uwsgi_opt_set_64bit, &uxslt.result_cache_expires, 0},
 	{NULL, 0, 0, NULL, NULL, NULL, 0},
 };
 
+static void uwsgi_xslt_stylesheet_free(struct uwsgi_xslt_stylesheet *uxs) {
+	if (!uxs) return;
+	xsltFreeStylesheet(uxs->ss);
+	free(uxs->filename);
+	free(uxs);
+}
+
+static struct uwsgi_xslt_stylesheet *uwsgi_xslt_stylesheet_load(char *xsltfile, struct stat *st) {
+	xsltStylesheetPtr ss = xsltParseStylesheetFile((const xmlChar *) xsltfile);
+	if (!ss) return NULL;
+	struct uwsgi_xslt_stylesheet *uxs = uwsgi_calloc(sizeof(struct uwsgi_xslt_stylesheet));
+	uxs->filename = uwsgi_str(xsltfile);
+	uxs->ss = ss;
+	uxs->refs = 1;
+	if (st) {
+		uxs->dev = st->st_dev;
+		uxs->ino = st->st_ino;
+		uxs->mtime = st->st_mtime;
+		uxs->size = st->st_size;
+	}
+	return uxs;
+}
+
+static struct uwsgi_xslt_stylesheet **uwsgi_xslt_stylesheet_slot(char *xsltfile) {
+	return &uxslt.ss_cache[djb33x_hash(xsltfile, strlen(xsltfile)) % uxslt.ss_cache_items];
+}
+
+// compiled stylesheets can be shared by multiple transformations (even in different threads)
+static struct uwsgi_xslt_stylesheet *uwsgi_xslt_stylesheet_get(char *xsltfile) {
+	if (!uxslt.ss_cache) return uwsgi_xslt_stylesheet_load(xsltfile, NULL);
+
+	struct stat st;
+	if (stat(xsltfile, &st)) return NULL;
+
+	pthread_mutex_lock(&uxslt.lock);
+	struct uwsgi_xslt_stylesheet *uxs = *uwsgi_xslt_stylesheet_slot(xsltfile);
+	if (uxs && !strcmp(uxs->filename, xsltfile) && uxs->dev == st.st_dev && uxs->ino == st.st_ino
+		&& uxs->mtime == st.st_mtime && uxs->size == st.st_size) {
+		uxs->refs++;
+		pthread_mutex_unlock(&uxslt.lock);
+		return uxs;
+	}
+	pthread_mutex_unlock(&uxslt.lock);
+
+	uxs = uwsgi_xslt_stylesheet_load(xsltfile, &st);
+	if (!uxs) return NULL;
+
+	// the old item could still be in use by other cores
+	struct uwsgi_xslt_stylesheet *old = NULL;
+	pthread_mutex_lock(&uxslt.lock);
+	struct uwsgi_xslt_stylesheet **slot = uwsgi_xslt_stylesheet_slot(xsltfile);
+	if (*slot) {
+		(*slot)->cached = 0;
+		if (!(*slot)->refs) old = *slot;
+	}
+	*slot = uxs;
+	uxs->cached = 1;
+	pthread_mutex_unlock(&uxslt.lock);
+
+	uwsgi_xslt_stylesheet_free(old);
+	return uxs;
+}
+
+static void uwsgi_xslt_stylesheet_put(struct uwsgi_xslt_stylesheet *uxs) {
+	if (!uxslt.ss_cache) {
+		uwsgi_xslt_stylesheet_free(uxs);
+		return;
+	}
+	pthread_mutex_lock(&uxslt.lock);
+	uxs->refs--;
+	int destroy = !uxs->refs && !uxs->cached;
+	pthread_mutex_unlock(&uxslt.lock);
+	if (destroy) uwsgi_xslt_stylesheet_free(uxs);
+}
+
+static int uwsgi_xslt_key_file(struct uwsgi_buffer *ub, char *filename) {
+	struct stat st;
+	if (stat(filename, &st)) return -1;
+	if (uwsgi_buffer_append(ub, filename, strlen(filename))) return -1;
+	if (uwsgi_buffer_append(ub, ":", 1)) return -1;
+	if (uwsgi_buffer_num64(ub, st.st_ino)) return -1;
+	if (uwsgi_buffer_append(ub, ":", 1)) return -1;
+	if (uwsgi_buffer_num64(ub, st.st_mtime)) return -1;
+	if (uwsgi_buffer_append(ub, ":", 1)) return -1;
+	return uwsgi_buffer_num64(ub, st.st_size);
+}
+
+/*
+	the key of a result in the --xslt-result-cache, the document is a file or a memory area
+	(NULL if the result cache is disabled or the key cannot be built)
+*/
+static struct uwsgi_buffer *uwsgi_xslt_result_key(char *xsltfile, char *docfile, char *mem, size_t mem_len, char *params) {
+	if (!uxslt.result_cache) return NULL;
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(uwsgi.page_size);
+	if (uwsgi_buffer_append(ub, "xslt|", 5)) goto error;
+	if (uwsgi_xslt_key_file(ub, xsltfile)) goto error;
+	if (uwsgi_buffer_append(ub, "|", 1)) goto error;
+	if (docfile) {
+		if (uwsgi_xslt_key_file(ub, docfile)) goto error;
+	}
+	else {
+		if (!uxslt.hash) uxslt.hash = uwsgi_hash_algo_get("wyhash");
+		if (uwsgi_buffer_append(ub, "mem:", 4)) goto error;
+		if (uwsgi_buffer_num64(ub, uwsgi_hash_algo_64(uxslt.hash, mem, mem_len))) goto error;
+		if (uwsgi_buffer_append(ub, ":", 1)) goto error;
+		if (uwsgi_buffer_num64(ub, mem_len)) goto error;
+	}
+	if (params) {
+		if (uwsgi_buffer_append(ub, "|", 1)) goto error;
+		if (uwsgi_buffer_append(ub, params, strlen(params))) goto error;
+	}
+	if (ub->pos > 0xffff) goto error;
+	return ub;
+error:
+	uwsgi_buffer_destroy(ub);
+	return NULL;
+}
+
+static char *uwsgi_xslt_result_get(struct uwsgi_buffer *key, int *rlen) {
+	if (!key) return NULL;
+	uint64_t vallen = 0;
+	char *value = uwsgi_cache_magic_get(key->buf, key->pos, &vallen, NULL, uxslt.result_cache);
+	*rlen = vallen;
+	return value;
+}
+
+static void uwsgi_xslt_result_set(struct uwsgi_buffer *key, char *output, int rlen) {
+	if (!key) return;
+	uwsgi_cache_magic_set(key->buf, key->pos, output, rlen, uxslt.result_cache_expires, UWSGI_CACHE_FLAG_UPDATE, uxslt.result_cache);
+}
+
 static char *uwsgi_xslt_apply(xmlDoc *doc, char *xsltfile, char *params, int *rlen) {
 
 	char **vparams = NULL;
@@ -88,8 +251,8 @@ static char *uwsgi_xslt_apply(xmlDoc *doc, char *xsltfile, char *params, int *rl
 	xmlSubstituteEntitiesDefault(1);
 	xmlLoadExtDtdDefaultValue = 1;
 
-        xsltStylesheetPtr ss = xsltParseStylesheetFile((const xmlChar *) xsltfile);
-        if (!ss) {
+        struct uwsgi_xslt_stylesheet *uxs = uwsgi_xslt_stylesheet_get(xsltfile);
+        if (!uxs) {
 		if (vparams) {
 			int i; for(i=1;i<(count*2);i+=2) free(vparams[i]);
 			free(vparams);
@@ -98,9 +261,9 @@ static char *uwsgi_xslt_apply(xmlDoc *doc, char *xsltfile, char *params, int *rl
                 return NULL;
         }
 
-        xmlDocPtr res = xsltApplyStylesheet(ss, doc, (const char **) vparams);
+        xmlDocPtr res = xsltApplyStylesheet(uxs->ss, doc, (const char **) vparams);
 	if (!res) {
-		xsltFreeStylesheet(ss);
+		uwsgi_xslt_stylesheet_put(uxs);
 		if (vparams) {
 			int i; for(i=1;i<(count*2);i+=2) free(vparams[i]);
 			free(vparams);
@@ -110,8 +273,8 @@ static char *uwsgi_xslt_apply(xmlDoc *doc, char *xsltfile, char *params, int *rl
 	}
 
         xmlChar *output;
-        int ret = xsltSaveResultToString(&output, rlen, res, ss);
-	xsltFreeStylesheet(ss);
+        int ret = xsltSaveResultToString(&output, rlen, res, uxs->ss);
+	uwsgi_xslt_stylesheet_put(uxs);
 	xmlFreeDoc(res);
 	if (vparams) {
 		int i; for(i=1;i<(count*2);i+=2) free(vparams[i]);
@@ -135,6 +298,8 @@ static int uwsgi_request_xslt(struct wsgi_request *wsgi_req) {
 	
 	char *params = NULL;
 	xmlDoc *doc = NULL;
+	struct uwsgi_buffer *key = NULL;
+	int from_cache = 0;
 
 	if (uwsgi_parse_vars(wsgi_req)) {
 		return -1;
@@ -272,23 +437,34 @@ static int uwsgi_request_xslt(struct wsgi_request *wsgi_req) {
 	return UWSGI_OK;
 
 apply:
+	if (wsgi_req->query_string_len > 0) {
+		params = uwsgi_concat2n(wsgi_req->query_string, wsgi_req->query_string_len, "", 0);
+	}
+
+	key = uwsgi_xslt_result_key(stylesheet, filename, NULL, 0, params);
+	output = uwsgi_xslt_result_get(key, &output_rlen);
+	if (output) {
+		from_cache = 1;
+		free(xmlfile);
+		goto send;
+	}
+
 	// we have both the file and the stylesheet, let's run the engine
 	doc = xmlParseFile(xmlfile);
 	free(xmlfile);
 	if (!doc) {
 		uwsgi_500(wsgi_req);
-                return UWSGI_OK;
+		goto end;
 	} 
-	if (wsgi_req->query_string_len > 0) {
-		params = uwsgi_concat2n(wsgi_req->query_string, wsgi_req->query_string_len, "", 0);
-	}
 	output = uwsgi_xslt_apply(doc, stylesheet, params, &output_rlen);
 	xmlFreeDoc(doc);
-	if (params) free(params);
 	if (!output) {
 		uwsgi_500(wsgi_req);
-		return UWSGI_OK;
+		goto end;
 	}
+	uwsgi_xslt_result_set(key, output, output_rlen);
+
+send:
 
 	// prepare headers
 	if (uwsgi_response_prepare_headers(wsgi_req, "200 OK", 6)) {
@@ -309,7 +485,12 @@ apply:
 	uwsgi_response_write_body_do(wsgi_req, output, output_rlen);
 
 end:
-	xmlFree(output);
+	if (output) {
+		if (from_cache) free(output);
+		else xmlFree(output);
+	}
+	if (params) free(params);
+	if (key) uwsgi_buffer_destroy(key);
 	return UWSGI_OK;
 }
 
@@ -321,13 +502,24 @@ static int transform_toxslt(struct wsgi_request *wsgi_req, struct uwsgi_transfor
 	int ret = -1;
         struct uwsgi_transformation_xslt_conf *utxc = (struct uwsgi_transformation_xslt_conf *) ut->data;
 	struct uwsgi_buffer *ub = ut->chunk;
+	xmlDoc *doc = NULL;
+
+	int rlen;
+	struct uwsgi_buffer *key = uwsgi_xslt_result_key(utxc->stylesheet->buf, NULL, ub->buf, ub->pos, utxc->params ? utxc->params->buf : NULL);
+	char *output = uwsgi_xslt_result_get(key, &rlen);
+	if (output) {
+		// uwsgi_buffer_map() takes the ownership of the memory (it is released with free())
+		goto map;
+	}
 
-	xmlDoc *doc = xmlReadMemory(ub->buf, ub->pos, NULL, NULL, 0);
+	doc = xmlReadMemory(ub->buf, ub->pos, NULL, NULL, 0);
 	if (!doc) goto end;
 
-	int rlen;
-        char *output = uwsgi_xslt_apply( doc, utxc->stylesheet->buf, utxc->params ? utxc->params->buf : NULL, &rlen);
+        output = uwsgi_xslt_apply( doc, utxc->stylesheet->buf, utxc->params ? utxc->params->buf : NULL, &rlen);
 	if (!output) goto end;
+	uwsgi_xslt_result_set(key, output, rlen);
+
+map:
 
 	// do not check for errors !!!
 	if (ut->round == 1) {
@@ -338,6 +530,7 @@ static int transform_toxslt(struct wsgi_request *wsgi_req, struct uwsgi_transfor
 	ret = 0;
 
 end:
+	if (key) uwsgi_buffer_destroy(key);
 	if (doc) xmlFreeDoc(doc);
         if (utxc->stylesheet) uwsgi_buffer_destroy(utxc->stylesheet);
         if (utxc->params) uwsgi_buffer_destroy(utxc->params);
@@ -389,6 +582,8 @@ static int uwsgi_routing_func_xslt(struct wsgi_request *wsgi_req, struct uwsgi_r
 	struct uwsgi_buffer *ub_stylesheet = NULL;
 	struct uwsgi_buffer *ub_params = NULL;
 	struct uwsgi_buffer *ub_content_type = NULL;
+	struct uwsgi_buffer *key = NULL;
+	char *output = NULL;
 
 	ub_doc = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, urxc->doc, urxc->doc_len);
 	if (!ub_doc) goto end;
@@ -406,20 +601,32 @@ static int uwsgi_routing_func_xslt(struct wsgi_request *wsgi_req, struct uwsgi_r
 	if (!ub_content_type) goto end;
 
 	int rlen;
-	xmlDoc *doc = xmlParseFile(ub_doc->buf) ;
-	if (!doc) goto end;
-        char *output = uwsgi_xslt_apply(doc, ub_stylesheet->buf, ub_params ? ub_params->buf : NULL, &rlen);
-	xmlFreeDoc(doc);
-	if (!output) goto end;
+	int from_cache = 0;
+	key = uwsgi_xslt_result_key(ub_stylesheet->buf, ub_doc->buf, NULL, 0, ub_params ? ub_params->buf : NULL);
+	output = uwsgi_xslt_result_get(key, &rlen);
+	if (output) {
+		from_cache = 1;
+	}
+	else {
+		xmlDoc *doc = xmlParseFile(ub_doc->buf) ;
+		if (!doc) goto end;
+		output = uwsgi_xslt_apply(doc, ub_stylesheet->buf, ub_params ? ub_params->buf : NULL, &rlen);
+		xmlFreeDoc(doc);
+		if (!output) goto end;
+		uwsgi_xslt_result_set(key, output, rlen);
+	}
 
-        if (uwsgi_response_prepare_headers(wsgi_req, "200 OK", 6)) goto end;
-        if (uwsgi_response_add_content_length(wsgi_req, rlen)) goto end;
-        if (uwsgi_response_add_content_type(wsgi_req, urxc->content_type, urxc->content_type_len)) goto end;
+        if (uwsgi_response_prepare_headers(wsgi_req, "200 OK", 6)) goto release;
+        if (uwsgi_response_add_content_length(wsgi_req, rlen)) goto release;
+        if (uwsgi_response_add_content_type(wsgi_req, urxc->content_type, urxc->content_type_len)) goto release;
 
         uwsgi_response_write_body_do(wsgi_req, output, rlen);
-	xmlFree(output);
+release:
+	if (from_cache) free(output);
+	else xmlFree(output);
 
 end:
+	if (key) uwsgi_buffer_destroy(key);
 	if (ub_doc) uwsgi_buffer_destroy(ub_doc);
 	if (ub_stylesheet) uwsgi_buffer_destroy(ub_stylesheet);
 	if (ub_params) uwsgi_buffer_destroy(ub_params);
@@ -489,6 +696,16 @@ static int uwsgi_router_toxslt(struct uwsgi_route *ur, char *args) {
 
 
 
+static void uwsgi_xslt_post_fork() {
+	if (uxslt.no_ss_cache) return;
+	if (!uxslt.ss_cache_items) uxslt.ss_cache_items = 64;
+	if (pthread_mutex_init(&uxslt.lock, NULL)) {
+		uwsgi_error("uwsgi_xslt_post_fork()/pthread_mutex_init()");
+		exit(1);
+	}
+	uxslt.ss_cache = uwsgi_calloc(sizeof(struct uwsgi_xslt_stylesheet *) * uxslt.ss_cache_items);
+}
+
 static void router_xslt_register() {
         uwsgi_register_router("xslt", uwsgi_router_xslt);
         uwsgi_register_router("toxslt", uwsgi_router_toxslt);
@@ -500,6 +717,7 @@ struct uwsgi_plugin xslt_plugin = {
 	.modifier1 = 23,
 	.options = uwsgi_xslt_options,
 	.request = uwsgi_request_xslt,
+	.post_fork = uwsgi_xslt_post_fork,
 	.after_request = uwsgi_xslt_log,
         .on_load = router_xslt_register,
 };
@@ -5,29 +5,227 @@
 */
 
 #include "../../uwsgi.h"
+#ifdef __linux__
+#include <linux/filter.h>
+#endif
 
 extern struct uwsgi_server uwsgi;
 
 struct uwsgi_string_list *zergpool_socket_names;
+int zergpool_steer;
 
 #define ZERGPOOL_EVENTS 64
+// the jump offsets of the steering program are 8 bit
+#define ZERGPOOL_MAX_ZERGS 256
 
 struct uwsgi_option zergpool_options[] = {
 	{ "zergpool", required_argument, 0, "start a zergpool on specified address for specified address", uwsgi_opt_add_string_list, &zergpool_socket_names, 0},
 	{ "zerg-pool", required_argument, 0, "start a zergpool on specified address for specified address", uwsgi_opt_add_string_list, &zergpool_socket_names, 0},
+	{ "zergpool-steer", no_argument, 0, "give each zerg its own SO_REUSEPORT listener and steer new connections to the least loaded zergs", uwsgi_opt_true, &zergpool_steer, 0},
 	{0, 0, 0, 0, 0, 0, 0},
 };
 
+// a zerg attached to a steering pool
+struct zergpool_zerg {
+	// the connection the zerg reports its load on
+	int fd;
+	// busy workers permille
+	int load;
+	int active;
+};
+
 struct zergpool_socket {
 	int fd;
 	int *sockets;
 	int num_sockets;
 
+	// steering mode: names of the TCP addresses and a listener for each zerg slot
+	char **names;
+	int **slots;
+	struct zergpool_zerg *zergs;
+	int zergs_cnt;
+
 	struct zergpool_socket *next;
 };
 
 struct zergpool_socket *zergpool_sockets;
 
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+/*
+	pick a listener at random, weighting each zerg slot by its spare capacity:
+
+	A = random % total
+	for each slot but the last: if A < cumulative weight -> return slot
+	return last slot
+
+	idle slots have no weight, so the kernel never selects them
+*/
+static void zergpool_steer_update(struct zergpool_socket *zps) {
+	int i, pos;
+	uint32_t total = 0;
+	int n = zps->zergs_cnt;
+	if (n < 2) return;
+
+	uint32_t *cumulative = uwsgi_malloc(sizeof(uint32_t) * n);
+	for (i = 0; i < n; i++) {
+		struct zergpool_zerg *zerg = &zps->zergs[i];
+		if (zerg->active) {
+			int weight = 1000 - zerg->load;
+			if (weight < 10) weight = 10;
+			total += weight;
+		}
+		cumulative[i] = total;
+	}
+
+	if (!total) goto end;
+
+	struct sock_filter *code = uwsgi_calloc(sizeof(struct sock_filter) * ((n * 2) + 1));
+	struct sock_filter *ptr = code;
+	*ptr++ = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_RANDOM);
+	*ptr++ = (struct sock_filter) BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, total);
+	for (i = 0; i < n - 1; i++) {
+		*ptr++ = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, cumulative[i], 0, n - 1);
+	}
+	*ptr++ = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, n - 1);
+	for (i = 0; i < n - 1; i++) {
+		*ptr++ = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, i);
+	}
+
+	struct sock_fprog prog = {
+		.len = (n * 2) + 1,
+		.filter = code,
+	};
+
+	// the program is shared by the whole SO_REUSEPORT group
+	for (pos = 0; pos < zps->num_sockets; pos++) {
+		if (!zps->names[pos]) continue;
+		if (setsockopt(zps->slots[pos][0], SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog))) {
+			uwsgi_error("zergpool_steer_update()/setsockopt()");
+		}
+	}
+
+	free(code);
+end:
+	free(cumulative);
+}
+
+static void zergpool_zerg_attach(int queue, struct zergpool_socket *zps) {
+	int i, pos;
+	struct sockaddr_un zsun;
+	socklen_t zsun_len = sizeof(struct sockaddr_un);
+
+	int zerg_client = accept(zps->fd, (struct sockaddr *) &zsun, &zsun_len);
+	if (zerg_client < 0) {
+		uwsgi_error("zergpool_zerg_attach()/accept()");
+		return;
+	}
+
+	// reuse the slot of a dead zerg (its listeners are still in the groups)
+	int slot = -1;
+	for (i = 0; i < zps->zergs_cnt; i++) {
+		if (!zps->zergs[i].active) {
+			slot = i;
+			break;
+		}
+	}
+
+	if (slot < 0) {
+		if (zps->zergs_cnt >= ZERGPOOL_MAX_ZERGS) {
+			uwsgi_log("[zergpool] too many zergs attached, refusing the new one\n");
+			close(zerg_client);
+			return;
+		}
+		// bind the new listeners (their index in the group is the slot number)
+		for (pos = 0; pos < zps->num_sockets; pos++) {
+			if (!zps->names[pos]) continue;
+			int *listeners = realloc(zps->slots[pos], sizeof(int) * (zps->zergs_cnt + 1));
+			if (!listeners) {
+				uwsgi_error("zergpool_zerg_attach()/realloc()");
+				exit(1);
+			}
+			zps->slots[pos] = listeners;
+			char *name = uwsgi_str(zps->names[pos]);
+			int reuse_port = uwsgi.reuse_port;
+			uwsgi.reuse_port = 1;
+			listeners[zps->zergs_cnt] = bind_to_tcp(name, uwsgi.listen_queue, strrchr(name, ':'));
+			uwsgi.reuse_port = reuse_port;
+			free(name);
+			if (listeners[zps->zergs_cnt] < 0) {
+				uwsgi_log("[zergpool] unable to bind a SO_REUSEPORT listener on %s\n", zps->names[pos]);
+				exit(1);
+			}
+		}
+		struct zergpool_zerg *zergs = realloc(zps->zergs, sizeof(struct zergpool_zerg) * (zps->zergs_cnt + 1));
+		if (!zergs) {
+			uwsgi_error("zergpool_zerg_attach()/realloc()");
+			exit(1);
+		}
+		zps->zergs = zergs;
+		slot = zps->zergs_cnt;
+		zps->zergs_cnt++;
+	}
+
+	int *fds = uwsgi_malloc(sizeof(int) * zps->num_sockets);
+	for (pos = 0; pos < zps->num_sockets; pos++) {
+		fds[pos] = zps->names[pos] ? zps->slots[pos][slot] : zps->sockets[pos];
+	}
+	int ret = uwsgi_send_zerg(zerg_client, zps->num_sockets, fds);
+	free(fds);
+	if (ret) {
+		close(zerg_client);
+		return;
+	}
+
+	// a newborn zerg is still loading its apps, give it traffic after the first report
+	struct zergpool_zerg *zerg = &zps->zergs[slot];
+	zerg->fd = zerg_client;
+	zerg->load = 1000;
+	zerg->active = 1;
+	event_queue_add_fd_read(queue, zerg_client);
+	uwsgi_log("[zergpool] zerg attached to slot %d\n", slot);
+	zergpool_steer_update(zps);
+}
+
+static void zergpool_zerg_report(struct zergpool_socket *zps, int slot) {
+	struct zergpool_zerg *zerg = &zps->zergs[slot];
+	char buf[128];
+	ssize_t len = read(zerg->fd, buf, 127);
+	if (len <= 0) {
+		close(zerg->fd);
+		zerg->fd = -1;
+		zerg->active = 0;
+		uwsgi_log("[zergpool] zerg detached from slot %d\n", slot);
+		zergpool_steer_update(zps);
+		// nobody will accept() the connections queued in the dead zerg listeners
+		int pos;
+		for (pos = 0; pos < zps->num_sockets; pos++) {
+			if (!zps->names[pos]) continue;
+			int fd = zps->slots[pos][slot];
+			uwsgi_socket_nb(fd);
+			for (;;) {
+				int client = accept(fd, NULL, NULL);
+				if (client < 0) break;
+				close(client);
+			}
+		}
+		return;
+	}
+	buf[len] = 0;
+	// only the last complete report matters
+	char *end = buf + len;
+	while (end > buf && end[-1] == '\n') *--end = 0;
+	char *report = end;
+	while (report > buf && report[-1] != '\n') report--;
+	int load = atoi(report);
+	if (load < 0) load = 0;
+	if (load > 1000) load = 1000;
+	if (load != zerg->load) {
+		zerg->load = load;
+		zergpool_steer_update(zps);
+	}
+}
+#endif
+
 void zergpool_loop(int id, void *foobar) {
 
 	int i;
@@ -52,8 +250,23 @@ void zergpool_loop(int id, void *foobar) {
 			zps = zergpool_sockets;
 			while(zps) {
 				if (zps->fd == interesting_fd) {
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+					if (zergpool_steer) {
+						zergpool_zerg_attach(zergpool_queue, zps);
+						break;
+					}
+#endif
 					uwsgi_manage_zerg(zps->fd, zps->num_sockets, zps->sockets);
 				}
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+				int j;
+				for (j = 0; j < zps->zergs_cnt; j++) {
+					if (zps->zergs[j].active && zps->zergs[j].fd == interesting_fd) {
+						zergpool_zerg_report(zps, j);
+						break;
+					}
+				}
+#endif
 				zps = zps->next;
 			}
 		}
@@ -97,6 +310,10 @@ struct zergpool_socket *add_zergpool_socket(char *name, char *sockets) {
 	}
 	free(sock_list);
 	z_sock->sockets = uwsgi_calloc(sizeof(int) * (z_sock->num_sockets + 1));
+	if (zergpool_steer) {
+		z_sock->names = uwsgi_calloc(sizeof(char *) * z_sock->num_sockets);
+		z_sock->slots = uwsgi_calloc(sizeof(int *) * z_sock->num_sockets);
+	}
 
 	sock_list = uwsgi_str(sockets);
 	int pos = 0;
@@ -109,6 +326,14 @@ struct zergpool_socket *add_zergpool_socket(char *name, char *sockets) {
 			sockname = uwsgi_getsockname(z_sock->sockets[pos]);
 			uwsgi_log("zergpool %s bound to UNIX socket %s (fd: %d)\n", name, sockname, z_sock->sockets[pos]);
 		}
+		else if (zergpool_steer) {
+			// the listeners are bound when the zergs attach
+			z_sock->names[pos] = uwsgi_str(generate_socket_name(p));
+			z_sock->sockets[pos] = -1;
+			uwsgi_log("zergpool %s will steer TCP socket %s\n", name, z_sock->names[pos]);
+			pos++;
+			continue;
+		}
 		else {
 			char *gsn = generate_socket_name(p);
 			z_sock->sockets[pos] = bind_to_tcp(gsn, uwsgi.listen_queue, strchr(gsn, ':'));
@@ -127,6 +352,13 @@ int zergpool_init() {
 
 	if (!zergpool_socket_names) return 0;
 
+#if !defined(__linux__) || !defined(SO_ATTACH_REUSEPORT_CBPF)
+	if (zergpool_steer) {
+		uwsgi_log("zergpool steering requires SO_ATTACH_REUSEPORT_CBPF (Linux >= 4.5)\n");
+		exit(1);
+	}
+#endif
+
 	struct uwsgi_string_list *zpsn = zergpool_socket_names;
 	while(zpsn) {
 		char *colon = strchr(zpsn->value, ':');
@@ -98,7 +98,15 @@ int uwsgi_proto_base_accept(struct wsgi_request *wsgi_req, int fd) {
 
 	wsgi_req->c_len = sizeof(struct sockaddr_un);
 #if defined(__linux__) && defined(SOCK_NONBLOCK) && !defined(OBSOLETE_LINUX_KERNEL)
-        return accept4(fd, (struct sockaddr *) &wsgi_req->c_addr, (socklen_t *) & wsgi_req->c_len, SOCK_NONBLOCK);
+	int flags = SOCK_NONBLOCK;
+#ifdef SOCK_CLOEXEC
+	// saves the fcntl() in uwsgi_post_accept()
+	if (uwsgi.close_on_exec) {
+		flags |= SOCK_CLOEXEC;
+		wsgi_req->fd_cloexec = 1;
+	}
+#endif
+        return accept4(fd, (struct sockaddr *) &wsgi_req->c_addr, (socklen_t *) & wsgi_req->c_len, flags);
 #elif defined(__linux__)
 	int client_fd = accept(fd, (struct sockaddr *) &wsgi_req->c_addr, (socklen_t *) & wsgi_req->c_len);
 	if (client_fd >= 0) {
@@ -114,6 +122,85 @@ void uwsgi_proto_base_close(struct wsgi_request *wsgi_req) {
 	close(wsgi_req->fd);
 }
 
+/*
+	connections handed off by the routers (--fastrouter-handoff, --http-handoff)
+
+	the router connects to the UNIX socket and sends the client socket (SCM_RIGHTS) with a 32bit (little endian)
+	size followed by the bytes it already read from the client. Those bytes are consumed by the
+	parser (and by the body reader) before reading from the client socket.
+*/
+int uwsgi_proto_handoff_accept(struct wsgi_request *wsgi_req, int fd) {
+	int router_fd = uwsgi_proto_base_accept(wsgi_req, fd);
+	if (router_fd < 0) return -1;
+
+	int client_fd = -1;
+	int fds_count = 1;
+	pid_t pid;
+	uid_t uid;
+	gid_t gid;
+	uint8_t hdr[4];
+
+	// the router sends everything in a single shot
+	if (uwsgi_waitfd(router_fd, uwsgi.socket_timeout) <= 0) goto error;
+	ssize_t rlen = uwsgi_recv_cred_and_fds(router_fd, (char *) hdr, 4, &pid, &uid, &gid, &client_fd, &fds_count);
+	if (fds_count != 1 || client_fd < 0) {
+		uwsgi_log("uwsgi_proto_handoff_accept(): no socket received\n");
+		goto error;
+	}
+	if (rlen < 4 && uwsgi_read_whole_true_nb(router_fd, (char *) hdr + rlen, 4 - rlen, uwsgi.socket_timeout)) goto error;
+
+	size_t len = hdr[0] | (hdr[1] << 8) | (hdr[2] << 16) | ((uint32_t) hdr[3] << 24);
+	if (len > UWSGI_HANDOFF_MAX) {
+		uwsgi_log("uwsgi_proto_handoff_accept(): invalid handoff size: %llu\n", (unsigned long long) len);
+		goto error;
+	}
+	if (len > 0) {
+		wsgi_req->proto_handoff_buf = uwsgi_malloc(len);
+		if (uwsgi_read_whole_true_nb(router_fd, wsgi_req->proto_handoff_buf, len, uwsgi.socket_timeout)) goto error;
+		wsgi_req->proto_handoff_len = len;
+	}
+	close(router_fd);
+
+	// the peer is the real client
+	wsgi_req->fd_cloexec = 0;
+	wsgi_req->c_len = sizeof(struct sockaddr_un);
+	if (getpeername(client_fd, (struct sockaddr *) &wsgi_req->c_addr, (socklen_t *) & wsgi_req->c_len)) {
+		uwsgi_error("uwsgi_proto_handoff_accept()/getpeername()");
+		close(client_fd);
+		return -1;
+	}
+	uwsgi_socket_nb(client_fd);
+	return client_fd;
+
+error:
+	if (client_fd >= 0) close(client_fd);
+	close(router_fd);
+	return -1;
+}
+
+// read from the handed off data (if any) or from the socket
+ssize_t uwsgi_proto_handoff_read(struct wsgi_request *wsgi_req, char *buf, size_t len) {
+	if (!wsgi_req->proto_handoff_buf) {
+		return read(wsgi_req->fd, buf, len);
+	}
+	size_t remains = UMIN(wsgi_req->proto_handoff_len - wsgi_req->proto_handoff_pos, len);
+	memcpy(buf, wsgi_req->proto_handoff_buf + wsgi_req->proto_handoff_pos, remains);
+	wsgi_req->proto_handoff_pos += remains;
+	if (wsgi_req->proto_handoff_pos >= wsgi_req->proto_handoff_len) {
+		free(wsgi_req->proto_handoff_buf);
+		wsgi_req->proto_handoff_buf = NULL;
+	}
+	return remains;
+}
+
+ssize_t uwsgi_proto_handoff_read_body(struct wsgi_request *wsgi_req, char *buf, size_t len) {
+	// the part already moved by the parser comes first
+	if (wsgi_req->proto_parser_remains > 0) {
+		return uwsgi_proto_base_read_body(wsgi_req, buf, len);
+	}
+	return uwsgi_proto_handoff_read(wsgi_req, buf, len);
+}
+
 #ifdef UWSGI_SSL
 int uwsgi_proto_ssl_accept(struct wsgi_request *wsgi_req, int server_fd) {
 
@@ -137,20 +224,20 @@ void uwsgi_proto_ssl_close(struct wsgi_request *wsgi_req) {
 struct uwsgi_buffer *uwsgi_proto_base_add_header(struct wsgi_request *wsgi_req, char *k, uint16_t kl, char *v, uint16_t vl) {
 	struct uwsgi_buffer *ub = NULL;
 	if (kl > 0) {
-		ub = uwsgi_buffer_new(kl + 2 + vl + 2);
+		ub = uwsgi_buffer_get(kl + 2 + vl + 2);
 		if (uwsgi_buffer_append(ub, k, kl)) goto end;
 		if (uwsgi_buffer_append(ub, ": ", 2)) goto end;
 		if (uwsgi_buffer_append(ub, v, vl)) goto end;
 		if (uwsgi_buffer_append(ub, "\r\n", 2)) goto end;
 	}
 	else {
-		ub = uwsgi_buffer_new(vl + 2);
+		ub = uwsgi_buffer_get(vl + 2);
 		if (uwsgi_buffer_append(ub, v, vl)) goto end;
                 if (uwsgi_buffer_append(ub, "\r\n", 2)) goto end;
 	}
 	return ub;
 end:
-	uwsgi_buffer_destroy(ub);
+	uwsgi_buffer_put(ub);
 	return NULL;
 }
 
@@ -158,35 +245,35 @@ struct uwsgi_buffer *uwsgi_proto_base_prepare_headers(struct wsgi_request *wsgi_
         struct uwsgi_buffer *ub = NULL;
 	if (uwsgi.cgi_mode == 0) {
 		if (wsgi_req->protocol_len) {
-			ub = uwsgi_buffer_new(wsgi_req->protocol_len + 1 + sl + 2);
+			ub = uwsgi_buffer_get(wsgi_req->protocol_len + 1 + sl + 2);
 			if (uwsgi_buffer_append(ub, wsgi_req->protocol, wsgi_req->protocol_len)) goto end;
 			if (uwsgi_buffer_append(ub, " ", 1)) goto end;
 		}
 		else {
-			ub = uwsgi_buffer_new(9 + sl + 2);
+			ub = uwsgi_buffer_get(9 + sl + 2);
 			if (uwsgi_buffer_append(ub, "HTTP/1.0 ", 9)) goto end;
 		}
 	}
 	else {
-		ub = uwsgi_buffer_new(8 + sl + 2);
+		ub = uwsgi_buffer_get(8 + sl + 2);
 		if (uwsgi_buffer_append(ub, "Status: ", 8)) goto end;
 	}
         if (uwsgi_buffer_append(ub, s, sl)) goto end;
 	if (uwsgi_buffer_append(ub, "\r\n", 2)) goto end;
         return ub;
 end:
-        uwsgi_buffer_destroy(ub);
+        uwsgi_buffer_put(ub);
         return NULL;
 }
 
 struct uwsgi_buffer *uwsgi_proto_base_cgi_prepare_headers(struct wsgi_request *wsgi_req, char *s, uint16_t sl) {
-	struct uwsgi_buffer *ub = uwsgi_buffer_new(8 + sl + 2);
+	struct uwsgi_buffer *ub = uwsgi_buffer_get(8 + sl + 2);
 	if (uwsgi_buffer_append(ub, "Status: ", 8)) goto end;
         if (uwsgi_buffer_append(ub, s, sl)) goto end;
 	if (uwsgi_buffer_append(ub, "\r\n", 2)) goto end;
 	return ub;	
 end:
-	uwsgi_buffer_destroy(ub);
+	uwsgi_buffer_put(ub);
 	return NULL;
 }
 
@@ -261,6 +348,118 @@ int uwsgi_proto_base_writev(struct wsgi_request * wsgi_req, struct iovec *iov, s
 }
 
 
+// remove the first wlen bytes of a vector (as uwsgi_proto_base_writev() does)
+static void proto_iov_consume(struct iovec *iov, size_t *len, size_t wlen) {
+	size_t i = 0;
+	while (i < *len && iov[i].iov_len <= wlen) {
+		wlen -= iov[i].iov_len;
+		i++;
+	}
+	if (i < *len) {
+		iov[i].iov_base += wlen;
+		iov[i].iov_len -= wlen;
+	}
+	memmove(iov, iov + i, sizeof(struct iovec) * (*len - i));
+	*len -= i;
+}
+
+#define UWSGI_PROTO_FRAMED_BATCH 8
+
+/*
+	writev() for protocols sending the body in records (an 8 bytes header followed by at most max bytes),
+	a batch of records is sent with a single syscall. Only the record interrupted by a partial write is
+	remembered (its header in proto_frame_hdr and its remaining payload), write_pos counts only the payload
+*/
+int uwsgi_proto_framed_writev(struct wsgi_request *wsgi_req, struct iovec *iov, size_t *len, size_t max, void (*header)(struct wsgi_request *, char *, size_t)) {
+	char hdrs[UWSGI_PROTO_FRAMED_BATCH][8];
+	char *rec_hdr[UWSGI_PROTO_FRAMED_BATCH];
+	size_t rec_hlen[UWSGI_PROTO_FRAMED_BATCH];
+	size_t rec_payload[UWSGI_PROTO_FRAMED_BATCH];
+	struct iovec fiov[UWSGI_RESPONSE_IOV];
+
+	for(;;) {
+		size_t i, pending = 0;
+		for(i=0;i<*len;i++) pending += iov[i].iov_len;
+		if (!wsgi_req->proto_frame_remains && !pending) return UWSGI_OK;
+
+		size_t records = 0, fiov_len = 0, iov_i = 0, iov_off = 0, requested = 0;
+		// resume the interrupted record
+		size_t payload = wsgi_req->proto_frame_remains;
+		size_t hlen = payload ? wsgi_req->proto_frame_hdr_remains : 0;
+		char *hptr = wsgi_req->proto_frame_hdr + (8 - hlen);
+
+		while (records < UWSGI_PROTO_FRAMED_BATCH && fiov_len + 2 <= UWSGI_RESPONSE_IOV) {
+			if (!payload) {
+				if (!pending) break;
+				payload = UMIN(pending, max);
+				header(wsgi_req, hdrs[records], payload);
+				hptr = hdrs[records];
+				hlen = 8;
+			}
+			rec_hdr[records] = hptr;
+			rec_hlen[records] = hlen;
+			rec_payload[records] = payload;
+			records++;
+			if (hlen) {
+				fiov[fiov_len].iov_base = hptr;
+				fiov[fiov_len].iov_len = hlen;
+				fiov_len++;
+			}
+			size_t need = payload;
+			while (need > 0 && iov_i < *len && fiov_len < UWSGI_RESPONSE_IOV) {
+				size_t chunk = UMIN(iov[iov_i].iov_len - iov_off, need);
+				if (chunk) {
+					fiov[fiov_len].iov_base = iov[iov_i].iov_base + iov_off;
+					fiov[fiov_len].iov_len = chunk;
+					fiov_len++;
+					need -= chunk;
+					iov_off += chunk;
+				}
+				if (iov_off == iov[iov_i].iov_len) {
+					iov_i++;
+					iov_off = 0;
+				}
+			}
+			pending -= payload - need;
+			requested += hlen + payload - need;
+			payload = 0;
+			// no more space in the vector
+			if (need > 0) break;
+		}
+
+		ssize_t wlen = writev(wsgi_req->fd, fiov, fiov_len);
+		if (wlen <= 0) {
+			if (wlen < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS)) {
+				return UWSGI_AGAIN;
+			}
+			return -1;
+		}
+
+		// find the record interrupted by the (partial) write
+		size_t sent = wlen, body_sent = 0;
+		wsgi_req->proto_frame_hdr_remains = 0;
+		wsgi_req->proto_frame_remains = 0;
+		for(i=0;i<records;i++) {
+			size_t h = UMIN(sent, rec_hlen[i]);
+			sent -= h;
+			size_t b = UMIN(sent, rec_payload[i]);
+			sent -= b;
+			body_sent += b;
+			if (h < rec_hlen[i] || b < rec_payload[i]) {
+				size_t hremains = rec_hlen[i] - h;
+				memmove(wsgi_req->proto_frame_hdr + (8 - hremains), rec_hdr[i] + h, hremains);
+				wsgi_req->proto_frame_hdr_remains = hremains;
+				wsgi_req->proto_frame_remains = rec_payload[i] - b;
+				break;
+			}
+		}
+		wsgi_req->write_pos += body_sent;
+		proto_iov_consume(iov, len, body_sent);
+		if ((size_t) wlen < requested) return UWSGI_AGAIN;
+	}
+}
+
+
 #ifdef UWSGI_SSL
 int uwsgi_proto_ssl_write(struct wsgi_request * wsgi_req, char *buf, size_t len) {
 	int ret = -1;
@@ -315,6 +514,24 @@ int uwsgi_proto_base_sendfile(struct wsgi_request * wsgi_req, int fd, size_t pos
 int uwsgi_proto_ssl_sendfile(struct wsgi_request *wsgi_req, int fd, size_t pos, size_t len) {
 	char buf[32768];
 
+#ifdef SSL_OP_ENABLE_KTLS
+	// the kernel does the encryption, the file can be sent without copies
+	if (BIO_get_ktls_send(SSL_get_wbio(wsgi_req->ssl))) {
+		ossl_ssize_t wlen = SSL_sendfile(wsgi_req->ssl, fd, pos+wsgi_req->write_pos, len-wsgi_req->write_pos, 0);
+		if (wlen > 0) {
+			wsgi_req->write_pos += wlen;
+			if (wsgi_req->write_pos == len) {
+				return UWSGI_OK;
+			}
+			return UWSGI_AGAIN;
+		}
+		if (SSL_get_error(wsgi_req->ssl, wlen) == SSL_ERROR_WANT_WRITE) {
+			return UWSGI_AGAIN;
+		}
+		return -1;
+	}
+#endif
+
 	ssize_t rlen = read(fd, buf, UMIN(len, 32768));
 	if (rlen <= 0) return -1;
 
@@ -72,7 +72,8 @@ int fastcgi_to_uwsgi(struct wsgi_request *wsgi_req, char *buf, size_t len) {
 /*
 
 	each fastcgi packet is composed by a header and a body
-	the parser rebuild a whole packet until it finds a 0 STDIN
+	the parser walks the buffered records (params are converted directly from the
+	read buffer) until it finds a STDIN one, the memory is compacted only once
 
 */
 
@@ -102,52 +103,57 @@ int uwsgi_proto_fastcgi_parser(struct wsgi_request *wsgi_req) {
 	return -1;
 parse:
 	wsgi_req->proto_parser_pos += len;
+	// offset of the first unparsed record
+	size_t off = 0;
+	struct fcgi_record *fr;
+	uint32_t fcgi_all_len = 0;
 	// ok let's see what we need to do
-	for (;;) {
-		if (wsgi_req->proto_parser_pos >= sizeof(struct fcgi_record)) {
-			struct fcgi_record *fr = (struct fcgi_record *) wsgi_req->proto_parser_buf;
-			uint16_t fcgi_len = uwsgi_be16((char *) &fr->cl1);
-			uint32_t fcgi_all_len = sizeof(struct fcgi_record) + fcgi_len + fr->pad;
-			uint8_t fcgi_type = fr->type;
-			uint8_t *sid = (uint8_t *) & wsgi_req->stream_id;
-			sid[0] = fr->req0;
-			sid[1] = fr->req1;
-			// if STDIN, end of the loop
-			if (fcgi_type == 5) {
-				wsgi_req->uh->modifier1 = uwsgi.fastcgi_modifier1;
-				wsgi_req->uh->modifier2 = uwsgi.fastcgi_modifier2;
-				// does the request stream ended ?
-				if (fcgi_len == 0) wsgi_req->proto_parser_eof = 1;
-				return UWSGI_OK;
-			}
-			// if we have a full packet, parse it and reset the memory
-			if (wsgi_req->proto_parser_pos >= fcgi_all_len) {
-				// PARAMS ? (ignore other types)
-				if (fcgi_type == 4) {
-					if (fastcgi_to_uwsgi(wsgi_req, wsgi_req->proto_parser_buf + sizeof(struct fcgi_record), fcgi_len)) {
-						return -1;
-					}
-				}
-				memmove(wsgi_req->proto_parser_buf, wsgi_req->proto_parser_buf + fcgi_all_len, wsgi_req->proto_parser_pos - fcgi_all_len);
-				wsgi_req->proto_parser_pos -= fcgi_all_len;
-			}
-			else if (fcgi_all_len > wsgi_req->proto_parser_buf_size - wsgi_req->proto_parser_pos) {
-				char *tmp_buf = realloc(wsgi_req->proto_parser_buf, wsgi_req->proto_parser_buf_size + fcgi_all_len - (wsgi_req->proto_parser_buf_size - wsgi_req->proto_parser_pos));
-				if (!tmp_buf) {
-					uwsgi_error("uwsgi_proto_fastcgi_parser()/realloc()");
-					return -1;
-				}
-				wsgi_req->proto_parser_buf = tmp_buf;
-				wsgi_req->proto_parser_buf_size += (fcgi_all_len - (wsgi_req->proto_parser_buf_size - wsgi_req->proto_parser_pos));
-				break;
+	while (wsgi_req->proto_parser_pos - off >= sizeof(struct fcgi_record)) {
+		fr = (struct fcgi_record *) (wsgi_req->proto_parser_buf + off);
+		uint16_t fcgi_len = uwsgi_be16((char *) &fr->cl1);
+		fcgi_all_len = sizeof(struct fcgi_record) + fcgi_len + fr->pad;
+		uint8_t fcgi_type = fr->type;
+		uint8_t *sid = (uint8_t *) & wsgi_req->stream_id;
+		sid[0] = fr->req0;
+		sid[1] = fr->req1;
+		// if STDIN, end of the loop (the body reader expects the record at the start of the buffer)
+		if (fcgi_type == 5) {
+			wsgi_req->uh->modifier1 = uwsgi.fastcgi_modifier1;
+			wsgi_req->uh->modifier2 = uwsgi.fastcgi_modifier2;
+			// does the request stream ended ?
+			if (fcgi_len == 0) wsgi_req->proto_parser_eof = 1;
+			if (off > 0) {
+				memmove(wsgi_req->proto_parser_buf, wsgi_req->proto_parser_buf + off, wsgi_req->proto_parser_pos - off);
+				wsgi_req->proto_parser_pos -= off;
 			}
-			else {
-				break;
+			return UWSGI_OK;
+		}
+		// incomplete record
+		if (wsgi_req->proto_parser_pos - off < fcgi_all_len) break;
+		// PARAMS ? (ignore other types)
+		if (fcgi_type == 4) {
+			if (fastcgi_to_uwsgi(wsgi_req, wsgi_req->proto_parser_buf + off + sizeof(struct fcgi_record), fcgi_len)) {
+				return -1;
 			}
 		}
-		else {
-			break;
+		off += fcgi_all_len;
+		fcgi_all_len = 0;
+	}
+
+	if (off > 0) {
+		memmove(wsgi_req->proto_parser_buf, wsgi_req->proto_parser_buf + off, wsgi_req->proto_parser_pos - off);
+		wsgi_req->proto_parser_pos -= off;
+	}
+
+	// the incomplete record does not fit in the buffer
+	if (fcgi_all_len > wsgi_req->proto_parser_buf_size) {
+		char *tmp_buf = realloc(wsgi_req->proto_parser_buf, fcgi_all_len);
+		if (!tmp_buf) {
+			uwsgi_error("uwsgi_proto_fastcgi_parser()/realloc()");
+			return -1;
 		}
+		wsgi_req->proto_parser_buf = tmp_buf;
+		wsgi_req->proto_parser_buf_size = fcgi_all_len;
 	}
 	return UWSGI_AGAIN;
 
@@ -239,44 +245,32 @@ gather:
 
 }
 
-// write a STDOUT packet
-int uwsgi_proto_fastcgi_write(struct wsgi_request *wsgi_req, char *buf, size_t len) {
-
-	// fastcgi packets are limited to 64k
-	if (wsgi_req->proto_parser_status == 0) {
-		uint16_t fcgi_len = UMIN(len - wsgi_req->write_pos, 0xffff);
-		wsgi_req->proto_parser_status = fcgi_len;
-		struct fcgi_record fr;
-		fr.version = 1;
-		fr.type = 6;
-		uint8_t *sid = (uint8_t *) & wsgi_req->stream_id;
-		fr.req1 = sid[1];
-		fr.req0 = sid[0];
-		fr.pad = 0;
-		fr.reserved = 0;
-		fr.cl0 = (uint8_t) (fcgi_len & 0xff);
-		fr.cl1 = (uint8_t) ((fcgi_len >> 8) & 0xff);
-		if (uwsgi_write_true_nb(wsgi_req->fd, (char *) &fr, sizeof(struct fcgi_record), uwsgi.socket_timeout)) {
-			return -1;
-		}
-	}
+// build the header of a STDOUT record
+static void fastcgi_stdout_header(struct wsgi_request *wsgi_req, char *buf, size_t len) {
+	struct fcgi_record *fr = (struct fcgi_record *) buf;
+	fr->version = 1;
+	fr->type = 6;
+	uint8_t *sid = (uint8_t *) & wsgi_req->stream_id;
+	fr->req1 = sid[1];
+	fr->req0 = sid[0];
+	fr->pad = 0;
+	fr->reserved = 0;
+	fr->cl0 = (uint8_t) (len & 0xff);
+	fr->cl1 = (uint8_t) ((len >> 8) & 0xff);
+}
 
-	ssize_t wlen = write(wsgi_req->fd, buf + wsgi_req->write_pos, wsgi_req->proto_parser_status);
-	if (wlen > 0) {
-		wsgi_req->write_pos += wlen;
-		wsgi_req->proto_parser_status -= wlen;
-		if (wsgi_req->write_pos == len) {
-			return UWSGI_OK;
-		}
-		return UWSGI_AGAIN;
-	}
-	if (wlen < 0) {
-		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS) {
-			return UWSGI_AGAIN;
-		}
-	}
-	return -1;
+// write STDOUT packets (fastcgi packets are limited to 64k), headers and data are sent with the same writev()
+int uwsgi_proto_fastcgi_write(struct wsgi_request *wsgi_req, char *buf, size_t len) {
+	struct iovec iov;
+	size_t iov_len = 1;
+	iov.iov_base = buf + wsgi_req->write_pos;
+	iov.iov_len = len - wsgi_req->write_pos;
+	return uwsgi_proto_framed_writev(wsgi_req, &iov, &iov_len, 0xffff, fastcgi_stdout_header);
+}
 
+// the whole vector is coalesced in the minimum number of STDOUT packets
+int uwsgi_proto_fastcgi_writev(struct wsgi_request *wsgi_req, struct iovec *iov, size_t *len) {
+	return uwsgi_proto_framed_writev(wsgi_req, iov, len, 0xffff, fastcgi_stdout_header);
 }
 
 void uwsgi_proto_fastcgi_close(struct wsgi_request *wsgi_req) {
@@ -314,37 +308,39 @@ end:
 int uwsgi_proto_fastcgi_sendfile(struct wsgi_request *wsgi_req, int fd, size_t pos, size_t len) {
 
 	// fastcgi packets are limited to 64k
-	if (wsgi_req->proto_parser_status == 0) {
-		uint16_t fcgi_len = (uint16_t) UMIN(len - wsgi_req->write_pos, 0xffff);
-		wsgi_req->proto_parser_status = fcgi_len;
-		struct fcgi_record fr;
-		fr.version = 1;
-		fr.type = 6;
-		uint8_t *sid = (uint8_t *) & wsgi_req->stream_id;
-		fr.req1 = sid[1];
-		fr.req0 = sid[0];
-		fr.pad = 0;
-		fr.reserved = 0;
-		fr.cl0 = (uint8_t) (fcgi_len & 0xff);
-		fr.cl1 = (uint8_t) ((fcgi_len >> 8) & 0xff);
-		if (uwsgi_write_true_nb(wsgi_req->fd, (char *) &fr, sizeof(struct fcgi_record), uwsgi.socket_timeout)) {
-			return -1;
-		}
+	if (wsgi_req->proto_frame_remains == 0) {
+		if (wsgi_req->write_pos == len) return UWSGI_OK;
+		wsgi_req->proto_frame_remains = UMIN(len - wsgi_req->write_pos, 0xffff);
+		fastcgi_stdout_header(wsgi_req, wsgi_req->proto_frame_hdr, wsgi_req->proto_frame_remains);
+		wsgi_req->proto_frame_hdr_remains = sizeof(struct fcgi_record);
+	}
+
+	// the header is sent without blocking (and possibly in the same segment of the data)
+	if (wsgi_req->proto_frame_hdr_remains > 0) {
+		int flags = 0;
+#ifdef MSG_MORE
+		flags = MSG_MORE;
+#endif
+		ssize_t hlen = send(wsgi_req->fd, wsgi_req->proto_frame_hdr + (sizeof(struct fcgi_record) - wsgi_req->proto_frame_hdr_remains), wsgi_req->proto_frame_hdr_remains, flags);
+		if (hlen < 0) goto error;
+		if (hlen == 0) return -1;
+		wsgi_req->proto_frame_hdr_remains -= hlen;
+		if (wsgi_req->proto_frame_hdr_remains > 0) return UWSGI_AGAIN;
 	}
 
-	ssize_t wlen = uwsgi_sendfile_do(wsgi_req->fd, fd, pos + wsgi_req->write_pos, wsgi_req->proto_parser_status);
+	ssize_t wlen = uwsgi_sendfile_do(wsgi_req->fd, fd, pos + wsgi_req->write_pos, wsgi_req->proto_frame_remains);
 	if (wlen > 0) {
 		wsgi_req->write_pos += wlen;
-		wsgi_req->proto_parser_status -= wlen;
+		wsgi_req->proto_frame_remains -= wlen;
 		if (wsgi_req->write_pos == len) {
 			return UWSGI_OK;
 		}
 		return UWSGI_AGAIN;
 	}
-	if (wlen < 0) {
-		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS) {
-			return UWSGI_AGAIN;
-		}
+	if (wlen == 0) return -1;
+error:
+	if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS) {
+		return UWSGI_AGAIN;
 	}
 	return -1;
 }
@@ -357,6 +353,7 @@ void uwsgi_proto_fastcgi_setup(struct uwsgi_socket *uwsgi_sock) {
 	uwsgi_sock->proto_fix_headers = uwsgi_proto_base_fix_headers;
 	uwsgi_sock->proto_read_body = uwsgi_proto_fastcgi_read_body;
 	uwsgi_sock->proto_write = uwsgi_proto_fastcgi_write;
+	uwsgi_sock->proto_writev = uwsgi_proto_fastcgi_writev;
 	uwsgi_sock->proto_write_headers = uwsgi_proto_fastcgi_write;
 	uwsgi_sock->proto_sendfile = uwsgi_proto_fastcgi_sendfile;
 	uwsgi_sock->proto_close = uwsgi_proto_fastcgi_close;
@@ -370,6 +367,7 @@ void uwsgi_proto_fastcgi_nph_setup(struct uwsgi_socket *uwsgi_sock) {
 	uwsgi_sock->proto_fix_headers = uwsgi_proto_base_fix_headers;
 	uwsgi_sock->proto_read_body = uwsgi_proto_fastcgi_read_body;
 	uwsgi_sock->proto_write = uwsgi_proto_fastcgi_write;
+	uwsgi_sock->proto_writev = uwsgi_proto_fastcgi_writev;
 	uwsgi_sock->proto_write_headers = uwsgi_proto_fastcgi_write;
 	uwsgi_sock->proto_sendfile = uwsgi_proto_fastcgi_sendfile;
 	uwsgi_sock->proto_close = uwsgi_proto_fastcgi_close;
@@ -4,33 +4,39 @@
 
 extern struct uwsgi_server uwsgi;
 
+// jump to the next CR (memchr() is vectorized by the libc)
+static inline char *http_next_cr(char *ptr, char *watermark) {
+	char *cr = memchr(ptr, '\r', watermark - ptr);
+	return cr ? cr : watermark;
+}
+
 static char * http_header_to_cgi(char *hh, size_t hhlen, size_t *keylen, size_t *vallen, int *has_prefix) {
 	size_t i;
 	char *val = hh;
-	int status = 0;
+	// only the name is converted, values (think about big cookies) are never scanned
 	for (i = 0; i < hhlen; i++) {
-                if (!status) {
-                        hh[i] = toupper((int) hh[i]);
-                        if (hh[i] == '-')
-                                hh[i] = '_';
-                        if (hh[i] == ':') {
-                                status = 1;
-                                *keylen = i;
-                        }
-                }
-                else if (status == 1 && hh[i] != ' ') {
-                        status = 2;
-                        val += i;
-                        *vallen+=1;
-                }
-                else if (status == 2) {
-                        *vallen+=1;
-                }
-        }
+		char c = hh[i];
+		if (c == ':') break;
+		if (c >= 'a' && c <= 'z') {
+			hh[i] = c - ('a' - 'A');
+		}
+		else if (c == '-') {
+			hh[i] = '_';
+		}
+	}
 
-	if (!(*keylen))
+	if (i == 0 || i >= hhlen)
                 return NULL;
 
+	*keylen = i;
+	for (i++; i < hhlen; i++) {
+		if (hh[i] != ' ') {
+			val += i;
+			*vallen = hhlen - i;
+			break;
+		}
+	}
+
 	if (uwsgi_strncmp("CONTENT_LENGTH", 14, hh, *keylen) && uwsgi_strncmp("CONTENT_TYPE", 12, hh, *keylen)) {
 		*has_prefix = 0x02;
         }
@@ -254,6 +260,8 @@ static int http_parse(struct wsgi_request *wsgi_req, char *watermark) {
 	// SERVER_PROTOCOL
 	base = ptr;
 	while (ptr < watermark) {
+		ptr = http_next_cr(ptr, watermark);
+		if (ptr >= watermark) break;
 		if (*ptr == '\r') {
 			if (ptr + 1 >= watermark)
 				return -1 ;
@@ -322,6 +330,8 @@ static int http_parse(struct wsgi_request *wsgi_req, char *watermark) {
 	struct uwsgi_string_list *headers = NULL, *usl = NULL;
 
 	while (ptr < watermark) {
+		ptr = http_next_cr(ptr, watermark);
+		if (ptr >= watermark) break;
 		if (*ptr == '\r') {
 			if (ptr + 1 >= watermark)
 				return -1;
@@ -419,7 +429,7 @@ static int uwsgi_proto_http_parser(struct wsgi_request *wsgi_req) {
 		return -1;
 	}
 
-	ssize_t len = read(wsgi_req->fd, wsgi_req->proto_parser_buf + wsgi_req->proto_parser_pos, uwsgi.buffer_size - wsgi_req->proto_parser_pos);
+	ssize_t len = uwsgi_proto_handoff_read(wsgi_req, wsgi_req->proto_parser_buf + wsgi_req->proto_parser_pos, uwsgi.buffer_size - wsgi_req->proto_parser_pos);
 	if (len > 0) {
 		goto parse;
 	}
@@ -580,6 +590,11 @@ clear:
 
 
 struct uwsgi_buffer *uwsgi_to_http(struct wsgi_request *wsgi_req, char *host, uint16_t host_len, char *uri, uint16_t uri_len) {
+	return uwsgi_to_http2(wsgi_req, host, host_len, uri, uri_len, 0);
+}
+
+// keepalive requests are still HTTP/1.0, so the response cannot be chunked
+struct uwsgi_buffer *uwsgi_to_http2(struct wsgi_request *wsgi_req, char *host, uint16_t host_len, char *uri, uint16_t uri_len, int keepalive) {
 
         struct uwsgi_buffer *ub = uwsgi_buffer_new(4096);
 
@@ -655,7 +670,12 @@ next:
 	}
 
 	// append required headers
-	if (uwsgi_buffer_append(ub, "Connection: close\r\n", 19)) goto clear;
+	if (keepalive) {
+		if (uwsgi_buffer_append(ub, "Connection: keep-alive\r\n", 24)) goto clear;
+	}
+	else {
+		if (uwsgi_buffer_append(ub, "Connection: close\r\n", 19)) goto clear;
+	}
 	if (uwsgi_buffer_append(ub, "X-Forwarded-For: ", 17)) goto clear;
 
 	if (x_forwarded_for_len > 0) {
@@ -732,6 +752,13 @@ void uwsgi_proto_http_setup(struct uwsgi_socket *uwsgi_sock) {
 
 }
 
+// connections passed by the http router (--http-handoff)
+void uwsgi_proto_http_handoff_setup(struct uwsgi_socket *uwsgi_sock) {
+	uwsgi_proto_http_setup(uwsgi_sock);
+	uwsgi_sock->proto_accept = uwsgi_proto_handoff_accept;
+	uwsgi_sock->proto_read_body = uwsgi_proto_handoff_read_body;
+}
+
 /*
 close the connection on errors, incomplete parsing, HTTP/1.0,  pipelined or offloaded requests
 NOTE: Connection: close is not honoured
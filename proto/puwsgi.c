@@ -13,7 +13,125 @@ increase write_errors on error to force socket close
 
 */
 
+/*
+
+multiplexed puwsgi (v2)
+
+a peer can send each request as a series of frames, every frame is a uwsgi packet
+with modifier1 254, the frame type as modifier2 and a 4 bytes (little endian) request id
+at the start of the payload:
+
+	REQUEST  -> the uwsgi packet (header + vars) of the request
+	BODY     -> a chunk of the request body
+	RESPONSE -> a chunk of the response (sent by the worker)
+	END      -> the response is complete (sent by the worker)
+
+the end of the response is always known, so the connection can be reused after every request
+(unframed responses, HEAD requests and unread bodies included). Requests can be pipelined and
+their body chunks interleaved: frames not belonging to the running request are kept in the
+per-core buffer, body frames of already completed requests (ids must increase on a connection)
+are discarded.
+
+*/
+
+// frames waiting in the per-core buffer cannot be more than this
+#define UWSGI_PUWSGI_BACKLOG (4 * (UMAX16 + 4))
+
+static uint16_t puwsgi_frame_size(char *buf) {
+	return (uint8_t) buf[1] | (((uint8_t) buf[2]) << 8);
+}
+
+static uint32_t puwsgi_frame_id(char *buf) {
+	return (uint8_t) buf[4] | (((uint8_t) buf[5]) << 8) | (((uint8_t) buf[6]) << 16) | (((uint32_t) (uint8_t) buf[7]) << 24);
+}
+
+static void puwsgi_frame_header(char *buf, uint8_t type, uint32_t id, uint16_t len) {
+	uint16_t fsize = len + 4;
+	buf[0] = UWSGI_MODIFIER_PUWSGI_FRAME;
+	buf[1] = (uint8_t) (fsize & 0xff);
+	buf[2] = (uint8_t) ((fsize >> 8) & 0xff);
+	buf[3] = type;
+	buf[4] = (uint8_t) (id & 0xff);
+	buf[5] = (uint8_t) ((id >> 8) & 0xff);
+	buf[6] = (uint8_t) ((id >> 16) & 0xff);
+	buf[7] = (uint8_t) ((id >> 24) & 0xff);
+}
+
+static void puwsgi_frame_drop(struct uwsgi_buffer *ub, size_t pos, size_t len) {
+	memmove(ub->buf + pos, ub->buf + pos + len, ub->pos - (pos + len));
+	ub->pos -= len;
+}
+
+// read more frames in the per-core buffer
+static ssize_t puwsgi_mux_fill(struct wsgi_request *wsgi_req, struct uwsgi_buffer *ub) {
+	if (ub->pos >= UWSGI_PUWSGI_BACKLOG) {
+		uwsgi_log("[uwsgi-puwsgi] too many pipelined frames on fd %d\n", wsgi_req->fd);
+		errno = ENOBUFS;
+		return -1;
+	}
+	if (uwsgi_buffer_ensure(ub, 32768)) return -1;
+	ssize_t len = read(wsgi_req->fd, ub->buf + ub->pos, ub->len - ub->pos);
+	if (len > 0) ub->pos += len;
+	return len;
+}
+
+static int puwsgi_mux_parser(struct wsgi_request *wsgi_req, struct uwsgi_buffer *ub) {
+	for(;;) {
+		while (ub->pos >= 8) {
+			if ((uint8_t) ub->buf[0] != UWSGI_MODIFIER_PUWSGI_FRAME) goto invalid;
+			uint16_t fsize = puwsgi_frame_size(ub->buf);
+			if (fsize < 4) goto invalid;
+			if (ub->pos < (size_t) fsize + 4) break;
+			uint8_t type = ub->buf[3];
+			// remains of the body of a completed request
+			if (type == UWSGI_PUWSGI_BODY) {
+				puwsgi_frame_drop(ub, 0, fsize + 4);
+				continue;
+			}
+			if (type != UWSGI_PUWSGI_REQUEST || fsize < 8) goto invalid;
+			char *pkt = ub->buf + 8;
+			uint16_t pktsize = puwsgi_frame_size(pkt);
+			if ((size_t) pktsize + 8 != fsize) goto invalid;
+			if (pktsize > uwsgi.buffer_size) {
+				uwsgi_log("invalid request block size: %u (max %u)...skip\n", pktsize, uwsgi.buffer_size);
+				wsgi_req->write_errors++;
+				return -1;
+			}
+			memcpy(wsgi_req->uh, pkt, pktsize + 4);
+#ifdef __BIG_ENDIAN__
+			wsgi_req->uh->_pktsize = uwsgi_swap16(wsgi_req->uh->_pktsize);
+#endif
+			wsgi_req->len = pktsize;
+			wsgi_req->proto_parser_pos = pktsize + 4;
+			wsgi_req->proto_mux = 1;
+			wsgi_req->proto_mux_id = puwsgi_frame_id(ub->buf);
+			puwsgi_frame_drop(ub, 0, fsize + 4);
+			return UWSGI_OK;
+		}
+
+		ssize_t len = puwsgi_mux_fill(wsgi_req, ub);
+		if (len > 0) continue;
+		if (len < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS) {
+				return UWSGI_AGAIN;
+			}
+			uwsgi_error("uwsgi_proto_puwsgi_parser()");
+		}
+		wsgi_req->write_errors++;
+		return -1;
+	}
+
+invalid:
+	uwsgi_log("[uwsgi-puwsgi] invalid frame on fd %d\n", wsgi_req->fd);
+	wsgi_req->write_errors++;
+	return -1;
+}
+
 int uwsgi_proto_puwsgi_parser(struct wsgi_request *wsgi_req) {
+	struct uwsgi_buffer *ub = wsgi_req->socket->puwsgi_rx[wsgi_req->async_id];
+	// pipelined frames
+	if (ub->pos > 0) return puwsgi_mux_parser(wsgi_req, ub);
+
 	ssize_t len;
 	char *ptr = (char *) wsgi_req->uh;
 	if (wsgi_req->proto_parser_pos < 4) {
@@ -21,14 +139,29 @@ int uwsgi_proto_puwsgi_parser(struct wsgi_request *wsgi_req) {
 		if (len > 0) {
 			wsgi_req->proto_parser_pos += len;
 			if (wsgi_req->proto_parser_pos == 4) {
+				// multiplexed frame, continue in the per-core buffer
+				if (wsgi_req->uh->modifier1 == UWSGI_MODIFIER_PUWSGI_FRAME) {
+					wsgi_req->proto_parser_pos = 0;
+					// the END frame is a small write after the response, do not let it wait for an ack
+					if (!wsgi_req->socket->retry[wsgi_req->async_id] && wsgi_req->socket->family != AF_UNIX) {
+						uwsgi_tcp_nodelay(wsgi_req->fd);
+					}
+					if (uwsgi_buffer_append(ub, ptr, 4)) {
+						wsgi_req->write_errors++;
+						return -1;
+					}
+					return puwsgi_mux_parser(wsgi_req, ub);
+				}
 #ifdef __BIG_ENDIAN__
-                        	wsgi_req->len = uwsgi_swap16(wsgi_req->len);
+                        	wsgi_req->uh->_pktsize = uwsgi_swap16(wsgi_req->uh->_pktsize);
 #endif
+				wsgi_req->len = wsgi_req->uh->_pktsize;
 				if (wsgi_req->len > uwsgi.buffer_size) {
                                 	uwsgi_log("invalid request block size: %u (max %u)...skip\n", wsgi_req->len, uwsgi.buffer_size);
-					wsgi_req->write_errors++;		
+					wsgi_req->write_errors++;
                                 	return -1;
                         	}
+				if (wsgi_req->len == 0) return UWSGI_OK;
 			}
 			return UWSGI_AGAIN;
 		}
@@ -38,7 +171,7 @@ int uwsgi_proto_puwsgi_parser(struct wsgi_request *wsgi_req) {
 	if (len > 0) {
 		wsgi_req->proto_parser_pos += len;
 		if ((wsgi_req->proto_parser_pos-4) == wsgi_req->len) {
-			return UWSGI_OK;	
+			return UWSGI_OK;
 		}
 		return UWSGI_AGAIN;
 	}
@@ -47,45 +180,185 @@ negative:
 		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS) {
 			return UWSGI_AGAIN;
 		}
-		uwsgi_error("uwsgi_proto_uwsgi_parser()");	
-		wsgi_req->write_errors++;		
+		uwsgi_error("uwsgi_proto_uwsgi_parser()");
+		wsgi_req->write_errors++;
 		return -1;
 	}
 	// 0 len
 	if (wsgi_req->proto_parser_pos > 0) {
-		uwsgi_error("uwsgi_proto_uwsgi_parser()");	
+		uwsgi_error("uwsgi_proto_uwsgi_parser()");
 	}
-	wsgi_req->write_errors++;		
+	wsgi_req->write_errors++;
 	return -1;
 }
 
+// get the next body chunk of the running request from the buffered frames, 0 if none is ready
+static ssize_t puwsgi_mux_body(struct wsgi_request *wsgi_req, struct uwsgi_buffer *ub, char *buf, size_t len) {
+	size_t pos = 0;
+	while (pos + 8 <= ub->pos) {
+		char *frame = ub->buf + pos;
+		if ((uint8_t) frame[0] != UWSGI_MODIFIER_PUWSGI_FRAME) goto invalid;
+		uint16_t fsize = puwsgi_frame_size(frame);
+		if (fsize < 4) goto invalid;
+		// frames arrive in order, wait for the whole one
+		if (pos + fsize + 4 > ub->pos) return 0;
+		if (frame[3] == UWSGI_PUWSGI_BODY) {
+			uint32_t id = puwsgi_frame_id(frame);
+			if (id == wsgi_req->proto_mux_id) {
+				size_t flen = fsize - 4;
+				size_t rlen = UMIN(flen, len);
+				memcpy(buf, frame + 8, rlen);
+				if (rlen == flen) {
+					puwsgi_frame_drop(ub, pos, fsize + 4);
+				}
+				// consume only the beginning of the payload
+				else {
+					puwsgi_frame_drop(ub, pos + 8, rlen);
+					puwsgi_frame_header(ub->buf + pos, UWSGI_PUWSGI_BODY, id, flen - rlen);
+				}
+				if (rlen > 0) return rlen;
+				continue;
+			}
+			// a completed request
+			if ((int32_t) (id - wsgi_req->proto_mux_id) < 0) {
+				puwsgi_frame_drop(ub, pos, fsize + 4);
+				continue;
+			}
+		}
+		// pipelined requests and their bodies
+		pos += fsize + 4;
+	}
+	return 0;
+
+invalid:
+	uwsgi_log("[uwsgi-puwsgi] invalid frame on fd %d\n", wsgi_req->fd);
+	errno = EPROTO;
+	return -1;
+}
+
+static ssize_t uwsgi_proto_puwsgi_read_body(struct wsgi_request *wsgi_req, char *buf, size_t len) {
+	if (!wsgi_req->proto_mux) return uwsgi_proto_base_read_body(wsgi_req, buf, len);
+	struct uwsgi_buffer *ub = wsgi_req->socket->puwsgi_rx[wsgi_req->async_id];
+	for(;;) {
+		ssize_t rlen = puwsgi_mux_body(wsgi_req, ub, buf, len);
+		if (rlen != 0) return rlen;
+		rlen = puwsgi_mux_fill(wsgi_req, ub);
+		if (rlen <= 0) return rlen;
+	}
+}
+
+static void puwsgi_mux_response_header(struct wsgi_request *wsgi_req, char *buf, size_t len) {
+	puwsgi_frame_header(buf, UWSGI_PUWSGI_RESPONSE, wsgi_req->proto_mux_id, len);
+}
+
+static int uwsgi_proto_puwsgi_write(struct wsgi_request *wsgi_req, char *buf, size_t len) {
+	if (!wsgi_req->proto_mux) return uwsgi_proto_base_write(wsgi_req, buf, len);
+	struct iovec iov;
+	size_t iov_len = 1;
+	iov.iov_base = buf + wsgi_req->write_pos;
+	iov.iov_len = len - wsgi_req->write_pos;
+	return uwsgi_proto_framed_writev(wsgi_req, &iov, &iov_len, UWSGI_PUWSGI_FRAME_MAX, puwsgi_mux_response_header);
+}
+
+static int uwsgi_proto_puwsgi_writev(struct wsgi_request *wsgi_req, struct iovec *iov, size_t *len) {
+	if (!wsgi_req->proto_mux) return uwsgi_proto_base_writev(wsgi_req, iov, len);
+	return uwsgi_proto_framed_writev(wsgi_req, iov, len, UWSGI_PUWSGI_FRAME_MAX, puwsgi_mux_response_header);
+}
+
+// file chunks are read in memory, on partial writes the rest of the frame is read again
+static int uwsgi_proto_puwsgi_sendfile(struct wsgi_request *wsgi_req, int fd, size_t pos, size_t len) {
+	if (!wsgi_req->proto_mux) return uwsgi_proto_base_sendfile(wsgi_req, fd, pos, len);
+	char buf[32768];
+	size_t remains = UMIN(len - wsgi_req->write_pos, sizeof(buf));
+	if (wsgi_req->proto_frame_remains) remains = UMIN(remains, wsgi_req->proto_frame_remains);
+	if (remains == 0) return UWSGI_OK;
+	ssize_t rlen = pread(fd, buf, remains, pos + wsgi_req->write_pos);
+	if (rlen <= 0) return -1;
+	struct iovec iov;
+	size_t iov_len = 1;
+	iov.iov_base = buf;
+	iov.iov_len = rlen;
+	int ret = uwsgi_proto_framed_writev(wsgi_req, &iov, &iov_len, UWSGI_PUWSGI_FRAME_MAX, puwsgi_mux_response_header);
+	if (ret != UWSGI_OK) return ret;
+	return wsgi_req->write_pos == len ? UWSGI_OK : UWSGI_AGAIN;
+}
+
+// remember if the response is framed, so the peer can find its end
+static struct uwsgi_buffer *uwsgi_proto_puwsgi_add_header(struct wsgi_request *wsgi_req, char *k, uint16_t kl, char *v, uint16_t vl) {
+	if (kl > 0) {
+		if (!uwsgi_strnicmp(k, kl, "Content-Length", 14)) wsgi_req->proto_response_framed = 1;
+	}
+	else if (vl > 15 && !strncasecmp(v, "Content-Length:", 15)) {
+		wsgi_req->proto_response_framed = 1;
+	}
+	return uwsgi_proto_base_add_header(wsgi_req, k, kl, v, vl);
+}
+
+// the END frame marks the end of a multiplexed response
+static int puwsgi_mux_end(struct wsgi_request *wsgi_req) {
+	if (wsgi_req->write_errors || wsgi_req->proto_frame_remains || wsgi_req->proto_frame_hdr_remains) return -1;
+	char hdr[8];
+	puwsgi_frame_header(hdr, UWSGI_PUWSGI_END, wsgi_req->proto_mux_id, 0);
+	return uwsgi_write_true_nb(wsgi_req->fd, hdr, 8, uwsgi.socket_timeout);
+}
+
 /*
 close the connection on errors, otherwise force edge triggering
+
+unframed responses (no Content-Length), HEAD requests and unread bodies close
+the connection too, as the peer would not be able to find the end of the response
+(unless the request is multiplexed)
 */
 void uwsgi_proto_puwsgi_close(struct wsgi_request *wsgi_req) {
-	// check for errors or incomplete packets
-	if (wsgi_req->write_errors || (size_t) (wsgi_req->len + 4) != wsgi_req->proto_parser_pos) {
-		close(wsgi_req->fd);
-		wsgi_req->socket->retry[wsgi_req->async_id] = 0;
-		wsgi_req->socket->fd_threads[wsgi_req->async_id] = -1;
+	if (wsgi_req->proto_mux) {
+		if (!puwsgi_mux_end(wsgi_req)) goto keep;
+		goto drop;
 	}
-	else {
-		wsgi_req->socket->retry[wsgi_req->async_id] = 1;
-		wsgi_req->socket->fd_threads[wsgi_req->async_id] = wsgi_req->fd;
+	// check for errors or incomplete packets
+	if (wsgi_req->write_errors || (size_t) (wsgi_req->len + 4) != wsgi_req->proto_parser_pos
+		|| !wsgi_req->proto_response_framed || wsgi_req->post_pos < wsgi_req->post_cl
+		|| wsgi_req->via == UWSGI_VIA_OFFLOAD
+		|| !uwsgi_strncmp("HEAD", 4, wsgi_req->method, wsgi_req->method_len)) {
+		goto drop;
 	}
+keep:
+	wsgi_req->socket->retry[wsgi_req->async_id] = 1;
+	wsgi_req->socket->fd_threads[wsgi_req->async_id] = wsgi_req->fd;
+	return;
+drop:
+	close(wsgi_req->fd);
+	wsgi_req->socket->puwsgi_rx[wsgi_req->async_id]->pos = 0;
+	wsgi_req->socket->retry[wsgi_req->async_id] = 0;
+	wsgi_req->socket->fd_threads[wsgi_req->async_id] = -1;
 }
 
 int uwsgi_proto_puwsgi_accept(struct wsgi_request *wsgi_req, int fd) {
 	if (wsgi_req->socket->retry[wsgi_req->async_id]) {
 		wsgi_req->fd = wsgi_req->socket->fd_threads[wsgi_req->async_id];
-		int ret = uwsgi_wait_read_req(wsgi_req);
+		// pipelined frames are parsed without waiting
+		if (wsgi_req->socket->puwsgi_rx[wsgi_req->async_id]->pos > 0) return wsgi_req->fd;
+		int ret;
+		// an idle persistent connection gives way to new ones (the peer will see it closed)
+		if (uwsgi.wait_read_hook == uwsgi_simple_wait_read_hook) {
+			int ready_fd = -1;
+			ret = uwsgi.wait_read2_hook(wsgi_req->fd, wsgi_req->socket->fd, uwsgi.socket_timeout, &ready_fd);
+			if (ret > 0 && ready_fd == wsgi_req->socket->fd) {
+				close(wsgi_req->fd);
+				wsgi_req->socket->retry[wsgi_req->async_id] = 0;
+				wsgi_req->socket->fd_threads[wsgi_req->async_id] = -1;
+				return uwsgi_proto_base_accept(wsgi_req, wsgi_req->socket->fd);
+			}
+		}
+		else {
+			ret = uwsgi_wait_read_req(wsgi_req);
+		}
                 if (ret <= 0) {
 			close(wsgi_req->fd);
 			wsgi_req->socket->retry[wsgi_req->async_id] = 0;
 			wsgi_req->socket->fd_threads[wsgi_req->async_id] = -1;
                 	return -1;
 		}
-		return wsgi_req->socket->fd_threads[wsgi_req->async_id];	
+		return wsgi_req->socket->fd_threads[wsgi_req->async_id];
 	}
 	return uwsgi_proto_base_accept(wsgi_req, fd);
 }
@@ -94,16 +367,21 @@ void uwsgi_proto_puwsgi_setup(struct uwsgi_socket *uwsgi_sock) {
                         uwsgi_sock->proto = uwsgi_proto_puwsgi_parser;
                         uwsgi_sock->proto_accept = uwsgi_proto_puwsgi_accept;
                         uwsgi_sock->proto_prepare_headers = uwsgi_proto_base_prepare_headers;
-                        uwsgi_sock->proto_add_header = uwsgi_proto_base_add_header;
+                        uwsgi_sock->proto_add_header = uwsgi_proto_puwsgi_add_header;
                         uwsgi_sock->proto_fix_headers = uwsgi_proto_base_fix_headers;
-                        uwsgi_sock->proto_read_body = uwsgi_proto_noop_read_body;
-                        uwsgi_sock->proto_write = uwsgi_proto_base_write;
-                        uwsgi_sock->proto_writev = uwsgi_proto_base_writev;
-                        uwsgi_sock->proto_write_headers = uwsgi_proto_base_write;
-                        uwsgi_sock->proto_sendfile = uwsgi_proto_base_sendfile;
+                        uwsgi_sock->proto_read_body = uwsgi_proto_puwsgi_read_body;
+                        uwsgi_sock->proto_write = uwsgi_proto_puwsgi_write;
+                        uwsgi_sock->proto_writev = uwsgi_proto_puwsgi_writev;
+                        uwsgi_sock->proto_write_headers = uwsgi_proto_puwsgi_write;
+                        uwsgi_sock->proto_sendfile = uwsgi_proto_puwsgi_sendfile;
                         uwsgi_sock->proto_close = uwsgi_proto_puwsgi_close;
                         uwsgi_sock->fd_threads = uwsgi_malloc(sizeof(int) * uwsgi.cores);
                         memset(uwsgi_sock->fd_threads, -1, sizeof(int) * uwsgi.cores);
                         uwsgi_sock->retry = uwsgi_calloc(sizeof(int) * uwsgi.cores);
+                        uwsgi_sock->puwsgi_rx = uwsgi_malloc(sizeof(struct uwsgi_buffer *) * uwsgi.cores);
+                        int i;
+                        for(i=0;i<uwsgi.cores;i++) {
+                                uwsgi_sock->puwsgi_rx[i] = uwsgi_buffer_new(uwsgi.page_size);
+                        }
                         uwsgi.is_et = 1;
                 }
@@ -6,7 +6,7 @@ extern struct uwsgi_server uwsgi;
 
 static int uwsgi_proto_uwsgi_parser(struct wsgi_request *wsgi_req) {
 	char *ptr = (char *) wsgi_req->uh;
-	ssize_t len = read(wsgi_req->fd, ptr + wsgi_req->proto_parser_pos, (uwsgi.buffer_size + 4) - wsgi_req->proto_parser_pos);
+	ssize_t len = uwsgi_proto_handoff_read(wsgi_req, ptr + wsgi_req->proto_parser_pos, (uwsgi.buffer_size + 4) - wsgi_req->proto_parser_pos);
 	if (len > 0) {
 		wsgi_req->proto_parser_pos += len;
 		if (wsgi_req->proto_parser_pos >= 4) {
@@ -212,12 +212,66 @@ int uwsgi_proto_uwsgi_parser_unix(struct wsgi_request *wsgi_req) {
 
 */
 
+/*
+	the http router can ask (UWSGI_RESPONSE_HINT var) for a 4 bytes uwsgi header before the response:
+	the size of the header block and the flags it needs for keepalive/chunking/gzip decisions,
+	so it does not need to parse the HTTP headers again
+*/
+static int uwsgi_proto_uwsgi_fix_headers(struct wsgi_request *wsgi_req) {
+	if (uwsgi_proto_base_fix_headers(wsgi_req)) return -1;
+	if (!wsgi_req->response_hint) return 0;
+
+	struct uwsgi_buffer *ub = wsgi_req->headers;
+	uint8_t flags = 0;
+	if (ub->pos < 8 || memcmp(ub->buf, "HTTP/1.1", 8)) flags |= UWSGI_RESPONSE_HINT_NOT_HTTP11;
+
+	char *ptr = memchr(ub->buf, '\n', ub->pos);
+	char *end = ub->buf + ub->pos;
+	while (ptr && ++ptr < end) {
+		char *eol = memchr(ptr, '\r', end - ptr);
+		if (!eol) break;
+		char *colon = memchr(ptr, ':', eol - ptr);
+		if (colon) {
+			size_t key_len = colon - ptr;
+			char *value = colon + 1;
+			while (value < eol && *value == ' ') value++;
+			size_t value_len = eol - value;
+			if (!uwsgi_strnicmp(ptr, key_len, "Content-Length", 14) || !uwsgi_strnicmp(ptr, key_len, "Transfer-Encoding", 17)) {
+				flags |= UWSGI_RESPONSE_HINT_HAS_SIZE;
+			}
+			else if (!uwsgi_strnicmp(ptr, key_len, "Connection", 10)) {
+				flags |= UWSGI_RESPONSE_HINT_HAS_CONNECTION;
+				if (!uwsgi_strnicmp(value, value_len, "close", 5)) flags |= UWSGI_RESPONSE_HINT_CLOSE;
+			}
+			else if (!uwsgi_strnicmp(ptr, key_len, "Trailers", 8)) {
+				flags |= UWSGI_RESPONSE_HINT_CLOSE;
+			}
+			else if (!uwsgi_strnicmp(ptr, key_len, "Content-Encoding", 16)) {
+				flags |= UWSGI_RESPONSE_HINT_HAS_ENCODING;
+			}
+			else if (!uwsgi_strnicmp(ptr, key_len, "uWSGI-Encoding", 14) && !uwsgi_strnicmp(value, value_len, "gzip", 4)) {
+				flags |= UWSGI_RESPONSE_HINT_UWSGI_GZIP;
+			}
+		}
+		ptr = memchr(eol, '\n', end - eol);
+	}
+
+	char hint[4];
+	hint[0] = UWSGI_MODIFIER_RESPONSE_HINT;
+	hint[1] = (uint8_t) (ub->pos & 0xff);
+	hint[2] = (uint8_t) ((ub->pos >> 8) & 0xff);
+	hint[3] = flags;
+	// the header block could already be at its 64k limit
+	ub->limit = 0;
+	return uwsgi_buffer_insert(ub, 0, hint, 4);
+}
+
 void uwsgi_proto_uwsgi_setup(struct uwsgi_socket *uwsgi_sock) {
 	uwsgi_sock->proto = uwsgi_proto_uwsgi_parser;
 	uwsgi_sock->proto_accept = uwsgi_proto_base_accept;
 	uwsgi_sock->proto_prepare_headers = uwsgi_proto_base_prepare_headers;
 	uwsgi_sock->proto_add_header = uwsgi_proto_base_add_header;
-	uwsgi_sock->proto_fix_headers = uwsgi_proto_base_fix_headers;
+	uwsgi_sock->proto_fix_headers = uwsgi_proto_uwsgi_fix_headers;
 	uwsgi_sock->proto_read_body = uwsgi_proto_base_read_body;
 	uwsgi_sock->proto_write = uwsgi_proto_base_write;
 	uwsgi_sock->proto_writev = uwsgi_proto_base_writev;
@@ -228,6 +282,13 @@ void uwsgi_proto_uwsgi_setup(struct uwsgi_socket *uwsgi_sock) {
 		uwsgi_sock->can_offload = 1;
 }
 
+// connections passed by the fastrouter (--fastrouter-handoff)
+void uwsgi_proto_uwsgi_handoff_setup(struct uwsgi_socket *uwsgi_sock) {
+	uwsgi_proto_uwsgi_setup(uwsgi_sock);
+	uwsgi_sock->proto_accept = uwsgi_proto_handoff_accept;
+	uwsgi_sock->proto_read_body = uwsgi_proto_handoff_read_body;
+}
+
 #ifdef UWSGI_SSL
 void uwsgi_proto_suwsgi_setup(struct uwsgi_socket *uwsgi_sock) {
         uwsgi_sock->proto = uwsgi_proto_suwsgi_parser;
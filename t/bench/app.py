@@ -0,0 +1,19 @@
+# the application used by the benchmark profiles (see t/bench/run.py)
+#
+# /          12 bytes hello world
+# /size/N    N bytes body
+
+HELLO = b'Hello World\n'
+BODIES = {}
+
+
+def application(environ, start_response):
+    path = environ.get('PATH_INFO', '/')
+    body = HELLO
+    if path.startswith('/size/'):
+        size = int(path[6:])
+        body = BODIES.get(size)
+        if body is None:
+            body = BODIES.setdefault(size, b'x' * size)
+    start_response('200 OK', [('Content-Type', 'text/plain'), ('Content-Length', str(len(body)))])
+    return [body]
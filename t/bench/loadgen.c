@@ -0,0 +1,452 @@
+/*
+
+	fixed-rate HTTP/1.1 load generator for the uWSGI benchmarks
+
+	cc -O2 -o t/bench/loadgen t/bench/loadgen.c
+
+	./loadgen -p 9090 -u /hello -c 32 -r 5000 -d 10 -w 2
+
+	requests are scheduled at a fixed rate (open loop) and the latency is measured from
+	the scheduled time, so a stalled server is not hidden by the generator slowing down
+	(coordinated omission). With -r 0 every connection sends a new request as soon as
+	the previous one is completed (closed loop, max throughput).
+
+	The results (of the measurement window, after the warmup) are printed as JSON.
+
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define LG_BUFSIZE 65536
+
+struct lg_conn {
+	int fd;
+	int busy;
+	// the connection already served a request
+	int reused;
+	// scheduled time of the request in flight
+	uint64_t scheduled;
+	char *buf;
+	size_t pos;
+	// parsed response
+	int headers_done;
+	int status;
+	int chunked;
+	int close_delimited;
+	int keepalive;
+	int64_t content_length;
+	size_t body_start;
+	uint64_t body_read;
+};
+
+static struct {
+	char *host;
+	char *port;
+	char *path;
+	char *extra_headers;
+	int conns;
+	uint64_t rate;
+	double duration;
+	double warmup;
+	double timeout;
+	struct addrinfo *ai;
+	char *request;
+	size_t request_len;
+
+	uint64_t *latencies;
+	uint64_t latencies_cnt;
+	uint64_t latencies_size;
+	uint64_t completed;
+	uint64_t errors;
+	uint64_t non_2xx;
+	uint64_t timeouts;
+	uint64_t bytes;
+	uint64_t dropped;
+	uint64_t in_flight;
+} lg;
+
+static uint64_t now_usec() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+static void conn_reset(struct lg_conn *c) {
+	if (c->fd > -1) close(c->fd);
+	c->fd = -1;
+	c->busy = 0;
+	c->reused = 0;
+	c->pos = 0;
+	c->headers_done = 0;
+}
+
+static int conn_open(struct lg_conn *c) {
+	c->fd = socket(lg.ai->ai_family, SOCK_STREAM, 0);
+	if (c->fd < 0) return -1;
+	fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL) | O_NONBLOCK);
+	int one = 1;
+	setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(int));
+	if (connect(c->fd, lg.ai->ai_addr, lg.ai->ai_addrlen) && errno != EINPROGRESS) {
+		close(c->fd);
+		c->fd = -1;
+		return -1;
+	}
+	return 0;
+}
+
+static void account(struct lg_conn *c, uint64_t now, int measure) {
+	if (!measure) return;
+	if (c->status < 200 || c->status > 299) {
+		lg.non_2xx++;
+	}
+	lg.completed++;
+	if (lg.latencies_cnt >= lg.latencies_size) {
+		lg.latencies_size = lg.latencies_size ? lg.latencies_size * 2 : 65536;
+		lg.latencies = realloc(lg.latencies, sizeof(uint64_t) * lg.latencies_size);
+		if (!lg.latencies) {
+			perror("realloc()");
+			exit(1);
+		}
+	}
+	lg.latencies[lg.latencies_cnt++] = now - c->scheduled;
+}
+
+static int conn_send(struct lg_conn *c, uint64_t scheduled) {
+	if (c->fd < 0 && conn_open(c)) return -1;
+	c->scheduled = scheduled;
+	c->busy = 1;
+	c->pos = 0;
+	c->headers_done = 0;
+	// the request is tiny, a single write is enough (the socket buffer is empty)
+	ssize_t wlen = write(c->fd, lg.request, lg.request_len);
+	if (wlen == (ssize_t) lg.request_len) return 0;
+	if (wlen < 0 && (errno == EAGAIN || errno == ENOTCONN)) {
+		// still connecting, the request will be sent on POLLOUT
+		c->pos = (size_t) -1;
+		return 0;
+	}
+	// stale keepalive connection
+	if (c->reused) {
+		conn_reset(c);
+		return conn_send(c, scheduled);
+	}
+	return -1;
+}
+
+// returns 1 when the response is complete, 0 if more data is needed, -1 on error
+static int parse_response(struct lg_conn *c) {
+	if (!c->headers_done) {
+		char *end = memmem(c->buf, c->pos, "\r\n\r\n", 4);
+		if (!end) return c->pos >= LG_BUFSIZE ? -1 : 0;
+		c->headers_done = 1;
+		c->body_start = (end - c->buf) + 4;
+		c->status = 0;
+		c->chunked = 0;
+		c->content_length = -1;
+		c->keepalive = 1;
+		c->body_read = 0;
+		if (c->pos < 12 || memcmp(c->buf, "HTTP/1.", 7)) return -1;
+		if (c->buf[7] == '0') c->keepalive = 0;
+		c->status = atoi(c->buf + 9);
+		char *line = memchr(c->buf, '\n', c->body_start) + 1;
+		while (line < c->buf + c->body_start - 2) {
+			char *eol = memchr(line, '\n', (c->buf + c->body_start) - line);
+			if (!eol) break;
+			if (!strncasecmp(line, "Content-Length:", 15)) {
+				c->content_length = strtoll(line + 15, NULL, 10);
+			}
+			else if (!strncasecmp(line, "Transfer-Encoding:", 18) && memmem(line, eol - line, "chunked", 7)) {
+				c->chunked = 1;
+			}
+			else if (!strncasecmp(line, "Connection:", 11)) {
+				if (memmem(line, eol - line, "close", 5)) c->keepalive = 0;
+				if (memmem(line, eol - line, "eep-", 4)) c->keepalive = 1;
+			}
+			line = eol + 1;
+		}
+		c->close_delimited = !c->chunked && c->content_length < 0;
+		if (c->close_delimited) c->keepalive = 0;
+		// 204/304 have no body
+		if (c->status == 204 || c->status == 304) {
+			c->content_length = 0;
+			c->close_delimited = 0;
+		}
+	}
+
+	if (c->content_length >= 0) {
+		return (c->pos - c->body_start) >= (uint64_t) c->content_length;
+	}
+
+	if (c->chunked) {
+		// walk the chunks (the body is consumed as it is parsed to keep the buffer small)
+		for (;;) {
+			char *ptr = c->buf + c->body_start;
+			size_t avail = c->pos - c->body_start;
+			char *eol = memmem(ptr, avail, "\r\n", 2);
+			if (!eol) return 0;
+			uint64_t chunk = strtoull(ptr, NULL, 16);
+			size_t need = (eol - ptr) + 2 + chunk + 2;
+			if (avail < need) {
+				// chunks bigger than the buffer are not supported
+				return need > LG_BUFSIZE - c->body_start ? -1 : 0;
+			}
+			if (chunk == 0) return 1;
+			memmove(ptr, ptr + need, avail - need);
+			c->pos -= need;
+		}
+	}
+
+	// close delimited
+	return 0;
+}
+
+static int percentile_cmp(const void *a, const void *b) {
+	uint64_t x = *(uint64_t *) a, y = *(uint64_t *) b;
+	return x < y ? -1 : x > y;
+}
+
+static double percentile(double p) {
+	if (!lg.latencies_cnt) return 0;
+	uint64_t idx = (uint64_t) (p * lg.latencies_cnt);
+	if (idx >= lg.latencies_cnt) idx = lg.latencies_cnt - 1;
+	return lg.latencies[idx] / 1000.0;
+}
+
+static void usage(char *name) {
+	fprintf(stderr, "usage: %s [-h host] -p port [-u path] [-c connections] [-r rate] [-d seconds] [-w warmup] [-t timeout] [-H header]\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv) {
+	int opt;
+	lg.host = "127.0.0.1";
+	lg.path = "/";
+	lg.extra_headers = "";
+	lg.conns = 16;
+	lg.rate = 1000;
+	lg.duration = 10;
+	lg.warmup = 1;
+	lg.timeout = 10;
+
+	while ((opt = getopt(argc, argv, "h:p:u:c:r:d:w:t:H:")) != -1) {
+		switch (opt) {
+		case 'h': lg.host = optarg; break;
+		case 'p': lg.port = optarg; break;
+		case 'u': lg.path = optarg; break;
+		case 'c': lg.conns = atoi(optarg); break;
+		case 'r': lg.rate = strtoull(optarg, NULL, 10); break;
+		case 'd': lg.duration = atof(optarg); break;
+		case 'w': lg.warmup = atof(optarg); break;
+		case 't': lg.timeout = atof(optarg); break;
+		case 'H': {
+			char *h = malloc(strlen(lg.extra_headers) + strlen(optarg) + 3);
+			sprintf(h, "%s%s\r\n", lg.extra_headers, optarg);
+			lg.extra_headers = h;
+			break;
+		}
+		default: usage(argv[0]);
+		}
+	}
+	if (!lg.port || lg.conns < 1 || lg.duration <= 0) usage(argv[0]);
+
+	signal(SIGPIPE, SIG_IGN);
+
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_STREAM;
+	int ret = getaddrinfo(lg.host, lg.port, &hints, &lg.ai);
+	if (ret) {
+		fprintf(stderr, "getaddrinfo(): %s\n", gai_strerror(ret));
+		exit(1);
+	}
+
+	lg.request = malloc(strlen(lg.path) + strlen(lg.host) + strlen(lg.extra_headers) + 64);
+	lg.request_len = sprintf(lg.request, "GET %s HTTP/1.1\r\nHost: %s\r\n%s\r\n", lg.path, lg.host, lg.extra_headers);
+
+	struct lg_conn *conns = calloc(lg.conns, sizeof(struct lg_conn));
+	struct pollfd *pfds = calloc(lg.conns, sizeof(struct pollfd));
+	int i;
+	for (i = 0; i < lg.conns; i++) {
+		conns[i].fd = -1;
+		conns[i].buf = malloc(LG_BUFSIZE);
+	}
+
+	uint64_t start = now_usec();
+	uint64_t measure_start = start + (uint64_t) (lg.warmup * 1000000);
+	uint64_t end = measure_start + (uint64_t) (lg.duration * 1000000);
+	uint64_t timeout = (uint64_t) (lg.timeout * 1000000);
+	uint64_t interval = lg.rate ? 1000000 / lg.rate : 0;
+	if (lg.rate && !interval) interval = 1;
+	// next scheduled request (rate mode)
+	uint64_t next = start;
+	// requests scheduled but waiting for a free connection
+	uint64_t *backlog = NULL;
+	uint64_t backlog_head = 0, backlog_tail = 0, backlog_size = 0;
+
+	for (;;) {
+		uint64_t now = now_usec();
+		if (now >= end) break;
+
+		if (lg.rate) {
+			while (next <= now) {
+				if (backlog_tail - backlog_head >= backlog_size) {
+					// compact or grow
+					uint64_t pending = backlog_tail - backlog_head;
+					uint64_t *tmp = malloc(sizeof(uint64_t) * (backlog_size ? backlog_size * 2 : 4096));
+					if (pending) memcpy(tmp, backlog + backlog_head, sizeof(uint64_t) * pending);
+					free(backlog);
+					backlog = tmp;
+					backlog_size = backlog_size ? backlog_size * 2 : 4096;
+					backlog_head = 0;
+					backlog_tail = pending;
+				}
+				else if (backlog_tail >= backlog_size) {
+					uint64_t pending = backlog_tail - backlog_head;
+					memmove(backlog, backlog + backlog_head, sizeof(uint64_t) * pending);
+					backlog_head = 0;
+					backlog_tail = pending;
+				}
+				backlog[backlog_tail++] = next;
+				next += interval;
+			}
+		}
+
+		// dispatch
+		for (i = 0; i < lg.conns; i++) {
+			struct lg_conn *c = &conns[i];
+			if (c->busy) continue;
+			uint64_t scheduled = now;
+			if (lg.rate) {
+				if (backlog_head == backlog_tail) break;
+				scheduled = backlog[backlog_head++];
+			}
+			if (conn_send(c, scheduled)) {
+				if (now >= measure_start) lg.errors++;
+				conn_reset(c);
+			}
+		}
+
+		for (i = 0; i < lg.conns; i++) {
+			pfds[i].fd = conns[i].busy ? conns[i].fd : -1;
+			pfds[i].events = conns[i].pos == (size_t) -1 ? POLLOUT : POLLIN;
+			pfds[i].revents = 0;
+		}
+
+		int wait_ms = 100;
+		if (lg.rate && next > now) {
+			wait_ms = (next - now) / 1000;
+		}
+		else if (lg.rate) {
+			wait_ms = 0;
+		}
+		if (poll(pfds, lg.conns, wait_ms) < 0 && errno != EINTR) {
+			perror("poll()");
+			exit(1);
+		}
+		now = now_usec();
+		int measure = now >= measure_start;
+
+		for (i = 0; i < lg.conns; i++) {
+			struct lg_conn *c = &conns[i];
+			if (!c->busy) continue;
+			if (now - c->scheduled > timeout && !pfds[i].revents) {
+				if (measure) lg.timeouts++;
+				conn_reset(c);
+				continue;
+			}
+			if (!pfds[i].revents) continue;
+
+			if (c->pos == (size_t) -1) {
+				c->pos = 0;
+				if (write(c->fd, lg.request, lg.request_len) != (ssize_t) lg.request_len) {
+					if (measure) lg.errors++;
+					conn_reset(c);
+				}
+				continue;
+			}
+
+			ssize_t rlen = read(c->fd, c->buf + c->pos, LG_BUFSIZE - c->pos);
+			if (rlen < 0 && errno == EAGAIN) continue;
+			if (rlen <= 0) {
+				if (rlen == 0 && c->headers_done && c->close_delimited) {
+					account(c, now, measure);
+				}
+				// the server closed an idle keepalive connection, resend on a new one
+				else if (c->reused && c->pos == 0) {
+					uint64_t scheduled = c->scheduled;
+					conn_reset(c);
+					if (conn_send(c, scheduled)) {
+						if (measure) lg.errors++;
+						conn_reset(c);
+					}
+					continue;
+				}
+				else if (measure) {
+					lg.errors++;
+				}
+				conn_reset(c);
+				continue;
+			}
+			if (measure) lg.bytes += rlen;
+			c->pos += rlen;
+			int done = parse_response(c);
+			if (done < 0) {
+				if (measure) lg.errors++;
+				conn_reset(c);
+				continue;
+			}
+			// keep only the headers in the buffer for big (content-length) bodies
+			if (!done && c->headers_done && c->content_length >= 0 && c->pos >= LG_BUFSIZE) {
+				size_t body = c->pos - c->body_start;
+				c->content_length -= body;
+				c->pos = c->body_start;
+				continue;
+			}
+			if (!done) continue;
+			account(c, now, measure);
+			if (!c->keepalive) {
+				conn_reset(c);
+			}
+			else {
+				c->busy = 0;
+				c->reused = 1;
+			}
+		}
+	}
+
+	lg.dropped = backlog_tail - backlog_head;
+	for (i = 0; i < lg.conns; i++) {
+		if (conns[i].busy) lg.in_flight++;
+	}
+
+	double elapsed = (now_usec() - measure_start) / 1000000.0;
+	qsort(lg.latencies, lg.latencies_cnt, sizeof(uint64_t), percentile_cmp);
+	double mean = 0;
+	uint64_t j;
+	for (j = 0; j < lg.latencies_cnt; j++) mean += lg.latencies[j];
+	if (lg.latencies_cnt) mean = (mean / lg.latencies_cnt) / 1000.0;
+
+	printf("{\"rate\": %llu, \"connections\": %d, \"duration\": %.3f, \"requests\": %llu, \"throughput\": %.1f, "
+		"\"errors\": %llu, \"non_2xx\": %llu, \"timeouts\": %llu, \"in_flight\": %llu, \"not_sent\": %llu, \"bytes\": %llu, "
+		"\"latency_ms\": {\"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"p999\": %.3f, \"max\": %.3f}}\n",
+		(unsigned long long) lg.rate, lg.conns, elapsed, (unsigned long long) lg.completed, lg.completed / elapsed,
+		(unsigned long long) lg.errors, (unsigned long long) lg.non_2xx, (unsigned long long) lg.timeouts,
+		(unsigned long long) lg.in_flight, (unsigned long long) lg.dropped, (unsigned long long) lg.bytes,
+		mean, percentile(0.50), percentile(0.90), percentile(0.99), percentile(0.999), percentile(1.0));
+	return 0;
+}
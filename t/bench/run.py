@@ -0,0 +1,280 @@
+#!/usr/bin/env python3
+# end-to-end benchmark and performance regression suite
+#
+#   make bench
+#   python3 t/bench/run.py [--profiles prefork,threads] [--output results.json] [--baseline old.json]
+#
+# every profile starts a uWSGI instance serving t/bench/app.py, drives it with t/bench/loadgen
+# at the configured rates and records throughput, latency percentiles, cpu time and rss of the
+# whole process tree. With --baseline the results are compared with a previous run and the
+# script exits with 1 if any metric regressed more than --threshold percent.
+#
+# profiles whose plugins are not available (e.g. gevent) are reported as skipped.
+
+import argparse
+import json
+import os
+import platform
+import shutil
+import signal
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(os.path.dirname(HERE))
+
+# a profile can override the request path and the list of rates (requests per second,
+# 0 means closed loop: as fast as possible)
+PROFILES = {
+    'prefork': {
+        'args': ['--http11-socket', '{addr}', '--master', '--processes', '4'],
+    },
+    'threads': {
+        'args': ['--http11-socket', '{addr}', '--master', '--processes', '1', '--threads', '8'],
+    },
+    # http 1.1 keepalive is managed only by the sync loop
+    'async': {
+        'args': ['--http-socket', '{addr}', '--master', '--processes', '1', '--async', '64', '--ugreen'],
+    },
+    'gevent': {
+        'args': ['--http-socket', '{addr}', '--master', '--processes', '1', '--plugin', 'gevent', '--gevent', '64'],
+    },
+    'http-router': {
+        'args': ['--http', '{addr}', '--http-keepalive', '--master', '--processes', '4'],
+    },
+    'offload-static': {
+        'args': ['--http11-socket', '{addr}', '--master', '--processes', '2', '--offload-threads', '2',
+                 '--static-map', '/static={tmpdir}'],
+        'path': '/static/file.bin',
+    },
+}
+
+
+def free_port():
+    s = socket.socket()
+    s.bind(('127.0.0.1', 0))
+    port = s.getsockname()[1]
+    s.close()
+    return port
+
+
+def wait_ready(port, path, timeout):
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        try:
+            s = socket.create_connection(('127.0.0.1', port), 1)
+            s.sendall(('GET %s HTTP/1.0\r\nHost: 127.0.0.1\r\n\r\n' % path).encode())
+            data = s.recv(1024)
+            s.close()
+            if data.startswith(b'HTTP/1.') and b' 200 ' in data.split(b'\r\n', 1)[0]:
+                return True
+        except OSError:
+            pass
+        time.sleep(0.1)
+    return False
+
+
+def process_tree(pid):
+    pids = [pid]
+    i = 0
+    while i < len(pids):
+        try:
+            with open('/proc/%d/task/%d/children' % (pids[i], pids[i])) as f:
+                pids += [int(p) for p in f.read().split()]
+        except OSError:
+            pass
+        i += 1
+    return pids
+
+
+def tree_usage(pid):
+    # returns (cpu seconds, rss bytes) of the process tree
+    ticks = os.sysconf('SC_CLK_TCK')
+    pagesize = os.sysconf('SC_PAGE_SIZE')
+    cpu = 0
+    rss = 0
+    for p in process_tree(pid):
+        try:
+            with open('/proc/%d/stat' % p) as f:
+                fields = f.read().rsplit(')', 1)[1].split()
+            cpu += (int(fields[11]) + int(fields[12])) / float(ticks)
+            with open('/proc/%d/statm' % p) as f:
+                rss += int(f.read().split()[1]) * pagesize
+        except (OSError, IndexError):
+            pass
+    return cpu, rss
+
+
+def run_loadgen(args, port, path, rate):
+    cmd = [args.loadgen, '-p', str(port), '-u', path, '-c', str(args.connections), '-r', str(rate),
+           '-d', str(args.duration), '-w', str(args.warmup)]
+    return subprocess.Popen(cmd, stdout=subprocess.PIPE, universal_newlines=True)
+
+
+def run_profile(args, name, profile, tmpdir):
+    port = free_port()
+    path = profile.get('path', '/')
+    uargs = [a.format(addr='127.0.0.1:%d' % port, tmpdir=tmpdir) for a in profile['args']]
+    cmd = [args.uwsgi, '--plugins-dir', args.plugins_dir, '--plugin', args.plugin, '--wsgi-file',
+           os.path.join(HERE, 'app.py'), '--disable-logging', '--die-on-term'] + uargs + args.extra
+    log = open(os.path.join(tmpdir, name + '.log'), 'w')
+    proc = subprocess.Popen(cmd, stdout=log, stderr=subprocess.STDOUT)
+    result = {'command': ' '.join(cmd), 'path': path, 'runs': []}
+    try:
+        if not wait_ready(port, path, args.startup_timeout):
+            log.flush()
+            with open(log.name) as f:
+                tail = [l.strip() for l in f.readlines()[-3:]]
+            result['skipped'] = 'instance not ready: %s' % ' / '.join(tail)
+            return result
+        for rate in profile.get('rates', args.rates):
+            # baseline cpu/rss sampled after the warmup
+            lg = run_loadgen(args, port, path, rate)
+            time.sleep(args.warmup)
+            cpu_start, _ = tree_usage(proc.pid)
+            t_start = time.time()
+            rss_max = 0
+            while lg.poll() is None:
+                _, rss = tree_usage(proc.pid)
+                rss_max = max(rss_max, rss)
+                time.sleep(0.2)
+            cpu_end, _ = tree_usage(proc.pid)
+            elapsed = time.time() - t_start
+            out = lg.stdout.read()
+            if lg.returncode != 0:
+                result['runs'].append({'rate': rate, 'error': 'loadgen exited with %d' % lg.returncode})
+                continue
+            run = json.loads(out)
+            run['cpu_seconds'] = round(cpu_end - cpu_start, 3)
+            run['cpu_percent'] = round(100 * (cpu_end - cpu_start) / elapsed, 1) if elapsed else 0
+            run['rss_max'] = rss_max
+            result['runs'].append(run)
+    finally:
+        proc.send_signal(signal.SIGTERM)
+        try:
+            proc.wait(10)
+        except subprocess.TimeoutExpired:
+            proc.kill()
+            proc.wait()
+        log.close()
+    return result
+
+
+# metric, higher is better
+METRICS = [
+    ('throughput', True),
+    ('latency_ms.p50', False),
+    ('latency_ms.p99', False),
+    ('latency_ms.p999', False),
+    ('cpu_seconds', False),
+    ('rss_max', False),
+]
+
+
+def metric(run, key):
+    for k in key.split('.'):
+        run = run.get(k) if isinstance(run, dict) else None
+    return run
+
+
+def compare(results, baseline, threshold):
+    regressions = []
+    for name, profile in results['profiles'].items():
+        old = baseline.get('profiles', {}).get(name)
+        if not old or 'skipped' in profile or 'skipped' in old:
+            continue
+        old_runs = dict((r['rate'], r) for r in old['runs'] if 'error' not in r)
+        for run in profile['runs']:
+            if 'error' in run or run['rate'] not in old_runs:
+                continue
+            for key, higher_is_better in METRICS:
+                a = metric(old_runs[run['rate']], key)
+                b = metric(run, key)
+                if not a or b is None:
+                    continue
+                delta = 100.0 * (b - a) / a
+                worse = -delta if higher_is_better else delta
+                line = '%-16s rate=%-6s %-16s %12.3f -> %12.3f (%+.1f%%)' % (name, run['rate'], key, a, b, delta)
+                if worse > threshold:
+                    regressions.append(line)
+                    line += ' REGRESSION'
+                print(line)
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description='uWSGI end-to-end benchmarks')
+    parser.add_argument('--uwsgi', default=os.path.join(ROOT, 'uwsgi'))
+    parser.add_argument('--plugins-dir', default=ROOT)
+    parser.add_argument('--plugin', default='python', help='the python plugin to load (e.g. python3)')
+    parser.add_argument('--loadgen', default=os.path.join(HERE, 'loadgen'))
+    parser.add_argument('--profiles', default=','.join(PROFILES))
+    parser.add_argument('--rates', default='0,2000', help='comma separated requests per second (0 = closed loop)')
+    parser.add_argument('--connections', type=int, default=32)
+    parser.add_argument('--duration', type=float, default=10)
+    parser.add_argument('--warmup', type=float, default=2)
+    parser.add_argument('--startup-timeout', type=float, default=15)
+    parser.add_argument('--static-size', type=int, default=65536)
+    parser.add_argument('--output', default='bench_results.json')
+    parser.add_argument('--baseline')
+    parser.add_argument('--threshold', type=float, default=10, help='allowed regression in percent')
+    parser.add_argument('extra', nargs='*', help='additional uWSGI options (after --)')
+    args = parser.parse_args()
+    args.rates = [int(r) for r in args.rates.split(',')]
+
+    for f in (args.uwsgi, args.loadgen):
+        if not os.access(f, os.X_OK):
+            sys.exit('unable to find %s (run "make bench")' % f)
+
+    tmpdir = tempfile.mkdtemp(prefix='uwsgi-bench-')
+    with open(os.path.join(tmpdir, 'file.bin'), 'wb') as f:
+        f.write(b'x' * args.static_size)
+
+    results = {
+        'timestamp': int(time.time()),
+        'host': platform.node(),
+        'machine': platform.machine(),
+        'cpus': os.cpu_count(),
+        'uwsgi': subprocess.check_output([args.uwsgi, '--version'], universal_newlines=True).strip(),
+        'settings': {'connections': args.connections, 'duration': args.duration, 'warmup': args.warmup},
+        'profiles': {},
+    }
+
+    try:
+        for name in args.profiles.split(','):
+            if name not in PROFILES:
+                sys.exit('unknown profile: %s' % name)
+            print('*** %s ***' % name)
+            result = run_profile(args, name, PROFILES[name], tmpdir)
+            results['profiles'][name] = result
+            if 'skipped' in result:
+                print('skipped: %s' % result['skipped'])
+            for run in result['runs']:
+                if 'error' in run:
+                    print('rate=%s %s' % (run['rate'], run['error']))
+                    continue
+                print('rate=%-6s %10.1f req/s p50=%.3fms p99=%.3fms p999=%.3fms errors=%d cpu=%.1f%% rss=%dKB' % (
+                    run['rate'], run['throughput'], run['latency_ms']['p50'], run['latency_ms']['p99'],
+                    run['latency_ms']['p999'], run['errors'] + run['timeouts'] + run['non_2xx'] + run['in_flight'],
+                    run['cpu_percent'], run['rss_max'] / 1024))
+    finally:
+        shutil.rmtree(tmpdir, True)
+
+    with open(args.output, 'w') as f:
+        json.dump(results, f, indent=2, sort_keys=True)
+    print('results written to %s' % args.output)
+
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+        regressions = compare(results, baseline, args.threshold)
+        if regressions:
+            print('%d regressions over %.1f%%' % (len(regressions), args.threshold))
+            sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,115 @@
+import uwsgi
+
+import os
+import random
+import threading
+import time
+
+# workload, all of the values can be overridden by the environment
+#
+# CACHEBENCH_CACHES   comma separated list of caches (default: plain,bitmap,lru,bitmap_lru)
+# CACHEBENCH_REMOTE   address of a cache server, the caches are accessed with the cache protocol
+# CACHEBENCH_THREADS  number of threads (default 1)
+# CACHEBENCH_OPS      operations per thread (default 100000)
+# CACHEBENCH_KEYS     number of distinct keys (default 10000)
+# CACHEBENCH_KEYDIST  uniform or zipf (default uniform)
+# CACHEBENCH_VALUES   fixed:N, uniform:MIN:MAX or pareto:MIN:MAX (default uniform:16:1024)
+# CACHEBENCH_READS    reads ratio between 0 and 1 (default 0.9)
+# CACHEBENCH_SEED     random seed (default 17), every thread uses SEED + thread id
+
+
+def env(name, default):
+    return os.environ.get('CACHEBENCH_' + name, default)
+
+caches = env('CACHES', 'plain,bitmap,lru,bitmap_lru').split(',')
+remote = env('REMOTE', None)
+threads = int(env('THREADS', 1))
+ops = int(env('OPS', 100000))
+keys = int(env('KEYS', 10000))
+keydist = env('KEYDIST', 'uniform')
+values = env('VALUES', 'uniform:16:1024').split(':')
+reads = float(env('READS', 0.9))
+seed = int(env('SEED', 17))
+
+
+def value_size(rnd):
+    if values[0] == 'fixed':
+        return int(values[1])
+    low, high = int(values[1]), int(values[2])
+    if values[0] == 'pareto':
+        return min(high, int(low * rnd.paretovariate(1.2)))
+    return rnd.randint(low, high)
+
+
+def key_index(rnd):
+    if keydist == 'zipf':
+        # approximated zipf (s ~= 1), a few keys get most of the traffic
+        return min(keys - 1, int(keys ** rnd.random()) - 1)
+    return rnd.randint(0, keys - 1)
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return 0
+    return sorted_values[min(len(sorted_values) - 1, int(len(sorted_values) * p))]
+
+
+def worker(cache, tid, results):
+    rnd = random.Random(seed + tid)
+    payload = 'x' * (1024 * 1024)
+    get_lat = []
+    set_lat = []
+    hits = 0
+    now = time.time
+    for i in range(ops):
+        key = 'key%d' % key_index(rnd)
+        if rnd.random() < reads:
+            t = now()
+            value = uwsgi.cache_get(key, cache)
+            get_lat.append(now() - t)
+            if value is not None:
+                hits += 1
+        else:
+            value = payload[:value_size(rnd)]
+            t = now()
+            uwsgi.cache_update(key, value, 0, cache)
+            set_lat.append(now() - t)
+    results.append((get_lat, set_lat, hits))
+
+
+def bench(name):
+    cache = name
+    if remote:
+        cache = '%s@%s' % (name, remote)
+
+    # warm up the cache with a deterministic set of items
+    rnd = random.Random(seed)
+    payload = 'x' * (1024 * 1024)
+    for i in range(keys):
+        uwsgi.cache_update('key%d' % i, payload[:value_size(rnd)], 0, cache)
+
+    results = []
+    workers = [threading.Thread(target=worker, args=(cache, tid, results)) for tid in range(threads)]
+    started_at = time.time()
+    for t in workers:
+        t.start()
+    for t in workers:
+        t.join()
+    elapsed = time.time() - started_at
+
+    get_lat = sorted(sum([r[0] for r in results], []))
+    set_lat = sorted(sum([r[1] for r in results], []))
+    hits = sum([r[2] for r in results])
+    total = len(get_lat) + len(set_lat)
+
+    print '%-12s %10d ops/s  get p50 %7.1fus p99 %7.1fus  set p50 %7.1fus p99 %7.1fus  hit ratio %.2f' % (
+        name, total / elapsed,
+        percentile(get_lat, 0.5) * 1000000, percentile(get_lat, 0.99) * 1000000,
+        percentile(set_lat, 0.5) * 1000000, percentile(set_lat, 0.99) * 1000000,
+        float(hits) / max(1, len(get_lat)))
+
+print 'cache benchmark: %s, threads: %d, ops: %d, keys: %d (%s), values: %s, reads: %.2f' % (
+    remote and 'cache protocol (%s)' % remote or 'in-process', threads, ops, keys, keydist, ':'.join(values), reads)
+
+for name in caches:
+    bench(name)
@@ -0,0 +1,50 @@
+import uwsgi
+import unittest
+
+
+class SegmentsTest(unittest.TestCase):
+
+    __caches__ = [
+        'segmented',
+        'segmented_bitmap',
+        'segmented_lru'
+    ]
+
+    def setUp(self):
+        for cache in self.__caches__:
+            uwsgi.cache_clear(cache)
+
+    def test_set_get(self):
+        for i in range(500):
+            self.assertTrue(uwsgi.cache_set('key%d' % i, 'val%d' % i, 0, 'segmented'))
+        for i in range(500):
+            self.assertEqual(uwsgi.cache_get('key%d' % i, 'segmented'), 'val%d' % i)
+
+    def test_del(self):
+        self.assertTrue(uwsgi.cache_set('key', 'HELLO', 0, 'segmented'))
+        self.assertTrue(uwsgi.cache_exists('key', 'segmented'))
+        self.assertTrue(uwsgi.cache_del('key', 'segmented'))
+        self.assertIsNone(uwsgi.cache_exists('key', 'segmented'))
+
+    def test_keys_and_clear(self):
+        for i in range(100):
+            uwsgi.cache_set('key%d' % i, 'val', 0, 'segmented')
+        keys = uwsgi.cache_keys('segmented')
+        self.assertEqual(len(keys), 100)
+        self.assertTrue('key42' in keys)
+        uwsgi.cache_clear('segmented')
+        self.assertEqual(len(uwsgi.cache_keys('segmented')), 0)
+
+    def test_bitmap(self):
+        self.assertTrue(uwsgi.cache_set('key', 'X' * 200, 0, 'segmented_bitmap'))
+        self.assertEqual(uwsgi.cache_get('key', 'segmented_bitmap'), 'X' * 200)
+        self.assertIsNone(uwsgi.cache_set('big', 'X' * 5000, 0, 'segmented_bitmap'))
+
+    def test_lru(self):
+        # every segment evicts its own least recently used item
+        for i in range(100):
+            self.assertTrue(uwsgi.cache_set('KEY%d' % i, 'Y' * 20, 0, 'segmented_lru'))
+        self.assertEqual(uwsgi.cache_get('KEY99', 'segmented_lru'), 'Y' * 20)
+        self.assertIsNone(uwsgi.cache_get('KEY0', 'segmented_lru'))
+
+unittest.main()
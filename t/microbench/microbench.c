@@ -0,0 +1,460 @@
+/*
+
+	micro benchmarks for the core hot-path primitives
+
+	make microbench
+	./t/microbench/microbench [-s samples] [-t msecs] [-j] [filter...]
+
+	the program is linked with the very same objects of the uwsgi binary (see
+	the --microbench option of uwsgiconfig.py), so the numbers refer to the
+	code (and the CFLAGS) of the current build.
+
+	every benchmark is calibrated to run for at least -t msecs (default 20) per sample,
+	-s samples (default 15) are taken and the mean ns/op is reported with its 95%
+	confidence interval, the median and the relative standard deviation.
+
+	with -j one json object per benchmark is printed (to be stored/compared by scripts).
+
+*/
+
+// uwsgi.h is included by the http router header
+#include "../../plugins/http/common.h"
+
+// the http router could be not embedded in the current build
+extern struct uwsgi_http uhttp __attribute__((weak));
+int http_headers_parse(struct corerouter_peer *, int) __attribute__((weak));
+
+struct microbench {
+	char *name;
+	// returns non zero if the benchmark is not available
+	int (*setup)(void);
+	void (*run)(uint64_t);
+};
+
+static volatile uint64_t mb_sink;
+
+/*
+	uwsgi_parse_vars
+*/
+static struct wsgi_request mb_wsgi_req;
+
+static void mb_packet_add(struct uwsgi_buffer *ub, char *key, char *value) {
+	if (uwsgi_buffer_append_keyval(ub, key, strlen(key), value, strlen(value))) exit(1);
+}
+
+static int mb_parse_vars_setup() {
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(uwsgi.page_size);
+	mb_packet_add(ub, "REQUEST_METHOD", "GET");
+	mb_packet_add(ub, "REQUEST_URI", "/foo/bar?a=1&b=2");
+	mb_packet_add(ub, "PATH_INFO", "/foo/bar");
+	mb_packet_add(ub, "QUERY_STRING", "a=1&b=2");
+	mb_packet_add(ub, "SERVER_PROTOCOL", "HTTP/1.1");
+	mb_packet_add(ub, "SCRIPT_NAME", "");
+	mb_packet_add(ub, "SERVER_NAME", "localhost");
+	mb_packet_add(ub, "SERVER_PORT", "8080");
+	mb_packet_add(ub, "REMOTE_ADDR", "127.0.0.1");
+	mb_packet_add(ub, "REMOTE_PORT", "51234");
+	mb_packet_add(ub, "HTTP_HOST", "example.com");
+	mb_packet_add(ub, "HTTP_USER_AGENT", "Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36");
+	mb_packet_add(ub, "HTTP_ACCEPT", "text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8");
+	mb_packet_add(ub, "HTTP_ACCEPT_LANGUAGE", "en-US,en;q=0.5");
+	mb_packet_add(ub, "HTTP_ACCEPT_ENCODING", "gzip, deflate, br");
+	mb_packet_add(ub, "HTTP_COOKIE", "session=0123456789abcdef0123456789abcdef; theme=dark");
+	mb_packet_add(ub, "HTTP_CONNECTION", "keep-alive");
+
+	mb_wsgi_req.buffer = ub->buf;
+	mb_wsgi_req.len = ub->pos;
+	mb_wsgi_req.hvec = uwsgi_malloc(sizeof(struct iovec) * uwsgi.vec_size);
+	return 0;
+}
+
+static void mb_parse_vars(uint64_t n) {
+	while (n--) {
+		mb_wsgi_req.parsed = 0;
+		mb_wsgi_req.var_cnt = 0;
+		mb_wsgi_req.uri_len = 0;
+		if (uwsgi_parse_vars(&mb_wsgi_req)) exit(1);
+	}
+}
+
+/*
+	http_headers_parse (http router)
+*/
+static struct http_session mb_hr;
+static struct corerouter_peer mb_main_peer;
+static struct corerouter_peer mb_peer;
+
+static int mb_http_setup() {
+	if (!http_headers_parse || !&uhttp) return -1;
+	char *request = "GET /foo/bar?a=1&b=2 HTTP/1.1\r\n"
+		"Host: example.com\r\n"
+		"User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+		"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+		"Accept-Language: en-US,en;q=0.5\r\n"
+		"Accept-Encoding: gzip, deflate, br\r\n"
+		"Cookie: session=0123456789abcdef0123456789abcdef; theme=dark\r\n"
+		"Connection: keep-alive\r\n\r\n";
+	mb_main_peer.in = uwsgi_buffer_new(uwsgi.page_size);
+	if (uwsgi_buffer_append(mb_main_peer.in, request, strlen(request))) return -1;
+	mb_hr.session.main_peer = &mb_main_peer;
+	mb_hr.session.corerouter = &uhttp.cr;
+	strcpy(mb_hr.session.client_address, "127.0.0.1");
+	strcpy(mb_hr.session.client_port, "51234");
+	mb_hr.headers_size = mb_main_peer.in->pos;
+	mb_main_peer.session = &mb_hr.session;
+	mb_peer.session = &mb_hr.session;
+	return 0;
+}
+
+static void mb_http(uint64_t n) {
+	while (n--) {
+		if (http_headers_parse(&mb_peer, 0)) exit(1);
+		uwsgi_buffer_destroy(mb_peer.out);
+		mb_peer.out = NULL;
+	}
+}
+
+/*
+	uwsgi_buffer_* appends (a buffer reset every 64 appends)
+*/
+static struct uwsgi_buffer *mb_ub;
+
+static int mb_buffer_setup() {
+	mb_ub = uwsgi_buffer_new(uwsgi.page_size);
+	return 0;
+}
+
+static void mb_buffer_append(uint64_t n) {
+	while (n--) {
+		if ((n & 63) == 0) mb_ub->pos = 0;
+		if (uwsgi_buffer_append(mb_ub, "Content-Type: te", 16)) exit(1);
+	}
+}
+
+static void mb_buffer_keyval(uint64_t n) {
+	while (n--) {
+		if ((n & 63) == 0) mb_ub->pos = 0;
+		if (uwsgi_buffer_append_keyval(mb_ub, "HTTP_HOST", 9, "example.com", 11)) exit(1);
+	}
+}
+
+static void mb_buffer_num64(uint64_t n) {
+	while (n--) {
+		if ((n & 63) == 0) mb_ub->pos = 0;
+		if (uwsgi_buffer_num64(mb_ub, (int64_t) n)) exit(1);
+	}
+}
+
+/*
+	uwsgi_cache_get2/set2 (with the locking of the cache api)
+*/
+#define MB_CACHE_KEYS 4096
+static struct uwsgi_cache *mb_cache;
+static char mb_cache_keys[MB_CACHE_KEYS][16];
+static char mb_cache_value[128];
+
+static int mb_cache_setup() {
+	if (mb_cache) return 0;
+	mb_cache = uwsgi_cache_create("name=microbench,items=8192,blocksize=256");
+	int i;
+	memset(mb_cache_value, 'x', sizeof(mb_cache_value));
+	for (i = 0; i < MB_CACHE_KEYS; i++) {
+		snprintf(mb_cache_keys[i], 16, "key%012d", i);
+		if (uwsgi_cache_set2(mb_cache, mb_cache_keys[i], 15, mb_cache_value, sizeof(mb_cache_value), 0, 0)) return -1;
+	}
+	return 0;
+}
+
+static void mb_cache_get(uint64_t n) {
+	while (n--) {
+		uint64_t vallen = 0;
+		uwsgi_rlock(mb_cache->lock);
+		char *value = uwsgi_cache_get2(mb_cache, mb_cache_keys[n % MB_CACHE_KEYS], 15, &vallen);
+		uwsgi_rwunlock(mb_cache->lock);
+		mb_sink += (uint64_t) value + vallen;
+	}
+}
+
+static void mb_cache_set(uint64_t n) {
+	while (n--) {
+		uwsgi_wlock(mb_cache->lock);
+		if (uwsgi_cache_set2(mb_cache, mb_cache_keys[n % MB_CACHE_KEYS], 15, mb_cache_value, sizeof(mb_cache_value), 0, UWSGI_CACHE_FLAG_UPDATE)) exit(1);
+		uwsgi_rwunlock(mb_cache->lock);
+	}
+}
+
+#ifdef UWSGI_PCRE
+/*
+	uwsgi_regexp_match_ovec (a typical route)
+*/
+static pcre *mb_pattern;
+static pcre_extra *mb_pattern_extra;
+static int *mb_ovec;
+static int mb_ovec_n;
+
+static int mb_regexp_setup() {
+	if (uwsgi_regexp_build("^/foo/(.+)/bar/([0-9]+)$", &mb_pattern, &mb_pattern_extra)) return -1;
+	mb_ovec_n = uwsgi_regexp_ovector(mb_pattern, mb_pattern_extra);
+	mb_ovec = uwsgi_calloc(sizeof(int) * (3 * (mb_ovec_n + 1)));
+	return 0;
+}
+
+static void mb_regexp(uint64_t n) {
+	char *subject = "/foo/hello/world/bar/12345";
+	int len = strlen(subject);
+	while (n--) {
+		if (uwsgi_regexp_match_ovec(mb_pattern, mb_pattern_extra, subject, len, mb_ovec, mb_ovec_n) < 0) exit(1);
+	}
+}
+#endif
+
+/*
+	locks (uncontended)
+*/
+static struct uwsgi_lock_item *mb_lock;
+static struct uwsgi_lock_item *mb_rwlock;
+
+static int mb_lock_setup() {
+	if (!mb_lock) mb_lock = uwsgi_lock_init("microbench");
+	if (!mb_rwlock) mb_rwlock = uwsgi_rwlock_init("microbench rw");
+	return 0;
+}
+
+static void mb_lock_unlock(uint64_t n) {
+	while (n--) {
+		uwsgi_lock(mb_lock);
+		uwsgi_unlock(mb_lock);
+	}
+}
+
+static void mb_rlock_unlock(uint64_t n) {
+	while (n--) {
+		uwsgi_rlock(mb_rwlock);
+		uwsgi_rwunlock(mb_rwlock);
+	}
+}
+
+static void mb_wlock_unlock(uint64_t n) {
+	while (n--) {
+		uwsgi_wlock(mb_rwlock);
+		uwsgi_rwunlock(mb_rwlock);
+	}
+}
+
+/*
+	rb timers: add + del with 1024 armed timers
+*/
+#define MB_TIMERS 1024
+static struct uwsgi_rbtree *mb_timers;
+static struct uwsgi_rb_timer *mb_timers_items[MB_TIMERS];
+
+static int mb_timers_setup() {
+	if (mb_timers) return 0;
+	mb_timers = uwsgi_init_rb_timer();
+	int i;
+	for (i = 0; i < MB_TIMERS; i++) {
+		mb_timers_items[i] = uwsgi_add_rb_timer(mb_timers, (uint64_t) (rand() % 100000), NULL);
+	}
+	return 0;
+}
+
+static void mb_timers_add_del(uint64_t n) {
+	while (n--) {
+		int i = n % MB_TIMERS;
+		uwsgi_del_rb_timer(mb_timers, mb_timers_items[i]);
+		free(mb_timers_items[i]);
+		mb_timers_items[i] = uwsgi_add_rb_timer(mb_timers, (uint64_t) ((n * 7919) % 100000), NULL);
+	}
+}
+
+/*
+	logformat engine (the line is written to /dev/null)
+*/
+static int mb_logformat_setup() {
+	if (uwsgi.logchunks) return 0;
+	if (mb_parse_vars_setup()) return -1;
+	mb_parse_vars(1);
+	mb_wsgi_req.status = 200;
+	mb_wsgi_req.response_size = 1234;
+	mb_wsgi_req.start_of_request = uwsgi_micros();
+	mb_wsgi_req.end_of_request = mb_wsgi_req.start_of_request + 1500;
+	uwsgi.req_log_fd = open("/dev/null", O_WRONLY);
+	if (uwsgi.req_log_fd < 0) return -1;
+	uwsgi_setup_log_format();
+	uwsgi_build_log_format("%(addr) - %(user) [%(ltime)] \"%(method) %(uri) %(proto)\" %(status) %(size) \"%(referer)\" \"%(uagent)\" %(micros)");
+	return 0;
+}
+
+static void mb_logformat(uint64_t n) {
+	while (n--) {
+		uwsgi_logit_lf(&mb_wsgi_req);
+	}
+}
+
+static struct microbench microbenches[] = {
+	{"parse_vars", mb_parse_vars_setup, mb_parse_vars},
+	{"http_headers_parse", mb_http_setup, mb_http},
+	{"buffer_append", mb_buffer_setup, mb_buffer_append},
+	{"buffer_append_keyval", mb_buffer_setup, mb_buffer_keyval},
+	{"buffer_num64", mb_buffer_setup, mb_buffer_num64},
+	{"cache_get2", mb_cache_setup, mb_cache_get},
+	{"cache_set2", mb_cache_setup, mb_cache_set},
+#ifdef UWSGI_PCRE
+	{"regexp_match_ovec", mb_regexp_setup, mb_regexp},
+#endif
+	{"lock_fast", mb_lock_setup, mb_lock_unlock},
+	{"rwlock_fast_read", mb_lock_setup, mb_rlock_unlock},
+	{"rwlock_fast_write", mb_lock_setup, mb_wlock_unlock},
+	{"rb_timer_add_del", mb_timers_setup, mb_timers_add_del},
+	{"logformat", mb_logformat_setup, mb_logformat},
+	{NULL, NULL, NULL},
+};
+
+static time_t mb_clock_seconds() {
+	return time(NULL);
+}
+
+static uint64_t mb_clock_microseconds() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return ((uint64_t) tv.tv_sec * 1000000) + tv.tv_usec;
+}
+
+// the same of the default "unix" clock (that is static in core/uwsgi.c)
+static struct uwsgi_clock mb_clock = {
+	.name = "microbench",
+	.seconds = mb_clock_seconds,
+	.microseconds = mb_clock_microseconds,
+};
+
+static uint64_t mb_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+static int mb_double_cmp(const void *a, const void *b) {
+	double x = *(double *) a, y = *(double *) b;
+	return x < y ? -1 : x > y;
+}
+
+// two-sided 95% student t values for 1..30 degrees of freedom
+static double mb_t95[] = {
+	12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+static void mb_run(struct microbench *mb, int samples, uint64_t sample_ns, int json) {
+	// calibration: find the iterations needed for a sample (this is the warmup too)
+	uint64_t iterations = 1;
+	for (;;) {
+		uint64_t start = mb_now();
+		mb->run(iterations);
+		uint64_t elapsed = mb_now() - start;
+		if (elapsed >= sample_ns) break;
+		if (elapsed < sample_ns / 100) {
+			iterations *= 10;
+		}
+		else {
+			iterations = (iterations * sample_ns * 1.2) / elapsed + 1;
+		}
+	}
+
+	double *ns = uwsgi_malloc(sizeof(double) * samples);
+	int i;
+	double mean = 0;
+	for (i = 0; i < samples; i++) {
+		uint64_t start = mb_now();
+		mb->run(iterations);
+		ns[i] = (double) (mb_now() - start) / iterations;
+		mean += ns[i];
+	}
+	mean /= samples;
+	double var = 0;
+	for (i = 0; i < samples; i++) {
+		var += (ns[i] - mean) * (ns[i] - mean);
+	}
+	double sd = samples > 1 ? sqrt(var / (samples - 1)) : 0;
+	double t = samples > 1 ? (samples - 1 <= 30 ? mb_t95[samples - 2] : 1.960) : 0;
+	double ci = t * sd / sqrt(samples);
+	qsort(ns, samples, sizeof(double), mb_double_cmp);
+	double median = samples % 2 ? ns[samples / 2] : (ns[samples / 2 - 1] + ns[samples / 2]) / 2;
+
+	if (json) {
+		printf("{\"name\": \"%s\", \"ns_op\": %.3f, \"ci95\": %.3f, \"median\": %.3f, \"min\": %.3f, \"max\": %.3f, \"stddev\": %.3f, \"samples\": %d, \"iterations\": %llu}\n",
+			mb->name, mean, ci, median, ns[0], ns[samples - 1], sd, samples, (unsigned long long) iterations);
+	}
+	else {
+		printf("%-24s %12.2f ns/op +- %8.2f (95%%)  median %10.2f  rsd %5.1f%%  (%d x %llu)\n",
+			mb->name, mean, ci, median, mean > 0 ? 100 * sd / mean : 0, samples, (unsigned long long) iterations);
+	}
+	fflush(stdout);
+	free(ns);
+}
+
+static void mb_usage(char *name) {
+	struct microbench *mb = microbenches;
+	fprintf(stderr, "usage: %s [-s samples] [-t msecs] [-j] [filter...]\n\navailable benchmarks:\n", name);
+	while (mb->name) {
+		fprintf(stderr, "\t%s\n", mb->name);
+		mb++;
+	}
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	int samples = 15;
+	uint64_t sample_ms = 20;
+	int json = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "s:t:jh")) != -1) {
+		switch (opt) {
+		case 's':
+			samples = atoi(optarg);
+			break;
+		case 't':
+			sample_ms = strtoull(optarg, NULL, 10);
+			break;
+		case 'j':
+			json = 1;
+			break;
+		default:
+			mb_usage(argv[0]);
+		}
+	}
+	if (samples < 2 || !sample_ms) mb_usage(argv[0]);
+
+	// the minimal server setup needed by the primitives
+	uwsgi.page_size = getpagesize();
+	uwsgi.shared = uwsgi_calloc_shared(sizeof(struct uwsgi_shared));
+	uwsgi_init_default();
+	uwsgi_register_clock(&mb_clock);
+	uwsgi_set_clock("microbench");
+	strcpy(uwsgi.hostname, "localhost");
+	uwsgi.hostname_len = strlen(uwsgi.hostname);
+	uwsgi.no_initial_output = 1;
+	uwsgi_hash_algo_register_all();
+	uwsgi_setup_locking();
+	uwsgi_register_logchunks();
+	srand(17);
+
+	struct microbench *mb = microbenches;
+	while (mb->name) {
+		int i, selected = optind >= argc;
+		for (i = optind; i < argc; i++) {
+			if (strstr(mb->name, argv[i])) selected = 1;
+		}
+		if (selected) {
+			if (mb->setup()) {
+				if (!json) printf("%-24s not available in this build\n", mb->name);
+			}
+			else {
+				mb_run(mb, samples, sample_ms * 1000000, json);
+			}
+		}
+		mb++;
+	}
+	return 0;
+}
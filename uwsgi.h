@@ -89,6 +89,9 @@ extern "C" {
 #define UWSGI_VIA_ROUTE	2
 #define UWSGI_VIA_OFFLOAD	3
 
+#define UWSGI_SHM_HUGEPAGES_THP	1
+#define UWSGI_SHM_HUGEPAGES_HUGETLB	2
+
 #ifndef UWSGI_LOAD_EMBEDDED_PLUGINS
 #define UWSGI_LOAD_EMBEDDED_PLUGINS
 #endif
@@ -192,6 +195,32 @@ extern "C" {
 #include <uuid/uuid.h>
 #endif
 
+/*
+	USDT static probes (provider "uwsgi"), a single nop when not traced:
+
+	bpftrace -l 'usdt:/path/to/uwsgi:uwsgi:*'
+*/
+#ifdef UWSGI_USDT
+#include <sys/sdt.h>
+#define uwsgi_probe(n) DTRACE_PROBE(uwsgi, n)
+#define uwsgi_probe1(n, a) DTRACE_PROBE1(uwsgi, n, a)
+#define uwsgi_probe2(n, a, b) DTRACE_PROBE2(uwsgi, n, a, b)
+#define uwsgi_probe3(n, a, b, c) DTRACE_PROBE3(uwsgi, n, a, b, c)
+#define uwsgi_probe4(n, a, b, c, d) DTRACE_PROBE4(uwsgi, n, a, b, c, d)
+#define uwsgi_probe5(n, a, b, c, d, e) DTRACE_PROBE5(uwsgi, n, a, b, c, d, e)
+#define uwsgi_probe6(n, a, b, c, d, e, f) DTRACE_PROBE6(uwsgi, n, a, b, c, d, e, f)
+#define uwsgi_probe7(n, a, b, c, d, e, f, g) DTRACE_PROBE7(uwsgi, n, a, b, c, d, e, f, g)
+#else
+#define uwsgi_probe(n)
+#define uwsgi_probe1(n, a)
+#define uwsgi_probe2(n, a, b)
+#define uwsgi_probe3(n, a, b, c)
+#define uwsgi_probe4(n, a, b, c, d)
+#define uwsgi_probe5(n, a, b, c, d, e)
+#define uwsgi_probe6(n, a, b, c, d, e, f)
+#define uwsgi_probe7(n, a, b, c, d, e, f, g)
+#endif
+
 #include <string.h>
 #include <sys/stat.h>
 #include <netinet/tcp.h>
@@ -199,6 +228,15 @@ extern "C" {
 #ifndef TCP_FASTOPEN
 #define TCP_FASTOPEN 23
 #endif
+#ifndef TCP_FASTOPEN_CONNECT
+#define TCP_FASTOPEN_CONNECT 30
+#endif
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
 #endif
 #include <netdb.h>
 
@@ -354,6 +392,12 @@ extern int pivot_root(const char *new_root, const char *put_old);
 #define UWSGI_CACHE_FLAG_DIV	1 << 8
 #define UWSGI_CACHE_FLAG_FIXEXPIRE	1 << 9
 
+#define UWSGI_CACHE_EVICTION_NONE	0
+#define UWSGI_CACHE_EVICTION_LRU	1
+#define UWSGI_CACHE_EVICTION_CLOCK	2
+#define UWSGI_CACHE_EVICTION_SAMPLED_LRU	3
+#define UWSGI_CACHE_EVICTION_LFU	4
+
 #ifdef UWSGI_SSL
 #include "openssl/conf.h"
 #include "openssl/ssl.h"
@@ -361,6 +405,7 @@ extern int pivot_root(const char *new_root, const char *put_old);
 #endif
 
 #include <glob.h>
+#include <fnmatch.h>
 
 #ifdef __CYGWIN__
 #define __WINCRYPT_H__
@@ -373,11 +418,38 @@ extern int pivot_root(const char *new_root, const char *put_old);
         ((unsigned char *) ((struct cmsghdr *)(cmsg) + 1))
 #endif
 
+#define UWSGI_DGRAM_BATCH 16
+
+// connections accepted by an async loop on a single wakeup when the master reports a listen queue
+#define UWSGI_ACCEPT_BATCH 8
+
+// max size of the data passed with a connection handed off by the routers
+#define UWSGI_HANDOFF_MAX 65536
+
+// datagrams received with a single syscall
+struct uwsgi_dgram_batch {
+	int max;
+	size_t size;
+	char *buf;
+	struct sockaddr_storage *addr;
+	socklen_t *addr_len;
+	ssize_t *len;
+#ifdef __linux__
+	struct iovec *iov;
+	struct mmsghdr *msgs;
+#endif
+};
+
+#define UWSGI_BUFFER_SMALL 256
+
 struct uwsgi_buffer {
 	char *buf;
 	size_t pos;
 	size_t len;
 	size_t limit;
+	// the payload follows the structure (small pooled buffers)
+	int inline_buf;
+	struct uwsgi_buffer *pool_next;
 #ifdef UWSGI_DEBUG_BUFFER
 	int freed;
 #endif
@@ -433,8 +505,17 @@ struct uwsgi_lock_ops {
 #define uwsgi_wlock(x) uwsgi.lock_ops.wlock(x)
 #define uwsgi_rwunlock(x) uwsgi.lock_ops.rwunlock(x)
 
+// memory barriers and atomic operations (gcc/clang builtins) for lock-free shared memory access
+#define uwsgi_barrier() __sync_synchronize()
+#define uwsgi_atomic_inc(x) __sync_add_and_fetch(x, 1)
+#define uwsgi_atomic_or(x, v) __sync_fetch_and_or(x, v)
+#define uwsgi_atomic_get_and_clear(x) __sync_fetch_and_and(x, 0)
+#define uwsgi_atomic_cas(x, o, n) __sync_bool_compare_and_swap(x, o, n)
+#define uwsgi_atomic_xchg(x, v) __sync_lock_test_and_set(x, v)
+
 #define uwsgi_wait_read_req(x) uwsgi.wait_read_hook(x->fd, uwsgi.socket_timeout) ; x->switches++
-#define uwsgi_wait_write_req(x) uwsgi.wait_write_hook(x->fd, uwsgi.socket_timeout) ; x->switches++
+#define uwsgi_wait_write_req(x) uwsgi_wait_write_req_do(x)
+#define uwsgi_req_timing(x, s) if (uwsgi.req_timing) uwsgi_req_stage(x, s)
 
 #ifdef UWSGI_PCRE
 #include <pcre.h>
@@ -479,9 +560,17 @@ struct uwsgi_regexp_list {
 };
 #endif
 
+#define UWSGI_TIMER_WHEEL_SLOTS 4096
+struct uwsgi_timer_wheel {
+	uint64_t base;
+	uint64_t count;
+	struct uwsgi_rb_timer *slots[UWSGI_TIMER_WHEEL_SLOTS];
+};
+
 struct uwsgi_rbtree {
 	struct uwsgi_rb_timer *root;
 	struct uwsgi_rb_timer *sentinel;
+	struct uwsgi_timer_wheel *wheel;
 };
 
 struct uwsgi_rb_timer {
@@ -497,6 +586,7 @@ struct uwsgi_rbtree *uwsgi_init_rb_timer(void);
 struct uwsgi_rb_timer *uwsgi_min_rb_timer(struct uwsgi_rbtree *, struct uwsgi_rb_timer *);
 struct uwsgi_rb_timer *uwsgi_add_rb_timer(struct uwsgi_rbtree *, uint64_t, void *);
 void uwsgi_del_rb_timer(struct uwsgi_rbtree *, struct uwsgi_rb_timer *);
+struct uwsgi_rb_timer *uwsgi_reset_rb_timer(struct uwsgi_rbtree *, struct uwsgi_rb_timer *, uint64_t);
 
 
 union uwsgi_sockaddr {
@@ -565,6 +655,10 @@ struct uwsgi_gateway_socket {
 	// could be useful for plugins
 	int mode;
 
+	// one SO_REUSEPORT listener for each gateway process
+	int *shards;
+	int shards_cnt;
+
 };
 
 
@@ -612,6 +706,8 @@ struct uwsgi_daemon {
 	char *chdir;
 };
 
+struct uwsgi_log_batch;
+
 struct uwsgi_logger {
 	char *name;
 	char *id;
@@ -626,9 +722,29 @@ struct uwsgi_logger {
 	char *buf;
 	// used by choosen logger
 	char *arg;
+	// the logger sends ul->msg with the line in msg_iov[count] (batches can use sendmmsg)
+	int dgram;
+	struct uwsgi_log_batch *batch;
 	struct uwsgi_logger *next;
 };
 
+/*
+	lines for a logger are accumulated (as 32bit size + line) and sent by a thread
+	of the master, so the logging context never waits for the network
+*/
+struct uwsgi_log_batch {
+	struct uwsgi_logger *ul;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int spawned;
+	struct uwsgi_buffer *pending;
+	struct uwsgi_buffer *flushing;
+	uint64_t lines;
+	uint64_t flushes;
+	uint64_t drops;
+	struct uwsgi_log_batch *next;
+};
+
 #ifdef UWSGI_SSL
 struct uwsgi_legion_node {
 	char *name;
@@ -641,6 +757,11 @@ struct uwsgi_legion_node {
 	uint64_t lord_valor;
 	char lord_uuid[36];
 	time_t last_seen;
+	// heartbeat inter-arrival statistics (milliseconds) for the phi accrual detector
+	uint64_t last_seen_us;
+	double interval_mean;
+	double interval_var;
+	uint32_t samples;
 	struct uwsgi_legion_node *prev;
 	struct uwsgi_legion_node *next;
 };
@@ -727,16 +848,68 @@ struct uwsgi_queue_item {
 	time_t ts;
 };
 
+// lock-free bounded MPMC ring (Vyukov style), positions are never wrapped
+struct uwsgi_queue_ring {
+	volatile uint64_t enqueue_pos;
+	char pad0[56];
+	volatile uint64_t dequeue_pos;
+	char pad1[56];
+};
+
+// consumers sleeping for new items (futex on seq, or the eventfd for async cores)
+struct uwsgi_queue_waiters {
+	volatile uint32_t seq;
+	volatile uint32_t waiters;
+};
+
+// a message spans one or more consecutive cells, the head one holds the sizes
+struct uwsgi_queue_cell {
+	volatile uint64_t seq;
+	uint32_t cells;
+	uint32_t size;
+};
+
 struct uwsgi_hash_algo {
 	char *name;
 	 uint32_t(*func) (char *, uint64_t);
+	 uint64_t(*func64) (char *, uint64_t);
 	struct uwsgi_hash_algo *next;
 };
 
+// the full 64bit value (if the algo has one)
+#define uwsgi_hash_algo_64(uha, key, keylen) ((uha)->func64 ? (uha)->func64(key, keylen) : (uint64_t) (uha)->func(key, keylen))
+
 struct uwsgi_hash_algo *uwsgi_hash_algo_get(char *);
 void uwsgi_hash_algo_register(char *, uint32_t(*)(char *, uint64_t));
+void uwsgi_hash_algo_register64(char *, uint32_t(*)(char *, uint64_t), uint64_t(*)(char *, uint64_t));
 void uwsgi_hash_algo_register_all(void);
 
+// a set of response headers serialized once (as "Key: value\r\n" lines)
+#define UWSGI_MAX_HEADER_TEMPLATES 8
+// a shared GCRA rate limiter (see core/ratelimit.c)
+struct uwsgi_ratelimit {
+	char *name;
+	uint64_t buckets;
+	// usecs between requests and allowed burst
+	uint64_t interval;
+	uint64_t tolerance;
+	uint64_t epoch;
+	uint64_t *slots;
+	uint64_t *rejected;
+	struct uwsgi_hash_algo *hash;
+	struct uwsgi_ratelimit *next;
+};
+
+struct uwsgi_header_template {
+	char *name;
+	struct uwsgi_buffer *ub;
+	uint16_t count;
+	struct uwsgi_header_template *next;
+};
+
+// chunks of the shared heap are (32 << class) bytes, header included
+#define UWSGI_SHAREDHEAP_CLASSES 20
+
 struct uwsgi_sharedarea {
 	int id;
 	int pages;
@@ -749,6 +922,51 @@ struct uwsgi_sharedarea {
 	uint8_t honour_used;
 	uint64_t used;
 	void *obj;
+	// the area is managed as a variable-size heap (a lock for each size class)
+	uint8_t heap;
+	struct uwsgi_lock_item *heap_locks[UWSGI_SHAREDHEAP_CLASSES];
+	struct uwsgi_lock_item *heap_brk_lock;
+	// futex word and eventfd for uwsgi_sharedarea_wait()
+	uint32_t notify_seq;
+	uint32_t waiters;
+	int efd;
+	uint64_t page_size;
+};
+
+// stored at the start of the area
+struct uwsgi_sharedheap {
+	uint64_t magic;
+	uint64_t size;
+	uint64_t brk;
+	// offsets of the first free chunk of each class
+	uint64_t free_list[UWSGI_SHAREDHEAP_CLASSES];
+	uint64_t allocated[UWSGI_SHAREDHEAP_CLASSES];
+};
+
+// precedes every chunk payload
+struct uwsgi_sharedheap_chunk {
+	uint32_t magic;
+	uint32_t size_class;
+	uint64_t len;
+};
+
+// updates waiting to be sent to the cache nodes (in shared memory)
+struct uwsgi_cache_replication {
+	struct uwsgi_lock_item *lock;
+	int active;
+	uint64_t node_id;
+	uint64_t seq;
+	uint64_t pos;
+	uint64_t size;
+	uint64_t freq;
+	uint64_t dropped;
+	char *buf;
+};
+
+// open addressing index bucket (8 per cacheline), slot 0 means empty
+struct uwsgi_cache_bucket {
+	uint32_t hash;
+	uint32_t slot;
 };
 
 // maintain alignment here !!!
@@ -841,6 +1059,60 @@ struct uwsgi_cache {
 	int lazy_expire;
 	uint64_t sweep_on_full;
 	int clear_on_full;
+
+	// lock striping: keys are routed (by hash) to independently locked sub-caches
+	uint64_t segments;
+	struct uwsgi_cache **segment;
+
+	// optimistic (seqlock) reads: one sequence counter for each hashtable slot
+	int optimistic;
+	uint32_t *seqlocks;
+
+	// approximated eviction policies (clock, sampled-lru, lfu), lru is managed by purge_lru
+	uint8_t eviction;
+	uint64_t eviction_samples;
+	uint64_t clock_hand;
+
+	// open addressing (linear probing) index, used instead of hashtable (hashsize is the number of buckets)
+	int open_index;
+	struct uwsgi_cache_bucket *buckets;
+
+	// incremental persistence, only the dirty pages are written to the store
+	int store_incremental;
+	int store_fd;
+	uint64_t *store_dirty;
+	uint64_t store_pages;
+
+	// values bigger than this are served directly from the store file
+	uint64_t store_sendfile;
+
+	// expiration timing wheel: items are linked (by index) in the slot of their expiration second
+	uint64_t wheel_slots;
+	uint64_t wheel_pos;
+	uint64_t *wheel;
+	uint64_t *wheel_next;
+	uint64_t *wheel_prev;
+
+	// bumped on every modification, invalidates the per-thread near caches (l1)
+	uint64_t *generation;
+	uint64_t l1_items;
+	uint64_t l1_max_value;
+
+	// page size of the items area
+	uint64_t page_size;
+
+	// batched, sequenced replication to the udp nodes
+	struct uwsgi_cache_replication *replication;
+
+	// size-class allocator for bitmap mode: chunks of 2^n blocks carved from slabs of slab_blocks blocks
+	uint64_t slab_blocks;
+	uint64_t slabs;
+	uint8_t slab_classes;
+	uint64_t *slab_free;
+	uint8_t *slab_class;
+	uint64_t *slab_used;
+	uint64_t *slab_unused;
+	uint64_t slab_unused_ptr;
 };
 
 struct uwsgi_option {
@@ -859,6 +1131,18 @@ struct uwsgi_opt {
 	int configured;
 };
 
+// options emitted by a config parser, collected for --config-cache
+struct uwsgi_config_cache {
+	char *path;
+	char *content;
+	size_t content_len;
+	uint32_t content_hash;
+	uint32_t magic_hash;
+	uint32_t items;
+	struct uwsgi_buffer *ub;
+	struct uwsgi_config_cache *prev;
+};
+
 #define UWSGI_OK	0
 #define UWSGI_AGAIN	1
 #define UWSGI_ACCEPTING	2
@@ -895,6 +1179,24 @@ struct uwsgi_opt {
 #define UWSGI_MODIFIER_MULTICAST	74
 #define UWSGI_MODIFIER_PING		100
 
+// multiplexed puwsgi frames (modifier2 is the frame type, the payload starts with the request id)
+#define UWSGI_MODIFIER_PUWSGI_FRAME	254
+#define UWSGI_PUWSGI_REQUEST		0
+#define UWSGI_PUWSGI_BODY		1
+#define UWSGI_PUWSGI_RESPONSE		2
+#define UWSGI_PUWSGI_END		3
+// max payload of a frame (after the 4 bytes request id)
+#define UWSGI_PUWSGI_FRAME_MAX		(0xffff - 4)
+
+// response metadata sent by uwsgi backends before the HTTP headers (pktsize is the size of the header block, modifier2 the flags)
+#define UWSGI_MODIFIER_RESPONSE_HINT	253
+#define UWSGI_RESPONSE_HINT_HAS_SIZE	1
+#define UWSGI_RESPONSE_HINT_NOT_HTTP11	2
+#define UWSGI_RESPONSE_HINT_CLOSE	4
+#define UWSGI_RESPONSE_HINT_HAS_CONNECTION	8
+#define UWSGI_RESPONSE_HINT_HAS_ENCODING	16
+#define UWSGI_RESPONSE_HINT_UWSGI_GZIP	32
+
 #define UWSGI_MODIFIER_RESPONSE		255
 
 #define NL_SIZE 2
@@ -972,6 +1274,8 @@ struct uwsgi_socket {
 
 	// this is a special map for having socket->thread mapping
 	int *fd_threads;
+	// multiplexed puwsgi frames already read from the connection of each core
+	struct uwsgi_buffer **puwsgi_rx;
 
 	// generally used by zeromq handlers
 	char uuid[37];
@@ -994,6 +1298,19 @@ struct uwsgi_socket {
 	// used for avoiding vacuum mess
 	ino_t inode;
 
+	// one SO_REUSEPORT listener for each worker
+	int *shards;
+	int shards_cnt;
+
+	// --socket-qos
+	int priority;
+	int weight;
+	int reserved;
+	uint64_t shed_backlog;
+	uint64_t *shed;
+	// smooth weighted round robin state (for each core)
+	int *qos_current;
+
 #ifdef UWSGI_SSL
 	SSL_CTX *ssl_ctx;
 #endif
@@ -1008,6 +1325,7 @@ struct uwsgi_protocol {
 
 struct uwsgi_server;
 struct uwsgi_instance;
+struct uwsgi_stats;
 
 struct uwsgi_plugin {
 
@@ -1069,6 +1387,15 @@ struct uwsgi_plugin {
 
 	void (*vassal)(struct uwsgi_instance *);
 	void (*vassal_before_exec)(struct uwsgi_instance *, char **);
+
+	// run in the zygote after the apps are loaded (before forking workers)
+	void (*zygote_ready)(void);
+
+	// add "key":value, items to the object of a worker in the master stats
+	int (*worker_stats)(struct uwsgi_stats *, int);
+
+	// run in the workers (after a request) when the master detects memory pressure
+	void (*memory_pressure)(void);
 };
 
 #ifdef UWSGI_PCRE
@@ -1123,12 +1450,42 @@ struct uwsgi_app {
 	void *uwsgi_version;
 	void *uwsgi_node;
 
+	// constant part of the environ, merged in every request
+	void *environ_template;
+	// interned environ keys
+	void *environ_keys;
+
 	time_t started_at;
 	time_t startup_time;
 
 	uint64_t avg_response_time;
 };
 
+struct uwsgi_spooler;
+
+/*
+	spooler engines store and discover the tasks
+
+	"dir" (the default) scans the spool directory, "inotify" uses the spool directory too
+	(with new tasks signaled by the kernel) and "shm" keeps them in a shared memory ring
+*/
+struct uwsgi_spooler_engine {
+	char *name;
+	// called in the master for each spooler (before fork)
+	void (*init) (struct uwsgi_spooler *);
+	// store a task, returns its name (NULL means "fall back to a spool file")
+	char *(*push) (struct uwsgi_spooler *, char *, uint16_t, char *, size_t, time_t, char *, size_t);
+	// called in the spooler, returns a descriptor to monitor for new tasks (-1 for periodic scans only)
+	int (*fd) (struct uwsgi_spooler *);
+	// run the available tasks, full is 0 when woken up by the engine descriptor
+	void (*run) (struct uwsgi_spooler *, int);
+	// used by --spooler-cheap
+	int (*pending) (struct uwsgi_spooler *);
+	// the engine discovers new spool files by itself (no need to wake up the spooler with SIGUSR1)
+	int notified;
+	struct uwsgi_spooler_engine *next;
+};
+
 struct uwsgi_spooler {
 
 	char dir[PATH_MAX];
@@ -1148,6 +1505,14 @@ struct uwsgi_spooler {
 	struct uwsgi_spooler *next;
 
 	time_t last_task_managed;
+
+	struct uwsgi_spooler_engine *engine;
+	void *engine_data;
+	// priority (+1) of the task being run, released if the process dies
+	int claimed;
+	// journal record (segment + 1 and offset) being run, managed again if the process dies
+	uint64_t claimed_segment;
+	uint64_t claimed_offset;
 };
 
 #ifdef UWSGI_ROUTING
@@ -1159,6 +1524,7 @@ struct uwsgi_spooler {
 // close the request
 #define UWSGI_ROUTE_BREAK 2
 
+struct uwsgi_route_template;
 struct uwsgi_route {
 
 	pcre *pattern;
@@ -1207,10 +1573,31 @@ struct uwsgi_route {
 	// this is used by virtual route to free resources
 	void (*free)(struct uwsgi_route *);
 
+	// parsed strings of the route (one list for each core)
+	struct uwsgi_route_template **templates;
+
+	// the alternation of this route and of the following ones (group_len in total)
+	// sharing the same subject, a miss skips the whole group
+	pcre *group_pattern;
+	pcre_extra *group_pattern_extra;
+	uint32_t group_len;
+
 	struct uwsgi_route *next;
 
 };
 
+// memoized regexp results (one direct-mapped table for each core)
+#define UWSGI_ROUTE_MEMO_SUBJECT 256
+#define UWSGI_ROUTE_MEMO_OVEC 30
+struct uwsgi_route_memo {
+	void *pattern;
+	uint32_t hash;
+	uint16_t subject_len;
+	int n;
+	int ovector[UWSGI_ROUTE_MEMO_OVEC];
+	char subject[UWSGI_ROUTE_MEMO_SUBJECT];
+};
+
 struct uwsgi_route_condition {
 	char *name;
 	int (*func)(struct wsgi_request *, struct uwsgi_route *);
@@ -1248,6 +1635,11 @@ struct uwsgi_alarm_instance {
 	char *last_msg;
 	size_t last_msg_size;
 
+	// --alarm-burst accounting
+	time_t window_start;
+	uint64_t window_count;
+	uint64_t suppressed;
+
 	struct uwsgi_alarm *alarm;
 	struct uwsgi_alarm_instance *next;
 };
@@ -1281,6 +1673,11 @@ struct uwsgi_alarm_log {
 	pcre *pattern;
 	pcre_extra *pattern_extra;
 	int negate;
+	// a literal every match has to contain (if any)
+	char *literal;
+	size_t literal_len;
+	// the regexp is part of the combined one
+	int combined;
 	struct uwsgi_alarm_ll *alarms;
 	struct uwsgi_alarm_log *next;
 };
@@ -1299,6 +1696,15 @@ struct uwsgi_async_fd {
 	struct uwsgi_async_fd *next;
 };
 
+// request-scoped memory (one for each core), released by uwsgi_close_request()
+struct uwsgi_req_arena {
+	char *buf;
+	size_t size;
+	size_t pos;
+	// allocations not fitting in buf
+	void **large;
+};
+
 struct uwsgi_logvar {
 	char key[256];
 	uint8_t keylen;
@@ -1329,9 +1735,23 @@ struct uwsgi_transformation {
 	struct uwsgi_buffer *ub;
 	uint64_t len;
 	uint64_t custom64;
+	// always called when the chain is destroyed (even if the final round did not run)
+	void (*free)(struct uwsgi_transformation *);
 	struct uwsgi_transformation *next;
 };
 
+// stages of the request timing (--req-timing)
+enum {
+	UWSGI_REQ_STAGE_QUEUE,
+	UWSGI_REQ_STAGE_PARSE,
+	UWSGI_REQ_STAGE_BODY,
+	UWSGI_REQ_STAGE_ROUTING,
+	UWSGI_REQ_STAGE_APP,
+	UWSGI_REQ_STAGE_WRITE,
+	UWSGI_REQ_STAGE_CLOSE,
+	UWSGI_REQ_STAGE_MAX,
+};
+
 struct wsgi_request {
 	int fd;
 	struct uwsgi_header *uh;
@@ -1354,6 +1774,11 @@ struct wsgi_request {
 	uint64_t start_of_request_in_sec;
 	uint64_t end_of_request;
 
+	// microseconds spent in each stage (monotonic clock), write waits are not accounted to other stages
+	uint64_t timing_mark;
+	uint64_t timing_write_mark;
+	uint64_t timing[UWSGI_REQ_STAGE_MAX];
+
 	char *uri;
 	uint16_t uri_len;
 	char *remote_addr;
@@ -1441,10 +1866,14 @@ struct wsgi_request {
 
 	uint16_t var_cnt;
 	uint16_t header_cnt;
+	// number of hvec items already in the vars index
+	uint16_t vars_indexed;
 
 	int do_not_log;
 
 	int do_not_add_to_async_queue;
+	// the socket has been accepted with SOCK_CLOEXEC
+	int fd_cloexec;
 
 	int do_not_account;
 
@@ -1489,6 +1918,9 @@ struct wsgi_request {
 	size_t post_readline_pos;
 	size_t post_readline_watermark;
 	FILE *post_file;
+	// the body is streamed by an offload thread (post-buffering-stream)
+	uint8_t post_stream;
+	int post_stream_fd;
 	char *post_readline_buf;
 	// this is used when no post buffering is in place
 	char *post_read_buf;
@@ -1499,6 +1931,9 @@ struct wsgi_request {
 
 	size_t range_from;
 	size_t range_to;
+	// the raw Range header
+	char *range;
+	uint16_t range_len;
 
 	// current socket mapped to request
 	struct uwsgi_socket *socket;
@@ -1514,6 +1949,19 @@ struct wsgi_request {
 	uint64_t proto_parser_buf_size;
 	void *proto_parser_remains_buf;
 	size_t proto_parser_remains;
+	// the response has a Content-Length (persistent protocols)
+	int proto_response_framed;
+	// multiplexed puwsgi: request id
+	int proto_mux;
+	uint32_t proto_mux_id;
+	// framed protocols: header of the record being sent and its remaining payload
+	char proto_frame_hdr[8];
+	uint8_t proto_frame_hdr_remains;
+	size_t proto_frame_remains;
+	// handoff sockets: bytes read by the router before passing the connection
+	char *proto_handoff_buf;
+	size_t proto_handoff_len;
+	size_t proto_handoff_pos;
 
 	char *buffer;
 
@@ -1525,6 +1973,8 @@ struct wsgi_request {
 	struct uwsgi_logvar *logvars;
 	struct uwsgi_string_list *additional_headers;
 	struct uwsgi_string_list *remove_headers;
+	struct uwsgi_header_template *header_templates[UWSGI_MAX_HEADER_TEMPLATES];
+	int header_templates_cnt;
 
 	struct uwsgi_buffer *websocket_buf;
 	struct uwsgi_buffer *websocket_send_buf;
@@ -1537,6 +1987,18 @@ struct wsgi_request {
 	time_t websocket_last_ping;
 	time_t websocket_last_pong;
 	int websocket_closed;
+	// permessage-deflate state (z_streams are allocated lazily)
+	uint8_t websocket_deflate;
+	uint8_t websocket_server_no_takeover;
+	uint8_t websocket_client_no_takeover;
+	uint8_t websocket_server_wbits;
+	uint8_t websocket_client_wbits;
+	uint8_t websocket_fin;
+	uint8_t websocket_rsv1;
+	uint8_t websocket_compressed;
+	void *websocket_zdeflate;
+	void *websocket_zinflate;
+	time_t websocket_zlast;
 	// websocket specific headers
 	char *http_sec_websocket_key;
 	uint16_t http_sec_websocket_key_len;
@@ -1544,14 +2006,16 @@ struct wsgi_request {
 	uint16_t http_origin_len;
 	char *http_sec_websocket_protocol;
 	uint16_t http_sec_websocket_protocol_len;
+	char *http_sec_websocket_extensions;
+	uint16_t http_sec_websocket_extensions_len;
 	
 
 	struct uwsgi_buffer *chunked_input_buf;
 	uint8_t chunked_input_parser_status;
 	ssize_t chunked_input_chunk_len;
-	size_t chunked_input_need;
 	uint8_t chunked_input_complete;
-        size_t chunked_input_decapitate;
+	// parser cursor in chunked_input_buf
+	size_t chunked_input_offset;
 
 	uint64_t stream_id;
 
@@ -1560,6 +2024,8 @@ struct wsgi_request {
 	int is_final_routing;
 	int is_error_routing;
 	int is_response_routing;
+	// the router asked for a response metadata hint (UWSGI_RESPONSE_HINT)
+	int response_hint;
 	int routes_applied;
 	int response_routes_applied;
 	// internal routing vm program counter
@@ -1648,7 +2114,7 @@ struct uwsgi_stats_pusher;
 struct uwsgi_stats_pusher_instance;
 
 #define UWSGI_PROTO_MIN_CHECK 4
-#define UWSGI_PROTO_MAX_CHECK 28
+#define UWSGI_PROTO_MAX_CHECK 30
 
 struct uwsgi_offload_engine;
 
@@ -1696,6 +2162,8 @@ struct uwsgi_harakiri_options {
 	int workers;
 	int spoolers;
 	int mules;
+	// sub-second workers harakiri (workers is rounded up)
+	int workers_ms;
 };
 
 struct uwsgi_fsmon {
@@ -1708,6 +2176,7 @@ struct uwsgi_fsmon {
 };
 
 struct uwsgi_subscription_client;
+struct uwsgi_subscribe_chash;
 
 struct uwsgi_server {
 
@@ -1771,10 +2240,14 @@ struct uwsgi_server {
 	struct uwsgi_logchunk *logchunks;
 	struct uwsgi_logchunk *registered_logchunks;
 	void (*logit) (struct wsgi_request *);
-	struct iovec **logvectors;
+	struct uwsgi_buffer **logformat_buffers;
+	int logformat_json;
 
 	// autoload plugins
 	int autoload;
+	// plugins loaded only when needed
+	int lazy_plugins;
+	struct uwsgi_string_list *lazy_plugins_list;
 	struct uwsgi_string_list *plugins_dir;
 	struct uwsgi_string_list *blacklist;
 	struct uwsgi_string_list *whitelist;
@@ -1811,8 +2284,15 @@ struct uwsgi_server {
 	uint64_t master_cycles;
 
 	int reuse_port;
+	int reuse_port_workers;
+	int reuse_port_incoming_cpu;
+	// worker counters are aggregated from the cores by the master
+	int lazy_worker_stats;
 	int tcp_fast_open;
 	int tcp_fast_open_client;
+	// usecs of busy polling on TCP sockets (SO_BUSY_POLL)
+	int so_busy_poll;
+	int so_prefer_busy_poll;
 
 	int enable_proxy_protocol;
 
@@ -1831,6 +2311,12 @@ struct uwsgi_server {
 	int lazy;
 	// enable lazy-apps mode
 	int lazy_apps;
+	// load apps in a zygote forking the workers
+	int zygote;
+	int zygote_fd;
+	pid_t zygote_pid;
+	int i_am_a_zygote;
+	int zygote_apps_loaded;
 	// enable cheaper mode
 	int cheaper;
 	char *requested_cheaper_algo;
@@ -1870,9 +2356,14 @@ struct uwsgi_server {
 	int early_emperor;
 	int emperor_throttle;
 	int emperor_freq;
+	int emperor_fsmon;
+	int emperor_fsmon_rescan;
 	int emperor_max_throttle;
 	int emperor_magic_exec;
 	int emperor_heartbeat;
+	int emperor_on_demand_idle;
+	int emperor_on_demand_prewarm;
+	int emperor_activity_report;
 	int emperor_curse_tolerance;
 	struct uwsgi_string_list *emperor_extra_extension;
 	// search for a file with the specified extension at the same level of the vassal file
@@ -1912,8 +2403,16 @@ struct uwsgi_server {
 	struct uwsgi_string_list *remove_headers;
 	struct uwsgi_string_list *collect_headers;
 
+	struct uwsgi_string_list *header_templates_list;
+	struct uwsgi_string_list *add_header_templates;
+	struct uwsgi_header_template *header_templates;
+	// --add-header and --add-header-template serialized once
+	struct uwsgi_header_template *additional_headers_template;
+
 	// set cpu affinity
 	int cpu_affinity;
+	int numa_interleave;
+	int numa_workers;
 
 	int reload_mercy;
 	int worker_reload_mercy;
@@ -1935,6 +2434,10 @@ struct uwsgi_server {
 	int exported_opts_cnt;
 	struct uwsgi_custom_option *custom_options;
 
+	// parsed config files cache
+	char *config_cache;
+	struct uwsgi_config_cache *config_cache_capture;
+
 	// dump the whole set of options
 	int dump_options;
 	// show ini representation of the current config
@@ -1964,6 +2467,9 @@ struct uwsgi_server {
 	struct uwsgi_string_list *zerg_node;
 	int zerg_fallback;
 	int zerg_server_fd;
+	// connections to the zergpools, used for load reports
+	int *zerg_report_fds;
+	int zerg_report_fds_cnt;
 
 	// security
 	char *chroot;
@@ -2073,6 +2579,12 @@ struct uwsgi_server {
 	size_t log_master_bufsize;
 	int log_master_stream;
 	int log_master_req_stream;
+	uint64_t req_log_ring;
+	struct uwsgi_string_list *log_batch;
+	uint64_t log_batch_size;
+	uint64_t log_batch_max;
+	int log_batch_freq;
+	struct uwsgi_log_batch *log_batches;
 
 	int log_reopen;
 	int log_truncate;
@@ -2191,6 +2703,7 @@ struct uwsgi_server {
 
 #ifdef UWSGI_PCRE
 	int pcre_jit;
+	uint64_t pcre_jit_stack_size;
 	struct uwsgi_regexp_list *log_drain_rules;
 	struct uwsgi_regexp_list *log_filter_rules;
 	struct uwsgi_regexp_list *log_route;
@@ -2210,6 +2723,9 @@ struct uwsgi_server {
 	struct uwsgi_alarm *alarms;
 	struct uwsgi_alarm_instance *alarm_instances;
 	struct uwsgi_alarm_log *alarm_logs;
+	// the alternation of all of the combinable log-alarm regexps
+	struct uwsgi_alarm_log *alarm_logs_combined;
+	uint64_t alarm_burst;
 	struct uwsgi_thread *alarm_thread;
 
 	int threaded_logger;
@@ -2244,8 +2760,13 @@ struct uwsgi_server {
 	int use_static_cache_paths;
 	char *static_cache_paths_name;
 	struct uwsgi_cache *static_cache_paths;
+	int static_fd_cache;
+	int static_fd_cache_ttl;
+	struct uwsgi_string_list *static_fd_cache_watch;
 	int cache_expire_freq;
 	int cache_report_freed_items;
+	uint64_t cache_remote_l1;
+	int cache_remote_l1_ttl;
 	int cache_no_expire;
 	uint64_t cache_max_items;
 	uint64_t cache_blocksize;
@@ -2271,6 +2792,9 @@ struct uwsgi_server {
 	int static_gzip_all;
 	struct uwsgi_string_list *static_gzip_dir;
 	struct uwsgi_string_list *static_gzip_ext;
+	struct uwsgi_string_list *static_precompressed;
+	char *static_gzip_store;
+	char *static_gzip_cache;
 #ifdef UWSGI_PCRE
 	struct uwsgi_regexp_list *static_gzip;
 #endif
@@ -2280,8 +2804,14 @@ struct uwsgi_server {
 	struct uwsgi_offload_engine *offload_engine_transfer;
 	struct uwsgi_offload_engine *offload_engine_memory;
 	struct uwsgi_offload_engine *offload_engine_pipe;
+	struct uwsgi_offload_engine *offload_engine_snapshot;
+	struct uwsgi_offload_engine *offload_engine_byteranges;
+	struct uwsgi_offload_engine *offload_engine_body;
+	struct uwsgi_offload_engine *offload_engine_websocket;
 	int offload_threads;
 	int offload_threads_events;
+	int offload_threads_rr;
+	int offload_http_keepalive;
 	struct uwsgi_thread **offload_thread;
 
 	int check_static_docroot;
@@ -2300,13 +2830,21 @@ struct uwsgi_server {
 	// async commodity
 	struct wsgi_request **async_waiting_fd_table;
 	struct wsgi_request **async_proto_fd_table;
-	struct uwsgi_async_request *async_runqueue;
-	struct uwsgi_async_request *async_runqueue_last;
+	struct uwsgi_async_request *async_runqueue_items;
+
+	struct uwsgi_req_arena *req_arenas;
+	uint64_t req_arena_size;
 
-	struct uwsgi_rbtree *rb_async_timeouts;
+	// per-core open addressing index of the request vars (hvec positions + 1)
+	uint16_t *vars_index;
+	uint16_t vars_index_mask;
+
+	int timer_wheel;
 
 	int async_queue_unused_ptr;
 	struct wsgi_request **async_queue_unused;
+	// the stack of unused cores is shared by the --async-threads
+	pthread_mutex_t async_queue_unused_lock;
 
 
 	// store rlimit
@@ -2324,17 +2862,32 @@ struct uwsgi_server {
 	rlim_t evil_reload_on_as;
 	rlim_t evil_reload_on_rss;
 
+	// cgroup v2 memory pressure monitoring
+	int memory_pressure;
+	char *memory_pressure_cgroup;
+	int memory_pressure_high;
+	int memory_pressure_psi;
+	int memory_pressure_cooldown;
+	int memory_pressure_active;
+	uint64_t memory_pressure_seen;
+
 	struct uwsgi_string_list *reload_on_fd;
 	struct uwsgi_string_list *brutal_reload_on_fd;
 
 	struct uwsgi_string_list *touch_reload;
 	struct uwsgi_string_list *touch_chain_reload;
+	// how many workers can be reloaded at the same time by the chain
+	int chain_reload_workers;
+	// requests sent to each new worker before accepting
+	struct uwsgi_string_list *worker_warmup;
 	struct uwsgi_string_list *touch_workers_reload;
 	struct uwsgi_string_list *touch_gracefully_stop;
 	struct uwsgi_string_list *touch_logrotate;
 	struct uwsgi_string_list *touch_logreopen;
 	struct uwsgi_string_list *touch_exec;
 	struct uwsgi_string_list *touch_signal;
+	// stat() the touch-* files every cycle instead of using fsmon
+	int touch_polling;
 
 	struct uwsgi_string_list *fs_reload;
 	struct uwsgi_string_list *fs_brutal_reload;
@@ -2372,6 +2925,13 @@ struct uwsgi_server {
 	int spooler_ordered;
 	int spooler_quiet;
 	int spooler_frequency;
+	char *spooler_engine;
+	struct uwsgi_spooler_engine *spooler_engines;
+	uint64_t spooler_shm_tasks;
+	uint64_t spooler_shm_task_size;
+	uint64_t spooler_segment_size;
+	int spooler_commit_interval;
+	struct uwsgi_string_list *spooler_priority_limits;
 
 	int snmp;
 	char *snmp_addr;
@@ -2384,11 +2944,19 @@ struct uwsgi_server {
 	// removed in 2.1, here for ABI compatibility
 	uint16_t __buffer_size;
 	int signal_bufsize;
+	int signal_coalesce;
+	int core_signals;
+	// number of coalesced deliveries of the signal being handled
+	uint32_t signal_count;
 
 	// post buffering
 	size_t post_buffering;
 	int post_buffering_harakiri;
 	size_t post_buffering_bufsize;
+	int post_buffering_stream;
+	// bodies on disk: moved with splice(), temp files directory
+	int post_buffering_splice;
+	char *post_buffering_dir;
 	size_t body_read_warning;
 
 	int master_process;
@@ -2399,6 +2967,7 @@ struct uwsgi_server {
 	int vassal_sos_backlog;
 
 	int no_defer_accept;
+	int defer_accept_timeout;
 	int so_keepalive;
 	int so_send_timeout;
 	uint64_t so_sndbuf;
@@ -2424,14 +2993,22 @@ struct uwsgi_server {
 	int numproc;
 	int async;
 	int async_running;
-	int async_queue;
-	int async_nevents;
+	int async_threads;
+	// connections accepted by an async loop on a single wakeup
+	int accept_batch;
+	struct uwsgi_async_loop *async_loops;
 
 	time_t async_queue_is_full;
 
 	int max_vars;
 	int vec_size;
 
+	// rate limiters
+	struct uwsgi_string_list *ratelimits_list;
+	int dns_cache_ttl;
+	int dns_cache_size;
+	struct uwsgi_ratelimit *ratelimits;
+
 	// shared area
 	struct uwsgi_string_list *sharedareas_list;
 	int sharedareas_cnt;
@@ -2441,6 +3018,7 @@ struct uwsgi_server {
 	pthread_mutex_t thunder_mutex;
 	pthread_mutex_t six_feet_under_lock;
 	pthread_mutex_t lock_static;
+	pthread_mutex_t lock_offload_snapshots;
 
 	int use_thunder_lock;
 	struct uwsgi_lock_item *the_thunder_lock;
@@ -2455,6 +3033,10 @@ struct uwsgi_server {
 	struct uwsgi_string_list *farms_list;
 	struct uwsgi_farm *farms;
 	int mule_msg_size;
+	uint64_t mule_ring;
+	struct uwsgi_mule_ring *mule_ring_any;
+	int mule_ring_heap;
+	uint64_t mule_ring_ref_size;
 
 	pid_t mypid;
 	int mywid;
@@ -2489,6 +3071,8 @@ struct uwsgi_server {
 	struct uwsgi_route *response_routes;
 	struct uwsgi_route_condition *route_conditions;
 	struct uwsgi_route_var *route_vars;
+	uint64_t route_memo;
+	struct uwsgi_route_memo **route_memo_tables;
 #endif
 
 	struct uwsgi_string_list *error_page_403;
@@ -2544,6 +3128,8 @@ struct uwsgi_server {
 	int is_et;
 
 	struct uwsgi_string_list *map_socket;
+	struct uwsgi_string_list *socket_qos;
+	int sockets_qos;
 
 	struct uwsgi_cron *crons;
 	time_t cron_harakiri;
@@ -2618,16 +3204,27 @@ struct uwsgi_server {
 	char *stats;
 	int stats_fd;
 	int stats_http;
+	int stats_openmetrics;
+	char *stats_binary;
+	int stats_binary_fd;
 	int stats_minified;
 	struct uwsgi_string_list *requested_stats_pushers;
 	struct uwsgi_stats_pusher *stats_pushers;
 	struct uwsgi_stats_pusher_instance *stats_pusher_instances;
 	int stats_pusher_default_freq;
+	uint64_t stats_pusher_mtu;
+	int stats_pusher_changed_only;
 
 	uint64_t queue_size;
 	uint64_t queue_blocksize;
 	void *queue;
 	struct uwsgi_queue_header *queue_header;
+	uint64_t queue_ring;
+	uint64_t queue_ring_cellsize;
+	struct uwsgi_queue_ring *queue_ring_header;
+	char *queue_ring_cells;
+	struct uwsgi_queue_waiters *queue_waiters;
+	int queue_efd;
 	char *queue_store;
 	size_t queue_filesize;
 	int queue_store_sync;
@@ -2650,17 +3247,29 @@ struct uwsgi_server {
 	// rpc
 	uint64_t rpc_max;
 	struct uwsgi_rpc *rpc_table;	
+	// persistent rpc connections
+	int rpc_pool;
+	int rpc_pool_idle;
+	int rpc_session_timeout;
 
 	// subscription client
 	int subscriptions_blocked;
 	int subscribe_freq;
 	int subscription_tolerance;
+	int subscription_delta;
 	int unsubscribe_on_graceful_reload;
 	struct uwsgi_string_list *subscriptions;
 	struct uwsgi_string_list *subscriptions2;
 
 	struct uwsgi_subscribe_node *(*subscription_algo) (struct uwsgi_subscribe_slot *, struct uwsgi_subscribe_node *, struct uwsgi_subscription_client *);
 	int subscription_dotsplit;
+	// chash algo: virtual nodes per weight unit, max load (percent of the average, 0 = unbounded)
+	int subscription_chash_vnodes;
+	int subscription_chash_load;
+	int subscription_ewma_decay;
+	char *subscription_iphash_algo;
+	int subscription_outlier_errors;
+	int subscription_outlier_ejection;
 
 	int never_swap;
 
@@ -2674,9 +3283,16 @@ struct uwsgi_server {
 #ifdef UWSGI_PCRE
 	struct uwsgi_regexp_list *sni_regexp;
 #endif
-	struct uwsgi_string_list *sni;
 	char *sni_dir;
 	char *sni_dir_ciphers;
+	int sni_lazy;
+	int sni_max_contexts;
+	uint64_t *sni_generation;
+	// session tickets keys shared by all of the processes (rotated by the master)
+	int ssl_tickets_rotate;
+	char *ssl_tickets_secret;
+	struct uwsgi_ssl_tickets *ssl_tickets;
+	int ssl_ktls;
 #endif
 
 #ifdef UWSGI_SSL
@@ -2684,7 +3300,9 @@ struct uwsgi_server {
 	struct uwsgi_legion_action *legion_actions;
 	int legion_queue;
 	int legion_freq;
+	int legion_freq_ms;
 	int legion_tolerance;
+	int legion_phi_threshold;
 	int legion_skew_tolerance;
 	uint16_t legion_scroll_max_size;
 	uint64_t legion_scroll_list_max_size;
@@ -2694,19 +3312,40 @@ struct uwsgi_server {
 #ifdef __linux__
 #ifdef MADV_MERGEABLE
 	int linux_ksm;
+	char *ksm_mode_str;
+	int ksm_mode;
 	int ksm_buffer_size;
 	char *ksm_mappings_last;
 	char *ksm_mappings_current;
 	size_t ksm_mappings_last_size;
 	size_t ksm_mappings_current_size;
 #endif
+	int thp_heaps;
+	int idle_workers_cold;
+	int stats_cow;
+	int taskstats;
 #endif
+	// huge pages for the big shared memory areas
+	int shm_hugepages;
+	uint64_t workers_page_size;
 
 	struct uwsgi_buffer *websockets_ping;
 	struct uwsgi_buffer *websockets_pong;
 	int websockets_ping_freq;
 	int websockets_pong_tolerance;
 	uint64_t websockets_max_size;
+	int websockets_deflate;
+	int websockets_deflate_window_bits;
+	int websockets_deflate_mem_level;
+	int websockets_deflate_level;
+	int websockets_deflate_no_context_takeover;
+	int websockets_deflate_idle;
+	uint64_t websockets_deflate_min_size;
+	int websockets_offload;
+	uint64_t websockets_offload_ring;
+	char *websockets_offload_forward;
+	uint64_t websockets_offload_max_pending;
+	struct uwsgi_websockets_ring *websockets_ring;
 
 	int chunked_input_timeout;
 	uint64_t chunked_input_limit;
@@ -2717,6 +3356,17 @@ struct uwsgi_server {
 	char *metrics_dir;
 	int metrics_dir_restore;
 	uint64_t metrics_cnt;
+	struct uwsgi_metric **metrics_hash;
+	struct uwsgi_metric **metrics_oid_hash;
+	int64_t *metrics_shards;
+	uint64_t metrics_shards_stride;
+	int metrics_no_shards;
+	int metrics_no_histograms;
+	struct uwsgi_metric *metric_request_latency;
+	struct uwsgi_metric *metric_cache_get_latency;
+	struct uwsgi_metric *metric_router_latency;
+	int req_timing;
+	struct uwsgi_metric *metric_req_stages[UWSGI_REQ_STAGE_MAX];
 	struct uwsgi_string_list *additional_metrics;
 	struct uwsgi_string_list *metrics_threshold;
 
@@ -2781,6 +3431,12 @@ struct uwsgi_server {
 	struct uwsgi_string_list *vassal_fork_base;
 	struct uwsgi_string_list *emperor_collect_attributes;
 	char *emperor_fork_server_attr;
+	struct uwsgi_string_list *emperor_fork_templates;
+	char *emperor_use_fork_template;
+	char *emperor_fork_template_attr;
+	int emperor_spawn_concurrency;
+	int emperor_spawn_timeout;
+	char *emperor_spawn_priority_attr;
 	char *emperor_wrapper_attr;
 	int emperor_subreaper;
         struct uwsgi_string_list *hook_as_on_demand_vassal;
@@ -2803,6 +3459,10 @@ struct uwsgi_server {
 	int die_on_no_workers;
 	int spooler_cheap;
 	int cheaper_idle;
+
+	// predict cheaper algorithm
+	int cheaper_sample_ms;
+	int cheaper_predict_horizon;
 };
 
 struct uwsgi_rpc {
@@ -2813,6 +3473,31 @@ struct uwsgi_rpc {
 	struct uwsgi_plugin *plugin;
 };
 
+// a single call of uwsgi_do_rpc_multi()
+struct uwsgi_rpc_call {
+	char *node;
+	char *func;
+	uint8_t argc;
+	char **argv;
+	uint16_t *argvs;
+
+	// set by uwsgi_do_rpc_multi()
+	char *response;
+	uint64_t len;
+
+	// internal state
+	int fd;
+	int owner;
+	int reused;
+	uint32_t id;
+};
+
+// pending signals of a signal pipe (--signal-coalesce)
+struct uwsgi_signal_queue {
+	uint64_t pending[4];
+	uint32_t count[256];
+};
+
 struct uwsgi_signal_entry {
 	int wid;
 	uint8_t modifier1;
@@ -2887,6 +3572,13 @@ struct uwsgi_shared {
 	int mule_signal_pipe[2];
 	int mule_queue_pipe[2];
 
+	// wake up the master for an earlier harakiri deadline (sub-second harakiri)
+	int harakiri_pipe[2];
+	uint64_t master_wakeup;
+
+	// bumped by the master when a --static-fd-cache-watch directory changes
+	uint64_t static_fd_cache_generation;
+
 	// 256 items * (uwsgi.numproc + 1)
 	struct uwsgi_signal_entry *signal_table;
 
@@ -2920,11 +3612,19 @@ struct uwsgi_shared {
 
 	uint64_t routed_signals;
 	uint64_t unrouted_signals;
+	uint64_t coalesced_signals;
+
+	struct uwsgi_signal_queue worker_signal_queue;
+	struct uwsgi_signal_queue spooler_signal_queue;
+	struct uwsgi_signal_queue mule_signal_queue;
 
 	uint64_t busy_workers;
 	uint64_t idle_workers;
 	uint64_t overloaded;
 
+	// bumped by the master to ask the workers to free memory
+	uint64_t memory_pressure_gen;
+
 	int ready;
 };
 
@@ -2941,6 +3641,12 @@ struct uwsgi_core {
 	uint64_t read_errors;
 	uint64_t exceptions;
 
+	// share of the worker counters (folded by the master in multithread mode)
+	uint64_t delta_requests;
+	uint64_t tx;
+	uint64_t running_time;
+	uint64_t avg_response_time;
+
 	pthread_t thread_id;
 
 	int offload_rr;
@@ -2959,6 +3665,41 @@ struct uwsgi_core {
 	// uWSGI 2.1
 	time_t harakiri;
 	time_t user_harakiri;
+	// harakiri deadline in milliseconds (checked by the master)
+	uint64_t harakiri_deadline;
+
+	// request logs for the threaded logger (--req-log-ring)
+	struct uwsgi_log_ring *req_log_ring;
+
+	// --core-signals
+	int signal_pipe[2];
+	struct uwsgi_signal_queue signal_queue;
+// each core starts on its own cacheline, so threads do not dirty the counters of the others
+} __attribute__ ((aligned (64)));
+
+/*
+	single producer (a worker core) / single consumer (the threaded logger) ring
+	of request log records (a 32bit size followed by the line).
+	head and tail only grow, their difference is the used space.
+*/
+#define UWSGI_REQ_LOG_RING_POLL 10
+
+struct uwsgi_log_ring {
+	volatile uint64_t head;
+	uint64_t drops;
+	volatile uint64_t tail __attribute__ ((aligned (64)));
+	char data[] __attribute__ ((aligned (64)));
+};
+
+// kernel accounting of a worker or a mule (--taskstats), times are in microseconds
+struct uwsgi_taskstats {
+	uint64_t cpu_time;
+	uint64_t voluntary_switches;
+	uint64_t involuntary_switches;
+	uint64_t read_bytes;
+	uint64_t write_bytes;
+	uint64_t cpu_delay;
+	uint64_t blkio_delay;
 };
 
 struct uwsgi_worker {
@@ -2979,6 +3720,8 @@ struct uwsgi_worker {
 	// renamed in 2.1 (was 'user_harakiri')
 	time_t user_harakiri_unused;
 	uint64_t harakiri_count;
+	// lower bound (msec) of the harakiri deadlines of the cores, 0 if none
+	uint64_t harakiri_next;
 	int pending_harakiri;
 
 	uint64_t vsz_size;
@@ -3009,6 +3752,7 @@ struct uwsgi_worker {
 	uint64_t signals;
 
 	int signal_pipe[2];
+	struct uwsgi_signal_queue signal_queue;
 
 	uint64_t avg_response_time;
 
@@ -3017,6 +3761,13 @@ struct uwsgi_worker {
 	int accepting;
 
 	char name[0xff];
+
+	// one item per offload thread
+	struct uwsgi_offload_thread_stats *offload_stats;
+	// wakeup socketpairs of the offloaded websockets hubs (two items per offload thread)
+	int *websockets_hub_pipes;
+
+	struct uwsgi_taskstats taskstats;
 };
 
 
@@ -3025,6 +3776,7 @@ struct uwsgi_mule {
 	pid_t pid;
 
 	int signal_pipe[2];
+	struct uwsgi_signal_queue signal_queue;
 	int queue_pipe[2];
 
 	time_t last_spawn;
@@ -3044,6 +3796,30 @@ struct uwsgi_mule {
 
 	time_t cursed_at;
 	time_t no_mercy_at;
+
+	// --mule-ring
+	struct uwsgi_mule_ring *ring;
+	int ring_pipe[2];
+	// the mule is sleeping waiting for ring messages
+	int ring_waiting;
+
+	struct uwsgi_taskstats taskstats;
+};
+
+/*
+	shared memory message ring (--mule-ring)
+
+	records are a 32bit header (length, optionally with the UWSGI_MULE_RING_REF flag) followed by
+	the payload, a ref payload is the handle and the size of a sharedheap chunk.
+*/
+#define UWSGI_MULE_RING_REF 0x80000000
+struct uwsgi_mule_ring {
+	struct uwsgi_lock_item *lock;
+	uint64_t size;
+	uint64_t head;
+	uint64_t tail;
+	uint64_t full;
+	char *data;
 };
 
 struct uwsgi_mule_farm {
@@ -3056,10 +3832,12 @@ struct uwsgi_farm {
 	char name[0xff];
 
 	int signal_pipe[2];
+	struct uwsgi_signal_queue signal_queue;
 	int queue_pipe[2];
 
 	struct uwsgi_mule_farm *mules;
 
+	struct uwsgi_mule_ring *ring;
 };
 
 
@@ -3080,7 +3858,14 @@ int bind_to_udp(char *, int, int);
 int bind_to_unix_dgram(char *);
 int timed_connect(struct pollfd *, const struct sockaddr *, int, int, int);
 int uwsgi_connect(char *, int, int);
+int uwsgi_pool_connect(char *, int);
+void uwsgi_pool_release(char *, int, int);
+char *uwsgi_shard_addr(char *, size_t, char *, size_t);
 int uwsgi_connect_udp(char *);
+struct uwsgi_dgram_batch *uwsgi_dgram_batch_new(int, size_t);
+int uwsgi_dgram_batch_recv(int, struct uwsgi_dgram_batch *);
+#define uwsgi_dgram_batch_buf(udb, i) ((udb)->buf + ((i) * (udb)->size))
+int uwsgi_dgram_send_nodes(int, struct iovec *, int, struct uwsgi_string_list *);
 int uwsgi_connectn(char *, uint16_t, int, int);
 
 void daemonize(char *);
@@ -3187,6 +3972,7 @@ void *uwsgi_load_plugin(int, char *, char *);
 int unconfigured_hook(struct wsgi_request *);
 
 void uwsgi_ini_config(char *, char *[]);
+void uwsgi_ini_set_last_file(char *);
 
 #ifdef UWSGI_YAML
 void uwsgi_yaml_config(char *, char *[]);
@@ -3222,6 +4008,7 @@ int find_worker_id(pid_t);
 
 void simple_loop();
 void *simple_loop_run(void *);
+void uwsgi_worker_warmup(void);
 
 int uwsgi_count_options(struct uwsgi_option *);
 
@@ -3231,6 +4018,8 @@ struct wsgi_request *threaded_current_wsgi_req(void);
 void build_options(void);
 
 int uwsgi_postbuffer_do_in_disk(struct wsgi_request *);
+int uwsgi_postbuffer_do_stream(struct wsgi_request *);
+void uwsgi_postbuffer_stream_close(struct wsgi_request *);
 int uwsgi_postbuffer_do_in_mem(struct wsgi_request *);
 
 void uwsgi_register_loop(char *, void (*)(void));
@@ -3267,6 +4056,9 @@ int uwsgi_cache_del2(struct uwsgi_cache *, char *, uint16_t, uint64_t, uint16_t)
 char *uwsgi_cache_get2(struct uwsgi_cache *, char *, uint16_t, uint64_t *);
 char *uwsgi_cache_get3(struct uwsgi_cache *, char *, uint16_t, uint64_t *, uint64_t *);
 char *uwsgi_cache_get4(struct uwsgi_cache *, char *, uint16_t, uint64_t *, uint64_t *);
+char *uwsgi_cache_get_optimistic(struct uwsgi_cache *, char *, uint16_t, uint64_t *, uint64_t *);
+char *uwsgi_cache_snapshot(struct uwsgi_cache *, char *, uint16_t, uint64_t *, uint64_t *, uint64_t *);
+uint64_t uwsgi_cache_generation(struct uwsgi_cache *, char *, uint16_t);
 uint32_t uwsgi_cache_exists2(struct uwsgi_cache *, char *, uint16_t);
 struct uwsgi_cache *uwsgi_cache_create(char *);
 struct uwsgi_cache *uwsgi_cache_by_name(char *);
@@ -3277,6 +4069,7 @@ void uwsgi_cache_setup_nodes(struct uwsgi_cache *);
 int64_t uwsgi_cache_num2(struct uwsgi_cache *, char *, uint16_t);
 
 void uwsgi_cache_sync_all(void);
+void uwsgi_cache_flush_all(void);
 void uwsgi_cache_start_sweepers(void);
 void uwsgi_cache_start_sync_servers(void);
 
@@ -3291,6 +4084,7 @@ int event_queue_add_fd_read(int, int);
 int event_queue_add_fd_write(int, int);
 int event_queue_del_fd(int, int, int);
 int event_queue_wait(int, int, int *);
+int event_queue_wait_ms(int, int, int *);
 int event_queue_wait_multi(int, int, void *, int);
 int event_queue_interesting_fd(void *, int);
 int event_queue_interesting_fd_has_error(void *, int);
@@ -3303,6 +4097,16 @@ int event_queue_fd_write_to_readwrite(int, int);
 int event_queue_interesting_fd_is_read(void *, int);
 int event_queue_interesting_fd_is_write(void *, int);
 
+#define UWSGI_EVENT_QUEUE_READ	1
+#define UWSGI_EVENT_QUEUE_WRITE	2
+// the fd could still be ready (edge-triggered mode)
+#define UWSGI_EVENT_QUEUE_REARM	4
+// the fd is going to be closed
+#define UWSGI_EVENT_QUEUE_CLOSE	8
+int event_queue_defer(int, int);
+int event_queue_fd_interest(int, int, int);
+void event_queue_flush(int);
+
 int event_queue_add_timer(int, int *, int);
 struct uwsgi_timer *event_queue_ack_timer(int);
 
@@ -3323,6 +4127,7 @@ int uwsgi_start(void *);
 int uwsgi_register_rpc(char *, struct uwsgi_plugin *, uint8_t, void *);
 uint64_t uwsgi_rpc(char *, uint8_t, char **, uint16_t *, char **);
 char *uwsgi_do_rpc(char *, char *, uint8_t, char **, uint16_t *, uint64_t *);
+int uwsgi_do_rpc_multi(struct uwsgi_rpc_call *, int);
 void uwsgi_rpc_init(void);
 
 char *uwsgi_cheap_string(char *, int);
@@ -3355,6 +4160,8 @@ int is_unix(char *, int);
 int is_a_number(char *);
 
 char *uwsgi_resolve_ip(char *);
+void uwsgi_dns_cache_init(void);
+void uwsgi_dns_cache_pin(char *);
 
 void uwsgi_init_queue(void);
 char *uwsgi_queue_get(uint64_t, uint64_t *);
@@ -3362,6 +4169,9 @@ char *uwsgi_queue_pull(uint64_t *);
 int uwsgi_queue_push(char *, uint64_t);
 char *uwsgi_queue_pop(uint64_t *);
 int uwsgi_queue_set(uint64_t, char *, uint64_t);
+int uwsgi_queue_ring_push(char *, uint64_t);
+char *uwsgi_queue_ring_pull(uint64_t *);
+char *uwsgi_queue_pull_wait(uint64_t *, int, int);
 
 
 struct uwsgi_subscribe_req {
@@ -3430,13 +4240,33 @@ int uwsgi_list_has_str(char *, char *);
 
 void uwsgi_cache_fix(struct uwsgi_cache *);
 
+// one for each core (indexed by async_id), so the runqueue never allocates
 struct uwsgi_async_request {
 
 	struct wsgi_request *wsgi_req;
 	struct uwsgi_async_request *prev;
 	struct uwsgi_async_request *next;
+	int queued;
+	// the core must be given back when leaving the runqueue
+	int release;
+};
+
+// the state of the async loop of a thread
+struct uwsgi_async_loop {
+	int id;
+	int queue;
+	int nevents;
+	struct uwsgi_async_request *runqueue;
+	struct uwsgi_async_request *runqueue_last;
+	struct uwsgi_rbtree *timeouts;
+	struct wsgi_request *wsgi_req;
+	// read by the other threads for choosing the one accepting a connection
+	volatile int running;
+	volatile int polling;
 };
 
+struct uwsgi_async_loop *uwsgi_async_loop_get(void);
+
 int event_queue_read(void);
 int event_queue_write(void);
 
@@ -3464,6 +4294,9 @@ char *uwsgi_amqp_consume(int, uint64_t *, char **);
 int uwsgi_file_serve(struct wsgi_request *, char *, uint16_t, char *, uint16_t, int);
 int uwsgi_starts_with(char *, int, char *, int);
 int uwsgi_static_want_gzip(struct wsgi_request *, char *, size_t *, struct stat *);
+char *uwsgi_static_want_encoding(struct wsgi_request *, char *, size_t *, struct stat *, size_t *);
+int uwsgi_accept_encoding_q(char *, uint16_t, char *, size_t);
+void uwsgi_static_compression_setup(void);
 
 #ifdef __sun__
 time_t timegm(struct tm *);
@@ -3474,6 +4307,7 @@ size_t uwsgi_str_occurence(char *, size_t, char);
 
 int uwsgi_proto_base_write(struct wsgi_request *, char *, size_t);
 int uwsgi_proto_base_writev(struct wsgi_request *, struct iovec *, size_t *);
+int uwsgi_proto_framed_writev(struct wsgi_request *, struct iovec *, size_t *, size_t, void (*)(struct wsgi_request *, char *, size_t));
 #ifdef UWSGI_SSL
 int uwsgi_proto_ssl_write(struct wsgi_request *, char *, size_t);
 #endif
@@ -3487,6 +4321,9 @@ ssize_t uwsgi_proto_ssl_read_body(struct wsgi_request *, char *, size_t);
 
 int uwsgi_proto_base_accept(struct wsgi_request *, int);
 void uwsgi_proto_base_close(struct wsgi_request *);
+int uwsgi_proto_handoff_accept(struct wsgi_request *, int);
+ssize_t uwsgi_proto_handoff_read(struct wsgi_request *, char *, size_t);
+ssize_t uwsgi_proto_handoff_read_body(struct wsgi_request *, char *, size_t);
 #ifdef UWSGI_SSL
 int uwsgi_proto_ssl_accept(struct wsgi_request *, int);
 void uwsgi_proto_ssl_close(struct wsgi_request *);
@@ -3500,6 +4337,8 @@ void uwsgi_proto_puwsgi_setup(struct uwsgi_socket *);
 void uwsgi_proto_raw_setup(struct uwsgi_socket *);
 void uwsgi_proto_http_setup(struct uwsgi_socket *);
 void uwsgi_proto_http11_setup(struct uwsgi_socket *);
+void uwsgi_proto_uwsgi_handoff_setup(struct uwsgi_socket *);
+void uwsgi_proto_http_handoff_setup(struct uwsgi_socket *);
 #ifdef UWSGI_SSL
 void uwsgi_proto_https_setup(struct uwsgi_socket *);
 void uwsgi_proto_suwsgi_setup(struct uwsgi_socket *);
@@ -3542,13 +4381,16 @@ struct uwsgi_regexp_list *uwsgi_regexp_custom_new_list(struct uwsgi_regexp_list
 void uwsgi_string_del_list(struct uwsgi_string_list **, struct uwsgi_string_list *);
 
 void uwsgi_init_all_apps(void);
+void uwsgi_log_startup_stage(const char *, char *, uint64_t);
 void uwsgi_init_worker_mount_apps(void);
 void uwsgi_socket_nb(int);
+void uwsgi_socket_busy_poll(int);
 void uwsgi_socket_b(int);
 int uwsgi_write_nb(int, char *, size_t, int);
 int uwsgi_read_nb(int, char *, size_t, int);
 ssize_t uwsgi_read_true_nb(int, char *, size_t, int);
 int uwsgi_read_whole_true_nb(int, char *, size_t, int);
+int uwsgi_read_lines_true_nb(int, int, int);
 int uwsgi_read_uh(int fd, struct uwsgi_header *, int);
 int uwsgi_proxy_nb(struct wsgi_request *, char *, struct uwsgi_buffer *, size_t, int);
 
@@ -3645,12 +4487,13 @@ struct uwsgi_farm *get_farm_by_name(char *);
 struct uwsgi_subscription_client {
 	int fd;
 	union uwsgi_sockaddr *sockaddr;
+	// affinity key (uri, header...) used by the chash algo
 	char *cookie;
+	uint16_t cookie_len;
 };
 
 struct uwsgi_subscribe_node {
 
-	char name[0xff];
 	uint16_t len;
 	uint8_t modifier1;
 	uint8_t modifier2;
@@ -3691,11 +4534,22 @@ struct uwsgi_subscribe_node {
 	uint64_t backup_level;
 	//here the solution is a bit hacky, we take the first letter of the proto ('u','\0' -> uwsgi, 'h' -> http, 'f' -> fastcgi, 's' -> scgi)
 	char proto;
+
+	// peak-ewma of the backend time to first byte (usecs), fed by the routers
+	double latency;
+	uint64_t latency_stamp;
+
+	// outlier detection: consecutive errors, number of ejections and end of the current ejection (0 = not ejected)
+	uint64_t errors;
+	uint64_t ejections;
+	time_t ejected_until;
+
+	// allocated with the node (len bytes + a terminating zero)
+	char name[];
 };
 
 struct uwsgi_subscribe_slot {
 
-	char key[0xff];
 	uint16_t keylen;
 
 	uint32_t hash;
@@ -3716,18 +4570,37 @@ struct uwsgi_subscribe_slot {
 	// uWSGI 2.1 (algo is required)
         struct uwsgi_subscribe_node *(*algo) (struct uwsgi_subscribe_slot *, struct uwsgi_subscribe_node *, struct uwsgi_subscription_client *);
 
+	// hash ring of the chash algo (built lazily)
+	struct uwsgi_subscribe_chash *chash;
+
+	// allocated with the slot (keylen bytes + a terminating zero)
+	char key[];
 };
 
-void mule_send_msg(int, char *, size_t);
+// power of two sized, doubled when the number of slots exceeds the number of buckets
+struct uwsgi_subscribe_table {
+	struct uwsgi_subscribe_slot **buckets;
+	uint64_t size;
+	uint64_t count;
+};
+
+int mule_send_msg(int, char *, size_t);
+int uwsgi_mule_ring_push(int, struct uwsgi_farm *, char *, size_t);
+int uwsgi_mule_get_msgs(int, int, char **, size_t *, int, int);
 
 uint32_t djb33x_hash(char *, uint64_t);
+uint32_t uwsgi_jump_hash(uint64_t, uint32_t);
 void create_signal_pipe(int *);
 void create_msg_pipe(int *, int);
-struct uwsgi_subscribe_slot *uwsgi_get_subscribe_slot(struct uwsgi_subscribe_slot **, char *, uint16_t);
-struct uwsgi_subscribe_node *uwsgi_get_subscribe_node_by_name(struct uwsgi_subscribe_slot **, char *, uint16_t, char *, uint16_t);
-struct uwsgi_subscribe_node *uwsgi_get_subscribe_node(struct uwsgi_subscribe_slot **, char *, uint16_t, struct uwsgi_subscription_client *);
-int uwsgi_remove_subscribe_node(struct uwsgi_subscribe_slot **, struct uwsgi_subscribe_node *);
-struct uwsgi_subscribe_node *uwsgi_add_subscribe_node(struct uwsgi_subscribe_slot **, struct uwsgi_subscribe_req *);
+struct uwsgi_subscribe_slot *uwsgi_get_subscribe_slot(struct uwsgi_subscribe_table *, char *, uint16_t);
+struct uwsgi_subscribe_node *uwsgi_get_subscribe_node_by_name(struct uwsgi_subscribe_table *, char *, uint16_t, char *, uint16_t);
+struct uwsgi_subscribe_node *uwsgi_get_subscribe_node(struct uwsgi_subscribe_table *, char *, uint16_t, struct uwsgi_subscription_client *);
+int uwsgi_remove_subscribe_node(struct uwsgi_subscribe_table *, struct uwsgi_subscribe_node *);
+struct uwsgi_subscribe_node *uwsgi_add_subscribe_node(struct uwsgi_subscribe_table *, struct uwsgi_subscribe_req *);
+struct uwsgi_subscribe_node *uwsgi_refresh_subscribe_node(struct uwsgi_subscribe_table *, struct uwsgi_subscribe_req *);
+struct uwsgi_buffer *uwsgi_subscription_snapshot(struct uwsgi_subscribe_table *);
+void uwsgi_subscription_node_latency(struct uwsgi_subscribe_node *, uint64_t);
+void uwsgi_subscription_node_outcome(struct uwsgi_subscribe_node *, int);
 
 ssize_t uwsgi_mule_get_msg(int, int, char *, size_t, int);
 
@@ -3738,6 +4611,9 @@ int uwsgi_remote_signal_send(char *, uint8_t);
 
 void uwsgi_configure();
 
+int uwsgi_config_cache_replay(char *, char *, struct uwsgi_config_cache **);
+void uwsgi_config_cache_store(struct uwsgi_config_cache *);
+
 int uwsgi_read_response(int, struct uwsgi_header *, int, char **);
 char *uwsgi_simple_file_read(char *);
 
@@ -3753,8 +4629,17 @@ int uwsgi_long2str2n(unsigned long long, char *, int);
 #ifdef __linux__
 void uwsgi_build_unshare(char *, int *);
 #ifdef MADV_MERGEABLE
+#define UWSGI_KSM_ALL 0
+#define UWSGI_KSM_ANON 1
+#define UWSGI_KSM_PROCESS 2
 void uwsgi_linux_ksm_map(void);
 #endif
+void uwsgi_linux_thp_heaps(void);
+int64_t uwsgi_linux_process_madvise_heaps(pid_t, int);
+struct uwsgi_buffer *uwsgi_linux_proc_read(char *);
+int uwsgi_linux_smaps_rollup(pid_t, uint64_t *, uint64_t *);
+void uwsgi_master_check_idle_workers_memory(void);
+void uwsgi_master_taskstats(void);
 #endif
 
 #ifdef UWSGI_CAP
@@ -3763,6 +4648,7 @@ void uwsgi_apply_cap(cap_value_t *, int);
 #endif
 
 void uwsgi_register_logger(char *, ssize_t(*func) (struct uwsgi_logger *, char *, size_t));
+void uwsgi_register_dgram_logger(char *, ssize_t(*func) (struct uwsgi_logger *, char *, size_t));
 void uwsgi_append_logger(struct uwsgi_logger *);
 void uwsgi_append_req_logger(struct uwsgi_logger *);
 struct uwsgi_logger *uwsgi_get_logger(char *);
@@ -3779,12 +4665,19 @@ void escape_json(char *, size_t, char *);
 
 void *uwsgi_malloc_shared(size_t);
 void *uwsgi_calloc_shared(size_t);
+void *uwsgi_mmap_shared(size_t, uint64_t *);
+uint64_t uwsgi_fd_page_size(int);
+uint64_t uwsgi_path_page_size(char *);
+uint64_t uwsgi_hugepage_size(void);
 
 struct uwsgi_spooler *uwsgi_new_spooler(char *);
 
 struct uwsgi_spooler *uwsgi_get_spooler_by_name(char *, size_t);
 
 int uwsgi_zerg_attach(char *);
+void uwsgi_zerg_report_add(int);
+void uwsgi_zerg_report_sync(void);
+void uwsgi_setup_zerg_report(void);
 
 int uwsgi_manage_opt(char *, char *);
 
@@ -3814,6 +4707,7 @@ void uwsgi_opt_gid(char *, char *, void *);
 void uwsgi_opt_set_rawint(char *, char *, void *);
 void uwsgi_opt_set_16bit(char *, char *, void *);
 void uwsgi_opt_set_64bit(char *, char *, void *);
+void uwsgi_opt_set_shm_hugepages(char *, char *, void *);
 void uwsgi_opt_set_megabytes(char *, char *, void *);
 void uwsgi_opt_set_dyn(char *, char *, void *);
 void uwsgi_opt_set_placeholder(char *, char *, void *);
@@ -3835,8 +4729,9 @@ void uwsgi_opt_safe_fd(char *, char *, void *);
 void uwsgi_opt_add_legion_cron(char *, char *, void *);
 void uwsgi_opt_add_unique_legion_cron(char *, char *, void *);
 void uwsgi_opt_sni(char *, char *, void *);
-struct uwsgi_string_list *uwsgi_ssl_add_sni_item(char *, char *, char *, char *, char *);
+SSL_CTX *uwsgi_ssl_add_sni_item(char *, char *, char *, char *, char *);
 void uwsgi_ssl_del_sni_item(char *, uint16_t);
+void uwsgi_ssl_sni_reload();
 char *uwsgi_write_pem_to_file(char *, char *, size_t, char *);
 #endif
 void uwsgi_opt_flock(char *, char *, void *);
@@ -3921,6 +4816,7 @@ void uwsgi_opt_set_unshare(char *, char *, void *);
 #endif
 
 int uwsgi_tmpfd();
+int uwsgi_tmpfd_in(char *);
 FILE *uwsgi_tmpfile();
 
 #ifdef UWSGI_ROUTING
@@ -3934,6 +4830,7 @@ int uwsgi_apply_routes_do(struct uwsgi_route *, struct wsgi_request *, char *, u
 void uwsgi_register_embedded_routers(void);
 void uwsgi_routing_dump();
 struct uwsgi_buffer *uwsgi_routing_translate(struct wsgi_request *, struct uwsgi_route *, char *, uint16_t, char *, size_t);
+struct uwsgi_buffer *uwsgi_routing_expand(struct wsgi_request *, struct uwsgi_route *, char *, uint16_t, char *, size_t);
 int uwsgi_route_api_func(struct wsgi_request *, char *, char *);
 struct uwsgi_route_condition *uwsgi_register_route_condition(char *, int (*) (struct wsgi_request *, struct uwsgi_route *));
 void uwsgi_fixup_routes(struct uwsgi_route *);
@@ -3949,6 +4846,7 @@ void uwsgi_check_logrotate(void);
 char *uwsgi_check_touches(struct uwsgi_string_list *);
 
 void uwsgi_manage_zerg(int, int, int *);
+int uwsgi_send_zerg(int, int, int *);
 
 time_t uwsgi_now(void);
 
@@ -3958,6 +4856,8 @@ int uwsgi_cheaper_algo_spare2(int);
 int uwsgi_cheaper_algo_backlog(int);
 int uwsgi_cheaper_algo_backlog2(int);
 int uwsgi_cheaper_algo_manual(int);
+int uwsgi_cheaper_algo_predict(int);
+uint64_t uwsgi_master_sample_listen_queue(void);
 
 int uwsgi_master_log(void);
 int uwsgi_master_req_log(void);
@@ -3988,8 +4888,15 @@ int uwsgi_socket_is_already_bound(char *name);
 
 char *uwsgi_expand_path(char *, int, char *);
 int uwsgi_try_autoload(char *);
+int uwsgi_lazy_plugin_option(char *);
+int uwsgi_lazy_plugin_load(char *);
 
 uint64_t uwsgi_micros(void);
+uint64_t uwsgi_micros_monotonic(void);
+int uwsgi_wait_write_req_do(struct wsgi_request *);
+void uwsgi_req_timing_start(struct wsgi_request *);
+void uwsgi_req_stage(struct wsgi_request *, int);
+void uwsgi_req_timing_end(struct wsgi_request *);
 int uwsgi_is_file(char *);
 int uwsgi_is_file2(char *, struct stat *);
 int uwsgi_is_dir(char *);
@@ -4032,14 +4939,56 @@ struct uwsgi_stats_pusher_instance {
 	int retry_delay;
 	time_t next_retry;
 
+	// last pushed values (--stats-pusher-changed-only), indexed by the metric position
+	int64_t *last_values;
+	int last_values_count;
+
 	struct uwsgi_stats_pusher_instance *next;
 };
 
+#define UWSGI_STATS_PUSHER_MMSG 64
+
+// coalesce metric lines in datagrams up to uwsgi.stats_pusher_mtu and send them with sendmmsg()
+struct uwsgi_stats_pusher_dgram {
+	int fd;
+	struct sockaddr *addr;
+	socklen_t addr_len;
+	struct uwsgi_buffer *ub;
+	// end of each closed packet in ub
+	size_t ends[UWSGI_STATS_PUSHER_MMSG];
+	int packets;
+	size_t packet_start;
+};
+
+struct uwsgi_stats_pusher_dgram *uwsgi_stats_pusher_dgram_new(int, struct sockaddr *, socklen_t);
+int uwsgi_stats_pusher_dgram_add(struct uwsgi_stats_pusher_dgram *, char *, size_t);
+void uwsgi_stats_pusher_dgram_flush(struct uwsgi_stats_pusher_dgram *);
+int uwsgi_stats_pusher_changed(struct uwsgi_stats_pusher_instance *, int, int64_t);
+
 struct uwsgi_thread;
 void uwsgi_stats_pusher_loop(struct uwsgi_thread *);
 
 void uwsgi_stats_pusher_setup(void);
 void uwsgi_send_stats(int, struct uwsgi_stats *(*func) (void));
+void uwsgi_send_stats_binary(int);
+
+/*
+	an OpenMetrics section: the collector appends families and samples to a compact binary snapshot,
+	the text is rendered again only when the snapshot differs from the previous one
+*/
+struct uwsgi_openmetrics_section {
+	int (*collect)(struct uwsgi_buffer *, void *);
+	void *data;
+	struct uwsgi_buffer *raw;
+	struct uwsgi_buffer *next_raw;
+	struct uwsgi_buffer *text;
+};
+
+int uwsgi_openmetrics_family(struct uwsgi_buffer *, char *, char *, char *);
+int uwsgi_openmetrics_sample(struct uwsgi_buffer *, char *, int64_t, int, ...);
+int uwsgi_openmetrics_section_render(struct uwsgi_openmetrics_section *, struct uwsgi_buffer *);
+struct uwsgi_buffer *uwsgi_openmetrics_master(void);
+int uwsgi_stats_send_buffer(int, struct uwsgi_buffer *);
 struct uwsgi_stats *uwsgi_master_generate_stats(void);
 struct uwsgi_stats_pusher * uwsgi_register_stats_pusher(char *, void (*)(struct uwsgi_stats_pusher_instance *, time_t, char *, size_t));
 
@@ -4059,6 +5008,9 @@ int uwsgi_stats_keyvaln_comma(struct uwsgi_stats *, char *, char *, int);
 int uwsgi_stats_key(struct uwsgi_stats *, char *);
 int uwsgi_stats_keylong(struct uwsgi_stats *, char *, unsigned long long);
 int uwsgi_stats_keylong_comma(struct uwsgi_stats *, char *, unsigned long long);
+#ifdef __linux__
+int uwsgi_stats_taskstats(struct uwsgi_stats *, struct uwsgi_taskstats *);
+#endif
 int uwsgi_stats_keyslong(struct uwsgi_stats *, char *, long long);
 int uwsgi_stats_keyslong_comma(struct uwsgi_stats *, char *, long long);
 int uwsgi_stats_str(struct uwsgi_stats *, char *);
@@ -4088,7 +5040,21 @@ void uwsgi_setup_inherited_sockets();
 void uwsgi_setup_emperor();
 
 #ifdef UWSGI_SSL
+struct uwsgi_ssl_ticket_key {
+	unsigned char name[16];
+	unsigned char aes_key[32];
+	unsigned char hmac_key[32];
+	uint64_t period;
+};
+
+// a ring of four keys (two previous periods, the current and the next one), the master writes only the oldest one
+struct uwsgi_ssl_tickets {
+	uint64_t period;
+	struct uwsgi_ssl_ticket_key keys[4];
+};
+
 void uwsgi_ssl_init(void);
+void uwsgi_ssl_tickets_rotate(void);
 SSL_CTX *uwsgi_ssl_new_server_context(char *, char *, char *, char *, char *);
 char *uwsgi_rsa_sign(char *, char *, size_t, unsigned int *);
 char *uwsgi_sanitize_cert_filename(char *, char *, uint16_t);
@@ -4102,7 +5068,7 @@ char *uwsgi_md5(char *, size_t, char *);
 
 void uwsgi_opt_ssa(char *, char *, void *);
 
-int uwsgi_no_subscriptions(struct uwsgi_subscribe_slot **);
+int uwsgi_no_subscriptions(struct uwsgi_subscribe_table *);
 void uwsgi_deadlock_check(pid_t);
 
 
@@ -4116,10 +5082,12 @@ struct uwsgi_logchunk {
 	int type;
 	int free;
 	ssize_t(*func) (struct wsgi_request *, char **);
+	int (*append) (struct wsgi_request *, struct uwsgi_buffer *);
 	struct uwsgi_logchunk *next;
 };
 
 void uwsgi_build_log_format(char *);
+void uwsgi_setup_log_format(void);
 
 void uwsgi_add_logchunk(int, int, char *, size_t);
 struct uwsgi_logchunk *uwsgi_register_logchunk(char *, ssize_t (*)(struct wsgi_request *, char **), int);
@@ -4139,6 +5107,9 @@ struct uwsgi_emperor_scanner {
 	void (*event_func) (struct uwsgi_emperor_scanner *);
 	struct uwsgi_imperial_monitor *monitor;
 	struct uwsgi_emperor_scanner *next;
+	// filesystem events monitoring (--emperor-fsmon)
+	time_t last_scan;
+	struct uwsgi_string_list *watched_dirs;
 };
 
 void uwsgi_register_imperial_monitor(char *, void (*)(struct uwsgi_emperor_scanner *), void (*)(struct uwsgi_emperor_scanner *));
@@ -4195,6 +5166,24 @@ struct uwsgi_instance {
 
 	// uWSGI 2.1 (vassal's attributes)
 	struct uwsgi_dyn_dict *attrs;
+
+	// emperor indexes (name and pid hash chains) and housekeeping timer
+	struct uwsgi_instance *name_next;
+	struct uwsgi_instance *pid_next;
+	struct uwsgi_rb_timer *timer;
+
+	// spawn scheduler
+	int spawn_priority;
+	int spawn_pending;
+	int spawning;
+	time_t spawned_at;
+	struct uwsgi_instance *spawn_prev;
+	struct uwsgi_instance *spawn_next;
+
+	// on-demand activity (active minutes per hour of the day)
+	time_t last_activity;
+	uint16_t activity_hist[24];
+	uint32_t activity_day[24];
 };
 
 struct uwsgi_instance *emperor_get_by_fd(int);
@@ -4230,8 +5219,19 @@ void uwsgi_setup_mules_and_farms(void);
 
 void uwsgi_setup_workers(void);
 void uwsgi_map_sockets(void);
+void uwsgi_setup_socket_qos(void);
+int uwsgi_socket_qos_fd(struct wsgi_request *, int);
+int uwsgi_socket_shed(struct wsgi_request *);
+void uwsgi_update_listen_queue(struct uwsgi_socket *);
+void uwsgi_setup_socket_shards(void);
+void uwsgi_attach_socket_shards(void);
 
 void uwsgi_set_cpu_affinity(void);
+void uwsgi_numa_setup(void);
+void uwsgi_numa_mbind(void *, size_t);
+void uwsgi_numa_alloc_for_worker(int);
+int uwsgi_numa_worker_cpu(int);
+void uwsgi_numa_worker(void);
 
 void uwsgi_emperor_start(void);
 
@@ -4243,6 +5243,9 @@ int uwsgi_buffer_append(struct uwsgi_buffer *, char *, size_t);
 int uwsgi_buffer_fix(struct uwsgi_buffer *, size_t);
 int uwsgi_buffer_ensure(struct uwsgi_buffer *, size_t);
 void uwsgi_buffer_destroy(struct uwsgi_buffer *);
+struct uwsgi_buffer *uwsgi_buffer_get(size_t);
+void uwsgi_buffer_put(struct uwsgi_buffer *);
+void uwsgi_buffer_reset(struct uwsgi_buffer *);
 int uwsgi_buffer_u8(struct uwsgi_buffer *, uint8_t);
 int uwsgi_buffer_byte(struct uwsgi_buffer *, char);
 int uwsgi_buffer_u16le(struct uwsgi_buffer *, uint16_t);
@@ -4274,6 +5277,7 @@ struct uwsgi_buffer *uwsgi_buffer_from_file(char *);
 ssize_t uwsgi_buffer_write_simple(struct wsgi_request *, struct uwsgi_buffer *);
 
 struct uwsgi_buffer *uwsgi_to_http(struct wsgi_request *, char *, uint16_t, char *, uint16_t);
+struct uwsgi_buffer *uwsgi_to_http2(struct wsgi_request *, char *, uint16_t, char *, uint16_t, int);
 struct uwsgi_buffer *uwsgi_to_http_dumb(struct wsgi_request *, char *, uint16_t, char *, uint16_t);
 
 ssize_t uwsgi_pipe(int, int, int);
@@ -4317,6 +5321,12 @@ struct uwsgi_thread {
 	struct uwsgi_offload_request *offload_requests_head;
 	struct uwsgi_offload_request *offload_requests_tail;
 	void (*func) (struct uwsgi_thread *);
+	// offload threads only
+	struct uwsgi_offload_request **offload_requests_by_fd;
+	int offload_max_fd;
+	void *offload_hub;
+	// idle keepalive connections to http upstreams
+	struct uwsgi_offload_upstream *offload_upstreams;
 };
 struct uwsgi_thread *uwsgi_thread_new(void (*)(struct uwsgi_thread *));
 struct uwsgi_thread *uwsgi_thread_new_with_data(void (*)(struct uwsgi_thread *), void *data);
@@ -4380,6 +5390,14 @@ struct uwsgi_offload_request {
 	void (*free)(struct uwsgi_offload_request *);
 };
 
+// an idle http upstream connection, owned by a single offload thread
+struct uwsgi_offload_upstream {
+	char *name;
+	int fd;
+	uint64_t last_used;
+	struct uwsgi_offload_upstream *next;
+};
+
 struct uwsgi_offload_engine {
 	char *name;
 	int (*prepare_func)(struct wsgi_request *, struct uwsgi_offload_request *);
@@ -4391,21 +5409,57 @@ struct uwsgi_offload_engine *uwsgi_offload_engine_by_name(char *);
 struct uwsgi_offload_engine *uwsgi_offload_register_engine(char *, int (*)(struct wsgi_request *, struct uwsgi_offload_request *), int (*) (struct uwsgi_thread *, struct uwsgi_offload_request *, int));
 
 void uwsgi_offload_setup(struct uwsgi_offload_engine *, struct uwsgi_offload_request *, struct wsgi_request *, uint8_t);
+void uwsgi_offload_append(struct uwsgi_thread *, struct uwsgi_offload_request *);
+void uwsgi_offload_close(struct uwsgi_thread *, struct uwsgi_offload_request *);
 int uwsgi_offload_run(struct wsgi_request *, struct uwsgi_offload_request *, int *);
 void uwsgi_offload_engines_register_all(void);
 
-struct uwsgi_thread *uwsgi_offload_thread_start(void);
+struct uwsgi_offload_thread_stats {
+	// tasks currently managed by the thread (used for dispatching)
+	uint64_t active;
+	uint64_t tasks;
+	uint64_t bytes;
+// updated by different threads
+} __attribute__ ((aligned (64)));
+
+// a refcounted copy of a cache item or of a sharedarea range
+struct uwsgi_offload_snapshot {
+	// the cache (or the sharedarea)
+	void *source;
+	char *key;
+	uint16_t keylen;
+	uint64_t pos;
+	uint64_t range;
+	// seqlock counter of the cache slot or the sharedarea updates counter
+	uint64_t generation;
+	uint64_t expires;
+	char *buf;
+	uint64_t len;
+	int refcnt;
+};
+
+struct uwsgi_thread *uwsgi_offload_thread_start(struct uwsgi_offload_thread_stats *);
 int uwsgi_offload_request_sendfile_do(struct wsgi_request *, int, size_t);
+int uwsgi_offload_request_sendfile_range_do(struct wsgi_request *, int, size_t, size_t);
+struct uwsgi_byteranges;
+int uwsgi_offload_request_byteranges_do(struct wsgi_request *, int, struct uwsgi_byteranges *);
+int uwsgi_offload_request_body_do(struct wsgi_request *, int);
 int uwsgi_offload_request_net_do(struct wsgi_request *, char *, struct uwsgi_buffer *);
+int uwsgi_offload_request_http_do(struct wsgi_request *, char *, struct uwsgi_buffer *);
 int uwsgi_offload_request_memory_do(struct wsgi_request *, char *, size_t);
 int uwsgi_offload_request_pipe_do(struct wsgi_request *, int, size_t);
+int uwsgi_offload_request_snapshot_do(struct wsgi_request *, struct uwsgi_offload_snapshot *);
+
+struct uwsgi_offload_snapshot *uwsgi_offload_snapshot_cache(struct uwsgi_cache *, char *, uint16_t);
+struct uwsgi_offload_snapshot *uwsgi_offload_snapshot_sharedarea(int, uint64_t, uint64_t);
+void uwsgi_offload_snapshot_release(struct uwsgi_offload_snapshot *);
 
 int uwsgi_simple_sendfile(struct wsgi_request *, int, size_t, size_t);
 int uwsgi_simple_write(struct wsgi_request *, char *, size_t);
 
 
 void uwsgi_subscription_set_algo(char *);
-struct uwsgi_subscribe_slot **uwsgi_subscription_init_ht(void);
+struct uwsgi_subscribe_table *uwsgi_subscription_init_ht(void);
 
 int uwsgi_check_pidfile(char *);
 void uwsgi_daemons_spawn_all();
@@ -4419,6 +5473,7 @@ void uwsgi_loop_cores_run(void *(*)(void *));
 
 int uwsgi_kvlist_parse(char *, size_t, char, char, ...);
 int uwsgi_send_http_stats(int);
+int uwsgi_send_http_stats2(int, int *);
 
 ssize_t uwsgi_simple_request_read(struct wsgi_request *, char *, size_t);
 int uwsgi_plugin_modifier1(char *);
@@ -4468,6 +5523,10 @@ char *uwsgi_legion_lord_scroll(char *, uint16_t *);
 void uwsgi_additional_header_add(struct wsgi_request *, char *, uint16_t);
 void uwsgi_remove_header(struct wsgi_request *, char *, uint16_t);
 
+void *uwsgi_req_malloc(struct wsgi_request *, size_t);
+char *uwsgi_req_strndup(struct wsgi_request *, char *, size_t);
+void uwsgi_req_arena_reset(struct wsgi_request *);
+
 void uwsgi_proto_hooks_setup(void);
 
 char *uwsgi_base64_decode(char *, size_t, size_t *);
@@ -4479,10 +5538,28 @@ void uwsgi_subscribe_all(uint8_t, int);
 void uwsgi_websockets_init(void);
 int uwsgi_websocket_send(struct wsgi_request *, char *, size_t);
 int uwsgi_websocket_send_binary(struct wsgi_request *, char *, size_t);
+int uwsgi_websocket_send_many(struct wsgi_request *, struct iovec *, size_t, int);
+
+// offloaded websockets (--websockets-offload)
+struct uwsgi_websockets_ring {
+	struct uwsgi_lock_item *lock;
+	uint64_t size;
+	// absolute offset of the next record
+	uint64_t head;
+	char *data;
+};
+void uwsgi_websockets_hub_setup(void);
+int64_t uwsgi_websocket_offload(struct wsgi_request *, char *, uint16_t);
+int uwsgi_websocket_publish(char *, uint16_t, char *, size_t, int);
+int uwsgi_websocket_offload_prepare(struct wsgi_request *, struct uwsgi_offload_request *);
+int uwsgi_websocket_offload_do(struct uwsgi_thread *, struct uwsgi_offload_request *, int);
+int uwsgi_websockets_hub_event(struct uwsgi_thread *, int);
+void uwsgi_websockets_hub_tick(struct uwsgi_thread *);
 struct uwsgi_buffer *uwsgi_websocket_recv(struct wsgi_request *);
 struct uwsgi_buffer *uwsgi_websocket_recv_nb(struct wsgi_request *);
 
 char *uwsgi_chunked_read(struct wsgi_request *, size_t *, int, int);
+ssize_t uwsgi_chunked_read_into(struct wsgi_request *, char *, size_t, int, int);
 
 uint16_t uwsgi_be16(char *);
 uint32_t uwsgi_be32(char *);
@@ -4506,12 +5583,15 @@ int uwsgi_simple_wait_read2_hook(int, int, int, int *);
 int uwsgi_simple_wait_milliseconds_hook(int);
 int uwsgi_response_write_headers_do(struct wsgi_request *);
 char *uwsgi_request_body_read(struct wsgi_request *, ssize_t , ssize_t *);
+ssize_t uwsgi_request_body_read_nb(struct wsgi_request *, char *, size_t);
 char *uwsgi_request_body_readline(struct wsgi_request *, ssize_t, ssize_t *);
 void uwsgi_request_body_seek(struct wsgi_request *, off_t);
 
 struct uwsgi_buffer *uwsgi_proto_base_prepare_headers(struct wsgi_request *, char *, uint16_t);
 struct uwsgi_buffer *uwsgi_proto_base_cgi_prepare_headers(struct wsgi_request *, char *, uint16_t);
 int uwsgi_response_write_body_do(struct wsgi_request *, char *, size_t);
+// vectors sent by plugins in a single uwsgi_response_writev_body_do() call (more are allowed)
+#define UWSGI_RESPONSE_IOV 64
 int uwsgi_response_writev_body_do(struct wsgi_request *, struct iovec *, size_t);
 
 int uwsgi_proto_base_sendfile(struct wsgi_request *, int, size_t, size_t);
@@ -4523,6 +5603,42 @@ ssize_t uwsgi_sendfile_do(int, int, size_t, size_t);
 int uwsgi_proto_base_fix_headers(struct wsgi_request *);
 int uwsgi_response_add_content_length(struct wsgi_request *, uint64_t);
 int uwsgi_response_add_content_range(struct wsgi_request *, uint64_t, uint64_t, uint64_t);
+
+struct uwsgi_header_template *uwsgi_header_template_get(char *, size_t);
+int uwsgi_response_add_header_template(struct wsgi_request *, struct uwsgi_header_template *);
+void uwsgi_header_templates_setup(void);
+
+// more ranges are ignored (the whole resource is sent)
+#define UWSGI_MAX_RANGES 16
+
+struct uwsgi_http_range {
+	uint64_t from;
+	uint64_t to;
+};
+int uwsgi_parse_http_ranges(char *, uint16_t, uint64_t, struct uwsgi_http_range *, int);
+
+// a multipart/byteranges body, part headers and the closing boundary are stored in ub
+struct uwsgi_byterange_part {
+	uint64_t hdr_pos;
+	uint64_t hdr_len;
+	uint64_t pos;
+	uint64_t len;
+};
+
+struct uwsgi_byteranges {
+	char boundary[17];
+	struct uwsgi_buffer *ub;
+	// the last one is the closing boundary (with no data)
+	int n;
+	struct uwsgi_byterange_part *parts;
+	// the whole body
+	uint64_t len;
+};
+
+struct uwsgi_byteranges *uwsgi_byteranges_new(struct uwsgi_http_range *, int, uint64_t, char *, uint16_t);
+void uwsgi_byteranges_destroy(struct uwsgi_byteranges *);
+int uwsgi_response_add_byteranges_headers(struct wsgi_request *, struct uwsgi_byteranges *);
+int uwsgi_response_byteranges_do(struct wsgi_request *, int, struct uwsgi_byteranges *, int);
 int uwsgi_response_add_expires(struct wsgi_request *, uint64_t);
 int uwsgi_response_add_last_modified(struct wsgi_request *, uint64_t);
 int uwsgi_response_add_date(struct wsgi_request *, char *, uint16_t, uint64_t);
@@ -4543,6 +5659,11 @@ void uwsgi_master_manage_udp(int);
 void uwsgi_threaded_logger_spawn(void);
 
 void uwsgi_master_check_idle(void);
+void uwsgi_master_report_activity(void);
+void uwsgi_master_report_zerg_load(void);
+void uwsgi_master_memory_pressure_init(void);
+void uwsgi_master_check_memory_pressure(void);
+void uwsgi_worker_check_memory_pressure(void);
 int uwsgi_master_check_workers_deadline(void);
 int uwsgi_master_check_gateways_deadline(void);
 int uwsgi_master_check_mules_deadline(void);
@@ -4561,6 +5682,10 @@ void uwsgi_master_check_chain(void);
 
 void uwsgi_master_fix_request_counters(void);
 int uwsgi_master_manage_events(int);
+void uwsgi_master_watch_pid(pid_t);
+void uwsgi_master_watch_pids_start(void);
+void uwsgi_master_watch_pids_close(void);
+int uwsgi_master_manage_pidfd(int);
 
 void uwsgi_block_signal(int);
 void uwsgi_unblock_signal(int);
@@ -4568,6 +5693,7 @@ void uwsgi_unblock_signal(int);
 int uwsgi_worker_is_busy(int);
 
 void uwsgi_post_accept(struct wsgi_request *);
+int uwsgi_accept_batch(void);
 void uwsgi_tcp_nodelay(int);
 
 struct uwsgi_exception_handler_instance;
@@ -4592,6 +5718,10 @@ struct uwsgi_exception_handler *uwsgi_exception_handler_by_name(char *);
 void uwsgi_manage_exception(struct wsgi_request *, int);
 int uwsgi_exceptions_catch(struct wsgi_request *);
 uint64_t uwsgi_worker_exceptions(int);
+uint64_t uwsgi_worker_delta_requests(int);
+uint64_t uwsgi_master_next_harakiri(void);
+int uwsgi_master_check_workers_harakiri(void);
+void uwsgi_worker_harakiri_bound(int, uint64_t);
 struct uwsgi_exception_handler *uwsgi_register_exception_handler(char *, int (*)(struct uwsgi_exception_handler_instance *, char *, size_t));
 
 char *proxy1_parse(char *ptr, char *watermark, char **src, uint16_t *src_len, char **dst, uint16_t *dst_len,  char **src_port, uint16_t *src_port_len, char **dst_port, uint16_t *dst_port_len);
@@ -4620,6 +5750,7 @@ struct uwsgi_cache_magic_context {
 	uint16_t status_len;
 	char *cache;
 	uint16_t cache_len;
+	uint64_t failed;
 };
 
 char *uwsgi_cache_magic_get(char *, uint16_t, uint64_t *, uint64_t *, char *);
@@ -4627,6 +5758,9 @@ int uwsgi_cache_magic_set(char *, uint16_t, char *, uint64_t, uint64_t, uint64_t
 int uwsgi_cache_magic_del(char *, uint16_t, char *);
 int uwsgi_cache_magic_exists(char *, uint16_t, char *);
 int uwsgi_cache_magic_clear(char *);
+int uwsgi_cache_magic_mget(uint64_t, char **, uint16_t *, char **, uint64_t *, char *);
+int uwsgi_cache_magic_mset(uint64_t, char **, uint16_t *, char **, uint64_t *, uint64_t, uint64_t, char *);
+int uwsgi_cache_magic_get_fd(char *, uint16_t, int *, uint64_t *, uint64_t *, uint64_t *, char *);
 void uwsgi_cache_magic_context_hook(char *, uint16_t, char *, uint16_t, void *);
 
 char *uwsgi_legion_scrolls(char *, uint64_t *);
@@ -4643,6 +5777,7 @@ struct uwsgi_buffer *uwsgi_zlib_decompress(char *, size_t);
 int uwsgi_gzip_fix(z_stream *, uint32_t, struct uwsgi_buffer *, size_t);
 char *uwsgi_gzip_chunk(z_stream *, uint32_t *, char *, size_t, size_t *);
 int uwsgi_gzip_prepare(z_stream *, char *, size_t, uint32_t *);
+void uwsgi_websocket_deflate_free(struct wsgi_request *);
 #endif
 
 char *uwsgi_get_cookie(struct wsgi_request *, char *, uint16_t, uint16_t *);
@@ -4651,6 +5786,7 @@ char *uwsgi_get_qs(struct wsgi_request *, char *, uint16_t, uint16_t *);
 struct uwsgi_route_var *uwsgi_get_route_var(char *, uint16_t);
 struct uwsgi_route_var *uwsgi_register_route_var(char *, char *(*)(struct wsgi_request *, char *, uint16_t, uint16_t *));
 
+void uwsgi_static_fd_cache_setup(void);
 char *uwsgi_get_mime_type(char *, int, size_t *);
 
 void config_magic_table_fill(char *, char *[]);
@@ -4701,13 +5837,23 @@ int uwsgi_master_check_cron_death(int);
 struct uwsgi_fsmon *uwsgi_register_fsmon(char *, void (*)(struct uwsgi_fsmon *), void *data);
 int uwsgi_fsmon_event(int);
 void uwsgi_fsmon_setup();
+int uwsgi_fsmon_watch_dir(int, int *, char *);
+int uwsgi_fsmon_dir_events(int, void (*)(int, char *, void *), void *);
+void uwsgi_fsmon_touches_add(struct uwsgi_string_list *);
+int uwsgi_fsmon_touch_event(int);
+int uwsgi_fsmon_touch_skip(struct uwsgi_string_list *);
+int uwsgi_master_check_touches(void);
 
 void uwsgi_exit(int) __attribute__ ((__noreturn__));
 void uwsgi_fallback_config();
 
 struct uwsgi_cache_item *uwsgi_cache_keys(struct uwsgi_cache *, uint64_t *, struct uwsgi_cache_item **);
+uint64_t uwsgi_cache_scan(struct uwsgi_cache *, uint64_t, uint64_t, char *, struct uwsgi_buffer *);
 void uwsgi_cache_rlock(struct uwsgi_cache *);
+void uwsgi_cache_wlock(struct uwsgi_cache *);
 void uwsgi_cache_rwunlock(struct uwsgi_cache *);
+struct uwsgi_lock_item *uwsgi_cache_key_lock(struct uwsgi_cache *, char *, uint16_t);
+void uwsgi_cache_counters(struct uwsgi_cache *, uint64_t *, uint64_t *, uint64_t *, uint64_t *);
 char *uwsgi_cache_item_key(struct uwsgi_cache_item *);
 
 char *uwsgi_binsh(void);
@@ -4768,10 +5914,32 @@ enum {
 	UWSGI_METRIC_GAUGE,
 	UWSGI_METRIC_ABSOLUTE,
 	UWSGI_METRIC_ALIAS,
+	UWSGI_METRIC_HISTOGRAM,
 };
 
 struct uwsgi_metric_child;
 
+#define UWSGI_METRICS_HASH_SIZE 1024
+
+// log-linear buckets: 16 linear sub-buckets for each power of two up to 2^40
+#define UWSGI_METRIC_HISTOGRAM_SUB_BITS 4
+#define UWSGI_METRIC_HISTOGRAM_MAX_BITS 40
+#define UWSGI_METRIC_HISTOGRAM_BUCKETS ((UWSGI_METRIC_HISTOGRAM_MAX_BITS - UWSGI_METRIC_HISTOGRAM_SUB_BITS + 1) << UWSGI_METRIC_HISTOGRAM_SUB_BITS)
+
+struct uwsgi_metric_histogram {
+	// shared memory: a row of buckets for each core, plus one for the other processes
+	uint64_t *buckets;
+	uint64_t slots;
+	// the last merged snapshot (private to the collector)
+	uint64_t *last;
+	// total number of samples
+	int64_t count;
+	// percentiles of the last collection interval
+	int64_t p50;
+	int64_t p99;
+	int64_t p999;
+};
+
 struct uwsgi_metric_collector {
 	char *name;
 	int64_t (*func)(struct uwsgi_metric *);
@@ -4838,7 +6006,15 @@ struct uwsgi_metric {
 	struct uwsgi_metric_child *children;
 	struct uwsgi_metric_threshold *thresholds;
 
+	// per-core deltas (for metrics updated by the application)
+	int64_t *shards;
+
+	struct uwsgi_metric_histogram *histogram;
+
         struct uwsgi_metric *next;
+	// hash index chains (by name and by oid)
+	struct uwsgi_metric *hnext;
+	struct uwsgi_metric *ohnext;
 
 	// allow to reset metrics after each push
 	uint8_t reset_after_push;
@@ -4861,6 +6037,8 @@ int64_t uwsgi_metric_get(char *, char *);
 int64_t uwsgi_metric_getn(char *, size_t, char *, size_t);
 int uwsgi_metric_set_max(char *, char *, int64_t);
 int uwsgi_metric_set_min(char *, char *, int64_t);
+struct uwsgi_metric *uwsgi_register_metric_histogram(char *, char *, int);
+void uwsgi_metric_histogram_add(struct uwsgi_metric *, struct wsgi_request *, uint64_t);
 
 struct uwsgi_metric_collector *uwsgi_register_metric_collector(char *, int64_t (*)(struct uwsgi_metric *));
 struct uwsgi_metric *uwsgi_register_metric(char *, char *, uint8_t, char *, void *, uint32_t, void *);
@@ -4879,6 +6057,7 @@ int uwsgi_base128(struct uwsgi_buffer *, uint64_t, int);
 struct wsgi_request *find_wsgi_req_proto_by_fd(int);
 
 struct uwsgi_protocol *uwsgi_register_protocol(char *, void (*)(struct uwsgi_socket *));
+void uwsgi_socket_setup_protocol(struct uwsgi_socket *, char *);
 
 void uwsgi_protocols_register(void);
 
@@ -4886,11 +6065,16 @@ void uwsgi_build_plugin(char *dir);
 
 void uwsgi_sharedareas_init();
 
+void uwsgi_ratelimits_init(void);
+struct uwsgi_ratelimit *uwsgi_ratelimit_get(char *);
+int uwsgi_ratelimit_acquire(struct uwsgi_ratelimit *, char *, uint16_t, uint64_t *);
+
 struct uwsgi_sharedarea *uwsgi_sharedarea_init(int);
 struct uwsgi_sharedarea *uwsgi_sharedarea_init_ptr(char *, uint64_t);
 struct uwsgi_sharedarea *uwsgi_sharedarea_init_fd(int, uint64_t, off_t);
 
 int64_t uwsgi_sharedarea_read(int, uint64_t, char *, uint64_t);
+char *uwsgi_sharedarea_snapshot(int, uint64_t, uint64_t *, uint64_t *);
 int uwsgi_sharedarea_write(int, uint64_t, char *, uint64_t);
 int uwsgi_sharedarea_read64(int, uint64_t, int64_t *);
 int uwsgi_sharedarea_write64(int, uint64_t, int64_t *);
@@ -4908,6 +6092,16 @@ int uwsgi_sharedarea_dec8(int, uint64_t, int8_t);
 int uwsgi_sharedarea_dec16(int, uint64_t, int16_t);
 int uwsgi_sharedarea_dec32(int, uint64_t, int32_t);
 int uwsgi_sharedarea_dec64(int, uint64_t, int64_t);
+int uwsgi_sharedarea_fetch_add64(int, uint64_t, int64_t, int64_t *);
+int uwsgi_sharedarea_xchg64(int, uint64_t, int64_t, int64_t *);
+int uwsgi_sharedarea_cas64(int, uint64_t, int64_t, int64_t, int64_t *);
+int uwsgi_sharedarea_min64(int, uint64_t, int64_t, int64_t *);
+int uwsgi_sharedarea_max64(int, uint64_t, int64_t, int64_t *);
+int uwsgi_sharedarea_fetch_add32(int, uint64_t, int32_t, int32_t *);
+int uwsgi_sharedarea_xchg32(int, uint64_t, int32_t, int32_t *);
+int uwsgi_sharedarea_cas32(int, uint64_t, int32_t, int32_t, int32_t *);
+int uwsgi_sharedarea_min32(int, uint64_t, int32_t, int32_t *);
+int uwsgi_sharedarea_max32(int, uint64_t, int32_t, int32_t *);
 int uwsgi_sharedarea_wait(int, int, int);
 int uwsgi_sharedarea_unlock(int);
 int uwsgi_sharedarea_rlock(int);
@@ -4915,6 +6109,11 @@ int uwsgi_sharedarea_wlock(int);
 int uwsgi_sharedarea_update(int);
 
 struct uwsgi_sharedarea *uwsgi_sharedarea_get_by_id(int, uint64_t);
+uint64_t uwsgi_sharedheap_alloc(int, uint64_t);
+int uwsgi_sharedheap_free(int, uint64_t);
+int uwsgi_sharedheap_write(int, uint64_t, char *, uint64_t);
+int64_t uwsgi_sharedheap_read(int, uint64_t, char *, uint64_t);
+int64_t uwsgi_sharedheap_len(int, uint64_t);
 int uwsgi_websocket_send_from_sharedarea(struct wsgi_request *, int, uint64_t, uint64_t);
 int uwsgi_websocket_send_binary_from_sharedarea(struct wsgi_request *, int, uint64_t, uint64_t);
 
@@ -4941,6 +6140,11 @@ int uwsgi_send_fds_and_body(int, int *, int, char *, size_t);
 ssize_t uwsgi_recv_cred_and_fds(int, char *, size_t buf_len, pid_t *, uid_t *, gid_t *, int *, int *);
 void uwsgi_fork_server(char *);
 
+void uwsgi_zygote_start(void);
+int uwsgi_zygote_spawn(int);
+void uwsgi_zygote_reload(void);
+int uwsgi_master_check_zygote_death(int);
+
 void uwsgi_emperor_ini_attrs(char *, char *, struct uwsgi_dyn_dict **);
 
 int uwsgi_buffer_httpdate(struct uwsgi_buffer *, time_t);
@@ -4973,6 +6177,9 @@ int uwsgi_zeus_spawn_instance(struct uwsgi_instance *);
 
 time_t uwsgi_parse_http_date(char *, uint16_t);
 void uwsgi_spooler_cheap_check(void);
+struct uwsgi_spooler_engine *uwsgi_register_spooler_engine(char *, void (*)(struct uwsgi_spooler *, int));
+void uwsgi_spooler_engines_setup(void);
+void uwsgi_spooler_engine_init(struct uwsgi_spooler *);
 #ifdef __cplusplus
 }
 #endif
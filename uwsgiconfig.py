@@ -76,6 +76,7 @@ report = {
     'pcre': False,
     'routing': False,
     'capabilities': False,
+    'usdt': False,
     'yaml': False,
     'json': False,
     'ssl': False,
@@ -522,6 +523,9 @@ def build_uwsgi(uc, print_only=False, gcll=None):
         print("*** error linking uWSGI ***")
         sys.exit(1)
 
+    if uc.get('microbench'):
+        build_microbench(gcc_list, cflags, ldflags, libs)
+
     print("################# uWSGI configuration #################")
     print("")
     for report_key in report:
@@ -542,6 +546,32 @@ def build_uwsgi(uc, print_only=False, gcll=None):
         pb(uc)
 
 
+def build_microbench(gcc_list, cflags, ldflags, libs):
+    print("*** uWSGI linking microbenchmarks ***")
+    objects = []
+    for item in map(add_o, gcc_list):
+        # the core has to be rebuilt without main()
+        if item == 'core/uwsgi.o':
+            item = 't/microbench/uwsgi.o'
+            cmdline = "%s -c %s -DUWSGI_AS_SHARED_LIBRARY -o %s core/uwsgi.c" % (GCC, ' '.join(cflags), item)
+            print_compilation_output("[%s] %s" % (GCC, item), cmdline)
+            if os.system(cmdline) != 0:
+                sys.exit(1)
+        objects.append(item)
+    ldline = "%s -o t/microbench/microbench %s t/microbench/microbench.c %s %s %s" % (
+        GCC,
+        ' '.join(cflags),
+        ' '.join(uniq_warnings(ldflags)),
+        ' '.join(objects),
+        ' '.join(uniq_warnings(libs))
+    )
+    print(ldline)
+    if os.system(ldline) != 0:
+        print("*** error linking the microbenchmarks ***")
+        sys.exit(1)
+    print("*** microbenchmarks are ready, launch them with ./t/microbench/microbench ***")
+
+
 def open_profile(filename):
     if filename.startswith('http://') or filename.startswith('https://') or filename.startswith('ftp://'):
         wrapped = False
@@ -592,10 +622,10 @@ class uConf(object):
             'core/errors', 'core/hash', 'core/master_events', 'core/chunked',
             'core/queue', 'core/event', 'core/signal', 'core/strings',
             'core/progress', 'core/timebomb', 'core/ini', 'core/fsmon',
-            'core/mount', 'core/metrics', 'core/plugins_builder',
-            'core/sharedarea', 'core/fork_server', 'core/webdav', 'core/zeus',
-            'core/rpc', 'core/gateway', 'core/loop', 'core/cookie',
-            'core/querystring', 'core/rb_timers', 'core/transformations',
+            'core/mount', 'core/metrics', 'core/openmetrics', 'core/plugins_builder',
+            'core/sharedarea', 'core/fork_server', 'core/zygote', 'core/numa', 'core/webdav', 'core/zeus',
+            'core/rpc', 'core/ratelimit', 'core/gateway', 'core/loop', 'core/cookie',
+            'core/querystring', 'core/rb_timers', 'core/transformations', 'core/resolver', 'core/taskstats',
             'core/uwsgi',
         ]
         # add protocols
@@ -888,6 +918,8 @@ class uConf(object):
 
         if event_mode == 'epoll':
             self.cflags.append('-DUWSGI_EVENT_USE_EPOLL')
+        elif event_mode == 'io_uring':
+            self.cflags.append('-DUWSGI_EVENT_USE_IO_URING')
         elif event_mode == 'kqueue':
             self.cflags.append('-DUWSGI_EVENT_USE_KQUEUE')
         elif event_mode == 'devpoll':
@@ -1036,6 +1068,10 @@ class uConf(object):
             self.libs.append('-lcap')
             report['capabilities'] = True
 
+        if self.has_include('sys/sdt.h'):
+            self.cflags.append("-DUWSGI_USDT")
+            report['usdt'] = True
+
         if self.has_include('uuid/uuid.h'):
             self.cflags.append("-DUWSGI_UUID")
             if uwsgi_os in ('Linux', 'GNU', 'GNU/kFreeBSD') or uwsgi_os.startswith('CYGWIN') or os.path.exists('/usr/lib/libuuid.so') or os.path.exists('/usr/local/lib/libuuid.so') or os.path.exists('/usr/lib64/libuuid.so') or os.path.exists('/usr/local/lib64/libuuid.so'):
@@ -1505,6 +1541,7 @@ if __name__ == "__main__":
     parser.add_option("-u", "--unbit", action="store_true", dest="unbit", help="build unbit profile")
     parser.add_option("-p", "--plugin", action="callback", callback=vararg_callback, dest="plugin", help="build a plugin as shared library, optionally takes a build profile name", metavar="PLUGIN [PROFILE]")
     parser.add_option("-x", "--extra-plugin", action="callback", callback=vararg_callback,  dest="extra_plugin", help="build an external plugin as shared library, takes an optional include dir", metavar="PLUGIN [NAME]")
+    parser.add_option("-m", "--microbench", action="callback", callback=vararg_callback, dest="microbench", help="same as --build but links the core micro benchmarks too (t/microbench)", metavar="PROFILE")
     parser.add_option("-c", "--clean", action="store_true", dest="clean", help="clean the build")
     parser.add_option("-e", "--check", action="store_true", dest="check", help="run cppcheck")
     parser.add_option("-v", "--verbose", action="store_true", dest="verbose", help="more verbose build")
@@ -1527,10 +1564,12 @@ if __name__ == "__main__":
         add_cflags.extend(['-g', '-fsanitize=address', '-fno-omit-frame-pointer'])
         add_ldflags.extend(['-g', '-fsanitize=address'])
 
-    if options.build is not None or options.cflags is not None:
+    if options.build is not None or options.cflags is not None or options.microbench is not None:
         is_cflags = options.cflags is not None
         try:
-            if not is_cflags:
+            if options.microbench is not None:
+                bconf = options.microbench[0]
+            elif not is_cflags:
                 bconf = options.build[0]
             else:
                 bconf = options.cflags[0]
@@ -1542,6 +1581,8 @@ if __name__ == "__main__":
             bconf = 'buildconf/%s' % bconf
 
         uc = uConf(bconf, is_cflags)
+        if options.microbench is not None:
+            uc.set('microbench', 'true')
         if add_cflags or add_ldflags:
             gcc_list, cflags, ldflags, libs = uc.get_gcll()
             if add_cflags:
@@ -1588,6 +1629,7 @@ if __name__ == "__main__":
         os.system("rm -f lib/*.o")
         os.system("rm -f plugins/*/*.o")
         os.system("rm -f build/*.o")
+        os.system("rm -f t/microbench/*.o t/microbench/microbench")
         os.system("rm -f core/dot_h.c")
         os.system("rm -f core/config_py.c")
     elif options.check: